@@ -0,0 +1,288 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/bit_kernels.h"
+
+#include <absl/numeric/bits.h>
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+uint64_t PopCountPortable(const uint8_t* data, size_t len) {
+  uint64_t count = 0;
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof(word));
+    count += absl::popcount(word);
+  }
+  for (; i < len; i++)
+    count += absl::popcount(data[i]);
+  return count;
+}
+
+size_t FindFirstByteNotPortable(const uint8_t* data, size_t len, uint8_t byte) {
+  const uint64_t pattern = uint64_t(byte) * 0x0101010101010101ULL;
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof(word));
+    if (word != pattern)
+      break;
+  }
+  for (; i < len; i++) {
+    if (data[i] != byte)
+      return i;
+  }
+  return len;
+}
+
+void BitOpPortable(BitOpKind op, uint8_t* dest, const uint8_t* src, size_t len) {
+  switch (op) {
+    case BitOpKind::AND:
+      for (size_t i = 0; i < len; i++)
+        dest[i] &= src[i];
+      break;
+    case BitOpKind::OR:
+      for (size_t i = 0; i < len; i++)
+        dest[i] |= src[i];
+      break;
+    case BitOpKind::XOR:
+      for (size_t i = 0; i < len; i++)
+        dest[i] ^= src[i];
+      break;
+  }
+}
+
+void MaxPortable(uint8_t* dest, const uint8_t* src, size_t len) {
+  for (size_t i = 0; i < len; i++)
+    dest[i] = max(dest[i], src[i]);
+}
+
+#if defined(__aarch64__)
+
+uint64_t PopCountNeon(const uint8_t* data, size_t len) {
+  uint64x2_t acc = vdupq_n_u64(0);
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    uint8x16_t cnt = vcntq_u8(vld1q_u8(data + i));
+    acc = vpadalq_u32(acc, vpaddlq_u16(vpaddlq_u8(cnt)));
+  }
+  return vaddvq_u64(acc) + PopCountPortable(data + i, len - i);
+}
+
+size_t FindFirstByteNotNeon(const uint8_t* data, size_t len, uint8_t byte) {
+  const uint8x16_t pattern = vdupq_n_u8(byte);
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    uint8x16_t ne = vmvnq_u8(vceqq_u8(vld1q_u8(data + i), pattern));
+    if (vmaxvq_u8(ne) != 0)
+      break;
+  }
+  return i + FindFirstByteNotPortable(data + i, len - i, byte);
+}
+
+void BitOpNeon(BitOpKind op, uint8_t* dest, const uint8_t* src, size_t len) {
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    uint8x16_t d = vld1q_u8(dest + i), s = vld1q_u8(src + i);
+    switch (op) {
+      case BitOpKind::AND:
+        d = vandq_u8(d, s);
+        break;
+      case BitOpKind::OR:
+        d = vorrq_u8(d, s);
+        break;
+      case BitOpKind::XOR:
+        d = veorq_u8(d, s);
+        break;
+    }
+    vst1q_u8(dest + i, d);
+  }
+  BitOpPortable(op, dest + i, src + i, len - i);
+}
+
+void MaxNeon(uint8_t* dest, const uint8_t* src, size_t len) {
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16)
+    vst1q_u8(dest + i, vmaxq_u8(vld1q_u8(dest + i), vld1q_u8(src + i)));
+  MaxPortable(dest + i, src + i, len - i);
+}
+
+#elif defined(__x86_64__)
+
+// Counts the bits of every nibble with a lookup table. The byte counts are at most 8 per
+// block, so up to 31 blocks are summed before they are widened to 64 bits.
+__attribute__((target("avx2"))) uint64_t PopCountAvx2(const uint8_t* data, size_t len) {
+  const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1,
+                                          1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_mask = _mm256_set1_epi8(0x0f);
+  __m256i acc = _mm256_setzero_si256();
+  size_t i = 0;
+  while (i + 32 <= len) {
+    __m256i local = _mm256_setzero_si256();
+    for (unsigned n = 0; n < 31 && i + 32 <= len; n++, i += 32) {
+      __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+      __m256i lo = _mm256_and_si256(v, low_mask);
+      __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+      local = _mm256_add_epi8(local, _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo),
+                                                     _mm256_shuffle_epi8(lookup, hi)));
+    }
+    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(local, _mm256_setzero_si256()));
+  }
+
+  uint64_t count = _mm256_extract_epi64(acc, 0) + _mm256_extract_epi64(acc, 1) +
+                   _mm256_extract_epi64(acc, 2) + _mm256_extract_epi64(acc, 3);
+  return count + PopCountPortable(data + i, len - i);
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq"))) uint64_t PopCountAvx512(const uint8_t* data,
+                                                                           size_t len) {
+  __m512i acc = _mm512_setzero_si512();
+  size_t i = 0;
+  for (; i + 64 <= len; i += 64)
+    acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(_mm512_loadu_si512(data + i)));
+  return _mm512_reduce_add_epi64(acc) + PopCountPortable(data + i, len - i);
+}
+
+__attribute__((target("avx2"))) size_t FindFirstByteNotAvx2(const uint8_t* data, size_t len,
+                                                             uint8_t byte) {
+  const __m256i pattern = _mm256_set1_epi8(char(byte));
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+    uint32_t eq = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, pattern));
+    if (eq != 0xFFFFFFFF)
+      return i + __builtin_ctz(~eq);
+  }
+  return i + FindFirstByteNotPortable(data + i, len - i, byte);
+}
+
+__attribute__((target("avx512f,avx512bw"))) size_t FindFirstByteNotAvx512(const uint8_t* data,
+                                                                          size_t len,
+                                                                          uint8_t byte) {
+  const __m512i pattern = _mm512_set1_epi8(char(byte));
+  size_t i = 0;
+  for (; i + 64 <= len; i += 64) {
+    __mmask64 ne = _mm512_cmpneq_epi8_mask(_mm512_loadu_si512(data + i), pattern);
+    if (ne != 0)
+      return i + __builtin_ctzll(ne);
+  }
+  return i + FindFirstByteNotPortable(data + i, len - i, byte);
+}
+
+__attribute__((target("avx2"))) void BitOpAvx2(BitOpKind op, uint8_t* dest, const uint8_t* src,
+                                               size_t len) {
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dest + i));
+    __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    switch (op) {
+      case BitOpKind::AND:
+        d = _mm256_and_si256(d, s);
+        break;
+      case BitOpKind::OR:
+        d = _mm256_or_si256(d, s);
+        break;
+      case BitOpKind::XOR:
+        d = _mm256_xor_si256(d, s);
+        break;
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i), d);
+  }
+  BitOpPortable(op, dest + i, src + i, len - i);
+}
+
+__attribute__((target("avx512f"))) void BitOpAvx512(BitOpKind op, uint8_t* dest,
+                                                    const uint8_t* src, size_t len) {
+  size_t i = 0;
+  for (; i + 64 <= len; i += 64) {
+    __m512i d = _mm512_loadu_si512(dest + i), s = _mm512_loadu_si512(src + i);
+    switch (op) {
+      case BitOpKind::AND:
+        d = _mm512_and_si512(d, s);
+        break;
+      case BitOpKind::OR:
+        d = _mm512_or_si512(d, s);
+        break;
+      case BitOpKind::XOR:
+        d = _mm512_xor_si512(d, s);
+        break;
+    }
+    _mm512_storeu_si512(dest + i, d);
+  }
+  BitOpPortable(op, dest + i, src + i, len - i);
+}
+
+__attribute__((target("avx2"))) void MaxAvx2(uint8_t* dest, const uint8_t* src, size_t len) {
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dest + i));
+    __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i), _mm256_max_epu8(d, s));
+  }
+  MaxPortable(dest + i, src + i, len - i);
+}
+
+#endif
+
+struct Kernels {
+  uint64_t (*pop_count)(const uint8_t* data, size_t len);
+  size_t (*find_first_byte_not)(const uint8_t* data, size_t len, uint8_t byte);
+  void (*bit_op)(BitOpKind op, uint8_t* dest, const uint8_t* src, size_t len);
+  void (*max)(uint8_t* dest, const uint8_t* src, size_t len);
+};
+
+Kernels SelectKernels() {
+  Kernels res{PopCountPortable, FindFirstByteNotPortable, BitOpPortable, MaxPortable};
+#if defined(__aarch64__)
+  res = {PopCountNeon, FindFirstByteNotNeon, BitOpNeon, MaxNeon};
+#elif defined(__x86_64__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    res = {PopCountAvx2, FindFirstByteNotAvx2, BitOpAvx2, MaxAvx2};
+  if (__builtin_cpu_supports("avx512f"))
+    res.bit_op = BitOpAvx512;
+  if (__builtin_cpu_supports("avx512bw"))
+    res.find_first_byte_not = FindFirstByteNotAvx512;
+  if (__builtin_cpu_supports("avx512vpopcntdq"))
+    res.pop_count = PopCountAvx512;
+#endif
+  return res;
+}
+
+// Chosen once for the cpu we run on.
+const Kernels kKernels = SelectKernels();
+
+}  // namespace
+
+uint64_t PopCount(const uint8_t* data, size_t len) {
+  return kKernels.pop_count(data, len);
+}
+
+size_t FindFirstByteNot(const uint8_t* data, size_t len, uint8_t byte) {
+  return kKernels.find_first_byte_not(data, len, byte);
+}
+
+void BitOpInPlace(BitOpKind op, uint8_t* dest, const uint8_t* src, size_t len) {
+  kKernels.bit_op(op, dest, src, len);
+}
+
+void MaxInPlace(uint8_t* dest, const uint8_t* src, size_t len) {
+  kKernels.max(dest, src, len);
+}
+
+}  // namespace dfly
@@ -0,0 +1,29 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace dfly {
+
+// Bulk bitmap kernels, used by the bit commands. They are selected at startup for the
+// instruction sets of the cpu.
+
+// Returns the number of set bits in the len bytes of data.
+uint64_t PopCount(const uint8_t* data, size_t len);
+
+// Returns the index of the first byte of data that differs from byte, or len if there is none.
+size_t FindFirstByteNot(const uint8_t* data, size_t len, uint8_t byte);
+
+enum class BitOpKind : uint8_t { AND, OR, XOR };
+
+// Applies dest[i] = dest[i] op src[i] to the first len bytes.
+void BitOpInPlace(BitOpKind op, uint8_t* dest, const uint8_t* src, size_t len);
+
+// Applies dest[i] = max(dest[i], src[i]) to the first len bytes.
+void MaxInPlace(uint8_t* dest, const uint8_t* src, size_t len);
+
+}  // namespace dfly
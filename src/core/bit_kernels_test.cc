@@ -0,0 +1,83 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/bit_kernels.h"
+
+#include <absl/numeric/bits.h>
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+namespace dfly {
+
+using namespace std;
+
+class BitKernelsTest : public ::testing::Test {
+ protected:
+  vector<uint8_t> RandomBytes(size_t len) {
+    vector<uint8_t> res(len);
+    for (uint8_t& b : res)
+      b = gen_();
+    return res;
+  }
+
+  mt19937 gen_{42};
+};
+
+// The lengths cover the vector widths and the scalar tails of the kernels.
+TEST_F(BitKernelsTest, PopCount) {
+  for (size_t len : {0, 1, 7, 8, 31, 32, 33, 64, 100, 1000, 31 * 32 + 5, 10000}) {
+    vector<uint8_t> data = RandomBytes(len);
+    uint64_t expected = 0;
+    for (uint8_t b : data)
+      expected += absl::popcount(b);
+    EXPECT_EQ(expected, PopCount(data.data(), len)) << len;
+
+    vector<uint8_t> ones(len, 0xff);
+    EXPECT_EQ(len * 8, PopCount(ones.data(), len)) << len;
+  }
+}
+
+TEST_F(BitKernelsTest, FindFirstByteNot) {
+  for (size_t len : {0, 1, 9, 32, 65, 200}) {
+    for (uint8_t byte : {0x00, 0xff}) {
+      vector<uint8_t> data(len, byte);
+      EXPECT_EQ(len, FindFirstByteNot(data.data(), len, byte)) << len;
+      for (size_t pos = 0; pos < len; pos++) {
+        data[pos] = byte ^ 0x10;
+        EXPECT_EQ(pos, FindFirstByteNot(data.data(), len, byte)) << len << " " << pos;
+        data[pos] = byte;
+      }
+    }
+  }
+}
+
+TEST_F(BitKernelsTest, BitOpInPlace) {
+  for (size_t len : {0, 3, 32, 64, 100, 1027}) {
+    vector<uint8_t> a = RandomBytes(len), b = RandomBytes(len);
+    for (BitOpKind op : {BitOpKind::AND, BitOpKind::OR, BitOpKind::XOR}) {
+      vector<uint8_t> dest = a;
+      BitOpInPlace(op, dest.data(), b.data(), len);
+      for (size_t i = 0; i < len; i++) {
+        uint8_t expected = op == BitOpKind::AND  ? a[i] & b[i]
+                           : op == BitOpKind::OR ? a[i] | b[i]
+                                                 : a[i] ^ b[i];
+        ASSERT_EQ(expected, dest[i]) << len << " " << i;
+      }
+    }
+  }
+}
+
+TEST_F(BitKernelsTest, MaxInPlace) {
+  for (size_t len : {0, 5, 32, 100, 16384}) {
+    vector<uint8_t> a = RandomBytes(len), b = RandomBytes(len);
+    vector<uint8_t> dest = a;
+    MaxInPlace(dest.data(), b.data(), len);
+    for (size_t i = 0; i < len; i++)
+      ASSERT_EQ(max(a[i], b[i]), dest[i]) << len << " " << i;
+  }
+}
+
+}  // namespace dfly
@@ -4,8 +4,11 @@
 
 #pragma once
 
+#include <absl/types/span.h>
+
 #include <functional>
 #include <optional>
+#include <vector>
 
 #include "base/pmr/memory_resource.h"
 #include "core/detail/bptree_internal.h"
@@ -48,6 +51,23 @@ template <typename T, typename Policy = BPTreePolicy<T>> class BPTree {
 
   bool Delete(KeyT item);
 
+  /// @brief Applies update(), which may change how item compares to the other items, to an item
+  ///        of the tree. If item still sorts between its neighbours afterwards it stays in place,
+  ///        otherwise it is moved to its new position.
+  /// @param item - must be in the tree.
+  /// @return true if the item stayed in place.
+  template <typename Cb> bool Update(KeyT item, Cb&& update);
+
+  /// @brief Replaces item with new_item that compares equal to it, i.e. a copy of it at a
+  ///        different address. Used to defragment the items.
+  /// @return true if item was found.
+  bool Replace(KeyT item, KeyT new_item);
+
+  /// @brief Builds the tree bottom-up in a single pass. Leaves and inner nodes are packed
+  ///        to the full capacity, only the last two nodes of each level may be balanced.
+  /// @param items - must be sorted and unique. The tree must be empty.
+  void FromSorted(absl::Span<const KeyT> items);
+
   std::optional<uint32_t> GetRank(KeyT item) const;
 
   size_t Height() const {
@@ -102,11 +122,21 @@ template <typename T, typename Policy = BPTreePolicy<T>> class BPTree {
   /// @param path
   void Delete(BPTreePath path);
 
+  /// @brief Moves the nodes for which pred(node) returns true to newly allocated memory.
+  ///        Used to defragment the tree, the items and the tree shape do not change.
+  /// @return the number of re-allocated nodes.
+  template <typename Pred> unsigned ReallocNodesIf(Pred&& pred);
+
  private:
   BPTreeNode* CreateNode(bool leaf);
 
   void DestroyNode(BPTreeNode* node);
 
+  // Splits a level of units into groups of at most max_group units, separated by `gap` units.
+  // Every group has at least min_group units unless there is only one group.
+  static std::vector<unsigned> PackGroups(size_t units, unsigned max_group, unsigned min_group,
+                                          unsigned gap);
+
   void InsertToFullLeaf(KeyT item, const BPTreePath& path);
 
   // Returns true if insertion was handled by rebalancing.
@@ -115,6 +145,10 @@ template <typename T, typename Policy = BPTreePolicy<T>> class BPTree {
 
   void IncreaseSubtreeCounts(const BPTreePath& path, unsigned depth, int32_t delta);
 
+  // Returns true if the terminal item of path is greater than its predecessor and less than its
+  // successor.
+  bool IsInOrder(const BPTreePath& path) const;
+
   // Charts the path towards key. Returns true if key is found.
   // In that case path->Last().first->Key(path->Last().second) == key.
   // Fills the tree path not including the key itself. In case key was not found,
@@ -206,6 +240,90 @@ template <typename T, typename Policy> bool BPTree<T, Policy>::Insert(KeyT item)
   return true;
 }
 
+template <typename T, typename Policy>
+void BPTree<T, Policy>::FromSorted(absl::Span<const KeyT> items) {
+  using Layout = detail::BPNodeLayout<T>;
+  using Comp [[maybe_unused]] = typename Policy::KeyCompareTo;
+
+  assert(root_ == nullptr);
+  if (items.empty())
+    return;
+
+  // Every level is a sequence of nodes interleaved with separators, i.e.
+  // node0, separators[0], node1, ..., separators[n-2], node[n-1].
+  std::vector<BPTreeNode*> nodes;
+  std::vector<KeyT> separators;
+
+  size_t pos = 0;
+  for (unsigned len : PackGroups(items.size(), Layout::kMaxLeafKeys, Layout::kMinLeafKeys, 1)) {
+    if (pos > 0)
+      separators.push_back(items[pos++]);
+
+    BPTreeNode* leaf = CreateNode(true);
+    for (unsigned i = 0; i < len; ++i) {
+      assert(pos == 0 || Comp()(items[pos - 1], items[pos]) < 0);
+      leaf->SetKey(i, items[pos++]);
+    }
+    leaf->num_items_ = len;
+    nodes.push_back(leaf);
+  }
+  assert(pos == items.size());
+  height_ = 1;
+
+  // Build the inner levels, a node with k keys takes k + 1 children and the separators
+  // between them. The separators between the nodes move one level up.
+  while (nodes.size() > 1) {
+    std::vector<BPTreeNode*> parents;
+    std::vector<KeyT> parent_separators;
+
+    size_t child = 0;
+    for (unsigned len : PackGroups(nodes.size(), Layout::kMaxInnerKeys + 1,
+                                   Layout::kMinInnerKeys + 1, 0)) {
+      if (child > 0)
+        parent_separators.push_back(separators[child - 1]);
+
+      BPTreeNode* node = CreateNode(false);
+      uint32_t tree_count = len - 1;
+      for (unsigned i = 0; i < len; ++i, ++child) {
+        if (i > 0)
+          node->SetKey(i - 1, separators[child - 1]);
+        node->SetChild(i, nodes[child]);
+        tree_count += nodes[child]->TreeCount();
+      }
+      node->num_items_ = len - 1;
+      node->SetTreeCount(tree_count);
+      parents.push_back(node);
+    }
+
+    nodes.swap(parents);
+    separators.swap(parent_separators);
+    height_++;
+  }
+
+  root_ = nodes.front();
+  count_ = items.size();
+}
+
+template <typename T, typename Policy>
+std::vector<unsigned> BPTree<T, Policy>::PackGroups(size_t units, unsigned max_group,
+                                                    unsigned min_group, unsigned gap) {
+  std::vector<unsigned> groups;
+  while (units > max_group) {
+    groups.push_back(max_group);
+    units -= max_group + gap;
+  }
+  groups.push_back(units);
+
+  // The last group may be underfilled, in that case we split the units of the two last groups
+  // evenly, so that both halves have at least min_group units.
+  if (groups.size() > 1 && units < min_group) {
+    unsigned total = max_group + units;
+    groups[groups.size() - 2] = total - total / 2;
+    groups.back() = total / 2;
+  }
+  return groups;
+}
+
 template <typename T, typename Policy> bool BPTree<T, Policy>::Delete(KeyT item) {
   if (!root_)
     return false;
@@ -219,6 +337,57 @@ template <typename T, typename Policy> bool BPTree<T, Policy>::Delete(KeyT item)
   return true;
 }
 
+template <typename T, typename Policy>
+bool BPTree<T, Policy>::Replace(KeyT item, KeyT new_item) {
+  BPTreePath path;
+  if (!Locate(item, &path))
+    return false;
+
+  // Every item is kept by exactly one node, either as a leaf key or as a separator.
+  auto [node, pos] = path.Last();
+  node->SetKey(pos, new_item);
+  return true;
+}
+
+template <typename T, typename Policy>
+template <typename Cb>
+bool BPTree<T, Policy>::Update(KeyT item, Cb&& update) {
+  BPTreePath path;
+  bool found = Locate(item, &path);
+  assert(found);
+  (void)found;
+
+  update();
+  if (IsInOrder(path))
+    return true;
+
+  // Delete(path) does not compare the item it removes, so the tree is valid again afterwards.
+  Delete(path);
+  bool inserted = Insert(item);
+  assert(inserted);
+  (void)inserted;
+
+  return false;
+}
+
+template <typename T, typename Policy>
+bool BPTree<T, Policy>::IsInOrder(const BPTreePath& path) const {
+  typename Policy::KeyCompareTo cmp;
+  auto [node, pos] = path.Last();
+  KeyT item = node->Key(pos);
+
+  // Usually both neighbours are in the same leaf.
+  if (node->IsLeaf() && pos > 0 && pos + 1 < node->NumItems())
+    return cmp(node->Key(pos - 1), item) < 0 && cmp(item, node->Key(pos + 1)) < 0;
+
+  BPTreePath prev = path;
+  if (prev.Prev() && cmp(prev.Terminal(), item) >= 0)
+    return false;
+
+  BPTreePath next = path;
+  return !next.Next() || cmp(item, next.Terminal()) < 0;
+}
+
 template <typename T, typename Policy>
 std::optional<uint32_t> BPTree<T, Policy>::GetRank(KeyT item) const {
   if (!root_)
@@ -462,8 +631,12 @@ template <typename T, typename Policy>
 detail::BPTreePath<T> BPTree<T, Policy>::GEQ(KeyT item) const {
   BPTreePath path;
 
-  if (!Locate(item, &path) && path.Last().second >= path.Last().first->NumItems())
-    path.Clear();
+  // If the path leads past the last key of a leaf, the next item is the separator of the closest
+  // ancestor that was not descended through its last child.
+  if (!Locate(item, &path)) {
+    while (!path.Empty() && path.Last().second >= path.Last().first->NumItems())
+      path.Pop();
+  }
 
   return path;
 }
@@ -504,7 +677,10 @@ template <typename T, typename Policy> void BPTree<T, Policy>::Delete(BPTreePath
     path.DigRight();
 
     BPTreeNode* leaf = path.Last().first;
-    assert(Comp()(leaf->Key(leaf->NumItems() - 1), node->Key(key_pos)) < 0);
+
+    // The removed item is not compared, Update() deletes items whose order has changed.
+    assert(key_pos + 1 == node->NumItems() ||
+           Comp()(leaf->Key(leaf->NumItems() - 1), node->Key(key_pos + 1)) < 0);
 
     // set a new separator.
     node->SetKey(key_pos, leaf->Key(leaf->NumItems() - 1));
@@ -560,6 +736,44 @@ template <typename T, typename Policy> void BPTree<T, Policy>::Delete(BPTreePath
   }
 }
 
+template <typename T, typename Policy>
+template <typename Pred>
+unsigned BPTree<T, Policy>::ReallocNodesIf(Pred&& pred) {
+  unsigned res = 0;
+  auto realloc_node = [&](BPTreeNode* node) {
+    if (!pred(static_cast<const void*>(node)))
+      return node;
+
+    void* ptr = mr_->allocate(detail::kBPNodeSize, 8);
+    memcpy(ptr, static_cast<const void*>(node), detail::kBPNodeSize);
+    mr_->deallocate(node, detail::kBPNodeSize, 8);
+    ++res;
+    return reinterpret_cast<BPTreeNode*>(ptr);
+  };
+
+  if (!root_)
+    return 0;
+
+  // Nodes do not point to their parents or siblings, so only the parent's slot needs updating.
+  root_ = realloc_node(root_);
+  std::vector<BPTreeNode*> inner;
+  if (!root_->IsLeaf())
+    inner.push_back(root_);
+
+  while (!inner.empty()) {
+    BPTreeNode* node = inner.back();
+    inner.pop_back();
+    for (unsigned i = 0; i <= node->NumItems(); ++i) {
+      BPTreeNode* child = realloc_node(node->Child(i));
+      node->SetChild(i, child);
+      if (!child->IsLeaf())
+        inner.push_back(child);
+    }
+  }
+
+  return res;
+}
+
 template <typename T, typename Policy> void BPTree<T, Policy>::DestroyNode(BPTreeNode* node) {
   void* ptr = node;
   mr_->deallocate(ptr, detail::kBPNodeSize, 8);
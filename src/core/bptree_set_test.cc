@@ -222,6 +222,46 @@ TEST_F(BPTreeSetTest, Delete) {
   }
 }
 
+TEST_F(BPTreeSetTest, FromSorted) {
+  for (unsigned len : {0u, 1u, 31u, 32u, 46u, 63u, 64u, 500u, 1000u, 7000u, 100000u}) {
+    vector<uint64_t> items(len);
+    for (unsigned i = 0; i < len; ++i) {
+      items[i] = i * 2;
+    }
+
+    bptree_.FromSorted(items);
+    ASSERT_EQ(len, bptree_.Size());
+    ASSERT_TRUE(Validate()) << len;
+
+    for (unsigned i = 0; i < len; ++i) {
+      ASSERT_EQ(i, bptree_.GetRank(i * 2)) << len;
+      ASSERT_EQ(i * 2, bptree_.FromRank(i).Terminal());
+    }
+
+    // The packed tree has fewer nodes than the tree built by insertions.
+    BPTree<uint64_t> inserted(&mi_alloc_);
+    for (uint64_t item : items) {
+      inserted.Insert(item);
+    }
+    ASSERT_LE(bptree_.NodeCount(), inserted.NodeCount());
+    ASSERT_LE(bptree_.Height(), inserted.Height());
+    inserted.Clear();
+
+    // The tree stays valid after modifications.
+    for (unsigned i = 0; i < len; ++i) {
+      ASSERT_TRUE(bptree_.Insert(i * 2 + 1));
+      if (i % 3 == 0) {
+        ASSERT_TRUE(bptree_.Delete(i * 2));
+      }
+    }
+    ASSERT_TRUE(Validate()) << len;
+
+    bptree_.Clear();
+    ASSERT_EQ(mi_alloc_.used(), 0u);
+    ASSERT_EQ(bptree_.NodeCount(), 0u);
+  }
+}
+
 TEST_F(BPTreeSetTest, Iterate) {
   FillTree(2);
 
@@ -275,6 +315,14 @@ TEST_F(BPTreeSetTest, Ranges) {
 
   path = bptree_.LEQ(1);
   EXPECT_TRUE(path.Empty());
+
+  // The next item of keys past the end of a leaf is stored in an inner node
+  for (uint64_t i = 3; i < 13998; i += 2) {
+    path = bptree_.GEQ(i);
+    ASSERT_FALSE(path.Empty()) << i;
+    ASSERT_EQ(i + 1, path.Terminal());
+    ASSERT_EQ((i + 1) / 2 - 1, path.Rank());
+  }
 }
 
 TEST_F(BPTreeSetTest, MemoryUsage) {
@@ -324,6 +372,100 @@ TEST_F(BPTreeSetTest, MemoryUsage) {
   LOG(INFO) << "df btree: " << double(mi_alloc.used()) / sds_vec.size() << " bytes per entry";
 }
 
+TEST_F(BPTreeSetTest, ReallocNodes) {
+  FillTree();
+  size_t used = mi_alloc_.used();
+
+  EXPECT_EQ(0u, bptree_.ReallocNodesIf([](const void*) { return false; }));
+  EXPECT_EQ(bptree_.NodeCount(), bptree_.ReallocNodesIf([](const void*) { return true; }));
+  EXPECT_EQ(used, mi_alloc_.used());
+
+  ASSERT_TRUE(Validate());
+  for (unsigned i = 0; i < kNumElems; ++i) {
+    ASSERT_EQ(i, bptree_.GetRank(i));
+  }
+}
+
+TEST_F(BPTreeSetTest, Update) {
+  struct PtrPolicy {
+    using KeyT = double*;
+
+    struct KeyCompareTo {
+      int operator()(const double* a, const double* b) const {
+        return *a < *b ? -1 : (*a > *b ? 1 : 0);
+      }
+    };
+  };
+
+  vector<double> vals(kNumElems);
+  BPTree<double*, PtrPolicy> tree(&mi_alloc_);
+  for (unsigned i = 0; i < kNumElems; ++i) {
+    vals[i] = i * 2;
+    ASSERT_TRUE(tree.Insert(&vals[i]));
+  }
+
+  // Small increments keep the items between their neighbours.
+  for (unsigned i = 0; i < kNumElems; i += 3) {
+    ASSERT_TRUE(tree.Update(&vals[i], [&] { vals[i] += 1; })) << i;
+  }
+
+  // Moves the first items past the rest.
+  for (unsigned i = 0; i < 10; ++i) {
+    ASSERT_FALSE(tree.Update(&vals[i], [&] { vals[i] += kNumElems * 3; })) << i;
+  }
+  ASSERT_TRUE(tree.Update(&vals[10], [&] { vals[10] = -1; })) << "the first item stays first";
+
+  ASSERT_EQ(kNumElems, tree.Size());
+  double prev = -2;
+  tree.Iterate(0, kNumElems - 1, [&](double* v) {
+    EXPECT_LT(prev, *v);
+    prev = *v;
+    return true;
+  });
+
+  EXPECT_EQ(0u, tree.GetRank(&vals[10]));
+  for (unsigned i = 0; i < 10; ++i) {
+    EXPECT_EQ(kNumElems - 10 + i, tree.GetRank(&vals[i]));
+  }
+  for (unsigned i = 11; i < kNumElems; ++i) {
+    ASSERT_EQ(i - 10, tree.GetRank(&vals[i]));
+  }
+}
+
+TEST_F(BPTreeSetTest, Replace) {
+  struct PtrPolicy {
+    using KeyT = double*;
+
+    struct KeyCompareTo {
+      int operator()(const double* a, const double* b) const {
+        return *a < *b ? -1 : (*a > *b ? 1 : 0);
+      }
+    };
+  };
+
+  vector<double> vals(kNumElems), copies(kNumElems);
+  BPTree<double*, PtrPolicy> tree(&mi_alloc_);
+  for (unsigned i = 0; i < kNumElems; ++i) {
+    vals[i] = copies[i] = i;
+    ASSERT_TRUE(tree.Insert(&vals[i]));
+  }
+
+  for (unsigned i = 0; i < kNumElems; ++i) {
+    ASSERT_TRUE(tree.Replace(&vals[i], &copies[i])) << i;
+  }
+  double missing = kNumElems;
+  EXPECT_FALSE(tree.Replace(&missing, &missing));
+
+  // The originals are not referenced anymore.
+  fill(vals.begin(), vals.end(), -1);
+  unsigned index = 0;
+  tree.Iterate(0, kNumElems - 1, [&](double* v) {
+    EXPECT_EQ(&copies[index++], v);
+    return true;
+  });
+  EXPECT_EQ(kNumElems, index);
+}
+
 TEST_F(BPTreeSetTest, InsertSDS) {
   vector<ZsetPolicy::KeyT> vals;
   for (unsigned i = 0; i < 256; ++i) {
@@ -463,6 +605,52 @@ static void BM_FindRandomZSL(benchmark::State& state) {
 }
 BENCHMARK(BM_FindRandomZSL)->Arg(1024)->Arg(1 << 16)->Arg(1 << 20);
 
+static void BM_GetRankBPTree(benchmark::State& state) {
+  unsigned iters = state.range(0);
+  std::vector<ZsetPolicy::KeyT> vals = GenerateRandomPairs(iters);
+  SDSTree bptree;
+  for (unsigned i = 0; i < iters; ++i) {
+    bptree.Insert(vals[i]);
+  }
+
+  unsigned i = 0;
+  while (state.KeepRunningBatch(10)) {
+    for (unsigned j = 0; j < 10; ++j) {
+      benchmark::DoNotOptimize(bptree.GetRank(vals[i]));
+      ++i;
+      if (vals.size() == i)
+        i = 0;
+    }
+  }
+  for (const auto v : vals) {
+    sdsfree(v.s);
+  }
+}
+BENCHMARK(BM_GetRankBPTree)->Arg(1024)->Arg(1 << 16)->Arg(1 << 20);
+
+// ZRANGE by rank: locate the start rank and iterate over 10 items from there.
+static void BM_IterateRankBPTree(benchmark::State& state) {
+  unsigned iters = state.range(0);
+  std::vector<ZsetPolicy::KeyT> vals = GenerateRandomPairs(iters);
+  SDSTree bptree;
+  for (unsigned i = 0; i < iters; ++i) {
+    bptree.Insert(vals[i]);
+  }
+
+  mt19937 dre(10);
+  while (state.KeepRunning()) {
+    uint32_t start = dre() % (bptree.Size() - 10);
+    bptree.Iterate(start, start + 9, [](ZsetPolicy::KeyT key) {
+      benchmark::DoNotOptimize(key);
+      return true;
+    });
+  }
+  for (const auto v : vals) {
+    sdsfree(v.s);
+  }
+}
+BENCHMARK(BM_IterateRankBPTree)->Arg(1024)->Arg(1 << 16)->Arg(1 << 20);
+
 void RegisterBPTreeBench() {
   auto* tlh = mi_heap_get_backing();
   init_zmalloc_threadlocal(tlh);
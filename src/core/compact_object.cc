@@ -5,6 +5,7 @@
 #include "core/compact_object.h"
 
 // #define XXH_INLINE_ALL
+#include <lz4.h>
 #include <xxhash.h>
 
 extern "C" {
@@ -17,6 +18,7 @@ extern "C" {
 #include "redis/zmalloc.h"  // for non-string objects.
 #include "redis/zset.h"
 }
+#include <absl/container/flat_hash_map.h>
 #include <absl/strings/str_cat.h>
 #include <absl/strings/strip.h>
 
@@ -25,7 +27,9 @@ extern "C" {
 #include "base/flags.h"
 #include "base/logging.h"
 #include "base/pod_array.h"
+#include "core/compact_string_set.h"
 #include "core/detail/bitpacking.h"
+#include "core/key_prefix_dict.h"
 #include "core/sorted_map.h"
 #include "core/string_map.h"
 #include "core/string_set.h"
@@ -59,6 +63,10 @@ inline void FreeObjSet(unsigned encoding, void* ptr, MemoryResource* mr) {
       CompactObj::DeleteMR<StringSet>(ptr);
       break;
     }
+    case kEncodingCompactSet: {
+      CompactObj::DeleteMR<CompactStringSet>(ptr);
+      break;
+    }
 
     case kEncodingIntSet:
       zfree((void*)ptr);
@@ -76,6 +84,10 @@ size_t MallocUsedSet(unsigned encoding, void* ptr) {
       StringSet* ss = (StringSet*)ptr;
       return ss->ObjMallocUsed() + ss->SetMallocUsed() + zmalloc_usable_size(ptr);
     }
+    case kEncodingCompactSet: {
+      CompactStringSet* cs = (CompactStringSet*)ptr;
+      return cs->ObjMallocUsed() + cs->SetMallocUsed() + zmalloc_usable_size(ptr);
+    }
     case kEncodingIntSet:
       return intsetBlobLen((intset*)ptr);
   }
@@ -141,24 +153,32 @@ inline void FreeObjZset(unsigned encoding, void* ptr) {
   }
 }
 
+// Re-allocates a contiguous blob of `size` bytes that was allocated with zmalloc
+// if its page is underutilized.
+// Returns pointer to the new blob and whether the re-allocation happened.
+pair<void*, bool> DefragBlob(void* ptr, size_t size, float ratio) {
+  if (!zmalloc_page_is_underutilized(ptr, ratio))
+    return {ptr, false};
+
+  void* replacement = zmalloc(size);
+  memcpy(replacement, ptr, size);
+  zfree(ptr);
+
+  return {replacement, true};
+}
+
+// Listpack is stored as a single contiguous array
+pair<void*, bool> DefragListPack(uint8_t* lp, float ratio) {
+  return DefragBlob(lp, lpBytes(lp), ratio);
+}
+
 // Iterates over allocations of internal hash data structures and re-allocates
 // them if their pages are underutilized.
 // Returns pointer to new object ptr and whether any re-allocations happened.
 pair<void*, bool> DefragHash(MemoryResource* mr, unsigned encoding, void* ptr, float ratio) {
   switch (encoding) {
-    // Listpack is stored as a single contiguous array
-    case kEncodingListPack: {
-      uint8_t* lp = (uint8_t*)ptr;
-      if (!zmalloc_page_is_underutilized(lp, ratio))
-        return {lp, false};
-
-      size_t lp_bytes = lpBytes(lp);
-      uint8_t* replacement = lpNew(lpBytes(lp));
-      memcpy(replacement, lp, lp_bytes);
-      lpFree(lp);
-
-      return {replacement, true};
-    };
+    case kEncodingListPack:
+      return DefragListPack((uint8_t*)ptr, ratio);
 
     // StringMap supports re-allocation of it's internal nodes
     case kEncodingStrMap2: {
@@ -176,6 +196,70 @@ pair<void*, bool> DefragHash(MemoryResource* mr, unsigned encoding, void* ptr, f
   };
 }
 
+pair<void*, bool> DefragSet(unsigned encoding, void* ptr, float ratio) {
+  switch (encoding) {
+    case kEncodingIntSet:
+      return DefragBlob(ptr, intsetBlobLen((intset*)ptr), ratio);
+
+    case kEncodingStrMap2: {
+      bool realloced = false;
+
+      StringSet* ss = (StringSet*)ptr;
+      for (auto it = ss->begin(); it != ss->end(); ++it)
+        realloced |= it.ReallocIfNeeded(ratio);
+
+      return {ss, realloced};
+    }
+
+    default:  // dict and CompactStringSet encodings are not defragmented.
+      return {ptr, false};
+  }
+}
+
+pair<void*, bool> DefragZSet(unsigned encoding, void* ptr, float ratio) {
+  switch (encoding) {
+    case OBJ_ENCODING_LISTPACK:
+      return DefragListPack((uint8_t*)ptr, ratio);
+
+    case OBJ_ENCODING_SKIPLIST:
+      return {ptr, ((detail::SortedMap*)ptr)->DefragIfNeeded(ratio)};
+
+    default:
+      ABSL_UNREACHABLE();
+  }
+}
+
+// Re-allocates the listpacks, or their compressed blobs, of the quicklist nodes.
+bool DefragList(quicklist* ql, float ratio) {
+  bool realloced = false;
+  for (quicklistNode* node = ql->head; node; node = node->next) {
+    size_t size = node->sz;
+    if (node->encoding == QUICKLIST_NODE_ENCODING_LZ4)
+      size = sizeof(quicklistLZ4) + ((quicklistLZ4*)node->entry)->sz;
+
+    auto [new_ptr, did] = DefragBlob(node->entry, size, ratio);
+    node->entry = (unsigned char*)new_ptr;
+    realloced |= did;
+  }
+  return realloced;
+}
+
+// Re-allocates the listpacks that hold the stream entries. Consumer groups are left as is.
+bool DefragStream(stream* s, float ratio) {
+  bool realloced = false;
+  raxIterator ri;
+  raxStart(&ri, s->rax_tree);
+  raxSeek(&ri, "^", NULL, 0);
+  while (raxNext(&ri)) {
+    auto [new_ptr, did] = DefragListPack((uint8_t*)ri.data, ratio);
+    if (did)
+      raxSetData(ri.node, ri.data = new_ptr);
+    realloced |= did;
+  }
+  raxStop(&ri);
+  return realloced;
+}
+
 inline void FreeObjStream(void* ptr) {
   freeStream((stream*)ptr);
 }
@@ -210,8 +294,18 @@ struct TL {
 
   MemoryResource* local_mr = PMR_NS::get_default_resource();
   size_t small_str_bytes;
+  size_t compressed_blobs = 0;
+  size_t compressed_bytes = 0;
+  size_t compressed_raw_bytes = 0;
   base::PODArray<uint8_t> tmp_buf;
   string tmp_str;
+  unique_ptr<KeyPrefixDict> prefix_dict;
+
+  // The shared blobs by the hashes of their strings, see SetSharedString.
+  absl::flat_hash_map<uint64_t, detail::SharedBlob*> shared_blobs;
+  size_t shared_min_size = 0;  // 0 if disabled.
+  size_t shared_bytes = 0;
+  size_t shared_refs = 0;
 };
 
 thread_local TL tl;
@@ -288,6 +382,10 @@ size_t RobjWrapper::Size() const {
           StringSet* ss = (StringSet*)inner_obj_;
           return ss->UpperBoundSize();
         }
+        case kEncodingCompactSet: {
+          CompactStringSet* cs = (CompactStringSet*)inner_obj_;
+          return cs->Size();
+        }
         default:
           LOG(FATAL) << "Unexpected encoding " << encoding_;
       };
@@ -395,17 +493,32 @@ void RobjWrapper::SetString(string_view s, MemoryResource* mr) {
 }
 
 bool RobjWrapper::DefragIfNeeded(float ratio) {
-  if (type() == OBJ_STRING) {
-    if (zmalloc_page_is_underutilized(inner_obj(), ratio)) {
+  pair<void*, bool> res{inner_obj_, false};
+  switch (type()) {
+    case OBJ_STRING:
+      if (!zmalloc_page_is_underutilized(inner_obj(), ratio))
+        return false;
       ReallocateString(tl.local_mr);
       return true;
-    }
-  } else if (type() == OBJ_HASH) {
-    auto [new_ptr, realloced] = DefragHash(tl.local_mr, encoding_, inner_obj_, ratio);
-    inner_obj_ = new_ptr;
-    return realloced;
+    case OBJ_HASH:
+      res = DefragHash(tl.local_mr, encoding_, inner_obj_, ratio);
+      break;
+    case OBJ_SET:
+      res = DefragSet(encoding_, inner_obj_, ratio);
+      break;
+    case OBJ_ZSET:
+      res = DefragZSet(encoding_, inner_obj_, ratio);
+      break;
+    case OBJ_LIST:
+      res.second = DefragList((quicklist*)inner_obj_, ratio);
+      break;
+    case OBJ_STREAM:
+      res.second = DefragStream((stream*)inner_obj_, ratio);
+      break;
   }
-  return false;
+
+  inner_obj_ = res.first;
+  return res.second;
 }
 
 int RobjWrapper::ZsetAdd(double score, sds ele, int in_flags, int* out_flags, double* newscore) {
@@ -537,6 +650,12 @@ using namespace std;
 auto CompactObj::GetStats() -> Stats {
   Stats res;
   res.small_string_bytes = tl.small_str_bytes;
+  res.compressed_blobs = tl.compressed_blobs;
+  res.compressed_bytes = tl.compressed_bytes;
+  res.compressed_raw_bytes = tl.compressed_raw_bytes;
+  res.shared_blobs = tl.shared_blobs.size();
+  res.shared_bytes = tl.shared_bytes;
+  res.shared_refs = tl.shared_refs;
 
   return res;
 }
@@ -546,6 +665,19 @@ void CompactObj::InitThreadLocal(MemoryResource* mr) {
   tl.tmp_buf = base::PODArray<uint8_t>{mr};
 }
 
+void CompactObj::EnableKeyPrefixes(bool enable) {
+  // The learned prefixes stay registered globally, the existing keys can still be decoded.
+  if (enable && !tl.prefix_dict)
+    tl.prefix_dict = make_unique<KeyPrefixDict>();
+  else if (!enable)
+    tl.prefix_dict.reset();
+}
+
+void CompactObj::EnableSharedStrings(size_t min_size) {
+  // The blobs stay in the map until their last reference is freed.
+  tl.shared_min_size = min_size;
+}
+
 CompactObj::~CompactObj() {
   if (HasAllocated()) {
     Free();
@@ -583,6 +715,15 @@ size_t CompactObj::Size() const {
       case EXTERNAL_TAG:
         raw_size = u_.ext_ptr.size;
         break;
+      case COMPRESSED_TAG:
+        raw_size = u_.compressed.raw_size;
+        break;
+      case PREFIX_TAG:
+        raw_size = KeyPrefixDict::Get(u_.prefixed.prefix_id).size() + u_.prefixed.suffix_len;
+        break;
+      case SHARED_TAG:
+        raw_size = u_.shared->size;
+        break;
       case ROBJ_TAG:
         raw_size = u_.r_obj.Size();
         break;
@@ -622,6 +763,17 @@ uint64_t CompactObj::HashCode() const {
       absl::AlphaNum an(u_.ival);
       return XXH3_64bits_withSeed(an.data(), an.size(), kHashSeed);
     }
+    case COMPRESSED_TAG:
+      GetString(&tl.tmp_str);
+      return XXH3_64bits_withSeed(tl.tmp_str.data(), tl.tmp_str.size(), kHashSeed);
+    case PREFIX_TAG: {
+      char buf[KeyPrefixDict::kMaxPrefixLen + KeyPrefixDict::kMaxSuffixLen];
+      size_t len = Size();
+      GetString(buf);
+      return XXH3_64bits_withSeed(buf, len, kHashSeed);
+    }
+    case SHARED_TAG:
+      return u_.shared->hash;
   }
   // We need hash only for keys.
   LOG(DFATAL) << "Should not reach " << int(taglen_);
@@ -634,9 +786,13 @@ uint64_t CompactObj::HashCode(string_view str) {
 }
 
 unsigned CompactObj::ObjType() const {
-  if (IsInline() || taglen_ == INT_TAG || taglen_ == SMALL_TAG || taglen_ == EXTERNAL_TAG)
+  if (IsInline() || taglen_ == INT_TAG || taglen_ == SMALL_TAG || taglen_ == COMPRESSED_TAG ||
+      taglen_ == PREFIX_TAG || taglen_ == SHARED_TAG)
     return OBJ_STRING;
 
+  if (taglen_ == EXTERNAL_TAG)
+    return u_.ext_ptr.type;
+
   if (taglen_ == ROBJ_TAG)
     return u_.r_obj.type();
 
@@ -764,14 +920,15 @@ std::optional<int64_t> CompactObj::TryGetInt() const {
 
 auto CompactObj::GetJson() const -> JsonType* {
   if (ObjType() == OBJ_JSON) {
-    return u_.json_obj.json_ptr;
+    DCHECK(!IsPackedJson());
+    return IsPackedJson() ? nullptr : u_.json_obj.json_ptr;
   }
   return nullptr;
 }
 
 void CompactObj::SetJson(JsonType&& j) {
-  if (taglen_ == JSON_TAG) {                  // already json
-    DCHECK(u_.json_obj.json_ptr != nullptr);  // must be allocated
+  if (taglen_ == JSON_TAG && !IsPackedJson()) {  // already json
+    DCHECK(u_.json_obj.json_ptr != nullptr);     // must be allocated
     *u_.json_obj.json_ptr = std::move(j);
   } else {
     SetMeta(JSON_TAG);
@@ -780,6 +937,35 @@ void CompactObj::SetJson(JsonType&& j) {
   }
 }
 
+void CompactObj::SetPackedJson(const JsonType& j) {
+  vector<uint8_t> packed = PackJson(j);
+  SetPackedJson(string_view{reinterpret_cast<const char*>(packed.data()), packed.size()});
+}
+
+void CompactObj::SetPackedJson(string_view packed) {
+  DCHECK(!packed.empty());
+
+  SetMeta(JSON_TAG);
+  u_.json_obj.packed_ptr = (char*)tl.local_mr->allocate(packed.size(), kAlignSize);
+  u_.json_obj.packed_size = packed.size();
+  memcpy(u_.json_obj.packed_ptr, packed.data(), packed.size());
+}
+
+string_view CompactObj::GetPackedJson() const {
+  DCHECK(IsPackedJson());
+  return {u_.json_obj.packed_ptr, u_.json_obj.packed_size};
+}
+
+void CompactObj::UnpackJson() {
+  if (!IsPackedJson())
+    return;
+
+  // The blob was produced by PackJson, hence it is valid.
+  optional<JsonType> j = ::dfly::UnpackJson(GetPackedJson());
+  CHECK(j);
+  SetJson(std::move(*j));
+}
+
 void CompactObj::SetString(std::string_view str) {
   uint8_t mask = mask_ & ~kEncMask;
   CHECK(!IsExternal());
@@ -852,6 +1038,53 @@ void CompactObj::SetString(std::string_view str) {
   u_.r_obj.SetString(encoded, tl.local_mr);
 }
 
+void CompactObj::SetKey(string_view key) {
+  static_assert(sizeof(u_.prefixed.suffix) == KeyPrefixDict::kMaxSuffixLen);
+
+  // Shorter keys are stored inline anyway.
+  if (tl.prefix_dict && key.size() > ascii_len(kInlineLen)) {
+    if (optional<KeyPrefixDict::Match> match = tl.prefix_dict->Find(key); match) {
+      string_view suffix = key.substr(match->len);
+      SetMeta(PREFIX_TAG, mask_ & ~kEncMask);
+      u_.prefixed.prefix_id = match->id;
+      u_.prefixed.suffix_len = suffix.size();
+      memcpy(u_.prefixed.suffix, suffix.data(), suffix.size());
+      return;
+    }
+  }
+
+  SetString(key);
+}
+
+void CompactObj::SetSharedString(string_view str) {
+  if (tl.shared_min_size == 0 || str.size() < tl.shared_min_size || str.size() > UINT32_MAX) {
+    SetString(str);
+    return;
+  }
+
+  uint64_t hash = HashCode(str);
+  auto [it, inserted] = tl.shared_blobs.try_emplace(hash, nullptr);
+  if (inserted) {
+    void* ptr =
+        tl.local_mr->allocate(sizeof(detail::SharedBlob) + str.size(), alignof(detail::SharedBlob));
+    it->second = new (ptr) detail::SharedBlob{hash, 0, uint32_t(str.size())};
+    memcpy(it->second->data(), str.data(), str.size());
+    tl.shared_bytes += zmalloc_size(ptr);
+  } else if (it->second->view() != str) {
+    // A different string with the same hash, it is stored on its own.
+    SetString(str);
+    return;
+  }
+
+  detail::SharedBlob* blob = it->second;
+
+  // Referenced before SetMeta frees the current value, which may hold the same blob.
+  ++blob->refcount;
+  SetMeta(SHARED_TAG, mask_ & ~kEncMask);
+  u_.shared = blob;
+  ++tl.shared_refs;
+}
+
 string_view CompactObj::GetSlice(string* scratch) const {
   CHECK(!IsExternal());
   uint8_t is_encoded = mask_ & kEncMask;
@@ -918,6 +1151,21 @@ string_view CompactObj::GetSlice(string* scratch) const {
     return *scratch;
   }
 
+  if (taglen_ == COMPRESSED_TAG) {
+    scratch->resize(u_.compressed.raw_size);
+    DecompressTo(scratch->data());
+    return *scratch;
+  }
+
+  if (taglen_ == PREFIX_TAG) {
+    GetString(scratch);
+    return *scratch;
+  }
+
+  if (taglen_ == SHARED_TAG) {
+    return u_.shared->view();
+  }
+
   LOG(FATAL) << "Bad tag " << int(taglen_);
 
   return string_view{};
@@ -926,7 +1174,6 @@ string_view CompactObj::GetSlice(string* scratch) const {
 bool CompactObj::DefragIfNeeded(float ratio) {
   switch (taglen_) {
     case ROBJ_TAG:
-      // currently only these objet types are supported for this operation
       if (u_.r_obj.inner_obj() != nullptr) {
         return u_.r_obj.DefragIfNeeded(ratio);
       }
@@ -938,6 +1185,12 @@ bool CompactObj::DefragIfNeeded(float ratio) {
       return false;
     case EXTERNAL_TAG:
       return false;
+    case COMPRESSED_TAG:
+      // Compressed blobs are cold by definition, we do not bother moving them.
+      return false;
+    case SHARED_TAG:
+      // Other values reference the blob.
+      return false;
     default:
       // This is the case when the object is at inline_str
       return false;
@@ -946,10 +1199,11 @@ bool CompactObj::DefragIfNeeded(float ratio) {
 
 bool CompactObj::HasAllocated() const {
   if (IsRef() || taglen_ == INT_TAG || IsInline() || taglen_ == EXTERNAL_TAG ||
-      (taglen_ == ROBJ_TAG && u_.r_obj.inner_obj() == nullptr))
+      taglen_ == PREFIX_TAG || (taglen_ == ROBJ_TAG && u_.r_obj.inner_obj() == nullptr))
     return false;
 
-  DCHECK(taglen_ == ROBJ_TAG || taglen_ == SMALL_TAG || taglen_ == JSON_TAG);
+  DCHECK(taglen_ == ROBJ_TAG || taglen_ == SMALL_TAG || taglen_ == JSON_TAG ||
+         taglen_ == COMPRESSED_TAG || taglen_ == SHARED_TAG);
   return true;
 }
 
@@ -1028,12 +1282,85 @@ void CompactObj::GetString(char* dest) const {
     return;
   }
 
+  if (taglen_ == COMPRESSED_TAG) {
+    DecompressTo(dest);
+    return;
+  }
+
+  if (taglen_ == PREFIX_TAG) {
+    string_view prefix = KeyPrefixDict::Get(u_.prefixed.prefix_id);
+    memcpy(dest, prefix.data(), prefix.size());
+    memcpy(dest + prefix.size(), u_.prefixed.suffix, u_.prefixed.suffix_len);
+    return;
+  }
+
+  if (taglen_ == SHARED_TAG) {
+    memcpy(dest, u_.shared->data(), u_.shared->size);
+    return;
+  }
+
   LOG(FATAL) << "Bad tag " << int(taglen_);
 }
 
-void CompactObj::SetExternal(size_t offset, size_t sz) {
+bool CompactObj::Compress() {
+  // Compressing a shared value would copy its blob.
+  if (IsRef() || ObjType() != OBJ_STRING || !HasAllocated() || IsCompressed() || IsShared())
+    return false;
+
+  size_t malloc_used = MallocUsed();
+  size_t raw_size = Size();
+  if (raw_size > LZ4_MAX_INPUT_SIZE)
+    return false;
+
+  // Compress the original string and not its ascii packed form, which is already dense.
+  GetString(&tl.tmp_str);
+
+  int bound = LZ4_compressBound(raw_size);
+  tl.tmp_buf.resize(bound);
+  char* buf = reinterpret_cast<char*>(tl.tmp_buf.data());
+  int res = LZ4_compress_default(tl.tmp_str.data(), buf, raw_size, bound);
+
+  // Not worth paying for decompression on reads if we save less than a quarter.
+  if (res <= 0 || size_t(res) > malloc_used * 3 / 4)
+    return false;
+
+  void* ptr = tl.local_mr->allocate(res, kAlignSize);
+  memcpy(ptr, buf, res);
+
+  SetMeta(COMPRESSED_TAG, mask_ & ~kEncMask);
+  u_.compressed.ptr = reinterpret_cast<char*>(ptr);
+  u_.compressed.raw_size = raw_size;
+  u_.compressed.size = res;
+
+  ++tl.compressed_blobs;
+  tl.compressed_bytes += zmalloc_size(ptr);
+  tl.compressed_raw_bytes += raw_size;
+
+  return true;
+}
+
+void CompactObj::Decompress() {
+  DCHECK_EQ(COMPRESSED_TAG, taglen_);
+
+  tl.tmp_str.resize(u_.compressed.raw_size);
+  DecompressTo(tl.tmp_str.data());
+
+  SetMeta(0, mask_);  // Frees the compressed blob.
+  SetString(tl.tmp_str);
+}
+
+void CompactObj::DecompressTo(char* dest) const {
+  DCHECK_EQ(COMPRESSED_TAG, taglen_);
+
+  int res = LZ4_decompress_safe(u_.compressed.ptr, dest, u_.compressed.size,
+                                u_.compressed.raw_size);
+  CHECK_EQ(res, int(u_.compressed.raw_size)) << "Corrupted compressed blob";
+}
+
+void CompactObj::SetExternal(size_t offset, size_t sz, unsigned type) {
   SetMeta(EXTERNAL_TAG, mask_ & ~kEncMask);
 
+  u_.ext_ptr.type = type;
   u_.ext_ptr.page_index = offset / 4096;
   u_.ext_ptr.page_offset = offset % 4096;
   u_.ext_ptr.size = sz;
@@ -1062,10 +1389,28 @@ void CompactObj::Free() {
   } else if (taglen_ == SMALL_TAG) {
     tl.small_str_bytes -= u_.small_str.MallocUsed();
     u_.small_str.Free();
+  } else if (taglen_ == COMPRESSED_TAG) {
+    --tl.compressed_blobs;
+    tl.compressed_bytes -= zmalloc_size(u_.compressed.ptr);
+    tl.compressed_raw_bytes -= u_.compressed.raw_size;
+    tl.local_mr->deallocate(u_.compressed.ptr, u_.compressed.size, kAlignSize);
+  } else if (taglen_ == SHARED_TAG) {
+    detail::SharedBlob* blob = u_.shared;
+    --tl.shared_refs;
+    if (--blob->refcount == 0) {
+      tl.shared_blobs.erase(blob->hash);
+      tl.shared_bytes -= zmalloc_size(blob);
+      tl.local_mr->deallocate(blob, sizeof(detail::SharedBlob) + blob->size,
+                              alignof(detail::SharedBlob));
+    }
   } else if (taglen_ == JSON_TAG) {
     VLOG(1) << "Freeing JSON object";
-    u_.json_obj.json_ptr->~JsonType();
-    tl.local_mr->deallocate(u_.json_obj.json_ptr, kAlignSize);
+    if (IsPackedJson()) {
+      tl.local_mr->deallocate(u_.json_obj.packed_ptr, u_.json_obj.packed_size, kAlignSize);
+    } else {
+      u_.json_obj.json_ptr->~JsonType();
+      tl.local_mr->deallocate(u_.json_obj.json_ptr, kAlignSize);
+    }
   } else {
     LOG(FATAL) << "Unsupported tag " << int(taglen_);
   }
@@ -1073,6 +1418,43 @@ void CompactObj::Free() {
   memset(u_.inline_str, 0, kInlineLen);
 }
 
+bool CompactObj::HasMovableStringBlob() const {
+  return taglen_ == ROBJ_TAG && u_.r_obj.type() == OBJ_STRING;
+}
+
+bool CompactObj::CanFreeInSteps() const {
+  if (taglen_ != ROBJ_TAG)
+    return false;
+
+  switch (u_.r_obj.type()) {
+    case OBJ_LIST:
+      return true;
+    case OBJ_SET:
+    case OBJ_HASH:
+      return u_.r_obj.encoding() == kEncodingStrMap2;
+  }
+  return false;
+}
+
+size_t CompactObj::FreeStep(size_t max_elements) {
+  DCHECK(CanFreeInSteps());
+
+  void* inner = u_.r_obj.inner_obj();
+  switch (u_.r_obj.type()) {
+    case OBJ_LIST: {
+      quicklist* ql = static_cast<quicklist*>(inner);
+      size_t count = std::min<size_t>(ql->count, max_elements);
+      quicklistDelRange(ql, 0, count);
+      return count;
+    }
+    case OBJ_SET:
+      return static_cast<StringSet*>(inner)->ClearStep(max_elements);
+    case OBJ_HASH:
+      return static_cast<StringMap*>(inner)->ClearStep(max_elements);
+  }
+  return 0;
+}
+
 size_t CompactObj::MallocUsed() const {
   if (!HasAllocated())
     return 0;
@@ -1082,6 +1464,8 @@ size_t CompactObj::MallocUsed() const {
   }
 
   if (taglen_ == JSON_TAG) {
+    if (IsPackedJson())
+      return zmalloc_size(u_.json_obj.packed_ptr);
     DCHECK(u_.json_obj.json_ptr != nullptr);
     return zmalloc_size(u_.json_obj.json_ptr);
   }
@@ -1090,6 +1474,16 @@ size_t CompactObj::MallocUsed() const {
     return u_.small_str.MallocUsed();
   }
 
+  if (taglen_ == COMPRESSED_TAG) {
+    return zmalloc_size(u_.compressed.ptr);
+  }
+
+  // Every value is charged for the whole blob, so that its memory usage does not change when
+  // other values release the blob. Stats::shared_bytes tells the actual usage.
+  if (taglen_ == SHARED_TAG) {
+    return zmalloc_size(u_.shared);
+  }
+
   LOG(DFATAL) << "should not reach";
   return 0;
 }
@@ -1097,6 +1491,38 @@ size_t CompactObj::MallocUsed() const {
 bool CompactObj::operator==(const CompactObj& o) const {
   DCHECK(taglen_ != JSON_TAG && o.taglen_ != JSON_TAG) << "cannot use JSON type to check equal";
 
+  // The same key can be stored with different prefixes or without one, depending on the prefixes
+  // known when it was set.
+  if (taglen_ == PREFIX_TAG || o.taglen_ == PREFIX_TAG) {
+    if (taglen_ == o.taglen_ && u_.prefixed.prefix_id == o.u_.prefixed.prefix_id) {
+      return u_.prefixed.suffix_len == o.u_.prefixed.suffix_len &&
+             memcmp(u_.prefixed.suffix, o.u_.prefixed.suffix, u_.prefixed.suffix_len) == 0;
+    }
+    const CompactObj& prefixed = taglen_ == PREFIX_TAG ? *this : o;
+    const CompactObj& other = taglen_ == PREFIX_TAG ? o : *this;
+    string tmp;
+    return prefixed == other.GetSlice(&tmp);
+  }
+
+  // Only SetSharedString produces shared values, so equal strings are not always shared.
+  if (taglen_ == SHARED_TAG || o.taglen_ == SHARED_TAG) {
+    if (taglen_ == o.taglen_)
+      return u_.shared == o.u_.shared || u_.shared->view() == o.u_.shared->view();
+    const CompactObj& shared = taglen_ == SHARED_TAG ? *this : o;
+    const CompactObj& other = taglen_ == SHARED_TAG ? o : *this;
+    return other == shared.u_.shared->view();
+  }
+
+  // Values are compressed when they turn cold, so a copy may be compressed while the other is not.
+  if ((taglen_ == COMPRESSED_TAG) != (o.taglen_ == COMPRESSED_TAG)) {
+    const CompactObj& compressed = taglen_ == COMPRESSED_TAG ? *this : o;
+    const CompactObj& other = taglen_ == COMPRESSED_TAG ? o : *this;
+    if (other.ObjType() != OBJ_STRING || other.IsExternal() || other.Size() != compressed.Size())
+      return false;
+    string tmp;
+    return compressed == other.GetSlice(&tmp);
+  }
+
   uint8_t m1 = mask_ & kEncMask;
   uint8_t m2 = o.mask_ & kEncMask;
   if (m1 != m2)
@@ -1114,6 +1540,12 @@ bool CompactObj::operator==(const CompactObj& o) const {
   if (taglen_ == SMALL_TAG)
     return u_.small_str.Equal(o.u_.small_str);
 
+  // lz4 is deterministic, therefore equal strings have equal blobs.
+  if (taglen_ == COMPRESSED_TAG) {
+    return u_.compressed.size == o.u_.compressed.size &&
+           memcmp(u_.compressed.ptr, o.u_.compressed.ptr, u_.compressed.size) == 0;
+  }
+
   DCHECK(IsInline() && o.IsInline());
 
   return memcmp(u_.inline_str, o.u_.inline_str, taglen_) == 0;
@@ -1130,6 +1562,21 @@ bool CompactObj::EqualNonInline(std::string_view sv) const {
       return u_.r_obj.Equal(sv);
     case SMALL_TAG:
       return u_.small_str.Equal(sv);
+    case COMPRESSED_TAG:
+      if (sv.size() != u_.compressed.raw_size)
+        return false;
+      GetString(&tl.tmp_str);
+      return sv == tl.tmp_str;
+    case PREFIX_TAG: {
+      // The suffixes of the keys sharing a prefix differ, compare them first.
+      size_t suffix_len = u_.prefixed.suffix_len;
+      if (sv.size() < suffix_len ||
+          memcmp(sv.data() + sv.size() - suffix_len, u_.prefixed.suffix, suffix_len) != 0)
+        return false;
+      return sv.substr(0, sv.size() - suffix_len) == KeyPrefixDict::Get(u_.prefixed.prefix_id);
+    }
+    case SHARED_TAG:
+      return sv == u_.shared->view();
     default:
       break;
   }
@@ -20,6 +20,7 @@ constexpr unsigned kEncodingIntSet = 0;
 constexpr unsigned kEncodingStrMap = 1;   // for set/map encodings of strings
 constexpr unsigned kEncodingStrMap2 = 2;  // for set/map encodings of strings using DenseSet
 constexpr unsigned kEncodingListPack = 3;
+constexpr unsigned kEncodingCompactSet = 4;  // for sets of strings using CompactStringSet
 
 namespace detail {
 
@@ -88,6 +89,21 @@ class RobjWrapper {
 
 } __attribute__((packed));
 
+// Refcounted immutable string, followed by its bytes. See CompactObj::SetSharedString.
+struct SharedBlob {
+  uint64_t hash;
+  uint32_t refcount;
+  uint32_t size;
+
+  char* data() {
+    return reinterpret_cast<char*>(this + 1);
+  }
+
+  std::string_view view() {
+    return std::string_view{data(), size};
+  }
+};
+
 }  // namespace detail
 
 class CompactObj {
@@ -103,6 +119,9 @@ class CompactObj {
     ROBJ_TAG = 19,
     EXTERNAL_TAG = 20,
     JSON_TAG = 21,
+    COMPRESSED_TAG = 22,
+    PREFIX_TAG = 23,
+    SHARED_TAG = 24,
   };
 
   enum MaskBit {
@@ -118,6 +137,7 @@ class CompactObj {
     ASCII2_ENC_BIT = 0x10,
     IO_PENDING = 0x20,
     STICKY = 0x40,
+    TOUCHED = 0x80,  // Set upon access, cleared by the cold values compression pass.
   };
 
   static constexpr uint8_t kEncMask = ASCII1_ENC_BIT | ASCII2_ENC_BIT;
@@ -152,6 +172,8 @@ class CompactObj {
 
   // TODO: We don't use c++ constructs (ctor, dtor, =) in objects of U,
   // because we use memcpy here.
+  // String references can be read with Size(), GetSlice() and GetString() from other threads
+  // as long as the owning shard keeps the object read-locked.
   CompactObj AsRef() const {
     CompactObj res;
     memcpy(&res.u_, &u_, sizeof(u_));
@@ -242,6 +264,31 @@ class CompactObj {
     }
   }
 
+  bool WasTouched() const {
+    return mask_ & TOUCHED;
+  }
+
+  void SetTouched(bool t) {
+    if (t) {
+      mask_ |= TOUCHED;
+    } else {
+      mask_ &= ~TOUCHED;
+    }
+  }
+
+  // Compresses a string value with LZ4. Returns false and keeps the object intact if it is not
+  // a string or if compression does not save enough memory.
+  // The value stays transparent to readers: Size(), GetSlice() and GetString() return
+  // the original string.
+  bool Compress();
+
+  // Requires: IsCompressed() - true. Switches the value back to one of the regular encodings.
+  void Decompress();
+
+  bool IsCompressed() const {
+    return taglen_ == COMPRESSED_TAG;
+  }
+
   unsigned Encoding() const;
   unsigned ObjType() const;
 
@@ -285,6 +332,31 @@ class CompactObj {
   void SetString(std::string_view str);
   void GetString(std::string* res) const;
 
+  // Same as SetString, but stores the key as a reference to its prefix in the key prefix
+  // dictionary of the thread and its inline suffix, if the dictionary knows a prefix of the key.
+  // See KeyPrefixDict.
+  void SetKey(std::string_view key);
+
+  bool HasKeyPrefix() const {
+    return taglen_ == PREFIX_TAG;
+  }
+
+  // Enables the key prefix dictionary of the thread for SetKey.
+  static void EnableKeyPrefixes(bool enable);
+
+  // Same as SetString, but a string of at least the minimum size set by EnableSharedStrings
+  // references an immutable blob of the thread that all the values with the same content share.
+  // Writes replace the value with SetString, so a shared blob is never modified in place.
+  void SetSharedString(std::string_view str);
+
+  bool IsShared() const {
+    return taglen_ == SHARED_TAG;
+  }
+
+  // Enables SetSharedString for the strings of at least min_size bytes, 0 disables it.
+  // The existing shared values stay valid.
+  static void EnableSharedStrings(size_t min_size);
+
   // Will set this to hold OBJ_JSON, after that it is safe to call GetJson
   // NOTE: in order to avid copy which can be expensive in this case,
   // you need to move an object that created with the function JsonFromString
@@ -292,8 +364,26 @@ class CompactObj {
   void SetJson(JsonType&& j);
 
   // pre condition - the type here is OBJ_JSON and was set with SetJson
+  // Returns nullptr for packed json values, see UnpackJson().
   JsonType* GetJson() const;
 
+  // Will set this to hold OBJ_JSON in the packed encoding (see PackJson). Packed values are read
+  // with GetPackedJson and must be unpacked before GetJson can be used.
+  void SetPackedJson(const JsonType& j);
+
+  // Same as above for a value that is already packed, see PackJsonFromString.
+  void SetPackedJson(std::string_view packed);
+
+  bool IsPackedJson() const {
+    return taglen_ == JSON_TAG && u_.json_obj.packed_size > 0;
+  }
+
+  // pre condition - IsPackedJson()
+  std::string_view GetPackedJson() const;
+
+  // Converts a packed json value to the JsonType encoding. No-op for other values.
+  void UnpackJson();
+
   // dest must have at least Size() bytes available
   void GetString(char* dest) const;
 
@@ -301,7 +391,8 @@ class CompactObj {
     return taglen_ == EXTERNAL_TAG;
   }
 
-  void SetExternal(size_t offset, size_t sz);
+  // type is the type of the offloaded value, ObjType() keeps returning it.
+  void SetExternal(size_t offset, size_t sz, unsigned type);
   std::pair<size_t, size_t> GetExternalSlice() const;
 
   // In case this object a single blob, returns number of bytes allocated on heap
@@ -315,12 +406,31 @@ class CompactObj {
     return taglen_ <= kInlineLen;
   }
 
+  // Whether the value is a string blob of the thread's memory resource, that can be moved to
+  // another thread as is. Small strings live in the thread's segment allocator and compressed
+  // blobs and shared blobs are counted in thread local stats, they must be copied.
+  bool HasMovableStringBlob() const;
+
+  // Whether FreeStep can free the value in steps: lists, and sets and hashes encoded as dense
+  // sets.
+  bool CanFreeInSteps() const;
+
+  // Frees up to max_elements elements of the value, for tearing down large deleted values in
+  // steps. Returns the number of freed elements, 0 once the value is empty.
+  size_t FreeStep(size_t max_elements);
+
   static constexpr unsigned InlineLen() {
     return kInlineLen;
   }
 
   struct Stats {
     size_t small_string_bytes = 0;
+    size_t compressed_blobs = 0;
+    size_t compressed_bytes = 0;      // allocated for the compressed blobs.
+    size_t compressed_raw_bytes = 0;  // original size of the compressed strings.
+    size_t shared_blobs = 0;
+    size_t shared_bytes = 0;  // allocated for the shared blobs.
+    size_t shared_refs = 0;   // values referencing the shared blobs.
   };
 
   static Stats GetStats();
@@ -351,6 +461,9 @@ class CompactObj {
 
   bool CmpEncoded(std::string_view sv) const;
 
+  // Requires: IsCompressed() - true. dest must have at least Size() bytes available.
+  void DecompressTo(char* dest) const;
+
   void SetMeta(uint8_t taglen, uint8_t mask = 0) {
     if (HasAllocated()) {
       Free();
@@ -370,9 +483,25 @@ class CompactObj {
     uint32_t size;
   } __attribute__((packed));
 
+  struct CompressedBlob {
+    char* ptr;
+    uint32_t raw_size;  // size of the original string.
+    uint32_t size;      // size of the lz4 block.
+  } __attribute__((packed));
+
+  struct PrefixedKey {
+    uint16_t prefix_id;
+    uint8_t suffix_len;
+    char suffix[13];
+  } __attribute__((packed));
+
   struct JsonWrapper {
-    JsonType* json_ptr = nullptr;
-    size_t unneeded = 0;
+    union {
+      JsonType* json_ptr;
+      char* packed_ptr;
+    };
+    uint32_t packed_size = 0;  // 0 unless the value is packed.
+    uint32_t unneeded = 0;
   } __attribute__((packed));
 
   // My main data structure. Union of representations.
@@ -387,6 +516,9 @@ class CompactObj {
     JsonWrapper json_obj;
     int64_t ival __attribute__((packed));
     ExternalPtr ext_ptr;
+    CompressedBlob compressed;
+    PrefixedKey prefixed;
+    detail::SharedBlob* shared;
 
     U() : r_obj() {
     }
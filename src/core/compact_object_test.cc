@@ -5,6 +5,8 @@
 
 #include <absl/strings/str_cat.h>
 #include <mimalloc.h>
+#include <random>
+#include <thread>
 #include <xxhash.h>
 
 #include <jsoncons/json.hpp>
@@ -79,15 +81,25 @@ void DeallocateAtRandom(size_t steps, std::vector<void*>* ptrs) {
   }
 }
 
+// Shared by the tests and the benchmarks, which may run in the same process.
+static void InitThreadHeap() {
+  static bool initialized = false;
+  if (initialized)
+    return;
+  initialized = true;
+
+  InitRedisTables();  // to initialize server struct.
+
+  auto* tlh = mi_heap_get_backing();
+  init_zmalloc_threadlocal(tlh);
+  SmallString::InitThreadLocal(tlh);
+  CompactObj::InitThreadLocal(PMR_NS::get_default_resource());
+}
+
 class CompactObjectTest : public ::testing::Test {
  protected:
   static void SetUpTestSuite() {
-    InitRedisTables();  // to initialize server struct.
-
-    auto* tlh = mi_heap_get_backing();
-    init_zmalloc_threadlocal(tlh);
-    SmallString::InitThreadLocal(tlh);
-    CompactObj::InitThreadLocal(PMR_NS::get_default_resource());
+    InitThreadHeap();
   }
 
   static void TearDownTestSuite() {
@@ -329,6 +341,164 @@ TEST_F(CompactObjectTest, MediumString) {
   EXPECT_EQ(27463, cobj_.Size());
 }
 
+TEST_F(CompactObjectTest, SmallStringCrossThread) {
+  string s(100, 'x');
+  s[10] = '\xff';  // avoid ascii packing.
+  cobj_.SetString(s);
+  ASSERT_GT(CompactObj::GetStats().small_string_bytes, 0u);
+
+  // Small string pointers must be translatable outside of the owning thread.
+  CompactObj ref = cobj_.AsRef();
+  string res;
+  std::thread th([&] {
+    string scratch;
+    res = ref.GetSlice(&scratch);
+  });
+  th.join();
+  EXPECT_EQ(s, res);
+}
+
+TEST_F(CompactObjectTest, Compressed) {
+  string tmp;
+  for (unsigned i = 0; tmp.size() < 8000; ++i) {
+    absl::StrAppend(&tmp, "{\"id\":", i, ",\"name\":\"item\",\"tags\":[\"a\",\"b\"]}");
+  }
+
+  cobj_.SetString(tmp);
+  cobj_.SetExpire(true);
+  size_t malloc_used = cobj_.MallocUsed();
+  ASSERT_TRUE(cobj_.Compress());
+  EXPECT_TRUE(cobj_.IsCompressed());
+  EXPECT_TRUE(cobj_.HasExpire());
+  EXPECT_LT(cobj_.MallocUsed(), malloc_used / 2);
+  EXPECT_EQ(OBJ_STRING, cobj_.ObjType());
+  EXPECT_EQ(tmp.size(), cobj_.Size());
+  EXPECT_EQ(tmp, cobj_.GetSlice(&tmp_));
+  EXPECT_EQ(tmp, cobj_.ToString());
+  EXPECT_EQ(cobj_, tmp);
+  EXPECT_EQ(1u, CompactObj::GetStats().compressed_blobs);
+
+  // A compressed value equals the raw copy of the same string.
+  CompactObj raw;
+  raw.SetString(tmp);
+  EXPECT_TRUE(cobj_ == raw);
+  EXPECT_TRUE(raw == cobj_);
+  raw.SetString(tmp.substr(1));
+  EXPECT_FALSE(cobj_ == raw);
+
+  cobj_.Decompress();
+  EXPECT_FALSE(cobj_.IsCompressed());
+  EXPECT_EQ(tmp, cobj_.ToString());
+  EXPECT_EQ(0u, CompactObj::GetStats().compressed_blobs);
+
+  // Overwriting a compressed value releases the blob.
+  ASSERT_TRUE(cobj_.Compress());
+  cobj_.SetString("bar");
+  EXPECT_EQ(0u, CompactObj::GetStats().compressed_blobs);
+  EXPECT_EQ(0u, CompactObj::GetStats().compressed_bytes);
+
+  // Random data does not compress.
+  default_random_engine gen{42};
+  uniform_int_distribution<int> dist(0, 255);
+  for (char& c : tmp)
+    c = dist(gen);
+  cobj_.SetString(tmp);
+  EXPECT_FALSE(cobj_.Compress());
+  EXPECT_EQ(tmp, cobj_.ToString());
+}
+
+TEST_F(CompactObjectTest, KeyPrefixes) {
+  CompactObj::EnableKeyPrefixes(true);
+
+  // The prefix is learned from the samples of the keys sharing it.
+  vector<CompactObj> keys(1000);
+  for (size_t i = 0; i < keys.size(); ++i)
+    keys[i].SetKey(absl::StrCat("user:session:", 10000000 + i));
+  EXPECT_FALSE(keys.front().HasKeyPrefix());
+  ASSERT_TRUE(keys.back().HasKeyPrefix());
+
+  const CompactObj& key = keys.back();
+  string str = absl::StrCat("user:session:", 10000000 + keys.size() - 1);
+  EXPECT_EQ(0u, key.MallocUsed());
+  EXPECT_EQ(OBJ_STRING, key.ObjType());
+  EXPECT_EQ(str.size(), key.Size());
+  EXPECT_EQ(str, key.ToString());
+  EXPECT_EQ(str, key.GetSlice(&tmp_));
+  EXPECT_EQ(key, str);
+  EXPECT_NE(key, "user:session:10000001");
+  EXPECT_EQ(CompactObj::HashCode(str), key.HashCode());
+  EXPECT_NE(key, keys[keys.size() - 2]);
+
+  // The same key stored with and without the prefix.
+  CompactObj plain{str};
+  EXPECT_FALSE(plain.HasKeyPrefix());
+  EXPECT_EQ(key, plain);
+  EXPECT_EQ(plain, key);
+  CompactObj prefixed;
+  prefixed.SetKey(str);
+  EXPECT_EQ(key, prefixed);
+
+  // The prefixes are decoded on other threads as well.
+  CompactObj ref = key.AsRef();
+  string res;
+  std::thread th([&] { res = ref.ToString(); });
+  th.join();
+  EXPECT_EQ(str, res);
+
+  // The suffix must fit inline.
+  CompactObj long_key;
+  long_key.SetKey(absl::StrCat("user:session:", string(20, 'x')));
+  EXPECT_FALSE(long_key.HasKeyPrefix());
+
+  CompactObj::EnableKeyPrefixes(false);
+}
+
+TEST_F(CompactObjectTest, SharedStrings) {
+  string str(1000, 'x');
+  CompactObj small;
+  small.SetSharedString(str);
+  EXPECT_FALSE(small.IsShared());  // disabled.
+
+  CompactObj::EnableSharedStrings(512);
+  vector<CompactObj> values(3);
+  for (auto& v : values)
+    v.SetSharedString(str);
+  ASSERT_TRUE(values[0].IsShared());
+  EXPECT_EQ(1u, CompactObj::GetStats().shared_blobs);
+  EXPECT_EQ(3u, CompactObj::GetStats().shared_refs);
+
+  const CompactObj& value = values[0];
+  EXPECT_EQ(OBJ_STRING, value.ObjType());
+  EXPECT_EQ(str.size(), value.Size());
+  EXPECT_EQ(str, value.ToString());
+  EXPECT_EQ(str, value.GetSlice(&tmp_));
+  EXPECT_EQ(value, str);
+  EXPECT_EQ(value, values[1]);
+  EXPECT_EQ(value, small);
+  EXPECT_EQ(small, value);
+  EXPECT_EQ(CompactObj::HashCode(str), value.HashCode());
+  EXPECT_GE(value.MallocUsed(), str.size());
+  EXPECT_FALSE(values[1].Compress());
+
+  small.SetSharedString(string(100, 'x'));
+  EXPECT_FALSE(small.IsShared());  // below the minimal size.
+
+  // Overwriting a value leaves the others intact.
+  values[0].SetString("bar");
+  EXPECT_EQ(str, values[1].ToString());
+  EXPECT_EQ(2u, CompactObj::GetStats().shared_refs);
+
+  values[1].SetSharedString(str);
+  EXPECT_EQ(2u, CompactObj::GetStats().shared_refs);
+
+  values.clear();
+  EXPECT_EQ(0u, CompactObj::GetStats().shared_blobs);
+  EXPECT_EQ(0u, CompactObj::GetStats().shared_bytes);
+  EXPECT_EQ(0u, CompactObj::GetStats().shared_refs);
+
+  CompactObj::EnableSharedStrings(0);
+}
+
 TEST_F(CompactObjectTest, AsciiUtil) {
   std::string_view data{"aaaaaabb"};
   uint8_t buf[32];
@@ -554,6 +724,37 @@ TEST_F(CompactObjectTest, JsonTypeTest) {
   ASSERT_TRUE(failed_json == nullptr);
 }
 
+TEST_F(CompactObjectTest, PackedJson) {
+  std::optional<JsonType> json = JsonFromString(R"({"a":[1,2,{"b":"foo"}], "c":null, "d":1.5})");
+  ASSERT_TRUE(json.has_value());
+  string expected = json->to_string();
+
+  cobj_.SetPackedJson(*json);
+  ASSERT_EQ(OBJ_JSON, cobj_.ObjType());
+  ASSERT_TRUE(cobj_.IsPackedJson());
+  EXPECT_EQ(nullptr, cobj_.GetJson());
+  EXPECT_GT(cobj_.MallocUsed(), 0u);
+
+  std::optional<string> str = PackedJsonToString(cobj_.GetPackedJson());
+  ASSERT_TRUE(str.has_value());
+  EXPECT_EQ(expected, *str);
+
+  cobj_.UnpackJson();
+  ASSERT_EQ(OBJ_JSON, cobj_.ObjType());
+  ASSERT_FALSE(cobj_.IsPackedJson());
+  ASSERT_TRUE(cobj_.GetJson() != nullptr);
+  EXPECT_EQ(expected, cobj_.GetJson()->to_string());
+
+  std::optional<vector<uint8_t>> packed = PackJsonFromString(expected);
+  ASSERT_TRUE(packed.has_value());
+  cobj_.SetPackedJson(string_view{reinterpret_cast<const char*>(packed->data()), packed->size()});
+  ASSERT_TRUE(cobj_.IsPackedJson());
+  EXPECT_EQ(expected, PackedJsonToString(cobj_.GetPackedJson()));
+
+  EXPECT_FALSE(PackJsonFromString(R"({"a":)"));
+  EXPECT_FALSE(PackJsonFromString(""));
+}
+
 TEST_F(CompactObjectTest, JsonTypeWithPathTest) {
   std::string_view books_json =
       R"({"books":[{
@@ -658,6 +859,45 @@ TEST_F(CompactObjectTest, DefragHash) {
   }
 }
 
+TEST_F(CompactObjectTest, DefragIntSet) {
+  vector<intset*> sets(1000);
+  for (size_t i = 0; i < sets.size(); i++) {
+    intset* is = intsetNew();
+    for (int64_t j = 0; j < 30; j++) {
+      uint8_t success = 0;
+      is = intsetAdd(is, j * 1000, &success);
+    }
+    sets[i] = is;
+  }
+
+  for (size_t i = 0; i < sets.size(); i++) {
+    if (i % 10 != 0)
+      zfree(sets[i]);
+  }
+
+  intset* target = nullptr;
+  for (size_t i = 0; i < sets.size(); i += 10) {
+    if (zmalloc_page_is_underutilized(sets[i], 0.8))
+      target = sets[i];
+  }
+  CHECK_NE(target, nullptr);
+
+  cobj_.InitRobj(OBJ_SET, kEncodingIntSet, target);
+  ASSERT_TRUE(cobj_.DefragIfNeeded(0.8));
+
+  intset* is = (intset*)cobj_.RObjPtr();
+  EXPECT_NE(is, target) << "must have changed due to realloc";
+  ASSERT_EQ(intsetLen(is), 30u);
+  for (int64_t j = 0; j < 30; j++) {
+    EXPECT_TRUE(intsetFind(is, j * 1000));
+  }
+
+  for (size_t i = 0; i < sets.size(); i += 10) {
+    if (sets[i] != target)
+      zfree(sets[i]);
+  }
+}
+
 static void ascii_pack_naive(const char* ascii, size_t len, uint8_t* bin) {
   const char* end = ascii + len;
 
@@ -785,4 +1025,48 @@ static void BM_UnpackSimd(benchmark::State& state) {
 }
 BENCHMARK(BM_UnpackSimd);
 
+// Encoding of string values on SET: integers, ascii packing and raw strings by size.
+static string BenchValue(bool ascii, size_t len) {
+  string val(len, 'a');
+  if (!ascii)
+    val.back() = '\xff';
+  return val;
+}
+
+static void BM_SetString(benchmark::State& state) {
+  InitThreadHeap();
+  string val = BenchValue(state.range(0), state.range(1));
+  CompactObj cobj;
+
+  while (state.KeepRunning()) {
+    cobj.SetString(val);
+  }
+}
+BENCHMARK(BM_SetString)->ArgsProduct({{0, 1}, {8, 16, 64, 1024}});
+
+static void BM_SetIntString(benchmark::State& state) {
+  InitThreadHeap();
+  CompactObj cobj;
+  string val = "1234567890";
+
+  while (state.KeepRunning()) {
+    cobj.SetString(val);
+  }
+}
+BENCHMARK(BM_SetIntString);
+
+// Decoding of string values on GET.
+static void BM_GetString(benchmark::State& state) {
+  InitThreadHeap();
+  CompactObj cobj;
+  cobj.SetString(BenchValue(state.range(0), state.range(1)));
+  string res;
+
+  while (state.KeepRunning()) {
+    cobj.GetString(&res);
+    benchmark::DoNotOptimize(res);
+  }
+}
+BENCHMARK(BM_GetString)->ArgsProduct({{0, 1}, {8, 16, 64, 1024}});
+
 }  // namespace dfly
@@ -0,0 +1,242 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/compact_string_set.h"
+
+#include <absl/numeric/bits.h>
+
+#include <cstring>
+
+#include "core/compact_object.h"
+
+extern "C" {
+#include "redis/zmalloc.h"
+}
+
+#include "base/logging.h"
+
+using namespace std;
+
+namespace dfly {
+
+namespace {
+
+constexpr uint32_t kMinCapacity = 4;
+
+inline uint64_t HashStr(string_view str) {
+  return CompactObj::HashCode(str);
+}
+
+inline string_view ToSv(sds s) {
+  return string_view{s, sdslen(s)};
+}
+
+inline size_t SdsAllocSize(sds s) {
+  return zmalloc_usable_size(sdsAllocPtr(s));
+}
+
+}  // namespace
+
+CompactStringSet::~CompactStringSet() {
+  Clear();
+}
+
+bool CompactStringSet::Add(string_view str) {
+  uint64_t hash = HashStr(str);
+  if (FindSlot(str, hash) >= 0)
+    return false;
+
+  InsertUnique(sdsnewlen(str.data(), str.size()), hash);
+  return true;
+}
+
+unsigned CompactStringSet::AddMany(absl::Span<const string_view> span) {
+  Reserve(size_ + span.size());
+
+  unsigned res = 0;
+  for (string_view str : span) {
+    res += Add(str);
+  }
+  return res;
+}
+
+bool CompactStringSet::AddSds(sds s) {
+  string_view str = ToSv(s);
+  uint64_t hash = HashStr(str);
+  if (FindSlot(str, hash) >= 0)
+    return false;
+
+  InsertUnique(s, hash);
+  return true;
+}
+
+bool CompactStringSet::Erase(string_view str) {
+  int64_t pos = FindSlot(str, HashStr(str));
+  if (pos < 0)
+    return false;
+
+  FreeSlot(pos);
+
+  // Shrink tables that became mostly empty.
+  if (capacity_ > kMinCapacity && size_ * 8 < capacity_)
+    Resize(size_);
+  return true;
+}
+
+bool CompactStringSet::Contains(string_view str) const {
+  return FindSlot(str, HashStr(str)) >= 0;
+}
+
+optional<string> CompactStringSet::Pop() {
+  for (uint32_t i = 0; i < capacity_; ++i) {
+    if (IsOccupied(slots_[i])) {
+      sds s = ToSds(slots_[i]);
+      string res{s, sdslen(s)};
+      FreeSlot(i);
+      return res;
+    }
+  }
+  return nullopt;
+}
+
+void CompactStringSet::Clear() {
+  for (uint32_t i = 0; i < capacity_; ++i) {
+    if (IsOccupied(slots_[i]))
+      sdsfree(ToSds(slots_[i]));
+  }
+
+  if (slots_)
+    mr_->deallocate(slots_, capacity_ * sizeof(uint64_t), alignof(uint64_t));
+
+  slots_ = nullptr;
+  capacity_ = capacity_log_ = size_ = tombstones_ = 0;
+  obj_malloc_used_ = 0;
+}
+
+void CompactStringSet::Reserve(size_t sz) {
+  if (sz * 4 > size_t(capacity_) * 3)
+    Resize(sz);
+}
+
+uint32_t CompactStringSet::Scan(uint32_t cursor, const std::function<void(sds)>& cb) const {
+  if (size_ == 0)
+    return 0;
+
+  const uint32_t mask = capacity_ - 1;
+
+  // The members of a home slot reside in the run of non-empty slots starting at it.
+  for (uint32_t home = cursor >> (32 - capacity_log_); home < capacity_; ++home) {
+    bool found = false;
+    for (uint32_t i = home; slots_[i] != kEmpty; i = (i + 1) & mask) {
+      if (!IsOccupied(slots_[i]))
+        continue;
+
+      sds s = ToSds(slots_[i]);
+      if (HomeSlot(HashStr(ToSv(s))) == home) {
+        cb(s);
+        found = true;
+      }
+    }
+
+    if (found)
+      return home + 1 == capacity_ ? 0 : (home + 1) << (32 - capacity_log_);
+  }
+
+  return 0;
+}
+
+int64_t CompactStringSet::FindSlot(string_view str, uint64_t hash) const {
+  if (size_ == 0)
+    return -1;
+
+  const uint64_t fp = Fingerprint(hash);
+  const uint32_t mask = capacity_ - 1;
+
+  // The load factor guarantees that the table has empty slots, so the probing terminates.
+  for (uint32_t i = HomeSlot(hash);; i = (i + 1) & mask) {
+    uint64_t slot = slots_[i];
+    if (slot == kEmpty)
+      return -1;
+
+    if ((slot & ~kPtrMask) == fp && IsOccupied(slot) && ToSv(ToSds(slot)) == str)
+      return i;
+  }
+}
+
+void CompactStringSet::InsertUnique(sds s, uint64_t hash) {
+  uint64_t ptr = reinterpret_cast<uint64_t>(s);
+  DCHECK_EQ(ptr & ~kPtrMask, 0u);
+
+  // Keep the load factor, including the tombstones, below 3/4.
+  if ((size_ + tombstones_ + 1) * 4 > capacity_ * 3)
+    Resize(size_ + 1);
+
+  const uint32_t mask = capacity_ - 1;
+  uint32_t i = HomeSlot(hash);
+  while (IsOccupied(slots_[i]))
+    i = (i + 1) & mask;
+
+  if (slots_[i] == kTombstone)
+    --tombstones_;
+
+  slots_[i] = Fingerprint(hash) | ptr;
+  ++size_;
+  obj_malloc_used_ += SdsAllocSize(s);
+}
+
+void CompactStringSet::FreeSlot(uint32_t i) {
+  DCHECK(IsOccupied(slots_[i]));
+
+  sds s = ToSds(slots_[i]);
+  obj_malloc_used_ -= SdsAllocSize(s);
+  sdsfree(s);
+  --size_;
+
+  const uint32_t mask = capacity_ - 1;
+  if (slots_[(i + 1) & mask] != kEmpty) {
+    slots_[i] = kTombstone;
+    ++tombstones_;
+    return;
+  }
+
+  // No probe sequence continues past i, so it and the tombstones preceding it become empty.
+  slots_[i] = kEmpty;
+  for (uint32_t j = (i - 1) & mask; slots_[j] == kTombstone; j = (j - 1) & mask) {
+    slots_[j] = kEmpty;
+    --tombstones_;
+  }
+}
+
+void CompactStringSet::Resize(size_t sz) {
+  uint32_t capacity = kMinCapacity;
+  while (size_t(capacity) * 3 < sz * 4)
+    capacity *= 2;
+
+  uint64_t* old_slots = slots_;
+  uint32_t old_capacity = capacity_;
+
+  slots_ = static_cast<uint64_t*>(
+      mr_->allocate(capacity * sizeof(uint64_t), alignof(uint64_t)));
+  memset(slots_, 0, capacity * sizeof(uint64_t));
+  capacity_ = capacity;
+  capacity_log_ = absl::countr_zero(capacity);
+  tombstones_ = 0;
+
+  // The fingerprints do not keep the bits of the home slot, hence the members are rehashed.
+  const uint32_t mask = capacity_ - 1;
+  for (uint32_t i = 0; i < old_capacity; ++i) {
+    if (!IsOccupied(old_slots[i]))
+      continue;
+
+    uint32_t j = HomeSlot(HashStr(ToSv(ToSds(old_slots[i]))));
+    while (slots_[j] != kEmpty)
+      j = (j + 1) & mask;
+    slots_[j] = old_slots[i];
+  }
+
+  if (old_slots)
+    mr_->deallocate(old_slots, old_capacity * sizeof(uint64_t), alignof(uint64_t));
+}
+
+}  // namespace dfly
@@ -0,0 +1,176 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include <absl/types/span.h>
+
+#include "base/pmr/memory_resource.h"
+
+extern "C" {
+#include "redis/sds.h"
+}
+
+namespace dfly {
+
+// Open-addressing set of strings, designed for small and medium sized sets.
+// Every slot holds an sds pointer tagged with a 16 bit fingerprint of the member hash in its
+// upper bits. Lookups probe linearly from the home slot and compare the strings only if the
+// fingerprints match, so usually they touch a single cache line of the table. Compared to
+// StringSet it does not allocate chain links, but it does not support member expiry either.
+class CompactStringSet {
+ public:
+  using MemoryResource = PMR_NS::memory_resource;
+
+  explicit CompactStringSet(MemoryResource* mr = PMR_NS::get_default_resource()) : mr_(mr) {
+  }
+
+  ~CompactStringSet();
+
+  CompactStringSet(const CompactStringSet&) = delete;
+  CompactStringSet& operator=(const CompactStringSet&) = delete;
+
+  // Returns true if str was added.
+  bool Add(std::string_view str);
+
+  // Adds all the elements of span and returns the number of elements that were added.
+  unsigned AddMany(absl::Span<const std::string_view> span);
+
+  // Takes ownership of s if it was added. Returns true if s was added.
+  bool AddSds(sds s);
+
+  bool Erase(std::string_view str);
+
+  bool Contains(std::string_view str) const;
+
+  std::optional<std::string> Pop();
+
+  void Clear();
+
+  void Reserve(size_t sz);
+
+  // Same cursor semantics as DenseSet::Scan: the home slot is taken from the upper bits of
+  // the hash, so the cursor remains valid when the table is resized.
+  uint32_t Scan(uint32_t cursor, const std::function<void(sds)>& cb) const;
+
+  size_t Size() const {
+    return size_;
+  }
+
+  bool Empty() const {
+    return size_ == 0;
+  }
+
+  // Memory used by the members.
+  size_t ObjMallocUsed() const {
+    return obj_malloc_used_;
+  }
+
+  // Memory used by the slots table.
+  size_t SetMallocUsed() const {
+    return size_t(capacity_) * sizeof(uint64_t);
+  }
+
+  class iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = sds;
+    using difference_type = std::ptrdiff_t;
+    using pointer = sds*;
+    using reference = sds&;
+
+    iterator() = default;
+
+    iterator& operator++() {
+      ++curr_;
+      SkipFree();
+      return *this;
+    }
+
+    value_type operator*() const {
+      return ToSds(*curr_);
+    }
+
+    bool operator==(const iterator& o) const {
+      return curr_ == o.curr_;
+    }
+
+    bool operator!=(const iterator& o) const {
+      return curr_ != o.curr_;
+    }
+
+   private:
+    friend class CompactStringSet;
+
+    iterator(const uint64_t* curr, const uint64_t* end) : curr_(curr), end_(end) {
+      SkipFree();
+    }
+
+    void SkipFree() {
+      while (curr_ != end_ && !IsOccupied(*curr_))
+        ++curr_;
+    }
+
+    const uint64_t* curr_ = nullptr;
+    const uint64_t* end_ = nullptr;
+  };
+
+  iterator begin() const {
+    return iterator{slots_, slots_ + capacity_};
+  }
+
+  iterator end() const {
+    return iterator{slots_ + capacity_, slots_ + capacity_};
+  }
+
+ private:
+  static constexpr uint64_t kEmpty = 0;
+  static constexpr uint64_t kTombstone = 1;
+  static constexpr uint64_t kPtrMask = (1ULL << 48) - 1;
+
+  static bool IsOccupied(uint64_t slot) {
+    return slot > kTombstone;
+  }
+
+  static sds ToSds(uint64_t slot) {
+    return reinterpret_cast<sds>(slot & kPtrMask);
+  }
+
+  static uint64_t Fingerprint(uint64_t hash) {
+    return hash << 48;
+  }
+
+  uint32_t HomeSlot(uint64_t hash) const {
+    return hash >> (64 - capacity_log_);
+  }
+
+  // Returns the index of the slot holding str or -1 if str is not in the set.
+  int64_t FindSlot(std::string_view str, uint64_t hash) const;
+
+  // Inserts s that is known to be absent from the set.
+  void InsertUnique(sds s, uint64_t hash);
+
+  // Frees the member at slot index i.
+  void FreeSlot(uint32_t i);
+
+  // Reallocates the table to fit sz members and drops the tombstones.
+  void Resize(size_t sz);
+
+  MemoryResource* mr_;
+  uint64_t* slots_ = nullptr;
+  uint32_t capacity_ = 0;  // 0 or a power of 2.
+  uint32_t capacity_log_ = 0;
+  uint32_t size_ = 0;
+  uint32_t tombstones_ = 0;
+  size_t obj_malloc_used_ = 0;
+};
+
+}  // namespace dfly
@@ -0,0 +1,171 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/compact_string_set.h"
+
+#include <absl/strings/str_cat.h>
+#include <gtest/gtest.h>
+#include <mimalloc.h>
+
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "glog/logging.h"
+
+extern "C" {
+#include "redis/zmalloc.h"
+}
+
+namespace dfly {
+
+using namespace std;
+using absl::StrCat;
+
+class CompactStringSetTest : public ::testing::Test {
+ protected:
+  static void SetUpTestSuite() {
+    auto* tlh = mi_heap_get_backing();
+    init_zmalloc_threadlocal(tlh);
+  }
+
+  void TearDown() override {
+    cs_.Clear();
+    EXPECT_EQ(zmalloc_used_memory_tl, 0);
+  }
+
+  CompactStringSet cs_;
+};
+
+TEST_F(CompactStringSetTest, Basic) {
+  EXPECT_TRUE(cs_.Empty());
+  EXPECT_FALSE(cs_.Contains("foo"));
+  EXPECT_FALSE(cs_.Erase("foo"));
+
+  EXPECT_TRUE(cs_.Add("foo"));
+  EXPECT_TRUE(cs_.Add("bar"));
+  EXPECT_TRUE(cs_.Add(""));
+  EXPECT_FALSE(cs_.Add("foo"));
+  EXPECT_EQ(3u, cs_.Size());
+
+  EXPECT_TRUE(cs_.Contains("foo"));
+  EXPECT_TRUE(cs_.Contains(""));
+  EXPECT_FALSE(cs_.Contains("fo"));
+
+  EXPECT_TRUE(cs_.Erase("foo"));
+  EXPECT_FALSE(cs_.Contains("foo"));
+  EXPECT_EQ(2u, cs_.Size());
+
+  sds s = sdsnew("bar");
+  EXPECT_FALSE(cs_.AddSds(s));
+  sdsfree(s);
+  EXPECT_TRUE(cs_.AddSds(sdsnew("baz")));
+  EXPECT_TRUE(cs_.Contains("baz"));
+}
+
+TEST_F(CompactStringSetTest, AddMany) {
+  vector<string> strs;
+  for (unsigned i = 0; i < 100; ++i) {
+    strs.push_back(StrCat("member", i));
+  }
+
+  vector<string_view> batch(strs.begin(), strs.end());
+  batch.push_back(strs[0]);
+  EXPECT_EQ(100u, cs_.AddMany(absl::MakeSpan(batch)));
+  EXPECT_EQ(0u, cs_.AddMany(absl::MakeSpan(batch)));
+  EXPECT_EQ(100u, cs_.Size());
+  for (const auto& s : strs) {
+    ASSERT_TRUE(cs_.Contains(s));
+  }
+}
+
+TEST_F(CompactStringSetTest, IterateAndPop) {
+  unordered_set<string> expected;
+  for (unsigned i = 0; i < 300; ++i) {
+    expected.insert(StrCat(i));
+    cs_.Add(StrCat(i));
+  }
+
+  unordered_set<string> seen;
+  for (sds s : cs_) {
+    EXPECT_TRUE(seen.emplace(s, sdslen(s)).second);
+  }
+  EXPECT_EQ(expected, seen);
+
+  seen.clear();
+  while (auto res = cs_.Pop()) {
+    EXPECT_TRUE(seen.insert(*res).second);
+  }
+  EXPECT_EQ(expected, seen);
+  EXPECT_TRUE(cs_.Empty());
+  EXPECT_TRUE(cs_.begin() == cs_.end());
+}
+
+TEST_F(CompactStringSetTest, Scan) {
+  unordered_set<string> expected;
+  for (unsigned i = 0; i < 100; ++i) {
+    expected.insert(StrCat("member", i));
+    cs_.Add(StrCat("member", i));
+  }
+
+  // The members that exist during the whole scan are returned even if the table grows.
+  unordered_set<string> seen;
+  uint32_t cursor = 0;
+  unsigned added = 0;
+  do {
+    cursor = cs_.Scan(cursor, [&](sds s) { seen.emplace(s, sdslen(s)); });
+    for (unsigned i = 0; i < 10 && added < 400; ++i) {
+      cs_.Add(StrCat("added", added++));
+    }
+  } while (cursor);
+
+  for (const auto& s : expected) {
+    EXPECT_TRUE(seen.count(s)) << s;
+  }
+}
+
+TEST_F(CompactStringSetTest, MemoryUsage) {
+  EXPECT_EQ(0u, cs_.SetMallocUsed());
+
+  for (unsigned i = 0; i < 500; ++i) {
+    cs_.Add(StrCat("member", i));
+  }
+  EXPECT_GE(cs_.SetMallocUsed(), 500 * sizeof(uint64_t));
+  EXPECT_EQ(size_t(zmalloc_used_memory_tl), cs_.ObjMallocUsed());
+
+  // The table shrinks back when most of its members are removed.
+  size_t table_size = cs_.SetMallocUsed();
+  for (unsigned i = 0; i < 490; ++i) {
+    ASSERT_TRUE(cs_.Erase(StrCat("member", i)));
+  }
+  EXPECT_LT(cs_.SetMallocUsed(), table_size / 8);
+  EXPECT_EQ(size_t(zmalloc_used_memory_tl), cs_.ObjMallocUsed());
+}
+
+TEST_F(CompactStringSetTest, Random) {
+  mt19937 gen(0);
+  unordered_set<string> expected;
+
+  for (unsigned i = 0; i < 100000; ++i) {
+    string member = StrCat(gen() % 600);
+    switch (gen() % 3) {
+      case 0:
+        ASSERT_EQ(expected.insert(member).second, cs_.Add(member));
+        break;
+      case 1:
+        ASSERT_EQ(expected.erase(member) > 0, cs_.Erase(member));
+        break;
+      default:
+        ASSERT_EQ(expected.count(member) > 0, cs_.Contains(member));
+    }
+    ASSERT_EQ(expected.size(), cs_.Size());
+  }
+
+  for (const auto& s : expected) {
+    ASSERT_TRUE(cs_.Contains(s));
+  }
+}
+
+}  // namespace dfly
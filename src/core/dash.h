@@ -3,6 +3,7 @@
 //
 #pragma once
 
+#include <type_traits>
 #include <vector>
 
 #include "base/pmr/memory_resource.h"
@@ -18,6 +19,12 @@ struct BasicDashPolicy {
   enum { kSlotNum = 12, kBucketNum = 64, kStashBucketNum = 2 };
   static constexpr bool kUseVersion = false;
 
+  // Number of 64-byte blocks of the bloom filter of every segment, 0 disables the filter.
+  // The filter answers most lookups of missing keys with a single cache line access instead of
+  // probing the buckets. About 10 bits per slot of the segment keep the false positive rate at
+  // a few percent. Optional for the policies, see detail::FilterBlocks.
+  static constexpr unsigned kFilterBlocks = 0;
+
   template <typename U> static void DestroyValue(const U&) {
   }
   template <typename U> static void DestroyKey(const U&) {
@@ -28,6 +35,19 @@ struct BasicDashPolicy {
   }
 };
 
+namespace detail {
+
+template <typename Policy, typename = void> struct FilterBlocks {
+  static constexpr unsigned value = 0;
+};
+
+template <typename Policy>
+struct FilterBlocks<Policy, std::void_t<decltype(Policy::kFilterBlocks)>> {
+  static constexpr unsigned value = Policy::kFilterBlocks;
+};
+
+}  // namespace detail
+
 template <typename _Key, typename _Value, typename Policy>
 class DashTable : public detail::DashTableBase {
   DashTable(const DashTable&) = delete;
@@ -38,6 +58,7 @@ class DashTable : public detail::DashTableBase {
     static constexpr unsigned BUCKET_CNT = Policy::kBucketNum;
     static constexpr unsigned STASH_BUCKET_NUM = Policy::kStashBucketNum;
     static constexpr bool USE_VERSION = Policy::kUseVersion;
+    static constexpr unsigned FILTER_BLOCKS = detail::FilterBlocks<Policy>::value;
   };
 
   using Base = detail::DashTableBase;
@@ -130,6 +151,7 @@ class DashTable : public detail::DashTableBase {
             PMR_NS::memory_resource* mr = PMR_NS::get_default_resource());
   ~DashTable();
 
+  // Splits the segments ahead of time so that the table holds size entries without splitting.
   void Reserve(size_t size);
 
   // false for duplicate, true if inserted.
@@ -157,8 +179,26 @@ class DashTable : public detail::DashTableBase {
         .first;
   }
 
-  template <typename U> const_iterator Find(U&& key) const;
-  template <typename U> iterator Find(U&& key);
+  template <typename U> const_iterator Find(U&& key) const {
+    return Find(std::forward<U>(key), DoHash(key));
+  }
+  template <typename U> iterator Find(U&& key) {
+    return Find(std::forward<U>(key), DoHash(key));
+  }
+
+  // Same as above with the hash of the key computed by the caller, key_hash must be DoHash(key).
+  template <typename U> const_iterator Find(U&& key, uint64_t key_hash) const;
+  template <typename U> iterator Find(U&& key, uint64_t key_hash);
+
+  // Finds count keys at once. First hashes a window of keys and prefetches their buckets,
+  // then resolves them, so that the memory stalls of the individual lookups overlap.
+  // dest[i] is set to the result of Find(keys[i]).
+  template <typename U> void FindBatch(const U* keys, size_t count, const_iterator* dest) const;
+
+  // Prefetches the segment and the buckets that may host the key with hash key_hash.
+  void Prefetch(uint64_t key_hash) const {
+    segment_[SegmentId(key_hash)]->Prefetch(key_hash);
+  }
 
   // it must be valid.
   void Erase(iterator it);
@@ -232,7 +272,7 @@ class DashTable : public detail::DashTableBase {
   // before returning. Unlike begin/end interface, traverse is stable during table mutations.
   // It guarantees that if key exists (1)at the beginning of traversal, (2) stays in the table
   // during the traversal, then Traverse() will eventually reach it even when the
-  // table shrinks or grows.
+  // table shrinks or grows. Segment merges may cause entries to be visited again.
   // Returns: cursor that is guaranteed to be less than 2^40.
   template <typename Cb> Cursor Traverse(Cursor curs, Cb&& cb);
 
@@ -275,6 +315,20 @@ class DashTable : public detail::DashTableBase {
 
   void Clear();
 
+  // Tries to merge the segment at seg_id with its buddy, i.e. the segment that has the same
+  // local depth and was split from the same parent. Merges only if both segments together
+  // hold at most max_load * kSegCapacity entries and the move is guaranteed to succeed.
+  // Before any entry moves, calls cb(bucket_iterator) for every non-empty bucket of both
+  // segments with version lower than ver_threshold, similarly to CVCUponInsert, because merging
+  // moves entries across buckets. Lowers the global depth when no segment needs it anymore.
+  // Invalidates iterators into both segments. Returns true if the segments were merged.
+  template <typename Cb>
+  bool Merge(uint32_t seg_id, double max_load, uint64_t ver_threshold, Cb&& cb);
+
+  bool Merge(uint32_t seg_id, double max_load) {
+    return Merge(seg_id, max_load, 0, [](bucket_iterator) {});
+  }
+
   // Returns true if an element was deleted i.e the rightmost slot was busy.
   bool ShiftRight(bucket_iterator it);
 
@@ -305,6 +359,15 @@ class DashTable : public detail::DashTableBase {
   void IncreaseDepth(unsigned new_depth);
   void Split(uint32_t seg_id);
 
+  // Halves the segment directory while all segments have local depth lower than global depth.
+  void DecreaseDepthIfPossible();
+
+  // Called after deleting from seg, drops the deleted keys from its filter once they accumulate.
+  void MaybeRebuildFilter(SegmentType* seg) {
+    if (seg->IsFilterStale())
+      seg->RebuildFilter([this](const auto& k) { return policy_.HashFn(k); });
+  }
+
   // Segment directory contains multiple segment pointers, some of them pointing to
   // the same object. IterateDistinct goes over all distinct segments in the table.
   template <typename Cb> void IterateDistinct(Cb&& cb);
@@ -644,6 +707,7 @@ bool DashTable<_Key, _Value, Policy>::ShiftRight(bucket_iterator it) {
 
   bool deleted = seg->ShiftRight(it.bucket_id_, hash_val);
   size_ -= unsigned(deleted);
+  MaybeRebuildFilter(seg);
 
   return deleted;
 }
@@ -663,8 +727,7 @@ void DashTable<_Key, _Value, Policy>::IterateDistinct(Cb&& cb) {
 
 template <typename _Key, typename _Value, typename Policy>
 template <typename U>
-auto DashTable<_Key, _Value, Policy>::Find(U&& key) const -> const_iterator {
-  uint64_t key_hash = DoHash(key);
+auto DashTable<_Key, _Value, Policy>::Find(U&& key, uint64_t key_hash) const -> const_iterator {
   size_t seg_id = SegmentId(key_hash);  // seg_id takes up global_depth_ high bits.
   const auto* target = segment_[seg_id];
 
@@ -682,8 +745,7 @@ auto DashTable<_Key, _Value, Policy>::Find(U&& key) const -> const_iterator {
 
 template <typename _Key, typename _Value, typename Policy>
 template <typename U>
-auto DashTable<_Key, _Value, Policy>::Find(U&& key) -> iterator {
-  uint64_t key_hash = DoHash(key);
+auto DashTable<_Key, _Value, Policy>::Find(U&& key, uint64_t key_hash) -> iterator {
   uint32_t segid = SegmentId(key_hash);
   const auto* target = segment_[segid];
 
@@ -694,6 +756,30 @@ auto DashTable<_Key, _Value, Policy>::Find(U&& key) -> iterator {
   return iterator{};
 }
 
+template <typename _Key, typename _Value, typename Policy>
+template <typename U>
+void DashTable<_Key, _Value, Policy>::FindBatch(const U* keys, size_t count,
+                                                const_iterator* dest) const {
+  // Large enough to cover the memory latency, small enough to keep the prefetched lines in L1.
+  constexpr size_t kWindow = 16;
+  uint64_t hashes[kWindow];
+
+  for (size_t start = 0; start < count; start += kWindow) {
+    size_t len = std::min(kWindow, count - start);
+    for (size_t i = 0; i < len; ++i) {
+      hashes[i] = DoHash(keys[start + i]);
+      Prefetch(hashes[i]);
+    }
+
+    for (size_t i = 0; i < len; ++i) {
+      uint32_t seg_id = SegmentId(hashes[i]);
+      auto seg_it = segment_[seg_id]->FindIt(keys[start + i], hashes[i], EqPred());
+      dest[start + i] = seg_it.found() ? const_iterator{this, seg_id, seg_it.index, seg_it.slot}
+                                       : const_iterator{};
+    }
+  }
+}
+
 template <typename _Key, typename _Value, typename Policy>
 size_t DashTable<_Key, _Value, Policy>::Erase(const Key_t& key) {
   uint64_t key_hash = DoHash(key);
@@ -707,6 +793,7 @@ size_t DashTable<_Key, _Value, Policy>::Erase(const Key_t& key) {
   policy_.DestroyValue(target->Value(it.index, it.slot));
   target->Delete(it, key_hash);
   --size_;
+  MaybeRebuildFilter(target);
 
   return 1;
 }
@@ -722,6 +809,7 @@ void DashTable<_Key, _Value, Policy>::Erase(iterator it) {
 
   target->Delete(sit, key_hash);
   --size_;
+  MaybeRebuildFilter(target);
 }
 
 template <typename _Key, typename _Value, typename Policy>
@@ -730,13 +818,18 @@ void DashTable<_Key, _Value, Policy>::Reserve(size_t size) {
     return;
 
   size_t sg_floor = (size - 1) / SegmentType::capacity();
-  if (sg_floor < segment_.size()) {
-    return;
+  if (sg_floor >= segment_.size()) {
+    assert(sg_floor > 1u);
+    unsigned new_depth = 1 + (63 ^ __builtin_clzll(sg_floor));
+
+    IncreaseDepth(new_depth);
   }
-  assert(sg_floor > 1u);
-  unsigned new_depth = 1 + (63 ^ __builtin_clzll(sg_floor));
 
-  IncreaseDepth(new_depth);
+  // Splitting in directory order keeps the segment depths even.
+  for (size_t sid = 0; sid < segment_.size() && capacity() < size; sid = NextSeg(sid)) {
+    while (segment_[sid]->local_depth() < global_depth_ && capacity() < size)
+      Split(sid);
+  }
 }
 
 template <typename _Key, typename _Value, typename Policy>
@@ -886,6 +979,90 @@ void DashTable<_Key, _Value, Policy>::Split(uint32_t seg_id) {
   }
 }
 
+template <typename _Key, typename _Value, typename Policy>
+template <typename Cb>
+bool DashTable<_Key, _Value, Policy>::Merge(uint32_t seg_id, double max_load,
+                                            uint64_t ver_threshold, Cb&& cb) {
+  assert(seg_id < segment_.size());
+  SegmentType* seg = segment_[seg_id];
+  unsigned depth = seg->local_depth();
+
+  // Never go below the initial table size, similarly to Clear().
+  if (depth <= initial_depth_)
+    return false;
+
+  size_t chunk_size = 1u << (global_depth_ - depth);
+  size_t start_idx = seg_id & (~(chunk_size - 1));
+  size_t buddy_idx = start_idx ^ chunk_size;
+  SegmentType* buddy = segment_[buddy_idx];
+
+  // The buddy has been split further, it must be merged back first.
+  if (buddy->local_depth() != depth)
+    return false;
+
+  // Similarly to Split, the left segment is the one that stays.
+  size_t left_idx = std::min(start_idx, buddy_idx);
+  SegmentType* left = segment_[left_idx];
+  SegmentType* right = segment_[left_idx + chunk_size];
+
+  if (left->SlowSize() + right->SlowSize() > max_load * SegmentType::capacity())
+    return false;
+
+  auto hash_fn = [this](const auto& k) { return policy_.HashFn(k); };
+  if (!left->CanMoveFrom(hash_fn, *right))
+    return false;
+
+  if constexpr (kUseVersion) {
+    for (size_t sid : {left_idx, left_idx + chunk_size}) {
+      const SegmentType* target = segment_[sid];
+      for (uint8_t i = 0; i < kPhysicalBucketNum; ++i) {
+        if (target->GetVersion(i) < ver_threshold && !target->GetBucket(i).IsEmpty()) {
+          cb(bucket_iterator{this, uint32_t(sid), i});
+        }
+      }
+    }
+  }
+
+  left->MoveFrom(hash_fn, right);
+  left->set_local_depth(depth - 1);
+
+  for (size_t i = left_idx + chunk_size; i < left_idx + 2 * chunk_size; ++i) {
+    segment_[i] = left;
+  }
+
+  PMR_NS::polymorphic_allocator<SegmentType> alloc(segment_.get_allocator().resource());
+  alloc.destroy(right);
+  alloc.deallocate(right, 1);
+  --unique_segments_;
+
+  DecreaseDepthIfPossible();
+  return true;
+}
+
+template <typename _Key, typename _Value, typename Policy>
+void DashTable<_Key, _Value, Policy>::DecreaseDepthIfPossible() {
+  while (global_depth_ > initial_depth_) {
+    bool can_decrease = true;
+    for (size_t i = 0; i < segment_.size(); i = NextSeg(i)) {
+      if (segment_[i]->local_depth() == global_depth_) {
+        can_decrease = false;
+        break;
+      }
+    }
+
+    if (!can_decrease)
+      return;
+
+    // Every pair (2i, 2i + 1) points to the same segment.
+    size_t new_size = segment_.size() / 2;
+    for (size_t i = 0; i < new_size; ++i) {
+      segment_[i] = segment_[2 * i];
+    }
+    segment_.resize(new_size);
+    --global_depth_;
+  }
+}
+
 template <typename _Key, typename _Value, typename Policy>
 template <typename Cb>
 auto DashTable<_Key, _Value, Policy>::Traverse(Cursor curs, Cb&& cb) -> Cursor {
@@ -895,6 +1072,11 @@ auto DashTable<_Key, _Value, Policy>::Traverse(Cursor curs, Cb&& cb) -> Cursor {
   uint32_t sid = curs.segment_id(global_depth_);
   uint8_t bid = curs.bucket_id();
 
+  // If segments were merged since the cursor was created, it may point into the middle of the
+  // merged segment, whose right half was not traversed at bid yet. Continue from the start of
+  // the segment, so that its entries are not skipped, at the cost of visiting the left half again.
+  sid &= ~((1u << (global_depth_ - segment_[sid]->local_depth())) - 1);
+
   auto hash_fun = [this](const auto& k) { return policy_.HashFn(k); };
 
   bool fetched = false;
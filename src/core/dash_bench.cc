@@ -6,14 +6,25 @@
 
 #include <absl/base/internal/cycleclock.h>
 #include <absl/container/flat_hash_map.h>
+#include <absl/strings/str_cat.h>
+#include <benchmark/benchmark.h>
+
+#include <random>
 
 #include "base/hash.h"
 #include "base/histogram.h"
 #include "base/init.h"
+#include "base/zipf_gen.h"
+#include "core/compact_object.h"
 #include "core/dash.h"
+#include "core/score_map.h"
+#include "core/small_string.h"
+#include "core/string_map.h"
+#include "core/string_set.h"
 
 extern "C" {
 #include "redis/dict.h"
+#include "redis/redis_aux.h"
 #include "redis/sds.h"
 #include "redis/zmalloc.h"
 }
@@ -21,8 +32,14 @@ extern "C" {
 using namespace std;
 
 ABSL_FLAG(uint32_t, n, 100000, "num items");
-ABSL_FLAG(string, type, "dash", "");
+ABSL_FLAG(string, type, "",
+          "If set to dash, dict or flat, runs the legacy insertion latency benchmark of that "
+          "table instead of the benchmark suite");
 ABSL_FLAG(bool, sds, false, "If true, uses sds as primary key");
+ABSL_FLAG(bool, find, false,
+          "If true, probes all the inserted items after the insertion phase and reports "
+          "per-probe cycles");
+ABSL_FLAG(double, zipf_alpha, 0.99, "Skew of the zipfian key distribution, must be in (0, 1)");
 
 namespace dfly {
 
@@ -77,7 +94,7 @@ struct SdsDashPolicy {
   }
 
   static bool Equal(sds u1, sds u2) {
-    return dictSdsKeyCompare(nullptr, u1, u2) == 0;
+    return dictSdsKeyCompare(nullptr, u1, u2) != 0;
   }
 
   static bool Equal(sds u1, std::string_view u2) {
@@ -138,6 +155,27 @@ void BenchDash(uint64_t num) {
   }
 }
 
+// Measures lookups of all the keys that were inserted by BenchDash.
+void BenchDashFind(uint64_t num) {
+  base::Histogram find_hist;
+  uint64_t total_cycles = 0, found = 0;
+
+  for (uint64_t i = 0; i < num; ++i) {
+    int64_t start = absl::base_internal::CycleClock::Now();
+    auto it = udt.Find(i);
+    LFENCE;
+    int64_t end = absl::base_internal::CycleClock::Now();
+
+    found += !it.is_done();
+    total_cycles += end - start;
+    find_hist.Add(end - start);
+  }
+
+  CONSOLE_INFO << "find latencies histogram (cycles):\n" << find_hist.ToString();
+  CONSOLE_INFO << "Found " << found << " items, average " << double(total_cycles) / num
+               << " cycles per probe";
+}
+
 inline sds Prefix() {
   return sdsnew("xxxxxxxxxxxxxxxxxxxxxxx");
 }
@@ -190,17 +228,298 @@ void BenchDictSds() {
   }
 }
 
-}  // namespace dfly
+// Benchmark suite.
+// The legacy benchmarks above measure single insertion latencies, the suite below measures
+// throughput of the core data structures under more realistic access patterns.
+// The benchmark names are stable, so the reports produced with
+// --benchmark_out=<file> --benchmark_out_format=json can be compared across releases.
 
-using namespace dfly;
+enum KeyDist : int64_t { kUniform = 0, kZipf = 1 };
 
-int main(int argc, char* argv[]) {
-  MainInitGuard guard(&argc, &argv);
+constexpr size_t kNumSamples = 1 << 16;  // must be a power of 2.
 
-  init_zmalloc_threadlocal(mi_heap_get_backing());
+// Precomputes a sequence of key ids in [0, range) so that the timed loops do not pay for
+// the random generators.
+vector<uint64_t> GenKeyIds(uint64_t range, int64_t dist) {
+  vector<uint64_t> res(kNumSamples);
+  default_random_engine rand_eng{42};
 
-  string table_type = GetFlag(FLAGS_type);
+  if (dist == kZipf) {
+    base::ZipfianGenerator zipf(0, range - 1, GetFlag(FLAGS_zipf_alpha));
+    for (auto& id : res)
+      id = zipf.Next(rand_eng);
+
+    // ZipfianGenerator returns the lowest ids most frequently, scatter them over the range
+    // to avoid biasing towards the keys that were inserted first.
+    for (auto& id : res)
+      id = (id * 0x9E3779B97F4A7C15ULL) % range;
+  } else {
+    uniform_int_distribution<uint64_t> udist(0, range - 1);
+    for (auto& id : res)
+      id = udist(rand_eng);
+  }
+  return res;
+}
 
+// Returns a key of exactly key_size bytes (if key_size is large enough to hold the id).
+string MakeKey(uint64_t id, size_t key_size) {
+  string res = absl::StrCat("key:", id);
+  if (res.size() < key_size)
+    res.resize(key_size, 'x');
+  return res;
+}
+
+vector<string> MakeKeys(uint64_t count, size_t key_size) {
+  vector<string> res(count);
+  for (uint64_t i = 0; i < count; ++i)
+    res[i] = MakeKey(i, key_size);
+  return res;
+}
+
+const char* DistName(int64_t dist) {
+  return dist == kZipf ? "zipf" : "uniform";
+}
+
+// Lookups of existing keys. Args: key distribution, number of items.
+void BM_DashFind(benchmark::State& state) {
+  uint64_t items = state.range(1);
+  Dash64 dt;
+  for (uint64_t i = 0; i < items; ++i)
+    dt.Insert(i, i);
+
+  vector<uint64_t> ids = GenKeyIds(items, state.range(0));
+  size_t next = 0;
+  for (auto _ : state) {
+    auto it = dt.Find(ids[next++ & (kNumSamples - 1)]);
+    benchmark::DoNotOptimize(it);
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetLabel(DistName(state.range(0)));
+}
+BENCHMARK(BM_DashFind)
+    ->ArgNames({"dist", "items"})
+    ->ArgsProduct({{kUniform, kZipf}, {1 << 16, 1 << 20, 1 << 23}});
+
+// Read/write mix over a populated table, writes are split evenly between upserts and deletes
+// so that the table size stays roughly constant.
+// Args: key distribution, percent of reads, number of items.
+void BM_DashMixed(benchmark::State& state) {
+  uint64_t items = state.range(2);
+  unsigned read_pct = state.range(1);
+
+  Dash64 dt;
+  for (uint64_t i = 0; i < items; ++i)
+    dt.Insert(i, i);
+
+  vector<uint64_t> ids = GenKeyIds(items, state.range(0));
+  vector<uint8_t> ops(kNumSamples);
+  default_random_engine rand_eng{7};
+  uniform_int_distribution<unsigned> pct_dist(0, 199);
+  for (auto& op : ops)
+    op = pct_dist(rand_eng) / 2 < read_pct ? 0 : 1 + (pct_dist(rand_eng) & 1);
+
+  size_t next = 0;
+  for (auto _ : state) {
+    size_t idx = next++ & (kNumSamples - 1);
+    uint64_t key = ids[idx];
+    switch (ops[idx]) {
+      case 0:
+        benchmark::DoNotOptimize(dt.Find(key));
+        break;
+      case 1:
+        dt.Insert(key, next);
+        break;
+      default:
+        dt.Erase(key);
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["size"] = dt.size();
+  state.SetLabel(DistName(state.range(0)));
+}
+BENCHMARK(BM_DashMixed)
+    ->ArgNames({"dist", "read_pct", "items"})
+    ->ArgsProduct({{kUniform, kZipf}, {50, 90, 99}, {1 << 20}});
+
+// Lookups by string keys of various sizes. Args: key size, number of items.
+void BM_DashSdsFind(benchmark::State& state) {
+  size_t key_size = state.range(0);
+  uint64_t items = state.range(1);
+  vector<string> keys = MakeKeys(items, key_size);
+
+  DashSds dt;
+  for (const auto& k : keys)
+    dt.Insert(sdsnewlen(k.data(), k.size()), 0);
+
+  vector<uint64_t> ids = GenKeyIds(items, kUniform);
+  size_t next = 0;
+  for (auto _ : state) {
+    string_view key = keys[ids[next++ & (kNumSamples - 1)]];
+    benchmark::DoNotOptimize(dt.Find(key));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DashSdsFind)
+    ->ArgNames({"key_size", "items"})
+    ->ArgsProduct({{16, 64, 256}, {1 << 20}});
+
+// Grows the table from scratch while reading the keys inserted so far, so that the reads
+// interleave with segment splits. Args: reads per insertion, number of items to insert.
+void BM_DashGrowWhileReading(benchmark::State& state) {
+  unsigned reads = state.range(0);
+  uint64_t items = state.range(1);
+  default_random_engine rand_eng{42};
+
+  for (auto _ : state) {
+    Dash64 dt;
+    for (uint64_t i = 0; i < items; ++i) {
+      dt.Insert(i, i);
+      for (unsigned j = 0; j < reads; ++j) {
+        benchmark::DoNotOptimize(dt.Find(rand_eng() % (i + 1)));
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * items * (reads + 1));
+}
+BENCHMARK(BM_DashGrowWhileReading)
+    ->ArgNames({"reads", "items"})
+    ->ArgsProduct({{1, 8}, {1 << 20}})
+    ->Unit(benchmark::kMillisecond);
+
+// Args: key size, number of items.
+void BM_StringSetAdd(benchmark::State& state) {
+  vector<string> keys = MakeKeys(state.range(1), state.range(0));
+
+  for (auto _ : state) {
+    StringSet ss;
+    for (const auto& k : keys)
+      ss.Add(k);
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_StringSetAdd)
+    ->ArgNames({"key_size", "items"})
+    ->ArgsProduct({{4, 16, 64, 256}, {1 << 16}})
+    ->Unit(benchmark::kMicrosecond);
+
+// Args: key distribution, percent of reads, number of items. Initially half of the keys are
+// present, writes add the missing keys and delete the present ones.
+void BM_StringSetMixed(benchmark::State& state) {
+  uint64_t items = state.range(2);
+  unsigned read_pct = state.range(1);
+  vector<string> keys = MakeKeys(items * 2, 24);
+
+  StringSet ss;
+  for (uint64_t i = 0; i < items; ++i)
+    ss.Add(keys[i * 2]);
+
+  vector<uint64_t> ids = GenKeyIds(items * 2, state.range(0));
+  size_t next = 0;
+  for (auto _ : state) {
+    size_t idx = next++ & (kNumSamples - 1);
+    const string& key = keys[ids[idx]];
+    if (idx % 100 < read_pct) {
+      benchmark::DoNotOptimize(ss.Contains(key));
+    } else if (!ss.Add(key)) {
+      ss.Erase(key);
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetLabel(DistName(state.range(0)));
+}
+BENCHMARK(BM_StringSetMixed)
+    ->ArgNames({"dist", "read_pct", "items"})
+    ->ArgsProduct({{kUniform, kZipf}, {50, 90}, {1 << 20}});
+
+// HSET/HGET like mix. Args: key distribution, percent of reads, value size.
+void BM_StringMapMixed(benchmark::State& state) {
+  constexpr uint64_t kItems = 1 << 18;
+  unsigned read_pct = state.range(1);
+  vector<string> fields = MakeKeys(kItems, 16);
+  string value(state.range(2), 'v');
+
+  StringMap sm;
+  for (const auto& f : fields)
+    sm.AddOrUpdate(f, value);
+
+  vector<uint64_t> ids = GenKeyIds(kItems, state.range(0));
+  size_t next = 0;
+  for (auto _ : state) {
+    size_t idx = next++ & (kNumSamples - 1);
+    const string& field = fields[ids[idx]];
+    if (idx % 100 < read_pct) {
+      benchmark::DoNotOptimize(sm.Find(field));
+    } else {
+      sm.AddOrUpdate(field, value);
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetLabel(DistName(state.range(0)));
+}
+BENCHMARK(BM_StringMapMixed)
+    ->ArgNames({"dist", "read_pct", "val_size"})
+    ->ArgsProduct({{kUniform, kZipf}, {50, 90}, {8, 128}});
+
+// ZADD/ZSCORE like mix. Args: key distribution, percent of reads.
+void BM_ScoreMapMixed(benchmark::State& state) {
+  constexpr uint64_t kItems = 1 << 18;
+  unsigned read_pct = state.range(1);
+  vector<string> members = MakeKeys(kItems, 16);
+
+  ScoreMap sm;
+  for (uint64_t i = 0; i < kItems; ++i)
+    sm.AddOrUpdate(members[i], i);
+
+  vector<uint64_t> ids = GenKeyIds(kItems, state.range(0));
+  size_t next = 0;
+  for (auto _ : state) {
+    size_t idx = next++ & (kNumSamples - 1);
+    const string& member = members[ids[idx]];
+    if (idx % 100 < read_pct) {
+      benchmark::DoNotOptimize(sm.Find(member));
+    } else {
+      sm.AddOrUpdate(member, next);
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetLabel(DistName(state.range(0)));
+}
+BENCHMARK(BM_ScoreMapMixed)
+    ->ArgNames({"dist", "read_pct"})
+    ->ArgsProduct({{kUniform, kZipf}, {50, 90}});
+
+// Covers the inline, the small string and the heap encodings of CompactObj strings.
+// Args: string size.
+void BM_CompactObjSetGet(benchmark::State& state) {
+  vector<string> keys = MakeKeys(1024, state.range(0));
+  CompactObj obj;
+  string dest;
+
+  size_t next = 0;
+  for (auto _ : state) {
+    obj.SetString(keys[next++ & 1023]);
+    obj.GetString(&dest);
+    benchmark::DoNotOptimize(dest.data());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CompactObjSetGet)->ArgName("size")->Arg(8)->Arg(16)->Arg(32)->Arg(128)->Arg(1024);
+
+// Args: string size.
+void BM_CompactObjHash(benchmark::State& state) {
+  vector<CompactObj> objs(1024);
+  for (unsigned i = 0; i < objs.size(); ++i)
+    objs[i].SetString(MakeKey(i, state.range(0)));
+
+  size_t next = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(objs[next++ & 1023].HashCode());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CompactObjHash)->ArgName("size")->Arg(8)->Arg(16)->Arg(32)->Arg(128);
+
+void RunLegacy(const string& table_type) {
   bool is_sds = GetFlag(FLAGS_sds);
   uint64_t start = absl::GetCurrentTimeNanos();
   uint64_t num = GetFlag(FLAGS_n);
@@ -210,6 +529,9 @@ int main(int argc, char* argv[]) {
       BenchDashSds(num);
     } else {
       BenchDash(num);
+      if (GetFlag(FLAGS_find)) {
+        BenchDashFind(num);
+      }
     }
   } else if (table_type == "dict") {
     if (is_sds) {
@@ -226,6 +548,34 @@ int main(int argc, char* argv[]) {
   CONSOLE_INFO << "latencies histogram (jiffies, 100ns):\n" << hist.ToString();
   uint64_t delta = (absl::GetCurrentTimeNanos() - start) / 1000000;
   CONSOLE_INFO << "Took " << delta << " ms";
+}
+
+}  // namespace dfly
+
+using namespace dfly;
+
+int main(int argc, char* argv[]) {
+  // Strips the --benchmark_* flags before the rest of the flags are parsed.
+  benchmark::Initialize(&argc, argv);
+  MainInitGuard guard(&argc, &argv);
+
+  auto* tlh = mi_heap_get_backing();
+  init_zmalloc_threadlocal(tlh);
+
+  string table_type = GetFlag(FLAGS_type);
+  if (!table_type.empty()) {
+    RunLegacy(table_type);
+    return 0;
+  }
+
+  InitRedisTables();
+  SmallString::InitThreadLocal(tlh);
+  CompactObj::InitThreadLocal(PMR_NS::get_default_resource());
+
+  benchmark::AddCustomContext("dash_segment_bytes", absl::StrCat(Dash64::kSegBytes));
+  benchmark::AddCustomContext("zipf_alpha", absl::StrCat(GetFlag(FLAGS_zipf_alpha)));
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
 
   return 0;
 }
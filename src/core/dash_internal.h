@@ -6,6 +6,7 @@
 
 #include <absl/base/internal/endian.h>
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <cstdint>
@@ -111,6 +112,10 @@ template <unsigned NUM_SLOTS, unsigned NUM_STASH_FPS> class BucketBase {
   static constexpr unsigned kStashFpLen = NUM_STASH_FPS;
   static constexpr unsigned kStashPresentBit = 1 << 4;
 
+  // stash_arr_ directly follows finger_arr_, so a 16-byte compare of finger_arr_ also
+  // covers the stash fingerprints when they fit.
+  static constexpr bool kStashInCmpWindow = NUM_SLOTS + NUM_STASH_FPS <= 16;
+
   using FpArray = std::array<uint8_t, NUM_SLOTS>;
   using StashFpArray = std::array<uint8_t, NUM_STASH_FPS>;
 
@@ -148,6 +153,19 @@ template <unsigned NUM_SLOTS, unsigned NUM_STASH_FPS> class BucketBase {
     return mask & GetProbe(probe);
   }
 
+  // Compares fp against the fingerprints of buckets a and b in a single SIMD pass.
+  // The lower 16 bits of the result belong to a and the upper 16 bits belong to b.
+  // Within each half, bits [0, NUM_SLOTS) correspond to the slot fingerprints and the bits
+  // that follow to the stash fingerprints that fit into the 16-byte window.
+  static uint32_t CompareFP2(const BucketBase& a, const BucketBase& b, uint8_t fp) {
+    return detail::CompareFp2x16(a.finger_arr_.data(), b.finger_arr_.data(), fp);
+  }
+
+  // Same as Find() but works on the 16-bit half of the CompareFP2 result for this bucket.
+  unsigned FindByCmpMask(uint32_t cmp_mask, bool probe) const {
+    return cmp_mask & GetBusy() & GetProbe(probe);
+  }
+
   uint8_t Fp(unsigned i) const {
     assert(i < finger_arr_.size());
     return finger_arr_[i];
@@ -201,6 +219,12 @@ template <unsigned NUM_SLOTS, unsigned NUM_STASH_FPS> class BucketBase {
   template <typename F>
   std::pair<unsigned, SlotId> IterateStash(uint8_t fp, bool is_probe, F&& func) const;
 
+  // Same as IterateStash but reuses the 16-bit half of the CompareFP2 result for this bucket
+  // when the stash fingerprints are covered by it.
+  template <typename F>
+  std::pair<unsigned, SlotId> IterateStash(uint8_t fp, uint32_t cmp_mask, bool is_probe,
+                                           F&& func) const;
+
   void Swap(unsigned slot_a, unsigned slot_b) {
     slotb_.Swap(slot_a, slot_b);
     std::swap(finger_arr_[slot_a], finger_arr_[slot_b]);
@@ -289,12 +313,101 @@ static_assert(alignof(VersionedBB<14, 4>) == 1, "");
 static_assert(sizeof(VersionedBB<12, 4>) == 12 * 2 + 8, "");
 static_assert(sizeof(VersionedBB<14, 4>) <= 14 * 2 + 8, "");
 
+// Blocked bloom filter of the key hashes of a segment. Every key sets kNumProbes bits of a single
+// 64-byte block, so a lookup reads one cache line. It has no false negatives but it can not
+// remove keys: it counts the deletions and the segment rebuilds it once they accumulate.
+template <unsigned NUM_BLOCKS> class SegmentFilter {
+ public:
+  void Add(uint64_t hash) {
+    uint64_t h = Mix(hash);
+    Block& block = blocks_[BlockIndex(h)];
+    for (uint32_t p = h >> 32, i = 0; i < kNumProbes; ++i, p >>= 9) {
+      block.word[(p >> 6) & 7] |= 1ULL << (p & 63);
+    }
+  }
+
+  bool MayContain(uint64_t hash) const {
+    uint64_t h = Mix(hash);
+    const Block& block = blocks_[BlockIndex(h)];
+    uint64_t res = 1;
+    for (uint32_t p = h >> 32, i = 0; i < kNumProbes; ++i, p >>= 9) {
+      res &= block.word[(p >> 6) & 7] >> (p & 63);
+    }
+    return res & 1;
+  }
+
+  void Prefetch(uint64_t hash) const {
+    __builtin_prefetch(&blocks_[BlockIndex(Mix(hash))]);
+  }
+
+  void OnDelete() {
+    ++deletions_;
+  }
+
+  // Number of keys deleted since the filter was cleared.
+  unsigned deletions() const {
+    return deletions_;
+  }
+
+  void Clear() {
+    std::fill(std::begin(blocks_), std::end(blocks_), Block{});
+    deletions_ = 0;
+  }
+
+ private:
+  static constexpr unsigned kNumProbes = 3;  // 9 bits each.
+  static_assert(kNumProbes * 9 <= 32);
+
+  struct alignas(64) Block {
+    uint64_t word[8] = {0};
+  };
+
+  // The segment id, the bucket id and the fingerprint are taken from the hash as is, so the
+  // filter mixes it first. The probes use the high bits of the product, the block its low bits.
+  static uint64_t Mix(uint64_t hash) {
+    return ((hash ^ (hash >> 29)) * 0x9E3779B97F4A7C15ULL);
+  }
+
+  static unsigned BlockIndex(uint64_t mixed) {
+    return ((mixed & 0xFFFFFFFF) * NUM_BLOCKS) >> 32;
+  }
+
+  Block blocks_[NUM_BLOCKS];
+  uint32_t deletions_ = 0;
+};
+
+// Disabled filter, it takes no space in the segment.
+template <> class SegmentFilter<0> {
+ public:
+  void Add(uint64_t) {
+  }
+
+  bool MayContain(uint64_t) const {
+    return true;
+  }
+
+  void Prefetch(uint64_t) const {
+  }
+
+  void OnDelete() {
+  }
+
+  unsigned deletions() const {
+    return 0;
+  }
+
+  void Clear() {
+  }
+};
+
 // Segment - static-hashtable of size NUM_SLOTS*(BUCKET_CNT + STASH_BUCKET_NUM).
+// FILTER_BLOCKS - number of 64-byte blocks of the segment bloom filter, 0 disables it.
 struct DefaultSegmentPolicy {
   static constexpr unsigned NUM_SLOTS = 12;
   static constexpr unsigned BUCKET_CNT = 64;
   static constexpr unsigned STASH_BUCKET_NUM = 2;
   static constexpr bool USE_VERSION = true;
+  static constexpr unsigned FILTER_BLOCKS = 0;
 };
 
 template <typename _Key, typename _Value, typename Policy = DefaultSegmentPolicy> class Segment {
@@ -302,6 +415,7 @@ template <typename _Key, typename _Value, typename Policy = DefaultSegmentPolicy
   static constexpr unsigned STASH_BUCKET_NUM = Policy::STASH_BUCKET_NUM;
   static constexpr unsigned NUM_SLOTS = Policy::NUM_SLOTS;
   static constexpr bool USE_VERSION = Policy::USE_VERSION;
+  static constexpr unsigned FILTER_BLOCKS = Policy::FILTER_BLOCKS;
 
   static_assert(BUCKET_CNT + STASH_BUCKET_NUM < 255);
   static constexpr unsigned kFingerBits = 8;
@@ -327,7 +441,12 @@ template <typename _Key, typename _Value, typename Policy = DefaultSegmentPolicy
     }
 
     template <typename U, typename Pred>
-    SlotId FindByFp(uint8_t fp_hash, bool probe, U&& k, Pred&& pred) const;
+    SlotId FindByFp(uint8_t fp_hash, bool probe, U&& k, Pred&& pred) const {
+      return FindByMask(this->Find(fp_hash, probe), std::forward<U>(k), std::forward<Pred>(pred));
+    }
+
+    // mask - candidate slots whose fingerprints matched the searched key.
+    template <typename U, typename Pred> SlotId FindByMask(unsigned mask, U&& k, Pred&& pred) const;
 
     bool ShiftRight();
 
@@ -389,6 +508,7 @@ template <typename _Key, typename _Value, typename Policy = DefaultSegmentPolicy
     size_t neighbour_probes = 0;
     size_t stash_probes = 0;
     size_t stash_overflow_probes = 0;
+    size_t filter_negatives = 0;
   };
 
   /* number of normal buckets in one segment*/
@@ -421,12 +541,25 @@ template <typename _Key, typename _Value, typename Policy = DefaultSegmentPolicy
   // should it should be deallocated or reinitialized.
   template <typename HashFn> void MoveFrom(HashFn&& hfunc, Segment* src);
 
+  // Dry-run check for MoveFrom. Returns true if all the entries of src fit into their home
+  // buckets in this segment, which guarantees that MoveFrom succeeds. Conservative - may
+  // return false even if MoveFrom could succeed by using neighbour or stash buckets.
+  template <typename HashFn> bool CanMoveFrom(HashFn&& hfunc, const Segment& src) const;
+
   void Delete(const Iterator& it, Hash_t key_hash);
 
   void Clear();  // clears the segment.
 
   size_t SlowSize() const;
 
+  // Returns true if enough keys were deleted since the filter was built to make it worth
+  // rebuilding. Always false when the filter is disabled.
+  bool IsFilterStale() const {
+    return filter_.deletions() >= kMaxSize / 4;
+  }
+
+  template <typename HashFn> void RebuildFilter(HashFn&& hfunc);
+
   static constexpr size_t capacity() {
     return kMaxSize;
   }
@@ -507,6 +640,15 @@ template <typename _Key, typename _Value, typename Policy = DefaultSegmentPolicy
 
   template <typename U, typename Pred> Iterator FindIt(U&& key, Hash_t key_hash, Pred&& cf) const;
 
+  // Prefetches the home and the neighbour buckets of key_hash. Used by batched lookups
+  // to overlap the cache misses of multiple keys.
+  void Prefetch(Hash_t key_hash) const {
+    uint8_t bid = BucketIndex(key_hash);
+    filter_.Prefetch(key_hash);
+    __builtin_prefetch(&bucket_[bid]);
+    __builtin_prefetch(&bucket_[NextBid(bid)]);
+  }
+
   // Returns valid iterator if succeeded or invalid if not (it's full).
   // Requires: key should be not present in the segment.
   // if spread is true, tries to spread the load between neighbour and home buckets,
@@ -544,7 +686,10 @@ template <typename _Key, typename _Value, typename Policy = DefaultSegmentPolicy
         RemoveStashReference(bid - kRegularBucketCnt, right_hashval);
     }
 
-    return bucket_[bid].ShiftRight();
+    bool deleted = bucket_[bid].ShiftRight();
+    if (deleted)
+      filter_.OnDelete();
+    return deleted;
   }
 
   // Bumps up this entry making it more "important" for the eviction policy.
@@ -602,6 +747,7 @@ template <typename _Key, typename _Value, typename Policy = DefaultSegmentPolicy
 
   Bucket bucket_[kTotalBuckets];
   size_t local_depth_;
+  [[no_unique_address]] SegmentFilter<FILTER_BLOCKS> filter_;
 
  public:
   static constexpr size_t kBucketSz = sizeof(Bucket);
@@ -985,6 +1131,30 @@ auto BucketBase<NUM_SLOTS, NUM_OVR>::IterateStash(uint8_t fp, bool is_probe, F&&
   return std::pair<unsigned, SlotId>(0, BucketBase::kNanSlot);
 }
 
+template <unsigned NUM_SLOTS, unsigned NUM_OVR>
+template <typename F>
+auto BucketBase<NUM_SLOTS, NUM_OVR>::IterateStash(uint8_t fp, uint32_t cmp_mask, bool is_probe,
+                                                  F&& func) const
+    -> ::std::pair<unsigned, SlotId> {
+  if constexpr (!kStashInCmpWindow) {
+    return IterateStash(fp, is_probe, std::forward<F>(func));
+  }
+
+  unsigned om = is_probe ? stash_probe_mask_ : ~stash_probe_mask_;
+  unsigned mask = (cmp_mask >> NUM_SLOTS) & stash_busy_ & om & ((1u << kStashFpLen) - 1);
+
+  while (mask) {
+    unsigned i = __builtin_ctz(mask);
+    unsigned pos = (stash_pos_ >> (i * 2)) & 3;
+    auto sid = func(i, pos);
+    if (sid != BucketBase::kNanSlot) {
+      return std::pair<unsigned, SlotId>(pos, sid);
+    }
+    mask &= mask - 1;
+  }
+  return std::pair<unsigned, SlotId>(0, BucketBase::kNanSlot);
+}
+
 template <unsigned NUM_SLOTS, unsigned NUM_STASH_FPS>
 void VersionedBB<NUM_SLOTS, NUM_STASH_FPS>::SetVersion(uint64_t version) {
   absl::little_endian::Store64(version_, version);
@@ -1018,9 +1188,8 @@ ___] |___ |__] |  | |___ | \|  |
 
 template <typename Key, typename Value, typename Policy>
 template <typename U, typename Pred>
-auto Segment<Key, Value, Policy>::Bucket::FindByFp(uint8_t fp_hash, bool probe, U&& k,
-                                                   Pred&& pred) const -> SlotId {
-  unsigned mask = this->Find(fp_hash, probe);
+auto Segment<Key, Value, Policy>::Bucket::FindByMask(unsigned mask, U&& k, Pred&& pred) const
+    -> SlotId {
   if (!mask)
     return kNanSlot;
 
@@ -1105,6 +1274,14 @@ auto Segment<Key, Value, Policy>::Insert(U&& key, V&& value, Hash_t key_hash, Pr
 template <typename Key, typename Value, typename Policy>
 template <typename U, typename Pred>
 auto Segment<Key, Value, Policy>::FindIt(U&& key, Hash_t key_hash, Pred&& cf) const -> Iterator {
+  // Definite misses are answered without touching the buckets.
+  if (!filter_.MayContain(key_hash)) {
+#ifdef ENABLE_DASH_STATS
+    stats.filter_negatives++;
+#endif
+    return Iterator{};
+  }
+
   uint8_t bidx = BucketIndex(key_hash);
   const Bucket& target = bucket_[bidx];
 
@@ -1113,15 +1290,21 @@ auto Segment<Key, Value, Policy>::FindIt(U&& key, Hash_t key_hash, Pred&& cf) co
   __builtin_prefetch(&target);
 
   uint8_t fp_hash = key_hash & kFpMask;
-  SlotId sid = target.FindByFp(fp_hash, false, key, cf);
+  uint8_t nid = NextBid(bidx);
+  const Bucket& probe = bucket_[nid];
+
+  // Matches the fingerprints of the home and the neighbour buckets, including their stash
+  // fingerprints, in a single SIMD compare.
+  uint32_t cmp_mask = BucketType::CompareFP2(target, probe, fp_hash);
+  uint32_t target_mask = cmp_mask & 0xFFFF;
+  uint32_t probe_mask = cmp_mask >> 16;
+
+  SlotId sid = target.FindByMask(target.FindByCmpMask(target_mask, false), key, cf);
   if (sid != BucketType::kNanSlot) {
     return Iterator{bidx, sid};
   }
 
-  uint8_t nid = NextBid(bidx);
-  const Bucket& probe = bucket_[nid];
-
-  sid = probe.FindByFp(fp_hash, true, key, cf);
+  sid = probe.FindByMask(probe.FindByCmpMask(probe_mask, true), key, cf);
 
 #ifdef ENABLE_DASH_STATS
   stats.neighbour_probes++;
@@ -1148,11 +1331,23 @@ auto Segment<Key, Value, Policy>::FindIt(U&& key, Hash_t key_hash, Pred&& cf) co
     stats.stash_overflow_probes++;
 #endif
 
-    for (unsigned i = 0; i < STASH_BUCKET_NUM; ++i) {
-      auto sid = stash_cb(0, i);
+    // Compare stash buckets pairwise.
+    for (unsigned i = 0; i < STASH_BUCKET_NUM; i += 2) {
+      unsigned j = std::min(i + 1, STASH_BUCKET_NUM - 1);
+      const Bucket& s0 = bucket_[kRegularBucketCnt + i];
+      const Bucket& s1 = bucket_[kRegularBucketCnt + j];
+      uint32_t stash_mask = BucketType::CompareFP2(s0, s1, fp_hash);
+
+      auto sid = s0.FindByMask(s0.FindByCmpMask(stash_mask & 0xFFFF, false), key, cf);
       if (sid != BucketType::kNanSlot) {
         return Iterator{uint8_t(kRegularBucketCnt + i), sid};
       }
+      if (j == i)
+        break;
+      sid = s1.FindByMask(s1.FindByCmpMask(stash_mask >> 16, false), key, cf);
+      if (sid != BucketType::kNanSlot) {
+        return Iterator{uint8_t(kRegularBucketCnt + j), sid};
+      }
     }
 
     // We exit because we searched through all stash buckets anyway, no need to use overflow fps.
@@ -1163,12 +1358,12 @@ auto Segment<Key, Value, Policy>::FindIt(U&& key, Hash_t key_hash, Pred&& cf) co
   stats.stash_probes++;
 #endif
 
-  auto stash_res = target.IterateStash(fp_hash, false, stash_cb);
+  auto stash_res = target.IterateStash(fp_hash, target_mask, false, stash_cb);
   if (stash_res.second != BucketType::kNanSlot) {
     return Iterator{uint8_t(kRegularBucketCnt + stash_res.first), stash_res.second};
   }
 
-  stash_res = probe.IterateStash(fp_hash, true, stash_cb);
+  stash_res = probe.IterateStash(fp_hash, probe_mask, true, stash_cb);
   if (stash_res.second != BucketType::kNanSlot) {
     return Iterator{uint8_t(kRegularBucketCnt + stash_res.first), stash_res.second};
   }
@@ -1187,6 +1382,7 @@ template <typename Key, typename Value, typename Policy> void Segment<Key, Value
   for (unsigned i = 0; i < kTotalBuckets; ++i) {
     bucket_[i].Clear();
   }
+  filter_.Clear();
 }
 
 template <typename Key, typename Value, typename Policy>
@@ -1200,6 +1396,19 @@ void Segment<Key, Value, Policy>::Delete(const Iterator& it, Hash_t key_hash) {
   }
 
   b.Delete(it.slot);
+  filter_.OnDelete();
+}
+
+template <typename Key, typename Value, typename Policy>
+template <typename HFunc>
+void Segment<Key, Value, Policy>::RebuildFilter(HFunc&& hfunc) {
+  if constexpr (FILTER_BLOCKS > 0) {
+    filter_.Clear();
+    for (unsigned i = 0; i < kTotalBuckets; ++i) {
+      bucket_[i].ForEachSlot(
+          [&](auto* bucket, unsigned slot, bool) { filter_.Add(hfunc(bucket->key[slot])); });
+    }
+  }
 }
 
 // Split items from the left segment to the right during the growth phase.
@@ -1215,6 +1424,10 @@ void Segment<Key, Value, Policy>::Split(HFunc&& hfn, Segment* dest_right) {
   // do_versioning();
   auto is_mine = [this](Hash_t hash) { return (hash >> (64 - local_depth_) & 1) == 0; };
 
+  // The filter is rebuilt from the keys that stay, the moved keys are added to dest_right's
+  // filter by InsertUniq.
+  filter_.Clear();
+
   for (unsigned i = 0; i < kRegularBucketCnt; ++i) {
     uint32_t invalid_mask = 0;
 
@@ -1224,8 +1437,10 @@ void Segment<Key, Value, Policy>::Split(HFunc&& hfn, Segment* dest_right) {
 
       // we extract local_depth bits from the left part of the hash. Since we extended local_depth,
       // we added an additional bit to the right, therefore we need to look at lsb of the extract.
-      if (is_mine(hash))
+      if (is_mine(hash)) {
+        filter_.Add(hash);
         return;  // keep this key in the source
+      }
 
       invalid_mask |= (1u << slot);
 
@@ -1274,6 +1489,8 @@ void Segment<Key, Value, Policy>::Split(HFunc&& hfn, Segment* dest_right) {
       Hash_t hash = hfn(key);
 
       if (is_mine(hash)) {
+        filter_.Add(hash);
+
         // If the entry stays in the same segment we try to unload it back to the regular bucket.
         Iterator it = TryMoveFromStash(i, slot, hash);
         if (it.found()) {
@@ -1304,6 +1521,27 @@ void Segment<Key, Value, Policy>::Split(HFunc&& hfn, Segment* dest_right) {
   }
 }
 
+template <typename Key, typename Value, typename Policy>
+template <typename HFunc>
+bool Segment<Key, Value, Policy>::CanMoveFrom(HFunc&& hfunc, const Segment& src) const {
+  uint8_t needed[kRegularBucketCnt] = {0};
+
+  for (unsigned bid = 0; bid < kTotalBuckets; ++bid) {
+    const Bucket& src_bucket = src.bucket_[bid];
+    uint32_t mask = src_bucket.GetBusy();
+    while (mask) {
+      unsigned slot = __builtin_ctz(mask);
+      mask &= mask - 1;
+
+      unsigned home = BucketIndex(hfunc(src_bucket.key[slot]));
+      if (bucket_[home].Size() + (++needed[home]) > NUM_SLOTS)
+        return false;
+    }
+  }
+
+  return true;
+}
+
 template <typename Key, typename Value, typename Policy>
 template <typename HFunc>
 void Segment<Key, Value, Policy>::MoveFrom(HFunc&& hfunc, Segment* src) {
@@ -1385,6 +1623,10 @@ auto Segment<Key, Value, Policy>::InsertUniq(U&& key, V&& value, Hash_t key_hash
   Bucket& neighbor = bucket_[nid];
   Bucket* insert_first = &target;
 
+  // If the segment is full, the key stays in the filter as a false positive until the split
+  // rebuilds it.
+  filter_.Add(key_hash);
+
   uint8_t meta_hash = key_hash & kFpMask;
   unsigned ts = target.Size(), ns = neighbor.Size();
   bool probe = false;
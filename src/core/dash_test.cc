@@ -480,6 +480,7 @@ TEST_F(DashTest, Reserve) {
   for (unsigned i = 0; i <= bc * 2; ++i) {
     dt_.Reserve(i);
     ASSERT_GE((1 << dt_.depth()) * Dash64::kSegCapacity, i);
+    ASSERT_GE(dt_.capacity(), i);
   }
 }
 
@@ -522,6 +523,187 @@ TEST_F(DashTest, Insert) {
   ASSERT_TRUE(dt_.Find(some_val).is_done());
 }
 
+TEST_F(DashTest, FindBatch) {
+  constexpr size_t kNumItems = 10000;
+  for (size_t i = 0; i < kNumItems; ++i) {
+    dt_.Insert(i * 2, i);
+  }
+
+  vector<uint64_t> keys(kNumItems * 2 + 7);
+  for (size_t i = 0; i < keys.size(); ++i) {
+    keys[i] = i;
+  }
+
+  vector<Dash64::const_iterator> res(keys.size());
+  dt_.FindBatch(keys.data(), keys.size(), res.data());
+
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (i % 2 == 0 && i < kNumItems * 2) {
+      ASSERT_FALSE(res[i].is_done()) << i;
+      ASSERT_EQ(i, res[i]->first);
+      ASSERT_EQ(i / 2, res[i]->second);
+    } else {
+      ASSERT_TRUE(res[i].is_done()) << i;
+    }
+  }
+}
+
+TEST_F(DashTest, SegmentFilter) {
+  constexpr unsigned kNumKeys = 840;
+  detail::SegmentFilter<16> filter;
+  filter.Clear();
+  for (uint64_t i = 0; i < kNumKeys; ++i) {
+    filter.Add(UInt64Policy::HashFn(i));
+  }
+
+  unsigned positives = 0;
+  for (uint64_t i = 0; i < kNumKeys * 10; ++i) {
+    bool res = filter.MayContain(UInt64Policy::HashFn(i));
+    if (i < kNumKeys) {
+      ASSERT_TRUE(res) << i;
+    } else {
+      positives += res;
+    }
+  }
+  EXPECT_LT(positives, kNumKeys * 9 / 10);
+
+  filter.OnDelete();
+  EXPECT_EQ(1u, filter.deletions());
+  filter.Clear();
+  EXPECT_EQ(0u, filter.deletions());
+  EXPECT_FALSE(filter.MayContain(UInt64Policy::HashFn(0)));
+}
+
+struct FilterPolicy : public UInt64Policy {
+  static constexpr unsigned kFilterBlocks = 16;
+};
+
+TEST_F(DashTest, Filter) {
+  using FilterDash = DashTable<uint64_t, uint64_t, FilterPolicy>;
+  static_assert(FilterDash::kSegBytes > Dash64::kSegBytes);
+
+  constexpr size_t kNumItems = 20000;
+  FilterDash dt;
+  for (size_t i = 0; i < kNumItems; ++i) {
+    dt.Insert(i, i);
+  }
+  ASSERT_GT(dt.unique_segments(), 1u);
+
+  for (size_t i = 0; i < kNumItems * 2; ++i) {
+    auto it = dt.Find(i);
+    ASSERT_EQ(i < kNumItems, !it.is_done()) << i;
+  }
+
+  // Deletions rebuild the filters, the remaining keys must stay visible.
+  for (size_t i = 0; i < kNumItems; ++i) {
+    if (i % 4 != 0)
+      ASSERT_EQ(1u, dt.Erase(i));
+  }
+
+  for (size_t i = 0; i < kNumItems; ++i) {
+    auto it = dt.Find(i);
+    ASSERT_EQ(i % 4 == 0, !it.is_done()) << i;
+  }
+
+  for (size_t i = 0; i < kNumItems; ++i) {
+    if (i % 4 != 0)
+      dt.Insert(i, i);
+  }
+  EXPECT_EQ(kNumItems, dt.size());
+  for (size_t i = 0; i < kNumItems; ++i) {
+    ASSERT_FALSE(dt.Find(i).is_done()) << i;
+  }
+}
+
+TEST_F(DashTest, MergeSegments) {
+  constexpr size_t kNumItems = 100000;
+  for (size_t i = 0; i < kNumItems; ++i) {
+    dt_.Insert(i, i);
+  }
+
+  unsigned segments = dt_.unique_segments();
+  unsigned depth = dt_.depth();
+  ASSERT_GT(segments, 16u);
+
+  // Nothing can be merged when the table is full.
+  for (size_t i = 0; i < dt_.GetSegmentCount(); i = dt_.NextSeg(i)) {
+    ASSERT_FALSE(dt_.Merge(i, 0.5));
+  }
+
+  for (size_t i = 0; i < kNumItems; ++i) {
+    if (i % 10 != 0)
+      dt_.Erase(i);
+  }
+
+  unsigned merged = 0;
+  bool progress = true;
+  while (progress) {
+    progress = false;
+    for (size_t i = 0; i < dt_.GetSegmentCount(); i = dt_.NextSeg(i)) {
+      if (dt_.Merge(i, 0.5)) {
+        ++merged;
+        progress = true;
+        break;
+      }
+    }
+  }
+
+  EXPECT_GT(merged, 0u);
+  EXPECT_EQ(segments - merged, dt_.unique_segments());
+  EXPECT_LT(dt_.depth(), depth);
+  EXPECT_EQ(kNumItems / 10, dt_.size());
+
+  for (size_t i = 0; i < kNumItems; ++i) {
+    auto it = dt_.Find(i);
+    if (i % 10 == 0) {
+      ASSERT_FALSE(it.is_done()) << i;
+      ASSERT_EQ(i, it->second);
+    } else {
+      ASSERT_TRUE(it.is_done()) << i;
+    }
+  }
+
+  size_t traversed = 0;
+  auto cb = [&](auto it) { ++traversed; };
+  Dash64::Cursor cursor;
+  do {
+    cursor = dt_.Traverse(cursor, cb);
+  } while (cursor);
+  EXPECT_EQ(kNumItems / 10, traversed);
+}
+
+TEST_F(DashTest, TraverseDuringMerge) {
+  constexpr size_t kNumItems = 100000;
+  for (size_t i = 0; i < kNumItems; ++i) {
+    dt_.Insert(i, i);
+  }
+  for (size_t i = 0; i < kNumItems; ++i) {
+    if (i % 10 != 0)
+      dt_.Erase(i);
+  }
+
+  // Merges segments while the traversal is in progress. Every entry must be visited at least
+  // once, though the merges may cause some to be visited twice.
+  set<uint64_t> seen;
+  auto cb = [&](auto it) { seen.insert(it->first); };
+  Dash64::Cursor cursor;
+  unsigned merged = 0;
+  size_t merge_sid = 0;
+  do {
+    cursor = dt_.Traverse(cursor, cb);
+    for (unsigned j = 0; j < 4; ++j) {
+      merged += dt_.Merge(merge_sid, 0.5);
+      // Merges may shrink the directory.
+      merge_sid = merge_sid < dt_.GetSegmentCount() ? dt_.NextSeg(merge_sid) : 0;
+      if (merge_sid >= dt_.GetSegmentCount())
+        merge_sid = 0;
+    }
+  } while (cursor);
+
+  EXPECT_GT(merged, 0u);
+  EXPECT_EQ(kNumItems / 10, seen.size());
+}
+
 TEST_F(DashTest, Traverse) {
   constexpr auto kNumItems = 50;
   for (size_t i = 0; i < kNumItems; ++i) {
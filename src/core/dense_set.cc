@@ -25,8 +25,15 @@ constexpr size_t kMinSizeShift = 2;
 constexpr size_t kMinSize = 1 << kMinSizeShift;
 constexpr bool kAllowDisplacements = true;
 
+// Tables with at least that many buckets grow incrementally.
+constexpr size_t kMinRehashSize = 1 << 14;
+
+// Number of old buckets migrated by each mutation while rehashing.
+constexpr unsigned kRehashBucketsPerStep = 4;
+
 DenseSet::IteratorBase::IteratorBase(const DenseSet* owner, bool is_end)
     : owner_(const_cast<DenseSet*>(owner)), curr_entry_(nullptr) {
+  // While rehashing, the iteration continues into old_entries_ after entries_ is exhausted.
   curr_list_ = is_end ? owner_->entries_.end() : owner_->entries_.begin();
 
   // Even if `is_end` is `false`, the list can be empty.
@@ -57,29 +64,37 @@ void DenseSet::IteratorBase::Advance() {
   }
 
   if (!step_link) {
-    DCHECK(curr_list_ != owner_->entries_.end());
-    do {
+    DCHECK(curr_list_ != ListEnd());
+    while (true) {
       ++curr_list_;
-      if (curr_list_ == owner_->entries_.end()) {
-        curr_entry_ = nullptr;
-        owner_ = nullptr;
-        return;
+      if (curr_list_ == ListEnd()) {
+        if (in_old_ || !owner_->IsRehashing()) {
+          // end() iterators always point to the end of entries_.
+          curr_list_ = owner_->entries_.end();
+          curr_entry_ = nullptr;
+          owner_ = nullptr;
+          in_old_ = false;
+          return;
+        }
+        in_old_ = true;
+        curr_list_ = owner_->old_entries_.begin();
       }
       owner_->ExpireIfNeeded(nullptr, &(*curr_list_));
-    } while (curr_list_->IsEmpty());
-    DCHECK(curr_list_ != owner_->entries_.end());
+      if (!curr_list_->IsEmpty())
+        break;
+    }
     curr_entry_ = &(*curr_list_);
   }
   DCHECK(!curr_entry_->IsEmpty());
 }
 
-DenseSet::DenseSet(MemoryResource* mr) : entries_(mr) {
+DenseSet::DenseSet(MemoryResource* mr) : entries_(mr), old_entries_(mr) {
 }
 
 DenseSet::~DenseSet() {
   // We can not call Clear from the base class because it internally calls ObjDelete which is
   // a virtual function. Therefore, destructor of the derived classes must clean up the table.
-  CHECK(entries_.empty());
+  CHECK(entries_.empty() && old_entries_.empty());
 }
 
 size_t DenseSet::PushFront(DenseSet::ChainVectorIterator it, void* data, bool has_ttl) {
@@ -167,6 +182,14 @@ void* DenseSet::PopDataFront(DenseSet::ChainVectorIterator it) {
 }
 
 void DenseSet::ClearInternal() {
+  for (auto it = old_entries_.begin(); it != old_entries_.end(); ++it) {
+    while (!it->IsEmpty()) {
+      bool has_ttl = it->HasTtl();
+      ObjDelete(PopDataFront(it), has_ttl);
+    }
+  }
+  ReleaseOldTable();
+
   for (auto it = entries_.begin(); it != entries_.end(); ++it) {
     while (!it->IsEmpty()) {
       bool has_ttl = it->HasTtl();
@@ -197,6 +220,39 @@ bool DenseSet::Equal(DensePtr dptr, const void* ptr, uint32_t cookie) const {
   return ObjEqual(dptr.GetObject(), ptr, cookie);
 }
 
+bool DenseSet::VisitOldBuckets(uint32_t bid, const ItemCb* cb) const {
+  if (rehash_cursor_ == old_entries_.size())
+    return false;
+
+  auto& old_entries = const_cast<DenseSet*>(this)->old_entries_;
+  uint32_t old_bid = bid >> (capacity_log_ - old_capacity_log_);
+  uint32_t start = std::max<uint32_t>(old_bid, 1) - 1;
+  uint32_t end = std::min<uint32_t>(old_bid + 2, old_entries.size());
+  bool found = false;
+
+  for (uint32_t i = std::max(start, rehash_cursor_); i < end; ++i) {
+    DensePtr* curr = &old_entries[i];
+    ExpireIfNeeded(nullptr, curr);
+
+    while (!curr->IsEmpty()) {
+      const void* obj = curr->GetObject();
+      if (BucketId(obj, 0) == bid) {
+        if (!cb)
+          return true;
+        (*cb)(obj);
+        found = true;
+      }
+
+      if (!curr->IsLink())
+        break;
+      if (ExpireIfNeeded(curr, &curr->AsLink()->next) && !curr->IsLink())
+        break;
+      curr = &curr->AsLink()->next;
+    }
+  }
+  return found;
+}
+
 bool DenseSet::NoItemBelongsBucket(uint32_t bid) const {
   auto& entries = const_cast<DenseSet*>(this)->entries_;
   DensePtr* curr = &entries[bid];
@@ -256,7 +312,17 @@ void DenseSet::Reserve(size_t sz) {
 
   sz = absl::bit_ceil(sz);
   if (sz > entries_.size()) {
+    if (IsRehashing()) {
+      MigrateNext(old_entries_.size());
+      ReleaseOldTable();
+    }
+
     size_t prev_size = entries_.size();
+    if (prev_size >= kMinRehashSize) {
+      StartRehash(sz);
+      return;
+    }
+
     entries_.resize(sz);
     capacity_log_ = absl::bit_width(sz) - 1;
     Grow(prev_size);
@@ -264,6 +330,8 @@ void DenseSet::Reserve(size_t sz) {
 }
 
 void DenseSet::Grow(size_t prev_size) {
+  DCHECK(!IsRehashing());
+
   // perform rehashing of items in the set
   for (long i = prev_size - 1; i >= 0; --i) {
     DensePtr* curr = &entries_[i];
@@ -281,7 +349,7 @@ void DenseSet::Grow(size_t prev_size) {
         break;
       void* ptr = curr->GetObject();
 
-      DCHECK(ptr != nullptr && ObjectAllocSize(ptr));
+      DCHECK(ptr != nullptr);
 
       uint32_t bid = BucketId(ptr, 0);
 
@@ -312,7 +380,7 @@ void DenseSet::Grow(size_t prev_size) {
             // we want to make *prev a DensePtr instead of DenseLink and we
             // want to deallocate the link.
             DensePtr tmp = DensePtr::From(plink);
-            DCHECK(ObjectAllocSize(tmp.GetObject()));
+            DCHECK(tmp.GetObject() != nullptr);
 
             FreeLink(plink);
             *prev = tmp;
@@ -337,9 +405,7 @@ void DenseSet::Grow(size_t prev_size) {
   }
 }
 
-auto DenseSet::AddOrFindDense(void* ptr, bool has_ttl) -> DensePtr* {
-  uint64_t hc = Hash(ptr, 0);
-
+auto DenseSet::AddOrFindDense(void* ptr, bool has_ttl, uint64_t hc) -> DensePtr* {
   if (entries_.empty()) {
     capacity_log_ = kMinSizeShift;
     entries_.resize(kMinSize);
@@ -354,6 +420,8 @@ auto DenseSet::AddOrFindDense(void* ptr, bool has_ttl) -> DensePtr* {
 
   // if the value is already in the set exit early
   uint32_t bucket_id = BucketId(hc);
+  if (IsRehashing())
+    MigrateAround(bucket_id);
   DensePtr* dptr = Find(ptr, bucket_id, 0).second;
   if (dptr != nullptr) {
     return dptr;
@@ -363,8 +431,74 @@ auto DenseSet::AddOrFindDense(void* ptr, bool has_ttl) -> DensePtr* {
   return nullptr;
 }
 
-// Assumes that the object does not exist in the set.
-void DenseSet::AddUnique(void* obj, bool has_ttl, uint64_t hashcode) {
+void DenseSet::StartRehash(size_t new_size) {
+  DCHECK(old_entries_.empty());
+  DCHECK_GT(new_size, entries_.size());
+
+  entries_.swap(old_entries_);
+  entries_.resize(new_size);
+  old_capacity_log_ = capacity_log_;
+  capacity_log_ = absl::bit_width(new_size) - 1;
+  rehash_cursor_ = 0;
+}
+
+void DenseSet::RehashStep() {
+  MigrateNext(kRehashBucketsPerStep);
+  if (rehash_cursor_ == old_entries_.size())
+    ReleaseOldTable();
+}
+
+void DenseSet::MigrateNext(size_t max_buckets) {
+  for (size_t i = 0; i < max_buckets && rehash_cursor_ < old_entries_.size(); ++i) {
+    MigrateBucket(rehash_cursor_++);
+  }
+}
+
+void DenseSet::MigrateAround(uint32_t bid) {
+  if (rehash_cursor_ == old_entries_.size())
+    return;
+
+  // bid maps to a single old bucket but its entries could be displaced to the neighbours.
+  uint32_t old_bid = bid >> (capacity_log_ - old_capacity_log_);
+  uint32_t start = std::max<uint32_t>(old_bid, 1) - 1;
+  uint32_t end = std::min<uint32_t>(old_bid + 2, old_entries_.size());
+
+  for (uint32_t i = std::max(start, rehash_cursor_); i < end; ++i) {
+    MigrateBucket(i);
+  }
+}
+
+void DenseSet::MigrateBucket(uint32_t old_bid) {
+  ChainVectorIterator it = old_entries_.begin() + old_bid;
+
+  while (true) {
+    ExpireIfNeeded(nullptr, &(*it));
+    if (it->IsEmpty())
+      break;
+
+    if (it->IsObject())
+      --num_used_buckets_;
+
+    bool has_ttl = it->HasTtl();
+    void* obj = PopDataFront(it);
+    obj_malloc_used_ -= ObjectAllocSize(obj);
+    --size_;
+
+    // The new array is at least twice as large as the old one and each mutation migrates
+    // a few buckets, so the migration completes long before the new array fills up.
+    DCHECK_LT(size_, entries_.size());
+    InsertUnique(obj, has_ttl, Hash(obj, 0));
+  }
+}
+
+void DenseSet::ReleaseOldTable() {
+  old_entries_.clear();
+  old_entries_.shrink_to_fit();
+  rehash_cursor_ = 0;
+  old_capacity_log_ = 0;
+}
+
+void DenseSet::InsertUnique(void* obj, bool has_ttl, uint64_t hashcode) {
   if (entries_.empty()) {
     capacity_log_ = kMinSizeShift;
     entries_.resize(kMinSize);
@@ -392,11 +526,19 @@ void DenseSet::AddUnique(void* obj, bool has_ttl, uint64_t hashcode) {
       break;
     }
 
-    size_t prev_size = entries_.size();
-    entries_.resize(prev_size * 2);
-    ++capacity_log_;
+    if (IsRehashing()) {
+      MigrateNext(old_entries_.size());
+      ReleaseOldTable();
+    }
 
-    Grow(prev_size);
+    size_t prev_size = entries_.size();
+    if (prev_size >= kMinRehashSize) {
+      StartRehash(prev_size * 2);
+    } else {
+      entries_.resize(prev_size * 2);
+      ++capacity_log_;
+      Grow(prev_size);
+    }
     bucket_id = BucketId(hashcode);
   }
 
@@ -435,11 +577,20 @@ void DenseSet::AddUnique(void* obj, bool has_ttl, uint64_t hashcode) {
   ++size_;
 }
 
-auto DenseSet::Find2(const void* ptr, uint32_t bid, uint32_t cookie)
+auto DenseSet::FindOld(const void* ptr, uint32_t bid, uint32_t cookie)
     -> tuple<size_t, DensePtr*, DensePtr*> {
-  DCHECK_LT(bid, entries_.size());
+  if (!IsRehashing())
+    return {0, nullptr, nullptr};
+
+  uint32_t old_bid = bid >> (capacity_log_ - old_capacity_log_);
+  return FindInTable(old_entries_, ptr, old_bid, cookie);
+}
 
-  DensePtr* curr = &entries_[bid];
+auto DenseSet::FindInTable(ChainVector& table, const void* ptr, uint32_t bid, uint32_t cookie)
+    -> tuple<size_t, DensePtr*, DensePtr*> {
+  DCHECK_LT(bid, table.size());
+
+  DensePtr* curr = &table[bid];
   ExpireIfNeeded(nullptr, curr);
 
   if (Equal(*curr, ptr, cookie)) {
@@ -448,7 +599,7 @@ auto DenseSet::Find2(const void* ptr, uint32_t bid, uint32_t cookie)
 
   // first look for displaced nodes since this is quicker than iterating a potential long chain
   if (bid > 0) {
-    curr = &entries_[bid - 1];
+    curr = &table[bid - 1];
     ExpireIfNeeded(nullptr, curr);
 
     if (Equal(*curr, ptr, cookie)) {
@@ -456,8 +607,8 @@ auto DenseSet::Find2(const void* ptr, uint32_t bid, uint32_t cookie)
     }
   }
 
-  if (bid + 1 < entries_.size()) {
-    curr = &entries_[bid + 1];
+  if (bid + 1 < table.size()) {
+    curr = &table[bid + 1];
     ExpireIfNeeded(nullptr, curr);
 
     if (Equal(*curr, ptr, cookie)) {
@@ -466,10 +617,12 @@ auto DenseSet::Find2(const void* ptr, uint32_t bid, uint32_t cookie)
   }
 
   // if the node is not displaced, search the correct chain
-  DensePtr* prev = &entries_[bid];
+  DensePtr* prev = &table[bid];
   curr = prev->Next();
   while (curr != nullptr) {
-    ExpireIfNeeded(prev, curr);
+    // If the last entry of the chain expired, it was freed together with the link of prev.
+    if (ExpireIfNeeded(prev, curr) && !prev->IsLink())
+      break;
 
     if (Equal(*curr, ptr, cookie)) {
       return {bid, prev, curr};
@@ -495,7 +648,7 @@ void DenseSet::Delete(DensePtr* prev, DensePtr* ptr) {
 
       DenseLinkKey* plink = prev->AsLink();
       DensePtr tmp = DensePtr::From(plink);
-      DCHECK(ObjectAllocSize(tmp.GetObject()));
+      DCHECK(tmp.GetObject() != nullptr);
 
       FreeLink(plink);
       *prev = tmp;
@@ -517,20 +670,38 @@ void DenseSet::Delete(DensePtr* prev, DensePtr* ptr) {
 
 void* DenseSet::PopInternal() {
   ChainVectorIterator bucket_iter = entries_.begin();
+  bool found = false;
 
-  // find the first non-empty chain
-  do {
-    while (bucket_iter != entries_.end() && bucket_iter->IsEmpty()) {
-      ++bucket_iter;
+  // While rehashing, pop from the old array first. Its buckets below rehash_cursor_ are empty.
+  while (rehash_cursor_ < old_entries_.size()) {
+    bucket_iter = old_entries_.begin() + rehash_cursor_;
+    ExpireIfNeeded(nullptr, &(*bucket_iter));
+    if (!bucket_iter->IsEmpty()) {
+      found = true;
+      break;
     }
+    ++rehash_cursor_;
+  }
 
-    // empty set
-    if (bucket_iter == entries_.end()) {
-      return nullptr;
-    }
+  if (!found) {
+    if (IsRehashing())
+      ReleaseOldTable();
 
-    ExpireIfNeeded(nullptr, &(*bucket_iter));
-  } while (bucket_iter->IsEmpty());
+    // find the first non-empty chain
+    bucket_iter = entries_.begin();
+    do {
+      while (bucket_iter != entries_.end() && bucket_iter->IsEmpty()) {
+        ++bucket_iter;
+      }
+
+      // empty set
+      if (bucket_iter == entries_.end()) {
+        return nullptr;
+      }
+
+      ExpireIfNeeded(nullptr, &(*bucket_iter));
+    } while (bucket_iter->IsEmpty());
+  }
 
   if (bucket_iter->IsObject()) {
     --num_used_buckets_;
@@ -544,8 +715,8 @@ void* DenseSet::PopInternal() {
   return ret;
 }
 
-void* DenseSet::AddOrReplaceObj(void* obj, bool has_ttl) {
-  DensePtr* ptr = AddOrFindDense(obj, has_ttl);
+void* DenseSet::AddOrReplaceObj(void* obj, bool has_ttl, uint64_t hashcode) {
+  DensePtr* ptr = AddOrFindDense(obj, has_ttl, hashcode);
   if (!ptr)
     return nullptr;
 
@@ -590,11 +761,17 @@ uint32_t DenseSet::Scan(uint32_t cursor, const ItemCb& cb) const {
 
   // First find the bucket to scan, skip empty buckets.
   // A bucket is empty if the current index is empty and the data is not displaced
-  // to the right or to the left.
-  while (entries_idx < entries_.size() && NoItemBelongsBucket(entries_idx)) {
+  // to the right or to the left. While rehashing, the entries of the bucket that were not
+  // migrated yet are still in old_entries_, so they are reported together with the bucket.
+  while (entries_idx < entries_.size()) {
+    if (!NoItemBelongsBucket(entries_idx) || VisitOldBuckets(entries_idx, nullptr))
+      break;
     ++entries_idx;
   }
 
+  if (entries_idx < entries_.size())
+    VisitOldBuckets(entries_idx, &cb);
+
   if (entries_idx == entries_.size()) {
     return 0;
   }
@@ -647,6 +824,63 @@ uint32_t DenseSet::Scan(uint32_t cursor, const ItemCb& cb) const {
   return entries_idx << (32 - capacity_log_);
 }
 
+size_t DenseSet::ClearStep(size_t max_elements) {
+  if (IsRehashing()) {  // Rare, not worth handling both tables.
+    size_t res = size_;
+    ClearInternal();
+    return res;
+  }
+
+  size_t deleted = 0;
+  while (deleted < max_elements && !entries_.empty()) {
+    auto it = entries_.end() - 1;
+    while (deleted < max_elements && !it->IsEmpty()) {
+      bool has_ttl = it->HasTtl();
+      ObjDelete(PopDataFront(it), has_ttl);
+      ++deleted;
+    }
+    if (!it->IsEmpty())
+      break;
+    entries_.pop_back();
+  }
+
+  size_ -= std::min<size_t>(size_, deleted);
+  if (entries_.empty())
+    ClearInternal();  // resets the counters.
+  return deleted;
+}
+
+auto DenseSet::ExpireStep(uint32_t cursor, unsigned max_buckets) -> ExpireStepResult {
+  ExpireStepResult res;
+  if (capacity_log_ == 0)
+    return res;
+
+  uint32_t entries_idx = cursor >> (32 - capacity_log_);
+  for (; res.visited < max_buckets && entries_idx < entries_.size(); ++entries_idx) {
+    ++res.visited;
+    if (IsRehashing())
+      MigrateAround(entries_idx);
+
+    DensePtr* curr = &entries_[entries_idx];
+    ExpireIfNeeded(nullptr, curr);
+
+    while (!curr->IsEmpty()) {
+      res.ttl_seen |= curr->HasTtl();
+      if (!curr->IsLink())
+        break;
+
+      DensePtr* next = &curr->AsLink()->next;
+      if (ExpireIfNeeded(curr, next) && !curr->IsLink())
+        break;
+      curr = next;
+    }
+  }
+
+  if (entries_idx < entries_.size())
+    res.cursor = entries_idx << (32 - capacity_log_);
+  return res;
+}
+
 auto DenseSet::NewLink(void* data, DensePtr next) -> DenseLinkKey* {
   LinkAllocator la(mr());
   DenseLinkKey* lk = la.allocate(1);
@@ -673,6 +907,10 @@ bool DenseSet::ExpireIfNeededInternal(DensePtr* prev, DensePtr* node) const {
     // updates the *node to next item if relevant or resets it to empty.
     const_cast<DenseSet*>(this)->Delete(prev, node);
     deleted = true;
+
+    // node was the last entry of the chain and it was freed together with the link of prev.
+    if (prev && !prev->IsLink())
+      break;
   } while (node->HasTtl());
 
   return deleted;
@@ -36,6 +36,12 @@ namespace dfly {
 // 75% utilization: N*1.33*8 + 0.12N*16 = 13N or ~22 bytes savings per record.
 // with potential replacements of hset/zset data structures.
 // static_assert(sizeof(dictEntry) == 24);
+//
+// Large tables grow incrementally: the bucket array is replaced with a larger one and the
+// entries of the old array are migrated a few buckets at a time by the subsequent mutations
+// and Scan calls. Lookups first migrate the old buckets that may hold the looked up key,
+// so the key is always searched in the new array only. Iteration (begin()) completes the
+// migration upfront since it visits all the entries anyway.
 
 class DenseSet {
   struct DenseLinkKey;
@@ -171,6 +177,7 @@ class DenseSet {
  protected:
   using LinkAllocator = PMR_NS::polymorphic_allocator<DenseLinkKey>;
   using DensePtrAllocator = PMR_NS::polymorphic_allocator<DensePtr>;
+  using ChainVector = std::vector<DensePtr, DensePtrAllocator>;
   using ChainVectorIterator = std::vector<DensePtr, DensePtrAllocator>::iterator;
   using ChainVectorConstIterator = std::vector<DensePtr, DensePtrAllocator>::const_iterator;
 
@@ -178,8 +185,8 @@ class DenseSet {
     friend class DenseSet;
 
    public:
-    IteratorBase(DenseSet* owner, ChainVectorIterator list_it, DensePtr* e)
-        : owner_(owner), curr_list_(list_it), curr_entry_(e) {
+    IteratorBase(DenseSet* owner, ChainVectorIterator list_it, DensePtr* e, bool in_old = false)
+        : owner_(owner), curr_list_(list_it), curr_entry_(e), in_old_(in_old) {
     }
 
     // returns the expiry time of the current entry or UINT32_MAX if no ttl is set.
@@ -199,9 +206,14 @@ class DenseSet {
 
     void Advance();
 
+    ChainVectorIterator ListEnd() const {
+      return in_old_ ? owner_->old_entries_.end() : owner_->entries_.end();
+    }
+
     DenseSet* owner_;
     ChainVectorIterator curr_list_;
     DensePtr* curr_entry_;
+    bool in_old_ = false;  // curr_list_ points into old_entries_.
   };
 
  public:
@@ -236,7 +248,13 @@ class DenseSet {
   }
 
   size_t SetMallocUsed() const {
-    return entries_.capacity() * sizeof(DensePtr) + num_links_ * sizeof(DenseLinkKey);
+    return (entries_.capacity() + old_entries_.capacity()) * sizeof(DensePtr) +
+           num_links_ * sizeof(DenseLinkKey);
+  }
+
+  // True if the table is being grown incrementally and the old bucket array is still around.
+  bool IsRehashing() const {
+    return !old_entries_.empty();
   }
 
   using ItemCb = std::function<void(const void*)>;
@@ -244,6 +262,21 @@ class DenseSet {
   uint32_t Scan(uint32_t cursor, const ItemCb& cb) const;
   void Reserve(size_t sz);
 
+  struct ExpireStepResult {
+    uint32_t cursor = 0;    // next cursor, 0 if the traversal is complete.
+    unsigned visited = 0;   // number of visited buckets.
+    bool ttl_seen = false;  // whether the visited buckets still hold entries with ttl.
+  };
+
+  // Deletes the expired entries of up to max_buckets buckets starting from cursor.
+  // Uses the same cursor semantics as Scan.
+  ExpireStepResult ExpireStep(uint32_t cursor, unsigned max_buckets);
+
+  // Deletes up to max_elements elements from the end of the table, for tearing down large
+  // sets in steps. The set must not be used otherwise until it is empty.
+  // Returns the number of deleted elements, 0 if the set is empty.
+  size_t ClearStep(size_t max_elements);
+
   // set an abstract time that allows expiry.
   void set_time(uint32_t val) {
     time_now_ = val;
@@ -268,7 +301,13 @@ class DenseSet {
   void CollectExpired();
 
   bool EraseInternal(void* obj, uint32_t cookie) {
-    auto [prev, found] = Find(obj, BucketId(obj, cookie), cookie);
+    uint32_t bid = BucketId(obj, cookie);
+    if (IsRehashing()) {
+      RehashStep();
+      MigrateAround(bid);
+    }
+
+    auto [prev, found] = Find(obj, bid, cookie);
     if (found) {
       Delete(prev, found);
       return true;
@@ -282,9 +321,15 @@ class DenseSet {
     if (Empty())
       return IteratorBase{};
 
-    auto [bid, _, curr] = Find2(ptr, BucketId(ptr, cookie), cookie);
+    uint32_t bid = BucketId(ptr, cookie);
+    auto [new_bid, _, curr] = Find2(ptr, bid, cookie);
     if (curr) {
-      return IteratorBase(this, entries_.begin() + bid, curr);
+      return IteratorBase(this, entries_.begin() + new_bid, curr);
+    }
+
+    auto [old_bid, old_prev, old_curr] = FindOld(ptr, bid, cookie);
+    if (old_curr) {
+      return IteratorBase(this, old_entries_.begin() + old_bid, old_curr, true);
     }
     return IteratorBase{};
   }
@@ -313,10 +358,28 @@ class DenseSet {
 
   // Returns the previous object if it has been replaced.
   // nullptr, if obj was added.
-  void* AddOrReplaceObj(void* obj, bool has_ttl);
+  void* AddOrReplaceObj(void* obj, bool has_ttl) {
+    return AddOrReplaceObj(obj, has_ttl, Hash(obj, 0));
+  }
+
+  // Same as above, with the hashcode of obj computed by the caller.
+  void* AddOrReplaceObj(void* obj, bool has_ttl, uint64_t hashcode);
 
   // Assumes that the object does not exist in the set.
-  void AddUnique(void* obj, bool has_ttl, uint64_t hashcode);
+  void AddUnique(void* obj, bool has_ttl, uint64_t hashcode) {
+    if (IsRehashing())
+      RehashStep();
+    InsertUnique(obj, has_ttl, hashcode);
+  }
+
+  // Bulk insertions hash all their keys up front and prefetch the buckets a few keys ahead
+  // of the one being inserted, so that the cache misses of the random bucket accesses overlap.
+  static constexpr unsigned kBulkPrefetchDistance = 8;
+
+  void PrefetchBucket(uint64_t hashcode) const {
+    if (!entries_.empty())
+      __builtin_prefetch(&entries_[BucketId(hashcode)]);
+  }
 
  private:
   DenseSet(const DenseSet&) = delete;
@@ -343,8 +406,36 @@ class DenseSet {
   // Return if bucket has no item which is not displaced and right/left bucket has no displaced item
   // belong to given bid
   bool NoItemBelongsBucket(uint32_t bid) const;
+
+  // While rehashing, calls cb for the objects of old_entries_ whose bucket in entries_ is bid.
+  // Returns true if there are such objects. If cb is null, returns on the first one found.
+  bool VisitOldBuckets(uint32_t bid, const ItemCb* cb) const;
   void Grow(size_t prev_size);
 
+  // Assumes that the object does not exist in the set. Grows the table if needed.
+  void InsertUnique(void* obj, bool has_ttl, uint64_t hashcode);
+
+  // ============ Incremental rehashing ==================
+  // Moves entries_ aside into old_entries_ and allocates a new bucket array of new_size.
+  void StartRehash(size_t new_size);
+
+  // Migrates a bounded number of old buckets. Releases the old array once all of them
+  // were migrated. Called by mutations.
+  void RehashStep();
+
+  // Migrates up to max_buckets old buckets starting from rehash_cursor_. Does not release
+  // the old array. Read paths never migrate, they look up both arrays instead.
+  void MigrateNext(size_t max_buckets);
+
+  // Migrates the old buckets that may hold entries of bucket bid in entries_. Mutations call it
+  // before looking up bid, so that they only need to search entries_.
+  void MigrateAround(uint32_t bid);
+
+  // Moves the entries of old_entries_[old_bid] into entries_.
+  void MigrateBucket(uint32_t old_bid);
+
+  void ReleaseOldTable();
+
   // ============ Pseudo Linked List Functions for interacting with Chains ==================
   size_t PushFront(ChainVectorIterator, void* obj, bool has_ttl);
   void PushFront(ChainVectorIterator, DensePtr);
@@ -354,7 +445,11 @@ class DenseSet {
 
   // Returns DensePtr if the object with such key already exists,
   // Returns null if obj was added.
-  DensePtr* AddOrFindDense(void* obj, bool has_ttl);
+  DensePtr* AddOrFindDense(void* obj, bool has_ttl) {
+    return AddOrFindDense(obj, has_ttl, Hash(obj, 0));
+  }
+
+  DensePtr* AddOrFindDense(void* obj, bool has_ttl, uint64_t hashcode);
 
   // ============ Pseudo Linked List in DenseSet end ==================
 
@@ -365,7 +460,18 @@ class DenseSet {
   }
 
   // returns bid and (prev, item) pair. If item is root, then prev is null.
-  std::tuple<size_t, DensePtr*, DensePtr*> Find2(const void* ptr, uint32_t bid, uint32_t cookie);
+  // Searches only entries_, see FindOld for the entries that were not migrated yet.
+  std::tuple<size_t, DensePtr*, DensePtr*> Find2(const void* ptr, uint32_t bid, uint32_t cookie) {
+    return FindInTable(entries_, ptr, bid, cookie);
+  }
+
+  // Same as Find2 but searches old_entries_ while rehashing. bid is the bucket in entries_,
+  // the returned bid is the bucket in old_entries_.
+  std::tuple<size_t, DensePtr*, DensePtr*> FindOld(const void* ptr, uint32_t bid,
+                                                   uint32_t cookie);
+
+  std::tuple<size_t, DensePtr*, DensePtr*> FindInTable(ChainVector& table, const void* ptr,
+                                                       uint32_t bid, uint32_t cookie);
 
   DenseLinkKey* NewLink(void* data, DensePtr next);
 
@@ -391,11 +497,17 @@ class DenseSet {
 
   std::vector<DensePtr, DensePtrAllocator> entries_;
 
+  // Non-empty while rehashing. Buckets below rehash_cursor_ are already migrated,
+  // the rest may be migrated out of order by MigrateAround.
+  std::vector<DensePtr, DensePtrAllocator> old_entries_;
+  uint32_t rehash_cursor_ = 0;
+
   mutable size_t obj_malloc_used_ = 0;
   mutable uint32_t size_ = 0;              // number of elements in the set.
   mutable uint32_t num_links_ = 0;         // number of links in the set.
   mutable uint32_t num_used_buckets_ = 0;  // number of buckets used in entries_ array.
   unsigned capacity_log_ = 0;
+  unsigned old_capacity_log_ = 0;
 
   uint32_t time_now_ = 0;
 
@@ -407,7 +519,10 @@ inline void* DenseSet::FindInternal(const void* obj, uint64_t hashcode, uint32_t
     return nullptr;
 
   uint32_t bid = BucketId(hashcode);
-  DensePtr* ptr = const_cast<DenseSet*>(this)->Find(obj, bid, cookie).second;
+  DenseSet* self = const_cast<DenseSet*>(this);
+  DensePtr* ptr = self->Find(obj, bid, cookie).second;
+  if (!ptr)
+    ptr = std::get<2>(self->FindOld(obj, bid, cookie));
   return ptr ? ptr->GetObject() : nullptr;
 }
 
@@ -118,4 +118,34 @@ optional<pair<size_t, size_t>> ExtentTree::GetRange(size_t len, size_t align) {
   return pair{aligned_start, range_end};
 }
 
+bool ExtentTree::Remove(size_t start, size_t len) {
+  DCHECK_GT(len, 0u);
+
+  // The extent that starts at or before start.
+  auto eit = extents_.upper_bound(start);
+  if (eit == extents_.begin())
+    return false;
+  --eit;
+
+  size_t extent_start = eit->first;
+  size_t extent_end = eit->second;
+  size_t range_end = start + len;
+  if (range_end > extent_end)
+    return false;
+
+  len_extents_.erase(pair{extent_end - extent_start, extent_start});
+  if (start > extent_start) {
+    eit->second = start;
+    len_extents_.emplace(start - extent_start, extent_start);
+  } else {
+    extents_.erase(eit);
+  }
+
+  if (range_end < extent_end) {
+    extents_.emplace(range_end, extent_end);
+    len_extents_.emplace(extent_end - range_end, range_end);
+  }
+  return true;
+}
+
 }  // namespace dfly
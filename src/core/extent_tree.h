@@ -22,6 +22,10 @@ class ExtentTree {
   // start is aligned by align.
   std::optional<std::pair<size_t, size_t>> GetRange(size_t len, size_t align);
 
+  // Removes [start, start + len) from the tree. Returns false if the range is not contained in
+  // a single extent, in which case the tree is unchanged.
+  bool Remove(size_t start, size_t len);
+
  private:
   absl::btree_map<size_t, size_t> extents_;                 // start -> end.
   absl::btree_set<std::pair<size_t, size_t>> len_extents_;  // (length, start)
@@ -55,4 +55,18 @@ TEST_F(ExtentTreeTest, Basic) {
   EXPECT_THAT(*op, testing::Pair(60, 92));
 }
 
+TEST_F(ExtentTreeTest, Remove) {
+  tree_.Add(0, 256);
+  EXPECT_TRUE(tree_.Remove(64, 64));
+  EXPECT_FALSE(tree_.Remove(96, 64));  // not free.
+  EXPECT_FALSE(tree_.Remove(256, 16));
+
+  auto op = tree_.GetRange(128, 1);
+  EXPECT_TRUE(op);
+  EXPECT_THAT(*op, testing::Pair(128, 256));
+
+  EXPECT_TRUE(tree_.Remove(0, 64));
+  EXPECT_FALSE(tree_.GetRange(1, 1));
+}
+
 }  // namespace dfly
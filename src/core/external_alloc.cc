@@ -390,11 +390,88 @@ void ExternalAllocator::Free(size_t offset, size_t sz) {
   allocated_bytes_ -= block_size;
 }
 
+bool ExternalAllocator::MallocAt(size_t offset, size_t sz) {
+  PageClass pc = detail::ClassFromSize(sz);
+  if (pc == PageClass::LARGE_P || offset >= capacity_)
+    return false;
+
+  size_t idx = offset / kSegmentSize;
+  if (idx >= segments_.size() || !segments_[idx]) {
+    if (!extent_tree_.Remove(idx * kSegmentSize, kSegmentSize))
+      return false;
+
+    SegmentDescr* seg = CreateSegment(pc, idx * kSegmentSize);
+    if (sq_[pc] == nullptr) {
+      sq_[pc] = seg;
+    } else {
+      sq_[pc]->LinkBefore(seg);
+    }
+  }
+
+  SegmentDescr* seg = segments_[idx];
+  if (seg->page_class() != pc)
+    return false;
+
+  BinIdx bin_idx = ToBinIdx(sz);
+  size_t block_size = ToBlockSize(bin_idx);
+  size_t page_size = 1ULL << seg->page_shift();
+  size_t delta = offset % kSegmentSize;
+  Page* page = seg->GetPage(delta >> seg->page_shift());
+  size_t block_offs = delta % page_size;
+  if (block_offs % block_size != 0 || block_offs / block_size >= page_size / block_size)
+    return false;
+
+  if (!page->segment_inuse) {
+    page->segment_inuse = 1;
+    ++seg->page_info_.used;
+    page->Init(pc, bin_idx);
+
+    // Full segments are not kept in the queue, see FindPage.
+    if (!seg->HasFreePages()) {
+      SegmentDescr* next = seg->Detach();
+      if (sq_[pc] == seg)
+        sq_[pc] = next;
+    }
+  } else if (page->block_size_bin != bin_idx) {
+    return false;
+  }
+
+  unsigned block_id = block_offs / block_size;
+  if (!page->free_blocks[block_id])
+    return false;
+
+  page->free_blocks.reset(block_id);
+  --page->available;
+  allocated_bytes_ += block_size;
+  return true;
+}
+
 void ExternalAllocator::AddStorage(size_t start, size_t size) {
   extent_tree_.Add(start, size);
   capacity_ += size;
 }
 
+vector<pair<size_t, size_t>> ExternalAllocator::GetSparsePages(double max_ratio) const {
+  vector<pair<size_t, size_t>> res;
+  for (SegmentDescr* seg : segments_) {
+    if (!seg)
+      continue;
+
+    size_t page_size = 1ULL << seg->page_shift();
+    for (unsigned i = 0; i < seg->capacity(); ++i) {
+      Page* page = seg->GetPage(i);
+      if (!page->segment_inuse || page->available == 0 ||
+          free_pages_[page->block_size_bin] == page)
+        continue;
+
+      size_t blocks_num = page_size / ToBlockSize(page->block_size_bin);
+      if (blocks_num - page->available <= max_ratio * blocks_num)
+        res.emplace_back(seg->BlockOffset(page, 0), page_size);
+    }
+  }
+  return res;
+}
+
 size_t ExternalAllocator::GoodSize(size_t sz) {
   uint8_t bin_idx = ToBinIdx(sz);
   if (bin_idx < kLargeSizeBin)
@@ -436,19 +513,7 @@ auto ExternalAllocator::FindPage(PageClass pc) -> Page* {
   if (op_range) {
     DCHECK_EQ(0u, op_range->first % kSegmentAlignment);
 
-    unsigned num_pages = NumPagesInSegment(pc);
-    size_t seg_idx = op_range->first / kSegmentAlignment;
-
-    if (segments_.size() > seg_idx) {
-      DCHECK(segments_[seg_idx] == nullptr);
-    } else {
-      segments_.resize(seg_idx + 1);
-    }
-
-    void* ptr =
-        mi_malloc_aligned(sizeof(SegmentDescr) + num_pages * sizeof(Page), kSegDescrAlignment);
-    SegmentDescr* seg = new (ptr) SegmentDescr(pc, op_range->first, num_pages);
-    segments_[seg_idx] = seg;
+    SegmentDescr* seg = CreateSegment(pc, op_range->first);
 
     DCHECK(sq_[pc] == NULL);
     DCHECK(seg->next == seg->prev && seg == seg->next);
@@ -460,6 +525,23 @@ auto ExternalAllocator::FindPage(PageClass pc) -> Page* {
   return nullptr;
 }
 
+auto ExternalAllocator::CreateSegment(PageClass pc, size_t offset) -> SegmentDescr* {
+  unsigned num_pages = NumPagesInSegment(pc);
+  size_t seg_idx = offset / kSegmentAlignment;
+
+  if (segments_.size() > seg_idx) {
+    DCHECK(segments_[seg_idx] == nullptr);
+  } else {
+    segments_.resize(seg_idx + 1);
+  }
+
+  void* ptr =
+      mi_malloc_aligned(sizeof(SegmentDescr) + num_pages * sizeof(Page), kSegDescrAlignment);
+  SegmentDescr* seg = new (ptr) SegmentDescr(pc, offset, num_pages);
+  segments_[seg_idx] = seg;
+  return seg;
+}
+
 int64_t ExternalAllocator::LargeMalloc(size_t size) {
   size_t align_sz = alignup(size, 4_KB);
   auto op_range = extent_tree_.GetRange(align_sz, 4_KB);
@@ -498,6 +580,27 @@ void ExternalAllocator::FreePage(Page* page, SegmentDescr* owner, size_t block_s
     }
   }
   --owner->page_info_.used;
+
+  if (owner->used() == 0)
+    ReleaseSegment(owner);
+}
+
+void ExternalAllocator::ReleaseSegment(SegmentDescr* seg) {
+  // The segment has free pages, hence it is linked into its class queue.
+  auto& sq = sq_[seg->page_class()];
+  SegmentDescr* next = seg->Detach();
+  if (sq == seg)
+    sq = next;
+
+  size_t offset = seg->offset_;
+  segments_[offset / kSegmentAlignment] = nullptr;
+  mi_free(seg);
+
+  if (hold_released_) {
+    released_.emplace_back(offset, kSegmentSize);
+  } else {
+    extent_tree_.Add(offset, kSegmentSize);
+  }
 }
 
 inline auto ExternalAllocator::ToSegDescr(Page* page) -> SegmentDescr* {
@@ -5,6 +5,7 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <utility>
 #include <vector>
 
 #include "core/extent_tree.h"
@@ -71,6 +72,12 @@ class ExternalAllocator {
 
   void Free(size_t offset, size_t sz);
 
+  // Allocates the block at offset as if it were returned by Malloc(sz), for restoring the
+  // allocations of existing storage. Returns false if the block is taken, lies outside of the
+  // storage or in a page of another block size, or if sz is above the medium page class.
+  // The pages populated this way only serve Free, new allocations use other pages.
+  bool MallocAt(size_t offset, size_t sz);
+
   /// Adds backing storage to the allocator. The range should not overlap with already
   /// added storage ranges.
   void AddStorage(size_t start, size_t size);
@@ -80,6 +87,27 @@ class ExternalAllocator {
   // No allocation is done.
   static size_t GoodSize(size_t sz);
 
+  // Returns the (offset, length) ranges of the pages whose share of used blocks is at most
+  // max_ratio, skipping the pages that serve new allocations. Such pages are not allocated from
+  // until they become free, hence moving their blocks elsewhere makes their space reusable.
+  std::vector<std::pair<size_t, size_t>> GetSparsePages(double max_ratio) const;
+
+  // If hold is true, the storage of segments that become free is not reused until it is
+  // returned with AddFreeRange. This lets the caller release the disk space of these ranges
+  // first. Otherwise it is reused immediately.
+  void set_hold_released(bool hold) {
+    hold_released_ = hold;
+  }
+
+  // Returns the ranges of the segments that became free since the previous call.
+  std::vector<std::pair<size_t, size_t>> TakeReleasedRanges() {
+    return std::move(released_);
+  }
+
+  void AddFreeRange(size_t start, size_t len) {
+    extent_tree_.Add(start, len);
+  }
+
   size_t capacity() const {
     return capacity_;
   }
@@ -98,7 +126,12 @@ class ExternalAllocator {
 
   int64_t LargeMalloc(size_t size);
   SegmentDescr* GetNewSegment(detail::PageClass sc);
+
+  // Creates the descriptor of the segment at offset, whose range is already taken from
+  // extent_tree_.
+  SegmentDescr* CreateSegment(detail::PageClass pc, size_t offset);
   void FreePage(Page* page, SegmentDescr* owner, size_t block_size);
+  void ReleaseSegment(SegmentDescr* seg);
 
   static SegmentDescr* ToSegDescr(Page*);
 
@@ -110,6 +143,9 @@ class ExternalAllocator {
 
   ExtentTree extent_tree_;
 
+  std::vector<std::pair<size_t, size_t>> released_;
+  bool hold_released_ = false;
+
   size_t capacity_ = 0;  // in bytes.
   size_t allocated_bytes_ = 0;
 };
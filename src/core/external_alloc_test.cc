@@ -117,4 +117,71 @@ TEST_F(ExternalAllocatorTest, Classes) {
   EXPECT_EQ(1_MB + 4_KB, ExternalAllocator::GoodSize(1_MB + 1));
 }
 
+TEST_F(ExternalAllocatorTest, SparsePages) {
+  ext_alloc_.AddStorage(0, kSegSize);
+
+  // Fills page0 and starts page1 with 8KB blocks.
+  vector<int64_t> offsets;
+  for (unsigned i = 0; i < 1_MB / 8_KB + 1; ++i) {
+    offsets.push_back(ext_alloc_.Malloc(8_KB));
+    ASSERT_GE(offsets.back(), 0);
+  }
+  EXPECT_EQ(1_MB, offsets.back());
+  EXPECT_TRUE(ext_alloc_.GetSparsePages(0.5).empty());
+
+  for (unsigned i = 0; i < 100; ++i) {
+    ext_alloc_.Free(offsets[i], 8_KB);
+  }
+
+  // page1 serves the allocations, hence it is not reported.
+  auto pages = ext_alloc_.GetSparsePages(0.5);
+  ASSERT_EQ(1u, pages.size());
+  EXPECT_EQ(0u, pages[0].first);
+  EXPECT_EQ(1_MB, pages[0].second);
+  EXPECT_TRUE(ext_alloc_.GetSparsePages(0.1).empty());
+}
+
+TEST_F(ExternalAllocatorTest, ReleaseSegment) {
+  ext_alloc_.AddStorage(0, kSegSize);
+  ext_alloc_.set_hold_released(true);
+
+  int64_t offs = ext_alloc_.Malloc(8_KB);
+  ASSERT_EQ(0, offs);
+  ext_alloc_.Free(offs, 8_KB);
+
+  // The free segment is not reused until it is returned.
+  EXPECT_EQ(-kSegSize, ext_alloc_.Malloc(8_KB));
+  auto ranges = ext_alloc_.TakeReleasedRanges();
+  ASSERT_EQ(1u, ranges.size());
+  EXPECT_EQ(0u, ranges[0].first);
+  EXPECT_EQ(size_t(kSegSize), ranges[0].second);
+  EXPECT_TRUE(ext_alloc_.TakeReleasedRanges().empty());
+
+  ext_alloc_.AddFreeRange(ranges[0].first, ranges[0].second);
+  EXPECT_EQ(0, ext_alloc_.Malloc(8_KB));
+  EXPECT_EQ(8_KB, ext_alloc_.allocated_bytes());
+}
+
+TEST_F(ExternalAllocatorTest, MallocAt) {
+  ext_alloc_.AddStorage(0, kSegSize * 2);
+  EXPECT_FALSE(ext_alloc_.MallocAt(kSegSize * 2, kMinBlockSize));  // outside of the storage.
+  EXPECT_FALSE(ext_alloc_.MallocAt(0, 2_MB));                      // large.
+
+  ASSERT_TRUE(ext_alloc_.MallocAt(kSegSize + 1_MB + 16_KB, 8_KB));
+  EXPECT_FALSE(ext_alloc_.MallocAt(kSegSize + 1_MB + 16_KB, 8_KB));  // taken.
+  EXPECT_FALSE(ext_alloc_.MallocAt(kSegSize + 1_MB + 4_KB, 8_KB));   // not a block boundary.
+  EXPECT_FALSE(ext_alloc_.MallocAt(kSegSize + 1_MB, kMinBlockSize));  // another block size.
+  EXPECT_FALSE(ext_alloc_.MallocAt(kSegSize, 512_KB));                // another page class.
+  EXPECT_EQ(8_KB, ext_alloc_.allocated_bytes());
+
+  // New allocations use other pages.
+  int64_t offs = ext_alloc_.Malloc(8_KB);
+  ASSERT_GE(offs, 0);
+  EXPECT_NE(size_t(offs / 1_MB), size_t(kSegSize + 1_MB) / 1_MB);
+
+  ext_alloc_.Free(kSegSize + 1_MB + 16_KB, 8_KB);
+  ext_alloc_.Free(offs, 8_KB);
+  EXPECT_EQ(0u, ext_alloc_.allocated_bytes());
+}
+
 }  // namespace dfly
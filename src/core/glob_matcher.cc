@@ -0,0 +1,65 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/glob_matcher.h"
+
+#include <absl/strings/match.h>
+#include <absl/strings/str_split.h>
+#include <string.h>
+
+extern "C" {
+#include "redis/util.h"
+}
+
+namespace dfly {
+
+using namespace std;
+
+GlobMatcher::GlobMatcher(string_view pattern, bool case_sensitive)
+    : pattern_(pattern), case_sensitive_(case_sensitive) {
+  if (!case_sensitive)
+    return;
+
+  size_t special = pattern.find_first_of("*?[\\");
+  prefix_ = pattern.substr(0, special);
+
+  if (pattern.find_first_of("?[\\") == string_view::npos) {
+    star_only_ = true;
+    literals_ = absl::StrSplit(pattern, '*');
+  }
+}
+
+bool GlobMatcher::Matches(string_view str) const {
+  if (!absl::StartsWith(str, prefix_))
+    return false;
+
+  // stringmatchlen does not match empty strings with stars, keep its behavior.
+  if (!star_only_ || str.empty()) {
+    return stringmatchlen(pattern_.data() + prefix_.size(), pattern_.size() - prefix_.size(),
+                          str.data() + prefix_.size(), str.size() - prefix_.size(),
+                          !case_sensitive_) == 1;
+  }
+
+  if (literals_.size() == 1)
+    return str.size() == prefix_.size();
+
+  const string& suffix = literals_.back();
+  if (str.size() < prefix_.size() + suffix.size() || !absl::EndsWith(str, suffix))
+    return false;
+
+  string_view middle = str.substr(prefix_.size(), str.size() - prefix_.size() - suffix.size());
+  for (size_t i = 1; i + 1 < literals_.size(); ++i) {
+    const string& literal = literals_[i];
+    if (literal.empty())
+      continue;
+
+    const void* pos = memmem(middle.data(), middle.size(), literal.data(), literal.size());
+    if (pos == nullptr)
+      return false;
+    middle.remove_prefix(static_cast<const char*>(pos) - middle.data() + literal.size());
+  }
+  return true;
+}
+
+}  // namespace dfly
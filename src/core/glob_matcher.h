@@ -0,0 +1,39 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace dfly {
+
+// GlobMatcher matches strings against a redis glob pattern, that is compiled once.
+//
+// Patterns with only literals and '*' are matched with prefix and suffix comparisons and a
+// memmem search for every literal in between. Other patterns check their literal prefix first
+// and fall back to stringmatchlen for the rest.
+class GlobMatcher {
+ public:
+  explicit GlobMatcher(std::string_view pattern, bool case_sensitive = true);
+
+  bool Matches(std::string_view str) const;
+
+  // The literal prefix that all the matching strings start with.
+  std::string_view prefix() const {
+    return prefix_;
+  }
+
+ private:
+  std::string pattern_;
+  std::string prefix_;
+  bool case_sensitive_;
+
+  // The literals between the stars, if the pattern has no other special characters.
+  bool star_only_ = false;
+  std::vector<std::string> literals_;
+};
+
+}  // namespace dfly
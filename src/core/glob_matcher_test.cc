@@ -0,0 +1,80 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/glob_matcher.h"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <string>
+
+extern "C" {
+#include "redis/util.h"
+}
+
+namespace dfly {
+
+using namespace std;
+
+class GlobMatcherTest : public ::testing::Test {};
+
+TEST_F(GlobMatcherTest, Literals) {
+  GlobMatcher exact("tenant:123");
+  EXPECT_TRUE(exact.Matches("tenant:123"));
+  EXPECT_FALSE(exact.Matches("tenant:1234"));
+  EXPECT_FALSE(exact.Matches("tenant:12"));
+
+  GlobMatcher prefix("tenant:123:*");
+  EXPECT_EQ("tenant:123:", prefix.prefix());
+  EXPECT_TRUE(prefix.Matches("tenant:123:"));
+  EXPECT_TRUE(prefix.Matches("tenant:123:foo"));
+  EXPECT_FALSE(prefix.Matches("tenant:124:foo"));
+
+  GlobMatcher middle("a*bc*bc*d");
+  EXPECT_TRUE(middle.Matches("abcbcd"));
+  EXPECT_TRUE(middle.Matches("axbcybcd"));
+  EXPECT_FALSE(middle.Matches("abcd"));
+  EXPECT_FALSE(middle.Matches("abcbc"));
+
+  GlobMatcher overlap("ab*ba");
+  EXPECT_FALSE(overlap.Matches("aba"));
+  EXPECT_TRUE(overlap.Matches("abba"));
+}
+
+TEST_F(GlobMatcherTest, Special) {
+  GlobMatcher m("user:?[0-9]*\\*");
+  EXPECT_EQ("user:", m.prefix());
+  EXPECT_TRUE(m.Matches("user:a1*"));
+  EXPECT_TRUE(m.Matches("user:b2xyz*"));
+  EXPECT_FALSE(m.Matches("user:ab*"));
+  EXPECT_FALSE(m.Matches("usr:a1*"));
+
+  GlobMatcher nocase("Foo*", false);
+  EXPECT_TRUE(nocase.Matches("fOObar"));
+  EXPECT_FALSE(nocase.Matches("fo"));
+}
+
+// Compares with stringmatchlen on random patterns and strings over a small alphabet.
+TEST_F(GlobMatcherTest, Random) {
+  const string_view kPatternChars = "ab*?";
+  mt19937 gen(42);
+  auto random_str = [&](string_view chars, size_t max_len) {
+    string res(gen() % (max_len + 1), 'a');
+    for (char& c : res)
+      c = chars[gen() % chars.size()];
+    return res;
+  };
+
+  for (unsigned i = 0; i < 2000; ++i) {
+    string pattern = random_str(kPatternChars, 6);
+    GlobMatcher matcher(pattern);
+    for (unsigned j = 0; j < 20; ++j) {
+      string str = random_str("ab", 8);
+      bool expected = stringmatchlen(pattern.data(), pattern.size(), str.data(), str.size(), 0);
+      ASSERT_EQ(expected, matcher.Matches(str)) << pattern << " " << str;
+    }
+  }
+}
+
+}  // namespace dfly
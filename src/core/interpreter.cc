@@ -359,23 +359,49 @@ int RedisLogCommand(lua_State* lua) {
   return 0;
 }
 
+// Set funcname to the name of the global that holds the function of sha.
+void FuncName(string_view sha, char (&funcname)[43]) {
+  DCHECK(sha.size() == 40);
+  funcname[0] = 'f';
+  funcname[1] = '_';
+  memcpy(funcname + 2, sha.data(), 40);
+  funcname[42] = '\0';
+}
+
+int DumpWriter(lua_State* lua, const void* data, size_t size, void* ud) {
+  static_cast<string*>(ud)->append(static_cast<const char*>(data), size);
+  return 0;
+}
+
+}  // namespace
+
 // See https://www.lua.org/manual/5.3/manual.html#lua_Alloc
-void* mimalloc_glue(void* ud, void* ptr, size_t osize, size_t nsize) {
-  (void)ud;
+// When ptr is null, osize encodes the type of the new object rather than its size.
+void* Interpreter::LuaAlloc(void* ud, void* ptr, size_t osize, size_t nsize) {
+  MemoryState* mem = static_cast<MemoryState*>(ud);
+  size_t old_size = ptr ? osize : 0;
+
   if (nsize == 0) {
     mi_free_size(ptr, osize);
+    mem->used -= old_size;
     return nullptr;
-  } else if (ptr == nullptr) {
-    return mi_malloc(nsize);
-  } else {
-    return mi_realloc(ptr, nsize);
   }
-}
 
-}  // namespace
+  // Only growth can fail, lua assumes that shrinking a block always succeeds.
+  if (nsize > old_size && mem->running && mem->limit &&
+      mem->used + nsize - old_size > mem->run_base + mem->limit) {
+    return nullptr;
+  }
+
+  void* res = ptr ? mi_heap_realloc(mem->heap, ptr, nsize) : mi_heap_malloc(mem->heap, nsize);
+  if (res)
+    mem->used += nsize - old_size;
+  return res;
+}
 
-Interpreter::Interpreter() {
-  lua_ = lua_newstate(mimalloc_glue, nullptr);
+Interpreter::Interpreter() : mem_{new MemoryState} {
+  mem_->heap = mi_heap_new();
+  lua_ = lua_newstate(LuaAlloc, mem_.get());
   InitLua(lua_);
   void** ptr = static_cast<void**>(lua_getextraspace(lua_));
   *ptr = this;
@@ -404,6 +430,11 @@ Interpreter::Interpreter() {
   lua_pushcfunction(lua_, RedisAPCallCommand);
   lua_settable(lua_, -3);
 
+  /* redis.pcall_batch */
+  lua_pushstring(lua_, "pcall_batch");
+  lua_pushcfunction(lua_, RedisPCallBatchCommand);
+  lua_settable(lua_, -3);
+
   lua_pushstring(lua_, "sha1hex");
   lua_pushcfunction(lua_, RedisSha1Command);
   lua_settable(lua_, -3);
@@ -427,6 +458,7 @@ Interpreter::Interpreter() {
 
 Interpreter::~Interpreter() {
   lua_close(lua_);
+  mi_heap_destroy(mem_->heap);
 }
 
 void Interpreter::FuncSha1(string_view body, char* fp) {
@@ -436,32 +468,41 @@ void Interpreter::FuncSha1(string_view body, char* fp) {
   ToHex(digest, fp);
 }
 
-auto Interpreter::AddFunction(string_view sha, string_view body, string* result) -> AddResult {
+auto Interpreter::AddFunction(string_view sha, string_view body, string* result,
+                              string* bytecode) -> AddResult {
   char funcname[43];
-  funcname[0] = 'f';
-  funcname[1] = '_';
-  DCHECK(sha.size() == 40);
-  memcpy(funcname + 2, sha.data(), sha.size());
-  funcname[42] = '\0';
+  FuncName(sha, funcname);
 
   int type = lua_getglobal(lua_, funcname);
   lua_pop(lua_, 1);
 
-  if (type == LUA_TNIL && !AddInternal(funcname, body, result))
+  if (type == LUA_TNIL && !AddInternal(funcname, body, result, bytecode))
     return COMPILE_ERR;
 
   return type == LUA_TNIL ? ADD_OK : ALREADY_EXISTS;
 }
 
+auto Interpreter::AddCompiledFunction(string_view sha, string_view bytecode, string* error)
+    -> AddResult {
+  char funcname[43];
+  FuncName(sha, funcname);
+
+  int type = lua_getglobal(lua_, funcname);
+  lua_pop(lua_, 1);
+  if (type != LUA_TNIL)
+    return ALREADY_EXISTS;
+
+  // Only binary chunks are accepted, the chunk defines the global function like AddInternal().
+  int res = luaL_loadbufferx(lua_, bytecode.data(), bytecode.size(), "@user_script", "b");
+  return RunChunk(res, error) ? ADD_OK : COMPILE_ERR;
+}
+
 bool Interpreter::Exists(string_view sha) const {
   if (sha.size() != 40)
     return false;
 
   char fname[43];
-  fname[0] = 'f';
-  fname[1] = '_';
-  fname[42] = '\0';
-  memcpy(fname + 2, sha.data(), 40);
+  FuncName(sha, fname);
 
   int type = lua_getglobal(lua_, fname);
   lua_pop(lua_, 1);
@@ -492,10 +533,18 @@ auto Interpreter::RunFunction(string_view sha, std::string* error) -> RunResult
 
   /* We have zero arguments and expect
    * a single return value. */
+  mem_->run_base = mem_->used;
+  mem_->running = true;
   int err = lua_pcall(lua_, 0, 1, -2);
+  mem_->running = false;
 
   if (err) {
     *error = lua_tostring(lua_, -1);
+
+    // Release the garbage of a script that ran out of memory right away, so that the
+    // next script starts from a clean state.
+    if (err == LUA_ERRMEM)
+      lua_gc(lua_, LUA_GCCOLLECT);
   }
 
   return err == 0 ? RUN_OK : RUN_ERR;
@@ -589,11 +638,22 @@ bool Interpreter::IsResultSafe() const {
   return res;
 }
 
-bool Interpreter::AddInternal(const char* f_id, string_view body, string* error) {
+bool Interpreter::AddInternal(const char* f_id, string_view body, string* error,
+                              string* bytecode) {
   string script = absl::StrCat("function ", f_id, "() \n");
   absl::StrAppend(&script, body, "\nend");
 
   int res = luaL_loadbuffer(lua_, script.data(), script.size(), "@user_script");
+  if (res == 0 && bytecode) {
+    bytecode->clear();
+    lua_dump(lua_, DumpWriter, bytecode, 0);  // keep debug info for error messages
+  }
+
+  return RunChunk(res, error);
+}
+
+bool Interpreter::RunChunk(int load_res, string* error) {
+  int res = load_res;
   if (res == 0) {
     res = lua_pcall(lua_, 0, 0, 0);  // run func definition code
   }
@@ -721,7 +781,7 @@ void Interpreter::ResetStack() {
 // Returns number of results, which is always 1 in this case.
 // Please note that lua resets the stack once the function returns so no need
 // to unwind the stack manually in the function (though lua allows doing this).
-int Interpreter::RedisGenericCommand(bool raise_error, bool async) {
+int Interpreter::RedisGenericCommand(bool raise_error, bool async, bool batch, int base) {
   /* By using Lua debug hooks it is possible to trigger a recursive call
    * to luaRedisGenericCommand(), which normally should never happen.
    * To make this function reentrant is futile and makes it slower, but
@@ -740,7 +800,7 @@ int Interpreter::RedisGenericCommand(bool raise_error, bool async) {
   }
 
   cmd_depth_++;
-  int argc = lua_gettop(lua_);
+  int argc = lua_gettop(lua_) - base;
 
 #define RETURN_ERROR(err)                      \
   {                                            \
@@ -759,7 +819,7 @@ int Interpreter::RedisGenericCommand(bool raise_error, bool async) {
 
   // Determine size required for backing storage for all args.
   // Skip command name (idx=1), as its stored in a separate buffer.
-  for (int idx = 2; idx <= argc; idx++) {
+  for (int idx = base + 2; idx <= base + argc; idx++) {
     switch (lua_type(lua_, idx)) {
       case LUA_TNUMBER:
         if (lua_isinteger(lua_, idx)) {
@@ -782,12 +842,12 @@ int Interpreter::RedisGenericCommand(bool raise_error, bool async) {
   absl::FixedArray<absl::Span<char>, 4> args(argc);
 
   // Copy command name to name_buffer and set it as first arg.
-  unsigned name_len = lua_rawlen(lua_, 1);
+  unsigned name_len = lua_rawlen(lua_, base + 1);
   if (name_len >= sizeof(name_buffer)) {
     RETURN_ERROR("Lua redis() command name too long");
   }
 
-  memcpy(name_buffer, lua_tostring(lua_, 1), name_len);
+  memcpy(name_buffer, lua_tostring(lua_, base + 1), name_len);
   args[0] = {name_buffer, name_len};
   buffer_.resize(blob_len + 4, '\0');  // backing storage for args
 
@@ -795,22 +855,23 @@ int Interpreter::RedisGenericCommand(bool raise_error, bool async) {
   char* end = cur + blob_len;
   for (int idx = 2; idx <= argc; idx++) {
     size_t len = 0;
-    switch (lua_type(lua_, idx)) {
+    int pos = base + idx;
+    switch (lua_type(lua_, pos)) {
       case LUA_TNUMBER:
-        if (lua_isinteger(lua_, idx)) {
-          char* next = absl::numbers_internal::FastIntToBuffer(lua_tointeger(lua_, idx), cur);
+        if (lua_isinteger(lua_, pos)) {
+          char* next = absl::numbers_internal::FastIntToBuffer(lua_tointeger(lua_, pos), cur);
           len = next - cur;
-        } else if (lua_isnumber(lua_, idx)) {
+        } else if (lua_isnumber(lua_, pos)) {
           // we pass `end - cur + 1` because we do not want to skip the last character
           // if it's the last argument.
-          int fmt_len = absl::SNPrintF(cur, end - cur + 1, "%.17g", lua_tonumber(lua_, idx));
+          int fmt_len = absl::SNPrintF(cur, end - cur + 1, "%.17g", lua_tonumber(lua_, pos));
           CHECK_GT(fmt_len, 0);
           len = fmt_len;
         }
         break;
       case LUA_TSTRING:
-        len = lua_rawlen(lua_, idx);
-        memcpy(cur, lua_tostring(lua_, idx), len + 1);  // + 1 for null terminator
+        len = lua_rawlen(lua_, pos);
+        memcpy(cur, lua_tostring(lua_, pos), len + 1);  // + 1 for null terminator
     };
 
     args[idx - 1] = {cur, len};
@@ -821,8 +882,8 @@ int Interpreter::RedisGenericCommand(bool raise_error, bool async) {
    * and this way we guaranty we will have room on the stack for the result. */
   lua_pop(lua_, argc);
   RedisTranslator translator(lua_);
-  redis_func_(
-      CallArgs{MutSliceSpan{args}, &buffer_, &translator, async, raise_error, &raise_error});
+  redis_func_(CallArgs{MutSliceSpan{args}, &buffer_, &translator, async, raise_error,
+                       &raise_error, batch});
   cmd_depth_--;
 
   // Shrink reusable buffer if it's too big.
@@ -843,6 +904,67 @@ int Interpreter::RedisGenericCommand(bool raise_error, bool async) {
   return 1;
 }
 
+// redis.pcall_batch({cmd, args...}, ...) runs independent commands squashed and returns the table
+// of their replies, with errors returned like by pcall.
+int Interpreter::RedisBatchCommand() {
+  int num_cmds = lua_gettop(lua_);
+
+  // Validate all commands before queuing any of them, so a batch is either queued fully or not
+  for (int i = 1; i <= num_cmds; i++) {
+    if (!lua_istable(lua_, i) || lua_rawlen(lua_, i) == 0) {
+      PushError(lua_, "Lua redis.pcall_batch() arguments must be non empty tables");
+      return 1;
+    }
+
+    int len = lua_rawlen(lua_, i);
+    if (!lua_checkstack(lua_, len + 1)) {
+      PushError(lua_, "Lua redis.pcall_batch() command has too many arguments");
+      return 1;
+    }
+
+    for (int j = 1; j <= len; j++) {
+      int type = lua_rawgeti(lua_, i, j);
+      lua_pop(lua_, 1);
+      if ((j == 1 && type != LUA_TSTRING) || (type != LUA_TSTRING && type != LUA_TNUMBER)) {
+        PushError(lua_, "Lua redis() command arguments must be strings or integers");
+        return 1;
+      }
+    }
+  }
+
+  for (int i = 1; i <= num_cmds; i++) {
+    int len = lua_rawlen(lua_, i);
+    for (int j = 1; j <= len; j++)
+      lua_rawgeti(lua_, i, j);
+
+    RedisGenericCommand(false, true, true, num_cmds);
+    if (lua_gettop(lua_) > num_cmds)  // failed to queue, the error is on top
+      return 1;
+  }
+
+  if (num_cmds == 0) {
+    lua_newtable(lua_);
+    return 1;
+  }
+
+  // Run the batch, its replies are pushed in order
+  lua_settop(lua_, 0);
+  bool abort = false;
+  RedisTranslator translator(lua_);
+  redis_func_(CallArgs{MutSliceSpan{}, &buffer_, &translator, false, false, &abort, true});
+
+  if (abort)  // error of a preceding acall
+    return RaiseError(lua_);
+
+  DCHECK_EQ(lua_gettop(lua_), num_cmds);
+  lua_createtable(lua_, num_cmds, 0);
+  lua_insert(lua_, 1);
+  for (int i = num_cmds; i >= 1; i--)
+    lua_rawseti(lua_, 1, i);
+
+  return 1;
+}
+
 int Interpreter::RedisCallCommand(lua_State* lua) {
   void** ptr = static_cast<void**>(lua_getextraspace(lua));
   return reinterpret_cast<Interpreter*>(*ptr)->RedisGenericCommand(true, false);
@@ -863,10 +985,16 @@ int Interpreter::RedisAPCallCommand(lua_State* lua) {
   return reinterpret_cast<Interpreter*>(*ptr)->RedisGenericCommand(false, true);
 }
 
+int Interpreter::RedisPCallBatchCommand(lua_State* lua) {
+  void** ptr = static_cast<void**>(lua_getextraspace(lua));
+  return reinterpret_cast<Interpreter*>(*ptr)->RedisBatchCommand();
+}
+
 Interpreter* InterpreterManager::Get() {
   // Grow if none is available and we have unused capacity left.
   if (available_.empty() && storage_.size() < storage_.capacity()) {
     storage_.emplace_back();
+    storage_.back().SetMemoryLimit(mem_limit_);
     return &storage_.back();
   }
 
@@ -876,9 +1004,28 @@ Interpreter* InterpreterManager::Get() {
   return ir;
 }
 
+Interpreter* InterpreterManager::TryGet() {
+  if (available_.empty() && storage_.size() == storage_.capacity())
+    return nullptr;
+  return Get();
+}
+
 void InterpreterManager::Return(Interpreter* ir) {
   available_.push_back(ir);
   waker_.notify();
 }
 
+size_t InterpreterManager::UsedMemory() const {
+  size_t res = 0;
+  for (const auto& ir : storage_)
+    res += ir.UsedMemory();
+  return res;
+}
+
+void InterpreterManager::SetMemoryLimit(size_t limit) {
+  mem_limit_ = limit;
+  for (auto& ir : storage_)
+    ir.SetMemoryLimit(limit);
+}
+
 }  // namespace dfly
@@ -5,6 +5,7 @@
 #pragma once
 
 #include <functional>
+#include <memory>
 #include <optional>
 #include <string_view>
 
@@ -12,6 +13,7 @@
 #include "core/fibers.h"
 
 typedef struct lua_State lua_State;
+typedef struct mi_heap_s mi_heap_t;
 
 namespace dfly {
 
@@ -50,6 +52,10 @@ class Interpreter {
     // The function can request an abort due to an error, even if error_abort is false.
     // It happens when async cmds are flushed and result in an uncatched error.
     bool* requested_abort;
+
+    // Queued by pcall_batch, replies nothing unless it failed. Empty args complete the batch,
+    // which then replies to all of its commands in order.
+    bool batch = false;
   };
 
   using RedisFunc = std::function<void(CallArgs)>;
@@ -75,8 +81,14 @@ class Interpreter {
     COMPILE_ERR = 2,
   };
 
-  // Add function with sha and body to interpreter.
-  AddResult AddFunction(std::string_view sha, std::string_view body, std::string* error);
+  // Add function with sha and body to interpreter. If bytecode is set, it's filled with the
+  // compiled function that can be added to other interpreters with AddCompiledFunction().
+  AddResult AddFunction(std::string_view sha, std::string_view body, std::string* error,
+                        std::string* bytecode = nullptr);
+
+  // Add function with sha from bytecode dumped by AddFunction(), without compiling it again.
+  AddResult AddCompiledFunction(std::string_view sha, std::string_view bytecode,
+                                std::string* error);
 
   bool Exists(std::string_view sha) const;
 
@@ -103,6 +115,17 @@ class Interpreter {
 
   void ResetStack();
 
+  // Bytes currently allocated by the lua state, including loaded functions and globals.
+  size_t UsedMemory() const {
+    return mem_->used;
+  }
+
+  // Limits how much a single RunFunction() call may grow the state by, 0 means no limit.
+  // Allocations above the limit fail and abort the script with a "not enough memory" error.
+  void SetMemoryLimit(size_t limit) {
+    mem_->limit = limit;
+  }
+
   // fp must point to buffer with at least 41 chars.
   // fp[40] will be set to '\0'.
   static void FuncSha1(std::string_view body, char* fp);
@@ -114,19 +137,39 @@ class Interpreter {
   }
 
  private:
+  // State of the lua allocator. Kept on the heap so that its address, which lua holds,
+  // stays stable.
+  struct MemoryState {
+    mi_heap_t* heap = nullptr;  // private heap of the interpreter, dropped as a whole on close
+    size_t used = 0;
+    size_t limit = 0;
+    size_t run_base = 0;  // usage when the running script started
+    bool running = false;
+  };
+
+  static void* LuaAlloc(void* ud, void* ptr, size_t osize, size_t nsize);
+
   // Returns true if function was successfully added,
   // otherwise returns false and sets the error.
-  bool AddInternal(const char* f_id, std::string_view body, std::string* error);
+  bool AddInternal(const char* f_id, std::string_view body, std::string* error,
+                   std::string* bytecode);
+
+  // Runs the loaded chunk on top of the stack, returns false and fills error on failure.
+  bool RunChunk(int load_res, std::string* error);
   bool IsTableSafe() const;
 
-  int RedisGenericCommand(bool raise_error, bool async);
+  // Runs the command with the arguments above the first base stack elements.
+  int RedisGenericCommand(bool raise_error, bool async, bool batch = false, int base = 0);
   int RedisACallErrorsCommand();
+  int RedisBatchCommand();
 
   static int RedisCallCommand(lua_State* lua);
   static int RedisPCallCommand(lua_State* lua);
   static int RedisACallCommand(lua_State* lua);
   static int RedisAPCallCommand(lua_State* lua);
+  static int RedisPCallBatchCommand(lua_State* lua);
 
+  std::unique_ptr<MemoryState> mem_;
   lua_State* lua_;
   unsigned cmd_depth_ = 0;
   RedisFunc redis_func_;
@@ -147,9 +190,19 @@ class InterpreterManager {
   // Borrow interpreter. Always return it after usage.
   Interpreter* Get();
 
+  // Like Get() but returns nullptr instead of waiting when all the interpreters are borrowed.
+  Interpreter* TryGet();
+
   void Return(Interpreter*);
 
+  // Memory used by all interpreters of the manager.
+  size_t UsedMemory() const;
+
+  // Applies Interpreter::SetMemoryLimit to all current and future interpreters.
+  void SetMemoryLimit(size_t limit);
+
  private:
+  size_t mem_limit_ = 0;
   EventCount waker_;
   std::vector<Interpreter*> available_;
   std::vector<Interpreter> storage_;
@@ -225,6 +225,51 @@ TEST_F(InterpreterTest, Add) {
   EXPECT_TRUE(intptr_.Exists(sha1));
 }
 
+TEST_F(InterpreterTest, AddCompiled) {
+  const char* s1 = "return 42";
+  char sha_buf1[64], sha_buf2[64];
+  Interpreter::FuncSha1(s1, sha_buf1);
+  Interpreter::FuncSha1("return 1", sha_buf2);
+  string_view sha1{sha_buf1, std::strlen(sha_buf1)};
+  string_view sha2{sha_buf2, std::strlen(sha_buf2)};
+
+  string err, bytecode;
+  EXPECT_EQ(Interpreter::ADD_OK, intptr_.AddFunction(sha1, s1, &err, &bytecode));
+  EXPECT_FALSE(bytecode.empty());
+
+  Interpreter other;
+  EXPECT_EQ(Interpreter::ADD_OK, other.AddCompiledFunction(sha1, bytecode, &err));
+  EXPECT_EQ(Interpreter::ALREADY_EXISTS, other.AddCompiledFunction(sha1, bytecode, &err));
+  EXPECT_EQ(0, lua_gettop(other.lua()));
+
+  // Source code is not accepted as bytecode
+  EXPECT_EQ(Interpreter::COMPILE_ERR, other.AddCompiledFunction(sha2, "return 1", &err));
+  EXPECT_FALSE(other.Exists(sha2));
+
+  ASSERT_EQ(Interpreter::RUN_OK, other.RunFunction(sha1, &err));
+  EXPECT_EQ(42, lua_tointeger(other.lua(), -1));
+  lua_pop(other.lua(), 1);
+}
+
+TEST_F(InterpreterTest, MemoryLimit) {
+  size_t used = intptr_.UsedMemory();
+  EXPECT_GT(used, 0u);
+
+  intptr_.SetMemoryLimit(1 << 20);
+  const char* kAlloc = "local t = {}; for i = 1, 100000 do t[i] = 'str' .. i end; return 1";
+  EXPECT_FALSE(Execute(kAlloc));
+  EXPECT_THAT(error_, testing::HasSubstr("not enough memory"));
+  intptr_.ResetStack();
+
+  // The garbage of the failed run is collected, small scripts still run.
+  EXPECT_LT(intptr_.UsedMemory(), used + (64 << 10));
+  ASSERT_TRUE(Execute("return 42"));
+  EXPECT_EQ("i(42)", ser_.res);
+
+  intptr_.SetMemoryLimit(0);
+  EXPECT_TRUE(Execute(kAlloc));
+}
+
 // Test cases taken from scripting.tcl
 TEST_F(InterpreterTest, Execute) {
   ASSERT_TRUE(Execute("return 42"));
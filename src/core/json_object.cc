@@ -4,6 +4,8 @@
 
 #include "core/json_object.h"
 
+#include <jsoncons_ext/cbor/cbor.hpp>
+
 #include "base/logging.h"
 #include "core/compact_object.h"
 
@@ -12,6 +14,17 @@ using namespace std;
 
 namespace dfly {
 
+namespace {
+
+constexpr size_t kJsonPathCacheCapacity = 256;
+
+JsonPathCache<const JsonExpression>& ThreadPathCache() {
+  static thread_local JsonPathCache<const JsonExpression> cache{kJsonPathCacheCapacity};
+  return cache;
+}
+
+}  // namespace
+
 optional<JsonType> JsonFromString(string_view input) {
   error_code ec;
   auto JsonErrorHandler = [](json_errc ec, const ser_context&) {
@@ -32,4 +45,80 @@ optional<JsonType> JsonFromString(string_view input) {
   return nullopt;
 }
 
+vector<uint8_t> PackJson(const JsonType& j) {
+  vector<uint8_t> res;
+  cbor::encode_cbor(j, res);
+  return res;
+}
+
+optional<vector<uint8_t>> PackJsonFromString(string_view input) {
+  error_code ec;
+  auto JsonErrorHandler = [](json_errc ec, const ser_context&) {
+    VLOG(1) << "Error while decode JSON: " << make_error_code(ec).message();
+    return false;
+  };
+
+  vector<uint8_t> res;
+  cbor::cbor_bytes_encoder encoder(res);
+  json_parser parser(basic_json_decode_options<char>{}, JsonErrorHandler);
+
+  parser.update(input);
+  parser.finish_parse(encoder, ec);
+  encoder.flush();
+  if (ec || res.empty())
+    return nullopt;
+
+  return res;
+}
+
+optional<JsonType> UnpackJson(string_view packed) {
+  json_decoder<JsonType> decoder(
+      std::pmr::polymorphic_allocator<char>{CompactObj::memory_resource()});
+  cbor::cbor_bytes_reader reader(
+      jsoncons::span<const uint8_t>{reinterpret_cast<const uint8_t*>(packed.data()), packed.size()},
+      decoder);
+
+  error_code ec;
+  reader.read(ec);
+  if (ec || !decoder.is_valid()) {
+    VLOG(1) << "Error while decoding packed JSON: " << ec.message();
+    return nullopt;
+  }
+  return decoder.get_result();
+}
+
+optional<string> PackedJsonToString(string_view packed) {
+  string res;
+  compact_json_string_encoder encoder(res);
+  cbor::cbor_bytes_reader reader(
+      jsoncons::span<const uint8_t>{reinterpret_cast<const uint8_t*>(packed.data()), packed.size()},
+      encoder);
+
+  error_code ec;
+  reader.read(ec);
+  if (ec) {
+    VLOG(1) << "Error while decoding packed JSON: " << ec.message();
+    return nullopt;
+  }
+  return res;
+}
+
+shared_ptr<const JsonExpression> GetJsonPathExpr(string_view path, error_code& ec) {
+  auto& cache = ThreadPathCache();
+  if (auto res = cache.Find(path); res)
+    return res;
+
+  auto expr = MakeJsonPathExpr(path, ec);
+  if (ec)
+    return nullptr;
+
+  auto res = make_shared<const JsonExpression>(std::move(expr));
+  cache.Insert(path, res);
+  return res;
+}
+
+void EvictJsonPathExpr(string_view path) {
+  ThreadPathCache().Remove(path);
+}
+
 }  // namespace dfly
@@ -4,11 +4,16 @@
 
 #pragma once
 
+#include <absl/container/flat_hash_map.h>
+
 #include <jsoncons/json.hpp>
 #include <jsoncons_ext/jsonpath/jsonpath.hpp>
+#include <list>
 #include <memory>
 #include <optional>
+#include <string>
 #include <string_view>
+#include <vector>
 
 namespace dfly {
 
@@ -20,10 +25,86 @@ using JsonType = jsoncons::pmr::json;
 // Build a json object from string. If the string is not legal json, will return nullopt
 std::optional<JsonType> JsonFromString(std::string_view input);
 
+// Packed json is the CBOR encoding of a json value. It takes a fraction of the memory of JsonType,
+// which allocates every member and string separately, and it can be serialized back to text
+// without building the DOM.
+std::vector<uint8_t> PackJson(const JsonType& j);
+
+// Same as PackJson(*JsonFromString(input)) but the text is encoded while it is parsed, without
+// building the DOM. Returns nullopt if input is not legal json.
+std::optional<std::vector<uint8_t>> PackJsonFromString(std::string_view input);
+
+// Returns nullopt if packed is not a valid encoding.
+std::optional<JsonType> UnpackJson(std::string_view packed);
+
+// Returns the same text as JsonType::to_string() of the unpacked value.
+std::optional<std::string> PackedJsonToString(std::string_view packed);
+
 inline auto MakeJsonPathExpr(std::string_view path, std::error_code& ec)
     -> jsoncons::jsonpath::jsonpath_expression<JsonType> {
   return jsoncons::jsonpath::make_expression<JsonType, std::allocator<char>>(
       jsoncons::allocator_set<JsonType::allocator_type, std::allocator<char>>(), path, ec);
 }
 
+using JsonExpression = jsoncons::jsonpath::jsonpath_expression<JsonType>;
+
+// LRU cache of compiled json paths keyed by the path string. Clients usually repeat a handful
+// of paths, so caching them saves compiling the path on every command. Not thread safe, every
+// thread has its own instance.
+template <typename T> class JsonPathCache {
+ public:
+  explicit JsonPathCache(size_t capacity) : capacity_(capacity) {
+  }
+
+  // Returns nullptr if path is not cached.
+  std::shared_ptr<T> Find(std::string_view path) {
+    auto it = index_.find(path);
+    if (it == index_.end())
+      return nullptr;
+
+    items_.splice(items_.begin(), items_, it->second);
+    return it->second->second;
+  }
+
+  void Insert(std::string_view path, std::shared_ptr<T> value) {
+    if (auto it = index_.find(path); it != index_.end()) {
+      it->second->second = std::move(value);
+      items_.splice(items_.begin(), items_, it->second);
+      return;
+    }
+
+    if (items_.size() >= capacity_) {
+      index_.erase(items_.back().first);
+      items_.pop_back();
+    }
+    items_.emplace_front(std::string{path}, std::move(value));
+    index_.emplace(items_.front().first, items_.begin());
+  }
+
+  void Remove(std::string_view path) {
+    if (auto it = index_.find(path); it != index_.end()) {
+      items_.erase(it->second);
+      index_.erase(it);
+    }
+  }
+
+  size_t Size() const {
+    return items_.size();
+  }
+
+ private:
+  using Item = std::pair<std::string, std::shared_ptr<T>>;
+
+  size_t capacity_;
+  std::list<Item> items_;  // Ordered from the most recently used.
+  absl::flat_hash_map<std::string_view, typename std::list<Item>::iterator> index_;
+};
+
+// Returns the compiled expression of path from the cache of the calling thread, compiling it
+// on a miss. Returns nullptr and sets ec if path is not a valid json path.
+std::shared_ptr<const JsonExpression> GetJsonPathExpr(std::string_view path, std::error_code& ec);
+
+// Drops path from the cache of the calling thread.
+void EvictJsonPathExpr(std::string_view path);
+
 }  // namespace dfly
@@ -8,6 +8,7 @@
 
 #include "base/gtest.h"
 #include "base/logging.h"
+#include "core/json_object.h"
 
 namespace dfly {
 using namespace jsoncons;
@@ -159,4 +160,43 @@ TEST_F(JsonTest, JsonWithPolymorhicAllocator) {
   EXPECT_EQ("Im Westen nichts Neues", j1["store"]["book"][1]["title"].as_string());
   EXPECT_EQ(10.00, j1["store"]["book"][1]["price"].as_double());
 }
+
+TEST_F(JsonTest, PathCache) {
+  JsonPathCache<int> cache{2};
+  cache.Insert("a", std::make_shared<int>(1));
+  cache.Insert("b", std::make_shared<int>(2));
+  ASSERT_TRUE(cache.Find("a"));
+
+  // "b" is the least recently used entry.
+  cache.Insert("c", std::make_shared<int>(3));
+  EXPECT_EQ(2u, cache.Size());
+  EXPECT_FALSE(cache.Find("b"));
+  EXPECT_EQ(1, *cache.Find("a"));
+  EXPECT_EQ(3, *cache.Find("c"));
+
+  cache.Insert("a", std::make_shared<int>(4));
+  EXPECT_EQ(4, *cache.Find("a"));
+  cache.Remove("a");
+  EXPECT_FALSE(cache.Find("a"));
+  EXPECT_EQ(1u, cache.Size());
+}
+
+TEST_F(JsonTest, CachedPathExpr) {
+  std::error_code ec;
+  auto expr = GetJsonPathExpr("$.a[*]", ec);
+  ASSERT_FALSE(ec);
+  ASSERT_TRUE(expr);
+  EXPECT_EQ(expr, GetJsonPathExpr("$.a[*]", ec));
+
+  json j = R"({"a": [1, 2]})"_json;
+  pmr::json pj = pmr::json::parse(j.to_string());
+  EXPECT_EQ(2u, expr->evaluate(pj).size());
+
+  EvictJsonPathExpr("$.a[*]");
+  EXPECT_NE(expr, GetJsonPathExpr("$.a[*]", ec));
+
+  EXPECT_FALSE(GetJsonPathExpr("$.a[", ec));
+  EXPECT_TRUE(ec);
+}
+
 }  // namespace dfly
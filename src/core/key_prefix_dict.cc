@@ -0,0 +1,123 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/key_prefix_dict.h"
+
+#include <absl/base/internal/spinlock.h>
+
+#include <atomic>
+
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+constexpr string_view kDelimiters = ":/.|";
+
+// Every kSampleEvery-th key without a known prefix is sampled.
+constexpr uint32_t kSampleEvery = 16;
+
+// The number of samples sharing a candidate that make it a prefix.
+constexpr uint32_t kPromoteCount = 8;
+
+// Most candidates end in unique parts of the keys, they are dropped when there are too many.
+constexpr size_t kMaxCandidates = 1024;
+
+struct GlobalTable {
+  absl::base_internal::SpinLock mu;
+  absl::flat_hash_map<string, uint16_t> ids;  // guarded by mu
+  atomic<const string*> prefixes[KeyPrefixDict::kMaxPrefixes] = {};
+  atomic<uint32_t> size{0};
+};
+
+// Never destroyed, the keys referencing the prefixes can outlive the static objects.
+GlobalTable& Table() {
+  static GlobalTable* table = new GlobalTable;
+  return *table;
+}
+
+// Returns the id of the prefix or nullopt if the table is full.
+optional<uint16_t> Register(string_view prefix) {
+  GlobalTable& table = Table();
+  absl::base_internal::SpinLockHolder lk{&table.mu};
+  if (auto it = table.ids.find(prefix); it != table.ids.end())
+    return it->second;
+
+  uint32_t id = table.size.load(memory_order_relaxed);
+  if (id == KeyPrefixDict::kMaxPrefixes)
+    return nullopt;
+
+  table.prefixes[id].store(new string(prefix), memory_order_release);
+  table.size.store(id + 1, memory_order_release);
+  table.ids.emplace(prefix, id);
+  return id;
+}
+
+// Calls cb with the lengths of the prefixes of key that end with a delimiter and leave a suffix
+// of at most kMaxSuffixLen bytes, from the longest, until cb returns true.
+template <typename F> void ForEachSplit(string_view key, F&& cb) {
+  size_t max_len = min<size_t>(key.size(), KeyPrefixDict::kMaxPrefixLen);
+  size_t min_len = max<size_t>(key.size() > KeyPrefixDict::kMaxSuffixLen
+                                   ? key.size() - KeyPrefixDict::kMaxSuffixLen
+                                   : 0,
+                               1);
+  for (size_t len = max_len; len >= min_len; --len) {
+    if (kDelimiters.find(key[len - 1]) != string_view::npos && cb(len))
+      return;
+  }
+}
+
+}  // namespace
+
+auto KeyPrefixDict::Find(string_view key) -> optional<Match> {
+  optional<Match> res;
+  if (!ids_.empty()) {
+    ForEachSplit(key, [&](size_t len) {
+      auto it = ids_.find(key.substr(0, len));
+      if (it == ids_.end())
+        return false;
+      res = Match{it->second, uint8_t(len)};
+      return true;
+    });
+  }
+
+  if (!res && ++sample_cnt_ % kSampleEvery == 0)
+    Sample(key);
+  return res;
+}
+
+string_view KeyPrefixDict::Get(uint16_t id) {
+  const string* prefix = Table().prefixes[id].load(memory_order_acquire);
+  DCHECK(prefix);
+  return *prefix;
+}
+
+size_t KeyPrefixDict::GlobalSize() {
+  return Table().size.load(memory_order_acquire);
+}
+
+void KeyPrefixDict::Sample(string_view key) {
+  if (GlobalSize() == kMaxPrefixes)
+    return;
+
+  ForEachSplit(key, [this, key](size_t len) {
+    string_view prefix = key.substr(0, len);
+    if (candidates_.size() >= kMaxCandidates && !candidates_.contains(prefix))
+      candidates_.clear();
+
+    if (++candidates_[prefix] == kPromoteCount) {
+      candidates_.erase(prefix);
+      if (optional<uint16_t> id = Register(prefix); id) {
+        DVLOG(1) << "Learned key prefix " << prefix << " " << *id;
+        ids_.emplace(prefix, *id);
+      }
+    }
+    return false;
+  });
+}
+
+}  // namespace dfly
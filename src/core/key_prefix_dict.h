@@ -0,0 +1,57 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/container/flat_hash_map.h>
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace dfly {
+
+// Prefixes shared by many keys, that CompactObj::SetKey stores once instead of in every key.
+// A key with a known prefix keeps only the id of the prefix and its suffix inline, so it does not
+// allocate.
+//
+// Every thread learns the prefixes of its keys by sampling the keys that have none: the part of
+// the key up to a delimiter that leaves an inline suffix becomes a prefix once enough samples
+// share it. The prefixes are registered in a global table that only grows, so any thread can
+// decode the keys and an id stays valid for the lifetime of the process.
+class KeyPrefixDict {
+ public:
+  static constexpr unsigned kMaxPrefixes = 1 << 12;
+  static constexpr unsigned kMaxPrefixLen = 64;
+  static constexpr unsigned kMaxSuffixLen = 13;
+
+  struct Match {
+    uint16_t id;
+    uint8_t len;  // of the prefix
+  };
+
+  // Returns the longest prefix of key known to the thread that leaves a suffix of at most
+  // kMaxSuffixLen bytes. Samples the keys without one.
+  std::optional<Match> Find(std::string_view key);
+
+  // The prefix with the id, thread safe.
+  static std::string_view Get(uint16_t id);
+
+  // Number of prefixes registered by all threads.
+  static size_t GlobalSize();
+
+  size_t size() const {
+    return ids_.size();
+  }
+
+ private:
+  void Sample(std::string_view key);
+
+  absl::flat_hash_map<std::string, uint16_t> ids_;         // prefixes learned by the thread
+  absl::flat_hash_map<std::string, uint32_t> candidates_;  // sampled prefixes and their counts
+  uint32_t sample_cnt_ = 0;
+};
+
+}  // namespace dfly
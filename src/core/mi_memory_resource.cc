@@ -29,7 +29,8 @@ void* MiMemoryResource::do_allocate(std::size_t size, std::size_t align) {
 }
 
 void MiMemoryResource::do_deallocate(void* ptr, std::size_t size, std::size_t align) {
-  DCHECK(size > 33554400 || mi_heap_contains_block(heap_, ptr));
+  // The block may come from the heap of another thread, see AdoptUsed.
+  DCHECK(mi_is_in_heap_region(ptr));
 
   size_t usable = mi_usable_size(ptr);
 
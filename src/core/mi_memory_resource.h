@@ -23,6 +23,16 @@ class MiMemoryResource : public PMR_NS::memory_resource {
     return used_;
   }
 
+  // Blocks handed over to another thread stay in this heap, mimalloc frees them from any thread.
+  // Their accounting moves with them: the old owner releases it and the new one adopts it.
+  void ReleaseUsed(size_t usable) {
+    used_ -= usable;
+  }
+
+  void AdoptUsed(size_t usable) {
+    used_ += usable;
+  }
+
  private:
   void* do_allocate(std::size_t size, std::size_t align) final;
 
@@ -133,6 +133,26 @@ void ScoreMap::ObjDelete(void* obj, bool has_ttl) const {
   sdsfree(s1);
 }
 
+bool ScoreMap::iterator::ReallocIfNeeded(float ratio,
+                                         absl::FunctionRef<void(sds, sds)> on_realloc) {
+  // Unwrap all links to correctly call SetObject()
+  auto* ptr = curr_entry_;
+  while (ptr->IsLink())
+    ptr = ptr->AsLink();
+
+  sds s = (sds)ptr->GetObject();
+  if (!zmalloc_page_is_underutilized(s, ratio))
+    return false;
+
+  size_t len = sdslen(s);
+  sds new_s = AllocSdsWithSpace(len, 8);
+  memcpy(new_s, s, len + 1 /* \0 */ + 8 /* score */);
+  ptr->SetObject(new_s);
+  on_realloc(s, new_s);
+  sdsfree(s);
+  return true;
+}
+
 detail::SdsScorePair ScoreMap::iterator::BreakToPair(void* obj) {
   sds f = (sds)obj;
   return detail::SdsScorePair(f, GetValue(f));
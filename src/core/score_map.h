@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <absl/functional/function_ref.h>
+
 #include <optional>
 #include <string_view>
 
@@ -68,6 +70,11 @@ class ScoreMap : public DenseSet {
       return *this;
     }
 
+    // Re-allocates the member if its page is underutilized. on_realloc(old, new) is called
+    // before the old member is freed, so that the other references to it can be updated.
+    // Returns true if re-allocation happened.
+    bool ReallocIfNeeded(float ratio, absl::FunctionRef<void(sds, sds)> on_realloc);
+
     bool operator==(const iterator& b) const {
       return curr_list_ == b.curr_list_;
     }
@@ -4,7 +4,10 @@
 
 #include "core/score_map.h"
 
+#include <absl/strings/str_cat.h>
+
 #include "base/gtest.h"
+#include "base/init.h"
 #include "base/logging.h"
 #include "core/mi_memory_resource.h"
 
@@ -84,4 +87,52 @@ TEST_F(ScoreMapTest, EmptyFind) {
   EXPECT_EQ(nullopt, sm_->Find("bar"));
 }
 
+static vector<string> GenerateMembers(unsigned count) {
+  vector<string> members(count);
+  for (unsigned i = 0; i < count; ++i) {
+    members[i] = absl::StrCat("member:", i);
+  }
+  return members;
+}
+
+static void BM_ScoreMapAdd(benchmark::State& state) {
+  unsigned count = state.range(0);
+  vector<string> members = GenerateMembers(count);
+  MiMemoryResource mr(mi_heap_get_backing());
+
+  while (state.KeepRunning()) {
+    ScoreMap sm(&mr);
+    for (unsigned i = 0; i < count; ++i) {
+      sm.AddOrUpdate(members[i], i);
+    }
+  }
+}
+BENCHMARK(BM_ScoreMapAdd)->Arg(1024)->Arg(1 << 16);
+
+static void BM_ScoreMapFind(benchmark::State& state) {
+  unsigned count = state.range(0);
+  vector<string> members = GenerateMembers(count);
+  MiMemoryResource mr(mi_heap_get_backing());
+  ScoreMap sm(&mr);
+  for (unsigned i = 0; i < count; ++i) {
+    sm.AddOrUpdate(members[i], i);
+  }
+
+  unsigned i = 0;
+  while (state.KeepRunningBatch(10)) {
+    for (unsigned j = 0; j < 10; ++j) {
+      benchmark::DoNotOptimize(sm.Find(members[i]));
+      if (++i == members.size())
+        i = 0;
+    }
+  }
+}
+BENCHMARK(BM_ScoreMapFind)->Arg(1024)->Arg(1 << 16)->Arg(1 << 20);
+
+void RegisterScoreMapBench() {
+  init_zmalloc_threadlocal(mi_heap_get_backing());
+}
+
+REGISTER_MODULE_INITIALIZER(ScoreMapBench, RegisterScoreMapBench());
+
 }  // namespace dfly
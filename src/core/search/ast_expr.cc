@@ -19,6 +19,9 @@ namespace dfly::search {
 AstTermNode::AstTermNode(string term) : term{term} {
 }
 
+AstAffixNode::AstAffixNode(string affix, Kind kind) : affix{std::move(affix)}, kind{kind} {
+}
+
 AstRangeNode::AstRangeNode(double lo, bool lo_excl, double hi, bool hi_excl)
     : lo{lo_excl ? nextafter(lo, hi) : lo}, hi{hi_excl ? nextafter(hi, lo) : hi} {
 }
@@ -49,14 +52,22 @@ AstTagsNode::AstTagsNode(std::string tag) {
   tags = {std::move(tag)};
 }
 
+AstTagsNode::AstTagsNode(AstAffixNode affix) {
+  affixes = {std::move(affix)};
+}
+
 AstTagsNode::AstTagsNode(AstExpr&& l, std::string tag) {
   DCHECK(holds_alternative<AstTagsNode>(l));
-  auto& tags_node = get<AstTagsNode>(l);
-
-  tags = std::move(tags_node.tags);
+  *this = std::move(get<AstTagsNode>(l));
   tags.push_back(std::move(tag));
 }
 
+AstTagsNode::AstTagsNode(AstExpr&& l, AstAffixNode affix) {
+  DCHECK(holds_alternative<AstTagsNode>(l));
+  *this = std::move(get<AstTagsNode>(l));
+  affixes.push_back(std::move(affix));
+}
+
 AstKnnNode::AstKnnNode(uint32_t limit, std::string_view field, OwnedFtVector vec,
                        std::string_view score_alias)
     : filter{nullptr},
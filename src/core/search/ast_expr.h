@@ -29,6 +29,21 @@ struct AstTermNode {
   std::string term;
 };
 
+// Matches all terms with a prefix (foo*), a suffix (*foo) or an infix (*foo*)
+struct AstAffixNode {
+  enum Kind { PREFIX, SUFFIX, INFIX };
+
+  AstAffixNode() = default;
+  AstAffixNode(std::string affix, Kind kind);
+
+  friend std::ostream& operator<<(std::ostream& stream, const AstAffixNode& node) {
+    return stream;
+  }
+
+  std::string affix;
+  Kind kind = PREFIX;
+};
+
 // Matches numeric range
 struct AstRangeNode {
   AstRangeNode(double lo, bool lo_excl, double hi, bool hi_excl);
@@ -65,9 +80,12 @@ struct AstFieldNode {
 // Stores a list of tags for a tag query
 struct AstTagsNode {
   AstTagsNode(std::string tag);
+  AstTagsNode(AstAffixNode affix);
   AstTagsNode(AstNode&& l, std::string tag);
+  AstTagsNode(AstNode&& l, AstAffixNode affix);
 
   std::vector<std::string> tags;
+  std::vector<AstAffixNode> affixes;
 };
 
 // Applies nearest neighbor search to the final result set
@@ -95,8 +113,8 @@ struct AstSortNode {
 };
 
 using NodeVariants =
-    std::variant<std::monostate, AstStarNode, AstTermNode, AstRangeNode, AstNegateNode,
-                 AstLogicalNode, AstFieldNode, AstTagsNode, AstKnnNode, AstSortNode>;
+    std::variant<std::monostate, AstStarNode, AstTermNode, AstAffixNode, AstRangeNode,
+                 AstNegateNode, AstLogicalNode, AstFieldNode, AstTagsNode, AstKnnNode, AstSortNode>;
 
 struct AstNode : public NodeVariants {
   using variant::variant;
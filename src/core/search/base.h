@@ -6,11 +6,15 @@
 
 #include <absl/container/flat_hash_map.h>
 #include <absl/container/inlined_vector.h>
+#include <absl/types/span.h>
 
 #include <cstdint>
+#include <cstring>
 #include <memory>
+#include <optional>
 #include <string>
 #include <string_view>
+#include <type_traits>
 #include <vector>
 
 #include "base/pmr/memory_resource.h"
@@ -23,6 +27,9 @@ using DocId = uint32_t;
 
 enum class VectorSimilarity { L2, COSINE };
 
+// INT8 stores every vector as int8 codes with a single float scale.
+enum class VectorQuantization { NONE, INT8 };
+
 using OwnedFtVector = std::pair<std::unique_ptr<float[]>, size_t /* dimension (size) */>;
 
 // Query params represent named parameters for queries supplied via PARAMS.
@@ -66,6 +73,103 @@ struct DocumentAccessor {
   virtual VectorInfo GetVector(std::string_view active_field) const = 0;
 };
 
+// Binary encoding of index contents, used for persisting indices in snapshots.
+// Values are stored in the native byte order.
+struct IndexWriter {
+  template <typename T> void Write(T value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    buf_.append(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  template <typename T> void WriteArray(absl::Span<const T> values) {
+    Write<uint64_t>(values.size());
+    WriteValues(values);
+  }
+
+  // Writes values without their count, for arrays written in parts after their size.
+  template <typename T> void WriteValues(absl::Span<const T> values) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    buf_.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+  }
+
+  void WriteString(std::string_view str) {
+    WriteArray(absl::MakeConstSpan(str.data(), str.size()));
+  }
+
+  std::string Take() {
+    return std::move(buf_);
+  }
+
+ private:
+  std::string buf_;
+};
+
+// Reads values written by IndexWriter. All reads fail once the input is exhausted.
+struct IndexReader {
+  explicit IndexReader(std::string_view data) : data_{data} {
+  }
+
+  template <typename T> bool Read(T* value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    if (data_.size() < sizeof(T))
+      return false;
+    memcpy(value, data_.data(), sizeof(T));
+    data_.remove_prefix(sizeof(T));
+    return true;
+  }
+
+  // Reads an array into a container of T that supports resize.
+  template <typename C> bool ReadArray(C* out) {
+    using T = typename C::value_type;
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    uint64_t size;
+    if (!Read(&size) || size > data_.size() / sizeof(T))
+      return false;
+    out->resize(size);
+    memcpy(out->data(), data_.data(), size * sizeof(T));
+    data_.remove_prefix(size * sizeof(T));
+    return true;
+  }
+
+  // The result points into the input.
+  bool ReadString(std::string_view* str) {
+    uint64_t size;
+    if (!Read(&size) || size > data_.size())
+      return false;
+    *str = data_.substr(0, size);
+    data_.remove_prefix(size);
+    return true;
+  }
+
+  bool Empty() const {
+    return data_.empty();
+  }
+
+ private:
+  std::string_view data_;
+};
+
+// Storage for the cold blocks of indices, outside of memory. Provided by the owner of the
+// indices.
+struct BlockStorage {
+  enum State { PENDING, STORED, FAILED };
+
+  virtual ~BlockStorage() = default;
+
+  // Starts writing a copy of the block and returns its handle, or nullopt if there is no space
+  // for it. The block is copied by the call.
+  virtual std::optional<uint64_t> Store(std::string_view block) = 0;
+
+  virtual State GetState(uint64_t handle) const = 0;
+
+  // Reads the len bytes of a stored copy into dest. Preempts.
+  virtual bool Load(uint64_t handle, size_t len, char* dest) = 0;
+
+  // Frees the copy in any state, a pending write is completed first.
+  virtual void Free(uint64_t handle, size_t len) = 0;
+};
+
 // Base class for type-specific indices.
 //
 // Queries should be done directly on subclasses with their distinc
@@ -74,6 +178,11 @@ struct BaseIndex {
   virtual ~BaseIndex() = default;
   virtual void Add(DocId id, DocumentAccessor* doc, std::string_view field) = 0;
   virtual void Remove(DocId id, DocumentAccessor* doc, std::string_view field) = 0;
+
+  // Serialize writes the contents of the index, Deserialize restores them into an empty index
+  // created with the same schema. Deserialize returns false if the data is malformed.
+  virtual void Serialize(IndexWriter* writer) const = 0;
+  virtual bool Deserialize(IndexReader* reader) = 0;
 };
 
 // Base class for type-specific sorting indices.
@@ -79,17 +79,48 @@ typename BlockList<C>::BlockListIterator& BlockList<C>::BlockListIterator::opera
   ++*block_it;
   if (block_it == block_end) {
     ++it;
-    if (it != it_end) {
-      block_it = it->begin();
-      block_end = it->end();
-    } else {
-      block_it = std::nullopt;
-      block_end = std::nullopt;
-    }
+    EnterBlock();
   }
   return *this;
 }
 
+template <typename C> void BlockList<C>::BlockListIterator::SeekGE(DocId t) {
+  if (it == it_end)
+    return;
+
+  // Jump to the last block that starts not after t
+  if (auto next = it + 1; next != it_end && *next->begin() <= t) {
+    it = std::upper_bound(next, it_end, t, [](DocId t, const C& l) { return *l.begin() > t; });
+    --it;
+    EnterBlock();
+  }
+
+  while (block_it != block_end && **block_it < t)
+    ++*block_it;
+
+  if (block_it == block_end) {
+    ++it;
+    EnterBlock();
+  }
+}
+
+template <typename C> void BlockList<C>::BlockListIterator::EnterBlock() {
+  if (it != it_end) {
+    block_it = it->begin();
+    block_end = it->end();
+  } else {
+    block_it = std::nullopt;
+    block_end = std::nullopt;
+  }
+}
+
+template <typename C> size_t BlockList<C>::ByteSize() const {
+  size_t bytes = 0;
+  for (const auto& block : blocks_)
+    bytes += block.ByteSize();
+  return bytes;
+}
+
 template class BlockList<CompressedSortedSet>;
 template class BlockList<SortedVector>;
 
@@ -41,6 +41,9 @@ template <typename Container /* underlying container */> class BlockList {
     return size_;
   }
 
+  // Memory taken by the entries of all blocks
+  size_t ByteSize() const;
+
   struct BlockListIterator {
     // To make it work with std container contructors
     using iterator_category = std::forward_iterator_tag;
@@ -55,6 +58,10 @@ template <typename Container /* underlying container */> class BlockList {
 
     BlockListIterator& operator++();
 
+    // Advances to the first element that is not less than t. The first elements of the blocks
+    // serve as skip pointers, so the blocks before the one that can contain t are not decoded.
+    void SeekGE(DocId t);
+
     friend class BlockList;
 
     bool operator==(const BlockListIterator& other) const {
@@ -73,6 +80,8 @@ template <typename Container /* underlying container */> class BlockList {
       }
     }
 
+    void EnterBlock();  // Start iterating the block at it or become end() if it is the end
+
     ConstBlockIt it, it_end;
     std::optional<typename Container::iterator> block_it, block_end;
   };
@@ -113,6 +122,10 @@ struct SortedVector {
     return entries_.size();
   }
 
+  size_t ByteSize() const {
+    return entries_.size() * sizeof(DocId);
+  }
+
   using iterator = typename PMR_NS::vector<DocId>::const_iterator;
 
   iterator begin() const {
@@ -103,6 +103,38 @@ TYPED_TEST(BlockListTest, RandomNumbers) {
   }
 }
 
+TYPED_TEST(BlockListTest, SeekGE) {
+  auto list = this->Make();
+  std::set<DocId> list_copy;
+  for (size_t i = 0; i < 500; i++) {
+    DocId t = rand() % 10'000;
+    list.Insert(t);
+    list_copy.insert(t);
+  }
+
+  for (size_t i = 0; i < 200; i++) {
+    DocId from = rand() % 10'000, to = from + rand() % 500;
+    auto it = list.begin();
+    it.SeekGE(from);
+    ASSERT_EQ(it != list.end(), list_copy.lower_bound(from) != list_copy.end());
+    if (it != list.end())
+      ASSERT_EQ(*it, *list_copy.lower_bound(from));
+
+    // Seeking again only moves forward
+    it.SeekGE(to);
+    auto expected = list_copy.lower_bound(to);
+    ASSERT_EQ(it != list.end(), expected != list_copy.end());
+    if (it != list.end())
+      ASSERT_EQ(*it, *expected);
+  }
+
+  auto it = list.begin();
+  it.SeekGE(10'000);
+  EXPECT_TRUE(it == list.end());
+  it.SeekGE(20'000);
+  EXPECT_TRUE(it == list.end());
+}
+
 static void BM_Erase90PctTail(benchmark::State& state) {
   BlockList<CompressedSortedSet> bl{PMR_NS::get_default_resource()};
 
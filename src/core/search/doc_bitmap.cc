@@ -0,0 +1,120 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/search/doc_bitmap.h"
+
+#include "base/logging.h"
+
+namespace dfly::search {
+
+using namespace std;
+
+bool DocBitmap::Insert(DocId id) {
+  size_t word = id / 64;
+  if (word >= words_.size())
+    words_.resize(word + 1, 0);
+
+  uint64_t bit = uint64_t(1) << (id % 64);
+  if (words_[word] & bit)
+    return false;
+
+  words_[word] |= bit;
+  size_++;
+  return true;
+}
+
+bool DocBitmap::Remove(DocId id) {
+  if (!Contains(id))
+    return false;
+
+  words_[id / 64] &= ~(uint64_t(1) << (id % 64));
+  size_--;
+
+  while (!words_.empty() && words_.back() == 0)
+    words_.pop_back();
+  return true;
+}
+
+void DocBitmap::AppendIntersection(const DocBitmap& other, vector<DocId>* out) const {
+  size_t num_words = min(words_.size(), other.words_.size());
+  for (size_t i = 0; i < num_words; i++) {
+    for (uint64_t bits = words_[i] & other.words_[i]; bits; bits &= bits - 1)
+      out->push_back(i * 64 + absl::countr_zero(bits));
+  }
+}
+
+void DocBitmap::AppendUnion(const DocBitmap& other, vector<DocId>* out) const {
+  size_t num_words = max(words_.size(), other.words_.size());
+  for (size_t i = 0; i < num_words; i++) {
+    uint64_t bits = (i < words_.size() ? words_[i] : 0) |
+                    (i < other.words_.size() ? other.words_[i] : 0);
+    for (; bits; bits &= bits - 1)
+      out->push_back(i * 64 + absl::countr_zero(bits));
+  }
+}
+
+void DocBitmap::ConstIterator::SeekGE(DocId t) {
+  size_t word = t / 64;
+  if (word < word_ || bits_ == 0)  // already past the word of t or at the end
+    return;
+
+  if (word >= bitmap_->words_.size()) {
+    *this = bitmap_->end();
+    return;
+  }
+
+  if (word > word_) {
+    word_ = word;
+    bits_ = bitmap_->words_[word];
+  }
+
+  bits_ &= ~uint64_t(0) << (t % 64);
+  SkipEmpty();
+}
+
+void DocBitmap::ConstIterator::SkipEmpty() {
+  while (bits_ == 0 && ++word_ < bitmap_->words_.size())
+    bits_ = bitmap_->words_[word_];
+}
+
+bool AdaptivePostings::Insert(DocId id) {
+  max_id_ = max(max_id_, id);
+  if (auto* bitmap = get_if<DocBitmap>(&postings_); bitmap)
+    return bitmap->Insert(id);
+
+  auto& list = get<List>(postings_);
+  if (!list.Insert(id))
+    return false;
+
+  // A list takes about 4 bytes per id and a bitmap 8 bytes per 64 ids up to the largest one.
+  // Convert once the bitmap takes at most half the memory of the list.
+  if (list.Size() >= kMinBitmapSize && (max_id_ / 64 + 1) * 4 <= list.Size()) {
+    DocBitmap bitmap{mr_};
+    for (DocId t : list)
+      bitmap.Insert(t);
+    postings_.emplace<DocBitmap>(std::move(bitmap));
+  }
+  return true;
+}
+
+bool AdaptivePostings::Remove(DocId id) {
+  if (auto* list = get_if<List>(&postings_); list)
+    return list->Remove(id);
+
+  auto& bitmap = get<DocBitmap>(postings_);
+  if (!bitmap.Remove(id))
+    return false;
+
+  // Convert back once the bitmap takes twice the memory of a list. The conversion threshold
+  // above is four times lower, so a value is not converted back and forth repeatedly.
+  if (bitmap.Size() < kMinBitmapSize / 2 || bitmap.NumWords() > bitmap.Size()) {
+    List list{mr_, block_size_};
+    for (DocId t : bitmap)
+      list.Insert(t);
+    postings_.emplace<List>(std::move(list));
+  }
+  return true;
+}
+
+}  // namespace dfly::search
@@ -0,0 +1,167 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/numeric/bits.h>
+
+#include <cstdint>
+#include <iterator>
+#include <variant>
+#include <vector>
+
+#include "base/pmr/memory_resource.h"
+#include "core/search/base.h"
+#include "core/search/block_list.h"
+
+namespace dfly::search {
+
+// Set of doc ids stored as a plain bitmap, one bit per id up to the largest one.
+// Takes less memory than a sorted list once a sizeable fraction of all ids is set and allows
+// checking for membership in constant time, which makes intersections with it cheap.
+class DocBitmap {
+ public:
+  explicit DocBitmap(PMR_NS::memory_resource* mr) : words_(mr) {
+  }
+
+  // Insert element, returns true if inserted, false if already present.
+  bool Insert(DocId id);
+
+  // Remove element, returns true if removed, false if not found.
+  bool Remove(DocId id);
+
+  bool Contains(DocId id) const {
+    size_t word = id / 64;
+    return word < words_.size() && (words_[word] >> (id % 64)) & 1;
+  }
+
+  size_t Size() const {
+    return size_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  // Number of 64 bit words, the bitmap never ends with zero words.
+  size_t NumWords() const {
+    return words_.size();
+  }
+
+  size_t ByteSize() const {
+    return words_.size() * sizeof(uint64_t);
+  }
+
+  // Append the sorted intersection or union with other to out.
+  void AppendIntersection(const DocBitmap& other, std::vector<DocId>* out) const;
+  void AppendUnion(const DocBitmap& other, std::vector<DocId>* out) const;
+
+  struct ConstIterator {
+    // To make it work with std container contructors
+    using iterator_category = std::forward_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = DocId;
+    using pointer = DocId*;
+    using reference = DocId&;
+
+    DocId operator*() const {
+      return word_ * 64 + absl::countr_zero(bits_);
+    }
+
+    ConstIterator& operator++() {
+      bits_ &= bits_ - 1;
+      SkipEmpty();
+      return *this;
+    }
+
+    // Advances to the first element that is not less than t.
+    void SeekGE(DocId t);
+
+    bool operator==(const ConstIterator& other) const {
+      return word_ == other.word_ && bits_ == other.bits_;
+    }
+
+    bool operator!=(const ConstIterator& other) const {
+      return !operator==(other);
+    }
+
+   private:
+    friend class DocBitmap;
+
+    ConstIterator(const DocBitmap* bitmap, size_t word) : bitmap_{bitmap}, word_{word} {
+      if (word_ < bitmap_->words_.size()) {
+        bits_ = bitmap_->words_[word_];
+        SkipEmpty();
+      }
+    }
+
+    void SkipEmpty();  // Move to the next non-empty word if the current one is exhausted
+
+    const DocBitmap* bitmap_;
+    size_t word_;
+    uint64_t bits_ = 0;  // bits of the current word that were not visited yet
+  };
+
+  using iterator = ConstIterator;
+
+  ConstIterator begin() const {
+    return ConstIterator{this, 0};
+  }
+
+  ConstIterator end() const {
+    return ConstIterator{this, words_.size()};
+  }
+
+ private:
+  PMR_NS::vector<uint64_t> words_;
+  size_t size_ = 0;
+};
+
+// Postings that are kept in a block list while they are sparse and moved to a bitmap once the
+// bitmap becomes considerably smaller than the list, i.e. for values shared by a large part of
+// all documents. They are moved back to a list when they become sparse again.
+class AdaptivePostings {
+ public:
+  using List = BlockList<SortedVector>;
+
+  AdaptivePostings(PMR_NS::memory_resource* mr, size_t block_size = 1000)
+      : mr_{mr}, block_size_{block_size}, postings_{std::in_place_type<List>, mr, block_size} {
+  }
+
+  // Insert element, returns true if inserted, false if already present.
+  bool Insert(DocId id);
+
+  // Remove element, returns true if removed, false if not found.
+  bool Remove(DocId id);
+
+  size_t Size() const {
+    return std::visit([](const auto& postings) { return postings.Size(); }, postings_);
+  }
+
+  size_t size() const {
+    return Size();
+  }
+
+  bool IsBitmap() const {
+    return std::holds_alternative<DocBitmap>(postings_);
+  }
+
+  // Calls f with a pointer to the current representation, either const List* or const DocBitmap*
+  template <typename F> decltype(auto) Visit(F&& f) const {
+    return std::visit([&f](const auto& postings) -> decltype(auto) { return f(&postings); },
+                      postings_);
+  }
+
+  // Postings smaller than that are never converted to bitmaps
+  static constexpr size_t kMinBitmapSize = 1024;
+
+ private:
+  PMR_NS::memory_resource* mr_;
+  size_t block_size_;
+  DocId max_id_ = 0;  // largest id ever inserted, bounds the size of the bitmap from above
+
+  std::variant<List, DocBitmap> postings_;
+};
+
+}  // namespace dfly::search
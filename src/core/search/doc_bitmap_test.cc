@@ -0,0 +1,119 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/search/doc_bitmap.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <set>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+namespace dfly::search {
+
+using namespace std;
+
+class DocBitmapTest : public testing::Test {
+ protected:
+  DocBitmap Make(const set<DocId>& ids) {
+    DocBitmap bitmap{PMR_NS::get_default_resource()};
+    for (DocId id : ids)
+      bitmap.Insert(id);
+    return bitmap;
+  }
+};
+
+TEST_F(DocBitmapTest, InsertRemove) {
+  DocBitmap bitmap{PMR_NS::get_default_resource()};
+  EXPECT_TRUE(bitmap.begin() == bitmap.end());
+
+  EXPECT_TRUE(bitmap.Insert(5));
+  EXPECT_TRUE(bitmap.Insert(64));
+  EXPECT_TRUE(bitmap.Insert(200));
+  EXPECT_FALSE(bitmap.Insert(64));
+  EXPECT_EQ(bitmap.Size(), 3u);
+
+  EXPECT_TRUE(bitmap.Contains(64));
+  EXPECT_FALSE(bitmap.Contains(63));
+  EXPECT_FALSE(bitmap.Contains(1000));
+  EXPECT_THAT(vector<DocId>(bitmap.begin(), bitmap.end()), testing::ElementsAre(5, 64, 200));
+
+  EXPECT_TRUE(bitmap.Remove(200));
+  EXPECT_FALSE(bitmap.Remove(200));
+  EXPECT_EQ(bitmap.NumWords(), 2u);
+  EXPECT_THAT(vector<DocId>(bitmap.begin(), bitmap.end()), testing::ElementsAre(5, 64));
+}
+
+TEST_F(DocBitmapTest, SeekGE) {
+  auto bitmap = Make({3, 70, 71, 500});
+
+  auto it = bitmap.begin();
+  it.SeekGE(2);
+  EXPECT_EQ(*it, 3u);
+  it.SeekGE(4);
+  EXPECT_EQ(*it, 70u);
+  it.SeekGE(71);
+  EXPECT_EQ(*it, 71u);
+  it.SeekGE(10);  // never moves backwards
+  EXPECT_EQ(*it, 71u);
+  it.SeekGE(200);
+  EXPECT_EQ(*it, 500u);
+  it.SeekGE(501);
+  EXPECT_TRUE(it == bitmap.end());
+}
+
+TEST_F(DocBitmapTest, SetOperations) {
+  default_random_engine rng{42};
+  set<DocId> s1, s2;
+  for (unsigned i = 0; i < 1000; i++) {
+    s1.insert(rng() % 3000);
+    s2.insert(rng() % 2000);
+  }
+  auto b1 = Make(s1), b2 = Make(s2);
+
+  vector<DocId> expected, out;
+  set_intersection(s1.begin(), s1.end(), s2.begin(), s2.end(), back_inserter(expected));
+  b1.AppendIntersection(b2, &out);
+  EXPECT_EQ(out, expected);
+
+  expected.clear();
+  out.clear();
+  set_union(s1.begin(), s1.end(), s2.begin(), s2.end(), back_inserter(expected));
+  b2.AppendUnion(b1, &out);
+  EXPECT_EQ(out, expected);
+}
+
+TEST_F(DocBitmapTest, AdaptivePostings) {
+  const size_t kNumDocs = AdaptivePostings::kMinBitmapSize * 4;
+  AdaptivePostings postings{PMR_NS::get_default_resource(), 100};
+
+  // Every other document, dense enough to become a bitmap
+  for (DocId id = 0; id < kNumDocs; id += 2)
+    EXPECT_TRUE(postings.Insert(id));
+  EXPECT_TRUE(postings.IsBitmap());
+  EXPECT_FALSE(postings.Insert(0));
+  EXPECT_EQ(postings.Size(), kNumDocs / 2);
+
+  auto ids = postings.Visit([](const auto* set) { return vector<DocId>(set->begin(), set->end()); });
+  EXPECT_EQ(ids.size(), kNumDocs / 2);
+  EXPECT_TRUE(is_sorted(ids.begin(), ids.end()));
+
+  // Became sparse again
+  for (DocId id = 0; id < kNumDocs; id += 2) {
+    if (id % 256 != 0)
+      EXPECT_TRUE(postings.Remove(id));
+  }
+  EXPECT_FALSE(postings.IsBitmap());
+  EXPECT_EQ(postings.Size(), kNumDocs / 256);
+
+  ids = postings.Visit([](const auto* set) { return vector<DocId>(set->begin(), set->end()); });
+  for (size_t i = 0; i < ids.size(); i++)
+    EXPECT_EQ(ids[i], i * 256);
+}
+
+}  // namespace dfly::search
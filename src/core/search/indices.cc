@@ -5,7 +5,9 @@
 #include "core/search/indices.h"
 
 #include <absl/container/flat_hash_set.h>
+#include <absl/container/inlined_vector.h>
 #include <absl/strings/ascii.h>
+#include <absl/strings/match.h>
 #include <absl/strings/numbers.h>
 #include <absl/strings/str_join.h>
 #include <absl/strings/str_split.h>
@@ -20,9 +22,18 @@
 #include <uni_algo/ranges_word.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 #include "base/logging.h"
+#include "core/search/vector_utils.h"
 
 namespace dfly::search {
 
@@ -30,6 +41,47 @@ using namespace std;
 
 namespace {
 
+// Approximate size of the blocks of flat vector indices.
+constexpr size_t kVectorBlockBytes = 1 << 16;
+
+// Threads shared by the bulk loads of all the shards. They are started on first use and live
+// until the process exits.
+class BulkLoadPool {
+ public:
+  static BulkLoadPool& Get() {
+    static BulkLoadPool* pool = new BulkLoadPool{};
+    return *pool;
+  }
+
+  // Runs task on a pool thread, starting threads until there are at least num_threads.
+  void Run(function<void()> task, unsigned num_threads) {
+    lock_guard lk{mu_};
+    while (num_started_ < num_threads) {
+      thread{[this] { Loop(); }}.detach();
+      num_started_++;
+    }
+    tasks_.push_back(std::move(task));
+    cv_.notify_one();
+  }
+
+ private:
+  void Loop() {
+    while (true) {
+      unique_lock lk{mu_};
+      cv_.wait(lk, [this] { return !tasks_.empty(); });
+      auto task = std::move(tasks_.front());
+      tasks_.pop_front();
+      lk.unlock();
+      task();
+    }
+  }
+
+  mutex mu_;
+  condition_variable cv_;
+  deque<function<void()>> tasks_;
+  unsigned num_started_ = 0;
+};
+
 bool IsAllAscii(string_view sv) {
   return all_of(sv.begin(), sv.end(), [](unsigned char c) { return isascii(c); });
 }
@@ -54,6 +106,36 @@ absl::flat_hash_set<string> NormalizeTags(string_view taglist) {
   return tags;
 }
 
+// Lowercase the stripped word like the indexed ones
+string NormalizeWord(string_view str) {
+  str = absl::StripAsciiWhitespace(str);
+  if (IsAllAscii(str))
+    return absl::AsciiStrToLower(str);
+  return una::cases::to_lowercase_utf8(str);
+}
+
+// Call f with a pointer to an iterable representation of the postings
+template <typename C, typename F> decltype(auto) VisitPostings(const BlockList<C>& ids, F&& f) {
+  return f(&ids);
+}
+
+template <typename F> decltype(auto) VisitPostings(const AdaptivePostings& ids, F&& f) {
+  return ids.Visit(std::forward<F>(f));
+}
+
+template <typename C> vector<DocId> MergePostings(absl::Span<const C* const> postings) {
+  vector<DocId> out;
+  auto append = [&out](const auto* set) { out.insert(out.end(), set->begin(), set->end()); };
+  for (const auto* ids : postings)
+    VisitPostings(*ids, append);
+
+  if (postings.size() > 1) {
+    sort(out.begin(), out.end());
+    out.erase(unique(out.begin(), out.end()), out.end());
+  }
+  return out;
+}
+
 };  // namespace
 
 NumericIndex::NumericIndex(PMR_NS::memory_resource* mr) : entries_{mr} {
@@ -62,54 +144,147 @@ NumericIndex::NumericIndex(PMR_NS::memory_resource* mr) : entries_{mr} {
 void NumericIndex::Add(DocId id, DocumentAccessor* doc, string_view field) {
   for (auto str : doc->GetStrings(field)) {
     double num;
-    if (absl::SimpleAtod(str, &num))
-      entries_.emplace(num, id);
+    if (absl::SimpleAtod(str, &num) && !isnan(num))
+      entries_.Insert({num, id});
   }
 }
 
 void NumericIndex::Remove(DocId id, DocumentAccessor* doc, string_view field) {
   for (auto str : doc->GetStrings(field)) {
     double num;
-    if (absl::SimpleAtod(str, &num))
-      entries_.erase({num, id});
+    if (absl::SimpleAtod(str, &num) && !isnan(num))
+      entries_.Delete({num, id});
   }
 }
 
+pair<uint32_t, uint32_t> NumericIndex::RankRange(double l, double r) const {
+  if (entries_.Size() == 0 || l > r)
+    return {0, 0};
+
+  auto first = entries_.GEQ({l, 0});
+  auto last = entries_.LEQ({r, numeric_limits<DocId>::max()});
+  if (first.Empty() || last.Empty())
+    return {0, 0};
+
+  uint32_t first_rank = first.Rank(), last_rank = last.Rank() + 1;
+  return {first_rank, max(first_rank, last_rank)};
+}
+
 vector<DocId> NumericIndex::Range(double l, double r) const {
-  auto it_l = entries_.lower_bound({l, 0});
-  auto it_r = entries_.lower_bound({r, numeric_limits<DocId>::max()});
+  auto [first, last] = RankRange(l, r);
+  if (first == last)
+    return {};
 
   vector<DocId> out;
-  for (auto it = it_l; it != it_r; ++it)
-    out.push_back(it->second);
+  out.reserve(last - first);
+  entries_.Iterate(first, last - 1, [&out](Entry entry) {
+    out.push_back(entry.id);
+    return true;
+  });
 
   sort(out.begin(), out.end());
   out.erase(unique(out.begin(), out.end()), out.end());
   return out;
 }
 
+size_t NumericIndex::RangeSize(double l, double r) const {
+  auto [first, last] = RankRange(l, r);
+  return last - first;
+}
+
+void NumericIndex::Serialize(IndexWriter* writer) const {
+  writer->Write<uint64_t>(entries_.Size());
+  if (entries_.Size() == 0)
+    return;
+
+  entries_.Iterate(0, entries_.Size() - 1, [writer](Entry entry) {
+    writer->Write(entry.value);
+    writer->Write(entry.id);
+    return true;
+  });
+}
+
+bool NumericIndex::Deserialize(IndexReader* reader) {
+  DCHECK_EQ(entries_.Size(), 0u);
+
+  uint64_t size;
+  if (!reader->Read(&size))
+    return false;
+
+  vector<Entry> entries;
+  for (uint64_t i = 0; i < size; i++) {
+    double value;
+    DocId id;
+    if (!reader->Read(&value) || !reader->Read(&id))
+      return false;
+
+    Entry entry{value, id};
+
+    // FromSorted requires strictly ascending entries
+    if (!entries.empty() && EntryPolicy::KeyCompareTo{}(entries.back(), entry) >= 0)
+      return false;
+    entries.push_back(entry);
+  }
+
+  entries_.FromSorted(entries);
+  return true;
+}
+
 template <typename C>
-BaseStringIndex<C>::BaseStringIndex(PMR_NS::memory_resource* mr) : entries_{mr} {
+BaseStringIndex<C>::BaseStringIndex(PMR_NS::memory_resource* mr)
+    : entries_{mr}, words_{mr}, reversed_words_{mr} {
 }
 
 template <typename C>
 const typename BaseStringIndex<C>::Container* BaseStringIndex<C>::Matching(string_view str) const {
-  str = absl::StripAsciiWhitespace(str);
+  auto it = entries_.find(NormalizeWord(str));
+  return (it != entries_.end()) ? &it->second : nullptr;
+}
 
-  string word;
-  if (IsAllAscii(str))
-    word = absl::AsciiStrToLower(str);
-  else
-    word = una::cases::to_lowercase_utf8(str);
+template <typename C>
+vector<DocId> BaseStringIndex<C>::MatchingPrefix(string_view prefix) const {
+  string word = NormalizeWord(prefix);
+
+  vector<const Container*> matched;
+  auto it = words_.lower_bound(string_view{word});
+  for (; it != words_.end() && absl::StartsWith(*it, word); ++it)
+    matched.push_back(&entries_.find(*it)->second);
+  return MergePostings<C>(absl::MakeConstSpan(matched));
+}
 
-  auto it = entries_.find(word);
-  return (it != entries_.end()) ? &it->second : nullptr;
+template <typename C>
+vector<DocId> BaseStringIndex<C>::MatchingSuffix(string_view suffix) const {
+  string word = NormalizeWord(suffix);
+  reverse(word.begin(), word.end());
+
+  vector<const Container*> matched;
+  auto it = reversed_words_.lower_bound(string_view{word});
+  for (; it != reversed_words_.end() && absl::StartsWith(*it, word); ++it)
+    matched.push_back(&entries_.find(string{it->rbegin(), it->rend()})->second);
+  return MergePostings<C>(absl::MakeConstSpan(matched));
+}
+
+template <typename C>
+vector<DocId> BaseStringIndex<C>::MatchingInfix(string_view infix) const {
+  string word = NormalizeWord(infix);
+
+  vector<const Container*> matched;
+  for (const auto& [entry_word, ids] : entries_) {
+    if (absl::StrContains(entry_word, word))
+      matched.push_back(&ids);
+  }
+  return MergePostings<C>(absl::MakeConstSpan(matched));
 }
 
 template <typename C>
 typename BaseStringIndex<C>::Container* BaseStringIndex<C>::GetOrCreate(string_view word) {
   auto* mr = entries_.get_allocator().resource();
-  return &entries_.try_emplace(PMR_NS::string{word, mr}, mr, 1000 /* block size */).first->second;
+  auto [it, inserted] = entries_.try_emplace(PMR_NS::string{word, mr}, mr, 1000 /* block size */);
+  if (inserted) {
+    words_.emplace(word);
+    reversed_words_.emplace(word.rbegin(), word.rend());
+  }
+  return &it->second;
 }
 
 template <typename C>
@@ -134,13 +309,54 @@ void BaseStringIndex<C>::Remove(DocId id, DocumentAccessor* doc, string_view fie
       continue;
 
     it->second.Remove(id);
-    if (it->second.Size() == 0)
+    if (it->second.Size() == 0) {
+      string_view word = it->first;
+      words_.erase(word);
+      string reversed{word.rbegin(), word.rend()};
+      reversed_words_.erase(string_view{reversed});
       entries_.erase(it);
+    }
   }
 }
 
-template struct BaseStringIndex<CompressedSortedSet>;
-template struct BaseStringIndex<SortedVector>;
+template <typename C> void BaseStringIndex<C>::Serialize(IndexWriter* writer) const {
+  writer->Write<uint64_t>(entries_.size());
+  for (const auto& [word, ids] : entries_) {
+    writer->WriteString(word);
+    writer->Write<uint64_t>(ids.Size());
+    VisitPostings(ids, [writer](const auto* set) {
+      for (DocId id : *set)
+        writer->Write(id);
+    });
+  }
+}
+
+template <typename C> bool BaseStringIndex<C>::Deserialize(IndexReader* reader) {
+  DCHECK(entries_.empty());
+
+  uint64_t num_words;
+  if (!reader->Read(&num_words))
+    return false;
+
+  for (uint64_t i = 0; i < num_words; i++) {
+    string_view word;
+    uint64_t num_ids;
+    if (!reader->ReadString(&word) || !reader->Read(&num_ids) || num_ids == 0)
+      return false;
+
+    // Ids are inserted in ascending order, so they are always appended to the last block.
+    Container* ids = GetOrCreate(word);
+    for (uint64_t j = 0; j < num_ids; j++) {
+      DocId id;
+      if (!reader->Read(&id) || !ids->Insert(id))
+        return false;
+    }
+  }
+  return true;
+}
+
+template struct BaseStringIndex<BlockList<CompressedSortedSet>>;
+template struct BaseStringIndex<AdaptivePostings>;
 
 absl::flat_hash_set<std::string> TextIndex::Tokenize(std::string_view value) const {
   return TokenizeWords(value);
@@ -159,29 +375,236 @@ std::pair<size_t /*dim*/, VectorSimilarity> BaseVectorIndex::Info() const {
 
 FlatVectorIndex::FlatVectorIndex(const SchemaField::VectorParams& params,
                                  PMR_NS::memory_resource* mr)
-    : BaseVectorIndex{params.dim, params.sim}, entries_{mr} {
+    : BaseVectorIndex{params.dim, params.sim}, quantization_{params.quantization}, mr_{mr} {
   DCHECK(!params.use_hnsw);
-  entries_.reserve(params.capacity * params.dim);
+  size_t doc_bytes = quantization_ == VectorQuantization::INT8 ? dim_ + sizeof(float)
+                                                               : dim_ * sizeof(float);
+  docs_per_block_ = max<size_t>(1, kVectorBlockBytes / doc_bytes);
+  blocks_.reserve((params.capacity + docs_per_block_ - 1) / docs_per_block_);
 }
 
-void FlatVectorIndex::Add(DocId id, DocumentAccessor* doc, string_view field) {
-  DCHECK_LE(id * dim_, entries_.size());
-  if (id * dim_ == entries_.size())
-    entries_.resize((id + 1) * dim_);
+FlatVectorIndex::~FlatVectorIndex() {
+  for (Block& block : blocks_)
+    Unstore(&block);
+}
 
+void FlatVectorIndex::Add(DocId id, DocumentAccessor* doc, string_view field) {
   // TODO: Let get vector write to buf itself
   auto [ptr, size] = doc->GetVector(field);
 
-  if (size == dim_)
-    memcpy(&entries_[id * dim_], ptr.get(), dim_ * sizeof(float));
+  DCHECK_LE(id, num_docs_);
+  num_docs_ = max<size_t>(num_docs_, id + 1);
+  while (blocks_.size() * docs_per_block_ < num_docs_)
+    blocks_.emplace_back(BlockSize(), mr_);
+
+  if (size != dim_)
+    return;
+
+  float* block = Touch(id);
+  Block& dest = blocks_[id / docs_per_block_];
+  Unstore(&dest);
+  ++dest.version;
+
+  if (quantization_ == VectorQuantization::INT8) {
+    int8_t* codes = const_cast<int8_t*>(Codes(block, id));
+    block[id % docs_per_block_] = QuantizeVector(ptr.get(), dim_, codes);
+    return;
+  }
+
+  memcpy(const_cast<float*>(Vector(block, id)), ptr.get(), dim_ * sizeof(float));
 }
 
 void FlatVectorIndex::Remove(DocId id, DocumentAccessor* doc, string_view field) {
   // noop
 }
 
+void FlatVectorIndex::Serialize(IndexWriter* writer) const {
+  // The arrays of the vectors, the codes and the scales of all documents, written block by block.
+  // Loading the spilled blocks preempts, documents added meanwhile are not written.
+  size_t num_docs = num_docs_;
+  auto write_array = [&](size_t per_doc, auto get) {
+    writer->Write<uint64_t>(num_docs * per_doc);
+    for (DocId first = 0; first < num_docs; first += docs_per_block_) {
+      size_t count = min(docs_per_block_, num_docs - first);
+      writer->WriteValues(absl::MakeConstSpan(get(Touch(first), first), count * per_doc));
+    }
+  };
+
+  auto vectors = [this](const float* block, DocId doc) { return Vector(block, doc); };
+  auto codes = [this](const float* block, DocId doc) { return Codes(block, doc); };
+  auto scales = [](const float* block, DocId doc) { return block; };
+  if (quantization_ == VectorQuantization::INT8) {
+    writer->WriteArray(absl::Span<const float>{});
+    write_array(dim_, codes);
+    write_array(1, scales);
+  } else {
+    write_array(dim_, vectors);
+    writer->WriteArray(absl::Span<const int8_t>{});
+    writer->WriteArray(absl::Span<const float>{});
+  }
+}
+
+bool FlatVectorIndex::Deserialize(IndexReader* reader) {
+  vector<float> entries, scales;
+  vector<int8_t> codes;
+  if (!reader->ReadArray(&entries) || !reader->ReadArray(&codes) || !reader->ReadArray(&scales))
+    return false;
+
+  bool quantized = quantization_ == VectorQuantization::INT8;
+  if (entries.size() % dim_ != 0 || codes.size() != scales.size() * dim_ ||
+      (quantized ? !entries.empty() : !scales.empty()))
+    return false;
+
+  for (Block& block : blocks_)
+    Unstore(&block);
+  blocks_.clear();
+
+  num_docs_ = quantized ? scales.size() : entries.size() / dim_;
+  for (DocId first = 0; first < num_docs_; first += docs_per_block_) {
+    float* block = blocks_.emplace_back(BlockSize(), mr_).data.data();
+    size_t count = min(docs_per_block_, num_docs_ - first);
+    if (quantized) {
+      memcpy(block, &scales[first], count * sizeof(float));
+      memcpy(const_cast<int8_t*>(Codes(block, first)), &codes[first * dim_], count * dim_);
+    } else {
+      memcpy(block, &entries[first * dim_], count * dim_ * sizeof(float));
+    }
+  }
+  return true;
+}
+
 const float* FlatVectorIndex::Get(DocId doc) const {
-  return &entries_[doc * dim_];
+  return quantization_ == VectorQuantization::NONE ? Vector(Touch(doc), doc) : nullptr;
+}
+
+FlatVectorIndex::Query FlatVectorIndex::MakeQuery(const float* target) const {
+  Query query{target};
+  if (quantization_ == VectorQuantization::INT8) {
+    query.codes = make_unique<int8_t[]>(dim_);
+    query.scale = QuantizeVector(target, dim_, query.codes.get());
+  }
+  return query;
+}
+
+float FlatVectorIndex::Distance(const Query& query, DocId doc) const {
+  const float* block = Touch(doc);
+  if (quantization_ == VectorQuantization::INT8)
+    return QuantizedVectorDistance(query.codes.get(), query.scale, Codes(block, doc),
+                                   Scale(block, doc), dim_, sim_);
+  return VectorDistance(query.vec, Vector(block, doc), dim_, sim_);
+}
+
+void FlatVectorIndex::Distances(const Query& query, const DocId* docs, size_t count,
+                                float* out) const {
+  if (quantization_ == VectorQuantization::INT8) {
+    for (size_t i = 0; i < count; i++)
+      out[i] = Distance(query, docs[i]);
+    return;
+  }
+
+  // Loading blocks may preempt, the loaded ones must stay in memory until the distances are
+  // computed.
+  ++pins_;
+  absl::InlinedVector<const float*, 64> vecs(count);
+  for (size_t i = 0; i < count; i++)
+    vecs[i] = Vector(Touch(docs[i]), docs[i]);
+  VectorDistances(query.vec, vecs.data(), count, dim_, sim_, out);
+  --pins_;
+}
+
+void FlatVectorIndex::SpillStep(BlockStorage* storage, size_t max_bytes, unsigned budget) {
+  DCHECK(!storage_ || storage_ == storage);
+  storage_ = storage;
+  if (pins_ > 0)
+    return;
+
+  size_t block_bytes = BlockSize() * sizeof(float);
+  vector<pair<uint64_t, size_t>> loaded;  // last access and index of the blocks in memory
+  for (size_t i = 0; i < blocks_.size(); i++) {
+    Block& block = blocks_[i];
+    if (block.data.empty())
+      continue;
+
+    // Failed writes are retried.
+    if (block.handle && storage_->GetState(*block.handle) == BlockStorage::FAILED)
+      Unstore(&block);
+    loaded.emplace_back(block.last_access, i);
+  }
+
+  size_t max_blocks = max_bytes / block_bytes;
+  if (loaded.size() <= max_blocks)
+    return;
+
+  size_t excess = loaded.size() - max_blocks;
+  partial_sort(loaded.begin(), loaded.begin() + excess, loaded.end());
+  loaded.resize(excess);
+
+  // The blocks are dropped once their copies are written, by one of the following calls.
+  for (auto [_, index] : loaded) {
+    Block& block = blocks_[index];
+    if (!block.handle && budget > 0) {
+      block.handle = storage_->Store({reinterpret_cast<char*>(block.data.data()), block_bytes});
+      budget = block.handle ? budget - 1 : 0;
+    } else if (block.handle && storage_->GetState(*block.handle) == BlockStorage::STORED) {
+      PMR_NS::vector<float>(mr_).swap(block.data);
+    }
+  }
+}
+
+size_t FlatVectorIndex::NumSpilledBlocks() const {
+  return count_if(blocks_.begin(), blocks_.end(),
+                  [](const Block& block) { return block.data.empty(); });
+}
+
+size_t FlatVectorIndex::BlockSize() const {
+  if (quantization_ == VectorQuantization::INT8)
+    return docs_per_block_ + (docs_per_block_ * dim_ + sizeof(float) - 1) / sizeof(float);
+  return docs_per_block_ * dim_;
+}
+
+float* FlatVectorIndex::Touch(DocId doc) const {
+  size_t index = doc / docs_per_block_;
+  DCHECK_LT(index, blocks_.size());
+  blocks_[index].last_access = ++access_clock_;
+
+  // Loading preempts, another load may fill the block meanwhile or it may be modified and
+  // spilled again.
+  while (blocks_[index].data.empty()) {
+    DCHECK(storage_ && blocks_[index].handle);
+    DCHECK_EQ(storage_->GetState(*blocks_[index].handle), BlockStorage::STORED);
+    uint64_t version = blocks_[index].version;
+    PMR_NS::vector<float> data(BlockSize(), mr_);
+    bool loaded = storage_->Load(*blocks_[index].handle, data.size() * sizeof(float),
+                                 reinterpret_cast<char*>(data.data()));
+
+    Block& block = blocks_[index];
+    if (block.data.empty() && block.version == version) {
+      // The stored copy is kept, so a block that failed to load has zero vectors until it is
+      // dropped and loaded again.
+      LOG_IF(ERROR, !loaded) << "Failed to load a block of a vector index";
+      block.data = std::move(data);
+    }
+  }
+  return blocks_[index].data.data();
+}
+
+void FlatVectorIndex::Unstore(Block* block) {
+  if (block->handle) {
+    storage_->Free(*block->handle, BlockSize() * sizeof(float));
+    block->handle.reset();
+  }
+}
+
+const float* FlatVectorIndex::Vector(const float* block, DocId doc) const {
+  return block + doc % docs_per_block_ * dim_;
+}
+
+const int8_t* FlatVectorIndex::Codes(const float* block, DocId doc) const {
+  return reinterpret_cast<const int8_t*>(block + docs_per_block_) + doc % docs_per_block_ * dim_;
+}
+
+float FlatVectorIndex::Scale(const float* block, DocId doc) const {
+  return block[doc % docs_per_block_];
 }
 
 struct HnswlibAdapter {
@@ -191,36 +614,152 @@ struct HnswlibAdapter {
                                                           100,           true} {
   }
 
-  void Add(float* data, DocId id) {
-    if (world_.cur_element_count + 1 >= world_.max_elements_)
+  // Deleted nodes are reused for new points, their neighbors are relinked by hnswlib.
+  void Add(const float* data, DocId id) {
+    // Points can't be replaced once deleted, so they are restored and updated instead.
+    if (auto it = world_.label_lookup_.find(id);
+        it != world_.label_lookup_.end() && world_.isMarkedDeleted(it->second)) {
+      world_.unmarkDelete(id);
+      world_.addPoint(data, id);
+      return;
+    }
+
+    bool replace_deleted = world_.getDeletedCount() > 0;
+    if (!replace_deleted && world_.cur_element_count + 1 >= world_.max_elements_)
       world_.resizeIndex(world_.cur_element_count * 2);
-    world_.addPoint(data, id);
+    world_.addPoint(data, id, replace_deleted);
+  }
+
+  // Inserts count points of data in parallel, on the calling thread and num_threads - 1 threads
+  // of the shared pool. hnswlib synchronizes concurrent insertions with per element locks, only
+  // its resizing must be done up front.
+  void AddBatch(const float* data, const DocId* ids, size_t count, size_t dim,
+                unsigned num_threads) {
+    if (world_.cur_element_count + count >= world_.max_elements_)
+      world_.resizeIndex(max(world_.cur_element_count * 2, world_.cur_element_count + count + 1));
+
+    // Pool tasks may start only after the batch is done if the pool is busy with the batches of
+    // other shards. So the caller waits for the points to be inserted, not for the tasks, and
+    // the tasks keep the state alive.
+    struct State {
+      atomic_size_t next{0};
+      size_t done = 0;
+      mutex mu;
+      condition_variable cv;
+    };
+    auto state = make_shared<State>();
+
+    auto worker = [this, state, data, ids, count, dim] {
+      size_t inserted = 0;
+      for (size_t i = state->next++; i < count; i = state->next++) {
+        world_.addPoint(data + i * dim, ids[i]);
+        inserted++;
+      }
+      if (inserted == 0)
+        return;
+
+      lock_guard lk{state->mu};
+      state->done += inserted;
+      if (state->done == count)
+        state->cv.notify_all();
+    };
+
+    for (unsigned i = 1; i < num_threads; i++)
+      BulkLoadPool::Get().Run(worker, num_threads - 1);
+    worker();
+
+    unique_lock lk{state->mu};
+    state->cv.wait(lk, [&] { return state->done == count; });
   }
 
   void Remove(DocId id) {
-    world_.markDelete(id);
+    if (Get(id))
+      world_.markDelete(id);
+  }
+
+  // Vector of the point or nullptr if it was not added or deleted
+  const float* Get(DocId id) const {
+    auto it = world_.label_lookup_.find(id);
+    if (it == world_.label_lookup_.end() || world_.isMarkedDeleted(it->second))
+      return nullptr;
+    return reinterpret_cast<const float*>(world_.getDataByInternalId(it->second));
+  }
+
+  size_t NumDeleted() {
+    return world_.getDeletedCount();
+  }
+
+  size_t NumPoints() {
+    return world_.cur_element_count - world_.getDeletedCount();
+  }
+
+  // Calls f(id, vector) for every point that is not deleted.
+  template <typename F> void ForEach(F&& f) const {
+    for (auto [label, internal_id] : world_.label_lookup_) {
+      if (!world_.isMarkedDeleted(internal_id))
+        f(DocId(label), reinterpret_cast<const float*>(world_.getDataByInternalId(internal_id)));
+    }
   }
 
   vector<pair<float, DocId>> Knn(float* target, size_t k) {
     return QueueToVec(world_.searchKnn(target, k));
   }
 
-  vector<pair<float, DocId>> Knn(float* target, size_t k, const vector<DocId>& allowed) {
-    struct BinsearchFilter : hnswlib::BaseFilterFunctor {
+  // Graph search restricted to the allowed ids, which are either a sorted vector or a bitmap.
+  // Unless filters keep only a small fraction of all points, it is much faster than a scan. With
+  // very selective filters, most visited nodes are filtered out and the search can stop before
+  // finding k matches, so the allowed points are scanned directly instead.
+  template <typename S> vector<pair<float, DocId>> Knn(float* target, size_t k, const S& allowed) {
+    if (allowed.size() <= max(kMinGraphSearchSize, NumPoints() / kMaxScanFraction))
+      return KnnScan(target, k, allowed);
+
+    struct SetFilter : hnswlib::BaseFilterFunctor {
       virtual bool operator()(hnswlib::labeltype id) {
-        return binary_search(allowed->begin(), allowed->end(), id);
+        return Contains(*allowed, id);
       }
 
-      BinsearchFilter(const vector<DocId>* allowed) : allowed{allowed} {
+      SetFilter(const S* allowed) : allowed{allowed} {
       }
-      const vector<DocId>* allowed;
+      const S* allowed;
     };
 
-    BinsearchFilter filter{&allowed};
-    return QueueToVec(world_.searchKnn(target, k, &filter));
+    SetFilter filter{&allowed};
+    auto out = QueueToVec(world_.searchKnn(target, k, &filter));
+    if (out.size() < min(k, allowed.size()))
+      return KnnScan(target, k, allowed);
+    return out;
   }
 
  private:
+  // Filters allowing fewer points than that are always scanned
+  static constexpr size_t kMinGraphSearchSize = 1000;
+
+  // Filters allowing less than that fraction of all points are scanned
+  static constexpr size_t kMaxScanFraction = 100;
+
+  static bool Contains(const vector<DocId>& ids, DocId id) {
+    return binary_search(ids.begin(), ids.end(), id);
+  }
+
+  static bool Contains(const DocBitmap& ids, DocId id) {
+    return ids.Contains(id);
+  }
+
+  // Exact k nearest allowed points, computed with the distance function of the graph
+  template <typename S>
+  vector<pair<float, DocId>> KnnScan(const float* target, size_t k, const S& allowed) const {
+    vector<pair<float, DocId>> out;
+    for (DocId id : allowed) {
+      if (const float* data = Get(id); data)
+        out.emplace_back(world_.fstdistfunc_(target, data, world_.dist_func_param_), id);
+    }
+
+    size_t prefix_size = min(k, out.size());
+    partial_sort(out.begin(), out.begin() + prefix_size, out.end());
+    out.resize(prefix_size);
+    return out;
+  }
+
   using SpaceUnion = std::variant<hnswlib::L2Space, hnswlib::InnerProductSpace>;
 
   static SpaceUnion MakeSpace(size_t dim, VectorSimilarity sim) {
@@ -249,7 +788,9 @@ struct HnswlibAdapter {
 };
 
 HnswVectorIndex::HnswVectorIndex(const SchemaField::VectorParams& params, PMR_NS::memory_resource*)
-    : BaseVectorIndex{params.dim, params.sim}, adapter_{make_unique<HnswlibAdapter>(params)} {
+    : BaseVectorIndex{params.dim, params.sim},
+      params_{params},
+      adapter_{make_unique<HnswlibAdapter>(params)} {
   DCHECK(params.use_hnsw);
   // TODO: Patch hnsw to use MR
 }
@@ -260,7 +801,46 @@ HnswVectorIndex::~HnswVectorIndex() {
 void HnswVectorIndex::Add(DocId id, DocumentAccessor* doc, string_view field) {
   auto [ptr, size] = doc->GetVector(field);
   if (size == dim_)
-    adapter_->Add(ptr.get(), id);
+    AddVector(ptr.get(), id);
+}
+
+void HnswVectorIndex::AddVector(float* data, DocId id) {
+  if (bulk_threads_ == 0) {
+    adapter_->Add(data, id);
+    if (compacted_)
+      compacted_->Add(data, id);
+    return;
+  }
+
+  bulk_data_.insert(bulk_data_.end(), data, data + dim_);
+  bulk_ids_.push_back(id);
+  if (bulk_ids_.size() >= kBulkBatchSize)
+    FlushBulk();
+}
+
+void HnswVectorIndex::StartBulkLoad(unsigned num_threads) {
+  // A single thread inserts the vectors directly, without buffering them.
+  bulk_threads_ = num_threads > 1 ? num_threads : 0;
+
+  // Bulk loads happen on empty indices, there is nothing to compact.
+  compacted_.reset();
+  compact_pending_ = {};
+}
+
+void HnswVectorIndex::FinishBulkLoad() {
+  FlushBulk();
+  bulk_threads_ = 0;
+  bulk_data_ = {};
+  bulk_ids_ = {};
+}
+
+void HnswVectorIndex::FlushBulk() {
+  if (bulk_ids_.empty())
+    return;
+
+  adapter_->AddBatch(bulk_data_.data(), bulk_ids_.data(), bulk_ids_.size(), dim_, bulk_threads_);
+  bulk_data_.clear();
+  bulk_ids_.clear();
 }
 
 std::vector<std::pair<float, DocId>> HnswVectorIndex::Knn(float* target, size_t k) const {
@@ -271,8 +851,80 @@ std::vector<std::pair<float, DocId>> HnswVectorIndex::Knn(float* target, size_t
   return adapter_->Knn(target, k, allowed);
 }
 
+std::vector<std::pair<float, DocId>> HnswVectorIndex::Knn(float* target, size_t k,
+                                                          const DocBitmap& allowed) const {
+  return adapter_->Knn(target, k, allowed);
+}
+
 void HnswVectorIndex::Remove(DocId id, DocumentAccessor* doc, string_view field) {
+  DCHECK_EQ(bulk_threads_, 0u);
   adapter_->Remove(id);
+  if (compacted_)
+    compacted_->Remove(id);
+}
+
+size_t HnswVectorIndex::NumDeleted() const {
+  return adapter_->NumDeleted();
+}
+
+void HnswVectorIndex::CompactStep(double max_deleted_ratio, size_t budget) {
+  if (bulk_threads_ > 0)
+    return;
+
+  if (!compacted_) {
+    size_t deleted = adapter_->NumDeleted(), live = adapter_->NumPoints();
+    if (deleted == 0 || deleted <= max_deleted_ratio * (deleted + live))
+      return;
+
+    SchemaField::VectorParams params = params_;
+    params.capacity = max(live, params_.capacity);
+    compacted_ = make_unique<HnswlibAdapter>(params);
+    adapter_->ForEach([this](DocId id, const float*) { compact_pending_.push_back(id); });
+    VLOG(1) << "Compacting hnsw index with " << deleted << " deleted and " << live << " points";
+  }
+
+  // Points added since the compaction started are already in the new graph and points deleted
+  // since are skipped.
+  for (; budget > 0 && !compact_pending_.empty(); compact_pending_.pop_back()) {
+    DocId id = compact_pending_.back();
+    if (const float* data = adapter_->Get(id); data && !compacted_->Get(id)) {
+      compacted_->Add(data, id);
+      budget--;
+    }
+  }
+
+  if (compact_pending_.empty()) {
+    adapter_ = std::move(compacted_);
+    compact_pending_ = {};
+  }
+}
+
+void HnswVectorIndex::Serialize(IndexWriter* writer) const {
+  DCHECK_EQ(bulk_threads_, 0u);
+
+  vector<pair<DocId, const float*>> points;
+  adapter_->ForEach([&points](DocId id, const float* data) { points.emplace_back(id, data); });
+
+  writer->Write<uint64_t>(points.size());
+  for (auto [id, data] : points) {
+    writer->Write(id);
+    writer->WriteArray(absl::MakeConstSpan(data, dim_));
+  }
+}
+
+bool HnswVectorIndex::Deserialize(IndexReader* reader) {
+  uint64_t size;
+  if (!reader->Read(&size))
+    return false;
+
+  vector<float> vec;
+  for (uint64_t i = 0; i < size; i++) {
+    DocId id;
+    if (!reader->Read(&id) || !reader->ReadArray(&vec) || vec.size() != dim_)
+      return false;
+    AddVector(vec.data(), id);
+  }
+  return true;
 }
 
 }  // namespace dfly::search
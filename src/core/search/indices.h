@@ -12,9 +12,11 @@
 #include <vector>
 
 #include "base/pmr/memory_resource.h"
+#include "core/bptree_set.h"
 #include "core/search/base.h"
 #include "core/search/block_list.h"
 #include "core/search/compressed_sorted_set.h"
+#include "core/search/doc_bitmap.h"
 
 // TODO: move core field definitions out of big header
 #include "core/search/search.h"
@@ -28,22 +30,49 @@ struct NumericIndex : public BaseIndex {
 
   void Add(DocId id, DocumentAccessor* doc, std::string_view field) override;
   void Remove(DocId id, DocumentAccessor* doc, std::string_view field) override;
+  void Serialize(IndexWriter* writer) const override;
+  bool Deserialize(IndexReader* reader) override;
 
   std::vector<DocId> Range(double l, double r) const;
 
+  // Number of values in [l, r], computed in logarithmic time from the subtree counts.
+  // Documents with multiple values in the range are counted multiple times.
+  size_t RangeSize(double l, double r) const;
+
  private:
-  using Entry = std::pair<double, DocId>;
-  absl::btree_set<Entry, std::less<Entry>, PMR_NS::polymorphic_allocator<Entry>> entries_;
+  struct Entry {
+    double value;
+    DocId id;
+  } __attribute__((packed));
+
+  struct EntryPolicy {
+    using KeyT = Entry;
+
+    struct KeyCompareTo {
+      int operator()(const Entry& a, const Entry& b) const {
+        if (a.value != b.value)
+          return a.value < b.value ? -1 : 1;
+        return a.id < b.id ? -1 : (a.id > b.id ? 1 : 0);
+      }
+    };
+  };
+
+  // Returns the rank range [first, last) of entries with values in [l, r].
+  std::pair<uint32_t, uint32_t> RankRange(double l, double r) const;
+
+  BPTree<Entry, EntryPolicy> entries_;
 };
 
-// Base index for string based indices.
+// Base index for string based indices, C is the container of the postings of a single word.
 template <typename C> struct BaseStringIndex : public BaseIndex {
-  using Container = BlockList<C>;
+  using Container = C;
 
   BaseStringIndex(PMR_NS::memory_resource* mr);
 
   void Add(DocId id, DocumentAccessor* doc, std::string_view field) override;
   void Remove(DocId id, DocumentAccessor* doc, std::string_view field) override;
+  void Serialize(IndexWriter* writer) const override;
+  bool Deserialize(IndexReader* reader) override;
 
   // Used by Add & Remove to tokenize text value
   virtual absl::flat_hash_set<std::string> Tokenize(std::string_view value) const = 0;
@@ -51,6 +80,14 @@ template <typename C> struct BaseStringIndex : public BaseIndex {
   // Pointer is valid as long as index is not mutated. Nullptr if not found
   const Container* Matching(std::string_view str) const;
 
+  // Sorted union of the postings of all words with the given prefix or suffix. The words are
+  // looked up in sorted dictionaries, so only the matching ones are visited.
+  std::vector<DocId> MatchingPrefix(std::string_view prefix) const;
+  std::vector<DocId> MatchingSuffix(std::string_view suffix) const;
+
+  // Same for words containing infix, which requires scanning all words.
+  std::vector<DocId> MatchingInfix(std::string_view infix) const;
+
  protected:
   Container* GetOrCreate(std::string_view word);
 
@@ -77,20 +114,25 @@ template <typename C> struct BaseStringIndex : public BaseIndex {
   absl::flat_hash_map<PMR_NS::string, Container, PmrHash, PmrEqual,
                       PMR_NS::polymorphic_allocator<std::pair<PMR_NS::string, Container>>>
       entries_;
+
+  // All words of entries_ and their byte-reversed copies, for prefix and suffix lookups
+  using Dictionary = absl::btree_set<PMR_NS::string, std::less<>,
+                                     PMR_NS::polymorphic_allocator<PMR_NS::string>>;
+  Dictionary words_, reversed_words_;
 };
 
 // Index for text fields.
 // Hashmap based lookup per word.
-struct TextIndex : public BaseStringIndex<CompressedSortedSet> {
+struct TextIndex : public BaseStringIndex<BlockList<CompressedSortedSet>> {
   TextIndex(PMR_NS::memory_resource* mr) : BaseStringIndex(mr) {
   }
 
   absl::flat_hash_set<std::string> Tokenize(std::string_view value) const override;
 };
 
-// Index for text fields.
-// Hashmap based lookup per word.
-struct TagIndex : public BaseStringIndex<SortedVector> {
+// Index for tag fields.
+// Hashmap based lookup per tag. The postings of tags shared by many documents are bitmaps.
+struct TagIndex : public BaseStringIndex<AdaptivePostings> {
   TagIndex(PMR_NS::memory_resource* mr) : BaseStringIndex(mr) {
   }
 
@@ -108,17 +150,82 @@ struct BaseVectorIndex : public BaseIndex {
 };
 
 // Index for vector fields.
-// Only supports lookup by id.
+// Only supports lookup by id. The vectors are kept in blocks of consecutive documents, the cold
+// blocks can be moved to a BlockStorage with SpillStep and are loaded back when they are used.
 struct FlatVectorIndex : public BaseVectorIndex {
+  // Query vector in the encoding of the index entries.
+  struct Query {
+    const float* vec;
+    std::unique_ptr<int8_t[]> codes;  // set for quantized indices
+    float scale = 0;
+  };
+
   FlatVectorIndex(const SchemaField::VectorParams& params, PMR_NS::memory_resource* mr);
+  ~FlatVectorIndex();
 
   void Add(DocId id, DocumentAccessor* doc, std::string_view field) override;
   void Remove(DocId id, DocumentAccessor* doc, std::string_view field) override;
+  // Serialize loads the spilled blocks, so it preempts if there are any.
+  void Serialize(IndexWriter* writer) const override;
+  bool Deserialize(IndexReader* reader) override;
 
+  // Returns nullptr for quantized indices. The vector is valid until the next SpillStep.
+  // Accessing the vectors of spilled blocks loads them, which preempts.
   const float* Get(DocId doc) const;
 
+  Query MakeQuery(const float* target) const;
+
+  // Distance from the query to the vector of doc. For quantized indices it is computed on the
+  // codes, not on the original vectors.
+  float Distance(const Query& query, DocId doc) const;
+
+  // Writes the distances from the query to the vectors of docs[i] to out[i].
+  void Distances(const Query& query, const DocId* docs, size_t count, float* out) const;
+
+  // Moves the least recently used blocks to storage until at most max_bytes of blocks remain in
+  // memory. Starts writing at most budget blocks, the written ones are dropped from memory by
+  // the following calls. Blocks that were not modified since they were loaded are dropped
+  // without writing them again. Skipped while a search is loading blocks, since it holds
+  // pointers into the loaded ones. The same storage must be used by all calls and outlive the
+  // index.
+  void SpillStep(BlockStorage* storage, size_t max_bytes, unsigned budget);
+
+  size_t NumSpilledBlocks() const;
+
  private:
-  PMR_NS::vector<float> entries_;
+  // The vectors of docs_per_block_ consecutive documents. For quantized indices their scales,
+  // followed by their dim_ codes each.
+  struct Block {
+    explicit Block(size_t size, PMR_NS::memory_resource* mr) : data(size, mr) {
+    }
+
+    PMR_NS::vector<float> data;  // empty if spilled
+    std::optional<uint64_t> handle;  // of the stored copy, equal to data if both are present
+    uint64_t last_access = 0;
+    uint64_t version = 0;  // changed when data gets a new content
+  };
+
+  size_t BlockSize() const;  // in floats
+
+  // Returns the data of the block of the document, loading it if it was spilled.
+  float* Touch(DocId doc) const;
+
+  // Frees the stored copy of the block before its data is modified.
+  void Unstore(Block* block);
+
+  const float* Vector(const float* block, DocId doc) const;
+  const int8_t* Codes(const float* block, DocId doc) const;
+  float Scale(const float* block, DocId doc) const;
+
+  VectorQuantization quantization_;
+  PMR_NS::memory_resource* mr_;
+  size_t docs_per_block_;
+  size_t num_docs_ = 0;
+
+  mutable std::vector<Block> blocks_;
+  BlockStorage* storage_ = nullptr;
+  mutable uint64_t access_clock_ = 0;
+  mutable unsigned pins_ = 0;  // searches that hold pointers into the blocks
 };
 
 struct HnswlibAdapter;
@@ -130,12 +237,51 @@ struct HnswVectorIndex : public BaseVectorIndex {
   void Add(DocId id, DocumentAccessor* doc, std::string_view field) override;
   void Remove(DocId id, DocumentAccessor* doc, std::string_view field) override;
 
+  // Only the vectors are serialized, the graph is rebuilt when they are deserialized. Like
+  // added vectors, they are inserted in batches if a bulk load is in progress.
+  void Serialize(IndexWriter* writer) const override;
+  bool Deserialize(IndexReader* reader) override;
+
+  // Vectors added until FinishBulkLoad are buffered and inserted in batches by num_threads
+  // threads, all but one of them from a pool shared by all the indices. Does nothing if
+  // num_threads <= 1. The index can not be searched or modified otherwise in the meantime.
+  void StartBulkLoad(unsigned num_threads);
+  void FinishBulkLoad();
+
   std::vector<std::pair<float, DocId>> Knn(float* target, size_t k) const;
+
+  // Nearest neighbors among the allowed documents. Selective filters are evaluated by scanning
+  // the allowed documents instead of searching the graph.
   std::vector<std::pair<float, DocId>> Knn(float* target, size_t k,
                                            const std::vector<DocId>& allowed) const;
+  std::vector<std::pair<float, DocId>> Knn(float* target, size_t k,
+                                           const DocBitmap& allowed) const;
+
+  // Number of deleted points that still occupy graph nodes. Their nodes are reused by new points.
+  size_t NumDeleted() const;
+
+  // Rebuilds the graph without deleted nodes once they make up more than max_deleted_ratio of all
+  // nodes. At most budget points are inserted per call, so the rebuild is spread over many calls.
+  // The old graph serves all searches until the new one is complete.
+  void CompactStep(double max_deleted_ratio, size_t budget);
 
  private:
+  static constexpr size_t kBulkBatchSize = 1 << 14;
+
+  // Inserts the vector right away or buffers it if a bulk load is in progress.
+  void AddVector(float* data, DocId id);
+  void FlushBulk();
+
+  SchemaField::VectorParams params_;
   std::unique_ptr<HnswlibAdapter> adapter_;
+
+  // New graph and the points left to copy to it while a compaction is in progress
+  std::unique_ptr<HnswlibAdapter> compacted_;
+  std::vector<DocId> compact_pending_;
+
+  unsigned bulk_threads_ = 0;
+  std::vector<float> bulk_data_;
+  std::vector<DocId> bulk_ids_;
 };
 
 }  // namespace dfly::search
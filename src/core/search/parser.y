@@ -65,6 +65,7 @@ using namespace std;
 // Needed 0 at the end to satisfy bison 3.5.1
 %token YYEOF 0
 %token <std::string> TERM "term" PARAM "param" FIELD "field"
+%token <std::string> PREFIX "prefix" SUFFIX "suffix" INFIX "infix"
 
 %precedence TERM
 %left OR_OP
@@ -79,6 +80,7 @@ using namespace std;
 %nterm <AstExpr> final_query filter search_expr search_unary_expr search_or_expr search_and_expr numeric_filter_expr
 %nterm <AstExpr> field_cond field_cond_expr field_unary_expr field_or_expr field_and_expr tag_list
 
+%nterm <AstAffixNode> affix
 %nterm <AstKnnNode> knn_query
 %nterm <std::string> opt_knn_alias
 
@@ -122,11 +124,18 @@ search_unary_expr:
   | NOT_OP search_unary_expr          { $$ = AstNegateNode(std::move($2)); }
   | TERM                              { $$ = AstTermNode(std::move($1)); }
   | UINT32                            { $$ = AstTermNode(to_string($1)); }
+  | affix                             { $$ = std::move($1); }
   | FIELD COLON field_cond            { $$ = AstFieldNode(std::move($1), std::move($3)); }
 
+affix:
+  PREFIX                              { $$ = AstAffixNode(std::move($1), AstAffixNode::PREFIX); }
+  | SUFFIX                            { $$ = AstAffixNode(std::move($1), AstAffixNode::SUFFIX); }
+  | INFIX                             { $$ = AstAffixNode(std::move($1), AstAffixNode::INFIX); }
+
 field_cond:
   TERM                                                  { $$ = AstTermNode(std::move($1)); }
   | UINT32                                              { $$ = AstTermNode(to_string($1)); }
+  | affix                                               { $$ = std::move($1); }
   | NOT_OP field_cond                                   { $$ = AstNegateNode(std::move($2)); }
   | LPAREN field_cond_expr RPAREN                       { $$ = std::move($2); }
   | LBRACKET numeric_filter_expr RBRACKET               { $$ = std::move($2); }
@@ -161,12 +170,15 @@ field_unary_expr:
   | NOT_OP field_unary_expr                      { $$ = AstNegateNode(std::move($2)); };
   | TERM                                         { $$ = AstTermNode(std::move($1)); }
   | UINT32                                       { $$ = AstTermNode(to_string($1)); }
+  | affix                                        { $$ = std::move($1); }
 
 tag_list:
   TERM                       { $$ = AstTagsNode(std::move($1)); }
   | UINT32                   { $$ = AstTagsNode(to_string($1)); }
+  | affix                    { $$ = AstTagsNode(std::move($1)); }
   | tag_list OR_OP TERM      { $$ = AstTagsNode(std::move($1), std::move($3)); }
   | tag_list OR_OP DOUBLE    { $$ = AstTagsNode(std::move($1), to_string($3)); }
+  | tag_list OR_OP affix     { $$ = AstTagsNode(std::move($1), std::move($3)); }
 
 
 %%
@@ -17,10 +17,10 @@
 #include "core/overloaded.h"
 #include "core/search/ast_expr.h"
 #include "core/search/compressed_sorted_set.h"
+#include "core/search/doc_bitmap.h"
 #include "core/search/indices.h"
 #include "core/search/query_driver.h"
 #include "core/search/sort_indices.h"
-#include "core/search/vector_utils.h"
 
 using namespace std;
 
@@ -42,11 +42,42 @@ AstExpr ParseQuery(std::string_view query, const QueryParams* params) {
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
 
+// Returns the first element of [first, last) that is not less than t, probing exponentially
+// growing steps first. Faster than lower_bound when the result is close to first.
+vector<DocId>::const_iterator GallopLowerBound(vector<DocId>::const_iterator first,
+                                               vector<DocId>::const_iterator last, DocId t) {
+  size_t step = 1;
+  while (step < size_t(last - first) && first[step] < t) {
+    first += step;
+    step *= 2;
+  }
+  return lower_bound(first, first + min(step, size_t(last - first)), t);
+}
+
+// Intersects by looking up the elements of small in large. Most of large is skipped if it is
+// much bigger, unlike in a merge of both sets.
+template <typename S, typename L>
+void IntersectBySeek(const S& small, const L& large, vector<DocId>* out) {
+  auto it = large.begin();
+  auto end = large.end();
+  for (DocId t : small) {
+    if constexpr (is_same_v<L, vector<DocId>>)
+      it = GallopLowerBound(it, end, t);
+    else
+      it.SeekGE(t);
+
+    if (it == end)
+      break;
+    if (*it == t)
+      out->push_back(t);
+  }
+}
+
 // Represents an either owned or non-owned result set that can be accessed transparently.
 struct IndexResult {
   using DocVec = vector<DocId>;
-  using BorrowedView =
-      variant<const DocVec*, const BlockList<CompressedSortedSet>*, const BlockList<SortedVector>*>;
+  using BorrowedView = variant<const DocVec*, const BlockList<CompressedSortedSet>*,
+                               const BlockList<SortedVector>*, const DocBitmap*>;
 
   IndexResult() : value_{DocVec{}} {
   }
@@ -59,6 +90,12 @@ struct IndexResult {
       value_ = DocVec{};
   }
 
+  // Borrow the current representation of the postings
+  IndexResult(const AdaptivePostings* postings) : value_{DocVec{}} {
+    if (postings)
+      postings->Visit([this](const auto* set) { value_ = set; });
+  }
+
   size_t Size() const {
     return visit([](auto* set) { return set->size(); }, Borrowed());
   }
@@ -67,6 +104,12 @@ struct IndexResult {
     return holds_alternative<DocVec>(value_);
   }
 
+  // Borrowed bitmap or nullptr if the result is stored differently
+  const DocBitmap* Bitmap() const {
+    auto* bitmap = get_if<const DocBitmap*>(&value_);
+    return bitmap ? *bitmap : nullptr;
+  }
+
   IndexResult& operator=(DocVec&& entries) {
     if (holds_alternative<DocVec>(value_)) {
       swap(get<DocVec>(value_), entries);  // swap to keep backing array
@@ -107,7 +150,7 @@ struct IndexResult {
 
  private:
   variant<DocVec /*owned*/, const DocVec*, const BlockList<CompressedSortedSet>*,
-          const BlockList<SortedVector>*>
+          const BlockList<SortedVector>*, const DocBitmap*>
       value_;
 };
 
@@ -116,12 +159,19 @@ struct ProfileBuilder {
     Overloaded node_info{
         [](monostate) -> string { return ""s; },
         [](const AstTermNode& n) { return absl::StrCat("Term{", n.term, "}"); },
+        [](const AstAffixNode& n) {
+          const char* kinds[] = {"Prefix", "Suffix", "Infix"};
+          return absl::StrCat(kinds[n.kind], "{", n.affix, "}");
+        },
         [](const AstRangeNode& n) { return absl::StrCat("Range{", n.lo, "<>", n.hi, "}"); },
         [](const AstLogicalNode& n) {
           auto op = n.op == AstLogicalNode::AND ? "and" : "or";
           return absl::StrCat("Logical{n=", n.nodes.size(), ",o=", op, "}");
         },
-        [](const AstTagsNode& n) { return absl::StrCat("Tags{", absl::StrJoin(n.tags, ","), "}"); },
+        [](const AstTagsNode& n) {
+          return absl::StrCat("Tags{", absl::StrJoin(n.tags, ","), ",affixes=", n.affixes.size(),
+                              "}");
+        },
         [](const AstFieldNode& n) { return absl::StrCat("Field{", n.field, "}"); },
         [](const AstKnnNode& n) { return absl::StrCat("KNN{l=", n.limit, "}"); },
         [](const AstNegateNode& n) { return absl::StrCat("Negate{}"); },
@@ -131,20 +181,24 @@ struct ProfileBuilder {
     return visit(node_info, node.Variant());
   }
 
-  using Tp = std::chrono::steady_clock::time_point;
-
-  Tp Start() {
-    depth_++;
-    return chrono::steady_clock::now();
+  // Start evaluating a node, decoded_bytes is the current value of the search's byte counter
+  void Start(size_t decoded_bytes) {
+    frames_.push_back({chrono::steady_clock::now(), decoded_bytes, 0});
   }
 
-  void Finish(Tp start, const AstNode& node, const IndexResult& result) {
-    DCHECK_GE(depth_, 1u);
-    auto took = chrono::steady_clock::now() - start;
+  void Finish(const AstNode& node, const IndexResult& result, size_t decoded_bytes) {
+    DCHECK(!frames_.empty());
+    Frame frame = frames_.back();
+    frames_.pop_back();
+
+    auto took = chrono::steady_clock::now() - frame.start;
     size_t micros = chrono::duration_cast<chrono::microseconds>(took).count();
-    auto descr = GetNodeInfo(node);
-    profile_.events.push_back({std::move(descr), micros, depth_ - 1, result.Size()});
-    depth_--;
+    profile_.events.push_back({GetNodeInfo(node), micros, frames_.size(), frame.num_input,
+                               result.Size(), decoded_bytes - frame.decoded_bytes});
+
+    // The result is an input of the parent node
+    if (!frames_.empty())
+      frames_.back().num_input += result.Size();
   }
 
   AlgorithmProfile Take() {
@@ -153,13 +207,30 @@ struct ProfileBuilder {
   }
 
  private:
-  size_t depth_;
+  struct Frame {
+    chrono::steady_clock::time_point start;
+    size_t decoded_bytes;  // byte counter when the node was started
+    size_t num_input;      // sum of the result sizes of the sub nodes
+  };
+
+  vector<Frame> frames_;  // nodes that are being evaluated
   AlgorithmProfile profile_;
 };
 
+// Memory taken by the entries of a result set
+template <typename S> size_t ByteSize(const S& set) {
+  if constexpr (is_same_v<S, vector<DocId>>)
+    return set.size() * sizeof(DocId);
+  else
+    return set.ByteSize();
+}
+
 struct BasicSearch {
   using LogicOp = AstLogicalNode::LogicOp;
 
+  // Intersect by seeking when one set is at least that many times larger than the other.
+  static constexpr size_t kSeekIntersectRatio = 8;
+
   BasicSearch(const FieldIndices* indices, size_t limit)
       : indices_{indices}, limit_{limit}, tmp_vec_{} {
   }
@@ -168,6 +239,12 @@ struct BasicSearch {
     profile_builder_ = ProfileBuilder{};
   }
 
+  // Account the entries of a borrowed index result that is read in full
+  void CountDecoded(const IndexResult& result) {
+    if (profile_builder_ && !result.IsOwned())
+      decoded_bytes_ += visit([](auto* set) { return ByteSize(*set); }, result.Borrowed());
+  }
+
   // Get casted sub index by field
   template <typename T> T* GetIndex(string_view field) {
     static_assert(is_base_of_v<BaseIndex, T>);
@@ -210,13 +287,47 @@ struct BasicSearch {
     IndexResult& current = *current_ptr;
     tmp_vec_.clear();
 
+    const DocBitmap* matched_bitmap = matched.Bitmap();
+    const DocBitmap* current_bitmap = current.Bitmap();
+
     if (op == LogicOp::AND) {
       tmp_vec_.reserve(min(matched.Size(), current.Size()));
-      auto cb = [this](auto* s1, auto* s2) {
-        set_intersection(s1->begin(), s1->end(), s2->begin(), s2->end(), back_inserter(tmp_vec_));
-      };
-      visit(cb, matched.Borrowed(), current.Borrowed());
+      if (matched_bitmap && current_bitmap) {
+        CountDecoded(matched);
+        CountDecoded(current);
+        matched_bitmap->AppendIntersection(*current_bitmap, &tmp_vec_);
+      } else if (matched_bitmap || current_bitmap) {
+        // Filter the other set by checking for membership in the bitmap
+        const DocBitmap* bitmap = matched_bitmap ? matched_bitmap : current_bitmap;
+        const IndexResult& other = matched_bitmap ? current : matched;
+        CountDecoded(other);
+        auto cb = [this, bitmap](auto* set) {
+          copy_if(set->begin(), set->end(), back_inserter(tmp_vec_),
+                  [bitmap](DocId id) { return bitmap->Contains(id); });
+        };
+        visit(cb, other.Borrowed());
+      } else if (current.Size() * kSeekIntersectRatio < matched.Size()) {
+        // Only the blocks of the large set that contain elements of the small one are decoded
+        CountDecoded(current);
+        auto cb = [this](auto* small, auto* large) { IntersectBySeek(*small, *large, &tmp_vec_); };
+        visit(cb, current.Borrowed(), matched.Borrowed());
+      } else {
+        CountDecoded(matched);
+        CountDecoded(current);
+        auto cb = [this](auto* s1, auto* s2) {
+          set_intersection(s1->begin(), s1->end(), s2->begin(), s2->end(),
+                           back_inserter(tmp_vec_));
+        };
+        visit(cb, matched.Borrowed(), current.Borrowed());
+      }
+    } else if (matched_bitmap && current_bitmap) {
+      CountDecoded(matched);
+      CountDecoded(current);
+      tmp_vec_.reserve(matched.Size() + current.Size());
+      matched_bitmap->AppendUnion(*current_bitmap, &tmp_vec_);
     } else {
+      CountDecoded(matched);
+      CountDecoded(current);
       tmp_vec_.reserve(matched.Size() + current.Size());
       auto cb = [this](auto* s1, auto* s2) {
         set_union(s1->begin(), s1->end(), s2->begin(), s2->end(), back_inserter(tmp_vec_));
@@ -239,8 +350,11 @@ struct BasicSearch {
          [](const auto& l, const auto& r) { return l.Size() < r.Size(); });
 
     IndexResult out{std::move(sub_results[0])};
-    for (auto& matched : absl::MakeSpan(sub_results).subspan(1))
+    for (auto& matched : absl::MakeSpan(sub_results).subspan(1)) {
+      if (op == LogicOp::AND && out.Size() == 0)
+        break;
       Merge(std::move(matched), &out, op);
+    }
     return out;
   }
 
@@ -267,6 +381,33 @@ struct BasicSearch {
     return UnifyResults(GetSubResults(selected_indices, mapping), LogicOp::OR);
   }
 
+  // Union of the postings of all words of the index matching the affix
+  template <typename I> static vector<DocId> MatchAffix(const AstAffixNode& node, const I* index) {
+    switch (node.kind) {
+      case AstAffixNode::PREFIX:
+        return index->MatchingPrefix(node.affix);
+      case AstAffixNode::SUFFIX:
+        return index->MatchingSuffix(node.affix);
+      case AstAffixNode::INFIX:
+        return index->MatchingInfix(node.affix);
+    }
+    return {};
+  }
+
+  // prefix*, *suffix, *infix*: access field's text index or unify results from all text indices
+  IndexResult Search(const AstAffixNode& node, string_view active_field) {
+    if (!active_field.empty()) {
+      if (auto* index = GetIndex<TextIndex>(active_field); index)
+        return MatchAffix(node, index);
+      return IndexResult{};
+    }
+
+    vector<TextIndex*> selected_indices = indices_->GetAllTextIndices();
+    auto mapping = [&node](TextIndex* index) -> IndexResult { return MatchAffix(node, index); };
+
+    return UnifyResults(GetSubResults(selected_indices, mapping), LogicOp::OR);
+  }
+
   // [range]: access field's numeric index
   IndexResult Search(const AstRangeNode& node, string_view active_field) {
     DCHECK(!active_field.empty());
@@ -277,9 +418,19 @@ struct BasicSearch {
 
   // negate -(*subquery*): explicitly compute result complement. Needs further optimizations
   IndexResult Search(const AstNegateNode& node, string_view active_field) {
-    vector<DocId> matched = SearchGeneric(*node.node, active_field).Take();
+    IndexResult matched_result = SearchGeneric(*node.node, active_field);
     vector<DocId> all = indices_->GetAllDocs();
 
+    // Bitmaps are checked for membership directly
+    if (const DocBitmap* bitmap = matched_result.Bitmap(); bitmap) {
+      auto pred = [bitmap](DocId doc) { return bitmap->Contains(doc); };
+      all.erase(remove_if(all.begin(), all.end(), pred), all.end());
+      return all;
+    }
+
+    CountDecoded(matched_result);
+    vector<DocId> matched = matched_result.Take();
+
     // To negate a result, we have to find the complement of matched to all documents,
     // so we remove all matched documents from the set of all documents.
     auto pred = [&matched](DocId doc) {
@@ -289,10 +440,58 @@ struct BasicSearch {
     return all;
   }
 
+  // Number of entries matched by a numeric range node, nullopt for other nodes
+  optional<size_t> EstimateRange(const AstNode& node, string_view active_field) {
+    if (auto* field_node = get_if<AstFieldNode>(&node.Variant()); field_node)
+      return EstimateRange(*field_node->node, field_node->field);
+
+    auto* range = get_if<AstRangeNode>(&node.Variant());
+    if (!range || active_field.empty())
+      return nullopt;
+
+    if (auto* index = GetIndex<NumericIndex>(active_field); index)
+      return index->RangeSize(range->lo, range->hi);
+    return nullopt;
+  }
+
   // logical query: unify all sub results
   IndexResult Search(const AstLogicalNode& node, string_view active_field) {
     auto mapping = [&](auto& node) { return SearchGeneric(node, active_field); };
-    return UnifyResults(GetSubResults(node.nodes, mapping), node.op);
+    if (node.op == LogicOp::OR)
+      return UnifyResults(GetSubResults(node.nodes, mapping), node.op);
+
+    // Numeric ranges have to be copied and sorted, so for AND they are evaluated after all other
+    // sub results, from the smallest estimate, and skipped once the intersection is empty.
+    vector<pair<size_t, const AstNode*>> ranges;
+    vector<IndexResult> sub_results;
+    for (const auto& sub_node : node.nodes) {
+      if (auto estimate = EstimateRange(sub_node, active_field); estimate)
+        ranges.emplace_back(*estimate, &sub_node);
+      else
+        sub_results.push_back(mapping(sub_node));
+    }
+
+    if (ranges.empty())
+      return UnifyResults(std::move(sub_results), node.op);
+
+    sort(ranges.begin(), ranges.end(),
+         [](const auto& l, const auto& r) { return l.first < r.first; });
+
+    optional<IndexResult> out;
+    if (!sub_results.empty())
+      out = UnifyResults(std::move(sub_results), node.op);
+
+    for (const auto& [estimate, range_node] : ranges) {
+      if (out && (out->Size() == 0 || estimate == 0))
+        return vector<DocId>{};
+
+      IndexResult matched = mapping(*range_node);
+      if (!out)
+        out = std::move(matched);
+      else
+        Merge(std::move(matched), &*out, LogicOp::AND);
+    }
+    return std::move(*out);
   }
 
   // @field: set active field for sub tree
@@ -306,7 +505,10 @@ struct BasicSearch {
   IndexResult Search(const AstTagsNode& node, string_view active_field) {
     if (auto* tag_index = GetIndex<TagIndex>(active_field); tag_index) {
       auto mapping = [tag_index](string_view tag) { return tag_index->Matching(tag); };
-      return UnifyResults(GetSubResults(node.tags, mapping), LogicOp::OR);
+      auto sub_results = GetSubResults(node.tags, mapping);
+      for (const auto& affix : node.affixes)
+        sub_results.emplace_back(MatchAffix(affix, tag_index));
+      return UnifyResults(std::move(sub_results), LogicOp::OR);
     }
     return IndexResult{};
   }
@@ -324,6 +526,7 @@ struct BasicSearch {
     preagg_total_ = sub_results.Size();
 
     if (auto* sort_index = GetSortIndex(node.field); sort_index) {
+      CountDecoded(sub_results);
       auto ids_vec = sub_results.Take();
       scores_ = sort_index->Sort(&ids_vec, limit_, node.descending);
       return ids_vec;
@@ -334,13 +537,29 @@ struct BasicSearch {
 
   void SearchKnnFlat(FlatVectorIndex* vec_index, const AstKnnNode& knn, IndexResult&& sub_results) {
     knn_distances_.reserve(sub_results.Size());
+    constexpr size_t kBatchSize = 64;
+    auto query = vec_index->MakeQuery(knn.vec.first.get());
+
+    // Distances are computed in batches of documents.
+    DocId docs[kBatchSize];
+    float distances[kBatchSize];
+    size_t batch = 0;
+    auto flush = [&] {
+      vec_index->Distances(query, docs, batch, distances);
+      for (size_t i = 0; i < batch; i++)
+        knn_distances_.emplace_back(distances[i], docs[i]);
+      batch = 0;
+    };
+
     auto cb = [&](auto* set) {
-      auto [dim, sim] = vec_index->Info();
       for (DocId matched_doc : *set) {
-        float dist = VectorDistance(knn.vec.first.get(), vec_index->Get(matched_doc), dim, sim);
-        knn_distances_.emplace_back(dist, matched_doc);
+        docs[batch++] = matched_doc;
+        if (batch == kBatchSize)
+          flush();
       }
+      flush();
     };
+    CountDecoded(sub_results);
     visit(cb, sub_results.Borrowed());
 
     size_t prefix_size = min(knn.limit, knn_distances_.size());
@@ -350,10 +569,14 @@ struct BasicSearch {
   }
 
   void SearchKnnHnsw(HnswVectorIndex* vec_index, const AstKnnNode& knn, IndexResult&& sub_results) {
-    if (indices_->GetAllDocs().size() == sub_results.Size())
+    if (indices_->GetAllDocs().size() == sub_results.Size()) {
       knn_distances_ = vec_index->Knn(knn.vec.first.get(), knn.limit);
-    else
+    } else if (const DocBitmap* bitmap = sub_results.Bitmap(); bitmap) {
+      knn_distances_ = vec_index->Knn(knn.vec.first.get(), knn.limit, *bitmap);
+    } else {
+      CountDecoded(sub_results);
       knn_distances_ = vec_index->Knn(knn.vec.first.get(), knn.limit, sub_results.Take());
+    }
   }
 
   // [KNN limit @field vec]: Compute distance from `vec` to all vectors keep closest `limit`
@@ -394,7 +617,8 @@ struct BasicSearch {
     if (!error_.empty())
       return IndexResult{};
 
-    ProfileBuilder::Tp start = profile_builder_ ? profile_builder_->Start() : ProfileBuilder::Tp{};
+    if (profile_builder_)
+      profile_builder_->Start(decoded_bytes_);
 
     auto cb = [this, active_field](const auto& inner) { return Search(inner, active_field); };
     auto result = visit(cb, node.Variant());
@@ -405,7 +629,7 @@ struct BasicSearch {
            visit([](auto* set) { return is_sorted(set->begin(), set->end()); }, result.Borrowed()));
 
     if (profile_builder_)
-      profile_builder_->Finish(start, node, result);
+      profile_builder_->Finish(node, result, decoded_bytes_);
 
     return result;
   }
@@ -431,7 +655,8 @@ struct BasicSearch {
 
   size_t preagg_total_ = 0;
   string error_;
-  optional<ProfileBuilder> profile_builder_ = ProfileBuilder{};
+  optional<ProfileBuilder> profile_builder_;
+  size_t decoded_bytes_ = 0;  // bytes of borrowed index postings read, counted only for profiles
 
   std::vector<ResultScore> scores_;
 
@@ -441,6 +666,37 @@ struct BasicSearch {
 
 #pragma GCC diagnostic pop
 
+// Write every index of the map together with its field identifier.
+template <typename M> void SerializeIndices(const M& indices, IndexWriter* writer) {
+  writer->Write<uint64_t>(indices.size());
+  for (const auto& [field, index] : indices) {
+    writer->WriteString(field);
+    index->Serialize(writer);
+  }
+}
+
+// Restore every index of the map, the data must contain each of them exactly once.
+template <typename M> bool DeserializeIndices(M* indices, IndexReader* reader) {
+  uint64_t size;
+  if (!reader->Read(&size) || size != indices->size())
+    return false;
+
+  absl::flat_hash_set<string_view> restored;
+  for (uint64_t i = 0; i < size; i++) {
+    string_view field;
+    if (!reader->ReadString(&field))
+      return false;
+
+    auto it = indices->find(field);
+    if (it == indices->end() || !restored.insert(field).second)
+      return false;
+
+    if (!it->second->Deserialize(reader))
+      return false;
+  }
+  return true;
+}
+
 }  // namespace
 
 FieldIndices::FieldIndices(Schema schema, PMR_NS::memory_resource* mr)
@@ -520,6 +776,53 @@ void FieldIndices::Remove(DocId doc, DocumentAccessor* access) {
   all_ids_.erase(it);
 }
 
+void FieldIndices::StartBulkLoad(unsigned num_threads) {
+  for (auto& [field, index] : indices_) {
+    if (auto* hnsw_index = dynamic_cast<HnswVectorIndex*>(index.get()); hnsw_index)
+      hnsw_index->StartBulkLoad(num_threads);
+  }
+}
+
+void FieldIndices::FinishBulkLoad() {
+  for (auto& [field, index] : indices_) {
+    if (auto* hnsw_index = dynamic_cast<HnswVectorIndex*>(index.get()); hnsw_index)
+      hnsw_index->FinishBulkLoad();
+  }
+}
+
+size_t FieldIndices::GetNumVectorTombstones() const {
+  size_t out = 0;
+  for (auto& [field, index] : indices_) {
+    if (auto* hnsw_index = dynamic_cast<HnswVectorIndex*>(index.get()); hnsw_index)
+      out += hnsw_index->NumDeleted();
+  }
+  return out;
+}
+
+void FieldIndices::CompactVectorIndicesStep(double max_deleted_ratio, size_t budget) {
+  for (auto& [field, index] : indices_) {
+    if (auto* hnsw_index = dynamic_cast<HnswVectorIndex*>(index.get()); hnsw_index)
+      hnsw_index->CompactStep(max_deleted_ratio, budget);
+  }
+}
+
+size_t FieldIndices::GetNumSpilledVectorBlocks() const {
+  size_t out = 0;
+  for (auto& [field, index] : indices_) {
+    if (auto* flat_index = dynamic_cast<FlatVectorIndex*>(index.get()); flat_index)
+      out += flat_index->NumSpilledBlocks();
+  }
+  return out;
+}
+
+void FieldIndices::SpillVectorIndicesStep(BlockStorage* storage, size_t max_bytes,
+                                          unsigned budget) {
+  for (auto& [field, index] : indices_) {
+    if (auto* flat_index = dynamic_cast<FlatVectorIndex*>(index.get()); flat_index)
+      flat_index->SpillStep(storage, max_bytes, budget);
+  }
+}
+
 BaseIndex* FieldIndices::GetIndex(string_view field) const {
   // Replace short field name with full identifier
   if (auto it = schema_.field_names.find(field); it != schema_.field_names.end())
@@ -550,6 +853,20 @@ std::vector<TextIndex*> FieldIndices::GetAllTextIndices() const {
   return out;
 }
 
+void FieldIndices::Serialize(IndexWriter* writer) const {
+  writer->WriteArray(absl::MakeConstSpan(all_ids_));
+  SerializeIndices(indices_, writer);
+  SerializeIndices(sort_indices_, writer);
+}
+
+bool FieldIndices::Deserialize(IndexReader* reader) {
+  DCHECK(all_ids_.empty());
+  if (!reader->ReadArray(&all_ids_) || !is_sorted(all_ids_.begin(), all_ids_.end()))
+    return false;
+
+  return DeserializeIndices(&indices_, reader) && DeserializeIndices(&sort_indices_, reader);
+}
+
 const vector<DocId>& FieldIndices::GetAllDocs() const {
   return all_ids_;
 }
@@ -33,6 +33,8 @@ struct SchemaField {
     VectorSimilarity sim = VectorSimilarity::L2;  // similarity type
     size_t capacity = 1000;                       // initial capacity
 
+    VectorQuantization quantization = VectorQuantization::NONE;  // only for flat indices
+
     size_t hnsw_m = 16;
   };
 
@@ -62,6 +64,26 @@ class FieldIndices {
   void Add(DocId doc, DocumentAccessor* access);
   void Remove(DocId doc, DocumentAccessor* access);
 
+  // Documents added until FinishBulkLoad are inserted into the hnsw vector indices in batches
+  // by num_threads threads. Used for building the indices over existing documents.
+  void StartBulkLoad(unsigned num_threads);
+  void FinishBulkLoad();
+
+  // Number of deleted points in the hnsw vector indices and a compaction step for each of them,
+  // see HnswVectorIndex::CompactStep.
+  size_t GetNumVectorTombstones() const;
+  void CompactVectorIndicesStep(double max_deleted_ratio, size_t budget);
+
+  // Moves cold blocks of the flat vector indices to storage, see FlatVectorIndex::SpillStep.
+  // max_bytes and budget apply to each of them.
+  size_t GetNumSpilledVectorBlocks() const;
+  void SpillVectorIndicesStep(BlockStorage* storage, size_t max_bytes, unsigned budget);
+
+  // Serialize writes the contents of all indices. Deserialize restores them into empty indices
+  // created with the same schema and returns false if the data is malformed.
+  void Serialize(IndexWriter* writer) const;
+  bool Deserialize(IndexReader* reader);
+
   BaseIndex* GetIndex(std::string_view field) const;
   BaseSortIndex* GetSortIndex(std::string_view field) const;
 
@@ -85,9 +107,11 @@ class FieldIndices {
 struct AlgorithmProfile {
   struct ProfileEvent {
     std::string descr;
-    size_t micros;         // time event took in microseconds
+    size_t micros;         // time event took in microseconds, including its sub events
     size_t depth;          // tree depth of event
+    size_t num_input;      // number of results of the sub events
     size_t num_processed;  // number of results processed by the event
+    size_t decoded_bytes;  // bytes of index postings read by the event and its sub events
   };
 
   std::vector<ProfileEvent> events;
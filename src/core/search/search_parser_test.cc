@@ -99,6 +99,12 @@ TEST_F(SearchParserTest, Scanner) {
   NEXT_EQ(TOK_TERM, string, "почтальон");
   NEXT_EQ(TOK_TERM, string, "Печкин");
 
+  SetInput("pre* *suf *in* *");
+  NEXT_EQ(TOK_PREFIX, string, "pre");
+  NEXT_EQ(TOK_SUFFIX, string, "suf");
+  NEXT_EQ(TOK_INFIX, string, "in");
+  NEXT_TOK(TOK_STAR);
+
   double d;
   ASSERT_TRUE(absl::SimpleAtod("33.3", &d));
   SetInput("33.3");
@@ -109,6 +115,7 @@ TEST_F(SearchParserTest, Parse) {
   EXPECT_EQ(0, Parse(" foo bar (baz) "));
   EXPECT_EQ(0, Parse(" -(foo) @foo:bar @ss:[1 2]"));
   EXPECT_EQ(0, Parse("@foo:{ tag1 | tag2 }"));
+  EXPECT_EQ(0, Parse("fo* @foo:*ar @foo:{ tag1 | ta* }"));
 
   EXPECT_EQ(1, Parse(" -(foo "));
   EXPECT_EQ(1, Parse(" foo:bar "));
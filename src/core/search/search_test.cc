@@ -8,6 +8,7 @@
 #include <absl/container/flat_hash_map.h>
 #include <absl/strings/escaping.h>
 #include <absl/strings/numbers.h>
+#include <absl/strings/str_cat.h>
 #include <absl/strings/str_split.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
@@ -19,6 +20,7 @@
 #include "base/gtest.h"
 #include "base/logging.h"
 #include "core/search/base.h"
+#include "core/search/indices.h"
 #include "core/search/query_driver.h"
 #include "core/search/vector_utils.h"
 
@@ -359,6 +361,179 @@ TEST_F(SearchTest, CheckTag) {
   EXPECT_TRUE(Check()) << GetError();
 }
 
+TEST_F(SearchTest, MatchAffix) {
+  PrepareQuery("fo*");
+  ExpectAll("foo", "Fox bar", "more fo");
+  ExpectNone("ufo", "bar", "f oo");
+  EXPECT_TRUE(Check()) << GetError();
+
+  PrepareQuery("*ar");
+  ExpectAll("bar", "foo CAR", "ar");
+  ExpectNone("bars", "foo");
+  EXPECT_TRUE(Check()) << GetError();
+
+  PrepareQuery("*oo*");
+  ExpectAll("foo", "moody", "oo", "cool bar");
+  ExpectNone("ofo", "bar");
+  EXPECT_TRUE(Check()) << GetError();
+}
+
+TEST_F(SearchTest, CheckTagAffix) {
+  PrepareSchema({{"f1", SchemaField::TAG}});
+
+  PrepareQuery("@f1:{re* | blue}");
+  ExpectAll(Map{{"f1", "red"}}, Map{{"f1", "reed, green"}}, Map{{"f1", "blue"}});
+  ExpectNone(Map{{"f1", "green"}}, Map{{"f1", "fire"}}, Map{{"f1", "blues"}});
+  EXPECT_TRUE(Check()) << GetError();
+}
+
+TEST_F(SearchTest, IntersectSkewed) {
+  auto schema = MakeSimpleSchema({{"tag", SchemaField::TAG}, {"text", SchemaField::TEXT}});
+  FieldIndices indices{schema, PMR_NS::get_default_resource()};
+
+  // Matches of a rare term are looked up in the postings of the common ones.
+  vector<DocId> expected;
+  for (DocId i = 0; i < 10'000; i++) {
+    bool rare = i % 97 == 0;
+    string text = i % 2 == 0 ? "even" : "odd";
+    MockedDocument doc{Map{{"tag", rare ? "common,rare" : "common"}, {"text", text}}};
+    indices.Add(i, &doc);
+    if (rare && i % 2 == 0)
+      expected.push_back(i);
+  }
+
+  SearchAlgorithm algo{};
+  QueryParams params;
+  algo.Init("@tag:{common} @tag:{rare} @text:even", &params);
+  EXPECT_EQ(algo.Search(&indices).ids, expected);
+
+  algo.Init("@tag:{rare} @text:even -@text:odd", &params);
+  EXPECT_EQ(algo.Search(&indices).ids, expected);
+}
+
+TEST_F(SearchTest, DenseTags) {
+  auto schema = MakeSimpleSchema({{"status", SchemaField::TAG}, {"text", SchemaField::TEXT}});
+  FieldIndices indices{schema, PMR_NS::get_default_resource()};
+
+  // Tags shared by many documents are stored as bitmaps.
+  vector<DocId> active_even, active_or_new, not_active;
+  for (DocId i = 0; i < 10'000; i++) {
+    string status = i % 3 == 0 ? "active" : (i % 3 == 1 ? "new" : "closed");
+    if (i % 5 == 0)
+      status += ",archived";
+    MockedDocument doc{Map{{"status", status}, {"text", i % 2 == 0 ? "even" : "odd"}}};
+    indices.Add(i, &doc);
+
+    if (i % 3 == 0 && i % 2 == 0)
+      active_even.push_back(i);
+    if (i % 3 != 2)
+      active_or_new.push_back(i);
+    if (i % 3 != 0)
+      not_active.push_back(i);
+  }
+
+  SearchAlgorithm algo{};
+  QueryParams params;
+
+  algo.Init("@status:{active} @text:even", &params);
+  EXPECT_EQ(algo.Search(&indices).ids, active_even);
+
+  algo.Init("@status:{active | new}", &params);
+  EXPECT_EQ(algo.Search(&indices).ids, active_or_new);
+
+  algo.Init("-@status:{active}", &params);
+  EXPECT_EQ(algo.Search(&indices).ids, not_active);
+
+  vector<DocId> active_archived;
+  for (DocId i = 0; i < 10'000; i += 15)
+    active_archived.push_back(i);
+  algo.Init("@status:{active} @status:{archived}", &params);
+  EXPECT_EQ(algo.Search(&indices).ids, active_archived);
+}
+
+TEST_F(SearchTest, Profile) {
+  auto schema = MakeSimpleSchema({{"title", SchemaField::TEXT}});
+  FieldIndices indices{schema, PMR_NS::get_default_resource()};
+
+  for (DocId i = 0; i < 100; i++) {
+    MockedDocument doc{Map{{"title", i % 4 == 0 ? "red car" : "red bike"}}};
+    indices.Add(i, &doc);
+  }
+
+  SearchAlgorithm algo{};
+  QueryParams params;
+  algo.Init("red car", &params);
+
+  // Profiling is disabled by default
+  EXPECT_FALSE(algo.Search(&indices).profile);
+
+  algo.EnableProfiling();
+  auto res = algo.Search(&indices);
+  ASSERT_TRUE(res.profile);
+
+  // The intersection is followed by both terms
+  const auto& events = res.profile->events;
+  ASSERT_EQ(events.size(), 3u);
+  EXPECT_EQ(events[0].depth, 0u);
+  EXPECT_EQ(events[0].num_input, 125u);
+  EXPECT_EQ(events[0].num_processed, 25u);
+  EXPECT_GT(events[0].decoded_bytes, 0u);
+
+  for (size_t i = 1; i < events.size(); i++) {
+    EXPECT_EQ(events[i].depth, 1u);
+    EXPECT_EQ(events[i].num_input, 0u);
+    EXPECT_LE(events[i].micros, events[0].micros);
+    EXPECT_LE(events[i].decoded_bytes, events[0].decoded_bytes);
+  }
+}
+
+TEST_F(SearchTest, NumericRanges) {
+  auto schema = MakeSimpleSchema({{"num", SchemaField::NUMERIC}, {"mod", SchemaField::NUMERIC},
+                                  {"tag", SchemaField::TAG}});
+  FieldIndices indices{schema, PMR_NS::get_default_resource()};
+
+  for (DocId i = 0; i < 10'000; i++) {
+    MockedDocument doc{Map{{"num", absl::StrCat(i)}, {"mod", absl::StrCat(i % 100)},
+                           {"tag", i % 2 ? "odd" : "even"}}};
+    indices.Add(i, &doc);
+  }
+
+  // Remove every third document
+  for (DocId i = 0; i < 10'000; i += 3) {
+    MockedDocument doc{Map{{"num", absl::StrCat(i)}, {"mod", absl::StrCat(i % 100)},
+                           {"tag", i % 2 ? "odd" : "even"}}};
+    indices.Remove(i, &doc);
+  }
+
+  auto* num_index = dynamic_cast<NumericIndex*>(indices.GetIndex("num"));
+  ASSERT_TRUE(num_index);
+
+  for (auto [l, r] : {pair{0.0, 9999.0}, pair{1.5, 2.5}, pair{500.0, 7000.0}, pair{-5.0, 0.0},
+                      pair{10000.0, 20000.0}, pair{42.0, 42.0}, pair{7.0, 3.0}}) {
+    vector<DocId> expected;
+    for (DocId i = max(0.0, ceil(l)); i <= min(9999.0, r); i++) {
+      if (i % 3 != 0)
+        expected.push_back(i);
+    }
+    EXPECT_EQ(num_index->Range(l, r), expected) << l << " " << r;
+    EXPECT_EQ(num_index->RangeSize(l, r), expected.size()) << l << " " << r;
+  }
+
+  // Small ranges are intersected first and large ones are skipped once the result is empty
+  SearchAlgorithm algo{};
+  QueryParams params;
+  algo.Init("@num:[0 9999] @mod:[5 5] @tag:{odd}", &params);
+  vector<DocId> expected;
+  for (DocId i = 5; i < 10'000; i += 100) {
+    if (i % 3 != 0)
+      expected.push_back(i);
+  }
+  EXPECT_EQ(algo.Search(&indices).ids, expected);
+
+  algo.Init("@num:[0 9999] @mod:[5 5] @tag:{even}", &params);
+  EXPECT_TRUE(algo.Search(&indices).ids.empty());
+}
+
 TEST_F(SearchTest, IntegerTerms) {
   PrepareSchema({{"status", SchemaField::TAG}, {"title", SchemaField::TEXT}});
 
@@ -561,6 +736,43 @@ TEST_P(KnnTest, Cosine) {
   }
 }
 
+TEST_P(KnnTest, Filtered) {
+  auto schema = MakeSimpleSchema({{"group", SchemaField::TAG}, {"pos", SchemaField::VECTOR}});
+  schema.fields["pos"].special_params = SchemaField::VectorParams{GetParam(), 1};
+  FieldIndices indices{schema, PMR_NS::get_default_resource()};
+
+  // A very selective and a dense filter, the latter is stored as a bitmap
+  for (size_t i = 0; i < 5000; i++) {
+    string group = i % 2 == 0 ? "even" : "odd";
+    if (i % 500 == 0)
+      group += ",rare";
+    MockedDocument doc{Map{{"group", group}, {"pos", ToBytes({float(i)})}}};
+    indices.Add(i, &doc);
+  }
+
+  SearchAlgorithm algo{};
+  QueryParams params;
+
+  {
+    params["vec"] = ToBytes({1100.0});
+    algo.Init("@group:{rare} =>[KNN 3 @pos $vec]", &params);
+    EXPECT_THAT(algo.Search(&indices).ids, testing::UnorderedElementsAre(500, 1000, 1500));
+  }
+
+  {
+    params["vec"] = ToBytes({2001.0});
+    algo.Init("@group:{even} =>[KNN 4 @pos $vec]", &params);
+    EXPECT_THAT(algo.Search(&indices).ids, testing::UnorderedElementsAre(1998, 2000, 2002, 2004));
+  }
+
+  // Fewer matches than requested
+  {
+    params["vec"] = ToBytes({0.0});
+    algo.Init("@group:{rare} =>[KNN 20 @pos $vec]", &params);
+    EXPECT_EQ(algo.Search(&indices).ids.size(), 10u);
+  }
+}
+
 TEST_P(KnnTest, AutoResize) {
   // Make sure index resizes automatically even with a small initial capacity
   const size_t kInitialCapacity = 5;
@@ -578,6 +790,302 @@ TEST_P(KnnTest, AutoResize) {
   EXPECT_EQ(indices.GetAllDocs().size(), 100);
 }
 
+TEST_P(KnnTest, BulkLoad) {
+  auto schema = MakeSimpleSchema({{"pos", SchemaField::VECTOR}});
+  schema.fields["pos"].special_params =
+      SchemaField::VectorParams{GetParam(), 1, VectorSimilarity::L2, 5};
+  FieldIndices indices{schema, PMR_NS::get_default_resource()};
+
+  indices.StartBulkLoad(4);
+  for (size_t i = 0; i < 1000; i++) {
+    MockedDocument doc{Map{{"pos", ToBytes({float(i)})}}};
+    indices.Add(i, &doc);
+  }
+  indices.FinishBulkLoad();
+
+  EXPECT_EQ(indices.GetAllDocs().size(), 1000);
+
+  SearchAlgorithm algo{};
+  QueryParams params;
+  params["vec"] = ToBytes({500.0});
+  algo.Init("*=>[KNN 3 @pos $vec]", &params);
+  EXPECT_THAT(algo.Search(&indices).ids, testing::UnorderedElementsAre(499, 500, 501));
+
+  // The index is updated directly again after the bulk load.
+  MockedDocument doc{Map{{"pos", ToBytes({2000.0})}}};
+  indices.Add(1000, &doc);
+  params["vec"] = ToBytes({1990.0});
+  algo.Init("*=>[KNN 1 @pos $vec]", &params);
+  EXPECT_THAT(algo.Search(&indices).ids, testing::UnorderedElementsAre(1000));
+}
+
+TEST_P(KnnTest, Serialization) {
+  auto schema = MakeSimpleSchema({{"tag", SchemaField::TAG},
+                                  {"text", SchemaField::TEXT},
+                                  {"num", SchemaField::NUMERIC},
+                                  {"pos", SchemaField::VECTOR}});
+  schema.fields["num"].flags |= SchemaField::SORTABLE;
+  schema.fields["pos"].special_params = SchemaField::VectorParams{GetParam(), 1};
+  FieldIndices indices{schema, PMR_NS::get_default_resource()};
+
+  auto make_doc = [](size_t i) {
+    return MockedDocument{Map{{"tag", i % 2 ? "odd" : "even"},
+                              {"text", absl::StrCat("word", i % 3)},
+                              {"num", absl::StrCat(i)},
+                              {"pos", ToBytes({float(i)})}}};
+  };
+
+  for (size_t i = 0; i < 100; i++) {
+    auto doc = make_doc(i);
+    indices.Add(i, &doc);
+  }
+  for (size_t i = 0; i < 100; i += 7) {
+    auto doc = make_doc(i);
+    indices.Remove(i, &doc);
+  }
+
+  IndexWriter writer;
+  indices.Serialize(&writer);
+  string data = writer.Take();
+
+  FieldIndices restored{schema, PMR_NS::get_default_resource()};
+  IndexReader reader{data};
+  ASSERT_TRUE(restored.Deserialize(&reader));
+  EXPECT_TRUE(reader.Empty());
+  EXPECT_EQ(restored.GetAllDocs(), indices.GetAllDocs());
+
+  SearchAlgorithm algo{};
+  QueryParams params;
+  params["vec"] = ToBytes({50.0});
+  for (string_view query : {"@tag:{odd} word1", "@num:[10 30] -@tag:{even}",
+                            "* => [KNN 3 @pos $vec]", "@tag:{even} => [KNN 2 @pos $vec]"}) {
+    algo.Init(query, &params);
+    EXPECT_EQ(algo.Search(&restored).ids, algo.Search(&indices).ids) << query;
+  }
+
+  SortOption sort{"num", true};
+  algo.Init("*", &params, &sort);
+  EXPECT_EQ(algo.Search(&restored, 5).ids, algo.Search(&indices, 5).ids);
+
+  // Truncated data is rejected
+  FieldIndices truncated{schema, PMR_NS::get_default_resource()};
+  IndexReader truncated_reader{string_view{data}.substr(0, data.size() / 2)};
+  EXPECT_FALSE(truncated.Deserialize(&truncated_reader));
+}
+
+TEST_F(SearchTest, HnswCompaction) {
+  HnswVectorIndex index{SchemaField::VectorParams{true, 1}, PMR_NS::get_default_resource()};
+  auto doc = [](float pos) { return MockedDocument{Map{{"pos", ToBytes({pos})}}}; };
+
+  for (DocId i = 0; i < 200; i++) {
+    auto d = doc(i);
+    index.Add(i, &d, "pos");
+  }
+
+  // Only odd points remain
+  for (DocId i = 0; i < 200; i += 2) {
+    auto d = doc(i);
+    index.Remove(i, &d, "pos");
+  }
+  EXPECT_EQ(index.NumDeleted(), 100u);
+
+  // Deleted nodes are reused
+  for (DocId i = 0; i < 10; i += 2) {
+    auto d = doc(i);
+    index.Add(i, &d, "pos");
+  }
+  EXPECT_EQ(index.NumDeleted(), 95u);
+
+  // Below the threshold nothing happens
+  index.CompactStep(0.5, 10);
+  EXPECT_EQ(index.NumDeleted(), 95u);
+
+  // Modifications during the compaction are applied to both graphs
+  index.CompactStep(0.2, 10);
+  for (DocId i = 1; i < 10; i += 2) {
+    auto d = doc(i);
+    index.Remove(i, &d, "pos");
+  }
+  auto d = doc(200);
+  index.Add(200, &d, "pos");
+
+  // The new graph contains only the points deleted after they were copied
+  for (size_t i = 0; i < 20; i++)
+    index.CompactStep(0.2, 10);
+  EXPECT_LE(index.NumDeleted(), 5u);
+
+  float target = 4.2;
+  auto knn = index.Knn(&target, 5);
+  vector<DocId> ids;
+  for (auto [_, id] : knn)
+    ids.push_back(id);
+  EXPECT_THAT(ids, testing::UnorderedElementsAre(0, 2, 4, 6, 8));
+
+  target = 200.4;
+  EXPECT_EQ(index.Knn(&target, 1)[0].second, 200u);
+}
+
+TEST_F(SearchTest, KnnQuantized) {
+  // Square:
+  // 3      2
+  //    4
+  // 0      1
+  const pair<float, float> kTestCoords[] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}, {0.5, 0.5}};
+
+  auto schema = MakeSimpleSchema({{"pos", SchemaField::VECTOR}});
+  SchemaField::VectorParams vparams{false, 2};
+  vparams.quantization = VectorQuantization::INT8;
+  schema.fields["pos"].special_params = vparams;
+  FieldIndices indices{schema, PMR_NS::get_default_resource()};
+
+  for (size_t i = 0; i < ABSL_ARRAYSIZE(kTestCoords); i++) {
+    string coords = ToBytes({kTestCoords[i].first, kTestCoords[i].second});
+    MockedDocument doc{Map{{"pos", coords}}};
+    indices.Add(i, &doc);
+  }
+
+  SearchAlgorithm algo{};
+  QueryParams params;
+
+  params["vec"] = ToBytes({0.7, 0.15});
+  algo.Init("* => [KNN 10 @pos $vec]", &params);
+  auto res = algo.Search(&indices);
+  EXPECT_THAT(res.ids, testing::ElementsAre(1, 4, 0, 2, 3));
+
+  // Distances are computed on the int8 codes, hence they are close to the exact ones.
+  ASSERT_EQ(res.scores.size(), 5u);
+  EXPECT_NEAR(get<float>(res.scores[0]), sqrt(0.3 * 0.3 + 0.15 * 0.15), 0.01);
+
+  params["vec"] = ToBytes({0.8, 0.9});
+  algo.Init("* => [KNN 10 @pos $vec]", &params);
+  EXPECT_THAT(algo.Search(&indices).ids, testing::ElementsAre(2, 4, 3, 1, 0));
+}
+
+// Keeps the blocks in memory, their writes complete once Complete is called.
+struct MockedBlockStorage : public BlockStorage {
+  optional<uint64_t> Store(string_view block) override {
+    blocks[next_handle] = {string{block}, false};
+    return next_handle++;
+  }
+
+  State GetState(uint64_t handle) const override {
+    return blocks.at(handle).second ? STORED : PENDING;
+  }
+
+  bool Load(uint64_t handle, size_t len, char* dest) override {
+    EXPECT_EQ(len, blocks.at(handle).first.size());
+    memcpy(dest, blocks.at(handle).first.data(), len);
+    loads++;
+    return true;
+  }
+
+  void Free(uint64_t handle, size_t len) override {
+    EXPECT_EQ(blocks.erase(handle), 1u);
+  }
+
+  void Complete() {
+    for (auto& [_, block] : blocks)
+      block.second = true;
+  }
+
+  absl::flat_hash_map<uint64_t, pair<string, bool>> blocks;
+  uint64_t next_handle = 0;
+  size_t loads = 0;
+};
+
+TEST_F(SearchTest, SpillVectors) {
+  // 64 documents per block of 64KB
+  constexpr size_t kDim = 256;
+  auto schema = MakeSimpleSchema({{"pos", SchemaField::VECTOR}});
+  schema.fields["pos"].special_params = SchemaField::VectorParams{false, kDim};
+  FieldIndices indices{schema, PMR_NS::get_default_resource()};
+
+  auto make_doc = [](float pos) {
+    return MockedDocument{Map{{"pos", ToBytes(vector(kDim, pos))}}};
+  };
+  for (size_t i = 0; i < 256; i++) {
+    auto doc = make_doc(i);
+    indices.Add(i, &doc);
+  }
+
+  SearchAlgorithm algo{};
+  QueryParams params;
+  params["vec"] = ToBytes(vector(kDim, 100.2f));
+  algo.Init("* => [KNN 3 @pos $vec]", &params);
+  auto expected = algo.Search(&indices).ids;
+
+  // Blocks are dropped once they are written, the least recently used ones first.
+  MockedBlockStorage storage;
+  indices.SpillVectorIndicesStep(&storage, 1 << 16, 2);
+  EXPECT_EQ(storage.blocks.size(), 2u);
+  EXPECT_EQ(indices.GetNumSpilledVectorBlocks(), 0u);
+
+  storage.Complete();
+  indices.SpillVectorIndicesStep(&storage, 1 << 16, 2);
+  EXPECT_EQ(indices.GetNumSpilledVectorBlocks(), 2u);
+  storage.Complete();
+  indices.SpillVectorIndicesStep(&storage, 1 << 16, 2);
+  EXPECT_EQ(indices.GetNumSpilledVectorBlocks(), 3u);
+
+  // Spilled blocks are loaded by searches
+  EXPECT_EQ(algo.Search(&indices).ids, expected);
+  EXPECT_EQ(storage.loads, 3u);
+
+  // Unmodified blocks are dropped without writing them again, modified ones are freed
+  indices.SpillVectorIndicesStep(&storage, 0, 0);
+  EXPECT_EQ(indices.GetNumSpilledVectorBlocks(), 3u);
+  auto doc = make_doc(1000);
+  indices.Add(0, &doc);
+  EXPECT_EQ(storage.blocks.size(), 2u);
+
+  // The spilled blocks are serialized
+  IndexWriter writer;
+  indices.Serialize(&writer);
+  string data = writer.Take();
+  FieldIndices restored{schema, PMR_NS::get_default_resource()};
+  IndexReader reader{data};
+  ASSERT_TRUE(restored.Deserialize(&reader));
+  EXPECT_EQ(algo.Search(&restored).ids, expected);
+}
+
+TEST_F(SearchTest, VectorDistance) {
+  default_random_engine gen{0};
+  uniform_real_distribution<float> dist{-1, 1};
+
+  // Cover the tails of all the vectorized kernels.
+  for (size_t dims : {1, 3, 4, 7, 8, 15, 16, 17, 33, 120}) {
+    vector<float> u(dims), v(dims);
+    for (size_t i = 0; i < dims; i++) {
+      u[i] = dist(gen);
+      v[i] = dist(gen);
+    }
+
+    double l2 = 0, uv = 0, uu = 0, vv = 0;
+    for (size_t i = 0; i < dims; i++) {
+      l2 += (u[i] - v[i]) * (u[i] - v[i]);
+      uv += u[i] * v[i];
+      uu += u[i] * u[i];
+      vv += v[i] * v[i];
+    }
+    float expected_l2 = sqrt(l2);
+    float expected_cosine = 1 - uv / sqrt(uu * vv);
+
+    EXPECT_NEAR(VectorDistance(u.data(), v.data(), dims, VectorSimilarity::L2), expected_l2, 1e-4);
+    EXPECT_NEAR(VectorDistance(u.data(), v.data(), dims, VectorSimilarity::COSINE),
+                expected_cosine, 1e-4);
+
+    const float* vs[] = {v.data(), u.data()};
+    float out[2];
+    VectorDistances(u.data(), vs, 2, dims, VectorSimilarity::L2, out);
+    EXPECT_NEAR(out[0], expected_l2, 1e-4);
+    EXPECT_NEAR(out[1], 0, 1e-4);
+
+    VectorDistances(u.data(), vs, 2, dims, VectorSimilarity::COSINE, out);
+    EXPECT_NEAR(out[0], expected_cosine, 1e-4);
+    EXPECT_NEAR(out[1], 0, 1e-4);
+  }
+}
+
 INSTANTIATE_TEST_SUITE_P(KnnFlat, KnnTest, testing::Values(false));
 INSTANTIATE_TEST_SUITE_P(KnnHnsw, KnnTest, testing::Values(true));
 
@@ -617,6 +1125,29 @@ static void BM_VectorSearch(benchmark::State& state) {
 
 BENCHMARK(BM_VectorSearch)->Args({120, 10'000});
 
+static void BM_VectorDistances(benchmark::State& state) {
+  unsigned ndims = state.range(0);
+  const unsigned kNumVecs = 1000;
+  auto sim = state.range(1) ? VectorSimilarity::COSINE : VectorSimilarity::L2;
+
+  vector<float> data((kNumVecs + 1) * ndims);
+  for (float& f : data)
+    f = static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
+
+  vector<const float*> vecs(kNumVecs);
+  for (size_t i = 0; i < kNumVecs; i++)
+    vecs[i] = &data[(i + 1) * ndims];
+
+  vector<float> out(kNumVecs);
+  while (state.KeepRunning()) {
+    VectorDistances(data.data(), vecs.data(), kNumVecs, ndims, sim, out.data());
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * kNumVecs);
+}
+
+BENCHMARK(BM_VectorDistances)->ArgsProduct({{32, 128, 768}, {0, 1}});
+
 }  // namespace search
 
 }  // namespace dfly
@@ -24,12 +24,26 @@ SimpleValueSortIndex<T>::SimpleValueSortIndex(PMR_NS::memory_resource* mr) : val
 template <typename T>
 std::vector<ResultScore> SimpleValueSortIndex<T>::Sort(std::vector<DocId>* ids, size_t limit,
                                                        bool desc) const {
-  auto cb = [this, desc](const auto& lhs, const auto& rhs) {
-    return desc ? (values_[lhs] > values_[rhs]) : (values_[lhs] < values_[rhs]);
+  // Ties are broken by id, so that pages of results with equal values don't overlap.
+  auto cb = [this, desc](DocId lhs, DocId rhs) {
+    const T& l = values_[lhs];
+    const T& r = values_[rhs];
+    if (l != r)
+      return desc ? (l > r) : (l < r);
+    return lhs < rhs;
   };
-  std::partial_sort(ids->begin(), ids->begin() + std::min(ids->size(), limit), ids->end(), cb);
 
-  vector<ResultScore> out(min(ids->size(), limit));
+  limit = min(ids->size(), limit);
+
+  // partial_sort keeps the best `limit` ids in a bounded heap, so most ids are rejected after a
+  // single comparison. When most of the ids are requested, sorting all of them is faster.
+  if (limit * 2 < ids->size())
+    std::partial_sort(ids->begin(), ids->begin() + limit, ids->end(), cb);
+  else
+    std::sort(ids->begin(), ids->end(), cb);
+  ids->resize(limit);
+
+  vector<ResultScore> out(limit);
   for (size_t i = 0; i < out.size(); i++)
     out[i] = values_[(*ids)[i]];
   return out;
@@ -48,6 +62,35 @@ void SimpleValueSortIndex<T>::Remove(DocId id, DocumentAccessor* doc, std::strin
   values_[id] = T{};
 }
 
+template <typename T> void SimpleValueSortIndex<T>::Serialize(IndexWriter* writer) const {
+  if constexpr (std::is_same_v<T, PMR_NS::string>) {
+    writer->Write<uint64_t>(values_.size());
+    for (const auto& value : values_)
+      writer->WriteString(value);
+  } else {
+    writer->WriteArray(absl::MakeConstSpan(values_));
+  }
+}
+
+template <typename T> bool SimpleValueSortIndex<T>::Deserialize(IndexReader* reader) {
+  if constexpr (std::is_same_v<T, PMR_NS::string>) {
+    uint64_t size;
+    if (!reader->Read(&size))
+      return false;
+
+    values_.clear();
+    for (uint64_t i = 0; i < size; i++) {
+      string_view value;
+      if (!reader->ReadString(&value))
+        return false;
+      values_.emplace_back(value);
+    }
+    return true;
+  } else {
+    return reader->ReadArray(&values_);
+  }
+}
+
 template <typename T> PMR_NS::memory_resource* SimpleValueSortIndex<T>::GetMemRes() const {
   return values_.get_allocator().resource();
 }
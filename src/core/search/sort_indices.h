@@ -25,6 +25,8 @@ template <typename T> struct SimpleValueSortIndex : BaseSortIndex {
 
   void Add(DocId id, DocumentAccessor* doc, std::string_view field) override;
   void Remove(DocId id, DocumentAccessor* doc, std::string_view field) override;
+  void Serialize(IndexWriter* writer) const override;
+  bool Deserialize(IndexReader* reader) override;
 
  protected:
   virtual T Get(DocId id, DocumentAccessor* doc, std::string_view field) = 0;
@@ -4,9 +4,17 @@
 
 #include "core/search/vector_utils.h"
 
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <memory>
 
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
 #include "base/logging.h"
 
 namespace dfly::search {
@@ -15,30 +23,168 @@ using namespace std;
 
 namespace {
 
-// Euclidean vector distance: sqrt( sum: (u[i] - v[i])^2  )
-__attribute__((optimize("fast-math"))) float L2Distance(const float* u, const float* v,
-                                                        size_t dims) {
+struct DotNorm {
+  float uv, vv;  // u * v and v * v
+};
+
+// Portable kernels, vectorized by the compiler for the build target.
+
+// Squared euclidean distance: sum: (u[i] - v[i])^2
+__attribute__((optimize("fast-math"))) float L2SquaredPortable(const float* u, const float* v,
+                                                               size_t dims) {
   float sum = 0;
   for (size_t i = 0; i < dims; i++)
     sum += (u[i] - v[i]) * (u[i] - v[i]);
-  return sqrt(sum);
+  return sum;
 }
 
-// TODO: Normalize vectors ahead if cosine distance is used
-__attribute__((optimize("fast-math"))) float CosineDistance(const float* u, const float* v,
-                                                            size_t dims) {
-  float sum_uv = 0, sum_uu = 0, sum_vv = 0;
+__attribute__((optimize("fast-math"))) DotNorm DotNormPortable(const float* u, const float* v,
+                                                               size_t dims) {
+  float sum_uv = 0, sum_vv = 0;
   for (size_t i = 0; i < dims; i++) {
     sum_uv += u[i] * v[i];
-    sum_uu += u[i] * u[i];
     sum_vv += v[i] * v[i];
   }
+  return {sum_uv, sum_vv};
+}
+
+#if defined(__aarch64__)
+
+float L2SquaredNeon(const float* u, const float* v, size_t dims) {
+  float32x4_t acc = vdupq_n_f32(0);
+  size_t i = 0;
+  for (; i + 4 <= dims; i += 4) {
+    float32x4_t diff = vsubq_f32(vld1q_f32(u + i), vld1q_f32(v + i));
+    acc = vfmaq_f32(acc, diff, diff);
+  }
+
+  float sum = vaddvq_f32(acc);
+  for (; i < dims; i++)
+    sum += (u[i] - v[i]) * (u[i] - v[i]);
+  return sum;
+}
+
+DotNorm DotNormNeon(const float* u, const float* v, size_t dims) {
+  float32x4_t acc_uv = vdupq_n_f32(0), acc_vv = vdupq_n_f32(0);
+  size_t i = 0;
+  for (; i + 4 <= dims; i += 4) {
+    float32x4_t vu = vld1q_f32(u + i), vv = vld1q_f32(v + i);
+    acc_uv = vfmaq_f32(acc_uv, vu, vv);
+    acc_vv = vfmaq_f32(acc_vv, vv, vv);
+  }
+
+  DotNorm res{vaddvq_f32(acc_uv), vaddvq_f32(acc_vv)};
+  for (; i < dims; i++) {
+    res.uv += u[i] * v[i];
+    res.vv += v[i] * v[i];
+  }
+  return res;
+}
+
+#elif defined(__x86_64__)
+
+__attribute__((target("avx2,fma"))) inline float HorizontalSum(__m256 v) {
+  __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  sum = _mm_hadd_ps(sum, sum);
+  sum = _mm_hadd_ps(sum, sum);
+  return _mm_cvtss_f32(sum);
+}
+
+__attribute__((target("avx2,fma"))) float L2SquaredAvx2(const float* u, const float* v,
+                                                         size_t dims) {
+  __m256 acc = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + 8 <= dims; i += 8) {
+    __m256 diff = _mm256_sub_ps(_mm256_loadu_ps(u + i), _mm256_loadu_ps(v + i));
+    acc = _mm256_fmadd_ps(diff, diff, acc);
+  }
+
+  float sum = HorizontalSum(acc);
+  for (; i < dims; i++)
+    sum += (u[i] - v[i]) * (u[i] - v[i]);
+  return sum;
+}
+
+__attribute__((target("avx2,fma"))) DotNorm DotNormAvx2(const float* u, const float* v,
+                                                         size_t dims) {
+  __m256 acc_uv = _mm256_setzero_ps(), acc_vv = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + 8 <= dims; i += 8) {
+    __m256 vu = _mm256_loadu_ps(u + i), vv = _mm256_loadu_ps(v + i);
+    acc_uv = _mm256_fmadd_ps(vu, vv, acc_uv);
+    acc_vv = _mm256_fmadd_ps(vv, vv, acc_vv);
+  }
+
+  DotNorm res{HorizontalSum(acc_uv), HorizontalSum(acc_vv)};
+  for (; i < dims; i++) {
+    res.uv += u[i] * v[i];
+    res.vv += v[i] * v[i];
+  }
+  return res;
+}
+
+// The tails are handled with masked loads that read zeroes past dims.
+__attribute__((target("avx512f"))) float L2SquaredAvx512(const float* u, const float* v,
+                                                          size_t dims) {
+  __m512 acc = _mm512_setzero_ps();
+  for (size_t i = 0; i < dims; i += 16) {
+    __mmask16 mask = dims - i >= 16 ? 0xFFFF : (1u << (dims - i)) - 1;
+    __m512 diff =
+        _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, u + i), _mm512_maskz_loadu_ps(mask, v + i));
+    acc = _mm512_fmadd_ps(diff, diff, acc);
+  }
+  return _mm512_reduce_add_ps(acc);
+}
 
-  if (float denom = sum_uu * sum_vv; denom != 0.0f)
-    return 1 - sum_uv / sqrt(denom);
+__attribute__((target("avx512f"))) DotNorm DotNormAvx512(const float* u, const float* v,
+                                                          size_t dims) {
+  __m512 acc_uv = _mm512_setzero_ps(), acc_vv = _mm512_setzero_ps();
+  for (size_t i = 0; i < dims; i += 16) {
+    __mmask16 mask = dims - i >= 16 ? 0xFFFF : (1u << (dims - i)) - 1;
+    __m512 vu = _mm512_maskz_loadu_ps(mask, u + i), vv = _mm512_maskz_loadu_ps(mask, v + i);
+    acc_uv = _mm512_fmadd_ps(vu, vv, acc_uv);
+    acc_vv = _mm512_fmadd_ps(vv, vv, acc_vv);
+  }
+  return {_mm512_reduce_add_ps(acc_uv), _mm512_reduce_add_ps(acc_vv)};
+}
+
+#endif
+
+struct Kernels {
+  float (*l2_squared)(const float* u, const float* v, size_t dims);
+  DotNorm (*dot_norm)(const float* u, const float* v, size_t dims);
+};
+
+Kernels SelectKernels() {
+#if defined(__aarch64__)
+  return {L2SquaredNeon, DotNormNeon};
+#elif defined(__x86_64__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return {L2SquaredAvx512, DotNormAvx512};
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return {L2SquaredAvx2, DotNormAvx2};
+#endif
+  return {L2SquaredPortable, DotNormPortable};
+}
+
+// Chosen once for the cpu we run on.
+const Kernels kKernels = SelectKernels();
+
+float CosineDistance(const DotNorm& uu, const DotNorm& uv) {
+  if (float denom = uu.vv * uv.vv; denom != 0.0f)
+    return 1 - uv.uv / sqrt(denom);
   return 0.0f;
 }
 
+// The integer sums below do not overflow for up to 2^17 dimensions.
+int32_t DotProduct(const int8_t* u, const int8_t* v, size_t dims) {
+  int32_t sum = 0;
+  for (size_t i = 0; i < dims; i++)
+    sum += int32_t(u[i]) * int32_t(v[i]);
+  return sum;
+}
+
 }  // namespace
 
 OwnedFtVector BytesToFtVector(string_view value) {
@@ -56,9 +202,62 @@ OwnedFtVector BytesToFtVector(string_view value) {
 float VectorDistance(const float* u, const float* v, size_t dims, VectorSimilarity sim) {
   switch (sim) {
     case VectorSimilarity::L2:
-      return L2Distance(u, v, dims);
+      return sqrt(kKernels.l2_squared(u, v, dims));
+    case VectorSimilarity::COSINE:
+      return CosineDistance(kKernels.dot_norm(u, u, dims), kKernels.dot_norm(u, v, dims));
+  };
+  return 0.0f;
+}
+
+void VectorDistances(const float* u, const float* const* vs, size_t count, size_t dims,
+                     VectorSimilarity sim, float* out) {
+  switch (sim) {
+    case VectorSimilarity::L2:
+      for (size_t i = 0; i < count; i++)
+        out[i] = sqrt(kKernels.l2_squared(u, vs[i], dims));
+      break;
+    case VectorSimilarity::COSINE: {
+      DotNorm uu = kKernels.dot_norm(u, u, dims);
+      for (size_t i = 0; i < count; i++)
+        out[i] = CosineDistance(uu, kKernels.dot_norm(u, vs[i], dims));
+      break;
+    }
+  };
+}
+
+float QuantizeVector(const float* v, size_t dims, int8_t* codes) {
+  float max_abs = 0;
+  for (size_t i = 0; i < dims; i++)
+    max_abs = max(max_abs, abs(v[i]));
+
+  if (max_abs == 0) {
+    memset(codes, 0, dims);
+    return 0.0f;
+  }
+
+  float scale = max_abs / 127;
+  for (size_t i = 0; i < dims; i++)
+    codes[i] = int8_t(lrintf(v[i] / scale));
+  return scale;
+}
+
+float QuantizedVectorDistance(const int8_t* u, float u_scale, const int8_t* v, float v_scale,
+                              size_t dims, VectorSimilarity sim) {
+  float uv = DotProduct(u, v, dims);
+  float uu = DotProduct(u, u, dims);
+  float vv = DotProduct(v, v, dims);
+
+  switch (sim) {
+    case VectorSimilarity::L2: {
+      // |u - v|^2 = |u|^2 + |v|^2 - 2 * u.v, the scales are applied to the integer sums.
+      float sum = u_scale * u_scale * uu + v_scale * v_scale * vv - 2 * u_scale * v_scale * uv;
+      return sqrt(max(sum, 0.0f));
+    }
     case VectorSimilarity::COSINE:
-      return CosineDistance(u, v, dims);
+      // The scales cancel out.
+      if (float denom = uu * vv; denom != 0.0f)
+        return 1 - uv / sqrt(denom);
+      return 0.0f;
   };
   return 0.0f;
 }
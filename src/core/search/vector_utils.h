@@ -10,6 +10,19 @@ namespace dfly::search {
 
 OwnedFtVector BytesToFtVector(std::string_view value);
 
+// The distance kernels are selected at startup for the instruction sets of the cpu.
 float VectorDistance(const float* u, const float* v, size_t dims, VectorSimilarity sim);
 
+// Writes the distances from u to the count vectors vs[i] to out[i]. Cheaper than calling
+// VectorDistance for each of them, as the work that depends solely on u is done once.
+void VectorDistances(const float* u, const float* const* vs, size_t count, size_t dims,
+                     VectorSimilarity sim, float* out);
+
+// Writes the int8 codes of v to codes and returns the scale, so that v[i] ~ codes[i] * scale.
+float QuantizeVector(const float* v, size_t dims, int8_t* codes);
+
+// Distance between two quantized vectors, computed on their codes.
+float QuantizedVectorDistance(const int8_t* u, float u_scale, const int8_t* v, float v_scale,
+                              size_t dims, VectorSimilarity sim);
+
 }  // namespace dfly::search
@@ -3,6 +3,7 @@
 //
 #include "core/segment_allocator.h"
 
+#include <absl/base/internal/spinlock.h>
 #include <mimalloc-types.h>
 
 #include "base/logging.h"
@@ -14,15 +15,44 @@ static_assert(kSegmentSize == 1 << 25);
 
 namespace dfly {
 
+namespace {
+
+ABSL_CONST_INIT absl::base_internal::SpinLock global_indx_mu(
+    absl::kConstInit, absl::base_internal::SCHEDULE_KERNEL_ONLY);
+
+// Guarded by global_indx_mu.
+absl::flat_hash_map<uint64_t, uint32_t>* GlobalIndex() {
+  static auto* indx = new absl::flat_hash_map<uint64_t, uint32_t>;
+  return indx;
+}
+
+}  // namespace
+
+std::atomic<uint8_t*> SegmentAllocator::address_table_[kMaxSegments];
+
 SegmentAllocator::SegmentAllocator(mi_heap_t* heap) : heap_(heap) {
 }
 
-void SegmentAllocator::ValidateMapSize() {
-  if (address_table_.size() > 1u << 12) {
-    // This can happen if we restrict dragonfly to small number of threads on high-memory machine,
-    // for example.
-    LOG(WARNING) << "address_table_ map is growing too large: " << address_table_.size();
+int32_t SegmentAllocator::RegisterSegment(uint64_t seg_ptr) {
+  absl::base_internal::SpinLockHolder lk(&global_indx_mu);
+
+  // Another thread may have registered this region before, if mimalloc handed it over.
+  auto* indx = GlobalIndex();
+  auto it = indx->find(seg_ptr);
+  if (it != indx->end())
+    return it->second;
+
+  if (indx->size() >= kMaxSegments) {
+    // This can happen on high-memory machines with lots of small strings.
+    LOG_FIRST_N(ERROR, 1) << "Small string translation table is full";
+    return -1;
   }
+
+  uint32_t id = indx->size();
+  address_table_[id].store(reinterpret_cast<uint8_t*>(seg_ptr), std::memory_order_release);
+  indx->emplace(seg_ptr, id);
+
+  return id;
 }
 
 }  // namespace dfly
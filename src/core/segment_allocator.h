@@ -6,10 +6,12 @@
 #include <absl/container/flat_hash_map.h>
 #include <mimalloc.h>
 
+#include <atomic>
+
 /***
  * This class is tightly coupled with mimalloc segment allocation logic and is designed to provide
- * a compact pointer representation (4bytes ptr) over 64bit address space that gives you
- * 32GB of allocations with option to extend it to 32*256GB if needed.
+ * a compact pointer representation (5 bytes ptr) over 64bit address space that gives you
+ * 8TB of allocations shared by all threads.
  *
  */
 
@@ -19,20 +21,31 @@ namespace dfly {
  * @brief Tightly coupled with mi_malloc 2.x implementation.
  *        Fetches 8MB segment pointers from the allocated pointers.
  *        Provides own indexing of small pointers to real address space using the segment ptrs/
+ *
+ *        The translation table is shared by all threads, so that small pointers allocated
+ *        by one thread can be translated by any other thread. Entries are only appended and
+ *        never change once published, therefore Translate is lock-free and safe to call
+ *        concurrently with allocations. Each allocator caches the segment ids it uses,
+ *        so the global index is locked only when a thread touches a new 8MB region.
  */
 
 class SegmentAllocator {
-  static constexpr uint32_t kSegmentIdBits = 12;
-  static constexpr uint32_t kSegmentIdMask = (1 << kSegmentIdBits) - 1;
+  static constexpr uint32_t kSegmentIdBits = 20;
+  static constexpr uint32_t kMaxSegments = 1 << kSegmentIdBits;
+  static constexpr uint32_t kSegmentIdMask = kMaxSegments - 1;
   static constexpr uint64_t kSegmentAlignMask = ~((1 << 23) - 1);
 
  public:
-  using Ptr = uint32_t;
+  // The segment id in the low kSegmentIdBits bits and the offset within the 8MB region in units
+  // of 8 bytes in the next 20 bits.
+  using Ptr = uint64_t;
+  static constexpr uint32_t kPtrBits = kSegmentIdBits + 20;
 
   SegmentAllocator(mi_heap_t* heap);
 
-  uint8_t* Translate(Ptr p) const {
-    return address_table_[p & kSegmentIdMask] + Offset(p);
+  // Can be called from any thread, as long as the pointer is kept alive by its owner.
+  static uint8_t* Translate(Ptr p) {
+    return address_table_[p & kSegmentIdMask].load(std::memory_order_acquire) + Offset(p);
   }
 
   std::pair<Ptr, uint8_t*> Allocate(uint32_t size);
@@ -52,14 +65,18 @@ class SegmentAllocator {
   }
 
  private:
-  static uint32_t Offset(Ptr p) {
+  static uint64_t Offset(Ptr p) {
     return (p >> kSegmentIdBits) * 8;
   }
 
-  void ValidateMapSize();
+  // Returns the global id of the segment, registering it if needed. Returns -1 if the
+  // translation table is full.
+  int32_t RegisterSegment(uint64_t seg_ptr);
+
+  static std::atomic<uint8_t*> address_table_[kMaxSegments];
 
-  std::vector<uint8_t*> address_table_;
-  absl::flat_hash_map<uint64_t, uint16_t> rev_indx_;
+  // Thread local cache of the global segment index.
+  absl::flat_hash_map<uint64_t, uint32_t> rev_indx_;
   mi_heap_t* heap_;
   size_t used_ = 0;
 };
@@ -73,14 +90,21 @@ inline auto SegmentAllocator::Allocate(uint32_t size) -> std::pair<Ptr, uint8_t*
   uint64_t seg_ptr = iptr & kSegmentAlignMask;
 
   // could be speed up using last used seg_ptr.
-  auto [it, inserted] = rev_indx_.emplace(seg_ptr, address_table_.size());
-  if (inserted) {
-    ValidateMapSize();
-    address_table_.push_back((uint8_t*)seg_ptr);
+  uint32_t seg_id;
+  if (auto it = rev_indx_.find(seg_ptr); it != rev_indx_.end()) {
+    seg_id = it->second;
+  } else {
+    int32_t id = RegisterSegment(seg_ptr);
+    if (id < 0) {
+      mi_free(ptr);
+      throw std::bad_alloc{};
+    }
+    seg_id = id;
+    rev_indx_.emplace(seg_ptr, seg_id);
   }
 
-  uint32_t seg_offset = (iptr - seg_ptr) / 8;
-  Ptr res = (seg_offset << kSegmentIdBits) | it->second;
+  uint64_t seg_offset = (iptr - seg_ptr) / 8;
+  Ptr res = (seg_offset << kSegmentIdBits) | seg_id;
   used_ += mi_good_size(size);
 
   return std::make_pair(res, (uint8_t*)ptr);
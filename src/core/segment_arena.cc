@@ -0,0 +1,191 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/segment_arena.h"
+
+#include <sys/mman.h>
+
+#include <algorithm>
+
+#include "base/logging.h"
+
+namespace dfly {
+
+namespace {
+
+constexpr size_t kHeaderSize = 64;
+constexpr size_t kMaxObjAlign = 64;
+
+struct FreeNode {
+  FreeNode* next;
+};
+
+}  // namespace
+
+struct SegmentArena::PageHeader {
+  FreeNode* free_list = nullptr;
+  PageHeader* prev = nullptr;
+  PageHeader* next = nullptr;
+  uint32_t used = 0;
+  uint32_t bump = 0;  // number of slots that were ever handed out from this page.
+};
+
+SegmentArena::Stats& SegmentArena::Stats::operator+=(const Stats& o) {
+  pages += o.pages;
+  reserved_bytes += o.reserved_bytes;
+  used_bytes += o.used_bytes;
+  return *this;
+}
+
+SegmentArena::SegmentArena(PMR_NS::memory_resource* upstream, std::vector<size_t> obj_sizes)
+    : upstream_(upstream) {
+  std::sort(obj_sizes.begin(), obj_sizes.end());
+  obj_sizes.erase(std::unique(obj_sizes.begin(), obj_sizes.end()), obj_sizes.end());
+
+  for (size_t sz : obj_sizes) {
+    // Round up to keep the objects aligned to cache lines.
+    size_t obj_size = (sz + kMaxObjAlign - 1) & ~(kMaxObjAlign - 1);
+    uint32_t per_page = (kPageSize - kHeaderSize) / obj_size;
+
+    // Too large objects would waste most of the page.
+    if (per_page < 4) {
+      LOG(WARNING) << "Object size " << sz << " is too large for the segment arena";
+      continue;
+    }
+    classes_.push_back(SizeClass{.obj_size = sz, .objs_per_page = per_page});
+  }
+}
+
+SegmentArena::~SegmentArena() {
+  for (auto& sc : classes_) {
+    LOG_IF(ERROR, sc.used_objs > 0) << "Segment arena leaks " << sc.used_objs << " objects";
+
+    // Release the empty pages that were kept around.
+    PageHeader* page = sc.partial;
+    while (page) {
+      PageHeader* next = page->next;
+      if (page->used == 0)
+        FreePage(&sc, page);
+      page = next;
+    }
+  }
+}
+
+auto SegmentArena::GetStats() const -> Stats {
+  Stats res;
+  for (const auto& sc : classes_) {
+    res.pages += sc.pages;
+    res.used_bytes += sc.used_objs * sc.obj_size;
+  }
+  res.reserved_bytes = res.pages * kPageSize;
+  return res;
+}
+
+auto SegmentArena::FindClass(size_t size, size_t align) -> SizeClass* {
+  if (align > kMaxObjAlign)
+    return nullptr;
+
+  for (auto& sc : classes_) {
+    if (sc.obj_size == size)
+      return &sc;
+  }
+  return nullptr;
+}
+
+auto SegmentArena::NewPage(SizeClass* sc) -> PageHeader* {
+  void* ptr = upstream_->allocate(kPageSize, kPageSize);
+
+#ifdef MADV_HUGEPAGE
+  // Best effort, the page may already be backed by regular pages. khugepaged collapses it later.
+  madvise(ptr, kPageSize, MADV_HUGEPAGE);
+#endif
+
+  PageHeader* page = new (ptr) PageHeader;
+  page->next = sc->partial;
+  if (sc->partial)
+    sc->partial->prev = page;
+  sc->partial = page;
+  ++sc->pages;
+
+  return page;
+}
+
+void SegmentArena::FreePage(SizeClass* sc, PageHeader* page) {
+  if (page->prev)
+    page->prev->next = page->next;
+  else
+    sc->partial = page->next;
+
+  if (page->next)
+    page->next->prev = page->prev;
+
+  --sc->pages;
+  page->~PageHeader();
+  upstream_->deallocate(page, kPageSize, kPageSize);
+}
+
+void* SegmentArena::do_allocate(std::size_t size, std::size_t align) {
+  SizeClass* sc = FindClass(size, align);
+  if (!sc)
+    return upstream_->allocate(size, align);
+
+  PageHeader* page = sc->partial ? sc->partial : NewPage(sc);
+  size_t stride = (sc->obj_size + kMaxObjAlign - 1) & ~(kMaxObjAlign - 1);
+
+  void* res;
+  if (page->free_list) {
+    res = page->free_list;
+    page->free_list = page->free_list->next;
+  } else {
+    DCHECK_LT(page->bump, sc->objs_per_page);
+    res = reinterpret_cast<uint8_t*>(page) + kHeaderSize + stride * page->bump++;
+  }
+
+  ++page->used;
+  ++sc->used_objs;
+
+  // Full pages leave the partial list.
+  if (page->used == sc->objs_per_page) {
+    sc->partial = page->next;
+    if (page->next)
+      page->next->prev = nullptr;
+    page->next = page->prev = nullptr;
+  }
+
+  return res;
+}
+
+void SegmentArena::do_deallocate(void* ptr, std::size_t size, std::size_t align) {
+  SizeClass* sc = FindClass(size, align);
+  if (!sc) {
+    upstream_->deallocate(ptr, size, align);
+    return;
+  }
+
+  PageHeader* page =
+      reinterpret_cast<PageHeader*>(reinterpret_cast<uintptr_t>(ptr) & ~(kPageSize - 1));
+  DCHECK_GT(page->used, 0u);
+
+  bool was_full = page->used == sc->objs_per_page;
+  FreeNode* node = reinterpret_cast<FreeNode*>(ptr);
+  node->next = page->free_list;
+  page->free_list = node;
+  --page->used;
+  --sc->used_objs;
+
+  if (was_full) {
+    page->prev = nullptr;
+    page->next = sc->partial;
+    if (sc->partial)
+      sc->partial->prev = page;
+    sc->partial = page;
+  }
+
+  // Keep the last page of the class to avoid thrashing on alloc/free cycles.
+  if (page->used == 0 && sc->pages > 1) {
+    FreePage(sc, page);
+  }
+}
+
+}  // namespace dfly
@@ -0,0 +1,70 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "base/pmr/memory_resource.h"
+
+namespace dfly {
+
+// SegmentArena packs equally sized objects, namely dash table segments, into large pages that
+// are aligned to the huge page size and are advised to be backed by transparent huge pages.
+// Random accesses to segments of very large tables hit fewer TLB entries that way.
+// Only allocations whose size was registered with the arena are served from its pages,
+// all other allocations are forwarded to the upstream resource. Since the routing depends only
+// on the allocation size, deallocations are routed the same way.
+// Not thread-safe, designed to be used by a single shard thread.
+class SegmentArena : public PMR_NS::memory_resource {
+ public:
+  static constexpr size_t kPageSize = 1ULL << 21;  // 2MB, THP size on x86_64 and aarch64.
+
+  struct Stats {
+    size_t pages = 0;           // number of pages allocated by the arena.
+    size_t reserved_bytes = 0;  // pages * kPageSize.
+    size_t used_bytes = 0;      // bytes of the objects hosted in the pages.
+
+    Stats& operator+=(const Stats& o);
+  };
+
+  // upstream provides the pages and serves all the non-segment allocations.
+  // obj_sizes - sizes of the objects that are served from the arena pages.
+  SegmentArena(PMR_NS::memory_resource* upstream, std::vector<size_t> obj_sizes);
+  ~SegmentArena();
+
+  SegmentArena(const SegmentArena&) = delete;
+  SegmentArena& operator=(const SegmentArena&) = delete;
+
+  Stats GetStats() const;
+
+ private:
+  struct PageHeader;
+
+  struct SizeClass {
+    size_t obj_size;
+    uint32_t objs_per_page;
+    PageHeader* partial = nullptr;  // doubly linked list of pages with free slots.
+    size_t pages = 0;
+    size_t used_objs = 0;
+  };
+
+  void* do_allocate(std::size_t size, std::size_t align) final;
+  void do_deallocate(void* ptr, std::size_t size, std::size_t align) final;
+
+  bool do_is_equal(const PMR_NS::memory_resource& o) const noexcept final {
+    return this == &o;
+  }
+
+  SizeClass* FindClass(size_t size, size_t align);
+  PageHeader* NewPage(SizeClass* sc);
+  void FreePage(SizeClass* sc, PageHeader* page);
+
+  PMR_NS::memory_resource* upstream_;
+  std::vector<SizeClass> classes_;
+};
+
+}  // namespace dfly
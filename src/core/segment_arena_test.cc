@@ -0,0 +1,85 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/segment_arena.h"
+
+#include "base/gtest.h"
+#include "base/hash.h"
+#include "base/logging.h"
+#include "core/dash.h"
+#include "core/mi_memory_resource.h"
+
+using namespace std;
+
+namespace dfly {
+
+class SegmentArenaTest : public ::testing::Test {
+ protected:
+  SegmentArenaTest() : mr_(mi_heap_get_backing()) {
+  }
+
+  MiMemoryResource mr_;
+};
+
+TEST_F(SegmentArenaTest, Basic) {
+  constexpr size_t kObjSize = 30000;
+  SegmentArena arena(&mr_, {kObjSize});
+
+  vector<void*> ptrs;
+  for (unsigned i = 0; i < 200; ++i) {
+    void* ptr = arena.allocate(kObjSize, 8);
+    ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(ptr) % 64);
+    memset(ptr, i, kObjSize);
+    ptrs.push_back(ptr);
+  }
+
+  SegmentArena::Stats stats = arena.GetStats();
+  EXPECT_EQ(200 * kObjSize, stats.used_bytes);
+  EXPECT_EQ(3u, stats.pages);  // 69 objects per page.
+  EXPECT_EQ(stats.pages * SegmentArena::kPageSize, stats.reserved_bytes);
+
+  // Other sizes are forwarded upstream.
+  size_t upstream_used = mr_.used();
+  void* other = arena.allocate(100, 8);
+  EXPECT_GT(mr_.used(), upstream_used);
+  arena.deallocate(other, 100, 8);
+  EXPECT_EQ(upstream_used, mr_.used());
+
+  for (unsigned i = 0; i < ptrs.size(); ++i) {
+    ASSERT_EQ(uint8_t(i), *reinterpret_cast<uint8_t*>(ptrs[i]));
+    arena.deallocate(ptrs[i], kObjSize, 8);
+  }
+
+  stats = arena.GetStats();
+  EXPECT_EQ(0u, stats.used_bytes);
+  EXPECT_EQ(1u, stats.pages);
+}
+
+struct UInt64Policy : public BasicDashPolicy {
+  static uint64_t HashFn(uint64_t v) {
+    return XXH3_64bits(&v, sizeof(v));
+  }
+};
+
+TEST_F(SegmentArenaTest, DashTable) {
+  using Dash64 = DashTable<uint64_t, uint64_t, UInt64Policy>;
+  SegmentArena arena(&mr_, {Dash64::kSegBytes});
+
+  {
+    Dash64 dt(1, UInt64Policy{}, &arena);
+    for (uint64_t i = 0; i < 100000; ++i) {
+      dt.Insert(i, i);
+    }
+    EXPECT_EQ(dt.unique_segments() * Dash64::kSegBytes, arena.GetStats().used_bytes);
+
+    for (uint64_t i = 0; i < 100000; ++i) {
+      auto it = dt.Find(i);
+      ASSERT_FALSE(it.is_done());
+      ASSERT_EQ(i, it->second);
+    }
+  }
+  EXPECT_EQ(0u, arena.GetStats().used_bytes);
+}
+
+}  // namespace dfly
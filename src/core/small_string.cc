@@ -50,6 +50,7 @@ size_t SmallString::UsedThreadLocal() {
 }
 
 static_assert(sizeof(SmallString) == 16);
+static_assert(SegmentAllocator::kPtrBits <= 40);
 
 // we should use only for sizes greater than kPrefLen
 size_t SmallString::Assign(std::string_view s) {
@@ -60,18 +61,18 @@ size_t SmallString::Assign(std::string_view s) {
   if (size_ == 0) {
     // packed structs can not be tied here.
     auto [sp, rp] = tl.seg_alloc->Allocate(s.size() - kPrefLen);
-    small_ptr_ = sp;
+    set_small_ptr(sp);
     realptr = rp;
     size_ = s.size();
   } else if (s.size() <= size_) {
-    realptr = tl.seg_alloc->Translate(small_ptr_);
+    realptr = SegmentAllocator::Translate(small_ptr());
 
     if (s.size() < size_) {
       size_t capacity = mi_usable_size(realptr);
       if (s.size() * 2 < capacity) {
-        tl.seg_alloc->Free(small_ptr_);
+        tl.seg_alloc->Free(small_ptr());
         auto [sp, rp] = tl.seg_alloc->Allocate(s.size() - kPrefLen);
-        small_ptr_ = sp;
+        set_small_ptr(sp);
         realptr = rp;
       }
       size_ = s.size();
@@ -90,14 +91,14 @@ void SmallString::Free() {
   if (size_ <= kPrefLen)
     return;
 
-  tl.seg_alloc->Free(small_ptr_);
+  tl.seg_alloc->Free(small_ptr());
   size_ = 0;
 }
 
 uint16_t SmallString::MallocUsed() const {
   if (size_ <= kPrefLen)
     return 0;
-  auto* realptr = tl.seg_alloc->Translate(small_ptr_);
+  auto* realptr = SegmentAllocator::Translate(small_ptr());
 
   return mi_malloc_usable_size(realptr);
 }
@@ -114,7 +115,7 @@ bool SmallString::Equal(std::string_view o) const {
   if (memcmp(prefix_, o.data(), kPrefLen) != 0)
     return false;
 
-  uint8_t* realp = tl.seg_alloc->Translate(small_ptr_);
+  uint8_t* realp = SegmentAllocator::Translate(small_ptr());
 
   return memcmp(realp, o.data() + kPrefLen, size_ - kPrefLen) == 0;
 }
@@ -152,7 +153,7 @@ void SmallString::Get(std::string* dest) const {
   if (size_) {
     DCHECK_GT(size_, kPrefLen);
     memcpy(dest->data(), prefix_, kPrefLen);
-    uint8_t* ptr = tl.seg_alloc->Translate(small_ptr_);
+    uint8_t* ptr = SegmentAllocator::Translate(small_ptr());
     memcpy(dest->data() + kPrefLen, ptr, size_ - kPrefLen);
   }
 }
@@ -165,7 +166,7 @@ unsigned SmallString::GetV(string_view dest[2]) const {
   }
 
   dest[0] = string_view{prefix_, kPrefLen};
-  uint8_t* ptr = tl.seg_alloc->Translate(small_ptr_);
+  uint8_t* ptr = SegmentAllocator::Translate(small_ptr());
   dest[1] = string_view{reinterpret_cast<char*>(ptr), size_ - kPrefLen};
   return 2;
 }
@@ -176,15 +177,15 @@ bool SmallString::DefragIfNeeded(float ratio) {
     return false;
   }
 
-  uint8_t* cur_real_ptr = tl.seg_alloc->Translate(small_ptr_);
+  uint8_t* cur_real_ptr = SegmentAllocator::Translate(small_ptr());
   if (!mi_heap_page_is_underutilized(tl.seg_alloc->heap(), cur_real_ptr, ratio))
     return false;
 
   auto [sp, rp] = tl.seg_alloc->Allocate(size_ - kPrefLen);
 
   memcpy(rp, cur_real_ptr, size_ - kPrefLen);
-  tl.seg_alloc->Free(small_ptr_);
-  small_ptr_ = sp;
+  tl.seg_alloc->Free(small_ptr());
+  set_small_ptr(sp);
 
   return true;
 }
@@ -14,8 +14,11 @@ namespace dfly {
 // for in-memory workloads, especially for keys.
 // Please note that this class does not have automatic constructors and destructors, therefore
 // it requires explicit management.
+// Mutating methods must run in the thread that allocated the string. The read accessors
+// (Equal, Get, GetV, MallocUsed) can be called from any thread as long as the owning thread
+// keeps the string alive, since the pointer translation table is shared.
 class SmallString {
-  static constexpr unsigned kPrefLen = 10;
+  static constexpr unsigned kPrefLen = 9;
 
  public:
   static void InitThreadLocal(void* heap);
@@ -51,11 +54,22 @@ class SmallString {
   bool DefragIfNeeded(float ratio);
 
  private:
+  uint64_t small_ptr() const {
+    return (uint64_t(small_ptr_hi_) << 32) | small_ptr_;
+  }
+
+  void set_small_ptr(uint64_t ptr) {
+    small_ptr_ = ptr;
+    small_ptr_hi_ = ptr >> 32;
+  }
+
   // prefix of the string that is broken down into 2 parts.
   char prefix_[kPrefLen];
 
-  uint32_t small_ptr_;  // 32GB capacity because we ignore 3 lsb bits (i.e. x8).
-  uint16_t size_;       // uint16_t - total size (including prefix)
+  // SegmentAllocator::Ptr split into 5 bytes, 8TB capacity because we ignore 3 lsb bits (i.e. x8).
+  uint32_t small_ptr_;
+  uint8_t small_ptr_hi_;
+  uint16_t size_;  // uint16_t - total size (including prefix)
 
 } __attribute__((packed));
 
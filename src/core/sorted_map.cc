@@ -4,6 +4,7 @@
 
 #include "core/sorted_map.h"
 
+#include <algorithm>
 #include <cmath>
 
 extern "C" {
@@ -229,6 +230,20 @@ bool SortedMap::RdImpl::Insert(double score, sds member) {
   return ret == DICT_OK;
 }
 
+bool SortedMap::RdImpl::BulkInsert(absl::Span<const ScoredMemberView> members) {
+  bool unique = true;
+  for (const auto& [score, member] : members) {
+    sds ele = sdsnewlen(member.data(), member.size());
+    if (dictFind(dict, ele) != nullptr) {
+      sdsfree(ele);
+      unique = false;
+      continue;
+    }
+    Insert(score, ele);
+  }
+  return unique;
+}
+
 int SortedMap::RdImpl::Add(double score, sds ele, int in_flags, int* out_flags, double* newscore) {
   zskiplistNode* znode;
 
@@ -514,6 +529,26 @@ bool SortedMap::RdImpl::Iterate(unsigned start_rank, unsigned len, bool reverse,
   return success;
 }
 
+bool SortedMap::RdImpl::IterateScoreRanges(absl::Span<const zrangespec> ranges,
+                                           absl::FunctionRef<bool(sds, double)> cb) const {
+  zskiplistNode* ln = nullptr;
+  for (const zrangespec& range : ranges) {
+    if (!ln || !zslValueGteMin(ln->score, &range)) {
+      ln = zslFirstInRange(zsl, &range);
+      if (!ln)
+        continue;
+    }
+
+    for (; ln && zslValueLteMax(ln->score, &range); ln = ln->level[0].forward) {
+      if (!cb(ln->ele, ln->score))
+        return false;
+    }
+    if (!ln)
+      return true;
+  }
+  return true;
+}
+
 uint64_t SortedMap::RdImpl::Scan(uint64_t cursor,
                                  absl::FunctionRef<void(std::string_view, double)> cb) const {
   auto scanCb = [](void* privdata, const dictEntry* de) {
@@ -592,10 +627,8 @@ int SortedMap::DfImpl::Add(double score, sds ele, int in_flags, int* out_flags,
     }
   }
 
-  // Update the score.
-  CHECK(score_tree->Delete(obj));
-  SetObjScore(obj, score);
-  CHECK(score_tree->Insert(obj));
+  // Update the score. The element keeps its place in the tree unless it passes a neighbour.
+  score_tree->Update(obj, [&] { SetObjScore(obj, score); });
   *out_flags = ZADD_OUT_UPDATED;
   *newscore = score;
   return 1;
@@ -635,6 +668,36 @@ bool SortedMap::DfImpl::Insert(double score, sds ele) {
   return true;
 }
 
+bool SortedMap::DfImpl::BulkInsert(absl::Span<const ScoredMemberView> members) {
+  DCHECK_EQ(0u, score_tree->Size());
+
+  score_map->Reserve(members.size());
+  vector<ScoreSds> objs;
+  objs.reserve(members.size());
+
+  bool unique = true;
+  for (const auto& [score, member] : members) {
+    auto [obj, added] = score_map->AddOrSkip(member, score);
+    if (added)
+      objs.push_back(obj);
+    else
+      unique = false;
+  }
+
+  // The input is often sorted already, for example RDB stores the members in descending order.
+  ScoreSdsPolicy::KeyCompareTo cmp;
+  auto less = [&cmp](ScoreSds a, ScoreSds b) { return cmp(a, b) < 0; };
+  if (!std::is_sorted(objs.begin(), objs.end(), less)) {
+    if (std::is_sorted(objs.rbegin(), objs.rend(), less))
+      std::reverse(objs.begin(), objs.end());
+    else
+      std::sort(objs.begin(), objs.end(), less);
+  }
+
+  score_tree->FromSorted(objs);
+  return unique;
+}
+
 optional<unsigned> SortedMap::DfImpl::GetRank(sds ele, bool reverse) const {
   ScoreSds obj = score_map->FindObj(ele);
   if (obj == nullptr)
@@ -814,6 +877,21 @@ size_t SortedMap::DfImpl::MallocSize() const {
   return score_map->SetMallocUsed() + score_map->ObjMallocUsed() + score_tree->Size() * 256;
 }
 
+bool SortedMap::DfImpl::DefragIfNeeded(float ratio) {
+  auto underutilized = [ratio](const void* node) {
+    return zmalloc_page_is_underutilized(const_cast<void*>(node), ratio) != 0;
+  };
+  bool realloced = score_tree->ReallocNodesIf(underutilized) > 0;
+
+  // The members are kept both by the map and the tree, the copy compares equal to the original
+  // so it takes its place in the tree.
+  auto replace = [this](sds old_ele, sds new_ele) { CHECK(score_tree->Replace(old_ele, new_ele)); };
+  for (auto it = score_map->begin(); it != score_map->end(); ++it)
+    realloced |= it.ReallocIfNeeded(ratio, replace);
+
+  return realloced;
+}
+
 bool SortedMap::DfImpl::Reserve(size_t sz) {
   score_map->Reserve(sz);
   return true;
@@ -1041,6 +1119,36 @@ bool SortedMap::DfImpl::Iterate(unsigned start_rank, unsigned len, bool reverse,
   return success;
 }
 
+bool SortedMap::DfImpl::IterateScoreRanges(absl::Span<const zrangespec> ranges,
+                                           absl::FunctionRef<bool(sds, double)> cb) const {
+  char buf[16];
+  size_t i = 0;
+  while (i < ranges.size()) {
+    auto path = score_tree->GEQ(BuildScoredKey(ranges[i].min, ranges[i].minex, buf));
+    if (path.Empty())
+      return true;
+
+    while (true) {
+      ScoreSds ele = path.Terminal();
+      double score = GetObjScore(ele);
+      while (i < ranges.size() && !zslValueLteMax(score, &ranges[i]))
+        ++i;
+      if (i == ranges.size())
+        return true;
+
+      // There is a gap before the next range, search for its start.
+      if (!zslValueGteMin(score, &ranges[i]))
+        break;
+
+      if (!cb((sds)ele, score))
+        return false;
+      if (!path.Next())
+        return true;
+    }
+  }
+  return true;
+}
+
 uint64_t SortedMap::DfImpl::Scan(uint64_t cursor,
                                  absl::FunctionRef<void(std::string_view, double)> cb) const {
   auto scan_cb = [&cb](const void* obj) {
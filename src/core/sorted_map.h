@@ -5,6 +5,7 @@
 #pragma once
 
 #include <absl/functional/function_ref.h>
+#include <absl/types/span.h>
 
 #include <memory>
 #include <optional>
@@ -38,6 +39,7 @@ class SortedMap {
  public:
   using ScoredMember = std::pair<std::string, double>;
   using ScoredArray = std::vector<ScoredMember>;
+  using ScoredMemberView = std::pair<double, std::string_view>;
 
   SortedMap(PMR_NS::memory_resource* res);
   SortedMap(const SortedMap&) = delete;
@@ -72,6 +74,13 @@ class SortedMap {
     return std::visit(Overload{[&](auto& impl) { return impl.Insert(score, member); }}, impl_);
   }
 
+  // Inserts members into an empty map, faster than inserting them one by one.
+  // Does not take ownership over the members. Returns false if the members are not unique,
+  // in which case only the first occurrence of each member is inserted.
+  bool BulkInsert(absl::Span<const ScoredMemberView> members) {
+    return std::visit(Overload{[&](auto& impl) { return impl.BulkInsert(members); }}, impl_);
+  }
+
   uint8_t* ToListPack() const {
     return std::visit(Overload{[](const auto& impl) { return impl.ToListPack(); }}, impl_);
   }
@@ -80,6 +89,12 @@ class SortedMap {
     return std::visit(Overload{[](const auto& impl) { return impl.MallocSize(); }}, impl_);
   }
 
+  // Re-allocates the internal nodes that reside on underutilized pages.
+  // Returns true if re-allocation happened.
+  bool DefragIfNeeded(float ratio) {
+    return std::visit(Overload{[&](auto& impl) { return impl.DefragIfNeeded(ratio); }}, impl_);
+  }
+
   uint64_t Scan(uint64_t cursor, absl::FunctionRef<void(std::string_view, double)> cb) const {
     return std::visit([&](const auto& impl) { return impl.Scan(cursor, cb); }, impl_);
   }
@@ -146,6 +161,16 @@ class SortedMap {
                       impl_);
   }
 
+  // Runs cb for each element with a score in one of the ranges, in ascending order. The ranges
+  // must be sorted and disjoint. A range that starts where the walk over the previous ones
+  // ended continues that walk rather than searching again.
+  // Stops iteration if cb returns false. Returns false in this case.
+  bool IterateScoreRanges(absl::Span<const zrangespec> ranges,
+                          absl::FunctionRef<bool(sds, double)> cb) const {
+    return std::visit([&](const auto& impl) { return impl.IterateScoreRanges(ranges, cb); },
+                      impl_);
+  }
+
  private:
   struct RdImpl {
     struct dict* dict = nullptr;
@@ -162,6 +187,8 @@ class SortedMap {
 
     bool Insert(double score, sds member);
 
+    bool BulkInsert(absl::Span<const ScoredMemberView> members);
+
     bool Delete(sds ele);
 
     size_t Size() const {
@@ -174,6 +201,10 @@ class SortedMap {
       return dictExpand(dict, sz) == DICT_OK;
     }
 
+    bool DefragIfNeeded(float ratio) {
+      return false;  // the skiplist is not defragmented.
+    }
+
     size_t DeleteRangeByRank(unsigned start, unsigned end) {
       return zslDeleteRangeByRank(zsl, start + 1, end + 1, dict);
     }
@@ -204,6 +235,9 @@ class SortedMap {
     bool Iterate(unsigned start_rank, unsigned len, bool reverse,
                  absl::FunctionRef<bool(sds, double)> cb) const;
 
+    bool IterateScoreRanges(absl::Span<const zrangespec> ranges,
+                            absl::FunctionRef<bool(sds, double)> cb) const;
+
     uint64_t Scan(uint64_t cursor, absl::FunctionRef<void(std::string_view, double)> cb) const;
   };
 
@@ -230,6 +264,9 @@ class SortedMap {
 
     bool Insert(double score, sds member);
 
+    // Builds the score tree bottom-up after sorting the members.
+    bool BulkInsert(absl::Span<const ScoredMemberView> members);
+
     bool Delete(sds ele);
 
     size_t Size() const {
@@ -240,6 +277,8 @@ class SortedMap {
 
     bool Reserve(size_t sz);
 
+    bool DefragIfNeeded(float ratio);
+
     size_t DeleteRangeByRank(unsigned start, unsigned end);
 
     size_t DeleteRangeByScore(const zrangespec& range);
@@ -264,6 +303,9 @@ class SortedMap {
     bool Iterate(unsigned start_rank, unsigned len, bool reverse,
                  absl::FunctionRef<bool(sds, double)> cb) const;
 
+    bool IterateScoreRanges(absl::Span<const zrangespec> ranges,
+                            absl::FunctionRef<bool(sds, double)> cb) const;
+
     uint64_t Scan(uint64_t cursor, absl::FunctionRef<void(std::string_view, double)> cb) const;
   };
 
@@ -4,17 +4,26 @@
 
 #include "core/sorted_map.h"
 
+#include <absl/flags/flag.h>
+#include <absl/flags/reflection.h>
+#include <absl/strings/str_cat.h>
 #include <gmock/gmock.h>
 #include <mimalloc.h>
 
+#include <random>
+
 #include "base/gtest.h"
+#include "base/init.h"
 #include "base/logging.h"
 #include "core/mi_memory_resource.h"
 
 extern "C" {
+#include "redis/listpack.h"
 #include "redis/zmalloc.h"
 }
 
+ABSL_DECLARE_FLAG(bool, use_zset_tree);
+
 using namespace std;
 using testing::ElementsAre;
 using testing::Pair;
@@ -105,6 +114,44 @@ TEST_F(SortedMapTest, InsertPop) {
                                       Pair(StrEq("a97"), 1000)));
 }
 
+TEST_F(SortedMapTest, BulkInsert) {
+  vector<string> strs;
+  for (unsigned i = 0; i < 1000; ++i) {
+    strs.push_back(absl::StrCat("a", i));
+  }
+
+  // Descending order, as the members are stored in RDB.
+  vector<SortedMap::ScoredMemberView> members;
+  for (unsigned i = 1000; i > 0; --i) {
+    members.emplace_back(i - 1, strs[i - 1]);
+  }
+  members.emplace_back(5000, strs[0]);
+
+  EXPECT_FALSE(sm_.BulkInsert(members));
+  EXPECT_EQ(1000u, sm_.Size());
+
+  vector<double> scores;
+  sm_.Iterate(0, 1000, false, [&](sds ele, double score) {
+    EXPECT_EQ(absl::StrCat("a", score), string_view(ele, sdslen(ele)));
+    scores.push_back(score);
+    return true;
+  });
+  EXPECT_EQ(1000u, scores.size());
+  EXPECT_TRUE(is_sorted(scores.begin(), scores.end()));
+
+  sds s = sdsnew("a10");
+  EXPECT_EQ(10, sm_.GetRank(s, false));
+  sdsfree(s);
+
+  SortedMap shuffled(&mr_);
+  members.pop_back();
+  std::reverse(members.begin() + 300, members.end());
+  EXPECT_TRUE(shuffled.BulkInsert(members));
+  EXPECT_EQ(1000u, shuffled.Size());
+  auto top = shuffled.PopTopScores(2, false);
+  EXPECT_THAT(top, ElementsAre(Pair(StrEq("a0"), 0), Pair(StrEq("a1"), 1)));
+}
+
 TEST_F(SortedMapTest, LexRanges) {
   for (unsigned i = 0; i < 100; ++i) {
     sds s = sdsempty();
@@ -205,6 +252,39 @@ TEST_F(SortedMapTest, ScoreRanges) {
   ASSERT_EQ(0, array.size());
 }
 
+TEST_F(SortedMapTest, IterateScoreRanges) {
+  for (bool use_tree : {true, false}) {
+    absl::FlagSaver saver;
+    absl::SetFlag(&FLAGS_use_zset_tree, use_tree);
+    SortedMap sm(&mr_);
+    for (unsigned i = 0; i < 100; ++i) {
+      ASSERT_TRUE(sm.Insert(i, sdsfromlonglong(i)));
+    }
+
+    // The second range continues the first one, the third one needs a new search and the
+    // last one is past the end.
+    vector<zrangespec> ranges = {{10, 20, 0, 1}, {20, 25, 0, 0}, {50, 52, 1, 0}, {200, 300, 0, 0}};
+    vector<double> scores;
+    EXPECT_TRUE(sm.IterateScoreRanges(ranges, [&](sds ele, double score) {
+      EXPECT_EQ(absl::StrCat(score), string_view(ele, sdslen(ele)));
+      scores.push_back(score);
+      return true;
+    }));
+    vector<double> expected;
+    for (unsigned i = 10; i <= 25; ++i)
+      expected.push_back(i);
+    expected.insert(expected.end(), {51, 52});
+    EXPECT_EQ(expected, scores) << use_tree;
+
+    scores.clear();
+    EXPECT_FALSE(sm.IterateScoreRanges(ranges, [&](sds ele, double score) {
+      scores.push_back(score);
+      return scores.size() < 3;
+    }));
+    EXPECT_THAT(scores, ElementsAre(10, 11, 12));
+  }
+}
+
 TEST_F(SortedMapTest, DeleteRange) {
   for (unsigned i = 0; i <= 100; ++i) {
     sds s = sdsempty();
@@ -265,4 +345,95 @@ TEST_F(SortedMapTest, MemoryUsage) {
   zslFree(zsl);
 }
 
+static vector<sds> GenerateMembers(unsigned count) {
+  vector<sds> members(count);
+  for (unsigned i = 0; i < count; ++i) {
+    members[i] = sdscatfmt(sdsempty(), "member:%u", i);
+  }
+  return members;
+}
+
+static void FreeSortedMap(PMR_NS::memory_resource* mr, SortedMap* sm) {
+  sm->~SortedMap();
+  mr->deallocate(sm, sizeof(SortedMap), alignof(SortedMap));
+}
+
+// ZADD of new members.
+static void BM_SortedMapAdd(benchmark::State& state) {
+  unsigned count = state.range(0);
+  vector<sds> members = GenerateMembers(count);
+  MiMemoryResource mr(mi_heap_get_backing());
+  int out_flags;
+  double new_score;
+
+  while (state.KeepRunning()) {
+    SortedMap sm(&mr);
+    for (unsigned i = 0; i < count; ++i) {
+      sm.Add(i, members[i], 0, &out_flags, &new_score);
+    }
+  }
+
+  for (sds s : members)
+    sdsfree(s);
+}
+BENCHMARK(BM_SortedMapAdd)->Arg(128)->Arg(1024)->Arg(1 << 16);
+
+// ZRANGE over 10 members starting at a random rank.
+static void BM_SortedMapRange(benchmark::State& state) {
+  unsigned count = state.range(0);
+  MiMemoryResource mr(mi_heap_get_backing());
+  SortedMap sm(&mr);
+  for (unsigned i = 0; i < count; ++i) {
+    sm.Insert(i, sdscatfmt(sdsempty(), "member:%u", i));
+  }
+
+  mt19937 dre(10);
+  while (state.KeepRunning()) {
+    unsigned start = dre() % (count - 10);
+    sm.Iterate(start, 10, false, [](sds ele, double score) {
+      benchmark::DoNotOptimize(ele);
+      return true;
+    });
+  }
+}
+BENCHMARK(BM_SortedMapRange)->Arg(1024)->Arg(1 << 16)->Arg(1 << 20);
+
+// The conversions done when a zset crosses zset_max_listpack_entries and on RDB load.
+static void BM_SortedMapToListPack(benchmark::State& state) {
+  unsigned count = state.range(0);
+  MiMemoryResource mr(mi_heap_get_backing());
+  SortedMap sm(&mr);
+  for (unsigned i = 0; i < count; ++i) {
+    sm.Insert(i, sdscatfmt(sdsempty(), "member:%u", i));
+  }
+
+  while (state.KeepRunning()) {
+    uint8_t* lp = sm.ToListPack();
+    lpFree(lp);
+  }
+}
+BENCHMARK(BM_SortedMapToListPack)->Arg(128)->Arg(1024);
+
+static void BM_SortedMapFromListPack(benchmark::State& state) {
+  unsigned count = state.range(0);
+  MiMemoryResource mr(mi_heap_get_backing());
+  SortedMap sm(&mr);
+  for (unsigned i = 0; i < count; ++i) {
+    sm.Insert(i, sdscatfmt(sdsempty(), "member:%u", i));
+  }
+  uint8_t* lp = sm.ToListPack();
+
+  while (state.KeepRunning()) {
+    FreeSortedMap(&mr, SortedMap::FromListPack(&mr, lp));
+  }
+  lpFree(lp);
+}
+BENCHMARK(BM_SortedMapFromListPack)->Arg(128)->Arg(1024);
+
+void RegisterSortedMapBench() {
+  init_zmalloc_threadlocal(mi_heap_get_backing());
+}
+
+REGISTER_MODULE_INITIALIZER(SortedMapBench, RegisterSortedMapBench());
+
 }  // namespace dfly
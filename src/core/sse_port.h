@@ -3,12 +3,17 @@
 //
 
 #pragma once
+
+#include <cstdint>
+#include <cstring>
+
 #if defined(__aarch64__)
 #include "base/sse2neon.h"
 #elif defined(__s390x__)
 #include <vecintrin.h>
 #else
 #include <emmintrin.h>
+#include <immintrin.h>
 #include <tmmintrin.h>
 #endif
 
@@ -27,4 +32,73 @@ inline __m128i mm_loadu_si128(const __m128i* ptr) {
 }
 #endif
 
+namespace detail {
+
+// Compares byte fp against 16 bytes starting at a and 16 bytes starting at b.
+// Returns a 32-bit mask, where bit i is set if a[i] == fp and bit (16 + i) is set if
+// b[i] == fp. Used by dash to probe the home and the neighbour buckets in one pass.
+// On x86 the AVX2 variant is chosen at runtime, aarch64 always has NEON.
+
+#if defined(__s390x__)
+
+inline uint32_t CompareFp2x16(const uint8_t* a, const uint8_t* b, uint8_t fp) {
+  uint32_t mask = 0;
+  for (unsigned i = 0; i < 16; ++i) {
+    mask |= uint32_t(a[i] == fp) << i;
+    mask |= uint32_t(b[i] == fp) << (i + 16);
+  }
+  return mask;
+}
+
+#elif defined(__aarch64__)
+
+// sse2neon emulates _mm_movemask_epi8 with a long sequence of shifts, therefore we
+// collapse the compare result with a weighted horizontal add instead.
+inline uint32_t NeonMoveMask16(uint8x16_t cmp) {
+  static const uint8_t kWeights[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+  uint8x16_t masked = vandq_u8(cmp, vld1q_u8(kWeights));
+  return uint32_t(vaddv_u8(vget_low_u8(masked))) | (uint32_t(vaddv_u8(vget_high_u8(masked))) << 8);
+}
+
+inline uint32_t CompareFp2x16(const uint8_t* a, const uint8_t* b, uint8_t fp) {
+  uint8x16_t key = vdupq_n_u8(fp);
+  uint32_t ma = NeonMoveMask16(vceqq_u8(vld1q_u8(a), key));
+  uint32_t mb = NeonMoveMask16(vceqq_u8(vld1q_u8(b), key));
+  return ma | (mb << 16);
+}
+
+#else
+
+inline uint32_t CompareFp2x16Sse2(const uint8_t* a, const uint8_t* b, uint8_t fp) {
+  const __m128i key = _mm_set1_epi8(fp);
+  __m128i da = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+  __m128i db = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+  uint32_t ma = _mm_movemask_epi8(_mm_cmpeq_epi8(da, key));
+  uint32_t mb = _mm_movemask_epi8(_mm_cmpeq_epi8(db, key));
+  return ma | (mb << 16);
+}
+
+__attribute__((target("avx2"))) inline uint32_t CompareFp2x16Avx2(const uint8_t* a,
+                                                                  const uint8_t* b, uint8_t fp) {
+  __m128i da = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+  __m128i db = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+  __m256i data = _mm256_inserti128_si256(_mm256_castsi128_si256(da), db, 1);
+  __m256i cmp = _mm256_cmpeq_epi8(data, _mm256_set1_epi8(fp));
+  return uint32_t(_mm256_movemask_epi8(cmp));
+}
+
+// Zero-initialized (false) before the dynamic initialization runs, so early callers
+// just fall back to SSE2.
+inline const bool kCpuHasAvx2 = [] {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") != 0;
+}();
+
+inline uint32_t CompareFp2x16(const uint8_t* a, const uint8_t* b, uint8_t fp) {
+  return kCpuHasAvx2 ? CompareFp2x16Avx2(a, b, fp) : CompareFp2x16Sse2(a, b, fp);
+}
+
+#endif
+
+}  // namespace detail
 }  // namespace dfly
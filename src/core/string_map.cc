@@ -4,6 +4,8 @@
 
 #include "core/string_map.h"
 
+#include <absl/container/inlined_vector.h>
+
 #include "base/endian.h"
 #include "base/logging.h"
 #include "core/compact_object.h"
@@ -91,6 +93,49 @@ bool StringMap::AddOrSkip(std::string_view field, std::string_view value, uint32
   return true;
 }
 
+unsigned StringMap::AddMany(absl::Span<const std::string_view> field_values, uint32_t ttl_sec,
+                            bool keep_existing) {
+  DCHECK_EQ(field_values.size() % 2, 0u);
+  size_t count = field_values.size() / 2;
+
+  // Reserve for the whole batch so that the table is not rehashed while being filled.
+  Reserve(UpperBoundSize() + count);
+
+  absl::InlinedVector<uint64_t, 32> hashes(count);
+  for (size_t i = 0; i < count; ++i) {
+    hashes[i] = Hash(&field_values[i * 2], 1);
+    if (i < kBulkPrefetchDistance)
+      PrefetchBucket(hashes[i]);
+  }
+
+  unsigned res = 0;
+  for (size_t i = 0; i < count; ++i) {
+    if (i + kBulkPrefetchDistance < count)
+      PrefetchBucket(hashes[i + kBulkPrefetchDistance]);
+
+    string_view field = field_values[i * 2];
+    string_view value = field_values[i * 2 + 1];
+
+    if (keep_existing) {
+      if (FindInternal(&field, hashes[i], 1) != nullptr)  // 1 - string_view
+        continue;
+
+      auto [newkey, sdsval_tag] = CreateEntry(field, value, time_now(), ttl_sec);
+      AddUnique(newkey, sdsval_tag & kValTtlBit, hashes[i]);
+      ++res;
+    } else {
+      auto [newkey, sdsval_tag] = CreateEntry(field, value, time_now(), ttl_sec);
+      sds prev_entry = (sds)AddOrReplaceObj(newkey, sdsval_tag & kValTtlBit, hashes[i]);
+      if (prev_entry)
+        ObjDelete(prev_entry, false);
+      else
+        ++res;
+    }
+  }
+
+  return res;
+}
+
 bool StringMap::Erase(string_view key) {
   return EraseInternal(&key, 1);
 }
@@ -221,6 +266,27 @@ pair<sds, bool> StringMap::ReallocIfNeeded(void* obj, float ratio) {
   return {new_key, true};
 }
 
+sds StringMap::SetExpiryTime(sds key, uint32_t ttl_sec) {
+  size_t key_len = sdslen(key);
+  uint64_t value_tag = absl::little_endian::Load64(key + key_len + 1);
+
+  // Entries that lost their expiry keep the room for it, as the ttl bit of the value tag tells.
+  if ((value_tag & kValTtlBit) == 0) {
+    sds new_key = AllocSdsWithSpace(key_len, 8 + 4);
+    memcpy(new_key, key, key_len + 1 /* \0 */);
+    absl::little_endian::Store64(new_key + key_len + 1, value_tag | kValTtlBit);
+
+    IncreaseMallocUsed(zmalloc_usable_size(sdsAllocPtr(new_key)));
+    DecreaseMallocUsed(zmalloc_usable_size(sdsAllocPtr(key)));
+    sdsfree(key);
+    key = new_key;
+  }
+
+  absl::little_endian::Store32(key + key_len + 1 + 8, time_now() + ttl_sec);
+  expiration_used_ = true;
+  return key;
+}
+
 uint64_t StringMap::Hash(const void* obj, uint32_t cookie) const {
   DCHECK_LT(cookie, 2u);
 
@@ -300,4 +366,23 @@ bool StringMap::iterator::ReallocIfNeeded(float ratio) {
   return realloced;
 }
 
+void StringMap::iterator::SetExpiryTime(uint32_t ttl_sec) {
+  // The ttl bit is kept by the pointer to the entry, while links hold the object.
+  auto* ptr = curr_entry_;
+  while (ptr->IsLink())
+    ptr = ptr->AsLink();
+
+  sds key = static_cast<StringMap*>(owner_)->SetExpiryTime((sds)ptr->GetObject(), ttl_sec);
+  ptr->SetObject(key);
+  curr_entry_->SetTtl(true);
+}
+
+bool StringMap::iterator::ClearExpiryTime() {
+  if (!curr_entry_->HasTtl())
+    return false;
+
+  curr_entry_->SetTtl(false);
+  return true;
+}
+
 }  // namespace dfly
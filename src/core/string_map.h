@@ -7,6 +7,8 @@
 #include <optional>
 #include <string_view>
 
+#include <absl/types/span.h>
+
 #include "core/dense_set.h"
 
 extern "C" {
@@ -70,6 +72,12 @@ class StringMap : public DenseSet {
     // re-allocation happened.
     bool ReallocIfNeeded(float ratio);
 
+    // Sets the field to expire ttl_sec after the current time of the map.
+    void SetExpiryTime(uint32_t ttl_sec);
+
+    // Removes the expiry of the field. Returns false if the field had no expiry.
+    bool ClearExpiryTime();
+
     iterator& operator++() {
       Advance();
       return *this;
@@ -110,6 +118,12 @@ class StringMap : public DenseSet {
   // false, if already exists. In that case no update is done.
   bool AddOrSkip(std::string_view field, std::string_view value, uint32_t ttl_sec = UINT32_MAX);
 
+  // Adds field/value pairs laid out as field1, value1, field2, value2, ...
+  // Existing fields are updated unless keep_existing is set, in which case they are skipped.
+  // Returns the number of fields that were added.
+  unsigned AddMany(absl::Span<const std::string_view> field_values, uint32_t ttl_sec,
+                   bool keep_existing);
+
   bool Erase(std::string_view s1);
 
   bool Contains(std::string_view s1) const;
@@ -153,6 +167,10 @@ class StringMap : public DenseSet {
   // Returns new pointer (stays same if key utilization is enough) and if reallocation happened.
   std::pair<sds, bool> ReallocIfNeeded(void* obj, float ratio);
 
+  // Stores the absolute expiry time in the entry, growing the key if it has no room for it.
+  // Returns the new pointer of the entry.
+  sds SetExpiryTime(sds key, uint32_t ttl_sec);
+
   uint64_t Hash(const void* obj, uint32_t cookie) const final;
   bool ObjEqual(const void* left, const void* right, uint32_t right_cookie) const final;
   size_t ObjectAllocSize(const void* obj) const final;
@@ -6,7 +6,6 @@
 
 #include <absl/strings/match.h>
 #include <absl/strings/str_cat.h>
-#include <gtest/gtest.h>
 #include <mimalloc.h>
 
 #include <algorithm>
@@ -18,6 +17,8 @@
 #include <unordered_set>
 #include <vector>
 
+#include "base/gtest.h"
+#include "base/init.h"
 #include "core/compact_object.h"
 #include "core/mi_memory_resource.h"
 #include "glog/logging.h"
@@ -118,6 +119,52 @@ TEST_F(StringMapTest, Ttl) {
   EXPECT_TRUE(it == sm_->end());
 }
 
+TEST_F(StringMapTest, SetExpiryTime) {
+  for (unsigned i = 0; i < 100; ++i)
+    EXPECT_TRUE(sm_->AddOrUpdate(absl::StrCat("f", i), absl::StrCat("v", i)));
+
+  sm_->set_time(1);
+  for (unsigned i = 0; i < 100; i += 2) {
+    auto it = sm_->Find(absl::StrCat("f", i));
+    ASSERT_FALSE(it.HasExpiry());
+    it.SetExpiryTime(2);
+    EXPECT_EQ(3u, it.ExpiryTime());
+  }
+
+  auto it = sm_->Find("f0");
+  EXPECT_TRUE(it.ClearExpiryTime());
+  EXPECT_FALSE(it.HasExpiry());
+  EXPECT_FALSE(it.ClearExpiryTime());
+  EXPECT_STREQ("v0", it->second);
+
+  sm_->set_time(3);
+  EXPECT_EQ(51u, sm_->SizeSlow());
+  EXPECT_TRUE(sm_->Contains("f0"));
+  EXPECT_FALSE(sm_->Contains("f2"));
+  EXPECT_STREQ("v1", sm_->Find("f1")->second);
+
+  // The entry kept the room for its expiry
+  it = sm_->Find("f0");
+  it.SetExpiryTime(1);
+  EXPECT_EQ(4u, it.ExpiryTime());
+  EXPECT_STREQ("v0", it->second);
+}
+
+TEST_F(StringMapTest, AddMany) {
+  EXPECT_TRUE(sm_->AddOrUpdate("foo", "bar"));
+
+  vector<string_view> kv = {"foo", "bar2", "k1", "v1", "k2", "v2", "k1", "v3"};
+  EXPECT_EQ(2u, sm_->AddMany(absl::MakeSpan(kv), UINT32_MAX, true));
+  EXPECT_EQ(3u, sm_->UpperBoundSize());
+  EXPECT_STREQ("bar", sm_->Find("foo")->second);
+  EXPECT_STREQ("v1", sm_->Find("k1")->second);
+
+  EXPECT_EQ(0u, sm_->AddMany(absl::MakeSpan(kv), UINT32_MAX, false));
+  EXPECT_STREQ("bar2", sm_->Find("foo")->second);
+  EXPECT_STREQ("v3", sm_->Find("k1")->second);
+  EXPECT_STREQ("v2", sm_->Find("k2")->second);
+}
+
 TEST_F(StringMapTest, IterateExpired) {
   EXPECT_TRUE(sm_->AddOrUpdate("k1", "v1", 1));
   EXPECT_TRUE(sm_->AddOrUpdate("k2", "v2", 1));
@@ -173,4 +220,71 @@ TEST_F(StringMapTest, ReallocIfNeeded) {
     EXPECT_EQ(sm_->Find(build_str(i * 10))->second, build_str(i * 10 + 1));
 }
 
+static vector<string> GenerateFields(unsigned count) {
+  vector<string> fields(count);
+  for (unsigned i = 0; i < count; ++i) {
+    fields[i] = StrCat("field:", i);
+  }
+  return fields;
+}
+
+static void BM_StringMapAdd(benchmark::State& state) {
+  unsigned count = state.range(0);
+  vector<string> fields = GenerateFields(count);
+  MiMemoryResource mr(mi_heap_get_backing());
+
+  while (state.KeepRunning()) {
+    StringMap sm(&mr);
+    for (const string& f : fields) {
+      sm.AddOrUpdate(f, "value");
+    }
+  }
+}
+BENCHMARK(BM_StringMapAdd)->Arg(1024)->Arg(1 << 16);
+
+static void BM_StringMapFind(benchmark::State& state) {
+  unsigned count = state.range(0);
+  vector<string> fields = GenerateFields(count);
+  MiMemoryResource mr(mi_heap_get_backing());
+  StringMap sm(&mr);
+  for (const string& f : fields) {
+    sm.AddOrUpdate(f, "value");
+  }
+
+  unsigned i = 0;
+  while (state.KeepRunningBatch(10)) {
+    for (unsigned j = 0; j < 10; ++j) {
+      benchmark::DoNotOptimize(sm.Find(fields[i]));
+      if (++i == fields.size())
+        i = 0;
+    }
+  }
+}
+BENCHMARK(BM_StringMapFind)->Arg(1024)->Arg(1 << 16)->Arg(1 << 20);
+
+// A full HSCAN of the map.
+static void BM_StringMapScan(benchmark::State& state) {
+  unsigned count = state.range(0);
+  vector<string> fields = GenerateFields(count);
+  MiMemoryResource mr(mi_heap_get_backing());
+  StringMap sm(&mr);
+  for (const string& f : fields) {
+    sm.AddOrUpdate(f, "value");
+  }
+
+  while (state.KeepRunning()) {
+    uint32_t cursor = 0;
+    do {
+      cursor = sm.Scan(cursor, [](const void* obj) { benchmark::DoNotOptimize(obj); });
+    } while (cursor);
+  }
+}
+BENCHMARK(BM_StringMapScan)->Arg(1024)->Arg(1 << 16);
+
+void RegisterStringMapBench() {
+  init_zmalloc_threadlocal(mi_heap_get_backing());
+}
+
+REGISTER_MODULE_INITIALIZER(StringMapBench, RegisterStringMapBench());
+
 }  // namespace dfly
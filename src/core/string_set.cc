@@ -4,6 +4,8 @@
 
 #include "core/string_set.h"
 
+#include <absl/container/inlined_vector.h>
+
 #include "core/compact_object.h"
 #include "core/sds_utils.h"
 
@@ -39,58 +41,118 @@ StringSet::~StringSet() {
 }
 
 bool StringSet::AddSds(sds s1) {
-  return AddOrFindObj(s1, false) == nullptr;
+  void* obj = s1;
+  if (sdslen(s1) <= kMaxInlineLen) {
+    obj = MakeMember({s1, sdslen(s1)}, UINT32_MAX);
+    sdsfree(s1);
+  }
+
+  if (AddOrFindObj(obj, false) != nullptr) {
+    ObjDelete(obj, false);
+    return false;
+  }
+  return true;
 }
 
 bool StringSet::Add(string_view src, uint32_t ttl_sec) {
   DCHECK_GT(ttl_sec, 0u);  // ttl_sec == 0 would mean find and delete immediately
 
-  sds newsds = nullptr;
-  bool has_ttl = false;
+  void* obj = MakeMember(src, ttl_sec);
+  if (AddOrFindObj(obj, ttl_sec != UINT32_MAX) != nullptr) {
+    ObjDelete(obj, ttl_sec != UINT32_MAX);
+    return false;
+  }
 
-  if (ttl_sec == UINT32_MAX) {
-    newsds = sdsnewlen(src.data(), src.size());
-  } else {
-    uint32_t at = time_now() + ttl_sec;
-    DCHECK_LT(time_now(), at);
-
-    newsds = AllocImmutableWithTtl(src.size(), at);
-    if (!src.empty())
-      memcpy(newsds, src.data(), src.size());
-    has_ttl = true;
+  return true;
+}
+
+unsigned StringSet::AddMany(absl::Span<const std::string_view> span, uint32_t ttl_sec) {
+  DCHECK_GT(ttl_sec, 0u);
+
+  // Reserve for the whole batch so that the table is not rehashed while being filled.
+  Reserve(UpperBoundSize() + span.size());
+
+  absl::InlinedVector<uint64_t, 32> hashes(span.size());
+  for (size_t i = 0; i < span.size(); ++i) {
+    hashes[i] = Hash(&span[i], 1);
+    if (i < kBulkPrefetchDistance)
+      PrefetchBucket(hashes[i]);
   }
 
-  if (AddOrFindObj(newsds, has_ttl) != nullptr) {
-    sdsfree(newsds);
-    return false;
+  unsigned res = 0;
+  for (size_t i = 0; i < span.size(); ++i) {
+    if (i + kBulkPrefetchDistance < span.size())
+      PrefetchBucket(hashes[i + kBulkPrefetchDistance]);
+
+    // 1 - string_view
+    if (FindInternal(&span[i], hashes[i], 1) != nullptr)
+      continue;
+
+    AddUnique(MakeMember(span[i], ttl_sec), ttl_sec != UINT32_MAX, hashes[i]);
+    ++res;
   }
 
-  return true;
+  return res;
+}
+
+string_view StringSet::MemberView(const void* obj, char* buf) {
+  if (IsInline(obj)) {
+    uint64_t val = uint64_t(obj);
+    size_t len = InlineLen(obj);
+    memcpy(buf, &val, len);
+    return {buf, len};
+  }
+
+  sds s = (sds)obj;
+  return {s, sdslen(s)};
+}
+
+void* StringSet::MakeMember(string_view src, uint32_t ttl_sec) const {
+  if (ttl_sec == UINT32_MAX) {
+    if (src.size() <= kMaxInlineLen) {
+      uint64_t val = 0;
+      memcpy(&val, src.data(), src.size());
+      return (void*)(val | (uint64_t(src.size()) << kInlineLenShift) | kInlineBit);
+    }
+    return sdsnewlen(src.data(), src.size());
+  }
+
+  uint32_t at = time_now() + ttl_sec;
+  DCHECK_LT(time_now(), at);
+
+  sds newsds = AllocImmutableWithTtl(src.size(), at);
+  if (!src.empty())
+    memcpy(newsds, src.data(), src.size());
+  return newsds;
 }
 
 std::optional<std::string> StringSet::Pop() {
-  sds str = (sds)PopInternal();
+  void* obj = PopInternal();
 
-  if (str == nullptr) {
+  if (obj == nullptr) {
     return std::nullopt;
   }
 
-  std::string ret{str, sdslen(str)};
-  sdsfree(str);
+  char buf[kMaxInlineLen];
+  std::string ret{MemberView(obj, buf)};
+  ObjDelete(obj, false);
 
   return ret;
 }
 
-uint32_t StringSet::Scan(uint32_t cursor, const std::function<void(const sds)>& func) const {
-  return DenseSet::Scan(cursor, [func](const void* ptr) { func((sds)ptr); });
+uint32_t StringSet::Scan(uint32_t cursor, const std::function<void(string_view)>& func) const {
+  return DenseSet::Scan(cursor, [func](const void* ptr) {
+    char buf[kMaxInlineLen];
+    func(MemberView(ptr, buf));
+  });
 }
 
 uint64_t StringSet::Hash(const void* ptr, uint32_t cookie) const {
   DCHECK_LT(cookie, 2u);
 
   if (cookie == 0) {
-    sds s = (sds)ptr;
-    return CompactObj::HashCode(string_view{s, sdslen(s)});
+    char buf[kMaxInlineLen];
+    return CompactObj::HashCode(MemberView(ptr, buf));
   }
 
   const string_view* sv = (const string_view*)ptr;
@@ -100,28 +162,30 @@ uint64_t StringSet::Hash(const void* ptr, uint32_t cookie) const {
 bool StringSet::ObjEqual(const void* left, const void* right, uint32_t right_cookie) const {
   DCHECK_LT(right_cookie, 2u);
 
-  sds s1 = (sds)left;
+  char left_buf[kMaxInlineLen];
+  string_view left_sv = MemberView(left, left_buf);
 
   if (right_cookie == 0) {
-    sds s2 = (sds)right;
+    // A member is inline if and only if it is short enough and has no expiry.
+    if (IsInline(left) && IsInline(right))
+      return left == right;
 
-    if (sdslen(s1) != sdslen(s2)) {
-      return false;
-    }
-
-    return sdslen(s1) == 0 || memcmp(s1, s2, sdslen(s1)) == 0;
+    char right_buf[kMaxInlineLen];
+    return left_sv == MemberView(right, right_buf);
   }
 
   const string_view* right_sv = (const string_view*)right;
-  string_view left_sv{s1, sdslen(s1)};
   return left_sv == (*right_sv);
 }
 
 size_t StringSet::ObjectAllocSize(const void* s1) const {
+  if (IsInline(s1))
+    return 0;
   return zmalloc_usable_size(sdsAllocPtr((sds)s1));
 }
 
 uint32_t StringSet::ObjExpireTime(const void* str) const {
+  DCHECK(!IsInline(str));
   sds s = (sds)str;
   DCHECK(MayHaveTtl(s));
 
@@ -130,7 +194,30 @@ uint32_t StringSet::ObjExpireTime(const void* str) const {
 }
 
 void StringSet::ObjDelete(void* obj, bool has_ttl) const {
-  sdsfree((sds)obj);
+  if (!IsInline(obj))
+    sdsfree((sds)obj);
+}
+
+bool StringSet::iterator::ReallocIfNeeded(float ratio) {
+  // Unwrap all links to correctly call SetObject()
+  auto* ptr = curr_entry_;
+  while (ptr->IsLink())
+    ptr = ptr->AsLink();
+
+  if (IsInline(ptr->GetObject()))
+    return false;
+
+  sds s = (sds)ptr->GetObject();
+  if (!zmalloc_page_is_underutilized(s, ratio))
+    return false;
+
+  size_t len = sdslen(s);
+  uint32_t space = curr_entry_->HasTtl() ? 4 : 0;  // optional expiry
+  sds new_s = AllocSdsWithSpace(len, space);
+  memcpy(new_s, s, len + 1 /* \0 */ + space);
+  ptr->SetObject(new_s);
+  sdsfree(s);
+  return true;
 }
 
 }  // namespace dfly
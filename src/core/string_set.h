@@ -10,6 +10,8 @@
 #include <string>
 #include <string_view>
 
+#include <absl/types/span.h>
+
 #include "core/dense_set.h"
 
 extern "C" {
@@ -18,6 +20,9 @@ extern "C" {
 
 namespace dfly {
 
+// Members of up to kMaxInlineLen bytes without expiry are stored in the object pointer instead
+// of an sds, so sets of small ids do not allocate their members. The iterators and the scans
+// return the members as string views.
 class StringSet : public DenseSet {
  public:
   StringSet(MemoryResource* res = PMR_NS::get_default_resource()) : DenseSet(res) {
@@ -28,6 +33,10 @@ class StringSet : public DenseSet {
   // Returns true if elem was added.
   bool Add(std::string_view s1, uint32_t ttl_sec = UINT32_MAX);
 
+  // Adds all the elements of span and returns the number of elements that were added.
+  // Faster than adding the elements one by one: the table is grown once for the whole batch.
+  unsigned AddMany(absl::Span<const std::string_view> span, uint32_t ttl_sec = UINT32_MAX);
+
   // Used currently by rdb_load. Returns true if elem was added.
   bool AddSds(sds elem);
 
@@ -48,9 +57,9 @@ class StringSet : public DenseSet {
   class iterator : private IteratorBase {
    public:
     using iterator_category = std::forward_iterator_tag;
-    using value_type = sds;
-    using pointer = sds*;
-    using reference = sds&;
+    using value_type = std::string_view;
+    using pointer = std::string_view*;
+    using reference = std::string_view&;
 
     explicit iterator(const IteratorBase& o) : IteratorBase(o) {
     }
@@ -77,13 +86,22 @@ class StringSet : public DenseSet {
       return !(*this == b);
     }
 
-    value_type operator*() {
-      return (value_type)curr_entry_->GetObject();
+    // Inline members point into the entry of the set, the views stay valid until the set is
+    // modified.
+    value_type operator*() const {
+      const auto* entry = curr_entry_;
+      while (entry->IsLink())
+        entry = entry->AsLink();
+
+      void* obj = entry->GetObject();
+      if (IsInline(obj))
+        return {reinterpret_cast<const char*>(entry), InlineLen(obj)};
+      return {static_cast<sds>(obj), sdslen(static_cast<sds>(obj))};
     }
 
-    value_type operator->() {
-      return (value_type)curr_entry_->GetObject();
-    }
+    // Try reducing memory fragmentation of the member by re-allocating. Returns true if
+    // re-allocation happened.
+    bool ReallocIfNeeded(float ratio);
 
     using IteratorBase::ExpiryTime;
     using IteratorBase::HasExpiry;
@@ -97,7 +115,7 @@ class StringSet : public DenseSet {
     return iterator{};
   }
 
-  uint32_t Scan(uint32_t, const std::function<void(sds)>&) const;
+  uint32_t Scan(uint32_t, const std::function<void(std::string_view)>&) const;
   iterator Find(std::string_view member) {
     return iterator{FindIt(&member, 1)};
   }
@@ -110,6 +128,29 @@ class StringSet : public DenseSet {
   size_t ObjectAllocSize(const void* s1) const override;
   uint32_t ObjExpireTime(const void* obj) const override;
   void ObjDelete(void* obj, bool has_ttl) const override;
+
+ private:
+  // An inline member has the top bit of the pointer set, its length in bits 48-50 and its bytes
+  // in the low bytes. DenseSet tags the pointers with bits 51-62 only, which keeps them intact.
+  static constexpr size_t kMaxInlineLen = 6;
+  static constexpr uint64_t kInlineBit = 1ULL << 63;
+  static constexpr unsigned kInlineLenShift = 48;
+  static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__);
+
+  static bool IsInline(const void* obj) {
+    return (uint64_t(obj) & kInlineBit) != 0;
+  }
+
+  static size_t InlineLen(const void* obj) {
+    return (uint64_t(obj) >> kInlineLenShift) & 7;
+  }
+
+  // Returns the member of obj. Inline members are copied into buf of kMaxInlineLen bytes.
+  static std::string_view MemberView(const void* obj, char* buf);
+
+  // Returns the inline member for src if it fits, or allocates the sds entry for it, with the
+  // expiry time appended if ttl_sec is set.
+  void* MakeMember(std::string_view src, uint32_t ttl_sec) const;
 };
 
 }  // end namespace dfly
@@ -132,6 +132,25 @@ static string random_string(mt19937& rand, unsigned len) {
   return ret;
 }
 
+TEST_F(StringSetTest, ClearStep) {
+  mt19937 generator(0);
+  constexpr size_t num_strs = 10000;
+  for (size_t i = 0; i < num_strs; ++i) {
+    ss_->Add(random_string(generator, 20));
+  }
+  size_t size = ss_->UpperBoundSize();
+
+  size_t deleted = 0;
+  while (size_t res = ss_->ClearStep(1000)) {
+    EXPECT_LE(res, 1000u);
+    deleted += res;
+    EXPECT_EQ(size - deleted, ss_->UpperBoundSize());
+  }
+  EXPECT_EQ(size, deleted);
+  EXPECT_TRUE(ss_->Empty());
+  EXPECT_EQ(0u, ss_->ObjMallocUsed());
+}
+
 TEST_F(StringSetTest, Resizing) {
   constexpr size_t num_strs = 4096;
   // pseudo random deterministic sequence with known seed should produce
@@ -172,11 +191,9 @@ TEST_F(StringSetTest, SimpleScan) {
 
   uint32_t cursor = 0;
   do {
-    cursor = ss_->Scan(cursor, [&](const sds ptr) {
-      sds s = (sds)ptr;
-      string_view str{s, sdslen(s)};
-      EXPECT_TRUE(info.count(str));
-      seen.insert(str);
+    cursor = ss_->Scan(cursor, [&](string_view str) {
+      ASSERT_TRUE(info.count(str));
+      seen.insert(*info.find(str));  // str may point into a temporary buffer.
     });
   } while (cursor != 0);
 
@@ -191,13 +208,11 @@ TEST_F(StringSetTest, ScanGuarantees) {
                                            "AAAAAAAAA@@@@@@@", "AAAAAAAAAA@@@@@@"};
   unordered_set<string_view> seen;
 
-  auto scan_callback = [&](const sds ptr) {
-    sds s = (sds)ptr;
-    string_view str{s, sdslen(s)};
+  auto scan_callback = [&](string_view str) {
     EXPECT_TRUE(to_be_seen.count(str) || maybe_seen.count(str));
     EXPECT_FALSE(not_be_seen.count(str));
     if (to_be_seen.count(str)) {
-      seen.insert(str);
+      seen.insert(*to_be_seen.find(str));
     }
   };
 
@@ -261,8 +276,8 @@ TEST_F(StringSetTest, IntOnly) {
   }
 
   size_t expected_seen = 0;
-  auto scan_callback = [&](const sds ptr) {
-    string str{ptr, sdslen(ptr)};
+  auto scan_callback = [&](string_view sv) {
+    string str{sv};
     EXPECT_FALSE(removed.count(str));
 
     if (numbers.count(atoi(str.data()))) {
@@ -304,9 +319,7 @@ TEST_F(StringSetTest, XtremeScanGrow) {
     EXPECT_TRUE(ss_->Add(str));
   }
 
-  auto scan_callback = [&](const sds ptr) {
-    sds s = (sds)ptr;
-    string_view str{s, sdslen(s)};
+  auto scan_callback = [&](string_view str) {
     if (to_see.count(string(str))) {
       seen.insert(string(str));
     }
@@ -358,8 +371,8 @@ TEST_F(StringSetTest, Pop) {
 
 TEST_F(StringSetTest, Iteration) {
   ss_->Add("foo");
-  for (const sds ptr : *ss_) {
-    LOG(INFO) << ptr;
+  for (string_view str : *ss_) {
+    LOG(INFO) << str;
   }
   ss_->Clear();
   constexpr size_t num_items = 8192;
@@ -377,8 +390,8 @@ TEST_F(StringSetTest, Iteration) {
     EXPECT_TRUE(ss_->Add(str));
   }
 
-  for (const sds ptr : *ss_) {
-    string str{ptr, sdslen(ptr)};
+  for (string_view sv : *ss_) {
+    string str{sv};
     EXPECT_TRUE(to_insert.count(str));
     to_insert.erase(str);
   }
@@ -401,7 +414,7 @@ TEST_F(StringSetTest, Ttl) {
   }
   EXPECT_EQ(101u, ss_->UpperBoundSize());
   it = ss_->Find("foo50");
-  EXPECT_STREQ("foo50", *it);
+  EXPECT_EQ("foo50", *it);
   EXPECT_EQ(2u, it.ExpiryTime());
 
   ss_->set_time(2);
@@ -413,7 +426,7 @@ TEST_F(StringSetTest, Ttl) {
 
   for (auto it = ss_->begin(); it != ss_->end(); ++it) {
     ASSERT_TRUE(absl::StartsWith(*it, "bar")) << *it;
-    string str = *it;
+    string str{*it};
     VLOG(1) << *it;
   }
 }
@@ -448,6 +461,157 @@ TEST_F(StringSetTest, Reserve) {
   }
 }
 
+TEST_F(StringSetTest, IncrementalGrow) {
+  vector<string> strs;
+
+  // Fill the table until it starts growing incrementally.
+  while (!ss_->IsRehashing()) {
+    strs.push_back(StrCat("key", strs.size()));
+    ASSERT_TRUE(ss_->Add(strs.back()));
+  }
+
+  // Lookups see both the migrated and not yet migrated entries.
+  for (const auto& s : strs) {
+    ASSERT_TRUE(ss_->Contains(s));
+  }
+
+  // Scanning while rehashing covers all the entries.
+  unordered_set<string> seen;
+  uint32_t cursor = 0;
+  do {
+    cursor = ss_->Scan(cursor, [&](string_view s) { seen.emplace(s); });
+  } while (cursor != 0);
+  EXPECT_EQ(strs.size(), seen.size());
+
+  size_t first_batch = strs.size();
+  for (size_t i = 0; i < first_batch; i += 2) {
+    ASSERT_TRUE(ss_->Erase(strs[i]));
+  }
+
+  while (ss_->IsRehashing()) {
+    strs.push_back(StrCat("key", strs.size()));
+    ASSERT_TRUE(ss_->Add(strs.back()));
+  }
+
+  size_t expected = 0;
+  for (size_t i = 0; i < strs.size(); ++i) {
+    bool erased = i < first_batch && i % 2 == 0;
+    ASSERT_EQ(!erased, ss_->Contains(strs[i])) << i;
+    expected += !erased;
+  }
+  EXPECT_EQ(expected, ss_->UpperBoundSize());
+
+  // Start another growth and check that iteration and Pop see all the entries.
+  while (!ss_->IsRehashing()) {
+    strs.push_back(StrCat("key", strs.size()));
+    ASSERT_TRUE(ss_->Add(strs.back()));
+    ++expected;
+  }
+
+  size_t iterated = 0;
+  for (string_view s : *ss_) {
+    (void)s;
+    ++iterated;
+  }
+  EXPECT_EQ(expected, iterated);
+
+  size_t popped = 0;
+  while (ss_->Pop()) {
+    ++popped;
+  }
+  EXPECT_EQ(expected, popped);
+  EXPECT_TRUE(ss_->Empty());
+}
+
+TEST_F(StringSetTest, ReadsDoNotMigrate) {
+  vector<string> strs;
+  while (!ss_->IsRehashing()) {
+    strs.push_back(StrCat("key", strs.size()));
+    ASSERT_TRUE(ss_->Add(strs.back()));
+  }
+
+  size_t set_malloc_used = ss_->SetMallocUsed();
+  size_t obj_malloc_used = ss_->ObjMallocUsed();
+  size_t used_buckets = ss_->NumUsedBuckets();
+
+  for (const auto& s : strs) {
+    ASSERT_TRUE(ss_->Contains(s));
+    ASSERT_TRUE(ss_->Find(s) != ss_->end());
+  }
+
+  unordered_set<string> seen;
+  uint32_t cursor = 0;
+  do {
+    cursor = ss_->Scan(cursor, [&](string_view s) { ASSERT_TRUE(seen.emplace(s).second); });
+  } while (cursor != 0);
+  EXPECT_EQ(strs.size(), seen.size());
+
+  seen.clear();
+  for (string_view s : *ss_) {
+    ASSERT_TRUE(seen.emplace(s).second);
+  }
+  EXPECT_EQ(strs.size(), seen.size());
+
+  // None of the reads above moved entries between the bucket arrays.
+  EXPECT_TRUE(ss_->IsRehashing());
+  EXPECT_EQ(set_malloc_used, ss_->SetMallocUsed());
+  EXPECT_EQ(obj_malloc_used, ss_->ObjMallocUsed());
+  EXPECT_EQ(used_buckets, ss_->NumUsedBuckets());
+}
+
+TEST_F(StringSetTest, AddMany) {
+  vector<string> strs;
+  mt19937 generator(0);
+
+  for (size_t i = 0; i < 100; ++i) {
+    strs.push_back(random_string(generator, 10));
+  }
+  ASSERT_TRUE(ss_->Add(strs[0]));
+
+  // Duplicates within the batch and with the existing elements are skipped.
+  vector<string_view> batch(strs.begin(), strs.end());
+  batch.push_back(strs[1]);
+  EXPECT_EQ(99u, ss_->AddMany(absl::MakeSpan(batch)));
+  EXPECT_EQ(100u, ss_->UpperBoundSize());
+  for (const auto& s : strs) {
+    ASSERT_TRUE(ss_->Contains(s));
+  }
+
+  EXPECT_EQ(0u, ss_->AddMany(absl::MakeSpan(batch)));
+
+  vector<string_view> ttl_batch = {"a", "b"};
+  EXPECT_EQ(2u, ss_->AddMany(absl::MakeSpan(ttl_batch), 1));
+  ss_->set_time(1);
+  EXPECT_FALSE(ss_->Contains("a"));
+  EXPECT_EQ(2u, ss_->AddMany(absl::MakeSpan(ttl_batch)));
+}
+
+TEST_F(StringSetTest, ExpireStep) {
+  for (size_t i = 0; i < 1000; ++i) {
+    ASSERT_TRUE(ss_->Add(absl::StrCat("ttl", i), 1));
+    ASSERT_TRUE(ss_->Add(absl::StrCat("keep", i)));
+  }
+
+  DenseSet::ExpireStepResult res = ss_->ExpireStep(0, 16);
+  EXPECT_EQ(16u, res.visited);
+  EXPECT_EQ(2000u, ss_->UpperBoundSize());
+
+  ss_->set_time(1);
+  bool ttl_seen = false;
+  uint32_t cursor = 0;
+  do {
+    res = ss_->ExpireStep(cursor, 16);
+    cursor = res.cursor;
+    ttl_seen |= res.ttl_seen;
+  } while (cursor);
+
+  EXPECT_FALSE(ttl_seen);
+  EXPECT_EQ(1000u, ss_->UpperBoundSize());
+  for (size_t i = 0; i < 1000; ++i) {
+    ASSERT_TRUE(ss_->Contains(absl::StrCat("keep", i)));
+  }
+}
+
 TEST_F(StringSetTest, IterateEmpty) {
   for (const auto& s : *ss_) {
     // We're iterating to make sure there is no crash. However, if we got here, it's a bug
@@ -455,4 +619,46 @@ TEST_F(StringSetTest, IterateEmpty) {
   }
 }
 
+TEST_F(StringSetTest, InlineMembers) {
+  // Up to 6 bytes without expiry are stored inline.
+  vector<string> members = {"", "1", "42", "abcdef", string("a\0b", 3)};
+  for (size_t i = 0; i < 1000; ++i)
+    members.push_back(to_string(100000 + i));
+  for (const auto& m : members)
+    EXPECT_TRUE(ss_->Add(m));
+  EXPECT_EQ(0u, ss_->ObjMallocUsed());
+
+  EXPECT_TRUE(ss_->AddSds(sdsnew("abcdeg")));
+  EXPECT_FALSE(ss_->AddSds(sdsnew("abcdef")));
+  EXPECT_FALSE(ss_->Add("42", 10));
+  EXPECT_TRUE(ss_->Add("abcdefg"));
+  EXPECT_TRUE(ss_->Add("xy", 10));
+  EXPECT_GT(ss_->ObjMallocUsed(), 0u);
+  members.insert(members.end(), {"abcdeg", "abcdefg", "xy"});
+
+  for (const auto& m : members)
+    EXPECT_TRUE(ss_->Contains(m)) << m;
+  EXPECT_FALSE(ss_->Contains("4"));
+  EXPECT_FALSE(ss_->Contains("abcde"));
+  EXPECT_TRUE(ss_->Find("xy").HasExpiry());
+  EXPECT_FALSE(ss_->Find("42").HasExpiry());
+
+  unordered_set<string> seen;
+  for (string_view s : *ss_)
+    seen.emplace(s);
+  EXPECT_EQ(seen, unordered_set<string>(members.begin(), members.end()));
+
+  EXPECT_TRUE(ss_->Erase("42"));
+  EXPECT_FALSE(ss_->Contains("42"));
+  EXPECT_EQ(members.size() - 1, ss_->UpperBoundSize());
+
+  size_t popped = 0;
+  while (auto str = ss_->Pop()) {
+    EXPECT_NE("42", *str);
+    ++popped;
+  }
+  EXPECT_EQ(members.size() - 1, popped);
+  EXPECT_EQ(0u, ss_->ObjMallocUsed());
+}
+
 }  // namespace dfly
@@ -6,6 +6,7 @@
 
 #include <cstdint>
 #include <limits>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
@@ -19,9 +20,17 @@ enum class KeyOp : int8_t { READ, WRITE, READ_WRITE };
 
 using GlobType = std::pair<std::string, KeyOp>;
 
+// Scheduling class of the connections of a user, see CLIENT SETPRIORITY.
+enum class Priority : uint8_t { LOW, NORMAL, HIGH };
+
+class KeyMatcher;
+
 struct AclKeys {
   std::vector<GlobType> key_globs;
   bool all_keys = false;
+
+  // key_globs compiled for matching, shared by the copies of the keys.
+  std::shared_ptr<const KeyMatcher> matcher;
 };
 
 }  // namespace dfly::acl
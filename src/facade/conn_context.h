@@ -113,6 +113,8 @@ class ConnectionContext {
   bool skip_acl_validation = false;
   // keys
   dfly::acl::AclKeys keys{{}, true};
+  // Set from the ACL user on AUTH or by CLIENT SETPRIORITY.
+  dfly::acl::Priority priority = dfly::acl::Priority::NORMAL;
 
  private:
   Connection* owner_;
@@ -7,6 +7,7 @@
 #include <absl/container/flat_hash_map.h>
 #include <absl/strings/match.h>
 #include <mimalloc.h>
+#include <sys/ioctl.h>
 
 #include <numeric>
 #include <variant>
@@ -54,6 +55,12 @@ ABSL_FLAG(bool, no_tls_on_admin_port, false, "Allow non-tls connections on admin
 ABSL_FLAG(uint64_t, pipeline_squash, 10,
           "Number of queued pipelined commands above which squashing is enabled, 0 means disabled");
 
+ABSL_FLAG(uint32_t, pipeline_squash_latency_usec, 0,
+          "If positive, squashed pipeline batches are sized from the observed cost per command, "
+          "so that each batch replies within this many microseconds. Cheap commands are squashed "
+          "in larger batches, and long queues of expensive ones are flushed in parts. "
+          "0 squashes the whole queue at once");
+
 // When changing this constant, also update `test_large_cmd` test in connection_test.py.
 ABSL_FLAG(uint32_t, max_multi_bulk_len, 1u << 16,
           "Maximum multi-bulk (array) length that is "
@@ -62,10 +69,15 @@ ABSL_FLAG(uint32_t, max_multi_bulk_len, 1u << 16,
 ABSL_FLAG(size_t, max_client_iobuf_len, 1u << 16,
           "Maximum io buffer length that is used to read client requests.");
 
+ABSL_FLAG(size_t, max_idle_iobuf_len, 1u << 12,
+          "Maximum io buffer length that a client connection keeps while it has no buffered "
+          "requests. Larger buffers are released until the next request arrives. "
+          "0 means buffers are never released.");
+
 ABSL_FLAG(bool, migrate_connections, true,
           "When enabled, Dragonfly will try to migrate connections to the target thread on which "
-          "they operate. Currently this is only supported for Lua script invocations, and can "
-          "happen at most once per connection.");
+          "they operate. Lua script invocations migrate at most once per connection, other "
+          "commands only with --migrate_affinity_window.");
 
 using namespace util;
 using nonstd::make_unexpected;
@@ -91,6 +103,13 @@ bool MatchHttp11Line(string_view line) {
   return absl::StartsWith(line, "GET ") && absl::EndsWith(line, "HTTP/1.1");
 }
 
+// True if the socket has no received bytes that are not read yet, i.e. the next Recv waits for
+// the client.
+bool RecvWouldBlock(util::FiberSocketBase* peer) {
+  int pending = 0;
+  return ioctl(peer->native_handle(), FIONREAD, &pending) == 0 && pending == 0;
+}
+
 void UpdateIoBufCapacity(const base::IoBuf& io_buf, ConnectionStats* stats,
                          absl::FunctionRef<void()> f) {
   const size_t prev_capacity = io_buf.Capacity();
@@ -229,6 +248,10 @@ constexpr size_t kMinReadSize = 256;
 
 thread_local uint32_t free_req_release_weight = 0;
 
+// Moving average of the time it takes to execute a squashed command on this thread, including
+// its shard hops. Shared by all connections of the thread, because they share the shards.
+thread_local uint64_t squashed_cmd_avg_ns = 0;
+
 const char* kPhaseName[Connection::NUM_PHASES] = {"SETUP", "READ", "PROCESS", "SHUTTING_DOWN",
                                                   "PRECLOSE"};
 
@@ -257,11 +280,29 @@ struct Connection::Shutdown {
 };
 
 Connection::PubMessage::PubMessage(string pattern, shared_ptr<char[]> buf, size_t channel_len,
-                                   size_t message_len)
+                                   size_t message_len, shared_ptr<const string> serialized)
     : pattern{std::move(pattern)},
       buf{std::move(buf)},
       channel_len{channel_len},
-      message_len{message_len} {
+      message_len{message_len},
+      serialized{std::move(serialized)} {
+}
+
+shared_ptr<const string> Connection::PubMessage::Serialize(string_view pattern,
+                                                           string_view channel,
+                                                           string_view message, bool sharded) {
+  auto res = make_shared<string>();
+  if (sharded) {
+    absl::StrAppend(res.get(), "3\r\n$8\r\nsmessage\r\n");
+  } else if (pattern.empty()) {
+    absl::StrAppend(res.get(), "3\r\n$7\r\nmessage\r\n");
+  } else {
+    absl::StrAppend(res.get(), "4\r\n$8\r\npmessage\r\n$", pattern.size(), "\r\n", pattern,
+                    "\r\n");
+  }
+  absl::StrAppend(res.get(), "$", channel.size(), "\r\n", channel, "\r\n$", message.size(),
+                  "\r\n", message, "\r\n");
+  return res;
 }
 
 string_view Connection::PubMessage::Channel() const {
@@ -284,6 +325,7 @@ struct Connection::DispatchOperations {
   void operator()(const MigrationRequestMessage& msg);
   void operator()(CheckpointMessage msg);
   void operator()(const InvalidationMessage& msg);
+  void operator()(const SUnsubscribeMessage& msg);
 
   template <typename T, typename D> void operator()(unique_ptr<T, D>& ptr) {
     operator()(*ptr.get());
@@ -353,7 +395,12 @@ size_t Connection::MessageHandle::UsedMemory() const {
       return 0;  // no access to internal type, memory usage negligible
     }
     size_t operator()(const InvalidationMessage& msg) {
-      return 0;
+      return std::accumulate(msg.keys.begin(), msg.keys.end(),
+                             msg.keys.capacity() * sizeof(std::string),
+                             [](size_t acc, auto& key) { return acc + key.capacity(); });
+    }
+    size_t operator()(const SUnsubscribeMessage& msg) {
+      return msg.channel.capacity();
     }
   };
 
@@ -374,7 +421,8 @@ bool Connection::MessageHandle::IsPubMsg() const {
 }
 
 bool Connection::MessageHandle::IsReplying() const {
-  return IsPipelineMsg() || IsPubMsg() || holds_alternative<MonitorMessage>(handle);
+  return IsPipelineMsg() || IsPubMsg() || holds_alternative<MonitorMessage>(handle) ||
+         holds_alternative<SUnsubscribeMessage>(handle);
 }
 
 void Connection::DispatchOperations::operator()(const MonitorMessage& msg) {
@@ -388,12 +436,19 @@ void Connection::DispatchOperations::operator()(const AclUpdateMessage& msg) {
       self->cntx()->acl_categories = msg.categories;
       self->cntx()->acl_commands = msg.commands;
       self->cntx()->keys = msg.keys;
+      self->cntx()->priority = msg.priority;
     }
   }
 }
 
 void Connection::DispatchOperations::operator()(const PubMessage& pub_msg) {
   RedisReplyBuilder* rbuilder = (RedisReplyBuilder*)builder;
+  if (pub_msg.serialized) {
+    string_view parts[] = {rbuilder->IsResp3() ? ">" : "*", *pub_msg.serialized};
+    rbuilder->SendRawVec(parts);
+    return;
+  }
+
   unsigned i = 0;
   array<string_view, 4> arr;
   if (pub_msg.pattern.empty()) {
@@ -434,12 +489,18 @@ void Connection::DispatchOperations::operator()(const InvalidationMessage& msg)
   rbuilder->SendBulkString("invalidate");
   if (msg.invalidate_due_to_flush) {
     rbuilder->SendNull();
+  } else if (!msg.keys.empty()) {
+    rbuilder->SendStringArr(absl::Span<const std::string>{msg.keys});
   } else {
     std::string_view keys[] = {msg.key};
     rbuilder->SendStringArr(keys);
   }
 }
 
+void Connection::DispatchOperations::operator()(const SUnsubscribeMessage& msg) {
+  self->service_->OnShardChannelMoved(self->cc_.get(), msg.channel);
+}
+
 Connection::Connection(Protocol protocol, util::HttpListenerBase* http_listener, SSL_CTX* ctx,
                        ServiceInterface* service)
     : io_buf_(kMinReadSize), http_listener_(http_listener), ctx_(ctx), service_(service), name_{} {
@@ -862,7 +923,7 @@ void Connection::DispatchCommand(uint32_t consumed, mi_heap_t* heap) {
       evc_.notify();
 
   } else {
-    SendAsync(MessageHandle{FromArgs(std::move(tmp_parse_args_), heap)});
+    SendAsync(MessageHandle{FromArgs(tmp_parse_args_, heap)});
     if (dispatch_q_.size() > 10)
       ThisFiber::Yield();
   }
@@ -1015,10 +1076,44 @@ auto Connection::IoLoop(util::FiberSocketBase* peer, SinkReplyBuilder* orig_buil
   ParserStatus parse_status = OK;
 
   size_t max_iobfuf_len = absl::GetFlag(FLAGS_max_client_iobuf_len);
+  size_t max_idle_len = absl::GetFlag(FLAGS_max_idle_iobuf_len);
 
   do {
     HandleMigrateRequest();
 
+    // Most connections are idle most of the time, so they give back the buffer grown for their
+    // largest request before waiting for the next one. The parser stashes partial requests,
+    // hence nothing references the buffer once its input is consumed. The buffer is kept while
+    // the client has more data in flight, and released at most once a second, so that clients
+    // that keep sending large requests do not shrink and regrow it on every request.
+    if (max_idle_len > 0 && io_buf_.InputLen() == 0 && io_buf_.Capacity() > max_idle_len &&
+        last_interaction_ > last_iobuf_shrink_ && RecvWouldBlock(peer)) {
+      UpdateIoBufCapacity(io_buf_, stats_, [&]() { io_buf_ = base::IoBuf{kMinReadSize}; });
+      last_iobuf_shrink_ = last_interaction_;
+    }
+
+    // The rest of a bulk string that does not fit into io_buf_ is read straight into the parser
+    // stash, instead of passing through io_buf_ and being copied.
+    if (redis_parser_ && io_buf_.InputLen() == 0) {
+      if (RespExpr::Buffer bulk_buf = redis_parser_->BulkAppendBuffer();
+          bulk_buf.size() >= io_buf_.Capacity()) {
+        phase_ = READ_SOCKET;
+
+        ::io::Result<size_t> recv_sz = peer->Recv(bulk_buf);
+        last_interaction_ = time(nullptr);
+        if (!recv_sz) {
+          ec = recv_sz.error();
+          parse_status = OK;
+          break;
+        }
+
+        redis_parser_->CommitBulk(*recv_sz);
+        stats_->io_read_bytes += *recv_sz;
+        ++stats_->io_read_cnt;
+        continue;
+      }
+    }
+
     io::MutableBytes append_buf = io_buf_.AppendBuffer();
     DCHECK(!append_buf.empty());
 
@@ -1122,11 +1217,12 @@ bool Connection::ShouldEndDispatchFiber(const MessageHandle& msg) {
   return false;
 }
 
-void Connection::SquashPipeline(facade::SinkReplyBuilder* builder) {
+void Connection::SquashPipeline(facade::SinkReplyBuilder* builder, size_t max_batch) {
   DCHECK_EQ(dispatch_q_.size(), pending_pipeline_cmd_cnt_);
 
+  size_t queued = dispatch_q_.size();
   vector<CmdArgList> squash_cmds;
-  squash_cmds.reserve(dispatch_q_.size());
+  squash_cmds.reserve(min(queued, max_batch));
 
   for (auto& msg : dispatch_q_) {
     CHECK(holds_alternative<PipelineMessagePtr>(msg.handle))
@@ -1134,13 +1230,25 @@ void Connection::SquashPipeline(facade::SinkReplyBuilder* builder) {
 
     auto& pmsg = get<PipelineMessagePtr>(msg.handle);
     squash_cmds.push_back(absl::MakeSpan(pmsg->args));
+    if (squash_cmds.size() == max_batch)
+      break;
   }
 
   cc_->async_dispatch = true;
 
+  uint64_t start_ns = absl::GetCurrentTimeNanos();
   size_t dispatched = service_->DispatchManyCommands(absl::MakeSpan(squash_cmds), cc_.get());
+  if (dispatched > 0) {
+    uint64_t cmd_ns = (absl::GetCurrentTimeNanos() - start_ns) / dispatched;
+    squashed_cmd_avg_ns =
+        squashed_cmd_avg_ns == 0 ? cmd_ns : (squashed_cmd_avg_ns * 7 + cmd_ns) / 8;
+  }
 
-  if (pending_pipeline_cmd_cnt_ == squash_cmds.size()) {  // Flush if no new commands appeared
+  // Flush if no new commands appeared. A partial batch flushes its replies as well, so that they
+  // are not held back by the rest of the queue.
+  if (squash_cmds.size() < queued) {
+    builder->FlushBatch();
+  } else if (pending_pipeline_cmd_cnt_ == squash_cmds.size()) {
     builder->FlushBatch();
     builder->SetBatchMode(false);  // in case the next dispatch is sync
   }
@@ -1212,6 +1320,7 @@ void Connection::DispatchFiber(util::FiberSocketBase* peer) {
   DispatchOperations dispatch_op{builder, this};
 
   size_t squashing_threshold = absl::GetFlag(FLAGS_pipeline_squash);
+  uint64_t squash_latency_ns = uint64_t(absl::GetFlag(FLAGS_pipeline_squash_latency_usec)) * 1000;
 
   uint64_t prev_epoch = fb2::FiberSwitchEpoch();
   while (!builder->GetError()) {
@@ -1246,7 +1355,14 @@ void Connection::DispatchFiber(util::FiberSocketBase* peer) {
     bool threshold_reached = pending_pipeline_cmd_cnt_ > squashing_threshold;
     bool are_all_plain_cmds = pending_pipeline_cmd_cnt_ == dispatch_q_.size();
     if (squashing_enabled && threshold_reached && are_all_plain_cmds && !skip_next_squashing_) {
-      SquashPipeline(builder);
+      // Without a latency target, or before the first measurement, we squash the whole queue.
+      // Batches never go below the threshold, as smaller ones are not worth squashing.
+      size_t max_batch = dispatch_q_.size();
+      if (squash_latency_ns > 0 && squashed_cmd_avg_ns > 0) {
+        max_batch = clamp<size_t>(squash_latency_ns / squashed_cmd_avg_ns, squashing_threshold + 1,
+                                  max_batch);
+      }
+      SquashPipeline(builder, max_batch);
     } else {
       MessageHandle msg = std::move(dispatch_q_.front());
       dispatch_q_.pop_front();
@@ -1271,13 +1387,18 @@ void Connection::DispatchFiber(util::FiberSocketBase* peer) {
     }
 
     queue_backpressure_->ec.notify();
+
+    // Low priority connections give way to the other fibers of the thread between the commands
+    // of their pipeline.
+    if (cc_->priority == dfly::acl::Priority::LOW && !dispatch_q_.empty())
+      ThisFiber::Yield();
   }
 
   DCHECK(cc_->conn_closing || builder->GetError());
   cc_->conn_closing = true;
 }
 
-Connection::PipelineMessagePtr Connection::FromArgs(RespVec args, mi_heap_t* heap) {
+Connection::PipelineMessagePtr Connection::FromArgs(const RespVec& args, mi_heap_t* heap) {
   DCHECK(!args.empty());
   size_t backed_sz = 0;
   for (const auto& arg : args) {
@@ -1399,6 +1520,10 @@ void Connection::SendInvalidationMessageAsync(InvalidationMessage msg) {
   SendAsync({std::move(msg)});
 }
 
+void Connection::SendSUnsubscribeAsync(SUnsubscribeMessage msg) {
+  SendAsync({std::move(msg)});
+}
+
 void Connection::LaunchDispatchFiberIfNeeded() {
   if (!dispatch_fb_.IsJoinable()) {
     dispatch_fb_ = fb2::Fiber(dfly::Launch::post, "connection_dispatch",
@@ -1511,13 +1636,12 @@ facade::ConnectionContext* Connection::cntx() {
   return cc_.get();
 }
 
-void Connection::RequestAsyncMigration(util::fb2::ProactorBase* dest) {
+void Connection::RequestAsyncMigration(util::fb2::ProactorBase* dest, bool once) {
   if (!migration_enabled_ || cc_ == nullptr) {
     return;
   }
 
-  // Connections can migrate at most once.
-  migration_enabled_ = false;
+  migration_enabled_ = !once;
   migration_request_ = dest;
 }
 
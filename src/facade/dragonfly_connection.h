@@ -71,11 +71,22 @@ class Connection : public util::Connection {
     std::shared_ptr<char[]> buf;      // stores channel name and message
     size_t channel_len, message_len;  // lengths in buf
 
+    // Reply shared by all the subscribers of a publish, serialized without the leading array
+    // symbol that differs between RESP2 and RESP3. Formatted on dispatch when empty.
+    std::shared_ptr<const std::string> serialized;
+
     std::string_view Channel() const;
     std::string_view Message() const;
 
     PubMessage(std::string pattern, std::shared_ptr<char[]> buf, size_t channel_len,
-               size_t message_len);
+               size_t message_len, std::shared_ptr<const std::string> serialized = {});
+
+    // Serializes the reply for the given pattern (empty for channel subscribers), as smessage
+    // for sharded channels.
+    static std::shared_ptr<const std::string> Serialize(std::string_view pattern,
+                                                        std::string_view channel,
+                                                        std::string_view message,
+                                                        bool sharded = false);
   };
 
   // Pipeline message, accumulated command to be executed.
@@ -106,6 +117,7 @@ class Connection : public util::Connection {
     uint32_t categories;
     std::vector<uint64_t> commands;
     dfly::acl::AclKeys keys;
+    dfly::acl::Priority priority;
   };
 
   // Migration request message, the dispatch fiber stops to give way for thread migration.
@@ -118,9 +130,15 @@ class Connection : public util::Connection {
 
   struct InvalidationMessage {
     std::string key;
+    std::vector<std::string> keys;  // batched keys of broadcast tracking, sent instead of key.
     bool invalidate_due_to_flush = false;
   };
 
+  // Unsubscribes the connection from a sharded channel whose slot moved to another node.
+  struct SUnsubscribeMessage {
+    std::string channel;
+  };
+
   struct MessageDeleter {
     void operator()(PipelineMessage* msg) const;
     void operator()(PubMessage* msg) const;
@@ -144,7 +162,8 @@ class Connection : public util::Connection {
     bool IsReplying() const;  // control messges don't reply, messages carrying data do
 
     std::variant<MonitorMessage, PubMessagePtr, PipelineMessagePtr, AclUpdateMessagePtr,
-                 MigrationRequestMessage, CheckpointMessage, InvalidationMessage>
+                 MigrationRequestMessage, CheckpointMessage, InvalidationMessage,
+                 SUnsubscribeMessage>
         handle;
 
     // time when the message was dispatched to the dispatch queue as reported by
@@ -212,6 +231,9 @@ class Connection : public util::Connection {
   // Add InvalidationMessage to dispatch queue.
   virtual void SendInvalidationMessageAsync(InvalidationMessage);
 
+  // Add SUnsubscribeMessage to dispatch queue.
+  virtual void SendSUnsubscribeAsync(SUnsubscribeMessage);
+
   // Must be called before sending pubsub messages to ensure the threads pipeline queue limit is not
   // reached. Blocks until free space is available. Controlled with `pipeline_queue_limit` flag.
   void EnsureAsyncMemoryBudget();
@@ -274,8 +296,9 @@ class Connection : public util::Connection {
   ConnectionContext* cntx();
 
   // Requests that at some point, this connection will be migrated to `dest` thread.
-  // Connections will migrate at most once, and only when the flag --migrate_connections is true.
-  void RequestAsyncMigration(util::fb2::ProactorBase* dest);
+  // Only when the flag --migrate_connections is true. With `once`, further requests are ignored
+  // afterwards, otherwise the caller is responsible for not bouncing the connection around.
+  void RequestAsyncMigration(util::fb2::ProactorBase* dest, bool once = true);
 
   void SetClientTrackingSwitch(bool is_on);
 
@@ -341,7 +364,8 @@ class Connection : public util::Connection {
   void RecycleMessage(MessageHandle msg);
 
   // Create new pipeline request, re-use from pool when possible.
-  PipelineMessagePtr FromArgs(RespVec args, mi_heap_t* heap);
+  // args is copied and not consumed, so the parser keeps reusing its buffer.
+  PipelineMessagePtr FromArgs(const RespVec& args, mi_heap_t* heap);
 
   ParserStatus ParseRedis(SinkReplyBuilder* orig_builder);
   ParserStatus ParseMemcache();
@@ -359,8 +383,9 @@ class Connection : public util::Connection {
 
   void LaunchDispatchFiberIfNeeded();  // Dispatch fiber is started lazily
 
-  // Squashes pipelined commands from the dispatch queue to spread load over all threads
-  void SquashPipeline(facade::SinkReplyBuilder*);
+  // Squashes up to max_batch pipelined commands from the dispatch queue to spread load over all
+  // threads.
+  void SquashPipeline(facade::SinkReplyBuilder*, size_t max_batch);
 
   // Clear pipelined messages, disaptching only intrusive ones.
   void ClearPipelinedMessages();
@@ -396,6 +421,7 @@ class Connection : public util::Connection {
   ServiceInterface* service_;
 
   time_t creation_time_, last_interaction_;
+  time_t last_iobuf_shrink_ = 0;  // when io_buf_ was last released while idle
 
   Phase phase_ = SETUP;
   std::string name_;
@@ -6,6 +6,10 @@
 
 #include <openssl/err.h>
 
+#ifdef __linux__
+#include <linux/filter.h>
+#endif
+
 #include <memory>
 
 #include "absl/functional/bind_front.h"
@@ -28,6 +32,10 @@ ABSL_FLAG(bool, tls, false, "");
 ABSL_FLAG(bool, conn_use_incoming_cpu, false,
           "If true uses incoming cpu of a socket in order to distribute"
           " incoming connections");
+ABSL_FLAG(bool, conn_reuseport, false,
+          "If true, listening sockets are opened with SO_REUSEPORT and every thread accepts "
+          "connections of the main port on its own socket. A new server process can also start "
+          "accepting on the same port while the old one is still draining");
 
 ABSL_FLAG(string, tls_cert_file, "", "cert file for tls connections");
 ABSL_FLAG(string, tls_key_file, "", "key file for tls connections");
@@ -195,6 +203,11 @@ error_code Listener::ConfigureServerSocket(int fd) {
   if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val)) < 0) {
     LOG(WARNING) << "Could not set reuse addr on socket " << SafeErrorMessage(errno);
   }
+
+  if (GetFlag(FLAGS_conn_reuseport) &&
+      setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &val, sizeof(val)) < 0) {
+    LOG(WARNING) << "Could not set reuse port on socket " << SafeErrorMessage(errno);
+  }
   bool success = ConfigureKeepAlive(fd);
 
 #ifdef __linux__
@@ -243,6 +256,53 @@ bool Listener::ReconfigureTLS() {
   return true;
 }
 
+void Listener::SetReusePortGroup(bool in_group) {
+  reuseport_group_ = in_group;
+}
+
+bool Listener::SteerReusePortGroup(absl::Span<Listener* const> group) {
+#ifdef __linux__
+  util::ProactorPool* pp = group.front()->pool();
+
+  // The index of a socket in the reuseport group is the order in which it started listening.
+  vector<int> group_index(pp->size(), -1);
+  for (unsigned i = 0; i < group.size(); ++i)
+    group_index[group[i]->socket()->proactor()->GetPoolIndex()] = i;
+
+  // For every cpu that runs a thread of the group, return the socket of that thread. The other
+  // cpus are spread over the group.
+  vector<sock_filter> code;
+  code.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU));
+  long num_cpus = sysconf(_SC_NPROCESSORS_CONF);
+  for (long cpu = 0; cpu < num_cpus; ++cpu) {
+    for (unsigned id : pp->MapCpuToThreads(cpu)) {
+      if (id < group_index.size() && group_index[id] >= 0) {
+        code.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, uint32_t(cpu), 0, 1));
+        code.push_back(BPF_STMT(BPF_RET | BPF_K, uint32_t(group_index[id])));
+        break;
+      }
+    }
+  }
+  code.push_back(BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, uint32_t(group.size())));
+  code.push_back(BPF_STMT(BPF_RET | BPF_A, 0));
+
+  if (code.size() > BPF_MAXINSNS) {
+    LOG(WARNING) << "Too many cpus to steer the reuseport group: " << num_cpus;
+    return false;
+  }
+
+  sock_fprog prog{uint16_t(code.size()), code.data()};
+  int fd = group.front()->socket()->native_handle();
+  if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) < 0) {
+    LOG(WARNING) << "Could not attach reuseport program " << SafeErrorMessage(errno);
+    return false;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
 void Listener::PreAcceptLoop(util::ProactorBase* pb) {
   per_thread_.resize(pool()->size());
 }
@@ -275,6 +335,27 @@ void Listener::PreShutdown() {
 void Listener::PostShutdown() {
 }
 
+void Listener::SetCpuNodes(std::vector<unsigned> cpu_nodes) {
+  cpu_nodes_ = std::move(cpu_nodes);
+}
+
+uint32_t Listener::PickNodeThread(unsigned node) {
+  uint32_t res_id = kuint32max;
+  for (unsigned cpu = 0; cpu < cpu_nodes_.size(); ++cpu) {
+    if (cpu_nodes_[cpu] != node)
+      continue;
+
+    for (unsigned id : pool()->MapCpuToThreads(cpu)) {
+      DCHECK_LT(id, per_thread_.size());
+      if (res_id == kuint32max ||
+          per_thread_[id].num_connections < per_thread_[res_id].num_connections) {
+        res_id = id;
+      }
+    }
+  }
+  return res_id;
+}
+
 void Listener::OnConnectionStart(util::Connection* conn) {
   unsigned id = conn->socket()->proactor()->GetPoolIndex();
   DCHECK_LT(id, per_thread_.size());
@@ -331,6 +412,13 @@ ProactorBase* Listener::PickConnectionProactor(util::FiberSocketBase* sock) {
 
   uint32_t res_id = kuint32max;
 
+  // The kernel already spread the connections over the reuseport group, keep them on the thread
+  // that accepted them.
+  if (reuseport_group_) {
+    DCHECK(ProactorBase::me());
+    return ProactorBase::me();
+  }
+
   if (!sock->IsUDS()) {
     int fd = sock->native_handle();
 
@@ -362,11 +450,19 @@ ProactorBase* Listener::PickConnectionProactor(util::FiberSocketBase* sock) {
           }
         }
 
+        if (res_id == kuint32max && size_t(cpu) < cpu_nodes_.size()) {
+          res_id = PickNodeThread(cpu_nodes_[cpu]);
+        }
+
         if (res_id == kuint32max) {
           VLOG(1) << "choosing a thread with minimum conns " << min_cnt_thread_id_ << " instead of "
                   << cpu;
           res_id = min_cnt_thread_id_;
         }
+      } else if (size_t(cpu) < cpu_nodes_.size()) {
+        // Keep the connection on the NUMA node that receives its traffic.
+        absl::base_internal::SpinLockHolder lock{&mutex_};
+        res_id = PickNodeThread(cpu_nodes_[cpu]);
       }
     }
   }
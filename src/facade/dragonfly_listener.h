@@ -46,6 +46,19 @@ class Listener : public util::ListenerInterface {
   bool IsPrivilegedInterface() const;
   bool IsMainInterface() const;
 
+  // Sets the NUMA node of every cpu, indexed by cpu. When set, connections are placed on a thread
+  // of the node of their incoming cpu. Must be called before the listener accepts connections.
+  void SetCpuNodes(std::vector<unsigned> cpu_nodes);
+
+  // Marks the listener as one of a group of SO_REUSEPORT listeners, one per thread, on the same
+  // port. Its connections stay on the thread that accepted them. Must be called before the
+  // listener accepts connections.
+  void SetReusePortGroup(bool in_group);
+
+  // Attaches a SO_ATTACH_REUSEPORT_CBPF program to the reuseport group, in the order its sockets
+  // started listening, that hands a connection to the listener of its incoming cpu.
+  static bool SteerReusePortGroup(absl::Span<Listener* const> group);
+
  private:
   util::Connection* NewConnection(ProactorBase* proactor) final;
   ProactorBase* PickConnectionProactor(util::FiberSocketBase* sock) final;
@@ -58,6 +71,10 @@ class Listener : public util::ListenerInterface {
   void PreShutdown() final;
   void PostShutdown() final;
 
+  // Returns the thread with the fewest connections among the threads of the cpus of node, or
+  // kuint32max if there are none. mutex_ must be held.
+  uint32_t PickNodeThread(unsigned node);
+
   std::unique_ptr<util::HttpListenerBase> http_base_;
 
   ServiceInterface* service_;
@@ -70,7 +87,10 @@ class Listener : public util::ListenerInterface {
 
   std::atomic_uint32_t next_id_{0};
 
+  std::vector<unsigned> cpu_nodes_;
+
   Role role_;
+  bool reuseport_group_ = false;
 
   uint32_t conn_cnt_{0};
   uint32_t min_cnt_thread_id_{0};
@@ -107,10 +107,146 @@ MP::Result ParseValueless(TokensView tokens, MP::Command* res) {
   return MP::OK;
 }
 
+// Maps the M<mode> flag of ms/ma onto the classic command it is equivalent to.
+MP::CmdType MetaMode(MP::CmdType type, string_view mode) {
+  if (mode.size() != 1)
+    return MP::INVALID;
+
+  char c = absl::ascii_toupper(mode[0]);
+  if (MP::IsStoreCmd(type)) {
+    switch (c) {
+      case 'S':
+        return MP::SET;
+      case 'E':
+        return MP::ADD;
+      case 'A':
+        return MP::APPEND;
+      case 'P':
+        return MP::PREPEND;
+      case 'R':
+        return MP::REPLACE;
+    }
+  } else if (type == MP::INCR || type == MP::DECR) {
+    if (c == 'I' || c == '+')
+      return MP::INCR;
+    if (c == 'D' || c == '-')
+      return MP::DECR;
+  }
+  return MP::INVALID;
+}
+
+// mg <key> <flags>*
+// ms <key> <datalen> <flags>*
+// md <key> <flags>*
+// ma <key> <flags>*
+// mn
+MP::Result ParseMeta(TokensView tokens, MP::Command* res) {
+  res->meta.enabled = true;
+  res->expire_ts = res->flags = res->bytes_len = 0;
+  switch (tokens[0][1]) {
+    case 'n':
+      res->type = MP::META_NOOP;
+      return tokens.size() == 1 ? MP::OK : MP::PARSE_ERROR;
+    case 'g':
+      res->type = MP::GET;
+      break;
+    case 's':
+      res->type = MP::SET;
+      break;
+    case 'd':
+      res->type = MP::DELETE;
+      break;
+    case 'a':
+      res->type = MP::INCR;
+      res->delta = 1;
+      break;
+    default:
+      return MP::UNKNOWN_CMD;
+  }
+
+  if (tokens.size() < 2 || tokens[1].size() > 250)
+    return MP::PARSE_ERROR;
+  res->key = tokens[1];
+
+  size_t flag_pos = 2;
+  if (res->type == MP::SET) {
+    if (tokens.size() < 3)
+      return MP::PARSE_ERROR;
+    if (!absl::SimpleAtoi(tokens[2], &res->bytes_len))
+      return MP::BAD_INT;
+    ++flag_pos;
+  }
+
+  // Flags that are not implemented (base64 keys, CAS compare, invalidation and
+  // stale-while-revalidate, autovivification) are rejected rather than silently ignored.
+  for (string_view flag : tokens.subspan(flag_pos)) {
+    string_view arg = flag.substr(1);
+    switch (flag[0]) {
+      case 'q':
+        res->meta.quiet = true;
+        break;
+      case 'O':
+        res->meta.opaque = arg;
+        break;
+      case 'k':
+        res->meta.return_key = true;
+        break;
+      case 'v':
+        if (MP::IsStoreCmd(res->type) || res->type == MP::DELETE)
+          return MP::PARSE_ERROR;
+        res->meta.return_value = true;
+        break;
+      case 'f':
+        if (res->type != MP::GET)
+          return MP::PARSE_ERROR;
+        res->meta.return_flags = true;
+        break;
+      case 'c':
+        if (res->type != MP::GET)
+          return MP::PARSE_ERROR;
+        res->meta.return_cas = true;
+        break;
+      case 's':
+        if (res->type != MP::GET)
+          return MP::PARSE_ERROR;
+        res->meta.return_size = true;
+        break;
+      case 'T':
+        if (!MP::IsStoreCmd(res->type))
+          return MP::PARSE_ERROR;
+        if (!absl::SimpleAtoi(arg, &res->expire_ts))
+          return MP::BAD_INT;
+        break;
+      case 'F':
+        if (!MP::IsStoreCmd(res->type))
+          return MP::PARSE_ERROR;
+        if (!absl::SimpleAtoi(arg, &res->flags))
+          return MP::BAD_INT;
+        break;
+      case 'D':
+        if (res->type != MP::INCR && res->type != MP::DECR)
+          return MP::PARSE_ERROR;
+        if (!absl::SimpleAtoi(arg, &res->delta))
+          return MP::BAD_DELTA;
+        break;
+      case 'M':
+        if (res->type = MetaMode(res->type, arg); res->type == MP::INVALID)
+          return MP::PARSE_ERROR;
+        break;
+      default:
+        return MP::PARSE_ERROR;
+    }
+  }
+
+  return MP::OK;
+}
+
 }  // namespace
 
 auto MP::Parse(string_view str, uint32_t* consumed, Command* cmd) -> Result {
   cmd->no_reply = false;  // re-initialize
+  cmd->keys_ext.clear();
+  cmd->meta = Command::Meta{};
   auto pos = str.find("\r\n");
   *consumed = 0;
   if (pos == string_view::npos) {
@@ -134,6 +270,10 @@ auto MP::Parse(string_view str, uint32_t* consumed, Command* cmd) -> Result {
   if (num_tokens == 0)
     return PARSE_ERROR;
 
+  if (tokens[0].size() == 2 && tokens[0][0] == 'm') {
+    return ParseMeta(TokensView{tokens.data(), num_tokens}, cmd);
+  }
+
   cmd->type = From(tokens[0]);
   if (cmd->type == INVALID) {
     return UNKNOWN_CMD;
@@ -33,6 +33,7 @@ class MemcacheParser {
 
     QUIT = 20,
     VERSION = 21,
+    META_NOOP = 22,  // mn
 
     // The rest of write commands.
     DELETE = 31,
@@ -56,6 +57,20 @@ class MemcacheParser {
     uint32_t bytes_len = 0;
     uint32_t flags = 0;
     bool no_reply = false;
+
+    // Set for meta protocol commands (mg/ms/md/ma/mn), which are parsed into the type of the
+    // matching classic command. See https://github.com/memcached/memcached/wiki/MetaCommands
+    struct Meta {
+      std::string_view opaque;    // O<token>, echoed back in the reply.
+      bool enabled = false;
+      bool quiet = false;         // q: omit replies that carry no information.
+      bool return_value = false;  // v
+      bool return_flags = false;  // f
+      bool return_cas = false;    // c
+      bool return_key = false;    // k
+      bool return_size = false;   // s
+    };
+    Meta meta;
   };
 
   enum Result {
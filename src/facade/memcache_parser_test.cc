@@ -101,6 +101,50 @@ TEST_F(MCParserTest, NoreplyBasic) {
   EXPECT_FALSE(cmd_.no_reply);
 }
 
+TEST_F(MCParserTest, Meta) {
+  MemcacheParser::Result st = parser_.Parse("mg foo v f k q Oabc\r\n", &consumed_, &cmd_);
+  EXPECT_EQ(MemcacheParser::OK, st);
+  EXPECT_EQ(MemcacheParser::GET, cmd_.type);
+  EXPECT_EQ("foo", cmd_.key);
+  EXPECT_TRUE(cmd_.meta.enabled);
+  EXPECT_TRUE(cmd_.meta.return_value && cmd_.meta.return_flags && cmd_.meta.return_key);
+  EXPECT_TRUE(cmd_.meta.quiet);
+  EXPECT_FALSE(cmd_.meta.return_cas);
+  EXPECT_EQ("abc", cmd_.meta.opaque);
+
+  st = parser_.Parse("ms foo 3 T10 F5 ME\r\n", &consumed_, &cmd_);
+  EXPECT_EQ(MemcacheParser::OK, st);
+  EXPECT_EQ(MemcacheParser::ADD, cmd_.type);
+  EXPECT_EQ(3, cmd_.bytes_len);
+  EXPECT_EQ(10, cmd_.expire_ts);
+  EXPECT_EQ(5, cmd_.flags);
+  EXPECT_FALSE(cmd_.meta.quiet);
+
+  st = parser_.Parse("ma foo MD D7 v\r\n", &consumed_, &cmd_);
+  EXPECT_EQ(MemcacheParser::OK, st);
+  EXPECT_EQ(MemcacheParser::DECR, cmd_.type);
+  EXPECT_EQ(7, cmd_.delta);
+
+  st = parser_.Parse("md foo q\r\n", &consumed_, &cmd_);
+  EXPECT_EQ(MemcacheParser::OK, st);
+  EXPECT_EQ(MemcacheParser::DELETE, cmd_.type);
+
+  st = parser_.Parse("mn\r\n", &consumed_, &cmd_);
+  EXPECT_EQ(MemcacheParser::OK, st);
+  EXPECT_EQ(MemcacheParser::META_NOOP, cmd_.type);
+
+  st = parser_.Parse("get bar\r\n", &consumed_, &cmd_);
+  EXPECT_EQ(MemcacheParser::OK, st);
+  EXPECT_FALSE(cmd_.meta.enabled);
+
+  EXPECT_EQ(MemcacheParser::PARSE_ERROR, parser_.Parse("mg\r\n", &consumed_, &cmd_));
+  EXPECT_EQ(MemcacheParser::PARSE_ERROR, parser_.Parse("md foo v\r\n", &consumed_, &cmd_));
+  EXPECT_EQ(MemcacheParser::PARSE_ERROR, parser_.Parse("ms foo 3 MX\r\n", &consumed_, &cmd_));
+  EXPECT_EQ(MemcacheParser::PARSE_ERROR, parser_.Parse("mg foo R30\r\n", &consumed_, &cmd_));
+  EXPECT_EQ(MemcacheParser::BAD_INT, parser_.Parse("ms foo bar\r\n", &consumed_, &cmd_));
+  EXPECT_EQ(MemcacheParser::UNKNOWN_CMD, parser_.Parse("mx foo\r\n", &consumed_, &cmd_));
+}
+
 class MCParserNoreplyTest : public MCParserTest {
  protected:
   void RunTest(string_view str, bool noreply) {
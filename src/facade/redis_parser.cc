@@ -25,6 +25,8 @@ auto RedisParser::Parse(Buffer str, uint32_t* consumed, RespExpr::Vec* res) -> R
   }
 
   if (state_ == INIT_S) {
+    if (server_mode_ && str[0] == '*' && ParseCommandFast(str, consumed, res))
+      return OK;
     InitStart(str[0], res);
   }
 
@@ -150,6 +152,61 @@ void RedisParser::StashState(RespExpr::Vec* res) {
   }
 }
 
+bool RedisParser::ParseCommandFast(Buffer str, uint32_t* consumed, RespVec* res) {
+  uint8_t* ptr = str.data();
+  uint8_t* end = ptr + str.size();
+
+  // Parses prefix, decimal digits and CRLF. Anything unusual, like signs or overlong numbers,
+  // is rejected here and validated by the state machine instead.
+  auto parse_len = [&](uint8_t prefix, int64_t* len) {
+    if (ptr == end || *ptr != prefix)
+      return false;
+    uint8_t* start = ++ptr;
+    int64_t val = 0;
+    while (ptr != end && *ptr >= '0' && *ptr <= '9' && ptr - start < 18) {
+      val = val * 10 + (*ptr - '0');
+      ++ptr;
+    }
+    if (ptr == start || end - ptr < 2 || ptr[0] != '\r' || ptr[1] != '\n')
+      return false;
+    ptr += 2;
+    *len = val;
+    return true;
+  };
+
+  // Each argument takes at least 6 bytes: $0\r\n\r\n
+  int64_t arr_len;
+  if (!parse_len('*', &arr_len) || arr_len == 0 || arr_len > max_arr_len_ ||
+      end - ptr < arr_len * 6)
+    return false;
+
+  for (int64_t i = 0; i < arr_len; ++i) {
+    int64_t len;
+    if (!parse_len('$', &len) || len > kMaxBulkLen || end - ptr < len + 2 || ptr[len] != '\r' ||
+        ptr[len + 1] != '\n') {
+      res->clear();
+      return false;
+    }
+
+    res->emplace_back(RespExpr::STRING);
+    res->back().u = len ? Buffer{ptr, size_t(len)} : Buffer{};
+    ptr += len + 2;
+  }
+
+  // Leave the state as if InitStart and the state machine ran.
+  buf_stash_.clear();
+  stash_.clear();
+  parse_stack_.clear();
+  cached_expr_ = res;
+  last_stashed_level_ = 0;
+  last_stashed_index_ = 0;
+  state_ = CMD_COMPLETE_S;
+  last_result_ = OK;
+
+  *consumed = ptr - str.data();
+  return true;
+}
+
 auto RedisParser::ParseInline(Buffer str) -> Result {
   DCHECK(!str.empty());
 
@@ -436,6 +493,23 @@ auto RedisParser::ConsumeBulk(Buffer str) -> Result {
   return INPUT_PENDING;
 }
 
+auto RedisParser::BulkAppendBuffer() const -> Buffer {
+  if (state_ != BULK_STR_S || !is_broken_token_ || bulk_len_ == 0)
+    return {};
+
+  const Buffer& bulk_str = get<Buffer>(cached_expr_->back().u);
+  return Buffer{bulk_str.end(), bulk_len_};
+}
+
+void RedisParser::CommitBulk(size_t size) {
+  DCHECK_LE(size, bulk_len_);
+  DCHECK(is_broken_token_);
+
+  auto& bulk_str = get<Buffer>(cached_expr_->back().u);
+  bulk_str = Buffer{bulk_str.data(), bulk_str.size() + size};
+  bulk_len_ -= size;
+}
+
 void RedisParser::HandleFinishArg() {
   state_ = PARSE_ARG_S;
   DCHECK(!parse_stack_.empty());
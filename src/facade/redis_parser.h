@@ -54,6 +54,14 @@ class RedisParser {
     return bulk_len_;
   }
 
+  // Returns the unfilled part of the bulk string being parsed once the parser has allocated its
+  // stash, so the caller can read the rest of a large bulk string into it directly. Empty
+  // otherwise.
+  Buffer BulkAppendBuffer() const;
+
+  // Marks the first size bytes of BulkAppendBuffer() as filled.
+  void CommitBulk(size_t size);
+
   size_t stash_size() const {
     return stash_.size();
   }
@@ -67,6 +75,11 @@ class RedisParser {
   void InitStart(uint8_t prefix_b, RespVec* res);
   void StashState(RespVec* res);
 
+  // Parses a complete array of bulk strings, which is how clients send commands, in one pass.
+  // Returns false without changing the parser state for anything else, including partial
+  // commands, which are left to the state machine.
+  bool ParseCommandFast(Buffer str, uint32_t* consumed, RespVec* res);
+
   // Skips the first character (*).
   Result ConsumeArrayLen(Buffer str);
   Result ParseArg(Buffer str);
@@ -167,6 +167,31 @@ TEST_F(RedisParserTest, Empty) {
   ASSERT_EQ(RedisParser::OK, Parse("*2\r\n$0\r\n\r\n$0\r\n\r\n"));
 }
 
+TEST_F(RedisParserTest, Pipeline) {
+  const char kCmds[] =
+      "*2\r\n$3\r\nGET\r\n$1\r\nx\r\n"
+      "*3\r\n$3\r\nSET\r\n$1\r\nx\r\n$0\r\n\r\n"
+      "*1\r\n$4";
+  ASSERT_EQ(RedisParser::OK, Parse(kCmds));
+  EXPECT_EQ(20, consumed_);
+  EXPECT_THAT(args_, ElementsAre("GET", "x"));
+
+  string_view rest = string_view{kCmds}.substr(20);
+  ASSERT_EQ(RedisParser::OK, Parse(rest));
+  EXPECT_EQ(26, consumed_);
+  EXPECT_THAT(args_, ElementsAre("SET", "x", ""));
+
+  // A partial command is left to the state machine.
+  ASSERT_EQ(RedisParser::INPUT_PENDING, Parse(rest.substr(26)));
+  ASSERT_EQ(RedisParser::OK, Parse("$4\r\nPING\r\n"));
+  EXPECT_THAT(args_, ElementsAre("PING"));
+
+  // So are numbers the fast path does not accept.
+  ASSERT_EQ(RedisParser::OK, Parse("*1\r\n$+4\r\nPING\r\n"));
+  EXPECT_THAT(args_, ElementsAre("PING"));
+  ASSERT_EQ(RedisParser::BAD_ARRAYLEN, Parse("*1\r\n$-2\r\nPING\r\n"));
+}
+
 TEST_F(RedisParserTest, LargeBulk) {
   std::string_view prefix("*1\r\n$1024\r\n");
 
@@ -191,6 +216,26 @@ TEST_F(RedisParserTest, LargeBulk) {
   ASSERT_EQ(RedisParser::OK, Parse("\r\n"));
 }
 
+TEST_F(RedisParserTest, LargeBulkDirectFill) {
+  std::string_view prefix("*1\r\n$1024\r\n");
+  ASSERT_EQ(RedisParser::INPUT_PENDING, Parse(prefix));
+  EXPECT_TRUE(parser_.BulkAppendBuffer().empty());
+
+  // The stash is allocated once a part of the bulk string arrives.
+  ASSERT_EQ(RedisParser::INPUT_PENDING, Parse(string(100, 'a')));
+  RedisParser::Buffer buf = parser_.BulkAppendBuffer();
+  ASSERT_EQ(924u, buf.size());
+
+  memset(buf.data(), 'b', 900);
+  parser_.CommitBulk(900);
+  ASSERT_EQ(24u, parser_.BulkAppendBuffer().size());
+
+  ASSERT_EQ(RedisParser::OK, Parse(absl::StrCat(string(24, 'c'), "\r\n")));
+  ASSERT_EQ(26u, consumed_);
+  EXPECT_TRUE(parser_.BulkAppendBuffer().empty());
+  ASSERT_THAT(args_, ElementsAre(string(100, 'a') + string(900, 'b') + string(24, 'c')));
+}
+
 TEST_F(RedisParserTest, NILs) {
   ASSERT_EQ(RedisParser::BAD_BULKLEN, Parse("_\r\n"));
   parser_.SetClientMode();
@@ -216,32 +216,103 @@ void MCReplyBuilder::SendSimpleString(std::string_view str) {
 }
 
 void MCReplyBuilder::SendStored() {
+  if (meta_cmd_)
+    return SendMeta("HD");
   SendSimpleString("STORED");
 }
 
 void MCReplyBuilder::SendLong(long val) {
   char buf[32];
   char* next = absl::numbers_internal::FastIntToBuffer(val, buf);
+  if (meta_cmd_)
+    return SendMeta(meta_cmd_->meta.return_value ? "VA" : "HD", string_view(buf, next - buf));
   SendSimpleString(string_view(buf, next - buf));
 }
 
+void MCReplyBuilder::SendMeta(string_view code, string_view value, const GetResp* entry) {
+  const auto& meta = meta_cmd_->meta;
+
+  // Quiet mode only suppresses the replies that do not tell anything new to the client.
+  if (meta.quiet && (code == "HD" || code == "EN" || code == "NF"))
+    return;
+
+  bool has_value = code == "VA";
+  string header{code};
+  if (has_value)
+    absl::StrAppend(&header, " ", value.size());
+  if (entry) {
+    if (meta.return_flags)
+      absl::StrAppend(&header, " f", entry->mc_flag);
+    if (meta.return_cas)
+      absl::StrAppend(&header, " c", entry->mc_ver);
+    if (meta.return_size)
+      absl::StrAppend(&header, " s", entry->value.size());
+  }
+  if (code != "EN") {
+    if (meta.return_key)
+      absl::StrAppend(&header, " k", meta_cmd_->key);
+    if (!meta.opaque.empty())
+      absl::StrAppend(&header, " O", meta.opaque);
+  }
+  header.append(kCRLF);
+
+  if (has_value) {
+    iovec v[] = {IoVec(header), IoVec(value), IoVec(kCRLF)};
+    Send(v, ABSL_ARRAYSIZE(v));
+  } else {
+    SendRaw(header);
+  }
+}
+
 void MCReplyBuilder::SendMGetResponse(MGetResponse resp) {
-  string header;
-  for (unsigned i = 0; i < resp.resp_arr.size(); ++i) {
-    if (resp.resp_arr[i]) {
+  if (meta_cmd_) {
+    DCHECK_EQ(resp.resp_arr.size(), 1u);
+    if (!resp.resp_arr[0])
+      return SendMeta("EN");
+
+    const GetResp& src = *resp.resp_arr[0];
+    return SendMeta(meta_cmd_->meta.return_value ? "VA" : "HD", src.value, &src);
+  }
+
+  // Values are written kBatchLen at a time with a single vectored write, so that a get with
+  // many keys does not issue a write per hit.
+  constexpr size_t kBatchLen = 32;
+  iovec vec[kBatchLen * 3 + 1];
+  size_t hdr_end[kBatchLen];
+  const GetResp* hits[kBatchLen];
+  string headers;
+
+  size_t size = resp.resp_arr.size(), i = 0;
+  do {
+    unsigned num_hits = 0;
+    headers.clear();
+    for (; i < size && num_hits < kBatchLen; ++i) {
+      if (!resp.resp_arr[i])
+        continue;
+
       const auto& src = *resp.resp_arr[i];
-      absl::StrAppend(&header, "VALUE ", src.key, " ", src.mc_flag, " ", src.value.size());
+      absl::StrAppend(&headers, "VALUE ", src.key, " ", src.mc_flag, " ", src.value.size());
       if (src.mc_ver) {
-        absl::StrAppend(&header, " ", src.mc_ver);
+        absl::StrAppend(&headers, " ", src.mc_ver);
       }
+      headers.append(kCRLF);
+      hdr_end[num_hits] = headers.size();
+      hits[num_hits++] = &src;
+    }
 
-      absl::StrAppend(&header, "\r\n");
-      iovec v[] = {IoVec(header), IoVec(src.value), IoVec(kCRLF)};
-      Send(v, ABSL_ARRAYSIZE(v));
-      header.clear();
+    // headers is complete for this batch, so it is safe to point into it now.
+    unsigned vec_len = 0;
+    for (unsigned j = 0; j < num_hits; ++j) {
+      size_t start = j ? hdr_end[j - 1] : 0;
+      vec[vec_len++] = IoVec(string_view{headers}.substr(start, hdr_end[j] - start));
+      vec[vec_len++] = IoVec(hits[j]->value);
+      vec[vec_len++] = IoVec(kCRLF);
     }
-  }
-  SendSimpleString("END");
+    if (i == size)
+      vec[vec_len++] = IoVec("END\r\n");
+    if (vec_len)
+      Send(vec, vec_len);
+  } while (i < size);
 }
 
 void MCReplyBuilder::SendError(string_view str, std::string_view type) {
@@ -262,13 +333,23 @@ void MCReplyBuilder::SendClientError(string_view str) {
 }
 
 void MCReplyBuilder::SendSetSkipped() {
+  if (meta_cmd_)
+    return SendMeta("NS");
   SendSimpleString("NOT_STORED");
 }
 
 void MCReplyBuilder::SendNotFound() {
+  if (meta_cmd_)
+    return SendMeta("NF");
   SendSimpleString("NOT_FOUND");
 }
 
+void MCReplyBuilder::SendDeleted() {
+  if (meta_cmd_)
+    return SendMeta("HD");
+  SendSimpleString("DELETED");
+}
+
 size_t RedisReplyBuilder::WrappedStrSpan::Size() const {
   return visit([](auto arr) { return arr.size(); }, (const StrSpan&)*this);
 }
@@ -338,6 +419,10 @@ void RedisReplyBuilder::SendNull() {
   Send(v, ABSL_ARRAYSIZE(v));
 }
 
+void RedisReplyBuilder::SendSerialized(std::string_view reply) {
+  SendRaw(reply);
+}
+
 void RedisReplyBuilder::SendBulkString(std::string_view str) {
   char tmp[absl::numbers_internal::kFastToBufferSize + 3];
   tmp[0] = '$';  // Format length
@@ -376,8 +461,12 @@ void RedisReplyBuilder::SendVerbatimString(std::string_view str, VerbatimFormat
 }
 
 void RedisReplyBuilder::SendLong(long num) {
-  string str = absl::StrCat(":", num, kCRLF);
-  SendRaw(str);
+  char buf[absl::numbers_internal::kFastToBufferSize + 3];
+  buf[0] = ':';
+  char* next = absl::numbers_internal::FastIntToBuffer(int64_t(num), buf + 1);
+  *next++ = '\r';
+  *next++ = '\n';
+  SendRaw(string_view{buf, size_t(next - buf)});
 }
 
 void RedisReplyBuilder::SendScoredArray(const std::vector<std::pair<std::string, double>>& arr,
@@ -417,8 +506,8 @@ void RedisReplyBuilder::SendDouble(double val) {
     SendBulkString(sb.Finalize());
   } else {
     // RESP3
-    string str = absl::StrCat(",", sb.Finalize(), kCRLF);
-    SendRaw(str);
+    iovec v[3] = {IoVec(","), IoVec(sb.Finalize()), IoVec(kCRLF)};
+    Send(v, ABSL_ARRAYSIZE(v));
   }
 }
 
@@ -434,7 +523,8 @@ void RedisReplyBuilder::SendMGetResponse(MGetResponse resp) {
 
   // for all the meta data to fill the vec batch. 10 digits for the blob size and 6 for
   // $, \r, \n, \r, \n
-  absl::FixedArray<char, 64> meta((vec_len + 2) * 16);  // 2 for header and next item meta data.
+  // 2 for header and next item meta data. vec_len is at most 32 so this never allocates.
+  absl::FixedArray<char, (32 + 2) * 16> meta((vec_len + 2) * 16);
 
   char* next = meta.data();
   char* cur_meta = next;
@@ -551,9 +641,15 @@ void RedisReplyBuilder::StartCollection(unsigned len, CollectionType type) {
   // We do not want to send multiple packets for small responses because these
   // trigger TCP-related artifacts (e.g. Nagle's algorithm) that slow down the delivery of the whole
   // response.
+  char buf[absl::numbers_internal::kFastToBufferSize + 3];
+  buf[0] = START_SYMBOLS[type][0];
+  char* next = absl::numbers_internal::FastIntToBuffer(len, buf + 1);
+  *next++ = '\r';
+  *next++ = '\n';
+
   bool prev = should_aggregate_;
   should_aggregate_ |= (len > 0);
-  SendRaw(absl::StrCat(START_SYMBOLS[type], len, kCRLF));
+  SendRaw(string_view{buf, size_t(next - buf)});
   should_aggregate_ = prev;
 }
 
@@ -581,8 +677,10 @@ void RedisReplyBuilder::SendStringArrInternal(WrappedStrSpan arr, CollectionType
   // When vector length is too long, Send returns EMSGSIZE.
   size_t vec_len = std::min<size_t>(256u, size);
 
-  absl::FixedArray<iovec, 16> vec(vec_len * 2 + 2);
-  absl::FixedArray<char, 64> meta((vec_len + 1) * 16);
+  // Arrays of up to kInlineLen strings are built without allocating.
+  constexpr size_t kInlineLen = 32;
+  absl::FixedArray<iovec, kInlineLen * 2 + 2> vec(vec_len * 2 + 2);
+  absl::FixedArray<char, (kInlineLen + 1) * 16> meta((vec_len + 1) * 16);
   char* next = meta.data();
 
   *next++ = type_char[0];
@@ -9,6 +9,7 @@
 #include <string_view>
 
 #include "facade/facade_types.h"
+#include "facade/memcache_parser.h"
 #include "facade/op_status.h"
 #include "io/io.h"
 
@@ -56,10 +57,10 @@ class SinkReplyBuilder {
       other.storage_list = nullptr;
     }
 
+    // Swaps the storage, so that other frees the storage that was assigned over
     MGetResponse& operator=(MGetResponse&& other) noexcept {
       resp_arr = std::move(other.resp_arr);
-      storage_list = other.storage_list;
-      other.storage_list = nullptr;
+      std::swap(storage_list, other.storage_list);
       return *this;
     }
   };
@@ -170,6 +171,7 @@ class SinkReplyBuilder {
 
 class MCReplyBuilder : public SinkReplyBuilder {
   bool noreply_;
+  const MemcacheParser::Command* meta_cmd_ = nullptr;
 
  public:
   MCReplyBuilder(::io::Sink* stream);
@@ -187,6 +189,7 @@ class MCReplyBuilder : public SinkReplyBuilder {
 
   void SendClientError(std::string_view str);
   void SendNotFound();
+  void SendDeleted();
   void SendSimpleString(std::string_view str) final;
   void SendProtocolError(std::string_view str) final;
 
@@ -195,6 +198,16 @@ class MCReplyBuilder : public SinkReplyBuilder {
   }
 
   bool NoReply() const;
+
+  // Replies in the meta protocol format on behalf of `cmd` until reset with nullptr.
+  // `cmd` must stay valid while it is set.
+  void SetMeta(const MemcacheParser::Command* cmd) {
+    meta_cmd_ = cmd;
+  }
+
+ private:
+  // Sends "<code> <return flags>\r\n" followed by the value block for VA replies.
+  void SendMeta(std::string_view code, std::string_view value = {}, const GetResp* entry = nullptr);
 };
 
 class RedisReplyBuilder : public SinkReplyBuilder {
@@ -238,6 +251,10 @@ class RedisReplyBuilder : public SinkReplyBuilder {
 
   virtual void StartCollection(unsigned len, CollectionType type);
 
+  // Sends a reply that was serialized beforehand, usually once for many connections. It must not
+  // contain types that differ between RESP2 and RESP3.
+  void SendSerialized(std::string_view reply);
+
   static char* FormatDouble(double val, char* dest, unsigned dest_len);
 
  protected:
@@ -837,6 +837,34 @@ TEST_F(RedisReplyBuilderTest, MGetLarge) {
   ASSERT_EQ(TakePayload(), expected);
 }
 
+TEST_F(RedisReplyBuilderTest, MCMGetResponse) {
+  vector<optional<string>> strs;
+  for (int i = 0; i < 100; i++) {
+    strs.emplace_back(i % 10 ? optional<string>{absl::StrCat("val", i)} : nullopt);
+  }
+  SinkReplyBuilder::MGetResponse resp = MakeMGetResponse(strs);
+  string expected;
+  for (int i = 0; i < 100; i++) {
+    if (!resp.resp_arr[i])
+      continue;
+    resp.resp_arr[i]->key = absl::StrCat("key", i);
+    resp.resp_arr[i]->mc_flag = i;
+    absl::StrAppend(&expected, "VALUE key", i, " ", i, " ", strs[i]->size(), "\r\n", *strs[i],
+                    "\r\n");
+  }
+  absl::StrAppend(&expected, "END\r\n");
+
+  MCReplyBuilder mc_builder(&sink_);
+  mc_builder.SendMGetResponse(std::move(resp));
+  ASSERT_EQ(TakePayload(), expected);
+
+  // 90 hits are written in 32 value batches.
+  EXPECT_EQ(GetReplyStats().io_write_cnt, 3);
+
+  mc_builder.SendMGetResponse(MakeMGetResponse({nullopt}));
+  ASSERT_EQ(TakePayload(), "END\r\n");
+}
+
 TEST_F(RedisReplyBuilderTest, BasicCapture) {
   using namespace std;
   string_view kTestSws[] = {"a1"sv, "a2"sv, "a3"sv, "a4"sv};
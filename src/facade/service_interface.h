@@ -42,6 +42,10 @@ class ServiceInterface {
   virtual void OnClose(ConnectionContext* cntx) {
   }
 
+  // Called from the dispatch fiber of a connection whose sharded channel moved to another node.
+  virtual void OnShardChannelMoved(ConnectionContext* cntx, std::string_view channel) {
+  }
+
   virtual std::string GetContextInfo(ConnectionContext* cntx) {
     return {};
   }
@@ -749,6 +749,9 @@ double hllTau(double x) {
   return z / 3;
 }
 
+/* Estimates the cardinality from the register histogram. */
+static uint64_t hllEstimate(const int* reghisto);
+
 /* Return the approximated cardinality of the set based on the harmonic
  * mean of the registers values. 'hdr' points to the start of the SDS
  * representing the String object holding the HLL representation.
@@ -761,9 +764,6 @@ double hllTau(double x) {
  * This is useful in order to speedup PFCOUNT when called against multiple
  * keys (no need to work with 6-bit integers encoding). */
 uint64_t hllCount(struct hllhdr* hdr, int* invalid) {
-  double m = HLL_REGISTERS;
-  double E;
-  int j;
   /* Note that reghisto size could be just HLL_Q+2, because HLL_Q+1 is
    * the maximum frequency of the "000...1" sequence the hash function is
    * able to return. However it is slow to check for sanity of the
@@ -781,6 +781,13 @@ uint64_t hllCount(struct hllhdr* hdr, int* invalid) {
   } else {
     serverPanic("Unknown HyperLogLog encoding in hllCount()");
   }
+  return hllEstimate(reghisto);
+}
+
+static uint64_t hllEstimate(const int* reghisto) {
+  double m = HLL_REGISTERS;
+  double E;
+  int j;
 
   /* Estimate cardinality from register histogram. See:
    * "New cardinality estimation algorithms for HyperLogLog sketches"
@@ -1039,18 +1046,77 @@ int64_t pfcountSingle(struct HllBufferPtr hll_ptr) {
   return card;
 }
 
+static inline uint8_t hllMax(uint8_t a, uint8_t b) {
+  return a > b ? a : b;
+}
+
+/* With HLL_BITS == 6 every 3 bytes of the dense registers hold 4 registers, so they are
+ * unpacked and packed a group at a time instead of with the per register macros. */
+
+/* Computes registers[i] = MAX(registers[i], p[i]) for the dense registers p. */
+static void hllDenseMergeRaw(const uint8_t* p, uint8_t* registers) {
+  for (int i = 0; i < HLL_REGISTERS; i += 4, p += 3) {
+    uint32_t w = p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+    registers[i] = hllMax(registers[i], w & HLL_REGISTER_MAX);
+    registers[i + 1] = hllMax(registers[i + 1], (w >> 6) & HLL_REGISTER_MAX);
+    registers[i + 2] = hllMax(registers[i + 2], (w >> 12) & HLL_REGISTER_MAX);
+    registers[i + 3] = hllMax(registers[i + 3], (w >> 18) & HLL_REGISTER_MAX);
+  }
+}
+
+static void hllDensePack(const uint8_t* registers, uint8_t* p) {
+  for (int i = 0; i < HLL_REGISTERS; i += 4, p += 3) {
+    uint32_t w = (registers[i] & HLL_REGISTER_MAX) |
+                 ((uint32_t)(registers[i + 1] & HLL_REGISTER_MAX) << 6) |
+                 ((uint32_t)(registers[i + 2] & HLL_REGISTER_MAX) << 12) |
+                 ((uint32_t)(registers[i + 3] & HLL_REGISTER_MAX) << 18);
+    p[0] = w & 0xff;
+    p[1] = (w >> 8) & 0xff;
+    p[2] = (w >> 16) & 0xff;
+  }
+}
+
 /* Merge dense-encoded HLL */
 static void hllMergeDense(uint8_t* max, struct HllBufferPtr to) {
   uint8_t* registers = max + HLL_HDR_SIZE;
-  uint8_t val;
   struct hllhdr* hll_hdr = (struct hllhdr*)to.hll;
 
-  for (int i = 0; i < HLL_REGISTERS; i++) {
-    HLL_DENSE_GET_REGISTER(val, hll_hdr->registers, i);
-    if (val > registers[i]) {
-      registers[i] = val;
-    }
+  hllDenseMergeRaw(hll_hdr->registers, registers);
+}
+
+size_t getHllRegisterCount() {
+  return HLL_REGISTERS;
+}
+
+int hllMergeDenseToRaw(struct HllBufferPtr hll_ptr, uint8_t* registers) {
+  if (isValidHLL(hll_ptr) != HLL_VALID_DENSE) {
+    return C_ERR;
   }
+  hllDenseMergeRaw(((struct hllhdr*)hll_ptr.hll)->registers, registers);
+  return C_OK;
+}
+
+int64_t pfcountRaw(const uint8_t* registers) {
+  int reghisto[64] = {0};
+  hllRawRegHisto((uint8_t*)registers, reghisto);
+  return hllEstimate(reghisto);
+}
+
+static void hllSetCache(struct hllhdr* hdr, uint64_t card) {
+  for (int i = 0; i < 8; i++) {
+    hdr->card[i] = (card >> (8 * i)) & 0xff;
+  }
+}
+
+int pfstoreRaw(const uint8_t* registers, struct HllBufferPtr out_hll) {
+  if (isValidHLL(out_hll) != HLL_VALID_DENSE) {
+    return C_ERR;
+  }
+
+  struct hllhdr* hdr = (struct hllhdr*)out_hll.hll;
+  hllDensePack(registers, hdr->registers);
+  hllSetCache(hdr, pfcountRaw(registers));
+  return C_OK;
 }
 
 int64_t pfcountMulti(struct HllBufferPtr* hlls, size_t hlls_count) {
@@ -57,4 +57,20 @@ int64_t pfcountMulti(struct HllBufferPtr* hlls, size_t hlls_count);
  * `out_hll` *can* be one of the elements in `in_hlls`. */
 int pfmerge(struct HllBufferPtr* in_hlls, size_t in_hlls_count, struct HllBufferPtr out_hll);
 
+/* Raw registers are an array of getHllRegisterCount() uint8_t registers, one byte each. They
+ * are cheaper to merge than the 6 bit registers of the dense encoding. */
+size_t getHllRegisterCount();
+
+/* Merges the dense-encoded `hll_ptr` into the raw `registers`, by computing MAX(registers[i],
+ * hll[i]).
+ * Returns 0 upon success, or a negative number if `hll_ptr` is not a dense-encoded HLL. */
+int hllMergeDenseToRaw(struct HllBufferPtr hll_ptr, uint8_t* registers);
+
+/* Returns the estimated count of the raw `registers`. */
+int64_t pfcountRaw(const uint8_t* registers);
+
+/* Writes the raw `registers` into the dense-encoded `out_hll`, with a valid cached cardinality.
+ * Returns 0 upon success, or a negative number if `out_hll` is not a dense-encoded HLL. */
+int pfstoreRaw(const uint8_t* registers, struct HllBufferPtr out_hll);
+
 #endif
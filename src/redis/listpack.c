@@ -702,7 +702,10 @@ unsigned char *lpFind(unsigned char *lp, unsigned char *p, unsigned char *s,
             if (value) {
                 /* check the value doesn't reach outside the listpack before accessing it */
                 assert(p >= lp + LP_HDR_SIZE && p + entry_size < lp + lp_bytes);
-                if (slen == ll && memcmp(value, s, slen) == 0) {
+                /* Most fields of the same length differ at their first or last byte, check them
+                 * before calling memcmp. */
+                if (slen == ll && (slen == 0 || (value[0] == s[0] && value[slen-1] == s[slen-1] &&
+                                                 memcmp(value, s, slen) == 0))) {
                     return p;
                 }
             } else {
@@ -736,8 +739,14 @@ unsigned char *lpFind(unsigned char *lp, unsigned char *p, unsigned char *s,
             skipcnt--;
 
             /* Move to next entry, avoid use `lpNext` due to `ASSERT_INTEGRITY` in
-            * `lpNext` will call `lpBytes`, will cause performance degradation */
-            p = lpSkip(p);
+            * `lpNext` will call `lpBytes`, will cause performance degradation.
+            * The skipped entries are usually small values, whose size is in their first byte. */
+            if (LP_ENCODING_IS_7BIT_UINT(p[0]))
+                p += LP_ENCODING_7BIT_UINT_ENTRY_SIZE;
+            else if (LP_ENCODING_IS_6BIT_STR(p[0]))
+                p += 2 + LP_ENCODING_6BIT_STR_LEN(p); /* encoding, string, 1 byte backlen */
+            else
+                p = lpSkip(p);
         }
 
         /* The next call to lpGetWithSize could read at most 8 bytes past `p`
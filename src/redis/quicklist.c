@@ -36,7 +36,7 @@
 #include "config.h"
 #include "listpack.h"
 #include "util.h" /* for ll2string */
-#include "lzfP.h"
+#include <lz4.h>
 
 
 #ifndef REDIS_STATIC
@@ -231,23 +231,26 @@ REDIS_STATIC int __quicklistCompressNode(quicklistNode *node) {
     if (node->sz < MIN_COMPRESS_BYTES)
         return 0;
 
-    // ROMAN: we allocate LZF_STATE on heap, piggy-backing on the existing allocation.
-    char* uptr = zmalloc(sizeof(quicklistLZF) + node->sz + sizeof(LZF_STATE));
-    quicklistLZF *lzf = (quicklistLZF*)uptr;
-    LZF_HSLOT* sdata = (LZF_HSLOT*)(uptr + sizeof(quicklistLZF) + node->sz);
+    /* Allocate the LZ4 state on heap, piggy-backing on the node allocation, because
+     * LZ4_compress_default keeps it on stack, which is too large for fibers. The compressed
+     * size is capped to guarantee the minimal improvement. */
+    int capacity = node->sz - MIN_COMPRESS_IMPROVE;
+    size_t state_offset = (sizeof(quicklistLZ4) + capacity + 7) & ~(size_t)7;
+    char* uptr = zmalloc(state_offset + LZ4_sizeofState());
+    quicklistLZ4 *lz4 = (quicklistLZ4*)uptr;
 
     /* Cancel if compression fails or doesn't compress small enough */
-    if (((lzf->sz = lzf_compress(node->entry, node->sz, lzf->compressed,
-                                 node->sz, sdata)) == 0) ||
-        lzf->sz + MIN_COMPRESS_IMPROVE >= node->sz) {
-        /* lzf_compress aborts/rejects compression if value not compressible. */
-        zfree(lzf);
+    int res = LZ4_compress_fast_extState(uptr + state_offset, (const char*)node->entry,
+                                         lz4->compressed, node->sz, capacity, 1);
+    if (res <= 0) {
+        zfree(lz4);
         return 0;
     }
-    lzf = zrealloc(lzf, sizeof(*lzf) + lzf->sz);
+    lz4->sz = res;
+    lz4 = zrealloc(lz4, sizeof(*lz4) + lz4->sz);
     zfree(node->entry);
-    node->entry = (unsigned char *)lzf;
-    node->encoding = QUICKLIST_NODE_ENCODING_LZF;
+    node->entry = (unsigned char *)lz4;
+    node->encoding = QUICKLIST_NODE_ENCODING_LZ4;
     return 1;
 }
 
@@ -267,14 +270,13 @@ REDIS_STATIC int __quicklistDecompressNode(quicklistNode *node) {
 #endif
     node->recompress = 0;
 
-    void *decompressed = zmalloc(node->sz);
-    quicklistLZF *lzf = (quicklistLZF *)node->entry;
-    if (lzf_decompress(lzf->compressed, lzf->sz, decompressed, node->sz) == 0) {
+    unsigned char *decompressed = zmalloc(node->sz);
+    if (!quicklistDecompressNodeTo(node, decompressed)) {
         /* Someone requested decompress, but we can't decompress.  Not good. */
         zfree(decompressed);
         return 0;
     }
-    zfree(lzf);
+    zfree(node->entry);
     node->entry = decompressed;
     node->encoding = QUICKLIST_NODE_ENCODING_RAW;
     return 1;
@@ -283,7 +285,7 @@ REDIS_STATIC int __quicklistDecompressNode(quicklistNode *node) {
 /* Decompress only compressed nodes. */
 #define quicklistDecompressNode(_node)                                         \
     do {                                                                       \
-        if ((_node) && (_node)->encoding == QUICKLIST_NODE_ENCODING_LZF) {     \
+        if ((_node) && (_node)->encoding == QUICKLIST_NODE_ENCODING_LZ4) {     \
             __quicklistDecompressNode((_node));                                \
         }                                                                      \
     } while (0)
@@ -291,19 +293,19 @@ REDIS_STATIC int __quicklistDecompressNode(quicklistNode *node) {
 /* Force node to not be immediately re-compressible */
 #define quicklistDecompressNodeForUse(_node)                                   \
     do {                                                                       \
-        if ((_node) && (_node)->encoding == QUICKLIST_NODE_ENCODING_LZF) {     \
+        if ((_node) && (_node)->encoding == QUICKLIST_NODE_ENCODING_LZ4) {     \
             __quicklistDecompressNode((_node));                                \
             (_node)->recompress = 1;                                           \
         }                                                                      \
     } while (0)
 
-/* Extract the raw LZF data from this quicklistNode.
- * Pointer to LZF data is assigned to '*data'.
- * Return value is the length of compressed LZF data. */
-size_t quicklistGetLzf(const quicklistNode *node, void **data) {
-    quicklistLZF *lzf = (quicklistLZF *)node->entry;
-    *data = lzf->compressed;
-    return lzf->sz;
+/* Decompress the data of the compressed 'node' into 'dest' with at least node->sz bytes,
+ * without changing the node.
+ * Returns 1 on successful decode, 0 on failure to decode. */
+int quicklistDecompressNodeTo(const quicklistNode *node, unsigned char *dest) {
+    const quicklistLZ4 *lz4 = (const quicklistLZ4 *)node->entry;
+    int res = LZ4_decompress_safe(lz4->compressed, (char *)dest, lz4->sz, node->sz);
+    return res >= 0 && (size_t)res == node->sz;
 }
 
 #define quicklistAllowsCompression(_ql) ((_ql)->compress != 0)
@@ -1392,11 +1394,11 @@ quicklist *quicklistDup(quicklist *orig) {
          current = current->next) {
         quicklistNode *node = quicklistCreateNode();
 
-        if (current->encoding == QUICKLIST_NODE_ENCODING_LZF) {
-            quicklistLZF *lzf = (quicklistLZF *)current->entry;
-            size_t lzf_sz = sizeof(*lzf) + lzf->sz;
-            node->entry = zmalloc(lzf_sz);
-            memcpy(node->entry, current->entry, lzf_sz);
+        if (current->encoding == QUICKLIST_NODE_ENCODING_LZ4) {
+            quicklistLZ4 *lz4 = (quicklistLZ4 *)current->entry;
+            size_t lz4_sz = sizeof(*lz4) + lz4->sz;
+            node->entry = zmalloc(lz4_sz);
+            memcpy(node->entry, current->entry, lz4_sz);
         } else if (current->encoding == QUICKLIST_NODE_ENCODING_RAW) {
             node->entry = zmalloc(current->sz);
             memcpy(node->entry, current->entry, current->sz);
@@ -1529,7 +1531,7 @@ int quicklistPopCustom(quicklist *quicklist, int where, unsigned char **data,
     }
 
     /* The head and tail should never be compressed */
-    assert(node->encoding != QUICKLIST_NODE_ENCODING_LZF);
+    assert(node->encoding != QUICKLIST_NODE_ENCODING_LZ4);
 
     if (unlikely(QL_NODE_IS_PLAIN(node))) {
         if (data)
@@ -1594,9 +1596,9 @@ void quicklistPush(quicklist *quicklist, void *value, const size_t sz,
                    int where) {
     /* The head and tail should never be compressed (we don't attempt to decompress them) */
     if (quicklist->head)
-        assert(quicklist->head->encoding != QUICKLIST_NODE_ENCODING_LZF);
+        assert(quicklist->head->encoding != QUICKLIST_NODE_ENCODING_LZ4);
     if (quicklist->tail)
-        assert(quicklist->tail->encoding != QUICKLIST_NODE_ENCODING_LZF);
+        assert(quicklist->tail->encoding != QUICKLIST_NODE_ENCODING_LZ4);
 
     if (where == QUICKLIST_HEAD) {
         quicklistPushHead(quicklist, value, sz);
@@ -1620,7 +1622,7 @@ void quicklistRepr(unsigned char *ql, int full) {
         printf("{quicklist node(%d)\n", i++);
         printf("{container : %s, encoding: %s, size: %zu, recompress: %d, attempted_compress: %d}\n",
                QL_NODE_IS_PLAIN(node) ? "PLAIN": "PACKED",
-               (node->encoding == QUICKLIST_NODE_ENCODING_RAW) ? "RAW": "LZF",
+               (node->encoding == QUICKLIST_NODE_ENCODING_RAW) ? "RAW": "LZ4",
                node->sz,
                node->recompress,
                node->attempted_compress);
@@ -38,7 +38,7 @@
 /* quicklistNode is a 32 byte struct describing a listpack for a quicklist.
  * We use bit fields keep the quicklistNode at 32 bytes.
  * count: 16 bits, max 65536 (max lp bytes is 65k, so max count actually < 32k).
- * encoding: 2 bits, RAW=1, LZF=2.
+ * encoding: 2 bits, RAW=1, LZ4=2.
  * container: 2 bits, PLAIN=1, PACKED=2.
  * recompress: 1 bit, bool, true if node is temporary decompressed for usage.
  * attempted_compress: 1 bit, boolean, used for verifying during testing.
@@ -49,22 +49,22 @@ typedef struct quicklistNode {
     unsigned char *entry;
     size_t sz;             /* entry size in bytes */
     unsigned int count : 16;     /* count of items in listpack */
-    unsigned int encoding : 2;   /* RAW==1 or LZF==2 */
+    unsigned int encoding : 2;   /* RAW==1 or LZ4==2 */
     unsigned int container : 2;  /* PLAIN==1 or PACKED==2 */
     unsigned int recompress : 1; /* was this node previous compressed? */
     unsigned int attempted_compress : 1; /* node can't compress; too small */
     unsigned int extra : 10; /* more bits to steal for future usage */
 } quicklistNode;
 
-/* quicklistLZF is a 8+N byte struct holding 'sz' followed by 'compressed'.
+/* quicklistLZ4 is a 8+N byte struct holding 'sz' followed by 'compressed'.
  * 'sz' is byte length of 'compressed' field.
- * 'compressed' is LZF data with total (compressed) length 'sz'
+ * 'compressed' is LZ4 block with total (compressed) length 'sz'
  * NOTE: uncompressed length is stored in quicklistNode->sz.
- * When quicklistNode->entry is compressed, node->entry points to a quicklistLZF */
-typedef struct quicklistLZF {
-    size_t sz; /* LZF size in bytes*/
+ * When quicklistNode->entry is compressed, node->entry points to a quicklistLZ4 */
+typedef struct quicklistLZ4 {
+    size_t sz; /* LZ4 size in bytes*/
     char compressed[];
-} quicklistLZF;
+} quicklistLZ4;
 
 /* Bookmarks are padded with realloc at the end of of the quicklist struct.
  * They should only be used for very big lists if thousands of nodes were the
@@ -136,7 +136,7 @@ typedef struct quicklistEntry {
 
 /* quicklist node encodings */
 #define QUICKLIST_NODE_ENCODING_RAW 1
-#define QUICKLIST_NODE_ENCODING_LZF 2
+#define QUICKLIST_NODE_ENCODING_LZ4 2
 
 /* quicklist compression disable */
 #define QUICKLIST_NOCOMPRESS 0
@@ -148,7 +148,7 @@ typedef struct quicklistEntry {
 #define QL_NODE_IS_PLAIN(node) ((node)->container == QUICKLIST_NODE_CONTAINER_PLAIN)
 
 #define quicklistNodeIsCompressed(node)                                        \
-    ((node)->encoding == QUICKLIST_NODE_ENCODING_LZF)
+    ((node)->encoding == QUICKLIST_NODE_ENCODING_LZ4)
 
 /* Prototypes */
 quicklist *quicklistCreate(void);
@@ -190,7 +190,7 @@ int quicklistPop(quicklist *quicklist, int where, unsigned char **data,
                  size_t *sz, long long *slong);
 unsigned long quicklistCount(const quicklist *ql);
 int quicklistCompare(const quicklistEntry *entry, const unsigned char *p2, const size_t p2_len);
-size_t quicklistGetLzf(const quicklistNode *node, void **data);
+int quicklistDecompressNodeTo(const quicklistNode *node, unsigned char *dest);
 void quicklistRepr(unsigned char *ql, int full);
 
 /* bookmarks */
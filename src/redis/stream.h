@@ -54,6 +54,53 @@ typedef struct streamIterator {
     unsigned char value_buf[LP_INTBUF_SIZE];
 } streamIterator;
 
+/* A pending (yet not acknowledged) message in a consumer group, as decoded
+ * from its streamPEL. */
+typedef struct streamPendingEntry {
+    streamID id;                /* ID of the message. */
+    mstime_t delivery_time;     /* Last time this message was delivered. */
+    uint64_t delivery_count;    /* Number of times this message was delivered.*/
+    struct streamConsumer *consumer; /* The consumer this message was delivered
+                                        to in the last delivery. NULL only
+                                        while the group is being loaded. */
+} streamPendingEntry;
+
+/* Maximum number of entries of a streamPEL block. */
+#define STREAM_PEL_BLOCK_MAX 64
+
+/* Pending entries list of a consumer group. The entries are sorted by ID
+ * and packed in blocks of up to STREAM_PEL_BLOCK_MAX entries, indexed by a
+ * radix tree keyed by a 128 bit big endian ID that is not above the first ID
+ * of the block. Inside a block every entry is stored as varints relative to
+ * the previous one: the ID delta, the delivery time delta, the delivery
+ * count and the index of its consumer in the 'consumers' table. Every block
+ * also keeps a mask of the indexes of its consumers modulo 64, so that the
+ * scans of the entries of a single consumer skip the blocks without any. */
+typedef struct streamPEL {
+    rax *blocks;                /* First ID of the block -> block. */
+    uint64_t size;              /* Number of entries. */
+    uint64_t version;           /* Incremented on every change of the
+                                   entries, see streamPELIterator. */
+    struct streamConsumer **consumers; /* By index, NULL if the slot is free. */
+    uint32_t consumers_len;     /* Number of slots of 'consumers'. */
+} streamPEL;
+
+/* Iterates the entries of a streamPEL in ID order, optionally only those
+ * of a single consumer. The PEL may be changed between the calls of
+ * streamPELNext(): the iterator then seeks again past the last entry it
+ * returned. */
+typedef struct streamPELIterator {
+    streamPEL *pel;
+    struct streamConsumer *consumer; /* If not NULL, only its entries. */
+    uint64_t version;           /* Of the PEL when the block was decoded. */
+    streamID next;              /* Entries below it were returned. */
+    int eof;
+    unsigned pos;               /* Of the next entry in 'entries'. */
+    unsigned count;             /* Number of entries in 'entries'. */
+    unsigned char block_key[sizeof(streamID)];
+    streamPendingEntry entries[STREAM_PEL_BLOCK_MAX];
+} streamPELIterator;
+
 /* Consumer group. */
 typedef struct streamCG {
     streamID last_id;       /* Last delivered (not acknowledged) ID for this
@@ -64,12 +111,9 @@ typedef struct streamCG {
                                group reads. In the real world, the reasoning behind
                                this value is detailed at the top comment of
                                streamEstimateDistanceFromFirstEverEntry(). */
-    rax *pel;               /* Pending entries list. This is a radix tree that
-                               has every message delivered to consumers (without
-                               the NOACK option) that was yet not acknowledged
-                               as processed. The key of the radix tree is the
-                               ID as a 64 bit big endian number, while the
-                               associated value is a streamNACK structure.*/
+    streamPEL *pel;         /* Pending entries list: every message delivered
+                               to consumers (without the NOACK option) that
+                               was yet not acknowledged as processed. */
     rax *consumers;         /* A radix tree representing the consumers by name
                                and their associated representation in the form
                                of streamConsumer structures. */
@@ -81,23 +125,11 @@ typedef struct streamConsumer {
     sds name;                   /* Consumer name. This is how the consumer
                                    will be identified in the consumer group
                                    protocol. Case sensitive. */
-    rax *pel;                   /* Consumer specific pending entries list: all
-                                   the pending messages delivered to this
-                                   consumer not yet acknowledged. Keys are
-                                   big endian message IDs, while values are
-                                   the same streamNACK structure referenced
-                                   in the "pel" of the consumer group structure
-                                   itself, so the value is shared. */
+    uint64_t pel_count;         /* Number of the entries of the group PEL
+                                   delivered to this consumer. */
+    uint32_t pel_index;         /* Index of the consumer in the group PEL. */
 } streamConsumer;
 
-/* Pending (yet not acknowledged) message in a consumer group. */
-typedef struct streamNACK {
-    mstime_t delivery_time;     /* Last time this message was delivered. */
-    uint64_t delivery_count;    /* Number of times this message was delivered.*/
-    streamConsumer *consumer;   /* The consumer this message was delivered to
-                                   in the last delivery. */
-} streamNACK;
-
 /* Stream propagation information, passed to functions in order to propagate
  * XCLAIM commands to AOF and slaves. */
 typedef struct streamPropInfo {
@@ -157,12 +189,10 @@ streamCG *streamLookupCG(stream *s, sds groupname);
 streamConsumer *streamLookupConsumer(streamCG *cg, sds name, int flags);
 streamConsumer *streamCreateConsumer(streamCG *cg, sds name, robj *key, int dbid, int flags);
 streamCG *streamCreateCG(stream *s, const char *name, size_t namelen, streamID *id, long long entries_read);
-streamNACK *streamCreateNACK(streamConsumer *consumer);
 void streamEncodeID(void *buf, streamID *id);
 void streamDecodeID(void *buf, streamID *id);
 int streamCompareID(streamID *a, streamID *b);
 int streamEntryExists(stream *s, streamID *id);
-void streamFreeNACK(streamNACK *na);
 int streamIncrID(streamID *id);
 int streamDecrID(streamID *id);
 // void streamPropagateConsumerCreation(client *c, robj *key, robj *groupname, sds consumername);
@@ -184,4 +214,18 @@ int streamIDEqZero(streamID *id);
 int streamRangeHasTombstones(stream *s, streamID *start, streamID *end);
 long long streamCGLag(stream *s, streamCG *cg);
 
+streamPEL *streamPELNew(void);
+void streamPELFree(streamPEL *pel);
+size_t streamPELAllocatedBytes(const streamPEL *pel);
+void streamPELAddConsumer(streamPEL *pel, streamConsumer *consumer);
+void streamPELRemoveConsumer(streamPEL *pel, streamConsumer *consumer);
+int streamPELFind(streamPEL *pel, streamID *id, streamPendingEntry *entry);
+int streamPELInsert(streamPEL *pel, const streamPendingEntry *entry);
+int streamPELUpdate(streamPEL *pel, const streamPendingEntry *entry);
+int streamPELDelete(streamPEL *pel, streamID *id);
+int streamPELLastID(streamPEL *pel, streamID *id);
+void streamPELIteratorStart(streamPELIterator *it, streamPEL *pel, streamID *start,
+                            streamConsumer *consumer);
+int streamPELNext(streamPELIterator *it, streamPendingEntry *entry);
+
 #endif
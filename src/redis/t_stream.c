@@ -60,7 +60,6 @@
 #define STREAM_LISTPACK_MAX_SIZE (1<<30)
 
 void streamFreeCG(streamCG *cg);
-void streamFreeNACK(streamNACK *na);
 
 #if ROMAN_ENABLE
 size_t streamReplyWithRangeFromConsumerPEL(client *c, stream *s, streamID *start, streamID *end, size_t count, streamConsumer *consumer);
@@ -218,20 +217,9 @@ robj *streamDup(robj *o) {
 
         serverAssert(new_cg != NULL);
 
-        /* Consumer Group PEL */
-        raxIterator ri_cg_pel;
-        raxStart(&ri_cg_pel,cg->pel);
-        raxSeek(&ri_cg_pel,"^",NULL,0);
-        while(raxNext(&ri_cg_pel)){
-            streamNACK *nack = ri_cg_pel.data;
-            streamNACK *new_nack = streamCreateNACK(NULL);
-            new_nack->delivery_time = nack->delivery_time;
-            new_nack->delivery_count = nack->delivery_count;
-            raxInsert(new_cg->pel, ri_cg_pel.key, sizeof(streamID), new_nack, NULL);
-        }
-        raxStop(&ri_cg_pel);
-
-        /* Consumers */
+        /* Consumers, by their index in the PEL of the group. */
+        streamConsumer **new_consumers =
+            zcalloc(sizeof(streamConsumer *) * (cg->pel->consumers_len + 1));
         raxIterator ri_consumers;
         raxStart(&ri_consumers, cg->consumers);
         raxSeek(&ri_consumers, "^", NULL, 0);
@@ -240,26 +228,23 @@ robj *streamDup(robj *o) {
             streamConsumer *new_consumer;
             new_consumer = zmalloc(sizeof(*new_consumer));
             new_consumer->name = sdsdup(consumer->name);
-            new_consumer->pel = raxNew();
             raxInsert(new_cg->consumers,(unsigned char *)new_consumer->name,
                         sdslen(new_consumer->name), new_consumer, NULL);
             new_consumer->seen_time = consumer->seen_time;
-
-            /* Consumer PEL */
-            raxIterator ri_cpel;
-            raxStart(&ri_cpel, consumer->pel);
-            raxSeek(&ri_cpel, "^", NULL, 0);
-            while (raxNext(&ri_cpel)) {
-                streamNACK *new_nack = raxFind(new_cg->pel,ri_cpel.key,sizeof(streamID));
-
-                serverAssert(new_nack != raxNotFound);
-
-                new_nack->consumer = new_consumer;
-                raxInsert(new_consumer->pel,ri_cpel.key,sizeof(streamID),new_nack,NULL);
-            }
-            raxStop(&ri_cpel);
+            streamPELAddConsumer(new_cg->pel, new_consumer);
+            new_consumers[consumer->pel_index] = new_consumer;
         }
         raxStop(&ri_consumers);
+
+        /* Consumer Group PEL, appended in ID order. */
+        streamPELIterator pi;
+        streamPendingEntry entry;
+        streamPELIteratorStart(&pi, cg->pel, NULL, NULL);
+        while (streamPELNext(&pi, &entry)) {
+            if (entry.consumer) entry.consumer = new_consumers[entry.consumer->pel_index];
+            serverAssert(streamPELInsert(new_cg->pel, &entry));
+        }
+        zfree(new_consumers);
     }
     raxStop(&ri_cgroups);
     return sobj;
@@ -2456,33 +2441,497 @@ cleanup: /* Cleanup. */
 #endif
 
 /* -----------------------------------------------------------------------
- * Low level implementation of consumer groups
+ * Pending entries list of the consumer groups
  * ----------------------------------------------------------------------- */
 
-/* Create a NACK entry setting the delivery count to 1 and the delivery
- * time to the current time. The NACK consumer will be set to the one
- * specified as argument of the function. */
-streamNACK *streamCreateNACK(streamConsumer *consumer) {
-    streamNACK *nack = zmalloc(sizeof(*nack));
-    nack->delivery_time = mstime();
-    nack->delivery_count = 1;
-    nack->consumer = consumer;
-    return nack;
+/* A block of a streamPEL. Its entries are encoded as PEL_ENTRY_FIELDS varints
+ * each, see pelEntryFields(). */
+typedef struct pelBlock {
+    streamID last_id;           /* ID of the last entry, for the appends. */
+    mstime_t last_time;         /* Delivery time of the last entry. */
+    uint64_t consumers_mask;    /* Bit (index % 64) of every consumer of the
+                                   entries. */
+    uint16_t count;             /* Number of entries. */
+    uint16_t bytes;             /* Used bytes of 'data'. */
+    unsigned char data[];
+} pelBlock;
+
+#define PEL_ENTRY_FIELDS 5
+
+static unsigned pelVarintLen(uint64_t v) {
+    unsigned len = 1;
+    while (v >= 0x80) {
+        v >>= 7;
+        len++;
+    }
+    return len;
+}
+
+static unsigned char *pelPutVarint(unsigned char *p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+static const unsigned char *pelGetVarint(const unsigned char *p, uint64_t *v) {
+    uint64_t res = 0;
+    unsigned shift = 0;
+    while (*p & 0x80) {
+        res |= (uint64_t)(*p++ & 0x7f) << shift;
+        shift += 7;
+    }
+    *v = res | ((uint64_t)*p++ << shift);
+    return p;
+}
+
+static uint64_t pelZigzag(uint64_t v) {
+    return (v << 1) ^ (uint64_t)((int64_t)v >> 63);
+}
+
+static uint64_t pelUnzigzag(uint64_t v) {
+    return (v >> 1) ^ (0 - (v & 1));
+}
+
+/* Sets the varints of the entry 'e' that follows 'prev' in its block, or
+ * that is the first one of its block if 'prev' is NULL. The IDs increase
+ * inside a block, so the ID is stored as the milliseconds delta followed by
+ * the sequence delta minus one when the milliseconds are the same, or by the
+ * sequence itself otherwise. The delivery times are stored as zigzag deltas
+ * and the consumers by their index plus one, zero meaning no consumer. */
+static void pelEntryFields(const streamPendingEntry *e, const streamPendingEntry *prev,
+                           uint64_t *f) {
+    if (prev == NULL) {
+        f[0] = e->id.ms;
+        f[1] = e->id.seq;
+        f[2] = pelZigzag(e->delivery_time);
+    } else {
+        f[0] = e->id.ms - prev->id.ms;
+        f[1] = f[0] ? e->id.seq : e->id.seq - prev->id.seq - 1;
+        f[2] = pelZigzag((uint64_t)e->delivery_time - (uint64_t)prev->delivery_time);
+    }
+    f[3] = e->delivery_count;
+    f[4] = e->consumer ? (uint64_t)e->consumer->pel_index + 1 : 0;
+}
+
+static uint64_t pelConsumerBit(const streamConsumer *consumer) {
+    return 1ULL << (consumer->pel_index & 63);
+}
+
+/* Encodes the entries into a block, reusing the allocation of 'b' if it is
+ * not NULL. Returns the block, which may have been reallocated. */
+static pelBlock *pelEncode(pelBlock *b, const streamPendingEntry *entries, unsigned count) {
+    uint64_t f[PEL_ENTRY_FIELDS];
+    size_t bytes = 0;
+    for (unsigned i = 0; i < count; i++) {
+        pelEntryFields(&entries[i], i ? &entries[i-1] : NULL, f);
+        for (unsigned j = 0; j < PEL_ENTRY_FIELDS; j++) bytes += pelVarintLen(f[j]);
+    }
+
+    size_t needed = sizeof(*b) + bytes;
+    if (b == NULL) {
+        b = zmalloc(needed);
+    } else {
+        size_t usable = zmalloc_usable_size(b);
+        if (usable < needed || usable > 2 * needed) b = zrealloc(b, needed);
+    }
+
+    unsigned char *p = b->data;
+    uint64_t mask = 0;
+    for (unsigned i = 0; i < count; i++) {
+        pelEntryFields(&entries[i], i ? &entries[i-1] : NULL, f);
+        for (unsigned j = 0; j < PEL_ENTRY_FIELDS; j++) p = pelPutVarint(p, f[j]);
+        if (entries[i].consumer) mask |= pelConsumerBit(entries[i].consumer);
+    }
+    b->count = count;
+    b->bytes = bytes;
+    b->last_id = entries[count-1].id;
+    b->last_time = entries[count-1].delivery_time;
+    b->consumers_mask = mask;
+    return b;
+}
+
+/* Appends an entry with an ID above the last one of the block, which must
+ * have less than STREAM_PEL_BLOCK_MAX entries. Returns the block, which may
+ * have been reallocated. */
+static pelBlock *pelAppend(pelBlock *b, const streamPendingEntry *entry) {
+    streamPendingEntry last = {b->last_id, b->last_time, 0, NULL};
+    uint64_t f[PEL_ENTRY_FIELDS];
+    size_t bytes = 0;
+    pelEntryFields(entry, &last, f);
+    for (unsigned j = 0; j < PEL_ENTRY_FIELDS; j++) bytes += pelVarintLen(f[j]);
+
+    size_t needed = sizeof(*b) + b->bytes + bytes;
+    if (zmalloc_usable_size(b) < needed) b = zrealloc(b, needed);
+
+    unsigned char *p = b->data + b->bytes;
+    for (unsigned j = 0; j < PEL_ENTRY_FIELDS; j++) p = pelPutVarint(p, f[j]);
+    b->count++;
+    b->bytes += bytes;
+    b->last_id = entry->id;
+    b->last_time = entry->delivery_time;
+    if (entry->consumer) b->consumers_mask |= pelConsumerBit(entry->consumer);
+    return b;
+}
+
+/* Decodes all the entries of the block, returns their number. */
+static unsigned pelDecode(streamPEL *pel, const pelBlock *b, streamPendingEntry *entries) {
+    const unsigned char *p = b->data;
+    uint64_t f[PEL_ENTRY_FIELDS];
+    for (unsigned i = 0; i < b->count; i++) {
+        for (unsigned j = 0; j < PEL_ENTRY_FIELDS; j++) p = pelGetVarint(p, &f[j]);
+        streamPendingEntry *e = &entries[i];
+        if (i == 0) {
+            e->id.ms = f[0];
+            e->id.seq = f[1];
+            e->delivery_time = (mstime_t)pelUnzigzag(f[2]);
+        } else {
+            const streamPendingEntry *prev = &entries[i-1];
+            e->id.ms = prev->id.ms + f[0];
+            e->id.seq = f[0] ? f[1] : prev->id.seq + f[1] + 1;
+            e->delivery_time = (mstime_t)((uint64_t)prev->delivery_time + pelUnzigzag(f[2]));
+        }
+        e->delivery_count = f[3];
+        e->consumer = f[4] ? pel->consumers[f[4] - 1] : NULL;
+    }
+    return b->count;
+}
+
+/* Returns the index of the first entry with an ID not below 'id'. */
+static unsigned pelLowerBound(const streamPendingEntry *entries, unsigned count, streamID *id) {
+    unsigned lo = 0, hi = count;
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        if (streamCompareID((streamID *)&entries[mid].id, id) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Seeks the blocks with 'op' and returns the first block found, copying its
+ * key to 'key', or NULL if there is none. */
+static pelBlock *pelSeekBlock(streamPEL *pel, const char *op, const unsigned char *seek_key,
+                              unsigned char *key) {
+    raxIterator ri;
+    pelBlock *b = NULL;
+    raxStart(&ri, pel->blocks);
+    raxSeek(&ri, op, (unsigned char *)seek_key, seek_key ? sizeof(streamID) : 0);
+    if (raxNext(&ri)) {
+        b = ri.data;
+        memcpy(key, ri.key, sizeof(streamID));
+    }
+    raxStop(&ri);
+    return b;
+}
+
+/* Returns the block that would hold the entry with the ID 'id', which is
+ * the one with the greatest key not above it, or NULL if there is none. */
+static pelBlock *pelFindBlock(streamPEL *pel, streamID *id, unsigned char *key) {
+    unsigned char id_key[sizeof(streamID)];
+    streamEncodeID(id_key, id);
+    return pelSeekBlock(pel, "<=", id_key, key);
+}
+
+/* Stores the block 'b' that replaced the block 'old' under 'key'. */
+static void pelStoreBlock(streamPEL *pel, unsigned char *key, pelBlock *old, pelBlock *b) {
+    if (b != old) raxInsert(pel->blocks, key, sizeof(streamID), b, NULL);
+}
+
+streamPEL *streamPELNew(void) {
+    streamPEL *pel = zmalloc(sizeof(*pel));
+    pel->blocks = raxNew();
+    pel->size = 0;
+    pel->version = 0;
+    pel->consumers = NULL;
+    pel->consumers_len = 0;
+    return pel;
+}
+
+/* Frees the PEL, but not its consumers. */
+void streamPELFree(streamPEL *pel) {
+    raxFreeWithCallback(pel->blocks, zfree);
+    zfree(pel->consumers);
+    zfree(pel);
+}
+
+/* Returns the allocated bytes of the blocks and of the consumers table. */
+size_t streamPELAllocatedBytes(const streamPEL *pel) {
+    size_t res = zmalloc_usable_size(pel);
+    if (pel->consumers) res += zmalloc_usable_size(pel->consumers);
+
+    raxIterator ri;
+    raxStart(&ri, pel->blocks);
+    raxSeek(&ri, "^", NULL, 0);
+    while (raxNext(&ri)) res += zmalloc_usable_size(ri.data);
+    raxStop(&ri);
+    return res;
+}
+
+/* Assigns an index of the PEL to the consumer, which must be done before it
+ * is set as the consumer of any entry. */
+void streamPELAddConsumer(streamPEL *pel, streamConsumer *consumer) {
+    uint32_t index = 0;
+    while (index < pel->consumers_len && pel->consumers[index] != NULL) index++;
+    if (index == pel->consumers_len) {
+        uint32_t len = pel->consumers_len ? pel->consumers_len * 2 : 4;
+        pel->consumers = zrealloc(pel->consumers, len * sizeof(streamConsumer *));
+        memset(pel->consumers + pel->consumers_len, 0,
+               (len - pel->consumers_len) * sizeof(streamConsumer *));
+        pel->consumers_len = len;
+    }
+    pel->consumers[index] = consumer;
+    consumer->pel_index = index;
+    consumer->pel_count = 0;
 }
 
-/* Free a NACK entry. */
-void streamFreeNACK(streamNACK *na) {
-    zfree(na);
+/* Deletes all the entries of the consumer and releases its index. */
+void streamPELRemoveConsumer(streamPEL *pel, streamConsumer *consumer) {
+    if (consumer->pel_count) {
+        streamPendingEntry entries[STREAM_PEL_BLOCK_MAX];
+        uint64_t bit = pelConsumerBit(consumer);
+        raxIterator ri;
+        raxStart(&ri, pel->blocks);
+        raxSeek(&ri, "^", NULL, 0);
+        while (consumer->pel_count && raxNext(&ri)) {
+            pelBlock *b = ri.data;
+            if (!(b->consumers_mask & bit)) continue;
+
+            unsigned count = pelDecode(pel, b, entries), kept = 0;
+            for (unsigned i = 0; i < count; i++) {
+                if (entries[i].consumer != consumer) entries[kept++] = entries[i];
+            }
+            if (kept == count) continue;
+
+            pel->size -= count - kept;
+            consumer->pel_count -= count - kept;
+            if (kept == 0) {
+                raxRemove(pel->blocks, ri.key, ri.key_len, NULL);
+                zfree(b);
+                raxSeek(&ri, ">", ri.key, ri.key_len);
+            } else {
+                pelBlock *nb = pelEncode(b, entries, kept);
+                if (nb != b) raxSetData(ri.node, nb);
+            }
+        }
+        raxStop(&ri);
+        pel->version++;
+    }
+    pel->consumers[consumer->pel_index] = NULL;
 }
 
+/* Looks up the entry with the ID 'id'. Returns 1 and sets 'entry' if it
+ * exists, 0 otherwise. */
+int streamPELFind(streamPEL *pel, streamID *id, streamPendingEntry *entry) {
+    streamPendingEntry entries[STREAM_PEL_BLOCK_MAX];
+    unsigned char key[sizeof(streamID)];
+    pelBlock *b = pelFindBlock(pel, id, key);
+    if (b == NULL || streamCompareID(id, &b->last_id) > 0) return 0;
+
+    unsigned count = pelDecode(pel, b, entries);
+    unsigned pos = pelLowerBound(entries, count, id);
+    if (pos == count || streamCompareID(&entries[pos].id, id) != 0) return 0;
+    if (entry) *entry = entries[pos];
+    return 1;
+}
+
+/* Inserts the entry. Returns 1 on success, or 0 if there is already an
+ * entry with its ID. */
+int streamPELInsert(streamPEL *pel, const streamPendingEntry *entry) {
+    streamPendingEntry entries[STREAM_PEL_BLOCK_MAX + 1];
+    unsigned char key[sizeof(streamID)], id_key[sizeof(streamID)];
+    streamID id = entry->id;
+    streamEncodeID(id_key, &id);
+
+    pelBlock *b = pelSeekBlock(pel, "<=", id_key, key);
+    if (b == NULL) {
+        b = pelSeekBlock(pel, "^", NULL, key);
+        if (b != NULL) {
+            /* The entry becomes the first one of the first block, so the
+             * block is keyed by its ID. */
+            raxRemove(pel->blocks, key, sizeof(key), NULL);
+            memcpy(key, id_key, sizeof(key));
+            raxInsert(pel->blocks, key, sizeof(key), b, NULL);
+        }
+    }
+
+    if (b == NULL || (streamCompareID(&id, &b->last_id) > 0 &&
+                      b->count == STREAM_PEL_BLOCK_MAX)) {
+        raxInsert(pel->blocks, id_key, sizeof(id_key), pelEncode(NULL, entry, 1), NULL);
+    } else if (streamCompareID(&id, &b->last_id) > 0) {
+        pelStoreBlock(pel, key, b, pelAppend(b, entry));
+    } else {
+        unsigned count = pelDecode(pel, b, entries);
+        unsigned pos = pelLowerBound(entries, count, &id);
+        if (pos < count && streamCompareID(&entries[pos].id, &id) == 0) return 0;
+
+        memmove(&entries[pos+1], &entries[pos], (count - pos) * sizeof(*entries));
+        entries[pos] = *entry;
+        count++;
+        if (count > STREAM_PEL_BLOCK_MAX) {
+            /* Split the block in halves. */
+            unsigned char split_key[sizeof(streamID)];
+            unsigned half = count / 2;
+            streamEncodeID(split_key, &entries[half].id);
+            raxInsert(pel->blocks, split_key, sizeof(split_key),
+                      pelEncode(NULL, entries + half, count - half), NULL);
+            count = half;
+        }
+        pelStoreBlock(pel, key, b, pelEncode(b, entries, count));
+    }
+
+    pel->size++;
+    pel->version++;
+    if (entry->consumer) entry->consumer->pel_count++;
+    return 1;
+}
+
+/* Sets the delivery time, the delivery count and the consumer of the entry
+ * with the ID of 'entry'. Returns 1 on success, or 0 if there is no such
+ * entry. */
+int streamPELUpdate(streamPEL *pel, const streamPendingEntry *entry) {
+    streamPendingEntry entries[STREAM_PEL_BLOCK_MAX];
+    unsigned char key[sizeof(streamID)];
+    streamID id = entry->id;
+    pelBlock *b = pelFindBlock(pel, &id, key);
+    if (b == NULL || streamCompareID(&id, &b->last_id) > 0) return 0;
+
+    unsigned count = pelDecode(pel, b, entries);
+    unsigned pos = pelLowerBound(entries, count, &id);
+    if (pos == count || streamCompareID(&entries[pos].id, &id) != 0) return 0;
+
+    if (entries[pos].consumer) entries[pos].consumer->pel_count--;
+    if (entry->consumer) entry->consumer->pel_count++;
+    entries[pos] = *entry;
+    pelStoreBlock(pel, key, b, pelEncode(b, entries, count));
+    pel->version++;
+    return 1;
+}
+
+/* Deletes the entry with the ID 'id'. Returns 1 on success, or 0 if there
+ * is no such entry. */
+int streamPELDelete(streamPEL *pel, streamID *id) {
+    streamPendingEntry entries[STREAM_PEL_BLOCK_MAX];
+    unsigned char key[sizeof(streamID)];
+    pelBlock *b = pelFindBlock(pel, id, key);
+    if (b == NULL || streamCompareID(id, &b->last_id) > 0) return 0;
+
+    unsigned count = pelDecode(pel, b, entries);
+    unsigned pos = pelLowerBound(entries, count, id);
+    if (pos == count || streamCompareID(&entries[pos].id, id) != 0) return 0;
+
+    streamConsumer *consumer = entries[pos].consumer;
+    memmove(&entries[pos], &entries[pos+1], (count - pos - 1) * sizeof(*entries));
+    count--;
+    if (count == 0) {
+        raxRemove(pel->blocks, key, sizeof(key), NULL);
+        zfree(b);
+    } else {
+        if (count <= STREAM_PEL_BLOCK_MAX / 4) {
+            /* Merge the next block into this one if both are small. */
+            unsigned char next_key[sizeof(streamID)];
+            pelBlock *next = pelSeekBlock(pel, ">", key, next_key);
+            if (next && count + next->count <= STREAM_PEL_BLOCK_MAX / 2) {
+                count += pelDecode(pel, next, entries + count);
+                raxRemove(pel->blocks, next_key, sizeof(next_key), NULL);
+                zfree(next);
+            }
+        }
+        pelStoreBlock(pel, key, b, pelEncode(b, entries, count));
+    }
+
+    pel->size--;
+    pel->version++;
+    if (consumer) consumer->pel_count--;
+    return 1;
+}
+
+/* Sets 'id' to the greatest ID of the entries. Returns 0 if the PEL is
+ * empty. */
+int streamPELLastID(streamPEL *pel, streamID *id) {
+    unsigned char key[sizeof(streamID)];
+    pelBlock *b = pelSeekBlock(pel, "$", NULL, key);
+    if (b == NULL) return 0;
+    *id = b->last_id;
+    return 1;
+}
+
+/* Decodes the first block that 'ri' returns with entries of the consumer of
+ * the iterator. */
+static void pelIteratorLoad(streamPELIterator *it, raxIterator *ri) {
+    while (raxNext(ri)) {
+        pelBlock *b = ri->data;
+        if (it->consumer && !(b->consumers_mask & pelConsumerBit(it->consumer))) continue;
+        memcpy(it->block_key, ri->key, sizeof(it->block_key));
+        it->count = pelDecode(it->pel, b, it->entries);
+        it->pos = 0;
+        return;
+    }
+    it->eof = 1;
+}
+
+/* Decodes the block of the first entry not below 'it->next'. */
+static void pelIteratorSeek(streamPELIterator *it) {
+    unsigned char key[sizeof(streamID)];
+    raxIterator ri;
+    streamEncodeID(key, &it->next);
+    it->version = it->pel->version;
+    it->pos = it->count = 0;
+    raxStart(&ri, it->pel->blocks);
+    raxSeek(&ri, "<=", key, sizeof(key));
+    if (raxEOF(&ri)) raxSeek(&ri, "^", NULL, 0);
+    pelIteratorLoad(it, &ri);
+    raxStop(&ri);
+    if (!it->eof) it->pos = pelLowerBound(it->entries, it->count, &it->next);
+}
+
+/* Starts iterating the entries with an ID not below 'start', or all of them
+ * if it is NULL. If 'consumer' is not NULL, only its entries are returned. */
+void streamPELIteratorStart(streamPELIterator *it, streamPEL *pel, streamID *start,
+                            streamConsumer *consumer) {
+    it->pel = pel;
+    it->consumer = consumer;
+    it->eof = 0;
+    it->next.ms = start ? start->ms : 0;
+    it->next.seq = start ? start->seq : 0;
+    pelIteratorSeek(it);
+}
+
+/* Sets 'entry' to the next entry. Returns 0 when there are no more. */
+int streamPELNext(streamPELIterator *it, streamPendingEntry *entry) {
+    if (!it->eof && it->version != it->pel->version) pelIteratorSeek(it);
+    while (!it->eof) {
+        while (it->pos < it->count) {
+            streamPendingEntry *e = &it->entries[it->pos++];
+            if (it->consumer && e->consumer != it->consumer) continue;
+            *entry = *e;
+            it->next = e->id;
+            if (streamIncrID(&it->next) != C_OK) it->eof = 1;
+            return 1;
+        }
+
+        raxIterator ri;
+        raxStart(&ri, it->pel->blocks);
+        raxSeek(&ri, ">", it->block_key, sizeof(it->block_key));
+        pelIteratorLoad(it, &ri);
+        raxStop(&ri);
+    }
+    return 0;
+}
+
+/* -----------------------------------------------------------------------
+ * Low level implementation of consumer groups
+ * ----------------------------------------------------------------------- */
+
 /* Free a consumer and associated data structures. Note that this function
  * will not reassign the pending messages associated with this consumer
  * nor will delete them from the stream, so when this function is called
  * to delete a consumer, and not when the whole stream is destroyed, the caller
  * should do some work before. */
 void streamFreeConsumer(streamConsumer *sc) {
-    raxFree(sc->pel); /* No value free callback: the PEL entries are shared
-                         between the consumer and the main stream PEL. */
     sdsfree(sc->name);
     zfree(sc);
 }
@@ -2497,7 +2946,7 @@ streamCG *streamCreateCG(stream *s, const char *name, size_t namelen, streamID *
         return NULL;
 
     streamCG *cg = zmalloc(sizeof(*cg));
-    cg->pel = raxNew();
+    cg->pel = streamPELNew();
     cg->consumers = raxNew();
     cg->last_id = *id;
     cg->entries_read = entries_read;
@@ -2507,7 +2956,7 @@ streamCG *streamCreateCG(stream *s, const char *name, size_t namelen, streamID *
 
 /* Free a consumer group and all its associated data. */
 void streamFreeCG(streamCG *cg) {
-    raxFreeWithCallback(cg->pel,(void(*)(void*))streamFreeNACK);
+    streamPELFree(cg->pel);
     raxFreeWithCallback(cg->consumers,(void(*)(void*))streamFreeConsumer);
     zfree(cg);
 }
@@ -2535,8 +2984,8 @@ streamConsumer *streamCreateConsumer(streamCG *cg, sds name, robj *key, int dbid
         return NULL;
     }
     consumer->name = sdsdup(name);
-    consumer->pel = raxNew();
     consumer->seen_time = mstime();
+    streamPELAddConsumer(cg->pel,consumer);
 
     return consumer;
 }
@@ -2555,17 +3004,8 @@ streamConsumer *streamLookupConsumer(streamCG *cg, sds name, int flags) {
 
 /* Delete the consumer specified in the consumer group 'cg'. */
 void streamDelConsumer(streamCG *cg, streamConsumer *consumer) {
-    /* Iterate all the consumer pending messages, deleting every corresponding
-     * entry from the global entry. */
-    raxIterator ri;
-    raxStart(&ri,consumer->pel);
-    raxSeek(&ri,"^",NULL,0);
-    while(raxNext(&ri)) {
-        streamNACK *nack = ri.data;
-        raxRemove(cg->pel,ri.key,ri.key_len,NULL);
-        streamFreeNACK(nack);
-    }
-    raxStop(&ri);
+    /* Delete all the consumer pending messages from the group PEL. */
+    streamPELRemoveConsumer(cg->pel,consumer);
 
     /* Deallocate the consumer. */
     raxRemove(cg->consumers,(unsigned char*)consumer->name,
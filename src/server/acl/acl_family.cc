@@ -68,11 +68,14 @@ void AclFamily::List(CmdArgList args, ConnectionContext* cntx) {
     const std::string maybe_space_com = acl_commands.empty() ? "" : " ";
     const std::string acl_keys = AclKeysToString(user.Keys());
     const std::string maybe_space = acl_keys.empty() ? "" : " ";
+    const std::string acl_priority = AclPriorityToString(user.GetPriority());
+    const std::string maybe_space_prio = acl_priority.empty() ? "" : " ";
 
     using namespace std::string_view_literals;
 
     absl::StrAppend(&buffer, username, " ", user.IsActive() ? "on "sv : "off "sv, password, " ",
-                    acl_cat, maybe_space_com, acl_commands, maybe_space, acl_keys);
+                    acl_cat, maybe_space_com, acl_commands, maybe_space, acl_keys,
+                    maybe_space_prio, acl_priority);
 
     cntx->SendSimpleString(buffer);
   }
@@ -80,12 +83,13 @@ void AclFamily::List(CmdArgList args, ConnectionContext* cntx) {
 
 void AclFamily::StreamUpdatesToAllProactorConnections(const std::string& user, uint32_t update_cat,
                                                       const Commands& update_commands,
-                                                      const AclKeys& update_keys) {
+                                                      const AclKeys& update_keys,
+                                                      Priority priority) {
   auto update_cb = [&]([[maybe_unused]] size_t id, util::Connection* conn) {
     DCHECK(conn);
     auto connection = static_cast<facade::Connection*>(conn);
-    connection->SendAclUpdateAsync(
-        facade::Connection::AclUpdateMessage{user, update_cat, update_commands, update_keys});
+    connection->SendAclUpdateAsync(facade::Connection::AclUpdateMessage{
+        user, update_cat, update_commands, update_keys, priority});
   };
 
   if (main_listener_) {
@@ -110,7 +114,7 @@ void AclFamily::SetUser(CmdArgList args, ConnectionContext* cntx) {
     user.Update(std::move(req));
     if (exists) {
       StreamUpdatesToAllProactorConnections(std::string(username), user.AclCategory(),
-                                            user.AclCommands(), user.Keys());
+                                            user.AclCommands(), user.Keys(), user.GetPriority());
     }
     cntx->SendOk();
   };
@@ -184,11 +188,14 @@ std::string AclFamily::RegistryToString() const {
     const std::string maybe_space_com = acl_commands.empty() ? "" : " ";
     const std::string acl_keys = AclKeysToString(user.Keys());
     const std::string maybe_space = acl_keys.empty() ? "" : " ";
+    const std::string acl_priority = AclPriorityToString(user.GetPriority());
+    const std::string maybe_space_prio = acl_priority.empty() ? "" : " ";
 
     using namespace std::string_view_literals;
 
     absl::StrAppend(&result, command, username, " ", user.IsActive() ? "ON "sv : "OFF "sv, password,
-                    acl_cat, maybe_space_com, acl_commands, maybe_space, acl_keys, "\n");
+                    acl_cat, maybe_space_com, acl_commands, maybe_space, acl_keys,
+                    maybe_space_prio, acl_priority, "\n");
   }
 
   if (!result.empty()) {
@@ -50,7 +50,7 @@ class AclFamily final {
   using Commands = std::vector<uint64_t>;
   void StreamUpdatesToAllProactorConnections(const std::string& user, uint32_t update_cat,
                                              const Commands& update_commands,
-                                             const AclKeys& update_keys);
+                                             const AclKeys& update_keys, Priority priority);
 
   // Helper function that closes all open connection from the deleted user
   void EvictOpenConnectionsOnAllProactors(std::string_view user);
@@ -11,12 +11,16 @@
 #include "base/logging.h"
 #include "facade/facade_test.h"
 #include "server/acl/acl_commands_def.h"
+#include "server/admission_controller.h"
 #include "server/command_registry.h"
+#include "server/main_service.h"
+#include "server/server_family.h"
 #include "server/test_utils.h"
 
 using namespace testing;
 
 ABSL_DECLARE_FLAG(std::vector<std::string>, rename_command);
+ABSL_DECLARE_FLAG(uint32_t, shed_queue_delay_usec);
 
 namespace dfly {
 
@@ -122,6 +126,29 @@ TEST_F(AclFamilyTest, AclAuth) {
   EXPECT_THAT(resp, "OK");
 }
 
+TEST_F(AclFamilyTest, AclPriority) {
+  TestInitAclFam();
+  EXPECT_THAT(Run({"ACL", "SETUSER", "batch", "ON", ">pass", "+@all", "~*", "priority=urgent"}),
+              ErrArg("ERR Unrecognized parameter PRIORITY=URGENT"));
+  EXPECT_EQ(Run({"ACL", "SETUSER", "batch", "ON", ">pass", "+@all", "~*", "priority=low"}), "OK");
+
+  auto resp = Run({"ACL", "LIST"});
+  EXPECT_THAT(resp.GetVec(),
+              Contains(AllOf(StartsWith("user batch on"), EndsWith(" priority=low"))));
+
+  // The connections authenticated as the user are shed first.
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_shed_queue_delay_usec, 1000);
+  service_->server_family().TEST_admission()->TEST_SetQueueDelay(1500);
+  EXPECT_EQ(Run({"SET", "foo", "bar"}), "OK");
+  EXPECT_EQ(Run({"AUTH", "batch", "pass"}), "OK");
+  EXPECT_THAT(Run({"SET", "foo", "bar"}), ErrArg("OVERLOADED"));
+
+  EXPECT_EQ(Run({"CLIENT", "SETPRIORITY", "NORMAL"}), "OK");
+  EXPECT_EQ(Run({"SET", "foo", "bar"}), "OK");
+  service_->server_family().TEST_admission()->TEST_SetQueueDelay(0);
+}
+
 TEST_F(AclFamilyTest, AclWhoAmI) {
   TestInitAclFam();
   auto resp = Run({"ACL", "WHOAMI", "WHO"});
@@ -407,4 +434,26 @@ TEST_F(AclFamilyTest, TestKeys) {
   EXPECT_THAT(resp, ErrArg("ERR Unrecognized parameter %RFOO"));
 }
 
+TEST_F(AclFamilyTest, TestKeyPermissions) {
+  TestInitAclFam();
+  auto resp = Run({"ACL", "SETUSER", "adi", "ON", ">pass", "+@all", "~foo", "~bar:*", "%R~ro:*",
+                   "%W~wo*", "~a?c"});
+  EXPECT_THAT(resp, "OK");
+  EXPECT_THAT(Run({"AUTH", "adi", "pass"}), "OK");
+
+  EXPECT_THAT(Run({"SET", "foo", "1"}), "OK");
+  EXPECT_THAT(Run({"SET", "bar:1", "1"}), "OK");
+  EXPECT_THAT(Run({"SET", "bar:", "1"}), "OK");
+  EXPECT_THAT(Run({"SET", "abc", "1"}), "OK");
+  EXPECT_THAT(Run({"SET", "wo", "1"}), "OK");
+  EXPECT_THAT(Run({"GET", "ro:1"}), ArgType(RespExpr::Type::NIL));
+
+  EXPECT_THAT(Run({"SET", "fooo", "1"}), ErrArg("NOPERM"));
+  EXPECT_THAT(Run({"SET", "bar", "1"}), ErrArg("NOPERM"));
+  EXPECT_THAT(Run({"SET", "ro:1", "1"}), ErrArg("NOPERM"));
+  EXPECT_THAT(Run({"GET", "wo"}), ErrArg("NOPERM"));
+  EXPECT_THAT(Run({"SET", "abbc", "1"}), ErrArg("NOPERM"));
+  EXPECT_THAT(Run({"MSET", "foo", "1", "baz", "2"}), ErrArg("NOPERM"));
+}
+
 }  // namespace dfly
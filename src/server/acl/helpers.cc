@@ -12,6 +12,7 @@
 #include "absl/strings/match.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_split.h"
+#include "absl/strings/strip.h"
 #include "server/acl/acl_commands_def.h"
 #include "server/common.h"
 
@@ -134,6 +135,33 @@ std::optional<bool> MaybeParseStatus(std::string_view command) {
   return {};
 }
 
+std::optional<Priority> MaybeParsePriority(std::string_view command) {
+  if (!absl::ConsumePrefix(&command, "PRIORITY=")) {
+    return {};
+  }
+  if (command == "LOW") {
+    return Priority::LOW;
+  }
+  if (command == "NORMAL") {
+    return Priority::NORMAL;
+  }
+  if (command == "HIGH") {
+    return Priority::HIGH;
+  }
+  return {};
+}
+
+std::string AclPriorityToString(Priority priority) {
+  switch (priority) {
+    case Priority::LOW:
+      return "priority=low";
+    case Priority::HIGH:
+      return "priority=high";
+    default:
+      return "";
+  }
+}
+
 using OptCat = std::optional<uint32_t>;
 
 // bool == true if +
@@ -275,6 +303,11 @@ std::variant<User::UpdateRequest, ErrorReply> ParseAclSetUser(T args,
       continue;
     }
 
+    if (auto priority = MaybeParsePriority(command); priority) {
+      req.priority = *priority;
+      continue;
+    }
+
     auto [cat, add] = MaybeParseAclCategory(command);
     if (cat) {
       using Sign = User::Sign;
@@ -27,6 +27,12 @@ std::optional<std::string> MaybeParsePassword(std::string_view command, bool has
 
 std::optional<bool> MaybeParseStatus(std::string_view command);
 
+// Parses PRIORITY=LOW|NORMAL|HIGH, command is upper case.
+std::optional<Priority> MaybeParsePriority(std::string_view command);
+
+// Empty for the normal priority, which is the default.
+std::string AclPriorityToString(Priority priority);
+
 using OptCat = std::optional<uint32_t>;
 std::pair<OptCat, bool> MaybeParseAclCategory(std::string_view command);
 
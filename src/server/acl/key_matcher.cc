@@ -0,0 +1,70 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/acl/key_matcher.h"
+
+#include <algorithm>
+
+namespace dfly::acl {
+
+using namespace std;
+
+namespace {
+
+constexpr string_view kGlobChars = "*?[\\";
+
+}  // namespace
+
+KeyMatcher::KeyMatcher(const vector<GlobType>& globs) {
+  for (const auto& [glob, op] : globs) {
+    if (op == KeyOp::READ || op == KeyOp::READ_WRITE)
+      read_.Add(glob);
+    if (op == KeyOp::WRITE || op == KeyOp::READ_WRITE)
+      write_.Add(glob);
+  }
+}
+
+bool KeyMatcher::Matches(string_view key, bool read, bool write) const {
+  return (read && read_.Matches(key)) || (write && write_.Matches(key));
+}
+
+void KeyMatcher::Globs::Add(string_view glob) {
+  size_t special = glob.find_first_of(kGlobChars);
+  if (special == string_view::npos) {
+    literals.emplace(glob);
+    return;
+  }
+
+  if (special + 1 == glob.size() && glob.back() == '*') {
+    glob.remove_suffix(1);
+    if (prefixes.emplace(glob).second) {
+      auto it = lower_bound(prefix_lens.begin(), prefix_lens.end(), glob.size());
+      if (it == prefix_lens.end() || *it != glob.size())
+        prefix_lens.insert(it, glob.size());
+    }
+    return;
+  }
+
+  others.emplace_back(glob);
+}
+
+bool KeyMatcher::Globs::Matches(string_view key) const {
+  if (literals.contains(key))
+    return true;
+
+  // stringmatchlen does not match empty strings with stars, keep its behavior.
+  if (!key.empty()) {
+    for (size_t len : prefix_lens) {
+      if (len > key.size())
+        break;
+      if (prefixes.contains(key.substr(0, len)))
+        return true;
+    }
+  }
+
+  return any_of(others.begin(), others.end(),
+                [key](const GlobMatcher& matcher) { return matcher.Matches(key); });
+}
+
+}  // namespace dfly::acl
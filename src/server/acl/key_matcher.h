@@ -0,0 +1,49 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/container/flat_hash_set.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "core/glob_matcher.h"
+#include "server/acl/acl_commands_def.h"
+
+namespace dfly::acl {
+
+// The key globs of a user compiled once, when the user is updated. It is immutable and shared by
+// all the connections of the user, an update replaces it.
+//
+// Literal globs are looked up in a hash set and globs of a literal prefix followed by a single '*'
+// are looked up by the prefixes of the key, with one hash set per prefix length. Only the other
+// globs are matched one by one.
+class KeyMatcher {
+ public:
+  explicit KeyMatcher(const std::vector<GlobType>& globs);
+
+  // Whether a command that reads, writes or both is allowed to access key.
+  bool Matches(std::string_view key, bool read, bool write) const;
+
+ private:
+  // The globs of one kind of access.
+  struct Globs {
+    void Add(std::string_view glob);
+    bool Matches(std::string_view key) const;
+
+    absl::flat_hash_set<std::string> literals;
+
+    // The prefixes of the prefix globs, by their length.
+    std::vector<size_t> prefix_lens;
+    absl::flat_hash_set<std::string> prefixes;
+
+    std::vector<GlobMatcher> others;
+  };
+
+  Globs read_, write_;
+};
+
+}  // namespace dfly::acl
@@ -10,6 +10,7 @@
 
 #include "absl/strings/escaping.h"
 #include "server/acl/helpers.h"
+#include "server/acl/key_matcher.h"
 
 namespace dfly::acl {
 
@@ -56,6 +57,10 @@ void User::Update(UpdateRequest&& req) {
   if (req.is_active) {
     SetIsActive(*req.is_active);
   }
+
+  if (req.priority) {
+    priority_ = *req.priority;
+  }
 }
 
 void User::SetPasswordHash(std::string_view password, bool is_hashed) {
@@ -138,6 +143,10 @@ const AclKeys& User::Keys() const {
   return keys_;
 }
 
+Priority User::GetPriority() const {
+  return priority_;
+}
+
 void User::SetKeyGlobs(std::vector<UpdateKey> keys) {
   for (auto& key : keys) {
     if (key.all_keys) {
@@ -150,6 +159,10 @@ void User::SetKeyGlobs(std::vector<UpdateKey> keys) {
       keys_.key_globs.push_back({std::move(key.key), key.op});
     }
   }
+
+  // The connections of the user keep the previous matcher until they receive the update.
+  keys_.matcher =
+      keys_.key_globs.empty() ? nullptr : std::make_shared<const KeyMatcher>(keys_.key_globs);
 }
 
 }  // namespace dfly::acl
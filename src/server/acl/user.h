@@ -37,6 +37,8 @@ class User final {
 
     std::optional<bool> is_active{};
 
+    std::optional<Priority> priority{};
+
     bool is_hashed{false};
 
     // If index s numberic_limits::max() then it's a +all flag
@@ -80,6 +82,8 @@ class User final {
 
   const AclKeys& Keys() const;
 
+  Priority GetPriority() const;
+
  private:
   // For ACL categories
   void SetAclCategories(uint32_t cat);
@@ -113,6 +117,9 @@ class User final {
 
   // if the user is on/off
   bool is_active_{false};
+
+  // the priority of the connections authenticated as the user
+  Priority priority_{Priority::NORMAL};
 };
 
 }  // namespace dfly::acl
@@ -33,7 +33,8 @@ UserRegistry::UserCredentials UserRegistry::GetCredentials(std::string_view user
   if (it == registry_.end()) {
     return {};
   }
-  return {it->second.AclCategory(), it->second.AclCommands(), it->second.Keys()};
+  return {it->second.AclCategory(), it->second.AclCommands(), it->second.Keys(),
+          it->second.GetPriority()};
 }
 
 bool UserRegistry::IsUserActive(std::string_view username) const {
@@ -47,6 +47,7 @@ class UserRegistry {
     uint32_t acl_categories{0};
     std::vector<uint64_t> acl_commands;
     AclKeys keys;
+    Priority priority{Priority::NORMAL};
   };
 
   // Acquires a read lock
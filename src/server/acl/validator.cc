@@ -7,13 +7,10 @@
 #include "base/logging.h"
 #include "facade/dragonfly_connection.h"
 #include "server/acl/acl_commands_def.h"
+#include "server/acl/key_matcher.h"
 #include "server/command_registry.h"
 #include "server/server_state.h"
 #include "server/transaction.h"
-// we need this because of stringmatchlen
-extern "C" {
-#include "redis/util.h"
-}
 
 namespace dfly::acl {
 
@@ -53,25 +50,11 @@ namespace dfly::acl {
     return {false, AclLog::Reason::COMMAND};
   }
 
-  auto match = [](const auto& pattern, const auto& target) {
-    return stringmatchlen(pattern.data(), pattern.size(), target.data(), target.size(), 0);
-  };
-
   const bool is_read_command = id.IsReadOnly();
   const bool is_write_command = id.IsWriteOnly();
 
-  auto iterate_globs = [&](auto target) {
-    for (auto& [elem, op] : keys.key_globs) {
-      if (match(elem, target)) {
-        if (is_read_command && (op == KeyOp::READ || op == KeyOp::READ_WRITE)) {
-          return true;
-        }
-        if (is_write_command && (op == KeyOp::WRITE || op == KeyOp::READ_WRITE)) {
-          return true;
-        }
-      }
-    }
-    return false;
+  auto match_key = [&](auto target) {
+    return keys.matcher && keys.matcher->Matches(target, is_read_command, is_write_command);
   };
 
   bool keys_allowed = true;
@@ -80,14 +63,14 @@ namespace dfly::acl {
     const size_t end = keys_index.end;
     if (keys_index.bonus) {
       auto target = facade::ToSV(tail_args[*keys_index.bonus]);
-      if (!iterate_globs(target)) {
+      if (!match_key(target)) {
         keys_allowed = false;
       }
     }
     if (keys_allowed) {
       for (size_t i = keys_index.start; i < end; i += keys_index.step) {
         auto target = facade::ToSV(tail_args[i]);
-        if (!iterate_globs(target)) {
+        if (!match_key(target)) {
           keys_allowed = false;
           break;
         }
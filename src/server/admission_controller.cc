@@ -0,0 +1,92 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/admission_controller.h"
+
+#include "base/flags.h"
+#include "base/logging.h"
+#include "server/engine_shard_set.h"
+
+ABSL_FLAG(uint32_t, shed_queue_delay_usec, 0,
+          "When the queue delay of a shard exceeds this, the commands of low priority connections "
+          "are rejected, and over twice this the commands of all the connections, except admin "
+          "and replication commands. 0 to disable");
+
+namespace dfly {
+
+using namespace std;
+using absl::GetFlag;
+using util::fb2::ProactorBase;
+
+namespace {
+
+// How often the queue delay of the shards is measured.
+constexpr auto kProbeInterval = 1ms;
+
+}  // namespace
+
+AdmissionController::AdmissionController(util::ProactorPool* pool) : pool_(pool) {
+}
+
+AdmissionController::~AdmissionController() {
+  DCHECK(!probe_fb_.IsJoinable());
+}
+
+void AdmissionController::Start() {
+  num_shards_ = shard_set->size();
+  probes_ = make_unique<ShardProbe[]>(num_shards_);
+  probe_fb_ = pool_->GetNextProactor()->LaunchFiber([this] { RunProbe(); });
+}
+
+void AdmissionController::Stop() {
+  if (!probe_fb_.IsJoinable())
+    return;
+
+  probe_done_.Notify();
+  probe_fb_.Join();
+
+  // Wait for the probes still in the queues, they reference this.
+  shard_set->RunBriefInParallel([](EngineShard*) {});
+}
+
+void AdmissionController::TEST_SetQueueDelay(uint64_t usec) {
+  frozen_.store(true, memory_order_relaxed);
+  target_usec_.store(GetFlag(FLAGS_shed_queue_delay_usec), memory_order_relaxed);
+  max_delay_usec_.store(usec, memory_order_relaxed);
+}
+
+void AdmissionController::RunProbe() {
+  while (!probe_done_.WaitFor(kProbeInterval)) {
+    if (frozen_.load(memory_order_relaxed))
+      continue;
+
+    uint32_t target = GetFlag(FLAGS_shed_queue_delay_usec);
+    target_usec_.store(target, memory_order_relaxed);
+    if (target == 0) {
+      max_delay_usec_.store(0, memory_order_relaxed);
+      continue;
+    }
+
+    // A probe that is still waiting in the queue shows the delay growing until it runs.
+    uint64_t now = ProactorBase::GetMonotonicTimeNs();
+    uint64_t max_delay = 0;
+    for (unsigned sid = 0; sid < num_shards_; ++sid) {
+      ShardProbe& probe = probes_[sid];
+      if (uint64_t posted = probe.posted_ns.load(memory_order_acquire); posted != 0) {
+        max_delay = max(max_delay, now - posted);
+        continue;
+      }
+
+      max_delay = max(max_delay, probe.delay_ns.load(memory_order_relaxed));
+      probe.posted_ns.store(now, memory_order_relaxed);
+      shard_set->Add(sid, [&probe, now] {
+        probe.delay_ns.store(ProactorBase::GetMonotonicTimeNs() - now, memory_order_relaxed);
+        probe.posted_ns.store(0, memory_order_release);
+      });
+    }
+    max_delay_usec_.store(max_delay / 1000, memory_order_relaxed);
+  }
+}
+
+}  // namespace dfly
@@ -0,0 +1,66 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include "util/fibers/fibers.h"
+#include "util/fibers/synchronization.h"
+#include "util/proactor_pool.h"
+
+namespace dfly {
+
+// Sheds commands while the shards are saturated, so that the latency of the admitted commands
+// stays bounded instead of the latency of every client degrading together.
+//
+// A probe measures the queue delay of every shard: the time a callback posted to the queue of
+// the shard waits before it runs. While the largest delay exceeds --shed_queue_delay_usec, the
+// commands of the connections with CLIENT SETPRIORITY LOW are rejected, and over twice the target
+// the commands of all the connections. The caller admits admin and replication commands.
+class AdmissionController {
+ public:
+  explicit AdmissionController(util::ProactorPool* pool);
+  ~AdmissionController();
+
+  void Start();
+  void Stop();
+
+  // Whether a command of a connection of the priority is admitted. Thread safe.
+  bool Admit(bool low_priority) const {
+    uint64_t target = target_usec_.load(std::memory_order_relaxed);
+    uint64_t delay = max_delay_usec_.load(std::memory_order_relaxed);
+    return target == 0 || delay <= (low_priority ? target : 2 * target);
+  }
+
+  // The largest queue delay of the shards measured by the last probe.
+  uint64_t QueueDelayUsec() const {
+    return max_delay_usec_.load(std::memory_order_relaxed);
+  }
+
+  // Overrides the measured delay and stops the probe from updating it.
+  void TEST_SetQueueDelay(uint64_t usec);
+
+ private:
+  struct ShardProbe {
+    std::atomic<uint64_t> posted_ns{0};  // when the pending probe was posted, 0 if none
+    std::atomic<uint64_t> delay_ns{0};   // of the last probe that ran
+  };
+
+  void RunProbe();
+
+  util::ProactorPool* pool_;
+  std::unique_ptr<ShardProbe[]> probes_;
+  unsigned num_shards_ = 0;
+
+  std::atomic<uint64_t> target_usec_{0};
+  std::atomic<uint64_t> max_delay_usec_{0};
+  std::atomic_bool frozen_{false};
+
+  util::fb2::Fiber probe_fb_;
+  util::fb2::Done probe_done_;
+};
+
+}  // namespace dfly
@@ -0,0 +1,114 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/big_keys.h"
+
+#include <absl/numeric/bits.h>
+
+#include <algorithm>
+
+namespace dfly {
+
+using namespace std;
+
+void BigKeys::OnUpdate(string_view key, unsigned type, size_t bytes, size_t elements) {
+  if (bytes < kMinBytes) {
+    OnDelete(key);
+    return;
+  }
+
+  // The pass may have visited the key already, so it is updated in its lists too.
+  Place(key, type, bytes, elements, &Key::bytes, &by_bytes_);
+  Place(key, type, bytes, elements, &Key::elements, &by_elements_);
+  Place(key, type, bytes, elements, &Key::bytes, &pass_by_bytes_);
+  Place(key, type, bytes, elements, &Key::elements, &pass_by_elements_);
+  UpdateMinBytes();
+}
+
+void BigKeys::OnDelete(string_view key) {
+  for (auto* list : {&by_bytes_, &by_elements_, &pass_by_bytes_, &pass_by_elements_})
+    Erase(key, list);
+  UpdateMinBytes();
+}
+
+void BigKeys::Sample(unsigned type, unsigned encoding, size_t bytes) {
+  for (Histogram* hist : {&pass_histograms_[type], &pass_encoding_histograms_[{type, encoding}]}) {
+    ++hist->buckets[Bucket(bytes)];
+    hist->sum += bytes;
+  }
+}
+
+void BigKeys::OnScanned(string_view key, unsigned type, size_t bytes, size_t elements) {
+  if (bytes < kMinBytes)
+    return;
+
+  Place(key, type, bytes, elements, &Key::bytes, &pass_by_bytes_);
+  Place(key, type, bytes, elements, &Key::elements, &pass_by_elements_);
+  UpdateMinBytes();
+}
+
+void BigKeys::FinishScan() {
+  by_bytes_ = std::move(pass_by_bytes_);
+  by_elements_ = std::move(pass_by_elements_);
+  histograms_ = std::move(pass_histograms_);
+  encoding_histograms_ = std::move(pass_encoding_histograms_);
+  pass_by_bytes_.clear();
+  pass_by_elements_.clear();
+  pass_histograms_.clear();
+  pass_encoding_histograms_.clear();
+  UpdateMinBytes();
+}
+
+void BigKeys::Clear() {
+  *this = BigKeys{};
+}
+
+unsigned BigKeys::Bucket(size_t bytes) {
+  return min<unsigned>(absl::bit_width(bytes), kNumBuckets - 1);
+}
+
+void BigKeys::Place(string_view key, unsigned type, size_t bytes, size_t elements,
+                    size_t Key::*field, vector<Key>* list) {
+  auto it = find_if(list->begin(), list->end(), [key](const Key& k) { return k.key == key; });
+  if (it == list->end()) {
+    size_t value = field == &Key::bytes ? bytes : elements;
+    if (list->size() < kMaxKeys) {
+      it = list->emplace(list->end());
+    } else if (list->back().*field < value) {
+      it = prev(list->end());
+    } else {
+      return;
+    }
+    it->key = key;
+  }
+
+  it->type = type;
+  it->bytes = bytes;
+  it->elements = elements;
+  sort(list->begin(), list->end(),
+       [field](const Key& a, const Key& b) { return a.*field > b.*field; });
+}
+
+void BigKeys::Erase(string_view key, vector<Key>* list) {
+  auto it = find_if(list->begin(), list->end(), [key](const Key& k) { return k.key == key; });
+  if (it != list->end())
+    list->erase(it);
+}
+
+void BigKeys::UpdateMinBytes() {
+  // A key enters a list that is not full or replaces its last key. The lists sorted by elements
+  // are not sorted by bytes, so all the keys are checked.
+  size_t min_bytes = SIZE_MAX;
+  for (const auto* list : {&by_bytes_, &by_elements_, &pass_by_bytes_, &pass_by_elements_}) {
+    if (list->size() < kMaxKeys) {
+      min_bytes = 0;
+      break;
+    }
+    for (const Key& k : *list)
+      min_bytes = min(min_bytes, k.bytes);
+  }
+  min_bytes_ = max(min_bytes, kMinBytes);
+}
+
+}  // namespace dfly
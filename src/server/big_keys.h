@@ -0,0 +1,119 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/container/flat_hash_map.h>
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace dfly {
+
+// BigKeys tracks the largest keys of a database, by the heap bytes and by the number of elements
+// of their values, and the histograms of the value sizes of each type and of each encoding.
+//
+// Usage:
+// - The write path calls OnUpdate() when a value changed and IsCandidate() holds for its old or
+//   new size, and OnDelete() when such a value is deleted. IsCandidate() is a single comparison,
+//   so the writes of small values do not pay for the tracking.
+// - A background pass visits all the values, calls Sample() for each of them and OnScanned() for
+//   those of at least kMinBytes, and FinishScan() once it is done. The first pass fills the lists
+//   and the histograms, the following passes refresh them.
+//
+// Notes:
+// - The lists are kept up to date between the passes for the values whose size goes through the
+//   write path. A value that grows in elements but not in bytes, or whose size changes outside
+//   of the write path, is found by the next pass.
+// - The histograms are those of the last complete pass.
+class BigKeys {
+ public:
+  // Maximum number of keys in every list.
+  static constexpr unsigned kMaxKeys = 32;
+
+  // Smaller values are only counted in the histograms.
+  static constexpr size_t kMinBytes = 1024;
+
+  // Bucket i of a histogram counts the values of less than 2^i bytes that are not in a lower
+  // bucket, the last one counts the rest.
+  static constexpr unsigned kNumBuckets = 32;
+
+  struct Key {
+    std::string key;
+    unsigned type = 0;
+    size_t bytes = 0;
+    size_t elements = 0;
+  };
+
+  struct Histogram {
+    std::array<uint64_t, kNumBuckets> buckets{};
+    uint64_t sum = 0;  // of the bytes of the values.
+
+    void Merge(const Histogram& other) {
+      for (unsigned i = 0; i < kNumBuckets; ++i)
+        buckets[i] += other.buckets[i];
+      sum += other.sum;
+    }
+  };
+
+  bool IsCandidate(size_t bytes) const {
+    return bytes >= min_bytes_;
+  }
+
+  void OnUpdate(std::string_view key, unsigned type, size_t bytes, size_t elements);
+  void OnDelete(std::string_view key);
+
+  void Sample(unsigned type, unsigned encoding, size_t bytes);
+  void OnScanned(std::string_view key, unsigned type, size_t bytes, size_t elements);
+  void FinishScan();
+
+  void Clear();
+
+  static unsigned Bucket(size_t bytes);
+
+  // Both are sorted from the largest key.
+  const std::vector<Key>& by_bytes() const {
+    return by_bytes_;
+  }
+
+  const std::vector<Key>& by_elements() const {
+    return by_elements_;
+  }
+
+  // By the type of the values.
+  const absl::flat_hash_map<unsigned, Histogram>& histograms() const {
+    return histograms_;
+  }
+
+  // By the type and the encoding of the values.
+  using TypeEncoding = std::pair<unsigned, unsigned>;
+  const absl::flat_hash_map<TypeEncoding, Histogram>& encoding_histograms() const {
+    return encoding_histograms_;
+  }
+
+ private:
+  static void Place(std::string_view key, unsigned type, size_t bytes, size_t elements,
+                    size_t Key::*field, std::vector<Key>* list);
+  static void Erase(std::string_view key, std::vector<Key>* list);
+
+  void UpdateMinBytes();
+
+  std::vector<Key> by_bytes_, by_elements_;
+  absl::flat_hash_map<unsigned, Histogram> histograms_;
+  absl::flat_hash_map<TypeEncoding, Histogram> encoding_histograms_;
+
+  // What the running pass has found so far, it replaces the above once it is done.
+  std::vector<Key> pass_by_bytes_, pass_by_elements_;
+  absl::flat_hash_map<unsigned, Histogram> pass_histograms_;
+  absl::flat_hash_map<TypeEncoding, Histogram> pass_encoding_histograms_;
+
+  // No list has a key of fewer bytes.
+  size_t min_bytes_ = kMinBytes;
+};
+
+}  // namespace dfly
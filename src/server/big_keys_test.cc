@@ -0,0 +1,101 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/big_keys.h"
+
+#include <absl/strings/str_cat.h>
+#include <gmock/gmock.h>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+using ::testing::ElementsAre;
+using ::testing::Field;
+using ::testing::IsEmpty;
+
+namespace dfly {
+
+auto KeyIs(std::string_view key) {
+  return Field(&BigKeys::Key::key, key);
+}
+
+TEST(BigKeysTest, Updates) {
+  BigKeys big_keys;
+  EXPECT_FALSE(big_keys.IsCandidate(100));
+  EXPECT_TRUE(big_keys.IsCandidate(BigKeys::kMinBytes));
+
+  big_keys.OnUpdate("a", 0, 2000, 5);
+  big_keys.OnUpdate("b", 0, 3000, 1);
+  big_keys.OnUpdate("c", 0, 100, 1000);
+  EXPECT_THAT(big_keys.by_bytes(), ElementsAre(KeyIs("b"), KeyIs("a")));
+  EXPECT_THAT(big_keys.by_elements(), ElementsAre(KeyIs("a"), KeyIs("b")));
+
+  big_keys.OnUpdate("a", 0, 4000, 5);
+  EXPECT_THAT(big_keys.by_bytes(), ElementsAre(KeyIs("a"), KeyIs("b")));
+  EXPECT_EQ(big_keys.by_bytes()[0].bytes, 4000u);
+
+  // Shrinking below the minimum removes the key.
+  big_keys.OnUpdate("b", 0, 10, 1);
+  EXPECT_THAT(big_keys.by_bytes(), ElementsAre(KeyIs("a")));
+
+  big_keys.OnDelete("a");
+  EXPECT_THAT(big_keys.by_bytes(), IsEmpty());
+  EXPECT_THAT(big_keys.by_elements(), IsEmpty());
+}
+
+TEST(BigKeysTest, MinBytes) {
+  BigKeys big_keys;
+  for (unsigned i = 0; i < BigKeys::kMaxKeys; ++i)
+    big_keys.OnUpdate(absl::StrCat("k", i), 0, 2000 + i, 10);
+  EXPECT_FALSE(big_keys.IsCandidate(1500));
+  EXPECT_TRUE(big_keys.IsCandidate(2000));
+
+  big_keys.OnUpdate("big", 0, 5000, 10);
+  EXPECT_EQ(big_keys.by_bytes().size(), BigKeys::kMaxKeys);
+  EXPECT_THAT(big_keys.by_bytes().front(), KeyIs("big"));
+  EXPECT_THAT(big_keys.by_bytes().back(), KeyIs("k1"));
+}
+
+TEST(BigKeysTest, Scan) {
+  BigKeys big_keys;
+  big_keys.OnScanned("stale", 0, 2000, 1);
+  big_keys.FinishScan();
+  EXPECT_THAT(big_keys.by_bytes(), ElementsAre(KeyIs("stale")));
+
+  // The next pass does not find it, as if it changed outside of the write path.
+  big_keys.Sample(0, 0, 10);
+  big_keys.Sample(0, 1, 3000);
+  big_keys.Sample(1, 0, 100);
+  big_keys.OnScanned("a", 0, 3000, 1);
+  EXPECT_EQ(big_keys.histograms().size(), 0u);
+
+  // Updates during the pass are kept.
+  big_keys.OnUpdate("b", 1, 5000, 50);
+  big_keys.FinishScan();
+  EXPECT_THAT(big_keys.by_bytes(), ElementsAre(KeyIs("b"), KeyIs("a")));
+  EXPECT_THAT(big_keys.by_elements(), ElementsAre(KeyIs("b"), KeyIs("a")));
+
+  const auto& hist = big_keys.histograms();
+  ASSERT_EQ(hist.size(), 2u);
+  EXPECT_EQ(hist.at(0).sum, 3010u);
+  EXPECT_EQ(hist.at(0).buckets[BigKeys::Bucket(10)], 1u);
+  EXPECT_EQ(hist.at(0).buckets[BigKeys::Bucket(3000)], 1u);
+  EXPECT_EQ(hist.at(1).buckets[BigKeys::Bucket(100)], 1u);
+
+  const auto& enc_hist = big_keys.encoding_histograms();
+  ASSERT_EQ(enc_hist.size(), 3u);
+  EXPECT_EQ(enc_hist.at({0, 0}).sum, 10u);
+  EXPECT_EQ(enc_hist.at({0, 1}).buckets[BigKeys::Bucket(3000)], 1u);
+  EXPECT_EQ(enc_hist.at({1, 0}).sum, 100u);
+}
+
+TEST(BigKeysTest, Bucket) {
+  EXPECT_EQ(BigKeys::Bucket(0), 0u);
+  EXPECT_EQ(BigKeys::Bucket(1), 1u);
+  EXPECT_EQ(BigKeys::Bucket(1023), 10u);
+  EXPECT_EQ(BigKeys::Bucket(1024), 11u);
+  EXPECT_EQ(BigKeys::Bucket(SIZE_MAX), BigKeys::kNumBuckets - 1);
+}
+
+}  // namespace dfly
@@ -15,6 +15,7 @@ extern "C" {
 
 #include "absl/strings/match.h"
 #include "base/logging.h"
+#include "core/bit_kernels.h"
 #include "facade/cmd_arg_parser.h"
 #include "server/acl/acl_commands_def.h"
 #include "server/command_registry.h"
@@ -63,7 +64,7 @@ std::size_t CountBitSetByByteIndices(std::string_view at, std::size_t start, std
 std::size_t CountBitSet(std::string_view str, int64_t start, int64_t end, bool bits);
 std::size_t CountBitSetByBitIndices(std::string_view at, std::size_t start, std::size_t end);
 OpResult<std::string> RunBitOpOnShard(std::string_view op, const OpArgs& op_args, ArgSlice keys);
-std::string RunBitOperationOnValues(std::string_view op, const BitsStrVec& values);
+std::string RunBitOperationOnValues(std::string_view op, BitsStrVec values);
 
 // ------------------------------------------------------------------------- //
 
@@ -84,62 +85,31 @@ bool ToUpperAndGetAsBit(CmdArgList args, size_t i, bool* as_bit) {
   }
 }
 
-// This function can be used for any case where we allowing out of bound
-// access where the default in this case would be 0 -such as bitop
-uint8_t GetByteAt(std::string_view s, std::size_t at) {
-  return at >= s.size() ? 0 : s[at];
+BitOpKind ToBitOpKind(std::string_view op) {
+  if (op == AND_OP_NAME)
+    return BitOpKind::AND;
+  if (op == OR_OP_NAME)
+    return BitOpKind::OR;
+  if (op == XOR_OP_NAME)
+    return BitOpKind::XOR;
+  LOG(FATAL) << "Operation not supported '" << op << "'";
+  return BitOpKind::AND;
 }
 
-// For XOR, OR, AND operations on a collection of bytes
-template <typename BitOp, typename SkipOp>
-std::string BitOpString(BitOp operation_f, SkipOp skip_f, const BitsStrVec& values,
-                        std::string new_value) {
-  // at this point, values are not empty
-  std::size_t max_size = new_value.size();
-
-  if (values.size() > 1) {
-    for (std::size_t i = 0; i < max_size; i++) {
-      std::uint8_t new_entry = operation_f(GetByteAt(values[0], i), GetByteAt(values[1], i));
-      for (std::size_t j = 2; j < values.size(); ++j) {
-        new_entry = operation_f(new_entry, GetByteAt(values[j], i));
-        if (skip_f(new_entry)) {
-          break;
-        }
-      }
-      new_value[i] = new_entry;
-    }
-    return new_value;
-  } else {
-    return values[0];
+// Folds value into the result of XOR, OR or AND operations, the shorter of the two is treated
+// as zero padded. The result grows to the longest value.
+void BitOpInto(BitOpKind op, std::string_view value, std::string* result) {
+  std::size_t common = std::min(result->size(), value.size());
+  if (op == BitOpKind::AND) {
+    // The bytes past the shorter of the two become zero.
+    std::fill(result->begin() + common, result->end(), 0);
+    result->resize(std::max(result->size(), value.size()), 0);
+  } else if (value.size() > common) {
+    // x | 0 and x ^ 0 are x.
+    result->append(value.substr(common));
   }
-}
-
-// Helper functions to support operations
-// so we would not need to check which
-// operations to run in the look (unlike
-// https://github.com/redis/redis/blob/c2b0c13d5c0fab49131f6f5e844f80bfa43f6219/src/bitops.c#L607)
-constexpr bool SkipAnd(uint8_t byte) {
-  return byte == 0x0;
-}
-
-constexpr bool SkipOr(uint8_t byte) {
-  return byte == 0xff;
-}
-
-constexpr bool SkipXor(uint8_t) {
-  return false;
-}
-
-constexpr uint8_t AndOp(uint8_t left, uint8_t right) {
-  return left & right;
-}
-
-constexpr uint8_t OrOp(uint8_t left, uint8_t right) {
-  return left | right;
-}
-
-constexpr uint8_t XorOp(uint8_t left, uint8_t right) {
-  return left ^ right;
+  BitOpInPlace(op, reinterpret_cast<uint8_t*>(result->data()),
+               reinterpret_cast<const uint8_t*>(value.data()), common);
 }
 
 std::string BitOpNotString(std::string from) {
@@ -179,14 +149,11 @@ constexpr std::uint8_t CountBitsRange(std::uint8_t byte, std::uint8_t from, uint
 // Count the number of bits that are on, on bytes boundaries: i.e. Start and end are the indices for
 // bytes locations inside str CountBitSetByByteIndices
 std::size_t CountBitSetByByteIndices(std::string_view at, std::size_t start, std::size_t end) {
+  end = std::min(end, at.size());  // don't overflow
   if (start >= end) {
     return 0;
   }
-  end = std::min(end, at.size());  // don't overflow
-  std::uint32_t count =
-      std::accumulate(std::next(at.begin(), start), std::next(at.begin(), end), 0,
-                      [](auto counter, uint8_t ch) { return counter + absl::popcount(ch); });
-  return count;
+  return PopCount(reinterpret_cast<const uint8_t*>(at.data()) + start, end - start);
 }
 
 // Count the number of bits that are on, on bits boundaries: i.e. Start and end are the indices for
@@ -391,51 +358,32 @@ OpResult<bool> BitNewValue(const OpArgs& args, std::string_view key, uint32_t of
 
 // ---------------------------------------------------------
 
-std::string RunBitOperationOnValues(std::string_view op, const BitsStrVec& values) {
+std::string RunBitOperationOnValues(std::string_view op, BitsStrVec values) {
   // This function accept an operation (either OR, XOR, NOT or OR), and run bit operation
   // on all the values we got from the database. Note that in case that one of the values
   // is shorter than the other it would return a 0 and the operation would continue
   // until we ran the longest value. The function will return the resulting new value
-  std::size_t max_len = 0;
-  std::size_t max_len_index = 0;
-
-  const auto BitOperation = [&]() {
-    if (op == OR_OP_NAME) {
-      std::string default_str{values[max_len_index]};
-      return BitOpString(OrOp, SkipOr, std::move(values), std::move(default_str));
-    } else if (op == XOR_OP_NAME) {
-      return BitOpString(XorOp, SkipXor, std::move(values), std::string(max_len, 0));
-    } else if (op == AND_OP_NAME) {
-      return BitOpString(AndOp, SkipAnd, std::move(values), std::string(max_len, 0));
-    } else if (op == NOT_OP_NAME) {
-      return BitOpNotString(values[0]);
-    } else {
-      LOG(FATAL) << "Operation not supported '" << op << "'";
-      return std::string{};  // otherwise we will have warning of not returning value
-    }
-  };
-
   if (values.empty()) {  // this is ok in case we don't have the src keys
     return std::string{};
   }
-  // The new result is the max length input
-  max_len = values[0].size();
+  if (op == NOT_OP_NAME) {
+    return BitOpNotString(std::move(values[0]));
+  }
+
+  BitOpKind kind = ToBitOpKind(op);
+  std::string result = std::move(values[0]);
   for (std::size_t i = 1; i < values.size(); ++i) {
-    if (values[i].size() > max_len) {
-      max_len = values[i].size();
-      max_len_index = i;
-    }
+    BitOpInto(kind, values[i], &result);
   }
-  return BitOperation();
+  return result;
 }
 
-OpResult<std::string> CombineResultOp(ShardStringResults result, std::string_view op) {
+OpResult<std::string> CombineResultOp(ShardStringResults&& result, std::string_view op) {
   // take valid result for each shard
   BitsStrVec values;
   for (auto&& res : result) {
     if (res) {
-      auto v = res.value();
-      values.emplace_back(std::move(v));
+      values.emplace_back(std::move(res.value()));
     } else {
       if (res.status() != OpStatus::KEY_NOTFOUND) {
         // something went wrong, just bale out
@@ -472,15 +420,22 @@ OpResult<std::string> RunBitOpOnShard(std::string_view op, const OpArgs& op_args
     return RunBitOpNot(op_args, keys);
   }
   EngineShard* es = op_args.shard;
-  BitsStrVec values;
-  values.reserve(keys.size());
+  BitOpKind kind = ToBitOpKind(op);
+  std::string result, scratch;
+  bool found = false;
 
-  // collect all the value for this shard
+  // Fold the values of this shard into the result as we read them, only the first one is copied.
   for (auto& key : keys) {
     OpResult<PrimeConstIterator> find_res =
         es->db_slice().FindAndFetchReadOnly(op_args.db_cntx, key, OBJ_STRING);
     if (find_res) {
-      values.emplace_back(GetString(find_res.value()->second));
+      std::string_view value = find_res.value()->second.GetSlice(&scratch);
+      if (found) {
+        BitOpInto(kind, value, &result);
+      } else {
+        result.assign(value);
+        found = true;
+      }
     } else {
       if (find_res.status() == OpStatus::KEY_NOTFOUND) {
         continue;  // this is allowed, just return empty string per Redis
@@ -489,9 +444,7 @@ OpResult<std::string> RunBitOpOnShard(std::string_view op, const OpArgs& op_args
       }
     }
   }
-  // Run the operation on all the values that we found
-  std::string op_result = RunBitOperationOnValues(op, values);
-  return op_result;
+  return result;
 }
 
 template <typename T> void HandleOpValueResult(const OpResult<T>& result, ConnectionContext* cntx) {
@@ -1164,7 +1117,7 @@ void BitOp(CmdArgList args, ConnectionContext* cntx) {
   cntx->transaction->Schedule();
   cntx->transaction->Execute(std::move(shard_bitop), false);  // we still have more work to do
   // All result from each shard
-  const auto joined_results = CombineResultOp(result_set, op);
+  const auto joined_results = CombineResultOp(std::move(result_set), op);
   // Second phase - save to targe key if successful
   if (!joined_results) {
     cntx->transaction->Conclude();
@@ -1289,40 +1242,58 @@ std::size_t GetFirstBitWithValueInByte(uint8_t byte, bool value) {
   }
 }
 
+// Returns the index of the first byte in [start, end) that has a bit with bit_value, or end.
+int64_t FindFirstByteWithBitValue(std::string_view value_str, bool bit_value, int64_t start,
+                                  int64_t end) {
+  const uint8_t kNotFoundByte = bit_value ? 0 : std::numeric_limits<uint8_t>::max();
+  return start + FindFirstByteNot(reinterpret_cast<const uint8_t*>(value_str.data()) + start,
+                                  end - start, kNotFoundByte);
+}
+
 int64_t FindFirstBitWithValueAsBit(std::string_view value_str, bool bit_value, int64_t start,
                                    int64_t end) {
-  for (int64_t i = start; i <= end; ++i) {
-    if (static_cast<size_t>(GetByteIndex(i)) >= value_str.size()) {
-      break;
-    }
-    const uint8_t current_byte = GetByteValue(value_str, i);
-    bool current_bit = CheckBitStatus(current_byte, GetNormalizedBitIndex(i));
-    if (current_bit != bit_value) {
-      continue;
+  end = std::min<int64_t>(end, value_str.size() * OFFSET_FACTOR - 1);
+
+  // The partial bytes at the edges of the range are checked bit by bit, the whole bytes
+  // in between are scanned at once.
+  auto check_bits = [&](int64_t from, int64_t to) -> int64_t {
+    for (int64_t i = from; i < to; ++i) {
+      if (CheckBitStatus(GetByteValue(value_str, i), GetNormalizedBitIndex(i)) == bit_value) {
+        return i;
+      }
     }
+    return -1;
+  };
 
-    return i;
+  int64_t first_whole = std::min((start + OFFSET_FACTOR - 1) / OFFSET_FACTOR * OFFSET_FACTOR,
+                                 end + 1);
+  if (int64_t pos = check_bits(start, first_whole); pos != -1) {
+    return pos;
   }
 
-  return -1;
+  int64_t first_byte = first_whole / OFFSET_FACTOR, last_byte = (end + 1) / OFFSET_FACTOR;
+  if (first_byte < last_byte) {
+    int64_t byte = FindFirstByteWithBitValue(value_str, bit_value, first_byte, last_byte);
+    if (byte < last_byte) {
+      return byte * OFFSET_FACTOR + GetFirstBitWithValueInByte(value_str[byte], bit_value);
+    }
+    first_whole = last_byte * OFFSET_FACTOR;
+  }
+  return check_bits(first_whole, end + 1);
 }
 
 int64_t FindFirstBitWithValueAsByte(std::string_view value_str, bool bit_value, int64_t start,
                                     int64_t end) {
-  for (int64_t i = start; i <= end; ++i) {
-    if (static_cast<size_t>(i) >= value_str.size()) {
-      break;
-    }
-    const uint8_t current_byte = value_str[i];
-    const uint8_t kNotFoundByte = bit_value ? 0 : std::numeric_limits<uint8_t>::max();
-    if (current_byte == kNotFoundByte) {
-      continue;
-    }
-
-    return i * OFFSET_FACTOR + GetFirstBitWithValueInByte(current_byte, bit_value);
+  end = std::min<int64_t>(end + 1, value_str.size());
+  if (start >= end) {
+    return -1;
   }
 
-  return -1;
+  int64_t byte = FindFirstByteWithBitValue(value_str, bit_value, start, end);
+  if (byte == end) {
+    return -1;
+  }
+  return byte * OFFSET_FACTOR + GetFirstBitWithValueInByte(value_str[byte], bit_value);
 }
 
 OpResult<int64_t> FindFirstBitWithValue(const OpArgs& op_args, std::string_view key, bool bit_value,
@@ -532,6 +532,29 @@ TEST_F(BitOpsFamilyTest, BitPos) {
   EXPECT_EQ(-1, CheckedInt({"bitpos", "d", "0"}));
 }
 
+// Values longer than the vector widths, with tails, go through the bulk kernels.
+TEST_F(BitOpsFamilyTest, LongValues) {
+  string a(1000, '\xff'), b(700, '\x0f');
+  a[999] = '\x01';
+  ASSERT_EQ(Run({"set", "a", a}), "OK");
+  ASSERT_EQ(Run({"set", "b", b}), "OK");
+
+  EXPECT_EQ(999 * 8 + 1, CheckedInt({"bitcount", "a"}));
+  EXPECT_EQ(700 * 4, CheckedInt({"bitcount", "b"}));
+  EXPECT_EQ(300 * 4, CheckedInt({"bitcount", "b", "100", "399"}));
+  EXPECT_EQ(999 * 8 + 7, CheckedInt({"bitpos", "a", "1", "999"}));
+  EXPECT_EQ(999 * 8, CheckedInt({"bitpos", "a", "0"}));
+  EXPECT_EQ(999 * 8, CheckedInt({"bitpos", "a", "0", "3", "-1", "BIT"}));
+  EXPECT_EQ(4, CheckedInt({"bitpos", "b", "1"}));
+
+  EXPECT_EQ(1000, CheckedInt({"bitop", "and", "dest", "a", "b"}));
+  EXPECT_EQ(b + string(300, '\0'), Run({"get", "dest"}).GetString());
+  EXPECT_EQ(1000, CheckedInt({"bitop", "or", "dest", "a", "b"}));
+  EXPECT_EQ(a, Run({"get", "dest"}).GetString());
+  EXPECT_EQ(1000, CheckedInt({"bitop", "xor", "dest", "a", "b"}));
+  EXPECT_EQ(string(700, '\xf0') + a.substr(700), Run({"get", "dest"}).GetString());
+}
+
 TEST_F(BitOpsFamilyTest, BitFieldParsing) {
   const auto syntax_error = ErrArg("ERR syntax error");
   // Parsing Errors
@@ -4,9 +4,8 @@
 
 #include "server/blocking_controller.h"
 
-#include <absl/container/inlined_vector.h>
-
 #include <boost/smart_ptr/intrusive_ptr.hpp>
+#include <list>
 
 extern "C" {
 #include "redis/object.h"
@@ -23,17 +22,25 @@ using namespace std;
 struct WatchItem {
   Transaction* trans;
   KeyReadyChecker key_ready_checker;
+  bool key_only;
 
   Transaction* get() const {
     return trans;
   }
 
-  WatchItem(Transaction* t, KeyReadyChecker krc) : trans(t), key_ready_checker(std::move(krc)) {
+  WatchItem(Transaction* t, KeyReadyChecker krc, bool ko)
+      : trans(t), key_ready_checker(std::move(krc)), key_only(ko) {
   }
 };
 
+// FIFO of the transactions blocked on a key. With thousands of waiters on the same key, pushes
+// and unwatches must not scan the queue, hence the list with an index by transaction.
 struct BlockingController::WatchQueue {
-  deque<WatchItem> items;
+  using ItemList = list<WatchItem>;
+
+  ItemList items;
+  absl::flat_hash_map<Transaction*, ItemList::iterator> index;
+  unsigned num_tx_checkers = 0;  // items whose checker is not key_only
   TxId notify_txid = UINT64_MAX;
 
   // Updated  by both coordinator and shard threads but at different times.
@@ -44,9 +51,29 @@ struct BlockingController::WatchQueue {
     notify_txid = UINT64_MAX;
   }
 
-  auto Find(Transaction* tx) const {
-    return find_if(items.begin(), items.end(),
-                   [tx](const WatchItem& wi) { return wi.get() == tx; });
+  // Returns false if tx already watches the key.
+  bool Push(Transaction* tx, KeyReadyChecker krc, bool key_only) {
+    auto [it, inserted] = index.emplace(tx, items.end());
+    if (inserted) {
+      it->second = items.emplace(items.end(), tx, std::move(krc), key_only);
+      num_tx_checkers += !key_only;
+    }
+    return inserted;
+  }
+
+  ItemList::iterator Erase(ItemList::iterator it) {
+    num_tx_checkers -= !it->key_only;
+    index.erase(it->get());
+    return items.erase(it);
+  }
+
+  // Returns true if tx was present in the queue.
+  bool Erase(Transaction* tx) {
+    auto it = index.find(tx);
+    if (it == index.end())
+      return false;
+    Erase(it->second);
+    return true;
   }
 };
 
@@ -79,7 +106,7 @@ bool BlockingController::DbWatchTable::UnwatchTx(string_view key, Transaction* t
 
   bool res = false;
   if (wq->state == WatchQueue::ACTIVE && wq->items.front().get() == tx) {
-    wq->items.pop_front();
+    wq->Erase(wq->items.begin());
 
     // We suspend the queue and add keys to re-verification.
     // If they are still present, this queue will be reactivated below.
@@ -95,9 +122,7 @@ bool BlockingController::DbWatchTable::UnwatchTx(string_view key, Transaction* t
     // This shard has not been awakened and in case this transaction in the queue
     // we must clean it up.
 
-    if (auto it = wq->Find(tx); it != wq->items.end()) {
-      wq->items.erase(it);
-    }
+    wq->Erase(tx);
   }
 
   if (wq->items.empty()) {
@@ -226,7 +251,8 @@ void BlockingController::NotifyPending() {
   awakened_indices_.clear();
 }
 
-void BlockingController::AddWatched(ArgSlice keys, KeyReadyChecker krc, Transaction* trans) {
+void BlockingController::AddWatched(ArgSlice keys, KeyReadyChecker krc, Transaction* trans,
+                                    bool key_only) {
   auto [dbit, added] = watched_dbs_.emplace(trans->GetDbIndex(), nullptr);
   if (added) {
     dbit->second.reset(new DbWatchTable);
@@ -240,16 +266,10 @@ void BlockingController::AddWatched(ArgSlice keys, KeyReadyChecker krc, Transact
       res->second.reset(new WatchQueue);
     }
 
-    if (!res->second->items.empty()) {
-      Transaction* last = res->second->items.back().get();
-      DCHECK_GT(last->GetUseCount(), 0u);
-
-      // Duplicate keys case. We push only once per key.
-      if (last == trans)
-        continue;
+    // Duplicate keys case. We push only once per key.
+    if (res->second->Push(trans, krc, key_only)) {
+      DVLOG(2) << "Emplace " << trans->DebugId() << " to watch " << key;
     }
-    DVLOG(2) << "Emplace " << trans->DebugId() << " to watch " << key;
-    res->second->items.emplace_back(trans, krc);
   }
 }
 
@@ -281,29 +301,44 @@ void BlockingController::NotifyWatchQueue(std::string_view key, WatchQueueMap* w
   auto& queue = wq->items;
   ShardId sid = owner_->shard_id();
 
-  // In the most cases we shouldn't have skipped elements at all
-  absl::InlinedVector<dfly::WatchItem, 4> skipped;
-  while (!queue.empty()) {
-    auto& wi = queue.front();
-    Transaction* head = wi.get();
-    // We check may the transaction be notified otherwise move it to the end of the queue
-    if (wi.key_ready_checker(owner_, context, head, key)) {
-      DVLOG(2) << "WQ-Pop " << head->DebugId() << " from key " << key;
-      if (head->NotifySuspended(owner_->committed_txid(), sid, key)) {
-        wq->state = WatchQueue::ACTIVE;
-        // We deliberately keep the notified transaction in the queue to know which queue
-        // must handled when this transaction finished.
-        wq->notify_txid = owner_->committed_txid();
-        awakened_transactions_.insert(head);
-        break;
-      }
+  // Queues with many waiters, like consumers of the same group, are usually scanned when
+  // none but the head can proceed. Therefore we do not move the skipped items on each scan,
+  // but rotate them to the end of the queue only if some transaction is notified.
+  // Checkers that depend only on the key give the same answer for all waiters, so they run
+  // at most once per scan. Otherwise every pop of the last element would check all of them.
+  optional<bool> key_ready;
+  auto it = queue.begin();
+  while (it != queue.end()) {
+    Transaction* head = it->get();
+    bool ready;
+    if (it->key_only && key_ready) {
+      ready = *key_ready;
     } else {
-      skipped.push_back(std::move(wi));
+      ready = it->key_ready_checker(owner_, context, head, key);
+      if (it->key_only)
+        key_ready = ready;
+    }
+
+    // We check may the transaction be notified otherwise move it to the end of the queue
+    if (!ready) {
+      if (it->key_only && wq->num_tx_checkers == 0)
+        break;  // nobody can proceed
+      ++it;
+      continue;
     }
 
-    queue.pop_front();
+    DVLOG(2) << "WQ-Pop " << head->DebugId() << " from key " << key;
+    if (head->NotifySuspended(owner_->committed_txid(), sid, key)) {
+      wq->state = WatchQueue::ACTIVE;
+      // We deliberately keep the notified transaction in the queue to know which queue
+      // must handled when this transaction finished.
+      wq->notify_txid = owner_->committed_txid();
+      awakened_transactions_.insert(head);
+      queue.splice(queue.end(), queue, queue.begin(), it);
+      break;
+    }
+    it = wq->Erase(it);
   }
-  std::move(skipped.begin(), skipped.end(), std::back_inserter(queue));
 
   if (wq->items.empty()) {
     wqm->erase(w_it);
@@ -39,7 +39,9 @@ class BlockingController {
   // TODO: consider moving all watched functions to
   // EngineShard with separate per db map.
   //! AddWatched adds a transaction to the blocking queue.
-  void AddWatched(ArgSlice watch_keys, KeyReadyChecker krc, Transaction* me);
+  //! key_only states that krc does not depend on the transaction, see Transaction::WaitOnWatch.
+  void AddWatched(ArgSlice watch_keys, KeyReadyChecker krc, Transaction* me,
+                  bool key_only = false);
 
   // Called from operations that create keys like lpush, rename etc.
   void AwakeWatched(DbIndex db_index, std::string_view db_key);
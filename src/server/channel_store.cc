@@ -23,6 +23,10 @@ bool Matches(string_view pattern, string_view channel) {
   return stringmatchlen(pattern.data(), pattern.size(), channel.data(), channel.size(), 0) == 1;
 }
 
+string_view LiteralPrefix(string_view pattern) {
+  return pattern.substr(0, min(pattern.find_first_of("*?[\\"), pattern.size()));
+}
+
 }  // namespace
 
 bool ChannelStore::Subscriber::ByThread(const Subscriber& lhs, const Subscriber& rhs) {
@@ -73,12 +77,49 @@ void ChannelStore::ChannelMap::DeleteAll() {
     delete ptr.Get();
 }
 
-ChannelStore::ChannelStore() : channels_{new ChannelMap{}}, patterns_{new ChannelMap{}} {
+void ChannelStore::PatternIndex::Add(string_view pattern) {
+  string_view prefix = LiteralPrefix(pattern);
+  auto [it, inserted] = by_prefix.try_emplace(prefix);
+  if (inserted)
+    ++prefix_lens[prefix.size()];
+  it->second.emplace_back(pattern);
+}
+
+void ChannelStore::PatternIndex::Remove(string_view pattern) {
+  string_view prefix = LiteralPrefix(pattern);
+  auto it = by_prefix.find(prefix);
+  DCHECK(it != by_prefix.end());
+
+  auto& patterns = it->second;
+  patterns.erase(find(patterns.begin(), patterns.end(), pattern));
+  if (!patterns.empty())
+    return;
+
+  by_prefix.erase(it);
+  if (auto lit = prefix_lens.find(prefix.size()); --lit->second == 0)
+    prefix_lens.erase(lit);
+}
+
+ChannelStore::ChannelStore()
+    : channels_{new ChannelMap{}},
+      patterns_{new ChannelMap{}},
+      shard_channels_{new ChannelMap{}} {
   control_block.most_recent = this;
 }
 
-ChannelStore::ChannelStore(ChannelMap* channels, ChannelMap* patterns)
-    : channels_{channels}, patterns_{patterns} {
+ChannelStore::ChannelStore(ChannelMap* channels, ChannelMap* patterns, ChannelMap* shard_channels)
+    : channels_{channels}, patterns_{patterns}, shard_channels_{shard_channels} {
+}
+
+ChannelStore::ChannelMap*& ChannelStore::MapFor(Kind kind) {
+  switch (kind) {
+    case PATTERN:
+      return patterns_;
+    case SHARD_CHANNEL:
+      return shard_channels_;
+    default:
+      return channels_;
+  }
 }
 
 void ChannelStore::Destroy() {
@@ -86,7 +127,7 @@ void ChannelStore::Destroy() {
   control_block.update_mu.unlock();
 
   auto* store = control_block.most_recent.load(memory_order_relaxed);
-  for (auto* chan_map : {store->channels_, store->patterns_}) {
+  for (auto* chan_map : {store->channels_, store->patterns_, store->shard_channels_}) {
     chan_map->DeleteAll();
     delete chan_map;
   }
@@ -101,15 +142,105 @@ vector<ChannelStore::Subscriber> ChannelStore::FetchSubscribers(string_view chan
   if (auto it = channels_->find(channel); it != channels_->end())
     Fill(*it->second, string{}, &res);
 
-  for (const auto& [pat, subs] : *patterns_) {
+  patterns_->index.ForEachCandidate(channel, [&](const string& pat) {
     if (Matches(pat, channel))
-      Fill(*subs, pat, &res);
-  }
+      Fill(*patterns_->find(pat)->second, pat, &res);
+  });
 
   sort(res.begin(), res.end(), Subscriber::ByThread);
   return res;
 }
 
+vector<ChannelStore::Subscriber> ChannelStore::FetchShardSubscribers(string_view channel) const {
+  vector<Subscriber> res;
+
+  if (auto it = shard_channels_->find(channel); it != shard_channels_->end())
+    Fill(*it->second, string{}, &res);
+
+  sort(res.begin(), res.end(), Subscriber::ByThread);
+  return res;
+}
+
+void ChannelStore::SendMessages(const vector<pair<string, string>>& messages) const {
+  struct Delivery {
+    shared_ptr<char[]> buf;  // channel and message
+    size_t channel_len, message_len;
+    shared_ptr<const string> serialized;  // for the channel subscribers
+    vector<Subscriber> subscribers;       // of one thread
+  };
+
+  vector<vector<Delivery>> by_thread(shard_set->pool()->size());
+  for (const auto& [channel, msg] : messages) {
+    vector<Subscriber> subscribers = FetchSubscribers(channel);
+    if (subscribers.empty())
+      continue;
+
+    auto buf = shared_ptr<char[]>{new char[channel.size() + msg.size()]};
+    memcpy(buf.get(), channel.data(), channel.size());
+    memcpy(buf.get() + channel.size(), msg.data(), msg.size());
+    auto serialized = facade::Connection::PubMessage::Serialize("", channel, msg);
+
+    // Subscribers are sorted by thread.
+    for (auto it = subscribers.begin(); it != subscribers.end();) {
+      unsigned tid = it->Thread();
+      auto next =
+          find_if(it, subscribers.end(), [tid](const auto& s) { return s.Thread() != tid; });
+      if (tid < by_thread.size()) {
+        by_thread[tid].push_back({buf, channel.size(), msg.size(), serialized,
+                                  {make_move_iterator(it), make_move_iterator(next)}});
+      }
+      it = next;
+    }
+  }
+
+  for (unsigned tid = 0; tid < by_thread.size(); ++tid) {
+    if (by_thread[tid].empty())
+      continue;
+
+    shard_set->pool()->at(tid)->DispatchBrief([batch = std::move(by_thread[tid])]() mutable {
+      for (auto& delivery : batch) {
+        for (auto& sub : delivery.subscribers) {
+          facade::Connection* conn = sub.Get();
+          if (!conn)
+            continue;
+
+          // Pattern subscribers format their reply on dispatch.
+          auto serialized = sub.pattern.empty() ? delivery.serialized : nullptr;
+          conn->SendPubMessageAsync({std::move(sub.pattern), delivery.buf, delivery.channel_len,
+                                     delivery.message_len, std::move(serialized)});
+        }
+      }
+    });
+  }
+}
+
+void ChannelStore::UnsubscribeShardChannels(absl::FunctionRef<bool(string_view)> pred) const {
+  vector<vector<pair<Subscriber, string>>> by_thread(shard_set->pool()->size());
+  for (const auto& [channel, subscribe_map] : *shard_channels_) {
+    if (!pred(channel))
+      continue;
+
+    vector<Subscriber> subscribers;
+    Fill(*subscribe_map, string{}, &subscribers);
+    for (auto& sub : subscribers) {
+      if (unsigned tid = sub.Thread(); tid < by_thread.size())
+        by_thread[tid].emplace_back(std::move(sub), channel);
+    }
+  }
+
+  for (unsigned tid = 0; tid < by_thread.size(); ++tid) {
+    if (by_thread[tid].empty())
+      continue;
+
+    shard_set->pool()->at(tid)->DispatchBrief([batch = std::move(by_thread[tid])]() mutable {
+      for (auto& [sub, channel] : batch) {
+        if (facade::Connection* conn = sub.Get(); conn)
+          conn->SendSUnsubscribeAsync({std::move(channel)});
+      }
+    });
+  }
+}
+
 void ChannelStore::Fill(const SubscribeMap& src, const string& pattern, vector<Subscriber>* out) {
   out->reserve(out->size() + src.size());
   for (const auto [cntx, thread_id] : src) {
@@ -121,22 +252,30 @@ void ChannelStore::Fill(const SubscribeMap& src, const string& pattern, vector<S
   }
 }
 
-std::vector<string> ChannelStore::ListChannels(const string_view pattern) const {
+vector<string> ChannelStore::ListKeys(const ChannelMap& map, string_view pattern) {
   vector<string> res;
-  for (const auto& [channel, _] : *channels_) {
+  for (const auto& [channel, _] : map) {
     if (pattern.empty() || Matches(pattern, channel))
       res.push_back(channel);
   }
   return res;
 }
 
+std::vector<string> ChannelStore::ListChannels(const string_view pattern) const {
+  return ListKeys(*channels_, pattern);
+}
+
+std::vector<string> ChannelStore::ListShardChannels(const string_view pattern) const {
+  return ListKeys(*shard_channels_, pattern);
+}
+
 size_t ChannelStore::PatternCount() const {
   return patterns_->size();
 }
 
-ChannelStoreUpdater::ChannelStoreUpdater(bool pattern, bool to_add, ConnectionContext* cntx,
-                                         uint32_t thread_id)
-    : pattern_{pattern}, to_add_{to_add}, cntx_{cntx}, thread_id_{thread_id} {
+ChannelStoreUpdater::ChannelStoreUpdater(ChannelStore::Kind kind, bool to_add,
+                                         ConnectionContext* cntx, uint32_t thread_id)
+    : kind_{kind}, to_add_{to_add}, cntx_{cntx}, thread_id_{thread_id} {
 }
 
 void ChannelStoreUpdater::Record(string_view key) {
@@ -144,7 +283,7 @@ void ChannelStoreUpdater::Record(string_view key) {
 }
 
 pair<ChannelStore::ChannelMap*, bool> ChannelStoreUpdater::GetTargetMap(ChannelStore* store) {
-  auto* target = pattern_ ? store->patterns_ : store->channels_;
+  auto* target = store->MapFor(kind_);
 
   for (auto key : ops_) {
     auto it = target->find(key);
@@ -165,6 +304,8 @@ void ChannelStoreUpdater::Modify(ChannelMap* target, string_view key) {
   // New key, add new slot.
   if (to_add_ && it == target->end()) {
     target->emplace(key, new SubscribeMap{{cntx_, thread_id_}});
+    if (kind_ == ChannelStore::PATTERN)
+      target->index.Add(key);
     return;
   }
 
@@ -173,6 +314,8 @@ void ChannelStoreUpdater::Modify(ChannelMap* target, string_view key) {
     DCHECK(it->second->begin()->first == cntx_);
     freelist_.push_back(it->second.Get());
     target->erase(it);
+    if (kind_ == ChannelStore::PATTERN)
+      target->index.Remove(key);
     return;
   }
 
@@ -204,9 +347,8 @@ void ChannelStoreUpdater::Apply() {
   // Prepare replacement.
   auto* replacement = store;
   if (copied) {
-    auto* new_chans = pattern_ ? store->channels_ : target;
-    auto* new_patterns = pattern_ ? target : store->patterns_;
-    replacement = new ChannelStore{new_chans, new_patterns};
+    replacement = new ChannelStore{store->channels_, store->patterns_, store->shard_channels_};
+    replacement->MapFor(kind_) = target;
   }
 
   // Update control block and unlock it.
@@ -225,7 +367,7 @@ void ChannelStoreUpdater::Apply() {
 
   // Delete previous map and channel store.
   if (copied) {
-    delete (pattern_ ? store->patterns_ : store->channels_);
+    delete store->MapFor(kind_);
     delete store;
   }
 
@@ -3,7 +3,9 @@
 //
 #pragma once
 
+#include <absl/container/btree_map.h>
 #include <absl/container/flat_hash_map.h>
+#include <absl/functional/function_ref.h>
 
 #include <string_view>
 
@@ -52,12 +54,34 @@ class ChannelStore {
     std::string pattern;  // non-empty if registered via psubscribe
   };
 
+  // Subscription namespaces. Sharded channels (SSUBSCRIBE) are separate from regular channels and
+  // are not matched by patterns.
+  enum Kind : uint8_t { CHANNEL, PATTERN, SHARD_CHANNEL };
+
   ChannelStore();
 
   // Fetch all subscribers for channel, including matching patterns.
   std::vector<Subscriber> FetchSubscribers(std::string_view channel) const;
 
+  // Fetch all subscribers for sharded channel.
+  std::vector<Subscriber> FetchShardSubscribers(std::string_view channel) const;
+
+  // Publishes the messages, given as channel and message pairs, with a single hop to every thread
+  // of their subscribers. Unlike PUBLISH it does not wait for the memory budget of the
+  // subscribers, so it can be called on shard threads.
+  void SendMessages(const std::vector<std::pair<std::string, std::string>>& messages) const;
+
+  // Sends the subscribers of the sharded channels for which pred returns true a request to
+  // unsubscribe, which their connections handle like SUNSUBSCRIBE.
+  void UnsubscribeShardChannels(absl::FunctionRef<bool(std::string_view)> pred) const;
+
+  // Whether there are no channel and pattern subscriptions.
+  bool Empty() const {
+    return channels_->empty() && patterns_->empty();
+  }
+
   std::vector<std::string> ListChannels(const std::string_view pattern) const;
+  std::vector<std::string> ListShardChannels(const std::string_view pattern) const;
   size_t PatternCount() const;
 
   // Destroy current instance and delete it.
@@ -88,6 +112,28 @@ class ChannelStore {
     std::atomic<SubscribeMap*> ptr;
   };
 
+  // Patterns grouped by their literal prefix (up to the first glob special character), so that
+  // a publish has to glob match only the patterns whose prefix is a prefix of the channel.
+  struct PatternIndex {
+    void Add(std::string_view pattern);
+    void Remove(std::string_view pattern);
+
+    // Call cb for every pattern that can match the channel.
+    template <typename F> void ForEachCandidate(std::string_view channel, F&& cb) const {
+      for (auto [len, _] : prefix_lens) {
+        if (len > channel.size())
+          break;
+        if (auto it = by_prefix.find(channel.substr(0, len)); it != by_prefix.end()) {
+          for (const auto& pattern : it->second)
+            cb(pattern);
+        }
+      }
+    }
+
+    absl::flat_hash_map<std::string, std::vector<std::string>> by_prefix;
+    absl::btree_map<size_t, unsigned> prefix_lens;  // prefix length -> number of prefixes
+  };
+
   // SubscriberMaps for channels/patterns.
   struct ChannelMap : absl::flat_hash_map<std::string, UpdatablePointer> {
     void Add(std::string_view key, ConnectionContext* me, uint32_t thread_id);
@@ -95,6 +141,10 @@ class ChannelStore {
 
     // Delete all stored SubscribeMap pointers.
     void DeleteAll();
+
+    // Maintained only for the patterns map. As slots are added or removed only on copies, it is
+    // copied and updated together with them.
+    PatternIndex index;
   };
 
   // Centralized controller to prevent overlaping updates.
@@ -106,13 +156,18 @@ class ChannelStore {
  private:
   static ControlBlock control_block;
 
-  ChannelStore(ChannelMap* channels, ChannelMap* patterns);
+  ChannelStore(ChannelMap* channels, ChannelMap* patterns, ChannelMap* shard_channels);
+
+  ChannelMap*& MapFor(Kind kind);
 
   static void Fill(const SubscribeMap& src, const std::string& pattern,
                    std::vector<Subscriber>* out);
 
+  static std::vector<std::string> ListKeys(const ChannelMap& map, std::string_view pattern);
+
   ChannelMap* channels_;
   ChannelMap* patterns_;
+  ChannelMap* shard_channels_;
 };
 
 // Performs RCU (read-copy-update) updates to the channel store.
@@ -120,7 +175,8 @@ class ChannelStore {
 // Queues operations and performs them with Apply().
 class ChannelStoreUpdater {
  public:
-  ChannelStoreUpdater(bool pattern, bool to_add, ConnectionContext* cntx, uint32_t thread_id);
+  ChannelStoreUpdater(ChannelStore::Kind kind, bool to_add, ConnectionContext* cntx,
+                      uint32_t thread_id);
 
   void Record(std::string_view key);
   void Apply();
@@ -136,7 +192,7 @@ class ChannelStoreUpdater {
   void Modify(ChannelMap* target, std::string_view key);
 
  private:
-  bool pattern_;
+  ChannelStore::Kind kind_;
   bool to_add_;
   ConnectionContext* cntx_;
   uint32_t thread_id_;
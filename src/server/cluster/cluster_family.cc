@@ -4,6 +4,10 @@
 
 #include "server/cluster/cluster_family.h"
 
+#include <absl/strings/match.h>
+
+#include <algorithm>
+#include <array>
 #include <jsoncons/json.hpp>
 #include <memory>
 #include <mutex>
@@ -16,6 +20,7 @@
 #include "facade/dragonfly_connection.h"
 #include "facade/error.h"
 #include "server/acl/acl_commands_def.h"
+#include "server/channel_store.h"
 #include "server/command_registry.h"
 #include "server/conn_context.h"
 #include "server/dflycmd.h"
@@ -105,6 +110,14 @@ void ClusterFamily::ClusterHelp(ConnectionContext* cntx) {
       "   <id> <ip:port> <flags> <master> <pings> <pongs> <epoch> <link> <slot> ...",
       "INFO",
       "  Return information about the cluster",
+      "SLOT-STATS SLOTSRANGE <start> <end> | ORDERBY <metric> [LIMIT <limit>] [ASC|DESC]",
+      "   Return the statistics of the owned slots in a range, or of the top slots by a metric.",
+      "   Metrics: key-count, ops-per-sec, total-reads, total-writes, read-bytes, write-bytes,",
+      "   memory-bytes.",
+      "COUNTKEYSINSLOT <slot>",
+      "   Return the number of keys in the slot.",
+      "GETKEYSINSLOT <slot> <count>",
+      "   Return at most count keys of the slot.",
       "HELP",
       "    Prints this help.",
   };
@@ -338,6 +351,173 @@ void ClusterFamily::KeySlot(CmdArgList args, ConnectionContext* cntx) {
   return cntx->SendLong(id);
 }
 
+namespace {
+
+// The slot statistics are not tracked in the emulated mode.
+constexpr string_view kSlotStatsRequireCluster =
+    "Slot statistics are tracked only with --cluster_mode=yes";
+
+constexpr string_view kSlotStatsMetrics[] = {"key-count",   "ops-per-sec", "total-reads",
+                                             "total-writes", "read-bytes",  "write-bytes",
+                                             "memory-bytes"};
+
+array<uint64_t, size(kSlotStatsMetrics)> SlotStatsValues(const SlotStats& stats) {
+  return {stats.key_count,        stats.ops_per_sec,      stats.total_reads,
+          stats.total_writes,     stats.total_read_bytes, stats.total_write_bytes,
+          stats.memory_bytes};
+}
+
+// Returns the statistics of the slots summed over all shards.
+vector<SlotStats> CollectSlotStats(const vector<SlotId>& slots) {
+  vector<SlotStats> res(slots.size());
+  Mutex mu;
+
+  auto cb = [&](auto*) {
+    EngineShard* shard = EngineShard::tlocal();
+    if (shard == nullptr)
+      return;
+
+    lock_guard lk(mu);
+    for (size_t i = 0; i < slots.size(); ++i) {
+      res[i] += shard->db_slice().GetSlotStats(slots[i]);
+    }
+  };
+
+  shard_set->pool()->AwaitFiberOnAll(std::move(cb));
+  return res;
+}
+
+}  // namespace
+
+void ClusterFamily::ClusterSlotStats(CmdArgList args, ConnectionContext* cntx) {
+  if (!ClusterConfig::IsEnabled())
+    return cntx->SendError(kSlotStatsRequireCluster);
+  if (tl_cluster_config == nullptr)
+    return cntx->SendError(kClusterNotConfigured);
+
+  CmdArgParser parser(args.subspan(1));
+  optional<pair<SlotId, SlotId>> range;
+  size_t metric = 0;
+  uint32_t limit = 16;
+  bool ascending = false;
+
+  if (parser.Check("SLOTSRANGE").IgnoreCase().ExpectTail(2)) {
+    auto [start, end] = parser.Next<uint32_t, uint32_t>();
+    if (!parser.HasError() && (start > end || end > ClusterConfig::kMaxSlotNum))
+      return cntx->SendError("Invalid slot range");
+    range.emplace(start, end);
+  } else if (parser.Check("ORDERBY").IgnoreCase().ExpectTail(1)) {
+    string_view name = parser.Next();
+    auto it = find_if(begin(kSlotStatsMetrics), end(kSlotStatsMetrics),
+                      [name](string_view m) { return absl::EqualsIgnoreCase(m, name); });
+    if (it == end(kSlotStatsMetrics))
+      return cntx->SendError(absl::StrCat("Unknown slot statistics metric '", name, "'"));
+    metric = it - begin(kSlotStatsMetrics);
+
+    while (parser.HasNext()) {
+      if (parser.Check("LIMIT").IgnoreCase().ExpectTail(1)) {
+        limit = parser.Next<uint32_t>();
+      } else if (parser.Check("ASC").IgnoreCase()) {
+        ascending = true;
+      } else if (parser.Check("DESC").IgnoreCase()) {
+        ascending = false;
+      } else {
+        return cntx->SendError(kSyntaxErr);
+      }
+    }
+    if (!parser.HasError() && (limit == 0 || limit > ClusterConfig::kMaxSlotNum + 1))
+      return cntx->SendError("Limit has to lie in between 1 and 16384");
+  } else {
+    return cntx->SendError(kSyntaxErr);
+  }
+
+  if (parser.HasNext())
+    return cntx->SendError(kSyntaxErr);
+  if (auto err = parser.Error(); err)
+    return cntx->SendError(err->MakeReply());
+
+  vector<SlotId> slots;
+  for (SlotId sid : tl_cluster_config->GetOwnedSlots()) {
+    if (!range || (range->first <= sid && sid <= range->second))
+      slots.push_back(sid);
+  }
+  sort(slots.begin(), slots.end());
+
+  vector<pair<SlotId, SlotStats>> entries;
+  entries.reserve(slots.size());
+  vector<SlotStats> stats = CollectSlotStats(slots);
+  for (size_t i = 0; i < slots.size(); ++i)
+    entries.emplace_back(slots[i], stats[i]);
+
+  if (!range) {
+    stable_sort(entries.begin(), entries.end(), [&](const auto& a, const auto& b) {
+      uint64_t va = SlotStatsValues(a.second)[metric], vb = SlotStatsValues(b.second)[metric];
+      return ascending ? va < vb : va > vb;
+    });
+    if (entries.size() > limit)
+      entries.resize(limit);
+  }
+
+  auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+  rb->StartArray(entries.size());
+  for (const auto& [sid, slot_stats] : entries) {
+    rb->StartArray(2);
+    rb->SendLong(sid);
+    auto values = SlotStatsValues(slot_stats);
+    rb->StartCollection(values.size(), RedisReplyBuilder::MAP);
+    for (size_t i = 0; i < values.size(); ++i) {
+      rb->SendBulkString(kSlotStatsMetrics[i]);
+      rb->SendLong(static_cast<long>(values[i]));
+    }
+  }
+}
+
+void ClusterFamily::CountKeysInSlot(CmdArgList args, ConnectionContext* cntx) {
+  if (!ClusterConfig::IsEnabled())
+    return cntx->SendError(kSlotStatsRequireCluster);
+
+  CmdArgParser parser(args.subspan(1));
+  auto sid = parser.Next<uint32_t>();
+  if (auto err = parser.Error(); err || parser.HasNext())
+    return cntx->SendError(err ? err->MakeReply() : ErrorReply{kSyntaxErr});
+  if (sid > ClusterConfig::kMaxSlotNum)
+    return cntx->SendError("Invalid slot id");
+
+  vector<SlotStats> stats = CollectSlotStats({SlotId(sid)});
+  cntx->SendLong(stats[0].key_count);
+}
+
+void ClusterFamily::GetKeysInSlot(CmdArgList args, ConnectionContext* cntx) {
+  if (!ClusterConfig::IsEnabled())
+    return cntx->SendError(kSlotStatsRequireCluster);
+
+  CmdArgParser parser(args.subspan(1));
+  auto [sid, count] = parser.Next<uint32_t, uint32_t>();
+  if (auto err = parser.Error(); err || parser.HasNext())
+    return cntx->SendError(err ? err->MakeReply() : ErrorReply{kSyntaxErr});
+  if (sid > ClusterConfig::kMaxSlotNum)
+    return cntx->SendError("Invalid slot id");
+
+  vector<string> keys;
+  Mutex mu;
+
+  auto cb = [&](auto*) {
+    EngineShard* shard = EngineShard::tlocal();
+    if (shard == nullptr)
+      return;
+
+    vector<string> shard_keys = shard->db_slice().GetSlotKeys(sid, count);
+    lock_guard lk(mu);
+    for (size_t i = 0; i < shard_keys.size() && keys.size() < count; ++i)
+      keys.push_back(std::move(shard_keys[i]));
+  };
+
+  shard_set->pool()->AwaitFiberOnAll(std::move(cb));
+
+  auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+  rb->SendStringArr(keys);
+}
+
 void ClusterFamily::Cluster(CmdArgList args, ConnectionContext* cntx) {
   // In emulated cluster mode, all slots are mapped to the same host, and number of cluster
   // instances is thus 1.
@@ -361,6 +541,12 @@ void ClusterFamily::Cluster(CmdArgList args, ConnectionContext* cntx) {
     return ClusterInfo(cntx);
   } else if (sub_cmd == "KEYSLOT") {
     return KeySlot(args, cntx);
+  } else if (sub_cmd == "SLOT-STATS") {
+    return ClusterSlotStats(args, cntx);
+  } else if (sub_cmd == "COUNTKEYSINSLOT") {
+    return CountKeysInSlot(args, cntx);
+  } else if (sub_cmd == "GETKEYSINSLOT") {
+    return GetKeysInSlot(args, cntx);
   } else {
     return cntx->SendError(facade::UnknownSubCmd(sub_cmd, "CLUSTER"), facade::kSyntaxErrType);
   }
@@ -539,8 +725,13 @@ void ClusterFamily::DflyClusterConfig(CmdArgList args, ConnectionContext* cntx)
   }
 
   SlotSet after = tl_cluster_config->GetOwnedSlots();
+  auto deleted_slots = GetDeletedSlots(is_first_config, before, after);
+
+  // Like redis, the sharded pub/sub subscribers of the slots that moved away are unsubscribed.
+  ServerState::tlocal()->channel_store()->UnsubscribeShardChannels(
+      [&](string_view channel) { return deleted_slots.contains(ClusterConfig::KeySlot(channel)); });
+
   if (ServerState::tlocal()->is_master) {
-    auto deleted_slots = GetDeletedSlots(is_first_config, before, after);
     DeleteSlots(deleted_slots);
     WriteFlushSlotsToJournal(deleted_slots);
   }
@@ -553,45 +744,32 @@ void ClusterFamily::DflyClusterGetSlotInfo(CmdArgList args, ConnectionContext* c
   parser.ExpectTag("SLOTS");
   auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
 
-  vector<std::pair<SlotId, SlotStats>> slots_stats;
+  vector<SlotId> slots;
   do {
     auto sid = parser.Next<uint32_t>();
     if (sid > ClusterConfig::kMaxSlotNum)
       return rb->SendError("Invalid slot id");
-    slots_stats.emplace_back(sid, SlotStats{});
+    slots.push_back(sid);
   } while (parser.HasNext());
 
   if (auto err = parser.Error(); err)
     return rb->SendError(err->MakeReply());
 
-  Mutex mu;
-
-  auto cb = [&](auto*) {
-    EngineShard* shard = EngineShard::tlocal();
-    if (shard == nullptr)
-      return;
-
-    lock_guard lk(mu);
-    for (auto& [slot, data] : slots_stats) {
-      data += shard->db_slice().GetSlotStats(slot);
-    }
-  };
-
-  shard_set->pool()->AwaitFiberOnAll(std::move(cb));
+  vector<SlotStats> slots_stats = CollectSlotStats(slots);
 
   rb->StartArray(slots_stats.size());
 
-  for (const auto& slot_data : slots_stats) {
+  for (size_t i = 0; i < slots.size(); ++i) {
     rb->StartArray(9);
-    rb->SendLong(slot_data.first);
+    rb->SendLong(slots[i]);
     rb->SendBulkString("key_count");
-    rb->SendLong(static_cast<long>(slot_data.second.key_count));
+    rb->SendLong(static_cast<long>(slots_stats[i].key_count));
     rb->SendBulkString("total_reads");
-    rb->SendLong(static_cast<long>(slot_data.second.total_reads));
+    rb->SendLong(static_cast<long>(slots_stats[i].total_reads));
     rb->SendBulkString("total_writes");
-    rb->SendLong(static_cast<long>(slot_data.second.total_writes));
+    rb->SendLong(static_cast<long>(slots_stats[i].total_writes));
     rb->SendBulkString("memory_bytes");
-    rb->SendLong(static_cast<long>(slot_data.second.memory_bytes));
+    rb->SendLong(static_cast<long>(slots_stats[i].memory_bytes));
   }
 }
 
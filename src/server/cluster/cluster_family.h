@@ -38,6 +38,9 @@ class ClusterFamily {
   void ClusterInfo(ConnectionContext* cntx);
 
   void KeySlot(CmdArgList args, ConnectionContext* cntx);
+  void ClusterSlotStats(CmdArgList args, ConnectionContext* cntx);
+  void CountKeysInSlot(CmdArgList args, ConnectionContext* cntx);
+  void GetKeysInSlot(CmdArgList args, ConnectionContext* cntx);
 
   void ReadOnly(CmdArgList args, ConnectionContext* cntx);
   void ReadWrite(CmdArgList args, ConnectionContext* cntx);
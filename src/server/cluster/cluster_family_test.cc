@@ -201,6 +201,10 @@ TEST_F(ClusterFamilyTest, ClusterConfigNoReplicas) {
 
   EXPECT_THAT(Run({"get", "x"}).GetString(),
               testing::MatchesRegex(R"(MOVED [0-9]+ 10.0.0.1:7000)"));
+  EXPECT_THAT(Run({"spublish", "x", "msg"}).GetString(),
+              testing::MatchesRegex(R"(MOVED [0-9]+ 10.0.0.1:7000)"));
+  EXPECT_THAT(Run({"ssubscribe", "x"}).GetString(),
+              testing::MatchesRegex(R"(MOVED [0-9]+ 10.0.0.1:7000)"));
 
   EXPECT_THAT(Run({"cluster", "slots"}),
               RespArray(ElementsAre(IntArg(0),              //
@@ -502,6 +506,55 @@ TEST_F(ClusterFamilyTest, ClusterGetSlotInfo) {
                                 "total_writes", IntArg(2), "memory_bytes", IntArg(0))))));
 }
 
+TEST_F(ClusterFamilyTest, ClusterSlotStats) {
+  string config_template = R"json(
+      [
+        {
+          "slot_ranges": [
+            {
+              "start": 0,
+              "end": 16383
+            }
+          ],
+          "master": {
+            "id": "$0",
+            "ip": "10.0.0.1",
+            "port": 7000
+          },
+          "replicas": []
+        }
+      ])json";
+  string config = absl::Substitute(config_template, GetMyId());
+
+  EXPECT_EQ(RunPrivileged({"dflycluster", "config", config}), "OK");
+
+  constexpr string_view kKey = "some-key";
+  const SlotId slot = ClusterConfig::KeySlot(kKey);
+  const string value(1'000, '#');
+  EXPECT_EQ(Run({"SET", kKey, value}), "OK");
+  EXPECT_EQ(Run({"GET", kKey}), value);
+
+  auto resp = Run({"cluster", "slot-stats", "slotsrange", absl::StrCat(slot), absl::StrCat(slot)});
+  EXPECT_THAT(resp, RespArray(ElementsAre(IntArg(slot), _)));
+  EXPECT_THAT(resp.GetVec()[1],
+              RespArray(ElementsAre("key-count", IntArg(1), "ops-per-sec", _, "total-reads",
+                                    IntArg(1), "total-writes", IntArg(1), "read-bytes",
+                                    IntArg(kKey.size() + value.size()), "write-bytes",
+                                    IntArg(kKey.size() + value.size()), "memory-bytes",
+                                    Not(IntArg(0)))));
+
+  // The slot with the key is the hottest one.
+  resp = Run({"cluster", "slot-stats", "orderby", "total-reads", "limit", "2"});
+  ASSERT_THAT(resp, ArrLen(2));
+  EXPECT_THAT(resp.GetVec()[0], RespArray(ElementsAre(IntArg(slot), _)));
+
+  EXPECT_THAT(Run({"cluster", "slot-stats", "slotsrange", "2", "1"}), ErrArg("Invalid slot range"));
+  EXPECT_THAT(Run({"cluster", "slot-stats", "orderby", "foo"}), ErrArg("Unknown slot statistics"));
+  EXPECT_THAT(Run({"cluster", "slot-stats", "orderby", "key-count", "limit", "0"}),
+              ErrArg("Limit has to lie"));
+  EXPECT_THAT(Run({"cluster", "slot-stats"}), ErrArg("syntax error"));
+}
+
 TEST_F(ClusterFamilyTest, ClusterSlotsPopulate) {
   string config_template = R"json(
       [
@@ -681,6 +734,58 @@ TEST_F(ClusterFamilyTest, ClusterConfigDeleteSomeSlots) {
                   RespArray(ElementsAre(IntArg(8000), "key_count", IntArg(0), _, _, _, _, _, _)))));
 }
 
+TEST_F(ClusterFamilyTest, ClusterConfigDeleteSlotsUnsubscribes) {
+  string config_template = R"json(
+      [
+        {
+          "slot_ranges": [
+            {
+              "start": 0,
+              "end": $1
+            }
+          ],
+          "master": {
+            "id": "$0",
+            "ip": "10.0.0.1",
+            "port": 7000
+          },
+          "replicas": []
+        },
+        {
+          "slot_ranges": [
+            {
+              "start": $2,
+              "end": 16383
+            }
+          ],
+          "master": {
+            "id": "other",
+            "ip": "10.0.0.2",
+            "port": 7000
+          },
+          "replicas": []
+        }
+      ])json";
+
+  string config = absl::Substitute(config_template, GetMyId(), "14000", "14001");
+  EXPECT_EQ(RunPrivileged({"dflycluster", "config", config}), "OK");
+
+  // "ch" maps to slot 13271, "other" to slot 11361.
+  single_response_ = false;
+  auto resp = pp_->at(1)->Await([&] { return Run({"ssubscribe", "ch"}); });
+  EXPECT_THAT(resp.GetVec(), ElementsAre("ssubscribe", "ch", IntArg(1)));
+  resp = pp_->at(1)->Await([&] { return Run({"ssubscribe", "other"}); });
+  EXPECT_THAT(resp.GetVec(), ElementsAre("ssubscribe", "other", IntArg(2)));
+  single_response_ = true;
+
+  // Move ownership over slot 13271 to the other master
+  config = absl::Substitute(config_template, GetMyId(), "13000", "13001");
+  EXPECT_EQ(RunPrivileged({"dflycluster", "config", config}), "OK");
+
+  ExpectConditionWithinTimeout([&]() { return SUnsubscribeMessagesLen("IO1") == 1; });
+  EXPECT_EQ(GetSUnsubscribeMessage("IO1", 0).channel, "ch");
+}
+
 TEST_F(ClusterFamilyTest, ClusterModeSelectNotAllowed) {
   EXPECT_THAT(Run({"select", "1"}), ErrArg("SELECT is not allowed in cluster mode"));
   EXPECT_EQ(Run({"select", "0"}), "OK");
@@ -796,6 +901,52 @@ TEST_F(ClusterFamilyTest, ClusterCrossSlot) {
   EXPECT_THAT(Run({"MGET", "key{tag}", "key2{tag}"}), RespArray(ElementsAre("value", "value2")));
 }
 
+TEST_F(ClusterFamilyTest, KeysInSlot) {
+  EXPECT_EQ(Run({"debug", "populate", "100", "key", "4", "slots", "0", "1"}), "OK");
+
+  int64_t count = CheckedInt({"cluster", "countkeysinslot", "0"});
+  EXPECT_GT(count, 0);
+  EXPECT_EQ(CheckedInt({"cluster", "countkeysinslot", "2"}), 0);
+
+  auto resp = Run({"cluster", "getkeysinslot", "0", "1000"});
+  ASSERT_THAT(resp, ArrLen(count));
+  for (const auto& key : resp.GetVec())
+    EXPECT_EQ(ClusterConfig::KeySlot(key.GetString()), 0);
+  EXPECT_THAT(Run({"cluster", "getkeysinslot", "0", "3"}), ArrLen(3));
+
+  EXPECT_THAT(Run({"cluster", "countkeysinslot", "16384"}), ErrArg("Invalid slot id"));
+  EXPECT_THAT(Run({"cluster", "getkeysinslot", "0"}), ErrArg("syntax error"));
+}
+
+class ClusterFamilySlotKeyIndexTest : public ClusterFamilyTest {
+ public:
+  ClusterFamilySlotKeyIndexTest() {
+    SetTestFlag("cluster_slot_key_index", "true");
+  }
+};
+
+TEST_F(ClusterFamilySlotKeyIndexTest, FlushSlots) {
+  EXPECT_EQ(Run({"debug", "populate", "100", "key", "4", "slots", "0", "1"}), "OK");
+  string deleted{Run({"cluster", "getkeysinslot", "0", "1"}).GetString()};
+  EXPECT_THAT(Run({"del", deleted}), IntArg(1));
+
+  int64_t count = CheckedInt({"cluster", "countkeysinslot", "0"});
+  EXPECT_GT(count, 0);
+
+  // The index is kept in sync with the deleted key.
+  auto resp = Run({"cluster", "getkeysinslot", "0", "1000"});
+  ASSERT_THAT(resp, ArrLen(count));
+  for (const auto& key : resp.GetVec())
+    EXPECT_EQ(ClusterConfig::KeySlot(key.GetString()), 0);
+
+  int64_t count1 = CheckedInt({"cluster", "countkeysinslot", "1"});
+  EXPECT_EQ(RunPrivileged({"dflycluster", "flushslots", "0"}), "OK");
+  ExpectConditionWithinTimeout(
+      [&]() { return CheckedInt({"cluster", "countkeysinslot", "0"}) == 0; });
+  EXPECT_THAT(Run({"cluster", "getkeysinslot", "0", "1000"}), ArrLen(0));
+  EXPECT_EQ(CheckedInt({"cluster", "countkeysinslot", "1"}), count1);
+}
+
 class ClusterFamilyEmulatedTest : public ClusterFamilyTest {
  public:
   ClusterFamilyEmulatedTest() {
@@ -4,16 +4,26 @@
 
 #include "server/cluster/outgoing_slot_migration.h"
 
+#include <algorithm>
+
+#include "base/flags.h"
 #include "server/db_slice.h"
 #include "server/journal/streamer.h"
 
+ABSL_FLAG(uint64_t, slot_migration_max_bytes_per_sec, 0,
+          "bandwidth budget of an outgoing slot migration, split evenly between its shard "
+          "flows. 0 is unlimited");
+ABSL_FLAG(uint32_t, slot_migration_cpu_percent, 100,
+          "share of the shard thread time in percent that the traversal of an outgoing slot "
+          "migration may use");
+
 namespace dfly {
 
 class OutgoingMigration::SliceSlotMigration {
  public:
   SliceSlotMigration(DbSlice* slice, SlotSet slots, uint32_t sync_id, journal::Journal* journal,
-                     Context* cntx)
-      : streamer_(slice, std::move(slots), sync_id, journal, cntx) {
+                     Context* cntx, RestoreStreamer::Budget budget)
+      : streamer_(slice, std::move(slots), sync_id, journal, cntx, budget) {
   }
 
   void Start(io::Sink* dest) {
@@ -51,8 +61,15 @@ void OutgoingMigration::StartFlow(DbSlice* slice, uint32_t sync_id, journal::Jou
   const auto shard_id = slice->shard_id();
 
   std::lock_guard lck(flows_mu_);
-  slot_migrations_[shard_id] =
-      std::make_unique<SliceSlotMigration>(slice, std::move(sset), sync_id, journal, &cntx_);
+
+  RestoreStreamer::Budget budget;
+  budget.bytes_per_sec = absl::GetFlag(FLAGS_slot_migration_max_bytes_per_sec);
+  if (budget.bytes_per_sec > 0)
+    budget.bytes_per_sec = std::max<uint64_t>(budget.bytes_per_sec / slot_migrations_.size(), 1);
+  budget.cpu_percent = absl::GetFlag(FLAGS_slot_migration_cpu_percent);
+
+  slot_migrations_[shard_id] = std::make_unique<SliceSlotMigration>(slice, std::move(sset), sync_id,
+                                                                    journal, &cntx_, budget);
   slot_migrations_[shard_id]->Start(dest);
 }
 
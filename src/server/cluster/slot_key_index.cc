@@ -0,0 +1,45 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/cluster/slot_key_index.h"
+
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+void SlotKeyIndex::Add(SlotId sid, string_view key) {
+  DCHECK_LE(sid, ClusterConfig::kMaxSlotNum);
+  if (slots_.empty())
+    slots_.resize(ClusterConfig::kMaxSlotNum + 1);
+
+  size_ += slots_[sid].emplace(key).second;
+}
+
+void SlotKeyIndex::Remove(SlotId sid, string_view key) {
+  if (slots_.empty())
+    return;
+
+  size_ -= slots_[sid].erase(key);
+}
+
+vector<string> SlotKeyIndex::Keys(SlotId sid, size_t limit) const {
+  vector<string> res;
+  if (slots_.empty())
+    return res;
+
+  const auto& keys = slots_[sid];
+  res.reserve(min(limit, keys.size()));
+  for (auto it = keys.begin(); it != keys.end() && res.size() < limit; ++it)
+    res.push_back(*it);
+  return res;
+}
+
+void SlotKeyIndex::Clear() {
+  slots_.clear();
+  size_ = 0;
+}
+
+}  // namespace dfly
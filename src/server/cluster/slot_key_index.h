@@ -0,0 +1,48 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/container/flat_hash_set.h>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "server/cluster/cluster_config.h"
+
+namespace dfly {
+
+// SlotKeyIndex keeps the keys of every cluster slot, so that flushing, counting and migrating
+// the keys of a slot costs O(keys in slot) instead of a traversal of the whole table.
+//
+// Notes:
+// - The index keeps a copy of every key, the per slot sets are allocated on the first Add.
+// - Keys returns a copy, so that callers can preempt and modify the table while they go over the
+//   keys. The keys may be gone or belong to a newer entry by the time they are looked up.
+class SlotKeyIndex {
+ public:
+  void Add(SlotId sid, std::string_view key);
+  void Remove(SlotId sid, std::string_view key);
+
+  // Returns at most limit keys of the slot.
+  std::vector<std::string> Keys(SlotId sid, size_t limit = SIZE_MAX) const;
+
+  size_t SlotSize(SlotId sid) const {
+    return slots_.empty() ? 0 : slots_[sid].size();
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  void Clear();
+
+ private:
+  std::vector<absl::flat_hash_set<std::string>> slots_;
+  size_t size_ = 0;
+};
+
+}  // namespace dfly
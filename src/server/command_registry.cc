@@ -4,6 +4,7 @@
 
 #include "server/command_registry.h"
 
+#include <absl/base/internal/cycleclock.h>
 #include <absl/strings/str_split.h>
 #include <absl/time/clock.h>
 
@@ -16,7 +17,10 @@
 #include "facade/dragonfly_connection.h"
 #include "facade/error.h"
 #include "server/acl/acl_commands_def.h"
+#include "server/conn_context.h"
+#include "server/proactor_watchdog.h"
 #include "server/server_state.h"
+#include "server/transaction.h"
 
 using namespace std;
 ABSL_FLAG(vector<string>, rename_command, {},
@@ -43,6 +47,21 @@ CommandId::CommandId(const char* name, uint32_t mask, int8_t arity, int8_t first
 
   if (mask & CO::BLOCKING)
     opt_mask_ |= CO::REVERSE_MAPPING;
+
+  string_view sv{name};
+  if (mask & CO::VARIADIC_KEYS) {
+    if (sv == "XREAD" || sv == "XREADGROUP")
+      variadic_keys_ = VariadicKeys::STREAMS;
+    else if (absl::EndsWith(sv, "STORE"))  // Z<xxx>STORE <key> commands
+      variadic_keys_ = VariadicKeys::DEST_NUM_KEYS;
+    else if (CO::IsEvalKind(sv))
+      variadic_keys_ = VariadicKeys::SCRIPT_NUM_KEYS;
+
+    requires_variadic_keys_ = absl::StartsWith(sv, "ZDIFF") || absl::StartsWith(sv, "ZUNION") ||
+                              absl::StartsWith(sv, "ZINTER");
+  }
+
+  has_store_option_ = (mask & CO::STORE_LAST_KEY) && sv == "GEORADIUSBYMEMBER";
 }
 
 bool CommandId::IsTransactional() const {
@@ -56,9 +75,20 @@ bool CommandId::IsTransactional() const {
 }
 
 uint64_t CommandId::Invoke(CmdArgList args, ConnectionContext* cntx) const {
+  using absl::base_internal::CycleClock;
+
+  // The fiber waits for the hops of the transaction off cpu, the shard callbacks account for their
+  // own cycles.
+  const Transaction* tx = cntx->transaction;
+  uint64_t wait_cycles = tx ? tx->GetWaitCycles() : 0;
+  int64_t start_cycles = CycleClock::Now();
   int64_t before = absl::GetCurrentTimeNanos();
-  handler_(args, cntx);
+  {
+    ProactorWatchdog::CommandScope watchdog_scope{this};
+    handler_(args, cntx);
+  }
   int64_t after = absl::GetCurrentTimeNanos();
+  int64_t cycles = CycleClock::Now() - start_cycles;
 
   ServerState* ss = ServerState::tlocal();  // Might have migrated thread, read after invocation
   int64_t execution_time_usec = (after - before) / 1000;
@@ -67,6 +97,14 @@ uint64_t CommandId::Invoke(CmdArgList args, ConnectionContext* cntx) const {
 
   ++ent.first;
   ent.second += execution_time_usec;
+  latency_histos_[ss->thread_index()].Add(execution_time_usec);
+
+  if (tx)
+    cycles -= tx->GetWaitCycles() - wait_cycles;
+  if (cycles > 0) {
+    AddCpuCycles(ss->thread_index(), cycles);
+    ProactorWatchdog::CheckSlice(*this, cycles);
+  }
 
   return execution_time_usec;
 }
@@ -102,12 +140,72 @@ CommandRegistry::CommandRegistry() {
   for (string name : GetFlag(FLAGS_restricted_commands)) {
     restricted_cmds_.emplace(AsciiStrToUpper(name));
   }
+
+  acl_name_ = RenamedOrOriginal("ACL");
 }
 
 void CommandRegistry::Init(unsigned int thread_count) {
   for (auto& [_, cmd] : cmd_map_) {
     cmd.Init(thread_count);
   }
+  BuildTable();
+}
+
+void CommandRegistry::BuildTable() {
+  using Entry = pair<string_view, CommandId*>;
+
+  table_seeds_.clear();
+  table_slots_.clear();
+  if (cmd_map_.empty())
+    return;
+
+  // About four names per bucket and half of the slots empty keep the seeds easy to find.
+  size_t num_buckets = absl::bit_ceil(cmd_map_.size() / 4 + 1);
+  size_t num_slots = absl::bit_ceil(cmd_map_.size() * 2);
+
+  vector<vector<pair<Entry, uint64_t>>> buckets(num_buckets);
+  for (auto& [name, cmd] : cmd_map_) {
+    uint64_t hash = absl::Hash<string_view>{}(name);
+    buckets[(hash >> 32) & (num_buckets - 1)].push_back({{name, &cmd}, hash});
+  }
+
+  // The largest buckets are placed first, while most of the slots are free.
+  vector<unsigned> order(num_buckets);
+  for (unsigned i = 0; i < num_buckets; ++i)
+    order[i] = i;
+  sort(order.begin(), order.end(),
+       [&](unsigned a, unsigned b) { return buckets[a].size() > buckets[b].size(); });
+
+  constexpr uint32_t kMaxSeed = 1u << 16;
+  vector<uint32_t> seeds(num_buckets, 0);
+  vector<Entry> slots(num_slots, Entry{{}, nullptr});
+  vector<size_t> placed;
+  for (unsigned b : order) {
+    uint32_t seed = 0;
+    for (; seed < kMaxSeed; ++seed) {
+      placed.clear();
+      for (const auto& [entry, hash] : buckets[b]) {
+        size_t slot = SlotHash(hash, seed) & (num_slots - 1);
+        if (slots[slot].second || find(placed.begin(), placed.end(), slot) != placed.end())
+          break;
+        placed.push_back(slot);
+      }
+      if (placed.size() == buckets[b].size())
+        break;
+    }
+
+    if (seed == kMaxSeed) {
+      LOG(WARNING) << "Could not build the command table, using the command map";
+      return;
+    }
+
+    seeds[b] = seed;
+    for (size_t i = 0; i < placed.size(); ++i)
+      slots[placed[i]] = buckets[b][i].first;
+  }
+
+  table_seeds_ = std::move(seeds);
+  table_slots_ = std::move(slots);
 }
 
 CommandRegistry& CommandRegistry::operator<<(CommandId cmd) {
@@ -138,6 +236,10 @@ CommandRegistry& CommandRegistry::operator<<(CommandId cmd) {
   }
   CHECK(cmd_map_.emplace(k, std::move(cmd)).second) << k;
 
+  // The table points into the map, which may have rehashed.
+  table_seeds_.clear();
+  table_slots_.clear();
+
   return *this;
 }
 
@@ -197,6 +299,8 @@ const char* OptName(CO::CommandOpt fl) {
       return "no-key-transactional";
     case NO_KEY_TX_SPAN_ALL:
       return "no-key-tx-span-all";
+    case OPTIMISTIC_READ:
+      return "optimistic-read";
   }
   return "unknown";
 }
@@ -6,10 +6,15 @@
 
 #include <absl/container/flat_hash_map.h>
 #include <absl/container/flat_hash_set.h>
+#include <absl/hash/hash.h>
+#include <absl/numeric/bits.h>
 #include <absl/types/span.h>
 
+#include <algorithm>
+#include <array>
 #include <functional>
 #include <optional>
+#include <vector>
 
 #include "base/function2.hpp"
 #include "facade/command_id.h"
@@ -44,6 +49,10 @@ enum CommandOpt : uint32_t {
   NO_KEY_TRANSACTIONAL = 1U << 16,
   NO_KEY_TX_SPAN_ALL =
       1U << 17,  // If set, all shards are active for the no-key-transactional command
+
+  // Read-only command whose hop callbacks can be re-run, allows reading optimistically without
+  // scheduling and retrying with locks upon conflicts.
+  OPTIMISTIC_READ = 1U << 18,
 };
 
 const char* OptName(CommandOpt fl);
@@ -64,8 +73,34 @@ static_assert(!IsEvalKind(""));
 // Per thread vector of command stats. Each entry is {cmd_calls, cmd_latency_agg in usec}.
 using CmdCallStats = std::pair<uint64_t, uint64_t>;
 
+// Per thread latency histogram of a command. Bucket i counts the calls that took less than 2^i
+// usec, the last bucket counts all the calls that took longer.
+struct CmdLatencyHistogram {
+  static constexpr unsigned kNumBuckets = 24;
+
+  std::array<uint64_t, kNumBuckets> buckets{};
+
+  void Add(uint64_t usec) {
+    ++buckets[std::min<unsigned>(absl::bit_width(usec), kNumBuckets - 1)];
+  }
+
+  void Merge(const CmdLatencyHistogram& other) {
+    for (unsigned i = 0; i < kNumBuckets; ++i)
+      buckets[i] += other.buckets[i];
+  }
+};
+
 class CommandId : public facade::CommandId {
  public:
+  // Where the keys of a VARIADIC_KEYS command are, derived from its name once so that
+  // DetermineKeys does not compare names on every call.
+  enum class VariadicKeys : uint8_t {
+    NUM_KEYS,         // <num_keys> <key>..., like ZUNION
+    DEST_NUM_KEYS,    // <dest> <num_keys> <key>..., like ZUNIONSTORE
+    SCRIPT_NUM_KEYS,  // <script> <num_keys> <key>..., like EVAL
+    STREAMS,          // the keys follow STREAMS, like XREAD
+  };
+
   // NOTICE: name must be a literal string, otherwise metrics break! (see cmd_stats_map in
   // server_state.h)
   CommandId(const char* name, uint32_t mask, int8_t arity, int8_t first_key, int8_t last_key,
@@ -75,6 +110,8 @@ class CommandId : public facade::CommandId {
 
   void Init(unsigned thread_count) {
     command_stats_ = std::make_unique<CmdCallStats[]>(thread_count);
+    latency_histos_ = std::make_unique<CmdLatencyHistogram[]>(thread_count);
+    cpu_cycles_ = std::make_unique<uint64_t[]>(thread_count);
   }
 
   using Handler =
@@ -88,6 +125,12 @@ class CommandId : public facade::CommandId {
   // Returns the invoke time in usec.
   uint64_t Invoke(CmdArgList args, ConnectionContext* cntx) const;
 
+  // Adds the cpu cycles the command consumed on the thread, either on its connection fiber or in
+  // the shard callbacks of its transaction.
+  void AddCpuCycles(unsigned thread_index, uint64_t cycles) const {
+    cpu_cycles_[thread_index] += cycles;
+  }
+
   // Returns error if validation failed, otherwise nullopt
   std::optional<facade::ErrorReply> Validate(CmdArgList tail_args) const;
 
@@ -117,18 +160,48 @@ class CommandId : public facade::CommandId {
     return (last_key_ != first_key_) || (opt_mask_ & CO::VARIADIC_KEYS);
   }
 
+  VariadicKeys variadic_keys() const {
+    return variadic_keys_;
+  }
+
+  // Whether a VARIADIC_KEYS command fails with zero keys.
+  bool requires_variadic_keys() const {
+    return requires_variadic_keys_;
+  }
+
+  // Whether a STORE_LAST_KEY command takes its store key after a STORE or STOREDIST option.
+  bool has_store_option() const {
+    return has_store_option_;
+  }
+
   void ResetStats(unsigned thread_index) {
     command_stats_[thread_index] = {0, 0};
+    latency_histos_[thread_index] = {};
+    cpu_cycles_[thread_index] = 0;
   }
 
   CmdCallStats GetStats(unsigned thread_index) const {
     return command_stats_[thread_index];
   }
 
+  const CmdLatencyHistogram& GetLatencyHistogram(unsigned thread_index) const {
+    return latency_histos_[thread_index];
+  }
+
+  uint64_t GetCpuCycles(unsigned thread_index) const {
+    return cpu_cycles_[thread_index];
+  }
+
  private:
   std::unique_ptr<CmdCallStats[]> command_stats_;
+  std::unique_ptr<CmdLatencyHistogram[]> latency_histos_;
+  std::unique_ptr<uint64_t[]> cpu_cycles_;
   Handler handler_;
   ArgValidator validator_;
+
+  VariadicKeys variadic_keys_ = VariadicKeys::NUM_KEYS;
+  bool requires_variadic_keys_ = false;
+  bool has_store_option_ = false;
 };
 
 class CommandRegistry {
@@ -140,11 +213,15 @@ class CommandRegistry {
   CommandRegistry& operator<<(CommandId cmd);
 
   const CommandId* Find(std::string_view cmd) const {
+    if (!table_slots_.empty())
+      return FindInTable(cmd);
     auto it = cmd_map_.find(cmd);
     return it == cmd_map_.end() ? nullptr : &it->second;
   }
 
   CommandId* Find(std::string_view cmd) {
+    if (!table_slots_.empty())
+      return FindInTable(cmd);
     auto it = cmd_map_.find(cmd);
     return it == cmd_map_.end() ? nullptr : &it->second;
   }
@@ -164,12 +241,13 @@ class CommandRegistry {
   }
 
   void MergeCallStats(unsigned thread_index,
-                      std::function<void(std::string_view, const CmdCallStats&)> cb) const {
+                      std::function<void(const CommandId&, const CmdCallStats&)> cb) const {
     for (const auto& k_v : cmd_map_) {
       auto src = k_v.second.GetStats(thread_index);
-      if (src.first == 0)
+      // Shard threads consume cycles of the commands called on other threads.
+      if (src.first == 0 && k_v.second.GetCpuCycles(thread_index) == 0)
         continue;
-      cb(k_v.second.name(), src);
+      cb(k_v.second, src);
     }
   }
 
@@ -177,16 +255,46 @@ class CommandRegistry {
 
   std::string_view RenamedOrOriginal(std::string_view orig) const;
 
+  // The name of the ACL command, after rename_command.
+  std::string_view acl_name() const {
+    return acl_name_;
+  }
+
   using FamiliesVec = std::vector<std::vector<std::string>>;
   FamiliesVec GetFamilies();
 
  private:
+  static uint64_t SlotHash(uint64_t hash, uint32_t seed) {
+    // The finalizer of splitmix64.
+    uint64_t z = hash + (uint64_t(seed) + 1) * 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+  CommandId* FindInTable(std::string_view cmd) const {
+    uint64_t hash = absl::Hash<std::string_view>{}(cmd);
+    uint32_t seed = table_seeds_[(hash >> 32) & (table_seeds_.size() - 1)];
+    const auto& slot = table_slots_[SlotHash(hash, seed) & (table_slots_.size() - 1)];
+    return slot.first == cmd ? slot.second : nullptr;
+  }
+
+  void BuildTable();
+
   absl::flat_hash_map<std::string, CommandId> cmd_map_;
   absl::flat_hash_map<std::string, std::string> cmd_rename_map_;
   absl::flat_hash_set<std::string> restricted_cmds_;
 
   FamiliesVec family_of_commands_;
   size_t bit_index_;
+
+  // A perfect hash table of cmd_map_, built by Init once all the commands are registered. Every
+  // bucket of names has a seed that maps them to distinct slots, so a lookup hashes the name once
+  // and compares it with a single slot. Empty until Init and if a command is registered after it.
+  std::vector<uint32_t> table_seeds_;
+  std::vector<std::pair<std::string_view, CommandId*>> table_slots_;
+
+  std::string acl_name_;
 };
 
 }  // namespace dfly
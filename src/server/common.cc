@@ -6,6 +6,8 @@
 
 #include <absl/strings/match.h>
 #include <absl/strings/str_cat.h>
+#include <absl/strings/str_join.h>
+#include <absl/strings/str_split.h>
 #include <fast_float/fast_float.h>
 
 #include <system_error>
@@ -13,7 +15,6 @@
 extern "C" {
 #include "redis/object.h"
 #include "redis/rdb.h"
-#include "redis/util.h"
 }
 
 #include "base/flags.h"
@@ -64,6 +65,7 @@ string_view KeyLockArgs::GetLockKey(string_view key) {
 
 atomic_uint64_t used_mem_peak(0);
 atomic_uint64_t used_mem_current(0);
+atomic_uint64_t used_mem_lua(0);
 atomic_uint64_t rss_mem_current(0);
 atomic_uint64_t rss_mem_peak(0);
 
@@ -220,7 +222,7 @@ void RecordExpiry(DbIndex dbid, string_view key) {
   auto journal = EngineShard::tlocal()->journal();
   CHECK(journal);
   journal->RecordEntry(0, journal::Op::EXPIRED, dbid, 1, ClusterConfig::KeySlot(key),
-                       make_pair("DEL", ArgSlice{key}), false);
+                       make_pair("DEL", ArgSlice{key}), false, key);
 }
 
 void TriggerJournalWriteToSink() {
@@ -232,16 +234,19 @@ void TriggerJournalWriteToSink() {
 #define ADD(x) (x) += o.x
 
 IoMgrStats& IoMgrStats::operator+=(const IoMgrStats& rhs) {
-  static_assert(sizeof(IoMgrStats) == 16);
+  static_assert(sizeof(IoMgrStats) == 40);
 
   read_total += rhs.read_total;
   read_delay_usec += rhs.read_delay_usec;
+  write_total += rhs.write_total;
+  write_delay_usec += rhs.write_delay_usec;
+  coalesced_write_total += rhs.coalesced_write_total;
 
   return *this;
 }
 
 TieredStats& TieredStats::operator+=(const TieredStats& o) {
-  static_assert(sizeof(TieredStats) == 48);
+  static_assert(sizeof(TieredStats) == 80);
 
   ADD(tiered_writes);
   ADD(storage_capacity);
@@ -249,6 +254,10 @@ TieredStats& TieredStats::operator+=(const TieredStats& o) {
   ADD(aborted_write_cnt);
   ADD(flush_skip_cnt);
   ADD(throttled_write_cnt);
+  ADD(compaction_moves);
+  ADD(page_cache_hits);
+  ADD(page_cache_misses);
+  ADD(blob_bytes);
 
   return *this;
 }
@@ -265,18 +274,23 @@ SearchStats& SearchStats::operator+=(const SearchStats& o) {
 
 #undef ADD
 
-OpResult<ScanOpts> ScanOpts::TryFrom(CmdArgList args) {
+OpResult<ScanOpts> ScanOpts::TryFrom(CmdArgList args, bool allow_snapshot) {
   ScanOpts scan_opts;
 
-  for (unsigned i = 0; i < args.size(); i += 2) {
+  for (unsigned i = 0; i < args.size(); ++i) {
     ToUpper(&args[i]);
     string_view opt = ArgS(args, i);
-    if (i + 1 == args.size()) {
+    if (opt == "SNAPSHOT" && allow_snapshot) {
+      scan_opts.snapshot = true;
+      continue;
+    }
+
+    if (++i == args.size()) {
       return facade::OpStatus::SYNTAX_ERR;
     }
 
     if (opt == "COUNT") {
-      if (!absl::SimpleAtoi(ArgS(args, i + 1), &scan_opts.limit)) {
+      if (!absl::SimpleAtoi(ArgS(args, i), &scan_opts.limit)) {
         return facade::OpStatus::INVALID_INT;
       }
       if (scan_opts.limit == 0)
@@ -284,14 +298,16 @@ OpResult<ScanOpts> ScanOpts::TryFrom(CmdArgList args) {
       else if (scan_opts.limit > 4096)
         scan_opts.limit = 4096;
     } else if (opt == "MATCH") {
-      scan_opts.pattern = ArgS(args, i + 1);
-      if (scan_opts.pattern == "*")
-        scan_opts.pattern = string_view{};
+      string_view pattern = ArgS(args, i);
+      if (pattern == "*")
+        scan_opts.matcher.reset();
+      else
+        scan_opts.matcher.emplace(pattern);
     } else if (opt == "TYPE") {
-      ToLower(&args[i + 1]);
-      scan_opts.type_filter = ArgS(args, i + 1);
+      ToLower(&args[i]);
+      scan_opts.type_filter = ArgS(args, i);
     } else if (opt == "BUCKET") {
-      if (!absl::SimpleAtoi(ArgS(args, i + 1), &scan_opts.bucket_id)) {
+      if (!absl::SimpleAtoi(ArgS(args, i), &scan_opts.bucket_id)) {
         return facade::OpStatus::INVALID_INT;
       }
     } else {
@@ -302,9 +318,7 @@ OpResult<ScanOpts> ScanOpts::TryFrom(CmdArgList args) {
 }
 
 bool ScanOpts::Matches(std::string_view val_name) const {
-  if (pattern.empty())
-    return true;
-  return stringmatchlen(pattern.data(), pattern.size(), val_name.data(), val_name.size(), 0) == 1;
+  return !matcher || matcher->Matches(val_name);
 }
 
 GenericError::operator std::error_code() const {
@@ -398,4 +412,73 @@ std::string AbslUnparseFlag(const dfly::MemoryBytesFlag& flag) {
   return strings::HumanReadableNumBytes(flag.value);
 }
 
+bool AbslParseFlag(std::string_view in, dfly::DbMemoryQuotasFlag* flag, std::string* err) {
+  flag->quotas.clear();
+  for (string_view entry : absl::StrSplit(in, ',', absl::SkipWhitespace())) {
+    size_t pos = entry.find(':');
+    uint32_t db = 0;
+    int64_t bytes = 0;
+    if (pos == string_view::npos || !absl::SimpleAtoi(entry.substr(0, pos), &db) ||
+        db >= kMaxDbId || !ParseHumanReadableBytes(entry.substr(pos + 1), &bytes) || bytes <= 0) {
+      *err = absl::StrCat("Invalid quota '", entry, "', expected <db index>:<bytes>, eg.: 0:10G");
+      return false;
+    }
+    flag->quotas.emplace_back(db, bytes);
+  }
+  return true;
+}
+
+std::string AbslUnparseFlag(const dfly::DbMemoryQuotasFlag& flag) {
+  vector<string> entries;
+  for (const auto& [db, bytes] : flag.quotas)
+    entries.push_back(absl::StrCat(db, ":", strings::HumanReadableNumBytes(bytes)));
+  return absl::StrJoin(entries, ",");
+}
+
+bool AbslParseFlag(std::string_view in, dfly::KeyspaceEventsFlag* flag, std::string* err) {
+  *flag = {};
+  for (char c : in) {
+    switch (c) {
+      case 'K':
+        flag->keyspace = true;
+        break;
+      case 'E':
+        flag->keyevent = true;
+        break;
+      case 'g':
+        flag->events |= KEYSPACE_EVENT_DEL;
+        break;
+      case '$':
+        flag->events |= KEYSPACE_EVENT_SET;
+        break;
+      case 'x':
+        flag->events |= KEYSPACE_EVENT_EXPIRED;
+        break;
+      case 'A':
+        flag->events |= KEYSPACE_EVENT_DEL | KEYSPACE_EVENT_SET | KEYSPACE_EVENT_EXPIRED;
+        break;
+      default:
+        *err = absl::StrCat("Unsupported keyspace event class '", string_view{&c, 1},
+                            "', expected a subset of KEg$xA");
+        return false;
+    }
+  }
+  return true;
+}
+
+std::string AbslUnparseFlag(const dfly::KeyspaceEventsFlag& flag) {
+  string res;
+  if (flag.keyspace)
+    res += 'K';
+  if (flag.keyevent)
+    res += 'E';
+  if (flag.events & KEYSPACE_EVENT_DEL)
+    res += 'g';
+  if (flag.events & KEYSPACE_EVENT_SET)
+    res += '$';
+  if (flag.events & KEYSPACE_EVENT_EXPIRED)
+    res += 'x';
+  return res;
+}
+
 }  // namespace dfly
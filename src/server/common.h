@@ -11,10 +11,12 @@
 #include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <optional>
 #include <string_view>
 #include <vector>
 
 #include "core/fibers.h"
+#include "core/glob_matcher.h"
 #include "facade/facade_types.h"
 #include "facade/op_status.h"
 
@@ -125,6 +127,9 @@ void TriggerJournalWriteToSink();
 struct IoMgrStats {
   uint64_t read_total = 0;
   uint64_t read_delay_usec = 0;
+  uint64_t write_total = 0;  // submitted writes, each one covers one or more coalesced writes.
+  uint64_t write_delay_usec = 0;
+  uint64_t coalesced_write_total = 0;  // writes merged into the preceding adjacent write.
 
   IoMgrStats& operator+=(const IoMgrStats& rhs);
 };
@@ -140,6 +145,16 @@ struct TieredStats {
   uint64_t flush_skip_cnt = 0;
   uint64_t throttled_write_cnt = 0;
 
+  // Values moved by the compaction out of sparse pages of the backing file.
+  uint64_t compaction_moves = 0;
+
+  // Reads served by the page cache of the backing file, and the ones that missed it.
+  uint64_t page_cache_hits = 0;
+  uint64_t page_cache_misses = 0;
+
+  // Bytes of the blobs that are not values of keys, like the spilled blocks of search indices.
+  size_t blob_bytes = 0;
+
   TieredStats& operator+=(const TieredStats&);
 };
 
@@ -182,6 +197,7 @@ const char* RdbTypeName(unsigned type);
 // Cached values, updated frequently to represent the correct state of the system.
 extern std::atomic_uint64_t used_mem_peak;
 extern std::atomic_uint64_t used_mem_current;
+extern std::atomic_uint64_t used_mem_lua;  // by lua interpreters of all threads, part of current
 extern std::atomic_uint64_t rss_mem_current;
 extern std::atomic_uint64_t rss_mem_peak;
 
@@ -350,13 +366,16 @@ class Context : protected Cancellation {
 };
 
 struct ScanOpts {
-  std::string_view pattern;
+  std::optional<GlobMatcher> matcher;  // unset if there is no pattern or it is "*".
   size_t limit = 10;
   std::string_view type_filter;
   unsigned bucket_id = UINT_MAX;
+  bool snapshot = false;  // SCAN ... SNAPSHOT, a point-in-time view of the keys.
 
   bool Matches(std::string_view val_name) const;
-  static OpResult<ScanOpts> TryFrom(CmdArgList args);
+
+  // SNAPSHOT is a syntax error unless allow_snapshot is set.
+  static OpResult<ScanOpts> TryFrom(CmdArgList args, bool allow_snapshot = false);
 };
 
 // I use relative time from Feb 1, 2023 in seconds.
@@ -377,4 +396,34 @@ struct MemoryBytesFlag {
 bool AbslParseFlag(std::string_view in, dfly::MemoryBytesFlag* flag, std::string* err);
 std::string AbslUnparseFlag(const dfly::MemoryBytesFlag& flag);
 
+// Memory quotas of databases, as a comma separated list of <db index>:<bytes>.
+struct DbMemoryQuotasFlag {
+  std::vector<std::pair<DbIndex, uint64_t>> quotas;
+};
+
+bool AbslParseFlag(std::string_view in, dfly::DbMemoryQuotasFlag* flag, std::string* err);
+std::string AbslUnparseFlag(const dfly::DbMemoryQuotasFlag& flag);
+
+enum KeyspaceEvent : uint8_t {
+  KEYSPACE_EVENT_DEL = 1,
+  KEYSPACE_EVENT_SET = 2,
+  KEYSPACE_EVENT_EXPIRED = 4,
+};
+
+// Keyspace notifications to publish, in the format of redis notify-keyspace-events: K for
+// __keyspace@<db>__:<key> channels, E for __keyevent@<db>__:<event> channels and the event
+// classes g (del), $ (set), x (expired) or A for all of them.
+struct KeyspaceEventsFlag {
+  bool keyspace = false;
+  bool keyevent = false;
+  uint8_t events = 0;  // mask of KeyspaceEvent
+
+  bool Enabled(KeyspaceEvent event) const {
+    return (keyspace || keyevent) && (events & event);
+  }
+};
+
+bool AbslParseFlag(std::string_view in, dfly::KeyspaceEventsFlag* flag, std::string* err);
+std::string AbslUnparseFlag(const dfly::KeyspaceEventsFlag& flag);
+
 }  // namespace dfly
@@ -117,8 +117,8 @@ void ConnectionContext::ChangeMonitor(bool start) {
   EnableMonitoring(start);
 }
 
-vector<unsigned> ChangeSubscriptions(bool pattern, CmdArgList args, bool to_add, bool to_reply,
-                                     ConnectionContext* conn) {
+vector<unsigned> ChangeSubscriptions(ChannelStore::Kind kind, CmdArgList args, bool to_add,
+                                     bool to_reply, ConnectionContext* conn) {
   vector<unsigned> result(to_reply ? args.size() : 0, 0);
 
   auto& conn_state = conn->conn_state;
@@ -133,12 +133,14 @@ vector<unsigned> ChangeSubscriptions(bool pattern, CmdArgList args, bool to_add,
   }
 
   auto& sinfo = *conn->conn_state.subscribe_info.get();
-  auto& local_store = pattern ? sinfo.patterns : sinfo.channels;
+  auto& local_store = kind == ChannelStore::PATTERN         ? sinfo.patterns
+                      : kind == ChannelStore::SHARD_CHANNEL ? sinfo.shard_channels
+                                                            : sinfo.channels;
 
   int32_t tid = util::ProactorBase::me()->GetPoolIndex();
   DCHECK_GE(tid, 0);
 
-  ChannelStoreUpdater csu{pattern, to_add, conn, uint32_t(tid)};
+  ChannelStoreUpdater csu{kind, to_add, conn, uint32_t(tid)};
 
   // Gather all the channels we need to subscribe to / remove.
   for (size_t i = 0; i < args.size(); ++i) {
@@ -148,8 +150,10 @@ vector<unsigned> ChangeSubscriptions(bool pattern, CmdArgList args, bool to_add,
     else if (!to_add && local_store.erase(channel) > 0)
       csu.Record(channel);
 
-    if (to_reply)
-      result[i] = sinfo.SubscriptionCount();
+    if (to_reply) {
+      result[i] = kind == ChannelStore::SHARD_CHANNEL ? sinfo.shard_channels.size()
+                                                      : sinfo.SubscriptionCount();
+    }
   }
 
   csu.Apply();
@@ -166,7 +170,8 @@ vector<unsigned> ChangeSubscriptions(bool pattern, CmdArgList args, bool to_add,
 }
 
 void ConnectionContext::ChangeSubscription(bool to_add, bool to_reply, CmdArgList args) {
-  vector<unsigned> result = ChangeSubscriptions(false, args, to_add, to_reply, this);
+  vector<unsigned> result =
+      ChangeSubscriptions(ChannelStore::CHANNEL, args, to_add, to_reply, this);
 
   if (to_reply) {
     for (size_t i = 0; i < result.size(); ++i) {
@@ -181,7 +186,8 @@ void ConnectionContext::ChangeSubscription(bool to_add, bool to_reply, CmdArgLis
 }
 
 void ConnectionContext::ChangePSubscription(bool to_add, bool to_reply, CmdArgList args) {
-  vector<unsigned> result = ChangeSubscriptions(true, args, to_add, to_reply, this);
+  vector<unsigned> result =
+      ChangeSubscriptions(ChannelStore::PATTERN, args, to_add, to_reply, this);
 
   if (to_reply) {
     const char* action[2] = {"punsubscribe", "psubscribe"};
@@ -195,6 +201,22 @@ void ConnectionContext::ChangePSubscription(bool to_add, bool to_reply, CmdArgLi
   }
 }
 
+void ConnectionContext::ChangeSSubscription(bool to_add, bool to_reply, CmdArgList args) {
+  vector<unsigned> result =
+      ChangeSubscriptions(ChannelStore::SHARD_CHANNEL, args, to_add, to_reply, this);
+
+  if (to_reply) {
+    const char* action[2] = {"sunsubscribe", "ssubscribe"};
+    if (result.size() == 0) {
+      return SendSubscriptionChangedResponse(action[to_add], std::nullopt, 0);
+    }
+
+    for (size_t i = 0; i < result.size(); ++i) {
+      SendSubscriptionChangedResponse(action[to_add], ArgS(args, i), result[i]);
+    }
+  }
+}
+
 void ConnectionContext::UnsubscribeAll(bool to_reply) {
   if (to_reply && (!conn_state.subscribe_info || conn_state.subscribe_info->channels.empty())) {
     return SendSubscriptionChangedResponse("unsubscribe", std::nullopt, 0);
@@ -216,6 +238,18 @@ void ConnectionContext::PUnsubscribeAll(bool to_reply) {
   ChangePSubscription(false, to_reply, CmdArgList{arg_vec});
 }
 
+void ConnectionContext::SUnsubscribeAll(bool to_reply) {
+  if (to_reply &&
+      (!conn_state.subscribe_info || conn_state.subscribe_info->shard_channels.empty())) {
+    return SendSubscriptionChangedResponse("sunsubscribe", std::nullopt, 0);
+  }
+
+  StringVec channels(conn_state.subscribe_info->shard_channels.begin(),
+                     conn_state.subscribe_info->shard_channels.end());
+  CmdArgVec arg_vec(channels.begin(), channels.end());
+  ChangeSSubscription(false, to_reply, CmdArgList{arg_vec});
+}
+
 void ConnectionContext::SendSubscriptionChangedResponse(string_view action,
                                                         std::optional<string_view> topic,
                                                         unsigned count) {
@@ -238,11 +272,12 @@ size_t ConnectionState::ScriptInfo::UsedMemory() const {
 }
 
 size_t ConnectionState::SubscribeInfo::UsedMemory() const {
-  return dfly::HeapSize(channels) + dfly::HeapSize(patterns);
+  return dfly::HeapSize(channels) + dfly::HeapSize(patterns) + dfly::HeapSize(shard_channels);
 }
 
 size_t ConnectionState::UsedMemory() const {
-  return dfly::HeapSize(exec_info) + dfly::HeapSize(script_info) + dfly::HeapSize(subscribe_info);
+  return dfly::HeapSize(exec_info) + dfly::HeapSize(script_info) + dfly::HeapSize(subscribe_info) +
+         dfly::HeapSize(tracking_prefixes) + dfly::HeapSize(affinity_info);
 }
 
 size_t ConnectionContext::UsedMemory() const {
@@ -106,12 +106,24 @@ struct ConnectionState {
     size_t async_cmds_heap_mem = 0;     // bytes used by async_cmds
     size_t async_cmds_heap_limit = 0;   // max bytes allowed for async_cmds
     std::vector<StoredCmd> async_cmds;  // aggregated by acall
+    std::vector<StoredCmd> batch_cmds;  // queued by pcall_batch
+  };
+
+  // Shards served by the single shard commands of the connection, see migrate_affinity_window.
+  struct AffinityInfo {
+    size_t UsedMemory() const {
+      return shard_hits.capacity() * sizeof(uint32_t);
+    }
+
+    std::vector<uint32_t> shard_hits;  // commands per shard in the current window
+    uint32_t samples = 0;
+    ShardId candidate = kInvalidSid;  // dominant shard of the previous window
   };
 
   // PUB-SUB messaging related data.
   struct SubscribeInfo {
     bool IsEmpty() const {
-      return channels.empty() && patterns.empty();
+      return channels.empty() && patterns.empty() && shard_channels.empty();
     }
 
     unsigned SubscriptionCount() const {
@@ -123,6 +135,7 @@ struct ConnectionState {
     // TODO: to provide unique_strings across service. This will allow us to use string_view here.
     absl::flat_hash_set<std::string> channels;
     absl::flat_hash_set<std::string> patterns;
+    absl::flat_hash_set<std::string> shard_channels;  // counted apart as in redis
   };
 
   struct ReplicationInfo {
@@ -132,6 +145,7 @@ struct ConnectionState {
     uint32_t repl_flow_id = UINT32_MAX;
     uint32_t repl_listening_port = 0;
     DflyVersion repl_version = DflyVersion::VER0;
+    bool repl_stripe = false;  // the connection is a stripe of a flow, see DFLY STRIPE.
   };
 
   struct SquashingInfo {
@@ -155,12 +169,21 @@ struct ConnectionState {
   // For get op - we use it as a mask of MCGetMask values.
   uint32_t memcache_flag = 0;
 
+  // Key prefixes registered with CLIENT TRACKING ON BCAST. Not empty iff broadcast mode is on;
+  // BCAST without PREFIX registers the empty prefix.
+  std::vector<std::string> tracking_prefixes;
+
+  // Reads on a replica fail if it lags behind the master by more than this, set by
+  // CLIENT READSTALENESS. 0 means unbounded.
+  uint32_t read_staleness_ms = 0;
+
   ExecInfo exec_info;
   ReplicationInfo replication_info;
 
   std::optional<SquashingInfo> squashing_info;
   std::unique_ptr<ScriptInfo> script_info;
   std::unique_ptr<SubscribeInfo> subscribe_info;
+  std::unique_ptr<AffinityInfo> affinity_info;
 };
 
 class ConnectionContext : public facade::ConnectionContext {
@@ -191,8 +214,10 @@ class ConnectionContext : public facade::ConnectionContext {
 
   void ChangeSubscription(bool to_add, bool to_reply, CmdArgList args);
   void ChangePSubscription(bool to_add, bool to_reply, CmdArgList args);
+  void ChangeSSubscription(bool to_add, bool to_reply, CmdArgList args);
   void UnsubscribeAll(bool to_reply);
   void PUnsubscribeAll(bool to_reply);
+  void SUnsubscribeAll(bool to_reply);
   void ChangeMonitor(bool start);  // either start or stop monitor on a given connection
 
   size_t UsedMemory() const override;
@@ -5,6 +5,7 @@
 
 #include "base/flags.h"
 #include "base/logging.h"
+#include "core/compact_string_set.h"
 #include "core/sorted_map.h"
 #include "core/string_map.h"
 #include "core/string_set.h"
@@ -17,6 +18,7 @@ extern "C" {
 #include "redis/intset.h"
 #include "redis/listpack.h"
 #include "redis/object.h"
+#include "redis/quicklist.h"
 #include "redis/redis_aux.h"
 #include "redis/util.h"
 #include "redis/zset.h"
@@ -136,20 +138,62 @@ bool IterateList(const PrimeValue& pv, const IterateFunc& func, long start, long
   if (end < 0 || end >= llen)
     end = llen - 1;
 
-  quicklistIter* qiter = quicklistGetIteratorAtIdx(ql, AL_START_HEAD, start);
-  quicklistEntry entry = QLEntry();
-  long lrange = end - start + 1;
+  if (start < 0 || start > end)
+    return true;
+
+  // We walk the nodes directly because quicklistIter decompresses the nodes in place and
+  // compresses them back once it moves on, which is wasteful for read-only iteration.
+  // Find the node of start from the closest end of the list, offset is the index of its first
+  // element.
+  quicklistNode* node;
+  long offset;
+  if (start < llen / 2) {
+    node = ql->head;
+    offset = 0;
+    while (offset + node->count <= start) {
+      offset += node->count;
+      node = node->next;
+    }
+  } else {
+    node = ql->tail;
+    offset = llen - node->count;
+    while (offset > start) {
+      node = node->prev;
+      offset -= node->count;
+    }
+  }
 
-  bool success = true;
-  while (success && quicklistNext(qiter, &entry) && lrange-- > 0) {
-    if (entry.value) {
-      success = func(ContainerEntry{reinterpret_cast<char*>(entry.value), entry.sz});
+  string decompressed;
+  for (long index = start; index <= end; node = node->next) {
+    DCHECK(node);
+    uint8_t* entry = node->entry;
+
+    if (quicklistNodeIsCompressed(node)) {
+      decompressed.resize(node->sz);
+      entry = reinterpret_cast<uint8_t*>(decompressed.data());
+      CHECK(quicklistDecompressNodeTo(node, entry));
+    }
+
+    if (QL_NODE_IS_PLAIN(node)) {
+      if (!func(ContainerEntry{reinterpret_cast<char*>(entry), node->sz}))
+        return false;
+      ++index;
     } else {
-      success = func(ContainerEntry{entry.longval});
+      for (uint8_t* p = lpSeek(entry, index - offset); p && index <= end; p = lpNext(entry, p)) {
+        unsigned int slen;
+        long long lval;
+        uint8_t* val = lpGetValue(p, &slen, &lval);
+        bool success = val ? func(ContainerEntry{reinterpret_cast<char*>(val), slen})
+                           : func(ContainerEntry{lval});
+        if (!success)
+          return false;
+        ++index;
+      }
     }
+    offset += node->count;
   }
-  quicklistReleaseIterator(qiter);
-  return success;
+
+  return true;
 }
 
 bool IterateSet(const PrimeValue& pv, const IterateFunc& func) {
@@ -164,7 +208,14 @@ bool IterateSet(const PrimeValue& pv, const IterateFunc& func) {
     }
   } else {
     if (pv.Encoding() == kEncodingStrMap2) {
-      for (sds ptr : *static_cast<StringSet*>(pv.RObjPtr())) {
+      for (string_view str : *static_cast<StringSet*>(pv.RObjPtr())) {
+        if (!func(ContainerEntry{str.data(), str.size()})) {
+          success = false;
+          break;
+        }
+      }
+    } else if (pv.Encoding() == kEncodingCompactSet) {
+      for (sds ptr : *static_cast<CompactStringSet*>(pv.RObjPtr())) {
         if (!func(ContainerEntry{ptr, sdslen(ptr)})) {
           success = false;
           break;
@@ -330,7 +381,7 @@ OpResult<string> RunCbOnFirstNonEmptyBlocking(Transaction* trans, int req_obj_ty
   };
 
   *block_flag = true;
-  auto status = trans->WaitOnWatch(limit_tp, std::move(wcb), key_checker);
+  auto status = trans->WaitOnWatch(limit_tp, std::move(wcb), key_checker, true);
   *block_flag = false;
 
   if (status != OpStatus::OK)
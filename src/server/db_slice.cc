@@ -5,13 +5,21 @@
 #include "server/db_slice.h"
 
 extern "C" {
+#include "redis/listpack.h"
 #include "redis/object.h"
+#include "redis/redis_aux.h"
+#include "redis/stream.h"
 }
 
 #include <absl/cleanup/cleanup.h>
+#include <absl/container/inlined_vector.h>
+#include <absl/strings/str_cat.h>
 
 #include "base/flags.h"
 #include "base/logging.h"
+#include "core/sorted_map.h"
+#include "core/string_map.h"
+#include "core/string_set.h"
 #include "generic_family.h"
 #include "server/engine_shard_set.h"
 #include "server/error.h"
@@ -30,6 +38,45 @@ ABSL_FLAG(uint32_t, max_segment_to_consider, 4,
           "The maximum number of dashtable segments to scan in each eviction "
           "when heartbeat based eviction is triggered under memory pressure.");
 
+ABSL_FLAG(uint32_t, cache_freq_sketch_width, 0,
+          "If positive, the number of counters per row of an access frequency sketch that cache "
+          "mode uses to evict the least frequently used of the candidate keys. With 0 cache mode "
+          "evicts without it, and --tiered_offload_cold uses a sketch of 131072 counters per row.");
+
+ABSL_FLAG(dfly::DbMemoryQuotasFlag, db_maxmemory, {},
+          "Memory quotas of databases, as a comma separated list of <db index>:<bytes>, "
+          "eg.: 0:10G,3:500MB. A database over its quota rejects writes or, in cache mode, "
+          "evicts its own keys, regardless of the memory used by the other databases.");
+
+ABSL_FLAG(bool, expiry_wheel, false,
+          "If true, expiring keys are also kept in a timing wheel so that the active expiry "
+          "deletes the due keys directly instead of relying on sampling the expire table. "
+          "Costs a copy of every expiring key.");
+
+ABSL_FLAG(bool, cluster_slot_key_index, false,
+          "If true, in cluster mode the keys of every slot are also kept in an index, so that "
+          "flushing, counting and migrating the keys of a slot does not traverse the whole "
+          "table. Costs a copy of every key.");
+
+ABSL_FLAG(uint32_t, lazyfree_min_elements, 0,
+          "If positive, deleted or overwritten lists, sets and hashes with at least this number "
+          "of elements are freed in steps by the shard heartbeat instead of at once. The backlog "
+          "is reported by lazyfree_pending_objects and lazyfree_pending_elements in INFO.");
+
+ABSL_FLAG(uint32_t, hot_keys_window_sec, 60,
+          "Length of the window of the top keys tracking. The counts of the keys and the rates "
+          "reported by HOTKEYS are reset when it ends. 0 keeps counting until HOTKEYS RESET.");
+
+ABSL_FLAG(dfly::KeyspaceEventsFlag, notify_keyspace_events, {},
+          "Keyspace notifications to publish, any of K (keyspace channels), E (keyevent "
+          "channels) and the event classes g (del), $ (set), x (expired) or A (all), like redis");
+
+ABSL_DECLARE_FLAG(bool, hot_key_replication);
+ABSL_DECLARE_FLAG(uint32_t, hot_key_min_reads);
+#ifdef __linux__
+ABSL_DECLARE_FLAG(bool, tiered_offload_cold);
+#endif
+
 namespace dfly {
 
 using namespace std;
@@ -39,6 +86,7 @@ using facade::OpStatus;
 
 namespace {
 
+#ifndef DF_INLINE_EXPIRE
 constexpr auto kPrimeSegmentSize = PrimeTable::kSegBytes;
 constexpr auto kExpireSegmentSize = ExpireTable::kSegBytes;
 
@@ -48,6 +96,7 @@ static_assert(kPrimeSegmentSize == 32288);
 // 20480 is the next goodsize so we are loosing ~300 bytes or 1.5%.
 // 24576
 static_assert(kExpireSegmentSize == 23528);
+#endif
 
 void AccountObjectMemory(string_view key, unsigned type, int64_t size, DbTable* db) {
   DCHECK_NE(db, nullptr);
@@ -62,6 +111,59 @@ void AccountObjectMemory(string_view key, unsigned type, int64_t size, DbTable*
   }
 }
 
+// Number of elements of a value tracked by BigKeys, the length for strings. JSON values do not
+// keep a count.
+size_t ElementCount(const PrimeValue& pv) {
+  return pv.ObjType() == OBJ_JSON ? 0 : pv.Size();
+}
+
+// Bytes of a value accounted for the slot statistics of the commands that access it.
+size_t SlotValueBytes(const PrimeValue& pv) {
+  return pv.ObjType() == OBJ_STRING ? pv.Size() : 0;
+}
+
+// Returns the hash as a listpack of less than max_bytes, or nullptr if it does not fit or has
+// fields with expiry time, which listpacks do not keep.
+uint8_t* StringMapToListPack(StringMap* sm, size_t max_bytes) {
+  size_t bytes = 0;
+  for (auto it = sm->begin(); it != sm->end(); ++it) {
+    size_t field_len = sdslen(it->first), value_len = sdslen(it->second);
+    bytes += field_len + value_len;
+    if (it.HasExpiry() || bytes >= max_bytes || field_len > server.max_map_field_len ||
+        value_len > server.max_map_field_len)
+      return nullptr;
+  }
+
+  uint8_t* lp = lpNew(bytes);
+  for (const auto& k_v : *sm) {
+    lp = lpAppend(lp, reinterpret_cast<const uint8_t*>(k_v.first), sdslen(k_v.first));
+    lp = lpAppend(lp, reinterpret_cast<const uint8_t*>(k_v.second), sdslen(k_v.second));
+  }
+
+  if (lpBytes(lp) >= max_bytes) {
+    lpFree(lp);
+    return nullptr;
+  }
+  return lp;
+}
+
+// Returns the sorted set as a listpack, or nullptr if it has more than max_entries members or
+// a member longer than zset_max_listpack_value.
+uint8_t* SortedMapToListPack(const detail::SortedMap& sm, size_t max_entries) {
+  if (sm.Size() > max_entries)
+    return nullptr;
+
+  size_t max_len = 0;
+  uint64_t cursor = 0;
+  do {
+    cursor = sm.Scan(cursor, [&](string_view member, double) {
+      max_len = std::max(max_len, member.size());
+    });
+  } while (cursor);
+
+  return max_len > server.zset_max_listpack_value ? nullptr : sm.ToListPack();
+}
+
 class PrimeEvictionPolicy {
  public:
   static constexpr bool can_evict = true;  // we implement eviction functionality.
@@ -175,41 +277,78 @@ unsigned PrimeEvictionPolicy::Evict(const PrimeTable::HotspotBuckets& eb, PrimeT
     return 0;
 
   constexpr size_t kNumStashBuckets = ABSL_ARRAYSIZE(eb.probes.by_type.stash_buckets);
+  DbTable* table = db_slice_->GetDBTable(cntx_.db_index);
+  const FrequencySketch& sketch = db_slice_->freq_sketch();
+
+  // The candidates are the last slots of the stash buckets, starting with a "randomly" chosen
+  // one. Without the frequency sketch only that one is considered, otherwise the least frequently
+  // used candidate is evicted.
+  auto last_slot = [&](unsigned i) {
+    auto bucket_it = eb.probes.by_type.stash_buckets[(eb.key_hash + i) % kNumStashBuckets];
+    auto last_slot_it = bucket_it;
+    last_slot_it += (PrimeTable::kBucketWidth - 1);
+    return pair{bucket_it, last_slot_it};
+  };
 
-  // choose "randomly" a stash bucket to evict an item.
-  auto bucket_it = eb.probes.by_type.stash_buckets[eb.key_hash % kNumStashBuckets];
-  auto last_slot_it = bucket_it;
-  last_slot_it += (PrimeTable::kBucketWidth - 1);
-  if (!last_slot_it.is_done()) {
-    // don't evict sticky items
-    if (last_slot_it->first.IsSticky()) {
-      return 0;
+  unsigned num_candidates = sketch.IsEnabled() ? kNumStashBuckets : 1;
+  optional<unsigned> victim;
+  unsigned victim_freq = 0;
+  string tmp;
+
+  for (unsigned i = 0; i < num_candidates; ++i) {
+    auto [bucket_it, last_slot_it] = last_slot(i);
+    if (last_slot_it.is_done()) {  // nothing to evict, just make room in the bucket
+      me->ShiftRight(bucket_it);
+      return 1;
     }
 
-    DbTable* table = db_slice_->GetDBTable(cntx_.db_index);
-    auto& lt = table->trans_locks;
-    string tmp;
-    string_view key = last_slot_it->first.GetSlice(&tmp);
+    // don't evict sticky items
+    if (last_slot_it->first.IsSticky())
+      continue;
+
     // do not evict locked keys
-    if (lt.find(KeyLockArgs::GetLockKey(key)) != lt.end())
-      return 0;
+    string_view key = last_slot_it->first.GetSlice(&tmp);
+    if (!table->trans_locks.Find(KeyLockArgs::GetLockKey(key)).IsFree())
+      continue;
 
-    // log the evicted keys to journal.
-    if (auto journal = db_slice_->shard_owner()->journal(); journal) {
-      ArgSlice delete_args(&key, 1);
-      journal->RecordEntry(0, journal::Op::EXPIRED, cntx_.db_index, 1, ClusterConfig::KeySlot(key),
-                           make_pair("DEL", delete_args), false);
+    unsigned freq = sketch.Estimate(last_slot_it->first.HashCode());
+    if (!victim || freq < victim_freq) {
+      victim = i;
+      victim_freq = freq;
     }
+  }
 
-    db_slice_->PerformDeletion(last_slot_it, table);
+  if (!victim)
+    return 0;
 
-    ++evicted_;
+  auto [bucket_it, last_slot_it] = last_slot(*victim);
+
+  // log the evicted keys to journal.
+  if (auto journal = db_slice_->shard_owner()->journal(); journal) {
+    string_view key = last_slot_it->first.GetSlice(&tmp);
+    ArgSlice delete_args(&key, 1);
+    journal->RecordEntry(0, journal::Op::EXPIRED, cntx_.db_index, 1, ClusterConfig::KeySlot(key),
+                         make_pair("DEL", delete_args), false, key);
   }
+
+  db_slice_->PerformDeletion(last_slot_it, table);
+  ++evicted_;
   me->ShiftRight(bucket_it);
 
   return 1;
 }
 
+// The cold values offloading can not work without the sketch, so it gets one even if cache mode
+// does not use it.
+uint32_t FreqSketchWidth() {
+  uint32_t width = GetFlag(FLAGS_cache_freq_sketch_width);
+#ifdef __linux__
+  if (width == 0 && GetFlag(FLAGS_tiered_offload_cold))
+    width = 1 << 17;
+#endif
+  return width;
+}
+
 }  // namespace
 
 #define ADD(x) (x) += o.x
@@ -229,14 +368,16 @@ DbStats& DbStats::operator+=(const DbStats& o) {
 }
 
 SliceEvents& SliceEvents::operator+=(const SliceEvents& o) {
-  static_assert(sizeof(SliceEvents) == 96, "You should update this function with new fields");
+  static_assert(sizeof(SliceEvents) == 112, "You should update this function with new fields");
 
   ADD(evicted_keys);
   ADD(hard_evictions);
   ADD(expired_keys);
+  ADD(expired_fields);
   ADD(garbage_collected);
   ADD(stash_unloaded);
   ADD(bumpups);
+  ADD(lazyfreed_objects);
   ADD(garbage_checked);
   ADD(hits);
   ADD(misses);
@@ -253,10 +394,14 @@ DbSlice::DbSlice(uint32_t index, bool caching_mode, EngineShard* owner)
     : shard_id_(index),
       caching_mode_(caching_mode),
       owner_(owner),
-      client_tracking_map_(owner->memory_resource()) {
+      client_tracking_map_(owner->memory_resource()),
+      freq_sketch_(FreqSketchWidth()) {
   db_arr_.emplace_back();
   CreateDb(0);
   expire_base_[0] = expire_base_[1] = 0;
+  expiry_wheel_ = GetFlag(FLAGS_expiry_wheel);
+  slot_key_index_ = GetFlag(FLAGS_cluster_slot_key_index);
+  keyspace_events_ = GetFlag(FLAGS_notify_keyspace_events);
   soft_budget_limit_ = (0.3 * max_memory_limit / shard_set->size());
 }
 
@@ -287,7 +432,17 @@ auto DbSlice::GetStats() const -> Stats {
     stats.expire_count = db_wrap.expire.size();
     stats.table_mem_usage = (db_wrap.prime.mem_usage() + db_wrap.expire.mem_usage());
   }
-  s.small_string_bytes = CompactObj::GetStats().small_string_bytes;
+  CompactObj::Stats cobj_stats = CompactObj::GetStats();
+  s.small_string_bytes = cobj_stats.small_string_bytes;
+  s.compressed_values = cobj_stats.compressed_blobs;
+  s.compressed_value_bytes = cobj_stats.compressed_bytes;
+  s.compressed_value_raw_bytes = cobj_stats.compressed_raw_bytes;
+  s.shared_string_blobs = cobj_stats.shared_blobs;
+  s.shared_string_bytes = cobj_stats.shared_bytes;
+  s.shared_string_refs = cobj_stats.shared_refs;
+  s.lazyfree_pending_objects = lazy_free_queue_.size();
+  s.lazyfree_pending_elements = lazy_free_elements_;
+  s.scan_snapshot_bytes = scan_snapshot_bytes_;
 
   return s;
 }
@@ -297,13 +452,96 @@ SlotStats DbSlice::GetSlotStats(SlotId sid) const {
   return db_arr_[0]->slots_stats[sid];
 }
 
-void DbSlice::Reserve(DbIndex db_ind, size_t key_size) {
+vector<string> DbSlice::GetSlotKeys(SlotId sid, size_t limit) const {
+  if (slot_key_index_)
+    return db_arr_[0]->slot_keys.Keys(sid, limit);
+
+  vector<string> res;
+  string tmp;
+  auto cb = [&](PrimeTable::iterator it) {
+    if (res.size() < limit) {
+      string_view key = it->first.GetSlice(&tmp);
+      if (ClusterConfig::KeySlot(key) == sid)
+        res.emplace_back(key);
+    }
+  };
+
+  // The table may be replaced while the fiber is suspended, so it's fetched in every iteration.
+  PrimeTable::Cursor cursor;
+  uint64_t i = 0;
+  do {
+    cursor = db_arr_[0]->prime.Traverse(cursor, cb);
+    if (++i % 100 == 0)
+      ThisFiber::Yield();
+  } while (cursor && res.size() < limit);
+  return res;
+}
+
+void DbSlice::SampleSlotRates(uint64_t now_ms) {
+  if (!ClusterConfig::IsEnabled() || !db_arr_[0] || now_ms < slot_rates_sample_ms_ + 1000)
+    return;
+
+  uint64_t elapsed_ms = now_ms - slot_rates_sample_ms_;
+  bool first_sample = slot_rates_sample_ms_ == 0;
+  slot_rates_sample_ms_ = now_ms;
+
+  DbTable& db = *db_arr_[0];
+  for (size_t sid = 0; sid < db.slots_stats.size(); ++sid) {
+    SlotStats& stats = db.slots_stats[sid];
+    uint64_t ops = stats.total_reads + stats.total_writes;
+    uint64_t prev_ops = std::exchange(db.slots_sampled_ops[sid], ops);
+    if (!first_sample)
+      stats.ops_per_sec = ops > prev_ops ? (ops - prev_ops) * 1000 / elapsed_ms : 0;
+  }
+}
+
+vector<DbSlice::HotKey> DbSlice::GetHotKeys(uint64_t now_ms) const {
+  double window_sec = max<uint64_t>(now_ms - min(hot_keys_window_ms_, now_ms), 1000) / 1000.0;
+
+  vector<HotKey> res;
+  for (DbIndex index = 0; index < db_arr_.size(); ++index) {
+    if (!db_arr_[index] || !db_arr_[index]->top_keys.IsEnabled())
+      continue;
+
+    for (auto& [key, count] : db_arr_[index]->top_keys.GetTopKeys()) {
+      res.push_back(HotKey{.key = key, .db = index, .shard = shard_id_, .count = count,
+                           .qps = count / window_sec});
+    }
+  }
+  return res;
+}
+
+void DbSlice::ResetHotKeysWindow(uint64_t now_ms) {
+  hot_keys_window_ms_ = now_ms;
+  for (auto& db : db_arr_) {
+    if (db)
+      db->top_keys.Reset();
+  }
+}
+
+void DbSlice::RotateHotKeysWindow(uint64_t now_ms) {
+  if (hot_keys_window_ms_ == 0) {
+    hot_keys_window_ms_ = now_ms;
+    return;
+  }
+
+  uint64_t window_ms = uint64_t(GetFlag(FLAGS_hot_keys_window_sec)) * 1000;
+  if (window_ms > 0 && now_ms >= hot_keys_window_ms_ + window_ms)
+    ResetHotKeysWindow(now_ms);
+}
+
+void DbSlice::Reserve(DbIndex db_ind, size_t key_size, size_t expire_size) {
   ActivateDb(db_ind);
 
+  // Splits move entries between buckets without notifying the snapshots.
+  if (!change_cb_.empty())
+    return;
+
   auto& db = db_arr_[db_ind];
   DCHECK(db);
 
   db->prime.Reserve(key_size);
+  db->expire.Reserve(expire_size);
 }
 
 DbSlice::AutoUpdater::AutoUpdater() {
@@ -380,6 +618,11 @@ DbSlice::ItAndUpdater DbSlice::FindMutable(const Context& cntx, string_view key)
       FindMutableInternal(cntx, key, std::nullopt, LoadExternalMode::kDontLoad).value());
 }
 
+DbSlice::ItAndUpdater DbSlice::FindMutableToReplace(const Context& cntx, string_view key) {
+  return std::move(
+      FindMutableInternal(cntx, key, std::nullopt, LoadExternalMode::kDontRead).value());
+}
+
 OpResult<DbSlice::ItAndUpdater> DbSlice::FindMutable(const Context& cntx, string_view key,
                                                      unsigned req_obj_type) {
   return FindMutableInternal(cntx, key, req_obj_type, LoadExternalMode::kDontLoad);
@@ -435,6 +678,7 @@ OpResult<PrimeConstIterator> DbSlice::FindAndFetchReadOnly(const Context& cntx,
 }
 
 OpResult<DbSlice::ItAndExp> DbSlice::FindInternal(const Context& cntx, std::string_view key,
+                                                  uint64_t key_hash,
                                                   std::optional<unsigned> req_obj_type,
                                                   UpdateStatsMode stats_mode,
                                                   LoadExternalMode load_mode) {
@@ -444,7 +688,13 @@ OpResult<DbSlice::ItAndExp> DbSlice::FindInternal(const Context& cntx, std::stri
 
   DbSlice::ItAndExp res;
   auto& db = *db_arr_[cntx.db_index];
-  res.it = db.prime.Find(key);
+  res.it = db.prime.Find(key, key_hash);
+
+  // Misses count too, so that keys inserted once after a miss do not look hot. The estimates
+  // are also the heat of the values when tiered storage offloads cold values.
+  TieredStorage* tiered = shard_owner()->tiered_storage();
+  if (caching_mode_ || (tiered && tiered->OffloadsColdValues()))
+    freq_sketch_.Increment(key_hash);
 
   absl::Cleanup update_stats_on_miss = [&]() {
     switch (stats_mode) {
@@ -465,11 +715,17 @@ OpResult<DbSlice::ItAndExp> DbSlice::FindInternal(const Context& cntx, std::stri
     return OpStatus::WRONG_TYPE;
   }
 
-  if (TieredStorage* tiered = shard_owner()->tiered_storage();
-      tiered && load_mode == LoadExternalMode::kLoad) {
+  bool load = load_mode == LoadExternalMode::kLoad ||
+              (load_mode == LoadExternalMode::kDontLoad && res.it->second.ObjType() != OBJ_STRING);
+  if (tiered && load) {
     if (res.it->second.HasIoPending()) {
       tiered->CancelIo(cntx.db_index, res.it);
     } else if (res.it->second.IsExternal()) {
+      // Expired values are deleted without being read from disk.
+      if (res.it->second.HasExpire() && !IsValid(ExpireIfNeeded(cntx, res.it).it)) {
+        return OpStatus::KEY_NOTFOUND;
+      }
+
       // Load reads data from disk therefore we will preempt in this function.
       // We will update the iterator if it changed during the preemption
       res.it = tiered->Load(cntx.db_index, res.it, key);
@@ -487,6 +743,9 @@ OpResult<DbSlice::ItAndExp> DbSlice::FindInternal(const Context& cntx, std::stri
     }
   }
 
+  // Keeps hot values away from the cold values compression (see CompressColdValuesStep).
+  res.it->second.SetTouched(true);
+
   if (caching_mode_ && IsValid(res.it)) {
     if (!change_cb_.empty()) {
       auto bump_cb = [&](PrimeTable::bucket_iterator bit) {
@@ -498,11 +757,18 @@ OpResult<DbSlice::ItAndExp> DbSlice::FindInternal(const Context& cntx, std::stri
       db.prime.CVCUponBump(change_cb_.back().first, res.it, bump_cb);
     }
     res.it = db.prime.BumpUp(res.it, PrimeBumpPolicy{bumped_items_});
+#ifdef DF_INLINE_EXPIRE
+    res.exp_it = db.FindExpire(res.it);  // the expiry period moved together with the entry.
+#endif
     ++events_.bumpups;
     bumped_items_.insert(res.it->first.AsRef());
   }
 
-  db.top_keys.Touch(key);
+  if (uint64_t count = db.top_keys.Touch(key);
+      stats_mode == UpdateStatsMode::kReadStats && count >= GetFlag(FLAGS_hot_key_min_reads) &&
+      GetFlag(FLAGS_hot_key_replication)) {
+    TrackHotRead(cntx.db_index, key, res);
+  }
 
   std::move(update_stats_on_miss).Cancel();
   switch (stats_mode) {
@@ -512,13 +778,73 @@ OpResult<DbSlice::ItAndExp> DbSlice::FindInternal(const Context& cntx, std::stri
     case UpdateStatsMode::kReadStats:
       events_.hits++;
       if (ClusterConfig::IsEnabled()) {
-        db.slots_stats[ClusterConfig::KeySlot(key)].total_reads++;
+        SlotStats& slot_stats = db.slots_stats[ClusterConfig::KeySlot(key)];
+        slot_stats.total_reads++;
+        slot_stats.total_read_bytes += key.size() + SlotValueBytes(res.it->second);
       }
       break;
   }
   return res;
 }
 
+void DbSlice::FindManyReadOnly(const Context& cntx, ArgSlice keys,
+                               std::optional<unsigned> req_obj_type,
+                               OpResult<PrimeConstIterator>* dest) {
+  FindManyInternal(cntx, keys, req_obj_type, LoadExternalMode::kDontLoad, dest);
+}
+
+void DbSlice::FindAndFetchManyReadOnly(const Context& cntx, ArgSlice keys, unsigned req_obj_type,
+                                       OpResult<PrimeConstIterator>* dest) {
+  FindManyInternal(cntx, keys, req_obj_type, LoadExternalMode::kLoad, dest);
+}
+
+void DbSlice::FindManyInternal(const Context& cntx, ArgSlice keys,
+                               std::optional<unsigned> req_obj_type, LoadExternalMode load_mode,
+                               OpResult<PrimeConstIterator>* dest) {
+  if (load_mode == LoadExternalMode::kLoad && keys.size() > 1)
+    FetchExternalMany(cntx.db_index, keys);
+
+  if (!IsDbValid(cntx.db_index)) {
+    std::fill(dest, dest + keys.size(), OpStatus::KEY_NOTFOUND);
+    return;
+  }
+
+  uint64_t hashes[kPrefetchWindow];
+  for (size_t start = 0; start < keys.size(); start += kPrefetchWindow) {
+    ArgSlice window = keys.subspan(start, kPrefetchWindow);
+    PrefetchKeys(cntx.db_index, window, hashes);
+
+    for (size_t i = 0; i < window.size(); ++i) {
+      auto res = FindInternal(cntx, window[i], hashes[i], req_obj_type,
+                              UpdateStatsMode::kReadStats, load_mode);
+      if (res.ok()) {
+        dest[start + i] = PrimeConstIterator{res->it};
+      } else {
+        dest[start + i] = res.status();
+      }
+    }
+  }
+}
+
+void DbSlice::FetchExternalMany(DbIndex db_ind, ArgSlice keys) {
+  TieredStorage* tiered = shard_owner()->tiered_storage();
+  if (tiered && IsDbValid(db_ind) && db_arr_[db_ind]->stats.tiered_entries > 0)
+    tiered->LoadMany(db_ind, keys);
+}
+
+void DbSlice::PrefetchKeys(DbIndex db_ind, ArgSlice keys, uint64_t* hashes) const {
+  if (!IsDbValid(db_ind))
+    return;
+
+  const PrimeTable& prime = db_arr_[db_ind]->prime;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    uint64_t key_hash = prime.DoHash(keys[i]);
+    prime.Prefetch(key_hash);
+    if (hashes)
+      hashes[i] = key_hash;
+  }
+}
+
 OpResult<pair<PrimeConstIterator, unsigned>> DbSlice::FindFirstReadOnly(const Context& cntx,
                                                                         ArgSlice args,
                                                                         int req_obj_type) {
@@ -546,6 +872,11 @@ OpResult<DbSlice::AddOrFindResult> DbSlice::AddOrFindAndFetch(const Context& cnt
   return AddOrFindInternal(cntx, key, LoadExternalMode::kLoad);
 }
 
+OpResult<DbSlice::AddOrFindResult> DbSlice::AddOrFindToReplace(const Context& cntx,
+                                                               string_view key) {
+  return AddOrFindInternal(cntx, key, LoadExternalMode::kDontRead);
+}
+
 OpResult<DbSlice::AddOrFindResult> DbSlice::AddOrFindInternal(const Context& cntx, string_view key,
                                                               LoadExternalMode load_mode) {
   DCHECK(IsDbValid(cntx.db_index));
@@ -585,9 +916,12 @@ OpResult<DbSlice::AddOrFindResult> DbSlice::AddOrFindInternal(const Context& cnt
   bool apply_memory_limit =
       !owner_->IsReplica() && !(ServerState::tlocal()->gstate() == GlobalState::LOADING);
 
+  // A database close to its quota can't grow and, in cache mode, evicts its own keys.
+  ssize_t budget = min(memory_budget_, db.QuotaBudget());
+
   PrimeEvictionPolicy evp{cntx,
                           (bool(caching_mode_) && !owner_->IsReplica()),
-                          int64_t(memory_budget_ - key.size()),
+                          int64_t(budget - key.size()),
                           ssize_t(soft_budget_limit_),
                           this,
                           apply_memory_limit};
@@ -601,7 +935,8 @@ OpResult<DbSlice::AddOrFindResult> DbSlice::AddOrFindInternal(const Context& cnt
 
   // Fast-path if change_cb_ is empty so we Find or Add using
   // the insert operation: twice more efficient.
-  CompactObj co_key{key};
+  CompactObj co_key;
+  co_key.SetKey(key);
   PrimeIterator it;
 
   // I try/catch just for sake of having a convenient place to set a breakpoint.
@@ -636,10 +971,12 @@ OpResult<DbSlice::AddOrFindResult> DbSlice::AddOrFindInternal(const Context& cnt
   events_.evicted_keys += evp.evicted();
   events_.garbage_checked += evp.checked();
 
-  memory_budget_ = evp.mem_budget() + evicted_obj_bytes;
+  memory_budget_ += evp.mem_budget() - budget + evicted_obj_bytes;
   if (ClusterConfig::IsEnabled()) {
     SlotId sid = ClusterConfig::KeySlot(key);
     db.slots_stats[sid].key_count += 1;
+    if (slot_key_index_)
+      db.slot_keys.Add(sid, key);
   }
 
   return DbSlice::AddOrFindResult{
@@ -673,6 +1010,10 @@ bool DbSlice::Del(DbIndex db_ind, PrimeIterator it) {
     DbContext cntx{db_ind, GetCurrentTimeMs()};
     doc_del_cb_(key, cntx, it->second);
   }
+  if (keyspace_events_.Enabled(KEYSPACE_EVENT_DEL)) {
+    string tmp;
+    OnKeyspaceEvent(db_ind, KEYSPACE_EVENT_DEL, it->first.GetSlice(&tmp));
+  }
   bumped_items_.erase(it->first.AsRef());
   PerformDeletion(it, db.get());
   deletion_count_++;
@@ -686,6 +1027,28 @@ void DbSlice::FlushSlotsFb(const SlotSet& slot_ids) {
   // was made. Therefore we delete slots entries with version < next_version
   uint64_t next_version = NextVersion();
 
+  ServerState& etl = *ServerState::tlocal();
+  if (slot_key_index_) {
+    uint64_t i = 0;
+    for (SlotId sid : slot_ids) {
+      for (const string& key : db_arr_[0]->slot_keys.Keys(sid)) {
+        // The table may be replaced while the fiber is suspended, so it's fetched for every key.
+        DbTable* table = db_arr_[0].get();
+        if (PrimeIterator it = table->prime.Find(key);
+            IsValid(it) && it.GetVersion() < next_version) {
+          PerformDeletion(it, table);
+        }
+        if (++i % 100 == 0) {
+          ThisFiber::Yield();
+          if (etl.gstate() == GlobalState::SHUTTING_DOWN)
+            return;
+        }
+      }
+    }
+    mi_heap_collect(etl.data_heap(), true);
+    return;
+  }
+
   std::string tmp;
   auto del_entry_cb = [&](PrimeTable::iterator it) {
     std::string_view key = it->first.GetSlice(&tmp);
@@ -696,7 +1059,6 @@ void DbSlice::FlushSlotsFb(const SlotSet& slot_ids) {
     return true;
   };
 
-  ServerState& etl = *ServerState::tlocal();
   PrimeTable* pt = &db_arr_[0]->prime;
   PrimeTable::Cursor cursor;
   uint64_t i = 0;
@@ -720,12 +1082,21 @@ void DbSlice::FlushSlots(SlotSet slot_ids) {
 }
 
 void DbSlice::FlushDbIndexes(const std::vector<DbIndex>& indexes) {
+  // The flushed keys are not tracked as deleted, so the next delta needs a new base.
+  save_base_version_ = running_save_version_ = 0;
+  DropDeletedKeys();
+
   // TODO: to add preeemptiveness by yielding inside clear.
   DbTableArray flush_db_arr(db_arr_.size());
   for (DbIndex index : indexes) {
     auto& db = db_arr_[index];
     CHECK(db);
     InvalidateDbWatches(index);
+    for (const auto& [key, state] : db->hot_keys) {
+      if (state.published)
+        HotKeyCache::Retract(index, key, state.published);
+    }
+    db->hot_keys.clear();
     flush_db_arr[index] = std::move(db);
 
     CreateDb(index);
@@ -736,6 +1107,9 @@ void DbSlice::FlushDbIndexes(const std::vector<DbIndex>& indexes) {
   }
   CHECK(bumped_items_.empty());
   auto cb = [this, flush_db_arr = std::move(flush_db_arr)]() mutable {
+    // Number of entries visited between yields when handing large values to LazyFree.
+    constexpr unsigned kLazyFreeVisitsPerYield = 1024;
+
     for (auto& db_ptr : flush_db_arr) {
       if (db_ptr && db_ptr->stats.tiered_entries > 0) {
         for (auto it = db_ptr->prime.begin(); it != db_ptr->prime.end(); ++it) {
@@ -744,8 +1118,17 @@ void DbSlice::FlushDbIndexes(const std::vector<DbIndex>& indexes) {
         }
 
         DCHECK_EQ(0u, db_ptr->stats.tiered_entries);
-        db_ptr.reset();
       }
+
+      if (db_ptr && GetFlag(FLAGS_lazyfree_min_elements) > 0) {
+        unsigned visited = 0;
+        for (auto it = db_ptr->prime.begin(); it != db_ptr->prime.end(); ++it) {
+          LazyFree(&it->second);
+          if (++visited % kLazyFreeVisitsPerYield == 0)
+            ThisFiber::Yield();
+        }
+      }
+      db_ptr.reset();
     }
     mi_heap_collect(ServerState::tlocal()->data_heap(), true);
   };
@@ -778,6 +1161,22 @@ void DbSlice::AddExpire(DbIndex db_ind, PrimeIterator main_it, uint64_t at) {
   uint64_t delta = at - expire_base_[0];  // TODO: employ multigen expire updates.
   CHECK(db_arr_[db_ind]->expire.Insert(main_it->first.AsRef(), ExpirePeriod(delta)).second);
   main_it->second.SetExpire(true);
+  ScheduleExpiry(db_ind, main_it, at);
+}
+
+void DbSlice::SetExpireTime(DbIndex db_ind, PrimeIterator main_it, ExpireIterator exp_it,
+                            uint64_t at) {
+  exp_it->second = FromAbsoluteTime(at);
+  ScheduleExpiry(db_ind, main_it, at);
+}
+
+void DbSlice::ScheduleExpiry(DbIndex db_ind, PrimeIterator it, uint64_t at_ms) {
+  // Replicas do not expire keys by themselves, they apply the deletions of the master.
+  if (!expiry_wheel_ || owner_->IsReplica())
+    return;
+
+  string tmp;
+  db_arr_[db_ind]->expiry_wheel.Add(it->first.GetSlice(&tmp), at_ms, GetCurrentTimeMs());
 }
 
 bool DbSlice::RemoveExpire(DbIndex db_ind, PrimeIterator main_it) {
@@ -878,7 +1277,7 @@ OpResult<int64_t> DbSlice::UpdateExpire(const Context& cntx, PrimeIterator prime
       return OpStatus::SKIPPED;
     }
 
-    expire_it->second = FromAbsoluteTime(abs_msec);
+    SetExpireTime(cntx.db_index, prime_it, expire_it, abs_msec);
     return abs_msec;
   } else {
     if (params.expire_options & ExpireFlags::EXPIRE_XX) {
@@ -916,6 +1315,7 @@ OpResult<DbSlice::AddOrFindResult> DbSlice::AddOrUpdateInternal(const Context& c
     } else {
       res.exp_it = db.expire.InsertNew(it->first.AsRef(), ExpirePeriod(delta));
     }
+    ScheduleExpiry(cntx.db_index, it, expire_at_ms);
   }
 
   return op_result;
@@ -946,7 +1346,7 @@ bool DbSlice::Acquire(IntentLock::Mode mode, const KeyLockArgs& lock_args) {
 
   if (lock_args.args.size() == 1) {
     string_view key = KeyLockArgs::GetLockKey(lock_args.args.front());
-    lock_acquired = lt[key].Acquire(mode);
+    lock_acquired = lt.Acquire(key, mode);
     uniq_keys_ = {key};  // needed only for tests.
   } else {
     uniq_keys_.clear();
@@ -954,7 +1354,7 @@ bool DbSlice::Acquire(IntentLock::Mode mode, const KeyLockArgs& lock_args) {
     for (size_t i = 0; i < lock_args.args.size(); i += lock_args.key_step) {
       string_view s = KeyLockArgs::GetLockKey(lock_args.args[i]);
       if (uniq_keys_.insert(s).second) {
-        bool res = lt[s].Acquire(mode);
+        bool res = lt.Acquire(s, mode);
         lock_acquired &= res;
       }
     }
@@ -972,12 +1372,8 @@ void DbSlice::ReleaseNormalized(IntentLock::Mode mode, DbIndex db_index, std::st
   DVLOG(1) << "Release " << IntentLock::ModeName(mode) << " " << count << " for " << key;
 
   auto& lt = db_arr_[db_index]->trans_locks;
-  auto it = lt.find(KeyLockArgs::GetLockKey(key));
-  CHECK(it != lt.end()) << key;
-  it->second.Release(mode, count);
-  if (it->second.IsFree()) {
-    lt.erase(it);
-  }
+  CHECK(!lt.Find(key).IsFree()) << key;
+  lt.Release(key, mode, count);
 }
 
 void DbSlice::Release(IntentLock::Mode mode, const KeyLockArgs& lock_args) {
@@ -995,12 +1391,8 @@ void DbSlice::Release(IntentLock::Mode mode, const KeyLockArgs& lock_args) {
     for (size_t i = 0; i < lock_args.args.size(); i += lock_args.key_step) {
       auto s = KeyLockArgs::GetLockKey(lock_args.args[i]);
       if (uniq_keys_.insert(s).second) {
-        auto it = lt.find(s);
-        CHECK(it != lt.end());
-        it->second.Release(mode);
-        if (it->second.IsFree()) {
-          lt.erase(it);
-        }
+        CHECK(!lt.Find(s).IsFree()) << s;
+        lt.Release(s, mode);
       }
     }
   }
@@ -1019,17 +1411,29 @@ bool DbSlice::CheckLock(IntentLock::Mode mode, const KeyLockArgs& lock_args) con
   const auto& lt = db_arr_[lock_args.db_index]->trans_locks;
   for (size_t i = 0; i < lock_args.args.size(); i += lock_args.key_step) {
     auto s = KeyLockArgs::GetLockKey(lock_args.args[i]);
-    auto it = lt.find(s);
-    if (it != lt.end() && !it->second.Check(mode)) {
+    if (!lt.Find(s).Check(mode)) {
       return false;
     }
   }
   return true;
 }
 
+void DbSlice::GetKeyVersions(const KeyLockArgs& lock_args, vector<uint64_t>* out) const {
+  const auto& prime = db_arr_[lock_args.db_index]->prime;
+  for (size_t i = 0; i < lock_args.args.size(); i += lock_args.key_step) {
+    auto it = prime.Find(lock_args.args[i]);
+    out->push_back(it.is_done() ? 0 : it.GetVersion());
+  }
+}
+
 void DbSlice::PreUpdate(DbIndex db_ind, PrimeIterator it) {
   FiberAtomicGuard fg;
 
+  if (DbTable* table = db_arr_[db_ind].get(); !table->hot_keys.empty()) {
+    string tmp;
+    UntrackHotKey(table, it->first.GetSlice(&tmp));
+  }
+
   DVLOG(2) << "Running callbacks in dbid " << db_ind;
   for (const auto& ccb : change_cb_) {
     ccb.second(db_ind, ChangeReq{it});
@@ -1039,10 +1443,13 @@ void DbSlice::PreUpdate(DbIndex db_ind, PrimeIterator it) {
 }
 
 void DbSlice::PostUpdate(DbIndex db_ind, PrimeIterator it, std::string_view key, size_t orig_size) {
-  int64_t delta = static_cast<int64_t>(it->second.MallocUsed()) - static_cast<int64_t>(orig_size);
+  size_t new_size = it->second.MallocUsed();
+  int64_t delta = static_cast<int64_t>(new_size) - static_cast<int64_t>(orig_size);
   AccountObjectMemory(key, it->second.ObjType(), delta, GetDBTable(db_ind));
 
   auto& db = *db_arr_[db_ind];
+  if (db.big_keys.IsCandidate(max(orig_size, new_size)))
+    db.big_keys.OnUpdate(key, it->second.ObjType(), new_size, ElementCount(it->second));
   auto& watched_keys = db.watched_keys;
   if (!watched_keys.empty()) {
     // Check if the key is watched.
@@ -1058,7 +1465,11 @@ void DbSlice::PostUpdate(DbIndex db_ind, PrimeIterator it, std::string_view key,
   ++events_.update;
 
   if (ClusterConfig::IsEnabled()) {
-    db.slots_stats[ClusterConfig::KeySlot(key)].total_writes += 1;
+    SlotStats& slot_stats = db.slots_stats[ClusterConfig::KeySlot(key)];
+    slot_stats.total_writes += 1;
+    slot_stats.total_write_bytes +=
+        key.size() + (it->second.ObjType() == OBJ_STRING ? SlotValueBytes(it->second)
+                                                           : static_cast<size_t>(abs(delta)));
   }
 
   SendInvalidationTrackingMessage(key);
@@ -1068,7 +1479,7 @@ DbSlice::ItAndExp DbSlice::ExpireIfNeeded(const Context& cntx, PrimeIterator it)
   DCHECK(it->second.HasExpire());
   auto& db = db_arr_[cntx.db_index];
 
-  auto expire_it = db->expire.Find(it->first);
+  auto expire_it = db->FindExpire(it);
 
   CHECK(IsValid(expire_it));
 
@@ -1095,6 +1506,12 @@ DbSlice::ItAndExp DbSlice::ExpireIfNeeded(const Context& cntx, PrimeIterator it)
     doc_del_cb_(tmp_key, cntx, it->second);
   }
 
+  if (keyspace_events_.Enabled(KEYSPACE_EVENT_EXPIRED)) {
+    if (tmp_key.empty())
+      tmp_key = it->first.GetSlice(&tmp_key_buf);
+    OnKeyspaceEvent(cntx.db_index, KEYSPACE_EVENT_EXPIRED, tmp_key);
+  }
+
   PerformDeletion(it, expire_it, db.get());
   ++events_.expired_keys;
 
@@ -1197,12 +1614,589 @@ auto DbSlice::DeleteExpiredStep(const Context& cntx, unsigned count) -> DeleteEx
   return result;
 }
 
+auto DbSlice::DeleteDueExpiredStep(const Context& cntx, unsigned limit) -> DeleteExpiredStats {
+  auto& db = *db_arr_[cntx.db_index];
+  DeleteExpiredStats result;
+
+  // The entries are hints, the keys may have been deleted or persisted since. The wheel never
+  // returns a key before its deadline, so a key that expires in the future got a new deadline,
+  // which was scheduled by its own entry.
+  vector<pair<string, uint64_t>> locked;
+  auto cb = [&](string_view key) {
+    auto prime_it = db.prime.Find(key);
+    if (prime_it.is_done() || !prime_it->second.HasExpire())
+      return;
+
+    result.traversed++;
+    auto exp_it = db.FindExpire(prime_it);
+    CHECK(!exp_it.is_done());
+    time_t at = ExpireTime(exp_it);
+    if (at > time_t(cntx.time_now_ms)) {
+      result.survivor_ttl_sum += at - cntx.time_now_ms;
+      return;
+    }
+
+    if (!CheckLock(IntentLock::EXCLUSIVE, cntx.db_index, key)) {
+      // Re-added after advancing the wheel, so that it is not returned again by this step.
+      locked.emplace_back(key, at);
+      return;
+    }
+
+    ExpireIfNeeded(cntx, prime_it);
+    ++result.deleted;
+  };
+
+  db.expiry_wheel.Advance(cntx.time_now_ms, limit, cb);
+  for (const auto& [key, at] : locked)
+    db.expiry_wheel.Add(key, at, cntx.time_now_ms);
+
+  return result;
+}
+
 int32_t DbSlice::GetNextSegmentForEviction(int32_t segment_id, DbIndex db_ind) const {
   // wraps around if we reached the end
   return db_arr_[db_ind]->prime.NextSeg((size_t)segment_id) %
          db_arr_[db_ind]->prime.GetSegmentCount();
 }
 
+namespace {
+
+template <typename Table, typename Cb>
+unsigned MergeTableStep(Table* table, uint32_t* cursor, unsigned max_segments, double max_load,
+                        uint64_t ver_threshold, Cb&& cb) {
+  unsigned merged = 0;
+  for (unsigned i = 0; i < max_segments; ++i) {
+    if (*cursor >= table->GetSegmentCount())
+      *cursor = 0;
+
+    if (table->Merge(*cursor, max_load, ver_threshold, cb)) {
+      ++merged;
+      continue;  // The merged segment may be merged again with its own buddy.
+    }
+
+    *cursor = table->NextSeg(*cursor);
+  }
+
+  return merged;
+}
+
+}  // namespace
+
+unsigned DbSlice::MergeSegmentsStep(DbIndex db_ind, unsigned max_segments, double max_load) {
+  if (!IsDbValid(db_ind))
+    return 0;
+
+  // Segments split once full, so the merged segment keeps at least half of its capacity free.
+  // Otherwise a table at the boundary would keep merging and splitting.
+  max_load = std::min(max_load, kMaxMergeLoad);
+
+  FiberAtomicGuard fg;
+  DbTable& db = *db_arr_[db_ind];
+
+  // Merging moves entries across buckets, therefore the snapshots must serialize the affected
+  // buckets before that.
+  uint64_t ver_threshold = change_cb_.empty() ? 0 : change_cb_.back().first;
+  auto prime_cb = [&](PrimeTable::bucket_iterator bit) {
+    for (const auto& ccb : change_cb_) {
+      ccb.second(db_ind, bit);
+    }
+  };
+
+  unsigned merged = MergeTableStep(&db.prime, &db.prime_merge_cursor, max_segments, max_load,
+                                   ver_threshold, prime_cb);
+#ifndef DF_INLINE_EXPIRE
+  merged += MergeTableStep(&db.expire, &db.expire_merge_cursor, max_segments, max_load, 0,
+                           [](ExpireTable::bucket_iterator) {});
+#endif
+  return merged;
+}
+
+unsigned DbSlice::CompressColdValuesStep(DbIndex db_ind, unsigned max_buckets, size_t min_size) {
+  if (!IsDbValid(db_ind))
+    return 0;
+
+  FiberAtomicGuard fg;
+  DbTable* db = db_arr_[db_ind].get();
+  unsigned changed = 0;
+  string tmp;
+
+  // The encoding change is invisible to readers, the value stays the same. Hence, we do not
+  // notify the snapshots, similarly to defragmentation.
+  auto cb = [&](PrimeIterator it) {
+    PrimeValue& pv = it->second;
+    if (pv.ObjType() != OBJ_STRING || pv.IsExternal() || pv.HasIoPending() ||
+        pv.Size() < min_size)
+      return;
+
+    // Values of locked keys may be referenced by borrowed replies.
+    if (!CheckLock(IntentLock::EXCLUSIVE, db_ind, it->first.GetSlice(&tmp)))
+      return;
+
+    // A second chance policy: the value must stay untouched for a whole traversal
+    // in order to be compressed.
+    bool touched = pv.WasTouched();
+    pv.SetTouched(false);
+    if (touched != pv.IsCompressed())
+      return;
+
+    int64_t before = pv.MallocUsed();
+    if (touched) {
+      pv.Decompress();
+    } else if (!pv.Compress()) {
+      return;
+    }
+
+    ++changed;
+    AccountObjectMemory(it->first.GetSlice(&tmp), OBJ_STRING, pv.MallocUsed() - before, db);
+  };
+
+  for (unsigned i = 0; i < max_buckets; ++i) {
+    db->compress_cursor = db->prime.Traverse(db->compress_cursor, cb);
+    if (!db->compress_cursor)
+      break;
+  }
+
+  return changed;
+}
+
+unsigned DbSlice::ShrinkEncodingsStep(DbIndex db_ind, unsigned max_buckets, double ratio) {
+  if (!IsDbValid(db_ind))
+    return 0;
+
+  FiberAtomicGuard fg;
+  DbTable* db = db_arr_[db_ind].get();
+  unsigned changed = 0;
+  string tmp;
+
+  // Like the compression, the encoding change is invisible to readers.
+  auto cb = [&](PrimeIterator it) {
+    PrimeValue& pv = it->second;
+    unsigned type = pv.ObjType();
+    if ((type != OBJ_HASH && type != OBJ_ZSET) || pv.IsExternal() || pv.HasIoPending())
+      return;
+
+    unsigned encoding = pv.Encoding();
+    if (encoding != (type == OBJ_HASH ? kEncodingStrMap2 : OBJ_ENCODING_SKIPLIST))
+      return;
+
+    // Values of locked keys may be referenced by the running commands.
+    if (!CheckLock(IntentLock::EXCLUSIVE, db_ind, it->first.GetSlice(&tmp)))
+      return;
+
+    uint8_t* lp;
+    if (type == OBJ_HASH) {
+      lp = StringMapToListPack(static_cast<StringMap*>(pv.RObjPtr()),
+                               size_t(server.max_listpack_map_bytes * ratio));
+    } else {
+      lp = SortedMapToListPack(*static_cast<detail::SortedMap*>(pv.RObjPtr()),
+                               size_t(server.zset_max_listpack_entries * ratio));
+    }
+    if (!lp)
+      return;
+
+    int64_t before = pv.MallocUsed();
+    if (type == OBJ_HASH) {
+      CompactObj::DeleteMR<StringMap>(pv.RObjPtr());
+      pv.InitRobj(OBJ_HASH, kEncodingListPack, lp);
+      db->stats.listpack_bytes += lpBytes(lp);
+    } else {
+      CompactObj::DeleteMR<detail::SortedMap>(pv.RObjPtr());
+      pv.InitRobj(OBJ_ZSET, OBJ_ENCODING_LISTPACK, lp);
+    }
+    db->stats.listpack_blob_cnt++;
+
+    ++changed;
+    AccountObjectMemory(it->first.GetSlice(&tmp), type, pv.MallocUsed() - before, db);
+  };
+
+  for (unsigned i = 0; i < max_buckets; ++i) {
+    db->shrink_cursor = db->prime.Traverse(db->shrink_cursor, cb);
+    if (!db->shrink_cursor)
+      break;
+  }
+
+  return changed;
+}
+
+void DbSlice::ScanBigKeysStep(DbIndex db_ind, unsigned max_buckets) {
+  if (!IsDbValid(db_ind))
+    return;
+
+  FiberAtomicGuard fg;
+  DbTable* db = db_arr_[db_ind].get();
+  string tmp;
+
+  auto cb = [&](PrimeIterator it) {
+    const PrimeValue& pv = it->second;
+    size_t bytes = pv.MallocUsed();
+    db->big_keys.Sample(pv.ObjType(), pv.Encoding(), bytes);
+    if (bytes >= BigKeys::kMinBytes)
+      db->big_keys.OnScanned(it->first.GetSlice(&tmp), pv.ObjType(), bytes, ElementCount(pv));
+  };
+
+  for (unsigned i = 0; i < max_buckets; ++i) {
+    db->big_keys_cursor = db->prime.Traverse(db->big_keys_cursor, cb);
+    if (!db->big_keys_cursor) {
+      db->big_keys.FinishScan();
+      break;
+    }
+  }
+}
+
+unsigned DbSlice::CompactTieredStep(unsigned max_buckets, unsigned max_moves, double max_ratio) {
+  TieredStorage* tiered = shard_owner()->tiered_storage();
+  if (!tiered || !change_cb_.empty())  // values are moved through memory.
+    return 0;
+
+  if (!tiered_compact_active_) {
+    if (!tiered->StartCompaction(max_ratio))
+      return 0;
+    tiered_compact_active_ = true;
+    tiered_compact_db_ = 0;
+  }
+
+  while (tiered_compact_db_ < db_arr_.size() &&
+         (!db_arr_[tiered_compact_db_] || db_arr_[tiered_compact_db_]->stats.tiered_entries == 0)) {
+    ++tiered_compact_db_;
+  }
+  if (tiered_compact_db_ >= db_arr_.size()) {
+    tiered_compact_active_ = false;
+    return 0;
+  }
+
+  DbIndex db_ind = tiered_compact_db_;
+  DbTable* db = db_arr_[db_ind].get();
+  vector<string> keys;
+
+  auto cb = [&](PrimeIterator it) {
+    if (tiered->IsCompactionCandidate(it->second) && !it->second.HasIoPending())
+      keys.push_back(it->first.ToString());
+  };
+
+  {
+    FiberAtomicGuard fg;
+    for (unsigned i = 0; i < max_buckets && keys.size() < max_moves; ++i) {
+      db->tiered_compact_cursor = db->prime.Traverse(db->tiered_compact_cursor, cb);
+      if (!db->tiered_compact_cursor) {
+        ++tiered_compact_db_;
+        break;
+      }
+    }
+  }
+
+  // Moving loads the values from disk and may preempt, hence the keys are looked up again.
+  unsigned moved = 0;
+  for (const string& key : keys) {
+    if (!IsDbValid(db_ind))
+      break;
+
+    // Values of locked keys are in use by transactions.
+    if (!CheckLock(IntentLock::EXCLUSIVE, db_ind, key))
+      continue;
+
+    PrimeIterator it = db_arr_[db_ind]->prime.Find(key);
+    if (!IsValid(it) || !tiered->IsCompactionCandidate(it->second))
+      continue;
+
+    tiered->Relocate(db_ind, it, key);
+    ++moved;
+  }
+
+  return moved;
+}
+
+namespace {
+
+// Returns the member table of hashes and sets that may hold members with expiry time.
+DenseSet* GetExpiringDenseSet(const PrimeValue& pv) {
+  if (pv.Encoding() != kEncodingStrMap2)
+    return nullptr;
+
+  DenseSet* res = nullptr;
+  if (pv.ObjType() == OBJ_HASH)
+    res = static_cast<StringMap*>(pv.RObjPtr());
+  else if (pv.ObjType() == OBJ_SET)
+    res = static_cast<StringSet*>(pv.RObjPtr());
+
+  return res && res->ExpirationUsed() ? res : nullptr;
+}
+
+}  // namespace
+
+void DbSlice::TrackExpiringFields(DbIndex db_ind, string_view key, const PrimeValue& pv) {
+  if (GetExpiringDenseSet(pv))
+    db_arr_[db_ind]->expiring_fields.try_emplace(key);
+}
+
+void DbSlice::TrackStreamRetention(DbIndex db_ind, string_view key,
+                                   const DbTable::StreamRetention& retention) {
+  auto& tracked = db_arr_[db_ind]->stream_retention;
+  if (auto it = tracked.find(key); it != tracked.end())
+    it->second = retention;
+  else
+    tracked.emplace(key, retention);
+}
+
+void DbSlice::UntrackStreamRetention(DbIndex db_ind, string_view key) {
+  auto& tracked = db_arr_[db_ind]->stream_retention;
+  if (tracked.empty())
+    return;
+  if (auto it = tracked.find(key); it != tracked.end())
+    tracked.erase(it);
+}
+
+unsigned DbSlice::TrimStreamsStep(DbIndex db_ind, unsigned max_streams) {
+  DbTable& db = *db_arr_[db_ind];
+  auto& tracked = db.stream_retention;
+  if (tracked.empty())
+    return 0;
+
+  unsigned deleted = 0;
+  vector<pair<string, string>> trimmed;  // keys and their lengths after trimming
+  {
+    FiberAtomicGuard fg;
+    auto it = tracked.lower_bound(db.stream_retention_cursor);
+
+    for (size_t keys_left = min<size_t>(tracked.size(), max_streams); keys_left > 0; --keys_left) {
+      if (it == tracked.end())
+        it = tracked.begin();
+
+      const string& key = it->first;
+      auto prime_it = db.prime.Find(key);
+      if (!IsValid(prime_it) || prime_it->second.ObjType() != OBJ_STREAM) {
+        it = tracked.erase(it);
+        continue;
+      }
+
+      PrimeValue& pv = prime_it->second;
+      if (pv.IsExternal() || !CheckLock(IntentLock::EXCLUSIVE, db_ind, key)) {
+        ++it;
+        continue;
+      }
+
+      const DbTable::StreamRetention& retention = it->second;
+      // Bounds the work per stream as the approximate trimming of XADD does.
+      streamAddTrimArgs args = {};
+      args.approx_trim = 1;
+      args.limit = 100 * server.stream_node_max_entries;
+      if (retention.by_id) {
+        args.trim_strategy = TRIM_STRATEGY_MINID;
+        args.minid = {retention.min_ms, retention.min_seq};
+      } else {
+        args.trim_strategy = TRIM_STRATEGY_MAXLEN;
+        args.maxlen = retention.max_len;
+      }
+
+      stream* s = static_cast<stream*>(pv.RObjPtr());
+      int64_t before = pv.MallocUsed();
+      if (int64_t res = streamTrim(s, &args); res > 0) {
+        deleted += res;
+        AccountObjectMemory(key, OBJ_STREAM, pv.MallocUsed() - before, &db);
+        trimmed.emplace_back(key, absl::StrCat(s->length));
+      }
+      ++it;
+    }
+
+    db.stream_retention_cursor = it == tracked.end() ? string{} : it->first;
+  }
+
+  // The replicas trim to the same length, they do not track the retention themselves.
+  if (auto journal = owner_->journal(); journal) {
+    for (const auto& [key, len] : trimmed) {
+      journal->RecordEntry(0, journal::Op::COMMAND, db_ind, 1, ClusterConfig::KeySlot(key),
+                           make_pair("XTRIM", ArgSlice{key, "MAXLEN", len}), false, key);
+    }
+  }
+
+  return deleted;
+}
+
+unsigned DbSlice::OffloadColdContainersStep(DbIndex db_ind, unsigned max_buckets,
+                                            size_t min_size) {
+  TieredStorage* tiered = shard_owner()->tiered_storage();
+  if (!IsDbValid(db_ind) || !tiered || !tiered->CanOffloadContainers())
+    return 0;
+
+  // Snapshots and replication streams serialize values from memory.
+  if (!change_cb_.empty())
+    return 0;
+
+  DbTable* db = db_arr_[db_ind].get();
+  vector<string> keys;
+  string tmp;
+
+  auto cb = [&](PrimeIterator it) {
+    PrimeValue& pv = it->second;
+    unsigned obj_type = pv.ObjType();
+    if ((obj_type != OBJ_HASH && obj_type != OBJ_SET && obj_type != OBJ_ZSET) ||
+        pv.IsExternal() || pv.HasIoPending())
+      return;
+
+    // The members with expiry time are expired by DeleteExpiredFieldsStep from memory.
+    if (GetExpiringDenseSet(pv))
+      return;
+
+    // A second chance policy, like in CompressColdValuesStep.
+    bool touched = pv.WasTouched();
+    pv.SetTouched(false);
+    if (!touched && pv.MallocUsed() >= min_size)
+      keys.push_back(it->first.ToString());
+  };
+
+  {
+    FiberAtomicGuard fg;
+    for (unsigned i = 0; i < max_buckets; ++i) {
+      db->offload_cursor = db->prime.Traverse(db->offload_cursor, cb);
+      if (!db->offload_cursor)
+        break;
+    }
+  }
+
+  // Scheduling submits writes and may preempt, hence the keys are looked up again.
+  unsigned scheduled = 0;
+  for (const string& key : keys) {
+    if (!IsDbValid(db_ind))
+      break;
+
+    // Values of locked keys are in use by transactions.
+    if (!CheckLock(IntentLock::EXCLUSIVE, db_ind, key))
+      continue;
+
+    PrimeIterator it = db_arr_[db_ind]->prime.Find(key);
+    if (!IsValid(it) || it->second.IsExternal() || it->second.HasIoPending() ||
+        it->second.WasTouched() || it->second.ObjType() == OBJ_STRING)
+      continue;
+
+    tiered->ScheduleOffload(db_ind, it, key);
+    ++scheduled;
+  }
+
+  return scheduled;
+}
+
+unsigned DbSlice::OffloadColdValuesStep(DbIndex db_ind, unsigned max_buckets,
+                                        unsigned max_offloads) {
+  TieredStorage* tiered = shard_owner()->tiered_storage();
+  if (!IsDbValid(db_ind) || !tiered || !tiered->OffloadsColdValues())
+    return 0;
+
+  DbTable* db = db_arr_[db_ind].get();
+  vector<pair<unsigned, string>> candidates;  // heat and key
+
+  auto cb = [&](PrimeIterator it) {
+    const PrimeValue& pv = it->second;
+    if (pv.ObjType() != OBJ_STRING || pv.IsExternal() || pv.HasIoPending() ||
+        pv.IsCompressed() || pv.IsShared() || pv.Size() < TieredStorage::kMinBlobLen)
+      return;
+
+    unsigned heat = freq_sketch_.Estimate(it->first.HashCode());
+    if (heat <= TieredStorage::kMaxColdHeat)
+      candidates.emplace_back(heat, it->first.ToString());
+  };
+
+  {
+    FiberAtomicGuard fg;
+    for (unsigned i = 0; i < max_buckets; ++i) {
+      db->offload_cold_cursor = db->prime.Traverse(db->offload_cold_cursor, cb);
+      if (!db->offload_cold_cursor)
+        break;
+    }
+  }
+
+  stable_sort(candidates.begin(), candidates.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+
+  // Scheduling submits writes and may preempt, hence the keys are looked up again.
+  unsigned scheduled = 0;
+  for (const auto& [heat, key] : candidates) {
+    if (scheduled == max_offloads || !IsDbValid(db_ind))
+      break;
+
+    // The key is not locked, so offloading must not wait for the pending writes.
+    if (!tiered->CanOffloadWithoutWait())
+      break;
+
+    if (!CheckLock(IntentLock::EXCLUSIVE, db_ind, key))
+      continue;
+
+    PrimeIterator it = db_arr_[db_ind]->prime.Find(key);
+    if (!IsValid(it) || it->second.ObjType() != OBJ_STRING || it->second.IsExternal() ||
+        it->second.HasIoPending() || it->second.IsCompressed() ||
+        it->second.Size() < TieredStorage::kMinBlobLen)
+      continue;
+
+    tiered->ScheduleOffload(db_ind, it, key);
+    ++scheduled;
+  }
+
+  return scheduled;
+}
+
+unsigned DbSlice::DeleteExpiredFieldsStep(const Context& cntx, unsigned max_buckets) {
+  DbTable& db = *db_arr_[cntx.db_index];
+  auto& tracked = db.expiring_fields;
+  if (tracked.empty())
+    return 0;
+
+  FiberAtomicGuard fg;
+  uint32_t now = MemberTimeSeconds(cntx.time_now_ms);
+  unsigned deleted = 0;
+  unsigned budget = max_buckets;
+
+  auto it = tracked.lower_bound(db.expiring_fields_cursor);
+
+  // Visits each tracked key at most once per step.
+  for (size_t keys_left = tracked.size(); budget > 0 && keys_left > 0; --keys_left) {
+    if (it == tracked.end())
+      it = tracked.begin();
+
+    const string& key = it->first;
+    auto prime_it = db.prime.Find(key);
+    DenseSet* ds = IsValid(prime_it) ? GetExpiringDenseSet(prime_it->second) : nullptr;
+    if (!ds) {
+      it = tracked.erase(it);
+      continue;
+    }
+
+    if (!CheckLock(IntentLock::EXCLUSIVE, cntx.db_index, key)) {
+      ++it;
+      continue;
+    }
+
+    // Similarly to the lazy expiry on access, the snapshots are not notified: they would
+    // skip the expired members anyway.
+    PrimeValue& pv = prime_it->second;
+    int64_t before = pv.MallocUsed();
+    size_t size_before = ds->UpperBoundSize();
+
+    ds->set_time(now);
+    auto& state = it->second;
+    DenseSet::ExpireStepResult res = ds->ExpireStep(state.cursor, budget);
+    budget -= std::min(budget, res.visited);
+    state.cursor = res.cursor;
+    state.ttl_seen |= res.ttl_seen;
+
+    deleted += size_before - ds->UpperBoundSize();
+    AccountObjectMemory(key, pv.ObjType(), pv.MallocUsed() - before, &db);
+
+    if (state.cursor != 0)  // the budget ran out in the middle of the pass.
+      break;
+
+    // A complete pass without members with expiry time, nothing left to expire.
+    if (!state.ttl_seen) {
+      it = tracked.erase(it);
+    } else {
+      state.ttl_seen = false;
+      ++it;
+    }
+  }
+
+  db.expiring_fields_cursor = it == tracked.end() ? string{} : it->first;
+  events_.expired_fields += deleted;
+
+  return deleted;
+}
+
 void DbSlice::FreeMemWithEvictionStep(DbIndex db_ind, size_t increase_goal_bytes) {
   DCHECK(!owner_->IsReplica());
   if ((!caching_mode_) || !expire_allowed_ || !GetFlag(FLAGS_enable_heartbeat_eviction))
@@ -1224,12 +2218,16 @@ void DbSlice::FreeMemWithEvictionStep(DbIndex db_ind, size_t increase_goal_bytes
   size_t used_memory_before = owner_->UsedMemory();
   vector<string> keys_to_journal;
 
+  // Candidates of the same slot and bucket in the visited segments, as (frequency, iterator).
+  absl::InlinedVector<pair<unsigned, PrimeIterator>, 8> candidates;
+
   {
     FiberAtomicGuard guard;
     for (int32_t slot_id = num_slots - 1; slot_id >= 0; --slot_id) {
       for (int32_t bucket_id = num_buckets - 1; bucket_id >= 0; --bucket_id) {
         // pick a random segment to start with in each eviction,
         // as segment_id does not imply any recency, and random selection should be fair enough
+        candidates.clear();
         int32_t segment_id = starting_segment_id;
         for (size_t num_seg_visited = 0; num_seg_visited < max_segment_to_consider;
              ++num_seg_visited, segment_id = GetNextSegmentForEviction(segment_id, db_ind)) {
@@ -1247,11 +2245,19 @@ void DbSlice::FreeMemWithEvictionStep(DbIndex db_ind, size_t increase_goal_bytes
           // check if the key is locked by looking up transaction table.
           auto& lt = db_table->trans_locks;
           string_view key = evict_it->first.GetSlice(&tmp);
-          if (lt.find(KeyLockArgs::GetLockKey(key)) != lt.end())
+          if (!lt.Find(KeyLockArgs::GetLockKey(key)).IsFree())
             continue;
 
+          candidates.emplace_back(freq_sketch_.Estimate(evict_it->first.HashCode()), evict_it);
+        }
+
+        // Evict the least frequently used candidates first, ties keep the segment order.
+        stable_sort(candidates.begin(), candidates.end(),
+                    [](const auto& l, const auto& r) { return l.first < r.first; });
+
+        for (auto [freq, evict_it] : candidates) {
           if (auto journal = owner_->journal(); journal) {
-            keys_to_journal.push_back(string(key));
+            keys_to_journal.push_back(string(evict_it->first.GetSlice(&tmp)));
           }
 
           PerformDeletion(evict_it, db_table.get());
@@ -1274,7 +2280,7 @@ finish:
     for (string_view key : keys_to_journal) {
       ArgSlice delete_args(&key, 1);
       journal->RecordEntry(0, journal::Op::EXPIRED, db_ind, 1, ClusterConfig::KeySlot(key),
-                           make_pair("DEL", delete_args), false);
+                           make_pair("DEL", delete_args), false, key);
     }
   }
 
@@ -1290,7 +2296,11 @@ finish:
 void DbSlice::CreateDb(DbIndex db_ind) {
   auto& db = db_arr_[db_ind];
   if (!db) {
-    db.reset(new DbTable{owner_->memory_resource(), db_ind});
+    db.reset(new DbTable{owner_->table_memory_resource(), db_ind});
+    for (const auto& [index, bytes] : GetFlag(FLAGS_db_maxmemory).quotas) {
+      if (index == db_ind)
+        db->memory_quota = bytes / shard_set->size();
+    }
   }
 }
 
@@ -1430,6 +2440,30 @@ void DbSlice::ResetEvents() {
   events_ = {};
 }
 
+DbSlice::DeletedKeys DbSlice::StartSave(uint64_t snapshot_version) {
+  DeletedKeys res(db_arr_.size());
+  for (DbIndex i = 0; i < db_arr_.size(); ++i) {
+    if (db_arr_[i])
+      res[i].swap(db_arr_[i]->deleted_keys);
+  }
+  running_save_version_ = snapshot_version;
+  return res;
+}
+
+void DbSlice::FinishSave(bool success) {
+  save_base_version_ = success ? running_save_version_ : 0;
+  running_save_version_ = 0;
+  if (save_base_version_ == 0)
+    DropDeletedKeys();
+}
+
+void DbSlice::DropDeletedKeys() {
+  for (auto& db : db_arr_) {
+    if (db)
+      absl::flat_hash_set<std::string>{}.swap(db->deleted_keys);
+  }
+}
+
 void DbSlice::TrackKeys(const facade::Connection::WeakRef& conn, const ArgSlice& keys) {
   if (conn.IsExpired()) {
     DVLOG(2) << "Connection expired, exiting TrackKey function.";
@@ -1445,7 +2479,81 @@ void DbSlice::TrackKeys(const facade::Connection::WeakRef& conn, const ArgSlice&
   }
 }
 
+void DbSlice::UpdateTrackingPrefixes(const std::vector<std::string>& prefixes, unsigned tid,
+                                     int delta) {
+  for (const auto& prefix : prefixes) {
+    auto [it, inserted] = tracking_prefixes_.try_emplace(prefix);
+    TrackingPrefix& tp = it->second;
+    if (inserted) {
+      tp.thread_refs.resize(shard_set->pool()->size());
+      tracking_prefix_lens_[prefix.size()]++;
+    }
+
+    DCHECK(delta > 0 || tp.thread_refs[tid] > 0);
+    tp.thread_refs[tid] += delta;
+    if (all_of(tp.thread_refs.begin(), tp.thread_refs.end(), [](unsigned c) { return c == 0; })) {
+      if (--tracking_prefix_lens_[prefix.size()] == 0)
+        tracking_prefix_lens_.erase(prefix.size());
+      tracking_prefixes_.erase(it);
+    }
+  }
+}
+
+void DbSlice::FlushTrackingPrefixes() {
+  if (!tracking_pending_)
+    return;
+  tracking_pending_ = false;
+
+  using Batch = vector<pair<string, vector<string>>>;  // prefix -> written keys
+  vector<Batch> batches(shard_set->pool()->size());
+  for (auto& [prefix, tp] : tracking_prefixes_) {
+    if (tp.pending.empty())
+      continue;
+
+    vector<string> keys = std::move(tp.pending);
+    tp.pending.clear();
+    for (unsigned tid = 0; tid < batches.size(); ++tid) {
+      if (tp.thread_refs[tid])
+        batches[tid].emplace_back(prefix, keys);
+    }
+  }
+
+  for (unsigned tid = 0; tid < batches.size(); ++tid) {
+    if (batches[tid].empty())
+      continue;
+
+    shard_set->pool()->at(tid)->DispatchBrief([batch = std::move(batches[tid])]() mutable {
+      const auto& conns_by_prefix = ServerState::tlocal()->tracking_prefixes;
+      for (auto& [prefix, keys] : batch) {
+        auto it = conns_by_prefix.find(prefix);
+        if (it == conns_by_prefix.end())
+          continue;
+        for (facade::Connection* conn : it->second) {
+          facade::Connection::InvalidationMessage msg;
+          msg.keys = keys;
+          conn->SendInvalidationMessageAsync(std::move(msg));
+        }
+      }
+    });
+  }
+}
+
+void DbSlice::OnKeyspaceEvent(DbIndex db_ind, KeyspaceEvent event, std::string_view key) {
+  if (keyspace_events_.Enabled(event))
+    pending_keyspace_events_.push_back({db_ind, event, string{key}});
+}
+
 void DbSlice::SendInvalidationTrackingMessage(std::string_view key) {
+  for (auto [len, unused] : tracking_prefix_lens_) {
+    if (len > key.size())
+      break;
+    auto it = tracking_prefixes_.find(key.substr(0, len));
+    if (it != tracking_prefixes_.end()) {
+      it->second.pending.emplace_back(key);
+      tracking_pending_ = true;
+    }
+  }
+
   auto it = client_tracking_map_.find(key);
   if (it != client_tracking_map_.end()) {
     // notify all the clients.
@@ -1489,6 +2597,10 @@ void DbSlice::PerformDeletion(PrimeIterator del_it, ExpireIterator exp_it, DbTab
   std::string tmp;
   std::string_view key = del_it->first.GetSlice(&tmp);
 
+  if (!table->hot_keys.empty()) {
+    UntrackHotKey(table, key);
+  }
+
   if (!exp_it.is_done()) {
     table->expire.Erase(exp_it);
   }
@@ -1505,6 +2617,8 @@ void DbSlice::PerformDeletion(PrimeIterator del_it, ExpireIterator exp_it, DbTab
   RemoveFromTiered(del_it, table);
 
   size_t value_heap_size = pv.MallocUsed();
+  if (table->big_keys.IsCandidate(value_heap_size))
+    table->big_keys.OnDelete(key);
   stats.inline_keys -= del_it->first.IsInline();
   AccountObjectMemory(key, del_it->first.ObjType(), -del_it->first.MallocUsed(), table);  // Key
   AccountObjectMemory(key, pv.ObjType(), -value_heap_size, table);                        // Value
@@ -1517,26 +2631,105 @@ void DbSlice::PerformDeletion(PrimeIterator del_it, ExpireIterator exp_it, DbTab
   if (ClusterConfig::IsEnabled()) {
     SlotId sid = ClusterConfig::KeySlot(key);
     table->slots_stats[sid].key_count -= 1;
+    if (slot_key_index_)
+      table->slot_keys.Remove(sid, key);
   }
 
+  if (save_base_version_ || running_save_version_)
+    table->deleted_keys.emplace(key);
+
+  LazyFree(&del_it->second);
   table->prime.Erase(del_it);
   SendInvalidationTrackingMessage(key);
 }
 
-void DbSlice::PerformDeletion(PrimeIterator del_it, DbTable* table) {
-  ExpireIterator exp_it;
-  if (del_it->second.HasExpire()) {
-    exp_it = table->expire.Find(del_it->first);
-    DCHECK(!exp_it.is_done());
+void DbSlice::TrackHotRead(DbIndex db_ind, string_view key, const ItAndExp& res) {
+  DbTable& db = *db_arr_[db_ind];
+  auto it = db.hot_keys.find(key);
+  if (it == db.hot_keys.end()) {
+    if (db.hot_keys.size() >= HotKeyCache::kMaxKeysPerDb)
+      return;
+    it = db.hot_keys.try_emplace(key).first;
+  }
+
+  HotKeyState& state = it->second;
+  if (state.published || ++state.reads < GetFlag(FLAGS_hot_key_min_reads))
+    return;
+
+  // Only plain strings are replicated, they are the only values that GET serves.
+  const PrimeValue& pv = res.it->second;
+  if (pv.ObjType() != OBJ_STRING || pv.IsExternal() || pv.HasIoPending() ||
+      pv.Size() > HotKeyCache::kMaxValueSize) {
+    state.reads = 0;
+    return;
   }
 
+  auto entry = make_shared<HotKeyCache::Entry>();
+  pv.GetString(&entry->value);
+  entry->expire_at_ms = ExpireTime(res.exp_it);
+  state.published = entry;
+  HotKeyCache::Publish(db_ind, key, std::move(entry));
+}
+
+void DbSlice::UntrackHotKey(DbTable* table, string_view key) {
+  auto it = table->hot_keys.find(key);
+  if (it == table->hot_keys.end())
+    return;
+
+  if (it->second.published)
+    HotKeyCache::Retract(table->index, key, std::move(it->second.published));
+  table->hot_keys.erase(it);
+}
+
+void DbSlice::PerformDeletion(PrimeIterator del_it, DbTable* table) {
+  ExpireIterator exp_it = table->FindExpire(del_it);
+  DCHECK_EQ(exp_it.is_done(), !del_it->second.HasExpire());
+
   PerformDeletion(del_it, exp_it, table);
 }
 
+void DbSlice::LazyFree(PrimeValue* pv) {
+  if (!pv->CanFreeInSteps())
+    return;
+
+  uint32_t min_elements = GetFlag(FLAGS_lazyfree_min_elements);
+  if (min_elements == 0 || pv->Size() < min_elements)
+    return;
+
+  bool has_expire = pv->HasExpire();
+  bool has_flag = pv->HasFlag();
+  lazy_free_elements_ += pv->Size();
+  lazy_free_queue_.push_back(std::move(*pv));
+  pv->SetExpire(has_expire);
+  pv->SetFlag(has_flag);
+}
+
+size_t DbSlice::LazyFreeStep(uint64_t max_usec) {
+  // Number of elements freed between the checks of the time budget.
+  constexpr size_t kElementsPerCheck = 1024;
+
+  int64_t deadline = absl::GetCurrentTimeNanos() + max_usec * 1000;
+  size_t freed = 0;
+  while (!lazy_free_queue_.empty()) {
+    size_t res = lazy_free_queue_.front().FreeStep(kElementsPerCheck);
+    if (res == 0) {
+      lazy_free_queue_.pop_front();
+      ++events_.lazyfreed_objects;
+    }
+    freed += res;
+    lazy_free_elements_ -= std::min(lazy_free_elements_, res);
+
+    if (absl::GetCurrentTimeNanos() >= deadline)
+      break;
+  }
+  return freed;
+}
+
 void DbSlice::OnCbFinish() {
   // TBD update bumpups logic we can not clear now after cb finish as cb can preempt
   // btw what do we do with inline?
   bumped_items_.clear();
+  FlushTrackingPrefixes();
 }
 
 }  // namespace dfly
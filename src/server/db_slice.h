@@ -4,11 +4,14 @@
 
 #pragma once
 
+#include <deque>
+
 #include "core/mi_memory_resource.h"
 #include "facade/dragonfly_connection.h"
 #include "facade/op_status.h"
 #include "server/common.h"
 #include "server/conn_context.h"
+#include "server/frequency_sketch.h"
 #include "server/table.h"
 
 namespace dfly {
@@ -41,10 +44,12 @@ struct SliceEvents {
   // evictions that were performed when we have a negative memory budget.
   size_t hard_evictions = 0;
   size_t expired_keys = 0;
+  size_t expired_fields = 0;  // members of hashes and sets deleted by the background expiry.
   size_t garbage_checked = 0;
   size_t garbage_collected = 0;
   size_t stash_unloaded = 0;
   size_t bumpups = 0;  // how many bump-upds we did.
+  size_t lazyfreed_objects = 0;  // deleted values that were freed in the background.
 
   // hits/misses on keys
   size_t hits = 0;
@@ -110,6 +115,15 @@ class DbSlice {
     std::vector<DbStats> db_stats;
     SliceEvents events;
     size_t small_string_bytes = 0;
+    size_t compressed_values = 0;
+    size_t compressed_value_bytes = 0;
+    size_t compressed_value_raw_bytes = 0;
+    size_t shared_string_blobs = 0;
+    size_t shared_string_bytes = 0;
+    size_t shared_string_refs = 0;
+    size_t lazyfree_pending_objects = 0;
+    size_t lazyfree_pending_elements = 0;
+    size_t scan_snapshot_bytes = 0;
   };
 
   using Context = DbContext;
@@ -154,7 +168,8 @@ class DbSlice {
   ~DbSlice();
 
   // Activates `db_ind` database if it does not exist (see ActivateDb below).
-  void Reserve(DbIndex db_ind, size_t key_size);
+  // Does not reserve while snapshots are running, because the tables are split ahead of time.
+  void Reserve(DbIndex db_ind, size_t key_size, size_t expire_size = 0);
 
   // Returns statistics for the whole db slice. A bit heavy operation.
   Stats GetStats() const;
@@ -162,6 +177,37 @@ class DbSlice {
   // Returns slot statistics for db 0.
   SlotStats GetSlotStats(SlotId sid) const;
 
+  // Updates the ops_per_sec of the slot statistics once a second has passed since the previous
+  // sample. Called by the shard heartbeat.
+  void SampleSlotRates(uint64_t now_ms);
+
+  struct HotKey {
+    std::string key;
+    DbIndex db = 0;
+    ShardId shard = 0;
+    uint64_t count = 0;  // estimated accesses since the window started
+    double qps = 0;      // count per second of the window, which is at least a second long
+  };
+
+  // Returns the keys found by the top keys tracking of all databases in the current window.
+  // Empty if the tracking is disabled.
+  std::vector<HotKey> GetHotKeys(uint64_t now_ms) const;
+
+  // Starts a new window of the top keys tracking, forgetting the counts of the previous one.
+  void ResetHotKeysWindow(uint64_t now_ms);
+
+  // Resets the window once it is --hot_keys_window_sec long. Called by the shard heartbeat.
+  void RotateHotKeysWindow(uint64_t now_ms);
+
+  // Whether the keys of every slot are indexed, see --cluster_slot_key_index.
+  bool HasSlotKeyIndex() const {
+    return slot_key_index_;
+  }
+
+  // Returns at most limit keys of the slot in db 0. Uses the slot key index when it is enabled,
+  // otherwise traverses the table and may preempt.
+  std::vector<std::string> GetSlotKeys(SlotId sid, size_t limit = SIZE_MAX) const;
+
   void UpdateExpireBase(uint64_t now, unsigned generation) {
     expire_base_[generation & 1] = now;
   }
@@ -181,6 +227,11 @@ class DbSlice {
     return bytes_per_object_;
   }
 
+  // Access frequencies of the keys in cache mode, used to choose eviction victims.
+  const FrequencySketch& freq_sketch() const {
+    return freq_sketch_;
+  }
+
   // returns absolute time of the expiration.
   time_t ExpireTime(ExpireConstIterator it) const {
     return it.is_done() ? 0 : expire_base_[0] + it->second.duration_ms();
@@ -202,6 +253,10 @@ class DbSlice {
   OpResult<ItAndUpdater> FindAndFetchMutable(const Context& cntx, std::string_view key,
                                              unsigned req_obj_type);
 
+  // For the callers that delete the value or replace it without reading it. Unlike FindMutable,
+  // external containers are not loaded either, so that their deletion reads nothing from disk.
+  ItAndUpdater FindMutableToReplace(const Context& cntx, std::string_view key);
+
   struct ItAndExpConst {
     PrimeConstIterator it;
     ExpireConstIterator exp_it;
@@ -212,6 +267,27 @@ class DbSlice {
   OpResult<PrimeConstIterator> FindAndFetchReadOnly(const Context& cntx, std::string_view key,
                                                     unsigned req_obj_type);
 
+  // Batched versions of FindReadOnly/FindAndFetchReadOnly for multi-key commands.
+  // Keys are resolved in windows: all the keys of a window are hashed and their table memory is
+  // prefetched before they are looked up, so that the cache misses of the lookups overlap.
+  // dest[i] receives the result for keys[i], dest must have at least keys.size() entries.
+  // If req_obj_type is not set, the type of the found entries is not checked.
+  void FindManyReadOnly(const Context& cntx, ArgSlice keys, std::optional<unsigned> req_obj_type,
+                        OpResult<PrimeConstIterator>* dest);
+  void FindAndFetchManyReadOnly(const Context& cntx, ArgSlice keys, unsigned req_obj_type,
+                                OpResult<PrimeConstIterator>* dest);
+
+  // Prefetches the table memory of the keys without looking them up. If hashes is set and the
+  // database exists, it receives the hashes of the keys and must have keys.size() entries.
+  void PrefetchKeys(DbIndex db_ind, ArgSlice keys, uint64_t* hashes = nullptr) const;
+
+  // Loads the tiered values of keys with a single batch of disk reads, so that the following
+  // lookups find them in memory. May preempt.
+  void FetchExternalMany(DbIndex db_ind, ArgSlice keys);
+
+  // Number of keys that batched lookups prefetch ahead.
+  static constexpr size_t kPrefetchWindow = 16;
+
   // Returns (iterator, args-index) if found, KEY_NOTFOUND otherwise.
   // If multiple keys are found, returns the first index in the ArgSlice.
   OpResult<std::pair<PrimeConstIterator, unsigned>> FindFirstReadOnly(const Context& cntx,
@@ -230,6 +306,9 @@ class DbSlice {
   OpResult<AddOrFindResult> AddOrFind(const Context& cntx, std::string_view key);
   OpResult<AddOrFindResult> AddOrFindAndFetch(const Context& cntx, std::string_view key);
 
+  // Same as FindMutableToReplace for the existing entries.
+  OpResult<AddOrFindResult> AddOrFindToReplace(const Context& cntx, std::string_view key);
+
   // Same as AddOrSkip, but overwrites in case entry exists.
   OpResult<AddOrFindResult> AddOrUpdate(const Context& cntx, std::string_view key, PrimeValue obj,
                                         uint64_t expire_at_ms);
@@ -248,6 +327,9 @@ class DbSlice {
   // Adds expiry information.
   void AddExpire(DbIndex db_ind, PrimeIterator main_it, uint64_t at);
 
+  // Changes the existing expiry time of main_it.
+  void SetExpireTime(DbIndex db_ind, PrimeIterator main_it, ExpireIterator exp_it, uint64_t at);
+
   // Removes the corresponing expiry information if exists.
   // Returns true if expiry existed (and removed).
   bool RemoveExpire(DbIndex db_ind, PrimeIterator main_it);
@@ -297,6 +379,11 @@ class DbSlice {
   // Returns true if all keys can be locked under m. Does not lock.
   bool CheckLock(IntentLock::Mode m, const KeyLockArgs& lock_args) const;
 
+  // Appends the versions of the buckets holding the keys of lock_args to out, 0 for missing keys.
+  // Bucket versions grow with every update, so a key did not change between two calls if both
+  // return the same version for it.
+  void GetKeyVersions(const KeyLockArgs& lock_args, std::vector<uint64_t>* out) const;
+
   size_t db_array_size() const {
     return db_arr_.size();
   }
@@ -355,6 +442,11 @@ class DbSlice {
   //! Unregisters the callback.
   void UnregisterOnChange(uint64_t id);
 
+  // Accounts the memory of the keys that SCAN SNAPSHOT views copied and did not return yet.
+  void UpdateScanSnapshotBytes(int64_t delta) {
+    scan_snapshot_bytes_ += delta;
+  }
+
   struct DeleteExpiredStats {
     uint32_t deleted = 0;         // number of deleted items due to expiry (less than traversed).
     uint32_t traversed = 0;       // number of traversed items that have ttl bit
@@ -363,8 +455,89 @@ class DbSlice {
 
   // Deletes some amount of possible expired items.
   DeleteExpiredStats DeleteExpiredStep(const Context& cntx, unsigned count);
+
+  // Deletes up to limit keys that the expiry wheel reports as due, see --expiry_wheel.
+  DeleteExpiredStats DeleteDueExpiredStep(const Context& cntx, unsigned limit);
+
+  bool IsExpiryWheelEnabled() const {
+    return expiry_wheel_;
+  }
   void FreeMemWithEvictionStep(DbIndex db_indx, size_t increase_goal_bytes);
 
+  // Incrementally merges sparse sibling segments of the prime and expire tables, so that
+  // the tables shrink after mass deletions. Checks up to max_segments segments of each table
+  // with a persistent cursor. max_load is the maximal utilization of the merged segment, at most
+  // kMaxMergeLoad. Returns the number of merged segments.
+  unsigned MergeSegmentsStep(DbIndex db_ind, unsigned max_segments, double max_load);
+
+  // The maximal utilization of a merged segment.
+  static constexpr double kMaxMergeLoad = 0.5;
+
+  // Incrementally traverses the prime table and compresses string values of at least min_size
+  // bytes that were not accessed since the previous traversal. Compressed values that were
+  // accessed again are decompressed back. Traverses up to max_buckets logical buckets with
+  // a persistent cursor. Returns the number of values that changed their encoding.
+  unsigned CompressColdValuesStep(DbIndex db_ind, unsigned max_buckets, size_t min_size);
+
+  // Incrementally traverses the prime table and converts the hashes and sorted sets that
+  // outgrew their listpack encoding back to listpacks, once they shrank to at most ratio of the
+  // listpack limits. A ratio below 1 keeps the values near a limit from converting back and
+  // forth. Sets have no listpack encoding and are not converted. Traverses up to max_buckets
+  // logical buckets with a persistent cursor. Returns the number of converted values.
+  unsigned ShrinkEncodingsStep(DbIndex db_ind, unsigned max_buckets, double ratio);
+
+  // Incrementally traverses the prime table to refresh the largest keys and the value size
+  // histograms of the database, see BigKeys. Traverses up to max_buckets logical buckets with
+  // a persistent cursor.
+  void ScanBigKeysStep(DbIndex db_ind, unsigned max_buckets);
+
+  // Incrementally traverses the prime table and offloads to tiered storage the hashes, sets and
+  // sorted sets that use at least min_size bytes and were not accessed since the previous
+  // traversal. They are loaded back by the next lookup. Traverses up to max_buckets logical
+  // buckets with a persistent cursor. Returns the number of offload attempts.
+  unsigned OffloadColdContainersStep(DbIndex db_ind, unsigned max_buckets, size_t min_size);
+
+  // Incrementally traverses the prime table and offloads to tiered storage up to max_offloads
+  // of the coldest strings among the ones whose access frequency is at most
+  // TieredStorage::kMaxColdHeat. Runs only if tiered storage offloads cold values. Traverses up
+  // to max_buckets logical buckets with a persistent cursor. Returns the number of offloads.
+  unsigned OffloadColdValuesStep(DbIndex db_ind, unsigned max_buckets, unsigned max_offloads);
+
+  // Incrementally moves the tiered values out of the pages of the backing file whose share of
+  // used blocks is at most max_ratio, so that these pages become free. A pass traverses all
+  // the databases and handles the pages that were sparse when it started. Traverses up to
+  // max_buckets logical buckets and moves up to max_moves values in each call.
+  // Returns the number of moved values.
+  unsigned CompactTieredStep(unsigned max_buckets, unsigned max_moves, double max_ratio);
+
+  // Registers key if pv is a hash or a set with members that have expiry time, so that
+  // DeleteExpiredFieldsStep expires its members in the background.
+  void TrackExpiringFields(DbIndex db_ind, std::string_view key, const PrimeValue& pv);
+
+  // Incrementally deletes the expired members of the tracked hashes and sets. Visits up to
+  // max_buckets buckets of their member tables, continuing from where the previous step
+  // stopped. Returns the number of deleted members.
+  unsigned DeleteExpiredFieldsStep(const Context& cntx, unsigned max_buckets);
+
+  // Registers the approximate trimming threshold of a stream, so that TrimStreamsStep trims it
+  // in the background, or removes the registration.
+  void TrackStreamRetention(DbIndex db_ind, std::string_view key,
+                            const DbTable::StreamRetention& retention);
+  void UntrackStreamRetention(DbIndex db_ind, std::string_view key);
+
+  // Trims up to max_streams of the tracked streams to their thresholds, removing whole nodes
+  // only, continuing from where the previous step stopped. Returns the number of deleted entries.
+  unsigned TrimStreamsStep(DbIndex db_ind, unsigned max_streams);
+
+  // Takes a deleted or overwritten value over, if --lazyfree_min_elements is set, the value has
+  // at least that many elements and can be freed in steps. pv is left as an empty string with
+  // its expire and memcache flag bits.
+  void LazyFree(PrimeValue* pv);
+
+  // Frees the elements of the values taken over by LazyFree, for up to max_usec.
+  // Returns the number of freed elements.
+  size_t LazyFreeStep(uint64_t max_usec);
+
   int32_t GetNextSegmentForEviction(int32_t segment_id, DbIndex db_ind) const;
 
   const DbTableArray& databases() const {
@@ -391,6 +564,20 @@ class DbSlice {
   // Resets the event counter for updates/insertions
   void ResetUpdateEvents();
 
+  // Delta snapshots. A save that tracks changes calls StartSave when its snapshot of the slice
+  // starts at snapshot_version, which returns the keys deleted since the previous such save
+  // started, per database. FinishSave makes a successful save the base of the next delta:
+  // the buckets with versions above the base and the deleted keys are all that changed since.
+  // Flushing the data invalidates the base.
+  using DeletedKeys = std::vector<absl::flat_hash_set<std::string>>;
+  DeletedKeys StartSave(uint64_t snapshot_version);
+  void FinishSave(bool success);
+
+  // The version of the save a delta can be based on, 0 if there is none.
+  uint64_t save_base_version() const {
+    return save_base_version_;
+  }
+
   // Resets events_ member. Used by CONFIG RESETSTAT
   void ResetEvents();
 
@@ -401,6 +588,37 @@ class DbSlice {
   // Track keys for the client represented by the the weak reference to its connection.
   void TrackKeys(const facade::Connection::WeakRef&, const ArgSlice&);
 
+  // Adds (delta 1) or removes (delta -1) the broadcast tracking registrations of `prefixes`
+  // made by a connection of thread `tid`.
+  void UpdateTrackingPrefixes(const std::vector<std::string>& prefixes, unsigned tid, int delta);
+
+  // Sends the keys written since the last call to the threads with connections tracking
+  // matching prefixes. Called after every transaction callback and by the heartbeat.
+  void FlushTrackingPrefixes();
+
+  struct KeyspaceNotification {
+    DbIndex db_index;
+    KeyspaceEvent event;
+    std::string key;
+  };
+
+  void SetKeyspaceEvents(const KeyspaceEventsFlag& events) {
+    keyspace_events_ = events;
+  }
+
+  const KeyspaceEventsFlag& keyspace_events() const {
+    return keyspace_events_;
+  }
+
+  // Queues the keyspace notification of the event on key if its class is enabled.
+  void OnKeyspaceEvent(DbIndex db_ind, KeyspaceEvent event, std::string_view key);
+
+  // Returns the keyspace notifications queued since the last call. They are published by the
+  // heartbeat, so the events of a shard tick are coalesced.
+  std::vector<KeyspaceNotification> TakeKeyspaceNotifications() {
+    return std::exchange(pending_keyspace_events_, {});
+  }
+
   // Delete a key referred by its iterator.
   void PerformDeletion(PrimeIterator del_it, DbTable* table);
 
@@ -430,6 +648,13 @@ class DbSlice {
   // Send invalidation message to the clients that are tracking the change to a key.
   void SendInvalidationTrackingMessage(std::string_view key);
 
+  // Counts a read of a hot key and replicates its value to all threads once it was read
+  // hot_key_min_reads times without being written.
+  void TrackHotRead(DbIndex db_ind, std::string_view key, const ItAndExp& res);
+
+  // Stops tracking the key and retracts its replicated value, called before it is changed.
+  void UntrackHotKey(DbTable* table, std::string_view key);
+
   void CreateDb(DbIndex index);
   size_t EvictObjects(size_t memory_to_free, PrimeIterator it, DbTable* table);
 
@@ -440,11 +665,21 @@ class DbSlice {
 
   enum class LoadExternalMode {
     kLoad,
-    kDontLoad,
+    kDontLoad,  // Still loads the containers, since they are read even by mutations.
+    kDontRead,  // The value is deleted or replaced, nothing is loaded.
   };
   OpResult<ItAndExp> FindInternal(const Context& cntx, std::string_view key,
+                                  std::optional<unsigned> req_obj_type, UpdateStatsMode stats_mode,
+                                  LoadExternalMode load_mode) {
+    return FindInternal(cntx, key, CompactObj::HashCode(key), req_obj_type, stats_mode, load_mode);
+  }
+
+  // Same as above with the hash of the key computed by the caller.
+  OpResult<ItAndExp> FindInternal(const Context& cntx, std::string_view key, uint64_t key_hash,
                                   std::optional<unsigned> req_obj_type, UpdateStatsMode stats_mode,
                                   LoadExternalMode load_mode);
+  void FindManyInternal(const Context& cntx, ArgSlice keys, std::optional<unsigned> req_obj_type,
+                        LoadExternalMode load_mode, OpResult<PrimeConstIterator>* dest);
   OpResult<AddOrFindResult> AddOrFindInternal(const Context& cntx, std::string_view key,
                                               LoadExternalMode load_mode);
   OpResult<ItAndUpdater> FindMutableInternal(const Context& cntx, std::string_view key,
@@ -457,6 +692,12 @@ class DbSlice {
   void RemoveFromTiered(PrimeIterator it, DbTable* table);
 
  private:
+  // Releases the keys tracked as deleted once there is no save to base a delta on.
+  void DropDeletedKeys();
+
+  // Adds the key of it to the expiry wheel of its database if the wheel is enabled.
+  void ScheduleExpiry(DbIndex db_ind, PrimeIterator it, uint64_t at_ms);
+
   ShardId shard_id_;
   uint8_t caching_mode_ : 1;
 
@@ -464,12 +705,30 @@ class DbSlice {
 
   time_t expire_base_[2];  // Used for expire logic, represents a real clock.
   bool expire_allowed_ = true;
+  bool expiry_wheel_ = false;
+  bool slot_key_index_ = false;
+
+  // State of the tiered compaction pass, see CompactTieredStep.
+  bool tiered_compact_active_ = false;
+  DbIndex tiered_compact_db_ = 0;
+
+  // Values waiting to be freed by LazyFreeStep, and their remaining number of elements.
+  std::deque<PrimeValue> lazy_free_queue_;
+  size_t lazy_free_elements_ = 0;
+
+  size_t scan_snapshot_bytes_ = 0;
 
   uint64_t version_ = 1;  // Used to version entries in the PrimeTable.
+
+  // Snapshot versions of the last successful save and of the running one, see StartSave.
+  uint64_t save_base_version_ = 0;
+  uint64_t running_save_version_ = 0;
   ssize_t memory_budget_ = SSIZE_MAX;
   size_t bytes_per_object_ = 0;
   size_t soft_budget_limit_ = 0;
   size_t deletion_count_ = 0;
+  uint64_t slot_rates_sample_ms_ = 0;
+  uint64_t hot_keys_window_ms_ = 0;  // start of the top keys tracking window
 
   mutable SliceEvents events_;  // we may change this even for const operations.
 
@@ -484,6 +743,8 @@ class DbSlice {
   // Used in temporary computations in Find item and CbFinish
   mutable absl::flat_hash_set<CompactObjectView> bumped_items_;
 
+  FrequencySketch freq_sketch_;
+
   // Registered by shard indices on when first document index is created.
   DocDeletionCallback doc_del_cb_;
 
@@ -512,6 +773,20 @@ class DbSlice {
                       absl::container_internal::hash_default_hash<std::string>,
                       absl::container_internal::hash_default_eq<std::string>, AllocatorType>
       client_tracking_map_;
+
+  struct TrackingPrefix {
+    std::vector<unsigned> thread_refs;  // registrations by thread index.
+    std::vector<std::string> pending;   // keys written since the last flush.
+  };
+
+  // Broadcast tracking prefixes. Their lengths are counted separately so that a written key
+  // is matched with a single lookup per distinct prefix length.
+  absl::flat_hash_map<std::string, TrackingPrefix> tracking_prefixes_;
+  absl::btree_map<size_t, unsigned> tracking_prefix_lens_;
+  bool tracking_pending_ = false;
+
+  KeyspaceEventsFlag keyspace_events_;
+  std::vector<KeyspaceNotification> pending_keyspace_events_;
 };
 
 }  // namespace dfly
@@ -19,6 +19,7 @@
 #include "server/error.h"
 #include "server/main_service.h"
 #include "server/rdb_load.h"
+#include "server/request_trace.h"
 #include "server/server_state.h"
 #include "server/string_family.h"
 #include "server/transaction.h"
@@ -302,7 +303,9 @@ void DebugCmd::Run(CmdArgList args) {
         "    arguments. Each descriptor is prefixed by its frequency count",
         "OBJECT <key> [COMPRESS]",
         "    Show low-level info about `key` and associated value.",
-        "LOAD <filename>",
+        "LOAD <filename> [<delta> ...]",
+        "    Replace the database with the snapshot, then apply the snapshots saved by",
+        "    SAVE DELTA in the given order.",
         "RELOAD [option ...]",
         "    Save the RDB on disk and reload it back to memory. Valid <option> values:",
         "    * NOSAVE: the database will be loaded from an existing RDB file.",
@@ -333,6 +336,9 @@ void DebugCmd::Run(CmdArgList args) {
         "TRAFFIC <path> | [STOP]"
         "    Starts traffic logging to the specified path. If path is not specified,"
         "    traffic logging is stopped.",
+        "TRACE [RESET]",
+        "    Returns the commands sampled with --trace_sample_every as Chrome trace JSON.",
+        "    RESET clears the sampled traces.",
         "HELP",
         "    Prints this help.",
     };
@@ -358,8 +364,8 @@ void DebugCmd::Run(CmdArgList args) {
     return Watched();
   }
 
-  if (subcmd == "LOAD" && args.size() == 2) {
-    return Load(ArgS(args, 1));
+  if (subcmd == "LOAD" && args.size() >= 2) {
+    return Load(ArgS(args, 1), args.subspan(2));
   }
 
   if (subcmd == "OBJECT" && args.size() >= 2) {
@@ -392,6 +398,10 @@ void DebugCmd::Run(CmdArgList args) {
     return LogTraffic(args.subspan(1));
   }
 
+  if (subcmd == "TRACE") {
+    return Trace(args.subspan(1));
+  }
+
   string reply = UnknownSubCmd(subcmd, "DEBUG");
   return cntx_->SendError(reply, kSyntaxErrType);
 }
@@ -456,7 +466,7 @@ void DebugCmd::Replica(CmdArgList args) {
   return rb->SendError(UnknownSubCmd("replica", "DEBUG"));
 }
 
-void DebugCmd::Load(string_view filename) {
+void DebugCmd::Load(string_view filename, CmdArgList deltas) {
   auto new_state = sf_.service().SwitchState(GlobalState::ACTIVE, GlobalState::LOADING);
   if (new_state.first != GlobalState::LOADING) {
     LOG(WARNING) << GlobalStateName(new_state.first) << " in progress, ignored";
@@ -485,12 +495,19 @@ void DebugCmd::Load(string_view filename) {
     path = dir_path;
   }
 
-  auto fut_ec = sf_.Load(path.generic_string());
-  if (fut_ec.valid()) {
-    ec = fut_ec.get();
-    if (ec) {
-      LOG(INFO) << "Could not load file " << ec.message();
-      return cntx_->SendError(ec.message());
+  vector<string> paths{path.generic_string()};
+  for (size_t i = 0; i < deltas.size(); ++i)
+    paths.emplace_back(ArgS(deltas, i));
+
+  // The deltas are loaded one after another, each overrides the keys loaded before it.
+  for (const string& load_path : paths) {
+    auto fut_ec = sf_.Load(load_path);
+    if (fut_ec.valid()) {
+      ec = fut_ec.get();
+      if (ec) {
+        LOG(INFO) << "Could not load file " << ec.message();
+        return cntx_->SendError(ec.message());
+      }
     }
   }
 
@@ -702,6 +719,35 @@ void DebugCmd::LogTraffic(CmdArgList args) {
   cntx_->SendOk();
 }
 
+void DebugCmd::Trace(CmdArgList args) {
+  bool reset = false;
+  if (args.size() == 1 && absl::AsciiStrToUpper(ArgS(args, 0)) == "RESET") {
+    reset = true;
+  } else if (!args.empty()) {
+    return cntx_->SendError(kSyntaxErr);
+  }
+
+  fb2::Mutex mu;
+  vector<shared_ptr<const RequestTrace>> traces;
+  shard_set->pool()->AwaitFiberOnAll([&](auto*) {
+    auto& ring = ServerState::tlocal()->GetTraceRing();
+    if (reset) {
+      ring.Reset();
+      return;
+    }
+    unique_lock lk(mu);
+    traces.insert(traces.end(), ring.Traces().begin(), ring.Traces().end());
+  });
+
+  if (reset)
+    return cntx_->SendOk();
+
+  sort(traces.begin(), traces.end(),
+       [](const auto& l, const auto& r) { return l->start_ns() < r->start_ns(); });
+  auto* rb = static_cast<RedisReplyBuilder*>(cntx_->reply_builder());
+  rb->SendBulkString(ToChromeTrace(traces));
+}
+
 void DebugCmd::Inspect(string_view key, CmdArgList args) {
   EngineShardSet& ess = *shard_set;
   ShardId sid = Shard(key, ess.size());
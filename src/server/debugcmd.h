@@ -37,7 +37,8 @@ class DebugCmd {
 
   void Reload(CmdArgList args);
   void Replica(CmdArgList args);
-  void Load(std::string_view filename);
+  // Replaces the data with the snapshot and applies the delta snapshots on top, in order.
+  void Load(std::string_view filename, CmdArgList deltas);
   void Exec();
   void Inspect(std::string_view key, CmdArgList args);
   void Watched();
@@ -46,6 +47,7 @@ class DebugCmd {
   void Stacktrace();
   void Shards();
   void LogTraffic(CmdArgList);
+  void Trace(CmdArgList args);
 
   ServerFamily& sf_;
   ConnectionContext* cntx_;
@@ -18,6 +18,11 @@ using namespace std;
 
 ABSL_DECLARE_FLAG(string, dir);
 ABSL_DECLARE_FLAG(string, dbfilename);
+ABSL_DECLARE_FLAG(bool, snapshot_deltas);
+
+ABSL_FLAG(uint32_t, save_deadline_sec, 0,
+          "If positive, a save that runs for 80% of this many seconds stops pacing its "
+          "serialization (see --snapshot_pacing) to finish in time");
 
 namespace dfly {
 namespace detail {
@@ -115,6 +120,7 @@ GenericError RdbSnapshot::Start(SaveMode save_mode, const std::string& path,
   is_linux_file_ = file_type & FileType::IO_URING;
   bool align_writes = (file_type & FileType::DIRECT) != 0;
   saver_.reset(new RdbSaver(io_sink_.get(), save_mode, align_writes));
+  saver_->SaveTieredRefs();
 
   return saver_->SaveHeader(std::move(glob_data));
 }
@@ -127,6 +133,11 @@ size_t RdbSnapshot::GetSaveBuffersSize() {
   return saver_->GetTotalBuffersSize();
 }
 
+void RdbSnapshot::BoostPacing(EngineShard* shard) {
+  if (started_)
+    saver_->BoostPacingInShard(shard);
+}
+
 error_code RdbSnapshot::Close() {
   if (is_linux_file_) {
     return static_cast<LinuxWriteWrapper*>(io_sink_.get())->Close();
@@ -134,14 +145,15 @@ error_code RdbSnapshot::Close() {
   return static_cast<io::WriteFile*>(io_sink_.get())->Close();
 }
 
-void RdbSnapshot::StartInShard(EngineShard* shard) {
-  saver_->StartSnapshotInShard(false, cntx_.GetCancellation(), shard);
+void RdbSnapshot::StartInShard(EngineShard* shard, optional<uint64_t> save_base) {
+  saver_->StartSnapshotInShard(false, cntx_.GetCancellation(), shard, save_base);
   started_ = true;
 }
 
 SaveStagesController::SaveStagesController(SaveStagesInputs&& inputs)
     : SaveStagesInputs{std::move(inputs)} {
   start_time_ = absl::Now();
+  track_changes_ = use_dfs_format_ && GetFlag(FLAGS_snapshot_deltas);
 }
 
 SaveStagesController::~SaveStagesController() {
@@ -166,7 +178,7 @@ GenericError SaveStagesController::Save() {
     *save_bytes_cb_ = [this]() { return GetSaveBuffersSize(); };
   }
 
-  RunStage(&SaveStagesController::SaveCb);
+  RunSaveStage();
   {
     lock_guard lk{*save_mu_};
     *save_bytes_cb_ = nullptr;
@@ -178,6 +190,9 @@ GenericError SaveStagesController::Save() {
 
   FinalizeFileMovement();
 
+  if (track_changes_)
+    FinishSaveInShards();
+
   UpdateSaveInfo();
 
   return *shared_err_;
@@ -231,6 +246,22 @@ void SaveStagesController::SaveDfsSingle(EngineShard* shard) {
 
   SaveMode mode = shard == nullptr ? SaveMode::SUMMARY : SaveMode::SINGLE_SHARD;
   auto glob_data = shard == nullptr ? RdbSaver::GetGlobalData(service_) : RdbSaver::GlobalData{};
+  glob_data.delta = delta_;
+  if (shard)
+    glob_data.repl_id = service_->server_family().master_id();
+
+  // The base is checked on the shard thread right before the snapshot starts, a flush could
+  // invalidate it since the command was issued.
+  optional<uint64_t> save_base;
+  if (shard && track_changes_) {
+    save_base = delta_ ? shard->db_slice().save_base_version() : 0;
+    if (*save_base == 0 && delta_) {
+      shared_err_ = GenericError{make_error_code(errc::operation_not_permitted),
+                                 "No base to save a delta of, a full save is needed"};
+      snapshot.reset();
+      return;
+    }
+  }
 
   if (auto err = snapshot->Start(mode, filename, glob_data); err) {
     shared_err_ = err;
@@ -239,7 +270,7 @@ void SaveStagesController::SaveDfsSingle(EngineShard* shard) {
   }
 
   if (mode == SaveMode::SINGLE_SHARD)
-    snapshot->StartInShard(shard);
+    snapshot->StartInShard(shard, save_base);
 }
 
 // Save a single rdb file
@@ -293,6 +324,37 @@ void SaveStagesController::UpdateSaveInfo() {
   last_save_info_->success_duration_sec = seconds;
 }
 
+void SaveStagesController::RunSaveStage() {
+  uint32_t deadline_sec = GetFlag(FLAGS_save_deadline_sec);
+  if (deadline_sec == 0)
+    return RunStage(&SaveStagesController::SaveCb);
+
+  fb2::Done save_done;
+  fb2::Fiber boost_fb("save_boost", [&] {
+    auto boost_after = chrono::milliseconds(uint64_t(deadline_sec) * 800);
+    boost_after -= chrono::milliseconds(absl::ToInt64Milliseconds(absl::Now() - start_time_));
+    if (save_done.WaitFor(max(boost_after, chrono::milliseconds(0))))
+      return;
+
+    LOG(INFO) << "Save is close to its deadline, serializing at full speed";
+    shard_set->RunBriefInParallel([this](EngineShard* shard) {
+      auto& snapshot = snapshots_[use_dfs_format_ ? shard->shard_id() : 0].first;
+      if (snapshot)
+        snapshot->BoostPacing(shard);
+    });
+  });
+
+  RunStage(&SaveStagesController::SaveCb);
+  save_done.Notify();
+  boost_fb.Join();
+}
+
+void SaveStagesController::FinishSaveInShards() {
+  bool success = !shared_err_;
+  shard_set->RunBriefInParallel(
+      [success](EngineShard* shard) { shard->db_slice().FinishSave(success); });
+}
+
 GenericError SaveStagesController::InitResources() {
   snapshots_.resize(use_dfs_format_ ? shard_set->size() + 1 : 1);
   for (auto& [snapshot, _] : snapshots_)
@@ -21,6 +21,7 @@ namespace detail {
 
 struct SaveStagesInputs {
   bool use_dfs_format_;
+  bool delta_;  // save only the changes since the last save, see SliceSnapshot::Start.
   std::string_view basename_;
   Transaction* trans_;
   Service* service_;
@@ -39,11 +40,12 @@ class RdbSnapshot {
   }
 
   GenericError Start(SaveMode save_mode, const string& path, const RdbSaver::GlobalData& glob_data);
-  void StartInShard(EngineShard* shard);
+  void StartInShard(EngineShard* shard, std::optional<uint64_t> save_base = std::nullopt);
 
   error_code SaveBody();
   error_code Close();
   size_t GetSaveBuffersSize();
+  void BoostPacing(EngineShard* shard);
 
   const RdbTypeFreqMap freq_map() const {
     return freq_map_;
@@ -96,6 +98,13 @@ struct SaveStagesController : public SaveStagesInputs {
   // Switch to saving state if in active state
   GenericError SwitchState();
 
+  // Makes a successful save the base of the next delta, see DbSlice::FinishSave.
+  void FinishSaveInShards();
+
+  // Runs the SaveCb stage. With --save_deadline_sec, stops pacing the serialization when the
+  // save gets close to the deadline.
+  void RunSaveStage();
+
   void SaveCb(unsigned index);
 
   void CloseCb(unsigned index);
@@ -108,6 +117,7 @@ struct SaveStagesController : public SaveStagesInputs {
   absl::Time start_time_;
   std::filesystem::path full_path_;
   bool is_cloud_;
+  bool track_changes_;  // whether the save tracks changes for delta snapshots.
 
   AggregateGenericError shared_err_;
   std::vector<std::pair<std::unique_ptr<RdbSnapshot>, std::filesystem::path>> snapshots_;
@@ -3,13 +3,25 @@
 
 #include "server/detail/snapshot_storage.h"
 
+#include <absl/strings/str_cat.h>
 #include <absl/strings/str_replace.h>
 #include <absl/strings/strip.h>
 #include <aws/core/auth/AWSCredentialsProvider.h>
+#include <aws/core/utils/stream/PreallocatedStreamBuf.h>
 #include <aws/s3/S3Client.h>
+#include <aws/s3/model/AbortMultipartUploadRequest.h>
+#include <aws/s3/model/CompleteMultipartUploadRequest.h>
+#include <aws/s3/model/CreateMultipartUploadRequest.h>
+#include <aws/s3/model/GetObjectRequest.h>
+#include <aws/s3/model/HeadObjectRequest.h>
 #include <aws/s3/model/ListObjectsV2Request.h>
 #include <aws/s3/model/PutObjectRequest.h>
+#include <aws/s3/model/UploadPartRequest.h>
 
+#include <mimalloc.h>
+#include <unistd.h>
+
+#include <deque>
 #include <regex>
 
 #include "base/logging.h"
@@ -21,6 +33,9 @@
 #include "util/aws/s3_read_file.h"
 #include "util/aws/s3_write_file.h"
 #include "util/fibers/fiber_file.h"
+#ifdef __linux__
+#include "util/fibers/uring_proactor.h"
+#endif
 
 namespace dfly {
 namespace detail {
@@ -38,12 +53,559 @@ std::optional<std::pair<std::string, std::string>> GetBucketPath(std::string_vie
   return std::make_pair(std::move(bucket_name), std::move(obj_path));
 }
 
+namespace {
+
+using Aws::S3::Model::CompletedPart;
+
+// Uploads a file with a multipart upload that keeps up to `upload_concurrency` parts in flight,
+// each uploaded by its own fiber. The part size doubles every kPartsPerDoubling parts, so that
+// the 10000 parts allowed by S3 cover files of any size while the first parts stay small.
+class S3ParallelWriteFile : public io::WriteFile {
+ public:
+  static constexpr int kPartsPerDoubling = 1000;
+
+  S3ParallelWriteFile(std::string bucket, std::string key, std::string upload_id,
+                      std::shared_ptr<Aws::S3::S3Client> s3, const S3TransferOptions& opts)
+      : io::WriteFile(key),
+        bucket_(std::move(bucket)),
+        key_(std::move(key)),
+        upload_id_(std::move(upload_id)),
+        s3_(std::move(s3)),
+        opts_(opts) {
+  }
+
+  ~S3ParallelWriteFile() {
+    inflight_ec_.await([this] { return inflight_ == 0; });
+  }
+
+  static io::Result<S3ParallelWriteFile*> Open(std::string bucket, std::string key,
+                                               std::shared_ptr<Aws::S3::S3Client> s3,
+                                               const S3TransferOptions& opts);
+
+  io::Result<size_t> WriteSome(const iovec* v, uint32_t len) final;
+
+  std::error_code Close() final;
+
+ private:
+  size_t PartSize() const {
+    int doublings = std::min((next_part_ - 1) / kPartsPerDoubling, 8);
+    return opts_.part_size << doublings;
+  }
+
+  // Uploads buf_ as the next part, waits while too many parts are in flight.
+  void FlushPart();
+
+  void UploadPart(int part_num, std::string data);
+
+  std::string bucket_, key_, upload_id_;
+  std::shared_ptr<Aws::S3::S3Client> s3_;
+  S3TransferOptions opts_;
+
+  std::string buf_;
+  int next_part_ = 1;
+  unsigned inflight_ = 0;
+  util::fb2::EventCount inflight_ec_;
+  std::vector<CompletedPart> parts_;
+  std::error_code ec_;  // the first error of the uploads.
+};
+
+io::Result<S3ParallelWriteFile*> S3ParallelWriteFile::Open(std::string bucket, std::string key,
+                                                           std::shared_ptr<Aws::S3::S3Client> s3,
+                                                           const S3TransferOptions& opts) {
+  Aws::S3::Model::CreateMultipartUploadRequest request;
+  request.SetBucket(bucket);
+  request.SetKey(key);
+  Aws::S3::Model::CreateMultipartUploadOutcome outcome = s3->CreateMultipartUpload(request);
+  if (!outcome.IsSuccess()) {
+    LOG(ERROR) << "Failed to create multipart upload of " << key << ": "
+               << outcome.GetError().GetExceptionName() << " " << outcome.GetError().GetMessage();
+    return nonstd::make_unexpected(std::make_error_code(std::errc::io_error));
+  }
+
+  std::string upload_id = outcome.GetResult().GetUploadId();
+  return new S3ParallelWriteFile(std::move(bucket), std::move(key), std::move(upload_id),
+                                 std::move(s3), opts);
+}
+
+io::Result<size_t> S3ParallelWriteFile::WriteSome(const iovec* v, uint32_t len) {
+  if (ec_)
+    return nonstd::make_unexpected(ec_);
+
+  size_t total = 0;
+  for (uint32_t i = 0; i < len; ++i) {
+    buf_.append(static_cast<const char*>(v[i].iov_base), v[i].iov_len);
+    total += v[i].iov_len;
+    while (buf_.size() >= PartSize())
+      FlushPart();
+  }
+  return total;
+}
+
+void S3ParallelWriteFile::FlushPart() {
+  size_t part_size = std::min(PartSize(), buf_.size());
+  std::string data = buf_.substr(0, part_size);
+  buf_.erase(0, part_size);
+
+  inflight_ec_.await([this] { return inflight_ < std::max(opts_.upload_concurrency, 1u); });
+  ++inflight_;
+  util::fb2::Fiber("s3_upload_part", [this, part_num = next_part_++, data = std::move(data)] {
+    UploadPart(part_num, std::move(data));
+    --inflight_;
+    inflight_ec_.notifyAll();
+  }).Detach();
+}
+
+void S3ParallelWriteFile::UploadPart(int part_num, std::string data) {
+  Aws::Utils::Stream::PreallocatedStreamBuf stream_buf(
+      reinterpret_cast<unsigned char*>(data.data()), data.size());
+  Aws::S3::Model::UploadPartRequest request;
+  request.SetBucket(bucket_);
+  request.SetKey(key_);
+  request.SetUploadId(upload_id_);
+  request.SetPartNumber(part_num);
+  request.SetContentLength(data.size());
+  request.SetBody(std::make_shared<Aws::IOStream>(&stream_buf));
+
+  Aws::S3::Model::UploadPartOutcome outcome = s3_->UploadPart(request);
+  if (!outcome.IsSuccess()) {
+    LOG(ERROR) << "Failed to upload part " << part_num << " of " << key_ << ": "
+               << outcome.GetError().GetExceptionName() << " " << outcome.GetError().GetMessage();
+    if (!ec_)
+      ec_ = std::make_error_code(std::errc::io_error);
+    return;
+  }
+
+  CompletedPart part;
+  part.SetPartNumber(part_num);
+  part.SetETag(outcome.GetResult().GetETag());
+  parts_.push_back(std::move(part));
+}
+
+std::error_code S3ParallelWriteFile::Close() {
+  // The last part may be smaller than the minimal size, and the first one too if it is the only.
+  if (!buf_.empty() || next_part_ == 1)
+    FlushPart();
+  inflight_ec_.await([this] { return inflight_ == 0; });
+
+  if (ec_) {
+    Aws::S3::Model::AbortMultipartUploadRequest request;
+    request.SetBucket(bucket_);
+    request.SetKey(key_);
+    request.SetUploadId(upload_id_);
+    s3_->AbortMultipartUpload(request);
+    return ec_;
+  }
+
+  std::sort(parts_.begin(), parts_.end(), [](const CompletedPart& l, const CompletedPart& r) {
+    return l.GetPartNumber() < r.GetPartNumber();
+  });
+  Aws::S3::Model::CompletedMultipartUpload completed;
+  completed.SetParts(std::move(parts_));
+
+  Aws::S3::Model::CompleteMultipartUploadRequest request;
+  request.SetBucket(bucket_);
+  request.SetKey(key_);
+  request.SetUploadId(upload_id_);
+  request.SetMultipartUpload(std::move(completed));
+  Aws::S3::Model::CompleteMultipartUploadOutcome outcome = s3_->CompleteMultipartUpload(request);
+  if (!outcome.IsSuccess()) {
+    LOG(ERROR) << "Failed to complete multipart upload of " << key_ << ": "
+               << outcome.GetError().GetExceptionName() << " " << outcome.GetError().GetMessage();
+    return std::make_error_code(std::errc::io_error);
+  }
+  return {};
+}
+
+// Downloads a file with ranged GETs of part_size, keeping up to `download_concurrency` ranges in
+// flight, each fetched by its own fiber. The ranges are reassembled in order, so the file must be
+// read sequentially, as io::FileSource does.
+class S3ParallelReadFile : public io::ReadonlyFile {
+ public:
+  S3ParallelReadFile(std::string bucket, std::string key, size_t size,
+                     std::shared_ptr<Aws::S3::S3Client> s3, const S3TransferOptions& opts)
+      : bucket_(std::move(bucket)), key_(std::move(key)), size_(size), s3_(std::move(s3)),
+        opts_(opts) {
+  }
+
+  ~S3ParallelReadFile() {
+    std::error_code ec = Close();
+    (void)ec;
+  }
+
+  static io::Result<S3ParallelReadFile*> Open(std::string bucket, std::string key,
+                                              std::shared_ptr<Aws::S3::S3Client> s3,
+                                              const S3TransferOptions& opts);
+
+  using io::ReadonlyFile::Read;
+  io::Result<size_t> Read(size_t offset, const iovec* v, uint32_t len) final;
+
+  std::error_code Close() final {
+    closed_ = true;
+    ec_.await([this] { return inflight_ == 0; });
+    ranges_.clear();
+    return {};
+  }
+
+  size_t Size() const final {
+    return size_;
+  }
+
+  int Handle() const final {
+    return -1;
+  }
+
+ private:
+  struct Range {
+    size_t offset;
+    std::string data;
+    size_t consumed = 0;
+    bool done = false;
+    bool failed = false;
+  };
+
+  // Starts fetching ranges until the concurrency limit or the end of the file.
+  void FetchAhead();
+
+  void Fetch(Range* range);
+
+  std::string bucket_, key_;
+  size_t size_;
+  std::shared_ptr<Aws::S3::S3Client> s3_;
+  S3TransferOptions opts_;
+
+  std::deque<std::unique_ptr<Range>> ranges_;  // in offset order, the first is being read.
+  size_t fetch_offset_ = 0;                   // where the next range starts.
+  size_t read_offset_ = 0;
+  unsigned inflight_ = 0;
+  bool closed_ = false;
+  util::fb2::EventCount ec_;
+};
+
+io::Result<S3ParallelReadFile*> S3ParallelReadFile::Open(std::string bucket, std::string key,
+                                                         std::shared_ptr<Aws::S3::S3Client> s3,
+                                                         const S3TransferOptions& opts) {
+  Aws::S3::Model::HeadObjectRequest request;
+  request.SetBucket(bucket);
+  request.SetKey(key);
+  Aws::S3::Model::HeadObjectOutcome outcome = s3->HeadObject(request);
+  if (!outcome.IsSuccess()) {
+    LOG(ERROR) << "Failed to get the size of " << key << ": "
+               << outcome.GetError().GetExceptionName() << " " << outcome.GetError().GetMessage();
+    return nonstd::make_unexpected(std::make_error_code(std::errc::io_error));
+  }
+
+  size_t size = outcome.GetResult().GetContentLength();
+  return new S3ParallelReadFile(std::move(bucket), std::move(key), size, std::move(s3), opts);
+}
+
+io::Result<size_t> S3ParallelReadFile::Read(size_t offset, const iovec* v, uint32_t len) {
+  if (closed_ || offset != read_offset_)
+    return nonstd::make_unexpected(std::make_error_code(std::errc::invalid_argument));
+
+  size_t total = 0;
+  for (uint32_t i = 0; i < len; ++i) {
+    char* dest = static_cast<char*>(v[i].iov_base);
+    size_t pos = 0;
+    while (pos < v[i].iov_len && read_offset_ < size_) {
+      FetchAhead();
+      Range* range = ranges_.front().get();
+      ec_.await([range] { return range->done; });
+      if (range->failed)
+        return nonstd::make_unexpected(std::make_error_code(std::errc::io_error));
+
+      size_t n = std::min(v[i].iov_len - pos, range->data.size() - range->consumed);
+      memcpy(dest + pos, range->data.data() + range->consumed, n);
+      range->consumed += n;
+      read_offset_ += n;
+      pos += n;
+      if (range->consumed == range->data.size())
+        ranges_.pop_front();
+    }
+    total += pos;
+  }
+  return total;
+}
+
+void S3ParallelReadFile::FetchAhead() {
+  unsigned concurrency = std::max(opts_.download_concurrency, 1u);
+  while (!closed_ && fetch_offset_ < size_ && ranges_.size() < concurrency) {
+    auto range = std::make_unique<Range>();
+    range->offset = fetch_offset_;
+    fetch_offset_ = std::min(size_, fetch_offset_ + opts_.part_size);
+    range->data.resize(fetch_offset_ - range->offset);
+
+    ++inflight_;
+    util::fb2::Fiber("s3_fetch_range", [this, range = range.get()] {
+      Fetch(range);
+      range->done = true;
+      --inflight_;
+      ec_.notifyAll();
+    }).Detach();
+    ranges_.push_back(std::move(range));
+  }
+}
+
+void S3ParallelReadFile::Fetch(Range* range) {
+  Aws::S3::Model::GetObjectRequest request;
+  request.SetBucket(bucket_);
+  request.SetKey(key_);
+  size_t last = range->offset + range->data.size() - 1;
+  request.SetRange(absl::StrCat("bytes=", range->offset, "-", last));
+
+  Aws::S3::Model::GetObjectOutcome outcome = s3_->GetObject(request);
+  if (!outcome.IsSuccess()) {
+    LOG(ERROR) << "Failed to download " << key_ << " at " << range->offset << ": "
+               << outcome.GetError().GetExceptionName() << " " << outcome.GetError().GetMessage();
+    range->failed = true;
+    return;
+  }
+
+  Aws::IOStream& body = outcome.GetResult().GetBody();
+  body.read(range->data.data(), range->data.size());
+  if (size_t(body.gcount()) != range->data.size()) {
+    LOG(ERROR) << "Short read of " << key_ << " at " << range->offset;
+    range->failed = true;
+  }
+}
+
+// Reads a file sequentially while up to `depth` chunks after the read offset are fetched by
+// their own fibers, so that the reads overlap with the decoding of the data.
+class ReadAheadFile : public io::ReadonlyFile {
+ public:
+  static constexpr size_t kChunkSize = 1 << 20;
+
+  ReadAheadFile(io::ReadonlyFile* file, unsigned depth)
+      : file_(file), size_(file->Size()), depth_(depth) {
+  }
+
+  ~ReadAheadFile() {
+    std::error_code ec = Close();
+    (void)ec;
+  }
+
+  using io::ReadonlyFile::Read;
+  io::Result<size_t> Read(size_t offset, const iovec* v, uint32_t len) final;
+
+  std::error_code Close() final;
+
+  size_t Size() const final {
+    return size_;
+  }
+
+  int Handle() const final {
+    return file_ ? file_->Handle() : -1;
+  }
+
+ private:
+  struct Chunk {
+    std::string data;
+    size_t consumed = 0;
+    bool done = false;
+    std::error_code ec;
+  };
+
+  // Starts fetching chunks until the depth limit or the end of the file.
+  void FetchAhead();
+
+  std::unique_ptr<io::ReadonlyFile> file_;
+  size_t size_;
+  unsigned depth_;
+
+  std::deque<std::unique_ptr<Chunk>> chunks_;  // in offset order, the first is being read.
+  size_t fetch_offset_ = 0;                     // where the next chunk starts.
+  size_t read_offset_ = 0;
+  unsigned inflight_ = 0;
+  util::fb2::EventCount ec_;
+};
+
+io::Result<size_t> ReadAheadFile::Read(size_t offset, const iovec* v, uint32_t len) {
+  if (!file_ || offset != read_offset_)
+    return nonstd::make_unexpected(std::make_error_code(std::errc::invalid_argument));
+
+  size_t total = 0;
+  for (uint32_t i = 0; i < len; ++i) {
+    char* dest = static_cast<char*>(v[i].iov_base);
+    size_t pos = 0;
+    while (pos < v[i].iov_len && read_offset_ < size_) {
+      FetchAhead();
+      Chunk* chunk = chunks_.front().get();
+      ec_.await([chunk] { return chunk->done; });
+      if (chunk->ec)
+        return nonstd::make_unexpected(chunk->ec);
+
+      size_t n = std::min(v[i].iov_len - pos, chunk->data.size() - chunk->consumed);
+      memcpy(dest + pos, chunk->data.data() + chunk->consumed, n);
+      chunk->consumed += n;
+      read_offset_ += n;
+      pos += n;
+      if (chunk->consumed == chunk->data.size())
+        chunks_.pop_front();
+    }
+    total += pos;
+  }
+  return total;
+}
+
+void ReadAheadFile::FetchAhead() {
+  while (fetch_offset_ < size_ && chunks_.size() < depth_) {
+    auto chunk = std::make_unique<Chunk>();
+    size_t offset = fetch_offset_;
+    fetch_offset_ = std::min(size_, fetch_offset_ + kChunkSize);
+    chunk->data.resize(fetch_offset_ - offset);
+
+    ++inflight_;
+    util::fb2::Fiber("read_ahead", [this, offset, chunk = chunk.get()] {
+      io::MutableBytes dest{reinterpret_cast<uint8_t*>(chunk->data.data()), chunk->data.size()};
+      io::Result<size_t> res = file_->Read(offset, dest);
+      if (!res)
+        chunk->ec = res.error();
+      else if (*res != dest.size())  // the file must not shrink while it is loaded.
+        chunk->ec = std::make_error_code(std::errc::io_error);
+      chunk->done = true;
+      --inflight_;
+      ec_.notifyAll();
+    }).Detach();
+    chunks_.push_back(std::move(chunk));
+  }
+}
+
+std::error_code ReadAheadFile::Close() {
+  if (!file_)
+    return {};
+
+  ec_.await([this] { return inflight_ == 0; });
+  chunks_.clear();
+  std::error_code ec = file_->Close();
+  file_.reset();
+  return ec;
+}
+
+#ifdef __linux__
+
+// Writes an O_DIRECT file through io_uring with up to `queue_depth` aligned buffers in flight,
+// instead of waiting for every write. The last buffer is padded to the block size and the file
+// is truncated to its real size on Close.
+class LinuxDirectWriteFile : public io::WriteFile {
+ public:
+  static constexpr size_t kBufSize = 1 << 20;
+  static constexpr size_t kBlockSize = 4096;
+
+  LinuxDirectWriteFile(std::string path, std::unique_ptr<util::fb2::LinuxFile> file,
+                       unsigned queue_depth);
+  ~LinuxDirectWriteFile();
+
+  io::Result<size_t> WriteSome(const iovec* v, uint32_t len) final;
+
+  std::error_code Close() final;
+
+ private:
+  // Submits the current buffer and waits for a free one.
+  void Submit();
+
+  std::unique_ptr<util::fb2::LinuxFile> file_;
+  std::vector<char*> free_bufs_;
+  char* buf_;
+  size_t buf_len_ = 0;
+  off_t offset_ = 0;  // of the next submitted buffer.
+  size_t size_ = 0;   // the bytes written to the file, without the padding.
+  unsigned inflight_ = 0;
+  util::fb2::EventCount ec_;
+  std::error_code write_ec_;  // the first error of the writes.
+};
+
+LinuxDirectWriteFile::LinuxDirectWriteFile(std::string path,
+                                           std::unique_ptr<util::fb2::LinuxFile> file,
+                                           unsigned queue_depth)
+    : io::WriteFile(path), file_(std::move(file)) {
+  for (unsigned i = 0; i < queue_depth; ++i)
+    free_bufs_.push_back((char*)mi_malloc_aligned(kBufSize, kBlockSize));
+  buf_ = free_bufs_.back();
+  free_bufs_.pop_back();
+}
+
+LinuxDirectWriteFile::~LinuxDirectWriteFile() {
+  ec_.await([this] { return inflight_ == 0; });
+  for (char* buf : free_bufs_)
+    mi_free(buf);
+  mi_free(buf_);
+}
+
+io::Result<size_t> LinuxDirectWriteFile::WriteSome(const iovec* v, uint32_t len) {
+  if (write_ec_)
+    return nonstd::make_unexpected(write_ec_);
+
+  size_t total = 0;
+  for (uint32_t i = 0; i < len; ++i) {
+    const char* src = reinterpret_cast<const char*>(v[i].iov_base);
+    size_t left = v[i].iov_len;
+    total += left;
+    while (left > 0) {
+      size_t n = std::min(left, kBufSize - buf_len_);
+      memcpy(buf_ + buf_len_, src, n);
+      buf_len_ += n;
+      src += n;
+      left -= n;
+      if (buf_len_ == kBufSize)
+        Submit();
+    }
+  }
+  size_ += total;
+  return total;
+}
+
+void LinuxDirectWriteFile::Submit() {
+  using util::fb2::UringProactor;
+
+  size_t len = (buf_len_ + kBlockSize - 1) & ~(kBlockSize - 1);
+  memset(buf_ + buf_len_, 0, len - buf_len_);
+
+  auto cb = [this, buf = buf_, len](auto*, UringProactor::IoResult res, uint32_t) {
+    if (!write_ec_ && res < 0)
+      write_ec_ = std::error_code{-res, std::system_category()};
+    else if (!write_ec_ && size_t(res) != len)
+      write_ec_ = std::make_error_code(std::errc::io_error);
+    free_bufs_.push_back(buf);
+    --inflight_;
+    ec_.notify();
+  };
+
+  auto* proactor = static_cast<UringProactor*>(util::fb2::ProactorBase::me());
+  util::fb2::SubmitEntry se = proactor->GetSubmitEntry(std::move(cb), 0);
+  se.PrepWrite(file_->fd(), buf_, len, offset_);
+  ++inflight_;
+  offset_ += len;
+  buf_len_ = 0;
+
+  ec_.await([this] { return !free_bufs_.empty(); });
+  buf_ = free_bufs_.back();
+  free_bufs_.pop_back();
+}
+
+std::error_code LinuxDirectWriteFile::Close() {
+  if (buf_len_ > 0)
+    Submit();
+  ec_.await([this] { return inflight_ == 0; });
+
+  if (!write_ec_ && ftruncate(file_->fd(), size_) != 0)
+    write_ec_ = std::error_code{errno, std::system_category()};
+
+  std::error_code ec = file_->Close();
+  return write_ec_ ? write_ec_ : ec;
+}
+
+#endif
+
+}  // namespace
+
 #ifdef __linux__
 const int kRdbWriteFlags = O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC | O_DIRECT;
 #endif
 
-FileSnapshotStorage::FileSnapshotStorage(FiberQueueThreadPool* fq_threadpool)
-    : fq_threadpool_{fq_threadpool} {
+FileSnapshotStorage::FileSnapshotStorage(FiberQueueThreadPool* fq_threadpool,
+                                         unsigned write_queue_depth, unsigned read_ahead_depth)
+    : fq_threadpool_{fq_threadpool},
+      write_queue_depth_{write_queue_depth},
+      read_ahead_depth_{read_ahead_depth} {
 }
 
 io::Result<std::pair<io::Sink*, uint8_t>, GenericError> FileSnapshotStorage::OpenWriteFile(
@@ -64,6 +626,12 @@ io::Result<std::pair<io::Sink*, uint8_t>, GenericError> FileSnapshotStorage::Ope
           "Couldn't open file for writing (is direct I/O supported by the file system?)"));
     }
 
+    // The direct writer aligns the writes itself, so the saver writes to it like to any file.
+    if ((kRdbWriteFlags & O_DIRECT) && write_queue_depth_ > 1) {
+      return std::pair(new LinuxDirectWriteFile(path, std::move(*res), write_queue_depth_),
+                       FileType::FILE);
+    }
+
     uint8_t file_type = FileType::FILE | FileType::IO_URING;
     if (kRdbWriteFlags & O_DIRECT) {
       file_type |= FileType::DIRECT;
@@ -77,14 +645,14 @@ io::Result<std::pair<io::Sink*, uint8_t>, GenericError> FileSnapshotStorage::Ope
 
 io::ReadonlyFileOrError FileSnapshotStorage::OpenReadFile(const std::string& path) {
 #ifdef __linux__
-  if (fq_threadpool_) {
-    return util::OpenFiberReadFile(path, fq_threadpool_);
-  } else {
-    return util::fb2::OpenRead(path);
-  }
+  io::ReadonlyFileOrError res =
+      fq_threadpool_ ? util::OpenFiberReadFile(path, fq_threadpool_) : util::fb2::OpenRead(path);
 #else
-  return util::OpenFiberReadFile(path, fq_threadpool_);
+  io::ReadonlyFileOrError res = util::OpenFiberReadFile(path, fq_threadpool_);
 #endif
+  if (res && read_ahead_depth_ > 0)
+    return new ReadAheadFile(*res, read_ahead_depth_);
+  return res;
 }
 
 io::Result<std::string, GenericError> FileSnapshotStorage::LoadPath(std::string_view dir,
@@ -172,7 +740,9 @@ io::Result<std::vector<std::string>, GenericError> FileSnapshotStorage::LoadPath
 }
 
 AwsS3SnapshotStorage::AwsS3SnapshotStorage(const std::string& endpoint, bool https,
-                                           bool ec2_metadata, bool sign_payload) {
+                                           bool ec2_metadata, bool sign_payload,
+                                           const S3TransferOptions& transfer)
+    : transfer_(transfer) {
   shard_set->pool()->GetNextProactor()->Await([&] {
     if (!ec2_metadata) {
       setenv("AWS_EC2_METADATA_DISABLED", "true", 0);
@@ -203,6 +773,15 @@ io::Result<std::pair<io::Sink*, uint8_t>, GenericError> AwsS3SnapshotStorage::Op
       return nonstd::make_unexpected(GenericError("Invalid S3 path"));
     }
     auto [bucket, key] = *bucket_path;
+    if (transfer_.upload_concurrency > 1) {
+      io::Result<S3ParallelWriteFile*> file =
+          S3ParallelWriteFile::Open(bucket, key, s3_, transfer_);
+      if (!file) {
+        return nonstd::make_unexpected(GenericError(file.error(), "Failed to open write file"));
+      }
+      return std::pair<io::Sink*, uint8_t>(*file, FileType::CLOUD);
+    }
+
     io::Result<util::aws::S3WriteFile> file = util::aws::S3WriteFile::Open(bucket, key, s3_);
     if (!file) {
       return nonstd::make_unexpected(GenericError(file.error(), "Failed to open write file"));
@@ -219,6 +798,14 @@ io::ReadonlyFileOrError AwsS3SnapshotStorage::OpenReadFile(const std::string& pa
     return nonstd::make_unexpected(GenericError("Invalid S3 path"));
   }
   auto [bucket, key] = *bucket_path;
+  if (transfer_.download_concurrency > 1) {
+    util::fb2::ProactorBase* proactor = shard_set->pool()->GetNextProactor();
+    io::Result<S3ParallelReadFile*> file = proactor->Await(
+        [&] { return S3ParallelReadFile::Open(bucket, key, s3_, transfer_); });
+    if (!file)
+      return nonstd::make_unexpected(file.error());
+    return *file;
+  }
   return new util::aws::S3ReadFile(bucket, key, s3_);
 }
 
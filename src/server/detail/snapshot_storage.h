@@ -53,7 +53,10 @@ class SnapshotStorage {
 
 class FileSnapshotStorage : public SnapshotStorage {
  public:
-  FileSnapshotStorage(FiberQueueThreadPool* fq_threadpool);
+  // write_queue_depth above 1 keeps that many direct writes of a file in flight with io_uring,
+  // read_ahead_depth above 0 reads that many chunks of a loaded file ahead of the loader.
+  FileSnapshotStorage(FiberQueueThreadPool* fq_threadpool, unsigned write_queue_depth = 1,
+                      unsigned read_ahead_depth = 0);
 
   io::Result<std::pair<io::Sink*, uint8_t>, GenericError> OpenWriteFile(
       const std::string& path) override;
@@ -68,12 +71,22 @@ class FileSnapshotStorage : public SnapshotStorage {
 
  private:
   util::fb2::FiberQueueThreadPool* fq_threadpool_;
+  unsigned write_queue_depth_;
+  unsigned read_ahead_depth_;
+};
+
+// Parallelism of the transfers of snapshot files from and to S3. With concurrency of 1 the files
+// are transferred as a single stream.
+struct S3TransferOptions {
+  unsigned upload_concurrency = 1;    // parts of a multipart upload in flight per file.
+  unsigned download_concurrency = 1;  // ranged GETs in flight per file.
+  size_t part_size = 16 << 20;        // size of the first parts and of the ranges.
 };
 
 class AwsS3SnapshotStorage : public SnapshotStorage {
  public:
   AwsS3SnapshotStorage(const std::string& endpoint, bool https, bool ec2_metadata,
-                       bool sign_payload);
+                       bool sign_payload, const S3TransferOptions& transfer = {});
 
   io::Result<std::pair<io::Sink*, uint8_t>, GenericError> OpenWriteFile(
       const std::string& path) override;
@@ -100,6 +113,7 @@ class AwsS3SnapshotStorage : public SnapshotStorage {
                                                               std::string_view prefix);
 
   std::shared_ptr<Aws::S3::S3Client> s3_;
+  S3TransferOptions transfer_;
 };
 
 // Returns bucket_name, obj_path for an s3 path.
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <cstring>
+
 #include "core/compact_object.h"
 #include "core/dash.h"
 #include "core/expire_period.h"
@@ -15,6 +17,51 @@ namespace detail {
 using PrimeKey = CompactObj;
 using PrimeValue = CompactObj;
 
+#ifdef DF_INLINE_EXPIRE
+
+// The value of a prime table slot that also keeps the expiry period of its key, so that keys
+// with expiry do not need an entry in a separate expire table. The period is meaningful only
+// when the expire bit of the value is set.
+class PrimeSlotValue : public CompactObj {
+ public:
+  PrimeSlotValue() = default;
+
+  PrimeSlotValue(PrimeSlotValue&& o) noexcept : CompactObj(std::move(o)) {
+    memcpy(period_, o.period_, sizeof(period_));
+  }
+
+  PrimeSlotValue& operator=(PrimeSlotValue&& o) noexcept {
+    CompactObj::operator=(std::move(o));
+    memcpy(period_, o.period_, sizeof(period_));
+    return *this;
+  }
+
+  // Replaces the value and keeps the expiry period of the slot, like the expire table entry
+  // is kept when a value is overridden.
+  PrimeSlotValue& operator=(CompactObj&& o) noexcept {
+    CompactObj::operator=(std::move(o));
+    return *this;
+  }
+
+  ExpirePeriod expire_period() const {
+    ExpirePeriod res;
+    memcpy(&res, period_, sizeof(res));
+    return res;
+  }
+
+  void set_expire_period(ExpirePeriod period) {
+    memcpy(period_, &period, sizeof(period_));
+  }
+
+ private:
+  // Unaligned storage keeps the slot at 26 bytes.
+  uint8_t period_[sizeof(ExpirePeriod)] = {};
+};
+
+#else
+using PrimeSlotValue = CompactObj;
+#endif
+
 struct PrimeTablePolicy {
   enum { kSlotNum = 14, kBucketNum = 56, kStashBucketNum = 4 };
 
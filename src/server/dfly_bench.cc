@@ -0,0 +1,449 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include <absl/random/random.h>
+#include <absl/strings/numbers.h>
+#include <absl/strings/str_cat.h>
+#include <absl/strings/str_split.h>
+#include <netdb.h>
+
+#include <boost/asio/ip/address.hpp>
+#include <cmath>
+#include <deque>
+#include <iostream>
+
+#include "base/histogram.h"
+#include "base/init.h"
+#include "base/io_buf.h"
+#include "base/logging.h"
+#include "facade/redis_parser.h"
+#include "facade/reply_builder.h"
+#include "util/fibers/pool.h"
+#include "util/fibers/synchronization.h"
+
+extern "C" {
+#include "redis/crc16.h"
+}
+
+// A load generator that drives a Redis compatible server from all the threads of the box. Every
+// thread runs --c connections, each sending --n requests with up to --pipeline of them in flight.
+// The latencies are measured from sending a request until its reply is parsed.
+
+ABSL_FLAG(std::string, h, "localhost", "server hostname or ip");
+ABSL_FLAG(uint16_t, p, 6379, "server port");
+ABSL_FLAG(uint32_t, c, 20, "number of connections per thread");
+ABSL_FLAG(uint32_t, n, 1000, "number of requests sent by each connection");
+ABSL_FLAG(uint32_t, test_time, 0, "if positive, runs for this number of seconds instead of --n");
+ABSL_FLAG(uint32_t, pipeline, 1, "maximum number of requests in flight per connection");
+ABSL_FLAG(uint32_t, d, 16, "size of the values of SET");
+ABSL_FLAG(std::string, ratio, "1:10", "ratio of SET to GET requests");
+ABSL_FLAG(std::string, key_prefix, "key:", "prefix of the keys");
+ABSL_FLAG(uint64_t, key_minimum, 0, "minimum key index");
+ABSL_FLAG(uint64_t, key_maximum, 10'000'000, "maximum key index");
+ABSL_FLAG(std::string, key_dist, "U",
+          "distribution of the key indices: U for uniform, Z for zipfian, S for sequential");
+ABSL_FLAG(double, zipf_alpha, 0.99, "skew of the zipfian distribution, must be in (0, 1)");
+ABSL_FLAG(bool, cluster, false,
+          "if true, reads the slots with CLUSTER SLOTS from the server and sends every request to "
+          "the node owning its key");
+
+using namespace std;
+using namespace util;
+using absl::GetFlag;
+using facade::RedisParser;
+using facade::RespExpr;
+using facade::RespVec;
+using tcp = ::boost::asio::ip::tcp;
+
+namespace dfly {
+namespace {
+
+constexpr uint16_t kMaxSlotNum = 0x3FFF;
+
+uint16_t KeySlot(string_view key) {
+  string_view tag = key;
+  if (size_t start = key.find('{'); start != key.npos) {
+    size_t end = key.find('}', start + 1);
+    if (end != key.npos && end != start + 1)
+      tag = key.substr(start + 1, end - start - 1);
+  }
+  return crc16(tag.data(), tag.size()) & kMaxSlotNum;
+}
+
+// Nodes of the cluster and the node of every slot. A single node owns all the slots if
+// --cluster is not set.
+struct Topology {
+  vector<tcp::endpoint> nodes;
+  vector<uint16_t> slot_nodes = vector<uint16_t>(kMaxSlotNum + 1, 0);
+};
+
+// Generates key indices in [min, max] following --key_dist.
+class KeyGenerator {
+ public:
+  KeyGenerator(uint64_t min, uint64_t max) : min_(min), range_(max - min + 1) {
+    string dist = GetFlag(FLAGS_key_dist);
+    if (dist == "Z") {
+      dist_ = ZIPF;
+      InitZipf(GetFlag(FLAGS_zipf_alpha));
+    } else if (dist == "S") {
+      dist_ = SEQUENTIAL;
+    } else {
+      CHECK_EQ(dist, "U") << "Unsupported key distribution";
+    }
+  }
+
+  uint64_t Next(absl::BitGen* gen, uint64_t* seq) const {
+    switch (dist_) {
+      case UNIFORM:
+        return min_ + absl::Uniform(*gen, uint64_t(0), range_);
+      case SEQUENTIAL:
+        return min_ + (*seq)++ % range_;
+      case ZIPF:
+        return min_ + NextZipf(gen);
+    }
+    return min_;
+  }
+
+ private:
+  enum Dist { UNIFORM, SEQUENTIAL, ZIPF };
+
+  static double Zeta(uint64_t n, double theta) {
+    double sum = 0;
+    for (uint64_t i = 1; i <= n; ++i)
+      sum += 1.0 / pow(double(i), theta);
+    return sum;
+  }
+
+  // "Quickly generating billion-record synthetic databases", Gray et al.
+  void InitZipf(double theta) {
+    CHECK(theta > 0 && theta < 1) << "zipf_alpha must be in (0, 1)";
+    theta_ = theta;
+    zetan_ = Zeta(range_, theta);
+    alpha_ = 1.0 / (1.0 - theta);
+    eta_ = (1 - pow(2.0 / range_, 1 - theta)) / (1 - Zeta(2, theta) / zetan_);
+  }
+
+  uint64_t NextZipf(absl::BitGen* gen) const {
+    double u = absl::Uniform(*gen, 0.0, 1.0);
+    double uz = u * zetan_;
+    if (uz < 1.0)
+      return 0;
+    if (uz < 1.0 + pow(0.5, theta_))
+      return 1;
+    return min<uint64_t>(range_ - 1, uint64_t(range_ * pow(eta_ * u - eta_ + 1, alpha_)));
+  }
+
+  Dist dist_ = UNIFORM;
+  uint64_t min_, range_;
+  double theta_ = 0, zetan_ = 0, alpha_ = 0, eta_ = 0;
+};
+
+struct Stats {
+  uint64_t requests = 0;
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t errors = 0;
+  base::Histogram latency_usec;
+
+  void Merge(const Stats& other) {
+    requests += other.requests;
+    hits += other.hits;
+    misses += other.misses;
+    errors += other.errors;
+    latency_usec.Merge(other.latency_usec);
+  }
+};
+
+// Sends requests to the nodes of the topology over a connection to each of them.
+class Driver {
+ public:
+  Driver(const Topology* topology, const KeyGenerator* keys) : topology_(topology), keys_(keys) {
+  }
+
+  error_code Connect();
+
+  // Sends requests until reaching num_reqs or deadline_ns, if it is positive.
+  void Run(uint64_t num_reqs, uint64_t deadline_ns);
+
+  const Stats& stats() const {
+    return stats_;
+  }
+
+ private:
+  struct Request {
+    uint64_t start_ns;
+    bool is_get;
+  };
+
+  struct Conn {
+    unique_ptr<FiberSocketBase> socket;
+    unique_ptr<facade::ReqSerializer> serializer;
+    RedisParser parser{UINT32_MAX, false};
+    base::IoBuf io_buf{4096};
+    deque<Request> inflight;
+    fb2::Fiber receive_fb;
+  };
+
+  void ReceiveReplies(Conn* conn);
+  void OnReply(Conn* conn, const RespVec& reply);
+
+  const Topology* topology_;
+  const KeyGenerator* keys_;
+  vector<unique_ptr<Conn>> conns_;
+  fb2::EventCount inflight_ec_;
+  absl::BitGen gen_;
+  uint64_t seq_ = 0;
+  Stats stats_;
+};
+
+error_code Driver::Connect() {
+  for (const tcp::endpoint& ep : topology_->nodes) {
+    auto conn = make_unique<Conn>();
+    conn->socket.reset(ProactorBase::me()->CreateSocket());
+    if (error_code ec = conn->socket->Connect(ep); ec)
+      return ec;
+
+    conn->serializer = make_unique<facade::ReqSerializer>(conn->socket.get());
+    conns_.push_back(std::move(conn));
+  }
+
+  for (auto& conn : conns_) {
+    conn->receive_fb =
+        fb2::Fiber("bench_recv", [this, conn = conn.get()] { ReceiveReplies(conn); });
+  }
+  return {};
+}
+
+void Driver::Run(uint64_t num_reqs, uint64_t deadline_ns) {
+  const string ratio = GetFlag(FLAGS_ratio);
+  vector<string_view> parts = absl::StrSplit(ratio, ':');
+  uint32_t set_weight = 1, get_weight = 1;
+  CHECK(parts.size() == 2 && absl::SimpleAtoi(parts[0], &set_weight) &&
+        absl::SimpleAtoi(parts[1], &get_weight) && set_weight + get_weight > 0)
+      << "Invalid ratio " << ratio;
+
+  const uint32_t pipeline = max(GetFlag(FLAGS_pipeline), 1u);
+  const string prefix = GetFlag(FLAGS_key_prefix);
+  const string value(GetFlag(FLAGS_d), 'x');
+
+  string cmd;
+  for (uint64_t i = 0;; ++i) {
+    if (deadline_ns ? ProactorBase::GetMonotonicTimeNs() >= deadline_ns : i >= num_reqs)
+      break;
+
+    string key = absl::StrCat(prefix, keys_->Next(&gen_, &seq_));
+    bool is_get = absl::Uniform(gen_, 0u, set_weight + get_weight) >= set_weight;
+    if (is_get) {
+      cmd = absl::StrCat("GET ", key);
+    } else {
+      cmd = absl::StrCat("SET ", key, " ", value);
+    }
+
+    Conn* conn = conns_[topology_->slot_nodes[KeySlot(key)]].get();
+    inflight_ec_.await([&] { return conn->inflight.size() < pipeline; });
+
+    conn->inflight.push_back({ProactorBase::GetMonotonicTimeNs(), is_get});
+    conn->serializer->SendCommand(cmd);
+    if (conn->serializer->ec()) {
+      LOG(ERROR) << "Failed to send a request: " << conn->serializer->ec().message();
+      break;
+    }
+  }
+
+  for (auto& conn : conns_) {
+    inflight_ec_.await([&] { return conn->inflight.empty(); });
+    (void)conn->socket->Shutdown(SHUT_RDWR);
+    conn->receive_fb.JoinIfNeeded();
+    (void)conn->socket->Close();
+  }
+}
+
+void Driver::ReceiveReplies(Conn* conn) {
+  RespVec reply;
+  while (true) {
+    io::Result<size_t> recv_sz = conn->socket->Recv(conn->io_buf.AppendBuffer());
+    if (!recv_sz || *recv_sz == 0)
+      break;
+    conn->io_buf.CommitWrite(*recv_sz);
+
+    RedisParser::Result result = RedisParser::OK;
+    while (conn->io_buf.InputLen() > 0) {
+      uint32_t consumed = 0;
+      result = conn->parser.Parse(conn->io_buf.InputBuffer(), &consumed, &reply);
+      conn->io_buf.ConsumeInput(consumed);
+      if (result != RedisParser::OK)
+        break;
+      OnReply(conn, reply);
+    }
+
+    if (result != RedisParser::OK && result != RedisParser::INPUT_PENDING) {
+      LOG(ERROR) << "Invalid reply, parser status " << result;
+      break;
+    }
+
+    if (conn->io_buf.AppendLen() < 64u)
+      conn->io_buf.EnsureCapacity(conn->io_buf.Capacity() * 2);
+  }
+
+  // Unblocks Run() if the connection broke with requests in flight.
+  stats_.errors += conn->inflight.size();
+  conn->inflight.clear();
+  (void)conn->socket->Shutdown(SHUT_RDWR);
+  inflight_ec_.notifyAll();
+}
+
+void Driver::OnReply(Conn* conn, const RespVec& reply) {
+  CHECK(!conn->inflight.empty()) << "Unexpected reply";
+  Request req = conn->inflight.front();
+  conn->inflight.pop_front();
+
+  stats_.requests++;
+  stats_.latency_usec.Add((ProactorBase::GetMonotonicTimeNs() - req.start_ns) / 1000);
+  if (!reply.empty() && reply.front().type == RespExpr::ERROR) {
+    stats_.errors++;
+  } else if (req.is_get) {
+    bool is_nil = !reply.empty() && reply.front().type == RespExpr::NIL;
+    (is_nil ? stats_.misses : stats_.hits)++;
+  }
+  inflight_ec_.notify();
+}
+
+tcp::endpoint Resolve(const string& host, uint16_t port) {
+  addrinfo hints{}, *servinfo = nullptr;
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  int res = getaddrinfo(host.c_str(), nullptr, &hints, &servinfo);
+  CHECK_EQ(res, 0) << "Failed to resolve " << host << ": " << gai_strerror(res);
+
+  auto* addr = reinterpret_cast<sockaddr_in*>(servinfo->ai_addr);
+  boost::asio::ip::address_v4 ip(ntohl(addr->sin_addr.s_addr));
+  freeaddrinfo(servinfo);
+  return tcp::endpoint{ip, port};
+}
+
+// Reads the slots of the cluster from the node at ep with CLUSTER SLOTS.
+Topology FetchClusterTopology(const tcp::endpoint& ep) {
+  unique_ptr<FiberSocketBase> socket(ProactorBase::me()->CreateSocket());
+  error_code ec = socket->Connect(ep);
+  CHECK(!ec) << "Failed to connect to " << ep << ": " << ec.message();
+
+  facade::ReqSerializer serializer(socket.get());
+  serializer.SendCommand("CLUSTER SLOTS");
+  CHECK(!serializer.ec()) << serializer.ec().message();
+
+  RedisParser parser{UINT32_MAX, false};
+  base::IoBuf io_buf{4096};
+  RespVec reply;
+  RedisParser::Result result = RedisParser::INPUT_PENDING;
+  while (result == RedisParser::INPUT_PENDING) {
+    if (io_buf.AppendLen() < 64u)
+      io_buf.EnsureCapacity(io_buf.Capacity() * 2);
+    io::Result<size_t> recv_sz = socket->Recv(io_buf.AppendBuffer());
+    CHECK(recv_sz && *recv_sz > 0) << "Failed to read CLUSTER SLOTS";
+    io_buf.CommitWrite(*recv_sz);
+
+    uint32_t consumed = 0;
+    result = parser.Parse(io_buf.InputBuffer(), &consumed, &reply);
+    io_buf.ConsumeInput(consumed);
+  }
+  CHECK_EQ(result, RedisParser::OK);
+  CHECK(!reply.empty()) << "The cluster has no slots";
+  CHECK(reply.front().type != RespExpr::ERROR)
+      << "CLUSTER SLOTS failed: " << reply.front().GetString();
+
+  // Every entry is [start slot, end slot, [master ip, master port, ...], replicas...].
+  Topology topology;
+  for (const RespExpr& entry : reply) {
+    CHECK_EQ(entry.type, RespExpr::ARRAY);
+    const RespVec* range = get<RespVec*>(entry.u);
+    CHECK_GE(range->size(), 3u);
+    int64_t start = *(*range)[0].GetInt(), end = *(*range)[1].GetInt();
+    const RespVec& master = *get<RespVec*>((*range)[2].u);
+    tcp::endpoint node = Resolve(master[0].GetString(), *master[1].GetInt());
+
+    auto it = find(topology.nodes.begin(), topology.nodes.end(), node);
+    if (it == topology.nodes.end())
+      it = topology.nodes.insert(it, node);
+
+    for (int64_t slot = start; slot <= end && slot <= kMaxSlotNum; ++slot)
+      topology.slot_nodes[slot] = it - topology.nodes.begin();
+  }
+
+  (void)socket->Close();
+  return topology;
+}
+
+void PrintStats(const Stats& stats, double elapsed_sec) {
+  const auto& hist = stats.latency_usec;
+  cout << "Requests: " << stats.requests << ", " << uint64_t(stats.requests / elapsed_sec)
+       << " per second in " << elapsed_sec << " seconds\n";
+  cout << "GET hits: " << stats.hits << ", misses: " << stats.misses
+       << ", errors: " << stats.errors << "\n";
+  cout << "Latency usec p50: " << hist.Percentile(50) << ", p90: " << hist.Percentile(90)
+       << ", p99: " << hist.Percentile(99) << ", p99.9: " << hist.Percentile(99.9)
+       << ", max: " << hist.Percentile(100) << endl;
+}
+
+}  // namespace
+}  // namespace dfly
+
+using namespace dfly;
+
+int main(int argc, char* argv[]) {
+  MainInitGuard guard(&argc, &argv);
+
+  CHECK_LE(GetFlag(FLAGS_key_minimum), GetFlag(FLAGS_key_maximum));
+
+#ifdef __linux__
+  unique_ptr<ProactorPool> pp(fb2::Pool::IOUring(256));
+#else
+  unique_ptr<ProactorPool> pp(fb2::Pool::Epoll());
+#endif
+  pp->Run();
+
+  Topology topology;
+  topology.nodes.push_back(Resolve(GetFlag(FLAGS_h), GetFlag(FLAGS_p)));
+  if (GetFlag(FLAGS_cluster)) {
+    tcp::endpoint seed = topology.nodes[0];
+    topology = pp->GetNextProactor()->Await([&] { return FetchClusterTopology(seed); });
+    cout << "Running against " << topology.nodes.size() << " cluster nodes" << endl;
+  }
+
+  KeyGenerator keys(GetFlag(FLAGS_key_minimum), GetFlag(FLAGS_key_maximum));
+
+  const uint32_t num_conns = GetFlag(FLAGS_c);
+  const uint64_t test_ns = uint64_t(GetFlag(FLAGS_test_time)) * 1'000'000'000;
+  const uint64_t start_ns = ProactorBase::GetMonotonicTimeNs();
+  const uint64_t deadline_ns = test_ns ? start_ns + test_ns : 0;
+
+  fb2::Mutex mu;
+  Stats total;
+  pp->AwaitFiberOnAll([&](unsigned index, ProactorBase* pb) {
+    vector<unique_ptr<Driver>> drivers;
+    for (uint32_t i = 0; i < num_conns; ++i) {
+      drivers.push_back(make_unique<Driver>(&topology, &keys));
+      error_code ec = drivers.back()->Connect();
+      CHECK(!ec) << "Failed to connect: " << ec.message();
+    }
+
+    vector<fb2::Fiber> fibers;
+    for (auto& driver : drivers) {
+      fibers.emplace_back("bench_driver", [&, driver = driver.get()] {
+        driver->Run(GetFlag(FLAGS_n), deadline_ns);
+      });
+    }
+    for (auto& fb : fibers)
+      fb.Join();
+
+    lock_guard lk(mu);
+    for (const auto& driver : drivers)
+      total.Merge(driver->stats());
+  });
+
+  double elapsed_sec = (ProactorBase::GetMonotonicTimeNs() - start_ns) / 1e9;
+  PrintStats(total, elapsed_sec);
+
+  pp->Stop();
+  return 0;
+}
@@ -57,6 +57,8 @@ ABSL_DECLARE_FLAG(int32_t, port);
 ABSL_DECLARE_FLAG(uint32_t, memcached_port);
 ABSL_DECLARE_FLAG(uint16_t, admin_port);
 ABSL_DECLARE_FLAG(std::string, admin_bind);
+ABSL_DECLARE_FLAG(bool, conn_reuseport);
+ABSL_DECLARE_FLAG(bool, conn_use_incoming_cpu);
 
 ABSL_FLAG(string, bind, "",
           "Bind address. If empty - binds on all interfaces. "
@@ -74,6 +76,9 @@ ABSL_FLAG(bool, version_check, true,
           "If true, Will monitor for new releases on Dragonfly servers once a day.");
 
 ABSL_FLAG(uint16_t, tcp_backlog, 128, "TCP listen(2) backlog parameter.");
+ABSL_FLAG(bool, numa_aware, false,
+          "On machines with multiple NUMA nodes, places new connections on a thread of the node "
+          "of their incoming cpu and lets mimalloc allocate per node.");
 
 using namespace util;
 using namespace facade;
@@ -147,7 +152,7 @@ string NormalizePaths(std::string_view path) {
   return string(path);
 }
 
-bool RunEngine(ProactorPool* pool, AcceptServer* acceptor) {
+bool RunEngine(ProactorPool* pool, AcceptServer* acceptor, const vector<unsigned>& cpu_nodes) {
   uint64_t maxmemory = GetMaxMemoryFlag();
   if (maxmemory > 0 && maxmemory < pool->size() * 256_MB) {
     LOG(ERROR) << "There are " << pool->size() << " threads, so "
@@ -166,6 +171,7 @@ bool RunEngine(ProactorPool* pool, AcceptServer* acceptor) {
   // need to pass it to the AclFamily::Init
   if (!tcp_disabled) {
     main_listener = new Listener{Protocol::REDIS, &service, Listener::Role::MAIN};
+    main_listener->SetCpuNodes(cpu_nodes);
     listeners.push_back(main_listener);
   }
 
@@ -267,10 +273,37 @@ bool RunEngine(ProactorPool* pool, AcceptServer* acceptor) {
     if (port == 0) {
       absl::SetFlag(&FLAGS_port, main_listener->socket()->LocalEndpoint().port());
     }
+
+    // Every other thread accepts on its own socket of the main port.
+    if (GetFlag(FLAGS_conn_reuseport)) {
+      uint16_t bound_port = main_listener->socket()->LocalEndpoint().port();
+      vector<Listener*> group{main_listener};
+      while (group.size() < pool->size()) {
+        auto listener = std::make_unique<Listener>(Protocol::REDIS, &service, Listener::Role::MAIN);
+        listener->SetCpuNodes(cpu_nodes);
+        ec = acceptor->AddListener(bind_addr, bound_port, listener.get());
+        if (ec) {
+          LOG(WARNING) << "Could not open reuseport listener on port " << bound_port
+                       << ", error: " << ec.message();
+          break;
+        }
+        group.push_back(listener.get());
+        listeners.push_back(listener.release());
+      }
+
+      if (group.size() > 1) {
+        for (Listener* listener : group)
+          listener->SetReusePortGroup(true);
+        if (GetFlag(FLAGS_conn_use_incoming_cpu))
+          Listener::SteerReusePortGroup(group);
+      }
+    }
   }
 
   if (mc_port > 0 && !tcp_disabled) {
-    acceptor->AddListener(mc_port, new Listener{Protocol::MEMCACHE, &service});
+    auto* mc_listener = new Listener{Protocol::MEMCACHE, &service};
+    mc_listener->SetCpuNodes(cpu_nodes);
+    acceptor->AddListener(mc_port, mc_listener);
   }
 
   service.Init(acceptor, listeners, opts);
@@ -353,6 +386,40 @@ bool ShouldUseEpollAPI(const base::sys::KernelVersion& kver) {
   return true;
 }
 
+// Returns the NUMA node of every cpu, indexed by cpu. Empty if the machine has a single node or
+// its topology can not be read.
+vector<unsigned> DetectCpuNodes() {
+  vector<unsigned> cpu_nodes;
+  unsigned node = 0;
+  for (;; ++node) {
+    auto cpulist = io::ReadFileToString(StrCat("/sys/devices/system/node/node", node, "/cpulist"));
+    if (!cpulist)
+      break;
+
+    // A comma separated list of cpus and inclusive cpu ranges, for example "0-3,8-11".
+    for (string_view range :
+         absl::StrSplit(absl::StripAsciiWhitespace(*cpulist), ',', absl::SkipEmpty())) {
+      vector<string_view> bounds = absl::StrSplit(range, '-');
+      unsigned first, last;
+      if (bounds.size() > 2 || !absl::SimpleAtoi(bounds.front(), &first) ||
+          !absl::SimpleAtoi(bounds.back(), &last) || last < first) {
+        LOG(WARNING) << "Failed to parse the cpus of NUMA node " << node << ": " << *cpulist;
+        return {};
+      }
+
+      if (cpu_nodes.size() <= last)
+        cpu_nodes.resize(last + 1);
+      fill(cpu_nodes.begin() + first, cpu_nodes.begin() + last + 1, node);
+    }
+  }
+
+  if (node < 2)
+    return {};
+
+  LOG(INFO) << "Detected " << node << " NUMA nodes";
+  return cpu_nodes;
+}
+
 void GetCGroupPath(string* memory_path, string* cpu_path) {
   CHECK(memory_path != nullptr) << "memory_path is null! (this shouldn't happen!)";
   CHECK(cpu_path != nullptr) << "cpu_path is null! (this shouldn't happen!)";
@@ -690,6 +757,17 @@ Usage: dragonfly [FLAGS]
   mi_option_set(mi_option_max_warnings, 0);
   mi_option_set(mi_option_decommit_delay, 1);
 
+  vector<unsigned> cpu_nodes;
+#ifdef __linux__
+  if (GetFlag(FLAGS_numa_aware)) {
+    cpu_nodes = dfly::DetectCpuNodes();
+    if (!cpu_nodes.empty()) {
+      // Lets mimalloc take the memory of each thread from the arenas of its own node.
+      mi_option_set(mi_option_use_numa_nodes, *max_element(cpu_nodes.begin(), cpu_nodes.end()) + 1);
+    }
+  }
+#endif
+
   unique_ptr<util::ProactorPool> pool;
 
 #ifdef __linux__
@@ -715,7 +793,7 @@ Usage: dragonfly [FLAGS]
   AcceptServer acceptor(pool.get());
   acceptor.set_back_log(absl::GetFlag(FLAGS_tcp_backlog));
 
-  int res = dfly::RunEngine(pool.get(), &acceptor) ? 0 : -1;
+  int res = dfly::RunEngine(pool.get(), &acceptor, cpu_nodes) ? 0 : -1;
 
   pool->Stop();
 
@@ -7,6 +7,7 @@
 #include <absl/strings/str_cat.h>
 #include <absl/strings/strip.h>
 
+#include <chrono>
 #include <limits>
 #include <memory>
 #include <optional>
@@ -21,6 +22,7 @@
 #include "facade/dragonfly_listener.h"
 #include "server/engine_shard_set.h"
 #include "server/error.h"
+#include "server/io_utils.h"
 #include "server/journal/journal.h"
 #include "server/journal/streamer.h"
 #include "server/main_service.h"
@@ -31,6 +33,10 @@
 #include "server/transaction.h"
 using namespace std;
 
+ABSL_FLAG(uint32_t, replication_lsn_heartbeat_ms, 100,
+          "Interval of the journal LSN updates sent to replicas in stable sync, "
+          "which they use to estimate their lag. 0 disables them.");
+
 ABSL_DECLARE_FLAG(string, dir);
 
 namespace dfly {
@@ -101,7 +107,8 @@ struct TransactionGuard {
 
 }  // namespace
 
-DflyCmd::DflyCmd(ServerFamily* server_family) : sf_(server_family) {
+DflyCmd::DflyCmd(ServerFamily* server_family)
+    : sf_(server_family), wait_ping_end_(shard_set->size(), 0) {
 }
 
 void DflyCmd::Run(CmdArgList args, ConnectionContext* cntx) {
@@ -117,10 +124,14 @@ void DflyCmd::Run(CmdArgList args, ConnectionContext* cntx) {
     return Thread(args, cntx);
   }
 
-  if (sub_cmd == "FLOW" && (args.size() == 4 || args.size() == 5)) {
+  if (sub_cmd == "FLOW" && args.size() >= 4) {
     return Flow(args, cntx);
   }
 
+  if (sub_cmd == "STRIPE" && args.size() == 5) {
+    return Stripe(args, cntx);
+  }
+
   if (sub_cmd == "SYNC" && args.size() == 2) {
     return Sync(args, cntx);
   }
@@ -180,11 +191,34 @@ void DflyCmd::Flow(CmdArgList args, ConnectionContext* cntx) {
   string_view flow_id_str = ArgS(args, 3);
 
   std::optional<LSN> seqid;
-  if (args.size() == 5) {
+  size_t opt_pos = 4;
+  if (args.size() % 2 == 1) {  // The options come in pairs after the seqid.
     seqid.emplace();
     if (!absl::SimpleAtoi(ArgS(args, 4), &seqid.value())) {
       return rb->SendError(facade::kInvalidIntErr);
     }
+    opt_pos = 5;
+  }
+
+  // [DB <index>]... [PREFIX <prefix>]... select the data that the replica receives.
+  journal::Filter filter;
+  for (; opt_pos < args.size(); opt_pos += 2) {
+    ToUpper(&args[opt_pos]);
+    string_view opt = ArgS(args, opt_pos);
+    if (opt_pos + 1 == args.size())
+      return rb->SendError(kSyntaxErr);
+
+    string_view value = ArgS(args, opt_pos + 1);
+    if (opt == "DB") {
+      DbIndex dbid;
+      if (!absl::SimpleAtoi(value, &dbid))
+        return rb->SendError(facade::kInvalidIntErr);
+      filter.dbs.push_back(dbid);
+    } else if (opt == "PREFIX") {
+      filter.prefixes.emplace_back(value);
+    } else {
+      return rb->SendError(kSyntaxErr);
+    }
   }
 
   VLOG(1) << "Got DFLY FLOW master_id: " << master_id << " sync_id: " << sync_id_str
@@ -207,6 +241,13 @@ void DflyCmd::Flow(CmdArgList args, ConnectionContext* cntx) {
   if (replica_ptr->replica_state != SyncState::PREPARATION)
     return rb->SendError(kInvalidState);
 
+  // A replica can serve replicas of its own only when it is not loading data from its master.
+  if (!ServerState::tlocal()->is_master && sf_->service().GetGlobalState() == GlobalState::LOADING)
+    return rb->SendError("replica is syncing with its master, try again later");
+
+  if (sf_->journal()->command_table() && replica_ptr->version < DflyVersion::VER4)
+    return rb->SendError("replica does not support the compact journal encoding");
+
   // Set meta info on connection.
   cntx->conn()->SetName(absl::StrCat("repl_flow_", sync_id));
   cntx->conn_state.replication_info.repl_session_id = sync_id;
@@ -220,13 +261,28 @@ void DflyCmd::Flow(CmdArgList args, ConnectionContext* cntx) {
   flow.conn = cntx->conn();
   flow.eof_token = eof_token;
   flow.version = replica_ptr->version;
+  flow.filter = std::move(filter);
 
   cntx->conn()->Migrate(shard_set->pool()->at(flow_id));
   sf_->journal()->StartInThread();
 
   std::string_view sync_type = "FULL";
-  if (seqid.has_value()) {
-    if (sf_->journal()->IsLSNInBuffer(*seqid) || sf_->journal()->GetLsn() == *seqid) {
+  if (seqid.has_value() && !flow.filter.Empty()) {
+    // The journal backlog is kept serialized, so its entries can not be filtered.
+    LOG(INFO) << "Partial sync requested with a filter, will perform a full sync of the data.";
+  } else if (seqid.has_value()) {
+    LSN floor = 0;
+    {
+      lock_guard lk(mu_);
+      if (flow_id < partial_sync_floor_.size())
+        floor = partial_sync_floor_[flow_id];
+    }
+
+    if (*seqid < floor) {
+      LOG(INFO) << "Partial sync requested from LSN=" << *seqid
+                << " that precedes the last full sync with our master. Will perform a full sync "
+                   "of the data.";
+    } else if (sf_->journal()->IsLSNInBuffer(*seqid) || sf_->journal()->GetLsn() == *seqid) {
       // This does not guarantee the lsn will still be present when DFLY SYNC runs,
       // replication will be retried if it gets evicted by then.
       flow.start_partial_sync_at = *seqid;
@@ -238,7 +294,7 @@ void DflyCmd::Flow(CmdArgList args, ConnectionContext* cntx) {
                 << " that the replication buffer doesn't contain this anymore (current_lsn="
                 << sf_->journal()->GetLsn() << "). Will perform a full sync of the data.";
       LOG(INFO) << "If this happens often you can control the replication buffer's size with the "
-                   "--shard_repl_backlog_len option";
+                   "--shard_repl_backlog_len option or keep it on disk with --journal_backlog_dir";
     }
   }
 
@@ -247,6 +303,47 @@ void DflyCmd::Flow(CmdArgList args, ConnectionContext* cntx) {
   rb->SendSimpleString(eof_token);
 }
 
+void DflyCmd::Stripe(CmdArgList args, ConnectionContext* cntx) {
+  RedisReplyBuilder* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+  string_view master_id = ArgS(args, 1);
+  string_view sync_id_str = ArgS(args, 2);
+
+  VLOG(1) << "Got DFLY STRIPE " << sync_id_str << " flow: " << ArgS(args, 3)
+          << " index: " << ArgS(args, 4);
+
+  if (master_id != sf_->master_id()) {
+    return rb->SendError(kBadMasterId);
+  }
+
+  unsigned flow_id, index;
+  if (!absl::SimpleAtoi(ArgS(args, 3), &flow_id) || flow_id >= shard_set->size() ||
+      !absl::SimpleAtoi(ArgS(args, 4), &index) || index == 0 ||
+      index >= StripedSink::kMaxStripes) {
+    return rb->SendError(facade::kInvalidIntErr);
+  }
+
+  auto [sync_id, replica_ptr] = GetReplicaInfoOrReply(sync_id_str, rb);
+  if (!sync_id)
+    return;
+
+  unique_lock lk(replica_ptr->mu);
+  if (replica_ptr->replica_state != SyncState::PREPARATION)
+    return rb->SendError(kInvalidState);
+
+  cntx->conn()->SetName(absl::StrCat("repl_stripe_", sync_id));
+  cntx->conn_state.replication_info.repl_session_id = sync_id;
+  cntx->conn_state.replication_info.repl_stripe = true;
+
+  auto& flow = replica_ptr->flows[flow_id];
+  if (flow.stripes.size() < index)
+    flow.stripes.resize(index);
+  flow.stripes[index - 1] = cntx->conn();
+
+  // Written by the full sync fiber of the flow.
+  cntx->conn()->Migrate(shard_set->pool()->at(flow_id));
+  rb->SendOk();
+}
+
 void DflyCmd::Sync(CmdArgList args, ConnectionContext* cntx) {
   RedisReplyBuilder* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
   string_view sync_id_str = ArgS(args, 1);
@@ -308,7 +405,9 @@ void DflyCmd::StartStable(CmdArgList args, ConnectionContext* cntx) {
       FlowInfo* flow = &replica_ptr->flows[shard->shard_id()];
 
       StopFullSyncInThread(flow, shard);
-      status = StartStableSyncInThread(flow, &replica_ptr->cntx, shard);
+      status = StartStableSyncInThread(flow, &replica_ptr->cntx, shard,
+                                       replica_ptr->journal_compression,
+                                       replica_ptr->version >= DflyVersion::VER3);
     };
     shard_set->RunBlockingInParallel(std::move(cb));
 
@@ -339,6 +438,9 @@ void DflyCmd::TakeOver(CmdArgList args, ConnectionContext* cntx) {
   if (auto err = parser.Error(); err)
     return cntx->SendError(err->MakeReply());
 
+  if (!ServerState::tlocal()->is_master)
+    return cntx->SendError("takeover is not supported from a replica");
+
   VLOG(1) << "Got DFLY TAKEOVER " << sync_id_str << " time out:" << timeout;
 
   auto [sync_id, replica_ptr] = GetReplicaInfoOrReply(sync_id_str, rb);
@@ -393,7 +495,7 @@ void DflyCmd::TakeOver(CmdArgList args, ConnectionContext* cntx) {
         if (absl::Now() - start > timeout_dur) {
           LOG(WARNING) << "Couldn't synchronize with replica for takeover in time: "
                        << replica_ptr->address << ":" << replica_ptr->listening_port
-                       << ", last acked: " << flow->last_acked_lsn << ", expecting "
+                       << ", last acked: " << flow->last_acked_lsn.load() << ", expecting "
                        << shard->journal()->GetLsn();
           status = OpStatus::TIMED_OUT;
           return;
@@ -402,7 +504,7 @@ void DflyCmd::TakeOver(CmdArgList args, ConnectionContext* cntx) {
           status = OpStatus::CANCELLED;
           return;
         }
-        VLOG(1) << "Replica lsn:" << flow->last_acked_lsn
+        VLOG(1) << "Replica lsn:" << flow->last_acked_lsn.load()
                 << " master lsn:" << shard->journal()->GetLsn();
         ThisFiber::SleepFor(1ms);
       }
@@ -461,7 +563,21 @@ OpStatus DflyCmd::StartFullSyncInThread(FlowInfo* flow, Context* cntx, EngineSha
   // of the flows also contain them.
   SaveMode save_mode =
       shard->shard_id() == 0 ? SaveMode::SINGLE_SHARD_WITH_SUMMARY : SaveMode::SINGLE_SHARD;
-  flow->saver = std::make_unique<RdbSaver>(flow->conn->socket(), save_mode, false);
+  io::Sink* sink = flow->conn->socket();
+  vector<io::Sink*> stripes{sink};
+  for (facade::Connection* conn : flow->stripes) {
+    if (!conn)
+      break;
+    stripes.push_back(conn->socket());
+  }
+  if (stripes.size() > 1) {
+    flow->striped_sink = std::make_unique<StripedSink>(std::move(stripes));
+    sink = flow->striped_sink.get();
+  }
+  flow->saver = std::make_unique<RdbSaver>(sink, save_mode, false);
+  flow->saver->SetFilter(flow->filter);
+  if (flow->version >= DflyVersion::VER6)
+    flow->saver->SaveNativeEncodings();
 
   flow->cleanup = [flow]() {
     flow->saver->Cancel();
@@ -491,16 +607,23 @@ void DflyCmd::StopFullSyncInThread(FlowInfo* flow, EngineShard* shard) {
   // Wait for full sync to finish.
   flow->full_sync_fb.JoinIfNeeded();
 
-  // Reset cleanup and saver
+  // Reset cleanup and saver, the stripes are not used after the full sync.
   flow->cleanup = []() {};
   flow->saver.reset();
+  flow->striped_sink.reset();
+  flow->stripes.clear();
 }
 
-OpStatus DflyCmd::StartStableSyncInThread(FlowInfo* flow, Context* cntx, EngineShard* shard) {
+OpStatus DflyCmd::StartStableSyncInThread(FlowInfo* flow, Context* cntx, EngineShard* shard,
+                                          bool compress_journal, bool lsn_heartbeats) {
   // Create streamer for shard flows.
 
   if (shard != nullptr) {
-    flow->streamer.reset(new JournalStreamer(sf_->journal(), cntx));
+    uint32_t heartbeat_ms =
+        lsn_heartbeats ? absl::GetFlag(FLAGS_replication_lsn_heartbeat_ms) : 0;
+    flow->streamer.reset(
+        new JournalStreamer(sf_->journal(), cntx, compress_journal, heartbeat_ms));
+    flow->streamer->SetFilter(flow->filter);
     flow->streamer->Start(flow->conn->socket());
   }
 
@@ -535,6 +658,13 @@ void DflyCmd::FullSyncFb(FlowInfo* flow, Context* cntx) {
     return;
   }
 
+  if (flow->striped_sink) {
+    if (ec = flow->striped_sink->Finish(); ec) {
+      cntx->ReportError(ec);
+      return;
+    }
+  }
+
   ec = flow->conn->socket()->Write(io::Buffer(flow->eof_token));
   if (ec) {
     cntx->ReportError(ec);
@@ -578,6 +708,13 @@ void DflyCmd::OnClose(ConnectionContext* cntx) {
   if (!replica_ptr)
     return;
 
+  // The replica closes the stripes once the full sync is over.
+  if (cntx->conn_state.replication_info.repl_stripe) {
+    lock_guard lk(replica_ptr->mu);
+    if (replica_ptr->replica_state == SyncState::STABLE_SYNC)
+      return;
+  }
+
   // Because CancelReplication holds the per-replica mutex,
   // aborting connection will block here until cancellation finishes.
   // This allows keeping resources alive during the cleanup phase.
@@ -647,17 +784,26 @@ std::vector<ReplicaRoleInfo> DflyCmd::GetReplicasRoleInfo() const {
 
     // If the replica state being updated, its lag is undefined,
     // the same applies of course if its state is not STABLE_SYNC.
+    ReplicaRoleInfo role_info{info->address, info->listening_port, "", lag};
     if (info->mu.try_lock()) {
       state = info->replica_state;
       // If the replica is not in stable sync, its lag is undefined, so we set it as max.
       if (state != SyncState::STABLE_SYNC) {
-        lag = std::numeric_limits<LSN>::max();
+        role_info.lsn_lag = std::numeric_limits<LSN>::max();
+      }
+      for (const FlowInfo& flow : info->flows) {
+        if (auto* stats = flow.streamer ? flow.streamer->compression_stats() : nullptr; stats) {
+          role_info.journal_bytes += stats->in_bytes.load(memory_order_relaxed);
+          role_info.journal_compressed_bytes += stats->out_bytes.load(memory_order_relaxed);
+          role_info.journal_compress_usec += stats->compress_usec.load(memory_order_relaxed);
+        }
       }
       info->mu.unlock();
     } else {
-      lag = std::numeric_limits<LSN>::max();
+      role_info.lsn_lag = std::numeric_limits<LSN>::max();
     }
-    vec.push_back(ReplicaRoleInfo{info->address, info->listening_port, SyncStateName(state), lag});
+    role_info.state = SyncStateName(state);
+    vec.push_back(std::move(role_info));
   }
   return vec;
 }
@@ -719,7 +865,8 @@ std::map<uint32_t, LSN> DflyCmd::ReplicationLags() const {
     for (const auto& info : replica_infos_) {
       const ReplicaInfo* replica = info.second.get();
       if (shard->journal()) {
-        int64_t lag = shard->journal()->GetLsn() - replica->flows[shard->shard_id()].last_acked_lsn;
+        int64_t lag =
+            shard->journal()->GetLsn() - replica->flows[shard->shard_id()].last_acked_lsn.load();
         lags[info.first] = lag;
       }
     }
@@ -743,6 +890,15 @@ void DflyCmd::SetDflyClientVersion(ConnectionContext* cntx, DflyVersion version)
   replica_ptr->version = version;
 }
 
+void DflyCmd::SetJournalCompression(ConnectionContext* cntx) {
+  auto replica_ptr = GetReplicaInfo(cntx->conn_state.replication_info.repl_session_id);
+  VLOG(1) << "Journal compression for session_id="
+          << cntx->conn_state.replication_info.repl_session_id;
+
+  lock_guard lk(replica_ptr->mu);
+  replica_ptr->journal_compression = true;
+}
+
 // Must run under locked replica_info.mu.
 bool DflyCmd::CheckReplicaStateOrReply(const ReplicaInfo& repl_info, SyncState expected,
                                        RedisReplyBuilder* rb) {
@@ -763,10 +919,65 @@ bool DflyCmd::CheckReplicaStateOrReply(const ReplicaInfo& repl_info, SyncState e
   return true;
 }
 
+unsigned DflyCmd::WaitForReplicas(unsigned num_replicas, uint64_t timeout_ms) {
+  // Replicas acknowledge a PING as soon as they applied the entries before it.
+  vector<LSN> targets(shard_set->size(), 0);
+  shard_set->RunBlockingInParallel([this, &targets](EngineShard* shard) {
+    journal::Journal* journal = shard->journal();
+    if (!journal)
+      return;
+
+    LSN& ping_end = wait_ping_end_[shard->shard_id()];
+    if (journal->GetLsn() != ping_end) {
+      journal->RecordEntry(0, journal::Op::PING, 0, 0, nullopt, {}, true);
+      ping_end = journal->GetLsn();
+    }
+    targets[shard->shard_id()] = journal->GetLsn();
+  });
+
+  auto count_acked = [&] {
+    unsigned res = 0;
+    lock_guard lk(mu_);
+    for (const auto& [sync_id, replica_ptr] : replica_infos_) {
+      const auto& flows = replica_ptr->flows;
+      bool acked = true;
+      for (size_t i = 0; i < flows.size() && acked; ++i)
+        acked = flows[i].last_acked_lsn.load() >= targets[i];
+      res += acked;
+    }
+    return res;
+  };
+
+  auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout_ms);
+  while (true) {
+    uint64_t acks = acks_received_.load();
+    unsigned acked = count_acked();
+    if (acked >= num_replicas || shutting_down_.load())
+      return acked;
+
+    auto new_ack = [&] { return acks_received_.load() != acks || shutting_down_.load(); };
+    if (timeout_ms == 0) {
+      acks_ec_.await(new_ack);
+    } else {
+      acks_ec_.await_until(new_ack, deadline);
+      if (chrono::steady_clock::now() >= deadline)
+        return count_acked();
+    }
+  }
+}
+
+void DflyCmd::OnReplicaAck() {
+  acks_received_.fetch_add(1);
+  acks_ec_.notifyAll();
+}
+
 void DflyCmd::BreakOnShutdown() {
 }
 
 void DflyCmd::Shutdown() {
+  shutting_down_.store(true);
+  acks_ec_.notifyAll();
+
   ReplicaInfoMap pending;
   {
     std::lock_guard lk(mu_);
@@ -778,11 +989,36 @@ void DflyCmd::Shutdown() {
   }
 }
 
+void DflyCmd::BreakDownstreamReplicas() {
+  // Entries journaled from now on may follow the data loaded from the master, but the previous
+  // ones never do.
+  vector<LSN> floor(shard_set->size());
+  shard_set->RunBriefInParallel([&floor](EngineShard* shard) {
+    if (journal::Journal* journal = shard->journal(); journal)
+      floor[shard->shard_id()] = journal->GetLsn() + 1;
+  });
+
+  ReplicaInfoMap pending;
+  {
+    std::lock_guard lk(mu_);
+    partial_sync_floor_ = std::move(floor);
+    pending = replica_infos_;
+  }
+
+  for (auto [sync_id, replica_ptr] : pending) {
+    CancelReplication(sync_id, replica_ptr);
+  }
+}
+
 void FlowInfo::TryShutdownSocket() {
   // Close socket for clean disconnect.
   if (conn->socket()->IsOpen()) {
     (void)conn->socket()->Shutdown(SHUT_RDWR);
   }
+  for (facade::Connection* stripe : stripes) {
+    if (stripe && stripe->socket()->IsOpen())
+      (void)stripe->socket()->Shutdown(SHUT_RDWR);
+  }
 }
 
 FlowInfo::~FlowInfo() {
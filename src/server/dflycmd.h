@@ -10,6 +10,7 @@
 #include <memory>
 
 #include "server/conn_context.h"
+#include "server/journal/types.h"
 
 namespace facade {
 class RedisReplyBuilder;
@@ -25,6 +26,7 @@ class EngineShardSet;
 class ServerFamily;
 class RdbSaver;
 class JournalStreamer;
+class StripedSink;
 struct ReplicaRoleInfo;
 struct ReplicationMemoryStats;
 
@@ -38,6 +40,11 @@ struct FlowInfo {
 
   facade::Connection* conn = nullptr;
 
+  // The connections after conn that the full sync is striped over, by their index - 1. They are
+  // used only if all the ones before them joined.
+  std::vector<facade::Connection*> stripes;
+  std::unique_ptr<StripedSink> striped_sink;
+
   Fiber full_sync_fb;                         // Full sync fiber.
   std::unique_ptr<RdbSaver> saver;            // Saver for full sync phase.
   std::unique_ptr<JournalStreamer> streamer;  // Streamer for stable sync phase
@@ -46,7 +53,9 @@ struct FlowInfo {
   DflyVersion version = DflyVersion::VER0;
 
   std::optional<LSN> start_partial_sync_at;
-  uint64_t last_acked_lsn = 0;
+  std::atomic_uint64_t last_acked_lsn{0};  // written by the flow connection on ACK.
+
+  journal::Filter filter;  // Of the data the replica receives, see DflyCmd::Flow.
 
   std::function<void()> cleanup;  // Optional cleanup for cancellation.
 };
@@ -117,6 +126,7 @@ class DflyCmd {
     std::string address;
     uint32_t listening_port;
     DflyVersion version = DflyVersion::VER0;
+    bool journal_compression = false;  // negotiated with REPLCONF JOURNAL-COMPRESSION
 
     // Flows describe the state of shard-local flow.
     // They are always indexed by the shard index on the master.
@@ -136,6 +146,11 @@ class DflyCmd {
   // Stop all background processes so we can exit in orderly manner.
   void Shutdown();
 
+  // Disconnects all replicas and refuses their partial sync from the journal written so far.
+  // Called by a replica before it loads a full sync of its own master, which is not journaled,
+  // so that the replicas chained to it sync again.
+  void BreakDownstreamReplicas();
+
   // Create new sync session.
   std::pair<uint32_t, std::shared_ptr<ReplicaInfo>> CreateSyncSession(ConnectionContext* cntx);
 
@@ -146,6 +161,17 @@ class DflyCmd {
   // Sets metadata.
   void SetDflyClientVersion(ConnectionContext* cntx, DflyVersion version);
 
+  // Compresses the stable sync stream of the replica with LZ4.
+  void SetJournalCompression(ConnectionContext* cntx);
+
+  // Waits until num_replicas replicas acknowledge the journal entries written before the call,
+  // or until the timeout passes, 0 waits without a timeout. Returns the number of replicas that
+  // acknowledged them.
+  unsigned WaitForReplicas(unsigned num_replicas, uint64_t timeout_ms);
+
+  // Called when a replica acknowledges journal entries.
+  void OnReplicaAck();
+
  private:
   // JOURNAL [START/STOP]
   // Start or stop journaling.
@@ -162,6 +188,11 @@ class DflyCmd {
   // return error and ask the replica to execute FLOW again.
   void Flow(CmdArgList args, ConnectionContext* cntx);
 
+  // STRIPE <masterid> <syncid> <flowid> <index>
+  // Register connection as stripe index of a flow, the full sync of the flow is striped over
+  // the flow connection and its stripes.
+  void Stripe(CmdArgList args, ConnectionContext* cntx);
+
   // SYNC <syncid>
   // Initiate full sync.
   void Sync(CmdArgList args, ConnectionContext* cntx);
@@ -189,7 +220,8 @@ class DflyCmd {
   void StopFullSyncInThread(FlowInfo* flow, EngineShard* shard);
 
   // Start stable sync in thread. Called for each flow.
-  facade::OpStatus StartStableSyncInThread(FlowInfo* flow, Context* cntx, EngineShard* shard);
+  facade::OpStatus StartStableSyncInThread(FlowInfo* flow, Context* cntx, EngineShard* shard,
+                                           bool compress_journal, bool lsn_heartbeats);
 
   // Fiber that runs full sync for each flow.
   void FullSyncFb(FlowInfo* flow, Context* cntx);
@@ -223,6 +255,17 @@ class DflyCmd {
   using ReplicaInfoMap = absl::btree_map<uint32_t, std::shared_ptr<ReplicaInfo>>;
   ReplicaInfoMap replica_infos_;
 
+  // The lowest LSN of every shard that a replica may resume partial sync from.
+  std::vector<LSN> partial_sync_floor_;
+
+  // The LSN of every shard after the last PING written by WaitForReplicas. Concurrent waits
+  // share a PING if no entries were written after it.
+  std::vector<LSN> wait_ping_end_;
+
+  std::atomic_uint64_t acks_received_{0};
+  std::atomic_bool shutting_down_{false};
+  EventCount acks_ec_;  // notified on replica acks, for WaitForReplicas.
+
   mutable Mutex mu_;  // Guard global operations. See header top for locking levels.
 };
 
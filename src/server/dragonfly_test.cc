@@ -25,6 +25,7 @@ extern "C" {
 ABSL_DECLARE_FLAG(float, mem_defrag_threshold);
 ABSL_DECLARE_FLAG(std::vector<std::string>, rename_command);
 ABSL_DECLARE_FLAG(double, oom_deny_ratio);
+ABSL_DECLARE_FLAG(dfly::DbMemoryQuotasFlag, db_maxmemory);
 
 namespace dfly {
 
@@ -35,6 +36,7 @@ using absl::StrCat;
 using ::io::Result;
 using testing::ElementsAre;
 using testing::HasSubstr;
+using testing::IsEmpty;
 
 namespace {
 
@@ -256,6 +258,24 @@ TEST_F(DflyEngineTest, EvalSha) {
   EXPECT_THAT(resp, "c6459b95a0e81df97af6fdd49b1a9e0287a57363");
 }
 
+TEST_F(DflyEngineTest, ScriptBytecodeShared) {
+  auto resp = Run({"script", "load", "return 7"});
+  ASSERT_THAT(resp, ArgType(RespExpr::STRING));
+  string sha{ToSV(resp.GetBuf())};
+
+  // Other threads load the bytecode compiled by SCRIPT LOAD
+  resp = pp_->at(1)->Await([&] { return Run({"evalsha", sha, "0"}); });
+  EXPECT_THAT(resp, IntArg(7));
+
+  resp = Run({"script", "stats"});
+  ASSERT_THAT(resp, ArrLen(8));
+  const auto& vec = resp.GetVec();
+  EXPECT_THAT(vec[0], "compiled_scripts");
+  EXPECT_THAT(vec[1], IntArg(1));
+  EXPECT_THAT(vec[4], "loaded_scripts");
+  EXPECT_THAT(vec[5], IntArg(1));
+}
+
 TEST_F(DflyEngineTest, Hello) {
   auto resp = Run({"hello"});
   ASSERT_THAT(resp, ArrLen(14));
@@ -322,6 +342,50 @@ TEST_F(DflyEngineTest, Memcache) {
   EXPECT_THAT(resp, ElementsAre("END"));
 }
 
+TEST_F(DflyEngineTest, MemcacheMeta) {
+  auto resp = RunMCLine("ms key 3 F5 T100", "bar");
+  EXPECT_THAT(resp, ElementsAre("HD"));
+
+  resp = RunMCLine("mg key v f k s Oop1");
+  EXPECT_THAT(resp, ElementsAre("VA 3 f5 s3 kkey Oop1", "bar"));
+
+  resp = RunMCLine("mg key");
+  EXPECT_THAT(resp, ElementsAre("HD"));
+
+  resp = RunMCLine("mg unkn v");
+  EXPECT_THAT(resp, ElementsAre("EN"));
+
+  resp = RunMCLine("mg unkn v q");
+  EXPECT_THAT(resp, IsEmpty());
+
+  resp = RunMCLine("ms key 3 ME", "baz");
+  EXPECT_THAT(resp, ElementsAre("NS"));
+
+  resp = RunMCLine("ms key 4 MA q", "val2");
+  EXPECT_THAT(resp, IsEmpty());
+
+  resp = RunMCLine("ms num 1", "5");
+  EXPECT_THAT(resp, ElementsAre("HD"));
+
+  resp = RunMCLine("ma num D10 v");
+  EXPECT_THAT(resp, ElementsAre("VA 2", "15"));
+
+  resp = RunMCLine("ma num MD");
+  EXPECT_THAT(resp, ElementsAre("HD"));
+
+  resp = RunMCLine("ma unkn");
+  EXPECT_THAT(resp, ElementsAre("NF"));
+
+  resp = RunMCLine("md key Oop2");
+  EXPECT_THAT(resp, ElementsAre("HD Oop2"));
+
+  resp = RunMCLine("md key");
+  EXPECT_THAT(resp, ElementsAre("NF"));
+
+  resp = RunMCLine("mn");
+  EXPECT_THAT(resp, ElementsAre("MN"));
+}
+
 TEST_F(DflyEngineTest, LimitMemory) {
   mi_option_enable(mi_option_limit_os_alloc);
   string blob(128, 'a');
@@ -459,6 +523,49 @@ TEST_F(DflyEngineTest, StickyEviction) {
   }
 }
 
+TEST_F(DflyEngineTest, DbMemoryQuota) {
+  max_memory_limit = 100'000'000;
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_db_maxmemory, DbMemoryQuotasFlag{{{1, 1'000'000}}});
+
+  string val(100, '.');
+  Run({"select", "1"});
+  RespExpr resp;
+  for (size_t i = 0; i < 50000; ++i) {
+    resp = Run({"set", StrCat("key", i), val});
+    if (resp != "OK")
+      break;
+  }
+  EXPECT_THAT(resp, ErrArg("Out of mem"));
+
+  // The other databases are not affected by the quota of db 1.
+  Run({"select", "0"});
+  for (size_t i = 0; i < 50000; ++i) {
+    ASSERT_EQ(Run({"set", StrCat("key", i), val}), "OK");
+  }
+}
+
+TEST_F(DflyEngineTest, DbMemoryQuotaCacheMode) {
+  max_memory_limit = 100'000'000;
+  shard_set->TEST_EnableHeartBeat();
+  shard_set->TEST_EnableCacheMode();
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_db_maxmemory, DbMemoryQuotasFlag{{{1, 1'000'000}}});
+
+  string val(100, '.');
+  Run({"select", "1"});
+  for (size_t i = 0; i < 50000; ++i) {
+    ASSERT_EQ(Run({"set", StrCat("key", i), val}), "OK");
+  }
+  EXPECT_LT(CheckedInt({"dbsize"}), 50000);
+
+  Run({"select", "0"});
+  for (size_t i = 0; i < 20000; ++i) {
+    ASSERT_EQ(Run({"set", StrCat("key", i), val}), "OK");
+  }
+  EXPECT_EQ(CheckedInt({"dbsize"}), 20000);
+}
+
 TEST_F(DflyEngineTest, PSubscribe) {
   single_response_ = false;
   auto resp = pp_->at(1)->Await([&] { return Run({"psubscribe", "a*", "b*"}); });
@@ -474,6 +581,80 @@ TEST_F(DflyEngineTest, PSubscribe) {
   EXPECT_EQ("foo", msg.Message());
   EXPECT_EQ("ab", msg.Channel());
   EXPECT_EQ("a*", msg.pattern);
+  ASSERT_TRUE(msg.serialized);
+  EXPECT_EQ("4\r\n$8\r\npmessage\r\n$2\r\na*\r\n$2\r\nab\r\n$3\r\nfoo\r\n", *msg.serialized);
+}
+
+TEST_F(DflyEngineTest, PSubscribeManyPatterns) {
+  single_response_ = false;
+  pp_->at(1)->Await(
+      [&] { return Run({"psubscribe", "a*", "ab*", "b?", "*c", "abc", "abcd", "a[bx]c"}); });
+
+  auto resp = pp_->at(0)->Await([&] { return Run({"publish", "abc", "foo"}); });
+  EXPECT_THAT(resp, IntArg(5));  // a*, ab*, *c, abc, a[bx]c
+  resp = pp_->at(0)->Await([&] { return Run({"publish", "bx", "foo"}); });
+  EXPECT_THAT(resp, IntArg(1));
+
+  pp_->at(1)->Await([&] { return Run({"punsubscribe", "a*", "*c"}); });
+  resp = pp_->at(0)->Await([&] { return Run({"publish", "abc", "foo"}); });
+  EXPECT_THAT(resp, IntArg(3));
+}
+
+TEST_F(DflyEngineTest, KeyspaceNotifications) {
+  single_response_ = false;
+  shard_set->TEST_EnableHeartBeat();
+  EXPECT_EQ(Run({"config", "set", "notify_keyspace_events", "KEg$"}), "OK");
+
+  pp_->at(1)->Await([&] { return Run({"subscribe", "__keyevent@0__:set"}); });
+  pp_->at(1)->Await([&] { return Run({"psubscribe", "__keyspace@0__:user:*"}); });
+  pp_->at(0)->Await([&] {
+    Run({"set", "user:1", "a"});
+    Run({"set", "other", "b"});
+    return Run({"del", "user:1", "other"});
+  });
+
+  // The notifications are published by the heartbeat.
+  ThisFiber::SleepFor(100ms);
+  pp_->AwaitFiberOnAll([](ProactorBase* pb) {});
+
+  ASSERT_EQ(4, SubscriberMessagesLen("IO1"));
+  vector<pair<string, string>> messages;
+  for (size_t i = 0; i < 4; ++i) {
+    const auto& msg = GetPublishedMessage("IO1", i);
+    messages.emplace_back(msg.Channel(), msg.Message());
+  }
+  EXPECT_THAT(messages,
+              testing::UnorderedElementsAre(pair{"__keyevent@0__:set"s, "user:1"s},
+                                            pair{"__keyevent@0__:set"s, "other"s},
+                                            pair{"__keyspace@0__:user:1"s, "set"s},
+                                            pair{"__keyspace@0__:user:1"s, "del"s}));
+
+  EXPECT_EQ(Run({"config", "set", "notify_keyspace_events", ""}), "OK");
+}
+
+TEST_F(DflyEngineTest, SSubscribe) {
+  single_response_ = false;
+  auto resp = pp_->at(1)->Await([&] { return Run({"ssubscribe", "ch"}); });
+  EXPECT_THAT(resp.GetVec(), ElementsAre("ssubscribe", "ch", IntArg(1)));
+
+  // Sharded channels are a separate namespace
+  resp = pp_->at(0)->Await([&] { return Run({"publish", "ch", "foo"}); });
+  EXPECT_THAT(resp, IntArg(0));
+  resp = pp_->at(0)->Await([&] { return Run({"spublish", "ch", "bar"}); });
+  EXPECT_THAT(resp, IntArg(1));
+  EXPECT_THAT(pp_->at(0)->Await([&] { return Run({"pubsub", "shardnumsub", "ch"}); }),
+              RespArray(ElementsAre("ch", IntArg(1))));
+
+  pp_->AwaitFiberOnAll([](ProactorBase* pb) {});
+
+  ASSERT_EQ(1, SubscriberMessagesLen("IO1"));
+  const auto& msg = GetPublishedMessage("IO1", 0);
+  EXPECT_EQ("bar", msg.Message());
+  ASSERT_TRUE(msg.serialized);
+  EXPECT_EQ("3\r\n$8\r\nsmessage\r\n$2\r\nch\r\n$3\r\nbar\r\n", *msg.serialized);
+
+  resp = pp_->at(1)->Await([&] { return Run({"sunsubscribe"}); });
+  EXPECT_THAT(resp.GetVec(), ElementsAre("sunsubscribe", "ch", IntArg(0)));
 }
 
 TEST_F(DflyEngineTest, Unsubscribe) {
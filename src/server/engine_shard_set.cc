@@ -5,6 +5,7 @@
 #include "server/engine_shard_set.h"
 
 #include <absl/strings/match.h>
+#include <absl/strings/str_split.h>
 
 extern "C" {
 #include "redis/object.h"
@@ -18,6 +19,9 @@ extern "C" {
 #include "base/logging.h"
 #include "io/proc_reader.h"
 #include "server/blocking_controller.h"
+#include "server/channel_store.h"
+#include "server/rdb_load.h"
+#include "server/rdb_save.h"
 #include "server/search/doc_index.h"
 #include "server/server_state.h"
 #include "server/tiered_storage.h"
@@ -30,8 +34,10 @@ using namespace std;
 ABSL_FLAG(string, tiered_prefix, "",
           "Experimental flag. Enables tiered storage if set. "
           "The string denotes the path and prefix of the files "
-          " associated with tiered storage. Stronly advised to use "
-          "high performance NVME ssd disks for this.");
+          "associated with tiered storage. Stronly advised to use "
+          "high performance NVME ssd disks for this. A comma separated list of prefixes "
+          "on different devices spreads the shards across them, proportionally to the "
+          "capacity of their filesystems.");
 
 ABSL_FLAG(dfly::MemoryBytesFlag, tiered_max_file_size, dfly::MemoryBytesFlag{},
           "Limit on maximum file size that is used by the database for tiered storage. "
@@ -57,12 +63,70 @@ ABSL_FLAG(float, mem_defrag_page_utilization_threshold, 0.8,
           "memory page under utilization threshold. Ratio between used and committed size, below "
           "this, memory in this page will defragmented");
 
+ABSL_FLAG(bool, table_huge_page_arena, false,
+          "If true, dashtable segments are packed into 2MB pages that are backed by transparent "
+          "huge pages, reducing TLB misses on large keyspaces.");
+
+ABSL_FLAG(float, table_merge_threshold, 0,
+          "Merge sibling dashtable segments during heartbeat when their combined utilization "
+          "is below this ratio, in order to release memory after mass deletions. Values above "
+          "0.5 are lowered to 0.5, so that a merged segment does not split right away. "
+          "0 disables merging.");
+
+ABSL_FLAG(bool, key_prefix_compression, false,
+          "If true, the shards learn the prefixes shared by many keys and store the keys with a "
+          "known prefix as a reference to it plus an inline suffix, without allocating them.");
+
+ABSL_FLAG(uint32_t, compress_cold_values_min_size, 0,
+          "If positive, string values of at least this size that were not accessed for a while "
+          "are compressed with LZ4 in the background, and decompressed back once they become "
+          "hot again. 0 disables the compression.");
+
+ABSL_FLAG(uint32_t, shared_strings_min_size, 0,
+          "If positive, the string values of at least this size set by SET share a single "
+          "immutable copy with the other values of the shard that have the same content. "
+          "0 disables the sharing.");
+
+ABSL_FLAG(float, listpack_shrink_ratio, 0.5,
+          "Hashes and sorted sets that outgrew their listpack encoding are converted back to "
+          "listpacks in the background once they shrink to this share of the listpack limits. "
+          "Capped at 0.9, so that values near a limit do not convert back and forth. "
+          "0 disables the conversion.");
+
+ABSL_FLAG(uint32_t, big_keys_scan_buckets, 16,
+          "Number of logical buckets of every database that each shard visits in a heartbeat to "
+          "refresh the largest keys and the value size histograms of MEMORY BIGKEYS. 0 disables "
+          "the scan, the largest keys are then only tracked as they are written.");
+
+ABSL_FLAG(dfly::MemoryBytesFlag, tiered_offload_containers_min_size, dfly::MemoryBytesFlag{},
+          "If positive and tiered storage is enabled, hashes, sets and sorted sets that use at "
+          "least this much memory and were not accessed for a while are offloaded to disk in "
+          "the background. They are loaded back on access. 0 disables the offloading.");
+
+ABSL_FLAG(float, tiered_compaction_threshold, 0,
+          "If positive, tiered values are moved in the background out of the pages of the "
+          "backing file whose share of used space is at most this ratio, so that these pages "
+          "are reused. 0 disables the compaction.");
+
+ABSL_FLAG(float, hnsw_compaction_threshold, 0.2,
+          "Rebuild hnsw vector indices in the background once deleted points make up more than "
+          "this ratio of their nodes. 0 disables the compaction.");
+
+ABSL_FLAG(dfly::MemoryBytesFlag, tiered_search_vector_memory, dfly::MemoryBytesFlag{},
+          "If positive and tiered storage is enabled, every flat vector index keeps at most this "
+          "much of its vectors in memory on each shard. The least recently used blocks of vectors "
+          "are moved to the backing file and loaded back when searches use them.");
+
 ABSL_FLAG(string, shard_round_robin_prefix, "",
           "When non-empty, keys which start with this prefix are not distributed across shards "
           "based on their value but instead via round-robin. Use cautiously! This can efficiently "
           "support up to a few hundreds of prefixes. Note: prefix is looked inside hash tags when "
           "cluster mode is enabled.");
 
+ABSL_FLAG(uint32_t, shard_load_window_sec, 60,
+          "The load of the shards reported by the metrics is sampled over the last one to two "
+          "windows of this many seconds");
+
 namespace dfly {
 
 using namespace util;
@@ -170,9 +234,7 @@ bool HasContendedLocks(unsigned shard_id, Transaction* trx, const DbTable* table
 
   if (trx->IsMulti()) {
     trx->IterateMultiLocks(shard_id, [&](const string& key) {
-      auto it = table->trans_locks.find(key);
-      DCHECK(it != table->trans_locks.end());
-      if (it->second.IsContended()) {
+      if (table->trans_locks.Find(key).IsContended()) {
         has_contended_locks = true;
       }
     });
@@ -180,13 +242,9 @@ bool HasContendedLocks(unsigned shard_id, Transaction* trx, const DbTable* table
     KeyLockArgs lock_args = trx->GetLockArgs(shard_id);
     for (size_t i = 0; i < lock_args.args.size(); i += lock_args.key_step) {
       string_view s = KeyLockArgs::GetLockKey(lock_args.args[i]);
-      auto it = table->trans_locks.find(s);
-      DCHECK(it != table->trans_locks.end());
-      if (it != table->trans_locks.end()) {
-        if (it->second.IsContended()) {
-          has_contended_locks = true;
-          break;
-        }
+      if (table->trans_locks.Find(s).IsContended()) {
+        has_contended_locks = true;
+        break;
       }
     }
   }
@@ -208,13 +266,14 @@ EngineShardSet* shard_set = nullptr;
 uint64_t TEST_current_time_ms = 0;
 
 EngineShard::Stats& EngineShard::Stats::operator+=(const EngineShard::Stats& o) {
-  static_assert(sizeof(Stats) == 40);
+  static_assert(sizeof(Stats) == 48);
 
   defrag_attempt_total += o.defrag_attempt_total;
   defrag_realloc_total += o.defrag_realloc_total;
   defrag_task_invocation_total += o.defrag_task_invocation_total;
   poll_execution_total += o.poll_execution_total;
   tx_ooo_total += o.tx_ooo_total;
+  high_priority_hop_total += o.high_priority_hop_total;
 
   return *this;
 }
@@ -293,9 +352,15 @@ bool EngineShard::DoDefrag() {
   uint64_t reallocations = 0;
   unsigned traverses_count = 0;
   uint64_t attempts = 0;
+  string tmp;
 
   do {
     cur = prime_table->Traverse(cur, [&](PrimeIterator it) {
+      // Strings of locked keys may be referenced by borrowed replies, they must stay in place.
+      if (it->second.ObjType() == OBJ_STRING &&
+          !slice.CheckLock(IntentLock::EXCLUSIVE, defrag_state_.dbid, it->first.GetSlice(&tmp)))
+        return;
+
       // for each value check whether we should move it because it
       // seats on underutilized page of memory, and if so, do it.
       bool did = it->second.DefragIfNeeded(threshold);
@@ -354,11 +419,19 @@ EngineShard::EngineShard(util::ProactorBase* pb, mi_heap_t* heap)
     : queue_(kQueueLen),
       txq_([](const Transaction* t) { return t->txid(); }),
       mi_resource_(heap),
+      table_arena_(GetFlag(FLAGS_table_huge_page_arena)
+                       ? new SegmentArena(&mi_resource_, {PrimeTable::kSegBytes,
+                                                          ExpireTable::kSegBytes})
+                       : nullptr),
       db_slice_(pb->GetPoolIndex(), GetFlag(FLAGS_cache_mode), this) {
   fiber_q_ = MakeFiber([this, index = pb->GetPoolIndex()] {
     ThisFiber::SetName(absl::StrCat("shard_queue", index));
     queue_.Run();
   });
+  fiber_high_q_ = MakeFiber([this, index = pb->GetPoolIndex()] {
+    ThisFiber::SetName(absl::StrCat("shard_high_queue", index));
+    RunHighPriorityLane();
+  });
 
   tmp_str1 = sdsempty();
 
@@ -372,6 +445,10 @@ EngineShard::~EngineShard() {
 }
 
 void EngineShard::Shutdown() {
+  high_hops_done_.store(true, memory_order_relaxed);
+  high_hops_ec_.notify();
+  fiber_high_q_.Join();
+
   queue_.Shutdown();
   fiber_q_.Join();
 
@@ -387,6 +464,58 @@ void EngineShard::Shutdown() {
   ProactorBase::me()->RemoveOnIdleTask(defrag_task_);
 }
 
+void EngineShard::AddHighPriorityHop(std::function<void()> hop) {
+  {
+    absl::base_internal::SpinLockHolder lk{&high_hops_mu_};
+    high_hops_.push_back(std::move(hop));
+  }
+  has_high_hops_.store(true, memory_order_release);
+  high_hops_ec_.notify();
+}
+
+void EngineShard::RunHighPriorityHops() {
+  if (!has_high_hops_.load(memory_order_acquire))
+    return;
+
+  for (const auto& hop : TakeHighPriorityHops())
+    hop();
+}
+
+vector<function<void()>> EngineShard::TakeHighPriorityHops() {
+  vector<function<void()>> hops;
+  {
+    absl::base_internal::SpinLockHolder lk{&high_hops_mu_};
+    hops.swap(high_hops_);
+    has_high_hops_.store(false, memory_order_relaxed);
+  }
+  stats_.high_priority_hop_total += hops.size();
+  return hops;
+}
+
+void EngineShard::RunHighPriorityLane() {
+  while (true) {
+    high_hops_ec_.await([this] {
+      return has_high_hops_.load(memory_order_acquire) ||
+             high_hops_done_.load(memory_order_relaxed);
+    });
+    if (high_hops_done_.load(memory_order_relaxed))
+      return;
+
+    // Outside of the shard queue fiber the hops must not interleave with preempting journal
+    // callbacks, like with inline scheduling. Otherwise they run in order with the queue.
+    auto hops = TakeHighPriorityHops();
+    if (ServerState::tlocal()->AllowInlineScheduling()) {
+      for (const auto& hop : hops)
+        hop();
+    } else {
+      queue_.Add([hops = std::move(hops)] {
+        for (const auto& hop : hops)
+          hop();
+      });
+    }
+  }
+}
+
 void EngineShard::StartPeriodicFiber(util::ProactorBase* pb) {
   uint32_t clock_cycle_ms = 1000 / std::max<uint32_t>(1, GetFlag(FLAGS_hz));
   if (clock_cycle_ms == 0)
@@ -398,7 +527,8 @@ void EngineShard::StartPeriodicFiber(util::ProactorBase* pb) {
   });
 }
 
-void EngineShard::InitThreadLocal(ProactorBase* pb, bool update_db_time, size_t max_file_size) {
+void EngineShard::InitThreadLocal(ProactorBase* pb, bool update_db_time, size_t max_file_size,
+                                  const string& backing_prefix) {
   CHECK(shard_ == nullptr) << pb->GetPoolIndex();
 
   mi_heap_t* data_heap = ServerState::tlocal()->data_heap();
@@ -406,9 +536,10 @@ void EngineShard::InitThreadLocal(ProactorBase* pb, bool update_db_time, size_t
   shard_ = new (ptr) EngineShard(pb, data_heap);
 
   CompactObj::InitThreadLocal(shard_->memory_resource());
+  CompactObj::EnableKeyPrefixes(GetFlag(FLAGS_key_prefix_compression));
+  CompactObj::EnableSharedStrings(GetFlag(FLAGS_shared_strings_min_size));
   SmallString::InitThreadLocal(data_heap);
 
-  string backing_prefix = GetFlag(FLAGS_tiered_prefix);
   if (!backing_prefix.empty()) {
     if (pb->GetKind() != ProactorBase::IOURING) {
       LOG(ERROR) << "Only ioring based backing storage is supported. Exiting...";
@@ -418,6 +549,17 @@ void EngineShard::InitThreadLocal(ProactorBase* pb, bool update_db_time, size_t
     shard_->tiered_storage_.reset(new TieredStorage(&shard_->db_slice_, max_file_size));
     error_code ec = shard_->tiered_storage_->Open(backing_prefix);
     CHECK(!ec) << ec.message();  // TODO
+
+    if (GetFlag(FLAGS_tiered_offload_containers_min_size).value > 0) {
+      TieredStorage::ContainerCodec codec;
+      codec.serialize = [](const PrimeValue& pv) {
+        io::StringSink sink;
+        SerializerBase::DumpObject(pv, &sink);
+        return sink.str();
+      };
+      codec.parse = [](string_view blob, PrimeValue* pv) { return RdbValueLoader{}.Load(blob, pv); };
+      shard_->tiered_storage_->SetContainerCodec(std::move(codec));
+    }
   }
 
   RoundRobinSharder::Init();
@@ -443,6 +585,8 @@ void EngineShard::DestroyThreadLocal() {
   mi_free(shard_);
   shard_ = nullptr;
   CompactObj::InitThreadLocal(nullptr);
+  CompactObj::EnableKeyPrefixes(false);
+  CompactObj::EnableSharedStrings(0);
   mi_heap_delete(tlh);
   RoundRobinSharder::Destroy();
   VLOG(1) << "Shard reset " << index;
@@ -593,8 +737,145 @@ void EngineShard::RemoveContTx(Transaction* tx) {
   }
 }
 
+void EngineShard::LoadStats::Merge(const LoadStats& other) {
+  txq_len.Merge(other.txq_len);
+  cont_wait_usec.Merge(other.cont_wait_usec);
+  hop_latency_usec.Merge(other.hop_latency_usec);
+}
+
+auto EngineShard::GetLoadStats() const -> LoadStats {
+  LoadStats res = load_stats_[0];
+  res.Merge(load_stats_[1]);
+  return res;
+}
+
+void EngineShard::PublishKeyspaceNotifications() {
+  vector<DbSlice::KeyspaceNotification> events = db_slice_.TakeKeyspaceNotifications();
+  const ChannelStore* cs = ServerState::tlocal()->channel_store();
+  if (events.empty() || cs->Empty())
+    return;
+
+  const KeyspaceEventsFlag& flag = db_slice_.keyspace_events();
+  vector<pair<string, string>> messages;
+  messages.reserve(events.size() * (flag.keyspace + flag.keyevent));
+  for (auto& ev : events) {
+    string_view name = ev.event == KEYSPACE_EVENT_DEL   ? "del"sv
+                       : ev.event == KEYSPACE_EVENT_SET ? "set"sv
+                                                        : "expired"sv;
+    if (flag.keyspace)
+      messages.emplace_back(absl::StrCat("__keyspace@", ev.db_index, "__:", ev.key), name);
+    if (flag.keyevent)
+      messages.emplace_back(absl::StrCat("__keyevent@", ev.db_index, "__:", name),
+                            std::move(ev.key));
+  }
+  cs->SendMessages(messages);
+}
+
+void EngineShard::SampleLoad(uint64_t now_ms) {
+  uint64_t window_ms = uint64_t(GetFlag(FLAGS_shard_load_window_sec)) * 1000;
+  if (now_ms >= load_window_start_ms_ + window_ms) {
+    load_stats_[1] = std::move(load_stats_[0]);
+    load_stats_[0] = LoadStats{};
+    load_window_start_ms_ = now_ms;
+  }
+
+  LoadStats& stats = load_stats_[0];
+  stats.txq_len.Add(txq_.size());
+
+  // A continuation transaction blocks the queue until it concludes.
+  if (continuation_trans_) {
+    if (continuation_trans_->txid() != sampled_cont_txid_) {
+      sampled_cont_txid_ = continuation_trans_->txid();
+      sampled_cont_since_ms_ = now_ms;
+    }
+    stats.cont_wait_usec.Add((now_ms - sampled_cont_since_ms_) * 1000);
+  }
+}
+
 void EngineShard::Heartbeat() {
   CacheStats();
+  SampleLoad(GetCurrentTimeMs());
+  db_slice_.SampleSlotRates(GetCurrentTimeMs());
+  db_slice_.RotateHotKeysWindow(GetCurrentTimeMs());
+
+  // Number of segments per table that are checked for merging in each heartbeat.
+  constexpr unsigned kMergeSegmentsPerStep = 4;
+  if (float merge_threshold = GetFlag(FLAGS_table_merge_threshold); merge_threshold > 0) {
+    for (unsigned i = 0; i < db_slice_.db_array_size(); ++i) {
+      db_slice_.MergeSegmentsStep(i, kMergeSegmentsPerStep, merge_threshold);
+    }
+  }
+
+  // Number of logical buckets per database that are visited by the compression pass in each
+  // heartbeat.
+  constexpr unsigned kCompressBucketsPerStep = 32;
+  if (uint32_t min_size = GetFlag(FLAGS_compress_cold_values_min_size); min_size > 0) {
+    for (unsigned i = 0; i < db_slice_.db_array_size(); ++i) {
+      db_slice_.CompressColdValuesStep(i, kCompressBucketsPerStep, min_size);
+    }
+  }
+
+  // Number of logical buckets per database that are visited by the listpack conversion pass in
+  // each heartbeat.
+  constexpr unsigned kShrinkBucketsPerStep = 32;
+  if (float ratio = GetFlag(FLAGS_listpack_shrink_ratio); ratio > 0) {
+    for (unsigned i = 0; i < db_slice_.db_array_size(); ++i) {
+      db_slice_.ShrinkEncodingsStep(i, kShrinkBucketsPerStep, min(ratio, 0.9f));
+    }
+  }
+
+  if (uint32_t buckets = GetFlag(FLAGS_big_keys_scan_buckets); buckets > 0) {
+    for (unsigned i = 0; i < db_slice_.db_array_size(); ++i) {
+      db_slice_.ScanBigKeysStep(i, buckets);
+    }
+  }
+
+  // Number of logical buckets per database that are visited by the offloading pass in each
+  // heartbeat.
+  constexpr unsigned kOffloadBucketsPerStep = 32;
+  if (size_t min_size = GetFlag(FLAGS_tiered_offload_containers_min_size).value; min_size > 0) {
+    for (unsigned i = 0; i < db_slice_.db_array_size(); ++i) {
+      db_slice_.OffloadColdContainersStep(i, kOffloadBucketsPerStep, min_size);
+    }
+  }
+
+  if (TieredStorage* tiered = tiered_storage(); tiered) {
+    // Number of logical buckets visited and of strings offloaded by the cold values sweep in
+    // each heartbeat.
+    constexpr unsigned kOffloadColdBucketsPerStep = 32;
+    constexpr unsigned kOffloadColdPerStep = 16;
+    if (tiered->OffloadsColdValues()) {
+      for (unsigned i = 0; i < db_slice_.db_array_size(); ++i) {
+        db_slice_.OffloadColdValuesStep(i, kOffloadColdBucketsPerStep, kOffloadColdPerStep);
+      }
+    }
+
+    // Number of logical buckets visited and of values moved by the compaction in each heartbeat.
+    constexpr unsigned kCompactBucketsPerStep = 32;
+    constexpr unsigned kCompactMovesPerStep = 16;
+    if (float threshold = GetFlag(FLAGS_tiered_compaction_threshold); threshold > 0) {
+      db_slice_.CompactTieredStep(kCompactBucketsPerStep, kCompactMovesPerStep, threshold);
+    }
+    tiered->ReleaseFreeSpace();
+  }
+
+  // Time spent freeing the elements of large deleted values in each heartbeat.
+  constexpr uint64_t kLazyFreeUsecPerStep = 1000;
+  db_slice_.LazyFreeStep(kLazyFreeUsecPerStep);
+
+  // Number of points inserted into the new graph of each compacted hnsw index in each heartbeat.
+  constexpr unsigned kHnswCompactPointsPerStep = 32;
+  if (float threshold = GetFlag(FLAGS_hnsw_compaction_threshold); threshold > 0) {
+    search_indices()->CompactVectorIndicesStep(threshold, kHnswCompactPointsPerStep);
+  }
+
+  // Number of blocks of each flat vector index written to the backing file in each heartbeat.
+  constexpr unsigned kVectorSpillBlocksPerStep = 4;
+  if (size_t max_bytes = GetFlag(FLAGS_tiered_search_vector_memory).value;
+      max_bytes > 0 && tiered_storage_ && tiered_storage_->CanOffloadWithoutWait()) {
+    search_indices()->SpillVectorIndicesStep(tiered_storage_.get(), max_bytes,
+                                             kVectorSpillBlocksPerStep);
+  }
 
   if (IsReplica())  // Never run expiration on replica.
     return;
@@ -602,11 +883,21 @@ void EngineShard::Heartbeat() {
   constexpr double kTtlDeleteLimit = 200;
   constexpr double kRedLimitFactor = 0.1;
 
+  // Number of member buckets per database visited by the expiry of hash and set members.
+  constexpr unsigned kFieldExpiryBucketsPerStep = 64;
+
+  // Number of streams per database trimmed to their retention by the background trimming.
+  constexpr unsigned kTrimStreamsPerStep = 16;
+
+  // Maximal number of due keys per database deleted by the expiry wheel.
+  constexpr unsigned kDueExpiredPerStep = 1000;
+
   uint32_t traversed = GetMovingSum6(TTL_TRAVERSE);
   uint32_t deleted = GetMovingSum6(TTL_DELETE);
   unsigned ttl_delete_target = 5;
 
-  if (deleted > 10) {
+  // With the expiry wheel the counters mostly reflect the due keys, sampling stays a fallback.
+  if (deleted > 10 && !db_slice_.IsExpiryWheelEnabled()) {
     // deleted should be <= traversed.
     // hence we map our delete/traversed ratio into a range [0, kTtlDeleteLimit).
     // The higher t
@@ -622,6 +913,15 @@ void EngineShard::Heartbeat() {
       continue;
 
     db_cntx.db_index = i;
+    if (db_slice_.IsExpiryWheelEnabled()) {
+      DbSlice::DeleteExpiredStats stats =
+          db_slice_.DeleteDueExpiredStep(db_cntx, kDueExpiredPerStep);
+
+      counter_[TTL_TRAVERSE].IncBy(stats.traversed);
+      counter_[TTL_DELETE].IncBy(stats.deleted);
+    }
+
+    // Sampling still catches the keys that were not scheduled, eg. loaded while being a replica.
     auto [pt, expt] = db_slice_.GetTables(i);
     if (expt->size() > pt->size() / 4) {
       DbSlice::DeleteExpiredStats stats = db_slice_.DeleteExpiredStep(db_cntx, ttl_delete_target);
@@ -630,12 +930,21 @@ void EngineShard::Heartbeat() {
       counter_[TTL_DELETE].IncBy(stats.deleted);
     }
 
-    // if our budget is below the limit
-    if (db_slice_.memory_budget() < redline) {
-      db_slice_.FreeMemWithEvictionStep(i, redline - db_slice_.memory_budget());
+    db_slice_.DeleteExpiredFieldsStep(db_cntx, kFieldExpiryBucketsPerStep);
+    db_slice_.TrimStreamsStep(i, kTrimStreamsPerStep);
+
+    // if our budget is below the limit, or the database is over its own quota
+    ssize_t goal = max(redline - db_slice_.memory_budget(),
+                       -db_slice_.GetDBTable(i)->QuotaBudget());
+    if (goal > 0) {
+      db_slice_.FreeMemWithEvictionStep(i, goal);
     }
   }
 
+  // Expired and evicted keys are not deleted by a transaction callback.
+  db_slice_.FlushTrackingPrefixes();
+  PublishKeyspaceNotifications();
+
   // Journal entries for expired entries are not writen to socket in the loop above.
   // Trigger write to socket when loop finishes.
   if (auto journal = EngineShard::tlocal()->journal(); journal) {
@@ -664,6 +973,7 @@ void EngineShard::RunPeriodic(std::chrono::milliseconds period_ms) {
         const auto& stats = EngineShardSet::GetCachedStats();
         for (const auto& s : stats)
           sum += s.used_memory.load(memory_order_relaxed);
+        sum += used_mem_lua.load(memory_order_relaxed);
 
         used_mem_current.store(sum, memory_order_relaxed);
 
@@ -776,15 +1086,15 @@ auto EngineShard::AnalyzeTxQueue() const -> TxQueueInfo {
       continue;
 
     info.total_locks += table->trans_locks.size();
-    for (const auto& k_v : table->trans_locks) {
-      if (k_v.second.IsContended()) {
+    table->trans_locks.ForEachLocked([&](unsigned stripe, const IntentLock& lock) {
+      if (lock.IsContended()) {
         info.contended_locks++;
-        if (k_v.second.ContentionScore() > info.max_contention_score) {
-          info.max_contention_score = k_v.second.ContentionScore();
-          info.max_contention_lock_name = k_v.first;
+        if (lock.ContentionScore() > info.max_contention_score) {
+          info.max_contention_score = lock.ContentionScore();
+          info.max_contention_lock_name = absl::StrCat("stripe", stripe);
         }
       }
-    }
+    });
   }
 
   return info;
@@ -802,8 +1112,8 @@ auto EngineShard::AnalyzeTxQueue() const -> TxQueueInfo {
 
  */
 
-uint64_t GetFsLimit() {
-  std::filesystem::path file_path(GetFlag(FLAGS_tiered_prefix));
+uint64_t GetFsLimit(const string& prefix) {
+  std::filesystem::path file_path(prefix);
   std::string dir_name_str = file_path.parent_path().string();
 
   struct statvfs stat;
@@ -819,28 +1129,65 @@ void EngineShardSet::Init(uint32_t sz, bool update_db_time) {
   CHECK_EQ(0u, size());
   cached_stats.resize(sz);
   shard_queue_.resize(sz);
+  shards_.resize(sz);
+
+  vector<string> prefixes =
+      absl::StrSplit(GetFlag(FLAGS_tiered_prefix), ',', absl::SkipWhitespace());
+
+  // The backing file prefix and the maximal file size of every shard.
+  vector<string> shard_prefix(sz);
+  vector<size_t> shard_file_size(sz, 0);
+  if (!prefixes.empty()) {
+    vector<uint64_t> fs_limit(prefixes.size());
+    uint64_t total_limit = 0;
+    for (size_t i = 0; i < prefixes.size(); ++i) {
+      fs_limit[i] = GetFsLimit(prefixes[i]);
+      total_limit += fs_limit[i];
+    }
 
-  string file_prefix = GetFlag(FLAGS_tiered_prefix);
-  size_t max_shard_file_size = 0;
-  if (!file_prefix.empty()) {
     size_t max_file_size = absl::GetFlag(FLAGS_tiered_max_file_size).value;
-    size_t max_file_size_limit = GetFsLimit();
     if (max_file_size == 0) {
       LOG(INFO) << "max_file_size has not been specified. Deciding myself....";
-      max_file_size = (max_file_size_limit * 0.8);
+      max_file_size = (total_limit * 0.8);
     } else {
-      if (max_file_size_limit < max_file_size) {
+      if (total_limit < max_file_size) {
         LOG(WARNING) << "Got max file size " << HumanReadableNumBytes(max_file_size)
-                     << ", however only " << HumanReadableNumBytes(max_file_size_limit)
+                     << ", however only " << HumanReadableNumBytes(total_limit)
                      << " disk space was found.";
       }
     }
-    max_shard_file_size = max_file_size / shard_queue_.size();
-    if (max_shard_file_size < 256_MB) {
-      LOG(ERROR) << "Max tiering file size is too small. Setting: "
-                 << HumanReadableNumBytes(max_file_size) << " Required at least "
-                 << HumanReadableNumBytes(256_MB * shard_queue_.size()) << ". Exiting..";
-      exit(1);
+
+    // Every shard goes to the device with the least shards relative to its capacity, so equal
+    // devices get the shards round robin.
+    vector<unsigned> device_shards(prefixes.size(), 0);
+    vector<unsigned> shard_device(sz);
+    for (uint32_t sid = 0; sid < sz; ++sid) {
+      size_t best = 0;
+      for (size_t i = 1; i < prefixes.size(); ++i) {
+        if ((device_shards[i] + 1) * fs_limit[best] < (device_shards[best] + 1) * fs_limit[i])
+          best = i;
+      }
+      shard_device[sid] = best;
+      ++device_shards[best];
+    }
+
+    for (uint32_t sid = 0; sid < sz; ++sid) {
+      unsigned device = shard_device[sid];
+      double weight = total_limit ? double(fs_limit[device]) / total_limit : 1.0 / prefixes.size();
+      shard_prefix[sid] = prefixes[device];
+      shard_file_size[sid] = max_file_size * weight / device_shards[device];
+      if (shard_file_size[sid] < 256_MB) {
+        LOG(ERROR) << "Max tiering file size is too small. Setting: "
+                   << HumanReadableNumBytes(shard_file_size[sid]) << " for shard " << sid
+                   << " on " << prefixes[device] << ", required at least "
+                   << HumanReadableNumBytes(256_MB) << ". Exiting..";
+        exit(1);
+      }
+    }
+
+    for (size_t i = 0; i < prefixes.size(); ++i) {
+      LOG_IF(WARNING, device_shards[i] == 0) << "No shards are placed on " << prefixes[i];
+      VLOG(1) << prefixes[i] << " holds " << device_shards[i] << " shards";
     }
     is_tiering_enabled_ = true;
     LOG(INFO) << "Max file size is: " << HumanReadableNumBytes(max_file_size);
@@ -848,7 +1195,7 @@ void EngineShardSet::Init(uint32_t sz, bool update_db_time) {
 
   pp_->AwaitFiberOnAll([&](uint32_t index, ProactorBase* pb) {
     if (index < shard_queue_.size()) {
-      InitThreadLocal(pb, update_db_time, max_shard_file_size);
+      InitThreadLocal(pb, update_db_time, shard_file_size[index], shard_prefix[index]);
     }
   });
 }
@@ -857,10 +1204,12 @@ void EngineShardSet::Shutdown() {
   RunBlockingInParallel([](EngineShard*) { EngineShard::DestroyThreadLocal(); });
 }
 
-void EngineShardSet::InitThreadLocal(ProactorBase* pb, bool update_db_time, size_t max_file_size) {
-  EngineShard::InitThreadLocal(pb, update_db_time, max_file_size);
+void EngineShardSet::InitThreadLocal(ProactorBase* pb, bool update_db_time, size_t max_file_size,
+                                     const string& backing_prefix) {
+  EngineShard::InitThreadLocal(pb, update_db_time, max_file_size, backing_prefix);
   EngineShard* es = EngineShard::tlocal();
   shard_queue_[es->shard_id()] = es->GetFiberQueue();
+  shards_[es->shard_id()] = es;
 }
 
 const vector<EngineShardSet::CachedStats>& EngineShardSet::GetCachedStats() {
@@ -8,10 +8,16 @@ extern "C" {
 #include "redis/sds.h"
 }
 
+#include <absl/base/internal/spinlock.h>
 #include <absl/container/btree_map.h>
 #include <absl/container/flat_hash_map.h>
 #include <xxhash.h>
 
+#include <array>
+#include <atomic>
+#include <functional>
+
+#include "base/histogram.h"
 #include "base/string_view_sso.h"
 #include "util/proactor_pool.h"
 #include "util/sliding_counter.h"
@@ -20,6 +26,7 @@ extern "C" {
 #include "core/external_alloc.h"
 #include "core/fibers.h"
 #include "core/mi_memory_resource.h"
+#include "core/segment_arena.h"
 #include "core/tx_queue.h"
 #include "server/cluster/cluster_config.h"
 #include "server/db_slice.h"
@@ -42,6 +49,7 @@ class EngineShard {
     uint64_t defrag_task_invocation_total = 0;
     uint64_t poll_execution_total = 0;
     uint64_t tx_ooo_total = 0;
+    uint64_t high_priority_hop_total = 0;
     Stats& operator+=(const Stats&);
   };
 
@@ -50,7 +58,9 @@ class EngineShard {
 
   // Sets up a new EngineShard in the thread.
   // If update_db_time is true, initializes periodic time update for its db_slice.
-  static void InitThreadLocal(util::ProactorBase* pb, bool update_db_time, size_t max_file_size);
+  // Tiered storage is enabled when backing_prefix is not empty.
+  static void InitThreadLocal(util::ProactorBase* pb, bool update_db_time, size_t max_file_size,
+                              const std::string& backing_prefix);
 
   static void DestroyThreadLocal();
 
@@ -74,10 +84,33 @@ class EngineShard {
     return &mi_resource_;
   }
 
+  // The same resource, for moving the accounting of blobs handed to other shards.
+  MiMemoryResource* mi_resource() {
+    return &mi_resource_;
+  }
+
+  // Memory resource for the dash tables of the db slice. Packs segments into huge pages
+  // if --table_huge_page_arena is set.
+  PMR_NS::memory_resource* table_memory_resource() {
+    return table_arena_ ? static_cast<PMR_NS::memory_resource*>(table_arena_.get()) : &mi_resource_;
+  }
+
+  // nullptr if the segment arena is disabled.
+  const SegmentArena* table_arena() const {
+    return table_arena_.get();
+  }
+
   FiberQueue* GetFiberQueue() {
     return &queue_;
   }
 
+  // Runs the hop ahead of the hops waiting in the shard queue. Thread safe.
+  void AddHighPriorityHop(std::function<void()> hop);
+
+  // Runs the pending high priority hops. Called by the hops of the shard queue before they run,
+  // so that a backlog of the queue does not delay the high priority hops.
+  void RunHighPriorityHops();
+
   // Processes TxQueue, blocked transactions or any other execution state related to that
   // shard. Tries executing the passed transaction if possible (does not guarantee though).
   void PollExecution(const char* context, Transaction* trans);
@@ -181,6 +214,22 @@ class EngineShard {
 
   TxQueueInfo AnalyzeTxQueue() const;
 
+  // Samples of the load of the shard, kept over the last one to two --shard_load_window_sec.
+  struct LoadStats {
+    base::Histogram txq_len;           // sampled every heartbeat
+    base::Histogram cont_wait_usec;    // age of the continuation tx, sampled every heartbeat
+    base::Histogram hop_latency_usec;  // from submitting the sampled hops until they start
+
+    void Merge(const LoadStats& other);
+  };
+
+  LoadStats GetLoadStats() const;
+
+  // Records the latency of a sampled hop from its submission by the coordinator.
+  void RecordHopLatency(uint64_t usec) {
+    load_stats_[0].hop_latency_usec.Add(usec);
+  }
+
  private:
   struct DefragTaskState {
     size_t dbid = 0u;
@@ -206,6 +255,12 @@ class EngineShard {
   void Heartbeat();
   void RunPeriodic(std::chrono::milliseconds period_ms);
 
+  // Publishes the keyspace notifications queued by the db slice since the last heartbeat.
+  void PublishKeyspaceNotifications();
+
+  // Samples the transaction queue and rotates the load stats window.
+  void SampleLoad(uint64_t now_ms);
+
   void CacheStats();
 
   // We are running a task that checks whether we need to
@@ -225,11 +280,26 @@ class EngineShard {
   // return true if we did not complete the shard scan
   bool DoDefrag();
 
+  // Runs the high priority hops while the shard queue is idle.
+  void RunHighPriorityLane();
+  std::vector<std::function<void()>> TakeHighPriorityHops();
+
   FiberQueue queue_;
   Fiber fiber_q_;
 
+  // The high priority hops, run by the hops of the shard queue or by fiber_high_q_.
+  absl::base_internal::SpinLock high_hops_mu_;
+  std::vector<std::function<void()>> high_hops_;  // guarded by high_hops_mu_
+  std::atomic_bool has_high_hops_{false};
+  std::atomic_bool high_hops_done_{false};
+  EventCount high_hops_ec_;
+  Fiber fiber_high_q_;
+
   TxQueue txq_;
   MiMemoryResource mi_resource_;
+
+  // Must be declared before db_slice_ because it outlives the tables.
+  std::unique_ptr<SegmentArena> table_arena_;
   DbSlice db_slice_;
 
   Stats stats_;
@@ -241,6 +311,12 @@ class EngineShard {
   TxId committed_txid_ = 0;
   Transaction* continuation_trans_ = nullptr;
   journal::Journal* journal_ = nullptr;
+
+  // The current and the previous window of the load stats.
+  std::array<LoadStats, 2> load_stats_;
+  uint64_t load_window_start_ms_ = 0;
+  TxId sampled_cont_txid_ = 0;          // the continuation tx seen by the last sample
+  uint64_t sampled_cont_since_ms_ = 0;  // when it was first seen
   IntentLock shard_lock_;
 
   uint32_t defrag_task_ = 0;
@@ -301,6 +377,13 @@ class EngineShardSet {
     return shard_queue_[sid]->Add(std::forward<F>(f));
   }
 
+  // Dispatches a hop of a high priority transaction ahead of the shard queue, it does not wait
+  // behind the backlog of the queue. See EngineShard::AddHighPriorityHop.
+  void AddHighPriority(ShardId sid, std::function<void()> hop) {
+    assert(sid < shards_.size());
+    shards_[sid]->AddHighPriorityHop(std::move(hop));
+  }
+
   // Runs a brief function on all shards. Waits for it to complete.
   // `func` must not preempt.
   template <typename U> void RunBriefInParallel(U&& func) const {
@@ -339,10 +422,12 @@ class EngineShardSet {
   void TEST_EnableCacheMode();
 
  private:
-  void InitThreadLocal(util::ProactorBase* pb, bool update_db_time, size_t max_file_size);
+  void InitThreadLocal(util::ProactorBase* pb, bool update_db_time, size_t max_file_size,
+                       const std::string& backing_prefix);
 
   util::ProactorPool* pp_;
   std::vector<FiberQueue*> shard_queue_;
+  std::vector<EngineShard*> shards_;
   bool is_tiering_enabled_ = false;
 };
 
@@ -0,0 +1,94 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/expiry_wheel.h"
+
+#include <algorithm>
+
+namespace dfly {
+
+using namespace std;
+
+void ExpiryWheel::Add(string_view key, uint64_t at_ms, uint64_t now_ms) {
+  if (!levels_) {
+    levels_ = make_unique<array<Level, kLevels>>();
+    current_sec_ = max(current_sec_, now_ms / 1000 + 1);
+  }
+
+  // Rounded up so that the key is due when the wheel processes its second.
+  Place(Entry{string(key), (at_ms + 999) / 1000});
+  ++size_;
+}
+
+unsigned ExpiryWheel::Advance(uint64_t now_ms, unsigned limit,
+                              absl::FunctionRef<void(string_view)> cb) {
+  if (!levels_)
+    return 0;
+
+  Tick(now_ms / 1000);
+
+  unsigned res = 0;
+  while (res < limit && !due_.empty()) {
+    string key = std::move(due_.back());
+    due_.pop_back();
+    --size_;
+    cb(key);
+    ++res;
+  }
+  return res;
+}
+
+void ExpiryWheel::Clear() {
+  levels_.reset();
+  due_.clear();
+  size_ = 0;
+}
+
+void ExpiryWheel::Place(Entry entry) {
+  if (entry.at_sec < current_sec_) {
+    due_.push_back(std::move(entry.key));
+    return;
+  }
+
+  // The lowest level at which the deadline shares the slot of the upper level with the
+  // current second.
+  unsigned level = 0;
+  while (level + 1 < kLevels && (entry.at_sec >> (kSlotBits * (level + 1))) !=
+                                    (current_sec_ >> (kSlotBits * (level + 1)))) {
+    ++level;
+  }
+
+  unsigned slot = (entry.at_sec >> (kSlotBits * level)) % kSlots;
+  (*levels_)[level][slot].push_back(std::move(entry));
+}
+
+void ExpiryWheel::Tick(uint64_t now_sec) {
+  while (current_sec_ <= now_sec) {
+    if (size_ == due_.size()) {  // nothing is scheduled, skip the idle seconds.
+      current_sec_ = now_sec + 1;
+      return;
+    }
+
+    // Cascade the upper level slots that start at this second, the highest level first
+    // because it may fill the slots of the lower levels that start now as well.
+    for (unsigned level = kLevels - 1; level > 0; --level) {
+      if (current_sec_ % (uint64_t(1) << (kSlotBits * level)) != 0)
+        continue;
+
+      unsigned slot = (current_sec_ >> (kSlotBits * level)) % kSlots;
+      vector<Entry> entries = std::move((*levels_)[level][slot]);
+      (*levels_)[level][slot].clear();
+      for (Entry& entry : entries)
+        Place(std::move(entry));
+    }
+
+    auto& slot = (*levels_)[0][current_sec_ % kSlots];
+    ++current_sec_;
+    for (Entry& entry : slot)
+      due_.push_back(std::move(entry.key));
+    slot.clear();
+  }
+}
+
+}  // namespace dfly
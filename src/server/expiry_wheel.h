@@ -0,0 +1,72 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/functional/function_ref.h>
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace dfly {
+
+// ExpiryWheel is a hierarchical timing wheel of key expiry deadlines with a resolution of a
+// second. It lets the heartbeat find exactly the keys that are due instead of sampling the
+// expire table.
+//
+// Notes:
+// - Entries are hints: the caller checks that a due key still exists and still expires before
+//   deleting it, so keys that are deleted, persisted or get a new deadline need no removal.
+//   A key whose deadline changed is just added again.
+// - There are 4 levels of 256 slots, level i slot spans 256^i seconds. Entries move to lower
+//   levels when the wheel reaches their slot, so every entry is moved at most 3 times.
+// - The wheel keeps a copy of every key, the slots are allocated on the first Add.
+class ExpiryWheel {
+ public:
+  // Adds key that expires at at_ms. now_ms is used to place the first entries of the wheel.
+  void Add(std::string_view key, uint64_t at_ms, uint64_t now_ms);
+
+  // Advances the wheel to now_ms and calls cb for at most limit keys whose deadline passed.
+  // The other due keys are kept for the next call. Returns the number of calls to cb.
+  unsigned Advance(uint64_t now_ms, unsigned limit, absl::FunctionRef<void(std::string_view)> cb);
+
+  // Number of entries, including the due ones.
+  size_t size() const {
+    return size_;
+  }
+
+  size_t due_size() const {
+    return due_.size();
+  }
+
+  void Clear();
+
+ private:
+  static constexpr unsigned kLevels = 4;
+  static constexpr unsigned kSlotBits = 8;
+  static constexpr unsigned kSlots = 1 << kSlotBits;
+
+  struct Entry {
+    std::string key;
+    uint64_t at_sec;
+  };
+
+  using Level = std::array<std::vector<Entry>, kSlots>;
+
+  void Place(Entry entry);
+
+  // Processes all the seconds up to and including now_sec.
+  void Tick(uint64_t now_sec);
+
+  std::unique_ptr<std::array<Level, kLevels>> levels_;
+  std::vector<std::string> due_;
+  uint64_t current_sec_ = 0;  // the next second to process, entries before it are due.
+  size_t size_ = 0;
+};
+
+}  // namespace dfly
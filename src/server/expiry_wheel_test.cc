@@ -0,0 +1,90 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/expiry_wheel.h"
+
+#include <absl/container/flat_hash_set.h>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+class ExpiryWheelTest : public ::testing::Test {
+ protected:
+  vector<string> Advance(uint64_t now_ms, unsigned limit = 1000) {
+    vector<string> res;
+    wheel_.Advance(now_ms, limit, [&](string_view key) { res.emplace_back(key); });
+    return res;
+  }
+
+  ExpiryWheel wheel_;
+};
+
+TEST_F(ExpiryWheelTest, Basic) {
+  const uint64_t now = 1'000'000'000;
+  EXPECT_TRUE(Advance(now).empty());
+
+  wheel_.Add("a", now + 1500, now);
+  wheel_.Add("b", now + 3000, now);
+  wheel_.Add("c", now - 10, now);  // already expired
+  EXPECT_EQ(wheel_.size(), 3u);
+
+  EXPECT_EQ(Advance(now), vector<string>{"c"});
+  EXPECT_TRUE(Advance(now + 1000).empty());
+  EXPECT_EQ(Advance(now + 2000), vector<string>{"a"});
+  EXPECT_TRUE(Advance(now + 2999).empty());
+  EXPECT_EQ(Advance(now + 3000), vector<string>{"b"});
+  EXPECT_EQ(wheel_.size(), 0u);
+}
+
+TEST_F(ExpiryWheelTest, Limit) {
+  const uint64_t now = 5'000'000;
+  for (unsigned i = 0; i < 10; ++i)
+    wheel_.Add(absl::StrCat("k", i), now + 100, now);
+
+  EXPECT_EQ(Advance(now + 1000, 4).size(), 4u);
+  EXPECT_EQ(wheel_.size(), 6u);
+  EXPECT_EQ(wheel_.due_size(), 6u);
+  EXPECT_EQ(Advance(now + 1000, 4).size(), 4u);
+  EXPECT_EQ(Advance(now + 1000, 4).size(), 2u);
+  EXPECT_EQ(wheel_.size(), 0u);
+}
+
+TEST_F(ExpiryWheelTest, Cascade) {
+  // Deadlines spread over all the levels, none of them is returned early or lost.
+  const uint64_t start = 1'700'000'123'000;
+  vector<uint64_t> deadlines;
+  for (uint64_t delta = 1; delta < (1ull << 25); delta = delta * 3 + 7)
+    deadlines.push_back(start + delta * 1000);
+
+  for (size_t i = 0; i < deadlines.size(); ++i)
+    wheel_.Add(absl::StrCat(i), deadlines[i], start);
+
+  absl::flat_hash_set<string> seen;
+  uint64_t now = start;
+  for (size_t i = 0; i < deadlines.size(); ++i) {
+    // Jump right before the deadline and then past it.
+    uint64_t before = deadlines[i] - 1000;
+    if (before > now) {
+      now = before;
+      EXPECT_TRUE(Advance(now).empty()) << i;
+    }
+    now = deadlines[i];
+    EXPECT_EQ(Advance(now), vector<string>{absl::StrCat(i)});
+    EXPECT_TRUE(seen.insert(absl::StrCat(i)).second);
+  }
+  EXPECT_EQ(wheel_.size(), 0u);
+}
+
+TEST_F(ExpiryWheelTest, Clear) {
+  wheel_.Add("a", 5000, 1000);
+  wheel_.Clear();
+  EXPECT_EQ(wheel_.size(), 0u);
+  EXPECT_TRUE(Advance(10000).empty());
+}
+
+}  // namespace dfly
@@ -0,0 +1,74 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/frequency_sketch.h"
+
+#include <absl/numeric/bits.h>
+
+#include <algorithm>
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+// Odd multipliers that spread the hash differently for each row.
+constexpr uint64_t kRowSeeds[] = {0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL,
+                                  0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL};
+
+constexpr unsigned kResetFactor = 10;
+
+}  // namespace
+
+FrequencySketch::FrequencySketch(uint32_t width)
+    : width_(width == 0 ? 0 : absl::bit_ceil(max(width, kCountersPerWord))) {
+}
+
+pair<uint32_t, unsigned> FrequencySketch::Position(uint64_t hash, unsigned row) const {
+  uint64_t h = hash * kRowSeeds[row];
+  h ^= h >> 32;
+  uint32_t index = row * width_ + (h & (width_ - 1));
+  return {index / kCountersPerWord, (index % kCountersPerWord) * 4};
+}
+
+void FrequencySketch::Increment(uint64_t hash) {
+  if (!IsEnabled())
+    return;
+
+  if (table_.empty())
+    table_.resize(size_t(width_) * kDepth / kCountersPerWord);
+
+  unsigned estimate = Estimate(hash);
+  if (estimate < 15) {
+    for (unsigned row = 0; row < kDepth; ++row) {
+      auto [word, shift] = Position(hash, row);
+      if (((table_[word] >> shift) & 0xf) == estimate)
+        table_[word] += uint64_t(1) << shift;
+    }
+  }
+
+  if (++additions_ >= uint64_t(kResetFactor) * width_)
+    Halve();
+}
+
+unsigned FrequencySketch::Estimate(uint64_t hash) const {
+  if (table_.empty())
+    return 0;
+
+  unsigned res = 15;
+  for (unsigned row = 0; row < kDepth; ++row) {
+    auto [word, shift] = Position(hash, row);
+    res = min<unsigned>(res, (table_[word] >> shift) & 0xf);
+  }
+  return res;
+}
+
+void FrequencySketch::Halve() {
+  for (uint64_t& word : table_)
+    word = (word >> 1) & 0x7777777777777777ULL;
+  additions_ /= 2;
+}
+
+}  // namespace dfly
@@ -0,0 +1,55 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace dfly {
+
+// FrequencySketch estimates how often keys were accessed recently, as the TinyLFU frequency
+// filter does. It is a count-min sketch of 4 rows of 4-bit counters indexed by the key hash.
+//
+// Notes:
+// - Counters saturate at 15 and all of them are halved after 10 * width increments, so the
+//   estimates follow changes of the workload instead of growing forever.
+// - Increments are conservative: only the counters equal to the current estimate are increased,
+//   which reduces the overestimation caused by collisions.
+// - The table is allocated on the first increment, so an unused sketch costs no memory.
+class FrequencySketch {
+ public:
+  // width is the number of counters per row, rounded up to a power of 2. 0 disables the sketch.
+  explicit FrequencySketch(uint32_t width);
+
+  void Increment(uint64_t hash);
+
+  // Returns the estimated access frequency in the range [0, 15].
+  unsigned Estimate(uint64_t hash) const;
+
+  bool IsEnabled() const {
+    return width_ > 0;
+  }
+
+  size_t MallocUsed() const {
+    return table_.capacity() * sizeof(uint64_t);
+  }
+
+ private:
+  static constexpr unsigned kDepth = 4;
+  static constexpr unsigned kCountersPerWord = 16;
+
+  // Position of the counter of hash in the row: word index and bit offset in the word.
+  std::pair<uint32_t, unsigned> Position(uint64_t hash, unsigned row) const;
+
+  void Halve();
+
+  uint32_t width_;
+  uint64_t additions_ = 0;
+  std::vector<uint64_t> table_;  // kDepth rows of width_ counters each
+};
+
+}  // namespace dfly
@@ -0,0 +1,50 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/frequency_sketch.h"
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+namespace dfly {
+
+TEST(FrequencySketchTest, Basic) {
+  FrequencySketch sketch(1024);
+  EXPECT_EQ(sketch.Estimate(1), 0u);
+  EXPECT_EQ(sketch.MallocUsed(), 0u);
+
+  for (unsigned i = 0; i < 5; ++i)
+    sketch.Increment(1);
+  sketch.Increment(2);
+
+  EXPECT_EQ(sketch.Estimate(1), 5u);
+  EXPECT_EQ(sketch.Estimate(2), 1u);
+  EXPECT_GT(sketch.MallocUsed(), 0u);
+
+  // Counters saturate
+  for (unsigned i = 0; i < 100; ++i)
+    sketch.Increment(1);
+  EXPECT_EQ(sketch.Estimate(1), 15u);
+}
+
+TEST(FrequencySketchTest, Aging) {
+  FrequencySketch sketch(16);
+  for (unsigned i = 0; i < 8; ++i)
+    sketch.Increment(7);
+  EXPECT_EQ(sketch.Estimate(7), 8u);
+
+  // 10 * width increments halve all the counters
+  for (unsigned i = 8; i < 160; ++i)
+    sketch.Increment(1000 + i);
+  EXPECT_LE(sketch.Estimate(7), 4u);
+}
+
+TEST(FrequencySketchTest, Disabled) {
+  FrequencySketch sketch(0);
+  sketch.Increment(1);
+  EXPECT_EQ(sketch.Estimate(1), 0u);
+  EXPECT_EQ(sketch.MallocUsed(), 0u);
+}
+
+}  // namespace dfly
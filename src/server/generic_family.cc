@@ -4,6 +4,16 @@
 
 #include "server/generic_family.h"
 
+#include <absl/base/casts.h>
+#include <absl/cleanup/cleanup.h>
+#include <absl/container/flat_hash_map.h>
+#include <absl/container/inlined_vector.h>
+#include <absl/functional/bind_front.h>
+
+#include <array>
+#include <cmath>
+#include <deque>
+
 extern "C" {
 #include "redis/crc64.h"
 #include "redis/object.h"
@@ -27,10 +37,17 @@ extern "C" {
 #include "server/rdb_save.h"
 #include "server/set_family.h"
 #include "server/transaction.h"
+#include "util/fibers/synchronization.h"
 #include "util/varz.h"
 
 ABSL_FLAG(uint32_t, dbnum, 16, "Number of databases");
 ABSL_FLAG(uint32_t, keys_output_limit, 8192, "Maximum number of keys output by keys command");
+ABSL_FLAG(bool, scan_parallel, false,
+          "If true, SCAN and KEYS traverse all the shards concurrently. SCAN cursors then refer "
+          "to scan positions that are kept by the server for a limited number of scans.");
+ABSL_FLAG(uint32_t, scan_snapshot_ttl, 10,
+          "Seconds after which the cursor of a SCAN SNAPSHOT that is not continued expires. The "
+          "keys it copied are released and the writes stop copying keys for it.");
 
 namespace dfly {
 using namespace std;
@@ -269,6 +286,8 @@ class Renamer {
 
   PrimeValue pv_;
   string str_val_;
+  bool copied_str_ = false;  // whether the value was copied to str_val_ instead of moved to pv_.
+  size_t moved_blob_bytes_ = 0;
 
   FindResult src_res_, dest_res_;  // index 0 for source, 1 for destination
   OpResult<void> status_;
@@ -327,10 +346,16 @@ OpStatus Renamer::MoveSrc(Transaction* t, EngineShard* es) {
 
     // We distinguish because of the SmallString that is pinned to its thread by design,
     // thus can not be accessed via another thread.
-    // Therefore, we copy it to standard string in its thread.
-    if (it->second.ObjType() == OBJ_STRING) {
+    // Therefore, we copy it to standard string in its thread. Raw string blobs are handed over
+    // as is, together with their heap accounting, so large values are not copied.
+    if (it->second.ObjType() == OBJ_STRING && !it->second.HasMovableStringBlob()) {
       it->second.GetString(&str_val_);
+      copied_str_ = true;
     } else {
+      if (it->second.HasMovableStringBlob()) {
+        moved_blob_bytes_ = it->second.MallocUsed();
+        es->mi_resource()->ReleaseUsed(moved_blob_bytes_);
+      }
       bool has_expire = it->second.HasExpire();
       pv_ = std::move(it->second);
       it->second.SetExpire(has_expire);
@@ -353,12 +378,13 @@ OpStatus Renamer::UpdateDest(Transaction* t, EngineShard* es) {
     auto res = db_slice.FindMutable(t->GetDbContext(), dest_key);
     auto& dest_it = res.it;
     bool is_prior_list = false;
+    es->mi_resource()->AdoptUsed(moved_blob_bytes_);
 
     if (IsValid(dest_it)) {
       bool has_expire = dest_it->second.HasExpire();
       is_prior_list = dest_it->second.ObjType() == OBJ_LIST;
 
-      if (src_res_.ref_val.ObjType() == OBJ_STRING) {
+      if (copied_str_) {
         dest_it->second.SetString(str_val_);
       } else {
         dest_it->second = std::move(pv_);
@@ -366,7 +392,7 @@ OpStatus Renamer::UpdateDest(Transaction* t, EngineShard* es) {
       dest_it->second.SetExpire(has_expire);  // preserve expire flag.
       db_slice.UpdateExpire(t->GetDbIndex(), dest_it, src_res_.expire_ts);
     } else {
-      if (src_res_.ref_val.ObjType() == OBJ_STRING) {
+      if (copied_str_) {
         pv_.SetString(str_val_);
       }
       auto op_res =
@@ -376,6 +402,7 @@ OpStatus Renamer::UpdateDest(Transaction* t, EngineShard* es) {
     }
 
     dest_it->first.SetSticky(src_res_.sticky);
+    db_slice.TrackExpiringFields(t->GetDbIndex(), dest_key, dest_it->second);
 
     if (!is_prior_list && dest_it->second.ObjType() == OBJ_LIST && es->blocking_controller()) {
       es->blocking_controller()->AwakeWatched(t->GetDbIndex(), dest_key);
@@ -486,11 +513,12 @@ bool ScanCb(const OpArgs& op_args, PrimeIterator it, const ScanOpts& opts, Strin
     return false;
   }
 
-  string str = it->first.ToString();
-  if (!opts.Matches(str)) {
+  string scratch;
+  string_view key = it->first.GetSlice(&scratch);
+  if (!opts.Matches(key)) {
     return false;
   }
-  res->push_back(std::move(str));
+  res->emplace_back(key);
 
   return true;
 }
@@ -562,6 +590,353 @@ uint64_t ScanGeneric(uint64_t cursor, const ScanOpts& scan_opts, StringVec* keys
   return cursor;
 }
 
+// Position of a shard that was scanned completely.
+constexpr uint64_t kScanDone = UINT64_MAX;
+
+// Scans all the shards concurrently, each one from its position in positions, and advances the
+// positions. Returns false when all the shards are done.
+bool ParallelScan(const ScanOpts& scan_opts, vector<uint64_t>* positions, StringVec* keys,
+                  ConnectionContext* cntx) {
+  constexpr uint64_t kMaxScanTimeMs = 100;
+  unsigned active = count_if(positions->begin(), positions->end(),
+                             [](uint64_t pos) { return pos != kScanDone; });
+  if (active == 0)
+    return false;
+
+  ScanOpts shard_opts = scan_opts;
+  shard_opts.limit = (scan_opts.limit + active - 1) / active;
+  DbContext db_cntx{.db_index = cntx->conn_state.db_index, .time_now_ms = GetCurrentTimeMs()};
+  vector<StringVec> shard_keys(positions->size());
+
+  auto cb = [&](EngineShard* shard) {
+    ShardId sid = shard->shard_id();
+    OpArgs op_args{shard, 0, db_cntx};
+    auto [prime_table, expire_table] = shard->db_slice().GetTables(db_cntx.db_index);
+
+    PrimeTable::Cursor cur = (*positions)[sid];
+    unsigned cnt = 0;
+    do {
+      cur = prime_table->Traverse(
+          cur, [&](PrimeIterator it) { cnt += ScanCb(op_args, it, shard_opts, &shard_keys[sid]); });
+    } while (cur && cnt < shard_opts.limit &&
+             GetCurrentTimeMs() <= db_cntx.time_now_ms + kMaxScanTimeMs);
+    (*positions)[sid] = cur ? cur.value() : kScanDone;
+  };
+  shard_set->RunBlockingInParallel(cb, [&](ShardId sid) { return (*positions)[sid] != kScanDone; });
+
+  for (StringVec& vec : shard_keys) {
+    keys->insert(keys->end(), make_move_iterator(vec.begin()), make_move_iterator(vec.end()));
+  }
+  return any_of(positions->begin(), positions->end(),
+                [](uint64_t pos) { return pos != kScanDone; });
+}
+
+// The state of the scans in progress, by their cursor. Only the latest kMaxScans are kept, the
+// cursors of older scans become invalid.
+template <typename Entry, size_t kMaxScans> class ScanCursors {
+ public:
+  // Returns the cursor of the entry. The entries of older scans it evicts are appended to evicted
+  // if it is set.
+  uint64_t Save(Entry entry, vector<Entry>* evicted = nullptr) {
+    lock_guard lk{mu_};
+    uint64_t cursor = ++last_cursor_;
+    entries_.emplace(cursor, Saved{std::move(entry), GetCurrentTimeMs()});
+    order_.push_back(cursor);
+    while (order_.size() > kMaxScans) {
+      auto it = entries_.find(order_.front());
+      if (evicted)
+        evicted->push_back(std::move(it->second.entry));
+      entries_.erase(it);
+      order_.pop_front();
+    }
+    return cursor;
+  }
+
+  optional<Entry> Take(uint64_t cursor) {
+    lock_guard lk{mu_};
+    auto it = entries_.find(cursor);
+    if (it == entries_.end())
+      return nullopt;
+    Entry entry = std::move(it->second.entry);
+    entries_.erase(it);
+    order_.erase(find(order_.begin(), order_.end(), cursor));
+    return entry;
+  }
+
+  // Removes the entries that were saved more than ttl_ms ago and appends them to expired.
+  void TakeExpired(uint64_t ttl_ms, vector<Entry>* expired) {
+    lock_guard lk{mu_};
+    uint64_t now_ms = GetCurrentTimeMs();
+    // The cursors are ordered by the time they were saved.
+    while (!order_.empty()) {
+      auto it = entries_.find(order_.front());
+      if (it->second.saved_ms + ttl_ms > now_ms)
+        break;
+      expired->push_back(std::move(it->second.entry));
+      entries_.erase(it);
+      order_.pop_front();
+    }
+  }
+
+ private:
+  struct Saved {
+    Entry entry;
+    uint64_t saved_ms;
+  };
+
+  util::fb2::Mutex mu_;
+  uint64_t last_cursor_ = 0;
+  absl::flat_hash_map<uint64_t, Saved> entries_;
+  deque<uint64_t> order_;
+};
+
+// The shard positions of a parallel scan.
+struct ParallelScanEntry {
+  DbIndex db_index;
+  vector<uint64_t> positions;
+};
+
+ScanCursors<ParallelScanEntry, 1024> parallel_scan_cursors;
+
+// A point-in-time view of the keys of a database of the shard, for SCAN SNAPSHOT.
+// Like SliceSnapshot, it registers for the changes of the slice with a new version, copies the
+// keys of every bucket with a lower version before the bucket changes or when the scan reaches it,
+// whichever comes first, and sets the version of the bucket to its own. So the scan returns every
+// key that existed when the view was created exactly once and none of the later ones, while the
+// writes go on. The keys of the buckets that change ahead of the scan are held by the view until
+// they are returned.
+// A view that is not advanced for --scan_snapshot_ttl expires on the next change of the slice: it
+// releases its keys and stops receiving the changes.
+class ShardScanView {
+ public:
+  ShardScanView(DbSlice* db_slice, DbIndex db_index, uint64_t now_ms);
+  ~ShardScanView();
+
+  ShardScanView(const ShardScanView&) = delete;
+  void operator=(const ShardScanView&) = delete;
+
+  // Appends the keys that match opts until opts.limit of them were appended or deadline_ms
+  // passed. Returns false once all the keys were returned. Does not preempt.
+  bool Next(const ScanOpts& opts, uint64_t deadline_ms, StringVec* keys);
+
+  // False once the database was flushed, the view can't continue then.
+  bool IsValid() const {
+    return db_slice_->IsDbValid(db_index_) && db_slice_->GetDBTable(db_index_) == table_.get();
+  }
+
+  bool IsExpired() const {
+    return !registered_;
+  }
+
+ private:
+  struct Key {
+    string key;
+    unsigned type;
+  };
+
+  void OnDbChange(DbIndex db_index, const DbSlice::ChangeReq& req);
+  void CopyBucket(PrimeTable::bucket_iterator it);
+  void Expire();
+
+  static size_t KeyBytes(const Key& k) {
+    return sizeof(Key) + k.key.capacity();
+  }
+
+  DbSlice* db_slice_;
+  DbIndex db_index_;
+  boost::intrusive_ptr<DbTable> table_;
+  uint64_t version_;
+  uint64_t now_ms_;  // Keys that expired before are skipped.
+  uint64_t last_used_ms_;
+  bool registered_ = true;
+
+  PrimeTable::Cursor cursor_;
+  bool traversed_ = false;
+  vector<Key> copied_;  // Not returned yet.
+  size_t copied_bytes_ = 0;
+};
+
+ShardScanView::ShardScanView(DbSlice* db_slice, DbIndex db_index, uint64_t now_ms)
+    : db_slice_(db_slice),
+      db_index_(db_index),
+      table_(db_slice->GetDBTable(db_index)),
+      now_ms_(now_ms),
+      last_used_ms_(now_ms) {
+  version_ = db_slice_->RegisterOnChange(absl::bind_front(&ShardScanView::OnDbChange, this));
+}
+
+ShardScanView::~ShardScanView() {
+  db_slice_->UpdateScanSnapshotBytes(-int64_t(copied_bytes_));
+  if (registered_)
+    db_slice_->UnregisterOnChange(version_);
+}
+
+bool ShardScanView::Next(const ScanOpts& opts, uint64_t deadline_ms, StringVec* keys) {
+  DCHECK(registered_);
+  last_used_ms_ = GetCurrentTimeMs();
+
+  size_t limit = keys->size() + opts.limit;
+  size_t prev_bytes = copied_bytes_;
+  absl::Cleanup account = [&] {
+    db_slice_->UpdateScanSnapshotBytes(int64_t(copied_bytes_) - int64_t(prev_bytes));
+  };
+
+  while (true) {
+    while (!copied_.empty() && keys->size() < limit) {
+      Key& k = copied_.back();
+      copied_bytes_ -= KeyBytes(k);
+      if ((opts.type_filter.empty() || ObjTypeName(k.type) == opts.type_filter) &&
+          opts.Matches(k.key)) {
+        keys->push_back(std::move(k.key));
+      }
+      copied_.pop_back();
+    }
+
+    if (keys->size() >= limit)
+      return !copied_.empty() || !traversed_;
+    if (traversed_)
+      return false;
+    if (GetCurrentTimeMs() > deadline_ms)
+      return true;
+
+    cursor_ = table_->prime.Traverse(cursor_, [this](PrimeIterator it) {
+      if (it.GetVersion() < version_) {
+        db_slice_->FlushChangeToEarlierCallbacks(db_index_, it, version_);
+        CopyBucket(it);
+      }
+    });
+    traversed_ = !cursor_;
+  }
+}
+
+void ShardScanView::OnDbChange(DbIndex db_index, const DbSlice::ChangeReq& req) {
+  if (db_index != db_index_ || !registered_ || !IsValid())
+    return;
+
+  uint64_t ttl_ms = uint64_t(absl::GetFlag(FLAGS_scan_snapshot_ttl)) * 1000;
+  if (ttl_ms > 0 && GetCurrentTimeMs() >= last_used_ms_ + ttl_ms)
+    return Expire();
+
+  FiberAtomicGuard fg;
+  size_t prev_bytes = copied_bytes_;
+  if (const PrimeTable::bucket_iterator* bit = req.update()) {
+    if (bit->GetVersion() < version_)
+      CopyBucket(*bit);
+  } else {
+    string_view key = get<string_view>(req.change);
+    table_->prime.CVCUponInsert(version_, key,
+                                [this](PrimeTable::bucket_iterator it) { CopyBucket(it); });
+  }
+  db_slice_->UpdateScanSnapshotBytes(int64_t(copied_bytes_) - int64_t(prev_bytes));
+}
+
+void ShardScanView::Expire() {
+  VLOG(1) << "Expiring idle scan view of db " << db_index_;
+  db_slice_->UpdateScanSnapshotBytes(-int64_t(copied_bytes_));
+  copied_bytes_ = 0;
+  vector<Key>{}.swap(copied_);
+
+  // The callbacks of the slice can't be unregistered while they are being called.
+  registered_ = false;
+  fb2::Fiber("expire_scan_view", [db_slice = db_slice_, version = version_] {
+    db_slice->UnregisterOnChange(version);
+  }).Detach();
+}
+
+void ShardScanView::CopyBucket(PrimeTable::bucket_iterator it) {
+  FiberAtomicGuard fg;
+  DCHECK_LT(it.GetVersion(), version_);
+  it.SetVersion(version_);
+
+  string scratch;
+  for (; !it.is_done(); ++it) {
+    if (it->second.HasExpire() &&
+        db_slice_->ExpireTime(table_->expire.Find(it->first)) <= int64_t(now_ms_)) {
+      continue;
+    }
+    copied_.push_back({string{it->first.GetSlice(&scratch)}, it->second.ObjType()});
+    copied_bytes_ += KeyBytes(copied_.back());
+  }
+}
+
+using ScanViews = vector<unique_ptr<ShardScanView>>;
+
+// The views of a snapshot scan, by shard. A view is reset once it is done.
+struct SnapshotScanEntry {
+  DbIndex db_index;
+  ScanViews views;
+};
+
+// The views hold the keys changed ahead of the scan, so fewer of them are kept than for parallel
+// scans.
+ScanCursors<SnapshotScanEntry, 16> snapshot_scan_cursors;
+
+// Set by Register, the command of the global transaction that creates the views is looked up
+// once all the commands are registered.
+const CommandRegistry* scan_registry = nullptr;
+
+// Creates the views of all the shards in one global transaction, so that they are taken at the
+// same point of the transaction order and the scan sees either all or none of the changes of a
+// multi-shard transaction.
+ScanViews CreateScanViews(DbIndex db_index) {
+  static const CommandId* cid = CHECK_NOTNULL(scan_registry->Find("_SCAN_SNAPSHOT"));
+  ScanViews views(shard_set->size());
+  uint64_t now_ms = GetCurrentTimeMs();
+
+  boost::intrusive_ptr<Transaction> trans{new Transaction{cid}};
+  trans->InitByArgs(db_index, {});
+  trans->ScheduleSingleHop([&](Transaction* t, EngineShard* shard) {
+    views[shard->shard_id()] = make_unique<ShardScanView>(&shard->db_slice(), db_index, now_ms);
+    return OpStatus::OK;
+  });
+  return views;
+}
+
+// The views are destroyed on their shards.
+void ReleaseScanViews(ScanViews* views) {
+  shard_set->RunBriefInParallel([&](EngineShard* shard) { (*views)[shard->shard_id()].reset(); },
+                                [&](ShardId sid) { return (*views)[sid] != nullptr; });
+}
+
+// Advances the views of all the shards concurrently, like ParallelScan. Returns false when all of
+// them are done, CANCELLED if the database was flushed since they were created and TIMED_OUT if
+// they expired.
+OpResult<bool> ScanSnapshot(const ScanOpts& scan_opts, ScanViews* views, StringVec* keys) {
+  constexpr uint64_t kMaxScanTimeMs = 100;
+  unsigned active = count_if(views->begin(), views->end(), [](const auto& v) { return bool(v); });
+  if (active == 0)
+    return false;
+
+  ScanOpts shard_opts = scan_opts;
+  shard_opts.limit = (scan_opts.limit + active - 1) / active;
+  uint64_t deadline_ms = GetCurrentTimeMs() + kMaxScanTimeMs;
+  vector<StringVec> shard_keys(views->size());
+  atomic_bool flushed{false}, expired{false};
+
+  auto cb = [&](EngineShard* shard) {
+    ShardId sid = shard->shard_id();
+    unique_ptr<ShardScanView>& view = (*views)[sid];
+    if (!view->IsValid()) {
+      flushed.store(true, memory_order_relaxed);
+    } else if (view->IsExpired()) {
+      expired.store(true, memory_order_relaxed);
+    } else if (!view->Next(shard_opts, deadline_ms, &shard_keys[sid])) {
+      view.reset();
+    }
+  };
+  shard_set->RunBlockingInParallel(cb, [&](ShardId sid) { return (*views)[sid] != nullptr; });
+
+  if (flushed.load(memory_order_relaxed))
+    return OpStatus::CANCELLED;
+  if (expired.load(memory_order_relaxed))
+    return OpStatus::TIMED_OUT;
+
+  for (StringVec& vec : shard_keys) {
+    keys->insert(keys->end(), make_move_iterator(vec.begin()), make_move_iterator(vec.end()));
+  }
+  return any_of(views->begin(), views->end(), [](const auto& v) { return bool(v); });
+}
+
 OpStatus OpExpire(const OpArgs& op_args, string_view key, const DbSlice::ExpireParams& params) {
   auto& db_slice = op_args.shard->db_slice();
   auto find_res = db_slice.FindMutable(op_args.db_cntx, key);
@@ -645,7 +1020,7 @@ void GenericFamily::Del(CmdArgList args, ConnectionContext* cntx) {
     if (del_cnt == 0) {
       mc_builder->SendNotFound();
     } else {
-      mc_builder->SendSimpleString("DELETED");
+      mc_builder->SendDeleted();
     }
   } else {
     cntx->SendLong(del_cnt);
@@ -795,13 +1170,20 @@ void GenericFamily::Keys(CmdArgList args, ConnectionContext* cntx) {
   StringVec keys;
 
   ScanOpts scan_opts;
-  scan_opts.pattern = pattern;
+  if (pattern != "*")
+    scan_opts.matcher.emplace(pattern);
   scan_opts.limit = 512;
   auto output_limit = absl::GetFlag(FLAGS_keys_output_limit);
 
-  do {
-    cursor = ScanGeneric(cursor, scan_opts, &keys, cntx);
-  } while (cursor != 0 && keys.size() < output_limit);
+  if (absl::GetFlag(FLAGS_scan_parallel)) {
+    vector<uint64_t> positions(shard_set->size(), 0);
+    while (ParallelScan(scan_opts, &positions, &keys, cntx) && keys.size() < output_limit) {
+    }
+  } else {
+    do {
+      cursor = ScanGeneric(cursor, scan_opts, &keys, cntx);
+    } while (cursor != 0 && keys.size() < output_limit);
+  }
 
   auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
   rb->StartArray(keys.size());
@@ -905,7 +1287,7 @@ struct SortEntry
 
   bool Parse(std::string&& item) {
     if constexpr (!ALPHA) {
-      if (!absl::SimpleAtod(item, &this->score))
+      if (!absl::SimpleAtod(item, &this->score) || isnan(this->score))
         return false;
     }
     key = std::move(item);
@@ -919,14 +1301,6 @@ struct SortEntry
     key = absl::StrCat(item);
     return true;
   }
-
-  std::conditional_t<ALPHA, const std::string&, double> Cmp() const {
-    if constexpr (ALPHA) {
-      return key;
-    } else {
-      return this->score;
-    }
-  }
 };
 
 // std::variant of all possible vectors of SortEntries
@@ -944,6 +1318,81 @@ SortEntryList MakeSortEntryList(bool alpha) {
     return SortEntryList{std::vector<SortEntry<false>>{}};
 }
 
+// A score mapped to an integer of the same order, and the index of its entry.
+struct SortKey {
+  uint64_t bits;
+  uint32_t index;
+};
+
+uint64_t OrderedBits(double d, bool reversed) {
+  uint64_t bits = absl::bit_cast<uint64_t>(d);
+  bits = (bits >> 63) ? ~bits : bits | (1ULL << 63);
+  return reversed ? ~bits : bits;
+}
+
+// Sorts the keys by their bits with a least significant digit first radix sort of bytes.
+// Skips the bytes that are the same for all the keys, like the high bytes of small integers.
+void RadixSort(vector<SortKey>* keys) {
+  array<array<uint32_t, 256>, 8> counts{};
+  for (const SortKey& key : *keys) {
+    for (unsigned i = 0; i < 8; ++i)
+      ++counts[i][(key.bits >> (i * 8)) & 0xff];
+  }
+
+  vector<SortKey> buf(keys->size());
+  for (unsigned i = 0; i < 8; ++i) {
+    array<uint32_t, 256>& offsets = counts[i];
+    if (offsets[(keys->front().bits >> (i * 8)) & 0xff] == keys->size())
+      continue;
+
+    uint32_t sum = 0;
+    for (uint32_t& offset : offsets) {
+      uint32_t count = offset;
+      offset = sum;
+      sum += count;
+    }
+    for (const SortKey& key : *keys)
+      buf[offsets[(key.bits >> (i * 8)) & 0xff]++] = key;
+    keys->swap(buf);
+  }
+}
+
+// Returns the indices of the scored entries in sorted order. Only the range [start, end) of
+// the result is guaranteed to be sorted.
+vector<uint32_t> SortByScore(const vector<SortEntry<false>>& entries, bool reversed, size_t start,
+                             size_t end) {
+  // Smaller inputs are sorted with a comparison sort.
+  constexpr size_t kRadixSortMinSize = 256;
+
+  vector<SortKey> keys(entries.size());
+  for (size_t i = 0; i < entries.size(); ++i)
+    keys[i] = {OrderedBits(entries[i].score, reversed), uint32_t(i)};
+
+  auto cmp = [](const SortKey& l, const SortKey& r) { return l.bits < r.bits; };
+  if (keys.size() >= kRadixSortMinSize && end - start > keys.size() / 8) {
+    RadixSort(&keys);
+  } else {
+    if (start > 0)
+      nth_element(keys.begin(), keys.begin() + start, keys.end(), cmp);
+    partial_sort(keys.begin() + start, keys.begin() + end, keys.end(), cmp);
+  }
+
+  vector<uint32_t> res(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i)
+    res[i] = keys[i].index;
+  return res;
+}
+
+// Sorts the range [start, end) of the entries by their strings.
+void SortAlpha(vector<SortEntry<true>>* entries, bool reversed, size_t start, size_t end) {
+  auto cmp = [reversed](const auto& l, const auto& r) {
+    return reversed ? r.key < l.key : l.key < r.key;
+  };
+  if (start > 0)
+    nth_element(entries->begin(), entries->begin() + start, entries->end(), cmp);
+  partial_sort(entries->begin() + start, entries->begin() + end, entries->end(), cmp);
+}
+
 // Iterate over container with generic function that accepts strings and ints
 template <typename F> bool Iterate(const PrimeValue& pv, F&& func) {
   auto cb = [&func](container_utils::ContainerEntry ce) {
@@ -995,7 +1444,7 @@ void GenericFamily::Sort(CmdArgList args, ConnectionContext* cntx) {
   std::string_view key = ArgS(args, 0);
   bool alpha = false;
   bool reversed = false;
-  std::optional<std::pair<size_t, size_t>> bounds;
+  int64_t offset = 0, limit = -1;
 
   for (size_t i = 1; i < args.size(); i++) {
     ToUpper(&args[i]);
@@ -1006,7 +1455,6 @@ void GenericFamily::Sort(CmdArgList args, ConnectionContext* cntx) {
     } else if (arg == "DESC") {
       reversed = true;
     } else if (arg == "LIMIT") {
-      int offset, limit;
       if (i + 2 >= args.size()) {
         return cntx->SendError(kSyntaxErr);
       }
@@ -1014,7 +1462,6 @@ void GenericFamily::Sort(CmdArgList args, ConnectionContext* cntx) {
           !absl::SimpleAtoi(ArgS(args, i + 2), &limit)) {
         return cntx->SendError(kInvalidIntErr);
       }
-      bounds = {offset, limit};
       i += 2;
     }
   }
@@ -1032,33 +1479,25 @@ void GenericFamily::Sort(CmdArgList args, ConnectionContext* cntx) {
     return rb->SendEmptyArray();
 
   auto result_type = fetch_result.type();
-  auto sort_call = [cntx, bounds, reversed, result_type](auto& entries) {
-    if (bounds) {
-      auto sort_it = entries.begin() + std::min(bounds->first + bounds->second, entries.size());
-      std::partial_sort(entries.begin(), sort_it, entries.end(),
-                        [reversed](const auto& lhs, const auto& rhs) {
-                          return bool(lhs.Cmp() < rhs.Cmp()) ^ reversed;
-                        });
-    } else {
-      std::sort(entries.begin(), entries.end(), [reversed](const auto& lhs, const auto& rhs) {
-        return bool(lhs.Cmp() < rhs.Cmp()) ^ reversed;
-      });
-    }
-
-    auto start_it = entries.begin();
-    auto end_it = entries.end();
-    if (bounds) {
-      start_it += std::min(bounds->first, entries.size());
-      end_it = entries.begin() + std::min(bounds->first + bounds->second, entries.size());
-    }
+  auto sort_call = [cntx, offset, limit, reversed, result_type](auto& entries) {
+    // A negative limit returns all the entries after offset, like in Redis.
+    size_t start = min<size_t>(max<int64_t>(offset, 0), entries.size());
+    size_t end = limit < 0 ? entries.size() : start + min<size_t>(limit, entries.size() - start);
 
     bool is_set = (result_type == OBJ_SET || result_type == OBJ_ZSET);
     auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
-    rb->StartCollection(std::distance(start_it, end_it),
-                        is_set ? RedisReplyBuilder::SET : RedisReplyBuilder::ARRAY);
-
-    for (auto it = start_it; it != end_it; ++it) {
-      rb->SendBulkString(it->key);
+    rb->StartCollection(end - start, is_set ? RedisReplyBuilder::SET : RedisReplyBuilder::ARRAY);
+    if (start == end)
+      return;
+
+    if constexpr (is_same_v<decay_t<decltype(entries)>, vector<SortEntry<true>>>) {
+      SortAlpha(&entries, reversed, start, end);
+      for (size_t i = start; i < end; ++i)
+        rb->SendBulkString(entries[i].key);
+    } else {
+      vector<uint32_t> order = SortByScore(entries, reversed, start, end);
+      for (size_t i = start; i < end; ++i)
+        rb->SendBulkString(entries[order[i]].key);
     }
   };
   std::visit(std::move(sort_call), fetch_result.value());
@@ -1328,7 +1767,7 @@ void GenericFamily::Scan(CmdArgList args, ConnectionContext* cntx) {
     return cntx->SendError("invalid cursor");
   }
 
-  OpResult<ScanOpts> ops = ScanOpts::TryFrom(args.subspan(1));
+  OpResult<ScanOpts> ops = ScanOpts::TryFrom(args.subspan(1), true);
   if (!ops) {
     DVLOG(1) << "Scan invalid args - return " << ops << " to the user";
     return cntx->SendError(ops.status());
@@ -1337,7 +1776,59 @@ void GenericFamily::Scan(CmdArgList args, ConnectionContext* cntx) {
   ScanOpts scan_op = ops.value();
 
   StringVec keys;
-  cursor = ScanGeneric(cursor, scan_op, &keys, cntx);
+  if (scan_op.snapshot) {
+    if (uint32_t ttl = absl::GetFlag(FLAGS_scan_snapshot_ttl); ttl > 0) {
+      vector<SnapshotScanEntry> expired;
+      snapshot_scan_cursors.TakeExpired(uint64_t(ttl) * 1000, &expired);
+      for (SnapshotScanEntry& old : expired)
+        ReleaseScanViews(&old.views);
+    }
+
+    SnapshotScanEntry entry{cntx->conn_state.db_index, {}};
+    if (cursor != 0) {
+      optional<SnapshotScanEntry> saved = snapshot_scan_cursors.Take(cursor);
+      if (!saved)
+        return cntx->SendError("invalid cursor");
+      entry = std::move(*saved);
+      if (entry.db_index != cntx->conn_state.db_index) {
+        ReleaseScanViews(&entry.views);
+        return cntx->SendError("invalid cursor");
+      }
+    } else {
+      // The views are created by a transaction of their own.
+      if (cntx->transaction)
+        return cntx->SendError("SNAPSHOT is not allowed in transactions and scripts");
+      entry.views = CreateScanViews(entry.db_index);
+    }
+
+    OpResult<bool> more = ScanSnapshot(scan_op, &entry.views, &keys);
+    cursor = 0;
+    if (!more) {
+      ReleaseScanViews(&entry.views);
+      if (more.status() == OpStatus::TIMED_OUT)
+        return cntx->SendError("invalid cursor");
+      return cntx->SendError("snapshot was invalidated by a flush");
+    }
+    if (*more) {
+      vector<SnapshotScanEntry> evicted;
+      cursor = snapshot_scan_cursors.Save(std::move(entry), &evicted);
+      for (SnapshotScanEntry& old : evicted)
+        ReleaseScanViews(&old.views);
+    }
+  } else if (absl::GetFlag(FLAGS_scan_parallel)) {
+    ParallelScanEntry entry{cntx->conn_state.db_index, vector<uint64_t>(shard_set->size(), 0)};
+    if (cursor != 0) {
+      optional<ParallelScanEntry> saved = parallel_scan_cursors.Take(cursor);
+      if (!saved || saved->db_index != entry.db_index)
+        return cntx->SendError("invalid cursor");
+      entry = std::move(*saved);
+    }
+    cursor = 0;
+    if (ParallelScan(scan_op, &entry.positions, &keys, cntx))
+      cursor = parallel_scan_cursors.Save(std::move(entry));
+  } else {
+    cursor = ScanGeneric(cursor, scan_op, &keys, cntx);
+  }
 
   auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
   rb->StartArray(2);
@@ -1369,7 +1860,11 @@ OpResult<uint32_t> GenericFamily::OpDel(const OpArgs& op_args, ArgSlice keys) {
   uint32_t res = 0;
 
   for (uint32_t i = 0; i < keys.size(); ++i) {
-    auto fres = db_slice.FindMutable(op_args.db_cntx, keys[i]);
+    if (i % DbSlice::kPrefetchWindow == 0) {
+      db_slice.PrefetchKeys(op_args.db_cntx.db_index, keys.subspan(i, DbSlice::kPrefetchWindow));
+    }
+
+    auto fres = db_slice.FindMutableToReplace(op_args.db_cntx, keys[i]);
     if (!IsValid(fres.it))
       continue;
     fres.post_updater.Run();
@@ -1384,9 +1879,11 @@ OpResult<uint32_t> GenericFamily::OpExists(const OpArgs& op_args, ArgSlice keys)
   auto& db_slice = op_args.shard->db_slice();
   uint32_t res = 0;
 
-  for (uint32_t i = 0; i < keys.size(); ++i) {
-    auto find_res = db_slice.FindReadOnly(op_args.db_cntx, keys[i]);
-    res += IsValid(find_res.it);
+  absl::InlinedVector<OpResult<PrimeConstIterator>, 32> find_res(keys.size());
+  db_slice.FindManyReadOnly(op_args.db_cntx, keys, std::nullopt, find_res.data());
+
+  for (const auto& it_res : find_res) {
+    res += it_res.ok();
   }
   return res;
 }
@@ -1442,6 +1939,8 @@ OpResult<void> GenericFamily::OpRen(const OpArgs& op_args, string_view from_key,
   }
 
   to_res.it->first.SetSticky(sticky);
+  // The tracking of from_key is dropped lazily once it's found to be gone.
+  db_slice.TrackExpiringFields(op_args.db_cntx.db_index, to_key, to_res.it->second);
 
   if (!is_prior_list && to_res.it->second.ObjType() == OBJ_LIST && es->blocking_controller()) {
     es->blocking_controller()->AwakeWatched(op_args.db_cntx.db_index, to_key);
@@ -1500,6 +1999,7 @@ OpStatus GenericFamily::OpMove(const OpArgs& op_args, string_view key, DbIndex t
   RETURN_ON_BAD_STATUS(op_result);
   auto& add_res = *op_result;
   add_res.it->first.SetSticky(sticky);
+  db_slice.TrackExpiringFields(target_db, key, add_res.it->second);
 
   if (add_res.it->second.ObjType() == OBJ_LIST && op_args.shard->blocking_controller()) {
     op_args.shard->blocking_controller()->AwakeWatched(target_db, key);
@@ -1543,6 +2043,7 @@ constexpr uint32_t kRestore = KEYSPACE | WRITE | SLOW | DANGEROUS;
 
 void GenericFamily::Register(CommandRegistry* registry) {
   constexpr auto kSelectOpts = CO::LOADING | CO::FAST | CO::NOSCRIPT;
+  scan_registry = registry;
   registry->StartFamily();
   *registry
       << CI{"DEL", CO::WRITE, -2, 1, -1, acl::kDel}.HFUNC(Del)
@@ -1568,6 +2069,11 @@ void GenericFamily::Register(CommandRegistry* registry) {
       << CI{"RENAMENX", CO::WRITE | CO::NO_AUTOJOURNAL, 3, 1, 2, acl::kRenamNX}.HFUNC(RenameNx)
       << CI{"SELECT", kSelectOpts, 2, 0, 0, acl::kSelect}.HFUNC(Select)
       << CI{"SCAN", CO::READONLY | CO::FAST | CO::LOADING, -2, 0, 0, acl::kScan}.HFUNC(Scan)
+      << CI{"_SCAN_SNAPSHOT", CO::READONLY | CO::GLOBAL_TRANS | CO::HIDDEN | CO::NOSCRIPT, 1, 0, 0,
+            acl::kScan}
+             .SetHandler([](CmdArgList, ConnectionContext* cntx) {
+               cntx->SendError(kSyntaxErr);  // Only runs the transaction of SCAN ... SNAPSHOT.
+             })
       << CI{"TTL", CO::READONLY | CO::FAST, 2, 1, 1, acl::kTTL}.HFUNC(Ttl)
       << CI{"PTTL", CO::READONLY | CO::FAST, 2, 1, 1, acl::kPTTL}.HFUNC(Pttl)
       << CI{"FIELDTTL", CO::READONLY | CO::FAST, 3, 1, 1, acl::kFieldTtl}.HFUNC(FieldTtl)
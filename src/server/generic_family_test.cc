@@ -8,6 +8,9 @@ extern "C" {
 #include "redis/rdb.h"
 }
 
+#include <random>
+
+#include "base/flags.h"
 #include "base/gtest.h"
 #include "base/logging.h"
 #include "facade/facade_test.h"
@@ -24,6 +27,11 @@ using namespace util;
 using namespace boost;
 using absl::StrCat;
 
+ABSL_DECLARE_FLAG(bool, expiry_wheel);
+ABSL_DECLARE_FLAG(uint32_t, lazyfree_min_elements);
+ABSL_DECLARE_FLAG(bool, scan_parallel);
+ABSL_DECLARE_FLAG(uint32_t, scan_snapshot_ttl);
+
 namespace dfly {
 
 class GenericFamilyTest : public BaseFamilyTest {};
@@ -75,6 +83,40 @@ TEST_F(GenericFamilyTest, Expire) {
   EXPECT_THAT(resp, ArgType(RespExpr::NIL));
 }
 
+TEST_F(GenericFamilyTest, ExpiryWheel) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_expiry_wheel, true);
+  ResetService();
+
+  for (unsigned i = 0; i < 100; ++i) {
+    Run({"set", StrCat("key", i), "val", "px", "1500"});
+  }
+  Run({"set", "persisted", "val", "px", "1500"});
+  Run({"persist", "persisted"});
+  Run({"set", "extended", "val", "px", "1500"});
+  Run({"pexpire", "extended", "10000"});
+
+  auto delete_due = [] {
+    shard_set->RunBriefInParallel([](EngineShard* es) {
+      DbContext cntx{.db_index = 0, .time_now_ms = TEST_current_time_ms};
+      es->db_slice().DeleteDueExpiredStep(cntx, 1000);
+    });
+  };
+
+  delete_due();
+  EXPECT_EQ(102, CheckedInt({"dbsize"}));
+
+  AdvanceTime(2000);
+  delete_due();
+  EXPECT_EQ(2, CheckedInt({"dbsize"}));
+  EXPECT_EQ(100u, GetMetrics().events.expired_keys);
+
+  AdvanceTime(10000);
+  delete_due();
+  EXPECT_EQ(1, CheckedInt({"dbsize"}));
+  EXPECT_EQ(1, CheckedInt({"exists", "persisted"}));
+}
+
 TEST_F(GenericFamilyTest, ExpireOptions) {
   // NX and XX are mutually exclusive
   Run({"set", "key", "val"});
@@ -174,6 +216,35 @@ TEST_F(GenericFamilyTest, Del) {
   Run({"del", "k1"});
 }
 
+TEST_F(GenericFamilyTest, LazyFree) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_lazyfree_min_elements, 1024);
+
+  vector<string> sadd = {"sadd", "set"}, hset = {"hset", "hash"}, rpush = {"rpush", "list"};
+  for (unsigned i = 0; i < 2000; ++i) {
+    sadd.push_back(StrCat("member", i));
+    hset.insert(hset.end(), {StrCat("field", i), "val"});
+    rpush.push_back(StrCat("elem", i));
+  }
+  Run(absl::Span<string>{sadd});
+  Run(absl::Span<string>{hset});
+  Run(absl::Span<string>{rpush});
+  Run({"sadd", "small", "a", "b"});
+
+  EXPECT_EQ(3, CheckedInt({"del", "set", "hash", "small"}));
+  Run({"pexpire", "list", "100000"});
+  EXPECT_EQ(Run({"set", "list", "foo", "keepttl"}), "OK");
+  EXPECT_EQ(Run({"get", "list"}), "foo");
+  EXPECT_GT(CheckedInt({"pttl", "list"}), 0);
+
+  shard_set->RunBriefInParallel(
+      [](EngineShard* es) { es->db_slice().LazyFreeStep(std::numeric_limits<uint32_t>::max()); });
+  Metrics metrics = GetMetrics();
+  EXPECT_EQ(3u, metrics.events.lazyfreed_objects);
+  EXPECT_EQ(0u, metrics.lazyfree_pending_objects);
+  EXPECT_EQ(0u, metrics.lazyfree_pending_elements);
+}
+
 TEST_F(GenericFamilyTest, TTL) {
   EXPECT_EQ(-2, CheckedInt({"ttl", "foo"}));
   EXPECT_EQ(-2, CheckedInt({"pttl", "foo"}));
@@ -251,6 +322,22 @@ TEST_F(GenericFamilyTest, RenameNonString) {
   EXPECT_EQ(1, CheckedInt({"del", "b"}));
 }
 
+TEST_F(GenericFamilyTest, RenameLargeString) {
+  string val(1 << 20, 'x');
+  val[100] = '\xff';
+  Run({"set", "x", val});
+  ASSERT_EQ(Run({"rename", "x", "b"}), "OK");
+  ASSERT_EQ(2, last_cmd_dbg_info_.shards_count);
+  EXPECT_EQ(Run({"get", "b"}), val);
+
+  // Overrides an existing value and moves the value back.
+  Run({"set", "x", "bar"});
+  ASSERT_EQ(Run({"rename", "b", "x"}), "OK");
+  EXPECT_EQ(Run({"get", "x"}), val);
+  EXPECT_EQ(0, CheckedInt({"exists", "b"}));
+  EXPECT_EQ(1, CheckedInt({"del", "x"}));
+}
+
 TEST_F(GenericFamilyTest, RenameBinary) {
   const char kKey1[] = "\x01\x02\x03\x04";
   const char kKey2[] = "\x05\x06\x07\x08";
@@ -393,6 +480,124 @@ TEST_F(GenericFamilyTest, Scan) {
   EXPECT_THAT(vec, Each(StartsWith("zset")));
 }
 
+TEST_F(GenericFamilyTest, ScanDuringMerge) {
+  constexpr unsigned kNumKeys = 50000;
+  Run({"debug", "populate", absl::StrCat(kNumKeys)});
+
+  // Leaves every 10th key, so that the segments become sparse enough to be merged.
+  vector<string> del{"del"};
+  for (unsigned i = 0; i < kNumKeys; ++i) {
+    if (i % 10 != 0)
+      del.push_back(absl::StrCat("key:", i));
+    if (del.size() == 1000 || i + 1 == kNumKeys) {
+      Run(absl::Span<string>{del});
+      del.resize(1);
+    }
+  }
+
+  set<string> seen;
+  string cursor = "0";
+  atomic_uint merged = 0;
+  do {
+    auto resp = Run({"scan", cursor, "count", "100"});
+    ASSERT_THAT(resp, ArrLen(2));
+    cursor = resp.GetVec()[0].GetString();
+    auto vec = StrArray(resp.GetVec()[1]);
+    seen.insert(vec.begin(), vec.end());
+
+    shard_set->RunBriefInParallel(
+        [&](EngineShard* es) { merged += es->db_slice().MergeSegmentsStep(0, 4, 0.5); });
+  } while (cursor != "0");
+
+  EXPECT_GT(merged.load(), 0u);
+  EXPECT_EQ(kNumKeys / 10, seen.size());
+}
+
+TEST_F(GenericFamilyTest, ScanParallel) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_scan_parallel, true);
+
+  for (unsigned i = 0; i < 200; ++i)
+    Run({"set", absl::StrCat("key", i), "bar"});
+  for (unsigned i = 0; i < 50; ++i)
+    Run({"sadd", absl::StrCat("set", i), "bar"});
+
+  set<string> seen;
+  string cursor = "0";
+  do {
+    auto resp = Run({"scan", cursor, "count", "16", "type", "string"});
+    ASSERT_THAT(resp, ArrLen(2));
+    cursor = resp.GetVec()[0].GetString();
+    auto vec = StrArray(resp.GetVec()[1]);
+    EXPECT_THAT(vec, Each(StartsWith("key")));
+    seen.insert(vec.begin(), vec.end());
+  } while (cursor != "0");
+  EXPECT_EQ(200u, seen.size());
+
+  EXPECT_THAT(Run({"keys", "set*"}), ArrLen(50));
+  EXPECT_THAT(Run({"scan", "12345"}), ErrArg("invalid cursor"));
+}
+
+TEST_F(GenericFamilyTest, ScanSnapshot) {
+  set<string> expected;
+  for (unsigned i = 0; i < 300; ++i) {
+    Run({"set", absl::StrCat("key", i), "bar"});
+    expected.insert(absl::StrCat("key", i));
+  }
+
+  auto resp = Run({"scan", "0", "count", "10", "snapshot"});
+  ASSERT_THAT(resp, ArrLen(2));
+  string cursor = resp.GetVec()[0].GetString();
+  ASSERT_NE(cursor, "0");
+  vector<string> seen = StrArray(resp.GetVec()[1]);
+
+  // None of the changes made after the scan started are visible.
+  for (unsigned i = 0; i < 300; i += 3)
+    Run({"del", absl::StrCat("key", i)});
+  for (unsigned i = 0; i < 300; ++i)
+    Run({"set", absl::StrCat("new", i), "bar"});
+
+  while (cursor != "0") {
+    resp = Run({"scan", cursor, "count", "10", "snapshot"});
+    ASSERT_THAT(resp, ArrLen(2));
+    cursor = resp.GetVec()[0].GetString();
+    auto vec = StrArray(resp.GetVec()[1]);
+    seen.insert(seen.end(), vec.begin(), vec.end());
+  }
+  EXPECT_EQ(seen.size(), expected.size());
+  EXPECT_EQ(set<string>(seen.begin(), seen.end()), expected);
+
+  // A flush invalidates the views.
+  resp = Run({"scan", "0", "count", "1", "snapshot"});
+  cursor = resp.GetVec()[0].GetString();
+  Run({"flushdb"});
+  EXPECT_THAT(Run({"scan", cursor, "snapshot"}), ErrArg("snapshot was invalidated by a flush"));
+
+  EXPECT_THAT(Run({"sscan", "set", "0", "snapshot"}), ErrArg("syntax error"));
+}
+
+TEST_F(GenericFamilyTest, ScanSnapshotExpiry) {
+  for (unsigned i = 0; i < 300; ++i)
+    Run({"set", absl::StrCat("key", i), "bar"});
+
+  auto resp = Run({"scan", "0", "count", "1", "snapshot"});
+  string cursor = resp.GetVec()[0].GetString();
+  ASSERT_NE(cursor, "0");
+
+  // The views copy the keys before they are deleted.
+  for (unsigned i = 0; i < 300; ++i)
+    Run({"del", absl::StrCat("key", i)});
+  EXPECT_GT(GetMetrics().scan_snapshot_bytes, 0u);
+
+  // The next changes expire the views that were not advanced in time, and release their keys.
+  AdvanceTime(absl::GetFlag(FLAGS_scan_snapshot_ttl) * 1000);
+  for (unsigned i = 0; i < 300; ++i)
+    Run({"set", absl::StrCat("new", i), "bar"});
+  EXPECT_EQ(GetMetrics().scan_snapshot_bytes, 0u);
+
+  EXPECT_THAT(Run({"scan", cursor, "snapshot"}), ErrArg("invalid cursor"));
+}
+
 TEST_F(GenericFamilyTest, Sort) {
   // Test list sort with params
   Run({"del", "list-1"});
@@ -456,6 +661,39 @@ TEST_F(GenericFamilyTest, Sort) {
   // Test not convertible to double
   Run({"lpush", "list-2", "NOTADOUBLE"});
   ASSERT_THAT(Run({"sort", "list-2"}), ErrArg("One or more scores can't be converted into double"));
+  Run({"lpush", "list-3", "nan"});
+  ASSERT_THAT(Run({"sort", "list-3"}), ErrArg("One or more scores can't be converted into double"));
+
+  // Negative limit returns all the entries after the offset
+  ASSERT_THAT(Run({"sort", "list-1", "LIMIT", "2", "-1"}).GetVec(),
+              ElementsAre("3.5", "10.1", "200"));
+}
+
+TEST_F(GenericFamilyTest, SortLarge) {
+  vector<string> rpush = {"rpush", "list"};
+  vector<double> scores;
+  mt19937 gen(42);
+  for (unsigned i = 0; i < 5000; ++i) {
+    double score = int(gen() % 20000) - 10000 + (i % 4) * 0.25;
+    rpush.push_back(StrCat(score));
+    scores.push_back(score);
+  }
+  Run(absl::Span<string>{rpush});
+  sort(scores.begin(), scores.end());
+
+  auto check = [&](vector<string> cmd, size_t start, size_t count, bool desc) {
+    auto resp = Run(absl::Span<string>{cmd});
+    ASSERT_THAT(resp, ArrLen(count));
+    auto vec = resp.GetVec();
+    for (size_t i = 0; i < count; ++i) {
+      double expected = desc ? scores[scores.size() - 1 - start - i] : scores[start + i];
+      ASSERT_EQ(StrCat(expected), vec[i].GetString()) << i;
+    }
+  };
+  check({"sort", "list"}, 0, 5000, false);
+  check({"sort", "list", "DESC"}, 0, 5000, true);
+  check({"sort", "list", "LIMIT", "1000", "10"}, 1000, 10, false);
+  check({"sort", "list", "DESC", "LIMIT", "4990", "100"}, 4990, 10, true);
 }
 
 TEST_F(GenericFamilyTest, Time) {
@@ -12,6 +12,7 @@ extern "C" {
 
 #include "base/logging.h"
 #include "base/stl_util.h"
+#include "core/bit_kernels.h"
 #include "facade/error.h"
 #include "server/acl/acl_commands_def.h"
 #include "server/command_registry.h"
@@ -143,66 +144,100 @@ OpResult<int64_t> CountHllsSingle(const OpArgs& op_args, string_view key) {
   }
 }
 
-OpResult<vector<string>> ReadValues(const OpArgs& op_args, ArgSlice keys) {
+// The hlls of a shard are merged on the shard thread, so that only their registers are passed
+// to the coordinator.
+struct ShardHll {
+  string registers;  // raw registers, empty if there are no hlls.
+  size_t count = 0;  // the number of merged hlls.
+  int64_t card = -1;  // the cached count of a single hll, or -1.
+};
+
+OpResult<ShardHll> MergeShardHlls(const OpArgs& op_args, ArgSlice keys) {
   try {
-    vector<string> values;
+    ShardHll res;
+    string scratch;
     for (size_t i = 0; i < keys.size(); ++i) {
       OpResult<PrimeConstIterator> it =
           op_args.shard->db_slice().FindReadOnly(op_args.db_cntx, keys[i], OBJ_STRING);
       if (it.ok()) {
-        string hll;
-        it.value()->second.GetString(&hll);
-        ConvertToDenseIfNeeded(&hll);
-        if (isValidHLL(StringToHllPtr(hll)) != HLL_VALID_DENSE) {
-          return OpStatus::INVALID_VALUE;
-        } else {
-          values.push_back(std::move(hll));
+        string_view hll = it.value()->second.GetSlice(&scratch);
+        switch (isValidHLL(StringToHllPtr(hll))) {
+          case HLL_VALID_DENSE:
+            break;
+          case HLL_VALID_SPARSE:
+            scratch = hll;
+            ConvertToDenseIfNeeded(&scratch);
+            hll = scratch;
+            break;
+          case HLL_INVALID:
+          default:
+            return OpStatus::INVALID_VALUE;
+        }
+
+        if (res.registers.empty()) {
+          res.registers.resize(getHllRegisterCount(), 0);
+        }
+        hllMergeDenseToRaw(StringToHllPtr(hll), reinterpret_cast<uint8_t*>(res.registers.data()));
+        ++res.count;
+
+        // Reuse the cached cardinality if this turns out to be the only hll.
+        if (keys.size() == 1) {
+          res.card = pfcountSingle(StringToHllPtr(hll));
         }
       } else if (it.status() == OpStatus::WRONG_TYPE) {
         return OpStatus::WRONG_TYPE;
       }
     }
-    return values;
+    return res;
   } catch (const std::bad_alloc&) {
     return OpStatus::OUT_OF_MEMORY;
   }
 }
 
-vector<HllBufferPtr> ConvertShardVector(const vector<vector<string>>& hlls) {
-  vector<HllBufferPtr> ptrs;
-  ptrs.reserve(hlls.size());
-  for (auto& shard_hlls : hlls) {
-    for (auto& hll : shard_hlls) {
-      ptrs.push_back(StringToHllPtr(hll));
+// Merges the registers of all shards into a single ShardHll.
+OpResult<ShardHll> CombineShardHlls(vector<OpResult<ShardHll>> results) {
+  ShardHll res;
+  for (auto& shard_res : results) {
+    if (!shard_res) {
+      return shard_res.status();
+    }
+
+    ShardHll& hll = *shard_res;
+    if (hll.count == 0) {
+      continue;
+    }
+    if (res.count == 0) {
+      res = std::move(hll);
+    } else {
+      MaxInPlace(reinterpret_cast<uint8_t*>(res.registers.data()),
+                 reinterpret_cast<const uint8_t*>(hll.registers.data()), res.registers.size());
+      res.count += hll.count;
     }
   }
-  return ptrs;
+  return res;
 }
 
 OpResult<int64_t> PFCountMulti(CmdArgList args, ConnectionContext* cntx) {
-  vector<vector<string>> hlls;
-  hlls.resize(shard_set->size());
+  vector<OpResult<ShardHll>> results(shard_set->size(), ShardHll{});
 
   auto cb = [&](Transaction* t, EngineShard* shard) {
-    ShardId sid = shard->shard_id();
     ArgSlice shard_args = t->GetShardArgs(shard->shard_id());
-    auto result = ReadValues(t->GetOpArgs(shard), shard_args);
-    if (result.ok()) {
-      hlls[sid] = std::move(result.value());
-    }
-    return result.status();
+    results[shard->shard_id()] = MergeShardHlls(t->GetOpArgs(shard), shard_args);
+    return OpStatus::OK;
   };
 
   Transaction* trans = cntx->transaction;
   trans->ScheduleSingleHop(std::move(cb));
 
-  vector<HllBufferPtr> ptrs = ConvertShardVector(hlls);
-  int64_t pf_count = pfcountMulti(ptrs.data(), ptrs.size());
-  if (pf_count < 0) {
-    return OpStatus::INVALID_VALUE;
-  } else {
-    return pf_count;
+  OpResult<ShardHll> total = CombineShardHlls(std::move(results));
+  RETURN_ON_BAD_STATUS(total);
+  if (total->count == 0) {
+    return 0;
+  }
+  if (total->count == 1 && total->card >= 0) {
+    return total->card;
   }
+  return pfcountRaw(reinterpret_cast<const uint8_t*>(total->registers.data()));
 }
 
 void PFCount(CmdArgList args, ConnectionContext* cntx) {
@@ -221,20 +256,17 @@ void PFCount(CmdArgList args, ConnectionContext* cntx) {
 }
 
 OpResult<int> PFMergeInternal(CmdArgList args, ConnectionContext* cntx) {
-  vector<vector<string>> hlls;
-  hlls.resize(shard_set->size());
+  vector<OpResult<ShardHll>> results(shard_set->size(), ShardHll{});
 
   atomic_bool success = true;
   auto cb = [&](Transaction* t, EngineShard* shard) {
     ShardId sid = shard->shard_id();
     ArgSlice shard_args = t->GetShardArgs(shard->shard_id());
-    auto result = ReadValues(t->GetOpArgs(shard), shard_args);
-    if (result.ok()) {
-      hlls[sid] = std::move(result.value());
-    } else {
+    results[sid] = MergeShardHlls(t->GetOpArgs(shard), shard_args);
+    if (!results[sid]) {
       success = false;
     }
-    return result.status();
+    return results[sid].status();
   };
 
   Transaction* trans = cntx->transaction;
@@ -246,12 +278,18 @@ OpResult<int> PFMergeInternal(CmdArgList args, ConnectionContext* cntx) {
     return OpStatus::INVALID_VALUE;
   }
 
-  vector<HllBufferPtr> ptrs = ConvertShardVector(hlls);
+  OpResult<ShardHll> total = CombineShardHlls(std::move(results));
+  DCHECK(total);
+  if (total->count == 0) {
+    total->registers.resize(getHllRegisterCount(), 0);
+  }
 
+  // The merged hll is stored with its cardinality cached, for the PFCOUNT that usually follows.
   string hll;
   hll.resize(getDenseHllSize());
   createDenseHll(StringToHllPtr(hll));
-  int result = pfmerge(ptrs.data(), ptrs.size(), StringToHllPtr(hll));
+  int result =
+      pfstoreRaw(reinterpret_cast<const uint8_t*>(total->registers.data()), StringToHllPtr(hll));
 
   auto set_cb = [&](Transaction* t, EngineShard* shard) {
     string_view key = ArgS(args, 0);
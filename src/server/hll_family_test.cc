@@ -4,6 +4,8 @@
 
 #include "server/hll_family.h"
 
+#include <absl/strings/str_cat.h>
+
 #include "base/gtest.h"
 #include "base/logging.h"
 #include "facade/facade_test.h"
@@ -132,4 +134,32 @@ TEST_F(HllFamilyTest, MergeInvalid) {
   EXPECT_EQ(CheckedInt({"pfcount", "key1"}), 3);
 }
 
+TEST_F(HllFamilyTest, CountMultipleInvalid) {
+  EXPECT_EQ(CheckedInt({"pfadd", "key1", "1", "2", "3"}), 1);
+  EXPECT_EQ(Run({"set", "key2", "..."}), "OK");
+  EXPECT_THAT(Run({"pfcount", "key1", "key2"}), ErrArg(HllFamily::kInvalidHllErr));
+  Run({"zadd", "key3", "1", "a"});
+  EXPECT_THAT(Run({"pfcount", "key1", "key3"}),
+              ErrArg("Operation against a key holding the wrong kind of value"));
+}
+
+TEST_F(HllFamilyTest, MergeManyKeys) {
+  vector<string> count_args = {"pfcount"}, merge_args = {"pfmerge", "dest"};
+  for (unsigned i = 0; i < 100; ++i) {
+    vector<string> add_args = {"pfadd", absl::StrCat("day", i)};
+    for (unsigned j = 0; j < 10; ++j)
+      add_args.push_back(absl::StrCat(i * 5 + j));
+    EXPECT_THAT(Run(absl::Span<string>{add_args}), IntArg(1));
+    count_args.push_back(add_args[1]);
+    merge_args.push_back(add_args[1]);
+  }
+
+  auto resp = Run(absl::Span<string>{count_args});
+  ASSERT_TRUE(resp.GetInt());
+  int64_t count = *resp.GetInt();
+  EXPECT_NEAR(count, 99 * 5 + 10, 5);
+  EXPECT_EQ(Run(absl::Span<string>{merge_args}), "OK");
+  EXPECT_EQ(CheckedInt({"pfcount", "dest"}), count);
+}
+
 }  // namespace dfly
@@ -0,0 +1,73 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/hot_key_cache.h"
+
+#include "server/engine_shard_set.h"
+#include "server/server_state.h"
+
+namespace dfly {
+
+using namespace std;
+
+HotKeyCache::EntryPtr HotKeyCache::Find(DbIndex db, string_view key) const {
+  if (db >= dbs_.size())
+    return nullptr;
+
+  auto it = dbs_[db].find(key);
+  if (it == dbs_[db].end())
+    return nullptr;
+
+  const EntryPtr& entry = it->second;
+  if (!entry->valid.load(memory_order_acquire))
+    return nullptr;
+
+  if (entry->expire_at_ms && entry->expire_at_ms <= GetCurrentTimeMs())
+    return nullptr;
+
+  return entry;
+}
+
+void HotKeyCache::Insert(DbIndex db, string_view key, EntryPtr entry) {
+  // The entry could have been invalidated before reaching this thread.
+  if (!entry->valid.load(memory_order_acquire))
+    return;
+
+  if (db >= dbs_.size())
+    dbs_.resize(db + 1);
+
+  auto [it, inserted] = dbs_[db].emplace(key, nullptr);
+  it->second = std::move(entry);
+  size_ += inserted;
+}
+
+void HotKeyCache::Erase(DbIndex db, string_view key, const Entry* entry) {
+  if (db >= dbs_.size())
+    return;
+
+  auto it = dbs_[db].find(key);
+  if (it != dbs_[db].end() && it->second.get() == entry) {
+    dbs_[db].erase(it);
+    size_--;
+  }
+}
+
+void HotKeyCache::Publish(DbIndex db, string_view key, EntryPtr entry) {
+  auto cb = [db, key = string{key}, entry = std::move(entry)](unsigned, util::ProactorBase*) {
+    ServerState::tlocal()->hot_key_cache()->Insert(db, key, entry);
+  };
+  shard_set->pool()->DispatchBrief(std::move(cb));
+}
+
+void HotKeyCache::Retract(DbIndex db, string_view key, EntryPtr entry) {
+  // Stop serving the value right away, the copies are erased asynchronously.
+  entry->valid.store(false, memory_order_release);
+
+  auto cb = [db, key = string{key}, entry = std::move(entry)](unsigned, util::ProactorBase*) {
+    ServerState::tlocal()->hot_key_cache()->Erase(db, key, entry.get());
+  };
+  shard_set->pool()->DispatchBrief(std::move(cb));
+}
+
+}  // namespace dfly
@@ -0,0 +1,73 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/container/flat_hash_map.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "server/common.h"
+
+namespace dfly {
+
+// Thread local cache of the values of hot string keys, used to serve GET on the coordinator
+// thread without a hop to the shard of the key.
+//
+// The shard that owns a key publishes an immutable copy of its value to all threads once the key
+// is read often without being written (see DbSlice::TrackHotRead). Before a write is applied the
+// shard marks the copy invalid, so that no thread serves it anymore, and only then retracts it
+// from all threads asynchronously.
+class HotKeyCache {
+ public:
+  struct Entry {
+    std::string value;
+    uint64_t expire_at_ms = 0;  // absolute expiry time, 0 if the key does not expire
+    std::atomic_bool valid{true};
+  };
+
+  using EntryPtr = std::shared_ptr<Entry>;
+
+  // Values larger than that are never replicated.
+  static constexpr size_t kMaxValueSize = 4096;
+
+  // Maximal number of hot keys tracked by a shard per db.
+  static constexpr size_t kMaxKeysPerDb = 64;
+
+  // Returns the entry of the key if it is cached, valid and not expired.
+  EntryPtr Find(DbIndex db, std::string_view key) const;
+
+  void Insert(DbIndex db, std::string_view key, EntryPtr entry);
+
+  // Erases the key only if it is still cached with the given entry.
+  void Erase(DbIndex db, std::string_view key, const Entry* entry);
+
+  bool Empty() const {
+    return size_ == 0;
+  }
+
+  size_t Size() const {
+    return size_;
+  }
+
+  // Called by the shard thread that owns the key.
+  static void Publish(DbIndex db, std::string_view key, EntryPtr entry);
+  static void Retract(DbIndex db, std::string_view key, EntryPtr entry);
+
+ private:
+  std::vector<absl::flat_hash_map<std::string, EntryPtr>> dbs_;
+  size_t size_ = 0;
+};
+
+// Tracking state of a hot key, kept by the db table of its shard.
+struct HotKeyState {
+  uint32_t reads = 0;  // reads since the key became hot or was last written
+  HotKeyCache::EntryPtr published;
+};
+
+}  // namespace dfly
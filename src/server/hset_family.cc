@@ -4,6 +4,9 @@
 
 #include "server/hset_family.h"
 
+#include <absl/container/inlined_vector.h>
+#include <absl/strings/match.h>
+
 extern "C" {
 #include "redis/listpack.h"
 #include "redis/object.h"
@@ -20,6 +23,7 @@ extern "C" {
 #include "server/container_utils.h"
 #include "server/engine_shard_set.h"
 #include "server/error.h"
+#include "server/generic_family.h"
 #include "server/search/doc_index.h"
 #include "server/transaction.h"
 
@@ -36,6 +40,8 @@ using IncrByParam = std::variant<double, int64_t>;
 using OptStr = std::optional<std::string>;
 enum GetAllMode : uint8_t { FIELDS = 1, VALUES = 2 };
 
+constexpr uint32_t kMaxFieldTtl = (1UL << 26);
+
 bool IsGoodForListpack(CmdArgList args, const uint8_t* lp) {
   size_t sum = 0;
   for (auto s : args) {
@@ -677,21 +683,17 @@ OpResult<uint32_t> OpSet(const OpArgs& op_args, string_view key, CmdArgList valu
   } else {
     DCHECK_EQ(kEncodingStrMap2, pv.Encoding());  // Dictionary
     StringMap* sm = GetStringMap(pv, op_args.db_cntx);
-    sm->Reserve(values.size() / 2);
-    bool added;
 
-    for (size_t i = 0; i < values.size(); i += 2) {
-      string_view field = ToSV(values[i]);
-      string_view value = ToSV(values[i + 1]);
-      if (op_sp.skip_if_exists)
-        added = sm->AddOrSkip(field, value, op_sp.ttl);
-      else
-        added = sm->AddOrUpdate(field, value, op_sp.ttl);
-
-      created += unsigned(added);
+    absl::InlinedVector<string_view, 32> field_values(values.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+      field_values[i] = ToSV(values[i]);
     }
+    created = sm->AddMany(field_values, op_sp.ttl, op_sp.skip_if_exists);
   }
 
+  if (op_sp.ttl != UINT32_MAX)
+    db_slice.TrackExpiringFields(op_args.db_cntx.db_index, key, pv);
+
   op_args.shard->search_indices()->AddDoc(key, op_args.db_cntx, pv);
 
   return created;
@@ -725,9 +727,8 @@ void HSetEx(CmdArgList args, ConnectionContext* cntx) {
   string_view key = ArgS(args, 0);
   string_view ttl_str = ArgS(args, 1);
   uint32_t ttl_sec;
-  constexpr uint32_t kMaxTtl = (1UL << 26);
 
-  if (!absl::SimpleAtoi(ttl_str, &ttl_sec) || ttl_sec == 0 || ttl_sec > kMaxTtl) {
+  if (!absl::SimpleAtoi(ttl_str, &ttl_sec) || ttl_sec == 0 || ttl_sec > kMaxFieldTtl) {
     return cntx->SendError(kInvalidIntErr);
   }
 
@@ -747,6 +748,255 @@ void HSetEx(CmdArgList args, ConnectionContext* cntx) {
   }
 }
 
+// Whether the NX/XX/GT/LT condition of HEXPIRE allows to change the expiry of a field from
+// current to expire_at. Fields without expiry have current = UINT32_MAX.
+bool FieldExpireCondHolds(int32_t flags, uint32_t current, uint32_t expire_at) {
+  if (flags & ExpireFlags::EXPIRE_NX)
+    return current == UINT32_MAX;
+  if (flags & ExpireFlags::EXPIRE_XX)
+    return current != UINT32_MAX;
+  if (flags & ExpireFlags::EXPIRE_GT)
+    return current != UINT32_MAX && expire_at > current;
+  if (flags & ExpireFlags::EXPIRE_LT)
+    return expire_at < current;
+  return true;
+}
+
+// Returns per field: -2 if it does not exist, 0 if the condition did not hold, 1 if the expiry
+// was set and 2 if the field was deleted because ttl_sec is 0.
+OpResult<vector<long>> OpExpireFields(const OpArgs& op_args, string_view key, uint32_t ttl_sec,
+                                      int32_t flags, CmdArgList fields) {
+  auto& db_slice = op_args.shard->db_slice();
+  auto it_res = db_slice.FindMutable(op_args.db_cntx, key, OBJ_HASH);
+  if (!it_res)
+    return it_res.status();
+
+  PrimeValue& pv = it_res->it->second;
+  vector<long> res(fields.size(), -2);
+  uint8_t intbuf[LP_INTBUF_SIZE];
+
+  // Listpack fields have no expiry, so the hash is converted once one of them gets it.
+  if (pv.Encoding() == kEncodingListPack && ttl_sec > 0 &&
+      (flags & (ExpireFlags::EXPIRE_XX | ExpireFlags::EXPIRE_GT)) == 0) {
+    uint8_t* lp = (uint8_t*)pv.RObjPtr();
+    bool found = any_of(fields.begin(), fields.end(),
+                        [&](auto field) { return LpFind(lp, ToSV(field), intbuf).has_value(); });
+    if (found) {
+      DbTableStats* stats = db_slice.MutableStats(op_args.db_cntx.db_index);
+      stats->listpack_blob_cnt--;
+      stats->listpack_bytes -= lpBytes(lp);
+      StringMap* sm = HSetFamily::ConvertToStrMap(lp);
+      lpFree(lp);
+      pv.InitRobj(OBJ_HASH, kEncodingStrMap2, sm);
+    }
+  }
+
+  uint32_t now = MemberTimeSeconds(op_args.db_cntx.time_now_ms);
+  CmdArgVec deleted;
+  bool expiry_set = false;
+
+  if (pv.Encoding() == kEncodingListPack) {
+    uint8_t* lp = (uint8_t*)pv.RObjPtr();
+    for (size_t i = 0; i < fields.size(); ++i) {
+      if (!LpFind(lp, ToSV(fields[i]), intbuf))
+        continue;
+
+      // Otherwise the hash would have been converted.
+      DCHECK(ttl_sec == 0 || !FieldExpireCondHolds(flags, UINT32_MAX, now + ttl_sec));
+      res[i] = FieldExpireCondHolds(flags, UINT32_MAX, now) ? 2 : 0;
+      if (res[i] == 2)
+        deleted.push_back(fields[i]);
+    }
+  } else {
+    DCHECK_EQ(pv.Encoding(), kEncodingStrMap2);
+    StringMap* sm = GetStringMap(pv, op_args.db_cntx);
+    for (size_t i = 0; i < fields.size(); ++i) {
+      auto it = sm->Find(ToSV(fields[i]));
+      if (it == sm->end())
+        continue;
+
+      if (!FieldExpireCondHolds(flags, it.ExpiryTime(), now + ttl_sec)) {
+        res[i] = 0;
+      } else if (ttl_sec == 0) {
+        res[i] = 2;
+        deleted.push_back(fields[i]);
+      } else {
+        it.SetExpiryTime(ttl_sec);
+        res[i] = 1;
+        expiry_set = true;
+      }
+    }
+  }
+
+  it_res->post_updater.Run();
+
+  if (expiry_set)
+    db_slice.TrackExpiringFields(op_args.db_cntx.db_index, key, pv);
+
+  if (!deleted.empty()) {
+    auto del_res = OpDel(op_args, key, absl::MakeSpan(deleted));
+    DCHECK(del_res);
+  }
+
+  return res;
+}
+
+// Returns per field: -2 if it does not exist, -1 if it has no expiry, otherwise its ttl.
+OpResult<vector<long>> OpFieldTtls(const OpArgs& op_args, string_view key, CmdArgList fields) {
+  auto& db_slice = op_args.shard->db_slice();
+  auto it_res = db_slice.FindReadOnly(op_args.db_cntx, key, OBJ_HASH);
+  if (!it_res)
+    return it_res.status();
+
+  vector<long> res(fields.size(), -2);
+  for (size_t i = 0; i < fields.size(); ++i) {
+    int32_t expire_at = HSetFamily::FieldExpireTime(op_args.db_cntx, (*it_res)->second,
+                                                    ToSV(fields[i]));
+    if (expire_at == -1)
+      res[i] = -1;
+    else if (expire_at >= 0)
+      res[i] = expire_at - MemberTimeSeconds(op_args.db_cntx.time_now_ms);
+  }
+  return res;
+}
+
+// Returns per field: -2 if it does not exist, -1 if it has no expiry and 1 if it was removed.
+OpResult<vector<long>> OpPersistFields(const OpArgs& op_args, string_view key,
+                                       CmdArgList fields) {
+  auto& db_slice = op_args.shard->db_slice();
+  auto it_res = db_slice.FindMutable(op_args.db_cntx, key, OBJ_HASH);
+  if (!it_res)
+    return it_res.status();
+
+  PrimeValue& pv = it_res->it->second;
+  vector<long> res(fields.size(), -2);
+
+  if (pv.Encoding() == kEncodingListPack) {
+    uint8_t intbuf[LP_INTBUF_SIZE];
+    for (size_t i = 0; i < fields.size(); ++i) {
+      if (LpFind((uint8_t*)pv.RObjPtr(), ToSV(fields[i]), intbuf))
+        res[i] = -1;
+    }
+  } else {
+    StringMap* sm = GetStringMap(pv, op_args.db_cntx);
+    for (size_t i = 0; i < fields.size(); ++i) {
+      auto it = sm->Find(ToSV(fields[i]));
+      if (it != sm->end())
+        res[i] = it.ClearExpiryTime() ? 1 : -1;
+    }
+  }
+
+  it_res->post_updater.Run();
+  return res;
+}
+
+// Parses the "FIELDS numfields field [field ...]" tail of the field expiry commands.
+optional<CmdArgList> ParseFieldsOrReply(CmdArgList args, ConnectionContext* cntx) {
+  if (args.size() < 2 || !absl::EqualsIgnoreCase(ArgS(args, 0), "FIELDS")) {
+    cntx->SendError("Mandatory argument FIELDS is missing or not at the right position");
+    return nullopt;
+  }
+
+  uint32_t num_fields;
+  if (!absl::SimpleAtoi(ArgS(args, 1), &num_fields) || num_fields == 0) {
+    cntx->SendError("Parameter `numFields` should be greater than 0");
+    return nullopt;
+  }
+
+  if (num_fields != args.size() - 2) {
+    cntx->SendError("The `numfields` parameter must match the number of arguments");
+    return nullopt;
+  }
+  return args.subspan(2);
+}
+
+void SendFieldResults(const OpResult<vector<long>>& result, size_t num_fields,
+                      ConnectionContext* cntx) {
+  if (!result && result.status() != OpStatus::KEY_NOTFOUND)
+    return cntx->SendError(result.status());
+
+  auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+  rb->StartArray(num_fields);
+  for (size_t i = 0; i < num_fields; ++i)
+    rb->SendLong(result ? (*result)[i] : -2);
+}
+
+// HEXPIRE key seconds [NX | XX | GT | LT] FIELDS numfields field [field ...]
+// HPEXPIRE key milliseconds [NX | XX | GT | LT] FIELDS numfields field [field ...]
+// Field expiry has a resolution of seconds, so milliseconds are rounded up.
+void HExpireGeneric(CmdArgList args, bool is_ms, ConnectionContext* cntx) {
+  string_view key = ArgS(args, 0);
+  int64_t ttl;
+  if (!absl::SimpleAtoi(ArgS(args, 1), &ttl))
+    return cntx->SendError(kInvalidIntErr);
+
+  uint64_t ttl_sec = is_ms ? (uint64_t(ttl) + 999) / 1000 : ttl;
+  if (ttl < 0 || ttl_sec > kMaxFieldTtl)
+    return cntx->SendError(InvalidExpireTime(cntx->cid->name()));
+
+  args.remove_prefix(2);
+  int32_t flags = ExpireFlags::EXPIRE_ALWAYS;
+  if (!args.empty() && !absl::EqualsIgnoreCase(ArgS(args, 0), "FIELDS")) {
+    ToUpper(&args[0]);
+    string_view cond = ArgS(args, 0);
+    if (cond == "NX") {
+      flags = ExpireFlags::EXPIRE_NX;
+    } else if (cond == "XX") {
+      flags = ExpireFlags::EXPIRE_XX;
+    } else if (cond == "GT") {
+      flags = ExpireFlags::EXPIRE_GT;
+    } else if (cond == "LT") {
+      flags = ExpireFlags::EXPIRE_LT;
+    } else {
+      return cntx->SendError(absl::StrCat("Unsupported option: ", cond));
+    }
+    args.remove_prefix(1);
+  }
+
+  optional<CmdArgList> fields = ParseFieldsOrReply(args, cntx);
+  if (!fields)
+    return;
+
+  auto cb = [&](Transaction* t, EngineShard* shard) {
+    return OpExpireFields(t->GetOpArgs(shard), key, ttl_sec, flags, *fields);
+  };
+  SendFieldResults(cntx->transaction->ScheduleSingleHopT(std::move(cb)), fields->size(), cntx);
+}
+
+void HExpire(CmdArgList args, ConnectionContext* cntx) {
+  HExpireGeneric(args, false, cntx);
+}
+
+void HPExpire(CmdArgList args, ConnectionContext* cntx) {
+  HExpireGeneric(args, true, cntx);
+}
+
+// HTTL key FIELDS numfields field [field ...]
+void HTtl(CmdArgList args, ConnectionContext* cntx) {
+  string_view key = ArgS(args, 0);
+  optional<CmdArgList> fields = ParseFieldsOrReply(args.subspan(1), cntx);
+  if (!fields)
+    return;
+
+  auto cb = [&](Transaction* t, EngineShard* shard) {
+    return OpFieldTtls(t->GetOpArgs(shard), key, *fields);
+  };
+  SendFieldResults(cntx->transaction->ScheduleSingleHopT(std::move(cb)), fields->size(), cntx);
+}
+
+// HPERSIST key FIELDS numfields field [field ...]
+void HPersist(CmdArgList args, ConnectionContext* cntx) {
+  string_view key = ArgS(args, 0);
+  optional<CmdArgList> fields = ParseFieldsOrReply(args.subspan(1), cntx);
+  if (!fields)
+    return;
+
+  auto cb = [&](Transaction* t, EngineShard* shard) {
+    return OpPersistFields(t->GetOpArgs(shard), key, *fields);
+  };
+  SendFieldResults(cntx->transaction->ScheduleSingleHopT(std::move(cb)), fields->size(), cntx);
+}
+
 }  // namespace
 
 void HSetFamily::HDel(CmdArgList args, ConnectionContext* cntx) {
@@ -1163,10 +1413,13 @@ namespace acl {
 constexpr uint32_t kHDel = WRITE | HASH | FAST;
 constexpr uint32_t kHLen = READ | HASH | FAST;
 constexpr uint32_t kHExists = READ | HASH | FAST;
+constexpr uint32_t kHExpire = WRITE | HASH | FAST;
+constexpr uint32_t kHPExpire = WRITE | HASH | FAST;
 constexpr uint32_t kHGet = READ | HASH | FAST;
 constexpr uint32_t kHGetAll = READ | HASH | SLOW;
 constexpr uint32_t kHMGet = READ | HASH | FAST;
 constexpr uint32_t kHMSet = WRITE | HASH | FAST;
+constexpr uint32_t kHPersist = WRITE | HASH | FAST;
 constexpr uint32_t kHIncrBy = WRITE | HASH | FAST;
 constexpr uint32_t kHIncrByFloat = WRITE | HASH | FAST;
 constexpr uint32_t kHKeys = READ | HASH | SLOW;
@@ -1176,6 +1429,7 @@ constexpr uint32_t kHSet = WRITE | HASH | FAST;
 constexpr uint32_t kHSetEx = WRITE | HASH | FAST;
 constexpr uint32_t kHSetNx = WRITE | HASH | FAST;
 constexpr uint32_t kHStrLen = READ | HASH | FAST;
+constexpr uint32_t kHTtl = READ | HASH | FAST;
 constexpr uint32_t kHVals = READ | HASH | SLOW;
 }  // namespace acl
 
@@ -1185,10 +1439,13 @@ void HSetFamily::Register(CommandRegistry* registry) {
       << CI{"HDEL", CO::FAST | CO::WRITE, -3, 1, 1, acl::kHDel}.HFUNC(HDel)
       << CI{"HLEN", CO::FAST | CO::READONLY, 2, 1, 1, acl::kHLen}.HFUNC(HLen)
       << CI{"HEXISTS", CO::FAST | CO::READONLY, 3, 1, 1, acl::kHExists}.HFUNC(HExists)
+      << CI{"HEXPIRE", CO::WRITE | CO::FAST, -6, 1, 1, acl::kHExpire}.SetHandler(HExpire)
       << CI{"HGET", CO::FAST | CO::READONLY, 3, 1, 1, acl::kHGet}.HFUNC(HGet)
       << CI{"HGETALL", CO::FAST | CO::READONLY, 2, 1, 1, acl::kHGetAll}.HFUNC(HGetAll)
       << CI{"HMGET", CO::FAST | CO::READONLY, -3, 1, 1, acl::kHMGet}.HFUNC(HMGet)
       << CI{"HMSET", CO::WRITE | CO::FAST | CO::DENYOOM, -4, 1, 1, acl::kHMSet}.HFUNC(HSet)
+      << CI{"HPERSIST", CO::WRITE | CO::FAST, -5, 1, 1, acl::kHPersist}.SetHandler(HPersist)
+      << CI{"HPEXPIRE", CO::WRITE | CO::FAST, -6, 1, 1, acl::kHPExpire}.SetHandler(HPExpire)
       << CI{"HINCRBY", CO::WRITE | CO::DENYOOM | CO::FAST, 4, 1, 1, acl::kHIncrBy}.HFUNC(HIncrBy)
       << CI{"HINCRBYFLOAT", CO::WRITE | CO::DENYOOM | CO::FAST, 4, 1, 1, acl::kHIncrByFloat}.HFUNC(
              HIncrByFloat)
@@ -1199,6 +1456,7 @@ void HSetFamily::Register(CommandRegistry* registry) {
       << CI{"HSETEX", CO::WRITE | CO::FAST | CO::DENYOOM, -5, 1, 1, acl::kHSetEx}.SetHandler(HSetEx)
       << CI{"HSETNX", CO::WRITE | CO::DENYOOM | CO::FAST, 4, 1, 1, acl::kHSetNx}.HFUNC(HSetNx)
       << CI{"HSTRLEN", CO::READONLY | CO::FAST, 3, 1, 1, acl::kHStrLen}.HFUNC(HStrLen)
+      << CI{"HTTL", CO::READONLY | CO::FAST, -5, 1, 1, acl::kHTtl}.SetHandler(HTtl)
       << CI{"HVALS", CO::READONLY, 2, 1, 1, acl::kHVals}.HFUNC(HVals);
 }
 
@@ -112,6 +112,28 @@ TEST_F(HSetFamilyTest, HSetNx) {
   EXPECT_EQ(Run({"hget", "key", "field2"}), "val2");
 }
 
+TEST_F(HSetFamilyTest, ListpackLookup) {
+  // Fields and values of all the small listpack encodings, some fields of the same length differ
+  // only in the middle.
+  vector<pair<string, string>> entries = {
+      {"", "empty"},     {"a", "1"},       {"aXb", "200"},         {"aYb", ""},
+      {"12", "-5000"},   {"-7", "v"},      {"100000", "1.5"},      {string(63, 'f'), "x"},
+      {"ba", "100000"},  {"ab", string(63, 'v')},
+  };
+  for (const auto& [field, value] : entries) {
+    Run({"hset", "key", field, value});
+  }
+  for (const auto& [field, value] : entries) {
+    EXPECT_EQ(Run({"hget", "key", field}), value) << field;
+  }
+  for (string_view field : {"aZb", "13", "b", "aXbc", "7"}) {
+    EXPECT_THAT(Run({"hget", "key", field}), ArgType(RespExpr::NIL)) << field;
+  }
+  EXPECT_EQ(1, CheckedInt({"hdel", "key", "aXb"}));
+  EXPECT_THAT(Run({"hget", "key", "aXb"}), ArgType(RespExpr::NIL));
+  EXPECT_EQ(Run({"hget", "key", "aYb"}), "");
+}
+
 TEST_F(HSetFamilyTest, HIncr) {
   EXPECT_EQ(10, CheckedInt({"hincrby", "key", "field", "10"}));
 
@@ -316,6 +338,54 @@ TEST_F(HSetFamilyTest, HSetEx) {
   EXPECT_THAT(Run({"HGET", "k", "f"}), ArgType(RespExpr::NIL));
 }
 
+TEST_F(HSetFamilyTest, HExpire) {
+  TEST_current_time_ms = kMemberExpiryBase * 1000;  // to reset to test time.
+
+  Run({"HSET", "k", "f1", "v1", "f2", "v2", "f3", "v3"});
+  EXPECT_THAT(Run({"HTTL", "k", "FIELDS", "2", "f1", "nf"}),
+              RespArray(ElementsAre(IntArg(-1), IntArg(-2))));
+  EXPECT_THAT(Run({"HTTL", "nk", "FIELDS", "1", "f1"}), IntArg(-2));
+
+  // The listpack is converted once a field gets an expiry
+  EXPECT_THAT(Run({"HEXPIRE", "k", "10", "XX", "FIELDS", "1", "f1"}), IntArg(0));
+  EXPECT_THAT(Run({"HEXPIRE", "k", "10", "FIELDS", "2", "f1", "nf"}),
+              RespArray(ElementsAre(IntArg(1), IntArg(-2))));
+  EXPECT_THAT(Run({"HTTL", "k", "FIELDS", "2", "f1", "f2"}),
+              RespArray(ElementsAre(IntArg(10), IntArg(-1))));
+
+  EXPECT_THAT(Run({"HEXPIRE", "k", "5", "NX", "FIELDS", "2", "f1", "f2"}),
+              RespArray(ElementsAre(IntArg(0), IntArg(1))));
+  EXPECT_THAT(Run({"HEXPIRE", "k", "20", "GT", "FIELDS", "2", "f1", "f3"}),
+              RespArray(ElementsAre(IntArg(1), IntArg(0))));
+  EXPECT_THAT(Run({"HPEXPIRE", "k", "2500", "LT", "FIELDS", "2", "f1", "f3"}),
+              RespArray(ElementsAre(IntArg(1), IntArg(1))));
+  EXPECT_THAT(Run({"HTTL", "k", "FIELDS", "3", "f1", "f2", "f3"}),
+              RespArray(ElementsAre(IntArg(3), IntArg(5), IntArg(3))));
+
+  EXPECT_THAT(Run({"HPERSIST", "k", "FIELDS", "3", "f3", "f3", "nf"}),
+              RespArray(ElementsAre(IntArg(1), IntArg(-1), IntArg(-2))));
+
+  AdvanceTime(3000);
+  EXPECT_THAT(Run({"HGETALL", "k"}), RespArray(UnorderedElementsAre("f2", "v2", "f3", "v3")));
+
+  // A zero ttl deletes the fields and the key with the last one
+  EXPECT_THAT(Run({"HEXPIRE", "k", "0", "FIELDS", "1", "f2"}), IntArg(2));
+  EXPECT_THAT(Run({"HEXPIRE", "k", "0", "FIELDS", "1", "f3"}), IntArg(2));
+  EXPECT_THAT(Run({"EXISTS", "k"}), IntArg(0));
+
+  Run({"HSET", "k", "f1", "v1"});
+  EXPECT_THAT(Run({"HEXPIRE", "k", "0", "FIELDS", "1", "f1"}), IntArg(2));
+  EXPECT_THAT(Run({"EXISTS", "k"}), IntArg(0));
+
+  EXPECT_THAT(Run({"HEXPIRE", "k", "10", "FIELDS", "2", "f1"}), ErrArg("numfields"));
+  EXPECT_THAT(Run({"HEXPIRE", "k", "10", "FIELDS", "0", "f1"}), ErrArg("numFields"));
+  EXPECT_THAT(Run({"HEXPIRE", "k", "10", "AB", "FIELDS", "1", "f1"}), ErrArg("Unsupported"));
+  EXPECT_THAT(Run({"HEXPIRE", "k", "-1", "FIELDS", "1", "f1"}), ErrArg("invalid expire time"));
+  EXPECT_THAT(Run({"HTTL", "k", "FIELD", "1", "f1"}), ErrArg("FIELDS is missing"));
+  Run({"SET", "s", "v"});
+  EXPECT_THAT(Run({"HTTL", "s", "FIELDS", "1", "f1"}), ErrArg("WRONGTYPE"));
+}
+
 TEST_F(HSetFamilyTest, TriggerConvertToStrMap) {
   const int kElements = 200;
   // Enough for IsGoodForListpack to become false
@@ -357,4 +427,77 @@ TEST_F(HSetFamilyTest, RandomField1NotExpired) {
   EXPECT_THAT(Run({"HRANDFIELD", "key"}), "keep");
 }
 
+TEST_F(HSetFamilyTest, BackgroundFieldExpiry) {
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(CheckedInt({"HSETEX", "key", "10", absl::StrCat("k", i), "v"}), 1);
+  }
+  EXPECT_EQ(CheckedInt({"HSET", "key", "keep", "v"}), 1);
+
+  AdvanceTime(10'000);
+  shard_set->RunBriefInParallel([](EngineShard* es) {
+    DbContext cntx{.db_index = 0, .time_now_ms = TEST_current_time_ms};
+    es->db_slice().DeleteExpiredFieldsStep(cntx, 1024);
+  });
+
+  // HLEN does not expire the fields by itself, so it sees only the background deletions.
+  EXPECT_THAT(Run({"HLEN", "key"}), IntArg(1));
+  EXPECT_EQ(100u, GetMetrics().events.expired_fields);
+}
+
+TEST_F(HSetFamilyTest, BackgroundFieldExpiryAfterRename) {
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(CheckedInt({"HSETEX", "key", "10", absl::StrCat("k", i), "v"}), 1);
+  }
+  EXPECT_EQ(CheckedInt({"HSET", "key", "keep", "v"}), 1);
+
+  EXPECT_EQ(Run({"RENAME", "key", "tmp"}), "OK");
+  EXPECT_THAT(Run({"RENAMENX", "tmp", "renamed"}), IntArg(1));
+
+  AdvanceTime(10'000);
+  shard_set->RunBriefInParallel([](EngineShard* es) {
+    DbContext cntx{.db_index = 0, .time_now_ms = TEST_current_time_ms};
+    es->db_slice().DeleteExpiredFieldsStep(cntx, 1024);
+  });
+
+  EXPECT_THAT(Run({"HLEN", "renamed"}), IntArg(1));
+  EXPECT_EQ(100u, GetMetrics().events.expired_fields);
+}
+
+TEST_F(HSetFamilyTest, ShrinkToListpack) {
+  string val(30, 'v');
+  for (int i = 0; i < 40; ++i) {
+    Run({"HSET", "key", absl::StrCat("f", i), val});
+    Run({"HSET", "ttl", absl::StrCat("f", i), val});
+  }
+  Run({"HEXPIRE", "ttl", "100", "FIELDS", "1", "f0"});
+  EXPECT_EQ(0u, GetMetrics().db_stats[0].listpack_blob_cnt);
+
+  auto shrink = [] {
+    atomic_uint changed = 0;
+    shard_set->RunBlockingInParallel(
+        [&](EngineShard* es) { changed += es->db_slice().ShrinkEncodingsStep(0, 1024, 0.5); });
+    return changed.load();
+  };
+
+  // Still above half of the listpack limit.
+  for (int i = 0; i < 20; ++i) {
+    Run({"HDEL", "key", absl::StrCat("f", i)});
+    Run({"HDEL", "ttl", absl::StrCat("f", i + 1)});
+  }
+  EXPECT_EQ(0u, shrink());
+
+  // Fields with expiry time keep the hash in its native encoding.
+  for (int i = 20; i < 35; ++i) {
+    Run({"HDEL", "key", absl::StrCat("f", i)});
+    Run({"HDEL", "ttl", absl::StrCat("f", i + 1)});
+  }
+  EXPECT_EQ(1u, shrink());
+  EXPECT_EQ(1u, GetMetrics().db_stats[0].listpack_blob_cnt);
+
+  EXPECT_THAT(Run({"HLEN", "key"}), IntArg(5));
+  EXPECT_EQ(Run({"HGET", "key", "f39"}), val);
+  EXPECT_THAT(Run({"HSET", "key", "new", "v"}), IntArg(1));
+  EXPECT_THAT(Run({"HLEN", "key"}), IntArg(6));
+}
+
 }  // namespace dfly
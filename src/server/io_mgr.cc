@@ -5,14 +5,23 @@
 #include "server/io_mgr.h"
 
 #include <fcntl.h>
+#include <linux/falloc.h>
+#include <sys/stat.h>
 #include <mimalloc.h>
 
+#include <numeric>
+
 #include "base/flags.h"
 #include "base/logging.h"
+#include "core/fibers.h"
 #include "facade/facade_types.h"
 #include "util/fibers/uring_proactor.h"
 
 ABSL_FLAG(bool, backing_file_direct, false, "If true uses O_DIRECT to open backing files");
+ABSL_FLAG(uint32_t, tiered_write_latency_target_usec, 5000,
+          "If positive, fewer tiered storage writes are kept in flight while their latency "
+          "exceeds this target, down to a few of them. 0 keeps up to "
+          "tiered_storage_max_pending_writes in flight regardless of their latency.");
 
 namespace dfly {
 
@@ -31,6 +40,12 @@ constexpr inline size_t alignup(size_t num, size_t align) {
   return (num + amask) & (~amask);
 }
 
+// The write depth controller does not go below it, so that the latency is still sampled.
+constexpr unsigned kMinWriteDepth = 4;
+
+// Maximal number of writes coalesced into a single vectored write.
+constexpr size_t kMaxWriteRun = 64;
+
 }  // namespace
 
 IoMgr::IoMgr() {
@@ -39,10 +54,13 @@ IoMgr::IoMgr() {
 
 constexpr size_t kInitialSize = 1UL << 28;  // 256MB
 
-error_code IoMgr::Open(const string& path) {
+error_code IoMgr::Open(const string& path, bool keep_contents) {
   CHECK(!backing_file_);
 
-  int kFlags = O_CREAT | O_RDWR | O_TRUNC | O_CLOEXEC;
+  int kFlags = O_CREAT | O_RDWR | O_CLOEXEC;
+  if (!keep_contents) {
+    kFlags |= O_TRUNC;
+  }
   if (absl::GetFlag(FLAGS_backing_file_direct)) {
     kFlags |= O_DIRECT;
   }
@@ -50,10 +68,20 @@ error_code IoMgr::Open(const string& path) {
   if (!res)
     return res.error();
   backing_file_ = std::move(res.value());
+
+  size_t size = kInitialSize;
+  if (keep_contents) {
+    struct stat st;
+    if (fstat(backing_file_->fd(), &st) != 0) {
+      return error_code{errno, system_category()};
+    }
+    size = max(size, alignup(st.st_size, kInitialSize));
+  }
+
   Proactor* proactor = (Proactor*)ProactorBase::me();
   {
     fb2::FiberCall fc(proactor);
-    fc->PrepFallocate(backing_file_->fd(), 0, 0, kInitialSize);
+    fc->PrepFallocate(backing_file_->fd(), 0, 0, size);
     fb2::FiberCall::IoResult io_res = fc.Get();
     if (io_res < 0) {
       return error_code{-io_res, system_category()};
@@ -67,7 +95,7 @@ error_code IoMgr::Open(const string& path) {
       return error_code{-io_res, system_category()};
     }
   }
-  sz_ = kInitialSize;
+  sz_ = size;
   return error_code{};
 }
 
@@ -98,14 +126,120 @@ error_code IoMgr::WriteAsync(size_t offset, string_view blob, WriteCb cb) {
   DCHECK(!blob.empty());
   VLOG(1) << "WriteAsync " << offset << "/" << blob.size();
 
+  // The writes issued until the fiber yields, for example by the flushes of one command, are
+  // collected so that the adjacent pages are written together.
+  queued_writes_.push_back(PendingWrite{offset, blob, std::move(cb)});
+  ++writes_in_flight_;
+  if (!flags.writes_queued) {
+    flags.writes_queued = 1;
+    ProactorBase::me()->DispatchBrief([this] { SubmitWrites(); });
+  }
+
+  return error_code{};
+}
+
+void IoMgr::SubmitWrites() {
+  flags.writes_queued = 0;
+  vector<PendingWrite> writes = std::move(queued_writes_);
+  queued_writes_.clear();
+
+  sort(writes.begin(), writes.end(),
+       [](const PendingWrite& a, const PendingWrite& b) { return a.offset < b.offset; });
+
+  vector<PendingWrite> run;
+  for (PendingWrite& write : writes) {
+    bool adjacent = !run.empty() && write.offset == run.back().offset + run.back().blob.size();
+    if (!run.empty() && (!adjacent || run.size() == kMaxWriteRun)) {
+      SubmitWriteRun(std::move(run));
+      run.clear();
+    }
+    run.push_back(std::move(write));
+  }
+  SubmitWriteRun(std::move(run));
+}
+
+void IoMgr::SubmitWriteRun(vector<PendingWrite> run) {
+  DCHECK(!run.empty());
   Proactor* proactor = (Proactor*)ProactorBase::me();
+  uint64_t from_ts = ProactorBase::GetMonotonicTimeNs();
 
-  auto ring_cb = [cb = std::move(cb)](auto*, Proactor::IoResult res, uint32_t flags) { cb(res); };
+  ++stats_.write_total;
+  stats_.coalesced_write_total += run.size() - 1;
+
+  if (run.size() == 1) {
+    auto ring_cb = [this, from_ts, cb = std::move(run[0].cb)](auto*, Proactor::IoResult res,
+                                                                uint32_t flags) {
+      AdjustWriteDepth((ProactorBase::GetMonotonicTimeNs() - from_ts) / 1000);
+      --writes_in_flight_;
+      cb(res);
+    };
+
+    SubmitEntry se = proactor->GetSubmitEntry(std::move(ring_cb), 0);
+    se.PrepWrite(backing_file_->fd(), run[0].blob.data(), run[0].blob.size(), run[0].offset);
+    return;
+  }
+
+  // The iovecs must stay valid until the write completes.
+  struct WriteRun {
+    vector<PendingWrite> writes;
+    vector<iovec> iov;
+  };
+  auto* wr = new WriteRun{std::move(run), {}};
+  wr->iov.reserve(wr->writes.size());
+  for (const PendingWrite& write : wr->writes) {
+    wr->iov.push_back(iovec{const_cast<char*>(write.blob.data()), write.blob.size()});
+  }
+
+  auto ring_cb = [this, from_ts, wr](auto*, Proactor::IoResult res, uint32_t flags) {
+    AdjustWriteDepth((ProactorBase::GetMonotonicTimeNs() - from_ts) / 1000);
+
+    // A short write fails the writes that it did not cover.
+    size_t written = res > 0 ? size_t(res) : 0;
+    for (PendingWrite& write : wr->writes) {
+      --writes_in_flight_;
+      if (res < 0) {
+        write.cb(res);
+      } else if (written >= write.blob.size()) {
+        written -= write.blob.size();
+        write.cb(int(write.blob.size()));
+      } else {
+        written = 0;
+        write.cb(-EIO);
+      }
+    }
+    delete wr;
+  };
 
   SubmitEntry se = proactor->GetSubmitEntry(std::move(ring_cb), 0);
-  se.PrepWrite(backing_file_->fd(), blob.data(), blob.size(), offset);
+  se.PrepWriteV(backing_file_->fd(), wr->iov.data(), wr->iov.size(), wr->writes[0].offset);
+}
 
-  return error_code{};
+void IoMgr::AdjustWriteDepth(uint64_t latency_usec) {
+  stats_.write_delay_usec += latency_usec;
+
+  uint32_t target = absl::GetFlag(FLAGS_tiered_write_latency_target_usec);
+  if (target == 0) {
+    write_depth_ = 0;
+    return;
+  }
+
+  uint64_t now = ProactorBase::GetMonotonicTimeNs();
+  if (latency_usec > target) {
+    // The writes submitted before the decrease complete late as well, so they are ignored.
+    if (now >= next_decrease_ns_) {
+      unsigned depth = write_depth_ ? write_depth_ : max(writes_in_flight_, kMinWriteDepth);
+      write_depth_ = max(depth * 3 / 4, kMinWriteDepth);
+      depth_credit_ = 0;
+      next_decrease_ns_ = now + latency_usec * 1000;
+    }
+    return;
+  }
+
+  // Grows only while the depth limits the writes in flight.
+  if (write_depth_ && writes_in_flight_ >= write_depth_ && ++depth_credit_ >= write_depth_) {
+    ++write_depth_;
+    depth_credit_ = 0;
+  }
 }
 
 error_code IoMgr::Read(size_t offset, io::MutableBytes dest) {
@@ -146,8 +280,94 @@ error_code IoMgr::Read(size_t offset, io::MutableBytes dest) {
   return ec;
 }
 
+error_code IoMgr::PunchHoleAsync(size_t offset, size_t len, WriteCb cb) {
+  DCHECK_GT(len, 0u);
+  VLOG(1) << "PunchHoleAsync " << offset << "/" << len;
+
+  Proactor* proactor = (Proactor*)ProactorBase::me();
+
+  auto ring_cb = [cb = std::move(cb)](auto*, Proactor::IoResult res, uint32_t flags) { cb(res); };
+
+  SubmitEntry se = proactor->GetSubmitEntry(std::move(ring_cb), 0);
+  se.PrepFallocate(backing_file_->fd(), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, len);
+
+  return error_code{};
+}
+
+error_code IoMgr::ReadMany(absl::Span<const ReadRequest> reqs) {
+  if (reqs.empty())
+    return error_code{};
+
+  vector<unsigned> order(reqs.size());
+  iota(order.begin(), order.end(), 0);
+  sort(order.begin(), order.end(),
+       [&](unsigned a, unsigned b) { return reqs[a].offset < reqs[b].offset; });
+
+  // Page aligned ranges, each one covers one or more requests. The alignment is needed
+  // for O_DIRECT and costs nothing otherwise.
+  struct Range {
+    size_t start;
+    size_t end;
+    uint8_t* space = nullptr;
+  };
+  vector<Range> ranges;
+  vector<unsigned> range_of(reqs.size());
+  for (unsigned i : order) {
+    DCHECK(!reqs[i].dest.empty());
+    size_t start = reqs[i].offset & ~4095ULL;
+    size_t end = alignup(reqs[i].offset + reqs[i].dest.size(), 4096);
+    if (!ranges.empty() && start <= ranges.back().end) {
+      ranges.back().end = max(ranges.back().end, end);
+    } else {
+      ranges.push_back(Range{start, end});
+    }
+    range_of[i] = ranges.size() - 1;
+  }
+
+  Proactor* proactor = (Proactor*)ProactorBase::me();
+  BlockingCounter bc{unsigned(ranges.size())};
+  error_code ec;
+  uint64_t from_ts = ProactorBase::GetMonotonicTimeNs();
+
+  for (Range& range : ranges) {
+    size_t len = range.end - range.start;
+    range.space = (uint8_t*)mi_malloc_aligned(len, 4096);
+
+    auto ring_cb = [&ec, bc, len](auto*, Proactor::IoResult res, uint32_t) mutable {
+      if (res < 0) {
+        ec = error_code{-res, system_category()};
+      } else if (size_t(res) < len) {
+        ec = make_error_code(errc::io_error);
+      }
+      bc.Dec();
+    };
+
+    SubmitEntry se = proactor->GetSubmitEntry(std::move(ring_cb), 0);
+    se.PrepRead(backing_file_->fd(), range.space, len, range.start);
+  }
+
+  bc.Wait();
+  uint64_t end_ts = ProactorBase::GetMonotonicTimeNs();
+
+  stats_.read_delay_usec += (end_ts - from_ts) / 1000;
+  stats_.read_total += ranges.size();
+
+  if (!ec) {
+    for (size_t i = 0; i < reqs.size(); ++i) {
+      const Range& range = ranges[range_of[i]];
+      memcpy(reqs[i].dest.data(), range.space + reqs[i].offset - range.start,
+             reqs[i].dest.size());
+    }
+  }
+
+  for (const Range& range : ranges) {
+    mi_free_size_aligned(range.space, range.end - range.start, 4096);
+  }
+  return ec;
+}
+
 void IoMgr::Shutdown() {
-  while (flags_val) {
+  while (flags_val || writes_in_flight_) {
     ThisFiber::SleepFor(200us);  // TODO: hacky for now.
   }
 }
@@ -4,8 +4,12 @@
 
 #pragma once
 
+#include <absl/types/span.h>
+
+#include <algorithm>
 #include <functional>
 #include <string>
+#include <vector>
 
 #include "server/common.h"
 #include "util/fibers/uring_file.h"
@@ -27,7 +31,8 @@ class IoMgr {
   // blocks until all the pending requests are finished.
   void Shutdown();
 
-  std::error_code Open(const std::string& path);
+  // If keep_contents is true, an existing file is not truncated and the span covers all of it.
+  std::error_code Open(const std::string& path, bool keep_contents = false);
 
   // Grows file by that length. len must be divided by 1MB.
   // passing other values will check-fail.
@@ -35,14 +40,36 @@ class IoMgr {
 
   // Returns error if submission failed. Otherwise - returns the io result
   // via cb. A caller must make sure that the blob exists until cb is called.
+  // The writes are submitted once the calling fiber yields, those of adjacent ranges together
+  // as a single vectored write.
   std::error_code WriteAsync(size_t offset, std::string_view blob, WriteCb cb);
   std::error_code Read(size_t offset, io::MutableBytes dest);
 
+  struct ReadRequest {
+    size_t offset;
+    io::MutableBytes dest;
+  };
+
+  // Submits all the reads together and blocks until they complete. Requests that touch the same
+  // or adjacent pages are coalesced into a single read. Returns the first error.
+  std::error_code ReadMany(absl::Span<const ReadRequest> reqs);
+
+  // Deallocates the disk space of the range, keeping the file size. The range is read as
+  // zeroes afterwards. Returns the io result via cb.
+  std::error_code PunchHoleAsync(size_t offset, size_t len, WriteCb cb);
+
   // Total file span
   size_t Span() const {
     return sz_;
   }
 
+  // The number of writes that should be in flight, at most max_depth. When the latency of the
+  // writes exceeds --tiered_write_latency_target_usec, it shrinks by a quarter at most once per
+  // latency period, and grows back by one write per round of writes that complete in time.
+  unsigned WriteDepth(unsigned max_depth) const {
+    return write_depth_ ? std::min(write_depth_, max_depth) : max_depth;
+  }
+
   bool grow_pending() const {
     return flags.grow_progress;
   }
@@ -52,13 +79,36 @@ class IoMgr {
   }
 
  private:
+  struct PendingWrite {
+    size_t offset;
+    std::string_view blob;
+    WriteCb cb;
+  };
+
+  // Submits the queued writes.
+  void SubmitWrites();
+
+  // Submits the adjacent writes as a single one.
+  void SubmitWriteRun(std::vector<PendingWrite> run);
+
+  void AdjustWriteDepth(uint64_t latency_usec);
+
   std::unique_ptr<util::fb2::LinuxFile> backing_file_;
   size_t sz_ = 0;
 
+  std::vector<PendingWrite> queued_writes_;
+  unsigned writes_in_flight_ = 0;
+
+  // 0 if the writes are not limited by their latency.
+  unsigned write_depth_ = 0;
+  unsigned depth_credit_ = 0;  // completed writes since write_depth_ grew.
+  uint64_t next_decrease_ns_ = 0;
+
   union {
     uint8_t flags_val;
     struct {
       uint8_t grow_progress : 1;
+      uint8_t writes_queued : 1;
     } flags;
   };
 
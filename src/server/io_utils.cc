@@ -4,15 +4,23 @@
 
 #include "server/io_utils.h"
 
+#include <absl/base/internal/endian.h>
+#include <lz4frame.h>
+
 #include "base/flags.h"
+#include "base/logging.h"
 #include "server/error.h"
+#include "util/fibers/proactor_base.h"
 
 using namespace std;
 
 namespace dfly {
 
 io::Result<size_t> BufferedStreamerBase::WriteSome(const iovec* vec, uint32_t len) {
-  return io::BufSink{&producer_buf_}.WriteSome(vec, len);
+  auto res = io::BufSink{&producer_buf_}.WriteSome(vec, len);
+  if (res)
+    bytes_written_ += *res;
+  return res;
 }
 
 void BufferedStreamerBase::NotifyWritten(bool allow_await) {
@@ -80,4 +88,162 @@ size_t BufferedStreamerBase::GetTotalBufferCapacities() const {
   return consumer_buf_.Capacity() + producer_buf_.Capacity();
 }
 
+Lz4FrameSink::Lz4FrameSink(io::Sink* upstream) : upstream_(upstream) {
+  auto res = LZ4F_createCompressionContext(&cctx_, LZ4F_VERSION);
+  CHECK(!LZ4F_isError(res));
+}
+
+Lz4FrameSink::~Lz4FrameSink() {
+  LZ4F_freeCompressionContext(cctx_);
+}
+
+io::Result<size_t> Lz4FrameSink::WriteSome(const iovec* v, uint32_t len) {
+  uint64_t start = util::fb2::ProactorBase::GetMonotonicTimeNs();
+
+  size_t in_len = 0;
+  for (uint32_t i = 0; i < len; ++i)
+    in_len += v[i].iov_len;
+
+  // The bound covers the flush of the data buffered by the previous updates.
+  buf_.resize(LZ4F_HEADER_SIZE_MAX + LZ4F_compressBound(in_len, nullptr));
+  size_t out_len = 0;
+  if (!started_) {
+    size_t res = LZ4F_compressBegin(cctx_, buf_.data(), buf_.size(), nullptr);
+    if (LZ4F_isError(res))
+      return nonstd::make_unexpected(std::make_error_code(std::errc::invalid_argument));
+    out_len += res;
+    started_ = true;
+  }
+
+  for (uint32_t i = 0; i < len; ++i) {
+    size_t res = LZ4F_compressUpdate(cctx_, buf_.data() + out_len, buf_.size() - out_len,
+                                     v[i].iov_base, v[i].iov_len, nullptr);
+    if (LZ4F_isError(res))
+      return nonstd::make_unexpected(std::make_error_code(std::errc::invalid_argument));
+    out_len += res;
+  }
+
+  size_t res = LZ4F_flush(cctx_, buf_.data() + out_len, buf_.size() - out_len, nullptr);
+  if (LZ4F_isError(res))
+    return nonstd::make_unexpected(std::make_error_code(std::errc::invalid_argument));
+  out_len += res;
+
+  uint64_t usec = (util::fb2::ProactorBase::GetMonotonicTimeNs() - start) / 1000;
+  stats_.compress_usec.fetch_add(usec, memory_order_relaxed);
+  stats_.in_bytes.fetch_add(in_len, memory_order_relaxed);
+  stats_.out_bytes.fetch_add(out_len, memory_order_relaxed);
+
+  if (auto ec = upstream_->Write(io::Bytes{buf_.data(), out_len}); ec)
+    return nonstd::make_unexpected(ec);
+  return in_len;
+}
+
+Lz4FrameSource::Lz4FrameSource(io::Source* upstream) : upstream_(upstream) {
+  auto res = LZ4F_createDecompressionContext(&dctx_, LZ4F_VERSION);
+  CHECK(!LZ4F_isError(res));
+}
+
+Lz4FrameSource::~Lz4FrameSource() {
+  LZ4F_freeDecompressionContext(dctx_);
+}
+
+io::Result<size_t> Lz4FrameSource::ReadSome(const iovec* v, uint32_t len) {
+  if (len == 0)
+    return 0;
+
+  while (true) {
+    // The frame header and the block headers produce no output, continue with the rest.
+    while (in_buf_.InputLen() > 0) {
+      size_t src_size = in_buf_.InputLen();
+      size_t dest_size = v[0].iov_len;
+      size_t res = LZ4F_decompress(dctx_, v[0].iov_base, &dest_size, in_buf_.InputBuffer().data(),
+                                   &src_size, nullptr);
+      if (LZ4F_isError(res)) {
+        LOG(ERROR) << "Could not decompress the stream: " << LZ4F_getErrorName(res);
+        return nonstd::make_unexpected(make_error_code(std::errc::illegal_byte_sequence));
+      }
+      in_buf_.ConsumeInput(src_size);
+      if (dest_size > 0)
+        return dest_size;
+    }
+
+    in_buf_.EnsureCapacity(4096);
+    io::MutableBytes dest = in_buf_.AppendBuffer();
+    iovec read_v{dest.data(), dest.size()};
+    io::Result<size_t> res = upstream_->ReadSome(&read_v, 1);
+    if (!res || *res == 0)
+      return res;
+    in_buf_.CommitWrite(*res);
+  }
+}
+
+StripedSink::StripedSink(std::vector<io::Sink*> stripes) : stripes_(std::move(stripes)) {
+  DCHECK(!stripes_.empty() && stripes_.size() <= kMaxStripes);
+}
+
+io::Result<size_t> StripedSink::WriteSome(const iovec* v, uint32_t len) {
+  size_t total = 0;
+  for (uint32_t i = 0; i < len; ++i) {
+    const uint8_t* data = static_cast<const uint8_t*>(v[i].iov_base);
+    for (size_t offs = 0; offs < v[i].iov_len; offs += kChunkSize) {
+      size_t size = min(kChunkSize, v[i].iov_len - offs);
+      if (auto ec = WriteChunk(io::Bytes{data + offs, size}); ec)
+        return nonstd::make_unexpected(ec);
+    }
+    total += v[i].iov_len;
+  }
+  return total;
+}
+
+error_code StripedSink::Finish() {
+  return WriteChunk({});
+}
+
+error_code StripedSink::WriteChunk(io::Bytes data) {
+  uint8_t header[4];
+  absl::little_endian::Store32(header, data.size());
+  iovec parts[2] = {{header, sizeof(header)}, {const_cast<uint8_t*>(data.data()), data.size()}};
+
+  io::Sink* sink = stripes_[next_];
+  next_ = (next_ + 1) % stripes_.size();
+  return sink->Write(parts, data.empty() ? 1 : 2);
+}
+
+StripedSource::StripedSource(std::vector<io::Source*> stripes) : stripes_(std::move(stripes)) {
+  DCHECK(!stripes_.empty());
+}
+
+io::Result<size_t> StripedSource::ReadSome(const iovec* v, uint32_t len) {
+  if (len == 0 || v[0].iov_len == 0 || done_)
+    return 0;
+
+  io::Source* source = stripes_[next_];
+  if (chunk_left_ == 0) {
+    uint8_t header[4];
+    io::Result<size_t> res = source->ReadAtLeast(io::MutableBytes{header}, sizeof(header));
+    if (!res)
+      return res;
+    if (*res < sizeof(header))
+      return nonstd::make_unexpected(make_error_code(errc::connection_aborted));
+
+    chunk_left_ = absl::little_endian::Load32(header);
+    if (chunk_left_ == 0) {
+      done_ = true;
+      return 0;
+    }
+  }
+
+  iovec read_v{v[0].iov_base, min<size_t>(v[0].iov_len, chunk_left_)};
+  io::Result<size_t> res = source->ReadSome(&read_v, 1);
+  if (!res)
+    return res;
+  if (*res == 0)
+    return nonstd::make_unexpected(make_error_code(errc::connection_aborted));
+
+  chunk_left_ -= *res;
+  if (chunk_left_ == 0)
+    next_ = (next_ + 1) % stripes_.size();
+  return *res;
+}
+
 }  // namespace dfly
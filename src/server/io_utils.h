@@ -2,11 +2,17 @@
 // See LICENSE for licensing terms.
 //
 
+#include <atomic>
+#include <vector>
+
 #include "base/io_buf.h"
 #include "core/fibers.h"
 #include "io/io.h"
 #include "server/common.h"
 
+struct LZ4F_cctx_s;
+struct LZ4F_dctx_s;
+
 namespace dfly {
 
 // Base for constructing buffered byte streams with backpressure
@@ -63,9 +69,15 @@ class BufferedStreamerBase : public io::Sink {
   // Whether the producer stopped or the context was cancelled.
   bool IsStopped();
 
+  // Bytes written by the producer so far.
+  uint64_t bytes_written() const {
+    return bytes_written_;
+  }
+
  protected:
   bool producer_done_ = false;  // whether producer is done
   unsigned buffered_ = 0;       // how many entries are buffered
+  uint64_t bytes_written_ = 0;
   EventCount waker_;            // two sided waker
 
   const Cancellation* cll_;  // global cancellation
@@ -76,4 +88,83 @@ class BufferedStreamerBase : public io::Sink {
   base::IoBuf producer_buf_, consumer_buf_;  // Two buffers that are swapped in turns.
 };
 
+// Compresses the data written to it into a single LZ4 frame written to upstream. Every write
+// is flushed, so that the reader can decompress the data of a write as soon as it arrives.
+class Lz4FrameSink : public io::Sink {
+ public:
+  // Updated by the writing thread and read by others.
+  struct Stats {
+    std::atomic_uint64_t in_bytes{0};
+    std::atomic_uint64_t out_bytes{0};
+    std::atomic_uint64_t compress_usec{0};
+  };
+
+  explicit Lz4FrameSink(io::Sink* upstream);
+  ~Lz4FrameSink();
+
+  io::Result<size_t> WriteSome(const iovec* v, uint32_t len) final;
+
+  const Stats& stats() const {
+    return stats_;
+  }
+
+ private:
+  io::Sink* upstream_;
+  LZ4F_cctx_s* cctx_;
+  bool started_ = false;
+  std::vector<uint8_t> buf_;
+  Stats stats_;
+};
+
+// Decompresses the LZ4 frame written by Lz4FrameSink.
+class Lz4FrameSource : public io::Source {
+ public:
+  explicit Lz4FrameSource(io::Source* upstream);
+  ~Lz4FrameSource();
+
+  io::Result<size_t> ReadSome(const iovec* v, uint32_t len) final;
+
+ private:
+  io::Source* upstream_;
+  LZ4F_dctx_s* dctx_;
+  base::IoBuf in_buf_{16 * 1024};
+};
+
+// Stripes the data written to it over several sinks, so that a stream is not limited by the
+// throughput of a single connection. The writes are split to chunks prefixed by their length,
+// that are written to the sinks in turns.
+class StripedSink : public io::Sink {
+ public:
+  static constexpr unsigned kMaxStripes = 16;
+  static constexpr size_t kChunkSize = 64 * 1024;
+
+  explicit StripedSink(std::vector<io::Sink*> stripes);
+
+  io::Result<size_t> WriteSome(const iovec* v, uint32_t len) final;
+
+  // Writes the empty chunk that ends the stream.
+  std::error_code Finish();
+
+ private:
+  std::error_code WriteChunk(io::Bytes data);
+
+  std::vector<io::Sink*> stripes_;
+  size_t next_ = 0;  // the stripe of the next chunk
+};
+
+// Reads the chunks written by StripedSink from the sources of its stripes, in the same order.
+// The sources are never read past the end of the stream.
+class StripedSource : public io::Source {
+ public:
+  explicit StripedSource(std::vector<io::Source*> stripes);
+
+  io::Result<size_t> ReadSome(const iovec* v, uint32_t len) final;
+
+ private:
+  std::vector<io::Source*> stripes_;
+  size_t next_ = 0;         // the stripe of the current chunk
+  uint32_t chunk_left_ = 0;  // bytes left to read in the current chunk
+  bool done_ = false;
+};
+
 }  // namespace dfly
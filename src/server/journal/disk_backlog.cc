@@ -0,0 +1,228 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/journal/disk_backlog.h"
+
+#include <absl/base/internal/endian.h>
+#include <absl/strings/match.h>
+#include <absl/strings/str_cat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <filesystem>
+
+#include "base/logging.h"
+
+namespace dfly {
+namespace journal {
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace {
+
+error_code LastError() {
+  return error_code{errno, system_category()};
+}
+
+error_code PWrite(int fd, string_view data, size_t offset) {
+  while (!data.empty()) {
+    ssize_t res = pwrite(fd, data.data(), data.size(), offset);
+    if (res < 0) {
+      if (errno == EINTR)
+        continue;
+      return LastError();
+    }
+    data.remove_prefix(res);
+    offset += res;
+  }
+  return {};
+}
+
+error_code PRead(int fd, size_t offset, size_t len, char* dest) {
+  while (len > 0) {
+    ssize_t res = pread(fd, dest, len, offset);
+    if (res < 0) {
+      if (errno == EINTR)
+        continue;
+      return LastError();
+    }
+    if (res == 0)
+      return make_error_code(std::errc::io_error);
+    dest += res;
+    len -= res;
+    offset += res;
+  }
+  return {};
+}
+
+}  // namespace
+
+DiskBacklog::DiskBacklog(string dir, unsigned index, size_t max_bytes, size_t segment_bytes)
+    : dir_(std::move(dir)),
+      index_(index),
+      max_bytes_(max_bytes),
+      segment_bytes_(max<size_t>(segment_bytes, 1)) {
+}
+
+DiskBacklog::~DiskBacklog() {
+  for (Segment& segment : segments_) {
+    close(segment.fd);
+    unlink(segment.path.c_str());
+  }
+}
+
+error_code DiskBacklog::Open() {
+  error_code ec;
+  fs::create_directories(dir_, ec);
+  if (ec)
+    return ec;
+
+  string prefix = absl::StrCat("journal-", absl::Dec(index_, absl::kZeroPad4), "-");
+  for (const auto& entry : fs::directory_iterator(dir_, ec)) {
+    string name = entry.path().filename().string();
+    if (absl::StartsWith(name, prefix) && absl::EndsWith(name, ".log")) {
+      fs::remove(entry.path(), ec);
+      if (ec)
+        return ec;
+    }
+  }
+  return ec;
+}
+
+error_code DiskBacklog::Append(LSN lsn, string_view data) {
+  size_t record_size = 4 + data.size();
+  if (segments_.empty() || segments_.back().end_lsn != lsn ||
+      segments_.back().size + record_size > segment_bytes_) {
+    if (error_code ec = RollSegment(lsn); ec)
+      return ec;
+  }
+
+  Segment& segment = segments_.back();
+  if ((lsn - segment.first_lsn) % kIndexStride == 0)
+    segment.index.push_back(segment.size);
+
+  char len_buf[4];
+  absl::little_endian::Store32(len_buf, data.size());
+  pending_.append(len_buf, sizeof(len_buf));
+  pending_.append(data);
+
+  segment.size += record_size;
+  segment.end_lsn = lsn + 1;
+  total_bytes_ += record_size;
+
+  if (pending_.size() >= kFlushBytes) {
+    if (error_code ec = Flush(); ec)
+      return ec;
+  }
+  Trim();
+  return {};
+}
+
+bool DiskBacklog::Contains(LSN lsn) const {
+  return !segments_.empty() && segments_.front().first_lsn <= lsn &&
+         lsn < segments_.back().end_lsn;
+}
+
+string_view DiskBacklog::GetEntry(LSN lsn) const {
+  DCHECK(Contains(lsn));
+  if (error_code ec = Flush(); ec) {
+    LOG(ERROR) << "Could not write journal backlog: " << ec.message();
+    return {};
+  }
+
+  auto it = upper_bound(segments_.begin(), segments_.end(), lsn,
+                        [](LSN lsn, const Segment& s) { return lsn < s.first_lsn; });
+  DCHECK(it != segments_.begin());
+  const Segment& segment = *--it;
+
+  size_t offset;
+  LSN cur;
+  if (cursor_segment_ == segment.first_lsn && cursor_lsn_ == lsn) {
+    offset = cursor_offset_;
+    cur = lsn;
+  } else {
+    size_t idx = (lsn - segment.first_lsn) / kIndexStride;
+    offset = segment.index[idx];
+    cur = segment.first_lsn + idx * kIndexStride;
+  }
+
+  char len_buf[4];
+  while (true) {
+    if (error_code ec = PRead(segment.fd, offset, sizeof(len_buf), len_buf); ec) {
+      LOG(ERROR) << "Could not read journal backlog " << segment.path << ": " << ec.message();
+      return {};
+    }
+    uint32_t len = absl::little_endian::Load32(len_buf);
+    if (cur == lsn) {
+      read_buf_.resize(len);
+      if (error_code ec = PRead(segment.fd, offset + 4, len, read_buf_.data()); ec) {
+        LOG(ERROR) << "Could not read journal backlog " << segment.path << ": " << ec.message();
+        return {};
+      }
+      cursor_segment_ = segment.first_lsn;
+      cursor_lsn_ = lsn + 1;
+      cursor_offset_ = offset + 4 + len;
+      return read_buf_;
+    }
+    offset += 4 + len;
+    ++cur;
+  }
+}
+
+error_code DiskBacklog::RollSegment(LSN lsn) {
+  if (error_code ec = Flush(); ec)
+    return ec;
+
+  Segment segment;
+  segment.path = (fs::path{dir_} / absl::StrCat("journal-", absl::Dec(index_, absl::kZeroPad4),
+                                                "-", next_segment_id_++, ".log"))
+                     .string();
+  segment.fd = open(segment.path.c_str(), O_CREAT | O_TRUNC | O_RDWR | O_CLOEXEC, 0644);
+  if (segment.fd < 0)
+    return LastError();
+
+  // The log must be contiguous, drop the older entries if an lsn was skipped.
+  if (!segments_.empty() && segments_.back().end_lsn != lsn) {
+    for (Segment& old : segments_) {
+      close(old.fd);
+      unlink(old.path.c_str());
+    }
+    segments_.clear();
+    total_bytes_ = 0;
+  }
+
+  segment.first_lsn = lsn;
+  segment.end_lsn = lsn;
+  segments_.push_back(std::move(segment));
+  flushed_ = 0;
+  return {};
+}
+
+error_code DiskBacklog::Flush() const {
+  if (pending_.empty())
+    return {};
+
+  error_code ec = PWrite(segments_.back().fd, pending_, flushed_);
+  if (!ec) {
+    flushed_ += pending_.size();
+    pending_.clear();
+  }
+  return ec;
+}
+
+void DiskBacklog::Trim() {
+  while (total_bytes_ > max_bytes_ && segments_.size() > 1) {
+    Segment& segment = segments_.front();
+    VLOG(1) << "Dropping journal backlog segment " << segment.path;
+    close(segment.fd);
+    unlink(segment.path.c_str());
+    total_bytes_ -= segment.size;
+    segments_.pop_front();
+  }
+}
+
+}  // namespace journal
+}  // namespace dfly
@@ -0,0 +1,91 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <deque>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "server/journal/types.h"
+
+namespace dfly {
+namespace journal {
+
+// DiskBacklog keeps the serialized journal entries of a slice in a log of segment files, so
+// that replicas can resume with partial sync after long disconnects.
+//
+// Notes:
+// - Entries are appended sequentially, each as a 4 byte length followed by the data.
+//   Appends are buffered in memory and written when the buffer fills up or an entry is read.
+// - Segments are rolled when they reach segment_bytes. The oldest segments are deleted
+//   when the log exceeds max_bytes, the current segment is always kept.
+// - Every kIndexStride entry offset is indexed. Sequential reads continue from the previous
+//   read, so replaying a range of entries scans every segment once.
+// - LSNs restart on every process start, so Open deletes the segments of a previous run.
+// - The file IO blocks the shard thread, it relies on the page cache to be fast.
+class DiskBacklog {
+ public:
+  DiskBacklog(std::string dir, unsigned index, size_t max_bytes, size_t segment_bytes);
+  ~DiskBacklog();
+
+  std::error_code Open();
+
+  std::error_code Append(LSN lsn, std::string_view data);
+
+  // Whether the entry with this lsn is available.
+  bool Contains(LSN lsn) const;
+
+  // Returns the entry with this lsn, that must be available. The result is valid until the
+  // next call. Returns an empty view if the read failed.
+  std::string_view GetEntry(LSN lsn) const;
+
+  size_t bytes() const {
+    return total_bytes_;
+  }
+
+  size_t segment_count() const {
+    return segments_.size();
+  }
+
+ private:
+  static constexpr unsigned kIndexStride = 64;
+  static constexpr size_t kFlushBytes = 64 * 1024;
+
+  struct Segment {
+    std::string path;
+    int fd = -1;
+    LSN first_lsn = 0;
+    LSN end_lsn = 0;  // the lsn after the last entry of the segment.
+    size_t size = 0;  // including the pending bytes of the current segment.
+    std::vector<uint32_t> index;  // offset of every kIndexStride entry.
+  };
+
+  std::error_code RollSegment(LSN lsn);
+  std::error_code Flush() const;
+  void Trim();
+
+  std::string dir_;
+  unsigned index_;
+  size_t max_bytes_;
+  size_t segment_bytes_;
+
+  std::deque<Segment> segments_;
+  size_t total_bytes_ = 0;
+  uint64_t next_segment_id_ = 0;
+
+  mutable std::string pending_;  // not yet written bytes of the last segment.
+  mutable size_t flushed_ = 0;   // written bytes of the last segment.
+
+  // The end of the previous read, for sequential reads.
+  mutable LSN cursor_lsn_ = 0;
+  mutable LSN cursor_segment_ = 0;  // the first lsn of the segment of the cursor.
+  mutable size_t cursor_offset_ = 0;
+  mutable std::string read_buf_;
+};
+
+}  // namespace journal
+}  // namespace dfly
@@ -29,7 +29,7 @@ Journal::Journal() {
 }
 
 void Journal::StartInThread() {
-  journal_slice.Init(unsigned(ProactorBase::me()->GetPoolIndex()));
+  journal_slice.Init(unsigned(ProactorBase::me()->GetPoolIndex()), command_table_.get());
 
   ServerState::tlocal()->set_journal(this);
   EngineShard* shard = EngineShard::tlocal();
@@ -119,8 +119,11 @@ bool Journal::EnterLameDuck() {
 }
 
 void Journal::RecordEntry(TxId txid, Op opcode, DbIndex dbid, unsigned shard_cnt,
-                          std::optional<SlotId> slot, Entry::Payload payload, bool await) {
-  journal_slice.AddLogRecord(Entry{txid, opcode, dbid, shard_cnt, slot, std::move(payload)}, await);
+                          std::optional<SlotId> slot, Entry::Payload payload, bool await,
+                          std::string_view key) {
+  Entry entry{txid, opcode, dbid, shard_cnt, slot, std::move(payload)};
+  entry.key = key;
+  journal_slice.AddLogRecord(entry, await);
 }
 
 /*
@@ -4,12 +4,15 @@
 
 #pragma once
 
+#include <memory>
+
 #include "server/journal/types.h"
 #include "util/proactor_pool.h"
 
 namespace dfly {
 
 class Transaction;
+class JournalCommandTable;
 
 namespace journal {
 
@@ -25,6 +28,16 @@ class Journal {
 
   void StartInThread();
 
+  // Entries are written in the compact encoding with this table if it is set. Must be called
+  // before the journal is started.
+  void SetCommandTable(std::shared_ptr<const JournalCommandTable> table) {
+    command_table_ = std::move(table);
+  }
+
+  const JournalCommandTable* command_table() const {
+    return command_table_.get();
+  }
+
   // Requires: journal is in lameduck mode.
   std::error_code Close();
 
@@ -57,13 +70,16 @@ class Journal {
 */
   LSN GetLsn() const;
 
+  // key is the first key of the payload, for the replication filters.
   void RecordEntry(TxId txid, Op opcode, DbIndex dbid, unsigned shard_cnt,
-                   std::optional<SlotId> slot, Entry::Payload payload, bool await);
+                   std::optional<SlotId> slot, Entry::Payload payload, bool await,
+                   std::string_view key = {});
 
  private:
   mutable Mutex state_mu_;
 
   std::atomic_bool lameduck_{false};
+  std::shared_ptr<const JournalCommandTable> command_table_;
 };
 
 }  // namespace journal
@@ -18,6 +18,13 @@
 
 ABSL_FLAG(uint32_t, shard_repl_backlog_len, 1 << 10,
           "The length of the circular replication log per shard");
+ABSL_FLAG(std::string, journal_backlog_dir, "",
+          "If set, the replication log of every shard is also kept in segment files in this "
+          "directory, so that replicas can use partial sync after long disconnects");
+ABSL_FLAG(uint64_t, journal_backlog_max_bytes, 1ULL << 30,
+          "The maximal size of the on disk replication log per shard");
+ABSL_FLAG(uint64_t, journal_backlog_segment_bytes, 64ULL << 20,
+          "The size of the segment files of the on disk replication log");
 
 namespace dfly {
 namespace journal {
@@ -57,12 +64,24 @@ JournalSlice::~JournalSlice() {
   // CHECK(!shard_file_);
 }
 
-void JournalSlice::Init(unsigned index) {
+void JournalSlice::Init(unsigned index, const JournalCommandTable* command_table) {
   if (ring_buffer_)  // calling this function multiple times is allowed and it's a no-op.
     return;
 
   slice_index_ = index;
+  command_table_ = command_table;
   ring_buffer_.emplace(2);
+
+  string dir = absl::GetFlag(FLAGS_journal_backlog_dir);
+  if (!dir.empty()) {
+    disk_backlog_.emplace(std::move(dir), index, absl::GetFlag(FLAGS_journal_backlog_max_bytes),
+                          absl::GetFlag(FLAGS_journal_backlog_segment_bytes));
+    if (error_code ec = disk_backlog_->Open(); ec) {
+      LOG(ERROR) << "Could not open journal backlog: " << ec.message();
+      disk_backlog_.reset();
+      status_ec_ = ec;
+    }
+  }
 }
 
 #if 0
@@ -129,6 +148,10 @@ error_code JournalSlice::Close() {
 bool JournalSlice::IsLSNInBuffer(LSN lsn) const {
   DCHECK(ring_buffer_);
 
+  if (disk_backlog_) {
+    return disk_backlog_->Contains(lsn);
+  }
+
   if (ring_buffer_->empty()) {
     return false;
   }
@@ -137,6 +160,9 @@ bool JournalSlice::IsLSNInBuffer(LSN lsn) const {
 
 std::string_view JournalSlice::GetEntry(LSN lsn) const {
   DCHECK(ring_buffer_ && IsLSNInBuffer(lsn));
+  if (disk_backlog_) {
+    return disk_backlog_->GetEntry(lsn);
+  }
   auto start = (*ring_buffer_)[0].lsn;
   DCHECK((*ring_buffer_)[lsn - start].lsn == lsn);
   return (*ring_buffer_)[lsn - start].data;
@@ -163,14 +189,26 @@ void JournalSlice::AddLogRecord(const Entry& entry, bool await) {
     item->slot = entry.slot;
 
     io::BufSink buf_sink{&ring_serialize_buf_};
-    JournalWriter writer{&buf_sink};
+    JournalWriter writer{&buf_sink, command_table_};
     writer.Write(entry);
 
     item->data = io::View(ring_serialize_buf_.InputBuffer());
     ring_serialize_buf_.Clear();
+
+    if (disk_backlog_) {
+      if (error_code ec = disk_backlog_->Append(item->lsn, item->data); ec) {
+        LOG(ERROR) << "Could not write journal backlog, disabling it: " << ec.message();
+        disk_backlog_.reset();
+        status_ec_ = ec;
+      }
+    }
     VLOG(2) << "Writing item [" << item->lsn << "]: " << entry.ToString();
   }
 
+  item->dbid = entry.dbid;
+  item->shard_cnt = entry.shard_cnt;
+  item->key = entry.key;
+
 #if 0
     if (shard_file_) {
       string line = absl::StrCat(item.lsn, " ", entry.txid, " ", entry.opcode, "\n");
@@ -10,9 +10,13 @@
 
 #include "base/ring_buffer.h"
 #include "server/common.h"
+#include "server/journal/disk_backlog.h"
 #include "server/journal/types.h"
 
 namespace dfly {
+
+class JournalCommandTable;
+
 namespace journal {
 
 // Journal slice is present for both shards and io threads.
@@ -21,7 +25,8 @@ class JournalSlice {
   JournalSlice();
   ~JournalSlice();
 
-  void Init(unsigned index);
+  // Entries are written in the compact encoding if command_table is set.
+  void Init(unsigned index, const JournalCommandTable* command_table = nullptr);
 
 #if 0
   std::error_code Open(std::string_view dir);
@@ -58,7 +63,7 @@ class JournalSlice {
   }
 
   /// Returns whether the journal entry with this LSN is available
-  /// from the buffer.
+  /// from the buffer or from the disk backlog if it is enabled.
   bool IsLSNInBuffer(LSN lsn) const;
   std::string_view GetEntry(LSN lsn) const;
 
@@ -67,6 +72,8 @@ class JournalSlice {
   // std::unique_ptr<LinuxFile> shard_file_;
   std::optional<base::RingBuffer<JournalItem>> ring_buffer_;
   base::IoBuf ring_serialize_buf_;
+  std::optional<DiskBacklog> disk_backlog_;
+  const JournalCommandTable* command_table_ = nullptr;
 
   mutable util::SharedMutex cb_mu_;
   std::vector<std::pair<uint32_t, ChangeCallback>> change_cb_arr_ ABSL_GUARDED_BY(cb_mu_);
@@ -2,6 +2,7 @@
 
 #include "base/gtest.h"
 #include "base/logging.h"
+#include "server/journal/disk_backlog.h"
 #include "server/journal/serializer.h"
 #include "server/journal/types.h"
 #include "server/serializer_commons.h"
@@ -134,6 +135,98 @@ TEST(Journal, WriteRead) {
   }
 }
 
+TEST(Journal, CompactEncoding) {
+  std::vector<journal::Entry> test_entries = {
+      {0, journal::Op::COMMAND, 0, 2, nullopt, make_pair("MSET", slice("A", "1", "B", "-5"))},
+      {1, journal::Op::COMMAND, 0, 1, nullopt, make_pair("SET", list("C", "05", "EX", "123"))},
+      {2, journal::Op::COMMAND, 1, 1, nullopt, make_pair("HSET", list("h", "f", "0"))},
+      {3, journal::Op::COMMAND, 1, 1, nullopt,
+       make_pair("LPUSH", list("l", "-0", "9223372036854775807", ""))},
+      {4, journal::Op::MULTI_COMMAND, 2, 1, nullopt, make_pair("DEL", list("E", "2"))},
+      {4, journal::Op::EXEC, 2, 1, nullopt}};
+
+  JournalCommandTable table{{"DEL", "LPUSH", "MSET", "SET"}};
+  EXPECT_EQ(1u, table.Find("LPUSH").value_or(0));
+  EXPECT_FALSE(table.Find("HSET"));
+
+  base::IoBuf buf, plain_buf;
+  io::BufSink sink{&buf}, plain_sink{&plain_buf};
+  JournalWriter writer{&sink, &table}, plain_writer{&plain_sink};
+  for (const auto& entry : test_entries) {
+    writer.Write(entry);
+    plain_writer.Write(entry);
+  }
+  EXPECT_LT(buf.InputLen(), plain_buf.InputLen());
+
+  io::BufSource source{&buf};
+  JournalReader reader{&source, 0};
+  reader.SetCommandTable(&table);
+
+  for (const auto& expected : test_entries) {
+    auto res = reader.ReadEntry();
+    ASSERT_TRUE(res.has_value());
+
+    ASSERT_EQ(expected.opcode, res->opcode);
+    ASSERT_EQ(expected.txid, res->txid);
+    ASSERT_EQ(expected.dbid, res->dbid);
+    ASSERT_EQ(ExtractPayload(expected), ExtractPayload(*res));
+  }
+}
+
+TEST(Journal, DiskBacklog) {
+  string dir = absl::StrCat(testing::TempDir(), "/journal_backlog");
+  auto entry = [](LSN lsn) { return absl::StrCat("entry-", lsn, string(lsn % 100, 'x')); };
+
+  journal::DiskBacklog backlog{dir, 0, 64_KB, 8_KB};
+  ASSERT_FALSE(backlog.Open());
+  EXPECT_FALSE(backlog.Contains(1));
+
+  for (LSN lsn = 1; lsn <= 2000; lsn++) {
+    ASSERT_FALSE(backlog.Append(lsn, entry(lsn)));
+  }
+  EXPECT_LE(backlog.bytes(), 64_KB);
+  EXPECT_GT(backlog.segment_count(), 1u);
+  EXPECT_TRUE(backlog.Contains(2000));
+  EXPECT_FALSE(backlog.Contains(2001));
+  EXPECT_FALSE(backlog.Contains(1));
+
+  LSN first = 2000;
+  while (backlog.Contains(first - 1))
+    --first;
+
+  // Sequential reads, then random ones.
+  for (LSN lsn = first; lsn <= 2000; lsn++) {
+    ASSERT_EQ(entry(lsn), backlog.GetEntry(lsn));
+  }
+  for (LSN lsn : {LSN(2000), first + 7, first, LSN(1999)}) {
+    ASSERT_EQ(entry(lsn), backlog.GetEntry(lsn));
+  }
+
+  // A gap drops the older entries.
+  ASSERT_FALSE(backlog.Append(2005, entry(2005)));
+  EXPECT_FALSE(backlog.Contains(2000));
+  EXPECT_EQ(entry(2005), backlog.GetEntry(2005));
+}
+
+TEST(Journal, Filter) {
+  journal::Filter filter;
+  EXPECT_TRUE(filter.Match({0, journal::Op::COMMAND, "", nullopt, 3, 1, "key"}));
+
+  filter.dbs = {1};
+  filter.prefixes = {"user:"};
+  EXPECT_TRUE(filter.Match({0, journal::Op::COMMAND, "", nullopt, 1, 1, "user:1"}));
+  EXPECT_FALSE(filter.Match({0, journal::Op::COMMAND, "", nullopt, 1, 1, "item:1"}));
+  EXPECT_FALSE(filter.Match({0, journal::Op::COMMAND, "", nullopt, 0, 1, "user:1"}));
+  EXPECT_TRUE(filter.Match({0, journal::Op::EXPIRED, "", nullopt, 1, 1, "user:1"}));
+
+  // Keyless entries always match, multi shard ones are matched by their database only.
+  EXPECT_TRUE(filter.Match({0, journal::Op::COMMAND, "", nullopt, 0, 1, ""}));
+  EXPECT_TRUE(filter.Match({0, journal::Op::COMMAND, "", nullopt, 1, 2, "item:1"}));
+  EXPECT_TRUE(filter.Match({0, journal::Op::MULTI_COMMAND, "", nullopt, 1, 1, "item:1"}));
+  EXPECT_FALSE(filter.Match({0, journal::Op::EXEC, "", nullopt, 0, 1, ""}));
+  EXPECT_TRUE(filter.Match({0, journal::Op::PING, "", nullopt, 0, 0, ""}));
+}
+
 }  // namespace dfly
 
 // TODO: extend test.
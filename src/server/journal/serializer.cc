@@ -4,6 +4,10 @@
 
 #include "server/journal/serializer.h"
 
+#include <absl/strings/numbers.h>
+#include <absl/strings/str_cat.h>
+
+#include <charconv>
 #include <system_error>
 
 #include "base/io_buf.h"
@@ -21,7 +25,34 @@ using namespace std;
 
 namespace dfly {
 
-JournalWriter::JournalWriter(io::Sink* sink) : sink_{sink} {
+namespace {
+
+// Set in the opcode of entries with a compact encoded command.
+constexpr uint8_t kCompactOpBit = 0x20;
+
+uint64_t ZigZagEncode(int64_t v) {
+  return (uint64_t(v) << 1) ^ uint64_t(v >> 63);
+}
+
+int64_t ZigZagDecode(uint64_t v) {
+  return int64_t(v >> 1) ^ -int64_t(v & 1);
+}
+
+}  // namespace
+
+JournalCommandTable::JournalCommandTable(vector<string> names) : names_{std::move(names)} {
+  for (uint32_t i = 0; i < names_.size(); i++) {
+    ids_.emplace(names_[i], i);
+  }
+}
+
+optional<uint32_t> JournalCommandTable::Find(string_view name) const {
+  auto it = ids_.find(name);
+  return it == ids_.end() ? nullopt : optional{it->second};
+}
+
+JournalWriter::JournalWriter(io::Sink* sink, const JournalCommandTable* command_table)
+    : sink_{sink}, command_table_{command_table} {
 }
 
 void JournalWriter::Write(uint64_t v) {
@@ -46,6 +77,24 @@ template <typename C> void JournalWriter::Write(std::pair<std::string_view, C> a
   }
   Write(cmd_size);
 
+  if (command_table_) {
+    // The name and the arguments start with a tag whose lowest bit is set for a command id or
+    // an integer, and is clear for the length of the string that follows.
+    if (auto id = command_table_->Find(cmd); id) {
+      Write((uint64_t(*id) << 1) | 1);
+    } else {
+      Write(uint64_t(cmd.size()) << 1);
+      sink_->Write(io::Buffer(cmd));
+    }
+    for (auto v : tail_args) {
+      if constexpr (is_same_v<C, CmdArgList>)
+        WriteCompactArg(facade::ToSV(v));
+      else
+        WriteCompactArg(v);
+    }
+    return;
+  }
+
   Write(cmd);
   for (auto v : tail_args) {
     if constexpr (is_same_v<C, CmdArgList>)
@@ -58,25 +107,43 @@ template <typename C> void JournalWriter::Write(std::pair<std::string_view, C> a
 template void JournalWriter::Write(pair<string_view, CmdArgList>);
 template void JournalWriter::Write(pair<string_view, ArgSlice>);
 
+void JournalWriter::WriteCompactArg(string_view arg) {
+  // Only integers with a single decimal form, so that the reader restores the same string.
+  // 18 digits keep the tagged value below 2^64.
+  int64_t v;
+  if (arg.size() <= 18 && absl::SimpleAtoi(arg, &v) && absl::AlphaNum(v).Piece() == arg) {
+    Write((ZigZagEncode(v) << 1) | 1);
+    return;
+  }
+  Write(uint64_t(arg.size()) << 1);
+  sink_->Write(io::Buffer(arg));
+}
+
 void JournalWriter::Write(std::monostate) {
 }
 
 void JournalWriter::Write(const journal::Entry& entry) {
   // Check if entry has a new db index and we need to emit a SELECT entry.
-  if (entry.opcode != journal::Op::SELECT && (!cur_dbid_ || entry.dbid != *cur_dbid_)) {
+  if (entry.opcode != journal::Op::SELECT && entry.opcode != journal::Op::LSN &&
+      (!cur_dbid_ || entry.dbid != *cur_dbid_)) {
     Write(journal::Entry{journal::Op::SELECT, entry.dbid, entry.slot});
     cur_dbid_ = entry.dbid;
   }
 
   VLOG(1) << "Writing entry " << entry.ToString();
 
-  Write(uint8_t(entry.opcode));
+  uint8_t opcode = uint8_t(entry.opcode);
+  if (command_table_ && entry.HasPayload())
+    opcode |= kCompactOpBit;
+  Write(opcode);
 
   switch (entry.opcode) {
     case journal::Op::SELECT:
       return Write(entry.dbid);
     case journal::Op::PING:
       return;
+    case journal::Op::LSN:
+      return Write(entry.txid);
     case journal::Op::COMMAND:
     case journal::Op::EXPIRED:
     case journal::Op::MULTI_COMMAND:
@@ -181,10 +248,58 @@ std::error_code JournalReader::ReadCommand(journal::ParsedEntry::CmdData* data)
   return std::error_code{};
 }
 
+std::error_code JournalReader::ReadCompactCommand(journal::ParsedEntry::CmdData* data) {
+  size_t num_strings = 0;
+  SET_OR_RETURN(ReadUInt<uint64_t>(), num_strings);
+  data->cmd_args.resize(num_strings);
+
+  size_t cmd_size = 0;
+  SET_OR_RETURN(ReadUInt<uint64_t>(), cmd_size);
+
+  data->command_buf = make_unique<char[]>(cmd_size);
+  char* ptr = data->command_buf.get();
+  for (size_t i = 0; i < num_strings; i++) {
+    uint64_t tag;
+    SET_OR_RETURN(ReadUInt<uint64_t>(), tag);
+
+    size_t size = tag >> 1;
+    if (tag & 1) {
+      char num_buf[24];
+      string_view value;
+      if (i == 0) {
+        if (!command_table_)
+          return make_error_code(errc::bad_message);
+        value = command_table_->Name(tag >> 1);
+        if (value.empty())
+          return make_error_code(errc::bad_message);
+      } else {
+        auto res = to_chars(num_buf, num_buf + sizeof(num_buf), ZigZagDecode(tag >> 1));
+        value = string_view(num_buf, res.ptr - num_buf);
+      }
+      if (value.size() > cmd_size)
+        return make_error_code(errc::bad_message);
+      size = value.size();
+      memcpy(ptr, value.data(), size);
+    } else {
+      if (size > cmd_size)
+        return make_error_code(errc::bad_message);
+      if (auto ec = EnsureRead(size); ec)
+        return ec;
+      buf_.ReadAndConsume(size, ptr);
+    }
+
+    data->cmd_args[i] = MutableSlice{ptr, size};
+    ptr += size;
+    cmd_size -= size;
+  }
+  return std::error_code{};
+}
+
 io::Result<journal::ParsedEntry> JournalReader::ReadEntry() {
   uint8_t int_op;
   SET_OR_UNEXPECT(ReadUInt<uint8_t>(), int_op);
-  journal::Op opcode = static_cast<journal::Op>(int_op);
+  bool compact = int_op & kCompactOpBit;
+  journal::Op opcode = static_cast<journal::Op>(int_op & ~kCompactOpBit);
 
   if (opcode == journal::Op::SELECT) {
     SET_OR_UNEXPECT(ReadUInt<uint16_t>(), dbid_);
@@ -199,6 +314,11 @@ io::Result<journal::ParsedEntry> JournalReader::ReadEntry() {
     return entry;
   }
 
+  if (opcode == journal::Op::LSN) {
+    SET_OR_UNEXPECT(ReadUInt<uint64_t>(), entry.txid);
+    return entry;
+  }
+
   SET_OR_UNEXPECT(ReadUInt<uint64_t>(), entry.txid);
   SET_OR_UNEXPECT(ReadUInt<uint32_t>(), entry.shard_cnt);
 
@@ -208,7 +328,7 @@ io::Result<journal::ParsedEntry> JournalReader::ReadEntry() {
     return entry;
   }
 
-  auto ec = ReadCommand(&entry.cmd);
+  auto ec = compact ? ReadCompactCommand(&entry.cmd) : ReadCommand(&entry.cmd);
   if (ec)
     return make_unexpected(ec);
 
@@ -4,8 +4,11 @@
 
 #pragma once
 
+#include <absl/container/flat_hash_map.h>
+
 #include <optional>
 #include <string>
+#include <vector>
 
 #include "base/io_buf.h"
 #include "io/io.h"
@@ -14,11 +17,35 @@
 
 namespace dfly {
 
+// Numbers the commands for the compact journal encoding. The master sends its table to the
+// replicas, so the numbers do not need to match between versions.
+class JournalCommandTable {
+ public:
+  explicit JournalCommandTable(std::vector<std::string> names);
+
+  std::optional<uint32_t> Find(std::string_view name) const;
+
+  // Empty if id is unknown.
+  std::string_view Name(uint32_t id) const {
+    return id < names_.size() ? std::string_view{names_[id]} : std::string_view{};
+  }
+
+  const std::vector<std::string>& names() const {
+    return names_;
+  }
+
+ private:
+  std::vector<std::string> names_;
+  absl::flat_hash_map<std::string_view, uint32_t> ids_;
+};
+
 // JournalWriter serializes journal entries to a sink.
 // It automatically keeps track of the current database index.
+// With a command table, commands are written in the compact encoding: the command name is
+// replaced by its id and integer arguments are written as packed integers.
 class JournalWriter {
  public:
-  JournalWriter(io::Sink* sink);
+  JournalWriter(io::Sink* sink, const JournalCommandTable* command_table = nullptr);
 
   // Write single entry to sink.
   void Write(const journal::Entry& entry);
@@ -32,8 +59,11 @@ class JournalWriter {
 
   void Write(std::monostate);  // Overload for empty std::variant
 
+  void WriteCompactArg(std::string_view arg);
+
  private:
   io::Sink* sink_;
+  const JournalCommandTable* command_table_;
   std::optional<DbIndex> cur_dbid_{};
 };
 
@@ -47,6 +77,11 @@ struct JournalReader {
   // Overwrite current source and ensure there is no leftover from previous.
   void SetSource(io::Source* source);
 
+  // Table of the writer of the compact encoded entries.
+  void SetCommandTable(const JournalCommandTable* table) {
+    command_table_ = table;
+  }
+
   // Try reading entry from source.
   io::Result<journal::ParsedEntry> ReadEntry();
 
@@ -62,9 +97,11 @@ struct JournalReader {
 
   // Read argument array into string buffer.
   std::error_code ReadCommand(journal::ParsedEntry::CmdData* entry);
+  std::error_code ReadCompactCommand(journal::ParsedEntry::CmdData* entry);
 
  private:
   io::Source* source_;
+  const JournalCommandTable* command_table_ = nullptr;
   base::IoBuf buf_;
   DbIndex dbid_;
 };
@@ -4,15 +4,31 @@
 
 #include "server/journal/streamer.h"
 
+#include <absl/base/internal/endian.h>
 #include <absl/functional/bind_front.h>
+#include <absl/strings/str_format.h>
 
+#include <algorithm>
+#include <chrono>
+
+#include "base/flags.h"
 #include "base/logging.h"
+#include "core/sorted_map.h"
+#include "core/string_map.h"
+#include "core/string_set.h"
+#include "server/container_utils.h"
+
+ABSL_DECLARE_FLAG(uint64_t, serialization_max_chunk_size);
 
 namespace dfly {
 using namespace util;
 
 void JournalStreamer::Start(io::Sink* dest) {
   using namespace journal;
+  if (compress_) {
+    compressor_ = std::make_unique<Lz4FrameSink>(dest);
+    dest = compressor_.get();
+  }
   write_fb_ = fb2::Fiber("journal_stream", &JournalStreamer::WriterFb, this, dest);
   journal_cb_id_ = journal_->RegisterOnChange([this](const JournalItem& item, bool allow_await) {
     if (!ShouldWrite(item)) {
@@ -27,9 +43,18 @@ void JournalStreamer::Start(io::Sink* dest) {
     Write(io::Buffer(item.data));
     NotifyWritten(allow_await);
   });
+
+  if (lsn_heartbeat_ms_ > 0) {
+    heartbeat_fb_ = fb2::Fiber("journal_lsn", &JournalStreamer::LsnHeartbeatFb, this);
+  }
 }
 
 void JournalStreamer::Cancel() {
+  heartbeat_done_.Notify();
+  if (heartbeat_fb_.IsJoinable()) {
+    heartbeat_fb_.Join();
+  }
+
   Finalize();  // Finalize must be called before UnregisterOnChange because we first need to stop
                // writing to buffer and notify the all the producers.
                // Writing to journal holds mutex protecting change_cb_arr_, than the fiber can
@@ -49,13 +74,43 @@ void JournalStreamer::WriterFb(io::Sink* dest) {
   }
 }
 
+void JournalStreamer::LsnHeartbeatFb() {
+  const std::chrono::milliseconds interval{lsn_heartbeat_ms_};
+  while (!heartbeat_done_.WaitFor(interval) && !IsStopped()) {
+    // Entries are passed to the streamer when they get their LSN, so all the entries before
+    // GetLsn() precede the heartbeat in the stream.
+    io::StringSink sink;
+    JournalWriter writer{&sink};
+    writer.Write(journal::Entry{journal_->GetLsn(), journal::Op::LSN, 0, 0, std::nullopt});
+    Write(io::Buffer(sink.str()));
+    NotifyWritten(false);
+  }
+}
+
+namespace {
+
+constexpr unsigned kMinBatchBuckets = 1;
+constexpr unsigned kInitialBatchBuckets = 100;
+constexpr unsigned kMaxBatchBuckets = 4096;
+
+// The traversal backs off when other fibers delay it by more than kBusyDelayNs after a yield,
+// and speeds up when they delay it by less than kIdleDelayNs.
+constexpr uint64_t kBusyDelayNs = 200'000;
+constexpr uint64_t kIdleDelayNs = 20'000;
+
+}  // namespace
+
 RestoreStreamer::RestoreStreamer(DbSlice* slice, SlotSet slots, uint32_t sync_id,
-                                 journal::Journal* journal, Context* cntx)
+                                 journal::Journal* journal, Context* cntx, Budget budget)
     : JournalStreamer(journal, cntx),
       db_slice_(slice),
       my_slots_(std::move(slots)),
-      sync_id_(sync_id) {
+      sync_id_(sync_id),
+      budget_(budget),
+      batch_buckets_(kInitialBatchBuckets) {
+  budget_.cpu_percent = std::clamp(budget_.cpu_percent, 1u, 100u);
   DCHECK(slice != nullptr);
+  max_chunk_size_ = absl::GetFlag(FLAGS_serialization_max_chunk_size);
 }
 
 void RestoreStreamer::Start(io::Sink* dest) {
@@ -67,22 +122,14 @@ void RestoreStreamer::Start(io::Sink* dest) {
 
   DCHECK(!snapshot_fb_.IsJoinable());
   snapshot_fb_ = fb2::Fiber("slot-snapshot", [this] {
-    PrimeTable::Cursor cursor;
-    uint64_t last_yield = 0;
-    PrimeTable* pt = &db_slice_->databases()[0]->prime;
-
-    do {
-      if (fiber_cancellation_.IsCancelled())
-        return;
-
-      cursor = pt->Traverse(cursor, absl::bind_front(&RestoreStreamer::WriteBucket, this));
-      ++last_yield;
+    traversal_start_ns_ = batch_start_ns_ = fb2::ProactorBase::GetMonotonicTimeNs();
+    if (!(db_slice_->HasSlotKeyIndex() ? TraverseSlotKeys() : TraverseTable()))
+      return;
 
-      if (last_yield >= 100) {
-        ThisFiber::Yield();
-        last_yield = 0;
-      }
-    } while (cursor);
+    // No bucket is written after the traversal, so no value is deferred anymore.
+    WriteDeferredValues();
+    if (fiber_cancellation_.IsCancelled())
+      return;
 
     VLOG(2) << "FULL-SYNC-CUT for " << sync_id_ << " : " << db_slice_->shard_id();
     WriteCommand(make_pair("DFLYMIGRATE", ArgSlice{"FULL-SYNC-CUT", absl::StrCat(sync_id_),
@@ -105,6 +152,84 @@ RestoreStreamer::~RestoreStreamer() {
   db_slice_->UnregisterOnChange(snapshot_version_);
 }
 
+bool RestoreStreamer::TraverseTable() {
+  PrimeTable::Cursor cursor;
+  uint64_t last_yield = 0;
+  PrimeTable* pt = &db_slice_->databases()[0]->prime;
+
+  do {
+    if (fiber_cancellation_.IsCancelled())
+      return false;
+
+    cursor = pt->Traverse(cursor, absl::bind_front(&RestoreStreamer::WriteBucket, this));
+    ++last_yield;
+    WriteDeferredValues();
+
+    if (last_yield >= batch_buckets_) {
+      PaceTraversal();
+      last_yield = 0;
+    }
+  } while (cursor);
+  return true;
+}
+
+bool RestoreStreamer::TraverseSlotKeys() {
+  uint64_t last_yield = 0;
+  for (SlotId sid : my_slots_) {
+    for (const string& key : db_slice_->GetSlotKeys(sid)) {
+      if (fiber_cancellation_.IsCancelled())
+        return false;
+
+      // Keys that were added meanwhile are sent by the journal, deleted ones are skipped.
+      PrimeTable* pt = &db_slice_->databases()[0]->prime;
+      PrimeIterator it = pt->Find(key);
+      if (!IsValid(it))
+        continue;
+
+      PrimeTable::bucket_iterator bit{it};
+      if (bit.GetVersion() >= snapshot_version_)
+        continue;  // already written together with another key of the bucket.
+
+      WriteBucket(bit);
+      WriteDeferredValues();
+      if (++last_yield >= batch_buckets_) {
+        PaceTraversal();
+        last_yield = 0;
+      }
+    }
+  }
+  return true;
+}
+
+void RestoreStreamer::PaceTraversal() {
+  uint64_t now = fb2::ProactorBase::GetMonotonicTimeNs();
+  uint64_t sleep_ns = 0;
+  if (budget_.cpu_percent < 100) {
+    sleep_ns = (now - batch_start_ns_) * (100 - budget_.cpu_percent) / budget_.cpu_percent;
+  }
+  if (budget_.bytes_per_sec > 0) {
+    // The time at which the bytes written so far fit into the budget.
+    uint64_t due_ns = traversal_start_ns_ + uint64_t(double(bytes_written()) * 1e9 /
+                                                      double(budget_.bytes_per_sec));
+    if (due_ns > now)
+      sleep_ns = std::max(sleep_ns, due_ns - now);
+  }
+
+  if (sleep_ns > 0)
+    ThisFiber::SleepFor(std::chrono::nanoseconds(sleep_ns));
+  else
+    ThisFiber::Yield();
+
+  // How long the fibers that were ready to run delayed the traversal. While the shard has spare
+  // capacity, bigger batches make it faster, while it is busy smaller ones keep the latency low.
+  batch_start_ns_ = fb2::ProactorBase::GetMonotonicTimeNs();
+  uint64_t delay_ns = batch_start_ns_ - now > sleep_ns ? batch_start_ns_ - now - sleep_ns : 0;
+  if (delay_ns > kBusyDelayNs)
+    batch_buckets_ = std::max(kMinBatchBuckets, batch_buckets_ / 2);
+  else if (delay_ns < kIdleDelayNs)
+    batch_buckets_ = std::min(kMaxBatchBuckets, batch_buckets_ * 2);
+}
+
 bool RestoreStreamer::ShouldWrite(const journal::JournalItem& item) const {
   if (!item.slot.has_value()) {
     return false;
@@ -129,6 +254,16 @@ void RestoreStreamer::WriteBucket(PrimeTable::bucket_iterator it) {
 
       string key_buffer;
       string_view key = it->first.GetSlice(&key_buffer);
+      if (!ShouldWrite(ClusterConfig::KeySlot(key))) {
+        ++it;
+        continue;
+      }
+
+      if (IsPreemptible(pv)) {
+        deferred_keys_.emplace_back(key);
+        ++it;
+        continue;
+      }
 
       uint64_t expire = 0;
       if (pv.HasExpire()) {
@@ -151,6 +286,17 @@ void RestoreStreamer::OnDbChange(DbIndex db_index, const DbSlice::ChangeReq& req
   FiberAtomicGuard fg;
   PrimeTable* table = db_slice_->GetTables(0).first;
 
+  if (active_robj_ != nullptr && !active_changed_) {
+    if (const PrimeTable::bucket_iterator* bit = req.update()) {
+      for (PrimeTable::bucket_iterator it = *bit; !it.is_done(); ++it) {
+        if (it->second.ObjType() != OBJ_STRING && it->second.RObjPtr() == active_robj_)
+          active_changed_ = true;
+      }
+    } else {
+      active_changed_ = get<string_view>(req.change) == active_key_;
+    }
+  }
+
   if (const PrimeTable::bucket_iterator* bit = req.update()) {
     if (bit->GetVersion() < snapshot_version_) {
       WriteBucket(*bit);
@@ -165,6 +311,9 @@ void RestoreStreamer::OnDbChange(DbIndex db_index, const DbSlice::ChangeReq& req
 }
 
 void RestoreStreamer::WriteEntry(string_view key, const PrimeValue& pv, uint64_t expire_ms) {
+  if (max_chunk_size_ > 0 && WriteChunkedEntry(key, pv, expire_ms))
+    return;
+
   absl::InlinedVector<string_view, 4> args;
 
   args.push_back(key);
@@ -181,6 +330,249 @@ void RestoreStreamer::WriteEntry(string_view key, const PrimeValue& pv, uint64_t
   WriteCommand(make_pair("RESTORE", ArgSlice{args}));
 }
 
+bool RestoreStreamer::WriteChunkedEntry(string_view key, const PrimeValue& pv,
+                                        uint64_t expire_ms) {
+  if (pv.MallocUsed() < max_chunk_size_)
+    return false;
+
+  // Values with expiring fields are restored, the commands can't set the field deadlines.
+  string_view cmd;
+  switch (pv.ObjType()) {
+    case OBJ_SET:
+      if (pv.Encoding() == kEncodingStrMap2 &&
+          static_cast<StringSet*>(pv.RObjPtr())->ExpirationUsed()) {
+        return false;
+      }
+      cmd = "SADD";
+      break;
+    case OBJ_HASH:
+      if (pv.Encoding() != kEncodingStrMap2 ||
+          static_cast<StringMap*>(pv.RObjPtr())->ExpirationUsed()) {
+        return false;
+      }
+      cmd = "HSET";
+      break;
+    case OBJ_ZSET:
+      cmd = "ZADD";
+      break;
+    case OBJ_LIST:
+      cmd = "RPUSH";
+      break;
+    default:
+      return false;
+  }
+
+  vector<string> args;
+  size_t args_size = 0;
+  auto add = [&](string arg) {
+    args_size += arg.size();
+    args.push_back(std::move(arg));
+  };
+
+  // Called after complete elements, so that pairs are not split between commands.
+  auto flush = [&](bool force) {
+    if (args.empty() || (!force && args_size < max_chunk_size_))
+      return;
+
+    vector<string_view> cmd_args{key};
+    cmd_args.insert(cmd_args.end(), args.begin(), args.end());
+    WriteCommand(make_pair(cmd, ArgSlice{cmd_args}));
+    args.clear();
+    args_size = 0;
+  };
+
+  auto add_entry = [&](container_utils::ContainerEntry ce) {
+    add(ce.ToString());
+    flush(false);
+    return true;
+  };
+
+  switch (pv.ObjType()) {
+    case OBJ_SET:
+      container_utils::IterateSet(pv, add_entry);
+      break;
+    case OBJ_LIST:
+      container_utils::IterateList(pv, add_entry);
+      break;
+    case OBJ_ZSET:
+      container_utils::IterateSortedSet(
+          pv.GetRobjWrapper(),
+          [&](container_utils::ContainerEntry ce, double score) {
+            add(absl::StrFormat("%.17g", score));
+            add(ce.ToString());
+            flush(false);
+            return true;
+          },
+          0, -1, false, true);
+      break;
+    case OBJ_HASH:
+      for (const auto& [k, v] : *static_cast<StringMap*>(pv.RObjPtr())) {
+        add(string{k, sdslen(k)});
+        add(string{v, sdslen(v)});
+        flush(false);
+      }
+      break;
+  }
+  flush(true);
+
+  if (expire_ms > 0) {
+    string expire_str = absl::StrCat(expire_ms);
+    string_view expire_args[] = {key, expire_str};
+    WriteCommand(make_pair("PEXPIREAT", ArgSlice{expire_args}));
+  }
+  return true;
+}
+
+bool RestoreStreamer::IsPreemptible(const PrimeValue& pv) const {
+  if (max_chunk_size_ == 0 || pv.MallocUsed() < max_chunk_size_)
+    return false;
+
+  // Lists are excluded because RPUSH of the chunks of a list that changed meanwhile would
+  // duplicate or reorder elements. Values with expiring fields are restored.
+  switch (pv.ObjType()) {
+    case OBJ_SET:
+      return pv.Encoding() == kEncodingStrMap2 &&
+             !static_cast<StringSet*>(pv.RObjPtr())->ExpirationUsed();
+    case OBJ_HASH:
+      return pv.Encoding() == kEncodingStrMap2 &&
+             !static_cast<StringMap*>(pv.RObjPtr())->ExpirationUsed();
+    case OBJ_ZSET:
+      return pv.Encoding() == OBJ_ENCODING_SKIPLIST;
+    default:
+      return false;
+  }
+}
+
+void RestoreStreamer::WriteDeferredValues() {
+  // OnDbChange may defer more values while a value is written.
+  while (!deferred_keys_.empty() && !fiber_cancellation_.IsCancelled()) {
+    WriteDeferredValue(deferred_keys_.front());
+    deferred_keys_.pop_front();
+  }
+}
+
+// The commands that changed the value since its bucket was written were streamed to the target
+// already, and were applied there to a missing or partial value. Therefore the value is deleted
+// on the target first and then written from its current state. The journal streams the changes
+// that happen while the chunks are written as well, so the value is written again from scratch
+// when it changes. After a few attempts the value is written without preemption.
+void RestoreStreamer::WriteDeferredValue(string_view key) {
+  constexpr unsigned kMaxAttempts = 3;
+
+  for (unsigned attempt = 1;; ++attempt) {
+    PrimeIterator it = db_slice_->databases()[0]->prime.Find(key);
+    if (!IsValid(it))
+      return;  // deleted, the target got the deletion from the journal.
+
+    if (attempt == kMaxAttempts || !IsPreemptible(it->second)) {
+      {
+        FiberAtomicGuard fg;
+        WriteCommand(make_pair("DEL", ArgSlice{key}));
+        uint64_t expire = 0;
+        if (it->second.HasExpire())
+          expire = db_slice_->ExpireTime(db_slice_->databases()[0]->expire.Find(it->first));
+        WriteEntry(key, it->second, expire);
+      }
+      NotifyWritten(true);
+      return;
+    }
+
+    active_key_ = key;
+    active_robj_ = it->second.RObjPtr();
+    active_changed_ = false;
+    WriteCommand(make_pair("DEL", ArgSlice{key}));
+
+    uint64_t cursor = 0;
+    while (true) {
+      {
+        FiberAtomicGuard fg;
+        cursor = WriteValueChunk(key, it->second, cursor);
+        if (cursor == 0 && it->second.HasExpire()) {
+          string expire_str = absl::StrCat(
+              db_slice_->ExpireTime(db_slice_->databases()[0]->expire.Find(it->first)));
+          string_view expire_args[] = {key, expire_str};
+          WriteCommand(make_pair("PEXPIREAT", ArgSlice{expire_args}));
+        }
+      }
+      NotifyWritten(true);
+      if (cursor == 0)
+        break;
+
+      PaceTraversal();
+      if (fiber_cancellation_.IsCancelled())
+        break;
+
+      it = db_slice_->databases()[0]->prime.Find(key);
+      if (active_changed_ || !IsValid(it) || it->second.RObjPtr() != active_robj_)
+        break;
+    }
+
+    active_robj_ = nullptr;
+    if (cursor == 0 || fiber_cancellation_.IsCancelled())
+      return;
+    VLOG(1) << "Value of " << key << " changed while it was written, attempt " << attempt;
+  }
+}
+
+uint64_t RestoreStreamer::WriteValueChunk(string_view key, const PrimeValue& pv,
+                                          uint64_t cursor) {
+  vector<string> args;
+  size_t args_size = 0;
+  auto add = [&](string_view arg) {
+    args_size += arg.size();
+    args.emplace_back(arg);
+  };
+
+  // Scans visit a few elements per call, the elements that exist during the whole write of the
+  // value are visited at least once.
+  string_view cmd;
+  switch (pv.ObjType()) {
+    case OBJ_SET: {
+      cmd = "SADD";
+      auto* ss = static_cast<StringSet*>(pv.RObjPtr());
+      do {
+        cursor = ss->Scan(uint32_t(cursor), [&](string_view ele) { add(ele); });
+      } while (cursor && args_size < max_chunk_size_);
+      break;
+    }
+    case OBJ_HASH: {
+      cmd = "HSET";
+      auto* sm = static_cast<StringMap*>(pv.RObjPtr());
+      do {
+        cursor = sm->Scan(uint32_t(cursor), [&](const void* obj) {
+          sds field = (sds)obj;
+          size_t len = sdslen(field);
+          sds value = (sds)absl::little_endian::Load64(field + len + 1);
+          add({field, len});
+          add({value, sdslen(value)});
+        });
+      } while (cursor && args_size < max_chunk_size_);
+      break;
+    }
+    case OBJ_ZSET: {
+      cmd = "ZADD";
+      auto* zs = static_cast<detail::SortedMap*>(pv.RObjPtr());
+      do {
+        cursor = zs->Scan(cursor, [&](string_view member, double score) {
+          add(absl::StrFormat("%.17g", score));
+          add(member);
+        });
+      } while (cursor && args_size < max_chunk_size_);
+      break;
+    }
+    default:
+      LOG(DFATAL) << "Unexpected type " << pv.ObjType();
+      return 0;
+  }
+
+  if (!args.empty()) {
+    vector<string_view> cmd_args{key};
+    cmd_args.insert(cmd_args.end(), args.begin(), args.end());
+    WriteCommand(make_pair(cmd, ArgSlice{cmd_args}));
+  }
+  return cursor;
+}
+
 void RestoreStreamer::WriteCommand(journal::Entry::Payload cmd_payload) {
   journal::Entry entry(0,                     // txid
                        journal::Op::COMMAND,  // single command
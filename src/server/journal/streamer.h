@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <deque>
+
 #include "server/db_slice.h"
 #include "server/io_utils.h"
 #include "server/journal/journal.h"
@@ -16,14 +18,27 @@ namespace dfly {
 // journal listener and writes them to a destination sink in a separate fiber.
 class JournalStreamer : protected BufferedStreamerBase {
  public:
-  JournalStreamer(journal::Journal* journal, Context* cntx)
-      : BufferedStreamerBase{cntx->GetCancellation()}, cntx_{cntx}, journal_{journal} {
+  // compress writes the stream as an LZ4 frame, flushed after every batch.
+  // If lsn_heartbeat_ms is set, the current journal LSN is sent at this interval so that the
+  // replica can estimate its lag.
+  JournalStreamer(journal::Journal* journal, Context* cntx, bool compress = false,
+                  uint32_t lsn_heartbeat_ms = 0)
+      : BufferedStreamerBase{cntx->GetCancellation()},
+        cntx_{cntx},
+        journal_{journal},
+        compress_{compress},
+        lsn_heartbeat_ms_{lsn_heartbeat_ms} {
   }
 
   // Self referential.
   JournalStreamer(const JournalStreamer& other) = delete;
   JournalStreamer(JournalStreamer&& other) = delete;
 
+  // Streams only the entries that match the filter. Must be called before Start.
+  void SetFilter(journal::Filter filter) {
+    filter_ = std::move(filter);
+  }
+
   // Register journal listener and start writer in fiber.
   virtual void Start(io::Sink* dest);
 
@@ -33,28 +48,46 @@ class JournalStreamer : protected BufferedStreamerBase {
 
   using BufferedStreamerBase::GetTotalBufferCapacities;
 
+  // Null if the stream is not compressed.
+  const Lz4FrameSink::Stats* compression_stats() const {
+    return compressor_ ? &compressor_->stats() : nullptr;
+  }
+
  private:
   // Writer fiber that steals buffer contents and writes them to dest.
   void WriterFb(io::Sink* dest);
+  void LsnHeartbeatFb();
   virtual bool ShouldWrite(const journal::JournalItem& item) const {
-    return true;
+    return filter_.Match(item);
   }
 
  private:
   Context* cntx_;
+  journal::Filter filter_;
 
   uint32_t journal_cb_id_{0};
   journal::Journal* journal_;
+  bool compress_;
+  std::unique_ptr<Lz4FrameSink> compressor_;
+  uint32_t lsn_heartbeat_ms_;
 
   Fiber write_fb_{};
+  Fiber heartbeat_fb_{};
+  util::fb2::Done heartbeat_done_;
 };
 
 // Serializes existing DB as RESTORE commands, and sends updates as regular commands.
 // Only handles relevant slots, while ignoring all others.
 class RestoreStreamer : public JournalStreamer {
  public:
+  // Limits of the traversal of the existing data. The changes are always streamed right away.
+  struct Budget {
+    uint64_t bytes_per_sec = 0;  // of the whole stream, 0 is unlimited.
+    uint32_t cpu_percent = 100;  // share of the shard thread time.
+  };
+
   RestoreStreamer(DbSlice* slice, SlotSet slots, uint32_t sync_id, journal::Journal* journal,
-                  Context* cntx);
+                  Context* cntx, Budget budget = {});
 
   void Start(io::Sink* dest) override;
   void Cancel() override;
@@ -70,17 +103,55 @@ class RestoreStreamer : public JournalStreamer {
   bool ShouldWrite(const journal::JournalItem& item) const override;
   bool ShouldWrite(SlotId slot_id) const;
 
+  // Called between batches of buckets. Sleeps to keep within the budget and adapts the batch size
+  // to the delay of the other fibers of the shard thread.
+  void PaceTraversal();
+
+  // Write the buckets that hold the keys of my_slots_, found by traversing the whole table or
+  // through the slot key index. Return false if the streamer was cancelled.
+  bool TraverseTable();
+  bool TraverseSlotKeys();
+
   void WriteBucket(PrimeTable::bucket_iterator it);
   void WriteEntry(string_view key, const PrimeValue& pv, uint64_t expire_ms);
+
+  // Writes a big container as commands that add chunks of its elements, so that the target
+  // does not parse a RESTORE of the whole value. Returns false for values that are restored.
+  bool WriteChunkedEntry(string_view key, const PrimeValue& pv, uint64_t expire_ms);
   void WriteCommand(journal::Entry::Payload cmd_payload);
 
+  // Big sets, hashes and sorted sets are not written with their bucket. They are written later
+  // by the traversal fiber, one chunk at a time with yields in between, see WriteDeferredValues.
+  bool IsPreemptible(const PrimeValue& pv) const;
+  void WriteDeferredValues();
+
+  // Writes DEL and the chunks of the value, restarting when the value changes meanwhile.
+  void WriteDeferredValue(std::string_view key);
+
+  // Writes the elements of the value from cursor on, until the chunk size is reached, as a single
+  // command. Returns the cursor of the next chunk, 0 when the value was written completely.
+  uint64_t WriteValueChunk(std::string_view key, const PrimeValue& pv, uint64_t cursor);
+
   DbSlice* db_slice_;
   uint64_t snapshot_version_ = 0;
   SlotSet my_slots_;
   uint32_t sync_id_;
+  size_t max_chunk_size_;  // serialization_max_chunk_size
   Fiber snapshot_fb_;
   Cancellation fiber_cancellation_;
   bool snapshot_finished_ = false;
+
+  Budget budget_;
+  unsigned batch_buckets_;  // buckets traversed between yields.
+  uint64_t traversal_start_ns_ = 0;
+  uint64_t batch_start_ns_ = 0;
+
+  std::deque<std::string> deferred_keys_;
+
+  // The value written by WriteDeferredValue. OnDbChange sets active_changed_ when it's modified.
+  std::string_view active_key_;
+  const void* active_robj_ = nullptr;
+  bool active_changed_ = false;
 };
 
 }  // namespace dfly
@@ -21,11 +21,30 @@ bool MultiShardExecution::InsertTxToSharedMap(TxId txid, uint32_t shard_cnt) {
 
   VLOG(2) << "txid: " << txid << " unique_shard_cnt_: " << shard_cnt
           << " was_insert: " << was_insert;
-  it->second.block.Dec();
+  TxExecutionSync& sync = it->second;
+  sync.block.Dec();
+  if (sync.missing_flows.fetch_sub(1, memory_order_acq_rel) == 1) {
+    lock_guard lk(map_mu);
+    for (EventCount* waker : sync.received_wakers)
+      waker->notify();
+  }
 
   return was_insert;
 }
 
+bool MultiShardExecution::IsReceived(TxId txid) {
+  return Find(txid).missing_flows.load(memory_order_acquire) == 0;
+}
+
+void MultiShardExecution::NotifyWhenReceived(TxId txid, EventCount* waker) {
+  lock_guard lk(map_mu);
+  auto it = tx_sync_execution.find(txid);
+  DCHECK(it != tx_sync_execution.end());
+  auto& wakers = it->second.received_wakers;
+  if (find(wakers.begin(), wakers.end(), waker) == wakers.end())
+    wakers.push_back(waker);
+}
+
 MultiShardExecution::TxExecutionSync& MultiShardExecution::Find(TxId txid) {
   std::lock_guard lk(map_mu);
   VLOG(2) << "Execute txid: " << txid;
@@ -44,10 +63,16 @@ void MultiShardExecution::CancelAllBlockingEntities() {
   for (auto& tx_data : tx_sync_execution) {
     tx_data.second.barrier.Cancel();
     tx_data.second.block.Cancel();
+    for (EventCount* waker : tx_data.second.received_wakers)
+      waker->notifyAll();
   }
 }
 
 bool TransactionData::AddEntry(journal::ParsedEntry&& entry) {
+  if (entry.opcode == journal::Op::LSN) {  // not a journal record.
+    master_lsn = entry.txid;
+    return true;
+  }
   ++journal_rec_count;
 
   switch (entry.opcode) {
@@ -112,7 +137,7 @@ std::optional<TransactionData> TransactionReader::NextTxData(JournalReader* read
     // Check if journal command can be executed right away.
     // Expiration checks lock on master, so it never conflicts with running multi transactions.
     if (res->opcode == journal::Op::EXPIRED || res->opcode == journal::Op::COMMAND ||
-        res->opcode == journal::Op::PING)
+        res->opcode == journal::Op::PING || res->opcode == journal::Op::LSN)
       return TransactionData::FromSingle(std::move(res.value()));
 
     // Otherwise, continue building multi command.
@@ -19,14 +19,23 @@ class MultiShardExecution {
     Barrier barrier;
     std::atomic_uint32_t counter;
     BlockingCounter block;
+    std::atomic_uint32_t missing_flows;  // flows that did not receive the transaction yet.
+    std::vector<EventCount*> received_wakers;
 
     explicit TxExecutionSync(uint32_t counter)
-        : barrier(counter), counter(counter), block(counter) {
+        : barrier(counter), counter(counter), block(counter), missing_flows(counter) {
     }
   };
 
   bool InsertTxToSharedMap(TxId txid, uint32_t shard_cnt);
   TxExecutionSync& Find(TxId txid);
+
+  // Whether all the flows of the transaction received it, so that it can be executed.
+  bool IsReceived(TxId txid);
+
+  // Notifies waker once all the flows of the transaction received it.
+  void NotifyWhenReceived(TxId txid, EventCount* waker);
+
   void Erase(TxId txid);
   void CancelAllBlockingEntities();
 
@@ -52,6 +61,7 @@ struct TransactionData {
   absl::InlinedVector<journal::ParsedEntry::CmdData, 1> commands{0};
   uint32_t journal_rec_count{0};  // Count number of source entries to check offset.
   bool is_ping = false;           // For Op::PING entries.
+  std::optional<LSN> master_lsn;  // For Op::LSN entries.
 };
 
 // Utility for reading TransactionData from a journal reader.
@@ -4,8 +4,40 @@
 
 #include "server/journal/types.h"
 
+#include <absl/strings/match.h>
+
+#include <algorithm>
+
 namespace dfly::journal {
 
+bool Filter::MatchDb(DbIndex dbid) const {
+  return dbs.empty() || std::find(dbs.begin(), dbs.end(), dbid) != dbs.end();
+}
+
+bool Filter::MatchKey(std::string_view key) const {
+  return prefixes.empty() || std::any_of(prefixes.begin(), prefixes.end(), [key](const auto& p) {
+           return absl::StartsWith(key, p);
+         });
+}
+
+bool Filter::Match(const JournalItem& item) const {
+  if (Empty())
+    return true;
+
+  switch (item.opcode) {
+    case Op::MULTI_COMMAND:
+    case Op::EXEC:
+      return MatchDb(item.dbid);
+    case Op::COMMAND:
+    case Op::EXPIRED:
+      if (item.key.empty())
+        return true;
+      return MatchDb(item.dbid) && (item.shard_cnt > 1 || MatchKey(item.key));
+    default:
+      return true;
+  }
+}
+
 std::string Entry::ToString() const {
   std::string rv = absl::StrCat("{op=", opcode, ", dbid=", dbid);
   std::visit(
@@ -6,6 +6,7 @@
 #include <optional>
 #include <string>
 #include <variant>
+#include <vector>
 
 #include "server/cluster/cluster_config.h"
 #include "server/common.h"
@@ -22,6 +23,7 @@ enum class Op : uint8_t {
   MULTI_COMMAND = 11,
   EXEC = 12,
   PING = 13,
+  LSN = 14,  // The current LSN of the master journal in txid. Sent by the streamer, not journaled.
 };
 
 struct EntryBase {
@@ -63,6 +65,10 @@ struct Entry : public EntryBase {
   std::string ToString() const;
 
   Payload payload;
+
+  // The first key of the shard part of a command, empty if it has none. Only set for the
+  // replication filters, see Filter.
+  std::string_view key;
 };
 
 struct ParsedEntry : public EntryBase {
@@ -80,6 +86,28 @@ struct JournalItem {
   Op opcode;
   std::string data;
   std::optional<SlotId> slot;
+  DbIndex dbid = 0;
+  uint32_t shard_cnt = 0;
+  std::string_view key;  // Of the entry, valid only during the change callbacks.
+};
+
+// Selects the data that a replica receives: the keys of the listed databases that start with one
+// of the listed prefixes. An empty list matches everything.
+struct Filter {
+  std::vector<DbIndex> dbs;
+  std::vector<std::string> prefixes;
+
+  bool Empty() const {
+    return dbs.empty() && prefixes.empty();
+  }
+
+  bool MatchDb(DbIndex dbid) const;
+  bool MatchKey(std::string_view key) const;
+
+  // Entries without keys, like FLUSHALL, always match. The entries of transactions and of the
+  // commands that span several shards are matched by their database only, since the replica
+  // executes them once it received all of their parts.
+  bool Match(const JournalItem& item) const;
 };
 
 using ChangeCallback = std::function<void(const JournalItem&, bool await)>;
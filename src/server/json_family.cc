@@ -19,6 +19,7 @@ extern "C" {
 #include <jsoncons_ext/jsonpath/jsonpath.hpp>
 #include <jsoncons_ext/jsonpointer/jsonpointer.hpp>
 
+#include "base/flags.h"
 #include "base/logging.h"
 #include "core/json_object.h"
 #include "facade/cmd_arg_parser.h"
@@ -30,12 +31,16 @@ extern "C" {
 #include "server/tiered_storage.h"
 #include "server/transaction.h"
 
+ABSL_FLAG(bool, json_packed_encoding, false,
+          "If true, JSON documents that are set as a whole or loaded from a snapshot are stored "
+          "in a compact binary encoding and converted to a DOM on their first modification.");
+
 namespace dfly {
 
 using namespace std;
 using namespace jsoncons;
 
-using JsonExpression = jsonpath::jsonpath_expression<JsonType>;
+using JsonExpressionPtr = shared_ptr<const JsonExpression>;
 using OptBool = optional<bool>;
 using OptLong = optional<long>;
 using OptSizeT = optional<size_t>;
@@ -52,7 +57,9 @@ inline OpStatus JsonReplaceVerifyNoOp(JsonType&) {
   return OpStatus::OK;
 }
 
-facade::OpStatus SetJson(const OpArgs& op_args, string_view key, JsonType&& value) {
+// Sets the value of key with set_value(PrimeValue&) and reindexes it.
+template <typename F>
+facade::OpStatus SetJsonValue(const OpArgs& op_args, string_view key, F&& set_value) {
   auto& db_slice = op_args.shard->db_slice();
 
   auto op_res = db_slice.AddOrFind(op_args.db_cntx, key);
@@ -61,13 +68,21 @@ facade::OpStatus SetJson(const OpArgs& op_args, string_view key, JsonType&& valu
   auto& res = *op_res;
 
   op_args.shard->search_indices()->RemoveDoc(key, op_args.db_cntx, res.it->second);
-
-  res.it->second.SetJson(std::move(value));
-
+  set_value(res.it->second);
   op_args.shard->search_indices()->AddDoc(key, op_args.db_cntx, res.it->second);
   return OpStatus::OK;
 }
 
+facade::OpStatus SetJson(const OpArgs& op_args, string_view key, JsonType&& value) {
+  return SetJsonValue(op_args, key, [&value](PrimeValue& pv) {
+    if (absl::GetFlag(FLAGS_json_packed_encoding)) {
+      pv.SetPackedJson(value);
+    } else {
+      pv.SetJson(std::move(value));
+    }
+  });
+}
+
 string JsonTypeToName(const JsonType& val) {
   using namespace std::string_literals;
 
@@ -90,14 +105,14 @@ string JsonTypeToName(const JsonType& val) {
   return std::string{};
 }
 
-io::Result<JsonExpression> ParseJsonPath(string_view path) {
+io::Result<JsonExpressionPtr> ParseJsonPath(string_view path) {
   if (path == ".") {
     // RedisJson V1 uses the dot for root level access.
     // There are more incompatibilities with legacy paths which are not supported.
     path = "$"sv;
   }
   std::error_code ec;
-  JsonExpression res = MakeJsonPathExpr(path, ec);
+  JsonExpressionPtr res = GetJsonPathExpr(path, ec);
   if (ec)
     return nonstd::make_unexpected(ec);
   return res;
@@ -125,29 +140,49 @@ void PrintOptVec(ConnectionContext* cntx, const OpResult<vector<optional<T>>>& r
   }
 }
 
+using ReplaceEvaluator = jsonpath::detail::jsonpath_evaluator<JsonType, JsonType&>;
+
+// Path compiled for evaluation on mutable values. The expression references the selectors owned
+// by its static resources, hence they are allocated together and never moved.
+struct MutableJsonPath {
+  using value_type = ReplaceEvaluator::value_type;
+  using reference = ReplaceEvaluator::reference;
+  using json_selector_t = ReplaceEvaluator::path_expression_type;
+
+  MutableJsonPath(string_view path, error_code& ec)
+      : static_resources(funcs), expr(ReplaceEvaluator{}.compile(static_resources, path, ec)) {
+  }
+
+  jsonpath::custom_functions<JsonType> funcs;
+  jsonpath::detail::static_resources<value_type, reference> static_resources;
+  json_selector_t expr;
+};
+
+constexpr size_t kMutablePathCacheCapacity = 256;
+
 error_code JsonReplace(JsonType& instance, string_view path, JsonReplaceCb callback) {
-  using evaluator_t = jsonpath::detail::jsonpath_evaluator<JsonType, JsonType&>;
-  using value_type = evaluator_t::value_type;
-  using reference = evaluator_t::reference;
-  using json_selector_t = evaluator_t::path_expression_type;
+  using reference = MutableJsonPath::reference;
+  using json_selector_t = MutableJsonPath::json_selector_t;
 
-  jsonpath::custom_functions<JsonType> funcs = jsonpath::custom_functions<JsonType>();
+  static thread_local JsonPathCache<MutableJsonPath> path_cache{kMutablePathCacheCapacity};
 
   error_code ec;
-  jsonpath::detail::static_resources<value_type, reference> static_resources(funcs);
-  evaluator_t e;
-  json_selector_t expr = e.compile(static_resources, path, ec);
-  if (ec) {
-    return ec;
+  shared_ptr<MutableJsonPath> compiled = path_cache.Find(path);
+  if (!compiled) {
+    compiled = make_shared<MutableJsonPath>(path, ec);
+    if (ec) {
+      return ec;
+    }
+    path_cache.Insert(path, compiled);
   }
 
-  jsonpath::detail::dynamic_resources<value_type, reference> resources;
+  jsonpath::detail::dynamic_resources<MutableJsonPath::value_type, reference> resources;
   auto f = [&callback](const json_selector_t::path_node_type& path, reference val) {
     callback(path, val);
   };
 
-  expr.evaluate(resources, instance, json_selector_t::path_node_type{}, instance, f,
-                jsonpath::result_options::nodups | jsonpath::result_options::path);
+  compiled->expr.evaluate(resources, instance, json_selector_t::path_node_type{}, instance, f,
+                          jsonpath::result_options::nodups | jsonpath::result_options::path);
   return ec;
 }
 
@@ -158,6 +193,9 @@ OpStatus UpdateEntry(const OpArgs& op_args, std::string_view key, std::string_vi
     return it_res.status();
   }
 
+  // Packed values are modified as a DOM, which is kept from now on.
+  it_res->it->second.UnpackJson();
+
   PrimeConstIterator entry_it = it_res->it;
   JsonType* json_val = entry_it->second.GetJson();
   DCHECK(json_val) << "should have a valid JSON object for key '" << key << "' the type for it is '"
@@ -183,13 +221,44 @@ OpStatus UpdateEntry(const OpArgs& op_args, std::string_view key, std::string_vi
   return res;
 }
 
-OpResult<JsonType*> GetJson(const OpArgs& op_args, string_view key) {
+// Normalized paths of the modified values with their new json text.
+using JsonUpdates = vector<pair<string, string>>;
+
+// Journals the values written by a json mutation as JSON.SET commands on their normalized paths.
+// Replicas then assign the values directly instead of evaluating the original expression and
+// repeating the operation on their copy of the document.
+void RecordJsonUpdates(const OpArgs& op_args, string_view key, const JsonUpdates& updates) {
+  if (!op_args.shard->journal() || updates.empty())
+    return;
+
+  if (updates.size() == 1) {
+    const auto& [path, value] = updates.front();
+    RecordJournal(op_args, "JSON.SET"sv, ArgSlice{key, path, value});
+    return;
+  }
+
+  for (const auto& [path, value] : updates) {
+    RecordJournal(op_args, "JSON.SET"sv, ArgSlice{key, path, value}, 1, true);
+  }
+  RecordJournalFinish(op_args, 1);
+}
+
+// Returns the json value of key for reading. Packed values are decoded into *tmp instead of
+// being unpacked in place, so that reads do not give up their memory savings.
+OpResult<JsonType*> GetJson(const OpArgs& op_args, string_view key, optional<JsonType>* tmp) {
   OpResult<PrimeConstIterator> it_res =
       op_args.shard->db_slice().FindReadOnly(op_args.db_cntx, key, OBJ_JSON);
   if (!it_res.ok())
     return it_res.status();
 
-  JsonType* json_val = it_res.value()->second.GetJson();
+  const PrimeValue& pv = it_res.value()->second;
+  if (pv.IsPackedJson()) {
+    *tmp = UnpackJson(pv.GetPackedJson());
+    DCHECK(*tmp) << "should have a valid packed JSON object for key " << key;
+    return &tmp->value();
+  }
+
+  JsonType* json_val = pv.GetJson();
   DCHECK(json_val) << "should have a valid JSON object for key " << key;
 
   return json_val;
@@ -397,20 +466,33 @@ void SendJsonValue(RedisReplyBuilder* rb, const JsonType& j) {
 }
 
 OpResult<string> OpJsonGet(const OpArgs& op_args, string_view key,
-                           const vector<pair<string_view, optional<JsonExpression>>>& expressions,
+                           const vector<pair<string_view, JsonExpressionPtr>>& expressions,
                            bool should_format, const OptString& indent, const OptString& new_line,
                            const OptString& space) {
-  OpResult<JsonType*> result = GetJson(op_args, key);
+  if (expressions.empty()) {
+    OpResult<PrimeConstIterator> it_res =
+        op_args.shard->db_slice().FindReadOnly(op_args.db_cntx, key, OBJ_JSON);
+    if (!it_res.ok())
+      return it_res.status();
+
+    // this implicitly means that we're using $ which
+    // means we just brings all values. Packed values are serialized without decoding them.
+    const PrimeValue& pv = it_res.value()->second;
+    if (pv.IsPackedJson()) {
+      optional<string> res = PackedJsonToString(pv.GetPackedJson());
+      DCHECK(res) << "should have a valid packed JSON object for key " << key;
+      return res ? std::move(*res) : string{};
+    }
+    return pv.GetJson()->to_string();
+  }
+
+  optional<JsonType> tmp;
+  OpResult<JsonType*> result = GetJson(op_args, key, &tmp);
   if (!result) {
     return result.status();
   }
 
   const JsonType& json_entry = *(result.value());
-  if (expressions.empty()) {
-    // this implicitly means that we're using $ which
-    // means we just brings all values
-    return json_entry.to_string();
-  }
 
   json_options options;
   if (should_format) {
@@ -435,7 +517,7 @@ OpResult<string> OpJsonGet(const OpArgs& op_args, string_view key,
     }
   }
 
-  auto eval_wrapped = [&json_entry](const optional<JsonExpression>& expr) {
+  auto eval_wrapped = [&json_entry](const JsonExpressionPtr& expr) {
     return expr ? expr->evaluate(json_entry) : json_entry;
   };
 
@@ -457,8 +539,10 @@ OpResult<string> OpJsonGet(const OpArgs& op_args, string_view key,
   return out.as<string>();
 }
 
-OpResult<vector<string>> OpType(const OpArgs& op_args, string_view key, JsonExpression expression) {
-  OpResult<JsonType*> result = GetJson(op_args, key);
+OpResult<vector<string>> OpType(const OpArgs& op_args, string_view key,
+                                const JsonExpression& expression) {
+  optional<JsonType> tmp;
+  OpResult<JsonType*> result = GetJson(op_args, key, &tmp);
   if (!result) {
     return result.status();
   }
@@ -474,8 +558,9 @@ OpResult<vector<string>> OpType(const OpArgs& op_args, string_view key, JsonExpr
 }
 
 OpResult<vector<OptSizeT>> OpStrLen(const OpArgs& op_args, string_view key,
-                                    JsonExpression expression) {
-  OpResult<JsonType*> result = GetJson(op_args, key);
+                                    const JsonExpression& expression) {
+  optional<JsonType> tmp;
+  OpResult<JsonType*> result = GetJson(op_args, key, &tmp);
   if (!result) {
     return result.status();
   }
@@ -494,8 +579,9 @@ OpResult<vector<OptSizeT>> OpStrLen(const OpArgs& op_args, string_view key,
 }
 
 OpResult<vector<OptSizeT>> OpObjLen(const OpArgs& op_args, string_view key,
-                                    JsonExpression expression) {
-  OpResult<JsonType*> result = GetJson(op_args, key);
+                                    const JsonExpression& expression) {
+  optional<JsonType> tmp;
+  OpResult<JsonType*> result = GetJson(op_args, key, &tmp);
   if (!result) {
     return result.status();
   }
@@ -515,8 +601,9 @@ OpResult<vector<OptSizeT>> OpObjLen(const OpArgs& op_args, string_view key,
 }
 
 OpResult<vector<OptSizeT>> OpArrLen(const OpArgs& op_args, string_view key,
-                                    JsonExpression expression) {
-  OpResult<JsonType*> result = GetJson(op_args, key);
+                                    const JsonExpression& expression) {
+  optional<JsonType> tmp;
+  OpResult<JsonType*> result = GetJson(op_args, key, &tmp);
   if (!result) {
     return result.status();
   }
@@ -562,8 +649,10 @@ OpResult<string> OpDoubleArithmetic(const OpArgs& op_args, string_view key, stri
   double int_part;
   bool has_fractional_part = (modf(num, &int_part) != 0);
   JsonType output(json_array_arg);
+  JsonUpdates updates;
+  bool journal = op_args.shard->journal() != nullptr;
 
-  auto cb = [&](const auto&, JsonType& val) {
+  auto cb = [&](const JsonExpression::path_node_type& path, JsonType& val) {
     if (val.is_number()) {
       double result = arithmetic_op(val.as<double>(), num);
       if (isinf(result)) {
@@ -577,6 +666,9 @@ OpResult<string> OpDoubleArithmetic(const OpArgs& op_args, string_view key, stri
         val = (uint64_t)result;
       }
       output.push_back(val);
+      if (journal) {
+        updates.emplace_back(jsonpath::to_string(path), val.to_string());
+      }
     } else {
       output.push_back(JsonType::null());
     }
@@ -594,6 +686,7 @@ OpResult<string> OpDoubleArithmetic(const OpArgs& op_args, string_view key, stri
     return status;
   }
 
+  RecordJsonUpdates(op_args, key, updates);
   return output.as_string();
 }
 
@@ -606,17 +699,18 @@ OpResult<long> OpDel(const OpArgs& op_args, string_view key, string_view path) {
     return total_deletions;
   }
 
-  OpResult<JsonType*> result = GetJson(op_args, key);
-  if (!result) {
+  auto it_res = op_args.shard->db_slice().FindMutable(op_args.db_cntx, key, OBJ_JSON);
+  if (!it_res) {
     return total_deletions;
   }
+  it_res->it->second.UnpackJson();
 
   vector<string> deletion_items;
   auto cb = [&](const JsonExpression::path_node_type& path, JsonType& val) {
     deletion_items.emplace_back(jsonpath::to_string(path));
   };
 
-  JsonType& json_entry = *(result.value());
+  JsonType& json_entry = *it_res->it->second.GetJson();
   error_code ec = JsonReplace(json_entry, path, cb);
   if (ec) {
     VLOG(1) << "Failed to evaluate expression on json with error: " << ec.message();
@@ -636,7 +730,9 @@ OpResult<long> OpDel(const OpArgs& op_args, string_view key, string_view path) {
     patch.emplace_back(patch_item);
   }
 
+  op_args.shard->search_indices()->RemoveDoc(key, op_args.db_cntx, it_res->it->second);
   jsonpatch::apply_patch(json_entry, patch, ec);
+  op_args.shard->search_indices()->AddDoc(key, op_args.db_cntx, it_res->it->second);
   if (ec) {
     VLOG(1) << "Failed to apply patch on json with error: " << ec.message();
     return 0;
@@ -649,8 +745,9 @@ OpResult<long> OpDel(const OpArgs& op_args, string_view key, string_view path) {
 // Returns a vector of string vectors,
 // keys within the same object are stored in the same string vector.
 OpResult<vector<StringVec>> OpObjKeys(const OpArgs& op_args, string_view key,
-                                      JsonExpression expression) {
-  OpResult<JsonType*> result = GetJson(op_args, key);
+                                      const JsonExpression& expression) {
+  optional<JsonType> tmp;
+  OpResult<JsonType*> result = GetJson(op_args, key, &tmp);
   if (!result) {
     return result.status();
   }
@@ -890,11 +987,6 @@ OpResult<vector<OptSizeT>> OpArrAppend(const OpArgs& op_args, string_view key, s
                                        const vector<JsonType>& append_values) {
   vector<OptSizeT> vec;
 
-  OpResult<JsonType*> result = GetJson(op_args, key);
-  if (!result) {
-    return result.status();
-  }
-
   auto cb = [&](const auto&, JsonType& val) {
     if (!val.is_array()) {
       vec.emplace_back(nullopt);
@@ -918,9 +1010,10 @@ OpResult<vector<OptSizeT>> OpArrAppend(const OpArgs& op_args, string_view key, s
 // An index value of -1 represents unfound in the array.
 // JSON scalar has types of string, boolean, null, and number.
 OpResult<vector<OptLong>> OpArrIndex(const OpArgs& op_args, string_view key,
-                                     JsonExpression expression, const JsonType& search_val,
+                                     const JsonExpression& expression, const JsonType& search_val,
                                      int start_index, int end_index) {
-  OpResult<JsonType*> result = GetJson(op_args, key);
+  optional<JsonType> tmp;
+  OpResult<JsonType*> result = GetJson(op_args, key, &tmp);
   if (!result) {
     return result.status();
   }
@@ -980,7 +1073,8 @@ OpResult<vector<OptLong>> OpArrIndex(const OpArgs& op_args, string_view key,
 }
 
 // Returns string vector that represents the query result of each supplied key.
-vector<OptString> OpJsonMGet(JsonExpression expression, const Transaction* t, EngineShard* shard) {
+vector<OptString> OpJsonMGet(const JsonExpression& expression, const Transaction* t,
+                             EngineShard* shard) {
   auto args = t->GetShardArgs(shard->shard_id());
   DCHECK(!args.empty());
   vector<OptString> response(args.size());
@@ -993,35 +1087,30 @@ vector<OptString> OpJsonMGet(JsonExpression expression, const Transaction* t, En
       continue;
 
     auto& dest = response[i].emplace();
-    JsonType* json_val = it_res.value()->second.GetJson();
+    optional<JsonType> tmp;
+    const PrimeValue& pv = it_res.value()->second;
+    if (pv.IsPackedJson())
+      tmp = UnpackJson(pv.GetPackedJson());
+    JsonType* json_val = tmp ? &tmp.value() : pv.GetJson();
     DCHECK(json_val) << "should have a valid JSON object for key " << args[i];
 
-    vector<JsonType> query_result;
-    auto cb = [&query_result](const string_view& path, const JsonType& val) {
-      query_result.push_back(val);
+    // The matches are dumped right into the array of the reply, instead of being copied into a
+    // JSON array first.
+    error_code ec;
+    auto cb = [&dest, &ec](const string_view& path, const JsonType& val) {
+      dest.push_back(dest.empty() ? '[' : ',');
+      error_code val_ec;
+      val.dump(dest, {}, val_ec);
+      if (val_ec)
+        ec = val_ec;
     };
+    expression.evaluate(*json_val, cb);
 
-    const JsonType& json_entry = *(json_val);
-    expression.evaluate(json_entry, cb);
-
-    if (query_result.empty()) {
-      continue;
-    }
-
-    JsonType arr(json_array_arg);
-    arr.reserve(query_result.size());
-    for (auto& s : query_result) {
-      arr.push_back(s);
-    }
-
-    string str;
-    error_code ec;
-    arr.dump(str, {}, ec);
     if (ec) {
       VLOG(1) << "Failed to dump JSON array to string with the error: " << ec.message();
     }
-
-    dest = std::move(str);
+    if (!dest.empty())
+      dest.push_back(']');
   }
 
   return response;
@@ -1029,8 +1118,9 @@ vector<OptString> OpJsonMGet(JsonExpression expression, const Transaction* t, En
 
 // Returns numeric vector that represents the number of fields of JSON value at each path.
 OpResult<vector<OptSizeT>> OpFields(const OpArgs& op_args, string_view key,
-                                    JsonExpression expression) {
-  OpResult<JsonType*> result = GetJson(op_args, key);
+                                    const JsonExpression& expression) {
+  optional<JsonType> tmp;
+  OpResult<JsonType*> result = GetJson(op_args, key, &tmp);
   if (!result) {
     return result.status();
   }
@@ -1046,8 +1136,9 @@ OpResult<vector<OptSizeT>> OpFields(const OpArgs& op_args, string_view key,
 
 // Returns json vector that represents the result of the json query.
 OpResult<vector<JsonType>> OpResp(const OpArgs& op_args, string_view key,
-                                  JsonExpression expression) {
-  OpResult<JsonType*> result = GetJson(op_args, key);
+                                  const JsonExpression& expression) {
+  optional<JsonType> tmp;
+  OpResult<JsonType*> result = GetJson(op_args, key, &tmp);
   if (!result) {
     return result.status();
   }
@@ -1062,8 +1153,18 @@ OpResult<vector<JsonType>> OpResp(const OpArgs& op_args, string_view key,
 // Returns boolean that represents the result of the operation.
 OpResult<bool> OpSet(const OpArgs& op_args, string_view key, string_view path,
                      std::string_view json_str, bool is_nx_condition, bool is_xx_condition) {
-  std::optional<JsonType> parsed_json = JsonFromString(json_str);
-  if (!parsed_json) {
+  std::optional<JsonType> parsed_json;
+  std::optional<vector<uint8_t>> packed_json;
+  bool is_root = (path == "." || path == "$");
+
+  // Whole documents are packed straight from the text when possible, without building the DOM.
+  if (is_root && absl::GetFlag(FLAGS_json_packed_encoding)) {
+    packed_json = PackJsonFromString(json_str);
+  } else {
+    parsed_json = JsonFromString(json_str);
+  }
+
+  if (!parsed_json && !packed_json) {
     LOG(WARNING) << "got invalid JSON string '" << json_str << "' cannot be saved";
     return OpStatus::SYNTAX_ERR;
   }
@@ -1072,7 +1173,7 @@ OpResult<bool> OpSet(const OpArgs& op_args, string_view key, string_view path,
   // NOTE: unlike in Redis, we are overriding the value when the path is "$"
   // this is regardless of the current key type. In redis if the key exists
   // and its not JSON, it would return an error.
-  if (path == "." || path == "$") {
+  if (is_root) {
     if (is_nx_condition || is_xx_condition) {
       OpResult<PrimeConstIterator> it_res =
           op_args.shard->db_slice().FindReadOnly(op_args.db_cntx, key, OBJ_JSON);
@@ -1086,7 +1187,15 @@ OpResult<bool> OpSet(const OpArgs& op_args, string_view key, string_view path,
       }
     }
 
-    if (SetJson(op_args, key, std::move(parsed_json.value())) == OpStatus::OUT_OF_MEMORY) {
+    OpStatus st;
+    if (packed_json) {
+      string_view packed{reinterpret_cast<const char*>(packed_json->data()), packed_json->size()};
+      st = SetJsonValue(op_args, key, [packed](PrimeValue& pv) { pv.SetPackedJson(packed); });
+    } else {
+      st = SetJson(op_args, key, std::move(parsed_json.value()));
+    }
+
+    if (st == OpStatus::OUT_OF_MEMORY) {
       return OpStatus::OUT_OF_MEMORY;
     }
 
@@ -1146,7 +1255,7 @@ OpResult<bool> OpSet(const OpArgs& op_args, string_view key, string_view path,
 // GCC extension of returning a value of multiple statements. The last statement is returned.
 #define PARSE_PATH_ARG(path)                                                   \
   ({                                                                           \
-    io::Result<JsonExpression> expr_result = ParseJsonPath(path);              \
+    io::Result<JsonExpressionPtr> expr_result = ParseJsonPath(path);           \
     if (!expr_result) {                                                        \
       VLOG(1) << "Invalid JSONPath syntax: " << expr_result.error().message(); \
       cntx->SendError(kSyntaxErr);                                             \
@@ -1201,10 +1310,10 @@ void JsonFamily::Resp(CmdArgList args, ConnectionContext* cntx) {
     path = ArgS(args, 1);
   }
 
-  JsonExpression expression = PARSE_PATH_ARG(path);
+  JsonExpressionPtr expression = PARSE_PATH_ARG(path);
 
   auto cb = [&](Transaction* t, EngineShard* shard) {
-    return OpResp(t->GetOpArgs(shard), key, std::move(expression));
+    return OpResp(t->GetOpArgs(shard), key, *expression);
   };
 
   Transaction* trans = cntx->transaction;
@@ -1249,10 +1358,10 @@ void JsonFamily::Debug(CmdArgList args, ConnectionContext* cntx) {
 
   string_view key = ArgS(args, 1);
   string_view path = ArgS(args, 2);
-  JsonExpression expression = PARSE_PATH_ARG(path);
+  JsonExpressionPtr expression = PARSE_PATH_ARG(path);
 
   auto cb = [&](Transaction* t, EngineShard* shard) {
-    return func(t->GetOpArgs(shard), key, std::move(expression));
+    return func(t->GetOpArgs(shard), key, *expression);
   };
 
   Transaction* trans = cntx->transaction;
@@ -1269,7 +1378,7 @@ void JsonFamily::MGet(CmdArgList args, ConnectionContext* cntx) {
   DCHECK_GE(args.size(), 1U);
 
   string_view path = ArgS(args, args.size() - 1);
-  JsonExpression expression = PARSE_PATH_ARG(path);
+  JsonExpressionPtr expression = PARSE_PATH_ARG(path);
 
   Transaction* transaction = cntx->transaction;
   unsigned shard_count = shard_set->size();
@@ -1277,14 +1386,15 @@ void JsonFamily::MGet(CmdArgList args, ConnectionContext* cntx) {
 
   auto cb = [&](Transaction* t, EngineShard* shard) {
     ShardId sid = shard->shard_id();
-    mget_resp[sid] = OpJsonMGet(*ParseJsonPath(path), t, shard);
+    mget_resp[sid] = OpJsonMGet(*expression, t, shard);
     return OpStatus::OK;
   };
 
   OpStatus result = transaction->ScheduleSingleHop(std::move(cb));
   CHECK_EQ(OpStatus::OK, result);
 
-  std::vector<OptString> results(args.size() - 1);
+  // The replies of the keys in the order of the arguments, pointing to the results of the shards.
+  std::vector<const OptString*> results(args.size() - 1, nullptr);
   for (ShardId sid = 0; sid < shard_count; ++sid) {
     if (!transaction->IsActive(sid))
       continue;
@@ -1295,22 +1405,17 @@ void JsonFamily::MGet(CmdArgList args, ConnectionContext* cntx) {
     DCHECK(!slice.empty());
     DCHECK_EQ(slice.size(), res.size());
 
-    for (size_t j = 0; j < slice.size(); ++j) {
-      if (!res[j])
-        continue;
-
-      uint32_t indx = transaction->ReverseArgIndex(sid, j);
-      results[indx] = std::move(res[j]);
-    }
+    for (size_t j = 0; j < slice.size(); ++j)
+      results[transaction->ReverseArgIndex(sid, j)] = &res[j];
   }
 
   auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
   rb->StartArray(results.size());
-  for (auto& it : results) {
-    if (!it) {
+  for (const OptString* res : results) {
+    if (!res || !*res) {
       rb->SendNull();
     } else {
-      rb->SendBulkString(*it);
+      rb->SendBulkString(**res);
     }
   }
 }
@@ -1319,7 +1424,7 @@ void JsonFamily::ArrIndex(CmdArgList args, ConnectionContext* cntx) {
   string_view key = ArgS(args, 0);
   string_view path = ArgS(args, 1);
 
-  JsonExpression expression = PARSE_PATH_ARG(path);
+  JsonExpressionPtr expression = PARSE_PATH_ARG(path);
 
   optional<JsonType> search_value = JsonFromString(ArgS(args, 2));
   if (!search_value) {
@@ -1351,7 +1456,7 @@ void JsonFamily::ArrIndex(CmdArgList args, ConnectionContext* cntx) {
   }
 
   auto cb = [&](Transaction* t, EngineShard* shard) {
-    return OpArrIndex(t->GetOpArgs(shard), key, std::move(expression), *search_value, start_index,
+    return OpArrIndex(t->GetOpArgs(shard), key, *expression, *search_value, start_index,
                       end_index);
   };
 
@@ -1542,10 +1647,10 @@ void JsonFamily::ObjKeys(CmdArgList args, ConnectionContext* cntx) {
   string_view key = ArgS(args, 0);
   string_view path = ArgS(args, 1);
 
-  JsonExpression expression = PARSE_PATH_ARG(path);
+  JsonExpressionPtr expression = PARSE_PATH_ARG(path);
 
   auto cb = [&](Transaction* t, EngineShard* shard) {
-    return OpObjKeys(t->GetOpArgs(shard), key, std::move(expression));
+    return OpObjKeys(t->GetOpArgs(shard), key, *expression);
   };
 
   Transaction* trans = cntx->transaction;
@@ -1653,10 +1758,10 @@ void JsonFamily::Type(CmdArgList args, ConnectionContext* cntx) {
   string_view key = ArgS(args, 0);
   string_view path = ArgS(args, 1);
 
-  JsonExpression expression = PARSE_PATH_ARG(path);
+  JsonExpressionPtr expression = PARSE_PATH_ARG(path);
 
   auto cb = [&](Transaction* t, EngineShard* shard) {
-    return OpType(t->GetOpArgs(shard), key, std::move(expression));
+    return OpType(t->GetOpArgs(shard), key, *expression);
   };
 
   Transaction* trans = cntx->transaction;
@@ -1682,10 +1787,10 @@ void JsonFamily::ArrLen(CmdArgList args, ConnectionContext* cntx) {
   string_view key = ArgS(args, 0);
   string_view path = ArgS(args, 1);
 
-  JsonExpression expression = PARSE_PATH_ARG(path);
+  JsonExpressionPtr expression = PARSE_PATH_ARG(path);
 
   auto cb = [&](Transaction* t, EngineShard* shard) {
-    return OpArrLen(t->GetOpArgs(shard), key, std::move(expression));
+    return OpArrLen(t->GetOpArgs(shard), key, *expression);
   };
 
   Transaction* trans = cntx->transaction;
@@ -1702,10 +1807,10 @@ void JsonFamily::ObjLen(CmdArgList args, ConnectionContext* cntx) {
   string_view key = ArgS(args, 0);
   string_view path = ArgS(args, 1);
 
-  JsonExpression expression = PARSE_PATH_ARG(path);
+  JsonExpressionPtr expression = PARSE_PATH_ARG(path);
 
   auto cb = [&](Transaction* t, EngineShard* shard) {
-    return OpObjLen(t->GetOpArgs(shard), key, std::move(expression));
+    return OpObjLen(t->GetOpArgs(shard), key, *expression);
   };
 
   Transaction* trans = cntx->transaction;
@@ -1722,10 +1827,10 @@ void JsonFamily::StrLen(CmdArgList args, ConnectionContext* cntx) {
   string_view key = ArgS(args, 0);
   string_view path = ArgS(args, 1);
 
-  JsonExpression expression = PARSE_PATH_ARG(path);
+  JsonExpressionPtr expression = PARSE_PATH_ARG(path);
 
   auto cb = [&](Transaction* t, EngineShard* shard) {
-    return OpStrLen(t->GetOpArgs(shard), key, std::move(expression));
+    return OpStrLen(t->GetOpArgs(shard), key, *expression);
   };
 
   Transaction* trans = cntx->transaction;
@@ -1747,7 +1852,7 @@ void JsonFamily::Get(CmdArgList args, ConnectionContext* cntx) {
   OptString indent;
   OptString new_line;
   OptString space;
-  vector<pair<string_view, optional<JsonExpression>>> expressions;
+  vector<pair<string_view, JsonExpressionPtr>> expressions;
 
   while (parser.HasNext()) {
     if (parser.Check("SPACE").IgnoreCase().ExpectTail(1)) {
@@ -1763,17 +1868,17 @@ void JsonFamily::Get(CmdArgList args, ConnectionContext* cntx) {
       continue;
     }
 
-    optional<JsonExpression> expr;
+    JsonExpressionPtr expr;
     string_view expr_str = parser.Next();
 
     if (expr_str != ".") {
-      io::Result<JsonExpression> res = ParseJsonPath(expr_str);
+      io::Result<JsonExpressionPtr> res = ParseJsonPath(expr_str);
       if (!res) {
         LOG(WARNING) << "path '" << expr_str
                      << "': Invalid JSONPath syntax: " << res.error().message();
         return cntx->SendError(kSyntaxErr);
       }
-      expr.emplace(std::move(*res));
+      expr = std::move(*res);
     }
 
     expressions.emplace_back(expr_str, std::move(expr));
@@ -1819,8 +1924,10 @@ void JsonFamily::Register(CommandRegistry* registry) {
   *registry << CI{"JSON.OBJLEN", CO::READONLY | CO::FAST, 3, 1, 1, acl::JSON}.HFUNC(ObjLen);
   *registry << CI{"JSON.ARRLEN", CO::READONLY | CO::FAST, 3, 1, 1, acl::JSON}.HFUNC(ArrLen);
   *registry << CI{"JSON.TOGGLE", CO::WRITE | CO::FAST, 3, 1, 1, acl::JSON}.HFUNC(Toggle);
-  *registry << CI{"JSON.NUMINCRBY", CO::WRITE | CO::FAST, 4, 1, 1, acl::JSON}.HFUNC(NumIncrBy);
-  *registry << CI{"JSON.NUMMULTBY", CO::WRITE | CO::FAST, 4, 1, 1, acl::JSON}.HFUNC(NumMultBy);
+  *registry << CI{"JSON.NUMINCRBY", CO::WRITE | CO::FAST | CO::NO_AUTOJOURNAL, 4, 1, 1, acl::JSON}
+                   .HFUNC(NumIncrBy);
+  *registry << CI{"JSON.NUMMULTBY", CO::WRITE | CO::FAST | CO::NO_AUTOJOURNAL, 4, 1, 1, acl::JSON}
+                   .HFUNC(NumMultBy);
   *registry << CI{"JSON.DEL", CO::WRITE, -2, 1, 1, acl::JSON}.HFUNC(Del);
   *registry << CI{"JSON.FORGET", CO::WRITE, -2, 1, 1, acl::JSON}.HFUNC(
       Del);  // An alias of JSON.DEL.
@@ -8,6 +8,7 @@
 
 #include <jsoncons/json.hpp>
 
+#include "base/flags.h"
 #include "base/gtest.h"
 #include "base/logging.h"
 #include "facade/facade_test.h"
@@ -18,6 +19,8 @@ using namespace testing;
 using namespace std;
 using namespace util;
 
+ABSL_DECLARE_FLAG(bool, json_packed_encoding);
+
 namespace dfly {
 
 class JsonFamilyTest : public BaseFamilyTest {
@@ -156,6 +159,41 @@ TEST_F(JsonFamilyTest, SetGetFromPhonebook) {
       R"([st{stt"number":s"212 555-1234",stt"type":s"home"st},st{stt"number":s"646 555-4567",stt"type":s"office"st}s])");
 }
 
+TEST_F(JsonFamilyTest, PackedEncoding) {
+  absl::SetFlag(&FLAGS_json_packed_encoding, true);
+  string json = R"({"a":{"a":"foo"},"b":[1,2,3],"c":1})";
+
+  auto resp = Run({"JSON.SET", "json", "$", json});
+  ASSERT_THAT(resp, "OK");
+
+  resp = Run({"JSON.GET", "json"});
+  EXPECT_EQ(resp, json);
+
+  resp = Run({"JSON.GET", "json", "$.a.a"});
+  EXPECT_EQ(resp, R"(["foo"])");
+
+  resp = Run({"JSON.TYPE", "json", "$.b"});
+  EXPECT_EQ(resp, "array");
+
+  resp = Run({"JSON.STRLEN", "json", "$.a.a"});
+  EXPECT_THAT(resp, IntArg(3));
+
+  // Writes unpack the value.
+  resp = Run({"JSON.NUMINCRBY", "json", "$.c", "2"});
+  EXPECT_EQ(resp, "[3]");
+
+  resp = Run({"JSON.DEL", "json", "$.b"});
+  EXPECT_THAT(resp, IntArg(1));
+
+  resp = Run({"JSON.GET", "json"});
+  EXPECT_EQ(resp, R"({"a":{"a":"foo"},"c":3})");
+
+  resp = Run({"JSON.SET", "json", "$", R"({"a":)"});
+  EXPECT_THAT(resp, ErrArg("syntax error"));
+
+  absl::SetFlag(&FLAGS_json_packed_encoding, false);
+}
+
 TEST_F(JsonFamilyTest, Type) {
   string json = R"(
     [1, 2.3, "foo", true, null, {}, []]
@@ -409,6 +447,21 @@ TEST_F(JsonFamilyTest, NumIncrBy) {
   EXPECT_EQ(resp, R"([{"a":"a"},{"a":"a","b":2},{"a":"a","b":"b"},{"a":2,"b":"b","c":4}])");
 }
 
+TEST_F(JsonFamilyTest, SetNormalizedPath) {
+  // Numeric updates are replicated as JSON.SET on the normalized paths of the changed values.
+  auto resp = Run({"JSON.SET", "json", "$", R"({"a":{"b":[1,2.5]},"c":"x"})"});
+  ASSERT_THAT(resp, "OK");
+
+  resp = Run({"JSON.SET", "json", "$['a']['b'][1]", "3.5"});
+  EXPECT_EQ(resp, "OK");
+
+  resp = Run({"JSON.SET", "json", "$['a']['b'][0]", "7"});
+  EXPECT_EQ(resp, "OK");
+
+  resp = Run({"JSON.GET", "json"});
+  EXPECT_EQ(resp, R"({"a":{"b":[7,3.5]},"c":"x"})");
+}
+
 TEST_F(JsonFamilyTest, NumMultBy) {
   string json = R"(
     {"a":[], "b":[1], "c":[1,2], "d":[1,2,3]}
@@ -935,6 +988,11 @@ TEST_F(JsonFamilyTest, MGet) {
   resp = Run({"JSON.MGET", "json3", "json4", "$..a"});
   ASSERT_EQ(RespExpr::ARRAY, resp.type);
   EXPECT_THAT(resp.GetVec(), ElementsAre(R"([1,3])", R"([4,6])"));
+
+  resp = Run({"JSON.MGET", "json3", "nokey", "json3", "$.nested"});
+  ASSERT_EQ(RespExpr::ARRAY, resp.type);
+  EXPECT_THAT(resp.GetVec(),
+              ElementsAre(R"([{"a":3}])", ArgType(RespExpr::NIL), R"([{"a":3}])"));
 }
 
 TEST_F(JsonFamilyTest, DebugFields) {
@@ -77,6 +77,58 @@ quicklist* GetQL(const PrimeValue& mv) {
   return (quicklist*)mv.RObjPtr();
 }
 
+// List elements stored back to back in a single buffer. Replies of LRANGE and LPOP/RPOP with
+// COUNT use it instead of StringVec, which allocates a string per element.
+class ListElements {
+ public:
+  void Reserve(size_t count) {
+    sizes_.reserve(count);
+  }
+
+  void Append(container_utils::ContainerEntry ce) {
+    if (ce.value) {
+      buf_.append(ce.value, ce.length);
+      sizes_.push_back(ce.length);
+    } else {
+      char tmp[absl::numbers_internal::kFastToBufferSize];
+      char* next = absl::numbers_internal::FastIntToBuffer(ce.longval, tmp);
+      buf_.append(tmp, next - tmp);
+      sizes_.push_back(next - tmp);
+    }
+  }
+
+  // Reverses the order of the elements returned by Views().
+  void Reverse() {
+    reversed_ = !reversed_;
+  }
+
+  size_t Size() const {
+    return sizes_.size();
+  }
+
+  bool Empty() const {
+    return sizes_.empty();
+  }
+
+  // The views are valid as long as this object is not modified.
+  vector<string_view> Views() const {
+    vector<string_view> res(sizes_.size());
+    const char* next = buf_.data();
+    for (size_t i = 0; i < sizes_.size(); ++i) {
+      res[i] = string_view{next, sizes_[i]};
+      next += sizes_[i];
+    }
+    if (reversed_)
+      reverse(res.begin(), res.end());
+    return res;
+  }
+
+ private:
+  string buf_;
+  vector<uint32_t> sizes_;
+  bool reversed_ = false;
+};
+
 void* listPopSaver(unsigned char* data, size_t sz) {
   return createStringObject((char*)data, sz);
 }
@@ -368,8 +420,8 @@ OpResult<uint32_t> OpPush(const OpArgs& op_args, std::string_view key, ListDir d
   return quicklistCount(ql);
 }
 
-OpResult<StringVec> OpPop(const OpArgs& op_args, string_view key, ListDir dir, uint32_t count,
-                          bool return_results, bool journal_rewrite) {
+OpResult<ListElements> OpPop(const OpArgs& op_args, string_view key, ListDir dir, uint32_t count,
+                             bool return_results, bool journal_rewrite) {
   auto& db_slice = op_args.shard->db_slice();
   auto it_res = db_slice.FindMutable(op_args.db_cntx, key, OBJ_LIST);
   if (!it_res)
@@ -378,21 +430,29 @@ OpResult<StringVec> OpPop(const OpArgs& op_args, string_view key, ListDir dir, u
   PrimeIterator it = it_res->it;
   quicklist* ql = GetQL(it->second);
 
-  StringVec res;
+  ListElements res;
   if (quicklistCount(ql) < count) {
     count = quicklistCount(ql);
   }
-  res.reserve(count);
+  long start = dir == ListDir::LEFT ? 0 : long(quicklistCount(ql)) - count;
 
+  // Read the popped range directly from the nodes and then drop it at once, instead of
+  // popping the elements one by one.
   if (return_results) {
-    for (unsigned i = 0; i < count; ++i) {
-      res.push_back(ListPop(dir, ql));
-    }
-  } else {
-    for (unsigned i = 0; i < count; ++i) {
-      ListPop(dir, ql);
-    }
+    res.Reserve(count);
+    container_utils::IterateList(
+        it->second,
+        [&res](container_utils::ContainerEntry ce) {
+          res.Append(ce);
+          return true;
+        },
+        start, start + long(count) - 1);
+
+    // Elements popped from the tail are returned starting from the last one.
+    if (dir == ListDir::RIGHT)
+      res.Reverse();
   }
+  quicklistDelRange(ql, start, count);
 
   it_res->post_updater.Run();
 
@@ -684,7 +744,7 @@ OpStatus OpTrim(const OpArgs& op_args, string_view key, long start, long end) {
   return OpStatus::OK;
 }
 
-OpResult<StringVec> OpRange(const OpArgs& op_args, std::string_view key, long start, long end) {
+OpResult<ListElements> OpRange(const OpArgs& op_args, std::string_view key, long start, long end) {
   auto res = op_args.shard->db_slice().FindReadOnly(op_args.db_cntx, key, OBJ_LIST);
   if (!res)
     return res.status();
@@ -704,19 +764,23 @@ OpResult<StringVec> OpRange(const OpArgs& op_args, std::string_view key, long st
    * The range is empty when start > end or start >= length. */
   if (start > end || start >= llen) {
     /* Out of range start or start > end result in empty list */
-    return StringVec{};
+    return ListElements{};
   }
 
-  StringVec str_vec;
+  if (end >= llen)
+    end = llen - 1;
+
+  ListElements elements;
+  elements.Reserve(end - start + 1);
   container_utils::IterateList(
       res.value()->second,
-      [&str_vec](container_utils::ContainerEntry ce) {
-        str_vec.emplace_back(ce.ToString());
+      [&elements](container_utils::ContainerEntry ce) {
+        elements.Append(ce);
         return true;
       },
       start, end);
 
-  return str_vec;
+  return elements;
 }
 
 void MoveGeneric(ConnectionContext* cntx, string_view src, string_view dest, ListDir src_dir,
@@ -881,7 +945,7 @@ OpResult<string> BPopPusher::RunSingle(Transaction* t, time_point tp) {
     return owner->db_slice().FindReadOnly(context, key, OBJ_LIST).ok();
   };
   // Block
-  if (auto status = t->WaitOnWatch(tp, std::move(wcb), key_checker); status != OpStatus::OK)
+  if (auto status = t->WaitOnWatch(tp, std::move(wcb), key_checker, true); status != OpStatus::OK)
     return status;
 
   t->Execute(cb_move, true);
@@ -910,7 +974,7 @@ OpResult<string> BPopPusher::RunPair(Transaction* t, time_point tp) {
     return owner->db_slice().FindReadOnly(context, key, OBJ_LIST).ok();
   };
 
-  if (auto status = t->WaitOnWatch(tp, std::move(wcb), key_checker); status != OpStatus::OK)
+  if (auto status = t->WaitOnWatch(tp, std::move(wcb), key_checker, true); status != OpStatus::OK)
     return status;
 
   return MoveTwoShards(t, pop_key_, push_key_, popdir_, pushdir_, true);
@@ -1107,7 +1171,7 @@ void ListFamily::LRange(CmdArgList args, ConnectionContext* cntx) {
   }
 
   auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
-  rb->SendStringArr(*res);
+  rb->SendStringArr(res->Views());
 }
 
 // lrem key 5 foo, will remove foo elements from the list if exists at most 5 times.
@@ -1273,7 +1337,7 @@ void ListFamily::PopGeneric(ListDir dir, CmdArgList args, ConnectionContext* cnt
     return OpPop(t->GetOpArgs(shard), key, dir, count, true, false);
   };
 
-  OpResult<StringVec> result = cntx->transaction->ScheduleSingleHopT(std::move(cb));
+  OpResult<ListElements> result = cntx->transaction->ScheduleSingleHopT(std::move(cb));
   auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
   switch (result.status()) {
     case OpStatus::KEY_NOTFOUND:
@@ -1284,17 +1348,14 @@ void ListFamily::PopGeneric(ListDir dir, CmdArgList args, ConnectionContext* cnt
   }
 
   if (return_arr) {
-    if (result->empty()) {
+    if (result->Empty()) {
       rb->SendNullArray();
     } else {
-      rb->StartArray(result->size());
-      for (const auto& k : *result) {
-        rb->SendBulkString(k);
-      }
+      rb->SendStringArr(result->Views());
     }
   } else {
-    DCHECK_EQ(1u, result->size());
-    rb->SendBulkString(result->front());
+    DCHECK_EQ(1u, result->Size());
+    rb->SendBulkString(result->Views().front());
   }
 }
 
@@ -4,6 +4,7 @@
 
 #include "server/list_family.h"
 
+#include <absl/container/flat_hash_set.h>
 #include <absl/strings/match.h>
 
 #include "base/gtest.h"
@@ -22,6 +23,8 @@ using namespace std;
 using namespace util;
 using absl::StrCat;
 
+ABSL_DECLARE_FLAG(int32_t, list_compress_depth);
+
 namespace dfly {
 
 class ListFamilyTest : public BaseFamilyTest {
@@ -240,6 +243,41 @@ TEST_F(ListFamilyTest, BLPopMultiPush) {
   ASSERT_EQ(0, NumWatched());
 }
 
+TEST_F(ListFamilyTest, BLPopManyWaiters) {
+  constexpr unsigned kNumWaiters = 64;
+  auto num_blocked = [this] { return GetMetrics().facade_stats.conn_stats.num_blocked_clients; };
+
+  vector<RespExpr> resps(kNumWaiters);
+  vector<Fiber> fibers(kNumWaiters);
+  for (unsigned i = 0; i < kNumWaiters; ++i) {
+    fibers[i] = pp_->at(i % num_threads_)->LaunchFiber([&, i] {
+      resps[i] = Run(absl::StrCat("w", i), {"blpop", kKey1, "0"});
+    });
+  }
+  while (num_blocked() < kNumWaiters)
+    ThisFiber::SleepFor(1ms);
+
+  // More waiters than items, every item is handed to exactly one of them.
+  for (unsigned i = 0; i < kNumWaiters / 2; ++i)
+    Run({"lpush", kKey1, absl::StrCat(i)});
+  while (num_blocked() > kNumWaiters / 2)
+    ThisFiber::SleepFor(1ms);
+  EXPECT_EQ(0, CheckedInt({"exists", kKey1}));
+
+  for (unsigned i = kNumWaiters / 2; i < kNumWaiters; ++i)
+    Run({"lpush", kKey1, absl::StrCat(i)});
+
+  absl::flat_hash_set<string> popped;
+  for (unsigned i = 0; i < kNumWaiters; ++i) {
+    fibers[i].Join();
+    ASSERT_THAT(resps[i], ArrLen(2));
+    popped.insert(resps[i].GetVec()[1].GetString());
+  }
+  EXPECT_EQ(kNumWaiters, popped.size());
+  EXPECT_EQ(0, NumWatched());
+  EXPECT_FALSE(HasAwakened());
+}
+
 TEST_F(ListFamilyTest, WrongTypeDoesNotWake) {
   RespExpr blpop_resp;
 
@@ -384,6 +422,50 @@ TEST_F(ListFamilyTest, LRange) {
   ASSERT_THAT(resp.GetVec(), ElementsAre("1", "2"));
 }
 
+TEST_F(ListFamilyTest, PopCount) {
+  Run({"rpush", kKey1, "a", "1", "b", "22", "c"});
+  auto resp = Run({"lpop", kKey1, "2"});
+  ASSERT_THAT(resp, ArrLen(2));
+  EXPECT_THAT(resp.GetVec(), ElementsAre("a", "1"));
+
+  resp = Run({"rpop", kKey1, "2"});
+  ASSERT_THAT(resp, ArrLen(2));
+  EXPECT_THAT(resp.GetVec(), ElementsAre("c", "22"));
+
+  EXPECT_EQ(Run({"rpop", kKey1, "5"}), "b");
+  EXPECT_EQ(0, CheckedInt({"exists", kKey1}));
+  EXPECT_THAT(Run({"lpop", kKey1, "2"}), ArgType(RespExpr::NIL));
+}
+
+TEST_F(ListFamilyTest, LRangeCompressed) {
+  absl::SetFlag(&FLAGS_list_compress_depth, 1);
+
+  // Large enough for the interior nodes of the list to be compressed.
+  vector<string> cmd = {"rpush", kKey1};
+  for (unsigned i = 0; i < 10000; ++i) {
+    cmd.push_back(StrCat("value:", i));
+  }
+  Run(cmd);
+
+  auto resp = Run({"lrange", kKey1, "5000", "5002"});
+  ASSERT_THAT(resp, ArrLen(3));
+  EXPECT_THAT(resp.GetVec(), ElementsAre("value:5000", "value:5001", "value:5002"));
+
+  resp = Run({"lrange", kKey1, "0", "-1"});
+  ASSERT_THAT(resp, ArrLen(10000));
+  EXPECT_EQ(resp.GetVec()[7777], "value:7777");
+
+  EXPECT_EQ(Run({"lset", kKey1, "4000", "foo"}), "OK");
+  EXPECT_EQ(Run({"lindex", kKey1, "4000"}), "foo");
+  EXPECT_EQ(Run({"lindex", kKey1, "-3"}), "value:9997");
+
+  Run({"debug", "reload"});
+  EXPECT_EQ(Run({"lindex", kKey1, "4000"}), "foo");
+  EXPECT_EQ(Run({"lrange", kKey1, "2", "2"}), "value:2");
+
+  absl::SetFlag(&FLAGS_list_compress_depth, 0);
+}
+
 TEST_F(ListFamilyTest, Lset) {
   Run({"rpush", kKey1, "0", "1", "2"});
   ASSERT_EQ(Run({"lset", kKey1, "0", "bar"}), "OK");
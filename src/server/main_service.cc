@@ -43,6 +43,8 @@ extern "C" {
 #include "server/json_family.h"
 #include "server/list_family.h"
 #include "server/multi_command_squasher.h"
+#include "server/rdb_load.h"
+#include "server/request_trace.h"
 #include "server/script_mgr.h"
 #include "server/search/search_family.h"
 #include "server/server_state.h"
@@ -90,6 +92,11 @@ ABSL_FLAG(double, oom_deny_ratio, 1.1,
           "commands with flag denyoom will return OOM when the ratio between maxmemory and used "
           "memory is above this value");
 
+ABSL_FLAG(uint32_t, migrate_affinity_window, 0,
+          "Number of single shard commands per sampling window of a connection. A connection "
+          "migrates to the thread of a shard that served 3/4 of its commands in two consecutive "
+          "windows. Requires --migrate_connections. 0 disables affinity based migration.");
+
 namespace dfly {
 
 #if defined(__linux__)
@@ -717,6 +724,67 @@ struct BorrowedInterpreter {
   bool owned_ = false;
 };
 
+// Delivers the message to the subscribers, returns their number.
+int DeliverPubMessage(vector<ChannelStore::Subscriber> subscribers, string_view channel,
+                      string_view msg, bool sharded) {
+  int num_published = subscribers.size();
+
+  if (!subscribers.empty()) {
+    // Make sure neither of the threads limits is reached.
+    // This check actually doesn't reserve any memory ahead and doesn't prevent the buffer
+    // from eventually filling up, especially if multiple clients are unblocked simultaneously,
+    // but is generally good enough to limit too fast producers.
+    // Most importantly, this approach allows not blocking and not awaiting in the dispatch below,
+    // thus not adding any overhead to backpressure checks.
+    optional<uint32_t> last_thread;
+    for (auto& sub : subscribers) {
+      DCHECK_LE(last_thread.value_or(0), sub.Thread());
+      if (last_thread && *last_thread == sub.Thread())  // skip same thread
+        continue;
+
+      if (sub.EnsureMemoryBudget())  // Invalid pointers are skipped
+        last_thread = sub.Thread();
+    }
+
+    auto subscribers_ptr = make_shared<decltype(subscribers)>(std::move(subscribers));
+    auto buf = shared_ptr<char[]>{new char[channel.size() + msg.size()]};
+    memcpy(buf.get(), channel.data(), channel.size());
+    memcpy(buf.get() + channel.size(), msg.data(), msg.size());
+
+    // The reply is formatted once for all channel subscribers and once per pattern on each
+    // thread for pattern subscribers, instead of once per subscriber.
+    auto serialized = facade::Connection::PubMessage::Serialize("", channel, msg, sharded);
+
+    auto cb = [subscribers_ptr, buf, serialized, channel_len = channel.size(),
+               msg_len = msg.size()](unsigned idx, util::ProactorBase*) {
+      auto it = lower_bound(subscribers_ptr->begin(), subscribers_ptr->end(), idx,
+                            ChannelStore::Subscriber::ByThreadId);
+
+      string last_pattern;
+      shared_ptr<const string> pattern_serialized;
+      while (it != subscribers_ptr->end() && it->Thread() == idx) {
+        if (auto* ptr = it->Get(); ptr) {
+          auto reply = serialized;
+          if (!it->pattern.empty()) {
+            if (!pattern_serialized || it->pattern != last_pattern) {
+              last_pattern = it->pattern;
+              pattern_serialized = facade::Connection::PubMessage::Serialize(
+                  last_pattern, {buf.get(), channel_len}, {buf.get() + channel_len, msg_len});
+            }
+            reply = pattern_serialized;
+          }
+          ptr->SendPubMessageAsync(
+              {std::move(it->pattern), buf, channel_len, msg_len, std::move(reply)});
+        }
+        it++;
+      }
+    };
+    shard_set->pool()->DispatchBrief(std::move(cb));
+  }
+
+  return num_published;
+}
+
 }  // namespace
 
 Service::Service(ProactorPool* pp)
@@ -777,6 +845,15 @@ void Service::Init(util::AcceptServer* acceptor, std::vector<facade::Listener*>
   config_registry.RegisterMutable("max_eviction_per_heartbeat");
   config_registry.RegisterMutable("max_segment_to_consider");
   config_registry.RegisterMutable("enable_heartbeat_eviction");
+  config_registry.RegisterMutable("notify_keyspace_events", [](const absl::CommandLineFlag& flag) {
+    auto res = flag.TryGet<KeyspaceEventsFlag>();
+    if (!res)
+      return false;
+
+    shard_set->RunBriefInParallel(
+        [events = *res](EngineShard* shard) { shard->db_slice().SetKeyspaceEvents(events); });
+    return true;
+  });
 
   uint32_t shard_num = GetFlag(FLAGS_num_shards);
   if (shard_num == 0 || shard_num > pp_.size()) {
@@ -800,7 +877,7 @@ void Service::Init(util::AcceptServer* acceptor, std::vector<facade::Listener*>
     acl_family_.Init(listeners.front(), &user_registry_);
   }
 
-  StringFamily::Init(&pp_);
+  StringFamily::Init(&pp_, registry_);
   GenericFamily::Init(&pp_);
   server_family_.Init(acceptor, std::move(listeners));
 
@@ -837,6 +914,65 @@ void Service::Shutdown() {
   ThisFiber::SleepFor(10ms);
 }
 
+// The loader adds every key of the snapshot once, and clients can not create keys while it
+// runs, so the keys that exist are final and commands on them can be served. The exception are
+// the big values loaded in chunks, their keys are visible before the last chunk is added.
+bool Service::AreKeysLoaded(const CommandId* cid, CmdArgList args, DbIndex db_index) {
+  if (cid->first_key_pos() == 0)
+    return false;
+
+  OpResult<KeyIndex> key_index = DetermineKeys(cid, args);
+  if (!key_index || key_index->num_args() == 0)
+    return false;
+
+  auto is_loaded = [db_index](string_view key) {
+    return shard_set->Await(Shard(key, shard_set->size()), [&] {
+      DbSlice& db_slice = EngineShard::tlocal()->db_slice();
+      return IsValid(db_slice.FindReadOnly(DbContext{db_index, GetCurrentTimeMs()}, key).it) &&
+             !RdbLoader::IsKeyPartial(db_index, key);
+    });
+  };
+
+  if (key_index->bonus && !is_loaded(ArgS(args, *key_index->bonus)))
+    return false;
+  for (unsigned i = key_index->start; i < key_index->end; i += key_index->step) {
+    if (!is_loaded(ArgS(args, i)))
+      return false;
+  }
+  return true;
+}
+
+optional<ErrorReply> Service::CheckReadStaleness(const CommandId* cid, CmdArgList args,
+                                                 const ConnectionContext& dfly_cntx) {
+  const auto& lags = ServerState::tlocal()->replica_flow_lags;
+  uint64_t lag_ms = UINT64_MAX;  // unknown before the replication starts.
+  if (lags && !lags->empty()) {
+    uint64_t now = ProactorBase::GetMonotonicTimeNs();
+    auto key_lag = [&](string_view key) { return (*lags)[Shard(key, lags->size())].LagMs(now); };
+
+    lag_ms = 0;
+    OpResult<KeyIndex> key_index =
+        cid->first_key_pos() > 0 ? DetermineKeys(cid, args) : OpStatus::INVALID_VALUE;
+    if (key_index && key_index->num_args() > 0) {
+      if (key_index->bonus)
+        lag_ms = max(lag_ms, key_lag(ArgS(args, *key_index->bonus)));
+      for (unsigned i = key_index->start; i < key_index->end; i += key_index->step)
+        lag_ms = max(lag_ms, key_lag(ArgS(args, i)));
+    } else {
+      for (const ReplicaFlowLag& lag : *lags)
+        lag_ms = max(lag_ms, lag.LagMs(now));
+    }
+  }
+
+  uint32_t bound_ms = dfly_cntx.conn_state.read_staleness_ms;
+  if (lag_ms <= bound_ms)
+    return nullopt;
+
+  return ErrorReply{absl::StrCat("-STALE replica lag ",
+                                 lag_ms == UINT64_MAX ? "unknown" : StrCat(lag_ms, "ms"),
+                                 " exceeds READSTALENESS of ", bound_ms, "ms")};
+}
+
 optional<ErrorReply> Service::CheckKeysOwnership(const CommandId* cid, CmdArgList args,
                                                  const ConnectionContext& dfly_cntx) {
   if (dfly_cntx.is_replicating) {
@@ -872,16 +1008,36 @@ optional<ErrorReply> Service::CheckKeysOwnership(const CommandId* cid, CmdArgLis
     return ErrorReply{"-CROSSSLOT Keys in request don't hash to the same slot"};
   }
 
+  return CheckSlotOwnership(keys_slot);
+}
+
+optional<ErrorReply> Service::CheckChannelsOwnership(CmdArgList channels,
+                                                     const ConnectionContext& dfly_cntx) {
+  if (dfly_cntx.is_replicating)
+    return nullopt;
+
+  optional<SlotId> channels_slot;
+  for (size_t i = 0; i < channels.size(); ++i) {
+    SlotId slot = ClusterConfig::KeySlot(ArgS(channels, i));
+    if (channels_slot && slot != *channels_slot)
+      return ErrorReply{"-CROSSSLOT Keys in request don't hash to the same slot"};
+    channels_slot = slot;
+  }
+
+  return CheckSlotOwnership(channels_slot);
+}
+
+optional<ErrorReply> Service::CheckSlotOwnership(optional<SlotId> slot) const {
   // Check keys slot is in my ownership
   const ClusterConfig* cluster_config = cluster_family_.cluster_config();
   if (cluster_config == nullptr) {
     return ErrorReply{kClusterNotConfigured};
   }
 
-  if (keys_slot.has_value() && !cluster_config->IsMySlot(*keys_slot)) {
+  if (slot.has_value() && !cluster_config->IsMySlot(*slot)) {
     // See more details here: https://redis.io/docs/reference/cluster-spec/#moved-redirection
-    ClusterConfig::Node master = cluster_config->GetMasterNodeForSlot(*keys_slot);
-    return ErrorReply{absl::StrCat("-MOVED ", *keys_slot, " ", master.ip, ":", master.port)};
+    ClusterConfig::Node master = cluster_config->GetMasterNodeForSlot(*slot);
+    return ErrorReply{absl::StrCat("-MOVED ", *slot, " ", master.ip, ":", master.port)};
   }
 
   return nullopt;
@@ -966,6 +1122,12 @@ std::optional<ErrorReply> Service::VerifyCommandState(const CommandId* cid, CmdA
   switch (etl.gstate()) {
     case GlobalState::LOADING:
       allowed_by_state = dfly_cntx.journal_emulated || (cid->opt_mask() & CO::LOADING);
+      // Scripts and transactions are not served, their commands may run on the shard threads.
+      if (!allowed_by_state && serving_load_.load(std::memory_order_relaxed) && !under_script &&
+          !dfly_cntx.conn_state.exec_info.IsCollecting() &&
+          !dfly_cntx.conn_state.exec_info.IsRunning()) {
+        allowed_by_state = AreKeysLoaded(cid, tail_args, dfly_cntx.conn_state.db_index);
+      }
       break;
     case GlobalState::SHUTTING_DOWN:
       allowed_by_state = false;
@@ -998,6 +1160,24 @@ std::optional<ErrorReply> Service::VerifyCommandState(const CommandId* cid, CmdA
   if (!etl.is_master && is_write_cmd && !dfly_cntx.is_replicating)
     return ErrorReply{"-READONLY You can't write against a read only replica."};
 
+  // Only the new commands that reach the shard queues are shed, the commands of a transaction or
+  // a script already running are always admitted.
+  if (const AdmissionController* admission = server_family_.admission();
+      admission && cid->IsTransactional() && !(cid->opt_mask() & CO::ADMIN) && !under_script &&
+      !dfly_cntx.conn_state.exec_info.IsRunning() && !dfly_cntx.is_replicating &&
+      !dfly_cntx.journal_emulated && dfly_cntx.conn() && !dfly_cntx.conn()->IsPrivileged()) {
+    if (!admission->Admit(dfly_cntx.priority == acl::Priority::LOW)) {
+      ++etl.stats.shed_cmd_cnt;
+      return ErrorReply{"-OVERLOADED The shards are saturated, try again later"};
+    }
+  }
+
+  if (!etl.is_master && dfly_cntx.conn_state.read_staleness_ms > 0 && cid->IsReadOnly() &&
+      !dfly_cntx.is_replicating) {
+    if (auto err = CheckReadStaleness(cid, tail_args, dfly_cntx); err)
+      return err;
+  }
+
   if (multi_active) {
     if (cmd_name == "SELECT" || absl::EndsWith(cmd_name, "SUBSCRIBE"))
       return ErrorReply{absl::StrCat("Can not call ", cmd_name, " within a transaction")};
@@ -1038,6 +1218,41 @@ std::optional<ErrorReply> Service::VerifyCommandState(const CommandId* cid, CmdA
   return VerifyConnectionAclStatus(cid, &dfly_cntx, "has no ACL permissions", tail_args);
 }
 
+// Counts the shard of a single shard command and requests migration to the thread of a shard
+// that dominates two consecutive sampling windows. Requiring two windows is the hysteresis that
+// keeps connections with mixed traffic from bouncing between threads.
+void TrackShardAffinity(ConnectionContext* cntx, ShardId sid) {
+  uint32_t window = GetFlag(FLAGS_migrate_affinity_window);
+  if (window == 0)
+    return;
+
+  auto& info = cntx->conn_state.affinity_info;
+  if (!info) {
+    info = make_unique<ConnectionState::AffinityInfo>();
+    info->shard_hits.resize(shard_set->size());
+  }
+
+  info->shard_hits[sid]++;
+  if (++info->samples < window)
+    return;
+
+  auto top_it = max_element(info->shard_hits.begin(), info->shard_hits.end());
+  ShardId top = top_it - info->shard_hits.begin();
+  ShardId candidate = (*top_it * 4 >= window * 3) ? top : kInvalidSid;
+
+  if (candidate != kInvalidSid && candidate == info->candidate &&
+      candidate != ServerState::tlocal()->thread_index()) {
+    VLOG(1) << "Migrating connection " << cntx->conn() << " from "
+            << ProactorBase::me()->GetPoolIndex() << " to " << candidate << " by affinity";
+    cntx->conn()->RequestAsyncMigration(shard_set->pool()->at(candidate), false);
+    candidate = kInvalidSid;
+  }
+
+  info->candidate = candidate;
+  info->samples = 0;
+  fill(info->shard_hits.begin(), info->shard_hits.end(), 0);
+}
+
 OpResult<void> OpTrackKeys(const OpArgs& op_args, ConnectionContext* cntx, const ArgSlice& keys) {
   auto& db_slice = op_args.shard->db_slice();
   db_slice.TrackKeys(cntx->conn()->Borrow(), keys);
@@ -1069,7 +1284,8 @@ void Service::DispatchCommand(CmdArgList args, facade::ConnectionContext* cntx)
 
   if (!dispatching_in_multi) {  // Don't interrupt running multi commands
     bool is_write = cid->IsWriteOnly();
-    is_write |= cid->name() == "PUBLISH" || cid->name() == "EVAL" || cid->name() == "EVALSHA";
+    is_write |= cid->name() == "PUBLISH" || cid->name() == "SPUBLISH" || cid->name() == "EVAL" ||
+                cid->name() == "EVALSHA";
     is_write |= cid->name() == "EXEC" && dfly_cntx->conn_state.exec_info.is_write;
 
     cntx->paused = true;
@@ -1108,6 +1324,11 @@ void Service::DispatchCommand(CmdArgList args, facade::ConnectionContext* cntx)
     }
   }
 
+  // Commands inside EXEC and scripts are traced as a part of them.
+  shared_ptr<RequestTrace> trace;
+  if (!dispatching_in_multi && etl.GetTraceRing().ShouldSample())
+    trace = make_shared<RequestTrace>(cid->name());
+
   // Create command transaction
   intrusive_ptr<Transaction> dist_trans;
 
@@ -1126,6 +1347,9 @@ void Service::DispatchCommand(CmdArgList args, facade::ConnectionContext* cntx)
 
     if (cid->IsTransactional()) {
       dist_trans.reset(new Transaction{cid});
+      if (trace)
+        dist_trans->SetTrace(trace);
+      dist_trans->SetHighPriority(dfly_cntx->priority == acl::Priority::HIGH);
 
       if (!dist_trans->IsMulti()) {  // Multi command initialize themself based on their mode.
         if (auto st = dist_trans->InitByArgs(dfly_cntx->conn_state.db_index, args_no_cmd);
@@ -1149,7 +1373,9 @@ void Service::DispatchCommand(CmdArgList args, facade::ConnectionContext* cntx)
 
   // if this is a read command, and client tracking has enabled,
   // start tracking all the updates to the keys in this read command
-  if ((cid->opt_mask() & CO::READONLY) && dfly_cntx->conn()->IsTrackingOn()) {
+  // Broadcast mode does not track reads, writes are matched against its prefixes instead.
+  if ((cid->opt_mask() & CO::READONLY) && dfly_cntx->conn()->IsTrackingOn() &&
+      dfly_cntx->conn_state.tracking_prefixes.empty()) {
     auto cb = [&](Transaction* t, EngineShard* shard) {
       auto keys = t->GetShardArgs(shard->shard_id());
       return OpTrackKeys(t->GetOpArgs(shard), dfly_cntx, keys);
@@ -1160,8 +1386,18 @@ void Service::DispatchCommand(CmdArgList args, facade::ConnectionContext* cntx)
   }
 
   if (!dispatching_in_multi) {
+    if (dfly_cntx->transaction && dfly_cntx->transaction->GetUniqueShardCnt() == 1 &&
+        dfly_cntx->conn()) {
+      TrackShardAffinity(dfly_cntx, dfly_cntx->transaction->GetUniqueShard());
+    }
     dfly_cntx->transaction = nullptr;
   }
+
+  if (trace) {
+    // The root span covers the command and its reply unless the connection batches replies.
+    trace->AddSpan(nullptr, trace->start_ns(), absl::GetCurrentTimeNanos());
+    ServerState::SafeTLocal()->GetTraceRing().Add(std::move(trace));
+  }
 }
 
 class ReplyGuard {
@@ -1233,9 +1469,16 @@ bool Service::InvokeCmd(const CommandId* cid, CmdArgList tail_args, ConnectionCo
       aux_slices.emplace_back(aux_params.back());
       tail_args = absl::MakeSpan(aux_slices);
     }
+
+    // Commands of EXEC and scripts share the transaction, only the whole of it is broken down.
+    optional<SlowLogTxStats> tx_stats;
+    if (cntx->transaction && !cntx->conn_state.exec_info.IsRunning() &&
+        cntx->conn_state.script_info == nullptr) {
+      tx_stats = cntx->transaction->GetSlowLogStats();
+    }
     ServerState::SafeTLocal()->GetSlowLog().Add(cid->name(), tail_args, conn->GetName(),
                                                 conn->RemoteEndpointStr(), invoke_time_usec,
-                                                absl::GetCurrentTimeNanos() / 1000);
+                                                absl::GetCurrentTimeNanos() / 1000, tx_stats);
   }
 
   if (cntx->transaction && !cntx->conn_state.exec_info.IsRunning() &&
@@ -1377,6 +1620,9 @@ void Service::DispatchMC(const MemcacheParser::Command& cmd, std::string_view va
     case MemcacheParser::VERSION:
       mc_builder->SendSimpleString("VERSION 1.5.0 DF");
       return;
+    case MemcacheParser::META_NOOP:
+      mc_builder->SendSimpleString("MN");
+      return;
     default:
       mc_builder->SendClientError("bad command line format");
       return;
@@ -1410,15 +1656,19 @@ void Service::DispatchMC(const MemcacheParser::Command& cmd, std::string_view va
       char* key = const_cast<char*>(s.data());
       args.emplace_back(key, s.size());
     }
+    if (cmd.meta.return_cas)
+      dfly_cntx->conn_state.memcache_flag = ConnectionState::FETCH_CAS_VER;
   } else {  // write commands.
     if (store_opt[0]) {
       args.emplace_back(store_opt, strlen(store_opt));
     }
   }
 
+  mc_builder->SetMeta(cmd.meta.enabled ? &cmd : nullptr);
   DispatchCommand(CmdArgList{args}, cntx);
 
   // Reset back.
+  mc_builder->SetMeta(nullptr);
   dfly_cntx->conn_state.memcache_flag = 0;
 }
 
@@ -1573,12 +1823,15 @@ optional<CapturingReplyBuilder::Payload> Service::FlushEvalAsyncCmds(ConnectionC
 
 void Service::CallFromScript(ConnectionContext* cntx, Interpreter::CallArgs& ca) {
   DCHECK(cntx->transaction);
-  DVLOG(1) << "CallFromScript " << ArgS(ca.args, 0);
+  DVLOG(1) << "CallFromScript " << (ca.args.empty() ? "batch" : ArgS(ca.args, 0));
 
   InterpreterReplier replier(ca.translator);
   facade::SinkReplyBuilder* orig = cntx->Inject(&replier);
   absl::Cleanup clean = [orig, cntx] { cntx->Inject(orig); };
 
+  if (ca.batch)
+    return CallBatchFromScript(cntx, ca, &replier);
+
   optional<ErrorReply> findcmd_err;
 
   if (ca.async) {
@@ -1612,6 +1865,38 @@ void Service::CallFromScript(ConnectionContext* cntx, Interpreter::CallArgs& ca)
   DispatchCommand(ca.args, cntx);
 }
 
+void Service::CallBatchFromScript(ConnectionContext* cntx, Interpreter::CallArgs& ca,
+                                  RedisReplyBuilder* replier) {
+  auto& info = cntx->conn_state.script_info;
+
+  // Queue the command, unknown commands fail the whole batch
+  if (!ca.args.empty()) {
+    ToUpper(&ca.args[0]);
+    if (auto* cid = registry_.Find(ArgS(ca.args, 0)); cid != nullptr) {
+      info->batch_cmds.emplace_back(std::move(*ca.buffer), cid, ca.args.subspan(1));
+    } else {
+      info->batch_cmds.clear();
+      replier->SendError(ReportUnknownCmd(ArgS(ca.args, 0)));
+    }
+    return;
+  }
+
+  // The batch is complete, preceding async commands run first
+  if (auto err = FlushEvalAsyncCmds(cntx, true); err) {
+    CapturingReplyBuilder::Apply(std::move(*err), replier);
+    *ca.requested_abort = true;
+    info->batch_cmds.clear();
+    return;
+  }
+
+  auto* eval_cid = registry_.Find("EVAL");
+  DCHECK(eval_cid);
+  cntx->transaction->MultiSwitchCmd(eval_cid);
+
+  MultiCommandSquasher::Execute(absl::MakeSpan(info->batch_cmds), cntx, this, true, false);
+  info->batch_cmds.clear();
+}
+
 void Service::Eval(CmdArgList args, ConnectionContext* cntx) {
   string_view body = ArgS(args, 0);
 
@@ -1664,10 +1949,7 @@ optional<ScriptMgr::ScriptParams> LoadScipt(string_view sha, ScriptMgr* script_m
     if (!script_data)
       return std::nullopt;
 
-    string err;
-    CHECK_EQ(Interpreter::ADD_OK, interpreter->AddFunction(sha, script_data->body, &err));
-    CHECK(err.empty()) << err;
-
+    script_mgr->AddToInterpreter(sha, *script_data, interpreter);
     return script_data;
   }
 
@@ -1734,8 +2016,7 @@ static std::string FullAclCommandFromArgs(CmdArgList args, std::string_view name
 
 std::pair<const CommandId*, CmdArgList> Service::FindCmd(CmdArgList args) const {
   const std::string_view command = facade::ToSV(args[0]);
-  std::string_view acl = "ACL";
-  if (command == registry_.RenamedOrOriginal(acl)) {
+  if (command == registry_.acl_name()) {
     if (args.size() == 1) {
       return {registry_.Find(ArgS(args, 0)), args};
     }
@@ -1775,6 +2056,25 @@ static bool CanRunSingleShardMulti(optional<ShardId> sid, const ScriptMgr::Scrip
   return true;
 }
 
+// Replies with the result of the script left on the stack of the interpreter.
+static void SendScriptResult(Interpreter::RunResult result, string_view sha, string_view error,
+                             Interpreter* interpreter, RedisReplyBuilder* rb) {
+  if (result == Interpreter::RUN_ERR) {
+    string resp = StrCat("Error running script (call to ", sha, "): ", error);
+    return rb->SendError(resp, facade::kScriptErrType);
+  }
+
+  CHECK(result == Interpreter::RUN_OK);
+
+  SinkReplyBuilder::ReplyAggregator agg(rb);
+  EvalSerializer ser{rb};
+  if (!interpreter->IsResultSafe()) {
+    rb->SendError("reached lua stack limit");
+  } else {
+    interpreter->SerializeResult(&ser);
+  }
+}
+
 void Service::EvalInternal(CmdArgList args, const EvalArgs& eval_args, Interpreter* interpreter,
                            ConnectionContext* cntx) {
   DCHECK(!eval_args.sha.empty());
@@ -1829,24 +2129,47 @@ void Service::EvalInternal(CmdArgList args, const EvalArgs& eval_args, Interpret
   };
 
   Interpreter::RunResult result;
+  optional<CapturingReplyBuilder::Payload> shard_reply;  // set if a shard interpreter ran it
 
   if (CanRunSingleShardMulti(sid, *params, *tx)) {
     // If script runs on a single shard, we run it remotely to save hops.
-    interpreter->SetRedisFunc([cntx, this](Interpreter::CallArgs args) {
+    auto redis_func = [cntx, this](Interpreter::CallArgs args) {
       // Disable squashing, as we're using the squashing mechanism to run remotely.
       args.async = false;
       CallFromScript(cntx, args);
-    });
+    };
+    interpreter->SetRedisFunc(redis_func);
 
     ++ServerState::tlocal()->stats.eval_shardlocal_coordination_cnt;
+    unsigned origin = ServerState::tlocal()->thread_index();
     tx->PrepareMultiForScheduleSingleHop(*sid, tx->GetDbIndex(), args);
     tx->ScheduleSingleHop([&](Transaction*, EngineShard*) {
       boost::intrusive_ptr<Transaction> stub_tx =
           new Transaction{tx, *sid, slot_checker.GetUniqueSlotId()};
       cntx->transaction = stub_tx.get();
 
-      result = interpreter->RunFunction(eval_args.sha, &error);
+      // Lua allocates from the heap of the thread that created the interpreter, so the script
+      // runs in an interpreter of the shard thread unless all of them are borrowed. Its reply is
+      // captured before the interpreter is returned.
+      ServerState* ss = ServerState::tlocal();
+      Interpreter* shard_ir = ss->thread_index() == origin ? nullptr : ss->TryBorrowInterpreter();
+      if (shard_ir && LoadScipt(eval_args.sha, server_family_.script_mgr(), shard_ir)) {
+        ++ss->stats.eval_shard_interpreter_cnt;
+        shard_ir->SetGlobalArray("KEYS", eval_args.keys);
+        shard_ir->SetGlobalArray("ARGV", eval_args.args);
+        shard_ir->SetRedisFunc(redis_func);
+
+        CapturingReplyBuilder crb;
+        SendScriptResult(shard_ir->RunFunction(eval_args.sha, &error), eval_args.sha, error,
+                         shard_ir, &crb);
+        shard_reply = crb.Take();
+        shard_ir->ResetStack();
+      } else {
+        result = interpreter->RunFunction(eval_args.sha, &error);
+      }
 
+      if (shard_ir)
+        ss->ReturnInterpreter(shard_ir);
       cntx->transaction = tx;
       return OpStatus::OK;
     });
@@ -1879,20 +2202,11 @@ void Service::EvalInternal(CmdArgList args, const EvalArgs& eval_args, Interpret
       cntx->transaction->UnlockMulti();
   }
 
-  if (result == Interpreter::RUN_ERR) {
-    string resp = StrCat("Error running script (call to ", eval_args.sha, "): ", error);
-    return cntx->SendError(resp, facade::kScriptErrType);
-  }
-
-  CHECK(result == Interpreter::RUN_OK);
+  auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+  if (shard_reply)
+    return CapturingReplyBuilder::Apply(std::move(*shard_reply), rb);
 
-  SinkReplyBuilder::ReplyAggregator agg(cntx->reply_builder());
-  EvalSerializer ser{static_cast<RedisReplyBuilder*>(cntx->reply_builder())};
-  if (!interpreter->IsResultSafe()) {
-    cntx->SendError("reached lua stack limit");
-  } else {
-    interpreter->SerializeResult(&ser);
-  }
+  SendScriptResult(result, eval_args.sha, error, interpreter, rb);
 }
 
 void Service::Discard(CmdArgList args, ConnectionContext* cntx) {
@@ -2112,50 +2426,25 @@ void Service::Exec(CmdArgList args, ConnectionContext* cntx) {
 
 void Service::Publish(CmdArgList args, ConnectionContext* cntx) {
   string_view channel = ArgS(args, 0);
-  string_view msg = ArgS(args, 1);
-
   auto* cs = ServerState::tlocal()->channel_store();
-  vector<ChannelStore::Subscriber> subscribers = cs->FetchSubscribers(channel);
-  int num_published = subscribers.size();
-
-  if (!subscribers.empty()) {
-    // Make sure neither of the threads limits is reached.
-    // This check actually doesn't reserve any memory ahead and doesn't prevent the buffer
-    // from eventually filling up, especially if multiple clients are unblocked simultaneously,
-    // but is generally good enough to limit too fast producers.
-    // Most importantly, this approach allows not blocking and not awaiting in the dispatch below,
-    // thus not adding any overhead to backpressure checks.
-    optional<uint32_t> last_thread;
-    for (auto& sub : subscribers) {
-      DCHECK_LE(last_thread.value_or(0), sub.Thread());
-      if (last_thread && *last_thread == sub.Thread())  // skip same thread
-        continue;
-
-      if (sub.EnsureMemoryBudget())  // Invalid pointers are skipped
-        last_thread = sub.Thread();
-    }
-
-    auto subscribers_ptr = make_shared<decltype(subscribers)>(std::move(subscribers));
-    auto buf = shared_ptr<char[]>{new char[channel.size() + msg.size()]};
-    memcpy(buf.get(), channel.data(), channel.size());
-    memcpy(buf.get() + channel.size(), msg.data(), msg.size());
+  cntx->SendLong(DeliverPubMessage(cs->FetchSubscribers(channel), channel, ArgS(args, 1), false));
+}
 
-    auto cb = [subscribers_ptr, buf, channel, msg](unsigned idx, util::ProactorBase*) {
-      auto it = lower_bound(subscribers_ptr->begin(), subscribers_ptr->end(), idx,
-                            ChannelStore::Subscriber::ByThreadId);
+int Service::PublishMessage(string_view channel, string_view msg) {
+  auto* cs = ServerState::tlocal()->channel_store();
+  return DeliverPubMessage(cs->FetchSubscribers(channel), channel, msg, false);
+}
 
-      while (it != subscribers_ptr->end() && it->Thread() == idx) {
-        if (auto* ptr = it->Get(); ptr) {
-          ptr->SendPubMessageAsync(
-              {std::move(it->pattern), std::move(buf), channel.size(), msg.size()});
-        }
-        it++;
-      }
-    };
-    shard_set->pool()->DispatchBrief(std::move(cb));
+void Service::SPublish(CmdArgList args, ConnectionContext* cntx) {
+  if (ClusterConfig::IsEnabled()) {
+    if (auto err = CheckChannelsOwnership(args.subspan(0, 1), *cntx); err)
+      return cntx->SendError(std::move(*err));
   }
 
-  cntx->SendLong(num_published);
+  string_view channel = ArgS(args, 0);
+  auto* cs = ServerState::tlocal()->channel_store();
+  cntx->SendLong(
+      DeliverPubMessage(cs->FetchShardSubscribers(channel), channel, ArgS(args, 1), true));
 }
 
 void Service::Subscribe(CmdArgList args, ConnectionContext* cntx) {
@@ -2170,6 +2459,23 @@ void Service::Unsubscribe(CmdArgList args, ConnectionContext* cntx) {
   }
 }
 
+void Service::SSubscribe(CmdArgList args, ConnectionContext* cntx) {
+  if (ClusterConfig::IsEnabled()) {
+    if (auto err = CheckChannelsOwnership(args, *cntx); err)
+      return cntx->SendError(std::move(*err));
+  }
+
+  cntx->ChangeSSubscription(true, true, std::move(args));
+}
+
+void Service::SUnsubscribe(CmdArgList args, ConnectionContext* cntx) {
+  if (args.size() == 0) {
+    cntx->SUnsubscribeAll(true);
+  } else {
+    cntx->ChangeSSubscription(false, true, args);
+  }
+}
+
 void Service::PSubscribe(CmdArgList args, ConnectionContext* cntx) {
   cntx->ChangePSubscription(true, true, args);
 }
@@ -2207,7 +2513,7 @@ void Service::PubsubPatterns(ConnectionContext* cntx) {
   cntx->SendLong(pattern_count);
 }
 
-void Service::PubsubNumSub(CmdArgList args, ConnectionContext* cntx) {
+void Service::PubsubNumSub(CmdArgList args, ConnectionContext* cntx, bool sharded) {
   int channels_size = args.size();
   auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
   rb->StartArray(channels_size * 2);
@@ -2215,7 +2521,9 @@ void Service::PubsubNumSub(CmdArgList args, ConnectionContext* cntx) {
   for (auto i = 0; i < channels_size; i++) {
     auto channel = ArgS(args, i);
     rb->SendBulkString(channel);
-    rb->SendLong(ServerState::tlocal()->channel_store()->FetchSubscribers(channel).size());
+    auto* cs = ServerState::tlocal()->channel_store();
+    rb->SendLong(sharded ? cs->FetchShardSubscribers(channel).size()
+                         : cs->FetchSubscribers(channel).size());
   }
 }
 
@@ -2246,6 +2554,10 @@ void Service::Pubsub(CmdArgList args, ConnectionContext* cntx) {
         "NUMSUB [<channel> <channel...>]",
         "\tReturns the number of subscribers for the specified channels, excluding",
         "\tpattern subscriptions.",
+        "SHARDCHANNELS [<pattern>]",
+        "\tReturn the currently active shard level channels matching a <pattern> (default: '*').",
+        "SHARDNUMSUB [<shardchannel> <shardchannel...>]",
+        "\tReturns the number of subscribers for the specified shard level channel(s).",
         "HELP",
         "\tPrints this help."};
 
@@ -2263,9 +2575,14 @@ void Service::Pubsub(CmdArgList args, ConnectionContext* cntx) {
     PubsubChannels(pattern, cntx);
   } else if (subcmd == "NUMPAT") {
     PubsubPatterns(cntx);
-  } else if (subcmd == "NUMSUB") {
+  } else if (subcmd == "NUMSUB" || subcmd == "SHARDNUMSUB") {
+    bool sharded = subcmd == "SHARDNUMSUB";
     args.remove_prefix(1);
-    PubsubNumSub(args, cntx);
+    PubsubNumSub(args, cntx, sharded);
+  } else if (subcmd == "SHARDCHANNELS") {
+    string_view pattern = args.size() > 1 ? ArgS(args, 1) : string_view{};
+    auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+    rb->SendStringArr(ServerState::tlocal()->channel_store()->ListShardChannels(pattern));
   } else {
     cntx->SendError(UnknownSubCmd(subcmd, "PUBSUB"));
   }
@@ -2402,11 +2719,15 @@ void Service::OnClose(facade::ConnectionContext* cntx) {
       server_cntx->UnsubscribeAll(false);
     }
 
-    if (conn_state.subscribe_info) {
-      DCHECK(!conn_state.subscribe_info->patterns.empty());
+    if (conn_state.subscribe_info && !conn_state.subscribe_info->patterns.empty()) {
       server_cntx->PUnsubscribeAll(false);
     }
 
+    if (conn_state.subscribe_info) {
+      DCHECK(!conn_state.subscribe_info->shard_channels.empty());
+      server_cntx->SUnsubscribeAll(false);
+    }
+
     DCHECK(!conn_state.subscribe_info);
   }
 
@@ -2419,6 +2740,19 @@ void Service::OnClose(facade::ConnectionContext* cntx) {
   cntx->conn()->SetClientTrackingSwitch(false);
 }
 
+void Service::OnShardChannelMoved(facade::ConnectionContext* cntx, string_view channel) {
+  ConnectionContext* server_cntx = static_cast<ConnectionContext*>(cntx);
+  const auto& sinfo = server_cntx->conn_state.subscribe_info;
+
+  // The connection could have unsubscribed in the meantime.
+  if (!sinfo || !sinfo->shard_channels.contains(channel))
+    return;
+
+  string channel_str{channel};
+  CmdArgVec args{MutableSlice{channel_str.data(), channel_str.size()}};
+  server_cntx->ChangeSSubscription(false, true, CmdArgList{args});
+}
+
 string Service::GetContextInfo(facade::ConnectionContext* cntx) {
   char buf[16] = {0};
   unsigned index = 0;
@@ -2464,6 +2798,9 @@ constexpr uint32_t kSubscribe = PUBSUB | SLOW;
 constexpr uint32_t kUnsubscribe = PUBSUB | SLOW;
 constexpr uint32_t kPSubscribe = PUBSUB | SLOW;
 constexpr uint32_t kPUnsubsribe = PUBSUB | SLOW;
+constexpr uint32_t kSPublish = PUBSUB | FAST;
+constexpr uint32_t kSSubscribe = PUBSUB | SLOW;
+constexpr uint32_t kSUnsubscribe = PUBSUB | SLOW;
 constexpr uint32_t kFunction = SLOW;
 constexpr uint32_t kMonitor = ADMIN | SLOW | DANGEROUS;
 constexpr uint32_t kPubSub = SLOW;
@@ -2493,6 +2830,11 @@ void Service::Register(CommandRegistry* registry) {
       << CI{"PSUBSCRIBE", CO::NOSCRIPT | CO::LOADING, -2, 0, 0, acl::kPSubscribe}.MFUNC(PSubscribe)
       << CI{"PUNSUBSCRIBE", CO::NOSCRIPT | CO::LOADING, -1, 0, 0, acl::kPUnsubsribe}.MFUNC(
              PUnsubscribe)
+      << CI{"SPUBLISH", CO::LOADING | CO::FAST, 3, 0, 0, acl::kSPublish}.MFUNC(SPublish)
+      << CI{"SSUBSCRIBE", CO::NOSCRIPT | CO::LOADING, -2, 0, 0, acl::kSSubscribe}.MFUNC(
+             SSubscribe)
+      << CI{"SUNSUBSCRIBE", CO::NOSCRIPT | CO::LOADING, -1, 0, 0, acl::kSUnsubscribe}.MFUNC(
+             SUnsubscribe)
       << CI{"FUNCTION", CO::NOSCRIPT, 2, 0, 0, acl::kFunction}.MFUNC(Function)
       << CI{"MONITOR", CO::ADMIN, 1, 0, 0, acl::kMonitor}.MFUNC(Monitor)
       << CI{"PUBSUB", CO::LOADING | CO::FAST, -1, 0, 0, acl::kPubSub}.MFUNC(Pubsub)
@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <utility>
 
 #include "base/varz_value.h"
@@ -90,8 +91,15 @@ class Service : public facade::ServiceInterface {
 
   GlobalState GetGlobalState() const;
 
+  // While set, the commands whose keys are all loaded already are served in LOADING state,
+  // see serve_while_loading.
+  void SetServingLoad(bool serving) {
+    serving_load_.store(serving, std::memory_order_relaxed);
+  }
+
   void ConfigureHttpHandlers(util::HttpListenerBase* base, bool is_privileged) final;
   void OnClose(facade::ConnectionContext* cntx) final;
+  void OnShardChannelMoved(facade::ConnectionContext* cntx, std::string_view channel) final;
   std::string GetContextInfo(facade::ConnectionContext* cntx) final;
 
   uint32_t shard_count() const {
@@ -108,6 +116,10 @@ class Service : public facade::ServiceInterface {
 
   absl::flat_hash_map<std::string, unsigned> UknownCmdMap() const;
 
+  // Publishes msg to the subscribers of channel like PUBLISH, returns their number.
+  // Must be called from a proactor thread.
+  int PublishMessage(std::string_view channel, std::string_view msg);
+
   ScriptMgr* script_mgr() {
     return server_family_.script_mgr();
   }
@@ -140,6 +152,9 @@ class Service : public facade::ServiceInterface {
   void Unsubscribe(CmdArgList args, ConnectionContext* cntx);
   void PSubscribe(CmdArgList args, ConnectionContext* cntx);
   void PUnsubscribe(CmdArgList args, ConnectionContext* cntx);
+  void SPublish(CmdArgList args, ConnectionContext* cntx);
+  void SSubscribe(CmdArgList args, ConnectionContext* cntx);
+  void SUnsubscribe(CmdArgList args, ConnectionContext* cntx);
   void Function(CmdArgList args, ConnectionContext* cntx);
   void Monitor(CmdArgList args, ConnectionContext* cntx);
   void Pubsub(CmdArgList args, ConnectionContext* cntx);
@@ -147,7 +162,7 @@ class Service : public facade::ServiceInterface {
 
   void PubsubChannels(std::string_view pattern, ConnectionContext* cntx);
   void PubsubPatterns(ConnectionContext* cntx);
-  void PubsubNumSub(CmdArgList channels, ConnectionContext* cntx);
+  void PubsubNumSub(CmdArgList channels, ConnectionContext* cntx, bool sharded);
 
   struct EvalArgs {
     std::string_view sha;  // only one of them is defined.
@@ -158,6 +173,21 @@ class Service : public facade::ServiceInterface {
   std::optional<facade::ErrorReply> CheckKeysOwnership(const CommandId* cid, CmdArgList args,
                                                        const ConnectionContext& dfly_cntx);
 
+  // Return error if the replica lags behind the master more than CLIENT READSTALENESS allows
+  // on the master shards of the keys, or on any shard for keyless commands.
+  std::optional<facade::ErrorReply> CheckReadStaleness(const CommandId* cid, CmdArgList args,
+                                                       const ConnectionContext& dfly_cntx);
+
+  // Same for sharded pub/sub channels, which are owned by the node owning their slot.
+  std::optional<facade::ErrorReply> CheckChannelsOwnership(CmdArgList channels,
+                                                           const ConnectionContext& dfly_cntx);
+
+  // Whether all the keys of the command exist, checked on their shards.
+  bool AreKeysLoaded(const CommandId* cid, CmdArgList args, DbIndex db_index);
+
+  // Return error if the slot is not owned by the server.
+  std::optional<facade::ErrorReply> CheckSlotOwnership(std::optional<SlotId> slot) const;
+
   void EvalInternal(CmdArgList args, const EvalArgs& eval_args, Interpreter* interpreter,
                     ConnectionContext* cntx);
   void CallSHA(CmdArgList args, std::string_view sha, Interpreter* interpreter,
@@ -169,6 +199,10 @@ class Service : public facade::ServiceInterface {
 
   void CallFromScript(ConnectionContext* cntx, Interpreter::CallArgs& args);
 
+  // Queue commands of pcall_batch and run them squashed once the batch is complete.
+  void CallBatchFromScript(ConnectionContext* cntx, Interpreter::CallArgs& ca,
+                           facade::RedisReplyBuilder* replier);
+
   void RegisterCommands();
   void Register(CommandRegistry* registry);
 
@@ -187,6 +221,7 @@ class Service : public facade::ServiceInterface {
 
   mutable Mutex mu_;
   GlobalState global_state_ = GlobalState::ACTIVE;  // protected by mu_;
+  std::atomic_bool serving_load_{false};
 };
 
 uint64_t GetMaxMemoryFlag();
@@ -4,10 +4,13 @@
 
 #include "server/memory_cmd.h"
 
+#include <absl/container/flat_hash_map.h>
 #include <absl/strings/str_cat.h>
+#include <absl/strings/str_join.h>
 #include <mimalloc.h>
 
 #include "base/io_buf.h"
+#include "facade/cmd_arg_parser.h"
 #include "facade/dragonfly_connection.h"
 #include "facade/error.h"
 #include "server/engine_shard_set.h"
@@ -41,6 +44,23 @@ bool MiArenaVisit(const mi_heap_t* heap, const mi_heap_area_t* area, void* block
   return true;
 };
 
+bool MiSizeClassVisit(const mi_heap_t* heap, const mi_heap_area_t* area, void* block,
+                      size_t block_size, void* arg) {
+  auto* classes = (absl::flat_hash_map<size_t, MallocSizeClass>*)arg;
+  MallocSizeClass& size_class = (*classes)[block_size];
+  size_t used = area->used * block_size;
+
+  size_class.block_size = block_size;
+  size_class.pages++;
+  size_class.committed += area->committed;
+  size_class.used += used;
+
+  size_t buckets = size_class.pages_by_utilization.size();
+  size_t bucket = area->committed > 0 ? (used * buckets) / area->committed : 0;
+  size_class.pages_by_utilization[min(bucket, buckets - 1)]++;
+  return true;
+}
+
 std::string MallocStats(bool backing, unsigned tid) {
   string str;
 
@@ -65,6 +85,16 @@ std::string MallocStats(bool backing, unsigned tid) {
     used += count * get<3>(k_v.first);
   }
 
+  absl::StrAppend(&str, "\nSize classes from thread:", tid, "\n");
+  absl::StrAppend(&str, "BlockSize Pages Committed Used Waste% Pages<25% <50% <75% <=100%\n");
+  for (const MallocSizeClass& size_class : CollectMallocSizeClasses(backing)) {
+    size_t waste = size_class.committed - min(size_class.used, size_class.committed);
+    absl::StrAppend(&str, size_class.block_size, " ", size_class.pages, " ", size_class.committed,
+                    " ", size_class.used, " ",
+                    (100.0 * waste) / std::max<size_t>(1UL, size_class.committed), " ",
+                    absl::StrJoin(size_class.pages_by_utilization, " "), "\n");
+  }
+
   uint64_t delta = (absl::GetCurrentTimeNanos() - start) / 1000;
   absl::StrAppend(&str, "--- End mimalloc statistics, took ", delta, "us ---\n");
   absl::StrAppend(&str, "total reserved: ", reserved, ", comitted: ", committed, ", used: ", used,
@@ -78,8 +108,82 @@ size_t MemoryUsage(PrimeIterator it) {
   return it->first.MallocUsed() + it->second.MallocUsed();
 }
 
+// Distinct prefixes tracked per shard, the keys of the other prefixes are reported together.
+constexpr size_t kMaxSampledPrefixes = 1024;
+constexpr string_view kOtherPrefixes = "<other>";
+
+// Prefix and object type.
+using PrefixKey = pair<string, unsigned>;
+
+// Samples up to `budget` keys of the database in this shard, in steps that yield in between.
+// Returns the number of keys and bytes by prefix, scaled to the size of the table.
+absl::flat_hash_map<PrefixKey, PrefixMemoryUsage> SamplePrefixes(DbIndex db_index, char delimiter,
+                                                                 size_t budget) {
+  constexpr unsigned kBucketsPerStep = 64;
+
+  absl::flat_hash_map<PrefixKey, PrefixMemoryUsage> res;
+  auto& db_slice = EngineShard::tlocal()->db_slice();
+  if (!db_slice.IsDbValid(db_index))
+    return res;
+
+  // Holds the table in case the database is flushed while we yield.
+  boost::intrusive_ptr<DbTable> table = db_slice.databases()[db_index];
+  PrimeTable::Cursor cursor;
+  size_t sampled = 0;
+  string tmp;
+
+  auto cb = [&](PrimeIterator it) {
+    string_view key = it->first.GetSlice(&tmp);
+    size_t pos = key.find(delimiter);
+    PrefixKey pkey{string(pos == string_view::npos ? "" : key.substr(0, pos)),
+                   it->second.ObjType()};
+    if (res.size() >= kMaxSampledPrefixes && !res.contains(pkey))
+      pkey.first = kOtherPrefixes;
+
+    PrefixMemoryUsage& usage = res[pkey];
+    usage.keys++;
+    usage.bytes += MemoryUsage(it);
+    ++sampled;
+  };
+
+  do {
+    for (unsigned i = 0; i < kBucketsPerStep && sampled < budget; ++i) {
+      cursor = table->prime.Traverse(cursor, cb);
+      if (!cursor)
+        break;
+    }
+    util::ThisFiber::Yield();
+  } while (cursor && sampled < budget);
+
+  // Keys are spread over the table by their hash, so the visited part is a fair sample.
+  double scale = sampled ? double(table->prime.size()) / sampled : 0;
+  for (auto& [pkey, usage] : res) {
+    usage.prefix = pkey.first;
+    usage.type = pkey.second;
+    usage.keys = usage.keys * scale;
+    usage.bytes = usage.bytes * scale;
+  }
+  return res;
+}
+
 }  // namespace
 
+vector<MallocSizeClass> CollectMallocSizeClasses(bool backing) {
+  mi_heap_t* heap = backing ? mi_heap_get_backing() : ServerState::tlocal()->data_heap();
+  absl::flat_hash_map<size_t, MallocSizeClass> classes;
+  mi_heap_visit_blocks(heap, false /* visit only the areas */, MiSizeClassVisit, &classes);
+
+  vector<MallocSizeClass> res;
+  res.reserve(classes.size());
+  for (auto& [block_size, size_class] : classes)
+    res.push_back(size_class);
+
+  sort(res.begin(), res.end(), [](const auto& l, const auto& r) {
+    return l.block_size < r.block_size;
+  });
+  return res;
+}
+
 MemoryCmd::MemoryCmd(ServerFamily* owner, ConnectionContext* cntx) : cntx_(cntx), owner_(owner) {
 }
 
@@ -98,6 +202,15 @@ void MemoryCmd::Run(CmdArgList args) {
         "    Show memory usage of a key.",
         "DECOMMIT",
         "    Force decommit the memory freed by the server back to OS.",
+        "PREFIXES [DELIMITER <char>] [SAMPLES <count>] [TOP <count>]",
+        "    Estimates the number of keys and their memory usage by key prefix and type,",
+        "    based on a sample of up to SAMPLES keys (10000 by default) per shard.",
+        "    The prefix ends at the first DELIMITER (':' by default). Returns the TOP",
+        "    (50 by default) prefixes by memory usage, which are also exported on /metrics.",
+        "BIGKEYS [BY BYTES|ELEMENTS] [COUNT <count>]",
+        "    Shows the COUNT (10 by default) largest keys of the database by the heap bytes",
+        "    or by the number of elements of their values. Tracked as the keys are written",
+        "    and refreshed by a background scan, so keys may be missing until it completes.",
     };
     auto* rb = static_cast<RedisReplyBuilder*>(cntx_->reply_builder());
     return rb->SendSimpleStrArr(help_arr);
@@ -112,6 +225,14 @@ void MemoryCmd::Run(CmdArgList args) {
     return Usage(key);
   }
 
+  if (sub_cmd == "PREFIXES") {
+    return Prefixes(args.subspan(1));
+  }
+
+  if (sub_cmd == "BIGKEYS") {
+    return LargestKeys(args.subspan(1));
+  }
+
   if (sub_cmd == "DECOMMIT") {
     shard_set->pool()->Await([](auto* pb) {
       mi_heap_collect(ServerState::tlocal()->data_heap(), true);
@@ -270,6 +391,126 @@ void MemoryCmd::Stats() {
   }
 }
 
+void MemoryCmd::Prefixes(CmdArgList args) {
+  string_view delimiter = ":";
+  size_t samples = 10000;
+  size_t top = 50;
+
+  CmdArgParser parser{args};
+  while (parser.HasNext()) {
+    if (parser.Check("DELIMITER").IgnoreCase().ExpectTail(1)) {
+      delimiter = parser.Next();
+      continue;
+    }
+    if (parser.Check("SAMPLES").IgnoreCase().ExpectTail(1)) {
+      samples = parser.Next<size_t>();
+      continue;
+    }
+    if (parser.Check("TOP").IgnoreCase().ExpectTail(1)) {
+      top = parser.Next<size_t>();
+      continue;
+    }
+    return cntx_->SendError(kSyntaxErr);
+  }
+
+  if (auto err = parser.Error(); err)
+    return cntx_->SendError(err->MakeReply());
+
+  if (delimiter.size() != 1 || samples == 0)
+    return cntx_->SendError(kSyntaxErr);
+
+  vector<absl::flat_hash_map<PrefixKey, PrefixMemoryUsage>> shard_usage(shard_set->size());
+  DbIndex db_index = cntx_->db_index();
+  shard_set->RunBlockingInParallel([&](EngineShard* shard) {
+    shard_usage[shard->shard_id()] = SamplePrefixes(db_index, delimiter[0], samples);
+  });
+
+  absl::flat_hash_map<PrefixKey, PrefixMemoryUsage> merged;
+  for (auto& usage_map : shard_usage) {
+    for (auto& [pkey, usage] : usage_map) {
+      auto [it, inserted] = merged.try_emplace(pkey, std::move(usage));
+      if (!inserted) {
+        it->second.keys += usage.keys;
+        it->second.bytes += usage.bytes;
+      }
+    }
+  }
+
+  vector<PrefixMemoryUsage> result;
+  result.reserve(merged.size());
+  for (auto& [_, usage] : merged)
+    result.push_back(std::move(usage));
+
+  sort(result.begin(), result.end(), [](const auto& l, const auto& r) {
+    return l.bytes > r.bytes || (l.bytes == r.bytes && l.prefix < r.prefix);
+  });
+  if (result.size() > top)
+    result.resize(top);
+
+  auto* rb = static_cast<RedisReplyBuilder*>(cntx_->reply_builder());
+  rb->StartArray(result.size());
+  for (const auto& usage : result) {
+    rb->StartArray(4);
+    rb->SendBulkString(usage.prefix);
+    rb->SendBulkString(CompactObj::ObjTypeToString(usage.type));
+    rb->SendLong(usage.keys);
+    rb->SendLong(usage.bytes);
+  }
+
+  owner_->SetPrefixMemoryUsage(std::move(result));
+}
+
+void MemoryCmd::LargestKeys(CmdArgList args) {
+  bool by_bytes = true;
+  size_t count = 10;
+
+  CmdArgParser parser{args};
+  while (parser.HasNext()) {
+    if (parser.Check("BY").IgnoreCase().ExpectTail(1)) {
+      by_bytes = parser.ToUpper().Switch("BYTES", true, "ELEMENTS", false);
+      continue;
+    }
+    if (parser.Check("COUNT").IgnoreCase().ExpectTail(1)) {
+      count = parser.Next<size_t>();
+      continue;
+    }
+    return cntx_->SendError(kSyntaxErr);
+  }
+
+  if (auto err = parser.Error(); err)
+    return cntx_->SendError(err->MakeReply());
+
+  vector<vector<BigKeys::Key>> shard_keys(shard_set->size());
+  DbIndex db_index = cntx_->db_index();
+  shard_set->RunBriefInParallel([&](EngineShard* shard) {
+    const DbSlice& db_slice = shard->db_slice();
+    if (!db_slice.IsDbValid(db_index))
+      return;
+    const BigKeys& big_keys = db_slice.GetDBTable(db_index)->big_keys;
+    shard_keys[shard->shard_id()] = by_bytes ? big_keys.by_bytes() : big_keys.by_elements();
+  });
+
+  vector<BigKeys::Key> result;
+  for (auto& keys : shard_keys)
+    std::move(keys.begin(), keys.end(), back_inserter(result));
+
+  auto field = by_bytes ? &BigKeys::Key::bytes : &BigKeys::Key::elements;
+  sort(result.begin(), result.end(),
+       [field](const auto& l, const auto& r) { return l.*field > r.*field; });
+  if (result.size() > count)
+    result.resize(count);
+
+  auto* rb = static_cast<RedisReplyBuilder*>(cntx_->reply_builder());
+  rb->StartArray(result.size());
+  for (const auto& key : result) {
+    rb->StartArray(4);
+    rb->SendBulkString(key.key);
+    rb->SendBulkString(CompactObj::ObjTypeToString(key.type));
+    rb->SendLong(key.bytes);
+    rb->SendLong(key.elements);
+  }
+}
+
 void MemoryCmd::Usage(std::string_view key) {
   ShardId sid = Shard(key, shard_set->size());
   ssize_t memory_usage = shard_set->pool()->at(sid)->AwaitBrief([key, this]() -> ssize_t {
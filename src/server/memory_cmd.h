@@ -4,12 +4,31 @@
 
 #pragma once
 
+#include <array>
+#include <vector>
+
 #include "server/conn_context.h"
 
 namespace dfly {
 
 class ServerFamily;
 
+// Usage of the mimalloc pages of a single block size.
+struct MallocSizeClass {
+  size_t block_size = 0;
+  size_t pages = 0;
+  size_t committed = 0;  // bytes
+  size_t used = 0;       // bytes of the used blocks
+
+  // Number of pages by the share of their committed bytes in use: below 25%, 50%, 75% and up to
+  // 100%.
+  std::array<size_t, 4> pages_by_utilization{};
+};
+
+// Returns the usage of the data heap of the thread, or of its backing heap, by block size.
+// Visits all the pages of the heap, so it takes time proportional to its size.
+std::vector<MallocSizeClass> CollectMallocSizeClasses(bool backing);
+
 class MemoryCmd {
  public:
   MemoryCmd(ServerFamily* owner, ConnectionContext* cntx);
@@ -19,6 +38,8 @@ class MemoryCmd {
  private:
   void Stats();
   void Usage(std::string_view key);
+  void Prefixes(CmdArgList args);
+  void LargestKeys(CmdArgList args);
 
   ConnectionContext* cntx_;
   ServerFamily* owner_;
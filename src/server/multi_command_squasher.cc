@@ -2,6 +2,7 @@
 
 #include <absl/container/inlined_vector.h>
 
+#include "base/flags.h"
 #include "facade/dragonfly_connection.h"
 #include "server/cluster/unique_slot_checker.h"
 #include "server/command_registry.h"
@@ -9,6 +10,10 @@
 #include "server/engine_shard_set.h"
 #include "server/transaction.h"
 
+ABSL_FLAG(uint32_t, low_priority_squash_rate, 0,
+          "The maximal number of squashed commands per second that the low priority connections of "
+          "a thread execute together. 0 for unlimited");
+
 namespace dfly {
 
 using namespace std;
@@ -17,6 +22,25 @@ using namespace util;
 
 namespace {
 
+// Delays the squashed batch of a low priority connection to keep the rate of the low priority
+// squashed commands of the thread under --low_priority_squash_rate.
+void PaceLowPriorityBatch(size_t num_cmds) {
+  uint32_t rate = absl::GetFlag(FLAGS_low_priority_squash_rate);
+  if (rate == 0)
+    return;
+
+  // When the thread is allowed to start the next low priority batch.
+  static thread_local uint64_t next_batch_ns = 0;
+
+  uint64_t now = ProactorBase::me()->GetMonotonicTimeNs();
+  uint64_t start = max(now, next_batch_ns);
+  next_batch_ns = start + num_cmds * 1'000'000'000 / rate;
+  if (start > now) {
+    ServerState::tlocal()->stats.low_priority_paced_cnt++;
+    ThisFiber::SleepFor(chrono::nanoseconds(start - now));
+  }
+}
+
 template <typename F> void IterateKeys(CmdArgList args, KeyIndex keys, F&& f) {
   for (unsigned i = keys.start; i < keys.end; i += keys.step)
     f(args[i]);
@@ -82,16 +106,18 @@ MultiCommandSquasher::SquashResult MultiCommandSquasher::TrySquash(StoredCmd* cm
   if (!keys.ok())
     return SquashResult::ERROR;
 
-  // Check if all commands belong to one shard
+  // Check if all commands belong to one shard and whether they depend on deferred commands
   bool found_more = false;
+  bool depends_on_deferred = false;
   UniqueSlotChecker slot_checker;
   ShardId last_sid = kInvalidSid;
-  IterateKeys(args, *keys, [&last_sid, &found_more, &slot_checker](MutableSlice key) {
+  IterateKeys(args, *keys, [&](MutableSlice key) {
+    string_view key_sv = facade::ToSV(key);
+    depends_on_deferred |= deferred_keys_.contains(key_sv);
+
     if (found_more)
       return;
 
-    string_view key_sv = facade::ToSV(key);
-
     slot_checker.Add(key_sv);
 
     ShardId sid = Shard(key_sv, shard_set->size());
@@ -102,9 +128,26 @@ MultiCommandSquasher::SquashResult MultiCommandSquasher::TrySquash(StoredCmd* cm
     found_more = true;
   });
 
-  if (found_more || last_sid == kInvalidSid)
+  if (last_sid == kInvalidSid)
     return SquashResult::NOT_SQUASHED;
 
+  if (found_more) {
+    if (!CanDefer())
+      return SquashResult::NOT_SQUASHED;
+
+    // Keys of deferred commands point into their stored buffers, which outlive the squasher
+    IterateKeys(args, *keys, [this](MutableSlice key) { deferred_keys_.insert(ToSV(key)); });
+    deferred_.emplace_back(cmd, CapturingReplyBuilder::Payload{});
+    order_.push_back(kInvalidSid);
+    num_deferred_++;
+
+    return deferred_.size() >= kMaxDeferred ? SquashResult::SQUASHED_FULL : SquashResult::SQUASHED;
+  }
+
+  // The command has to run after the deferred ones
+  if (depends_on_deferred && !ExecuteSquashed())
+    return SquashResult::ERROR;
+
   auto& sinfo = PrepareShardInfo(last_sid, slot_checker.GetUniqueSlotId());
 
   sinfo.had_writes |= cmd->Cid()->IsWriteOnly();
@@ -132,6 +175,14 @@ bool MultiCommandSquasher::ExecuteStandalone(StoredCmd* cmd) {
     }
   }
 
+  InvokeStandalone(cmd);
+  return true;
+}
+
+void MultiCommandSquasher::InvokeStandalone(StoredCmd* cmd) {
+  cmd->Fill(&tmp_keylist_);
+  auto args = absl::MakeSpan(tmp_keylist_);
+
   auto* tx = cntx_->transaction;
   tx->MultiSwitchCmd(cmd->Cid());
   cntx_->cid = cmd->Cid();
@@ -139,8 +190,36 @@ bool MultiCommandSquasher::ExecuteStandalone(StoredCmd* cmd) {
   if (cmd->Cid()->IsTransactional())
     tx->InitByArgs(cntx_->conn_state.db_index, args);
   service_->InvokeCmd(cmd->Cid(), args, cntx_);
+}
 
-  return true;
+bool MultiCommandSquasher::CanDefer() const {
+  // Without atomicity other clients could observe the reordered writes, e.g. a flag set after
+  // an MSET before the MSET itself. Aborting on errors requires running commands in order.
+  return atomic_ && !error_abort_ && deferred_.size() < kMaxDeferred;
+}
+
+void MultiCommandSquasher::ExecuteDeferred() {
+  CapturingReplyBuilder crb;
+  auto* orig_rb = cntx_->Inject(&crb);
+
+  for (auto& [cmd, reply] : deferred_) {
+    crb.SetReplyMode(cmd->ReplyMode());
+
+    cmd->Fill(&tmp_keylist_);
+    auto args = absl::MakeSpan(tmp_keylist_);
+    if (verify_commands_) {
+      if (auto err = service_->VerifyCommandState(cmd->Cid(), args, *cntx_); err) {
+        crb.SendError(std::move(*err));
+        reply = crb.Take();
+        continue;
+      }
+    }
+
+    InvokeStandalone(cmd);
+    reply = crb.Take();
+  }
+
+  cntx_->Inject(orig_rb);
 }
 
 OpStatus MultiCommandSquasher::SquashedHopCb(Transaction* parent_tx, EngineShard* es) {
@@ -155,6 +234,24 @@ OpStatus MultiCommandSquasher::SquashedHopCb(Transaction* parent_tx, EngineShard
   }
   absl::InlinedVector<MutableSlice, 4> arg_vec;
 
+  // Tiered values read by the batch are fetched together instead of one read per command.
+  if (es->tiered_storage()) {
+    vector<string_view> keys;
+    for (auto* cmd : sinfo.cmds) {
+      if (!cmd->Cid()->IsReadOnly())
+        continue;
+
+      arg_vec.resize(cmd->NumArgs());
+      auto args = absl::MakeSpan(arg_vec);
+      cmd->Fill(args);
+      if (auto key_index = DetermineKeys(cmd->Cid(), args); key_index)
+        IterateKeys(args, *key_index, [&](MutableSlice key) { keys.push_back(ToSV(key)); });
+    }
+
+    if (keys.size() > 1)
+      es->db_slice().FetchExternalMany(cntx_->conn_state.db_index, keys);
+  }
+
   for (auto* cmd : sinfo.cmds) {
     arg_vec.resize(cmd->NumArgs());
     auto args = absl::MakeSpan(arg_vec);
@@ -201,6 +298,10 @@ bool MultiCommandSquasher::ExecuteSquashed() {
   for (auto& sd : sharded_)
     sd.replies.reserve(sd.cmds.size());
 
+  // Atomic transactions are not delayed, they would hold their locks meanwhile.
+  if (cntx_->priority == acl::Priority::LOW && !atomic_)
+    PaceLowPriorityBatch(order_.size());
+
   Transaction* tx = cntx_->transaction;
   ServerState::tlocal()->stats.multi_squash_executions++;
   ProactorBase* proactor = ProactorBase::me();
@@ -208,7 +309,9 @@ bool MultiCommandSquasher::ExecuteSquashed() {
 
   // Atomic transactions (that have all keys locked) perform hops and run squashed commands via
   // stubs, non-atomic ones just run the commands in parallel.
-  if (IsAtomic()) {
+  if (order_.size() == deferred_.size()) {
+    // Only deferred commands
+  } else if (IsAtomic()) {
     cntx_->cid = base_cid_;
     auto cb = [this](ShardId sid) { return !sharded_[sid].cmds.empty(); };
     tx->PrepareSquashedMultiHop(base_cid_, cb);
@@ -218,11 +321,20 @@ bool MultiCommandSquasher::ExecuteSquashed() {
                                      [this](auto sid) { return !sharded_[sid].cmds.empty(); });
   }
 
+  if (!deferred_.empty())
+    ExecuteDeferred();
+
   uint64_t after_hop = proactor->GetMonotonicTimeNs();
   bool aborted = false;
 
   RedisReplyBuilder* rb = static_cast<RedisReplyBuilder*>(cntx_->reply_builder());
+  auto deferred_it = deferred_.begin();
   for (auto idx : order_) {
+    if (idx == kInvalidSid) {
+      CapturingReplyBuilder::Apply(std::move((deferred_it++)->second), rb);
+      continue;
+    }
+
     auto& replies = sharded_[idx].replies;
     CHECK(!replies.empty());
 
@@ -242,6 +354,8 @@ bool MultiCommandSquasher::ExecuteSquashed() {
     sinfo.cmds.clear();
 
   order_.clear();
+  deferred_.clear();
+  deferred_keys_.clear();
   return !aborted;
 }
 
@@ -284,8 +398,8 @@ void MultiCommandSquasher::Run() {
     }
   }
 
-  VLOG(1) << "Squashed " << num_squashed_ << " of " << cmds_.size()
-          << " commands, max fanout: " << num_shards_ << ", atomic: " << atomic_;
+  VLOG(1) << "Squashed " << num_squashed_ << " and deferred " << num_deferred_ << " of "
+          << cmds_.size() << " commands, max fanout: " << num_shards_ << ", atomic: " << atomic_;
 }
 
 bool MultiCommandSquasher::IsAtomic() const {
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <absl/container/flat_hash_set.h>
+
 #include "base/logging.h"
 #include "core/fibers.h"
 #include "facade/reply_capture.h"
@@ -22,6 +24,12 @@ namespace dfly {
 // transactional api for commands. Non atomic multi transactions use regular shard_set dispatches
 // instead of hops for executing batches. This allows avoiding locking many keys at once. Each shard
 // contains a non-atomic multi transaction to execute squashed commands.
+//
+// In atomic modes, commands that span multiple shards do not interrupt squashing if no following
+// command depends on them. They are deferred, run after the squashed batch with their replies
+// captured and replied in their original order. A squashed command that touches a key of a
+// deferred command flushes the batch first, so the order of commands is preserved per key.
+// Other clients can not observe the reordering, as the transaction holds the locks throughout.
 class MultiCommandSquasher {
  public:
   static void Execute(absl::Span<StoredCmd> cmds, ConnectionContext* cntx, Service* service,
@@ -45,6 +53,9 @@ class MultiCommandSquasher {
 
   static constexpr int kMaxSquashing = 32;
 
+  // Maximal number of multi shard commands that are deferred until the squashed batch has run.
+  static constexpr unsigned kMaxDeferred = 16;
+
  private:
   MultiCommandSquasher(absl::Span<StoredCmd> cmds, ConnectionContext* cntx, Service* Service,
                        bool verify_commands, bool error_abort);
@@ -58,6 +69,15 @@ class MultiCommandSquasher {
   // Execute separate non-squashed cmd. Return false if aborting on error.
   bool ExecuteStandalone(StoredCmd* cmd);
 
+  // Invoke cmd with the multi transaction of the context.
+  void InvokeStandalone(StoredCmd* cmd);
+
+  // Whether a multi shard cmd can be deferred until the current squashed batch has run.
+  bool CanDefer() const;
+
+  // Run deferred commands after the squashed batch and capture their replies.
+  void ExecuteDeferred();
+
   // Callback that runs on shards during squashed hop.
   facade::OpStatus SquashedHopCb(Transaction* parent_tx, EngineShard* es);
 
@@ -81,9 +101,14 @@ class MultiCommandSquasher {
   bool error_abort_ = false;      // Abort upon receiving error
 
   std::vector<ShardExecInfo> sharded_;
-  std::vector<ShardId> order_;  // reply order for squashed cmds
+  std::vector<ShardId> order_;  // reply order for squashed cmds, kInvalidSid for deferred ones
+
+  // Deferred multi shard commands with their replies and the keys they touch.
+  std::vector<std::pair<StoredCmd*, facade::CapturingReplyBuilder::Payload>> deferred_;
+  absl::flat_hash_set<std::string_view> deferred_keys_;
 
   size_t num_squashed_ = 0;
+  size_t num_deferred_ = 0;
   size_t num_shards_ = 0;
 
   std::vector<MutableSlice> tmp_keylist_;
@@ -562,6 +562,31 @@ TEST_F(MultiTest, MultiOOO) {
 }
 
 // Lua scripts lock their keys ahead and thus can run out of order.
+TEST_F(MultiTest, EvalBatch) {
+  const char* kScript = R"(
+    redis.acall('set', KEYS[3], 'c')
+    return redis.pcall_batch({'set', KEYS[1], '1'}, {'get', KEYS[2]}, {'incr', KEYS[1]},
+                             {'mget', KEYS[1], KEYS[3]})
+  )";
+
+  Run({"set", kKeySid1, "b"});
+  auto resp = Run({"eval", kScript, "3", kKeySid0, kKeySid1, kKeySid2});
+  ASSERT_THAT(resp, ArrLen(4));
+  const auto& vec = resp.GetVec();
+  EXPECT_THAT(vec[0], "OK");
+  EXPECT_THAT(vec[1], "b");
+  EXPECT_THAT(vec[2], IntArg(2));
+  EXPECT_THAT(vec[3], RespArray(ElementsAre("2", "c")));
+
+  // Unknown commands fail the whole batch without running any of it
+  resp = Run({"eval", "return redis.pcall_batch({'del', KEYS[1]}, {'nosuchcmd'})", "1", kKeySid0});
+  EXPECT_THAT(resp, ErrArg("unknown command"));
+  EXPECT_EQ(Run({"get", kKeySid0}), "2");
+
+  resp = Run({"eval", "return redis.pcall_batch({})", "0"});
+  EXPECT_THAT(resp, ErrArg("non empty tables"));
+}
+
 TEST_F(MultiTest, EvalOOO) {
   if (auto config = absl::GetFlag(FLAGS_default_lua_flags); config != "") {
     GTEST_SKIP() << "Skipped EvalOOO test because default_lua_flags is set";
@@ -598,6 +623,27 @@ TEST_F(MultiTest, EvalOOO) {
   EXPECT_EQ(1 + 2 * kTimes, sum);
 }
 
+TEST_F(MultiTest, EvalShardInterpreter) {
+  if (auto config = absl::GetFlag(FLAGS_default_lua_flags); config != "") {
+    GTEST_SKIP() << "Skipped EvalShardInterpreter test because default_lua_flags is set";
+    return;
+  }
+
+  // The keys of the script are on the shard of another thread, so an interpreter of that thread
+  // runs it.
+  const char* kScript =
+      "redis.call('SET', KEYS[1], ARGV[1]); return {redis.call('GET', KEYS[1]), #ARGV}";
+  auto resp = pp_->at(0)->Await([&] { return Run({"eval", kScript, "1", kKeySid1, "val"}); });
+  EXPECT_THAT(resp, RespArray(ElementsAre("val", IntArg(1))));
+
+  const char* kBadScript = "return redis.call('NOPE')";
+  resp = pp_->at(0)->Await([&] { return Run({"eval", kBadScript, "1", kKeySid1}); });
+  EXPECT_THAT(resp, ErrArg("Error running script"));
+
+  EXPECT_EQ(GetMetrics().coordinator_stats.eval_shard_interpreter_cnt, 2u);
+  EXPECT_EQ(Run({"get", kKeySid1}), "val");
+}
+
 // Run MULTI/EXEC commands in parallel, where each command is:
 //        MULTI - SET k1 v - SET k2 v - SET k3 v - EXEC
 // but the order of the commands inside appears in any permutation.
@@ -858,6 +904,42 @@ TEST_F(MultiTest, TestSquashing) {
   Run({"exec"});
 }
 
+// In atomic modes, multi shard commands are deferred behind the independent commands that follow
+// them, while commands touching their keys still observe their effects. Non atomic modes run them
+// in order. The replies are the same in both.
+TEST_F(MultiTest, SquashingDefersMultiShardCommands) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_multi_exec_squash, true);
+
+  for (auto mode : {Transaction::LOCK_AHEAD, Transaction::NON_ATOMIC}) {
+    SCOPED_TRACE(mode);
+    absl::SetFlag(&FLAGS_multi_exec_mode, mode);
+    Run({"flushall"});
+
+    Run({"multi"});
+    Run({"set", kKeySid0, "1"});
+    Run({"mset", kKeySid0, "2", kKeySid1, "2", kKeySid2, "2"});
+    Run({"hincrby", "h", "f", "1"});
+    Run({"incr", "x"});
+    Run({"mget", kKeySid0, kKeySid1});
+    Run({"incr", kKeySid2});
+    Run({"del", kKeySid0, kKeySid1});
+    Run({"get", kKeySid1});
+    auto resp = Run({"exec"});
+
+    ASSERT_THAT(resp, ArrLen(8));
+    const auto& vec = resp.GetVec();
+    EXPECT_THAT(vec[0], "OK");
+    EXPECT_THAT(vec[1], "OK");
+    EXPECT_THAT(vec[2], IntArg(1));
+    EXPECT_THAT(vec[3], IntArg(1));
+    EXPECT_THAT(vec[4], RespArray(ElementsAre("2", "2")));
+    EXPECT_THAT(vec[5], IntArg(3));
+    EXPECT_THAT(vec[6], IntArg(2));
+    EXPECT_THAT(vec[7], ArgType(RespExpr::NIL));
+  }
+}
+
 TEST_F(MultiTest, MultiLeavesTxQueue) {
   if (auto mode = absl::GetFlag(FLAGS_multi_exec_mode); mode == Transaction::NON_ATOMIC) {
     GTEST_SKIP() << "Skipped MultiLeavesTxQueue test because multi_exec_mode is non atomic";
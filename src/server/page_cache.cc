@@ -0,0 +1,64 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/page_cache.h"
+
+#include <cstring>
+
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+PageCache::PageCache(size_t capacity_bytes) : slots_(capacity_bytes / kPageSize) {
+  if (!slots_.empty())
+    data_.reset(new char[slots_.size() * kPageSize]);
+}
+
+const char* PageCache::Find(size_t offset) {
+  auto it = index_.find(offset);
+  if (it == index_.end())
+    return nullptr;
+
+  slots_[it->second].referenced = true;
+  return data_.get() + size_t(it->second) * kPageSize;
+}
+
+void PageCache::Insert(size_t offset, const char* data, uint64_t epoch) {
+  DCHECK_EQ(0u, offset % kPageSize);
+  if (slots_.empty() || epoch != epoch_ || index_.contains(offset))
+    return;
+
+  // Every page gets a second chance before it is evicted.
+  while (slots_[hand_].used && slots_[hand_].referenced) {
+    slots_[hand_].referenced = false;
+    hand_ = (hand_ + 1) % slots_.size();
+  }
+
+  Slot& slot = slots_[hand_];
+  if (slot.used)
+    index_.erase(slot.offset);
+
+  slot = Slot{offset, true, false};
+  index_[offset] = hand_;
+  memcpy(data_.get() + size_t(hand_) * kPageSize, data, kPageSize);
+  hand_ = (hand_ + 1) % slots_.size();
+}
+
+void PageCache::Invalidate(size_t offset, size_t len) {
+  ++epoch_;
+  if (index_.empty())
+    return;
+
+  for (size_t page = offset - offset % kPageSize; page < offset + len; page += kPageSize) {
+    auto it = index_.find(page);
+    if (it != index_.end()) {
+      slots_[it->second] = Slot{};
+      index_.erase(it);
+    }
+  }
+}
+
+}  // namespace dfly
@@ -0,0 +1,67 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/container/flat_hash_map.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace dfly {
+
+// PageCache keeps copies of recently read 4KB pages of the tiered backing file, so that bursts
+// of reads of the same pages do not go to disk. This matters when the file is opened with
+// O_DIRECT and the kernel page cache is bypassed.
+//
+// Notes:
+// - The capacity is fixed, pages are evicted with the CLOCK policy: every lookup sets the
+//   reference bit of the page and the hand evicts the first page without it.
+// - Writers invalidate the pages they overwrite. Every invalidation starts a new epoch and
+//   pages that were read in an earlier epoch are not inserted, since the read could race
+//   with the write.
+class PageCache {
+ public:
+  static constexpr size_t kPageSize = 4096;
+
+  explicit PageCache(size_t capacity_bytes);
+
+  // Returns the cached page that starts at offset or null.
+  const char* Find(size_t offset);
+
+  // Copies the page that starts at offset into the cache, unless the cache was invalidated
+  // since epoch.
+  void Insert(size_t offset, const char* data, uint64_t epoch);
+
+  // Drops the pages that intersect with [offset, offset + len).
+  void Invalidate(size_t offset, size_t len);
+
+  uint64_t epoch() const {
+    return epoch_;
+  }
+
+  size_t size() const {
+    return index_.size();
+  }
+
+  size_t capacity() const {
+    return slots_.size();
+  }
+
+ private:
+  struct Slot {
+    size_t offset = 0;
+    bool used = false;
+    bool referenced = false;
+  };
+
+  std::vector<Slot> slots_;
+  std::unique_ptr<char[]> data_;
+  absl::flat_hash_map<size_t, uint32_t> index_;  // page offset -> slot.
+  uint32_t hand_ = 0;
+  uint64_t epoch_ = 0;
+};
+
+}  // namespace dfly
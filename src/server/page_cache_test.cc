@@ -0,0 +1,77 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/page_cache.h"
+
+#include <string>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+class PageCacheTest : public ::testing::Test {
+ protected:
+  static string Page(char c) {
+    return string(PageCache::kPageSize, c);
+  }
+
+  static string Get(PageCache* cache, size_t offset) {
+    const char* page = cache->Find(offset);
+    return page ? string(page, PageCache::kPageSize) : string{};
+  }
+
+  PageCache cache_{PageCache::kPageSize * 3};
+};
+
+TEST_F(PageCacheTest, Basic) {
+  EXPECT_EQ(3u, cache_.capacity());
+  EXPECT_EQ(nullptr, cache_.Find(0));
+
+  cache_.Insert(0, Page('a').data(), cache_.epoch());
+  cache_.Insert(8192, Page('b').data(), cache_.epoch());
+  EXPECT_EQ(Page('a'), Get(&cache_, 0));
+  EXPECT_EQ(Page('b'), Get(&cache_, 8192));
+  EXPECT_EQ(nullptr, cache_.Find(4096));
+  EXPECT_EQ(2u, cache_.size());
+}
+
+TEST_F(PageCacheTest, Clock) {
+  for (unsigned i = 0; i < 3; ++i)
+    cache_.Insert(i * 4096, Page('a' + i).data(), cache_.epoch());
+
+  // The referenced page survives, the first unreferenced one is evicted.
+  cache_.Find(0);
+  cache_.Insert(3 * 4096, Page('d').data(), cache_.epoch());
+  EXPECT_EQ(3u, cache_.size());
+  EXPECT_EQ(Page('a'), Get(&cache_, 0));
+  EXPECT_EQ(nullptr, cache_.Find(4096));
+  EXPECT_EQ(Page('c'), Get(&cache_, 2 * 4096));
+  EXPECT_EQ(Page('d'), Get(&cache_, 3 * 4096));
+}
+
+TEST_F(PageCacheTest, Invalidate) {
+  cache_.Insert(0, Page('a').data(), cache_.epoch());
+  cache_.Insert(4096, Page('b').data(), cache_.epoch());
+
+  uint64_t epoch = cache_.epoch();
+  cache_.Invalidate(100, 4096);
+  EXPECT_EQ(0u, cache_.size());
+
+  // Pages read before the invalidation are not cached.
+  cache_.Insert(0, Page('a').data(), epoch);
+  EXPECT_EQ(nullptr, cache_.Find(0));
+  cache_.Insert(0, Page('c').data(), cache_.epoch());
+  EXPECT_EQ(Page('c'), Get(&cache_, 0));
+}
+
+TEST_F(PageCacheTest, Disabled) {
+  PageCache cache(0);
+  cache.Insert(0, Page('a').data(), cache.epoch());
+  EXPECT_EQ(nullptr, cache.Find(0));
+}
+
+}  // namespace dfly
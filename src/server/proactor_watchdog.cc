@@ -0,0 +1,152 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/proactor_watchdog.h"
+
+#include <absl/base/internal/cycleclock.h>
+#include <absl/debugging/stacktrace.h>
+#include <absl/debugging/symbolize.h>
+#include <absl/strings/str_cat.h>
+#include <absl/time/clock.h>
+
+#include "base/flags.h"
+#include "base/logging.h"
+
+ABSL_FLAG(uint32_t, stall_threshold_ms, 100,
+          "Report the proactors whose event loop did not run for longer than this and the commands "
+          "that ran on cpu longer than this without yielding. 0 to disable");
+
+namespace dfly {
+
+using namespace std;
+using absl::GetFlag;
+using absl::base_internal::CycleClock;
+
+namespace {
+
+// How often the probe fibers measure the latency of their event loop.
+constexpr auto kProbeInterval = 10ms;
+
+// Symbolized stack of the calling thread, one frame per line.
+string CurrentStack() {
+  void* frames[32];
+  int depth = absl::GetStackTrace(frames, size(frames), 1);
+
+  string res;
+  char name[256];
+  for (int i = 0; i < depth; ++i) {
+    const char* symbol = absl::Symbolize(frames[i], name, sizeof(name)) ? name : "(unknown)";
+    absl::StrAppend(&res, "\n  ", absl::Hex(frames[i]), " ", symbol);
+  }
+  return res;
+}
+
+}  // namespace
+
+thread_local ProactorWatchdog::ThreadState* ProactorWatchdog::tl_state = nullptr;
+
+ProactorWatchdog::CommandScope::CommandScope(const facade::CommandId* cid) : state_(tl_state) {
+  if (state_)
+    prev_ = state_->cmd.exchange(cid, memory_order_relaxed);
+}
+
+ProactorWatchdog::CommandScope::~CommandScope() {
+  if (state_)
+    state_->cmd.store(prev_, memory_order_relaxed);
+}
+
+ProactorWatchdog::ProactorWatchdog(util::ProactorPool* pool) : pool_(pool) {
+}
+
+ProactorWatchdog::~ProactorWatchdog() {
+  DCHECK(!monitor_.joinable());
+}
+
+void ProactorWatchdog::Start() {
+  states_.resize(pool_->size());
+  probes_.resize(pool_->size());
+  for (auto& state : states_)
+    state = make_unique<ThreadState>();
+
+  pool_->AwaitFiberOnAll([this](unsigned index, auto* pb) {
+    tl_state = states_[index].get();
+    probes_[index] = util::fb2::Fiber("proactor_probe", [this, index] {
+      RunProbe(states_[index].get());
+    });
+  });
+
+  monitor_ = thread{[this] { RunMonitor(); }};
+}
+
+void ProactorWatchdog::Stop() {
+  if (!monitor_.joinable())
+    return;
+
+  monitor_done_.store(true, memory_order_relaxed);
+  monitor_.join();
+
+  probes_done_.Notify();
+  pool_->AwaitFiberOnAll([this](unsigned index, auto* pb) {
+    probes_[index].JoinIfNeeded();
+    tl_state = nullptr;
+  });
+}
+
+void ProactorWatchdog::CheckSlice(const facade::CommandId& cid, uint64_t cycles) {
+  uint32_t threshold_ms = GetFlag(FLAGS_stall_threshold_ms);
+  if (threshold_ms == 0 || cycles < threshold_ms * CycleClock::Frequency() / 1000)
+    return;
+
+  // The stack shows the path the command took, for example from inside a script or EXEC.
+  LOG_EVERY_T(WARNING, 1) << cid.name() << " ran "
+                          << uint64_t(cycles * 1000 / CycleClock::Frequency())
+                          << "ms on cpu without yielding, stalling the other fibers of its thread:"
+                          << CurrentStack();
+}
+
+const base::Histogram& ProactorWatchdog::LoopLatency() {
+  static const base::Histogram empty;
+  return tl_state ? tl_state->loop_latency_usec : empty;
+}
+
+void ProactorWatchdog::RunProbe(ThreadState* state) {
+  uint64_t prev_ns = absl::GetCurrentTimeNanos();
+  state->tick_ns.store(prev_ns, memory_order_relaxed);
+
+  auto interval_ns = uint64_t(chrono::nanoseconds(kProbeInterval).count());
+  while (!probes_done_.WaitFor(kProbeInterval)) {
+    uint64_t now = absl::GetCurrentTimeNanos();
+    uint64_t expected_ns = prev_ns + interval_ns;
+    state->loop_latency_usec.Add(now > expected_ns ? (now - expected_ns) / 1000 : 0);
+    state->tick_ns.store(now, memory_order_relaxed);
+    prev_ns = now;
+  }
+}
+
+void ProactorWatchdog::RunMonitor() {
+  // The last tick of every proactor that was reported, so each stall is reported once.
+  vector<uint64_t> reported(states_.size(), 0);
+
+  while (!monitor_done_.load(memory_order_relaxed)) {
+    uint32_t threshold_ms = GetFlag(FLAGS_stall_threshold_ms);
+    this_thread::sleep_for(chrono::milliseconds(threshold_ms ? max(threshold_ms / 4, 1u) : 100));
+    if (threshold_ms == 0)
+      continue;
+
+    uint64_t now = absl::GetCurrentTimeNanos();
+    auto threshold_ns = uint64_t(chrono::nanoseconds(kProbeInterval + 1ms * threshold_ms).count());
+    for (size_t i = 0; i < states_.size(); ++i) {
+      uint64_t tick = states_[i]->tick_ns.load(memory_order_relaxed);
+      if (tick == 0 || tick == reported[i] || now < tick + threshold_ns)
+        continue;
+
+      reported[i] = tick;
+      const facade::CommandId* cid = states_[i]->cmd.load(memory_order_relaxed);
+      LOG(WARNING) << "Proactor " << i << " is stalled for " << (now - tick) / 1000000
+                   << "ms, running " << (cid ? cid->name() : "no command");
+    }
+  }
+}
+
+}  // namespace dfly
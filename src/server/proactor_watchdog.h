@@ -0,0 +1,79 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "base/histogram.h"
+#include "facade/command_id.h"
+#include "util/fibers/fibers.h"
+#include "util/fibers/synchronization.h"
+#include "util/proactor_pool.h"
+
+namespace dfly {
+
+// Watches the event loops of the proactors. A fiber that runs long without yielding, for example
+// a shard callback deleting a huge key or a long script, stalls all the other fibers of its
+// proactor.
+//
+// A probe fiber on every proactor wakes up periodically and records how late it woke up, which is
+// the latency of the iteration of the event loop. A monitor thread reports the proactors whose
+// probe did not run for longer than --stall_threshold_ms, together with the command running on
+// them. The commands that ran on cpu longer than the threshold are logged with their stack by the
+// thread that ran them once they finish.
+class ProactorWatchdog {
+  struct ThreadState;
+
+ public:
+  explicit ProactorWatchdog(util::ProactorPool* pool);
+  ~ProactorWatchdog();
+
+  void Start();
+  void Stop();
+
+  // Marks the command running on the calling thread until the scope ends, the monitor names it
+  // when it reports a stall of the thread. Scopes nest.
+  class CommandScope {
+   public:
+    explicit CommandScope(const facade::CommandId* cid);
+    ~CommandScope();
+
+   private:
+    ThreadState* state_;  // the fiber might migrate to another thread meanwhile
+    const facade::CommandId* prev_ = nullptr;
+  };
+
+  // Logs the stack of the calling thread if cid ran for cycles on cpu longer than the threshold.
+  static void CheckSlice(const facade::CommandId& cid, uint64_t cycles);
+
+  // Latencies of the event loop iterations of the calling thread, in usec.
+  static const base::Histogram& LoopLatency();
+
+ private:
+  struct ThreadState {
+    std::atomic<uint64_t> tick_ns{0};  // last time the probe ran
+    std::atomic<const facade::CommandId*> cmd{nullptr};
+    base::Histogram loop_latency_usec;  // accessed only by the thread itself
+  };
+
+  static thread_local ThreadState* tl_state;
+
+  void RunProbe(ThreadState* state);
+  void RunMonitor();
+
+  util::ProactorPool* pool_;
+  std::vector<std::unique_ptr<ThreadState>> states_;
+  std::vector<util::fb2::Fiber> probes_;
+  util::fb2::Done probes_done_;
+
+  std::thread monitor_;
+  std::atomic_bool monitor_done_{false};
+};
+
+}  // namespace dfly
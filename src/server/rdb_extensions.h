@@ -14,9 +14,15 @@ constexpr uint8_t RDB_TYPE_JSON = 30;
 constexpr uint8_t RDB_TYPE_HASH_WITH_EXPIRY = 31;
 constexpr uint8_t RDB_TYPE_SET_WITH_EXPIRY = 32;
 
+// The location of a value in the tiered backing file of the instance that saved the snapshot,
+// see --tiered_persistent. Followed by the shard id, the 8 bytes of the generation of the file,
+// the object type, the offset and the size of the value.
+constexpr uint8_t RDB_TYPE_TIERED_REF = 33;
+
 constexpr bool rdbIsObjectTypeDF(uint8_t type) {
   return __rdbIsObjectType(type) || (type == RDB_TYPE_JSON) ||
-         (type == RDB_TYPE_HASH_WITH_EXPIRY) || (type == RDB_TYPE_SET_WITH_EXPIRY);
+         (type == RDB_TYPE_HASH_WITH_EXPIRY) || (type == RDB_TYPE_SET_WITH_EXPIRY) ||
+         (type == RDB_TYPE_TIERED_REF);
 }
 
 //  Opcodes: Range 200-240 is used by DF extensions.
@@ -38,6 +44,19 @@ constexpr uint8_t RDB_OPCODE_JOURNAL_BLOB = 210;
 // so it is always sent at the end of the RDB stream.
 constexpr uint8_t RDB_OPCODE_JOURNAL_OFFSET = 211;
 
+// Serialized search indices of a shard, written at the start of its snapshot so that they
+// match the snapshotted documents. Followed by the shard id, the number of shards and
+// the output of ShardDocIndices::SerializeIndices as a string.
+constexpr uint8_t RDB_OPCODE_SEARCH_INDICES = 212;
+
+// A key deleted since the base of a delta snapshot, followed by the key as a string. Written
+// before the entries of the delta in the database selected by RDB_OPCODE_SELECTDB.
+constexpr uint8_t RDB_OPCODE_DELETED_KEY = 213;
+
+// The zstd dictionary of the following compressed blobs of the stream, followed by the
+// dictionary as a string.
+constexpr uint8_t RDB_OPCODE_COMPRESSION_DICT = 214;
+
 constexpr uint8_t RDB_OPCODE_DF_MASK = 220; /* Mask for key properties */
 
 // RDB_OPCODE_DF_MASK define 4byte field with next flags
@@ -19,6 +19,7 @@ extern "C" {
 #include "redis/zset.h"
 }
 #include <absl/cleanup/cleanup.h>
+#include <absl/container/flat_hash_set.h>
 #include <absl/strings/match.h>
 #include <absl/strings/str_cat.h>
 #include <absl/strings/str_split.h>
@@ -31,6 +32,7 @@ extern "C" {
 #include "base/endian.h"
 #include "base/flags.h"
 #include "base/logging.h"
+#include "core/compact_string_set.h"
 #include "core/json_object.h"
 #include "core/sorted_map.h"
 #include "core/string_map.h"
@@ -47,6 +49,7 @@ extern "C" {
 #include "server/serializer_commons.h"
 #include "server/server_state.h"
 #include "server/set_family.h"
+#include "server/tiered_storage.h"
 #include "server/transaction.h"
 #include "strings/human_readable.h"
 
@@ -54,6 +57,11 @@ ABSL_DECLARE_FLAG(int32_t, list_max_listpack_size);
 ABSL_DECLARE_FLAG(int32_t, list_compress_depth);
 ABSL_DECLARE_FLAG(uint32_t, dbnum);
 ABSL_DECLARE_FLAG(bool, use_set2);
+ABSL_DECLARE_FLAG(bool, json_packed_encoding);
+
+ABSL_FLAG(bool, rdb_parallel_decode, false,
+          "If true, the loading thread copies the serialized values of the common types and the "
+          "shards decode them in parallel, instead of parsing them on the loading thread.");
 
 namespace dfly {
 
@@ -67,7 +75,17 @@ using rdb::errc;
 namespace {
 
 constexpr size_t kYieldPeriod = 50000;
+
+// Keys of the shard thread whose values are loaded in chunks and still miss some of them.
+thread_local absl::flat_hash_set<std::pair<DbIndex, std::string>> tl_partial_keys;
 constexpr size_t kMaxBlobLen = 1ULL << 16;
+
+// The number of elements of the chunks of big containers, every chunk is applied to the key
+// separately. A chunk fits a single LoadTrace segment.
+constexpr size_t kMaxChunkElements = 4096;
+
+// Raw copies with bigger capacity are not kept by the reused items.
+constexpr size_t kMaxRetainedRawLen = 1ULL << 16;
 constexpr char kErrCat[] = "dragonfly.rdbload";
 
 inline void YieldIfNeeded(size_t i) {
@@ -223,6 +241,11 @@ class DecompressImpl {
   }
   virtual io::Result<base::IoBuf*> Decompress(std::string_view str) = 0;
 
+  // Decompresses the next blobs with the dictionary.
+  virtual std::error_code LoadDictionary(std::string_view dict) {
+    return RdbError(errc::feature_not_supported);
+  }
+
  protected:
   base::IoBuf uncompressed_mem_buf_;
 };
@@ -233,13 +256,23 @@ class ZstdDecompress : public DecompressImpl {
     dctx_ = ZSTD_createDCtx();
   }
   ~ZstdDecompress() {
+    ZSTD_freeDDict(ddict_);
     ZSTD_freeDCtx(dctx_);
   }
 
   io::Result<base::IoBuf*> Decompress(std::string_view str);
 
+  std::error_code LoadDictionary(std::string_view dict) final {
+    ZSTD_freeDDict(ddict_);
+    ddict_ = ZSTD_createDDict(dict.data(), dict.size());
+    if (!ddict_)
+      return RdbError(errc::rdb_file_corrupted);
+    return {};
+  }
+
  private:
   ZSTD_DCtx* dctx_;
+  ZSTD_DDict* ddict_ = nullptr;
 };
 
 io::Result<base::IoBuf*> ZstdDecompress::Decompress(std::string_view str) {
@@ -262,7 +295,9 @@ io::Result<base::IoBuf*> ZstdDecompress::Decompress(std::string_view str) {
     return Unexpected(errc::out_of_memory);
   }
   size_t const d_size =
-      ZSTD_decompressDCtx(dctx_, dest.data(), dest.size(), str.data(), str.size());
+      ddict_ ? ZSTD_decompress_usingDDict(dctx_, dest.data(), dest.size(), str.data(), str.size(),
+                                          ddict_)
+             : ZSTD_decompressDCtx(dctx_, dest.data(), dest.size(), str.data(), str.size());
   if (d_size == 0 || d_size != uncomp_size) {
     LOG(ERROR) << "Invalid ZSTD compressed string";
     return Unexpected(errc::rdb_file_corrupted);
@@ -363,7 +398,8 @@ io::Result<base::IoBuf*> Lz4Decompress::Decompress(std::string_view data) {
 
 class RdbLoaderBase::OpaqueObjLoader {
  public:
-  OpaqueObjLoader(int rdb_type, PrimeValue* pv) : rdb_type_(rdb_type), pv_(pv) {
+  OpaqueObjLoader(int rdb_type, PrimeValue* pv, LoadConfig config = {})
+      : rdb_type_(rdb_type), pv_(pv), config_(config) {
   }
 
   void operator()(robj* o) {
@@ -378,6 +414,11 @@ class RdbLoaderBase::OpaqueObjLoader {
   void operator()(const LzfString& lzfstr);
   void operator()(const unique_ptr<LoadTrace>& ptr);
 
+  // Restored only by RdbLoader::RestoreTieredRef, since it refers to the tiered storage.
+  void operator()(const TieredRef&) {
+    ec_ = RdbError(errc::feature_not_supported);
+  }
+
   std::error_code ec() const {
     return ec_;
   }
@@ -387,6 +428,7 @@ class RdbLoaderBase::OpaqueObjLoader {
   void CreateHMap(const LoadTrace* ltrace);
   void CreateList(const LoadTrace* ltrace);
   void CreateZSet(const LoadTrace* ltrace);
+  void AppendZSet(const LoadTrace* ltrace);
   void CreateStream(const LoadTrace* ltrace);
 
   void HandleBlob(string_view blob);
@@ -410,6 +452,7 @@ class RdbLoaderBase::OpaqueObjLoader {
   int rdb_type_;
   base::PODArray<char> tset_blob_;
   PrimeValue* pv_;
+  LoadConfig config_;
 };
 
 RdbLoaderBase::RdbLoaderBase() : origin_mem_buf_{16_KB} {
@@ -462,7 +505,7 @@ void RdbLoaderBase::OpaqueObjLoader::operator()(const unique_ptr<LoadTrace>& ptr
 }
 
 void RdbLoaderBase::OpaqueObjLoader::CreateSet(const LoadTrace* ltrace) {
-  size_t len = ltrace->blob_count();
+  size_t len = config_.reserve ? config_.reserve : ltrace->blob_count();
 
   bool is_intset = true;
   if (rdb_type_ == RDB_TYPE_HASH && ltrace->blob_count() <= SetFamily::MaxIntsetEntries()) {
@@ -484,7 +527,8 @@ void RdbLoaderBase::OpaqueObjLoader::CreateSet(const LoadTrace* ltrace) {
   auto cleanup = absl::MakeCleanup([&] {
     if (sdsele)
       sdsfree(sdsele);
-    decrRefCount(res);
+    if (res)
+      decrRefCount(res);
   });
 
   if (is_intset) {
@@ -501,10 +545,41 @@ void RdbLoaderBase::OpaqueObjLoader::CreateSet(const LoadTrace* ltrace) {
       }
       return true;
     });
+  } else if (rdb_type_ == RDB_TYPE_SET && len <= SetFamily::MaxCompactSetEntries() &&
+             GetFlag(FLAGS_use_set2)) {
+    std::move(cleanup).Cancel();
+
+    CompactStringSet* set = CompactObj::AllocateMR<CompactStringSet>();
+    set->Reserve(len);
+    Iterate(*ltrace, [&](const LoadBlob& blob) {
+      if (!set->Add(ToSV(blob.rdb_var))) {
+        LOG(ERROR) << "Duplicate set members detected";
+        ec_ = RdbError(errc::duplicate_key);
+        return false;
+      }
+      return true;
+    });
+
+    if (ec_) {
+      CompactObj::DeleteMR<CompactStringSet>(set);
+      return;
+    }
+    pv_->InitRobj(OBJ_SET, kEncodingCompactSet, set);
+    return;
   } else {
     bool use_set2 = GetFlag(FLAGS_use_set2);
+    void* inner = nullptr;
 
-    if (use_set2) {
+    if (config_.append) {
+      // The first chunk of the value created the set, whose size is above the compact limits.
+      use_set2 = pv_->Encoding() == kEncodingStrMap2;
+      if (!use_set2 && pv_->Encoding() != kEncodingStrMap) {
+        LOG(ERROR) << "Unexpected encoding " << pv_->Encoding() << " of a chunked set";
+        ec_ = RdbError(errc::rdb_file_corrupted);
+        return;
+      }
+      inner = pv_->RObjPtr();
+    } else if (use_set2) {
       StringSet* set = CompactObj::AllocateMR<StringSet>();
       set->set_time(MemberTimeSeconds(GetCurrentTimeMs()));
       res = createObject(OBJ_SET, set);
@@ -525,10 +600,13 @@ void RdbLoaderBase::OpaqueObjLoader::CreateSet(const LoadTrace* ltrace) {
 
     /* It's faster to expand the dict to the right size asap in order
      * to avoid rehashing */
-    if (len > DICT_HT_INITIAL_SIZE && !resizeStringSet(res, len, use_set2)) {
-      LOG(ERROR) << "OOM in dictTryExpand " << len;
-      ec_ = RdbError(errc::out_of_memory);
-      return;
+    if (res) {
+      if (len > DICT_HT_INITIAL_SIZE && !resizeStringSet(res, len, use_set2)) {
+        LOG(ERROR) << "OOM in dictTryExpand " << len;
+        ec_ = RdbError(errc::out_of_memory);
+        return;
+      }
+      inner = res->ptr;
     }
 
     if (use_set2) {
@@ -537,7 +615,7 @@ void RdbLoaderBase::OpaqueObjLoader::CreateSet(const LoadTrace* ltrace) {
         increment = 2;
       }
 
-      auto set = (StringSet*)res->ptr;
+      auto set = (StringSet*)inner;
       for (const auto& seg : ltrace->arr) {
         for (size_t i = 0; i < seg.size(); i += increment) {
           string_view element = ToSV(seg[i].rdb_var);
@@ -573,7 +651,7 @@ void RdbLoaderBase::OpaqueObjLoader::CreateSet(const LoadTrace* ltrace) {
         if (!sdsele)
           return false;
 
-        if (dictAdd((dict*)res->ptr, sdsele, NULL) != DICT_OK) {
+        if (dictAdd((dict*)inner, sdsele, NULL) != DICT_OK) {
           LOG(ERROR) << "Duplicate set members detected";
           ec_ = RdbError(errc::duplicate_key);
           return false;
@@ -585,7 +663,8 @@ void RdbLoaderBase::OpaqueObjLoader::CreateSet(const LoadTrace* ltrace) {
 
   if (ec_)
     return;
-  pv_->ImportRObj(res);
+  if (res)
+    pv_->ImportRObj(res);
   std::move(cleanup).Cancel();
 }
 
@@ -594,7 +673,7 @@ void RdbLoaderBase::OpaqueObjLoader::CreateHMap(const LoadTrace* ltrace) {
   if (rdb_type_ == RDB_TYPE_HASH_WITH_EXPIRY)
     increment = 3;
 
-  size_t len = ltrace->blob_count() / increment;
+  size_t len = (config_.reserve ? config_.reserve : ltrace->blob_count()) / increment;
 
   /* Too many entries? Use a hash table right from the start. */
   bool keep_lp = (len <= 64) && (rdb_type_ != RDB_TYPE_HASH_WITH_EXPIRY);
@@ -636,12 +715,25 @@ void RdbLoaderBase::OpaqueObjLoader::CreateHMap(const LoadTrace* ltrace) {
     lp = lpShrinkToFit(lp);
     pv_->InitRobj(OBJ_HASH, kEncodingListPack, lp);
   } else {
-    StringMap* string_map = CompactObj::AllocateMR<StringMap>();
-    string_map->set_time(MemberTimeSeconds(GetCurrentTimeMs()));
+    StringMap* string_map = nullptr;
+    if (config_.append) {
+      if (pv_->Encoding() != kEncodingStrMap2) {
+        LOG(ERROR) << "Unexpected encoding " << pv_->Encoding() << " of a chunked hash";
+        ec_ = RdbError(errc::rdb_file_corrupted);
+        return;
+      }
+      string_map = static_cast<StringMap*>(pv_->RObjPtr());
+    } else {
+      string_map = CompactObj::AllocateMR<StringMap>();
+      string_map->set_time(MemberTimeSeconds(GetCurrentTimeMs()));
+      string_map->Reserve(len);
+    }
 
-    auto cleanup = absl::MakeCleanup([&] { CompactObj::DeleteMR<StringMap>(string_map); });
+    auto cleanup = absl::MakeCleanup([&] {
+      if (!config_.append)
+        CompactObj::DeleteMR<StringMap>(string_map);
+    });
     std::string key;
-    string_map->Reserve(len);
     for (const auto& seg : ltrace->arr) {
       for (size_t i = 0; i < seg.size(); i += increment) {
         // ToSV may reference an internal buffer, therefore we can use only before the
@@ -679,15 +771,28 @@ void RdbLoaderBase::OpaqueObjLoader::CreateHMap(const LoadTrace* ltrace) {
         }
       }
     }
-    pv_->InitRobj(OBJ_HASH, kEncodingStrMap2, string_map);
+    if (!config_.append)
+      pv_->InitRobj(OBJ_HASH, kEncodingStrMap2, string_map);
     std::move(cleanup).Cancel();
   }
 }
 
 void RdbLoaderBase::OpaqueObjLoader::CreateList(const LoadTrace* ltrace) {
-  quicklist* ql =
-      quicklistNew(GetFlag(FLAGS_list_max_listpack_size), GetFlag(FLAGS_list_compress_depth));
-  auto cleanup = absl::Cleanup([&] { quicklistRelease(ql); });
+  quicklist* ql;
+  if (config_.append) {
+    if (pv_->ObjType() != OBJ_LIST) {
+      LOG(ERROR) << "Unexpected type " << pv_->ObjType() << " of a chunked list";
+      ec_ = RdbError(errc::rdb_file_corrupted);
+      return;
+    }
+    ql = static_cast<quicklist*>(pv_->RObjPtr());
+  } else {
+    ql = quicklistNew(GetFlag(FLAGS_list_max_listpack_size), GetFlag(FLAGS_list_compress_depth));
+  }
+  auto cleanup = absl::Cleanup([&] {
+    if (!config_.append)
+      quicklistRelease(ql);
+  });
 
   Iterate(*ltrace, [&](const LoadBlob& blob) {
     unsigned container = blob.encoding;
@@ -747,6 +852,9 @@ void RdbLoaderBase::OpaqueObjLoader::CreateList(const LoadTrace* ltrace) {
     return;
   }
 
+  if (config_.append)
+    return;
+
   robj* res = createObject(OBJ_LIST, ql);
   res->encoding = OBJ_ENCODING_QUICKLIST;
   std::move(cleanup).Cancel();
@@ -755,7 +863,12 @@ void RdbLoaderBase::OpaqueObjLoader::CreateList(const LoadTrace* ltrace) {
 }
 
 void RdbLoaderBase::OpaqueObjLoader::CreateZSet(const LoadTrace* ltrace) {
-  size_t zsetlen = ltrace->blob_count();
+  if (config_.append) {
+    AppendZSet(ltrace);
+    return;
+  }
+
+  size_t zsetlen = config_.reserve ? config_.reserve : ltrace->blob_count();
   detail::SortedMap* zs = CompactObj::AllocateMR<detail::SortedMap>();
   unsigned encoding = OBJ_ENCODING_SKIPLIST;
   auto cleanup = absl::MakeCleanup([&] { CompactObj::DeleteMR<detail::SortedMap>(zs); });
@@ -768,33 +881,43 @@ void RdbLoaderBase::OpaqueObjLoader::CreateZSet(const LoadTrace* ltrace) {
 
   size_t maxelelen = 0, totelelen = 0;
 
+  // The members are inserted in bulk, so that the map is built in a single pass.
+  vector<sds> elements;
+  vector<detail::SortedMap::ScoredMemberView> members;
+  elements.reserve(ltrace->blob_count());
+  members.reserve(ltrace->blob_count());
+  auto free_elements = absl::MakeCleanup([&] {
+    for (sds ele : elements)
+      sdsfree(ele);
+  });
+
   Iterate(*ltrace, [&](const LoadBlob& blob) {
     sds sdsele = ToSds(blob.rdb_var);
     if (!sdsele)
       return false;
 
-    double score = blob.score;
+    elements.push_back(sdsele);
 
     /* Don't care about integer-encoded strings. */
     if (sdslen(sdsele) > maxelelen)
       maxelelen = sdslen(sdsele);
     totelelen += sdslen(sdsele);
 
-    if (!zs->Insert(score, sdsele)) {
-      LOG(ERROR) << "Duplicate zset fields detected";
-      sdsfree(sdsele);
-      ec_ = RdbError(errc::rdb_file_corrupted);
-      return false;
-    }
-
+    members.emplace_back(blob.score, string_view{sdsele, sdslen(sdsele)});
     return true;
   });
 
   if (ec_)
     return;
 
+  if (!zs->BulkInsert(members)) {
+    LOG(ERROR) << "Duplicate zset fields detected";
+    ec_ = RdbError(errc::rdb_file_corrupted);
+    return;
+  }
+
   void* inner = zs;
-  if (zs->Size() <= server.zset_max_listpack_entries &&
+  if (config_.reserve == 0 && zs->Size() <= server.zset_max_listpack_entries &&
       maxelelen <= server.zset_max_listpack_value && lpSafeToAdd(NULL, totelelen)) {
     encoding = OBJ_ENCODING_LISTPACK;
     inner = zs->ToListPack();
@@ -806,6 +929,33 @@ void RdbLoaderBase::OpaqueObjLoader::CreateZSet(const LoadTrace* ltrace) {
   pv_->InitRobj(OBJ_ZSET, encoding, inner);
 }
 
+// BulkInsert needs an empty map, so the members of the next chunks are added one by one.
+void RdbLoaderBase::OpaqueObjLoader::AppendZSet(const LoadTrace* ltrace) {
+  if (pv_->Encoding() != OBJ_ENCODING_SKIPLIST) {
+    LOG(ERROR) << "Unexpected encoding " << pv_->Encoding() << " of a chunked zset";
+    ec_ = RdbError(errc::rdb_file_corrupted);
+    return;
+  }
+
+  auto* zs = static_cast<detail::SortedMap*>(pv_->GetRobjWrapper()->inner_obj());
+  Iterate(*ltrace, [&](const LoadBlob& blob) {
+    sds sdsele = ToSds(blob.rdb_var);
+    if (!sdsele)
+      return false;
+
+    int out_flags = 0;
+    double new_score;
+    zs->Add(blob.score, sdsele, ZADD_IN_NX, &out_flags, &new_score);
+    sdsfree(sdsele);
+    if ((out_flags & ZADD_OUT_ADDED) == 0) {
+      LOG(ERROR) << "Duplicate zset fields detected";
+      ec_ = RdbError(errc::rdb_file_corrupted);
+      return false;
+    }
+    return true;
+  });
+}
+
 void RdbLoaderBase::OpaqueObjLoader::CreateStream(const LoadTrace* ltrace) {
   CHECK(ltrace->stream_trace);
 
@@ -866,15 +1016,15 @@ void RdbLoaderBase::OpaqueObjLoader::CreateStream(const LoadTrace* ltrace) {
     }
 
     for (const auto& pel : cg.pel_arr) {
-      streamNACK* nack = streamCreateNACK(NULL);
-      nack->delivery_time = pel.delivery_time;
-      nack->delivery_count = pel.delivery_count;
+      streamPendingEntry nack;
+      streamDecodeID(const_cast<uint8_t*>(pel.rawid.data()), &nack.id);
+      nack.delivery_time = pel.delivery_time;
+      nack.delivery_count = pel.delivery_count;
+      nack.consumer = NULL;
 
-      if (!raxTryInsert(cgroup->pel, const_cast<uint8_t*>(pel.rawid.data()), pel.rawid.size(), nack,
-                        NULL)) {
+      if (!streamPELInsert(cgroup->pel, &nack)) {
         LOG(ERROR) << "Duplicated global PEL entry loading stream consumer group";
         ec_ = RdbError(errc::duplicate_key);
-        streamFreeNACK(nack);
         return;
       }
     }
@@ -895,24 +1045,24 @@ void RdbLoaderBase::OpaqueObjLoader::CreateStream(const LoadTrace* ltrace) {
       /* Create the PEL (pending entries list) about entries owned by this specific
        * consumer. */
       for (const auto& rawid : cons.nack_arr) {
-        uint8_t* ptr = const_cast<uint8_t*>(rawid.data());
-        streamNACK* nack = (streamNACK*)raxFind(cgroup->pel, ptr, rawid.size());
-        if (nack == raxNotFound) {
+        streamID id;
+        streamPendingEntry nack;
+        streamDecodeID(const_cast<uint8_t*>(rawid.data()), &id);
+        if (!streamPELFind(cgroup->pel, &id, &nack)) {
           LOG(ERROR) << "Consumer entry not found in group global PEL";
           ec_ = RdbError(errc::rdb_file_corrupted);
           return;
         }
 
         /* Set the NACK consumer, that was left to NULL when
-         * loading the global PEL. Then set the same shared
-         * NACK structure also in the consumer-specific PEL. */
-        nack->consumer = consumer;
-        if (!raxTryInsert(consumer->pel, ptr, rawid.size(), nack, NULL)) {
+         * loading the global PEL. */
+        if (nack.consumer) {
           LOG(ERROR) << "Duplicated consumer PEL entry loading a stream consumer group";
-          streamFreeNACK(nack);
           ec_ = RdbError(errc::duplicate_key);
           return;
         }
+        nack.consumer = consumer;
+        streamPELUpdate(cgroup->pel, &nack);
       }
     }
   }
@@ -1076,9 +1226,21 @@ void RdbLoaderBase::OpaqueObjLoader::HandleBlob(string_view blob) {
     std::memcpy(lp, src_lp, bytes);
     pv_->InitRobj(OBJ_ZSET, OBJ_ENCODING_LISTPACK, lp);
   } else if (rdb_type_ == RDB_TYPE_JSON) {
+    if (absl::GetFlag(FLAGS_json_packed_encoding)) {
+      auto packed = PackJsonFromString(blob);
+      if (!packed) {
+        ec_ = RdbError(errc::bad_json_string);
+        return;
+      }
+      string_view packed_sv{reinterpret_cast<const char*>(packed->data()), packed->size()};
+      pv_->SetPackedJson(packed_sv);
+      return;
+    }
+
     auto json = JsonFromString(blob);
     if (!json) {
       ec_ = RdbError(errc::bad_json_string);
+      return;
     }
     pv_->SetJson(std::move(*json));
   } else {
@@ -1403,6 +1565,9 @@ error_code RdbLoaderBase::ReadObj(int rdbtype, OpaqueObj* dest) {
     case RDB_TYPE_JSON:
       iores = ReadJson();
       break;
+    case RDB_TYPE_TIERED_REF:
+      iores = ReadTieredRef();
+      break;
     case RDB_TYPE_SET_LISTPACK:
       // We need to deal with protocol versions 9 and older because in these
       // RDB_TYPE_JSON == 20. On newer versions > 9 we bumped up RDB_TYPE_JSON to 30
@@ -1426,6 +1591,127 @@ error_code RdbLoaderBase::ReadObj(int rdbtype, OpaqueObj* dest) {
   return error_code{};
 }
 
+bool RdbLoaderBase::CanCopyRawObj(int rdbtype) const {
+  switch (rdbtype) {
+    case RDB_TYPE_STRING:
+    case RDB_TYPE_SET:
+    case RDB_TYPE_SET_INTSET:
+    case RDB_TYPE_HASH_ZIPLIST:
+    case RDB_TYPE_HASH_LISTPACK:
+    case RDB_TYPE_ZSET_LISTPACK:
+    case RDB_TYPE_HASH:
+    case RDB_TYPE_ZSET:
+    case RDB_TYPE_ZSET_2:
+    case RDB_TYPE_ZSET_ZIPLIST:
+    case RDB_TYPE_LIST_QUICKLIST:
+    case RDB_TYPE_LIST_QUICKLIST_2:
+      return true;
+    case RDB_TYPE_SET_LISTPACK:
+      return rdb_version_ >= 10;  // see ReadObj
+    default:
+      return false;
+  }
+}
+
+error_code RdbLoaderBase::CopyRawObj(int rdbtype, string* dest) {
+  DCHECK(CanCopyRawObj(rdbtype));
+
+  uint64_t len;
+  switch (rdbtype) {
+    case RDB_TYPE_SET:
+      RETURN_ON_ERR(CopyRawLen(dest, &len, nullptr));
+      for (uint64_t i = 0; i < len; ++i)
+        RETURN_ON_ERR(CopyRawString(dest));
+      break;
+    case RDB_TYPE_HASH:
+      RETURN_ON_ERR(CopyRawLen(dest, &len, nullptr));
+      for (uint64_t i = 0; i < len * 2; ++i)
+        RETURN_ON_ERR(CopyRawString(dest));
+      break;
+    case RDB_TYPE_ZSET:
+    case RDB_TYPE_ZSET_2:
+      RETURN_ON_ERR(CopyRawLen(dest, &len, nullptr));
+      for (uint64_t i = 0; i < len; ++i) {
+        RETURN_ON_ERR(CopyRawString(dest));
+        if (rdbtype == RDB_TYPE_ZSET_2) {
+          RETURN_ON_ERR(CopyRawBytes(8, dest));
+        } else {
+          // A length byte followed by the score as string, see FetchDouble.
+          RETURN_ON_ERR(CopyRawBytes(1, dest));
+          uint8_t score_len = dest->back();
+          if (score_len < 253)
+            RETURN_ON_ERR(CopyRawBytes(score_len, dest));
+        }
+      }
+      break;
+    case RDB_TYPE_LIST_QUICKLIST:
+    case RDB_TYPE_LIST_QUICKLIST_2:
+      RETURN_ON_ERR(CopyRawLen(dest, &len, nullptr));
+      for (uint64_t i = 0; i < len; ++i) {
+        if (rdbtype == RDB_TYPE_LIST_QUICKLIST_2) {
+          uint64_t container;
+          RETURN_ON_ERR(CopyRawLen(dest, &container, nullptr));
+        }
+        RETURN_ON_ERR(CopyRawString(dest));
+      }
+      break;
+    default:  // the types that are serialized as a single string.
+      RETURN_ON_ERR(CopyRawString(dest));
+  }
+
+  dest->append(kRawObjPadding, '\0');
+  return kOk;
+}
+
+error_code RdbLoaderBase::CopyRawString(string* dest) {
+  bool isencoded;
+  uint64_t len;
+  RETURN_ON_ERR(CopyRawLen(dest, &len, &isencoded));
+
+  if (!isencoded)
+    return CopyRawBytes(len, dest);
+
+  switch (len) {
+    case RDB_ENC_INT8:
+      return CopyRawBytes(1, dest);
+    case RDB_ENC_INT16:
+      return CopyRawBytes(2, dest);
+    case RDB_ENC_INT32:
+      return CopyRawBytes(4, dest);
+    case RDB_ENC_LZF: {
+      uint64_t clen, uncompressed_len;
+      RETURN_ON_ERR(CopyRawLen(dest, &clen, nullptr));
+      RETURN_ON_ERR(CopyRawLen(dest, &uncompressed_len, nullptr));
+      return CopyRawBytes(clen, dest);
+    }
+    default:
+      LOG(ERROR) << "Unknown RDB string encoding " << len;
+      return RdbError(errc::rdb_file_corrupted);
+  }
+}
+
+error_code RdbLoaderBase::CopyRawLen(string* dest, uint64_t* len, bool* is_encoded) {
+  // See LoadLen.
+  RETURN_ON_ERR(EnsureRead(9));
+
+  auto bytes = mem_buf_->InputBuffer();
+  PackedUIntMeta meta{bytes[0]};
+  SET_OR_RETURN(ReadPackedUInt(meta, bytes.subspan(1)), *len);
+  if (is_encoded)
+    *is_encoded = meta.Type() == RDB_ENCVAL;
+
+  size_t size = 1 + meta.ByteSize();
+  dest->append(reinterpret_cast<const char*>(bytes.data()), size);
+  mem_buf_->ConsumeInput(size);
+  return kOk;
+}
+
+error_code RdbLoaderBase::CopyRawBytes(size_t len, string* dest) {
+  size_t pos = dest->size();
+  dest->resize(pos + len);
+  return FetchBuf(len, dest->data() + pos);
+}
+
 error_code RdbLoaderBase::ReadStringObj(RdbVariant* dest) {
   bool isencoded;
   size_t len;
@@ -1500,13 +1786,25 @@ auto RdbLoaderBase::ReadLzf() -> io::Result<LzfString> {
   return res;
 }
 
+size_t RdbLoaderBase::NextChunkLen(size_t len, unsigned increment) {
+  size_t n = len;
+  if (chunked_)
+    n = std::min(len, kMaxChunkElements * increment);
+  pending_read_.remaining = len - n;
+  return n;
+}
+
 auto RdbLoaderBase::ReadSet(int rdbtype) -> io::Result<OpaqueObj> {
   size_t len;
-  SET_OR_UNEXPECT(LoadLen(NULL), len);
-
-  if (rdbtype == RDB_TYPE_SET_WITH_EXPIRY) {
-    len *= 2;
+  unsigned increment = rdbtype == RDB_TYPE_SET_WITH_EXPIRY ? 2 : 1;
+  if (pending_read_.remaining > 0) {
+    len = pending_read_.remaining;
+  } else {
+    SET_OR_UNEXPECT(LoadLen(NULL), len);
+    len *= increment;
+    pending_read_.reserve = len;
   }
+  len = NextChunkLen(len, increment);
 
   unique_ptr<LoadTrace> load_trace(new LoadTrace);
   load_trace->arr.resize((len + kMaxBlobLen - 1) / kMaxBlobLen);
@@ -1562,16 +1860,22 @@ auto RdbLoaderBase::ReadGeneric(int rdbtype) -> io::Result<OpaqueObj> {
 
 auto RdbLoaderBase::ReadHMap(int rdbtype) -> io::Result<OpaqueObj> {
   size_t len;
-  SET_OR_UNEXPECT(LoadLen(nullptr), len);
-
-  unique_ptr<LoadTrace> load_trace(new LoadTrace);
+  unsigned increment = 2;
+  if (rdbtype != RDB_TYPE_HASH) {
+    DCHECK_EQ(rdbtype, RDB_TYPE_HASH_WITH_EXPIRY);
+    increment = 3;
+  }
 
-  if (rdbtype == RDB_TYPE_HASH) {
-    len *= 2;
+  if (pending_read_.remaining > 0) {
+    len = pending_read_.remaining;
   } else {
-    DCHECK_EQ(rdbtype, RDB_TYPE_HASH_WITH_EXPIRY);
-    len *= 3;
+    SET_OR_UNEXPECT(LoadLen(nullptr), len);
+    len *= increment;
+    pending_read_.reserve = len;
   }
+  len = NextChunkLen(len, increment);
+
+  unique_ptr<LoadTrace> load_trace(new LoadTrace);
 
   load_trace->arr.resize((len + kMaxBlobLen - 1) / kMaxBlobLen);
   for (size_t i = 0; i < load_trace->arr.size(); ++i) {
@@ -1591,10 +1895,15 @@ auto RdbLoaderBase::ReadHMap(int rdbtype) -> io::Result<OpaqueObj> {
 auto RdbLoaderBase::ReadZSet(int rdbtype) -> io::Result<OpaqueObj> {
   /* Read sorted set value. */
   uint64_t zsetlen;
-  SET_OR_UNEXPECT(LoadLen(nullptr), zsetlen);
-
-  if (zsetlen == 0)
-    return Unexpected(errc::empty_key);
+  if (pending_read_.remaining > 0) {
+    zsetlen = pending_read_.remaining;
+  } else {
+    SET_OR_UNEXPECT(LoadLen(nullptr), zsetlen);
+    if (zsetlen == 0)
+      return Unexpected(errc::empty_key);
+    pending_read_.reserve = zsetlen;
+  }
+  zsetlen = NextChunkLen(zsetlen, 1);
 
   unique_ptr<LoadTrace> load_trace(new LoadTrace);
   load_trace->arr.resize((zsetlen + kMaxBlobLen - 1) / kMaxBlobLen);
@@ -1641,10 +1950,15 @@ auto RdbLoaderBase::ReadZSetZL() -> io::Result<OpaqueObj> {
 
 auto RdbLoaderBase::ReadListQuicklist(int rdbtype) -> io::Result<OpaqueObj> {
   uint64_t len;
-  SET_OR_UNEXPECT(LoadLen(nullptr), len);
-
-  if (len == 0)
-    return Unexpected(errc::empty_key);
+  if (pending_read_.remaining > 0) {
+    len = pending_read_.remaining;
+  } else {
+    SET_OR_UNEXPECT(LoadLen(nullptr), len);
+    if (len == 0)
+      return Unexpected(errc::empty_key);
+    pending_read_.reserve = len;
+  }
+  len = NextChunkLen(len, 1);
 
   unique_ptr<LoadTrace> load_trace(new LoadTrace);
   load_trace->arr.resize((len + kMaxBlobLen - 1) / kMaxBlobLen);
@@ -1836,6 +2150,16 @@ auto RdbLoaderBase::ReadJson() -> io::Result<OpaqueObj> {
   return OpaqueObj{std::move(dest), RDB_TYPE_JSON};
 }
 
+auto RdbLoaderBase::ReadTieredRef() -> io::Result<OpaqueObj> {
+  TieredRef ref;
+  SET_OR_UNEXPECT(LoadLen(nullptr), ref.shard_id);
+  SET_OR_UNEXPECT(FetchInt<uint64_t>(), ref.generation);
+  SET_OR_UNEXPECT(LoadLen(nullptr), ref.obj_type);
+  SET_OR_UNEXPECT(LoadLen(nullptr), ref.offset);
+  SET_OR_UNEXPECT(LoadLen(nullptr), ref.size);
+  return OpaqueObj{ref, RDB_TYPE_TIERED_REF};
+}
+
 template <typename T> io::Result<T> RdbLoaderBase::FetchInt() {
   auto ec = EnsureRead(sizeof(T));
   if (ec)
@@ -1878,6 +2202,8 @@ struct RdbLoader::ObjSettings {
 RdbLoader::RdbLoader(Service* service)
     : service_{service}, script_mgr_{service == nullptr ? nullptr : service->script_mgr()} {
   shard_buf_.reset(new ItemsBuf[shard_set->size()]);
+  parallel_decode_ = GetFlag(FLAGS_rdb_parallel_decode);
+  chunked_ = true;
 }
 
 RdbLoader::~RdbLoader() {
@@ -2005,6 +2331,38 @@ error_code RdbLoader::Load(io::Source* src) {
       continue;
     }
 
+    if (type == RDB_OPCODE_SEARCH_INDICES) {
+      uint64_t shard_id, shard_count;
+      string data;
+      SET_OR_RETURN(LoadLen(nullptr), shard_id);
+      SET_OR_RETURN(LoadLen(nullptr), shard_count);
+      SET_OR_RETURN(FetchGenericString(), data);
+
+      // Documents are assigned to shards by key, so the indices are usable only if the number
+      // of shards is the same. Otherwise they are rebuilt after loading.
+      if (shard_count == shard_set->size() && shard_id < shard_count) {
+        shard_set->Add(shard_id, [data = std::move(data)]() mutable {
+          EngineShard::tlocal()->search_indices()->SetSerializedIndices(std::move(data));
+        });
+      } else {
+        LOG(WARNING) << "Ignoring search indices serialized with " << shard_count << " shards";
+      }
+      continue;
+    }
+
+    if (type == RDB_OPCODE_DELETED_KEY) {
+      RETURN_ON_ERR(LoadDeletedKey());
+      continue;
+    }
+
+    if (type == RDB_OPCODE_COMPRESSION_DICT) {
+      string dict;
+      SET_OR_RETURN(FetchGenericString(), dict);
+      AllocateDecompressOnce(RDB_OPCODE_COMPRESSED_ZSTD_BLOB_START);
+      RETURN_ON_ERR(decompress_impl_->LoadDictionary(dict));
+      continue;
+    }
+
     if (type == RDB_OPCODE_SELECTDB) {
       unsigned dbid = 0;
 
@@ -2272,7 +2630,7 @@ error_code RdbLoader::HandleAux() {
   } else if (auxkey == "repl-stream-db") {
     // TODO
   } else if (auxkey == "repl-id") {
-    // TODO
+    repl_id_ = std::move(auxval);
   } else if (auxkey == "repl-offset") {
     // TODO
   } else if (auxkey == "lua") {
@@ -2301,6 +2659,17 @@ error_code RdbLoader::HandleAux() {
     /* Just ignored. */
   } else if (auxkey == "search-index") {
     LoadSearchIndexDefFromAux(std::move(auxval));
+  } else if (auxkey == "snapshot-delta") {
+    is_delta_ = true;
+  } else if (auxkey == "journal-lsn") {
+    uint32_t sid;
+    LSN lsn;
+    if (pair<string_view, string_view> pos = absl::StrSplit(auxval, ':');
+        absl::SimpleAtoi(pos.first, &sid) && absl::SimpleAtoi(pos.second, &lsn)) {
+      shard_lsn_.emplace(sid, lsn);
+    } else {
+      LOG(WARNING) << "Invalid journal-lsn: " << auxval;
+    }
   } else {
     /* We ignore fields we don't understand, as by AUX field
      * contract. */
@@ -2340,7 +2709,12 @@ void RdbLoader::FlushAllShards() {
 }
 
 std::error_code RdbLoaderBase::FromOpaque(const OpaqueObj& opaque, CompactObj* pv) {
-  OpaqueObjLoader visitor(opaque.rdb_type, pv);
+  return FromOpaque(opaque, LoadConfig{}, pv);
+}
+
+std::error_code RdbLoaderBase::FromOpaque(const OpaqueObj& opaque, LoadConfig config,
+                                          CompactObj* pv) {
+  OpaqueObjLoader visitor(opaque.rdb_type, pv, config);
   std::visit(visitor, opaque.obj);
 
   return visitor.ec();
@@ -2349,17 +2723,72 @@ std::error_code RdbLoaderBase::FromOpaque(const OpaqueObj& opaque, CompactObj* p
 void RdbLoader::LoadItemsBuffer(DbIndex db_ind, const ItemsBuf& ib) {
   DbSlice& db_slice = EngineShard::tlocal()->db_slice();
   DbContext db_cntx{.db_index = db_ind, .time_now_ms = GetCurrentTimeMs()};
+  optional<RdbValueLoader> raw_loader;
+
+  auto delete_key = [&](string_view key) {
+    if (auto res = db_slice.FindMutable(db_cntx, key); IsValid(res.it)) {
+      res.post_updater.Run();
+      db_slice.Del(db_ind, res.it);
+    }
+  };
+
+  for (auto* item : ib) {
+    if (item->is_deleted) {
+      delete_key(item->key);
+      continue;
+    }
+
+    if (item->load_config.append) {
+      // The next chunk of a big value, the key is missing if its first chunk was skipped.
+      if (auto res = db_slice.FindMutable(db_cntx, item->key); IsValid(res.it)) {
+        ec_ = FromOpaque(item->val, item->load_config, &res.it->second);
+        res.post_updater.Run();
+      }
+      if (!item->load_config.pending)
+        tl_partial_keys.erase(pair{db_ind, item->key});
+      if (ec_) {
+        LOG(ERROR) << "Could not load value for key '" << item->key << "' in DB " << db_ind;
+        stop_early_ = true;
+        break;
+      }
+      continue;
+    }
 
-  for (const auto* item : ib) {
     PrimeValue pv;
-    if (ec_ = FromOpaque(item->val, &pv); ec_) {
+    bool tiered_ref = item->val.rdb_type == RDB_TYPE_TIERED_REF;
+    if (tiered_ref) {
+      // Restored below once the key is known to be added, so that it owns the disk space.
+    } else if (!item->raw.empty()) {
+      if (!raw_loader)
+        raw_loader.emplace();
+      ec_ = raw_loader->LoadRaw(item->val.rdb_type, item->raw, &pv);
+      if (item->raw.capacity() > kMaxRetainedRawLen)
+        string{}.swap(item->raw);
+    } else {
+      ec_ = FromOpaque(item->val, item->load_config, &pv);
+    }
+
+    if (ec_) {
       LOG(ERROR) << "Could not load value for key '" << item->key << "' in DB " << db_ind;
       stop_early_ = true;
       break;
     }
 
-    if (item->expire_ms > 0 && db_cntx.time_now_ms >= item->expire_ms)
+    if (item->expire_ms > 0 && db_cntx.time_now_ms >= item->expire_ms) {
+      if (is_delta_)  // the key expired since the base was saved.
+        delete_key(item->key);
       continue;
+    }
+
+    if (tiered_ref) {
+      ec_ = RestoreTieredRef(db_ind, item->val, &pv);
+      if (ec_) {
+        LOG(ERROR) << "Could not restore external value for key '" << item->key << "' in DB "
+                   << db_ind;
+        stop_early_ = true;
+        break;
+      }
+    }
 
     auto op_res = db_slice.AddOrUpdate(db_cntx, item->key, std::move(pv), item->expire_ms);
     if (!op_res) {
@@ -2370,8 +2799,11 @@ void RdbLoader::LoadItemsBuffer(DbIndex db_ind, const ItemsBuf& ib) {
     }
 
     auto& res = *op_res;
+    if (item->load_config.pending)
+      tl_partial_keys.emplace(db_ind, item->key);
     res.it->first.SetSticky(item->is_sticky);
-    if (!res.is_new) {
+    db_slice.TrackExpiringFields(db_ind, item->key, res.it->second);
+    if (!res.is_new && !is_delta_) {
       LOG(WARNING) << "RDB has duplicated key '" << item->key << "' in DB " << db_ind;
     }
   }
@@ -2381,53 +2813,119 @@ void RdbLoader::LoadItemsBuffer(DbIndex db_ind, const ItemsBuf& ib) {
   }
 }
 
+error_code RdbLoader::RestoreTieredRef(DbIndex db_ind, const OpaqueObj& opaque, CompactObj* pv) {
+  const TieredRef& ref = get<TieredRef>(opaque.obj);
+  EngineShard* shard = EngineShard::tlocal();
+  TieredStorage* tiered = shard->tiered_storage();
+
+  // The key belongs to the same shard only if the number of shards did not change.
+  if (!tiered || !tiered->persistent() || ref.shard_id != shard->shard_id()) {
+    LOG(ERROR) << "The snapshot refers to the tiered storage of shard " << ref.shard_id
+               << ", which requires --tiered_persistent and the same number of shards";
+    return RdbError(errc::feature_not_supported);
+  }
+  return tiered->RestoreExternal(db_ind, ref.generation, ref.offset, ref.size, ref.obj_type, pv);
+}
+
 void RdbLoader::ResizeDb(size_t key_num, size_t expire_num) {
-  DCHECK_LT(key_num, 1U << 31);
-  DCHECK_LT(expire_num, 1U << 31);
-  // Note: To reserve space, it's necessary to allocate space at the shard level. We might
-  // load with different number of shards which makes database resizing unfeasible.
+  // The keys are spread evenly over the shards by their hash, whatever the number of shards of
+  // the server that saved them.
+  size_t shard_keys = key_num / shard_set->size();
+  size_t shard_expires = expire_num / shard_set->size();
+  DbIndex dbid = cur_db_index_;
+  VLOG(1) << "Reserving " << shard_keys << " keys per shard for db " << dbid;
+  shard_set->RunBriefInParallel([&](EngineShard* es) {
+    es->db_slice().Reserve(dbid, shard_keys, shard_expires);
+  });
 }
 
 error_code RdbLoader::LoadKeyValPair(int type, ObjSettings* settings) {
-  // We return the item in LoadItemsBuffer.
-  Item* item = item_queue_.Pop();
+  string key;
+  SET_OR_RETURN(ReadKey(), key);
+
+  // Big containers are read in chunks that are applied to the key one after another, so that
+  // the whole value does not need to be read into memory first.
+  bool append = false;
+  do {
+    // We return the item in LoadItemsBuffer.
+    Item* item = item_queue_.Pop();
 
-  if (item == nullptr) {
-    item = new Item;
-  }
-  auto cleanup = absl::Cleanup([item] { delete item; });
+    if (item == nullptr) {
+      item = new Item;
+    }
+    auto cleanup = absl::Cleanup([item] { delete item; });
 
-  // Read key
-  SET_OR_RETURN(ReadKey(), item->key);
+    item->key = key;
 
-  // Read value
-  error_code ec = ReadObj(type, &item->val);
-  if (ec) {
-    VLOG(1) << "ReadObj error " << ec << " for key " << item->key;
-    return ec;
-  }
+    // Read value
+    error_code ec;
+    item->is_deleted = false;
+    item->raw.clear();
+    if (parallel_decode_ && CanCopyRawObj(type)) {
+      item->val = OpaqueObj{RdbVariant{}, type};
+      ec = CopyRawObj(type, &item->raw);
+    } else {
+      ec = ReadObj(type, &item->val);
+    }
+    if (ec) {
+      VLOG(1) << "ReadObj error " << ec << " for key " << key;
+      return ec;
+    }
 
-  /* Check if the key already expired. This function is used when loading
-   * an RDB file from disk, either at startup, or when an RDB was
-   * received from the master. In the latter case, the master is
-   * responsible for key expiry. If we would expire keys here, the
-   * snapshot taken by the master may not be reflected on the slave.
-   * Similarly if the RDB is the preamble of an AOF file, we want to
-   * load all the keys as they are, since the log of operations later
-   * assume to work in an exact keyspace state. */
+    item->load_config = LoadConfig{};
+    if (append || pending_read_.remaining > 0)
+      item->load_config = LoadConfig{.reserve = pending_read_.reserve,
+                                     .append = append,
+                                     .pending = pending_read_.remaining > 0};
+    append = true;
 
-  if (ServerState::tlocal()->is_master && settings->has_expired) {
-    VLOG(2) << "Expire key: " << item->key;
-    return kOk;
+    /* Check if the key already expired. This function is used when loading
+     * an RDB file from disk, either at startup, or when an RDB was
+     * received from the master. In the latter case, the master is
+     * responsible for key expiry. If we would expire keys here, the
+     * snapshot taken by the master may not be reflected on the slave.
+     * Similarly if the RDB is the preamble of an AOF file, we want to
+     * load all the keys as they are, since the log of operations later
+     * assume to work in an exact keyspace state. */
+
+    if (ServerState::tlocal()->is_master && settings->has_expired) {
+      VLOG(2) << "Expire key: " << key;
+      if (!is_delta_ || item->load_config.append)
+        continue;
+      item->is_deleted = true;  // the key may be loaded from the base.
+    }
+
+    item->is_sticky = settings->is_sticky;
+
+    ShardId sid = Shard(key, shard_set->size());
+    item->expire_ms = settings->expiretime;
+
+    auto& out_buf = shard_buf_[sid];
+
+    out_buf.emplace_back(item);
+    std::move(cleanup).Cancel();
+
+    constexpr size_t kBufSize = 128;
+    if (out_buf.size() >= kBufSize) {
+      FlushShardAsync(sid);
+    }
+  } while (pending_read_.remaining > 0);
+
+  return kOk;
+}
+
+error_code RdbLoader::LoadDeletedKey() {
+  Item* item = item_queue_.Pop();
+  if (item == nullptr) {
+    item = new Item;
   }
+  auto cleanup = absl::Cleanup([item] { delete item; });
 
-  item->is_sticky = settings->is_sticky;
+  SET_OR_RETURN(ReadKey(), item->key);
+  item->is_deleted = true;
 
   ShardId sid = Shard(item->key, shard_set->size());
-  item->expire_ms = settings->expiretime;
-
   auto& out_buf = shard_buf_[sid];
-
   out_buf.emplace_back(item);
   std::move(cleanup).Cancel();
 
@@ -2489,6 +2987,9 @@ void RdbLoader::LoadSearchIndexDefFromAux(string&& def) {
 }
 
 void RdbLoader::PerformPreLoad(Service* service) {
+  // Partial keys of a load that failed.
+  shard_set->RunBriefInParallel([](EngineShard*) { tl_partial_keys.clear(); });
+
   const CommandId* cmd = service->FindCmd("FT.DROPINDEX");
   if (cmd == nullptr)
     return;  // MacOS
@@ -2496,18 +2997,58 @@ void RdbLoader::PerformPreLoad(Service* service) {
   shard_set->AwaitRunningOnShardQueue([](EngineShard* es) {
     for (const auto& name : es->search_indices()->GetIndexNames())
       es->search_indices()->DropIndex(name);
+    es->search_indices()->SetSerializedIndices({});
   });
 }
 
+bool RdbLoader::IsKeyPartial(DbIndex db_ind, string_view key) {
+  return !tl_partial_keys.empty() && tl_partial_keys.contains(pair{db_ind, string{key}});
+}
+
 void RdbLoader::PerformPostLoad(Service* service) {
   const CommandId* cmd = service->FindCmd("FT.CREATE");
   if (cmd == nullptr)  // On MacOS we don't include search so FT.CREATE won't exist.
     return;
 
-  // Rebuild all search indices as only their definitions are extracted from the snapshot
+  // Rebuild all search indices as only their definitions are extracted from the snapshot, or
+  // restore them if the snapshot contains their serialized contents
   shard_set->AwaitRunningOnShardQueue([](EngineShard* es) {
     es->search_indices()->RebuildAllIndices(OpArgs{es, nullptr, DbContext{0, GetCurrentTimeMs()}});
   });
 }
 
+error_code RdbValueLoader::Load(string_view payload, CompactObj* pv) {
+  io::BytesSource source{io::Buffer(payload)};
+  src_ = &source;
+
+  io::Result<uint8_t> type_id = FetchType();
+  if (!type_id)
+    return type_id.error();
+
+  if (!rdbIsObjectTypeDF(*type_id))
+    return RdbError(errc::invalid_rdb_type);
+
+  OpaqueObj obj;
+  if (error_code ec = ReadObj(*type_id, &obj); ec)
+    return ec;
+
+  return FromOpaque(obj, pv);
+}
+
+error_code RdbValueLoader::LoadRaw(int rdbtype, string_view payload, CompactObj* pv) {
+  // Drops the padding of the previous value.
+  mem_buf_->ConsumeInput(mem_buf_->InputLen());
+  bytes_read_ = 0;
+
+  io::BytesSource source{io::Buffer(payload)};
+  src_ = &source;
+  absl::Cleanup reset_src = [this] { src_ = nullptr; };
+
+  OpaqueObj obj;
+  if (error_code ec = ReadObj(rdbtype, &obj); ec)
+    return ec;
+
+  return FromOpaque(obj, pv);
+}
+
 }  // namespace dfly
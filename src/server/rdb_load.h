@@ -41,8 +41,17 @@ class RdbLoaderBase {
     uint64_t uncompressed_len;
   };
 
-  using RdbVariant =
-      std::variant<long long, base::PODArray<char>, LzfString, std::unique_ptr<LoadTrace>>;
+  // The location of an external value, see RDB_TYPE_TIERED_REF.
+  struct TieredRef {
+    uint64_t generation;
+    uint64_t offset;
+    uint64_t size;
+    ShardId shard_id;
+    uint8_t obj_type;
+  };
+
+  using RdbVariant = std::variant<long long, base::PODArray<char>, LzfString,
+                                  std::unique_ptr<LoadTrace>, TieredRef>;
 
   struct OpaqueObj {
     RdbVariant obj;
@@ -99,6 +108,13 @@ class RdbLoaderBase {
     }
   };
 
+  // How the blobs of a value that is read in chunks are loaded, see pending_read_.
+  struct LoadConfig {
+    size_t reserve = 0;    // the number of blobs of the whole value, 0 if it is read at once.
+    bool append = false;   // whether the blobs are added to the existing value of the key.
+    bool pending = false;  // whether more blobs of the value follow.
+  };
+
   class OpaqueObjLoader;
 
   io::Result<uint8_t> FetchType();
@@ -106,6 +122,7 @@ class RdbLoaderBase {
   template <typename T> io::Result<T> FetchInt();
 
   static std::error_code FromOpaque(const OpaqueObj& opaque, CompactObj* pv);
+  static std::error_code FromOpaque(const OpaqueObj& opaque, LoadConfig config, CompactObj* pv);
 
   io::Result<uint64_t> LoadLen(bool* is_encoded);
   std::error_code FetchBuf(size_t size, void* dest);
@@ -120,10 +137,29 @@ class RdbLoaderBase {
   ::io::Result<std::string> ReadKey();
 
   std::error_code ReadObj(int rdbtype, OpaqueObj* dest);
+
+  // True if objects of rdbtype can be copied by CopyRawObj.
+  bool CanCopyRawObj(int rdbtype) const;
+
+  // Appends the serialized object of rdbtype to dest without decoding it, so that it can be
+  // decoded by another thread with RdbValueLoader::LoadRaw. The copy only walks the lengths
+  // of the object, which is much cheaper than ReadObj. dest is padded with kRawObjPadding
+  // zero bytes because reads of lengths look ahead.
+  std::error_code CopyRawObj(int rdbtype, std::string* dest);
+  std::error_code CopyRawString(std::string* dest);
+  std::error_code CopyRawLen(std::string* dest, uint64_t* len, bool* is_encoded);
+  std::error_code CopyRawBytes(size_t len, std::string* dest);
+
+  static constexpr size_t kRawObjPadding = 9;
   std::error_code ReadStringObj(RdbVariant* rdb_variant);
   ::io::Result<long long> ReadIntObj(int encoding);
   ::io::Result<LzfString> ReadLzf();
 
+  // Returns how many of the len remaining blobs of a container to read now. The rest is left
+  // in pending_read_ when the loader reads big containers in chunks. increment is the number
+  // of blobs per element.
+  size_t NextChunkLen(size_t len, unsigned increment);
+
   ::io::Result<OpaqueObj> ReadSet(int rdbtype);
   ::io::Result<OpaqueObj> ReadIntSet();
   ::io::Result<OpaqueObj> ReadGeneric(int rdbtype);
@@ -133,6 +169,7 @@ class RdbLoaderBase {
   ::io::Result<OpaqueObj> ReadListQuicklist(int rdbtype);
   ::io::Result<OpaqueObj> ReadStreams();
   ::io::Result<OpaqueObj> ReadJson();
+  ::io::Result<OpaqueObj> ReadTieredRef();
 
   std::error_code HandleCompressedBlob(int op_type);
   std::error_code HandleCompressedBlobFinish();
@@ -157,6 +194,14 @@ class RdbLoaderBase {
   JournalReader journal_reader_{nullptr, 0};
   std::optional<uint64_t> journal_offset_ = std::nullopt;
   int rdb_version_ = RDB_VERSION;
+
+  // Set by RdbLoader, so that sets, hashes, sorted sets and lists with more than
+  // kMaxChunkElements elements are read by several ReadObj calls.
+  bool chunked_ = false;
+  struct {
+    size_t remaining = 0;  // blobs of the current value that were not read yet.
+    size_t reserve = 0;    // blobs of the whole current value.
+  } pending_read_;
 };
 
 class RdbLoader : protected RdbLoaderBase {
@@ -193,6 +238,21 @@ class RdbLoader : protected RdbLoaderBase {
     return journal_offset_;
   }
 
+  // The id of the master and the position of the shard journal a snapshot file was taken at,
+  // if it saved them. See RdbSaver::StartSnapshotInShard.
+  const std::string& repl_id() const {
+    return repl_id_;
+  }
+
+  std::optional<std::pair<ShardId, LSN>> shard_lsn() const {
+    return shard_lsn_;
+  }
+
+  // For the journal entries of a master with the compact journal encoding.
+  void SetJournalCommandTable(const JournalCommandTable* table) {
+    journal_reader_.SetCommandTable(table);
+  }
+
   // Set callback for receiving RDB_OPCODE_FULLSYNC_END.
   // This opcode is used by a master instance to notify it finished streaming static data
   // and is ready to switch to stable state sync.
@@ -207,13 +267,20 @@ class RdbLoader : protected RdbLoaderBase {
   // Called once immediately after loading the snapshot / full sync succeeded from the coordinator.
   static void PerformPostLoad(Service* service);
 
+  // Whether the value of the key is visible, but some of its chunks are not loaded yet.
+  // Must be called from the shard thread of the key.
+  static bool IsKeyPartial(DbIndex db_ind, std::string_view key);
+
  private:
   struct Item {
     std::string key;
     OpaqueObj val;
+    std::string raw;  // if not empty, the value copied by CopyRawObj, decoded by the shard.
     uint64_t expire_ms;
     std::atomic<Item*> next;
     bool is_sticky = false;
+    bool is_deleted = false;  // a tombstone of a delta snapshot, the key is deleted.
+    LoadConfig load_config;
 
     friend void MPSC_intrusive_store_next(Item* dest, Item* nxt) {
       dest->next.store(nxt, std::memory_order_release);
@@ -229,6 +296,7 @@ class RdbLoader : protected RdbLoaderBase {
   struct ObjSettings;
 
   std::error_code LoadKeyValPair(int type, ObjSettings* settings);
+  std::error_code LoadDeletedKey();
   void ResizeDb(size_t key_num, size_t expire_num);
   std::error_code HandleAux();
 
@@ -241,6 +309,9 @@ class RdbLoader : protected RdbLoaderBase {
 
   void LoadItemsBuffer(DbIndex db_ind, const ItemsBuf& ib);
 
+  // Maps the external value of a TieredRef back to the backing file of the shard.
+  std::error_code RestoreTieredRef(DbIndex db_ind, const OpaqueObj& opaque, CompactObj* pv);
+
   void LoadScriptFromAux(std::string&& value);
 
   // Load index definition from RESP string describing it in FT.CREATE format,
@@ -251,6 +322,10 @@ class RdbLoader : protected RdbLoaderBase {
   Service* service_;
   ScriptMgr* script_mgr_;
   std::unique_ptr<ItemsBuf[]> shard_buf_;
+  bool parallel_decode_;
+  bool is_delta_ = false;  // whether the file is a delta snapshot that overrides loaded keys.
+  std::string repl_id_;
+  std::optional<std::pair<ShardId, LSN>> shard_lsn_;
 
   size_t keys_loaded_ = 0;
   double load_time_ = 0;
@@ -266,4 +341,15 @@ class RdbLoader : protected RdbLoaderBase {
   detail::MPSCIntrusiveQueue<Item> item_queue_;
 };
 
+// Loads a single value that was serialized by SerializerBase::DumpObject. An instance should
+// not be reused for Load, since it buffers the input beyond the value. LoadRaw can be called
+// repeatedly.
+class RdbValueLoader : protected RdbLoaderBase {
+ public:
+  std::error_code Load(std::string_view payload, CompactObj* pv);
+
+  // Loads a value of rdbtype copied by RdbLoaderBase::CopyRawObj.
+  std::error_code LoadRaw(int rdbtype, std::string_view payload, CompactObj* pv);
+};
+
 }  // namespace dfly
@@ -8,6 +8,7 @@
 #include <absl/strings/str_cat.h>
 #include <absl/strings/str_format.h>
 #include <lz4frame.h>
+#include <zdict.h>
 #include <zstd.h>
 
 #include <jsoncons/json.hpp>
@@ -27,12 +28,14 @@ extern "C" {
 
 #include "base/flags.h"
 #include "base/logging.h"
+#include "core/compact_string_set.h"
 #include "core/json_object.h"
 #include "core/sorted_map.h"
 #include "core/string_map.h"
 #include "core/string_set.h"
 #include "server/engine_shard_set.h"
 #include "server/error.h"
+#include "server/journal/journal.h"
 #include "server/main_service.h"
 #include "server/rdb_extensions.h"
 #include "server/search/doc_index.h"
@@ -46,6 +49,12 @@ ABSL_FLAG(dfly::CompressionMode, compression_mode, dfly::CompressionMode::MULTI_
           "set 2 for multi entry zstd compression on df snapshot and single entry on rdb snapshot,"
           "set 3 for multi entry lz4 compression on df snapshot and single entry on rdb snapshot");
 ABSL_FLAG(int, compression_level, 2, "The compression level to use on zstd/lz4 compression");
+ABSL_FLAG(uint32_t, compression_dict_size, 0,
+          "If positive, dfs snapshots compressed with zstd train a dictionary of up to this many "
+          "bytes from a sample of the entries of every shard at the snapshot start");
+ABSL_FLAG(uint64_t, serialization_max_chunk_size, 0,
+          "If positive, big containers are flushed by the snapshot in chunks of about this many "
+          "bytes instead of being serialized into a single buffer. 0 disables chunking");
 
 namespace dfly {
 
@@ -108,6 +117,20 @@ unsigned TryIntegerEncoding(string_view input, uint8_t* dest) {
 constexpr size_t kBufLen = 64_KB;
 constexpr size_t kAmask = 4_KB - 1;
 
+// The listpack types of the values that RdbObjectType saves as ziplists, see
+// RdbSerializer::SaveNativeEncodings.
+uint8_t NativeObjectType(uint8_t rdb_type) {
+  switch (rdb_type) {
+    case RDB_TYPE_ZSET_ZIPLIST:
+      return RDB_TYPE_ZSET_LISTPACK;
+    case RDB_TYPE_HASH_ZIPLIST:
+      return RDB_TYPE_HASH_LISTPACK;
+    case RDB_TYPE_LIST_QUICKLIST:
+      return RDB_TYPE_LIST_QUICKLIST_2;
+  }
+  return rdb_type;
+}
+
 }  // namespace
 
 bool AbslParseFlag(std::string_view in, dfly::CompressionMode* flag, std::string* err) {
@@ -164,6 +187,8 @@ uint8_t RdbObjectType(const PrimeValue& pv) {
     case OBJ_SET:
       if (compact_enc == kEncodingIntSet)
         return RDB_TYPE_SET_INTSET;
+      else if (compact_enc == kEncodingCompactSet)
+        return RDB_TYPE_SET;
       else if (compact_enc == kEncodingStrMap || compact_enc == kEncodingStrMap2) {
         if (((StringSet*)pv.RObjPtr())->ExpirationUsed())
           return RDB_TYPE_SET_WITH_EXPIRY;
@@ -210,6 +235,11 @@ class CompressorImpl {
   }
   virtual io::Result<io::Bytes> Compress(io::Bytes data) = 0;
 
+  // Compresses the next blobs with the dictionary, ignored by the compressors without
+  // dictionaries.
+  virtual void SetDictionary(std::string_view dict) {
+  }
+
  protected:
   int compression_level_ = 1;
   size_t compressed_size_total_ = 0;
@@ -223,13 +253,20 @@ class ZstdCompressor : public CompressorImpl {
     cctx_ = ZSTD_createCCtx();
   }
   ~ZstdCompressor() {
+    ZSTD_freeCDict(cdict_);
     ZSTD_freeCCtx(cctx_);
   }
 
   io::Result<io::Bytes> Compress(io::Bytes data);
 
+  void SetDictionary(std::string_view dict) final {
+    ZSTD_freeCDict(cdict_);
+    cdict_ = ZSTD_createCDict(dict.data(), dict.size(), compression_level_);
+  }
+
  private:
   ZSTD_CCtx* cctx_;
+  ZSTD_CDict* cdict_ = nullptr;
   base::PODArray<uint8_t> compr_buf_;
 };
 
@@ -238,8 +275,14 @@ io::Result<io::Bytes> ZstdCompressor::Compress(io::Bytes data) {
   if (compr_buf_.capacity() < buf_size) {
     compr_buf_.reserve(buf_size);
   }
-  size_t compressed_size = ZSTD_compressCCtx(cctx_, compr_buf_.data(), compr_buf_.capacity(),
-                                             data.data(), data.size(), compression_level_);
+  size_t compressed_size;
+  if (cdict_) {
+    compressed_size = ZSTD_compress_usingCDict(cctx_, compr_buf_.data(), compr_buf_.capacity(),
+                                               data.data(), data.size(), cdict_);
+  } else {
+    compressed_size = ZSTD_compressCCtx(cctx_, compr_buf_.data(), compr_buf_.capacity(),
+                                        data.data(), data.size(), compression_level_);
+  }
 
   if (ZSTD_isError(compressed_size)) {
     return make_unexpected(error_code{int(compressed_size), generic_category()});
@@ -286,7 +329,9 @@ SerializerBase::SerializerBase(CompressionMode compression_mode)
     : compression_mode_(compression_mode), mem_buf_{4_KB}, tmp_buf_(nullptr) {
 }
 
-RdbSerializer::RdbSerializer(CompressionMode compression_mode) : SerializerBase(compression_mode) {
+RdbSerializer::RdbSerializer(CompressionMode compression_mode, FlushFun flush_fun)
+    : SerializerBase(compression_mode), flush_fun_(std::move(flush_fun)) {
+  max_chunk_size_ = absl::GetFlag(FLAGS_serialization_max_chunk_size);
 }
 
 RdbSerializer::~RdbSerializer() {
@@ -349,7 +394,10 @@ io::Result<uint8_t> RdbSerializer::SaveEntry(const PrimeKey& pk, const PrimeValu
   }
 
   string_view key = pk.GetSlice(&tmp_str_);
-  uint8_t rdb_type = RdbObjectType(pv);
+  bool tiered_ref = tiered_generation_ != 0 && pv.IsExternal();
+  uint8_t rdb_type = tiered_ref ? RDB_TYPE_TIERED_REF : RdbObjectType(pv);
+  if (native_encodings_)
+    rdb_type = NativeObjectType(rdb_type);
 
   DVLOG(3) << ((void*)this) << ": Saving key/val start " << key << " in dbid=" << dbid;
 
@@ -359,11 +407,18 @@ io::Result<uint8_t> RdbSerializer::SaveEntry(const PrimeKey& pk, const PrimeValu
   if (auto ec = SaveString(key); ec)
     return make_unexpected(ec);
 
-  if (auto ec = SaveValue(pv); ec) {
+  if (auto ec = tiered_ref ? SaveTieredRef(pv) : SaveValue(pv); ec) {
     LOG(ERROR) << "Problems saving value for key " << key << " in dbid=" << dbid;
     return make_unexpected(ec);
   }
 
+  // The tail of a chunked value is flushed uncompressed as well, because the loader finds
+  // compressed blobs only between entries.
+  if (flushed_mid_entry_) {
+    flushed_mid_entry_ = false;
+    flush_fun_(SerializedLen());
+  }
+
   return rdb_type;
 }
 
@@ -412,40 +467,37 @@ error_code RdbSerializer::SaveListObject(const robj* obj) {
     DVLOG(3) << "QL node (encoding/container/sz): " << node->encoding << "/" << node->container
              << "/" << node->sz;
 
-    if (QL_NODE_IS_PLAIN(node)) {
-      if (quicklistNodeIsCompressed(node)) {
-        void* data;
-        size_t compress_len = quicklistGetLzf(node, &data);
+    uint8_t* data = node->entry;
+    uint8_t* decompressed = NULL;
 
-        RETURN_ON_ERR(SaveLzfBlob(Bytes{reinterpret_cast<uint8_t*>(data), compress_len}, node->sz));
-      } else {
-        RETURN_ON_ERR(SaveString(node->entry, node->sz));
+    // Nodes are compressed in memory with LZ4, which is not an RDB encoding, so we save them raw.
+    if (quicklistNodeIsCompressed(node)) {
+      decompressed = (uint8_t*)zmalloc(node->sz);
+
+      if (!quicklistDecompressNodeTo(node, decompressed)) {
+        /* Someone requested decompress, but we can't decompress.  Not good. */
+        zfree(decompressed);
+        return make_error_code(errc::illegal_byte_sequence);
       }
+      data = decompressed;
+    }
+
+    auto cleanup = absl::MakeCleanup([=] {
+      if (decompressed)
+        zfree(decompressed);
+    });
+
+    if (native_encodings_)
+      RETURN_ON_ERR(SaveLen(node->container));
+
+    if (QL_NODE_IS_PLAIN(node) || native_encodings_) {
+      RETURN_ON_ERR(SaveString(data, node->sz));
     } else {
       // listpack
-      uint8_t* lp = node->entry;
-      uint8_t* decompressed = NULL;
-
-      if (quicklistNodeIsCompressed(node)) {
-        void* data;
-        size_t compress_len = quicklistGetLzf(node, &data);
-        decompressed = (uint8_t*)zmalloc(node->sz);
-
-        if (lzf_decompress(data, compress_len, decompressed, node->sz) == 0) {
-          /* Someone requested decompress, but we can't decompress.  Not good. */
-          zfree(decompressed);
-          return make_error_code(errc::illegal_byte_sequence);
-        }
-        lp = decompressed;
-      }
-
-      auto cleanup = absl::MakeCleanup([=] {
-        if (decompressed)
-          zfree(decompressed);
-      });
-      RETURN_ON_ERR(SaveListPackAsZiplist(lp));
+      RETURN_ON_ERR(SaveListPackAsZiplist(data));
     }
     node = node->next;
+    FlushIfNeeded();
   }
   return error_code{};
 }
@@ -464,6 +516,7 @@ error_code RdbSerializer::SaveSetObject(const PrimeValue& obj) {
       sds ele = (sds)de->key;
 
       RETURN_ON_ERR(SaveString(string_view{ele, sdslen(ele)}));
+      FlushIfNeeded();
     }
   } else if (obj.Encoding() == kEncodingStrMap2) {
     StringSet* set = (StringSet*)obj.RObjPtr();
@@ -471,13 +524,22 @@ error_code RdbSerializer::SaveSetObject(const PrimeValue& obj) {
     RETURN_ON_ERR(SaveLen(set->SizeSlow()));
 
     for (auto it = set->begin(); it != set->end(); ++it) {
-      RETURN_ON_ERR(SaveString(string_view{*it, sdslen(*it)}));
+      RETURN_ON_ERR(SaveString(*it));
       if (set->ExpirationUsed()) {
         int64_t expiry = -1;
         if (it.HasExpiry())
           expiry = it.ExpiryTime();
         RETURN_ON_ERR(SaveLongLongAsString(expiry));
       }
+      FlushIfNeeded();
+    }
+  } else if (obj.Encoding() == kEncodingCompactSet) {
+    CompactStringSet* set = (CompactStringSet*)obj.RObjPtr();
+
+    RETURN_ON_ERR(SaveLen(set->Size()));
+
+    for (sds ele : *set) {
+      RETURN_ON_ERR(SaveString(string_view{ele, sdslen(ele)}));
     }
   } else {
     CHECK_EQ(obj.Encoding(), kEncodingIntSet);
@@ -508,12 +570,16 @@ error_code RdbSerializer::SaveHSetObject(const PrimeValue& pv) {
           expiry = it.ExpiryTime();
         RETURN_ON_ERR(SaveLongLongAsString(expiry));
       }
+      FlushIfNeeded();
     }
   } else {
     CHECK_EQ(kEncodingListPack, pv.Encoding());
 
     uint8_t* lp = (uint8_t*)pv.RObjPtr();
-    RETURN_ON_ERR(SaveListPackAsZiplist(lp));
+    if (native_encodings_)
+      RETURN_ON_ERR(SaveString(lp, lpBytes(lp)));
+    else
+      RETURN_ON_ERR(SaveListPackAsZiplist(lp));
   }
 
   return error_code{};
@@ -541,12 +607,16 @@ error_code RdbSerializer::SaveZSetObject(const PrimeValue& pv) {
       ec = SaveBinaryDouble(score);
       if (ec)
         return false;
+      FlushIfNeeded();
       return true;
     });
   } else {
     CHECK_EQ(pv.Encoding(), unsigned(OBJ_ENCODING_LISTPACK)) << "Unknown zset encoding";
     uint8_t* lp = (uint8_t*)robj_wrapper->inner_obj();
-    RETURN_ON_ERR(SaveListPackAsZiplist(lp));
+    if (native_encodings_)
+      RETURN_ON_ERR(SaveString(lp, lpBytes(lp)));
+    else
+      RETURN_ON_ERR(SaveListPackAsZiplist(lp));
   }
 
   return error_code{};
@@ -579,6 +649,7 @@ error_code RdbSerializer::SaveStreamObject(const robj* obj) {
       raxStop(&ri);
       return ec;
     }
+    FlushIfNeeded();
   }
   raxStop(&ri);
 
@@ -618,7 +689,7 @@ error_code RdbSerializer::SaveStreamObject(const robj* obj) {
       RETURN_ON_ERR(SaveLen(s->last_id.seq));
 
       /* Save the global PEL. */
-      RETURN_ON_ERR(SaveStreamPEL(cg->pel, true));
+      RETURN_ON_ERR(SaveStreamPEL(cg->pel, nullptr));
 
       /* Save the consumers of this group. */
 
@@ -630,6 +701,13 @@ error_code RdbSerializer::SaveStreamObject(const robj* obj) {
 }
 
 error_code RdbSerializer::SaveJsonObject(const PrimeValue& pv) {
+  if (pv.IsPackedJson()) {
+    optional<string> json_string = PackedJsonToString(pv.GetPackedJson());
+    if (!json_string)
+      return make_error_code(errc::illegal_byte_sequence);
+    return SaveString(*json_string);
+  }
+
   auto json_string = pv.GetJson()->to_string();
   return SaveString(json_string);
 }
@@ -683,28 +761,29 @@ error_code RdbSerializer::SaveListPackAsZiplist(uint8_t* lp) {
   return ec;
 }
 
-error_code RdbSerializer::SaveStreamPEL(rax* pel, bool nacks) {
+// Saves the entries of the group PEL with their NACKs, or only the IDs of the entries of the
+// consumer if it is not null.
+error_code RdbSerializer::SaveStreamPEL(streamPEL* pel, streamConsumer* consumer) {
   /* Number of entries in the PEL. */
 
-  RETURN_ON_ERR(SaveLen(raxSize(pel)));
+  RETURN_ON_ERR(SaveLen(consumer ? consumer->pel_count : pel->size));
 
   /* Save each entry. */
-  raxIterator ri;
-  raxStart(&ri, pel);
-  raxSeek(&ri, "^", NULL, 0);
-  auto cleanup = absl::MakeCleanup([&] { raxStop(&ri); });
+  streamPELIterator it;
+  streamPendingEntry nack;
+  streamPELIteratorStart(&it, pel, nullptr, consumer);
 
-  while (raxNext(&ri)) {
-    /* We store IDs in raw form as 128 big big endian numbers, like
-     * they are inside the radix tree key. */
-    RETURN_ON_ERR(WriteRaw(Bytes{ri.key, sizeof(streamID)}));
+  while (streamPELNext(&it, &nack)) {
+    /* We store IDs in raw form as 128 big big endian numbers. */
+    uint8_t rawid[sizeof(streamID)];
+    streamEncodeID(rawid, &nack.id);
+    RETURN_ON_ERR(WriteRaw(rawid));
 
-    if (nacks) {
-      streamNACK* nack = (streamNACK*)ri.data;
+    if (!consumer) {
       uint8_t buf[8];
-      absl::little_endian::Store64(buf, nack->delivery_time);
+      absl::little_endian::Store64(buf, nack.delivery_time);
       RETURN_ON_ERR(WriteRaw(buf));
-      RETURN_ON_ERR(SaveLen(nack->delivery_count));
+      RETURN_ON_ERR(SaveLen(nack.delivery_count));
 
       /* We don't save the consumer name: we'll save the pending IDs
        * for each consumer in the consumer PEL, and resolve the consumer
@@ -737,12 +816,11 @@ error_code RdbSerializer::SaveStreamConsumers(streamCG* cg) {
     absl::little_endian::Store64(buf, consumer->seen_time);
     RETURN_ON_ERR(WriteRaw(buf));
 
-    /* Consumer PEL, without the ACKs (see last parameter of the function
-     * passed with value of 0), at loading time we'll lookup the ID
-     * in the consumer group global PEL and will put a reference in the
-     * consumer local PEL. */
+    /* Consumer PEL, without the ACKs, at loading time we'll lookup the ID
+     * in the consumer group global PEL and will set the consumer of the
+     * entry. */
 
-    RETURN_ON_ERR(SaveStreamPEL(consumer->pel, false));
+    RETURN_ON_ERR(SaveStreamPEL(cg->pel, consumer));
   }
 
   return error_code{};
@@ -756,6 +834,67 @@ error_code RdbSerializer::SendJournalOffset(uint64_t journal_offset) {
   return WriteRaw(buf);
 }
 
+error_code RdbSerializer::SaveSearchIndices(ShardId shard_id, uint32_t shard_count,
+                                            string_view data) {
+  VLOG(2) << "SaveSearchIndices " << data.size() << " bytes";
+  RETURN_ON_ERR(WriteOpcode(RDB_OPCODE_SEARCH_INDICES));
+  RETURN_ON_ERR(SaveLen(shard_id));
+  RETURN_ON_ERR(SaveLen(shard_count));
+  return SaveString(data);
+}
+
+error_code SerializerBase::SaveCompressionDict(string dict) {
+  VLOG(1) << "SaveCompressionDict " << dict.size() << " bytes";
+  RETURN_ON_ERR(WriteOpcode(RDB_OPCODE_COMPRESSION_DICT));
+  RETURN_ON_ERR(SaveString(dict));
+  pending_compression_dict_ = std::move(dict);
+  return error_code{};
+}
+
+string SerializerBase::TrainCompressionDict(string_view samples, const vector<size_t>& sizes,
+                                            size_t dict_size) {
+  string dict(dict_size, '\0');
+  size_t res = ZDICT_trainFromBuffer(dict.data(), dict.size(), samples.data(), sizes.data(),
+                                     sizes.size());
+  if (ZDICT_isError(res)) {
+    VLOG(1) << "Could not train a dictionary from " << sizes.size()
+            << " samples: " << ZDICT_getErrorName(res);
+    return {};
+  }
+  dict.resize(res);
+  return dict;
+}
+
+error_code RdbSerializer::SaveDeletedKey(string_view key, DbIndex dbid) {
+  RETURN_ON_ERR(SelectDb(dbid));
+  RETURN_ON_ERR(WriteOpcode(RDB_OPCODE_DELETED_KEY));
+  return SaveString(key);
+}
+
+error_code RdbSerializer::SaveTieredRef(const PrimeValue& pv) {
+  auto [offset, size] = pv.GetExternalSlice();
+  RETURN_ON_ERR(SaveLen(tiered_shard_id_));
+
+  uint8_t buf[8];
+  absl::little_endian::Store64(buf, tiered_generation_);
+  RETURN_ON_ERR(WriteRaw(buf));
+
+  RETURN_ON_ERR(SaveLen(pv.ObjType()));
+  RETURN_ON_ERR(SaveLen(offset));
+  return SaveLen(size);
+}
+
+void RdbSerializer::FlushIfNeeded() {
+  if (!flush_fun_ || max_chunk_size_ == 0)
+    return;
+
+  size_t len = SerializedLen();
+  if (len >= max_chunk_size_) {
+    flushed_mid_entry_ = true;
+    flush_fun_(len);
+  }
+}
+
 error_code SerializerBase::SendFullSyncCut() {
   VLOG(2) << "SendFullSyncCut";
   RETURN_ON_ERR(WriteOpcode(RDB_OPCODE_FULLSYNC_END));
@@ -784,8 +923,8 @@ error_code SerializerBase::WriteRaw(const io::Bytes& buf) {
   return error_code{};
 }
 
-error_code SerializerBase::FlushToSink(io::Sink* s) {
-  auto bytes = PrepareFlush();
+error_code SerializerBase::FlushToSink(io::Sink* s, FlushState flush_state) {
+  auto bytes = PrepareFlush(flush_state);
   if (bytes.empty())
     return error_code{};
 
@@ -795,11 +934,17 @@ error_code SerializerBase::FlushToSink(io::Sink* s) {
   RETURN_ON_ERR(s->Write(bytes));
   mem_buf_.ConsumeInput(bytes.size());
 
+  if (!pending_compression_dict_.empty()) {
+    AllocateCompressorOnce();
+    compressor_impl_->SetDictionary(pending_compression_dict_);
+    pending_compression_dict_.clear();
+  }
+
   return error_code{};
 }
 
-error_code RdbSerializer::FlushToSink(io::Sink* s) {
-  RETURN_ON_ERR(SerializerBase::FlushToSink(s));
+error_code RdbSerializer::FlushToSink(io::Sink* s, FlushState flush_state) {
+  RETURN_ON_ERR(SerializerBase::FlushToSink(s, flush_state));
 
   // After every flush we should write the DB index again because the blobs in the channel are
   // interleaved and multiple savers can correspond to a single writer (in case of single file rdb
@@ -871,13 +1016,14 @@ size_t SerializerBase::SerializedLen() const {
   return mem_buf_.InputLen();
 }
 
-io::Bytes SerializerBase::PrepareFlush() {
+io::Bytes SerializerBase::PrepareFlush(FlushState flush_state) {
   size_t sz = mem_buf_.InputLen();
   if (sz == 0)
     return mem_buf_.InputBuffer();
 
-  if (compression_mode_ == CompressionMode::MULTI_ENTRY_ZSTD ||
-      compression_mode_ == CompressionMode::MULTI_ENTRY_LZ4) {
+  bool multi_entry = compression_mode_ == CompressionMode::MULTI_ENTRY_ZSTD ||
+                     compression_mode_ == CompressionMode::MULTI_ENTRY_LZ4;
+  if (multi_entry && flush_state == FlushState::kFlushEndEntry) {
     CompressBlob();
   }
 
@@ -1048,11 +1194,14 @@ class RdbSaver::Impl {
 
   ~Impl();
 
-  void StartSnapshotting(bool stream_journal, const Cancellation* cll, EngineShard* shard);
+  void StartSnapshotting(bool stream_journal, const Cancellation* cll, EngineShard* shard,
+                         std::optional<uint64_t> save_base);
   void StartIncrementalSnapshotting(Context* cntx, EngineShard* shard, LSN start_lsn);
 
   void StopSnapshotting(EngineShard* shard);
 
+  void BoostPacing(EngineShard* shard);
+
   error_code ConsumeChannel(const Cancellation* cll);
 
   void FillFreqMap(RdbTypeFreqMap* dest) const;
@@ -1079,6 +1228,18 @@ class RdbSaver::Impl {
     return sink_;
   }
 
+  void SaveTieredRefs() {
+    tiered_refs_ = true;
+  }
+
+  void SaveNativeEncodings() {
+    native_encodings_ = true;
+  }
+
+  void SetFilter(journal::Filter filter) {
+    filter_ = std::move(filter);
+  }
+
  private:
   unique_ptr<SliceSnapshot>& GetSnapshot(EngineShard* shard);
 
@@ -1088,6 +1249,9 @@ class RdbSaver::Impl {
   RdbSerializer meta_serializer_;
   SliceSnapshot::RecordChannel channel_;
   bool push_to_sink_with_order_ = false;
+  bool tiered_refs_ = false;
+  bool native_encodings_ = false;
+  journal::Filter filter_;
   std::optional<AlignedBuffer> aligned_buf_;
 
   // Single entry compression is compatible with redis rdb snapshot
@@ -1221,11 +1385,19 @@ error_code RdbSaver::Impl::ConsumeChannel(const Cancellation* cll) {
 }
 
 void RdbSaver::Impl::StartSnapshotting(bool stream_journal, const Cancellation* cll,
-                                       EngineShard* shard) {
+                                       EngineShard* shard, std::optional<uint64_t> save_base) {
   auto& s = GetSnapshot(shard);
-  s = std::make_unique<SliceSnapshot>(&shard->db_slice(), &channel_, compression_mode_);
+  // Chunks of big values and compression dictionaries must not interleave with the records of
+  // other shards.
+  s = std::make_unique<SliceSnapshot>(&shard->db_slice(), &channel_, compression_mode_,
+                                      push_to_sink_with_order_);
+  if (tiered_refs_)
+    s->SaveTieredRefs();
+  if (native_encodings_)
+    s->SaveNativeEncodings();
+  s->SetFilter(filter_);
 
-  s->Start(stream_journal, cll);
+  s->Start(stream_journal, cll, save_base);
 }
 
 void RdbSaver::Impl::StartIncrementalSnapshotting(Context* cntx, EngineShard* shard,
@@ -1240,6 +1412,11 @@ void RdbSaver::Impl::StopSnapshotting(EngineShard* shard) {
   GetSnapshot(shard)->Stop();
 }
 
+void RdbSaver::Impl::BoostPacing(EngineShard* shard) {
+  if (auto& snapshot = GetSnapshot(shard); snapshot)
+    snapshot->BoostPacing();
+}
+
 void RdbSaver::Impl::Cancel() {
   auto* shard = EngineShard::tlocal();
   if (!shard)
@@ -1302,7 +1479,23 @@ RdbSaver::GlobalData RdbSaver::GetGlobalData(const Service* service) {
   }
 #endif
 
-  return RdbSaver::GlobalData{std::move(script_bodies), std::move(search_indices)};
+  vector<pair<size_t, size_t>> db_sizes;
+  Mutex mu;
+  shard_set->RunBriefInParallel([&](EngineShard* es) {
+    const DbSlice& db_slice = es->db_slice();
+    lock_guard lk(mu);
+    db_sizes.resize(max(db_sizes.size(), db_slice.db_array_size()));
+    for (DbIndex db = 0; db < db_slice.db_array_size(); ++db) {
+      if (const DbTable* table = db_slice.GetDBTable(db); table) {
+        db_sizes[db].first += table->prime.size();
+        db_sizes[db].second += table->expire.size();
+      }
+    }
+  });
+
+  GlobalData res{std::move(script_bodies), std::move(search_indices)};
+  res.db_sizes = std::move(db_sizes);
+  return res;
 }
 
 void RdbSaver::Impl::FillFreqMap(RdbTypeFreqMap* dest) const {
@@ -1356,9 +1549,29 @@ RdbSaver::RdbSaver(::io::Sink* sink, SaveMode save_mode, bool align_writes) {
 RdbSaver::~RdbSaver() {
 }
 
+void RdbSaver::SaveTieredRefs() {
+  impl_->SaveTieredRefs();
+}
+
+void RdbSaver::SaveNativeEncodings() {
+  impl_->SaveNativeEncodings();
+}
+
+void RdbSaver::SetFilter(journal::Filter filter) {
+  impl_->SetFilter(std::move(filter));
+}
+
 void RdbSaver::StartSnapshotInShard(bool stream_journal, const Cancellation* cll,
-                                    EngineShard* shard) {
-  impl_->StartSnapshotting(stream_journal, cll, shard);
+                                    EngineShard* shard, std::optional<uint64_t> save_base) {
+  // The position of the shard journal the snapshot is consistent with, so that a replica that
+  // loads the snapshot can continue from it. Taken right before the snapshot starts, without
+  // preempting, the journal records that follow are not reflected by the snapshot.
+  auto* journal = shard->journal();
+  if (journal && !stream_journal && save_mode_ == SaveMode::SINGLE_SHARD) {
+    string pos = absl::StrCat(shard->shard_id(), ":", journal->GetLsn());
+    LOG_IF(ERROR, impl_->SaveAuxFieldStrStr("journal-lsn", pos)) << "Failed to save " << pos;
+  }
+  impl_->StartSnapshotting(stream_journal, cll, shard, save_base);
 }
 
 void RdbSaver::StartIncrementalSnapshotInShard(Context* cntx, EngineShard* shard, LSN start_lsn) {
@@ -1369,6 +1582,10 @@ void RdbSaver::StopSnapshotInShard(EngineShard* shard) {
   impl_->StopSnapshotting(shard);
 }
 
+void RdbSaver::BoostPacingInShard(EngineShard* shard) {
+  impl_->BoostPacing(shard);
+}
+
 error_code RdbSaver::SaveHeader(const GlobalData& glob_state) {
   char magic[16];
   // We should use RDB_VERSION here from rdb.h when we ditch redis 6 support
@@ -1422,6 +1639,8 @@ error_code RdbSaver::SaveAux(const GlobalData& glob_state) {
   RETURN_ON_ERR(SaveAuxFieldStrInt("ctime", time(NULL)));
   RETURN_ON_ERR(SaveAuxFieldStrInt("used-mem", used_mem_current.load(memory_order_relaxed)));
   RETURN_ON_ERR(SaveAuxFieldStrInt("aof-preamble", aof_preamble));
+  if (glob_state.delta)
+    RETURN_ON_ERR(SaveAuxFieldStrInt("snapshot-delta", 1));
 
   // Save lua scripts only in rdb or summary file
   DCHECK(save_mode_ != SaveMode::SINGLE_SHARD || glob_state.lua_scripts.empty());
@@ -1438,7 +1657,25 @@ error_code RdbSaver::SaveAux(const GlobalData& glob_state) {
       RETURN_ON_ERR(impl_->SaveAuxFieldStrStr("search-index", s));
   }
 
-  // TODO: "repl-stream-db", "repl-id", "repl-offset"
+  // Lets the loader reserve the tables before the keys arrive. A delta holds only the changes,
+  // so its hints would not reflect the size of the loaded dataset.
+  if (!glob_state.delta) {
+    auto* serializer = impl_->serializer();
+    for (DbIndex db = 0; db < glob_state.db_sizes.size(); ++db) {
+      auto [keys, expires] = glob_state.db_sizes[db];
+      if (keys == 0)
+        continue;
+      RETURN_ON_ERR(serializer->SelectDb(db));
+      RETURN_ON_ERR(serializer->WriteOpcode(RDB_OPCODE_RESIZEDB));
+      RETURN_ON_ERR(serializer->SaveLen(keys));
+      RETURN_ON_ERR(serializer->SaveLen(expires));
+    }
+  }
+
+  if (!glob_state.repl_id.empty())
+    RETURN_ON_ERR(impl_->SaveAuxFieldStrStr("repl-id", glob_state.repl_id));
+
+  // TODO: "repl-stream-db", "repl-offset"
   return error_code{};
 }
 
@@ -10,6 +10,7 @@ extern "C" {
 #include "redis/object.h"
 }
 
+#include <functional>
 #include <optional>
 
 #include "base/io_buf.h"
@@ -20,8 +21,9 @@ extern "C" {
 #include "server/journal/types.h"
 #include "server/table.h"
 
-typedef struct rax rax;
 typedef struct streamCG streamCG;
+typedef struct streamConsumer streamConsumer;
+typedef struct streamPEL streamPEL;
 
 namespace dfly {
 
@@ -75,6 +77,11 @@ class RdbSaver {
   struct GlobalData {
     const StringVec lua_scripts;     // bodies of lua scripts
     const StringVec search_indices;  // ft.create commands to re-create search indices
+    bool delta = false;              // whether the snapshot is a delta of an earlier save
+    // The number of keys and of keys with expiry in each database, saved as hints for the loader.
+    std::vector<std::pair<size_t, size_t>> db_sizes;
+    // The id of the master whose journal positions the shard files save, see journal-lsn.
+    std::string repl_id;
   };
 
   // single_shard - true means that we run RdbSaver on a single shard and we do not use
@@ -87,8 +94,11 @@ class RdbSaver {
   ~RdbSaver();
 
   // Initiates the serialization in the shard's thread.
+  // save_base is set for the snapshots of saves that track changes for delta snapshots,
+  // see SliceSnapshot::Start.
   // TODO: to implement break functionality to allow stopping early.
-  void StartSnapshotInShard(bool stream_journal, const Cancellation* cll, EngineShard* shard);
+  void StartSnapshotInShard(bool stream_journal, const Cancellation* cll, EngineShard* shard,
+                            std::optional<uint64_t> save_base = std::nullopt);
 
   // Send only the incremental snapshot since start_lsn.
   void StartIncrementalSnapshotInShard(Context* cntx, EngineShard* shard, LSN start_lsn);
@@ -96,6 +106,22 @@ class RdbSaver {
   // Stops serialization in journal streaming mode in the shard's thread.
   void StopSnapshotInShard(EngineShard* shard);
 
+  // Stops pacing the serialization in the shard's thread, see SliceSnapshot::BoostPacing.
+  void BoostPacingInShard(EngineShard* shard);
+
+  // Makes the shard snapshots record the location of the external values of a persistent
+  // tiered storage instead of their contents, see SliceSnapshot::SaveTieredRefs. Only for the
+  // snapshots that this instance loads after a restart, since the locations refer to its files.
+  void SaveTieredRefs();
+
+  // Makes the shard snapshots save the listpacks as they are in memory, see
+  // RdbSerializer::SaveNativeEncodings. Only for the loaders of DflyVersion::VER6 and later.
+  void SaveNativeEncodings();
+
+  // Makes the shard snapshots save only the data that matches the filter, see
+  // SliceSnapshot::SetFilter.
+  void SetFilter(journal::Filter filter);
+
   // Stores auxiliary (meta) values and header_info
   std::error_code SaveHeader(const GlobalData& header_info);
 
@@ -133,6 +159,8 @@ class CompressorImpl;
 
 class SerializerBase {
  public:
+  enum class FlushState { kFlushMidEntry, kFlushEndEntry };
+
   explicit SerializerBase(CompressionMode compression_mode);
   virtual ~SerializerBase() = default;
 
@@ -143,7 +171,10 @@ class SerializerBase {
   size_t SerializedLen() const;
 
   // Flush internal buffer to sink.
-  virtual std::error_code FlushToSink(io::Sink* s);
+  // Entries are compressed only when flushed at their end, because the loader decompresses
+  // whole entries.
+  virtual std::error_code FlushToSink(io::Sink* s,
+                                      FlushState flush_state = FlushState::kFlushEndEntry);
 
   size_t GetTotalBufferCapacity() const;
 
@@ -163,9 +194,19 @@ class SerializerBase {
     return SaveString(io::View(io::Bytes{buf, len}));
   }
 
+  // Writes the zstd dictionary of the stream. The blobs after the next flush are compressed
+  // with it, so that the loader reads it before it is needed.
+  std::error_code SaveCompressionDict(std::string dict);
+
+  // Trains a zstd dictionary of up to dict_size bytes from samples, which are the
+  // concatenation of entries of the given sizes. Returns an empty string on failure, for
+  // example when there are too few samples.
+  static std::string TrainCompressionDict(std::string_view samples,
+                                          const std::vector<size_t>& sizes, size_t dict_size);
+
  protected:
   // Prepare internal buffer for flush. Compress it.
-  io::Bytes PrepareFlush();
+  io::Bytes PrepareFlush(FlushState flush_state);
 
   // If membuf data is compressable use compression impl to compress the data and write it to membuf
   void CompressBlob();
@@ -176,6 +217,7 @@ class SerializerBase {
   CompressionMode compression_mode_;
   base::IoBuf mem_buf_;
   std::unique_ptr<CompressorImpl> compressor_impl_;
+  std::string pending_compression_dict_;  // set by SaveCompressionDict until the next flush.
 
   static constexpr size_t kMinStrSizeToCompress = 256;
   static constexpr double kMinCompressionReductionPrecentage = 0.95;
@@ -192,11 +234,16 @@ class SerializerBase {
 
 class RdbSerializer : public SerializerBase {
  public:
-  explicit RdbSerializer(CompressionMode compression_mode);
+  // Called in the middle of big values when the serialized length exceeds
+  // serialization_max_chunk_size, so that the caller flushes the value in chunks.
+  using FlushFun = std::function<void(size_t len)>;
+
+  explicit RdbSerializer(CompressionMode compression_mode, FlushFun flush_fun = {});
 
   ~RdbSerializer();
 
-  std::error_code FlushToSink(io::Sink* s) override;
+  std::error_code FlushToSink(io::Sink* s,
+                              FlushState flush_state = FlushState::kFlushEndEntry) override;
   std::error_code SelectDb(uint32_t dbid);
 
   // Must be called in the thread to which `it` belongs.
@@ -213,6 +260,25 @@ class RdbSerializer : public SerializerBase {
 
   std::error_code SendJournalOffset(uint64_t journal_offset);
 
+  std::error_code SaveSearchIndices(ShardId shard_id, uint32_t shard_count, std::string_view data);
+
+  // Writes a tombstone of a key deleted since the base of a delta snapshot.
+  std::error_code SaveDeletedKey(std::string_view key, DbIndex dbid);
+
+  // Makes SaveEntry write the location of the external values as RDB_TYPE_TIERED_REF instead
+  // of their contents, see TieredStorage::SealForSnapshot.
+  void SaveTieredRefs(ShardId shard_id, uint64_t generation) {
+    tiered_shard_id_ = shard_id;
+    tiered_generation_ = generation;
+  }
+
+  // Makes SaveEntry write the listpacks of hashes, sorted sets and lists as they are in memory,
+  // with the listpack RDB types, instead of converting them to ziplists that older versions load.
+  // Saves converting them back and forth on both ends of a full sync.
+  void SaveNativeEncodings() {
+    native_encodings_ = true;
+  }
+
  private:
   std::error_code SaveObject(const PrimeValue& pv);
   std::error_code SaveListObject(const robj* obj);
@@ -221,15 +287,26 @@ class RdbSerializer : public SerializerBase {
   std::error_code SaveZSetObject(const PrimeValue& pv);
   std::error_code SaveStreamObject(const robj* obj);
   std::error_code SaveJsonObject(const PrimeValue& pv);
+  std::error_code SaveTieredRef(const PrimeValue& pv);
 
   std::error_code SaveLongLongAsString(int64_t value);
   std::error_code SaveBinaryDouble(double val);
   std::error_code SaveListPackAsZiplist(uint8_t* lp);
-  std::error_code SaveStreamPEL(rax* pel, bool nacks);
+  std::error_code SaveStreamPEL(streamPEL* pel, streamConsumer* consumer);
   std::error_code SaveStreamConsumers(streamCG* cg);
 
+  // Calls flush_fun_ between the elements of a big value, see FlushFun.
+  void FlushIfNeeded();
+
   std::string tmp_str_;
   DbIndex last_entry_db_index_ = kInvalidDbId;
+  FlushFun flush_fun_;
+  size_t max_chunk_size_ = 0;
+  bool flushed_mid_entry_ = false;
+
+  ShardId tiered_shard_id_ = 0;
+  uint64_t tiered_generation_ = 0;  // 0 if the external values are not saved as references.
+  bool native_encodings_ = false;
 };
 
 }  // namespace dfly
@@ -33,6 +33,13 @@ using absl::StrCat;
 ABSL_DECLARE_FLAG(int32, list_compress_depth);
 ABSL_DECLARE_FLAG(int32, list_max_listpack_size);
 ABSL_DECLARE_FLAG(dfly::CompressionMode, compression_mode);
+ABSL_DECLARE_FLAG(bool, rdb_parallel_decode);
+ABSL_DECLARE_FLAG(bool, snapshot_deltas);
+ABSL_DECLARE_FLAG(bool, snapshot_pacing);
+ABSL_DECLARE_FLAG(uint64_t, snapshot_max_bytes_per_sec);
+ABSL_DECLARE_FLAG(uint32_t, save_deadline_sec);
+ABSL_DECLARE_FLAG(uint64_t, serialization_max_chunk_size);
+ABSL_DECLARE_FLAG(uint32_t, compression_dict_size);
 
 namespace dfly {
 
@@ -126,6 +133,33 @@ TEST_F(RdbTest, LoadSmall6) {
   EXPECT_THAT(resp.GetVec(), ElementsAre(IntArg(1), IntArg(1)));
 }
 
+TEST_F(RdbTest, LoadSmall6ParallelDecode) {
+  absl::FlagSaver saver;
+  absl::SetFlag(&FLAGS_rdb_parallel_decode, true);
+
+  io::FileSource fs = GetSource("redis6_small.rdb");
+  RdbLoader loader{service_.get()};
+  auto ec = pp_->at(0)->Await([&] { return loader.Load(&fs); });
+  ASSERT_FALSE(ec) << ec.message();
+
+  auto resp = Run({"scan", "0"});
+  ASSERT_THAT(resp, ArrLen(2));
+  EXPECT_THAT(StrArray(resp.GetVec()[1]),
+              UnorderedElementsAre("list1", "hset_zl", "list2", "zset_sl", "intset", "set1",
+                                   "zset_zl", "hset_ht", "intkey", "strkey"));
+  EXPECT_THAT(Run({"get", "intkey"}), "1234567");
+  EXPECT_THAT(Run({"get", "strkey"}), "abcdefghjjjjjjjjjj");
+
+  resp = Run({"smembers", "intset"});
+  ASSERT_THAT(resp, ArgType(RespExpr::ARRAY));
+  EXPECT_THAT(resp.GetVec(),
+              UnorderedElementsAre("111", "222", "1234", "3333", "4444", "67899", "76554"));
+
+  Run({"select", "1"});
+  ASSERT_EQ(10, CheckedInt({"dbsize"}));
+  ASSERT_EQ(128, CheckedInt({"strlen", "longggggggggggggggkeyyyyyyyyyyyyy:9"}));
+}
+
 TEST_F(RdbTest, Stream) {
   io::FileSource fs = GetSource("redis6_stream.rdb");
   RdbLoader loader{service_.get()};
@@ -202,6 +236,141 @@ TEST_F(RdbTest, SaveLoadSticky) {
   EXPECT_THAT(Run({"stick", "c"}), IntArg(1));
 }
 
+TEST_F(RdbTest, SaveLoadDeltas) {
+  absl::FlagSaver fs;
+  SetFlag(&FLAGS_snapshot_deltas, true);
+
+  EXPECT_THAT(Run({"save", "delta", "delta0"}), ErrArg("a full save is needed"));
+
+  Run({"debug", "populate", "1000"});
+  Run({"set", "deleted", "1"});
+  Run({"set", "expiring", "1"});
+  ASSERT_EQ(Run({"save", "df", "base"}), "OK");
+  string base = service_->server_family().GetLastSaveInfo().file_name;
+
+  Run({"set", "key:1", "changed"});
+  Run({"del", "deleted"});
+  Run({"set", "added", "2"});
+  Run({"pexpire", "expiring", "1"});
+  ASSERT_EQ(Run({"save", "delta", "delta1"}), "OK");
+  string delta1 = service_->server_family().GetLastSaveInfo().file_name;
+
+  Run({"set", "added", "3"});
+  Run({"del", "key:2"});
+  ASSERT_EQ(Run({"save", "delta", "delta2"}), "OK");
+  string delta2 = service_->server_family().GetLastSaveInfo().file_name;
+
+  // A flush is not tracked as deletions, the next delta needs a new full save.
+  Run({"set", "unsaved", "4"});
+  Run({"flushall"});
+  EXPECT_THAT(Run({"save", "delta", "delta3"}), ErrArg("a full save is needed"));
+
+  ASSERT_EQ(Run({"debug", "load", base, delta1, delta2}), "OK");
+
+  EXPECT_EQ(1000, CheckedInt({"dbsize"}));
+  EXPECT_EQ(Run({"get", "key:1"}), "changed");
+  EXPECT_EQ(Run({"get", "key:3"}), "value:3");
+  EXPECT_EQ(Run({"get", "added"}), "3");
+  EXPECT_EQ(0, CheckedInt({"exists", "deleted", "expiring", "key:2", "unsaved"}));
+}
+
+TEST_F(RdbTest, SavePaced) {
+  absl::FlagSaver fs;
+  SetFlag(&FLAGS_snapshot_pacing, true);
+  SetFlag(&FLAGS_snapshot_max_bytes_per_sec, 256 << 10);
+  SetFlag(&FLAGS_save_deadline_sec, 1);  // boosts the save that would take longer.
+
+  Run({"debug", "populate", "20000", "key", "64"});
+  ASSERT_EQ(Run({"save", "df"}), "OK");
+
+  auto save_info = service_->server_family().GetLastSaveInfo();
+  ASSERT_EQ(Run({"debug", "load", save_info.file_name}), "OK");
+  EXPECT_EQ(20000, CheckedInt({"dbsize"}));
+}
+
+TEST_F(RdbTest, SaveLoadChunked) {
+  absl::FlagSaver fs;
+  SetFlag(&FLAGS_serialization_max_chunk_size, 4096);
+
+  // Above the number of elements the loader reads at once.
+  const int kElements = 10000;
+  vector<string> set_args{"sadd", "set"}, hash_args{"hset", "hash"};
+  vector<string> zset_args{"zadd", "zset"}, list_args{"rpush", "list"};
+  for (int i = 0; i < kElements; ++i) {
+    string val = absl::StrCat("element:", i);
+    set_args.push_back(val);
+    hash_args.push_back(val);
+    hash_args.push_back(absl::StrCat(i));
+    zset_args.push_back(absl::StrCat(i));
+    zset_args.push_back(val);
+    list_args.push_back(val);
+  }
+  Run(absl::MakeSpan(set_args));
+  Run(absl::MakeSpan(hash_args));
+  Run(absl::MakeSpan(zset_args));
+  Run(absl::MakeSpan(list_args));
+  Run({"pexpire", "set", "1000000"});
+  Run({"debug", "populate", "100"});
+
+  ASSERT_EQ(Run({"save", "df"}), "OK");
+  auto save_info = service_->server_family().GetLastSaveInfo();
+  ASSERT_EQ(Run({"debug", "load", save_info.file_name}), "OK");
+
+  EXPECT_EQ(104, CheckedInt({"dbsize"}));
+  EXPECT_EQ(kElements, CheckedInt({"scard", "set"}));
+  EXPECT_EQ(kElements, CheckedInt({"hlen", "hash"}));
+  EXPECT_EQ(kElements, CheckedInt({"zcard", "zset"}));
+  EXPECT_EQ(kElements, CheckedInt({"llen", "list"}));
+  EXPECT_GT(CheckedInt({"pttl", "set"}), 0);
+  EXPECT_EQ(Run({"hget", "hash", "element:9999"}), "9999");
+  EXPECT_EQ(Run({"zscore", "zset", "element:5000"}), "5000");
+  EXPECT_EQ(Run({"lindex", "list", "-1"}), "element:9999");
+  EXPECT_EQ(Run({"get", "key:99"}), "value:99");
+
+  // All chunks were added, so the keys can be served while loading.
+  for (string_view key : {"set", "hash", "zset", "list"}) {
+    EXPECT_FALSE(shard_set->Await(Shard(key, shard_set->size()),
+                                  [key] { return RdbLoader::IsKeyPartial(0, key); }))
+        << key;
+  }
+}
+
+TEST_F(RdbTest, SaveLoadCompressionDict) {
+  absl::FlagSaver fs;
+  SetFlag(&FLAGS_compression_mode, dfly::CompressionMode::MULTI_ENTRY_ZSTD);
+  SetFlag(&FLAGS_compression_dict_size, 1024);
+
+  Run({"debug", "populate", "5000", "key", "64"});
+  for (int i = 0; i < 100; ++i)
+    Run({"hset", absl::StrCat("hash:", i), "field1", absl::StrCat("value:", i), "field2", "x"});
+
+  ASSERT_EQ(Run({"save", "df"}), "OK");
+  auto save_info = service_->server_family().GetLastSaveInfo();
+  ASSERT_EQ(Run({"debug", "load", save_info.file_name}), "OK");
+
+  EXPECT_EQ(5100, CheckedInt({"dbsize"}));
+  EXPECT_EQ(Run({"hget", "hash:42", "field1"}), "value:42");
+  EXPECT_EQ(Run({"strlen", "key:4999"}), "64");
+}
+
+TEST_F(RdbTest, ServeWhileLoading) {
+  Run({"set", "a", "1"});
+  ASSERT_EQ(service_->SwitchState(GlobalState::ACTIVE, GlobalState::LOADING).first,
+            GlobalState::LOADING);
+  service_->SetServingLoad(true);
+
+  EXPECT_EQ(Run({"get", "a"}), "1");
+  EXPECT_EQ(2, CheckedInt({"incr", "a"}));
+  EXPECT_THAT(Run({"get", "b"}), ErrArg("LOADING"));
+  EXPECT_THAT(Run({"mset", "a", "3", "b", "1"}), ErrArg("LOADING"));
+  EXPECT_THAT(Run({"dbsize"}), ErrArg("LOADING"));
+
+  service_->SetServingLoad(false);
+  EXPECT_THAT(Run({"get", "a"}), ErrArg("LOADING"));
+  service_->SwitchState(GlobalState::LOADING, GlobalState::ACTIVE);
+  EXPECT_EQ(Run({"get", "a"}), "2");
+}
+
 TEST_F(RdbTest, Reload) {
   absl::FlagSaver fs;
 
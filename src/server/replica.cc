@@ -12,18 +12,23 @@ extern "C" {
 #include <absl/cleanup/cleanup.h>
 #include <absl/flags/flag.h>
 #include <absl/functional/bind_front.h>
+#include <absl/strings/ascii.h>
 #include <absl/strings/escaping.h>
 #include <absl/strings/str_cat.h>
 #include <absl/strings/strip.h>
 
+#include <algorithm>
 #include <boost/asio/ip/tcp.hpp>
 #include <memory>
+#include <optional>
 #include <utility>
 
 #include "base/logging.h"
 #include "facade/dragonfly_connection.h"
 #include "facade/redis_parser.h"
+#include "server/dflycmd.h"
 #include "server/error.h"
+#include "server/io_utils.h"
 #include "server/journal/executor.h"
 #include "server/journal/serializer.h"
 #include "server/main_service.h"
@@ -39,6 +44,17 @@ ABSL_FLAG(int, master_reconnect_timeout_ms, 1000,
           "Timeout for re-establishing connection to a replication master");
 ABSL_FLAG(bool, replica_partial_sync, true,
           "Use partial sync to reconnect when a replica connection is interrupted.");
+ABSL_FLAG(bool, replication_stream_compression, false,
+          "Ask a dragonfly master to compress the stable sync stream with LZ4.");
+ABSL_FLAG(uint32_t, replica_sync_stripes, 1,
+          "The number of connections the full sync of every shard flow is striped over, for links "
+          "where a single TCP stream can not reach the available bandwidth");
+ABSL_FLAG(std::vector<std::string>, replica_filter_dbs, {},
+          "Comma separated list of the databases to replicate, all of them if empty. Requires a "
+          "master that supports the replication filter.");
+ABSL_FLAG(std::vector<std::string>, replica_filter_prefixes, {},
+          "Comma separated list of the key prefixes to replicate, all the keys if empty. Keys of "
+          "multi shard transactions are replicated regardless of their prefix.");
 ABSL_DECLARE_FLAG(int32_t, port);
 
 namespace dfly {
@@ -77,6 +93,11 @@ Replica::~Replica() {
 
 static const char kConnErr[] = "could not connect to master: ";
 
+void Replica::SetJournalPosition(std::string master_repl_id, std::vector<LSN> lsns) {
+  master_context_.master_repl_id = std::move(master_repl_id);
+  last_journal_LSNs_ = std::move(lsns);
+}
+
 error_code Replica::Start(ConnectionContext* cntx) {
   VLOG(1) << "Starting replication";
   ProactorBase* mythread = ProactorBase::me();
@@ -298,8 +319,9 @@ std::error_code Replica::HandleCapaDflyResp() {
     return make_error_code(errc::bad_message);
   }
 
-  // If we're syncing a different replication ID, drop the saved LSNs.
-  if (master_context_.master_repl_id != ToSV(LastResponseArgs()[0].GetBuf())) {
+  // If we're syncing a different replication ID or shard count, drop the saved LSNs.
+  if (master_context_.master_repl_id != ToSV(LastResponseArgs()[0].GetBuf()) ||
+      (last_journal_LSNs_ && last_journal_LSNs_->size() != size_t(param_num_flows))) {
     last_journal_LSNs_.reset();
   }
   master_context_.master_repl_id = ToSV(LastResponseArgs()[0].GetBuf());
@@ -333,6 +355,32 @@ std::error_code Replica::ConfigureDflyMaster() {
     PC_RETURN_ON_BAD_RESPONSE(CheckRespIsSimpleReply("OK"));
   }
 
+  master_context_.journal_compression = false;
+  if (master_context_.version > DflyVersion::VER0 &&
+      absl::GetFlag(FLAGS_replication_stream_compression)) {
+    RETURN_ON_ERR(SendCommandAndReadResponse("REPLCONF JOURNAL-COMPRESSION LZ4"));
+    if (CheckRespIsSimpleReply("OK")) {
+      master_context_.journal_compression = true;
+    } else {
+      LOG(WARNING) << "Master does not support journal compression, using a plain stream";
+    }
+  }
+
+  master_context_.journal_commands.reset();
+  if (master_context_.version >= DflyVersion::VER4) {
+    RETURN_ON_ERR(SendCommandAndReadResponse("REPLCONF JOURNAL-COMMANDS LIST"));
+    vector<string> names;
+    for (const auto& arg : LastResponseArgs()) {
+      if (arg.type != RespExpr::STRING)
+        break;
+      names.emplace_back(ToSV(arg.GetBuf()));
+    }
+    if (!names.empty() && names.size() == LastResponseArgs().size()) {
+      master_context_.journal_commands =
+          make_shared<const JournalCommandTable>(std::move(names));
+    }
+  }
+
   return error_code{};
 }
 
@@ -377,6 +425,7 @@ error_code Replica::InitiatePSync() {
       service_.SwitchState(GlobalState::LOADING, GlobalState::ACTIVE);
     };
 
+    service_.server_family().GetDflyCmd()->BreakDownstreamReplicas();
     JournalExecutor{&service_}.FlushAll();
     RdbLoader loader(NULL);
     loader.set_source_limit(snapshot_size);
@@ -438,10 +487,14 @@ error_code Replica::InitiateDflySync() {
 
   // Initialize shard flows.
   shard_flows_.resize(num_df_flows_);
+  flow_lags_ = make_shared<vector<ReplicaFlowLag>>(num_df_flows_);
   for (unsigned i = 0; i < num_df_flows_; ++i) {
     shard_flows_[i].reset(
         new DflyShardReplica(server(), master_context_, i, &service_, multi_shard_exe_));
+    shard_flows_[i]->SetLag(&(*flow_lags_)[i]);
   }
+  shard_set->pool()->Await(
+      [lags = flow_lags_](unsigned, auto*) { ServerState::tlocal()->replica_flow_lags = lags; });
 
   // Blocked on until all flows got full sync cut.
   BlockingCounter sync_block{num_df_flows_};
@@ -494,6 +547,7 @@ error_code Replica::InitiateDflySync() {
         std::accumulate(is_full_sync.get(), is_full_sync.get() + num_df_flows_, 0);
 
     if (num_full_flows == num_df_flows_) {
+      service_.server_family().GetDflyCmd()->BreakDownstreamReplicas();
       JournalExecutor{&service_}.FlushAll();
       RdbLoader::PerformPreLoad(&service_);
     } else if (num_full_flows == 0) {
@@ -623,6 +677,12 @@ error_code Replica::ConsumeDflyStream() {
 
   last_journal_LSNs_.emplace();
   for (auto& flow : shard_flows_) {
+    if (flow->HasExecutedAhead()) {
+      LOG(INFO) << "Flow " << flow->FlowId() << " executed transactions out of order, "
+                << "the next sync will be a full sync";
+      last_journal_LSNs_.reset();
+      break;
+    }
     last_journal_LSNs_->push_back(flow->JournalExecutedCount());
   }
 
@@ -674,6 +734,12 @@ io::Result<bool> DflyShardReplica::StartSyncFlow(BlockingCounter sb, Context* cn
     absl::StrAppend(&cmd, " ", *lsn);
   }
 
+  // The master always performs a full sync for a filtered flow.
+  for (const std::string& db : absl::GetFlag(FLAGS_replica_filter_dbs))
+    absl::StrAppend(&cmd, " DB ", db);
+  for (const std::string& prefix : absl::GetFlag(FLAGS_replica_filter_prefixes))
+    absl::StrAppend(&cmd, " PREFIX ", prefix);
+
   ResetParser(/*server_mode=*/false);
   leftover_buf_.emplace(128);
   RETURN_ON_ERR_T(make_unexpected, SendCommand(cmd));
@@ -695,6 +761,22 @@ io::Result<bool> DflyShardReplica::StartSyncFlow(BlockingCounter sb, Context* cn
 
   leftover_buf_->ConsumeInput(read_resp->left_in_buffer);
 
+  // The master uses the stripes that joined in order before DFLY SYNC, so joining stops at the
+  // first failure.
+  stripes_.clear();
+  if (master_context_.version >= DflyVersion::VER5) {
+    unsigned num_stripes = min(absl::GetFlag(FLAGS_replica_sync_stripes), StripedSink::kMaxStripes);
+    for (unsigned index = 1; index < num_stripes; ++index) {
+      auto stripe = make_unique<DflyStripeClient>(server());
+      if (auto ec = stripe->Join(master_context_, flow_id_, index); ec) {
+        LOG(WARNING) << "Could not join stripe " << index << " of flow " << flow_id_ << ": "
+                     << ec.message();
+        break;
+      }
+      stripes_.push_back(std::move(stripe));
+    }
+  }
+
   // We can not discard io_buf because it may contain data
   // besides the response we parsed. Therefore we pass it further to ReplicateDFFb.
   sync_fb_ = fb2::Fiber("shard_full_sync", &DflyShardReplica::FullSyncDflyFb, this,
@@ -712,6 +794,9 @@ error_code DflyShardReplica::StartStableSyncFlow(Context* cntx) {
     return std::make_error_code(errc::io_error);
   }
 
+  // The master does not use the stripes after the full sync.
+  stripes_.clear();
+
   sync_fb_ =
       fb2::Fiber("shard_stable_sync_read", &DflyShardReplica::StableSyncDflyReadFb, this, cntx);
   if (use_multi_shard_exe_sync_) {
@@ -726,7 +811,20 @@ void DflyShardReplica::FullSyncDflyFb(std::string eof_token, BlockingCounter bc,
   DCHECK(leftover_buf_);
   io::PrefixSource ps{leftover_buf_->InputBuffer(), Sock()};
 
+  // The full sync data is striped over this connection and the stripes, the eof token follows
+  // it on this connection.
+  std::optional<StripedSource> striped;
+  io::Source* source = &ps;
+  if (!stripes_.empty()) {
+    vector<io::Source*> sources{&ps};
+    for (const auto& stripe : stripes_)
+      sources.push_back(stripe->Source());
+    striped.emplace(std::move(sources));
+    source = &*striped;
+  }
+
   RdbLoader loader(&service_);
+  loader.SetJournalCommandTable(master_context_.journal_commands.get());
   loader.SetFullSyncCutCb([bc, ran = false]() mutable {
     if (!ran) {
       bc.Dec();
@@ -735,13 +833,14 @@ void DflyShardReplica::FullSyncDflyFb(std::string eof_token, BlockingCounter bc,
   });
 
   // Load incoming rdb stream.
-  if (std::error_code ec = loader.Load(&ps); ec) {
+  if (std::error_code ec = loader.Load(source); ec) {
     cntx->ReportError(ec, "Error loading rdb format");
     return;
   }
 
-  // Try finding eof token.
-  io::PrefixSource chained_tail{loader.Leftover(), &ps};
+  // Try finding eof token. The striped stream is read only up to its end, so the token is next on
+  // this connection.
+  io::PrefixSource chained_tail{striped ? io::Bytes{} : loader.Leftover(), &ps};
   if (!eof_token.empty()) {
     unique_ptr<uint8_t[]> buf{new uint8_t[eof_token.size()]};
 
@@ -783,9 +882,22 @@ void DflyShardReplica::StableSyncDflyReadFb(Context* cntx) {
 
   io::PrefixSource ps{prefix, Sock()};
 
-  JournalReader reader{&ps, 0};
+  // The stable sync stream starts right after the full sync data, so the prefix is compressed
+  // as well.
+  std::optional<Lz4FrameSource> decompressor;
+  io::Source* source = &ps;
+  if (master_context_.journal_compression) {
+    decompressor.emplace(&ps);
+    source = &*decompressor;
+  }
+
+  JournalReader reader{source, 0};
+  reader.SetCommandTable(master_context_.journal_commands.get());
   TransactionReader tx_reader{};
 
+  // The offset of the records read so far.
+  uint64_t read_offs = journal_rec_executed_.load(std::memory_order_relaxed);
+
   if (master_context_.version > DflyVersion::VER0) {
     acks_fb_ = fb2::Fiber("shard_acks", &DflyShardReplica::StableSyncDflyAcksFb, this, cntx);
   }
@@ -803,15 +915,18 @@ void DflyShardReplica::StableSyncDflyReadFb(Context* cntx) {
 
     last_io_time_ = Proactor()->GetMonotonicTimeNs();
 
-    if (!tx_data->is_ping) {
+    if (tx_data->master_lsn) {
+      UpdateLag(*tx_data->master_lsn);
+    } else if (!tx_data->is_ping) {
+      read_offs += tx_data->journal_rec_count;
       if (use_multi_shard_exe_sync_) {
         InsertTxDataToShardResource(std::move(*tx_data));
       } else {
         ExecuteTxWithNoShardSync(std::move(*tx_data), cntx);
       }
     } else {
-      force_ping_ = true;
-      journal_rec_executed_.fetch_add(1, std::memory_order_relaxed);
+      ping_offs_ = ++read_offs;
+      AddExecutedRecords(1);
     }
 
     waker_.notify();
@@ -850,12 +965,12 @@ void DflyShardReplica::StableSyncDflyAcksFb(Context* cntx) {
 
   uint64_t current_offset;
   while (!cntx->IsCancelled()) {
-    // Handle ACKs with the master. PING opcodes from the master mean we should immediately
-    // answer.
+    // Handle ACKs with the master. PING opcodes from the master mean we should answer as soon as
+    // the records before them are executed. The ACKs of PINGs that arrive in the meantime are
+    // batched into one.
     current_offset = journal_rec_executed_.load(std::memory_order_relaxed);
-    VLOG(1) << "Sending an ACK with offset=" << current_offset << " forced=" << force_ping_;
+    VLOG(1) << "Sending an ACK with offset=" << current_offset << " ping=" << ping_offs_;
     ack_cmd = absl::StrCat("REPLCONF ACK ", current_offset);
-    force_ping_ = false;
     next_ack_tp = std::chrono::steady_clock::now() + ack_time_max_interval;
     if (auto ec = SendCommand(ack_cmd); ec) {
       cntx->ReportError(ec);
@@ -865,9 +980,9 @@ void DflyShardReplica::StableSyncDflyAcksFb(Context* cntx) {
 
     waker_.await_until(
         [&]() {
-          return journal_rec_executed_.load(std::memory_order_relaxed) >
-                     ack_offs_ + kAckRecordMaxInterval ||
-                 force_ping_ || cntx->IsCancelled();
+          uint64_t executed = journal_rec_executed_.load(std::memory_order_relaxed);
+          return executed > ack_offs_ + kAckRecordMaxInterval ||
+                 (ping_offs_ > ack_offs_ && executed >= ping_offs_) || cntx->IsCancelled();
         },
         next_ack_tp);
   }
@@ -897,7 +1012,9 @@ void DflyShardReplica::ExecuteTxWithNoShardSync(TransactionData&& tx_data, Conte
   bool was_insert = tx_data.IsGlobalCmd() &&
                     multi_shard_exe_->InsertTxToSharedMap(tx_data.txid, tx_data.shard_cnt);
 
-  ExecuteTx(std::move(tx_data), was_insert, cntx);
+  uint32_t rec_count = tx_data.journal_rec_count;
+  if (ExecuteTx(std::move(tx_data), was_insert, cntx))
+    AddExecutedRecords(rec_count);
 }
 
 void DflyShardReplica::InsertTxDataToShardResource(TransactionData&& tx_data) {
@@ -906,8 +1023,16 @@ void DflyShardReplica::InsertTxDataToShardResource(TransactionData&& tx_data) {
     was_insert = multi_shard_exe_->InsertTxToSharedMap(tx_data.txid, tx_data.shard_cnt);
   }
 
+  // Resolve the commands once here rather than on every ExecuteAhead scan over the queue.
+  bool has_keys = all_of(tx_data.commands.begin(), tx_data.commands.end(), [this](const auto& cmd) {
+    if (cmd.cmd_args.empty())
+      return false;
+    const CommandId* cid = service_.FindCmd(absl::AsciiStrToUpper(facade::ToSV(cmd.cmd_args[0])));
+    return cid && cid->first_key_pos() > 0;
+  });
+
   VLOG(2) << "txid: " << tx_data.txid << " pushed to queue";
-  trans_data_queue_.emplace(std::move(tx_data), was_insert);
+  trans_data_queue_.push_back(QueuedTx{std::move(tx_data), was_insert, has_keys});
 }
 
 void DflyShardReplica::StableSyncDflyExecFb(Context* cntx) {
@@ -917,22 +1042,80 @@ void DflyShardReplica::StableSyncDflyExecFb(Context* cntx) {
       return;
     }
     DCHECK(!trans_data_queue_.empty());
-    auto& data = trans_data_queue_.front();
-    ExecuteTx(std::move(data.first), data.second, cntx);
-    trans_data_queue_.pop();
+    QueuedTx& data = trans_data_queue_.front();
+    TxId txid = data.tx.txid;
+    if (!data.executed && data.tx.shard_cnt > 1 && !multi_shard_exe_->IsReceived(txid)) {
+      // Instead of blocking on it, apply the independent transactions behind it and wait only
+      // if there are none.
+      if (!ExecuteAhead(cntx)) {
+        size_t queued = trans_data_queue_.size();
+        multi_shard_exe_->NotifyWhenReceived(txid, &waker_);
+        waker_.await([&]() {
+          return multi_shard_exe_->IsReceived(txid) || trans_data_queue_.size() != queued ||
+                 cntx->IsCancelled();
+        });
+      }
+      continue;
+    }
+
+    uint32_t rec_count = data.tx.journal_rec_count;
+    if (data.executed || ExecuteTx(std::move(data.tx), data.inserted_by_me, cntx))
+      AddExecutedRecords(rec_count);
+    trans_data_queue_.pop_front();
+    ahead_pos_ = 0;
+    ahead_waiting_args_.clear();
     waker_.notify();
   }
 }
 
-void DflyShardReplica::ExecuteTx(TransactionData&& tx_data, bool inserted_by_me, Context* cntx) {
+bool DflyShardReplica::ExecuteAhead(Context* cntx) {
+  auto for_each_arg = [](const TransactionData& tx, auto cb) {
+    for (const auto& cmd : tx.commands) {
+      for (size_t i = 1; i < cmd.cmd_args.size(); ++i)
+        cb(facade::ToSV(cmd.cmd_args[i]));
+    }
+  };
+
+  // The scan resumes where the previous call for the same front stopped. The transactions
+  // before ahead_pos_ were either executed or their arguments are in ahead_waiting_args_.
+  if (ahead_pos_ == 0) {
+    for_each_arg(trans_data_queue_.front().tx,
+                 [&](string_view arg) { ahead_waiting_args_.insert(arg); });
+    ahead_pos_ = 1;
+  }
+
+  for (; ahead_pos_ < trans_data_queue_.size(); ++ahead_pos_) {
+    QueuedTx& data = trans_data_queue_[ahead_pos_];
+    if (!data.has_keys)
+      return false;
+
+    bool independent = data.tx.shard_cnt <= 1 || multi_shard_exe_->IsReceived(data.tx.txid);
+    for_each_arg(data.tx,
+                 [&](string_view arg) { independent &= !ahead_waiting_args_.contains(arg); });
+    if (!independent) {
+      for_each_arg(data.tx, [&](string_view arg) { ahead_waiting_args_.insert(arg); });
+      continue;
+    }
+
+    VLOG(2) << "Execute txid: " << data.tx.txid << " ahead of txid "
+            << trans_data_queue_.front().tx.txid;
+    data.executed = ExecuteTx(std::move(data.tx), data.inserted_by_me, cntx);
+    if (!data.executed)
+      return false;
+    ++ahead_pos_;
+    return true;
+  }
+  return false;
+}
+
+bool DflyShardReplica::ExecuteTx(TransactionData&& tx_data, bool inserted_by_me, Context* cntx) {
   if (cntx->IsCancelled()) {
-    return;
+    return false;
   }
   if (tx_data.shard_cnt <= 1 || (!use_multi_shard_exe_sync_ && !tx_data.IsGlobalCmd())) {
     VLOG(2) << "Execute cmd without sync between shards. txid: " << tx_data.txid;
     executor_->Execute(tx_data.dbid, absl::MakeSpan(tx_data.commands));
-    journal_rec_executed_.fetch_add(tx_data.journal_rec_count, std::memory_order_relaxed);
-    return;
+    return true;
   }
 
   auto& multi_shard_data = multi_shard_exe_->Find(tx_data.txid);
@@ -944,7 +1127,7 @@ void DflyShardReplica::ExecuteTx(TransactionData&& tx_data, bool inserted_by_me,
   multi_shard_data.block.Wait();
   // Check if we woke up due to cancellation.
   if (cntx_.IsCancelled())
-    return;
+    return false;
   VLOG(2) << "Execute txid: " << tx_data.txid << " block wait finished";
 
   if (tx_data.IsGlobalCmd()) {
@@ -953,7 +1136,7 @@ void DflyShardReplica::ExecuteTx(TransactionData&& tx_data, bool inserted_by_me,
     multi_shard_data.barrier.Wait();
     // Check if we woke up due to cancellation.
     if (cntx_.IsCancelled())
-      return;
+      return false;
     // Global command will be executed only from one flow fiber. This ensure corectness of data in
     // replica.
     if (inserted_by_me) {
@@ -964,12 +1147,11 @@ void DflyShardReplica::ExecuteTx(TransactionData&& tx_data, bool inserted_by_me,
     multi_shard_data.barrier.Wait();
     // Check if we woke up due to cancellation.
     if (cntx_.IsCancelled())
-      return;
+      return false;
   } else {  // Non global command will be executed by each flow fiber
     VLOG(2) << "Execute txid: " << tx_data.txid << " executing shard transaction commands";
     executor_->Execute(tx_data.dbid, absl::MakeSpan(tx_data.commands));
   }
-  journal_rec_executed_.fetch_add(tx_data.journal_rec_count, std::memory_order_relaxed);
 
   // Erase from map can be done only after all flow fibers executed the transaction commands.
   // The last fiber which will decrease the counter to 0 will be the one to erase the data from
@@ -979,6 +1161,7 @@ void DflyShardReplica::ExecuteTx(TransactionData&& tx_data, bool inserted_by_me,
   if (val == 1) {
     multi_shard_exe_->Erase(tx_data.txid);
   }
+  return true;
 }
 
 error_code Replica::ParseReplicationHeader(base::IoBuf* io_buf, PSyncResponse* dest) {
@@ -1068,6 +1251,12 @@ Replica::Info Replica::GetInfo() const {
     res.full_sync_done = (state_mask_.load() & R_SYNC_OK);
     res.master_last_io_sec = (ProactorBase::GetMonotonicTimeNs() - last_io_time) / 1000000000UL;
     res.master_id = master_context_.master_repl_id;
+    if (flow_lags_) {
+      uint64_t now = ProactorBase::GetMonotonicTimeNs();
+      for (const ReplicaFlowLag& lag : *flow_lags_) {
+        res.flow_lags.emplace_back(lag.lsn_lag.load(memory_order_relaxed), lag.LagMs(now));
+      }
+    }
     return res;
   };
 
@@ -1107,6 +1296,39 @@ uint32_t DflyShardReplica::FlowId() const {
   return flow_id_;
 }
 
+void DflyShardReplica::UpdateLag(LSN master_lsn) {
+  constexpr size_t kMaxPendingLsns = 1024;
+  if (!lag_)
+    return;
+
+  uint64_t now = Proactor()->GetMonotonicTimeNs();
+  uint64_t executed = journal_rec_executed_.load(memory_order_relaxed);
+  while (!pending_lsns_.empty() && pending_lsns_.front().first <= executed) {
+    lag_->caught_up_ns.store(pending_lsns_.front().second, memory_order_relaxed);
+    pending_lsns_.pop_front();
+  }
+
+  if (master_lsn <= executed) {
+    pending_lsns_.clear();
+    lag_->caught_up_ns.store(now, memory_order_relaxed);
+  } else if (pending_lsns_.size() < kMaxPendingLsns) {  // otherwise the estimate grows.
+    pending_lsns_.emplace_back(master_lsn, now);
+  }
+  lag_->lsn_lag.store(master_lsn > executed ? master_lsn - executed : 0, memory_order_relaxed);
+}
+
+void DflyShardReplica::AddExecutedRecords(uint32_t count) {
+  uint64_t executed = journal_rec_executed_.fetch_add(count, std::memory_order_relaxed) + count;
+  // The waker is shared with the other flow fibers, make sure the acks fiber sees it.
+  if (ping_offs_ > ack_offs_ && executed >= ping_offs_)
+    waker_.notifyAll();
+}
+
+bool DflyShardReplica::HasExecutedAhead() const {
+  return any_of(trans_data_queue_.begin(), trans_data_queue_.end(),
+                [](const QueuedTx& data) { return data.executed; });
+}
+
 uint64_t DflyShardReplica::JournalExecutedCount() const {
   return journal_rec_executed_.load(std::memory_order_relaxed);
 }
@@ -1117,8 +1339,22 @@ void DflyShardReplica::JoinFlow() {
   execution_fb_.JoinIfNeeded();
 }
 
+error_code DflyStripeClient::Join(const MasterContext& master_context, uint32_t flow_id,
+                                  unsigned index) {
+  RETURN_ON_ERR(ConnectAndAuth(absl::GetFlag(FLAGS_master_connect_timeout_ms) * 1ms, &cntx_));
+
+  ResetParser(/*server_mode=*/false);
+  RETURN_ON_ERR(SendCommandAndReadResponse(StrCat("DFLY STRIPE ", master_context.master_repl_id,
+                                                  " ", master_context.dfly_session_id, " ",
+                                                  flow_id, " ", index)));
+  PC_RETURN_ON_BAD_RESPONSE(CheckRespIsSimpleReply("OK"));
+  return error_code{};
+}
+
 void DflyShardReplica::Cancel() {
   CloseSocket();
+  for (auto& stripe : stripes_)
+    stripe->CloseSocket();
   waker_.notifyAll();
 }
 
@@ -3,9 +3,11 @@
 //
 #pragma once
 
+#include <absl/container/flat_hash_set.h>
 #include <absl/container/inlined_vector.h>
 
 #include <boost/fiber/barrier.hpp>
+#include <deque>
 #include <queue>
 #include <variant>
 
@@ -16,6 +18,7 @@
 #include "server/journal/tx_executor.h"
 #include "server/journal/types.h"
 #include "server/protocol_client.h"
+#include "server/server_state.h"
 #include "server/version.h"
 #include "util/fiber_socket_base.h"
 
@@ -29,6 +32,7 @@ class Service;
 class ConnectionContext;
 class JournalExecutor;
 struct JournalReader;
+class JournalCommandTable;
 class DflyShardReplica;
 
 // The attributes of the master we are connecting to.
@@ -36,6 +40,10 @@ struct MasterContext {
   std::string master_repl_id;
   std::string dfly_session_id;  // Sync session id for dfly sync.
   DflyVersion version = DflyVersion::VER0;
+  bool journal_compression = false;  // The master compresses the stable sync stream.
+
+  // The command table of the master's compact journal encoding, null if it is disabled.
+  std::shared_ptr<const JournalCommandTable> journal_commands;
 };
 
 // This class manages replication from both Dragonfly and Redis masters.
@@ -76,6 +84,10 @@ class Replica : ProtocolClient {
     return master_context_.master_repl_id;
   }
 
+  // Continues from the journal positions of a snapshot of the master that was loaded before the
+  // replication started, the master falls back to a full sync if it does not have them.
+  void SetJournalPosition(std::string master_repl_id, std::vector<LSN> lsns);
+
  private: /* Main standalone mode functions */
   // Coordinate state transitions. Spawned by start.
   void MainReplicationFb();
@@ -121,6 +133,7 @@ class Replica : ProtocolClient {
     bool full_sync_done;
     time_t master_last_io_sec;  // monotonic clock.
     std::string master_id;
+    std::vector<std::pair<uint64_t, uint64_t>> flow_lags;  // LSN lag and lag in ms per shard.
   };
 
   Info GetInfo() const;  // thread-safe, blocks fiber
@@ -151,6 +164,8 @@ class Replica : ProtocolClient {
   EventCount waker_;
 
   std::vector<std::unique_ptr<DflyShardReplica>> shard_flows_;
+  std::shared_ptr<std::vector<ReplicaFlowLag>> flow_lags_;  // published to all threads.
+
   // A vector of the last executer LSNs when a replication is interrupted.
   // Allows partial sync on reconnects.
   std::optional<std::vector<LSN>> last_journal_LSNs_;
@@ -171,6 +186,21 @@ class Replica : ProtocolClient {
 
 // This class implements a single shard replication flow from a Dragonfly master instance.
 // Multiple DflyShardReplica objects are managed by a Replica object.
+// An extra connection of a flow that the full sync of the flow is striped over.
+class DflyStripeClient : public ProtocolClient {
+ public:
+  explicit DflyStripeClient(ServerContext server_context)
+      : ProtocolClient(std::move(server_context)) {
+  }
+
+  // Connects and registers as the stripe index of the flow with DFLY STRIPE.
+  std::error_code Join(const MasterContext& master_context, uint32_t flow_id, unsigned index);
+
+  io::Source* Source() const {
+    return Sock();
+  }
+};
+
 class DflyShardReplica : public ProtocolClient {
  public:
   DflyShardReplica(ServerContext server_context, MasterContext master_context, uint32_t flow_id,
@@ -197,7 +227,14 @@ class DflyShardReplica : public ProtocolClient {
 
   void StableSyncDflyExecFb(Context* cntx);
 
-  void ExecuteTx(TransactionData&& tx_data, bool inserted_by_me, Context* cntx);
+  // Returns false if it was cancelled before the transaction was executed.
+  bool ExecuteTx(TransactionData&& tx_data, bool inserted_by_me, Context* cntx);
+
+  // Executes the first transaction in the queue that can run before the transactions in front
+  // of it, which wait for other flows. It must not share arguments with them, and all of
+  // its commands must have keys. Keyless commands are barriers. Returns whether one was
+  // executed. Consecutive calls for the same front continue the scan where it stopped.
+  bool ExecuteAhead(Context* cntx);
   void InsertTxDataToShardResource(TransactionData&& tx_data);
   void ExecuteTxWithNoShardSync(TransactionData&& tx_data, Context* cntx);
 
@@ -205,13 +242,42 @@ class DflyShardReplica : public ProtocolClient {
 
   uint64_t JournalExecutedCount() const;
 
+  // Whether transactions after a transaction that did not finish were executed. Their records
+  // are not counted as executed until the preceding ones are, so partial sync would repeat them.
+  bool HasExecutedAhead() const;
+
+  void SetLag(ReplicaFlowLag* lag) {
+    lag_ = lag;
+  }
+
  private:
+  // Updates the lag with a LSN heartbeat of the master.
+  void UpdateLag(LSN master_lsn);
+
+  // Counts executed records and wakes the acks fiber when a PING can be acknowledged.
+  void AddExecutedRecords(uint32_t count);
+
   Service& service_;
   MasterContext master_context_;
 
   std::optional<base::IoBuf> leftover_buf_;
 
-  std::queue<std::pair<TransactionData, bool>> trans_data_queue_;
+  // The connections after this one that the full sync is striped over.
+  std::vector<std::unique_ptr<DflyStripeClient>> stripes_;
+
+  struct QueuedTx {
+    TransactionData tx;
+    bool inserted_by_me;
+    bool has_keys;          // all of its commands have keys.
+    bool executed = false;  // executed ahead of the transactions in front of it.
+  };
+
+  std::deque<QueuedTx> trans_data_queue_;
+
+  // ExecuteAhead scan state for the current front of trans_data_queue_, reset when it's popped.
+  // The views point into the arguments of the queued transactions, which deque keeps in place.
+  size_t ahead_pos_ = 0;
+  absl::flat_hash_set<std::string_view> ahead_waiting_args_;
   static constexpr size_t kYieldAfterItemsInQueue = 50;
   EventCount waker_;  // waker for trans_data_queue_
   bool use_multi_shard_exe_sync_;
@@ -232,9 +298,15 @@ class DflyShardReplica : public ProtocolClient {
   Fiber acks_fb_;
   size_t ack_offs_ = 0;
 
-  bool force_ping_ = false;
+  // The offset after the last PING from the master. The master waits for its ACK, so it is sent as
+  // soon as all the records before the PING are executed.
+  uint64_t ping_offs_ = 0;
   Fiber execution_fb_;
 
+  ReplicaFlowLag* lag_ = nullptr;
+  // Heartbeats received before their preceding records were executed, with their arrival time.
+  std::deque<std::pair<LSN, uint64_t>> pending_lsns_;
+
   std::shared_ptr<MultiShardExecution> multi_shard_exe_;
   uint32_t flow_id_ = UINT32_MAX;  // Flow id if replica acts as a dfly flow.
 };
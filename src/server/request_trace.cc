@@ -0,0 +1,66 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/request_trace.h"
+
+#include <absl/strings/str_cat.h>
+#include <absl/time/clock.h>
+
+#include <atomic>
+
+#include "server/server_state.h"
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+atomic_uint64_t next_trace_id{1};
+
+void AppendEvent(string_view name, string_view cat, uint32_t tid, uint64_t start_ns,
+                 uint64_t end_ns, uint64_t trace_id, string* out) {
+  if (!out->empty() && out->back() == '}')
+    out->push_back(',');
+
+  // Chrome trace timestamps are in microseconds.
+  absl::StrAppend(out, "{\"name\":\"", name, "\",\"cat\":\"", cat, "\",\"ph\":\"X\",\"ts\":",
+                  start_ns / 1000, ".", absl::Dec(start_ns % 1000, absl::kZeroPad3),
+                  ",\"dur\":", (end_ns - start_ns) / 1000, ".",
+                  absl::Dec((end_ns - start_ns) % 1000, absl::kZeroPad3),
+                  ",\"pid\":1,\"tid\":", tid, ",\"args\":{\"trace_id\":", trace_id, "}}");
+}
+
+}  // namespace
+
+RequestTrace::RequestTrace(string_view cmd)
+    : id_(next_trace_id.fetch_add(1, memory_order_relaxed)),
+      start_ns_(absl::GetCurrentTimeNanos()),
+      cmd_(cmd) {
+}
+
+void RequestTrace::AddSpan(const char* name, uint64_t start_ns, uint64_t end_ns) {
+  uint32_t thread = ServerState::tlocal()->thread_index();
+  absl::base_internal::SpinLockHolder lk{&mu_};
+  spans_.push_back(Span{name, thread, start_ns, end_ns});
+}
+
+void RequestTrace::AppendChromeEvents(string* out) const {
+  absl::base_internal::SpinLockHolder lk{&mu_};
+  for (const Span& span : spans_) {
+    // The root span is named after the command, the phases of its transaction are grouped by it.
+    string_view name = span.name ? string_view{span.name} : cmd_;
+    AppendEvent(name, cmd_, span.thread, span.start_ns, span.end_ns, id_, out);
+  }
+}
+
+string ToChromeTrace(const vector<shared_ptr<const RequestTrace>>& traces) {
+  string events;
+  for (const auto& trace : traces) {
+    trace->AppendChromeEvents(&events);
+  }
+  return absl::StrCat("{\"traceEvents\":[", events, "],\"displayTimeUnit\":\"ns\"}");
+}
+
+}  // namespace dfly
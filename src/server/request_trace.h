@@ -0,0 +1,95 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/base/internal/spinlock.h>
+
+#include <boost/circular_buffer.hpp>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace dfly {
+
+// The spans of a sampled command, from its dispatch on the connection fiber to the phases of its
+// transaction on the shard threads. Shard callbacks of the same hop record spans in parallel.
+class RequestTrace {
+ public:
+  struct Span {
+    const char* name;  // static string, null for the root span named after the command
+    uint32_t thread;   // index of the thread that recorded the span
+    uint64_t start_ns;
+    uint64_t end_ns;
+  };
+
+  explicit RequestTrace(std::string_view cmd);
+
+  // Thread safe.
+  void AddSpan(const char* name, uint64_t start_ns, uint64_t end_ns);
+
+  // Appends the spans as comma separated events of the Chrome trace event format.
+  void AppendChromeEvents(std::string* out) const;
+
+  uint64_t id() const {
+    return id_;
+  }
+
+  uint64_t start_ns() const {
+    return start_ns_;
+  }
+
+  std::string_view cmd() const {
+    return cmd_;
+  }
+
+ private:
+  uint64_t id_;
+  uint64_t start_ns_;
+  std::string cmd_;
+
+  mutable absl::base_internal::SpinLock mu_;
+  std::vector<Span> spans_;
+};
+
+// Thread local ring of the recently sampled traces.
+class RequestTraceRing {
+ public:
+  // Returns true for every sample_every-th command of the thread, never if it's 0.
+  bool ShouldSample() {
+    return sample_every_ > 0 && ++sampled_cnt_ % sample_every_ == 0;
+  }
+
+  void SetSampleEvery(uint32_t sample_every) {
+    sample_every_ = sample_every;
+  }
+
+  void ChangeLength(size_t new_length) {
+    traces_.set_capacity(new_length);
+  }
+
+  void Add(std::shared_ptr<const RequestTrace> trace) {
+    if (traces_.capacity() > 0)
+      traces_.push_back(std::move(trace));
+  }
+
+  void Reset() {
+    traces_.clear();
+  }
+
+  const boost::circular_buffer<std::shared_ptr<const RequestTrace>>& Traces() const {
+    return traces_;
+  }
+
+ private:
+  uint32_t sample_every_ = 0;
+  uint64_t sampled_cnt_ = 0;
+  boost::circular_buffer<std::shared_ptr<const RequestTrace>> traces_;
+};
+
+// Returns the traces as a Chrome trace JSON document, viewable in chrome://tracing or Perfetto.
+std::string ToChromeTrace(const std::vector<std::shared_ptr<const RequestTrace>>& traces);
+
+}  // namespace dfly
@@ -10,6 +10,7 @@
 #include <absl/strings/numbers.h>
 #include <absl/strings/str_cat.h>
 #include <absl/strings/str_split.h>
+#include <absl/time/clock.h>
 
 #include <regex>
 #include <string>
@@ -74,6 +75,8 @@ void ScriptMgr::Run(CmdArgList args, ConnectionContext* cntx) {
         "   Lists loaded scripts.",
         "LATENCY",
         "   Prints latency histograms in usec for every called function.",
+        "STATS",
+        "   Prints the number of compiled scripts and bytecode loads and the time spent on them.",
         "HELP"
         "   Prints this help."};
     auto rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
@@ -89,6 +92,9 @@ void ScriptMgr::Run(CmdArgList args, ConnectionContext* cntx) {
   if (subcmd == "LATENCY")
     return LatencyCmd(cntx);
 
+  if (subcmd == "STATS")
+    return StatsCmd(cntx);
+
   if (subcmd == "LOAD" && args.size() == 2)
     return LoadCmd(args, cntx);
 
@@ -192,6 +198,19 @@ void ScriptMgr::LatencyCmd(ConnectionContext* cntx) const {
   }
 }
 
+void ScriptMgr::StatsCmd(ConnectionContext* cntx) const {
+  auto rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+  rb->StartCollection(4, RedisReplyBuilder::MAP);
+  rb->SendBulkString("compiled_scripts");
+  rb->SendLong(stats_.compile_cnt.load(memory_order_relaxed));
+  rb->SendBulkString("compile_usec");
+  rb->SendLong(stats_.compile_usec.load(memory_order_relaxed));
+  rb->SendBulkString("loaded_scripts");
+  rb->SendLong(stats_.load_cnt.load(memory_order_relaxed));
+  rb->SendBulkString("load_usec");
+  rb->SendLong(stats_.load_usec.load(memory_order_relaxed));
+}
+
 // Check if script starts with shebang (#!lua). If present, look for flags parameter and truncate
 // it.
 io::Result<optional<ScriptMgr::ScriptParams>, GenericError> DeduceParams(string_view* body) {
@@ -226,6 +245,12 @@ io::Result<string, GenericError> ScriptMgr::Insert(string_view body, Interpreter
     return string{sha};
   }
 
+  // Compiled already by another interpreter
+  if (auto data = Find(sha); data && data->bytecode) {
+    AddToInterpreter(sha, *data, interpreter);
+    return string{sha};
+  }
+
   string_view orig_body = body;
 
   auto params_opt = DeduceParams(&body);
@@ -242,11 +267,16 @@ io::Result<string, GenericError> ScriptMgr::Insert(string_view body, Interpreter
       body = *async_body;
   }
 
-  string result;
-  Interpreter::AddResult add_result = interpreter->AddFunction(sha, body, &result);
+  string result, bytecode;
+  uint64_t start = absl::GetCurrentTimeNanos();
+  Interpreter::AddResult add_result = interpreter->AddFunction(sha, body, &result, &bytecode);
   if (add_result == Interpreter::COMPILE_ERR)
     return nonstd::make_unexpected(GenericError{std::move(result)});
 
+  stats_.compile_cnt.fetch_add(1, memory_order_relaxed);
+  stats_.compile_usec.fetch_add((absl::GetCurrentTimeNanos() - start) / 1000,
+                                memory_order_relaxed);
+
   lock_guard lk{mu_};
   auto [it, _] = db_.emplace(sha, InternalScriptData{params, nullptr});
 
@@ -255,6 +285,8 @@ io::Result<string, GenericError> ScriptMgr::Insert(string_view body, Interpreter
     if (body != orig_body)
       it->second.orig_body = CharBufFromSV(orig_body);
   }
+  if (!it->second.bytecode && !bytecode.empty())
+    it->second.bytecode = make_shared<const string>(std::move(bytecode));
 
   UpdateScriptCaches(sha, it->second);
 
@@ -267,11 +299,32 @@ optional<ScriptMgr::ScriptData> ScriptMgr::Find(std::string_view sha) const {
 
   lock_guard lk{mu_};
   if (auto it = db_.find(sha); it != db_.end() && it->second.body)
-    return ScriptData{it->second, it->second.body.get(), {}};
+    return ScriptData{it->second, it->second.body.get(), {}, it->second.bytecode};
 
   return std::nullopt;
 }
 
+void ScriptMgr::AddToInterpreter(string_view sha, const ScriptData& data,
+                                 Interpreter* interpreter) {
+  string err;
+  uint64_t start = absl::GetCurrentTimeNanos();
+
+  Interpreter::AddResult res;
+  if (data.bytecode) {
+    res = interpreter->AddCompiledFunction(sha, *data.bytecode, &err);
+    stats_.load_cnt.fetch_add(1, memory_order_relaxed);
+    stats_.load_usec.fetch_add((absl::GetCurrentTimeNanos() - start) / 1000,
+                               memory_order_relaxed);
+  } else {
+    res = interpreter->AddFunction(sha, data.body, &err);
+    stats_.compile_cnt.fetch_add(1, memory_order_relaxed);
+    stats_.compile_usec.fetch_add((absl::GetCurrentTimeNanos() - start) / 1000,
+                                  memory_order_relaxed);
+  }
+
+  CHECK_NE(Interpreter::COMPILE_ERR, res) << err;
+}
+
 vector<pair<string, ScriptMgr::ScriptData>> ScriptMgr::GetAll() const {
   vector<pair<string, ScriptData>> res;
 
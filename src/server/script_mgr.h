@@ -7,6 +7,8 @@
 #include <absl/container/flat_hash_map.h>
 
 #include <array>
+#include <atomic>
+#include <memory>
 #include <optional>
 
 #include "server/conn_context.h"
@@ -33,6 +35,9 @@ class ScriptMgr {
   struct ScriptData : public ScriptParams {
     std::string body;       // script source code present in lua interpreter
     std::string orig_body;  // original code, before removing header and adding async
+
+    // Compiled body, shared by the interpreters of all threads.
+    std::shared_ptr<const std::string> bytecode;
   };
 
   struct ScriptKey : public std::array<char, 40> {
@@ -51,6 +56,9 @@ class ScriptMgr {
   // Get script body by sha, returns nullptr if not found.
   std::optional<ScriptData> Find(std::string_view sha) const;
 
+  // Add a script returned by Find() to the interpreter, loading its bytecode if present.
+  void AddToInterpreter(std::string_view sha, const ScriptData& data, Interpreter* interpreter);
+
   // Returns a list of all scripts in the database with their sha and body.
   std::vector<std::pair<std::string, ScriptData>> GetAll() const;
 
@@ -63,6 +71,7 @@ class ScriptMgr {
   void ConfigCmd(CmdArgList args, ConnectionContext* cntx);
   void ListCmd(ConnectionContext* cntx) const;
   void LatencyCmd(ConnectionContext* cntx) const;
+  void StatsCmd(ConnectionContext* cntx) const;
 
   void UpdateScriptCaches(ScriptKey sha, ScriptParams params) const;
 
@@ -70,9 +79,17 @@ class ScriptMgr {
   struct InternalScriptData : public ScriptParams {
     std::unique_ptr<char[]> body{};
     std::unique_ptr<char[]> orig_body{};
+    std::shared_ptr<const std::string> bytecode{};
+  };
+
+  // Scripts compiled from source and bytecode loads into interpreters, with their total time.
+  struct Stats {
+    std::atomic_uint64_t compile_cnt{0}, compile_usec{0};
+    std::atomic_uint64_t load_cnt{0}, load_usec{0};
   };
 
   ScriptParams default_params_;
+  Stats stats_;
 
   absl::flat_hash_map<ScriptKey, InternalScriptData> db_;
   mutable Mutex mu_;
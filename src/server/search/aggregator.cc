@@ -4,39 +4,73 @@
 
 #include "server/search/aggregator.h"
 
+#include <numeric>
+
 #include "base/logging.h"
 
 namespace dfly::aggregate {
 
 namespace {
 
+const Value kEmptyValue = Value{};
+
+const Value& GetValue(const DocValues& dv, std::string_view field) {
+  auto it = dv.find(field);
+  return it != dv.end() ? it->second : kEmptyValue;
+}
+
+// Fetch the values of a field from the documents in the given order, so that steps work on
+// columns with a single lookup per document and field.
+std::vector<const Value*> LoadColumn(absl::Span<const DocValues> values, std::string_view field,
+                                     absl::Span<const size_t> order) {
+  std::vector<const Value*> column(order.size());
+  for (size_t i = 0; i < order.size(); i++)
+    column[i] = &GetValue(values[order[i]], field);
+  return column;
+}
+
 struct GroupStep {
   PipelineResult operator()(std::vector<DocValues> values) {
-    // Separate items into groups
-    absl::flat_hash_map<absl::FixedArray<Value>, std::vector<DocValues>> groups;
-    for (auto& value : values) {
-      groups[Extract(value)].push_back(std::move(value));
-    }
+    // Assign group indices in order of appearance
+    absl::flat_hash_map<absl::FixedArray<Value>, size_t> groups;
+    std::vector<size_t> group_of(values.size());
+    for (size_t i = 0; i < values.size(); i++)
+      group_of[i] = groups.try_emplace(Extract(values[i]), groups.size()).first->second;
+
+    // Order documents by group, so every group is a continuous range of the reducer columns
+    std::vector<size_t> offsets(groups.size() + 1, 0);
+    for (size_t group : group_of)
+      offsets[group + 1]++;
+    for (size_t i = 1; i < offsets.size(); i++)
+      offsets[i] += offsets[i - 1];
+
+    std::vector<size_t> order(values.size());
+    std::vector<size_t> next(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < values.size(); i++)
+      order[next[group_of[i]]++] = i;
 
     // Restore DocValues and apply reducers
-    std::vector<DocValues> out;
+    std::vector<DocValues> out(groups.size());
     while (!groups.empty()) {
       auto node = groups.extract(groups.begin());
-      DocValues doc = Unpack(std::move(node.key()));
-      for (auto& reducer : reducers_) {
-        doc[reducer.result_field] = reducer.func({reducer.source_field, node.mapped()});
+      out[node.mapped()] = Unpack(std::move(node.key()));
+    }
+
+    for (auto& reducer : reducers_) {
+      auto column = LoadColumn(values, reducer.source_field, order);
+      for (size_t group = 0; group < out.size(); group++) {
+        auto range = absl::MakeConstSpan(column).subspan(offsets[group],
+                                                         offsets[group + 1] - offsets[group]);
+        out[group][reducer.result_field] = reducer.func(ValueIterator{range});
       }
-      out.push_back(std::move(doc));
     }
     return out;
   }
 
   absl::FixedArray<Value> Extract(const DocValues& dv) {
     absl::FixedArray<Value> out(fields_.size());
-    for (size_t i = 0; i < fields_.size(); i++) {
-      auto it = dv.find(fields_[i]);
-      out[i] = (it != dv.end()) ? it->second : Value{};
-    }
+    for (size_t i = 0; i < fields_.size(); i++)
+      out[i] = GetValue(dv, fields_[i]);
     return out;
   }
 
@@ -52,20 +86,8 @@ struct GroupStep {
   std::vector<Reducer> reducers_;
 };
 
-const Value kEmptyValue = Value{};
-
 }  // namespace
 
-const Value& ValueIterator::operator*() const {
-  auto it = values_.front().find(field_);
-  return it == values_.front().end() ? kEmptyValue : it->second;
-}
-
-ValueIterator& ValueIterator::operator++() {
-  values_.remove_prefix(1);
-  return *this;
-}
-
 Reducer::Func FindReducerFunc(std::string_view name) {
   const static auto kCountReducer = [](ValueIterator it) -> double {
     return std::distance(it, it.end());
@@ -98,14 +120,22 @@ PipelineStep MakeGroupStep(absl::Span<const std::string_view> fields,
 
 PipelineStep MakeSortStep(std::string field, bool descending) {
   return [field, descending](std::vector<DocValues> values) -> PipelineResult {
-    std::sort(values.begin(), values.end(), [field](const DocValues& l, const DocValues& r) {
-      auto it1 = l.find(field);
-      auto it2 = r.find(field);
-      return it1 == l.end() || (it2 != r.end() && it1->second < it2->second);
-    });
+    // Sort positions by a column of the field values and then move the documents to them
+    std::vector<size_t> order(values.size());
+    std::iota(order.begin(), order.end(), 0);
+    auto column = LoadColumn(values, field, order);
+
+    // Absent values are monostate, which is less than any other value
+    std::stable_sort(order.begin(), order.end(),
+                     [&column](size_t l, size_t r) { return *column[l] < *column[r]; });
     if (descending)
-      std::reverse(values.begin(), values.end());
-    return values;
+      std::reverse(order.begin(), order.end());
+
+    std::vector<DocValues> out;
+    out.reserve(values.size());
+    for (size_t i : order)
+      out.push_back(std::move(values[i]));
+    return out;
   };
 }
 
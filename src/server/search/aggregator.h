@@ -21,7 +21,7 @@ using DocValues = absl::flat_hash_map<std::string, Value>;  // documents sent th
 using PipelineResult = io::Result<std::vector<DocValues>, facade::ErrorReply>;
 using PipelineStep = std::function<PipelineResult(std::vector<DocValues>)>;  // Group, Sort, etc.
 
-// Iterator over Span<DocValues> that yields doc[field] or monostate if not present.
+// Iterator over a column of values of a document group, absent values are monostate.
 // Extra clumsy for STL compatibility!
 struct ValueIterator {
   using iterator_category = std::forward_iterator_tag;
@@ -30,13 +30,17 @@ struct ValueIterator {
   using pointer = const Value*;
   using reference = const Value&;
 
-  ValueIterator(std::string_view field, absl::Span<const DocValues> values)
-      : field_{field}, values_{values} {
+  explicit ValueIterator(absl::Span<const Value* const> values) : values_{values} {
   }
 
-  const Value& operator*() const;
+  const Value& operator*() const {
+    return *values_.front();
+  }
 
-  ValueIterator& operator++();
+  ValueIterator& operator++() {
+    values_.remove_prefix(1);
+    return *this;
+  }
 
   bool operator==(const ValueIterator& other) const {
     return values_.size() == other.values_.size();
@@ -47,14 +51,11 @@ struct ValueIterator {
   }
 
   static ValueIterator end() {
-    return ValueIterator{};
+    return ValueIterator{{}};
   }
 
  private:
-  ValueIterator() = default;
-
-  std::string_view field_;
-  absl::Span<const DocValues> values_;
+  absl::Span<const Value* const> values_;
 };
 
 struct Reducer {
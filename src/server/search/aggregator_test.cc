@@ -103,4 +103,48 @@ TEST(AggregatorTest, GroupWithReduce) {
   EXPECT_EQ(result->at(1).at("distinct-null"), Value{(double)1});
 }
 
+TEST(AggregatorTest, SortMissingValues) {
+  std::vector<DocValues> values = {
+      DocValues{{"a", 2.0}, {"id", "x"}},
+      DocValues{{"id", "y"}},
+      DocValues{{"a", 1.0}, {"id", "z"}},
+      DocValues{{"id", "w"}},
+  };
+  PipelineStep steps[] = {MakeSortStep("a", false)};
+
+  auto result = Process(values, steps);
+
+  // Documents without the field come first and keep their order
+  EXPECT_TRUE(result);
+  EXPECT_EQ(result->at(0)["id"], Value("y"));
+  EXPECT_EQ(result->at(1)["id"], Value("w"));
+  EXPECT_EQ(result->at(2)["id"], Value("z"));
+  EXPECT_EQ(result->at(3)["id"], Value("x"));
+}
+
+TEST(AggregatorTest, GroupReduceMinMaxAvg) {
+  std::vector<DocValues> values;
+  for (size_t i = 0; i < 30; i++)
+    values.push_back(DocValues{{"i", double(i)}, {"mod", double(i % 3)}});
+
+  std::string_view fields[] = {"mod"};
+  std::vector<Reducer> reducers = {Reducer{"i", "min", FindReducerFunc("MIN")},
+                                   Reducer{"i", "max", FindReducerFunc("MAX")},
+                                   Reducer{"i", "avg", FindReducerFunc("AVG")}};
+  PipelineStep steps[] = {MakeGroupStep(fields, std::move(reducers))};
+
+  auto result = Process(values, steps);
+  EXPECT_TRUE(result);
+  ASSERT_EQ(result->size(), 3);
+
+  // Groups are returned in order of appearance
+  for (size_t mod = 0; mod < 3; mod++) {
+    auto& group = result->at(mod);
+    EXPECT_EQ(group.at("mod"), Value(double(mod)));
+    EXPECT_EQ(group.at("min"), Value(double(mod)));
+    EXPECT_EQ(group.at("max"), Value(double(27 + mod)));
+    EXPECT_EQ(group.at("avg"), Value(double(13.5 + mod)));
+  }
+}
+
 }  // namespace dfly::aggregate
@@ -106,11 +106,8 @@ SearchDocData StringMapAccessor::Serialize(const search::Schema& schema) const {
   return out;
 }
 
-struct JsonAccessor::JsonPathContainer : public jsoncons::jsonpath::jsonpath_expression<JsonType> {
-};
-
 BaseAccessor::StringList JsonAccessor::GetStrings(string_view active_field) const {
-  auto* path = GetPath(active_field);
+  auto path = GetPath(active_field);
   if (!path)
     return {};
 
@@ -147,7 +144,7 @@ BaseAccessor::StringList JsonAccessor::GetStrings(string_view active_field) cons
 }
 
 BaseAccessor::VectorInfo JsonAccessor::GetVector(string_view active_field) const {
-  auto* path = GetPath(active_field);
+  auto path = GetPath(active_field);
   if (!path)
     return {};
 
@@ -166,24 +163,13 @@ BaseAccessor::VectorInfo JsonAccessor::GetVector(string_view active_field) const
   return {std::move(ptr), size};
 }
 
-JsonAccessor::JsonPathContainer* JsonAccessor::GetPath(std::string_view field) const {
-  if (auto it = path_cache_.find(field); it != path_cache_.end()) {
-    return it->second.get();
-  }
-
+shared_ptr<const JsonExpression> JsonAccessor::GetPath(std::string_view field) const {
   error_code ec;
-  auto path_expr = MakeJsonPathExpr(field, ec);
-
+  auto path = GetJsonPathExpr(field, ec);
   if (ec) {
     LOG(WARNING) << "Invalid Json path: " << field << ' ' << ec.message();
     return nullptr;
   }
-
-  JsonPathContainer path_container{move(path_expr)};
-  auto ptr = make_unique<JsonPathContainer>(move(path_container));
-
-  JsonPathContainer* path = ptr.get();
-  path_cache_[field] = move(ptr);
   return path;
 }
 
@@ -195,7 +181,7 @@ SearchDocData JsonAccessor::Serialize(const search::Schema& schema,
                                       const SearchParams::FieldReturnList& fields) const {
   SearchDocData out{};
   for (const auto& [ident, name] : fields) {
-    if (auto* path = GetPath(ident); path) {
+    if (auto path = GetPath(ident); path) {
       if (auto res = path->evaluate(json_); !res.empty())
         out[name] = res[0].to_string();
     }
@@ -204,16 +190,19 @@ SearchDocData JsonAccessor::Serialize(const search::Schema& schema,
 }
 
 void JsonAccessor::RemoveFieldFromCache(string_view field) {
-  path_cache_.erase(field);
+  EvictJsonPathExpr(field);
 }
 
-thread_local absl::flat_hash_map<std::string, std::unique_ptr<JsonAccessor::JsonPathContainer>>
-    JsonAccessor::path_cache_;
-
 unique_ptr<BaseAccessor> GetAccessor(const DbContext& db_cntx, const PrimeValue& pv) {
   DCHECK(pv.ObjType() == OBJ_HASH || pv.ObjType() == OBJ_JSON);
 
   if (pv.ObjType() == OBJ_JSON) {
+    if (pv.IsPackedJson()) {
+      auto json = UnpackJson(pv.GetPackedJson());
+      DCHECK(json);
+      return make_unique<JsonAccessor>(std::move(*json));
+    }
+
     DCHECK(pv.GetJson());
     return make_unique<JsonAccessor>(pv.GetJson());
   }
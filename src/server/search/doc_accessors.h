@@ -7,6 +7,7 @@
 #include <absl/container/flat_hash_map.h>
 #include <absl/types/span.h>
 
+#include <optional>
 #include <string>
 #include <utility>
 
@@ -63,11 +64,13 @@ struct StringMapAccessor : public BaseAccessor {
 
 // Accessor for json values
 struct JsonAccessor : public BaseAccessor {
-  struct JsonPathContainer;  // contains jsoncons::jsonpath::jsonpath_expression
-
   explicit JsonAccessor(const JsonType* json) : json_{*json} {
   }
 
+  // Takes ownership of a json value decoded for the accessor, used for packed values.
+  explicit JsonAccessor(JsonType&& json) : owned_json_{std::move(json)}, json_{*owned_json_} {
+  }
+
   StringList GetStrings(std::string_view field) const override;
   VectorInfo GetVector(std::string_view field) const override;
   SearchDocData Serialize(const search::Schema& schema) const override;
@@ -79,15 +82,12 @@ struct JsonAccessor : public BaseAccessor {
   static void RemoveFieldFromCache(std::string_view field);
 
  private:
-  /// Parses `field` into a JSON path. Caches the results internally.
-  JsonPathContainer* GetPath(std::string_view field) const;
+  /// Parses `field` into a JSON path. Uses the thread local cache of compiled json paths.
+  std::shared_ptr<const JsonExpression> GetPath(std::string_view field) const;
 
+  std::optional<JsonType> owned_json_;
   const JsonType& json_;
   mutable std::string buf_;
-
-  // Contains built json paths to avoid parsing them repeatedly
-  static thread_local absl::flat_hash_map<std::string, std::unique_ptr<JsonPathContainer>>
-      path_cache_;
 };
 
 // Get accessor for value
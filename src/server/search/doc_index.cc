@@ -4,26 +4,102 @@
 
 #include "server/search/doc_index.h"
 
+#include <absl/strings/str_cat.h>
 #include <absl/strings/str_join.h>
 
 #include <memory>
 
+#include "base/flags.h"
 #include "base/logging.h"
 #include "core/overloaded.h"
 #include "server/engine_shard_set.h"
 #include "server/search/doc_accessors.h"
 #include "server/server_state.h"
+#include "server/tiered_storage.h"
 
 extern "C" {
 #include "redis/object.h"
 };
 
+ABSL_FLAG(uint32_t, search_index_build_threads, 1,
+          "Number of threads that insert existing documents into HNSW vector indices when an "
+          "index is built. 1 inserts them on the shard thread. Above 1, the shard thread is "
+          "helped by a pool of search_index_build_threads - 1 threads shared by all shards");
+
+ABSL_FLAG(uint64_t, search_result_cache_bytes, 0,
+          "Memory limit of the FT.SEARCH result cache of every index on every shard. "
+          "0 disables the cache");
+
 namespace dfly {
 
 using namespace std;
 
 namespace {
 
+// Version of the ShardDocIndices::SerializeIndices format, data of other versions is ignored.
+constexpr uint32_t kSerializationVersion = 1;
+
+// Stores the spilled blocks of the indices in the backing file of the tiered storage.
+class TieredBlockStorage : public search::BlockStorage {
+ public:
+  explicit TieredBlockStorage(TieredStorage* tiered) : tiered_{tiered} {
+  }
+
+  optional<uint64_t> Store(string_view block) override {
+    auto cb = [this](size_t offset, bool success) {
+      auto it = writes_.find(offset);
+      DCHECK(it != writes_.end());
+      if (it->second.freed) {
+        tiered_->FreeBlob(offset, it->second.len);
+        writes_.erase(it);
+      } else if (success) {
+        writes_.erase(it);
+      } else {
+        it->second.failed = true;
+      }
+    };
+
+    int64_t offset = tiered_->WriteBlob(block, cb);
+    if (offset < 0)
+      return nullopt;
+    writes_[offset] = Write{block.size()};
+    return offset;
+  }
+
+  State GetState(uint64_t handle) const override {
+    auto it = writes_.find(handle);
+    if (it == writes_.end())
+      return STORED;
+    return it->second.failed ? FAILED : PENDING;
+  }
+
+  bool Load(uint64_t handle, size_t len, char* dest) override {
+    return !tiered_->Read(handle, len, dest);
+  }
+
+  void Free(uint64_t handle, size_t len) override {
+    auto it = writes_.find(handle);
+    if (it != writes_.end() && !it->second.failed) {
+      it->second.freed = true;  // freed once the write completes
+      return;
+    }
+    if (it != writes_.end())
+      writes_.erase(it);
+    tiered_->FreeBlob(handle, len);
+  }
+
+ private:
+  // Writes that did not complete or failed.
+  struct Write {
+    size_t len;
+    bool failed = false;
+    bool freed = false;
+  };
+
+  TieredStorage* tiered_;
+  absl::flat_hash_map<uint64_t, Write> writes_;
+};
+
 template <typename F>
 void TraverseAllMatching(const DocIndex& index, const OpArgs& op_args, F&& f) {
   auto& db_slice = op_args.shard->db_slice();
@@ -50,6 +126,17 @@ void TraverseAllMatching(const DocIndex& index, const OpArgs& op_args, F&& f) {
   } while (cursor);
 }
 
+// Approximate memory used by a cached search result.
+size_t CachedResultSize(string_view cache_key, const SearchResult& result) {
+  size_t size = cache_key.size() + sizeof(SearchResult);
+  for (const auto& doc : result.docs) {
+    size += sizeof(SerializedSearchDoc) + doc.key.size();
+    for (const auto& [field, value] : doc.values)
+      size += field.size() + value.size() + 2 * sizeof(string);
+  }
+  return size;
+}
+
 const absl::flat_hash_map<string_view, search::SchemaField::FieldType> kSchemaTypes = {
     {"TAG"sv, search::SchemaField::TAG},
     {"TEXT"sv, search::SchemaField::TEXT},
@@ -112,8 +199,12 @@ string DocIndexInfo::BuildRestoreCommand() const {
         [](monostate) {},
         [out = &out](const search::SchemaField::VectorParams& params) {
           auto sim = params.sim == search::VectorSimilarity::L2 ? "L2" : "COSINE";
-          absl::StrAppend(out, " ", params.use_hnsw ? "HNSW" : "FLAT", " 6 ", "DIM ", params.dim,
-                          " DISTANCE_METRIC ", sim, " INITIAL_CAP ", params.capacity);
+          bool quantized = params.quantization == search::VectorQuantization::INT8;
+          absl::StrAppend(out, " ", params.use_hnsw ? "HNSW" : "FLAT", quantized ? " 8 " : " 6 ",
+                          "DIM ", params.dim, " DISTANCE_METRIC ", sim, " INITIAL_CAP ",
+                          params.capacity);
+          if (quantized)
+            absl::StrAppend(out, " QUANTIZATION INT8");
         },
     };
     visit(info, finfo.special_params);
@@ -158,10 +249,54 @@ string_view ShardDocIndex::DocKeyIndex::Get(DocId id) const {
   return keys_[id];
 }
 
+bool ShardDocIndex::DocKeyIndex::Contains(string_view key) const {
+  return ids_.contains(key);
+}
+
 size_t ShardDocIndex::DocKeyIndex::Size() const {
   return ids_.size();
 }
 
+void ShardDocIndex::DocKeyIndex::Serialize(search::IndexWriter* writer) const {
+  writer->Write<uint64_t>(keys_.size());
+  for (const auto& key : keys_)
+    writer->WriteString(key);
+  writer->WriteArray(absl::MakeConstSpan(free_ids_));
+}
+
+bool ShardDocIndex::DocKeyIndex::Deserialize(search::IndexReader* reader) {
+  DCHECK_EQ(keys_.size(), 0u);
+
+  uint64_t size;
+  if (!reader->Read(&size))
+    return false;
+
+  for (uint64_t i = 0; i < size; i++) {
+    string_view key;
+    if (!reader->ReadString(&key))
+      return false;
+    keys_.emplace_back(key);
+  }
+
+  if (!reader->ReadArray(&free_ids_))
+    return false;
+
+  vector<bool> is_free(keys_.size());
+  for (DocId id : free_ids_) {
+    if (id >= keys_.size() || is_free[id])
+      return false;
+    is_free[id] = true;
+  }
+
+  for (DocId id = 0; id < keys_.size(); id++) {
+    if (!is_free[id] && !ids_.emplace(keys_[id], id).second)
+      return false;
+  }
+
+  last_id_ = keys_.size();
+  return true;
+}
+
 uint8_t DocIndex::GetObjCode() const {
   return type == JSON ? OBJ_JSON : OBJ_HASH;
 }
@@ -175,21 +310,63 @@ ShardDocIndex::ShardDocIndex(shared_ptr<DocIndex> index)
 }
 
 void ShardDocIndex::Rebuild(const OpArgs& op_args, PMR_NS::memory_resource* mr) {
+  ClearResultCache();
   key_index_ = DocKeyIndex{};
   indices_ = search::FieldIndices{base_->schema, mr};
 
   auto cb = [this](string_view key, BaseAccessor* doc) { indices_.Add(key_index_.Add(key), doc); };
+  indices_.StartBulkLoad(absl::GetFlag(FLAGS_search_index_build_threads));
   TraverseAllMatching(*base_, op_args, cb);
+  indices_.FinishBulkLoad();
 
   VLOG(1) << "Indexed " << key_index_.Size() << " docs on " << base_->prefix;
 }
 
+bool ShardDocIndex::Restore(const OpArgs& op_args, search::IndexReader* reader,
+                            PMR_NS::memory_resource* mr) {
+  ClearResultCache();
+  key_index_ = DocKeyIndex{};
+  indices_ = search::FieldIndices{base_->schema, mr};
+
+  string_view definition;
+  if (!reader->ReadString(&definition) || definition != GetInfo().BuildRestoreCommand())
+    return false;
+
+  indices_.StartBulkLoad(absl::GetFlag(FLAGS_search_index_build_threads));
+  bool valid = key_index_.Deserialize(reader) && indices_.Deserialize(reader) && reader->Empty();
+  indices_.FinishBulkLoad();
+  if (!valid)
+    return false;
+
+  // All matching documents must be indexed, with equal counts no other documents are.
+  size_t matching = 0;
+  bool all_indexed = true;
+  TraverseAllMatching(*base_, op_args, [&](string_view key, BaseAccessor* doc) {
+    matching++;
+    all_indexed &= key_index_.Contains(key);
+  });
+
+  if (!all_indexed || matching != key_index_.Size())
+    return false;
+
+  VLOG(1) << "Restored " << key_index_.Size() << " docs on " << base_->prefix;
+  return true;
+}
+
+void ShardDocIndex::Serialize(search::IndexWriter* writer) const {
+  writer->WriteString(GetInfo().BuildRestoreCommand());
+  key_index_.Serialize(writer);
+  indices_.Serialize(writer);
+}
+
 void ShardDocIndex::AddDoc(string_view key, const DbContext& db_cntx, const PrimeValue& pv) {
+  ClearResultCache();
   auto accessor = GetAccessor(db_cntx, pv);
   indices_.Add(key_index_.Add(key), accessor.get());
 }
 
 void ShardDocIndex::RemoveDoc(string_view key, const DbContext& db_cntx, const PrimeValue& pv) {
+  ClearResultCache();
   auto accessor = GetAccessor(db_cntx, pv);
   DocId id = key_index_.Remove(key);
   indices_.Remove(id, accessor.get());
@@ -201,7 +378,6 @@ bool ShardDocIndex::Matches(string_view key, unsigned obj_code) const {
 
 SearchResult ShardDocIndex::Search(const OpArgs& op_args, const SearchParams& params,
                                    search::SearchAlgorithm* search_algo) const {
-  auto& db_slice = op_args.shard->db_slice();
   auto search_results = search_algo->Search(&indices_, params.limit_offset + params.limit_total);
 
   if (!search_results.error.empty())
@@ -212,29 +388,101 @@ SearchResult ShardDocIndex::Search(const OpArgs& op_args, const SearchParams& pa
 
   size_t expired_count = 0;
   for (size_t i = 0; i < search_results.ids.size(); i++) {
-    auto key = key_index_.Get(search_results.ids[i]);
-    auto it = db_slice.FindReadOnly(op_args.db_cntx, key, base_->GetObjCode());
+    auto score =
+        search_results.scores.empty() ? std::monostate{} : std::move(search_results.scores[i]);
+    SerializedSearchDoc doc{string{key_index_.Get(search_results.ids[i])}, {}, std::move(score)};
 
-    if (!it || !IsValid(*it)) {  // Item must have expired
+    if (!SerializeDoc(op_args, params, &doc)) {  // Item must have expired
       expired_count++;
       continue;
     }
-
-    auto accessor = GetAccessor(op_args.db_cntx, (*it)->second);
-    auto doc_data = params.return_fields ? accessor->Serialize(base_->schema, *params.return_fields)
-                                         : accessor->Serialize(base_->schema);
-
-    auto score =
-        search_results.scores.empty() ? std::monostate{} : std::move(search_results.scores[i]);
-    out.push_back(SerializedSearchDoc{string{key}, std::move(doc_data), std::move(score)});
+    out.push_back(std::move(doc));
   }
 
   return SearchResult{search_results.total - expired_count, std::move(out),
                       std::move(search_results.profile)};
 }
 
+bool ShardDocIndex::SerializeDoc(const OpArgs& op_args, const SearchParams& params,
+                                 SerializedSearchDoc* doc) const {
+  auto& db_slice = op_args.shard->db_slice();
+  auto it = db_slice.FindReadOnly(op_args.db_cntx, doc->key, base_->GetObjCode());
+  if (!it || !IsValid(*it))
+    return false;
+
+  auto accessor = GetAccessor(op_args.db_cntx, (*it)->second);
+  doc->values = params.return_fields ? accessor->Serialize(base_->schema, *params.return_fields)
+                                     : accessor->Serialize(base_->schema);
+  return true;
+}
+
+SearchResult ShardDocIndex::CachedSearch(const OpArgs& op_args, const SearchParams& params,
+                                         search::SearchAlgorithm* search_algo,
+                                         string_view cache_key) {
+  const size_t max_bytes = absl::GetFlag(FLAGS_search_result_cache_bytes);
+  if (max_bytes == 0)
+    return Search(op_args, params, search_algo);
+
+  // Documents are serialized from the selected database, so it is a part of the key as well.
+  string key = absl::StrCat(op_args.db_cntx.db_index, ":", cache_key);
+
+  if (auto it = result_cache_.find(key); it != result_cache_.end()) {
+    SearchResult result = it->second;
+
+    // Keys that expired since are deleted by the lookups below, which clears the cache.
+    auto& db_slice = op_args.shard->db_slice();
+    bool valid = true;
+    for (const auto& doc : result.docs) {
+      auto doc_it = db_slice.FindReadOnly(op_args.db_cntx, doc.key, base_->GetObjCode());
+      valid &= doc_it && IsValid(*doc_it);
+    }
+
+    if (valid)
+      return result;
+  }
+
+  SearchResult result = Search(op_args, params, search_algo);
+  if (result.error || result.profile)
+    return result;
+
+  size_t size = CachedResultSize(key, result);
+  if (size > max_bytes)
+    return result;
+
+  if (auto it = result_cache_.find(key); it != result_cache_.end()) {
+    result_cache_bytes_ -= CachedResultSize(it->first, it->second);
+    result_cache_.erase(it);
+  }
+
+  // Evict arbitrary entries until the new one fits.
+  while (result_cache_bytes_ + size > max_bytes) {
+    auto it = result_cache_.begin();
+    result_cache_bytes_ -= CachedResultSize(it->first, it->second);
+    result_cache_.erase(it);
+  }
+
+  result_cache_bytes_ += size;
+  result_cache_.emplace(std::move(key), result);
+  return result;
+}
+
+void ShardDocIndex::ClearResultCache() {
+  result_cache_.clear();
+  result_cache_bytes_ = 0;
+}
+
 DocIndexInfo ShardDocIndex::GetInfo() const {
-  return {*base_, key_index_.Size()};
+  return {*base_, key_index_.Size(), result_cache_bytes_, indices_.GetNumVectorTombstones(),
+          indices_.GetNumSpilledVectorBlocks()};
+}
+
+void ShardDocIndex::CompactVectorIndicesStep(double max_deleted_ratio, size_t budget) {
+  indices_.CompactVectorIndicesStep(max_deleted_ratio, budget);
+}
+
+void ShardDocIndex::SpillVectorIndicesStep(search::BlockStorage* storage, size_t max_bytes,
+                                           unsigned budget) {
+  indices_.SpillVectorIndicesStep(storage, max_bytes, budget);
 }
 
 ShardDocIndices::ShardDocIndices() : local_mr_{ServerState::tlocal()->data_heap()} {
@@ -276,8 +524,65 @@ bool ShardDocIndices::DropIndex(string_view name) {
 }
 
 void ShardDocIndices::RebuildAllIndices(const OpArgs& op_args) {
-  for (auto& [_, ptr] : indices_)
+  absl::flat_hash_map<string_view, string_view> serialized;
+  if (!serialized_indices_.empty()) {
+    search::IndexReader reader{serialized_indices_};
+
+    uint32_t version;
+    uint64_t size;
+    bool valid = reader.Read(&version) && version == kSerializationVersion && reader.Read(&size);
+    for (uint64_t i = 0; valid && i < size; i++) {
+      string_view name, data;
+      valid = reader.ReadString(&name) && reader.ReadString(&data);
+      serialized[name] = data;
+    }
+
+    if (!valid) {
+      LOG(WARNING) << "Ignoring malformed serialized search indices";
+      serialized.clear();
+    }
+  }
+
+  for (auto& [name, ptr] : indices_) {
+    if (auto it = serialized.find(name); it != serialized.end()) {
+      search::IndexReader reader{it->second};
+      if (ptr->Restore(op_args, &reader, &local_mr_))
+        continue;
+      LOG(WARNING) << "Serialized search index " << name
+                   << " doesn't match the loaded documents, rebuilding it";
+    }
     ptr->Rebuild(op_args, &local_mr_);
+  }
+
+  serialized_indices_ = string{};
+}
+
+string ShardDocIndices::SerializeIndices() const {
+  if (indices_.empty())
+    return {};
+
+  // Loading the spilled vectors would preempt, so those indices are rebuilt when they are
+  // loaded instead.
+  vector<pair<string_view, const ShardDocIndex*>> serialized;
+  for (const auto& [name, index] : indices_) {
+    if (index->indices_.GetNumSpilledVectorBlocks() == 0)
+      serialized.emplace_back(name, index.get());
+  }
+
+  search::IndexWriter writer;
+  writer.Write(kSerializationVersion);
+  writer.Write<uint64_t>(serialized.size());
+  for (const auto& [name, index] : serialized) {
+    search::IndexWriter index_writer;
+    index->Serialize(&index_writer);
+    writer.WriteString(name);
+    writer.WriteString(index_writer.Take());
+  }
+  return writer.Take();
+}
+
+void ShardDocIndices::SetSerializedIndices(string data) {
+  serialized_indices_ = std::move(data);
 }
 
 vector<string> ShardDocIndices::GetIndexNames() const {
@@ -289,6 +594,10 @@ vector<string> ShardDocIndices::GetIndexNames() const {
 }
 
 void ShardDocIndices::AddDoc(string_view key, const DbContext& db_cntx, const PrimeValue& pv) {
+  // Serialized indices don't reflect modifications that are applied before they are restored
+  if (!serialized_indices_.empty())
+    serialized_indices_ = string{};
+
   for (auto& [_, index] : indices_) {
     if (index->Matches(key, pv.ObjType()))
       index->AddDoc(key, db_cntx, pv);
@@ -296,6 +605,9 @@ void ShardDocIndices::AddDoc(string_view key, const DbContext& db_cntx, const Pr
 }
 
 void ShardDocIndices::RemoveDoc(string_view key, const DbContext& db_cntx, const PrimeValue& pv) {
+  if (!serialized_indices_.empty())
+    serialized_indices_ = string{};
+
   for (auto& [_, index] : indices_) {
     if (index->Matches(key, pv.ObjType()))
       index->RemoveDoc(key, db_cntx, pv);
@@ -314,4 +626,17 @@ SearchStats ShardDocIndices::GetStats() const {
   return {GetUsedMemory(), indices_.size(), total_entries};
 }
 
+void ShardDocIndices::CompactVectorIndicesStep(double max_deleted_ratio, size_t budget) {
+  for (auto& [_, index] : indices_)
+    index->CompactVectorIndicesStep(max_deleted_ratio, budget);
+}
+
+void ShardDocIndices::SpillVectorIndicesStep(TieredStorage* tiered, size_t max_bytes,
+                                             unsigned budget) {
+  if (!block_storage_)
+    block_storage_ = make_unique<TieredBlockStorage>(tiered);
+  for (auto& [_, index] : indices_)
+    index->SpillVectorIndicesStep(block_storage_.get(), max_bytes, budget);
+}
+
 }  // namespace dfly
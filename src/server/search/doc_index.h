@@ -45,7 +45,7 @@ struct SearchResult {
   SearchResult(facade::ErrorReply error) : error{std::move(error)} {
   }
 
-  size_t total_hits;
+  size_t total_hits = 0;
   std::vector<SerializedSearchDoc> docs;
   std::optional<search::AlgorithmProfile> profile;
 
@@ -91,12 +91,16 @@ struct DocIndex {
 struct DocIndexInfo {
   DocIndex base_index;
   size_t num_docs;
+  size_t result_cache_bytes = 0;
+  size_t vector_tombstones = 0;  // deleted points kept in hnsw vector indices
+  size_t spilled_vector_blocks = 0;  // blocks of flat vector indices moved to tiered storage
 
   // Build original ft.create command that can be used to re-create this index
   std::string BuildRestoreCommand() const;
 };
 
 class ShardDocIndices;
+class TieredStorage;
 
 // Stores internal search indices for documents of a document index on a specific shard.
 class ShardDocIndex {
@@ -109,8 +113,12 @@ class ShardDocIndex {
     DocId Remove(std::string_view key);
 
     std::string_view Get(DocId id) const;
+    bool Contains(std::string_view key) const;
     size_t Size() const;
 
+    void Serialize(search::IndexWriter* writer) const;
+    bool Deserialize(search::IndexReader* reader);
+
    private:
     absl::flat_hash_map<std::string, DocId> ids_;
     std::vector<std::string> keys_;
@@ -126,6 +134,15 @@ class ShardDocIndex {
   SearchResult Search(const OpArgs& op_args, const SearchParams& params,
                       search::SearchAlgorithm* search_algo) const;
 
+  // Same as Search, but repeated searches with the same cache_key are served from a cache of
+  // results that is cleared whenever a document of the index changes.
+  SearchResult CachedSearch(const OpArgs& op_args, const SearchParams& params,
+                            search::SearchAlgorithm* search_algo, std::string_view cache_key);
+
+  // Fill the values of a document with the given key. Returns false if it doesn't exist anymore.
+  bool SerializeDoc(const OpArgs& op_args, const SearchParams& params,
+                    SerializedSearchDoc* doc) const;
+
   // Return whether base index matches
   bool Matches(std::string_view key, unsigned obj_code) const;
 
@@ -134,14 +151,34 @@ class ShardDocIndex {
 
   DocIndexInfo GetInfo() const;
 
+  // Spread the rebuild of hnsw vector indices with many deleted points over multiple calls.
+  void CompactVectorIndicesStep(double max_deleted_ratio, size_t budget);
+
+  // Move cold blocks of the flat vector indices to storage, see FlatVectorIndex::SpillStep.
+  void SpillVectorIndicesStep(search::BlockStorage* storage, size_t max_bytes, unsigned budget);
+
+  // Write the definition, the document ids and the contents of all field indices.
+  void Serialize(search::IndexWriter* writer) const;
+
  private:
   // Clears internal data. Traverses all matching documents and assigns ids.
   void Rebuild(const OpArgs& op_args, PMR_NS::memory_resource* mr);
 
+  // Clears internal data and restores it from data written by Serialize. Returns false if the
+  // data is malformed, belongs to another definition or doesn't contain exactly the matching
+  // documents. The index must be rebuilt in that case.
+  bool Restore(const OpArgs& op_args, search::IndexReader* reader, PMR_NS::memory_resource* mr);
+
+  void ClearResultCache();
+
  private:
   std::shared_ptr<const DocIndex> base_;
   search::FieldIndices indices_;
   DocKeyIndex key_index_;
+
+  // Results of CachedSearch by cache key, bounded by the search_result_cache_bytes flag.
+  absl::flat_hash_map<std::string, SearchResult> result_cache_;
+  size_t result_cache_bytes_ = 0;
 };
 
 // Stores shard doc indices by name on a specific shard.
@@ -159,9 +196,17 @@ class ShardDocIndices {
   // Drop index, return true if it existed and was dropped
   bool DropIndex(std::string_view name);
 
-  // Rebuild all indices
+  // Rebuild all indices. Indices stored with SetSerializedIndices are restored instead if they are
+  // consistent with the current documents.
   void RebuildAllIndices(const OpArgs& op_args);
 
+  // Serialize all indices of the shard, empty if there are none.
+  std::string SerializeIndices() const;
+
+  // Store the output of SerializeIndices loaded from a snapshot until RebuildAllIndices is called.
+  // It's discarded if documents are modified before that.
+  void SetSerializedIndices(std::string data);
+
   std::vector<std::string> GetIndexNames() const;
 
   void AddDoc(std::string_view key, const DbContext& db_cnt, const PrimeValue& pv);
@@ -170,9 +215,22 @@ class ShardDocIndices {
   size_t GetUsedMemory() const;
   SearchStats GetStats() const;  // combines stats for all indices
 
+  // Called from the shard heartbeat, compacts hnsw vector indices with many deleted points
+  // by inserting at most budget points into their new graphs.
+  void CompactVectorIndicesStep(double max_deleted_ratio, size_t budget);
+
+  // Called from the shard heartbeat, keeps at most max_bytes of the vectors of each flat vector
+  // index in memory and moves the least recently used ones to the backing file of tiered. At
+  // most budget blocks of each index are written. May preempt.
+  void SpillVectorIndicesStep(TieredStorage* tiered, size_t max_bytes, unsigned budget);
+
  private:
   MiMemoryResource local_mr_;
+
+  // Used by the indices, so it's destroyed after them.
+  std::unique_ptr<search::BlockStorage> block_storage_;
   absl::flat_hash_map<std::string, std::unique_ptr<ShardDocIndex>> indices_;
+  std::string serialized_indices_;
 };
 
 #ifdef __APPLE__
@@ -191,6 +249,13 @@ inline bool ShardDocIndices::DropIndex(std::string_view name) {
 inline void ShardDocIndices::RebuildAllIndices(const OpArgs& op_args) {
 }
 
+inline std::string ShardDocIndices::SerializeIndices() const {
+  return {};
+}
+
+inline void ShardDocIndices::SetSerializedIndices(std::string data) {
+}
+
 inline std::vector<std::string> ShardDocIndices::GetIndexNames() const {
   return {};
 }
@@ -211,5 +276,12 @@ inline SearchStats ShardDocIndices::GetStats() const {
   return {};
 }
 
+inline void ShardDocIndices::CompactVectorIndicesStep(double max_deleted_ratio, size_t budget) {
+}
+
+inline void ShardDocIndices::SpillVectorIndicesStep(TieredStorage* tiered, size_t max_bytes,
+                                                    unsigned budget) {
+}
+
 #endif  // __APPLE__
 }  // namespace dfly
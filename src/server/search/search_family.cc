@@ -7,6 +7,7 @@
 #include <absl/container/flat_hash_map.h>
 #include <absl/strings/ascii.h>
 #include <absl/strings/match.h>
+#include <absl/strings/str_cat.h>
 #include <absl/strings/str_format.h>
 
 #include <atomic>
@@ -73,6 +74,12 @@ search::SchemaField::VectorParams ParseVectorParams(CmdArgParser* parser) {
       continue;
     }
 
+    if (parser->Check("QUANTIZATION").ExpectTail(1)) {
+      params.quantization = parser->Switch("NONE", search::VectorQuantization::NONE, "INT8",
+                                           search::VectorQuantization::INT8);
+      continue;
+    }
+
     parser->Skip(2);
   }
 
@@ -115,6 +122,11 @@ optional<search::Schema> ParseSchemaOrReply(DocIndex::DataType type, CmdArgParse
         cntx->SendError("Knn vector dimension cannot be zero");
         return nullopt;
       }
+      if (!parser.HasError() && vector_params.use_hnsw &&
+          vector_params.quantization != search::VectorQuantization::NONE) {
+        cntx->SendError("Vector quantization is supported only for FLAT indices");
+        return nullopt;
+      }
       params = std::move(vector_params);
     }
 
@@ -211,6 +223,12 @@ optional<SearchParams> ParseSearchParamsOrReply(CmdArgParser parser, ConnectionC
   return params;
 }
 
+// Document of the merged results of an aggregation and the shard it was found on.
+struct SortedDoc {
+  SerializedSearchDoc* doc;
+  ShardId sid;
+};
+
 void SendSerializedDoc(const SerializedSearchDoc& doc, ConnectionContext* cntx) {
   auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
   rb->SendBulkString(doc.key);
@@ -260,31 +278,43 @@ void ReplyWithResults(const SearchParams& params, absl::Span<SearchResult> resul
   }
 }
 
-void ReplySorted(search::AggregationInfo agg, const SearchParams& params,
-                 absl::Span<SearchResult> results, ConnectionContext* cntx) {
+// Merges the results of an aggregation from all shards and selects the documents of the requested
+// page. Returns the total number of results.
+size_t SelectSorted(const search::AggregationInfo& agg, const SearchParams& params,
+                    absl::Span<SearchResult> results, vector<SortedDoc>* page) {
   size_t total = 0;
-  vector<SerializedSearchDoc*> docs;
-  for (auto& shard_results : results) {
-    total += shard_results.total_hits;
-    for (auto& doc : shard_results.docs) {
-      docs.push_back(&doc);
-    }
+  vector<SortedDoc> docs;
+  for (ShardId sid = 0; sid < results.size(); sid++) {
+    total += results[sid].total_hits;
+    for (auto& doc : results[sid].docs)
+      docs.push_back({&doc, sid});
   }
 
   size_t agg_limit = agg.limit.value_or(total);
   size_t prefix = min(params.limit_offset + params.limit_total, agg_limit);
 
+  // Ties are broken by key to return the same order for every page
   partial_sort(docs.begin(), docs.begin() + min(docs.size(), prefix), docs.end(),
-               [desc = agg.descending](const auto* l, const auto* r) {
-                 return desc ? (*l >= *r) : (*l < *r);
+               [desc = agg.descending](const SortedDoc& l, const SortedDoc& r) {
+                 if (*l.doc < *r.doc)
+                   return !desc;
+                 if (*r.doc < *l.doc)
+                   return desc;
+                 return l.doc->key < r.doc->key;
                });
 
   docs.resize(min(docs.size(), agg_limit));
 
   size_t start_idx = min(params.limit_offset, docs.size());
   size_t result_count = min(docs.size() - start_idx, params.limit_total);
+  page->assign(docs.begin() + start_idx, docs.begin() + start_idx + result_count);
+  return min(total, agg_limit);
+}
+
+void ReplySorted(search::AggregationInfo agg, const SearchParams& params, size_t total,
+                 absl::Span<const SortedDoc> page, ConnectionContext* cntx) {
   bool ids_only = params.IdsOnly();
-  size_t reply_size = ids_only ? (result_count + 1) : (result_count * 2 + 1);
+  size_t reply_size = ids_only ? (page.size() + 1) : (page.size() * 2 + 1);
 
   // Clear score alias if it's excluded from return values
   if (!params.ShouldReturnField(agg.alias))
@@ -293,8 +323,8 @@ void ReplySorted(search::AggregationInfo agg, const SearchParams& params,
   facade::SinkReplyBuilder::ReplyAggregator agg_reply{cntx->reply_builder()};
   auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
   rb->StartArray(reply_size);
-  rb->SendLong(min(total, agg_limit));
-  for (auto* doc : absl::MakeSpan(docs).subspan(start_idx, result_count)) {
+  rb->SendLong(total);
+  for (const auto& [doc, _] : page) {
     if (ids_only) {
       rb->SendBulkString(doc->key);
       continue;
@@ -416,15 +446,19 @@ void SearchFamily::FtInfo(CmdArgList args, ConnectionContext* cntx) {
   DCHECK(infos.front().base_index.schema.fields.size() ==
          infos.back().base_index.schema.fields.size());
 
-  size_t total_num_docs = 0;
-  for (const auto& info : infos)
+  size_t total_num_docs = 0, total_cache_bytes = 0, total_tombstones = 0, total_spilled = 0;
+  for (const auto& info : infos) {
     total_num_docs += info.num_docs;
+    total_cache_bytes += info.result_cache_bytes;
+    total_tombstones += info.vector_tombstones;
+    total_spilled += info.spilled_vector_blocks;
+  }
 
   const auto& info = infos.front();
   const auto& schema = info.base_index.schema;
 
   auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
-  rb->StartCollection(4, RedisReplyBuilder::MAP);
+  rb->StartCollection(7, RedisReplyBuilder::MAP);
 
   rb->SendSimpleString("index_name");
   rb->SendSimpleString(idx_name);
@@ -459,6 +493,15 @@ void SearchFamily::FtInfo(CmdArgList args, ConnectionContext* cntx) {
 
   rb->SendSimpleString("num_docs");
   rb->SendLong(total_num_docs);
+
+  rb->SendSimpleString("result_cache_bytes");
+  rb->SendLong(total_cache_bytes);
+
+  rb->SendSimpleString("vector_tombstones");
+  rb->SendLong(total_tombstones);
+
+  rb->SendSimpleString("spilled_vector_blocks");
+  rb->SendLong(total_spilled);
 }
 
 void SearchFamily::FtList(CmdArgList args, ConnectionContext* cntx) {
@@ -488,30 +531,81 @@ void SearchFamily::FtSearch(CmdArgList args, ConnectionContext* cntx) {
   if (!search_algo.Init(query_str, &params->query_params, sort_opt))
     return cntx->SendError("Query syntax error");
 
+  // All the arguments after the index name determine the result, so they form the cache key.
+  string cache_key;
+  for (size_t i = 1; i < args.size(); i++)
+    absl::StrAppend(&cache_key, args[i].size(), ":", ArgS(args, i));
+
+  // The keys and scores are enough to merge the results of an aggregation on the coordinator.
+  // With multiple shards, the documents are serialized in a second hop only if they were selected.
+  auto agg = search_algo.HasAggregation();
+  bool two_phase = agg && shard_set->size() > 1 && !params->IdsOnly();
+
+  SearchParams shard_params = *params;
+  if (two_phase)
+    shard_params.return_fields.emplace();
+
   // Because our coordinator thread may not have a shard, we can't check ahead if the index exists.
   atomic<bool> index_not_found{false};
   vector<SearchResult> docs(shard_set->size());
 
-  cntx->transaction->ScheduleSingleHop([&](Transaction* t, EngineShard* es) {
+  auto search_cb = [&](Transaction* t, EngineShard* es) {
     if (auto* index = es->search_indices()->GetIndex(index_name); index)
-      docs[es->shard_id()] = index->Search(t->GetOpArgs(es), *params, &search_algo);
+      docs[es->shard_id()] =
+          index->CachedSearch(t->GetOpArgs(es), shard_params, &search_algo, cache_key);
     else
       index_not_found.store(true, memory_order_relaxed);
     return OpStatus::OK;
-  });
+  };
 
-  if (index_not_found.load())
+  if (two_phase) {
+    cntx->transaction->Schedule();
+    cntx->transaction->Execute(search_cb, false);
+  } else {
+    cntx->transaction->ScheduleSingleHop(search_cb);
+  }
+
+  if (index_not_found.load()) {
+    cntx->transaction->Conclude();
     return cntx->SendError(string{index_name} + ": no such index");
+  }
 
   for (const auto& res : docs) {
-    if (res.error)
+    if (res.error) {
+      cntx->transaction->Conclude();
       return cntx->SendError(*res.error);
+    }
   }
 
-  if (auto agg = search_algo.HasAggregation(); agg)
-    ReplySorted(std::move(*agg), *params, absl::MakeSpan(docs), cntx);
-  else
-    ReplyWithResults(*params, absl::MakeSpan(docs), cntx);
+  if (!agg)
+    return ReplyWithResults(*params, absl::MakeSpan(docs), cntx);
+
+  vector<SortedDoc> page;
+  size_t total = SelectSorted(*agg, *params, absl::MakeSpan(docs), &page);
+
+  if (two_phase) {
+    // Documents that were deleted since the first hop are dropped from the reply
+    vector<uint8_t> found(page.size(), 0);
+    cntx->transaction->Execute(
+        [&](Transaction* t, EngineShard* es) {
+          auto* index = es->search_indices()->GetIndex(index_name);
+          for (size_t i = 0; index && i < page.size(); i++) {
+            if (page[i].sid == es->shard_id())
+              found[i] = index->SerializeDoc(t->GetOpArgs(es), *params, page[i].doc);
+          }
+          return OpStatus::OK;
+        },
+        true);
+
+    size_t pos = 0;
+    for (size_t i = 0; i < page.size(); i++) {
+      if (found[i])
+        page[pos++] = page[i];
+    }
+    page.resize(pos);
+  }
+
+  ReplySorted(std::move(*agg), *params, total, page, cntx);
 }
 
 void SearchFamily::FtProfile(CmdArgList args, ConnectionContext* cntx) {
@@ -533,7 +627,8 @@ void SearchFamily::FtProfile(CmdArgList args, ConnectionContext* cntx) {
   atomic_uint total_docs = 0;
   atomic_uint total_serialized = 0;
 
-  vector<pair<search::AlgorithmProfile, absl::Duration>> results(shard_set->size());
+  vector<SearchResult> docs(shard_set->size());
+  vector<absl::Duration> shard_took(shard_set->size());
 
   cntx->transaction->ScheduleSingleHop([&](Transaction* t, EngineShard* es) {
     auto* index = es->search_indices()->GetIndex(index_name);
@@ -542,34 +637,56 @@ void SearchFamily::FtProfile(CmdArgList args, ConnectionContext* cntx) {
 
     auto shard_start = absl::Now();
     auto res = index->Search(t->GetOpArgs(es), *params, &search_algo);
+    shard_took[es->shard_id()] = absl::Now() - shard_start;
 
     total_docs.fetch_add(res.total_hits);
     total_serialized.fetch_add(res.docs.size());
 
-    DCHECK(res.profile);
-    results[es->shard_id()] = {std::move(*res.profile), absl::Now() - shard_start};
+    DCHECK(res.profile || res.error);
+    docs[es->shard_id()] = std::move(res);
 
     return OpStatus::OK;
   });
 
+  // Merge the results like FT.SEARCH does, without replying with them
+  absl::Time merge_start = absl::Now();
+  if (auto agg = search_algo.HasAggregation(); agg) {
+    vector<SortedDoc> page;
+    SelectSorted(*agg, *params, absl::MakeSpan(docs), &page);
+  }
+  auto merge_took = absl::Now() - merge_start;
+
   auto took = absl::Now() - start;
   auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
-  rb->StartArray(results.size() + 1);
+  rb->StartArray(docs.size() + 1);
 
   // General stats
-  rb->StartCollection(3, RedisReplyBuilder::MAP);
+  rb->StartCollection(4, RedisReplyBuilder::MAP);
   rb->SendBulkString("took");
   rb->SendLong(absl::ToInt64Microseconds(took));
   rb->SendBulkString("hits");
   rb->SendLong(total_docs);
   rb->SendBulkString("serialized");
   rb->SendLong(total_serialized);
+  rb->SendBulkString("merge");
+  rb->SendLong(absl::ToInt64Microseconds(merge_took));
 
   // Per-shard stats
-  for (const auto& [profile, shard_took] : results) {
-    rb->StartCollection(2, RedisReplyBuilder::MAP);
+  for (ShardId sid = 0; sid < docs.size(); sid++) {
+    static const search::AlgorithmProfile kEmptyProfile;
+    const auto& profile = docs[sid].profile ? *docs[sid].profile : kEmptyProfile;
+
+    // The root event covers the whole query, the rest is spent serializing the documents
+    size_t shard_micros = absl::ToInt64Microseconds(shard_took[sid]);
+    size_t search_micros = profile.events.empty() ? 0 : profile.events.front().micros;
+
+    rb->StartCollection(4, RedisReplyBuilder::MAP);
     rb->SendBulkString("took");
-    rb->SendLong(absl::ToInt64Microseconds(shard_took));
+    rb->SendLong(shard_micros);
+    rb->SendBulkString("search");
+    rb->SendLong(search_micros);
+    rb->SendBulkString("serialize");
+    rb->SendLong(shard_micros - min(shard_micros, search_micros));
     rb->SendBulkString("tree");
 
     for (size_t i = 0; i < profile.events.size(); i++) {
@@ -586,8 +703,9 @@ void SearchFamily::FtProfile(CmdArgList args, ConnectionContext* cntx) {
       if (children > 0)
         rb->StartArray(2);
 
-      rb->SendSimpleString(
-          absl::StrFormat("t=%-10u n=%-10u %s", event.micros, event.num_processed, event.descr));
+      rb->SendSimpleString(absl::StrFormat("t=%-10u in=%-10u out=%-10u bytes=%-10u %s",
+                                           event.micros, event.num_input, event.num_processed,
+                                           event.decoded_bytes, event.descr));
 
       if (children > 0)
         rb->StartArray(children);
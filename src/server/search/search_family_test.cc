@@ -4,12 +4,16 @@
 
 #include "server/search/search_family.h"
 
+#include "base/flags.h"
 #include "base/gtest.h"
 #include "base/logging.h"
 #include "facade/facade_test.h"
 #include "server/command_registry.h"
 #include "server/test_utils.h"
 
+ABSL_DECLARE_FLAG(uint64_t, search_result_cache_bytes);
+ABSL_DECLARE_FLAG(bool, search_index_snapshot);
+
 using namespace testing;
 using namespace std;
 using namespace util;
@@ -95,7 +99,8 @@ TEST_F(SearchFamilyTest, InfoIndex) {
                 _, _, _, RespArray(ElementsAre("key_type", "HASH", "prefix", "doc-")), "attributes",
                 RespArray(ElementsAre(RespArray(
                     ElementsAre("identifier", "name", "attribute", "name", "type", "TEXT")))),
-                "num_docs", IntArg(15))));
+                "num_docs", IntArg(15), "result_cache_bytes", IntArg(0), "vector_tombstones",
+                IntArg(0), "spilled_vector_blocks", IntArg(0))));
 }
 
 TEST_F(SearchFamilyTest, Stats) {
@@ -418,6 +423,35 @@ TEST_F(SearchFamilyTest, TestReturn) {
   EXPECT_THAT(resp, MatchEntry("k0", "vec_return", "20"));
 }
 
+TEST_F(SearchFamilyTest, KnnMergeShards) {
+  auto floatsv = [](const float* f) -> string_view {
+    return {reinterpret_cast<const char*>(f), sizeof(float)};
+  };
+
+  Run({"ft.create", "i1", "SCHEMA", "title", "TEXT", "pos", "VECTOR", "FLAT", "4", "DIM", "1",
+       "DISTANCE_METRIC", "L2"});
+
+  for (unsigned i = 0; i < 50; i++) {
+    const float pos = i;
+    Run({"hset", absl::StrCat("d:", i), "title", absl::StrCat("title ", i), "pos", floatsv(&pos)});
+  }
+
+  // Only the documents selected from all shards are returned, in the order of their distance
+  const float query = 20.2;
+  auto resp = Run({"ft.search", "i1", "* => [KNN 3 @pos $q AS dist]", "SORTBY", "dist", "RETURN",
+                   "1", "title", "PARAMS", "2", "q", floatsv(&query)});
+  EXPECT_THAT(resp, RespArray(ElementsAre(
+                        IntArg(3), "d:20", RespArray(ElementsAre("title", "title 20")), "d:21",
+                        RespArray(ElementsAre("title", "title 21")), "d:19",
+                        RespArray(ElementsAre("title", "title 19")))));
+
+  resp = Run({"ft.search", "i1", "* => [KNN 5 @pos $q]", "LIMIT", "3", "2", "RETURN", "1", "title",
+              "PARAMS", "2", "q", floatsv(&query)});
+  EXPECT_THAT(resp, RespArray(ElementsAre(
+                        IntArg(5), "d:22", RespArray(ElementsAre("title", "title 22")), "d:18",
+                        RespArray(ElementsAre("title", "title 18")))));
+}
+
 TEST_F(SearchFamilyTest, SimpleUpdates) {
   EXPECT_EQ(Run({"ft.create", "i1", "schema", "title", "text", "visits", "numeric"}), "OK");
 
@@ -544,6 +578,34 @@ TEST_F(SearchFamilyTest, BasicSort) {
                 AreRange(10, 10 - i, 10 - i - 3, "d2:"));
 }
 
+TEST_F(SearchFamilyTest, SortWithTies) {
+  Run({"ft.create", "i1", "prefix", "1", "d:", "schema", "ord", "numeric", "sortable"});
+
+  for (size_t i = 0; i < 50; i++)
+    Run({"hset", absl::StrCat("d:", i), "ord", absl::StrCat(i % 5)});
+
+  EXPECT_THAT(Run({"ft.search", "i1", "*", "SORTBY", "ord", "LIMIT", "0", "10"}),
+              DocIds(50, vector<string>{"d:0", "d:5", "d:10", "d:15", "d:20", "d:25", "d:30",
+                                        "d:35", "d:40", "d:45"}));
+
+  // Documents with equal values are returned in the same order every time
+  auto get_page = [this] {
+    auto resp = Run({"ft.search", "i1", "*", "SORTBY", "ord", "LIMIT", "12", "6", "RETURN", "0"});
+    vector<string> ids;
+    for (const auto& id : resp.GetVec())
+      ids.push_back(id.type == RespExpr::STRING ? id.GetString() : "");
+    return ids;
+  };
+  auto page = get_page();
+  EXPECT_EQ(page.size(), 7u);
+  for (size_t i = 0; i < 5; i++)
+    EXPECT_EQ(get_page(), page);
+
+  auto resp = Run({"ft.search", "i1", "*", "SORTBY", "ord", "DESC", "LIMIT", "0", "10"});
+  EXPECT_THAT(resp, DocIds(50, vector<string>{"d:4", "d:9", "d:14", "d:19", "d:24", "d:29",
+                                              "d:34", "d:39", "d:44", "d:49"}));
+}
+
 TEST_F(SearchFamilyTest, FtProfile) {
   Run({"ft.create", "i1", "schema", "name", "text"});
 
@@ -552,14 +614,16 @@ TEST_F(SearchFamilyTest, FtProfile) {
   const auto& top_level = resp.GetVec();
   EXPECT_EQ(top_level.size(), shard_set->size() + 1);
 
-  EXPECT_THAT(top_level[0].GetVec(), ElementsAre("took", _, "hits", _, "serialized", _));
+  EXPECT_THAT(top_level[0].GetVec(),
+              ElementsAre("took", _, "hits", _, "serialized", _, "merge", _));
 
   for (size_t sid = 0; sid < shard_set->size(); sid++) {
     const auto& shard_resp = top_level[sid + 1].GetVec();
-    EXPECT_THAT(shard_resp, ElementsAre("took", _, "tree", _));
+    EXPECT_THAT(shard_resp, ElementsAre("took", _, "search", _, "serialize", _, "tree", _));
 
-    const auto& tree = shard_resp[3].GetVec();
+    const auto& tree = shard_resp[7].GetVec();
     EXPECT_THAT(tree[0].GetString(), HasSubstr("Logical{n=3,o=and}"sv));
+    EXPECT_THAT(tree[0].GetString(), HasSubstr("in=0"sv));
     EXPECT_EQ(tree[1].GetVec().size(), 3);
   }
 }
@@ -590,4 +654,87 @@ TEST_F(SearchFamilyTest, SimpleExpiry) {
   Run({"flushall"});
 }
 
+TEST_F(SearchFamilyTest, ResultCache) {
+  absl::SetFlag(&FLAGS_search_result_cache_bytes, 1 << 20);
+
+  EXPECT_EQ(Run({"ft.create", "i1", "schema", "title", "text", "votes", "numeric"}), "OK");
+  Run({"hset", "d:1", "title", "first post", "votes", "10"});
+  Run({"hset", "d:2", "title", "second post", "votes", "20"});
+
+  auto cache_bytes = [this] {
+    auto info = Run({"ft.info", "i1"});
+    const auto& vec = info.GetVec();
+    return *vec[vec.size() - 1].GetInt();
+  };
+
+  EXPECT_EQ(cache_bytes(), 0);
+  EXPECT_THAT(Run({"ft.search", "i1", "@votes:[15 30]"}), AreDocIds("d:2"));
+  EXPECT_GT(cache_bytes(), 0);
+  EXPECT_THAT(Run({"ft.search", "i1", "@votes:[15 30]"}), AreDocIds("d:2"));
+
+  // Different arguments are different entries
+  EXPECT_THAT(
+      Run({"ft.search", "i1", "@votes:[15 30]", "return", "1", "title"}),
+      RespArray(ElementsAre(IntArg(1), "d:2", RespArray(ElementsAre("title", "second post")))));
+
+  // Updates and deletions invalidate the cache
+  Run({"hset", "d:1", "votes", "25"});
+  EXPECT_EQ(cache_bytes(), 0);
+  EXPECT_THAT(Run({"ft.search", "i1", "@votes:[15 30]"}), AreDocIds("d:1", "d:2"));
+
+  Run({"del", "d:2"});
+  EXPECT_THAT(Run({"ft.search", "i1", "@votes:[15 30]"}), AreDocIds("d:1"));
+
+  Run({"hset", "d:3", "title", "third post", "votes", "30"});
+  EXPECT_THAT(Run({"ft.search", "i1", "@votes:[15 30]"}), AreDocIds("d:1", "d:3"));
+
+  // Expired documents are not returned from the cache
+  Run({"pexpire", "d:3", "50"});
+  EXPECT_THAT(Run({"ft.search", "i1", "@votes:[15 30]"}), AreDocIds("d:1", "d:3"));
+  AdvanceTime(60);
+  EXPECT_THAT(Run({"ft.search", "i1", "@votes:[15 30]"}), AreDocIds("d:1"));
+
+  absl::SetFlag(&FLAGS_search_result_cache_bytes, 0);
+}
+
+TEST_F(SearchFamilyTest, SnapshotIndices) {
+  absl::SetFlag(&FLAGS_search_index_snapshot, true);
+
+  auto floatsv = [](const float* f) -> string_view {
+    return {reinterpret_cast<const char*>(f), sizeof(float)};
+  };
+
+  Run({"ft.create", "i1", "SCHEMA", "title", "TEXT", "tags", "TAG", "votes", "NUMERIC",
+       "SORTABLE", "pos", "VECTOR", "HNSW", "4", "DIM", "1", "DISTANCE_METRIC", "L2"});
+
+  for (unsigned i = 0; i < 30; i++) {
+    const float pos = i;
+    Run({"hset", absl::StrCat("d:", i), "title", i % 2 ? "odd" : "even", "tags",
+         absl::StrCat("t", i % 3), "votes", absl::StrCat(i), "pos", floatsv(&pos)});
+  }
+  Run({"del", "d:4"});
+
+  const float query = 4.2;
+  auto check = [&] {
+    EXPECT_THAT(Run({"ft.search", "i1", "@votes:[3 6]"}), AreDocIds("d:3", "d:5", "d:6"));
+    EXPECT_THAT(Run({"ft.search", "i1", "even @tags:{t1}"}),
+                AreDocIds("d:10", "d:16", "d:22", "d:28"));
+    EXPECT_THAT(Run({"ft.search", "i1", "* => [KNN 2 @pos $q]", "PARAMS", "2", "q",
+                     floatsv(&query)}),
+                AreDocIds("d:3", "d:5"));
+    EXPECT_THAT(Run({"ft.search", "i1", "*", "SORTBY", "votes", "DESC", "LIMIT", "0", "2"}),
+                DocIds(29, vector<string>{"d:28", "d:29"}));
+  };
+
+  check();
+  EXPECT_EQ(Run({"debug", "reload"}), "OK");
+  check();
+
+  // The restored indices are updated like rebuilt ones
+  Run({"hset", "d:4", "votes", "4"});
+  EXPECT_THAT(Run({"ft.search", "i1", "@votes:[3 6]"}), AreDocIds("d:3", "d:4", "d:5", "d:6"));
+
+  absl::SetFlag(&FLAGS_search_index_snapshot, false);
+}
+
 }  // namespace dfly
@@ -4,9 +4,12 @@
 
 #include "server/server_family.h"
 
+#include <absl/base/internal/cycleclock.h>
 #include <absl/cleanup/cleanup.h>
+#include <absl/container/flat_hash_map.h>
 #include <absl/random/random.h>  // for master_id_ generation.
 #include <absl/strings/match.h>
+#include <absl/strings/str_format.h>
 #include <absl/strings/str_join.h>
 #include <absl/strings/str_replace.h>
 #include <absl/strings/strip.h>
@@ -23,6 +26,7 @@
 #include "slowlog.h"
 
 extern "C" {
+#include "redis/object.h"
 #include "redis/redis_aux.h"
 }
 
@@ -45,6 +49,7 @@ extern "C" {
 #include "server/error.h"
 #include "server/generic_family.h"
 #include "server/journal/journal.h"
+#include "server/journal/serializer.h"
 #include "server/main_service.h"
 #include "server/memory_cmd.h"
 #include "server/protocol_client.h"
@@ -96,6 +101,12 @@ ABSL_FLAG(CronExprFlag, snapshot_cron, {},
           "cron expression for the time to save a snapshot, crontab style");
 ABSL_FLAG(bool, df_snapshot_format, true,
           "if true, save in dragonfly-specific snapshotting format");
+ABSL_FLAG(bool, serve_while_loading, false,
+          "If true, the snapshot loaded on startup is served while it loads: commands whose keys "
+          "are all loaded are executed, the others fail with the LOADING error until then");
+ABSL_FLAG(bool, snapshot_deltas, false,
+          "if true, dragonfly format saves track the changes since the last save, so that "
+          "SAVE DELTA can write only the changed buckets and the deleted keys");
 ABSL_FLAG(int, epoll_file_threads, 0,
           "thread size for file workers when running in epoll mode, default is hardware concurrent "
           "threads");
@@ -107,6 +118,10 @@ ABSL_FLAG(int32_t, slowlog_log_slower_than, 10000,
           "Add commands slower than this threshold to slow log. The value is expressed in "
           "microseconds and if it's negative - disables the slowlog.");
 ABSL_FLAG(uint32_t, slowlog_max_len, 20, "Slow log maximum length.");
+ABSL_FLAG(uint32_t, trace_sample_every, 0,
+          "If positive, trace every n-th command of each thread. The spans of the sampled "
+          "commands and of their transaction phases are returned by DEBUG TRACE.");
+ABSL_FLAG(uint32_t, trace_max_len, 64, "Number of sampled traces kept by each thread.");
 
 ABSL_FLAG(string, s3_endpoint, "", "endpoint for s3 snapshots, default uses aws regional endpoint");
 ABSL_FLAG(bool, s3_use_https, true, "whether to use https for s3 endpoints");
@@ -119,6 +134,42 @@ ABSL_FLAG(bool, s3_ec2_metadata, false,
 // usage when writing snapshots to S3, at the expense of security.
 ABSL_FLAG(bool, s3_sign_payload, true,
           "whether to sign the s3 request payload when uploading snapshots");
+ABSL_FLAG(uint32_t, s3_upload_concurrency, 1,
+          "number of parts of a snapshot file uploaded to s3 in parallel, 1 uploads a single "
+          "stream");
+ABSL_FLAG(uint32_t, s3_download_concurrency, 1,
+          "number of ranges of a snapshot file downloaded from s3 in parallel, 1 downloads a "
+          "single stream");
+ABSL_FLAG(uint32_t, s3_part_size_mb, 16,
+          "size of the parallel s3 upload parts and download ranges, in MB");
+ABSL_FLAG(uint32_t, snapshot_write_queue_depth, 1,
+          "number of direct writes of a local snapshot file kept in flight with io_uring, 1 "
+          "waits for every write");
+ABSL_FLAG(uint32_t, snapshot_read_ahead_depth, 0,
+          "number of 1MB chunks of a local snapshot file read ahead of the loader, so that the "
+          "reads overlap with decoding. 0 disables read-ahead");
+ABSL_FLAG(bool, journal_compact_encoding, false,
+          "write the replication journal with command ids and packed integer arguments. "
+          "Requires replicas that support it, not supported in cluster mode");
+
+ABSL_FLAG(bool, replica_bootstrap_from_snapshot, false,
+          "With replicaof, load the snapshot from dir before replicating and continue from the "
+          "journal positions of the master it saved instead of a full sync. The master falls back "
+          "to a full sync if it no longer has the journal since.");
+
+ABSL_FLAG(uint32_t, hot_keys_alert_qps, 0,
+          "If positive, the keys whose estimated rate reaches this number of accesses per second "
+          "are published to the __hotkeys__ channel, once per key and --hot_keys_window_sec. "
+          "Requires enable_top_keys_tracking.");
+
+ABSL_FLAG(bool, metrics_malloc_size_classes, false,
+          "If true, /metrics reports the committed and used bytes and the page utilization of "
+          "every mimalloc block size in every shard. Visits all the pages of the data heaps on "
+          "each scrape.");
+
+ABSL_FLAG(uint32_t, metrics_max_staleness_ms, 0,
+          "If positive, INFO and the metrics endpoint reuse the metrics collected up to this many "
+          "milliseconds ago instead of collecting them from all the threads on every call.");
 
 ABSL_DECLARE_FLAG(int32_t, port);
 ABSL_DECLARE_FLAG(bool, cache_mode);
@@ -126,6 +177,9 @@ ABSL_DECLARE_FLAG(uint32_t, hz);
 ABSL_DECLARE_FLAG(bool, tls);
 ABSL_DECLARE_FLAG(string, tls_ca_cert_file);
 ABSL_DECLARE_FLAG(string, tls_ca_cert_dir);
+ABSL_DECLARE_FLAG(bool, enable_top_keys_tracking);
+ABSL_DECLARE_FLAG(bool, hot_key_replication);
+ABSL_DECLARE_FLAG(uint32_t, hot_keys_window_sec);
 
 bool AbslParseFlag(std::string_view in, ReplicaOfFlag* flag, std::string* err) {
 #define RETURN_ON_ERROR(cond, m)                                           \
@@ -340,7 +394,7 @@ void SlowLogGet(dfly::CmdArgList args, dfly::ConnectionContext* cntx, dfly::Serv
     const auto& entry = merged_slow_log[i].first;
     const auto& args = entry.cmd_args;
 
-    rb->StartArray(6);
+    rb->StartArray(entry.tx_stats ? 7 : 6);
 
     rb->SendLong(entry.entry_id * service.proactor_pool().size() + merged_slow_log[i].second);
     rb->SendLong(entry.unix_ts_usec / 1000000);
@@ -369,6 +423,27 @@ void SlowLogGet(dfly::CmdArgList args, dfly::ConnectionContext* cntx, dfly::Serv
 
     rb->SendBulkString(entry.client_ip);
     rb->SendBulkString(entry.client_name);
+
+    if (entry.tx_stats) {
+      const SlowLogTxStats& stats = *entry.tx_stats;
+      // The time the connection fiber spent outside of the hops, mostly building the reply.
+      uint64_t in_tx_usec = stats.schedule_usec + stats.hop_wait_usec;
+      uint64_t coordinator_usec =
+          entry.exec_time_usec > in_tx_usec ? entry.exec_time_usec - in_tx_usec : 0;
+      pair<string_view, uint64_t> fields[] = {{"schedule_usec", stats.schedule_usec},
+                                              {"queue_wait_usec", stats.queue_wait_usec},
+                                              {"execution_usec", stats.execution_usec},
+                                              {"conclude_usec", stats.conclude_usec},
+                                              {"coordinator_usec", coordinator_usec},
+                                              {"hops", stats.hops},
+                                              {"shards", stats.shards},
+                                              {"txq_len", stats.txq_len}};
+      rb->StartArray(ABSL_ARRAYSIZE(fields) * 2);
+      for (const auto& [name, value] : fields) {
+        rb->SendBulkString(name);
+        rb->SendLong(value);
+      }
+    }
   }
 }
 
@@ -482,10 +557,68 @@ void ClientPauseCmd(CmdArgList args, absl::Span<facade::Listener*> listeners,
   cntx->SendOk();
 }
 
-void ClientTracking(CmdArgList args, ConnectionContext* cntx) {
+// Registers the broadcast tracking prefixes of the connection in the table of its thread and
+// in every shard, or removes them again.
+void UpdateTrackingPrefixes(ConnectionContext* cntx, bool add) {
+  auto& prefixes = cntx->conn_state.tracking_prefixes;
+  if (prefixes.empty())
+    return;
+
+  ServerState* ss = ServerState::tlocal();
+  for (const auto& prefix : prefixes) {
+    auto& conns = ss->tracking_prefixes[prefix];
+    if (add) {
+      conns.push_back(cntx->conn());
+    } else {
+      conns.erase(find(conns.begin(), conns.end(), cntx->conn()));
+      if (conns.empty())
+        ss->tracking_prefixes.erase(prefix);
+    }
+  }
+
+  unsigned tid = ss->thread_index();
+  shard_set->RunBriefInParallel([&](EngineShard* shard) {
+    shard->db_slice().UpdateTrackingPrefixes(prefixes, tid, add ? 1 : -1);
+  });
+
+  if (!add)
+    prefixes.clear();
+}
+
+// CLIENT READSTALENESS <ms>
+void ClientReadStaleness(CmdArgList args, ConnectionContext* cntx) {
+  uint32_t bound_ms;
+  if (args.size() != 1 || !absl::SimpleAtoi(ArgS(args, 0), &bound_ms))
+    return cntx->SendError(kSyntaxErr);
+
+  cntx->conn_state.read_staleness_ms = bound_ms;
+  cntx->SendOk();
+}
+
+// CLIENT SETPRIORITY LOW|NORMAL|HIGH, CLIENT PRIORITY is an alias.
+void ClientSetPriority(CmdArgList args, ConnectionContext* cntx) {
   if (args.size() != 1)
     return cntx->SendError(kSyntaxErr);
 
+  ToUpper(&args[0]);
+  string_view priority = ArgS(args, 0);
+  if (priority == "LOW")
+    cntx->priority = acl::Priority::LOW;
+  else if (priority == "NORMAL")
+    cntx->priority = acl::Priority::NORMAL;
+  else if (priority == "HIGH")
+    cntx->priority = acl::Priority::HIGH;
+  else
+    return cntx->SendError(kSyntaxErr);
+
+  cntx->SendOk();
+}
+
+// CLIENT TRACKING ON|OFF [BCAST] [PREFIX prefix]...
+void ClientTracking(CmdArgList args, ConnectionContext* cntx) {
+  if (args.empty())
+    return cntx->SendError(kSyntaxErr);
+
   auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
   if (!rb->IsResp3())
     return cntx->SendError(
@@ -502,6 +635,32 @@ void ClientTracking(CmdArgList args, ConnectionContext* cntx) {
     return cntx->SendError(kSyntaxErr);
   }
 
+  bool bcast = false;
+  vector<string> prefixes;
+  for (size_t i = 1; i < args.size(); ++i) {
+    ToUpper(&args[i]);
+    string_view opt = ArgS(args, i);
+    if (opt == "BCAST" && is_on) {
+      bcast = true;
+    } else if (opt == "PREFIX" && is_on && i + 1 < args.size()) {
+      prefixes.emplace_back(ArgS(args, ++i));
+    } else {
+      return cntx->SendError(kSyntaxErr);
+    }
+  }
+
+  if (!prefixes.empty() && !bcast)
+    return cntx->SendError("PREFIX option requires BCAST mode to be enabled");
+
+  if (bcast && prefixes.empty())
+    prefixes.emplace_back();  // every key
+  sort(prefixes.begin(), prefixes.end());
+  prefixes.erase(unique(prefixes.begin(), prefixes.end()), prefixes.end());
+
+  UpdateTrackingPrefixes(cntx, false);
+  cntx->conn_state.tracking_prefixes = std::move(prefixes);
+  UpdateTrackingPrefixes(cntx, true);
+
   cntx->conn()->SetClientTrackingSwitch(is_on);
   return cntx->SendOk();
 }
@@ -585,6 +744,63 @@ string_view GetRedisMode() {
   return ClusterConfig::IsEnabledOrEmulated() ? "cluster"sv : "standalone"sv;
 }
 
+constexpr string_view kHotKeysChannel = "__hotkeys__"sv;
+
+// Number of the largest keys of all the shards that are exported on /metrics.
+constexpr size_t kMaxBigKeyMetrics = 10;
+
+bool IsTopKeysTrackingEnabled() {
+  return GetFlag(FLAGS_enable_top_keys_tracking) || GetFlag(FLAGS_hot_key_replication);
+}
+
+// Returns the hottest keys of all shards, at most limit of them, ordered by their rate.
+vector<DbSlice::HotKey> CollectHotKeys(size_t limit) {
+  vector<vector<DbSlice::HotKey>> shard_keys(shard_set->size());
+  shard_set->RunBriefInParallel([&](EngineShard* shard) {
+    shard_keys[shard->shard_id()] = shard->db_slice().GetHotKeys(GetCurrentTimeMs());
+  });
+
+  vector<DbSlice::HotKey> res;
+  for (auto& keys : shard_keys) {
+    std::move(keys.begin(), keys.end(), back_inserter(res));
+  }
+
+  auto by_qps = [](const auto& l, const auto& r) { return l.qps > r.qps; };
+  if (res.size() > limit) {
+    std::partial_sort(res.begin(), res.begin() + limit, res.end(), by_qps);
+    res.resize(limit);
+  } else {
+    std::sort(res.begin(), res.end(), by_qps);
+  }
+  return res;
+}
+
+// Escapes the characters that are not allowed in a prometheus label value.
+string EscapeLabelValue(string_view value) {
+  string res;
+  res.reserve(value.size());
+  for (char c : value) {
+    if (c == '\\' || c == '"') {
+      res.push_back('\\');
+      res.push_back(c);
+    } else if (c == '\n') {
+      res.append("\\n");
+    } else {
+      res.push_back(c);
+    }
+  }
+  return res;
+}
+
+// Lets the tiered storages modify the backing files they kept, once the snapshot that may
+// refer to them is loaded or there is none, see TieredStorage::RestoreExternal.
+void FinishTieredRestore() {
+  shard_set->RunBriefInParallel([](EngineShard* es) {
+    if (TieredStorage* tiered = es->tiered_storage(); tiered)
+      tiered->FinishRestore();
+  });
+}
+
 }  // namespace
 
 ServerFamily::ServerFamily(Service* service) : service_(*service) {
@@ -635,12 +851,33 @@ void SetSlowLogThreshold(util::ProactorPool& pool, int32_t val) {
   });
 }
 
+void SetTraceSampling(util::ProactorPool& pool, uint32_t sample_every, uint32_t max_len) {
+  pool.AwaitFiberOnAll([=](auto index, auto* context) {
+    auto& ring = ServerState::tlocal()->GetTraceRing();
+    ring.SetSampleEvery(sample_every);
+    ring.ChangeLength(max_len);
+  });
+}
+
 void ServerFamily::Init(util::AcceptServer* acceptor, std::vector<facade::Listener*> listeners) {
   CHECK(acceptor_ == nullptr);
   acceptor_ = acceptor;
   listeners_ = std::move(listeners);
   dfly_cmd_ = make_unique<DflyCmd>(this);
 
+  if (GetFlag(FLAGS_journal_compact_encoding)) {
+    if (ClusterConfig::IsEnabled()) {
+      // Slot migrations read the journal without the command table.
+      LOG(WARNING) << "journal_compact_encoding is not supported in cluster mode, ignoring it";
+    } else {
+      vector<string> names;
+      service_.mutable_registry()->Traverse(
+          [&names](string_view name, const CommandId&) { names.emplace_back(name); });
+      sort(names.begin(), names.end());
+      journal_->SetCommandTable(make_shared<const JournalCommandTable>(std::move(names)));
+    }
+  }
+
   auto os_string = GetOSString();
   LOG_FIRST_N(INFO, 1) << "Host OS: " << os_string << " with " << shard_set->pool()->size()
                        << " threads";
@@ -668,6 +905,21 @@ void ServerFamily::Init(util::AcceptServer* acceptor, std::vector<facade::Listen
     return res.has_value();
   });
 
+  SetTraceSampling(service_.proactor_pool(), GetFlag(FLAGS_trace_sample_every),
+                   GetFlag(FLAGS_trace_max_len));
+  config_registry.RegisterMutable("trace_sample_every", [this](const absl::CommandLineFlag& flag) {
+    auto res = flag.TryGet<uint32_t>();
+    if (res.has_value())
+      SetTraceSampling(service_.proactor_pool(), res.value(), GetFlag(FLAGS_trace_max_len));
+    return res.has_value();
+  });
+  config_registry.RegisterMutable("trace_max_len", [this](const absl::CommandLineFlag& flag) {
+    auto res = flag.TryGet<uint32_t>();
+    if (res.has_value())
+      SetTraceSampling(service_.proactor_pool(), GetFlag(FLAGS_trace_sample_every), res.value());
+    return res.has_value();
+  });
+
   // We only reconfigure TLS when the 'tls' config key changes. Therefore to
   // update TLS certs, first update tls_cert_file, then set 'tls true'.
   config_registry.RegisterMutable("tls", [this](const absl::CommandLineFlag& flag) {
@@ -686,6 +938,7 @@ void ServerFamily::Init(util::AcceptServer* acceptor, std::vector<facade::Listen
   config_registry.RegisterMutable("tls_key_file");
   config_registry.RegisterMutable("tls_ca_cert_file");
   config_registry.RegisterMutable("tls_ca_cert_dir");
+  config_registry.RegisterMutable("metrics_max_staleness_ms");
 
   pb_task_ = shard_set->pool()->GetNextProactor();
   if (pb_task_->GetKind() == ProactorBase::EPOLL) {
@@ -695,17 +948,32 @@ void ServerFamily::Init(util::AcceptServer* acceptor, std::vector<facade::Listen
   string flag_dir = GetFlag(FLAGS_dir);
   if (IsCloudPath(flag_dir)) {
     shard_set->pool()->GetNextProactor()->Await([&] { util::aws::Init(); });
+    detail::S3TransferOptions transfer;
+    transfer.upload_concurrency = absl::GetFlag(FLAGS_s3_upload_concurrency);
+    transfer.download_concurrency = absl::GetFlag(FLAGS_s3_download_concurrency);
+    // S3 does not accept parts smaller than 5MB, except for the last one.
+    transfer.part_size = size_t(std::max(absl::GetFlag(FLAGS_s3_part_size_mb), 5u)) << 20;
     snapshot_storage_ = std::make_shared<detail::AwsS3SnapshotStorage>(
         absl::GetFlag(FLAGS_s3_endpoint), absl::GetFlag(FLAGS_s3_use_https),
-        absl::GetFlag(FLAGS_s3_ec2_metadata), absl::GetFlag(FLAGS_s3_sign_payload));
+        absl::GetFlag(FLAGS_s3_ec2_metadata), absl::GetFlag(FLAGS_s3_sign_payload), transfer);
   } else if (fq_threadpool_) {
-    snapshot_storage_ = std::make_shared<detail::FileSnapshotStorage>(fq_threadpool_.get());
+    snapshot_storage_ = std::make_shared<detail::FileSnapshotStorage>(
+        fq_threadpool_.get(), 1, absl::GetFlag(FLAGS_snapshot_read_ahead_depth));
   } else {
-    snapshot_storage_ = std::make_shared<detail::FileSnapshotStorage>(nullptr);
+    snapshot_storage_ = std::make_shared<detail::FileSnapshotStorage>(
+        nullptr, absl::GetFlag(FLAGS_snapshot_write_queue_depth),
+        absl::GetFlag(FLAGS_snapshot_read_ahead_depth));
   }
 
   // check for '--replicaof' before loading anything
   if (ReplicaOfFlag flag = GetFlag(FLAGS_replicaof); flag.has_value()) {
+    if (GetFlag(FLAGS_replica_bootstrap_from_snapshot)) {
+      LoadFromSnapshot();
+      if (load_result_.valid())
+        load_result_.wait();
+    } else {
+      FinishTieredRestore();
+    }
     service_.proactor_pool().GetNextProactor()->Await(
         [this, &flag]() { this->Replicate(flag.host, flag.port); });
   } else {  // load from snapshot only if --replicaof is empty
@@ -723,6 +991,19 @@ void ServerFamily::Init(util::AcceptServer* acceptor, std::vector<facade::Listen
         return true;
       });
   create_snapshot_schedule_fb();
+
+  if (GetFlag(FLAGS_hot_keys_alert_qps) > 0) {
+    hot_keys_alert_fb_ =
+        service_.proactor_pool().GetNextProactor()->LaunchFiber([this] { HotKeysAlerting(); });
+  }
+
+  watchdog_ = make_unique<ProactorWatchdog>(&service_.proactor_pool());
+  watchdog_->Start();
+  config_registry.RegisterMutable("stall_threshold_ms");
+
+  admission_ = make_unique<AdmissionController>(&service_.proactor_pool());
+  admission_->Start();
+  config_registry.RegisterMutable("shed_queue_delay_usec");
 }
 
 void ServerFamily::LoadFromSnapshot() {
@@ -731,7 +1012,7 @@ void ServerFamily::LoadFromSnapshot() {
   if (load_path_result) {
     const std::string load_path = *load_path_result;
     if (!load_path.empty()) {
-      load_result_ = Load(load_path);
+      load_result_ = Load(load_path, GetFlag(FLAGS_serve_while_loading));
     }
   } else {
     if (std::error_code(load_path_result.error()) == std::errc::no_such_file_or_directory) {
@@ -740,6 +1021,9 @@ void ServerFamily::LoadFromSnapshot() {
       LOG(ERROR) << "Failed to load snapshot: " << load_path_result.error().Format();
     }
   }
+
+  if (!load_result_.valid())
+    FinishTieredRestore();
 }
 
 void ServerFamily::JoinSnapshotSchedule() {
@@ -756,6 +1040,15 @@ void ServerFamily::Shutdown() {
 
   JoinSnapshotSchedule();
 
+  hot_keys_alert_done_.Notify();
+  hot_keys_alert_fb_.JoinIfNeeded();
+
+  if (watchdog_)
+    watchdog_->Stop();
+
+  if (admission_)
+    admission_->Stop();
+
   if (save_on_shutdown_ && !absl::GetFlag(FLAGS_dbfilename).empty()) {
     shard_set->pool()->GetNextProactor()->Await([this] {
       if (GenericError ec = DoSave(); ec) {
@@ -788,15 +1081,39 @@ void ServerFamily::Shutdown() {
 struct AggregateLoadResult {
   AggregateError first_error;
   std::atomic<size_t> keys_read;
+
+  // The master ids and the journal positions saved by the shard files.
+  Mutex mu;
+  std::vector<std::pair<std::string, std::optional<std::pair<ShardId, LSN>>>> positions;
+
+  // The positions of all the shards, if every shard file saved its position for the same master.
+  std::optional<std::pair<std::string, std::vector<LSN>>> JournalPosition() const {
+    if (positions.empty() || positions.front().first.empty())
+      return nullopt;
+
+    vector<optional<LSN>> lsns(positions.size());
+    for (const auto& [repl_id, shard_lsn] : positions) {
+      if (repl_id != positions.front().first || !shard_lsn || shard_lsn->first >= lsns.size() ||
+          lsns[shard_lsn->first])
+        return nullopt;
+      lsns[shard_lsn->first] = shard_lsn->second;
+    }
+
+    vector<LSN> res;
+    for (optional<LSN> lsn : lsns)
+      res.push_back(*lsn);
+    return pair{positions.front().first, std::move(res)};
+  }
 };
 
 // Load starts as many fibers as there are files to load each one separately.
 // It starts one more fiber that waits for all load fibers to finish and returns the first
 // error (if any occured) with a future.
-Future<GenericError> ServerFamily::Load(const std::string& load_path) {
+Future<GenericError> ServerFamily::Load(const std::string& load_path, bool serve) {
   auto paths_result = snapshot_storage_->LoadPaths(load_path);
   if (!paths_result) {
     LOG(ERROR) << "Failed to load snapshot: " << paths_result.error().Format();
+    FinishTieredRestore();
 
     Promise<GenericError> ec_promise;
     ec_promise.set_value(paths_result.error());
@@ -814,6 +1131,8 @@ Future<GenericError> ServerFamily::Load(const std::string& load_path) {
   }
 
   RdbLoader::PerformPreLoad(&service_);
+  if (serve)
+    service_.SetServingLoad(true);
 
   auto& pool = service_.proactor_pool();
 
@@ -822,6 +1141,17 @@ Future<GenericError> ServerFamily::Load(const std::string& load_path) {
 
   auto aggregated_result = std::make_shared<AggregateLoadResult>();
 
+  // The summary file is loaded first, so that its size hints reserve the tables before the
+  // shard files insert the keys.
+  if (paths.size() > 1) {
+    auto summary_result = pool.GetNextProactor()->Await([&] { return LoadRdb(paths.front()); });
+    if (summary_result)
+      aggregated_result->keys_read.fetch_add(*summary_result);
+    else
+      aggregated_result->first_error = summary_result.error();
+    paths.erase(paths.begin());
+  }
+
   for (auto& path : paths) {
     // For single file, choose thread that does not handle shards if possible.
     // This will balance out the CPU during the load.
@@ -833,7 +1163,7 @@ Future<GenericError> ServerFamily::Load(const std::string& load_path) {
     }
 
     auto load_fiber = [this, aggregated_result, path = std::move(path)]() {
-      auto load_result = LoadRdb(path);
+      auto load_result = LoadRdb(path, aggregated_result.get());
       if (load_result.has_value())
         aggregated_result->keys_read.fetch_add(*load_result);
       else
@@ -858,8 +1188,17 @@ Future<GenericError> ServerFamily::Load(const std::string& load_path) {
     }
 
     RdbLoader::PerformPostLoad(&service_);
+    FinishTieredRestore();
+
+    if (GetFlag(FLAGS_replica_bootstrap_from_snapshot)) {
+      auto pos = aggregated_result->JournalPosition();
+      LOG_IF(WARNING, !pos) << "The snapshot has no journal positions, the replica will fully sync";
+      lock_guard lk(replicaof_mu_);
+      snapshot_journal_position_ = std::move(pos);
+    }
 
     LOG(INFO) << "Load finished, num keys read: " << aggregated_result->keys_read;
+    service_.SetServingLoad(false);
     service_.SwitchState(GlobalState::LOADING, GlobalState::ACTIVE);
     ec_promise.set_value(*(aggregated_result->first_error));
   };
@@ -868,6 +1207,32 @@ Future<GenericError> ServerFamily::Load(const std::string& load_path) {
   return ec_future;
 }
 
+void ServerFamily::HotKeysAlerting() {
+  const double threshold = GetFlag(FLAGS_hot_keys_alert_qps);
+
+  // The time each key was published at, so a key is published once per window.
+  absl::flat_hash_map<pair<DbIndex, string>, uint64_t> published;
+  while (!hot_keys_alert_done_.WaitFor(1s)) {
+    uint64_t now = GetCurrentTimeMs();
+    uint64_t window_ms = uint64_t(GetFlag(FLAGS_hot_keys_window_sec)) * 1000;
+    absl::erase_if(published, [&](const auto& entry) {
+      return window_ms > 0 && entry.second + window_ms <= now;
+    });
+
+    for (const auto& hot_key : CollectHotKeys(SIZE_MAX)) {
+      if (hot_key.qps < threshold)
+        break;
+
+      if (!published.emplace(pair{hot_key.db, hot_key.key}, now).second)
+        continue;
+
+      service_.PublishMessage(kHotKeysChannel, absl::StrCat(hot_key.db, " ", hot_key.shard, " ",
+                                                            uint64_t(hot_key.qps), " ",
+                                                            hot_key.key));
+    }
+  }
+}
+
 void ServerFamily::SnapshotScheduling() {
   const std::optional<cron::cronexpr> cron_expr = InferSnapshotCronExpr();
   if (!cron_expr) {
@@ -898,7 +1263,8 @@ void ServerFamily::SnapshotScheduling() {
   }
 }
 
-io::Result<size_t> ServerFamily::LoadRdb(const std::string& rdb_file) {
+io::Result<size_t> ServerFamily::LoadRdb(const std::string& rdb_file,
+                                         AggregateLoadResult* result) {
   error_code ec;
   io::ReadonlyFileOrError res = snapshot_storage_->OpenReadFile(rdb_file);
   if (res) {
@@ -909,6 +1275,10 @@ io::Result<size_t> ServerFamily::LoadRdb(const std::string& rdb_file) {
     if (!ec) {
       VLOG(1) << "Done loading RDB from " << rdb_file << ", keys loaded: " << loader.keys_loaded();
       VLOG(1) << "Loading finished after " << strings::HumanReadableElapsedTime(loader.load_time());
+      if (result) {
+        lock_guard lk(result->mu);
+        result->positions.emplace_back(loader.repl_id(), loader.shard_lsn());
+      }
       return loader.keys_loaded();
     }
   } else {
@@ -974,6 +1344,96 @@ void AppendMetricWithoutLabels(string_view name, string_view help, const absl::A
   AppendMetricValue(name, value, {}, {}, dest);
 }
 
+// Appends the buckets, the sum and the count of a value size histogram, see BigKeys.
+void AppendValueSizeHistogram(string_view name, const BigKeys::Histogram& hist,
+                              vector<string_view> label_names, vector<string_view> label_values,
+                              string* dest) {
+  string bucket_name = StrCat(name, "_bucket"), le;
+  label_names.push_back("le");
+  label_values.push_back({});
+  uint64_t cumulative = 0;
+  for (unsigned i = 0; i < BigKeys::kNumBuckets; ++i) {
+    cumulative += hist.buckets[i];
+    le = i + 1 < BigKeys::kNumBuckets ? StrCat(1ULL << i) : "+Inf";
+    label_values.back() = le;
+    AppendMetricValue(bucket_name, cumulative, label_names, label_values, dest);
+  }
+  label_names.pop_back();
+  label_values.pop_back();
+  AppendMetricValue(StrCat(name, "_sum"), hist.sum, label_names, label_values, dest);
+  AppendMetricValue(StrCat(name, "_count"), cumulative, label_names, label_values, dest);
+}
+
+// Names of the encodings of the types that have several, as OBJECT ENCODING reports them in
+// Redis. Empty for the other types.
+string_view EncodingName(unsigned type, unsigned encoding) {
+  switch (type) {
+    case OBJ_HASH:
+      return encoding == kEncodingListPack ? "listpack" : "hashtable";
+    case OBJ_ZSET:
+      return encoding == OBJ_ENCODING_LISTPACK ? "listpack" : "skiplist";
+    case OBJ_SET:
+      if (encoding == kEncodingIntSet)
+        return "intset";
+      return encoding == kEncodingCompactSet ? "compactset" : "hashtable";
+  }
+  return {};
+}
+
+// Latency histograms of ServerState::TxPhaseHistograms by phase name
+array<pair<string_view, const base::Histogram*>, 4> TxPhaseHistos(
+    const ServerState::TxPhaseHistograms& histos) {
+  return {{{"schedule", &histos.schedule},
+           {"queue_wait", &histos.queue_wait},
+           {"execution", &histos.execution},
+           {"conclude", &histos.conclude}}};
+}
+
+// Coarse family of a command for aggregated metrics, derived from its ACL categories.
+string_view CmdFamilyName(uint32_t acl_categories) {
+  static constexpr pair<uint32_t, string_view> kFamilies[] = {
+      {acl::STRING, "string"},         {acl::LIST, "list"},
+      {acl::HASH, "hash"},             {acl::SET, "set"},
+      {acl::SORTEDSET, "sortedset"},   {acl::STREAM, "stream"},
+      {acl::BITMAP, "bitmap"},         {acl::HYPERLOGLOG, "hyperloglog"},
+      {acl::GEO, "geo"},               {acl::JSON, "json"},
+      {acl::FT_SEARCH, "search"},      {acl::PUBSUB, "pubsub"},
+      {acl::SCRIPTING, "scripting"},   {acl::TRANSACTION, "transaction"},
+      {acl::CONNECTION, "connection"}, {acl::ADMIN, "admin"},
+      {acl::KEYSPACE, "keyspace"}};
+  for (const auto& [cat, name] : kFamilies) {
+    if (acl_categories & cat)
+      return name;
+  }
+  return "other";
+}
+
+// Appends a prometheus histogram from the cumulative counts of CmdLatencyHistogram buckets.
+void AppendLatencyHistogram(string_view metric_name, string_view label, string_view label_value,
+                            const CmdLatencyHistogram& hist, uint64_t sum_usec, string* dest) {
+  const string bucket_name = StrCat(metric_name, "_bucket");
+  uint64_t cumulative = 0;
+  for (unsigned i = 0; i + 1 < CmdLatencyHistogram::kNumBuckets; ++i) {
+    cumulative += hist.buckets[i];
+    AppendMetricValue(bucket_name, cumulative, {label, "le"},
+                      {label_value, StrCat((1ULL << i) * 1e-6)}, dest);
+  }
+  cumulative += hist.buckets.back();
+  AppendMetricValue(bucket_name, cumulative, {label, "le"}, {label_value, "+Inf"}, dest);
+  AppendMetricValue(StrCat(metric_name, "_sum"), sum_usec * 1e-6, {label}, {label_value}, dest);
+  AppendMetricValue(StrCat(metric_name, "_count"), cumulative, {label}, {label_value}, dest);
+}
+
+// p50, p99 and p99.9 in the format of INFO LATENCYSTATS
+string FormatPercentiles(const base::Histogram& hist) {
+  return absl::StrCat("p50=", hist.Percentile(50), ",p99=", hist.Percentile(99),
+                      ",p99.9=", hist.Percentile(99.9));
+}
+
+double CyclesToSeconds(uint64_t cycles) {
+  return cycles / absl::base_internal::CycleClock::Frequency();
+}
+
 void PrintPrometheusMetrics(const Metrics& m, StringResponse* resp) {
   // Server metrics
   AppendMetricHeader("version", "", MetricType::GAUGE, &resp->body());
@@ -1032,6 +1492,70 @@ void PrintPrometheusMetrics(const Metrics& m, StringResponse* resp) {
     absl::StrAppend(&resp->body(), type_used_memory_metric);
   }
 
+  if (!m.prefix_memory.empty()) {
+    string prefix_memory_metrics, prefix_keys_metrics;
+    AppendMetricHeader("prefix_used_memory", "Sampled memory usage by key prefix and type",
+                       MetricType::GAUGE, &prefix_memory_metrics);
+    AppendMetricHeader("prefix_keys", "Sampled number of keys by key prefix and type",
+                       MetricType::GAUGE, &prefix_keys_metrics);
+    for (const auto& usage : m.prefix_memory) {
+      // Prefixes come from the keys, so they must be escaped to be valid label values.
+      string prefix =
+          absl::StrReplaceAll(usage.prefix, {{"\\", "\\\\"}, {"\"", "\\\""}, {"\n", "\\n"}});
+      string_view type = CompactObj::ObjTypeToString(usage.type);
+      AppendMetricValue("prefix_used_memory", usage.bytes, {"prefix", "type"}, {prefix, type},
+                        &prefix_memory_metrics);
+      AppendMetricValue("prefix_keys", usage.keys, {"prefix", "type"}, {prefix, type},
+                        &prefix_keys_metrics);
+    }
+    absl::StrAppend(&resp->body(), prefix_memory_metrics, prefix_keys_metrics);
+  }
+
+  if (!m.value_size_histograms.empty()) {
+    string value_size_metrics;
+    AppendMetricHeader("value_size_bytes", "Sampled heap bytes of the values by type",
+                       MetricType::HISTOGRAM, &value_size_metrics);
+    for (const auto& [type, hist] : m.value_size_histograms) {
+      AppendValueSizeHistogram("value_size_bytes", hist, {"type"},
+                               {CompactObj::ObjTypeToString(type)}, &value_size_metrics);
+    }
+    absl::StrAppend(&resp->body(), value_size_metrics);
+  }
+
+  if (!m.encoding_size_histograms.empty()) {
+    string encoding_size_metrics;
+    AppendMetricHeader("encoding_size_bytes",
+                       "Sampled heap bytes of the containers by type and encoding",
+                       MetricType::HISTOGRAM, &encoding_size_metrics);
+    for (const auto& [type_enc, hist] : m.encoding_size_histograms) {
+      string_view encoding = EncodingName(type_enc.first, type_enc.second);
+      if (encoding.empty())
+        continue;
+      AppendValueSizeHistogram("encoding_size_bytes", hist, {"type", "encoding"},
+                               {CompactObj::ObjTypeToString(type_enc.first), encoding},
+                               &encoding_size_metrics);
+    }
+    absl::StrAppend(&resp->body(), encoding_size_metrics);
+  }
+
+  if (!m.big_keys.empty()) {
+    string big_key_bytes_metrics, big_key_elements_metrics;
+    AppendMetricHeader("big_key_bytes", "Heap bytes of the values of the largest keys",
+                       MetricType::GAUGE, &big_key_bytes_metrics);
+    AppendMetricHeader("big_key_elements", "Number of elements of the largest keys",
+                       MetricType::GAUGE, &big_key_elements_metrics);
+    for (const auto& [db, key] : m.big_keys) {
+      string name = EscapeLabelValue(key.key);
+      string db_name = StrCat(db);
+      string_view type = CompactObj::ObjTypeToString(key.type);
+      AppendMetricValue("big_key_bytes", key.bytes, {"db", "key", "type"}, {db_name, name, type},
+                        &big_key_bytes_metrics);
+      AppendMetricValue("big_key_elements", key.elements, {"db", "key", "type"},
+                        {db_name, name, type}, &big_key_elements_metrics);
+    }
+    absl::StrAppend(&resp->body(), big_key_bytes_metrics, big_key_elements_metrics);
+  }
+
   // Stats metrics
   AppendMetricWithoutLabels("connections_received_total", "", conn_stats.conn_received_cnt,
                             MetricType::COUNTER, &resp->body());
@@ -1089,6 +1613,16 @@ void PrintPrometheusMetrics(const Metrics& m, StringResponse* resp) {
                                 double(m.disk_stats.read_delay_usec) * 1e-6, MetricType::COUNTER,
                                 &resp->body());
     }
+    if (m.disk_stats.write_total > 0) {
+      AppendMetricWithoutLabels("tiered_write_ops_total", "", m.disk_stats.write_total,
+                                MetricType::COUNTER, &resp->body());
+      AppendMetricWithoutLabels("tiered_write_latency_seconds", "",
+                                double(m.disk_stats.write_delay_usec) * 1e-6, MetricType::COUNTER,
+                                &resp->body());
+      AppendMetricWithoutLabels("tiered_coalesced_writes_total", "",
+                                m.disk_stats.coalesced_write_total, MetricType::COUNTER,
+                                &resp->body());
+    }
     absl::StrAppend(&resp->body(), send_latency_metrics);
     absl::StrAppend(&resp->body(), send_count_metrics);
   }
@@ -1125,10 +1659,101 @@ void PrintPrometheusMetrics(const Metrics& m, StringResponse* resp) {
       AppendMetricValue("commands_total", calls, {"cmd"}, {name}, &command_metrics);
       AppendMetricValue("commands_duration_seconds", duration_seconds, {"cmd"}, {name},
                         &command_metrics);
+      AppendMetricValue("commands_cpu_seconds", CyclesToSeconds(m.cmd_cpu_cycles_map.at(name)),
+                        {"cmd"}, {name}, &command_metrics);
+    }
+
+    AppendMetricHeader("command_latency_seconds", "Latency histograms of commands",
+                       MetricType::HISTOGRAM, &command_metrics);
+    for (const auto& [name, hist] : m.cmd_latency_map) {
+      AppendLatencyHistogram("command_latency_seconds", "cmd", name, hist,
+                             m.cmd_stats_map.at(name).second, &command_metrics);
+    }
+
+    AppendMetricHeader("command_family_latency_seconds", "Latency histograms of command families",
+                       MetricType::HISTOGRAM, &command_metrics);
+    for (const auto& [family, hist] : m.family_latency_map) {
+      AppendLatencyHistogram("command_family_latency_seconds", "family", family, hist,
+                             m.family_stats_map.at(family).second, &command_metrics);
     }
     absl::StrAppend(&resp->body(), command_metrics);
   }
 
+  // Transaction phase latencies
+  if (!m.tx_phase_histos.empty()) {
+    string tx_phase_metrics;
+    AppendMetricHeader("transaction_phase_latency_seconds",
+                       "Latencies of the phases of transactions by command", MetricType::SUMMARY,
+                       &tx_phase_metrics);
+    for (const auto& [name, histos] : m.tx_phase_histos) {
+      for (const auto& [phase, hist] : TxPhaseHistos(histos)) {
+        if (hist->count() == 0)
+          continue;
+
+        for (double q : {0.5, 0.99, 0.999}) {
+          AppendMetricValue("transaction_phase_latency_seconds", hist->Percentile(q * 100) * 1e-6,
+                            {"cmd", "phase", "quantile"}, {name, phase, absl::StrCat(q)},
+                            &tx_phase_metrics);
+        }
+        AppendMetricValue("transaction_phase_latency_seconds_count", hist->count(),
+                          {"cmd", "phase"}, {name, phase}, &tx_phase_metrics);
+      }
+    }
+
+    AppendMetricHeader("transaction_hops", "Number of hops of transactions by command",
+                       MetricType::SUMMARY, &tx_phase_metrics);
+    for (const auto& [name, histos] : m.tx_phase_histos) {
+      if (histos.hops.count() == 0)
+        continue;
+
+      for (double q : {0.5, 0.99, 0.999}) {
+        AppendMetricValue("transaction_hops", histos.hops.Percentile(q * 100),
+                          {"cmd", "quantile"}, {name, absl::StrCat(q)}, &tx_phase_metrics);
+      }
+      AppendMetricValue("transaction_hops_count", histos.hops.count(), {"cmd"}, {name},
+                        &tx_phase_metrics);
+    }
+    absl::StrAppend(&resp->body(), tx_phase_metrics);
+  }
+
+  // Shard load samples
+  {
+    using LoadStats = EngineShard::LoadStats;
+    struct {
+      string_view name, help;
+      base::Histogram LoadStats::*hist;
+      double scale;
+    } load_metrics[] = {
+        {"shard_txq_len", "Length of the transaction queue of the shard, sampled every heartbeat",
+         &LoadStats::txq_len, 1},
+        {"shard_continuation_wait_seconds",
+         "Time the continuation transaction blocked the shard queue, sampled every heartbeat",
+         &LoadStats::cont_wait_usec, 1e-6},
+        {"shard_hop_latency_seconds",
+         "Latency of sampled hops from their submission until they start on the shard",
+         &LoadStats::hop_latency_usec, 1e-6},
+    };
+
+    string shard_load_metrics;
+    for (const auto& metric : load_metrics) {
+      AppendMetricHeader(metric.name, metric.help, MetricType::SUMMARY, &shard_load_metrics);
+      for (size_t sid = 0; sid < m.shard_load_stats.size(); ++sid) {
+        const base::Histogram& hist = m.shard_load_stats[sid].*metric.hist;
+        if (hist.count() == 0)
+          continue;
+
+        string shard = absl::StrCat(sid);
+        for (double q : {0.5, 0.99, 0.999}) {
+          AppendMetricValue(metric.name, hist.Percentile(q * 100) * metric.scale,
+                            {"shard", "quantile"}, {shard, absl::StrCat(q)}, &shard_load_metrics);
+        }
+        AppendMetricValue(StrCat(metric.name, "_count"), hist.count(), {"shard"}, {shard},
+                          &shard_load_metrics);
+      }
+    }
+    absl::StrAppend(&resp->body(), shard_load_metrics);
+  }
+
   if (!m.replication_metrics.empty()) {
     string replication_lag_metrics;
     AppendMetricHeader("connected_replica_lag_records", "Lag in records of a connected replica.",
@@ -1153,6 +1778,27 @@ void PrintPrometheusMetrics(const Metrics& m, StringResponse* resp) {
   double longrun_seconds = m.fiber_longrun_usec * 1e-6;
   AppendMetricWithoutLabels("fiber_longrun_seconds", "", longrun_seconds, MetricType::COUNTER,
                             &resp->body());
+
+  {
+    string loop_latency_metrics;
+    AppendMetricHeader("proactor_loop_latency_seconds",
+                       "Latency of the event loop iterations of the proactors, sampled every 10ms",
+                       MetricType::SUMMARY, &loop_latency_metrics);
+    for (size_t index = 0; index < m.loop_latency_usec.size(); ++index) {
+      const base::Histogram& hist = m.loop_latency_usec[index];
+      if (hist.count() == 0)
+        continue;
+
+      string thread = absl::StrCat(index);
+      for (double q : {0.5, 0.99, 0.999}) {
+        AppendMetricValue("proactor_loop_latency_seconds", hist.Percentile(q * 100) * 1e-6,
+                          {"thread", "quantile"}, {thread, absl::StrCat(q)}, &loop_latency_metrics);
+      }
+      AppendMetricValue("proactor_loop_latency_seconds_count", hist.count(), {"thread"}, {thread},
+                        &loop_latency_metrics);
+    }
+    absl::StrAppend(&resp->body(), loop_latency_metrics);
+  }
   AppendMetricWithoutLabels("tx_queue_len", "", m.tx_queue_len, MetricType::GAUGE, &resp->body());
 
   AppendMetricHeader("transaction_widths_total", "Transaction counts by their widths",
@@ -1183,13 +1829,66 @@ void PrintPrometheusMetrics(const Metrics& m, StringResponse* resp) {
   absl::StrAppend(&resp->body(), db_key_expire_metrics);
 }
 
+void PrintHotKeysMetrics(StringResponse* resp) {
+  constexpr size_t kNumHotKeys = 10;
+  AppendMetricHeader("hot_key_qps", "Estimated accesses per second of the hottest keys",
+                     MetricType::GAUGE, &resp->body());
+  for (const auto& hot_key : CollectHotKeys(kNumHotKeys)) {
+    AppendMetricValue("hot_key_qps", hot_key.qps, {"db", "shard", "key"},
+                      {absl::StrCat(hot_key.db), absl::StrCat(hot_key.shard),
+                       EscapeLabelValue(hot_key.key)},
+                      &resp->body());
+  }
+}
+
+void PrintMallocSizeClassMetrics(StringResponse* resp) {
+  vector<vector<MallocSizeClass>> shard_classes(shard_set->size());
+  shard_set->RunBriefInParallel([&](EngineShard* shard) {
+    shard_classes[shard->shard_id()] = CollectMallocSizeClasses(false);
+  });
+
+  string committed_metrics, used_metrics, pages_metrics;
+  AppendMetricHeader("malloc_size_class_committed_bytes",
+                     "Committed bytes of the mimalloc pages by shard and block size",
+                     MetricType::GAUGE, &committed_metrics);
+  AppendMetricHeader("malloc_size_class_used_bytes",
+                     "Bytes of the used blocks of the mimalloc pages by shard and block size",
+                     MetricType::GAUGE, &used_metrics);
+  AppendMetricHeader("malloc_size_class_pages",
+                     "Mimalloc pages by shard, block size and the upper bound of the percentage "
+                     "of their committed bytes in use",
+                     MetricType::GAUGE, &pages_metrics);
+
+  constexpr string_view kUtilization[] = {"25", "50", "75", "100"};
+  for (ShardId sid = 0; sid < shard_classes.size(); ++sid) {
+    string shard = absl::StrCat(sid);
+    for (const MallocSizeClass& size_class : shard_classes[sid]) {
+      string block_size = absl::StrCat(size_class.block_size);
+      AppendMetricValue("malloc_size_class_committed_bytes", size_class.committed,
+                        {"shard", "block_size"}, {shard, block_size}, &committed_metrics);
+      AppendMetricValue("malloc_size_class_used_bytes", size_class.used, {"shard", "block_size"},
+                        {shard, block_size}, &used_metrics);
+      for (size_t i = 0; i < size_class.pages_by_utilization.size(); ++i) {
+        AppendMetricValue("malloc_size_class_pages", size_class.pages_by_utilization[i],
+                          {"shard", "block_size", "utilization"},
+                          {shard, block_size, kUtilization[i]}, &pages_metrics);
+      }
+    }
+  }
+  absl::StrAppend(&resp->body(), committed_metrics, used_metrics, pages_metrics);
+}
+
 void ServerFamily::ConfigureMetrics(util::HttpListenerBase* http_base) {
   // The naming of the metrics should be compatible with redis_exporter, see
   // https://github.com/oliver006/redis_exporter/blob/master/exporter/exporter.go#L111
 
   auto cb = [this](const util::http::QueryArgs& args, util::HttpContext* send) {
     StringResponse resp = util::http::MakeStringResponse(boost::beast::http::status::ok);
-    PrintPrometheusMetrics(this->GetMetrics(), &resp);
+    PrintPrometheusMetrics(*this->GetCachedMetrics(), &resp);
+    if (IsTopKeysTrackingEnabled())
+      PrintHotKeysMetrics(&resp);
+    if (GetFlag(FLAGS_metrics_malloc_size_classes))
+      PrintMallocSizeClassMetrics(&resp);
 
     return send->Invoke(std::move(resp));
   };
@@ -1240,6 +1939,7 @@ string ServerFamily::GetReplicaMasterId() const {
 }
 
 void ServerFamily::OnClose(ConnectionContext* cntx) {
+  UpdateTrackingPrefixes(cntx, false);
   dfly_cmd_->OnClose(cntx);
 }
 
@@ -1262,7 +1962,8 @@ void ServerFamily::StatsMC(std::string_view section, facade::ConnectionContext*
   double utime = dbl_time(ru.ru_utime);
   double systime = dbl_time(ru.ru_stime);
 
-  Metrics m = GetMetrics();
+  shared_ptr<const Metrics> metrics = GetCachedMetrics();
+  const Metrics& m = *metrics;
 
   ADD_LINE(pid, getpid());
   ADD_LINE(uptime, m.uptime);
@@ -1297,7 +1998,7 @@ GenericError ServerFamily::DoSave(bool ignore_state) {
 }
 
 GenericError ServerFamily::DoSave(bool new_version, string_view basename, Transaction* trans,
-                                  bool ignore_state) {
+                                  bool ignore_state, bool delta) {
   if (shard_set->IsTieringEnabled()) {
     return GenericError{make_error_code(errc::operation_not_permitted),
                         StrCat("Can not save database in tiering mode")};
@@ -1314,8 +2015,8 @@ GenericError ServerFamily::DoSave(bool new_version, string_view basename, Transa
     start_save_time_ = absl::Now();
   }
   SaveStagesController sc{detail::SaveStagesInputs{
-      new_version, basename, trans, &service_, &is_saving_, fq_threadpool_.get(), &last_save_info_,
-      &save_mu_, &save_bytes_cb_, snapshot_storage_}};
+      new_version, delta, basename, trans, &service_, &is_saving_, fq_threadpool_.get(),
+      &last_save_info_, &save_mu_, &save_bytes_cb_, snapshot_storage_}};
   auto res = sc.Save();
   {
     std::lock_guard lck(save_mu_);
@@ -1346,6 +2047,16 @@ LastSaveInfo ServerFamily::GetLastSaveInfo() const {
   return last_save_info_;
 }
 
+vector<PrefixMemoryUsage> ServerFamily::GetPrefixMemoryUsage() const {
+  lock_guard lk(prefix_memory_mu_);
+  return prefix_memory_;
+}
+
+void ServerFamily::SetPrefixMemoryUsage(vector<PrefixMemoryUsage> usage) {
+  lock_guard lk(prefix_memory_mu_);
+  prefix_memory_ = std::move(usage);
+}
+
 void ServerFamily::DbSize(CmdArgList args, ConnectionContext* cntx) {
   atomic_ulong num_keys{0};
 
@@ -1448,6 +2159,7 @@ void ServerFamily::Auth(CmdArgList args, ConnectionContext* cntx) {
       cntx->acl_categories = cred.acl_categories;
       cntx->acl_commands = cred.acl_commands;
       cntx->keys = std::move(cred.keys);
+      cntx->priority = cred.priority;
       cntx->authenticated = true;
       return cntx->SendOk();
     }
@@ -1489,6 +2201,10 @@ void ServerFamily::Client(CmdArgList args, ConnectionContext* cntx) {
     return ClientTracking(sub_args, cntx);
   } else if (sub_cmd == "KILL") {
     return ClientKill(sub_args, absl::MakeSpan(listeners_), cntx);
+  } else if (sub_cmd == "READSTALENESS") {
+    return ClientReadStaleness(sub_args, cntx);
+  } else if (sub_cmd == "SETPRIORITY" || sub_cmd == "PRIORITY") {
+    return ClientSetPriority(sub_args, cntx);
   }
 
   if (sub_cmd == "SETINFO") {
@@ -1584,6 +2300,7 @@ void ServerFamily::Memory(CmdArgList args, ConnectionContext* cntx) {
 void ServerFamily::Save(CmdArgList args, ConnectionContext* cntx) {
   string err_detail;
   bool new_version = absl::GetFlag(FLAGS_df_snapshot_format);
+  bool delta = false;
   if (args.size() > 2) {
     return cntx->SendError(kSyntaxErr);
   }
@@ -1595,6 +2312,10 @@ void ServerFamily::Save(CmdArgList args, ConnectionContext* cntx) {
       new_version = true;
     } else if (sub_cmd == "RDB") {
       new_version = false;
+    } else if (sub_cmd == "DELTA") {
+      if (!absl::GetFlag(FLAGS_snapshot_deltas))
+        return cntx->SendError("SAVE DELTA requires --snapshot_deltas");
+      new_version = delta = true;
     } else {
       return cntx->SendError(UnknownSubCmd(sub_cmd, "SAVE"), kSyntaxErrType);
     }
@@ -1605,7 +2326,7 @@ void ServerFamily::Save(CmdArgList args, ConnectionContext* cntx) {
     basename = ArgS(args, 1);
   }
 
-  GenericError ec = DoSave(new_version, basename, cntx->transaction);
+  GenericError ec = DoSave(new_version, basename, cntx->transaction, false, delta);
   if (ec) {
     cntx->SendError(ec.Format());
   } else {
@@ -1622,6 +2343,15 @@ static void MergeDbSliceStats(const DbSlice::Stats& src, Metrics* dest) {
 
   dest->events += src.events;
   dest->small_string_bytes += src.small_string_bytes;
+  dest->compressed_values += src.compressed_values;
+  dest->compressed_value_bytes += src.compressed_value_bytes;
+  dest->compressed_value_raw_bytes += src.compressed_value_raw_bytes;
+  dest->shared_string_blobs += src.shared_string_blobs;
+  dest->shared_string_bytes += src.shared_string_bytes;
+  dest->shared_string_refs += src.shared_string_refs;
+  dest->lazyfree_pending_objects += src.lazyfree_pending_objects;
+  dest->lazyfree_pending_elements += src.lazyfree_pending_elements;
+  dest->scan_snapshot_bytes += src.scan_snapshot_bytes;
 }
 
 void ServerFamily::ResetStat() {
@@ -1654,12 +2384,6 @@ Metrics ServerFamily::GetMetrics() const {
   Metrics result;
   Mutex mu;
 
-  auto cmd_stat_cb = [&dest = result.cmd_stats_map](string_view name, const CmdCallStats& stat) {
-    auto& [calls, sum] = dest[string{name}];
-    calls += stat.first;
-    sum += stat.second;
-  };
-
   auto cb = [&](unsigned index, ProactorBase* pb) {
     EngineShard* shard = EngineShard::tlocal();
     ServerState* ss = ServerState::tlocal();
@@ -1670,8 +2394,13 @@ Metrics ServerFamily::GetMetrics() const {
     result.fiber_switch_delay_usec += fb2::FiberSwitchDelayUsec();
     result.fiber_longrun_cnt += fb2::FiberLongRunCnt();
     result.fiber_longrun_usec += fb2::FiberLongRunSumUsec();
+    if (result.loop_latency_usec.size() <= index)
+      result.loop_latency_usec.resize(index + 1);
+    result.loop_latency_usec[index] = ProactorWatchdog::LoopLatency();
 
     result.coordinator_stats.Add(shard_set->size(), ss->stats);
+    for (const auto& [name, histos] : ss->tx_phase_histos())
+      result.tx_phase_histos[string{name}].Merge(histos);
 
     result.uptime = time(NULL) - this->start_time_;
     result.qps += uint64_t(ss->MovingSum6());
@@ -1681,6 +2410,12 @@ Metrics ServerFamily::GetMetrics() const {
       result.heap_used_bytes += shard->UsedMemory();
       MergeDbSliceStats(shard->db_slice().GetStats(), &result);
       result.shard_stats += shard->stats();
+      if (result.shard_load_stats.size() <= shard->shard_id())
+        result.shard_load_stats.resize(shard->shard_id() + 1);
+      result.shard_load_stats[shard->shard_id()] = shard->GetLoadStats();
+
+      if (shard->table_arena())
+        result.table_arena_stats += shard->table_arena()->GetStats();
 
       if (shard->tiered_storage()) {
         result.tiered_stats += shard->tiered_storage()->GetStats();
@@ -1690,12 +2425,36 @@ Metrics ServerFamily::GetMetrics() const {
       if (shard->search_indices())
         result.search_stats += shard->search_indices()->GetStats();
 
+      const DbSlice& db_slice = shard->db_slice();
+      for (DbIndex db = 0; db < db_slice.db_array_size(); ++db) {
+        if (!db_slice.IsDbValid(db))
+          continue;
+        const BigKeys& big_keys = db_slice.GetDBTable(db)->big_keys;
+        for (const auto& [type, hist] : big_keys.histograms())
+          result.value_size_histograms[type].Merge(hist);
+        for (const auto& [type_enc, hist] : big_keys.encoding_histograms())
+          result.encoding_size_histograms[type_enc].Merge(hist);
+        for (const auto& key : big_keys.by_bytes())
+          result.big_keys.emplace_back(db, key);
+      }
+
       result.traverse_ttl_per_sec += shard->GetMovingSum6(EngineShard::TTL_TRAVERSE);
       result.delete_ttl_per_sec += shard->GetMovingSum6(EngineShard::TTL_DELETE);
       if (result.tx_queue_len < shard->txq()->size())
         result.tx_queue_len = shard->txq()->size();
     }
 
+    auto cmd_stat_cb = [&](const CommandId& cid, const CmdCallStats& stat) {
+      const auto& hist = cid.GetLatencyHistogram(index);
+      string name{cid.name()}, family{CmdFamilyName(cid.acl_categories())};
+      for (auto* dest : {&result.cmd_stats_map[name], &result.family_stats_map[family]}) {
+        dest->first += stat.first;
+        dest->second += stat.second;
+      }
+      result.cmd_latency_map[name].Merge(hist);
+      result.family_latency_map[family].Merge(hist);
+      result.cmd_cpu_cycles_map[name] += cid.GetCpuCycles(index);
+    };
     service_.mutable_registry()->MergeCallStats(index, cmd_stat_cb);
   };
 
@@ -1706,9 +2465,19 @@ Metrics ServerFamily::GetMetrics() const {
   result.traverse_ttl_per_sec /= 6;
   result.delete_ttl_per_sec /= 6;
 
-  bool is_master = ServerState::tlocal() && ServerState::tlocal()->is_master;
-  if (is_master)
-    result.replication_metrics = dfly_cmd_->GetReplicasRoleInfo();
+  // Lua interpreters live on all threads, not only on shards.
+  result.lua_used_bytes = used_mem_lua.load(memory_order_relaxed);
+  result.heap_used_bytes += result.lua_used_bytes;
+
+  // Replicas may have replicas of their own.
+  result.replication_metrics = dfly_cmd_->GetReplicasRoleInfo();
+
+  result.prefix_memory = GetPrefixMemoryUsage();
+
+  sort(result.big_keys.begin(), result.big_keys.end(),
+       [](const auto& l, const auto& r) { return l.second.bytes > r.second.bytes; });
+  if (result.big_keys.size() > kMaxBigKeyMetrics)
+    result.big_keys.resize(kMaxBigKeyMetrics);
 
   // Update peak stats. We rely on the fact that GetMetrics is called frequently enough to
   // update peak_stats_ from it.
@@ -1722,6 +2491,29 @@ Metrics ServerFamily::GetMetrics() const {
   return result;
 }
 
+shared_ptr<const Metrics> ServerFamily::GetCachedMetrics() const {
+  uint64_t max_staleness = GetFlag(FLAGS_metrics_max_staleness_ms);
+  if (max_staleness == 0)
+    return make_shared<const Metrics>(GetMetrics());
+
+  uint64_t now = GetCurrentTimeMs();
+  shared_ptr<const MetricsSnapshot> snapshot = atomic_load(&cached_metrics_);
+  bool fresh = snapshot && now < snapshot->collected_ms + max_staleness;
+  if (!fresh && !collecting_metrics_.exchange(true, memory_order_acquire)) {
+    auto collected = make_shared<MetricsSnapshot>();
+    collected->metrics = GetMetrics();
+    collected->collected_ms = now;
+    atomic_store(&cached_metrics_, shared_ptr<const MetricsSnapshot>(collected));
+    collecting_metrics_.store(false, memory_order_release);
+    snapshot = std::move(collected);
+  } else if (!snapshot) {  // Another caller collects the first snapshot.
+    return make_shared<const Metrics>(GetMetrics());
+  }
+
+  // Shares the ownership of the snapshot.
+  return shared_ptr<const Metrics>(snapshot, &snapshot->metrics);
+}
+
 void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
   if (args.size() > 1) {
     return cntx->SendError(kSyntaxErr);
@@ -1749,7 +2541,8 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
     absl::StrAppend(&info, a1, ":", a2, "\r\n");
   };
 
-  Metrics m = GetMetrics();
+  shared_ptr<const Metrics> metrics = GetCachedMetrics();
+  const Metrics& m = *metrics;
   DbStats total;
   for (const auto& db_stats : m.db_stats)
     total += db_stats;
@@ -1792,6 +2585,9 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
 
     append("comitted_memory", GetMallocCurrentCommitted());
 
+    append("used_memory_lua", m.lua_used_bytes);
+    append("used_memory_lua_human", HumanReadableNumBytes(m.lua_used_bytes));
+
     append("maxmemory", max_memory_limit);
     append("maxmemory_human", HumanReadableNumBytes(max_memory_limit));
 
@@ -1808,12 +2604,30 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
       }
     }
     append("table_used_memory", total.table_mem_usage);
+    if (m.table_arena_stats.pages > 0) {
+      append("table_arena_pages", m.table_arena_stats.pages);
+      append("table_arena_reserved_bytes", m.table_arena_stats.reserved_bytes);
+      append("table_arena_used_bytes", m.table_arena_stats.used_bytes);
+    }
     append("num_buckets", total.bucket_count);
     append("num_entries", total.key_count);
     append("inline_keys", total.inline_keys);
     append("listpack_blobs", total.listpack_blob_cnt);
     append("listpack_bytes", total.listpack_bytes);
     append("small_string_bytes", m.small_string_bytes);
+    if (m.compressed_values > 0) {
+      append("compressed_values", m.compressed_values);
+      append("compressed_value_bytes", m.compressed_value_bytes);
+      append("compressed_value_raw_bytes", m.compressed_value_raw_bytes);
+    }
+    if (m.shared_string_blobs > 0) {
+      append("shared_string_blobs", m.shared_string_blobs);
+      append("shared_string_bytes", m.shared_string_bytes);
+      append("shared_string_refs", m.shared_string_refs);
+    }
+    append("lazyfree_pending_objects", m.lazyfree_pending_objects);
+    append("lazyfree_pending_elements", m.lazyfree_pending_elements);
+    append("scan_snapshot_bytes", m.scan_snapshot_bytes);
     append("pipeline_cache_bytes", m.facade_stats.conn_stats.pipeline_cmd_cache_bytes);
     append("dispatch_queue_bytes", m.facade_stats.conn_stats.dispatch_queue_bytes);
     append("dispatch_queue_subscriber_bytes",
@@ -1861,8 +2675,10 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
     append("instantaneous_output_kbps", -1);
     append("rejected_connections", -1);
     append("expired_keys", m.events.expired_keys);
+    append("expired_fields", m.events.expired_fields);
     append("evicted_keys", m.events.evicted_keys);
     append("hard_evictions", m.events.hard_evictions);
+    append("lazyfreed_objects", m.events.lazyfreed_objects);
     append("garbage_checked", m.events.garbage_checked);
     append("garbage_collected", m.events.garbage_collected);
     append("bump_ups", m.events.bumpups);
@@ -1890,12 +2706,19 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
     append("tiered_bytes", total.tiered_size);
     append("tiered_reads", m.disk_stats.read_total);
     append("tiered_read_latency_usec", m.disk_stats.read_delay_usec);
+    append("tiered_write_ops", m.disk_stats.write_total);
+    append("tiered_write_latency_usec", m.disk_stats.write_delay_usec);
+    append("tiered_coalesced_writes", m.disk_stats.coalesced_write_total);
     append("tiered_writes", m.tiered_stats.tiered_writes);
     append("tiered_reserved", m.tiered_stats.storage_reserved);
     append("tiered_capacity", m.tiered_stats.storage_capacity);
     append("tiered_aborted_writes", m.tiered_stats.aborted_write_cnt);
     append("tiered_flush_skipped", m.tiered_stats.flush_skip_cnt);
     append("tiered_throttled_writes", m.tiered_stats.throttled_write_cnt);
+    append("tiered_compaction_moves", m.tiered_stats.compaction_moves);
+    append("tiered_page_cache_hits", m.tiered_stats.page_cache_hits);
+    append("tiered_page_cache_misses", m.tiered_stats.page_cache_misses);
+    append("tiered_blob_bytes", m.tiered_stats.blob_bytes);
   }
 
   if (should_enter("PERSISTENCE", true)) {
@@ -1942,11 +2765,23 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
       append("tx_width_freq", val);
     }
     append("tx_shard_ooo_total", m.shard_stats.tx_ooo_total);
+    append("tx_high_priority_hops_total", m.shard_stats.high_priority_hop_total);
     append("tx_schedule_cancel_total", m.coordinator_stats.tx_schedule_cancel_cnt);
+    append("tx_hop_batches_total", m.coordinator_stats.tx_hop_batch_cnt);
+    append("tx_batched_hops_total", m.coordinator_stats.tx_batched_hop_cnt);
+    append("tx_optimistic_reads_total", m.coordinator_stats.tx_optimistic_read_cnt);
+    append("tx_optimistic_conflicts_total", m.coordinator_stats.tx_optimistic_conflict_cnt);
+    append("hot_key_cache_hits_total", m.coordinator_stats.hot_key_cache_hits);
+    append("split_counter_incrs_total", m.coordinator_stats.split_counter_incrs);
+    append("shed_commands_total", m.coordinator_stats.shed_cmd_cnt);
+    append("low_priority_paced_batches_total", m.coordinator_stats.low_priority_paced_cnt);
+    if (admission_)
+      append("shard_queue_delay_usec", admission_->QueueDelayUsec());
     append("tx_queue_len", m.tx_queue_len);
     append("eval_io_coordination_total", m.coordinator_stats.eval_io_coordination_cnt);
     append("eval_shardlocal_coordination_total",
            m.coordinator_stats.eval_shardlocal_coordination_cnt);
+    append("eval_shard_interpreter_total", m.coordinator_stats.eval_shard_interpreter_cnt);
     append("eval_squashed_flushes", m.coordinator_stats.eval_squashed_flushes);
     append("multi_squash_execution_total", m.coordinator_stats.multi_squash_executions);
     append("multi_squash_execution_hop_usec", m.coordinator_stats.multi_squash_exec_hop_usec);
@@ -1956,16 +2791,25 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
   if (should_enter("REPLICATION")) {
     ServerState& etl = *ServerState::tlocal();
 
-    if (etl.is_master) {
-      append("role", "master");
+    auto append_replicas = [&] {
       append("connected_slaves", m.facade_stats.conn_stats.num_replicas);
       const auto& replicas = m.replication_metrics;
       for (size_t i = 0; i < replicas.size(); i++) {
         auto& r = replicas[i];
         // e.g. slave0:ip=172.19.0.3,port=6379,state=full_sync
-        append(StrCat("slave", i), StrCat("ip=", r.address, ",port=", r.listening_port,
-                                          ",state=", r.state, ",lag=", r.lsn_lag));
+        string line = StrCat("ip=", r.address, ",port=", r.listening_port, ",state=", r.state);
+        if (r.journal_compressed_bytes > 0) {
+          double ratio = double(r.journal_bytes) / r.journal_compressed_bytes;
+          absl::StrAppend(&line, ",compression_ratio=", absl::StrFormat("%.2f", ratio),
+                          ",compression_cpu_ms=", r.journal_compress_usec / 1000);
+        }
+        append(StrCat("slave", i), StrCat(line, ",lag=", r.lsn_lag));
       }
+    };
+
+    if (etl.is_master) {
+      append("role", "master");
+      append_replicas();
       append("master_replid", master_id_);
     } else {
       append("role", "replica");
@@ -1982,6 +2826,13 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
       append("master_last_io_seconds_ago", rinfo.master_last_io_sec);
       append("master_sync_in_progress", rinfo.full_sync_in_progress);
       append("master_replid", rinfo.master_id);
+      for (size_t i = 0; i < rinfo.flow_lags.size(); i++) {
+        auto [lsn_lag, lag_ms] = rinfo.flow_lags[i];
+        string line = lsn_lag == UINT64_MAX ? "lsn_lag=unknown" : StrCat("lsn_lag=", lsn_lag);
+        absl::StrAppend(&line, ",lag_ms=", lag_ms == UINT64_MAX ? "unknown" : StrCat(lag_ms));
+        append(StrCat("master_shard", i), line);
+      }
+      append_replicas();
     }
   }
 
@@ -1996,9 +2847,12 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
     vector<pair<string_view, string>> commands;
     for (const auto& [name, stats] : m.cmd_stats_map) {
       const auto calls = stats.first, sum = stats.second;
+      const double cpu_usec = CyclesToSeconds(m.cmd_cpu_cycles_map.at(name)) * 1e6;
       commands.push_back(
           {name, absl::StrJoin({absl::StrCat("calls=", calls), absl::StrCat("usec=", sum),
-                                absl::StrCat("usec_per_call=", static_cast<double>(sum) / calls)},
+                                absl::StrCat("usec_per_call=", static_cast<double>(sum) / calls),
+                                absl::StrCat("cpu_usec=", uint64_t(cpu_usec)),
+                                absl::StrCat("cpu_usec_per_call=", calls ? cpu_usec / calls : 0)},
                                ",")});
     }
 
@@ -2009,6 +2863,17 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
                   vector<pair<string_view, uint64_t>>(unknown_cmd.cbegin(), unknown_cmd.cend()));
   }
 
+  if (should_enter("LATENCYSTATS", true)) {
+    for (const auto& [name, histos] : m.tx_phase_histos) {
+      for (const auto& [phase, hist] : TxPhaseHistos(histos)) {
+        if (hist->count() > 0)
+          append(StrCat("tx_", phase, "_usec_", name), FormatPercentiles(*hist));
+      }
+      if (histos.hops.count() > 0)
+        append(StrCat("tx_hops_", name), FormatPercentiles(histos.hops));
+    }
+  }
+
   if (should_enter("MODULES")) {
     append("module",
            "name=ReJSON,ver=20000,api=1,filters=0,usedby=[search],using=[],options=[handle-io-"
@@ -2206,6 +3071,10 @@ void ServerFamily::ReplicaOfInternal(string_view host, string_view port_sv, Conn
   auto new_replica = make_shared<Replica>(string(host), port, &service_, master_id());
   replica_ = new_replica;
 
+  // The positions of the loaded snapshot are valid only if it was not flushed since.
+  if (auto pos = std::exchange(snapshot_journal_position_, nullopt); pos && !cntx->transaction)
+    new_replica->SetJournalPosition(std::move(pos->first), std::move(pos->second));
+
   // TODO: disconnect pending blocked clients (pubsub, blocking commands)
   SetMasterFlagOnAllThreads(false);  // Flip flag after assiging replica
 
@@ -2339,6 +3208,18 @@ void ServerFamily::ReplConf(CmdArgList args, ConnectionContext* cntx) {
         return cntx->SendError(kInvalidIntErr);
       }
       dfly_cmd_->SetDflyClientVersion(cntx, DflyVersion(version));
+    } else if (cmd == "JOURNAL-COMPRESSION" && args.size() == 2) {
+      if (!absl::EqualsIgnoreCase(arg, "LZ4")) {
+        return cntx->SendError(kSyntaxErr);
+      }
+      dfly_cmd_->SetJournalCompression(cntx);
+    } else if (cmd == "JOURNAL-COMMANDS" && arg == "LIST" && args.size() == 2) {
+      // The command table of the compact journal encoding, empty if it is disabled.
+      auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+      const JournalCommandTable* table = journal_->command_table();
+      if (!table)
+        return rb->SendEmptyArray();
+      return rb->SendStringArr(table->names());
     } else if (cmd == "ACK" && args.size() == 2) {
       // Don't send error/Ok back through the socket, because we don't want to interleave with
       // the journal writes that we write into the same socket.
@@ -2355,6 +3236,7 @@ void ServerFamily::ReplConf(CmdArgList args, ConnectionContext* cntx) {
       }
       VLOG(2) << "Received client ACK=" << ack;
       cntx->replication_flow->last_acked_lsn = ack;
+      dfly_cmd_->OnReplicaAck();
       return;
     } else {
       VLOG(1) << "Error " << cmd << " " << arg << " " << args.size();
@@ -2370,6 +3252,47 @@ err:
   cntx->SendError(kSyntaxErr);
 }
 
+void ServerFamily::Wait(CmdArgList args, ConnectionContext* cntx) {
+  CmdArgParser parser{args};
+  auto [num_replicas, timeout_ms] = parser.Next<uint32_t, uint64_t>();
+  if (auto err = parser.Error(); err)
+    return cntx->SendError(err->MakeReply());
+
+  if (!ServerState::tlocal()->is_master)
+    return cntx->SendError("WAIT cannot be used with replica instances");
+
+  // Like in Redis, WAIT does not block inside a transaction.
+  if (cntx->conn_state.exec_info.IsRunning())
+    num_replicas = 0;
+
+  cntx->SendLong(dfly_cmd_->WaitForReplicas(num_replicas, timeout_ms));
+}
+
+void ServerFamily::WaitAof(CmdArgList args, ConnectionContext* cntx) {
+  CmdArgParser parser{args};
+  auto [num_local, num_replicas, timeout_ms] = parser.Next<uint32_t, uint32_t, uint64_t>();
+  if (auto err = parser.Error(); err)
+    return cntx->SendError(err->MakeReply());
+
+  // There is no append only file, the local writes are persisted only by snapshots.
+  if (num_local > 0) {
+    return cntx->SendError(
+        "WAITAOF cannot be used when numlocal is set but appendonly is disabled.");
+  }
+
+  if (!ServerState::tlocal()->is_master)
+    return cntx->SendError("WAITAOF cannot be used with replica instances");
+
+  if (cntx->conn_state.exec_info.IsRunning())
+    num_replicas = 0;
+
+  unsigned acked = dfly_cmd_->WaitForReplicas(num_replicas, timeout_ms);
+  auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+  rb->StartArray(2);
+  rb->SendLong(0);
+  rb->SendLong(acked);
+}
+
 void ServerFamily::Role(CmdArgList args, ConnectionContext* cntx) {
   auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
   ServerState& etl = *ServerState::tlocal();
@@ -2471,7 +3394,9 @@ void ServerFamily::SlowLog(CmdArgList args, ConnectionContext* cntx) {
         "    Return top <count> entries from the slowlog (default: 10, -1 mean all).",
         "    Entries are made of:",
         "    id, timestamp, time in microseconds, arguments array, client IP and port,",
-        "    client name",
+        "    client name and for transactional commands the split of their time in",
+        "    microseconds between schedule, queue_wait, execution, conclude and the",
+        "    coordinator, with the number of hops, shards and the longest shard queue",
         "LEN",
         "    Return the length of the slowlog.",
         "RESET",
@@ -2505,6 +3430,60 @@ void ServerFamily::SlowLog(CmdArgList args, ConnectionContext* cntx) {
   cntx->SendError(UnknownSubCmd(sub_cmd, "SLOWLOG"), kSyntaxErrType);
 }
 
+void ServerFamily::HotKeys(CmdArgList args, ConnectionContext* cntx) {
+  ToUpper(&args[0]);
+  string_view sub_cmd = ArgS(args, 0);
+  auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+
+  if (sub_cmd == "HELP") {
+    string_view help[] = {
+        "HOTKEYS <subcommand> [<arg> [value] [opt] ...]. Subcommands are:",
+        "GET [<count>]",
+        "    Return the <count> keys with the highest estimated access rate in the current",
+        "    window (default: 10, -1 means all). Entries are made of:",
+        "    key, db, shard, estimated accesses, estimated accesses per second",
+        "RESET",
+        "    Forget the counts and start a new window.",
+        "HELP",
+        "    Prints this help.",
+    };
+    return rb->SendSimpleStrArr(help);
+  }
+
+  if (!IsTopKeysTrackingEnabled())
+    return cntx->SendError("top keys tracking is disabled, see enable_top_keys_tracking");
+
+  if (sub_cmd == "RESET" && args.size() == 1) {
+    shard_set->RunBriefInParallel(
+        [](EngineShard* shard) { shard->db_slice().ResetHotKeysWindow(GetCurrentTimeMs()); });
+    return cntx->SendOk();
+  }
+
+  if (sub_cmd == "GET" && args.size() <= 2) {
+    size_t limit = 10;
+    if (args.size() == 2) {
+      int64_t num;
+      if (!absl::SimpleAtoi(ArgS(args, 1), &num) || num < -1)
+        return cntx->SendError("count should be greater than or equal to -1");
+      limit = num >= 0 ? size_t(num) : SIZE_MAX;
+    }
+
+    vector<DbSlice::HotKey> hot_keys = CollectHotKeys(limit);
+    rb->StartArray(hot_keys.size());
+    for (const auto& hot_key : hot_keys) {
+      rb->StartArray(5);
+      rb->SendBulkString(hot_key.key);
+      rb->SendLong(hot_key.db);
+      rb->SendLong(hot_key.shard);
+      rb->SendLong(hot_key.count);
+      rb->SendDouble(hot_key.qps);
+    }
+    return;
+  }
+
+  cntx->SendError(UnknownSubCmd(sub_cmd, "HOTKEYS"), kSyntaxErrType);
+}
+
 void ServerFamily::Module(CmdArgList args, ConnectionContext* cntx) {
   ToUpper(&args[0]);
   if (ArgS(args, 0) != "LIST")
@@ -2539,6 +3518,7 @@ constexpr uint32_t kDbSize = KEYSPACE | READ | FAST;
 constexpr uint32_t kDebug = ADMIN | SLOW | DANGEROUS;
 constexpr uint32_t kFlushDB = KEYSPACE | WRITE | SLOW | DANGEROUS;
 constexpr uint32_t kFlushAll = KEYSPACE | WRITE | SLOW | DANGEROUS;
+constexpr uint32_t kHotKeys = ADMIN | SLOW | DANGEROUS;
 constexpr uint32_t kInfo = SLOW | DANGEROUS;
 constexpr uint32_t kHello = FAST | CONNECTION;
 constexpr uint32_t kLastSave = ADMIN | FAST | DANGEROUS;
@@ -2554,6 +3534,8 @@ constexpr uint32_t kRole = ADMIN | FAST | DANGEROUS;
 constexpr uint32_t kSlowLog = ADMIN | SLOW | DANGEROUS;
 constexpr uint32_t kScript = SLOW | SCRIPTING;
 constexpr uint32_t kModule = ADMIN | SLOW | DANGEROUS;
+constexpr uint32_t kWait = SLOW | CONNECTION;
+constexpr uint32_t kWaitAof = SLOW | CONNECTION;
 // TODO(check this)
 constexpr uint32_t kDfly = ADMIN;
 }  // namespace acl
@@ -2573,6 +3555,7 @@ void ServerFamily::Register(CommandRegistry* registry) {
       << CI{"FLUSHALL", CO::WRITE | CO::GLOBAL_TRANS, -1, 0, 0, acl::kFlushAll}.HFUNC(FlushAll)
       << CI{"INFO", CO::LOADING, -1, 0, 0, acl::kInfo}.HFUNC(Info)
       << CI{"HELLO", CO::LOADING, -1, 0, 0, acl::kHello}.HFUNC(Hello)
+      << CI{"HOTKEYS", CO::ADMIN | CO::LOADING, -2, 0, 0, acl::kHotKeys}.HFUNC(HotKeys)
       << CI{"LASTSAVE", CO::LOADING | CO::FAST, 1, 0, 0, acl::kLastSave}.HFUNC(LastSave)
       << CI{"LATENCY", CO::NOSCRIPT | CO::LOADING | CO::FAST, -2, 0, 0, acl::kLatency}.HFUNC(
              Latency)
@@ -2589,7 +3572,9 @@ void ServerFamily::Register(CommandRegistry* registry) {
       << CI{"SLOWLOG", CO::ADMIN | CO::FAST, -2, 0, 0, acl::kSlowLog}.HFUNC(SlowLog)
       << CI{"SCRIPT", CO::NOSCRIPT | CO::NO_KEY_TRANSACTIONAL, -2, 0, 0, acl::kScript}.HFUNC(Script)
       << CI{"DFLY", CO::ADMIN | CO::GLOBAL_TRANS | CO::HIDDEN, -2, 0, 0, acl::kDfly}.HFUNC(Dfly)
-      << CI{"MODULE", CO::ADMIN, 2, 0, 0, acl::kModule}.HFUNC(Module);
+      << CI{"MODULE", CO::ADMIN, 2, 0, 0, acl::kModule}.HFUNC(Module)
+      << CI{"WAIT", CO::NOSCRIPT, 3, 0, 0, acl::kWait}.HFUNC(Wait)
+      << CI{"WAITAOF", CO::NOSCRIPT, 4, 0, 0, acl::kWaitAof}.HFUNC(WaitAof);
 }
 
 }  // namespace dfly
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <atomic>
+#include <memory>
 #include <optional>
 #include <string>
 
@@ -11,8 +13,11 @@
 #include "facade/dragonfly_listener.h"
 #include "facade/redis_parser.h"
 #include "facade/reply_builder.h"
+#include "server/admission_controller.h"
 #include "server/channel_store.h"
+#include "server/command_registry.h"
 #include "server/engine_shard_set.h"
+#include "server/proactor_watchdog.h"
 #include "server/replica.h"
 #include "server/server_state.h"
 
@@ -46,6 +51,7 @@ class ConnectionContext;
 class CommandRegistry;
 class DflyCmd;
 class Service;
+struct AggregateLoadResult;
 class ScriptMgr;
 
 struct ReplicaRoleInfo {
@@ -53,6 +59,11 @@ struct ReplicaRoleInfo {
   uint32_t listening_port;
   std::string_view state;
   uint64_t lsn_lag;
+
+  // Set if the stable sync stream is compressed.
+  uint64_t journal_bytes = 0;
+  uint64_t journal_compressed_bytes = 0;
+  uint64_t journal_compress_usec = 0;
 };
 
 struct ReplicationMemoryStats {
@@ -67,6 +78,15 @@ struct PeakStats {
   size_t conn_read_buf_capacity = 0;     // peak of total read buf capcacities
 };
 
+// Estimated number and memory usage of the keys of a type that share a prefix,
+// as sampled by MEMORY PREFIXES.
+struct PrefixMemoryUsage {
+  std::string prefix;
+  unsigned type = 0;  // OBJ_STRING, OBJ_LIST etc.
+  uint64_t keys = 0;
+  uint64_t bytes = 0;
+};
+
 // Aggregated metrics over multiple sources on all shards
 struct Metrics {
   SliceEvents events;              // general keyspace stats
@@ -79,12 +99,23 @@ struct Metrics {
   SearchStats search_stats;
   ServerState::Stats coordinator_stats;  // stats on transaction running
   PeakStats peak_stats;
+  SegmentArena::Stats table_arena_stats;  // stats for --table_huge_page_arena
 
   size_t uptime = 0;
   size_t qps = 0;
 
   size_t heap_used_bytes = 0;
+  size_t lua_used_bytes = 0;
   size_t small_string_bytes = 0;
+  size_t compressed_values = 0;
+  size_t compressed_value_bytes = 0;
+  size_t compressed_value_raw_bytes = 0;
+  size_t shared_string_blobs = 0;
+  size_t shared_string_bytes = 0;
+  size_t shared_string_refs = 0;
+  size_t lazyfree_pending_objects = 0;
+  size_t lazyfree_pending_elements = 0;
+  size_t scan_snapshot_bytes = 0;
   uint32_t traverse_ttl_per_sec = 0;
   uint32_t delete_ttl_per_sec = 0;
   uint64_t fiber_switch_cnt = 0;
@@ -94,12 +125,38 @@ struct Metrics {
   uint64_t fiber_longrun_cnt = 0;
   uint64_t fiber_longrun_usec = 0;
 
+  // Latencies of the event loop iterations by proactor index, see ProactorWatchdog.
+  std::vector<base::Histogram> loop_latency_usec;
+
   // Max length of the all the tx shard-queues.
   uint32_t tx_queue_len = 0;
 
   // command call frequencies (count, aggregated latency in usec).
   std::map<std::string, std::pair<uint64_t, uint64_t>> cmd_stats_map;
+
+  // Load samples of the shards by shard id.
+  std::vector<EngineShard::LoadStats> shard_load_stats;
+
+  // On-cpu cycles by command, consumed on the connection fibers and in the shard callbacks.
+  std::map<std::string, uint64_t> cmd_cpu_cycles_map;
+
+  // Latency histograms by command and the call stats and histograms aggregated by command family.
+  std::map<std::string, CmdLatencyHistogram> cmd_latency_map;
+  std::map<std::string, std::pair<uint64_t, uint64_t>> family_stats_map;
+  std::map<std::string, CmdLatencyHistogram> family_latency_map;
+
+  // Latencies of transaction phases by command, only with --tx_latency_histograms.
+  std::map<std::string, ServerState::TxPhaseHistograms> tx_phase_histos;
   std::vector<ReplicaRoleInfo> replication_metrics;
+
+  // Cached result of the last MEMORY PREFIXES run.
+  std::vector<PrefixMemoryUsage> prefix_memory;
+
+  // Value size histograms by type and by type and encoding of all the databases and their
+  // largest keys by bytes, see BigKeys.
+  std::map<unsigned, BigKeys::Histogram> value_size_histograms;
+  std::map<BigKeys::TypeEncoding, BigKeys::Histogram> encoding_size_histograms;
+  std::vector<std::pair<DbIndex, BigKeys::Key>> big_keys;
 };
 
 struct LastSaveInfo {
@@ -143,6 +200,11 @@ class ServerFamily {
 
   Metrics GetMetrics() const;
 
+  // Returns the metrics collected at most --metrics_max_staleness_ms ago, for INFO and the
+  // metrics endpoint. Only the caller that finds them stale collects them again, the callers
+  // meanwhile are served the previous ones without hopping to the other threads.
+  std::shared_ptr<const Metrics> GetCachedMetrics() const;
+
   ScriptMgr* script_mgr() {
     return script_mgr_.get();
   }
@@ -155,8 +217,9 @@ class ServerFamily {
 
   // if new_version is true, saves DF specific, non redis compatible snapshot.
   // if basename is not empty it will override dbfilename flag.
+  // if delta is true, saves only the changes since the last DF save, see --snapshot_deltas.
   GenericError DoSave(bool new_version, std::string_view basename, Transaction* transaction,
-                      bool ignore_state = false);
+                      bool ignore_state = false, bool delta = false);
 
   // Calls DoSave with a default generated transaction and with the format
   // specified in --df_snapshot_format
@@ -168,9 +231,13 @@ class ServerFamily {
 
   LastSaveInfo GetLastSaveInfo() const;
 
+  // The result of the last MEMORY PREFIXES run, exported on /metrics.
+  std::vector<PrefixMemoryUsage> GetPrefixMemoryUsage() const;
+  void SetPrefixMemoryUsage(std::vector<PrefixMemoryUsage> usage);
+
   // Load snapshot from file (.rdb file or summary.dfs file) and return
-  // future with error_code.
-  Future<GenericError> Load(const std::string& file_name);
+  // future with error_code. If serve is true, the keys are served as soon as they are loaded.
+  Future<GenericError> Load(const std::string& file_name, bool serve = false);
 
   bool IsSaving() const {
     return is_saving_.load(std::memory_order_relaxed);
@@ -181,6 +248,15 @@ class ServerFamily {
   void PauseReplication(bool pause);
   std::optional<ReplicaOffsetInfo> GetReplicaOffsetInfo();
 
+  // Null until Init.
+  const AdmissionController* admission() const {
+    return admission_.get();
+  }
+
+  AdmissionController* TEST_admission() {
+    return admission_.get();
+  }
+
   const std::string& master_id() const {
     return master_id_;
   }
@@ -238,7 +314,10 @@ class ServerFamily {
   void Save(CmdArgList args, ConnectionContext* cntx);
   void Script(CmdArgList args, ConnectionContext* cntx);
   void SlowLog(CmdArgList args, ConnectionContext* cntx);
+  void HotKeys(CmdArgList args, ConnectionContext* cntx);
   void Module(CmdArgList args, ConnectionContext* cntx);
+  void Wait(CmdArgList args, ConnectionContext* cntx);
+  void WaitAof(CmdArgList args, ConnectionContext* cntx);
 
   void SyncGeneric(std::string_view repl_master_id, uint64_t offs, ConnectionContext* cntx);
 
@@ -252,11 +331,15 @@ class ServerFamily {
   void ReplicaOfInternal(std::string_view host, std::string_view port, ConnectionContext* cntx,
                          ActionOnConnectionFail on_error);
 
-  // Returns the number of loaded keys if successful.
-  io::Result<size_t> LoadRdb(const std::string& rdb_file);
+  // Returns the number of loaded keys if successful. Adds the journal position of the file to
+  // result if it is set.
+  io::Result<size_t> LoadRdb(const std::string& rdb_file, AggregateLoadResult* result = nullptr);
 
   void SnapshotScheduling();
 
+  // Publishes the keys that reach --hot_keys_alert_qps to the __hotkeys__ channel.
+  void HotKeysAlerting();
+
   void SendInvalidationMessages() const;
 
   Fiber snapshot_schedule_fb_;
@@ -272,6 +355,11 @@ class ServerFamily {
   mutable Mutex replicaof_mu_, save_mu_;
   std::shared_ptr<Replica> replica_ ABSL_GUARDED_BY(replicaof_mu_);
 
+  // The master id and the journal positions of every shard saved by the loaded snapshot, the
+  // first replication can continue from them. See --replica_bootstrap_from_snapshot.
+  std::optional<std::pair<std::string, std::vector<LSN>>> snapshot_journal_position_
+      ABSL_GUARDED_BY(replicaof_mu_);
+
   std::unique_ptr<ScriptMgr> script_mgr_;
   std::unique_ptr<journal::Journal> journal_;
   std::unique_ptr<DflyCmd> dfly_cmd_;
@@ -294,11 +382,28 @@ class ServerFamily {
   bool save_on_shutdown_{true};
 
   Done schedule_done_;
+
+  Fiber hot_keys_alert_fb_;
+  Done hot_keys_alert_done_;
+  std::unique_ptr<ProactorWatchdog> watchdog_;
+  std::unique_ptr<AdmissionController> admission_;
   std::unique_ptr<FiberQueueThreadPool> fq_threadpool_;
   std::shared_ptr<detail::SnapshotStorage> snapshot_storage_;
 
   mutable Mutex peak_stats_mu_;
   mutable PeakStats peak_stats_;
+
+  struct MetricsSnapshot {
+    Metrics metrics;
+    uint64_t collected_ms = 0;
+  };
+
+  // Accessed with std::atomic_load and std::atomic_store.
+  mutable std::shared_ptr<const MetricsSnapshot> cached_metrics_;
+  mutable std::atomic_bool collecting_metrics_{false};
+
+  mutable Mutex prefix_memory_mu_;
+  std::vector<PrefixMemoryUsage> prefix_memory_ ABSL_GUARDED_BY(prefix_memory_mu_);
 };
 
 }  // namespace dfly
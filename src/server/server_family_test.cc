@@ -4,11 +4,17 @@
 
 #include "server/server_family.h"
 
+#include <absl/strings/ascii.h>
 #include <absl/strings/match.h>
+#include <absl/strings/numbers.h>
+#include <absl/strings/str_cat.h>
+
+#include <numeric>
 
 #include "base/gtest.h"
 #include "base/logging.h"
 #include "facade/facade_test.h"
+#include "server/memory_cmd.h"
 #include "server/test_utils.h"
 
 using namespace testing;
@@ -16,6 +22,10 @@ using namespace std;
 using namespace util;
 using namespace boost;
 
+ABSL_DECLARE_FLAG(bool, tx_latency_histograms);
+ABSL_DECLARE_FLAG(uint32_t, shed_queue_delay_usec);
+ABSL_DECLARE_FLAG(uint32_t, metrics_max_staleness_ms);
+
 namespace dfly {
 
 class ServerFamilyTest : public BaseFamilyTest {
@@ -84,6 +94,23 @@ TEST_F(ServerFamilyTest, SlowLogArgsLengthTruncation) {
   EXPECT_THAT(key_value, expected_value);
 }
 
+TEST_F(ServerFamilyTest, SlowLogTxStats) {
+  EXPECT_EQ(Run({"config", "set", "slowlog_max_len", "3"}), "OK");
+  EXPECT_EQ(Run({"config", "set", "slowlog_log_slower_than", "0"}), "OK");
+
+  Run({"mset", "a", "1", "b", "2", "c", "3"});
+  auto resp = Run({"slowlog", "get", "1"});
+  ASSERT_THAT(resp, ArrLen(7));
+  EXPECT_THAT(resp.GetVec()[6].GetVec(),
+              ElementsAre("schedule_usec", _, "queue_wait_usec", _, "execution_usec", _,
+                          "conclude_usec", _, "coordinator_usec", _, "hops", IntArg(1), "shards",
+                          _, "txq_len", _));
+
+  // Not transactional
+  Run({"ping"});
+  EXPECT_THAT(Run({"slowlog", "get", "1"}), ArrLen(6));
+}
+
 TEST_F(ServerFamilyTest, SlowLogHelp) {
   auto resp = Run({"slowlog", "help"});
 
@@ -94,8 +121,11 @@ TEST_F(ServerFamilyTest, SlowLogHelp) {
           "    Return top <count> entries from the slowlog (default: 10, -1 mean all).",
           "    Entries are made of:",
           "    id, timestamp, time in microseconds, arguments array, client IP and port,",
-          "    client name", "LEN", "    Return the length of the slowlog.", "RESET",
-          "    Reset the slowlog.", "HELP", "    Prints this help."));
+          "    client name and for transactional commands the split of their time in",
+          "    microseconds between schedule, queue_wait, execution, conclude and the",
+          "    coordinator, with the number of hops, shards and the longest shard queue",
+          "LEN", "    Return the length of the slowlog.", "RESET", "    Reset the slowlog.",
+          "HELP", "    Prints this help."));
 }
 
 TEST_F(ServerFamilyTest, SlowLogMaxLengthZero) {
@@ -310,4 +340,289 @@ TEST_F(ServerFamilyTest, ClientTrackingSelectDB) {
   EXPECT_EQ(GetInvalidationMessage("IO0", 0).key, "C");
 }
 
+TEST_F(ServerFamilyTest, ClientTrackingBcast) {
+  Run({"HELLO", "3"});
+  EXPECT_THAT(Run({"CLIENT", "TRACKING", "ON", "PREFIX", "user:"}),
+              ErrArg("PREFIX option requires BCAST mode to be enabled"));
+  EXPECT_EQ(Run({"CLIENT", "TRACKING", "ON", "BCAST", "PREFIX", "user:", "PREFIX", "item:"}),
+            "OK");
+
+  // Reads are not tracked in broadcast mode, writes to the prefixes are reported anyway.
+  pp_->at(1)->Await([&] { return Run({"MSET", "user:1", "a", "item:2", "b", "other", "c"}); });
+  pp_->AwaitFiberOnAll([](ProactorBase* pb) {});
+
+  std::vector<std::string> keys_invalidated;
+  for (unsigned i = 0; i < InvalidationMessagesLen("IO0"); ++i) {
+    const auto& msg = GetInvalidationMessage("IO0", i);
+    keys_invalidated.insert(keys_invalidated.end(), msg.keys.begin(), msg.keys.end());
+  }
+  EXPECT_THAT(keys_invalidated, UnorderedElementsAre("user:1", "item:2"));
+
+  Run({"CLIENT", "TRACKING", "OFF"});
+  size_t num_msgs = InvalidationMessagesLen("IO0");
+  pp_->at(1)->Await([&] { return Run({"SET", "user:1", "d"}); });
+  pp_->AwaitFiberOnAll([](ProactorBase* pb) {});
+  EXPECT_EQ(InvalidationMessagesLen("IO0"), num_msgs);
+}
+
+TEST_F(ServerFamilyTest, TxLatencyStats) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_tx_latency_histograms, true);
+
+  Run({"set", "foo", "bar"});
+  Run({"mset", "a", "1", "b", "2", "c", "3"});
+  Run({"rename", "a", "d"});
+
+  auto info = Run({"info", "latencystats"}).GetString();
+  EXPECT_THAT(info, HasSubstr("tx_execution_usec_SET:p50="));
+  EXPECT_THAT(info, HasSubstr("tx_queue_wait_usec_MSET:p50="));
+  EXPECT_THAT(info, HasSubstr("tx_hops_SET:p50="));
+  EXPECT_THAT(info, HasSubstr("tx_hops_MSET:p50="));
+  EXPECT_THAT(info, HasSubstr("tx_hops_RENAME:p50="));
+
+  // Not part of the default sections
+  EXPECT_THAT(Run({"info"}).GetString(), Not(HasSubstr("tx_hops_SET")));
+}
+
+TEST_F(ServerFamilyTest, CommandCpuStats) {
+  for (unsigned i = 0; i < 10; ++i) {
+    Run({"mset", "a", "1", "b", "2", "c", "3"});
+  }
+
+  auto info = Run({"info", "commandstats"}).GetString();
+  size_t pos = info.find("cmdstat_MSET:calls=10,");
+  ASSERT_NE(pos, string::npos);
+  string_view line = string_view{info}.substr(pos, info.find('\n', pos) - pos);
+  string_view per_call = line.substr(line.find("cpu_usec_per_call=") + 18);
+  double cpu_usec = 0;
+  ASSERT_TRUE(absl::SimpleAtod(absl::StripTrailingAsciiWhitespace(per_call), &cpu_usec));
+  EXPECT_GT(cpu_usec, 0);
+}
+
+TEST_F(ServerFamilyTest, RequestTrace) {
+  absl::FlagSaver fs;
+  EXPECT_EQ(Run({"config", "set", "trace_sample_every", "1"}), "OK");
+
+  Run({"set", "foo", "bar"});
+  Run({"mset", "a", "1", "b", "2", "c", "3"});
+
+  auto trace = Run({"debug", "trace"}).GetString();
+  EXPECT_THAT(trace, HasSubstr("{\"traceEvents\":["));
+  EXPECT_THAT(trace, HasSubstr("{\"name\":\"SET\",\"cat\":\"SET\",\"ph\":\"X\""));
+  EXPECT_THAT(trace, HasSubstr("{\"name\":\"execution\",\"cat\":\"SET\""));
+  EXPECT_THAT(trace, HasSubstr("{\"name\":\"schedule\",\"cat\":\"MSET\""));
+
+  EXPECT_EQ(Run({"debug", "trace", "reset"}), "OK");
+  EXPECT_EQ(Run({"config", "set", "trace_sample_every", "0"}), "OK");
+  Run({"set", "foo", "bar"});
+  EXPECT_THAT(Run({"debug", "trace"}).GetString(), Not(HasSubstr("\"cat\":\"SET\"")));
+  EXPECT_THAT(Run({"debug", "trace", "foo"}), ErrArg("syntax error"));
+}
+
+TEST_F(ServerFamilyTest, CommandLatencyHistograms) {
+  Run({"set", "foo", "bar"});
+  Run({"get", "foo"});
+  Run({"get", "foo"});
+  Run({"lpush", "l", "a"});
+
+  auto metrics = GetMetrics();
+  auto total = [](const CmdLatencyHistogram& hist) {
+    return accumulate(hist.buckets.begin(), hist.buckets.end(), uint64_t(0));
+  };
+  EXPECT_EQ(total(metrics.cmd_latency_map["GET"]), 2u);
+  EXPECT_EQ(total(metrics.cmd_latency_map["SET"]), 1u);
+  EXPECT_EQ(metrics.family_stats_map["string"].first, 3u);
+  EXPECT_EQ(total(metrics.family_latency_map["string"]), 3u);
+  EXPECT_EQ(total(metrics.family_latency_map["list"]), 1u);
+}
+
+TEST_F(ServerFamilyTest, ShardLoadStats) {
+  for (unsigned i = 0; i < 500; ++i) {
+    Run({"set", StrCat("key", i), "v"});
+  }
+  // The queue depth is sampled by the shard heartbeats.
+  util::ThisFiber::SleepFor(100ms);
+
+  auto metrics = GetMetrics();
+  ASSERT_EQ(metrics.shard_load_stats.size(), shard_set->size());
+  uint64_t hops = 0;
+  for (const auto& stats : metrics.shard_load_stats) {
+    EXPECT_GT(stats.txq_len.count(), 0u);
+    hops += stats.hop_latency_usec.count();
+  }
+  EXPECT_GT(hops, 0u);
+}
+
+TEST_F(ServerFamilyTest, LoopLatency) {
+  // The probes of the watchdog measure the event loops every 10ms.
+  util::ThisFiber::SleepFor(100ms);
+
+  auto metrics = GetMetrics();
+  ASSERT_EQ(metrics.loop_latency_usec.size(), pp_->size());
+  for (const auto& hist : metrics.loop_latency_usec) {
+    EXPECT_GT(hist.count(), 0u);
+  }
+}
+
+TEST_F(ServerFamilyTest, MemoryPrefixes) {
+  for (unsigned i = 0; i < 300; ++i) {
+    Run({"set", StrCat("user:", i), string(100, 'x')});
+  }
+  for (unsigned i = 0; i < 100; ++i) {
+    Run({"hset", StrCat("session:", i), "field", "value"});
+  }
+  Run({"set", "nodelimiter", "1"});
+
+  // The sample covers all the keys, so the estimates are exact.
+  auto resp = Run({"memory", "prefixes", "samples", "1000"});
+  ASSERT_THAT(resp, ArrLen(3));
+  const auto& rows = resp.GetVec();
+  EXPECT_THAT(rows[0].GetVec(), ElementsAre("user", "STRING", IntArg(300), _));
+  EXPECT_THAT(rows[1].GetVec(), ElementsAre("session", "HASH", IntArg(100), _));
+  EXPECT_THAT(rows[2].GetVec(), ElementsAre("", "STRING", IntArg(1), _));
+
+  auto metrics = GetMetrics();
+  ASSERT_EQ(metrics.prefix_memory.size(), 3u);
+  EXPECT_EQ(metrics.prefix_memory[0].prefix, "user");
+  EXPECT_EQ(metrics.prefix_memory[0].keys, 300u);
+
+  resp = Run({"memory", "prefixes", "delimiter", "s", "top", "1"});
+  ASSERT_THAT(resp, ArrLen(4));
+  EXPECT_THAT(resp.GetVec(), ElementsAre("u", "STRING", IntArg(300), _));
+
+  EXPECT_THAT(Run({"memory", "prefixes", "delimiter", "::"}), ErrArg("syntax error"));
+}
+
+TEST_F(ServerFamilyTest, MemoryBigKeys) {
+  Run({"set", "small", "x"});
+  Run({"set", "str", string(100000, 'x')});
+  for (unsigned i = 0; i < 500; ++i) {
+    Run({"sadd", "set", StrCat("member", i)});
+  }
+
+  // The keys are tracked as they are written.
+  auto resp = Run({"memory", "bigkeys"});
+  ASSERT_THAT(resp, ArrLen(2));
+  EXPECT_THAT(resp.GetVec()[0].GetVec(), ElementsAre("str", "STRING", _, IntArg(100000)));
+  EXPECT_THAT(resp.GetVec()[1].GetVec(), ElementsAre("set", "SET", _, IntArg(500)));
+
+  resp = Run({"memory", "bigkeys", "by", "elements", "count", "1"});
+  EXPECT_THAT(resp.GetVec(), ElementsAre("str", "STRING", _, IntArg(100000)));
+
+  Run({"del", "str"});
+  resp = Run({"memory", "bigkeys"});
+  EXPECT_THAT(resp.GetVec(), ElementsAre("set", "SET", _, IntArg(500)));
+
+  // The heartbeat scan builds the histograms.
+  auto metrics = GetMetrics();
+  for (unsigned i = 0; i < 100 && metrics.value_size_histograms.count(OBJ_SET) == 0; ++i) {
+    util::ThisFiber::SleepFor(10ms);
+    metrics = GetMetrics();
+  }
+  ASSERT_EQ(metrics.value_size_histograms.count(OBJ_SET), 1u);
+  ASSERT_EQ(metrics.big_keys.size(), 1u);
+  EXPECT_EQ(metrics.big_keys[0].second.key, "set");
+
+  EXPECT_THAT(Run({"memory", "bigkeys", "by", "size"}), ErrArg("syntax error"));
+}
+
+TEST_F(ServerFamilyTest, MallocSizeClasses) {
+  for (unsigned i = 0; i < 1000; ++i) {
+    Run({"set", StrCat("key", i), string(100, 'x')});
+  }
+
+  auto classes = pp_->at(0)->Await([] { return CollectMallocSizeClasses(false); });
+  ASSERT_FALSE(classes.empty());
+  for (size_t i = 0; i < classes.size(); ++i) {
+    const auto& size_class = classes[i];
+    if (i > 0)
+      EXPECT_LT(classes[i - 1].block_size, size_class.block_size);
+    EXPECT_LE(size_class.used, size_class.committed);
+    EXPECT_EQ(size_class.pages, accumulate(size_class.pages_by_utilization.begin(),
+                                           size_class.pages_by_utilization.end(), size_t(0)));
+  }
+
+  auto resp = Run({"memory", "malloc-stats"});
+  EXPECT_THAT(resp.GetString(), HasSubstr("Size classes from thread:0"));
+}
+
+TEST_F(ServerFamilyTest, HotKeys) {
+  EXPECT_THAT(Run({"hotkeys", "get"}), ErrArg("top keys tracking is disabled"));
+
+  absl::FlagSaver fs;
+  SetTestFlag("enable_top_keys_tracking", "true");
+  ResetService();
+
+  Run({"set", "hot", "1"});
+  Run({"set", "cold", "1"});
+  for (unsigned i = 0; i < 200; ++i) {
+    Run({"get", "hot"});
+  }
+  Run({"get", "cold"});
+
+  // Only the keys touched at least 100 times are recorded.
+  auto resp = Run({"hotkeys", "get"});
+  ASSERT_THAT(resp, ArrLen(5));
+  const auto& entry = resp.GetVec();
+  EXPECT_THAT(entry, ElementsAre("hot", IntArg(0), _, _, _));
+  EXPECT_GE(*entry[3].GetInt(), 100);
+  double qps = 0;
+  EXPECT_TRUE(absl::SimpleAtod(entry[4].GetString(), &qps));
+  EXPECT_GT(qps, 0);
+
+  EXPECT_THAT(Run({"hotkeys", "get", "0"}), ArrLen(0));
+  EXPECT_THAT(Run({"hotkeys", "get", "-2"}), ErrArg("count should be"));
+
+  EXPECT_EQ(Run({"hotkeys", "reset"}), "OK");
+  EXPECT_THAT(Run({"hotkeys", "get"}), ArrLen(0));
+  EXPECT_THAT(Run({"hotkeys", "foo"}), ErrArg("Unknown subcommand"));
+}
+
+TEST_F(ServerFamilyTest, AdmissionControl) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_shed_queue_delay_usec, 1000);
+  AdmissionController* admission = service_->server_family().TEST_admission();
+  ASSERT_TRUE(admission);
+
+  // Over the target only the low priority connections are shed.
+  admission->TEST_SetQueueDelay(1500);
+  EXPECT_EQ(Run({"client", "priority", "low"}), "OK");
+  EXPECT_THAT(Run({"set", "foo", "bar"}), ErrArg("OVERLOADED"));
+  EXPECT_EQ(Run({"ping"}), "PONG");
+  EXPECT_EQ(Run({"client", "priority", "normal"}), "OK");
+  EXPECT_EQ(Run({"set", "foo", "bar"}), "OK");
+
+  admission->TEST_SetQueueDelay(2500);
+  EXPECT_THAT(Run({"get", "foo"}), ErrArg("OVERLOADED"));
+  EXPECT_EQ(GetMetrics().coordinator_stats.shed_cmd_cnt, 2u);
+
+  admission->TEST_SetQueueDelay(0);
+  EXPECT_EQ(Run({"get", "foo"}), "bar");
+  EXPECT_THAT(Run({"client", "priority", "urgent"}), ErrArg("syntax error"));
+}
+
+TEST_F(ServerFamilyTest, CachedMetrics) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_metrics_max_staleness_ms, 1000);
+
+  Run({"set", "a", "1"});
+  EXPECT_THAT(Run({"info", "keyspace"}).GetString(), HasSubstr("db0:keys=1,"));
+
+  Run({"set", "b", "2"});
+  EXPECT_THAT(Run({"info", "keyspace"}).GetString(), HasSubstr("db0:keys=1,"));
+
+  AdvanceTime(1000);
+  EXPECT_THAT(Run({"info", "keyspace"}).GetString(), HasSubstr("db0:keys=2,"));
+}
+
+TEST_F(ServerFamilyTest, HighPriorityHops) {
+  EXPECT_EQ(Run({"client", "setpriority", "high"}), "OK");
+  for (unsigned i = 0; i < 16; ++i)
+    EXPECT_EQ(Run({"set", absl::StrCat("key", i), "val"}), "OK");
+  EXPECT_EQ(Run({"get", "key7"}), "val");
+
+  // The hops to the shards of the other threads skip the shard queue.
+  EXPECT_GT(GetMetrics().shard_stats.high_priority_hop_total, 0u);
+}
+
 }  // namespace dfly
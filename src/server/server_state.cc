@@ -18,6 +18,8 @@ extern "C" {
 #include "server/journal/journal.h"
 
 ABSL_FLAG(uint32_t, interpreter_per_thread, 10, "Lua interpreters per thread");
+ABSL_FLAG(uint64_t, lua_mem_limit, 0,
+          "Maximal number of bytes a single script run may allocate. 0 means no limit");
 
 namespace dfly {
 
@@ -37,8 +39,17 @@ auto ServerState::Stats::operator=(Stats&& other) -> Stats& {
   }
   this->eval_io_coordination_cnt = other.eval_io_coordination_cnt;
   this->eval_shardlocal_coordination_cnt = other.eval_shardlocal_coordination_cnt;
+  this->eval_shard_interpreter_cnt = other.eval_shard_interpreter_cnt;
   this->eval_squashed_flushes = other.eval_squashed_flushes;
   this->tx_schedule_cancel_cnt = other.tx_schedule_cancel_cnt;
+  this->tx_hop_batch_cnt = other.tx_hop_batch_cnt;
+  this->tx_batched_hop_cnt = other.tx_batched_hop_cnt;
+  this->tx_optimistic_read_cnt = other.tx_optimistic_read_cnt;
+  this->tx_optimistic_conflict_cnt = other.tx_optimistic_conflict_cnt;
+  this->hot_key_cache_hits = other.hot_key_cache_hits;
+  this->split_counter_incrs = other.split_counter_incrs;
+  this->shed_cmd_cnt = other.shed_cmd_cnt;
+  this->low_priority_paced_cnt = other.low_priority_paced_cnt;
 
   delete[] this->tx_width_freq_arr;
   this->tx_width_freq_arr = other.tx_width_freq_arr;
@@ -47,8 +58,16 @@ auto ServerState::Stats::operator=(Stats&& other) -> Stats& {
   return *this;
 }
 
+void ServerState::TxPhaseHistograms::Merge(const TxPhaseHistograms& other) {
+  schedule.Merge(other.schedule);
+  queue_wait.Merge(other.queue_wait);
+  execution.Merge(other.execution);
+  conclude.Merge(other.conclude);
+  hops.Merge(other.hops);
+}
+
 ServerState::Stats& ServerState::Stats::Add(unsigned num_shards, const ServerState::Stats& other) {
-  static_assert(sizeof(Stats) == 12 * 8, "Stats size mismatch");
+  static_assert(sizeof(Stats) == 21 * 8, "Stats size mismatch");
 
   for (int i = 0; i < NUM_TX_TYPES; ++i) {
     this->tx_type_cnt[i] += other.tx_type_cnt[i];
@@ -56,8 +75,17 @@ ServerState::Stats& ServerState::Stats::Add(unsigned num_shards, const ServerSta
 
   this->eval_io_coordination_cnt += other.eval_io_coordination_cnt;
   this->eval_shardlocal_coordination_cnt += other.eval_shardlocal_coordination_cnt;
+  this->eval_shard_interpreter_cnt += other.eval_shard_interpreter_cnt;
   this->eval_squashed_flushes += other.eval_squashed_flushes;
   this->tx_schedule_cancel_cnt += other.tx_schedule_cancel_cnt;
+  this->tx_hop_batch_cnt += other.tx_hop_batch_cnt;
+  this->tx_batched_hop_cnt += other.tx_batched_hop_cnt;
+  this->tx_optimistic_read_cnt += other.tx_optimistic_read_cnt;
+  this->tx_optimistic_conflict_cnt += other.tx_optimistic_conflict_cnt;
+  this->hot_key_cache_hits += other.hot_key_cache_hits;
+  this->split_counter_incrs += other.split_counter_incrs;
+  this->shed_cmd_cnt += other.shed_cmd_cnt;
+  this->low_priority_paced_cnt += other.low_priority_paced_cnt;
 
   this->multi_squash_executions += other.multi_squash_executions;
   this->multi_squash_exec_hop_usec += other.multi_squash_exec_hop_usec;
@@ -109,9 +137,12 @@ ServerState::ServerState() : interpreter_mgr_{absl::GetFlag(FLAGS_interpreter_pe
   mi_heap_t* tlh = mi_heap_new();
   init_zmalloc_threadlocal(tlh);
   data_heap_ = tlh;
+
+  interpreter_mgr_.SetMemoryLimit(absl::GetFlag(FLAGS_lua_mem_limit));
 }
 
 ServerState::~ServerState() {
+  used_mem_lua.fetch_sub(lua_mem_reported_, std::memory_order_relaxed);
 }
 
 void ServerState::Init(uint32_t thread_index, uint32_t num_shards, acl::UserRegistry* registry) {
@@ -177,8 +208,18 @@ Interpreter* ServerState::BorrowInterpreter() {
   return interpreter_mgr_.Get();
 }
 
+Interpreter* ServerState::TryBorrowInterpreter() {
+  return interpreter_mgr_.TryGet();
+}
+
 void ServerState::ReturnInterpreter(Interpreter* ir) {
   interpreter_mgr_.Return(ir);
+
+  // Scripts change the memory of their interpreter only while borrowed, so it's enough to
+  // report it to the global counter here.
+  size_t used = interpreter_mgr_.UsedMemory();
+  used_mem_lua.fetch_add(used - lua_mem_reported_, std::memory_order_relaxed);
+  lua_mem_reported_ = used;
 }
 
 ServerState* ServerState::SafeTLocal() {
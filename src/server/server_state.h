@@ -4,6 +4,9 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <memory>
 #include <optional>
 #include <vector>
 
@@ -12,8 +15,11 @@
 #include "server/acl/acl_log.h"
 #include "server/acl/user_registry.h"
 #include "server/common.h"
+#include "server/hot_key_cache.h"
+#include "server/request_trace.h"
 #include "server/script_mgr.h"
 #include "server/slowlog.h"
+#include "server/split_counters.h"
 #include "util/sliding_counter.h"
 
 typedef struct mi_heap_s mi_heap_t;
@@ -82,6 +88,19 @@ class MonitorsRepo {
 
 enum class ClientPause { WRITE, ALL };
 
+// Lag of a replica flow behind its master shard, estimated from the LSN heartbeats of the master.
+// The replica publishes the lags of its flows to all threads for CLIENT READSTALENESS.
+struct ReplicaFlowLag {
+  std::atomic_uint64_t lsn_lag{UINT64_MAX};
+  std::atomic_uint64_t caught_up_ns{0};  // monotonic time of the last heartbeat applied.
+
+  // Milliseconds since the flow was up to date, UINT64_MAX if it never was.
+  uint64_t LagMs(uint64_t now_ns) const {
+    uint64_t caught_up = caught_up_ns.load(std::memory_order_relaxed);
+    return caught_up == 0 ? UINT64_MAX : (now_ns - std::min(now_ns, caught_up)) / 1000000;
+  }
+};
+
 // Present in every server thread. This class differs from EngineShard. The latter manages
 // state around engine shards while the former represents coordinator/connection state.
 // There may be threads that handle engine shards but not IO, there may be threads that handle IO
@@ -94,12 +113,45 @@ class ServerState {  // public struct - to allow initialization.
 
  public:
   enum TxType { GLOBAL, NORMAL, QUICK, INLINE, NUM_TX_TYPES };
+
+  // Latencies of the phases of the transactions of a command in usec and their number of hops.
+  struct TxPhaseHistograms {
+    base::Histogram schedule;    // scheduling into the transaction queues
+    base::Histogram queue_wait;  // until a hop starts running in a shard
+    base::Histogram execution;   // running the callback of a hop in a shard
+    base::Histogram conclude;    // releasing the locks in a shard after the last hop
+    base::Histogram hops;
+
+    void Merge(const TxPhaseHistograms& other);
+  };
+
   struct Stats {
     std::array<uint64_t, NUM_TX_TYPES> tx_type_cnt;
     uint64_t tx_schedule_cancel_cnt = 0;
 
+    // Batches of single shard hops dispatched together and the hops they contained.
+    uint64_t tx_hop_batch_cnt = 0;
+    uint64_t tx_batched_hop_cnt = 0;
+
+    // Multi shard reads that ran without scheduling and those that had to be scheduled.
+    uint64_t tx_optimistic_read_cnt = 0;
+    uint64_t tx_optimistic_conflict_cnt = 0;
+
+    // GETs served from the hot key cache of the thread.
+    uint64_t hot_key_cache_hits = 0;
+
+    // Increments of split counters added to the cell of the thread.
+    uint64_t split_counter_incrs = 0;
+
+    // Commands rejected because the shards were saturated, see AdmissionController.
+    uint64_t shed_cmd_cnt = 0;
+
+    // Squashed batches of low priority connections delayed by --low_priority_squash_rate.
+    uint64_t low_priority_paced_cnt = 0;
+
     uint64_t eval_io_coordination_cnt = 0;
     uint64_t eval_shardlocal_coordination_cnt = 0;
+    uint64_t eval_shard_interpreter_cnt = 0;  // shard local scripts run by the shard interpreters
     uint64_t eval_squashed_flushes = 0;
 
     uint64_t multi_squash_executions = 0;
@@ -178,6 +230,9 @@ class ServerState {  // public struct - to allow initialization.
   // Borrow interpreter from internal manager. Return int with ReturnInterpreter.
   Interpreter* BorrowInterpreter();
 
+  // Returns nullptr if all the interpreters of the thread are borrowed, does not preempt.
+  Interpreter* TryBorrowInterpreter();
+
   // Return interpreter to internal manager to be re-used.
   void ReturnInterpreter(Interpreter*);
 
@@ -217,6 +272,26 @@ class ServerState {  // public struct - to allow initialization.
     call_latency_histos_[sha].Add(latency_usec);
   }
 
+  // Transaction phase histograms by command name, recorded with --tx_latency_histograms.
+  // Names are literals of the command registry.
+  const absl::flat_hash_map<std::string_view, TxPhaseHistograms>& tx_phase_histos() const {
+    return tx_phase_histos_;
+  }
+
+  TxPhaseHistograms* GetTxPhaseHistos(std::string_view cmd) {
+    return &tx_phase_histos_[cmd];
+  }
+
+  // Values of hot keys replicated to this thread, see HotKeyCache.
+  HotKeyCache* hot_key_cache() {
+    return &hot_key_cache_;
+  }
+
+  // Cells of the split counters incremented on this thread, see SplitCounters.
+  SplitCounters* split_counters() {
+    return &split_counters_;
+  }
+
   void SetScriptParams(const ScriptMgr::ScriptKey& key, ScriptMgr::ScriptParams params) {
     cached_script_params_[key] = params;
   }
@@ -240,14 +315,25 @@ class ServerState {  // public struct - to allow initialization.
 
   bool ShouldLogSlowCmd(unsigned latency_usec) const;
 
+  bool IsSlowLogEnabled() const {
+    return slow_log_shard_.IsEnabled() && log_slower_than_usec != UINT32_MAX;
+  }
+
   Stats stats;
 
   bool is_master = true;
   std::string remote_client_id_;  // for cluster support
+
+  // Lags of the flows of the current replication, indexed by master shard. Null if none started.
+  std::shared_ptr<std::vector<ReplicaFlowLag>> replica_flow_lags;
   uint32_t log_slower_than_usec = UINT32_MAX;
 
   acl::UserRegistry* user_registry;
 
+  // Connections of this thread in broadcast tracking mode by registered key prefix. Shards only
+  // count registrations per thread and send written keys here to be fanned out.
+  absl::flat_hash_map<std::string, std::vector<facade::Connection*>> tracking_prefixes;
+
   acl::AclLog acl_log;
 
   // Starts or ends a `CLIENT PAUSE` command. @state controls whether
@@ -265,16 +351,22 @@ class ServerState {  // public struct - to allow initialization.
     return slow_log_shard_;
   };
 
+  RequestTraceRing& GetTraceRing() {
+    return trace_ring_;
+  }
+
   // Exec descriptor frequency count for this thread.
   absl::flat_hash_map<std::string, unsigned> exec_freq_count;
 
  private:
   int64_t live_transactions_ = 0;
   SlowLogShard slow_log_shard_;
+  RequestTraceRing trace_ring_;
   mi_heap_t* data_heap_;
   journal::Journal* journal_ = nullptr;
 
   InterpreterManager interpreter_mgr_;
+  size_t lua_mem_reported_ = 0;  // our part of used_mem_lua
   absl::flat_hash_map<ScriptMgr::ScriptKey, ScriptMgr::ScriptParams> cached_script_params_;
 
   ChannelStore* channel_store_;
@@ -294,6 +386,9 @@ class ServerState {  // public struct - to allow initialization.
   MonitorsRepo monitors_;
 
   absl::flat_hash_map<std::string, base::Histogram> call_latency_histos_;
+  absl::flat_hash_map<std::string_view, TxPhaseHistograms> tx_phase_histos_;
+  HotKeyCache hot_key_cache_;
+  SplitCounters split_counters_;
   uint32_t thread_index_ = 0;
   uint64_t used_mem_cached_ = 0;  // thread local cache of used_mem_current
   uint64_t used_mem_last_update_ = 0;
@@ -14,6 +14,7 @@ extern "C" {
 #include "base/flags.h"
 #include "base/logging.h"
 #include "base/stl_util.h"
+#include "core/compact_string_set.h"
 #include "core/string_set.h"
 #include "facade/cmd_arg_parser.h"
 #include "server/acl/acl_commands_def.h"
@@ -43,6 +44,9 @@ namespace {
 
 constexpr uint32_t kMaxIntSetEntries = 256;
 
+// Sets of strings up to this size use CompactStringSet.
+constexpr uint32_t kMaxCompactSetEntries = 512;
+
 bool IsDenseEncoding(const CompactObj& co) {
   return co.Encoding() == kEncodingStrMap2;
 }
@@ -51,6 +55,44 @@ bool IsDenseEncoding(const SetType& co) {
   return co.second == kEncodingStrMap2;
 }
 
+bool IsCompactEncoding(const CompactObj& co) {
+  return co.Encoding() == kEncodingCompactSet;
+}
+
+bool IsCompactEncoding(const SetType& co) {
+  return co.second == kEncodingCompactSet;
+}
+
+// Converts the set to StringSet, when it outgrows the compact encoding or gets members with ttl.
+void ConvertCompactToStrSet(CompactObj* set) {
+  CompactStringSet* cs = (CompactStringSet*)set->RObjPtr();
+  StringSet* ss = CompactObj::AllocateMR<StringSet>();
+  ss->Reserve(cs->Size());
+
+  for (sds ptr : *cs) {
+    CHECK(ss->Add(string_view{ptr, sdslen(ptr)}));
+  }
+
+  // frees cs on a way.
+  set->InitRobj(OBJ_SET, kEncodingStrMap2, ss);
+}
+
+CompactStringSet* ConvertToCompactSet(const intset* is) {
+  int64_t intele;
+  char buf[32];
+  int ii = 0;
+
+  CompactStringSet* cs = CompactObj::AllocateMR<CompactStringSet>();
+  cs->Reserve(intsetLen(is));
+
+  while (intsetGet(const_cast<intset*>(is), ii++, &intele)) {
+    char* next = absl::numbers_internal::FastIntToBuffer(intele, buf);
+    CHECK(cs->Add(string_view{buf, size_t(next - buf)}));
+  }
+
+  return cs;
+}
+
 intset* IntsetAddSafe(string_view val, intset* is, bool* success, bool* added) {
   long long llval;
   *added = false;
@@ -107,6 +149,13 @@ pair<unsigned, bool> RemoveStrSet(uint32_t now_sec, ArgSlice vals, CompactObj* s
     }
 
     isempty = ss->Empty();
+  } else if (IsCompactEncoding(*set)) {
+    CompactStringSet* cs = (CompactStringSet*)set->RObjPtr();
+    for (auto member : vals) {
+      removed += cs->Erase(member);
+    }
+
+    isempty = cs->Empty();
   } else {
     DCHECK_EQ(set->Encoding(), kEncodingStrMap);
     dict* d = (dict*)set->RObjPtr();
@@ -125,15 +174,21 @@ pair<unsigned, bool> RemoveStrSet(uint32_t now_sec, ArgSlice vals, CompactObj* s
 unsigned AddStrSet(const DbContext& db_context, ArgSlice vals, uint32_t ttl_sec, CompactObj* dest) {
   unsigned res = 0;
 
+  if (IsCompactEncoding(*dest)) {
+    DCHECK_EQ(ttl_sec, UINT32_MAX);
+    CompactStringSet* cs = (CompactStringSet*)dest->RObjPtr();
+    if (cs->Size() + vals.size() <= kMaxCompactSetEntries)
+      return cs->AddMany(vals);
+
+    ConvertCompactToStrSet(dest);
+  }
+
   if (IsDenseEncoding(*dest)) {
     StringSet* ss = (StringSet*)dest->RObjPtr();
     uint32_t time_now = MemberTimeSeconds(db_context.time_now_ms);
 
     ss->set_time(time_now);
-
-    for (auto member : vals) {
-      res += ss->Add(member, ttl_sec);
-    }
+    res = ss->AddMany(vals, ttl_sec);
   } else {
     DCHECK_EQ(dest->Encoding(), kEncodingStrMap);
     dict* ds = (dict*)dest->RObjPtr();
@@ -201,6 +256,8 @@ void InitSet(ArgSlice vals, CompactObj* set) {
   if (int_set) {
     intset* is = intsetNew();
     set->InitRobj(OBJ_SET, kEncodingIntSet, is);
+  } else if (GetFlag(FLAGS_use_set2) && vals.size() <= kMaxCompactSetEntries) {
+    set->InitRobj(OBJ_SET, kEncodingCompactSet, CompactObj::AllocateMR<CompactStringSet>());
   } else {
     InitStrSet(set);
   }
@@ -215,6 +272,20 @@ uint64_t ScanStrSet(const DbContext& db_context, const CompactObj& co, uint64_t
     StringSet* set = (StringSet*)co.RObjPtr();
     set->set_time(MemberTimeSeconds(db_context.time_now_ms));
 
+    do {
+      auto scan_callback = [&](string_view str) {
+        if (scan_op.Matches(str)) {
+          res->push_back(std::string(str));
+        }
+      };
+
+      curs = set->Scan(curs, scan_callback);
+
+    } while (curs && maxiterations-- && res->size() < count);
+  } else if (IsCompactEncoding(co)) {
+    // Shares the cursor semantics with StringSet, so the scan continues if the set is converted.
+    const CompactStringSet* set = (const CompactStringSet*)co.RObjPtr();
+
     do {
       auto scan_callback = [&](const sds ptr) {
         string_view str{ptr, sdslen(ptr)};
@@ -224,7 +295,6 @@ uint64_t ScanStrSet(const DbContext& db_context, const CompactObj& co, uint64_t
       };
 
       curs = set->Scan(curs, scan_callback);
-
     } while (curs && maxiterations-- && res->size() < count);
   } else {
     DCHECK_EQ(co.Encoding(), kEncodingStrMap);
@@ -263,6 +333,10 @@ uint32_t SetTypeLen(const DbContext& db_context, const SetType& set) {
     return ss->UpperBoundSize();
   }
 
+  if (IsCompactEncoding(set)) {
+    return ((const CompactStringSet*)set.first)->Size();
+  }
+
   DCHECK_EQ(set.second, kEncodingStrMap);
   return dictSize((const dict*)set.first);
 }
@@ -281,6 +355,10 @@ bool IsInSet(const DbContext& db_context, const SetType& st, int64_t val) {
     return ss->Contains(str);
   }
 
+  if (IsCompactEncoding(st)) {
+    return ((const CompactStringSet*)st.first)->Contains(str);
+  }
+
   DCHECK_EQ(st.second, kEncodingStrMap);
   return dictContains((dict*)st.first, str);
 }
@@ -299,6 +377,8 @@ bool IsInSet(const DbContext& db_context, const SetType& st, string_view member)
     ss->set_time(MemberTimeSeconds(db_context.time_now_ms));
 
     return ss->Contains(member);
+  } else if (IsCompactEncoding(st)) {
+    return ((const CompactStringSet*)st.first)->Contains(member);
   } else {
     DCHECK_EQ(st.second, kEncodingStrMap);
     return dictContains((dict*)st.first, member);
@@ -324,6 +404,8 @@ int32_t GetExpiry(const DbContext& db_context, const SetType& st, string_view me
       return -3;
 
     return it.HasExpiry() ? it.ExpiryTime() : -1;
+  } else if (IsCompactEncoding(st)) {
+    return ((const CompactStringSet*)st.first)->Contains(member) ? -1 : -3;
   } else {
     // Old encoding, does not support expiry.
     return -1;
@@ -344,7 +426,11 @@ void DiffStrSet(const DbContext& db_context, const SetType& st,
   if (IsDenseEncoding(st)) {
     StringSet* ss = (StringSet*)st.first;
     ss->set_time(MemberTimeSeconds(db_context.time_now_ms));
-    for (sds ptr : *ss) {
+    for (string_view str : *ss) {
+      result->erase(str);
+    }
+  } else if (IsCompactEncoding(st)) {
+    for (sds ptr : *(const CompactStringSet*)st.first) {
       result->erase(string_view{ptr, sdslen(ptr)});
     }
   } else {
@@ -360,12 +446,13 @@ void DiffStrSet(const DbContext& db_context, const SetType& st,
   }
 }
 
-void InterStrSet(const DbContext& db_context, const vector<SetType>& vec, StringVec* result) {
+// Stops after limit members were found if limit is not 0.
+void InterStrSet(const DbContext& db_context, const vector<SetType>& vec, unsigned limit,
+                 StringVec* result) {
   if (IsDenseEncoding(vec.front())) {
     StringSet* ss = (StringSet*)vec.front().first;
     ss->set_time(MemberTimeSeconds(db_context.time_now_ms));
-    for (const sds ptr : *ss) {
-      std::string_view str{ptr, sdslen(ptr)};
+    for (std::string_view str : *ss) {
       size_t j = 1;
       for (j = 1; j < vec.size(); ++j) {
         if (vec[j].first != ss && !IsInSet(db_context, vec[j], str)) {
@@ -375,6 +462,25 @@ void InterStrSet(const DbContext& db_context, const vector<SetType>& vec, String
 
       if (j == vec.size()) {
         result->push_back(std::string(str));
+        if (result->size() == limit)
+          break;
+      }
+    }
+  } else if (IsCompactEncoding(vec.front())) {
+    const CompactStringSet* cs = (const CompactStringSet*)vec.front().first;
+    for (sds ptr : *cs) {
+      std::string_view str{ptr, sdslen(ptr)};
+      size_t j = 1;
+      for (j = 1; j < vec.size(); ++j) {
+        if (vec[j].first != cs && !IsInSet(db_context, vec[j], str)) {
+          break;
+        }
+      }
+
+      if (j == vec.size()) {
+        result->push_back(std::string(str));
+        if (result->size() == limit)
+          break;
       }
     }
   } else {
@@ -395,6 +501,8 @@ void InterStrSet(const DbContext& db_context, const vector<SetType>& vec, String
       /* Only take action when all vec contain the member */
       if (j == vec.size()) {
         result->push_back(string(member));
+        if (result->size() == limit)
+          break;
       }
     }
     dictReleaseIterator(di);
@@ -412,6 +520,11 @@ StringVec PopStrSet(const DbContext& db_context, unsigned count, const SetType&
     for (unsigned i = 0; i < count && !ss->Empty(); ++i) {
       result.push_back(ss->Pop().value());
     }
+  } else if (IsCompactEncoding(st)) {
+    CompactStringSet* cs = (CompactStringSet*)st.first;
+    for (unsigned i = 0; i < count && !cs->Empty(); ++i) {
+      result.push_back(cs->Pop().value());
+    }
   } else {
     DCHECK_EQ(st.second, kEncodingStrMap);
     dict* ds = (dict*)st.first;
@@ -487,58 +600,6 @@ ResultSetView DiffResultVec(const ResultStringVec& result_vec, ShardId src_shard
   return uniques;
 }
 
-OpResult<SvArray> InterResultVec(const ResultStringVec& result_vec, unsigned required_shard_cnt,
-                                 unsigned limit = 0) {
-  absl::flat_hash_map<std::string_view, unsigned> uniques;
-
-  for (const auto& res : result_vec) {
-    if (!res && !base::_in(res.status(), {OpStatus::SKIPPED, OpStatus::KEY_NOTFOUND}))
-      return res.status();
-  }
-
-  for (const auto& res : result_vec) {
-    if (res.status() == OpStatus::KEY_NOTFOUND)
-      return OpStatus::OK;  // empty set.
-  }
-
-  bool first = true;
-  for (const auto& res : result_vec) {
-    if (res.status() == OpStatus::SKIPPED)
-      continue;
-
-    DCHECK(res);  // we handled it above.
-
-    // I use this awkward 'first' condition instead of table[s]++ deliberately.
-    // I do not want to add keys that I know will not stay in the set.
-    if (first) {
-      for (const string& s : res.value()) {
-        uniques.emplace(s, 1);
-      }
-      first = false;
-    } else {
-      for (const string& s : res.value()) {
-        auto it = uniques.find(s);
-        if (it != uniques.end()) {
-          ++it->second;
-        }
-      }
-    }
-  }
-
-  SvArray result;
-  result.reserve(uniques.size());
-
-  for (const auto& k_v : uniques) {
-    if (k_v.second == required_shard_cnt) {
-      if (limit != 0 && result.size() >= limit)
-        return result;
-      result.push_back(k_v.first);
-    }
-  }
-
-  return result;
-}
-
 SvArray ToSvArray(const absl::flat_hash_set<std::string_view>& set) {
   SvArray result;
   result.reserve(set.size());
@@ -599,15 +660,15 @@ OpResult<uint32_t> OpAdd(const OpArgs& op_args, std::string_view key, ArgSlice v
       if (!success) {
         co.SetRObjPtr(is);
 
-        robj tmp;
-        if (!SetFamily::ConvertToStrSet(is, intsetLen(is), &tmp)) {
-          return OpStatus::OUT_OF_MEMORY;
-        }
-
         // frees 'is' on a way.
         if (GetFlag(FLAGS_use_set2)) {
-          co.InitRobj(OBJ_SET, kEncodingStrMap2, tmp.ptr);
+          // Intsets are smaller than kMaxCompactSetEntries, AddStrSet converts further if needed.
+          co.InitRobj(OBJ_SET, kEncodingCompactSet, ConvertToCompactSet(is));
         } else {
+          robj tmp;
+          if (!SetFamily::ConvertToStrSet(is, intsetLen(is), &tmp)) {
+            return OpStatus::OUT_OF_MEMORY;
+          }
           co.InitRobj(OBJ_SET, kEncodingStrMap, tmp.ptr);
         }
 
@@ -663,12 +724,16 @@ OpResult<uint32_t> OpAddEx(const OpArgs& op_args, string_view key, uint32_t ttl_
         return OpStatus::OUT_OF_MEMORY;
       }
       co.InitRobj(OBJ_SET, kEncodingStrMap2, tmp.ptr);
+    } else if (IsCompactEncoding(co)) {
+      // Compact sets do not support members with ttl.
+      ConvertCompactToStrSet(&co);
     }
 
     CHECK(IsDenseEncoding(co));
   }
 
   uint32_t res = AddStrSet(op_args.db_cntx, std::move(vals), ttl_sec, &co);
+  db_slice.TrackExpiringFields(op_args.db_cntx.db_index, key, co);
 
   return res;
 }
@@ -792,6 +857,30 @@ OpResult<unsigned> Mover::Commit(Transaction* t) {
 // Read-only OpUnion op on sets.
 OpResult<StringVec> OpUnion(const OpArgs& op_args, ArgSlice keys) {
   DCHECK(!keys.empty());
+
+  // The members of a single set are unique already.
+  if (keys.size() == 1) {
+    OpResult<PrimeConstIterator> find_res =
+        op_args.shard->db_slice().FindReadOnly(op_args.db_cntx, keys.front(), OBJ_SET);
+    if (find_res.status() == OpStatus::KEY_NOTFOUND)
+      return StringVec{};
+    if (!find_res)
+      return find_res.status();
+
+    const PrimeValue& pv = find_res.value()->second;
+    if (IsDenseEncoding(pv)) {
+      StringSet* ss = (StringSet*)pv.RObjPtr();
+      ss->set_time(MemberTimeSeconds(op_args.db_cntx.time_now_ms));
+    }
+    StringVec res;
+    res.reserve(pv.Size());
+    container_utils::IterateSet(pv, [&res](container_utils::ContainerEntry ce) {
+      res.push_back(ce.ToString());
+      return true;
+    });
+    return res;
+  }
+
   absl::flat_hash_set<string> uniques;
 
   for (string_view key : keys) {
@@ -873,35 +962,71 @@ OpResult<StringVec> OpDiff(const OpArgs& op_args, ArgSlice keys) {
   return ToVec(std::move(uniques));
 }
 
-// Read-only OpInter op on sets.
-OpResult<StringVec> OpInter(const Transaction* t, EngineShard* es, bool remove_first) {
-  ArgSlice keys = t->GetShardArgs(es->shard_id());
-  if (remove_first) {
-    keys.remove_prefix(1);
+// Returns the error of the shard results of a store command, or OK.
+OpStatus StoreResultsStatus(const ResultStringVec& result_vec) {
+  for (const auto& res : result_vec) {
+    if (!res && res.status() != OpStatus::SKIPPED && res.status() != OpStatus::KEY_NOTFOUND)
+      return res.status();
   }
-  DCHECK(!keys.empty());
-
-  StringVec result;
-  if (keys.size() == 1) {
-    OpResult<PrimeConstIterator> find_res =
-        es->db_slice().FindReadOnly(t->GetDbContext(), keys.front(), OBJ_SET);
-    if (!find_res)
-      return find_res.status();
+  return OpStatus::OK;
+}
 
-    const PrimeValue& pv = find_res.value()->second;
-    if (IsDenseEncoding(pv)) {
-      StringSet* ss = (StringSet*)pv.RObjPtr();
-      ss->set_time(MemberTimeSeconds(t->GetDbContext().time_now_ms));
+// Overwrites key with the members of the add vectors, without the members of the remove
+// vectors. The set deduplicates the members itself, they are added and removed in chunks with
+// the bulk paths, so no other copy of the members is made. Returns the size of the stored set.
+uint32_t OpStore(const OpArgs& op_args, string_view key, absl::Span<const StringVec* const> add,
+                 absl::Span<const StringVec* const> remove) {
+  constexpr size_t kChunkSize = 1024;
+
+  OpAdd(op_args, key, {}, true, false);  // Deletes the previous value.
+
+  SvArray chunk;
+  auto for_each_chunk = [&chunk](const StringVec& vec, auto&& cb) {
+    for (size_t i = 0; i < vec.size(); i += kChunkSize) {
+      chunk.assign(vec.begin() + i, vec.begin() + min(vec.size(), i + kChunkSize));
+      if (!cb())
+        return;
     }
+  };
 
-    container_utils::IterateSet(find_res.value()->second,
-                                [&result](container_utils::ContainerEntry ce) {
-                                  result.push_back(ce.ToString());
-                                  return true;
-                                });
-    return result;
+  for (const StringVec* vec : add) {
+    for_each_chunk(*vec, [&] { return bool(OpAdd(op_args, key, chunk, false, false)); });
+  }
+  for (const StringVec* vec : remove) {
+    for_each_chunk(*vec, [&] { return bool(OpRem(op_args, key, chunk, false)); });
+  }
+
+  auto find_res = op_args.shard->db_slice().FindReadOnly(op_args.db_cntx, key, OBJ_SET);
+  uint32_t size = find_res ? find_res.value()->second.Size() : 0;
+
+  if (op_args.shard->journal()) {
+    RecordJournal(op_args, "DEL"sv, ArgSlice{key});
+    if (find_res) {
+      StringVec members;
+      auto record = [&] {
+        chunk.assign({key});
+        chunk.insert(chunk.end(), members.begin(), members.end());
+        RecordJournal(op_args, "SADD"sv, chunk);
+        members.clear();
+      };
+      const PrimeValue& pv = find_res.value()->second;
+      container_utils::IterateSet(pv, [&](container_utils::ContainerEntry ce) {
+        members.push_back(ce.ToString());
+        if (members.size() == kChunkSize)
+          record();
+        return true;
+      });
+      if (!members.empty())
+        record();
+    }
   }
+  return size;
+}
 
+// Finds the sets of keys and orders them by size, the smallest first.
+// If some keys are not sets, returns WRONG_TYPE or KEY_NOTFOUND, preferring the former.
+OpResult<vector<SetType>> FindSetsBySize(const DbContext& db_cntx, EngineShard* es,
+                                         ArgSlice keys) {
   // we must copy by value because AsRObj is temporary.
   vector<SetType> sets(keys.size());
 
@@ -909,7 +1034,7 @@ OpResult<StringVec> OpInter(const Transaction* t, EngineShard* es, bool remove_f
 
   for (size_t i = 0; i < keys.size(); ++i) {
     OpResult<PrimeConstIterator> find_res =
-        es->db_slice().FindReadOnly(t->GetDbContext(), keys[i], OBJ_SET);
+        es->db_slice().FindReadOnly(db_cntx, keys[i], OBJ_SET);
     if (!find_res) {
       if (status == OpStatus::OK || status == OpStatus::KEY_NOTFOUND ||
           find_res.status() != OpStatus::KEY_NOTFOUND) {
@@ -925,12 +1050,49 @@ OpResult<StringVec> OpInter(const Transaction* t, EngineShard* es, bool remove_f
   if (status != OpStatus::OK)
     return status;
 
-  auto comp = [db_contx = t->GetDbContext()](const SetType& left, const SetType& right) {
-    return SetTypeLen(db_contx, left) < SetTypeLen(db_contx, right);
+  auto comp = [&db_cntx](const SetType& left, const SetType& right) {
+    return SetTypeLen(db_cntx, left) < SetTypeLen(db_cntx, right);
   };
 
   std::sort(sets.begin(), sets.end(), comp);
+  return sets;
+}
+
+// Read-only OpInter op on sets. Stops after limit members were found if limit is not 0.
+OpResult<StringVec> OpInter(const Transaction* t, EngineShard* es, bool remove_first,
+                            unsigned limit = 0) {
+  ArgSlice keys = t->GetShardArgs(es->shard_id());
+  if (remove_first) {
+    keys.remove_prefix(1);
+  }
+  DCHECK(!keys.empty());
 
+  StringVec result;
+  if (keys.size() == 1) {
+    OpResult<PrimeConstIterator> find_res =
+        es->db_slice().FindReadOnly(t->GetDbContext(), keys.front(), OBJ_SET);
+    if (!find_res)
+      return find_res.status();
+
+    const PrimeValue& pv = find_res.value()->second;
+    if (IsDenseEncoding(pv)) {
+      StringSet* ss = (StringSet*)pv.RObjPtr();
+      ss->set_time(MemberTimeSeconds(t->GetDbContext().time_now_ms));
+    }
+
+    container_utils::IterateSet(find_res.value()->second,
+                                [&result, limit](container_utils::ContainerEntry ce) {
+                                  result.push_back(ce.ToString());
+                                  return result.size() != limit;
+                                });
+    return result;
+  }
+
+  OpResult<vector<SetType>> find_res = FindSetsBySize(t->GetDbContext(), es, keys);
+  if (!find_res)
+    return find_res.status();
+
+  const vector<SetType>& sets = *find_res;
   int encoding = sets.front().second;
   if (encoding == kEncodingIntSet) {
     int ii = 0;
@@ -947,10 +1109,120 @@ OpResult<StringVec> OpInter(const Transaction* t, EngineShard* es, bool remove_f
       /* Only take action when all sets contain the member */
       if (j == sets.size()) {
         result.push_back(absl::StrCat(intele));
+        if (result.size() == limit)
+          break;
       }
     }
   } else {
-    InterStrSet(t->GetDbContext(), sets, &result);
+    InterStrSet(t->GetDbContext(), sets, limit, &result);
+  }
+
+  return result;
+}
+
+// Intersects the sets of a scheduled transaction that spans multiple shards.
+// Rather than collecting the intersections of all the shards on the coordinator, the shard with
+// the smallest set computes its local intersection and the other shards filter these candidates
+// in parallel, so only the candidates cross the shards. Concludes the transaction if conclude
+// is true. The first key on dest_shard is the destination key of the STORE variant and is
+// skipped, kInvalidSid means there is no destination key.
+OpResult<StringVec> InterMultiShard(Transaction* t, ShardId dest_shard, unsigned limit,
+                                    bool conclude) {
+  auto shard_keys = [dest_shard](Transaction* t, EngineShard* es) {
+    ArgSlice keys = t->GetShardArgs(es->shard_id());
+    if (es->shard_id() == dest_shard)
+      keys.remove_prefix(1);
+    return keys;
+  };
+
+  // Find the shard with the smallest set.
+  vector<OpResult<uint32_t>> min_len(shard_set->size(), OpStatus::SKIPPED);
+  auto len_cb = [&](Transaction* t, EngineShard* es) {
+    ArgSlice keys = shard_keys(t, es);
+    if (keys.empty())
+      return OpStatus::OK;
+
+    OpResult<vector<SetType>> sets = FindSetsBySize(t->GetDbContext(), es, keys);
+    if (sets)
+      min_len[es->shard_id()] = SetTypeLen(t->GetDbContext(), sets->front());
+    else
+      min_len[es->shard_id()] = sets.status();
+    return OpStatus::OK;
+  };
+  t->Execute(std::move(len_cb), false);
+
+  auto finish = [&](OpResult<StringVec> res) {
+    if (conclude)
+      t->Conclude();
+    return res;
+  };
+
+  ShardId src_shard = kInvalidSid;
+  unsigned num_shards = 0;
+  for (ShardId sid = 0; sid < min_len.size(); ++sid) {
+    const auto& res = min_len[sid];
+    if (!res && !base::_in(res.status(), {OpStatus::SKIPPED, OpStatus::KEY_NOTFOUND}))
+      return finish(res.status());
+    if (res) {
+      ++num_shards;
+      if (src_shard == kInvalidSid || *res < *min_len[src_shard])
+        src_shard = sid;
+    }
+  }
+
+  for (const auto& res : min_len) {
+    if (res.status() == OpStatus::KEY_NOTFOUND)
+      return finish(StringVec{});  // empty set.
+  }
+
+  DCHECK_NE(src_shard, kInvalidSid);
+
+  StringVec candidates;
+  auto candidates_cb = [&](Transaction* t, EngineShard* es) {
+    if (es->shard_id() == src_shard) {
+      // The limit can be applied locally only if the shard holds all the sets.
+      OpResult<StringVec> res =
+          OpInter(t, es, es->shard_id() == dest_shard, num_shards == 1 ? limit : 0);
+      DCHECK(res);  // the keys were checked in the previous hop.
+      candidates = std::move(res.value());
+    }
+    return OpStatus::OK;
+  };
+  t->Execute(std::move(candidates_cb), false);
+
+  if (candidates.empty() || num_shards == 1)
+    return finish(std::move(candidates));
+
+  // Every shard marks which candidates are contained in all of its sets.
+  vector<vector<bool>> matches(shard_set->size());
+  auto filter_cb = [&](Transaction* t, EngineShard* es) {
+    ArgSlice keys = shard_keys(t, es);
+    if (keys.empty() || es->shard_id() == src_shard)
+      return OpStatus::OK;
+
+    OpResult<vector<SetType>> sets = FindSetsBySize(t->GetDbContext(), es, keys);
+    DCHECK(sets);
+
+    vector<bool>& shard_matches = matches[es->shard_id()];
+    shard_matches.resize(candidates.size());
+    for (size_t i = 0; i < candidates.size(); ++i) {
+      shard_matches[i] = all_of(sets->begin(), sets->end(), [&](const SetType& st) {
+        return IsInSet(t->GetDbContext(), st, candidates[i]);
+      });
+    }
+    return OpStatus::OK;
+  };
+  t->Execute(std::move(filter_cb), conclude);
+
+  StringVec result;
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    bool found = all_of(matches.begin(), matches.end(),
+                        [i](const vector<bool>& m) { return m.empty() || m[i]; });
+    if (found) {
+      result.push_back(std::move(candidates[i]));
+      if (result.size() == limit)
+        break;
+    }
   }
 
   return result;
@@ -1296,24 +1568,31 @@ void SDiffStore(CmdArgList args, ConnectionContext* cntx) {
 
   cntx->transaction->Schedule();
   cntx->transaction->Execute(std::move(diff_cb), false);
-  ResultSetView rsv = DiffResultVec(result_set, src_shard);
-  if (!rsv) {
+  if (OpStatus status = StoreResultsStatus(result_set); status != OpStatus::OK) {
     cntx->transaction->Conclude();
-    cntx->SendError(rsv.status());
+    cntx->SendError(status);
     return;
   }
 
-  SvArray result = ToSvArray(rsv.value());
+  vector<const StringVec*> add, remove;
+  for (ShardId sid = 0; sid < result_set.size(); ++sid) {
+    if (result_set[sid])
+      (sid == src_shard ? add : remove).push_back(&result_set[sid].value());
+  }
+  if (add.empty())
+    remove.clear();
+
+  uint32_t result_size = 0;
   auto store_cb = [&](Transaction* t, EngineShard* shard) {
     if (shard->shard_id() == dest_shard) {
-      OpAdd(t->GetOpArgs(shard), dest_key, result, true, true);
+      result_size = OpStore(t->GetOpArgs(shard), dest_key, add, remove);
     }
 
     return OpStatus::OK;
   };
 
   cntx->transaction->Execute(std::move(store_cb), true);
-  cntx->SendLong(result.size());
+  cntx->SendLong(result_size);
 }
 
 void SMembers(CmdArgList args, ConnectionContext* cntx) {
@@ -1395,19 +1674,26 @@ void SRandMember(CmdArgList args, ConnectionContext* cntx) {
   }
 }
 
-void SInter(CmdArgList args, ConnectionContext* cntx) {
-  ResultStringVec result_set(shard_set->size(), OpStatus::SKIPPED);
-
-  auto cb = [&](Transaction* t, EngineShard* shard) {
-    result_set[shard->shard_id()] = OpInter(t, shard, false);
+// Schedules the transaction, intersects its sets and concludes it.
+OpResult<StringVec> InterSets(Transaction* t, unsigned limit) {
+  if (t->GetUniqueShardCnt() == 1) {
+    auto cb = [limit](Transaction* t, EngineShard* shard) {
+      return OpInter(t, shard, false, limit);
+    };
+    OpResult<StringVec> result = t->ScheduleSingleHopT(std::move(cb));
+    if (result.status() == OpStatus::KEY_NOTFOUND)
+      return StringVec{};
+    return result;
+  }
 
-    return OpStatus::OK;
-  };
+  t->Schedule();
+  return InterMultiShard(t, kInvalidSid, limit, true);
+}
 
-  cntx->transaction->ScheduleSingleHop(std::move(cb));
-  OpResult<SvArray> result = InterResultVec(result_set, cntx->transaction->GetUniqueShardCnt());
+void SInter(CmdArgList args, ConnectionContext* cntx) {
+  OpResult<StringVec> result = InterSets(cntx->transaction, 0);
   if (result) {
-    SvArray arr = std::move(*result);
+    StringVec arr = std::move(*result);
     if (cntx->conn_state.script_info) {  // sort under script
       sort(arr.begin(), arr.end());
     }
@@ -1419,43 +1705,29 @@ void SInter(CmdArgList args, ConnectionContext* cntx) {
 }
 
 void SInterStore(CmdArgList args, ConnectionContext* cntx) {
-  ResultStringVec result_set(shard_set->size(), OpStatus::SKIPPED);
   string_view dest_key = ArgS(args, 0);
-  ShardId dest_shard = Shard(dest_key, result_set.size());
-  atomic_uint32_t inter_shard_cnt{0};
-
-  auto inter_cb = [&](Transaction* t, EngineShard* shard) {
-    ArgSlice largs = t->GetShardArgs(shard->shard_id());
-    if (shard->shard_id() == dest_shard) {
-      CHECK_EQ(largs.front(), dest_key);
-      if (largs.size() == 1)
-        return OpStatus::OK;
-    }
-    inter_shard_cnt.fetch_add(1, memory_order_relaxed);
-    result_set[shard->shard_id()] = OpInter(t, shard, shard->shard_id() == dest_shard);
-    return OpStatus::OK;
-  };
+  ShardId dest_shard = Shard(dest_key, shard_set->size());
 
   cntx->transaction->Schedule();
-  cntx->transaction->Execute(std::move(inter_cb), false);
 
-  OpResult<SvArray> result = InterResultVec(result_set, inter_shard_cnt.load(memory_order_relaxed));
+  OpResult<StringVec> result = InterMultiShard(cntx->transaction, dest_shard, 0, false);
   if (!result) {
     cntx->transaction->Conclude();
     cntx->SendError(result.status());
     return;
   }
 
+  SvArray members(result->begin(), result->end());
   auto store_cb = [&](Transaction* t, EngineShard* shard) {
     if (shard->shard_id() == dest_shard) {
-      OpAdd(t->GetOpArgs(shard), dest_key, result.value(), true, true);
+      OpAdd(t->GetOpArgs(shard), dest_key, members, true, true);
     }
 
     return OpStatus::OK;
   };
 
   cntx->transaction->Execute(std::move(store_cb), true);
-  cntx->SendLong(result->size());
+  cntx->SendLong(members.size());
 }
 
 void SInterCard(CmdArgList args, ConnectionContext* cntx) {
@@ -1470,15 +1742,9 @@ void SInterCard(CmdArgList args, ConnectionContext* cntx) {
   } else if (args.size() > (num_keys + 1))
     return cntx->SendError(kSyntaxErr);
 
-  ResultStringVec result_set(shard_set->size(), OpStatus::SKIPPED);
-  auto cb = [&](Transaction* t, EngineShard* shard) {
-    result_set[shard->shard_id()] = OpInter(t, shard, false);
-    return OpStatus::OK;
-  };
-
-  cntx->transaction->ScheduleSingleHop(std::move(cb));
-  OpResult<SvArray> result =
-      InterResultVec(result_set, cntx->transaction->GetUniqueShardCnt(), limit);
+  OpResult<StringVec> result = InterSets(cntx->transaction, limit);
+  if (!result)
+    return cntx->SendError(result.status());
 
   return cntx->SendLong(result->size());
 }
@@ -1526,26 +1792,29 @@ void SUnionStore(CmdArgList args, ConnectionContext* cntx) {
 
   cntx->transaction->Schedule();
   cntx->transaction->Execute(std::move(union_cb), false);
-
-  ResultSetView unionset = UnionResultVec(result_set);
-  if (!unionset) {
+  if (OpStatus status = StoreResultsStatus(result_set); status != OpStatus::OK) {
     cntx->transaction->Conclude();
-    cntx->SendError(unionset.status());
+    cntx->SendError(status);
     return;
   }
 
-  SvArray result = ToSvArray(unionset.value());
+  vector<const StringVec*> add;
+  for (const auto& res : result_set) {
+    if (res)
+      add.push_back(&res.value());
+  }
 
+  uint32_t result_size = 0;
   auto store_cb = [&](Transaction* t, EngineShard* shard) {
     if (shard->shard_id() == dest_shard) {
-      OpAdd(t->GetOpArgs(shard), dest_key, result, true, true);
+      result_size = OpStore(t->GetOpArgs(shard), dest_key, add, {});
     }
 
     return OpStatus::OK;
   };
 
   cntx->transaction->Execute(std::move(store_cb), true);
-  cntx->SendLong(result.size());
+  cntx->SendLong(result_size);
 }
 
 void SScan(CmdArgList args, ConnectionContext* cntx) {
@@ -1692,7 +1961,7 @@ void SetFamily::Register(CommandRegistry* registry) {
   registry->StartFamily();
   *registry
       << CI{"SADD", CO::WRITE | CO::FAST | CO::DENYOOM, -3, 1, 1, acl::kSAdd}.HFUNC(SAdd)
-      << CI{"SDIFF", CO::READONLY, -2, 1, -1, acl::kSDiff}.HFUNC(SDiff)
+      << CI{"SDIFF", CO::READONLY | CO::OPTIMISTIC_READ, -2, 1, -1, acl::kSDiff}.HFUNC(SDiff)
       << CI{"SDIFFSTORE", CO::WRITE | CO::DENYOOM | CO::NO_AUTOJOURNAL, -3, 1, -1, acl::kSDiffStore}
              .HFUNC(SDiffStore)
       << CI{"SINTER", CO::READONLY, -2, 1, -1, acl::kSInter}.HFUNC(SInter)
@@ -1710,7 +1979,7 @@ void SetFamily::Register(CommandRegistry* registry) {
       << CI{"SCARD", CO::READONLY | CO::FAST, 2, 1, 1, acl::kSCard}.HFUNC(SCard)
       << CI{"SPOP", CO::WRITE | CO::FAST | CO::NO_AUTOJOURNAL, -2, 1, 1, acl::kSPop}.HFUNC(SPop)
       << CI{"SRANDMEMBER", CO::READONLY, -2, 1, 1, acl::kSRandMember}.HFUNC(SRandMember)
-      << CI{"SUNION", CO::READONLY, -2, 1, -1, acl::kSUnion}.HFUNC(SUnion)
+      << CI{"SUNION", CO::READONLY | CO::OPTIMISTIC_READ, -2, 1, -1, acl::kSUnion}.HFUNC(SUnion)
       << CI{"SUNIONSTORE",    CO::WRITE | CO::DENYOOM | CO::NO_AUTOJOURNAL, -3, 1, -1,
             acl::kSUnionStore}
              .HFUNC(SUnionStore)
@@ -1726,6 +1995,10 @@ uint32_t SetFamily::MaxIntsetEntries() {
   return kMaxIntSetEntries;
 }
 
+uint32_t SetFamily::MaxCompactSetEntries() {
+  return kMaxCompactSetEntries;
+}
+
 void SetFamily::ConvertTo(const intset* src, dict* dest) {
   int64_t intele;
   char buf[32];
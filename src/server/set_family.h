@@ -26,6 +26,9 @@ class SetFamily {
 
   static uint32_t MaxIntsetEntries();
 
+  // Sets of strings up to this size are stored using CompactStringSet.
+  static uint32_t MaxCompactSetEntries();
+
   static void ConvertTo(const intset* src, dict* dest);
 
   // Returns true if succeeded, false on OOM.
@@ -56,6 +56,32 @@ TEST_F(SetFamilyTest, SUnionStore) {
   EXPECT_THAT(resp.GetVec(), UnorderedElementsAre("11", "10", "1", "2", "3"));
 }
 
+TEST_F(SetFamilyTest, StoreLargeSets) {
+  // Overlapping sets on different shards, larger than the chunks of the destination.
+  vector<string> sadd_x = {"sadd", "x"}, sadd_y = {"sadd", "y"}, sadd_z = {"sadd", "z"};
+  for (unsigned i = 0; i < 3000; ++i) {
+    sadd_x.push_back(absl::StrCat("m", i));
+    sadd_y.push_back(absl::StrCat("m", i + 2000));
+    if (i % 2 == 0)
+      sadd_z.push_back(absl::StrCat("m", i));
+  }
+  Run(absl::Span<string>{sadd_x});
+  Run(absl::Span<string>{sadd_y});
+  Run(absl::Span<string>{sadd_z});
+
+  EXPECT_THAT(Run({"sunionstore", "dest", "x", "y", "z"}), IntArg(5000));
+  EXPECT_THAT(Run({"scard", "dest"}), IntArg(5000));
+
+  // x without y leaves m0..m1999, without z leaves the odd ones.
+  EXPECT_THAT(Run({"sdiffstore", "dest", "x", "y", "z"}), IntArg(1000));
+  EXPECT_THAT(Run({"scard", "dest"}), IntArg(1000));
+  EXPECT_THAT(Run({"sismember", "dest", "m1"}), IntArg(1));
+  EXPECT_THAT(Run({"sismember", "dest", "m2"}), IntArg(0));
+
+  EXPECT_THAT(Run({"sdiffstore", "dest", "z", "x"}), IntArg(0));
+  EXPECT_THAT(Run({"exists", "dest"}), IntArg(0));
+}
+
 TEST_F(SetFamilyTest, SDiff) {
   auto resp = Run({"sadd", "b", "1", "2", "3"});
   Run({"sadd", "c", "10", "11"});
@@ -119,6 +145,45 @@ TEST_F(SetFamilyTest, SInterCard) {
   EXPECT_THAT(resp, ErrArg("value is not an integer or out of range"));
 }
 
+TEST_F(SetFamilyTest, SInterMultiShard) {
+  // Member i belongs to key j if it is divisible by j + 1, the intersection is multiples of 60.
+  vector<string> keys;
+  for (unsigned j = 0; j < 5; ++j) {
+    keys.push_back(absl::StrCat("key", j));
+    for (unsigned i = 0; i < 200; i += j + 1) {
+      Run({"sadd", keys.back(), absl::StrCat("m", i)});
+    }
+  }
+
+  vector<string_view> cmd = {"sinter"};
+  cmd.insert(cmd.end(), keys.begin(), keys.end());
+  auto resp = Run(cmd);
+  ASSERT_THAT(resp, ArgType(RespExpr::ARRAY));
+  EXPECT_THAT(resp.GetVec(), UnorderedElementsAre("m0", "m60", "m120", "m180"));
+  EXPECT_GT(last_cmd_dbg_info_.shards_count, 1u);
+
+  cmd = {"sintercard", "5"};
+  cmd.insert(cmd.end(), keys.begin(), keys.end());
+  EXPECT_EQ(4, CheckedInt(cmd));
+  cmd.insert(cmd.end(), {"LIMIT", "3"});
+  EXPECT_EQ(3, CheckedInt(cmd));
+
+  cmd = {"sinterstore", "dest"};
+  cmd.insert(cmd.end(), keys.begin(), keys.end());
+  EXPECT_EQ(4, CheckedInt(cmd));
+  EXPECT_THAT(Run({"smembers", "dest"}).GetVec(),
+              UnorderedElementsAre("m0", "m60", "m120", "m180"));
+
+  cmd.push_back("missing");
+  EXPECT_EQ(0, CheckedInt(cmd));
+  EXPECT_THAT(Run({"exists", "dest"}), IntArg(0));
+
+  Run({"set", "str", "foo"});
+  cmd = {"sinter", "str"};
+  cmd.insert(cmd.end(), keys.begin(), keys.end());
+  EXPECT_THAT(Run(cmd), ErrArg("WRONGTYPE"));
+}
+
 TEST_F(SetFamilyTest, SMove) {
   auto resp = Run({"sadd", "a", "1", "2", "3", "4"});
   Run({"sadd", "b", "3", "5", "6", "2"});
@@ -265,4 +330,36 @@ TEST_F(SetFamilyTest, SScan) {
   EXPECT_THAT(vec.size(), 0);
 }
 
+TEST_F(SetFamilyTest, CompactSetConversion) {
+  // Grows past the compact encoding limit one member at a time.
+  for (unsigned i = 0; i < SetFamily::MaxCompactSetEntries() + 100; ++i) {
+    ASSERT_THAT(Run({"sadd", "key", absl::StrCat("m", i)}), IntArg(1));
+    ASSERT_THAT(Run({"sadd", "key", absl::StrCat("m", i)}), IntArg(0));
+  }
+  EXPECT_THAT(Run({"scard", "key"}), IntArg(SetFamily::MaxCompactSetEntries() + 100));
+  EXPECT_THAT(Run({"sismember", "key", "m0"}), IntArg(1));
+
+  // Intsets are converted to the compact encoding first.
+  Run({"sadd", "intkey", "1", "2", "3"});
+  EXPECT_THAT(Run({"sadd", "intkey", "a", "b"}), IntArg(2));
+  EXPECT_THAT(Run({"smembers", "intkey"}).GetVec(), UnorderedElementsAre("1", "2", "3", "a", "b"));
+  EXPECT_THAT(Run({"srem", "intkey", "1", "a", "c"}), IntArg(2));
+  EXPECT_THAT(Run({"sinter", "intkey", "key"}), ArrLen(0));
+  EXPECT_THAT(Run({"sdiff", "intkey", "key"}).GetVec(), UnorderedElementsAre("2", "3", "b"));
+
+  vector<string> members;
+  uint64_t cursor = 0;
+  do {
+    auto resp = Run({"sscan", "intkey", absl::StrCat(cursor), "count", "1"});
+    ASSERT_TRUE(absl::SimpleAtoi(facade::ToSV(resp.GetVec()[0].GetBuf()), &cursor));
+    for (const auto& member : StrArray(resp.GetVec()[1]))
+      members.push_back(member);
+  } while (cursor);
+  EXPECT_THAT(members, UnorderedElementsAre("2", "3", "b"));
+
+  // Members with ttl are not supported by the compact encoding.
+  EXPECT_THAT(Run({"saddex", "intkey", "10", "c"}), IntArg(1));
+  EXPECT_THAT(Run({"scard", "intkey"}), IntArg(4));
+}
+
 }  // namespace dfly
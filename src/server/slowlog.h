@@ -5,6 +5,7 @@
 #pragma once
 
 #include <boost/circular_buffer.hpp>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -15,6 +16,18 @@ namespace dfly {
 constexpr size_t kMaximumSlowlogArgCount = 31;  // 32 - 1 for the command name
 constexpr size_t kMaximumSlowlogArgLength = 128;
 
+// Where a transactional command spent its time. The shard phases are summed over the shards.
+struct SlowLogTxStats {
+  uint64_t schedule_usec = 0;    // scheduling into the transaction queues and locking the keys
+  uint64_t queue_wait_usec = 0;  // hops waiting in the shard queues before running
+  uint64_t execution_usec = 0;   // running the callbacks of the hops
+  uint64_t conclude_usec = 0;    // releasing the locks after the last hop
+  uint64_t hop_wait_usec = 0;    // the connection fiber waiting for the hops to finish
+  uint32_t hops = 0;
+  uint32_t shards = 0;
+  uint32_t txq_len = 0;  // the longest shard queue the command was scheduled into
+};
+
 struct SlowLogEntry {
   uint32_t entry_id;
   uint64_t unix_ts_usec;
@@ -24,6 +37,7 @@ struct SlowLogEntry {
   std::vector<std::pair<std::string, uint32_t>> cmd_args;
   std::string client_ip;
   std::string client_name;
+  std::optional<SlowLogTxStats> tx_stats;
 };
 
 class SlowLogShard {
@@ -33,7 +47,8 @@ class SlowLogShard {
   }
 
   void Add(const std::string_view command_name, CmdArgList args, const std::string_view client_name,
-           const std::string_view client_ip, uint64_t exec_time_usec, uint64_t unix_ts_usec);
+           const std::string_view client_ip, uint64_t exec_time_usec, uint64_t unix_ts_usec,
+           std::optional<SlowLogTxStats> tx_stats = std::nullopt);
   void Reset();
   void ChangeLength(size_t new_length);
 
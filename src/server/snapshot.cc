@@ -12,6 +12,7 @@ extern "C" {
 #include <absl/strings/match.h>
 #include <absl/strings/str_cat.h>
 
+#include "base/flags.h"
 #include "base/logging.h"
 #include "core/heap_size.h"
 #include "server/db_slice.h"
@@ -19,6 +20,20 @@ extern "C" {
 #include "server/journal/journal.h"
 #include "server/rdb_extensions.h"
 #include "server/rdb_save.h"
+#include "server/search/doc_index.h"
+#include "server/tiered_storage.h"
+
+ABSL_FLAG(bool, search_index_snapshot, false,
+          "If true, search indices are serialized into snapshots and restored when loading them "
+          "instead of being rebuilt. Such snapshots can't be loaded by older versions");
+ABSL_FLAG(bool, snapshot_pacing, false,
+          "If true, snapshots adapt how long they serialize before yielding to the delay of the "
+          "commands waiting on the shard thread");
+ABSL_FLAG(uint64_t, snapshot_max_bytes_per_sec, 0,
+          "If positive and snapshot_pacing is set, limits the serialization throughput of a "
+          "snapshot on each shard");
+
+ABSL_DECLARE_FLAG(uint32_t, compression_dict_size);
 
 namespace dfly {
 
@@ -34,8 +49,12 @@ size_t SliceSnapshot::DbRecord::size() const {
   return HeapSize(value);
 }
 
-SliceSnapshot::SliceSnapshot(DbSlice* slice, RecordChannel* dest, CompressionMode compression_mode)
-    : db_slice_(slice), dest_(dest), compression_mode_(compression_mode) {
+SliceSnapshot::SliceSnapshot(DbSlice* slice, RecordChannel* dest, CompressionMode compression_mode,
+                             bool ordered)
+    : db_slice_(slice),
+      dest_(dest),
+      ordered_(ordered),
+      compression_mode_(compression_mode) {
   db_array_ = slice->databases();
   tl_slice_snapshots.insert(this);
 }
@@ -52,7 +71,8 @@ size_t SliceSnapshot::GetThreadLocalMemoryUsage() {
   return mem;
 }
 
-void SliceSnapshot::Start(bool stream_journal, const Cancellation* cll) {
+void SliceSnapshot::Start(bool stream_journal, const Cancellation* cll,
+                          optional<uint64_t> save_base) {
   DCHECK(!snapshot_fb_.IsJoinable());
 
   auto db_cb = absl::bind_front(&SliceSnapshot::OnDbChange, this);
@@ -65,9 +85,49 @@ void SliceSnapshot::Start(bool stream_journal, const Cancellation* cll) {
     journal_cb_id_ = journal->RegisterOnChange(std::move(journal_cb));
   }
 
-  serializer_ = std::make_unique<RdbSerializer>(compression_mode_);
+  RdbSerializer::FlushFun flush_fun;
+  if (ordered_)
+    flush_fun = [this](size_t) { FlushValueChunk(); };
+  serializer_ = std::make_unique<RdbSerializer>(compression_mode_, std::move(flush_fun));
+  if (native_encodings_)
+    serializer_->SaveNativeEncodings();
+
+  // Sealed before any bucket is serialized, so that the generation covers all the external
+  // values of the snapshot.
+  if (TieredStorage* tiered = db_slice_->shard_owner()->tiered_storage();
+      tiered_refs_ && tiered && tiered->persistent()) {
+    serializer_->SaveTieredRefs(db_slice_->shard_id(), tiered->SealForSnapshot());
+  }
 
-  VLOG(1) << "DbSaver::Start - saving entries with version less than " << snapshot_version_;
+  // The dictionary applies to the blobs that follow it, so it needs the records in order.
+  size_t dict_size = absl::GetFlag(FLAGS_compression_dict_size);
+  if (ordered_ && dict_size > 0 && compression_mode_ == CompressionMode::MULTI_ENTRY_ZSTD)
+    SaveCompressionDict(dict_size);
+  if (absl::GetFlag(FLAGS_snapshot_pacing)) {
+    SnapshotPacer::Options opts;
+    opts.max_bytes_per_sec = absl::GetFlag(FLAGS_snapshot_max_bytes_per_sec);
+    pacer_.emplace(opts, ProactorBase::GetMonotonicTimeNs());
+  }
+
+  // Serialize the indices before yielding, so that they match the documents of this snapshot.
+  if (absl::GetFlag(FLAGS_search_index_snapshot)) {
+    EngineShard* shard = db_slice_->shard_owner();
+    if (string data = shard->search_indices()->SerializeIndices(); !data.empty())
+      serializer_->SaveSearchIndices(shard->shard_id(), shard_set->size(), data);
+  }
+
+  // Taken without preempting after the registration, so that every deletion is either
+  // reflected by the buckets of this snapshot or tracked for the next one. The tombstones are
+  // serialized before any bucket, so that the loader applies them before the values.
+  if (save_base) {
+    DbSlice::DeletedKeys deleted_keys = db_slice_->StartSave(snapshot_version_);
+    base_version_ = *save_base;
+    if (base_version_ > 0)
+      SerializeDeletedKeys(deleted_keys);
+  }
+
+  VLOG(1) << "DbSaver::Start - saving entries with version less than " << snapshot_version_
+          << " and greater than " << base_version_;
 
   snapshot_fb_ = fb2::Fiber("snapshot", [this, stream_journal, cll] {
     IterateBucketsFb(cll);
@@ -185,7 +245,7 @@ void SliceSnapshot::IterateBucketsFb(const Cancellation* cll) {
     if (cll->IsCancelled())
       return;
 
-    if (!db_array_[db_indx])
+    if (!db_array_[db_indx] || !filter_.MatchDb(db_indx))
       continue;
 
     uint64_t last_yield = 0;
@@ -202,7 +262,10 @@ void SliceSnapshot::IterateBucketsFb(const Cancellation* cll) {
       cursor = next;
       PushSerializedToChannel(false);
 
-      if (stats_.loop_serialized >= last_yield + 100) {
+      if (pacer_) {
+        if (pacer_->ShouldYield(ProactorBase::GetMonotonicTimeNs()))
+          PacedYield();
+      } else if (stats_.loop_serialized >= last_yield + 100) {
         DVLOG(2) << "Before sleep " << ThisFiber::GetName();
         ThisFiber::Yield();
         DVLOG(2) << "After sleep";
@@ -227,12 +290,77 @@ void SliceSnapshot::IterateBucketsFb(const Cancellation* cll) {
           << stats_.loop_serialized << "/" << stats_.side_saved << "/" << stats_.savecb_calls;
 }
 
+// Does not preempt, so the sample is taken from the same state as the first buckets.
+void SliceSnapshot::SaveCompressionDict(size_t dict_size) {
+  constexpr size_t kMaxSampleBytes = 256_KB;
+  constexpr size_t kMaxSampleEntries = 1000;
+
+  RdbSerializer sampler(CompressionMode::NONE);
+  vector<size_t> sizes;
+  size_t sampled = 0;
+  for (DbIndex db_indx = 0; db_indx < db_array_.size(); ++db_indx) {
+    if (!db_array_[db_indx])
+      continue;
+
+    PrimeTable* pt = &db_array_[db_indx]->prime;
+    PrimeTable::Cursor cursor;
+    do {
+      cursor = pt->Traverse(cursor, [&](PrimeIterator it) {
+        if (sizes.size() >= kMaxSampleEntries || sampled >= kMaxSampleBytes)
+          return;
+        if (it->second.IsExternal())  // its contents are not in memory.
+          return;
+        CHECK(sampler.SaveEntry(it->first, it->second, 0, db_indx));
+        sizes.push_back(sampler.SerializedLen() - sampled);
+        sampled = sampler.SerializedLen();
+      });
+    } while (cursor && sizes.size() < kMaxSampleEntries && sampled < kMaxSampleBytes);
+  }
+
+  io::StringFile sfile;
+  sampler.FlushToSink(&sfile);
+  string dict = RdbSerializer::TrainCompressionDict(sfile.val, sizes, dict_size);
+  VLOG(1) << "Trained a compression dictionary of " << dict.size() << " bytes from "
+          << sizes.size() << " entries";
+  if (!dict.empty())
+    CHECK(!serializer_->SaveCompressionDict(std::move(dict)));
+}
+
+// Does not preempt, the tombstones are pushed to the channel by the snapshot fiber.
+void SliceSnapshot::SerializeDeletedKeys(const DbSlice::DeletedKeys& deleted_keys) {
+  for (DbIndex db_indx = 0; db_indx < deleted_keys.size(); ++db_indx) {
+    for (const string& key : deleted_keys[db_indx])
+      CHECK(!serializer_->SaveDeletedKey(key, db_indx));
+  }
+}
+
+void SliceSnapshot::PacedYield() {
+  uint64_t sleep_ns = pacer_->OnYield(ProactorBase::GetMonotonicTimeNs(),
+                                      stats_.pushed_bytes - stats_.paced_bytes);
+  stats_.paced_bytes = stats_.pushed_bytes;
+  if (sleep_ns > 0) {
+    ThisFiber::SleepFor(chrono::nanoseconds(sleep_ns));
+  } else {
+    ThisFiber::Yield();
+  }
+  pacer_->OnResume(ProactorBase::GetMonotonicTimeNs());
+
+  // Push in case other fibers filled the buffer.
+  PushSerializedToChannel(false);
+}
+
+void SliceSnapshot::BoostPacing() {
+  if (pacer_)
+    pacer_->Boost();
+}
+
 bool SliceSnapshot::BucketSaveCb(PrimeIterator it) {
   ++stats_.savecb_calls;
 
   uint64_t v = it.GetVersion();
-  if (v >= snapshot_version_) {
-    // either has been already serialized or added after snapshotting started.
+  if (v >= snapshot_version_ || IsUnchanged(v)) {
+    // either has been already serialized, added after snapshotting started or, in a delta,
+    // not changed since its base.
     DVLOG(3) << "Skipped " << it.segment_id() << ":" << it.bucket_id() << ":" << it.slot_id()
              << " at " << v;
     ++stats_.skipped;
@@ -258,9 +386,12 @@ unsigned SliceSnapshot::SerializeBucket(DbIndex db_index, PrimeTable::bucket_ite
   it.SetVersion(snapshot_version_);
   unsigned result = 0;
 
+  string key_buffer;
   while (!it.is_done()) {
-    ++result;
-    SerializeEntry(db_index, it->first, it->second, nullopt, serializer_.get());
+    if (filter_.prefixes.empty() || filter_.MatchKey(it->first.GetSlice(&key_buffer))) {
+      ++result;
+      SerializeEntry(db_index, it->first, it->second, nullopt, serializer_.get());
+    }
     ++it;
   }
   serialize_bucket_running_ = false;
@@ -283,6 +414,12 @@ void SliceSnapshot::SerializeEntry(DbIndex db_indx, const PrimeKey& pk, const Pr
 }
 
 bool SliceSnapshot::PushSerializedToChannel(bool force) {
+  // The chunks precede the serialized buffer in the stream.
+  for (DbRecord& rec : pending_chunks_)
+    dest_->Push(std::move(rec));
+  pending_chunks_.clear();
+  pending_chunks_bytes_ = 0;
+
   if (!force && serializer_->SerializedLen() < 4096)
     return false;
 
@@ -292,6 +429,7 @@ bool SliceSnapshot::PushSerializedToChannel(bool force) {
   size_t serialized = sfile.val.size();
   if (serialized == 0)
     return 0;
+  stats_.pushed_bytes += serialized;
 
   auto id = rec_id_++;
   DVLOG(2) << "Pushed " << id;
@@ -303,19 +441,35 @@ bool SliceSnapshot::PushSerializedToChannel(bool force) {
   return true;
 }
 
+void SliceSnapshot::FlushValueChunk() {
+  io::StringFile sfile;
+  serializer_->FlushToSink(&sfile, SerializerBase::FlushState::kFlushMidEntry);
+  if (sfile.val.empty())
+    return;
+
+  ++stats_.value_chunks;
+  stats_.pushed_bytes += sfile.val.size();
+  pending_chunks_bytes_ += sfile.val.size();
+  pending_chunks_.push_back(DbRecord{.id = rec_id_++, .value = std::move(sfile.val)});
+}
+
 void SliceSnapshot::OnDbChange(DbIndex db_index, const DbSlice::ChangeReq& req) {
+  if (!filter_.MatchDb(db_index))
+    return;
+
   FiberAtomicGuard fg;
   PrimeTable* table = db_slice_->GetTables(db_index).first;
 
   if (const PrimeTable::bucket_iterator* bit = req.update()) {
-    if (bit->GetVersion() < snapshot_version_) {
+    if (bit->GetVersion() < snapshot_version_ && !IsUnchanged(bit->GetVersion())) {
       stats_.side_saved += SerializeBucket(db_index, *bit);
     }
   } else {
     string_view key = get<string_view>(req.change);
     table->CVCUponInsert(snapshot_version_, key, [this, db_index](PrimeTable::bucket_iterator it) {
       DCHECK_LT(it.GetVersion(), snapshot_version_);
-      stats_.side_saved += SerializeBucket(db_index, it);
+      if (!IsUnchanged(it.GetVersion()))
+        stats_.side_saved += SerializeBucket(db_index, it);
     });
   }
 }
@@ -327,9 +481,10 @@ void SliceSnapshot::OnDbChange(DbIndex db_index, const DbSlice::ChangeReq& req)
 // OnJournalEntry registers for changes in journal, the journal change function signature is
 // (const journal::Entry& entry, bool await) In snapshot flow we dont use the await argument.
 void SliceSnapshot::OnJournalEntry(const journal::JournalItem& item, bool unused_await_arg) {
-  // We ignore EXEC and NOOP entries because we they have no meaning during
+  // We ignore EXEC, NOOP and PING entries because we they have no meaning during
   // the LOAD phase on replica.
-  if (item.opcode == journal::Op::NOOP || item.opcode == journal::Op::EXEC)
+  if (item.opcode == journal::Op::NOOP || item.opcode == journal::Op::EXEC ||
+      item.opcode == journal::Op::PING || !filter_.Match(item))
     return;
 
   serializer_->WriteJournalEntry(item.data);
@@ -353,7 +508,7 @@ size_t SliceSnapshot::GetTotalBufferCapacity() const {
     return 0;
   }
 
-  return serializer_->GetTotalBufferCapacity();
+  return serializer_->GetTotalBufferCapacity() + pending_chunks_bytes_;
 }
 
 size_t SliceSnapshot::GetTotalChannelCapacity() const {
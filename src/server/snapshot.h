@@ -11,7 +11,9 @@
 #include "core/size_tracking_channel.h"
 #include "io/file.h"
 #include "server/db_slice.h"
+#include "server/journal/types.h"
 #include "server/rdb_save.h"
+#include "server/snapshot_pacer.h"
 #include "server/table.h"
 
 namespace dfly {
@@ -57,14 +59,22 @@ class SliceSnapshot {
 
   using RecordChannel = SizeTrackingChannel<DbRecord, base::mpmc_bounded_queue<DbRecord>>;
 
-  SliceSnapshot(DbSlice* slice, RecordChannel* dest, CompressionMode compression_mode);
+  // ordered is true when the records are written in order, which allows flushing big values in
+  // several records and compressing with a dictionary, see serialization_max_chunk_size and
+  // compression_dict_size.
+  SliceSnapshot(DbSlice* slice, RecordChannel* dest, CompressionMode compression_mode,
+                bool ordered = false);
   ~SliceSnapshot();
 
   static size_t GetThreadLocalMemoryUsage();
 
   // Initialize snapshot, start bucket iteration fiber, register listeners.
   // In journal streaming mode it needs to be stopped by either Stop or Cancel.
-  void Start(bool stream_journal, const Cancellation* cll);
+  // save_base is set by the saves that track changes for delta snapshots, see
+  // DbSlice::StartSave. If it is not 0, the snapshot is a delta of the save at that version:
+  // it writes the keys deleted since then and only the buckets with greater versions.
+  void Start(bool stream_journal, const Cancellation* cll,
+             std::optional<uint64_t> save_base = std::nullopt);
 
   // Initialize a snapshot that sends only the missing journal updates
   // since start_lsn and then registers a callback switches into the
@@ -79,6 +89,27 @@ class SliceSnapshot {
   // Wait for iteration fiber to stop.
   void Join();
 
+  // Serialize at full speed from now on, see SnapshotPacer::Boost.
+  void BoostPacing();
+
+  // Records the location of the external values instead of their contents if the tiered
+  // storage is persistent, see RdbSerializer::SaveTieredRefs. Must be called before Start.
+  void SaveTieredRefs() {
+    tiered_refs_ = true;
+  }
+
+  // Saves the listpacks as they are in memory, see RdbSerializer::SaveNativeEncodings. Must be
+  // called before Start.
+  void SaveNativeEncodings() {
+    native_encodings_ = true;
+  }
+
+  // Serializes only the keys and the journal entries that match the filter, for the replicas
+  // that need a part of the data. Must be called before Start.
+  void SetFilter(journal::Filter filter) {
+    filter_ = std::move(filter);
+  }
+
   // Force stop. Needs to be called together with cancelling the context.
   // Snapshot can't always react to cancellation in streaming mode because the
   // iteration fiber might have finished running by then.
@@ -92,6 +123,20 @@ class SliceSnapshot {
   // Called on traversing cursor by IterateBucketsFb.
   bool BucketSaveCb(PrimeIterator it);
 
+  // Yields the thread when the pacer says so, sleeping to keep the throughput limit.
+  void PacedYield();
+
+  // Whether the bucket is unchanged since the base of a delta snapshot.
+  bool IsUnchanged(uint64_t bucket_version) const {
+    return bucket_version <= base_version_;
+  }
+
+  // Writes the tombstones of a delta snapshot.
+  void SerializeDeletedKeys(const DbSlice::DeletedKeys& deleted_keys);
+
+  // Trains a compression dictionary from a sample of the entries and writes it to the stream.
+  void SaveCompressionDict(size_t dict_size);
+
   // Serialize single bucket.
   // Returns number of serialized entries, updates bucket version to snapshot version.
   unsigned SerializeBucket(DbIndex db_index, PrimeTable::bucket_iterator bucket_it);
@@ -114,6 +159,10 @@ class SliceSnapshot {
   // Return if pushed.
   bool PushSerializedToChannel(bool force);
 
+  // Flushes a chunk of a big value while the bucket is serialized. The bucket must be
+  // serialized without preempting, so the chunk is pushed by the next PushSerializedToChannel.
+  void FlushValueChunk();
+
  public:
   uint64_t snapshot_version() const {
     return snapshot_version_;
@@ -136,6 +185,12 @@ class SliceSnapshot {
   DbIndex current_db_;
 
   std::unique_ptr<RdbSerializer> serializer_;
+  bool ordered_;
+  bool tiered_refs_ = false;
+  bool native_encodings_ = false;
+  journal::Filter filter_;
+  std::vector<DbRecord> pending_chunks_;  // flushed by FlushValueChunk, not pushed yet.
+  size_t pending_chunks_bytes_ = 0;
 
   // Used for sanity checks.
   bool serialize_bucket_running_ = false;
@@ -143,15 +198,21 @@ class SliceSnapshot {
 
   CompressionMode compression_mode_;
   RdbTypeFreqMap type_freq_map_;
+  std::optional<SnapshotPacer> pacer_;  // set with --snapshot_pacing.
 
   // version upper bound for entries that should be saved (not included).
   uint64_t snapshot_version_ = 0;
+
+  // Buckets with versions up to base_version_ are not saved by delta snapshots.
+  uint64_t base_version_ = 0;
   uint32_t journal_cb_id_ = 0;
   uint64_t rec_id_ = 0;
 
   struct Stats {
     size_t loop_serialized = 0, skipped = 0, side_saved = 0;
     size_t savecb_calls = 0;
+    size_t pushed_bytes = 0, paced_bytes = 0;
+    size_t value_chunks = 0;
   } stats_;
 };
 
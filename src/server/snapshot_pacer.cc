@@ -0,0 +1,49 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/snapshot_pacer.h"
+
+#include <algorithm>
+
+namespace dfly {
+
+using namespace std;
+
+SnapshotPacer::SnapshotPacer(const Options& opts, uint64_t now_ns)
+    : opts_(opts), slice_ns_(opts.min_slice_ns), slice_start_ns_(now_ns) {
+}
+
+uint64_t SnapshotPacer::OnYield(uint64_t now_ns, size_t bytes) {
+  yield_ns_ = now_ns;
+  sleep_ns_ = 0;
+  if (boosted_ || opts_.max_bytes_per_sec == 0)
+    return 0;
+
+  // Idle time is not credited, so the limit also holds for the bursts after it.
+  throttle_until_ns_ =
+      max(throttle_until_ns_, now_ns) + bytes * 1'000'000'000 / opts_.max_bytes_per_sec;
+  sleep_ns_ = throttle_until_ns_ > now_ns ? throttle_until_ns_ - now_ns : 0;
+  return sleep_ns_;
+}
+
+void SnapshotPacer::OnResume(uint64_t now_ns) {
+  slice_start_ns_ = now_ns;
+  if (boosted_)
+    return;
+
+  uint64_t waited = now_ns > yield_ns_ ? now_ns - yield_ns_ : 0;
+  uint64_t delay = waited > sleep_ns_ ? waited - sleep_ns_ : 0;
+  if (delay > kIdleDelayNs) {
+    slice_ns_ = max(opts_.min_slice_ns, slice_ns_ / 2);
+  } else {
+    slice_ns_ = min(opts_.max_slice_ns, slice_ns_ + slice_ns_ / 4 + 1);
+  }
+}
+
+void SnapshotPacer::Boost() {
+  boosted_ = true;
+  slice_ns_ = opts_.max_slice_ns;
+}
+
+}  // namespace dfly
@@ -0,0 +1,65 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace dfly {
+
+// SnapshotPacer decides when the serialization fiber of a snapshot yields the shard thread and
+// for how long, so that commands do not wait behind long runs of serialization.
+//
+// Notes:
+// - The fiber serializes for a time slice and yields. The time it takes to run again, beyond
+//   its sleep, is the delay of the work that was queued on the thread meanwhile. A delay means
+//   that the slice delayed that work too: the slice halves. A yield that returns at once means the
+//   thread is idle: the slice grows by a quarter, up to max_slice_ns.
+// - max_bytes_per_sec limits the throughput with a leaky bucket: the fiber sleeps until the
+//   bytes serialized so far are within the limit.
+// - Once boosted, the slices are the longest and the throughput is not limited. This is used
+//   when a save gets close to its deadline.
+class SnapshotPacer {
+ public:
+  struct Options {
+    uint64_t min_slice_ns = 50'000;
+    uint64_t max_slice_ns = 1'000'000;
+    uint64_t max_bytes_per_sec = 0;  // 0 means unlimited.
+  };
+
+  SnapshotPacer(const Options& opts, uint64_t now_ns);
+
+  // Whether the fiber used up its slice and should yield.
+  bool ShouldYield(uint64_t now_ns) const {
+    return now_ns >= slice_start_ns_ + slice_ns_;
+  }
+
+  // Called when the fiber yields, bytes is the size serialized since the previous call.
+  // Returns how long the fiber should sleep, 0 if it should only yield.
+  uint64_t OnYield(uint64_t now_ns, size_t bytes);
+
+  // Called when the fiber runs again after OnYield, starts the next slice.
+  void OnResume(uint64_t now_ns);
+
+  void Boost();
+
+  uint64_t slice_ns() const {
+    return slice_ns_;
+  }
+
+ private:
+  // A yield that returns sooner found no other work to run.
+  static constexpr uint64_t kIdleDelayNs = 20'000;
+
+  Options opts_;
+  uint64_t slice_ns_;
+  uint64_t slice_start_ns_;
+  uint64_t yield_ns_ = 0;
+  uint64_t sleep_ns_ = 0;
+  uint64_t throttle_until_ns_ = 0;  // when the bytes serialized so far are within the limit.
+  bool boosted_ = false;
+};
+
+}  // namespace dfly
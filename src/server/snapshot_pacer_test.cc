@@ -0,0 +1,67 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/snapshot_pacer.h"
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+class SnapshotPacerTest : public ::testing::Test {
+ protected:
+  // Serializes until the pacer yields, then resumes after the yield took wait_ns.
+  uint64_t RunSlice(SnapshotPacer* pacer, uint64_t wait_ns, size_t bytes = 0) {
+    now_ += pacer->slice_ns();
+    EXPECT_TRUE(pacer->ShouldYield(now_));
+    uint64_t sleep_ns = pacer->OnYield(now_, bytes);
+    now_ += sleep_ns + wait_ns;
+    pacer->OnResume(now_);
+    return sleep_ns;
+  }
+
+  uint64_t now_ = 1'000'000'000;
+};
+
+TEST_F(SnapshotPacerTest, AdaptsSlice) {
+  SnapshotPacer pacer{{.min_slice_ns = 50'000, .max_slice_ns = 1'000'000}, now_};
+  EXPECT_EQ(pacer.slice_ns(), 50'000u);
+  EXPECT_FALSE(pacer.ShouldYield(now_ + 49'999));
+
+  // An idle thread lets the slices grow to the maximum.
+  for (unsigned i = 0; i < 20; ++i)
+    RunSlice(&pacer, 0);
+  EXPECT_EQ(pacer.slice_ns(), 1'000'000u);
+
+  // Work that waited behind the slices shrinks them.
+  RunSlice(&pacer, 200'000);
+  EXPECT_EQ(pacer.slice_ns(), 500'000u);
+  for (unsigned i = 0; i < 10; ++i)
+    RunSlice(&pacer, 200'000);
+  EXPECT_EQ(pacer.slice_ns(), 50'000u);
+}
+
+TEST_F(SnapshotPacerTest, LimitsThroughput) {
+  SnapshotPacer pacer{{.max_bytes_per_sec = 1'000'000}, now_};
+
+  // 1000 bytes take 1ms at 1MB/s, the time of the slice counts.
+  EXPECT_EQ(RunSlice(&pacer, 0, 1000), 1'000'000u);
+
+  // The sleep is not a delay of other work, the slice still grows.
+  EXPECT_GT(pacer.slice_ns(), 50'000u);
+
+  // Idle time is not credited to the next bursts.
+  now_ += 10'000'000;
+  pacer.OnResume(now_);
+  EXPECT_EQ(RunSlice(&pacer, 0, 2000), 2'000'000u);
+
+  pacer.Boost();
+  EXPECT_EQ(pacer.slice_ns(), 1'000'000u);
+  EXPECT_EQ(RunSlice(&pacer, 200'000, 2000), 0u);
+  EXPECT_EQ(pacer.slice_ns(), 1'000'000u);
+}
+
+}  // namespace dfly
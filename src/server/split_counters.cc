@@ -0,0 +1,99 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/split_counters.h"
+
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+optional<int64_t> SplitCounters::Add(DbIndex db, string_view key, int64_t delta) {
+  if (db >= dbs_.size())
+    return nullopt;
+
+  auto it = dbs_[db].find(key);
+  if (it == dbs_[db].end())
+    return nullopt;
+
+  Cell& cell = it->second;
+  int64_t pending, estimate;
+  if (__builtin_add_overflow(cell.pending, delta, &pending) ||
+      __builtin_add_overflow(cell.base, pending, &estimate)) {
+    return nullopt;
+  }
+
+  cell.pending = pending;
+  return estimate;
+}
+
+void SplitCounters::Open(DbIndex db, string_view key, int64_t value) {
+  if (db >= dbs_.size())
+    dbs_.resize(db + 1);
+
+  // Another fiber of the thread could have opened the cell meanwhile, keep its increments.
+  auto [it, inserted] = dbs_[db].try_emplace(key);
+  it->second.base = value;
+  size_ += inserted;
+}
+
+int64_t SplitCounters::Take(DbIndex db, string_view key) {
+  if (db >= dbs_.size())
+    return 0;
+
+  auto it = dbs_[db].find(key);
+  if (it == dbs_[db].end())
+    return 0;
+
+  int64_t pending = it->second.pending;
+  dbs_[db].erase(it);
+  size_--;
+  return pending;
+}
+
+void SplitCounters::StartFlusher(chrono::milliseconds interval, FoldCb cb) {
+  fold_cb_ = std::move(cb);
+  flusher_ = util::fb2::Fiber("split_counters", [this, interval] {
+    while (!flusher_done_.WaitFor(interval)) {
+      FoldAll();
+    }
+    FoldAll();
+  });
+}
+
+void SplitCounters::StopFlusher() {
+  flusher_done_.Notify();
+  if (flusher_.IsJoinable())
+    flusher_.Join();
+}
+
+void SplitCounters::FoldAll() {
+  if (size_ == 0)
+    return;
+
+  // Folding suspends, so the cells are taken one at a time right before their fold is scheduled.
+  // This way a concurrent GET either takes the cell itself or is ordered after its fold.
+  for (DbIndex db = 0; db < dbs_.size(); ++db) {
+    vector<string> keys;
+    for (auto it = dbs_[db].begin(); it != dbs_[db].end();) {
+      if (it->second.pending == 0) {
+        dbs_[db].erase(it++);
+        size_--;
+      } else {
+        keys.push_back(it->first);
+        ++it;
+      }
+    }
+
+    for (const string& key : keys) {
+      if (int64_t delta = Take(db, key); delta != 0) {
+        DVLOG(2) << "Folding split counter " << key << " " << delta;
+        fold_cb_(db, key, delta);
+      }
+    }
+  }
+}
+
+}  // namespace dfly
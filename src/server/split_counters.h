@@ -0,0 +1,77 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/container/flat_hash_map.h>
+
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "server/common.h"
+#include "util/fibers/fibers.h"
+#include "util/fibers/synchronization.h"
+
+namespace dfly {
+
+// Thread local cells of split counters, the integer keys that start with --split_counter_prefix.
+//
+// An increment of a split counter hops to the shard of the key only if the thread has no cell for
+// it, the cell is opened with the value returned by that hop. Further increments on the thread
+// are added to the cell and reply with that value plus the increments pending in the cell, so
+// they are not serialized on the shard thread of the key.
+//
+// A fiber on every thread folds the pending increments into their keys periodically and closes
+// the cells, so each thread reads the key again on its next increment. GET folds the cells of the
+// key on all threads before reading it.
+class SplitCounters {
+ public:
+  // Applies the pending delta of the key on its shard.
+  using FoldCb = std::function<void(DbIndex db, std::string_view key, int64_t delta)>;
+
+  // Adds delta to the cell of the key. Returns the estimated value of the key, or nullopt if the
+  // thread has no cell for the key or the estimate would overflow.
+  std::optional<int64_t> Add(DbIndex db, std::string_view key, int64_t delta);
+
+  // Opens the cell of the key after an increment on its shard returned value.
+  void Open(DbIndex db, std::string_view key, int64_t value);
+
+  // Closes the cell of the key and returns its pending delta.
+  int64_t Take(DbIndex db, std::string_view key);
+
+  bool Empty() const {
+    return size_ == 0;
+  }
+
+  size_t Size() const {
+    return size_;
+  }
+
+  // Folds all the cells every interval with cb.
+  void StartFlusher(std::chrono::milliseconds interval, FoldCb cb);
+
+  // Stops the flusher after folding the remaining cells.
+  void StopFlusher();
+
+ private:
+  struct Cell {
+    int64_t base = 0;     // the value of the key when the cell was opened
+    int64_t pending = 0;  // increments not yet folded into the key
+  };
+
+  void FoldAll();
+
+  std::vector<absl::flat_hash_map<std::string, Cell>> dbs_;
+  size_t size_ = 0;
+
+  FoldCb fold_cb_;
+  util::fb2::Fiber flusher_;
+  util::fb2::Done flusher_done_;
+};
+
+}  // namespace dfly
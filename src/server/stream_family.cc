@@ -4,10 +4,12 @@
 
 #include "server/stream_family.h"
 
+#include <absl/container/flat_hash_map.h>
 #include <absl/strings/str_cat.h>
 
 extern "C" {
 #include "redis/object.h"
+#include "redis/redis_aux.h"
 #include "redis/stream.h"
 #include "redis/zmalloc.h"
 }
@@ -29,9 +31,36 @@ using namespace std;
 
 namespace {
 
+// An entry read from a stream. Its fields and values are kept back to back in a single buffer,
+// since entries are read mostly to be sent in a reply and allocating a pair of strings per
+// field dominated the cost of XRANGE and XREAD.
 struct Record {
   streamID id;
-  vector<pair<string, string>> kv_arr;
+  string data;
+  vector<uint32_t> sizes;  // Interleaved lengths of the fields and the values.
+
+  void Add(string_view field, string_view value) {
+    data.append(field);
+    data.append(value);
+    sizes.push_back(field.size());
+    sizes.push_back(value.size());
+  }
+
+  size_t NumFields() const {
+    return sizes.size() / 2;
+  }
+
+  // Calls cb(field, value) for every field of the entry.
+  template <typename F> void ForEachField(F&& cb) const {
+    const char* next = data.data();
+    for (size_t i = 0; i < sizes.size(); i += 2) {
+      string_view field{next, sizes[i]};
+      next += sizes[i];
+      string_view value{next, sizes[i + 1]};
+      next += sizes[i + 1];
+      cb(field, value);
+    }
+  }
 };
 
 using RecordVec = vector<Record>;
@@ -570,11 +599,12 @@ int StreamAppendItem(stream* s, CmdArgList fields, streamID* added_id, streamID*
 /* Create a NACK entry setting the delivery count to 1 and the delivery
  * time to the current time or test-hooked time. The NACK consumer will be
  * set to the one specified as argument of the function. */
-streamNACK* StreamCreateNACK(streamConsumer* consumer) {
-  streamNACK* nack = reinterpret_cast<streamNACK*>(zmalloc(sizeof(*nack)));
-  nack->delivery_time = GetCurrentTimeMs();
-  nack->delivery_count = 1;
-  nack->consumer = consumer;
+streamPendingEntry StreamCreateNACK(const streamID& id, streamConsumer* consumer) {
+  streamPendingEntry nack;
+  nack.id = id;
+  nack.delivery_time = GetCurrentTimeMs();
+  nack.delivery_count = 1;
+  nack.consumer = consumer;
   return nack;
 }
 
@@ -604,6 +634,32 @@ int StreamTrim(const AddTrimOpts& opts, stream* s) {
   return 0;
 }
 
+// Number of entries of a full stream node.
+uint64_t NodeMaxEntries() {
+  return server.stream_node_max_entries > 0 ? server.stream_node_max_entries : 100;
+}
+
+// Approximate trimming removes whole nodes only. XADD runs it once a full node is over the
+// MAXLEN threshold, or once per node of added entries for MINID, and the background trimming
+// of DbSlice::TrimStreamsStep handles the streams in between.
+bool ApproxTrimDue(const AddTrimOpts& opts, const stream* s) {
+  if (opts.trim_strategy == TrimStrategy::kMaxLen)
+    return s->length >= opts.max_len + NodeMaxEntries();
+
+  streamID first_id = s->first_id, minid = opts.minid.val;
+  return s->length > 0 && streamCompareID(&first_id, &minid) < 0 &&
+         s->entries_added % NodeMaxEntries() == 0;
+}
+
+DbTable::StreamRetention MakeRetention(const AddTrimOpts& opts) {
+  DbTable::StreamRetention res;
+  res.by_id = opts.trim_strategy == TrimStrategy::kMinId;
+  res.max_len = opts.max_len;
+  res.min_ms = opts.minid.val.ms;
+  res.min_seq = opts.minid.val.seq;
+  return res;
+}
+
 OpResult<streamID> OpAdd(const OpArgs& op_args, const AddTrimOpts& opts, CmdArgList args) {
   DCHECK(!args.empty() && args.size() % 2 == 0);
   auto& db_slice = op_args.shard->db_slice();
@@ -649,7 +705,14 @@ OpResult<streamID> OpAdd(const OpArgs& op_args, const AddTrimOpts& opts, CmdArgL
     return OpStatus::OUT_OF_MEMORY;
   }
 
-  StreamTrim(opts, stream_inst);
+  DbIndex db_index = op_args.db_cntx.db_index;
+  if (!opts.trim_approx) {
+    StreamTrim(opts, stream_inst);
+    db_slice.UntrackStreamRetention(db_index, opts.key);
+  } else if (ApproxTrimDue(opts, stream_inst)) {
+    StreamTrim(opts, stream_inst);
+    db_slice.TrackStreamRetention(db_index, opts.key, MakeRetention(opts));
+  }
 
   EngineShard* es = op_args.shard;
   if (es->blocking_controller()) {
@@ -659,6 +722,32 @@ OpResult<streamID> OpAdd(const OpArgs& op_args, const AddTrimOpts& opts, CmdArgL
   return result_id;
 }
 
+// Reads the fields of the entry the iterator is positioned at.
+Record ReadRecord(streamIterator* si, const streamID& id, int64_t numfields) {
+  Record rec;
+  rec.id = id;
+  rec.sizes.reserve(numfields * 2);
+
+  while (numfields--) {
+    unsigned char *key, *value;
+    int64_t key_len, value_len;
+    streamIteratorGetField(si, &key, &value, &key_len, &value_len);
+    rec.Add({reinterpret_cast<char*>(key), size_t(key_len)},
+            {reinterpret_cast<char*>(value), size_t(value_len)});
+  }
+  return rec;
+}
+
+void SendRecord(const Record& rec, RedisReplyBuilder* rb) {
+  rb->StartArray(2);
+  rb->SendBulkString(StreamIdRepr(rec.id));
+  rb->StartArray(rec.NumFields() * 2);
+  rec.ForEachField([rb](string_view field, string_view value) {
+    rb->SendBulkString(field);
+    rb->SendBulkString(value);
+  });
+}
+
 OpResult<RecordVec> OpRange(const OpArgs& op_args, string_view key, const RangeOpts& opts) {
   auto& db_slice = op_args.shard->db_slice();
   OpResult<PrimeConstIterator> res_it = db_slice.FindReadOnly(op_args.db_cntx, key, OBJ_STREAM);
@@ -677,11 +766,9 @@ OpResult<RecordVec> OpRange(const OpArgs& op_args, string_view key, const RangeO
   stream* s = (stream*)cobj.RObjPtr();
   streamID sstart = opts.start.val, send = opts.end.val;
 
+  result.reserve(min<uint64_t>(opts.count, s->length));
   streamIteratorStart(&si, s, &sstart, &send, opts.is_rev);
   while (streamIteratorGetID(&si, &id, &numfields)) {
-    Record rec;
-    rec.id = id;
-    rec.kv_arr.reserve(numfields);
     if (opts.group && streamCompareID(&id, &opts.group->last_id) > 0) {
       if (opts.group->entries_read != SCG_INVALID_ENTRIES_READ &&
           !streamRangeHasTombstones(s, &id, NULL)) {
@@ -696,47 +783,16 @@ OpResult<RecordVec> OpRange(const OpArgs& op_args, string_view key, const RangeO
       opts.group->last_id = id;
     }
 
-    /* Emit the field-value pairs. */
-    while (numfields--) {
-      unsigned char *key, *value;
-      int64_t key_len, value_len;
-      streamIteratorGetField(&si, &key, &value, &key_len, &value_len);
-      string skey(reinterpret_cast<char*>(key), key_len);
-      string sval(reinterpret_cast<char*>(value), value_len);
-
-      rec.kv_arr.emplace_back(std::move(skey), std::move(sval));
-    }
-
-    result.push_back(std::move(rec));
+    result.push_back(ReadRecord(&si, id, numfields));
 
     if (opts.group && !opts.noack) {
-      unsigned char buf[sizeof(streamID)];
-      StreamEncodeID(buf, &id);
-
       /* Try to add a new NACK. Most of the time this will work and
-       * will not require extra lookups. We'll fix the problem later
-       * if we find that there is already an entry for this ID. */
-      streamNACK* nack = StreamCreateNACK(opts.consumer);
-      int group_inserted = raxTryInsert(opts.group->pel, buf, sizeof(buf), nack, nullptr);
-      int consumer_inserted = raxTryInsert(opts.consumer->pel, buf, sizeof(buf), nack, nullptr);
-
-      /* Now we can check if the entry was already busy, and
-       * in that case reassign the entry to the new consumer,
-       * or update it if the consumer is the same as before. */
-      if (group_inserted == 0) {
-        streamFreeNACK(nack);
-        nack = static_cast<streamNACK*>(raxFind(opts.group->pel, buf, sizeof(buf)));
-        DCHECK(nack != raxNotFound);
-        raxRemove(nack->consumer->pel, buf, sizeof(buf), NULL);
-        /* Update the consumer and NACK metadata. */
-        nack->consumer = opts.consumer;
-        nack->delivery_time = GetCurrentTimeMs();
-        nack->delivery_count = 1;
-        /* Add the entry in the new consumer local PEL. */
-        raxInsert(opts.consumer->pel, buf, sizeof(buf), nack, NULL);
-      } else if (group_inserted == 1 && consumer_inserted == 0) {
-        return OpStatus::SKIPPED;  // ("NACK half-created. Should not be possible.");
-      }
+       * is an append to the last block of the PEL. If there is already
+       * an entry for this ID, reassign it to the new consumer, or update
+       * it if the consumer is the same as before. */
+      streamPendingEntry nack = StreamCreateNACK(id, opts.consumer);
+      if (!streamPELInsert(opts.group->pel, &nack))
+        streamPELUpdate(opts.group->pel, &nack);
     }
     if (opts.count == result.size())
       break;
@@ -754,24 +810,19 @@ OpResult<RecordVec> OpRangeFromConsumerPEL(const OpArgs& op_args, string_view ke
   if (opts.count == 0)
     return result;
 
-  unsigned char start_key[sizeof(streamID)];
-  unsigned char end_key[sizeof(streamID)];
   auto sstart = opts.start.val;
   auto send = opts.end.val;
 
-  StreamEncodeID(start_key, &sstart);
-  StreamEncodeID(end_key, &send);
-  raxIterator ri;
-
-  raxStart(&ri, opts.consumer->pel);
-  raxSeek(&ri, ">=", start_key, sizeof(start_key));
+  // Scans the consumer entries of the group PEL, the updates below make the iterator seek again.
+  streamPELIterator it;
+  streamPendingEntry nack;
+  streamPELIteratorStart(&it, opts.group->pel, &sstart, opts.consumer);
   size_t ecount = 0;
-  while (raxNext(&ri) && (!opts.count || ecount < opts.count)) {
-    if (memcmp(ri.key, &send, ri.key_len) > 0)
+  while ((!opts.count || ecount < opts.count) && streamPELNext(&it, &nack)) {
+    if (streamCompareID(&nack.id, &send) > 0)
       break;
-    streamID id;
+    streamID id = nack.id;
 
-    streamDecodeID(ri.key, &id);
     RangeOpts ropts;
     ropts.start.val = id;
     ropts.end.val = id;
@@ -779,14 +830,13 @@ OpResult<RecordVec> OpRangeFromConsumerPEL(const OpArgs& op_args, string_view ke
     if (!op_result || !op_result.value().size()) {
       result.push_back(Record{id, vector<pair<string, string>>()});
     } else {
-      streamNACK* nack = static_cast<streamNACK*>(ri.data);
-      nack->delivery_time = GetCurrentTimeMs();
-      nack->delivery_count++;
+      nack.delivery_time = GetCurrentTimeMs();
+      nack.delivery_count++;
+      streamPELUpdate(opts.group->pel, &nack);
       result.push_back(std::move(op_result.value()[0]));
     }
     ecount++;
   }
-  raxStop(&ri);
   return result;
 }
 
@@ -796,6 +846,25 @@ namespace {
 stream* GetReadOnlyStream(const CompactObj& cobj) {
   return const_cast<stream*>((const stream*)cobj.RObjPtr());
 }
+
+// The serialized reply of the last XREAD woken on a stream. An XADD usually wakes many readers
+// blocked on the same stream and id, which would read and serialize the same entries one by one.
+// Valid while the stream does not change.
+struct SharedXReadReply {
+  DbIndex db_index;
+  streamID start;
+  streamID first_id, last_id;
+  uint64_t length, entries_added;
+  shared_ptr<const string> reply;
+};
+
+// Replies by key, kept by every shard thread.
+thread_local absl::flat_hash_map<string, SharedXReadReply> tl_shared_xread_replies;
+
+// Most streams with blocked readers have a single live reply, the stale ones are dropped at once
+// when there are more.
+constexpr size_t kMaxSharedXReadReplies = 64;
+
 }  // namespace
 
 // Returns a map of stream to the ID of the last entry in the stream. Any
@@ -900,7 +969,7 @@ OpResult<vector<GroupInfo>> OpListGroups(const DbContext& db_cntx, string_view k
       GroupInfo ginfo;
       ginfo.name.assign(reinterpret_cast<char*>(ri.key), ri.key_len);
       ginfo.consumer_size = raxSize(cg->consumers);
-      ginfo.pending_size = raxSize(cg->pel);
+      ginfo.pending_size = cg->pel->size;
       ginfo.last_id = cg->last_id;
       ginfo.entries_read = cg->entries_read;
       ginfo.lag = streamCGLag(s, cg);
@@ -922,20 +991,7 @@ vector<Record> GetStreamRecords(stream* s, streamID start, streamID end, bool re
 
   streamIteratorStart(&si, s, &start, &end, reverse);
   while (streamIteratorGetID(&si, &id, &numfields)) {
-    Record rec;
-    rec.id = id;
-    rec.kv_arr.reserve(numfields);
-
-    while (numfields--) {
-      unsigned char *key, *value;
-      int64_t key_len, value_len;
-      streamIteratorGetField(&si, &key, &value, &key_len, &value_len);
-      string skey(reinterpret_cast<char*>(key), key_len);
-      string sval(reinterpret_cast<char*>(value), value_len);
-
-      rec.kv_arr.emplace_back(std::move(skey), std::move(sval));
-    }
-    records.push_back(std::move(rec));
+    records.push_back(ReadRecord(&si, id, numfields));
     arraylen++;
     if (count && count == arraylen)
       break;
@@ -949,24 +1005,20 @@ vector<Record> GetStreamRecords(stream* s, streamID start, streamID end, bool re
 void GetGroupPEL(stream* s, streamCG* cg, long long count, GroupInfo* ginfo) {
   vector<NACKInfo> nack_info_vec;
   long long arraylen_cg_pel = 0;
-  raxIterator ri_cg_pel;
-  raxStart(&ri_cg_pel, cg->pel);
-  raxSeek(&ri_cg_pel, "^", NULL, 0);
-  while (raxNext(&ri_cg_pel) && (!count || arraylen_cg_pel < count)) {
-    streamNACK* nack = static_cast<streamNACK*>(ri_cg_pel.data);
+  streamPELIterator it;
+  streamPendingEntry nack;
+  streamPELIteratorStart(&it, cg->pel, nullptr, nullptr);
+  while ((!count || arraylen_cg_pel < count) && streamPELNext(&it, &nack)) {
     NACKInfo nack_info;
 
-    streamID id;
-    streamDecodeID(ri_cg_pel.key, &id);
-    nack_info.pel_id = id;
-    nack_info.consumer_name = nack->consumer->name;
-    nack_info.delivery_time = nack->delivery_time;
-    nack_info.delivery_count = nack->delivery_count;
+    nack_info.pel_id = nack.id;
+    nack_info.consumer_name = nack.consumer->name;
+    nack_info.delivery_time = nack.delivery_time;
+    nack_info.delivery_count = nack.delivery_count;
 
     nack_info_vec.push_back(nack_info);
     arraylen_cg_pel++;
   }
-  raxStop(&ri_cg_pel);
   ginfo->stream_nack_vec = std::move(nack_info_vec);
 }
 
@@ -981,30 +1033,26 @@ void GetConsumers(stream* s, streamCG* cg, long long count, GroupInfo* ginfo) {
 
     consumer_info.name = consumer->name;
     consumer_info.seen_time = consumer->seen_time;
-    consumer_info.pel_count = raxSize(consumer->pel);
+    consumer_info.pel_count = consumer->pel_count;
 
     /* Consumer PEL */
     long long arraylen_cpel = 0;
-    raxIterator ri_cpel;
-    raxStart(&ri_cpel, consumer->pel);
-    raxSeek(&ri_cpel, "^", NULL, 0);
+    streamPELIterator it;
+    streamPendingEntry nack;
     vector<NACKInfo> consumer_pel_vec;
-    while (raxNext(&ri_cpel) && (!count || arraylen_cpel < count)) {
+    streamPELIteratorStart(&it, cg->pel, nullptr, consumer);
+    while ((!count || arraylen_cpel < count) && streamPELNext(&it, &nack)) {
       NACKInfo nack_info;
-      streamNACK* nack = static_cast<streamNACK*>(ri_cpel.data);
 
-      streamID id;
-      streamDecodeID(ri_cpel.key, &id);
-      nack_info.pel_id = id;
-      nack_info.delivery_time = nack->delivery_time;
-      nack_info.delivery_count = nack->delivery_count;
+      nack_info.pel_id = nack.id;
+      nack_info.delivery_time = nack.delivery_time;
+      nack_info.delivery_count = nack.delivery_count;
 
       consumer_pel_vec.push_back(nack_info);
       arraylen_cpel++;
     }
     consumer_info.pending = consumer_pel_vec;
     consumer_info_vec.push_back(consumer_info);
-    raxStop(&ri_cpel);
   }
   raxStop(&ri_consumers);
   ginfo->consumer_info_vec = std::move(consumer_info_vec);
@@ -1046,10 +1094,10 @@ OpResult<StreamInfo> OpStreams(const DbContext& db_cntx, string_view key, Engine
         ginfo.name.assign(reinterpret_cast<char*>(ri_cgroups.key), ri_cgroups.key_len);
         ginfo.last_id = cg->last_id;
         ginfo.consumer_size = raxSize(cg->consumers);
-        ginfo.pending_size = raxSize(cg->pel);
+        ginfo.pending_size = cg->pel->size;
         ginfo.entries_read = cg->entries_read;
         ginfo.lag = streamCGLag(s, cg);
-        ginfo.pel_count = raxSize(cg->pel);
+        ginfo.pel_count = cg->pel->size;
         GetGroupPEL(s, cg, count, &ginfo);
         GetConsumers(s, cg, count, &ginfo);
 
@@ -1102,7 +1150,7 @@ OpResult<vector<ConsumerInfo>> OpConsumers(const DbContext& db_cntx, EngineShard
       idle = 0;
 
     consumer_info.name = consumer->name;
-    consumer_info.pel_count = raxSize(consumer->pel);
+    consumer_info.pel_count = consumer->pel_count;
     consumer_info.idle = idle;
     result.push_back(std::move(consumer_info));
   }
@@ -1216,21 +1264,7 @@ void AppendClaimResultItem(ClaimInfo& result, stream* s, streamID id) {
   streamID cid;
   streamIteratorStart(&it, s, &id, &id, 0);
   while (streamIteratorGetID(&it, &cid, &numfields)) {
-    Record rec;
-    rec.id = cid;
-    rec.kv_arr.reserve(numfields);
-
-    /* Emit the field-value pairs. */
-    while (numfields--) {
-      unsigned char *key, *value;
-      int64_t key_len, value_len;
-      streamIteratorGetField(&it, &key, &value, &key_len, &value_len);
-      string skey(reinterpret_cast<char*>(key), key_len);
-      string sval(reinterpret_cast<char*>(value), value_len);
-
-      rec.kv_arr.emplace_back(std::move(skey), std::move(sval));
-    }
-    result.records.push_back(std::move(rec));
+    result.records.push_back(ReadRecord(&it, cid, numfields));
   }
   streamIteratorStop(&it);
 }
@@ -1257,33 +1291,29 @@ OpResult<ClaimInfo> OpClaim(const OpArgs& op_args, string_view key, const ClaimO
   }
 
   for (streamID id : ids) {
-    std::array<uint8_t, sizeof(streamID)> buf;
-    StreamEncodeID(buf.begin(), &id);
-
-    streamNACK* nack = (streamNACK*)raxFind(cgr_res->cg->pel, buf.begin(), sizeof(buf));
+    streamPendingEntry nack;
+    bool found = streamPELFind(cgr_res->cg->pel, &id, &nack);
     if (!streamEntryExists(cgr_res->s, &id)) {
-      if (nack != raxNotFound) {
+      if (found) {
         /* Release the NACK */
-        raxRemove(cgr_res->cg->pel, buf.begin(), sizeof(buf), nullptr);
-        raxRemove(nack->consumer->pel, buf.begin(), sizeof(buf), nullptr);
-        streamFreeNACK(nack);
+        streamPELDelete(cgr_res->cg->pel, &id);
       }
       continue;
     }
 
     // We didn't find a nack but the FORCE option is given.
-    // Create the NACK forcefully.
-    if ((opts.flags & kClaimForce) && nack == raxNotFound) {
-      /* Create the NACK. */
-      nack = streamCreateNACK(nullptr);
-      raxInsert(cgr_res->cg->pel, buf.begin(), sizeof(buf), nack, nullptr);
+    // Create the NACK forcefully, it is inserted with its consumer below.
+    bool created = false;
+    if ((opts.flags & kClaimForce) && !found) {
+      nack = StreamCreateNACK(id, nullptr);
+      found = created = true;
     }
 
     // We found the nack, continue.
-    if (nack != raxNotFound) {
+    if (found) {
       // First check if the entry id exceeds the `min_idle_time`.
-      if (nack->consumer && opts.min_idle_time) {
-        mstime_t this_idle = now - nack->delivery_time;
+      if (nack.consumer && opts.min_idle_time) {
+        mstime_t this_idle = now - nack.delivery_time;
         if (this_idle < opts.min_idle_time) {
           continue;
         }
@@ -1298,31 +1328,23 @@ OpResult<ClaimInfo> OpClaim(const OpArgs& op_args, string_view key, const ClaimO
                                         SCC_NO_NOTIFY | SCC_NO_DIRTIFY);
       }
 
-      // If the entry belongs to the same consumer, we don't have to
-      // do anything. Else remove the entry from the old consumer.
-      if (nack->consumer != consumer) {
-        /* Remove the entry from the old consumer.
-         * Note that nack->consumer is NULL if we created the
-         * NACK above because of the FORCE option. */
-        if (nack->consumer) {
-          raxRemove(nack->consumer->pel, buf.begin(), sizeof(buf), nullptr);
-        }
-      }
       // Set the delivery time for the entry.
-      nack->delivery_time = opts.delivery_time;
+      nack.delivery_time = opts.delivery_time;
       /* Set the delivery attempts counter if given, otherwise
        * autoincrement unless JUSTID option provided */
       if (opts.retry >= 0) {
-        nack->delivery_count = opts.retry;
+        nack.delivery_count = opts.retry;
       } else if (!(opts.flags & kClaimJustID)) {
-        nack->delivery_count++;
-      }
-      if (nack->consumer != consumer) {
-        /* Add the entry in the new consumer local PEL. */
-        raxInsert(consumer->pel, buf.begin(), sizeof(buf), nack, nullptr);
-        nack->consumer = consumer;
+        nack.delivery_count++;
       }
 
+      /* Assign the entry to the consumer. */
+      nack.consumer = consumer;
+      if (created)
+        streamPELInsert(cgr_res->cg->pel, &nack);
+      else
+        streamPELUpdate(cgr_res->cg->pel, &nack);
+
       /* Send the reply for this entry. */
       AppendClaimResultItem(result, cgr_res->s, id);
     }
@@ -1421,7 +1443,7 @@ OpResult<uint32_t> OpDelConsumer(const OpArgs& op_args, string_view key, string_
   shard->tmp_str1 = sdscpylen(shard->tmp_str1, consumer_name.data(), consumer_name.size());
   streamConsumer* consumer = streamLookupConsumer(cg, shard->tmp_str1, SLC_NO_REFRESH);
   if (consumer) {
-    pending = raxSize(consumer->pel);
+    pending = consumer->pel_count;
     streamDelConsumer(cg, consumer);
   }
 
@@ -1548,20 +1570,9 @@ OpResult<uint32_t> OpAck(const OpArgs& op_args, string_view key, string_view gna
 
   int acknowledged = 0;
   for (auto& id : ids) {
-    unsigned char buf[sizeof(streamID)];
-    streamEncodeID(buf, &id);
-
-    // From Redis' xackCommand's implemenation
-    // Lookup the ID in the group PEL: it will have a reference to the
-    // NACK structure that will have a reference to the consumer, so that
-    // we are able to remove the entry from both PELs.
-    streamNACK* nack = (streamNACK*)raxFind(res->cg->pel, buf, sizeof(buf));
-    if (nack != raxNotFound) {
-      raxRemove(res->cg->pel, buf, sizeof(buf), nullptr);
-      raxRemove(nack->consumer->pel, buf, sizeof(buf), nullptr);
-      streamFreeNACK(nack);
+    // The group PEL also counts the entries of every consumer, so a single delete updates both.
+    if (streamPELDelete(res->cg->pel, &id))
       acknowledged++;
-    }
   }
   return acknowledged;
 }
@@ -1584,35 +1595,28 @@ OpResult<ClaimInfo> OpAutoClaim(const OpArgs& op_args, string_view key, const Cl
   // multiplying <count>'s value by 10 (hard-coded).
   int64_t attempts = opts.count * 10;
 
-  unsigned char start_key[sizeof(streamID)];
+  // The iterator seeks again past the last entry it returned after the PEL changes.
   streamID start_id = opts.start;
-  streamEncodeID(start_key, &start_id);
-  raxIterator ri;
-  raxStart(&ri, group->pel);
-  raxSeek(&ri, ">=", start_key, sizeof(start_key));
+  streamPELIterator it;
+  streamPendingEntry nack;
+  streamPELIteratorStart(&it, group->pel, &start_id, nullptr);
 
   ClaimInfo result;
   result.justid = (opts.flags & kClaimJustID);
 
   auto now = GetCurrentTimeMs();
   int count = opts.count;
-  while (attempts-- && count && raxNext(&ri)) {
-    streamNACK* nack = (streamNACK*)ri.data;
-
-    streamID id;
-    streamDecodeID(ri.key, &id);
+  while (attempts-- && count && streamPELNext(&it, &nack)) {
+    streamID id = nack.id;
 
     if (!streamEntryExists(stream, &id)) {
-      raxRemove(group->pel, ri.key, ri.key_len, nullptr);
-      raxRemove(nack->consumer->pel, ri.key, ri.key_len, nullptr);
-      streamFreeNACK(nack);
+      streamPELDelete(group->pel, &id);
       result.deleted_ids.push_back(id);
-      raxSeek(&ri, ">=", ri.key, ri.key_len);
       continue;
     }
 
     if (opts.min_idle_time) {
-      mstime_t this_idle = now - nack->delivery_time;
+      mstime_t this_idle = now - nack.delivery_time;
       if (this_idle < opts.min_idle_time)
         continue;
     }
@@ -1626,34 +1630,23 @@ OpResult<ClaimInfo> OpAutoClaim(const OpArgs& op_args, string_view key, const Cl
       }
     }
 
-    if (nack->consumer != consumer) {
-      if (nack->consumer) {
-        raxRemove(nack->consumer->pel, ri.key, ri.key_len, nullptr);
-      }
-    }
-
-    nack->delivery_time = now;
+    nack.delivery_time = now;
     if (!result.justid) {
-      nack->delivery_count++;
-    }
-
-    if (nack->consumer != consumer) {
-      raxInsert(consumer->pel, ri.key, ri.key_len, nack, nullptr);
-      nack->consumer = consumer;
+      nack.delivery_count++;
     }
+    nack.consumer = consumer;
+    streamPELUpdate(group->pel, &nack);
 
     AppendClaimResultItem(result, stream, id);
     count--;
   }
 
-  raxNext(&ri);
   streamID end_id;
-  if (raxEOF(&ri)) {
-    end_id.ms = end_id.seq = 0;
+  if (streamPELNext(&it, &nack)) {
+    end_id = nack.id;
   } else {
-    streamDecodeID(ri.key, &end_id);
+    end_id.ms = end_id.seq = 0;
   }
-  raxStop(&ri);
   result.end_id = end_id;
 
   return result;
@@ -1687,27 +1680,24 @@ using PendingResult = std::variant<PendingReducedResult, PendingExtendedResultLi
 
 PendingReducedResult GetPendingReducedResult(streamCG* cg) {
   PendingReducedResult result;
-  result.count = raxSize(cg->pel);
+  result.count = cg->pel->size;
   if (!result.count) {
     return result;
   }
 
-  raxIterator ri;
-
-  raxStart(&ri, cg->pel);
-  raxSeek(&ri, "^", nullptr, 0);
-  raxNext(&ri);
-  streamDecodeID(ri.key, &result.start);
-
-  raxSeek(&ri, "$", nullptr, 0);
-  raxNext(&ri);
-  streamDecodeID(ri.key, &result.end);
+  streamPELIterator it;
+  streamPendingEntry nack;
+  streamPELIteratorStart(&it, cg->pel, nullptr, nullptr);
+  streamPELNext(&it, &nack);
+  result.start = nack.id;
+  streamPELLastID(cg->pel, &result.end);
 
+  raxIterator ri;
   raxStart(&ri, cg->consumers);
   raxSeek(&ri, "^", nullptr, 0);
   while (raxNext(&ri)) {
     streamConsumer* consumer = static_cast<streamConsumer*>(ri.data);
-    uint64_t pel_size = raxSize(consumer->pel);
+    uint64_t pel_size = consumer->pel_count;
     if (!pel_size)
       continue;
 
@@ -1723,27 +1713,22 @@ PendingReducedResult GetPendingReducedResult(streamCG* cg) {
 PendingExtendedResultList GetPendingExtendedResult(streamCG* cg, streamConsumer* consumer,
                                                    const PendingOpts& opts) {
   PendingExtendedResultList result;
-  rax* pel = consumer ? consumer->pel : cg->pel;
   streamID sstart = opts.start.val, send = opts.end.val;
   auto now = GetCurrentTimeMs();
-  unsigned char start_key[sizeof(streamID)];
-  unsigned char end_key[sizeof(streamID)];
-  raxIterator ri;
 
-  StreamEncodeID(start_key, &sstart);
-  StreamEncodeID(end_key, &send);
-  raxStart(&ri, pel);
-  raxSeek(&ri, ">=", start_key, sizeof(start_key));
+  // With a consumer, the blocks of the group PEL without its entries are skipped.
+  streamPELIterator it;
+  streamPendingEntry nack;
+  streamPELIteratorStart(&it, cg->pel, &sstart, consumer);
 
   auto count = opts.count;
-  while (count && raxNext(&ri)) {
-    if (memcmp(ri.key, end_key, ri.key_len) > 0) {
+  while (count && streamPELNext(&it, &nack)) {
+    if (streamCompareID(&nack.id, &send) > 0) {
       break;
     }
-    streamNACK* nack = static_cast<streamNACK*>(ri.data);
 
     if (opts.min_idle_time) {
-      mstime_t this_idle = now - nack->delivery_time;
+      mstime_t this_idle = now - nack.delivery_time;
       if (this_idle < opts.min_idle_time) {
         continue;
       }
@@ -1751,23 +1736,18 @@ PendingExtendedResultList GetPendingExtendedResult(streamCG* cg, streamConsumer*
 
     count--;
 
-    /* Entry ID. */
-    streamID id;
-    streamDecodeID(ri.key, &id);
-
     /* Milliseconds elapsed since last delivery. */
-    mstime_t elapsed = now - nack->delivery_time;
+    mstime_t elapsed = now - nack.delivery_time;
     if (elapsed < 0) {
       elapsed = 0;
     }
 
-    PendingExtendedResult item = {.start = id,
-                                  .consumer_name = nack->consumer->name,
-                                  .delivery_count = nack->delivery_count,
+    PendingExtendedResult item = {.start = nack.id,
+                                  .consumer_name = nack.consumer->name,
+                                  .delivery_count = nack.delivery_count,
                                   .elapsed = elapsed};
     result.push_back(item);
   }
-  raxStop(&ri);
   return result;
 }
 
@@ -2159,13 +2139,7 @@ void StreamFamily::XClaim(CmdArgList args, ConnectionContext* cntx) {
     const RecordVec& crec = cresult.records;
     rb->StartArray(crec.size());
     for (const auto& item : crec) {
-      rb->StartArray(2);
-      rb->SendBulkString(StreamIdRepr(item.id));
-      rb->StartArray(item.kv_arr.size() * 2);
-      for (const auto& [k, v] : item.kv_arr) {
-        rb->SendBulkString(k);
-        rb->SendBulkString(v);
-      }
+      SendRecord(item, rb);
     }
   }
 }
@@ -2366,13 +2340,7 @@ void StreamFamily::XInfo(CmdArgList args, ConnectionContext* cntx) {
           rb->SendBulkString("entries");
           rb->StartArray(sinfo->entries.size());
           for (const auto& entry : sinfo->entries) {
-            rb->StartArray(2);
-            rb->SendBulkString(StreamIdRepr(entry.id));
-            rb->StartArray(2);
-            for (const auto& k_v : entry.kv_arr) {
-              rb->SendBulkString(k_v.first);
-              rb->SendBulkString(k_v.second);
-            }
+            SendRecord(entry, rb);
           }
 
           rb->SendBulkString("groups");
@@ -2446,27 +2414,15 @@ void StreamFamily::XInfo(CmdArgList args, ConnectionContext* cntx) {
           rb->SendLong(sinfo->groups);
 
           rb->SendBulkString("first-entry");
-          if (sinfo->first_entry.kv_arr.size() != 0) {
-            rb->StartArray(2);
-            rb->SendBulkString(StreamIdRepr(sinfo->first_entry.id));
-            rb->StartArray(sinfo->first_entry.kv_arr.size() * 2);
-            for (pair<string, string> k_v : sinfo->first_entry.kv_arr) {
-              rb->SendBulkString(k_v.first);
-              rb->SendBulkString(k_v.second);
-            }
+          if (sinfo->first_entry.NumFields() != 0) {
+            SendRecord(sinfo->first_entry, rb);
           } else {
             rb->SendNullArray();
           }
 
           rb->SendBulkString("last-entry");
-          if (sinfo->last_entry.kv_arr.size() != 0) {
-            rb->StartArray(2);
-            rb->SendBulkString(StreamIdRepr(sinfo->last_entry.id));
-            rb->StartArray(sinfo->last_entry.kv_arr.size() * 2);
-            for (pair<string, string> k_v : sinfo->last_entry.kv_arr) {
-              rb->SendBulkString(k_v.first);
-              rb->SendBulkString(k_v.second);
-            }
+          if (sinfo->last_entry.NumFields() != 0) {
+            SendRecord(sinfo->last_entry, rb);
           } else {
             rb->SendNullArray();
           }
@@ -2801,6 +2757,51 @@ OpResult<unordered_map<string_view, streamID>> StreamLastIDs(Transaction* trans)
   return last_ids;
 }
 
+// Returns the serialized reply of an XREAD woken on key, shared with the other readers woken on
+// the same stream and id.
+OpResult<shared_ptr<const string>> OpSharedRead(const OpArgs& op_args, string_view key,
+                                                const RangeOpts& opts) {
+  auto res_it = op_args.shard->db_slice().FindReadOnly(op_args.db_cntx, key, OBJ_STREAM);
+  if (!res_it)
+    return res_it.status();
+
+  const stream* s = GetReadOnlyStream((*res_it)->second);
+  auto& replies = tl_shared_xread_replies;
+  if (auto it = replies.find(key); it != replies.end()) {
+    const SharedXReadReply& shared = it->second;
+    if (shared.db_index == op_args.db_cntx.db_index && shared.length == s->length &&
+        shared.entries_added == s->entries_added &&
+        !memcmp(&shared.start, &opts.start.val, sizeof(streamID)) &&
+        !memcmp(&shared.first_id, &s->first_id, sizeof(streamID)) &&
+        !memcmp(&shared.last_id, &s->last_id, sizeof(streamID))) {
+      return shared.reply;
+    }
+  }
+
+  OpResult<RecordVec> records = OpRange(op_args, key, opts);
+  if (!records)
+    return records.status();
+
+  io::StringSink sink;
+  {
+    RedisReplyBuilder rb(&sink);
+    rb.StartArray(1);
+    rb.StartArray(2);
+    rb.SendBulkString(key);
+    rb.StartArray(records->size());
+    for (const auto& item : *records)
+      SendRecord(item, &rb);
+  }
+
+  if (replies.size() >= kMaxSharedXReadReplies)
+    replies.clear();
+
+  auto reply = make_shared<const string>(sink.str());
+  replies[key] = {op_args.db_cntx.db_index, opts.start.val, s->first_id, s->last_id, s->length,
+                  s->entries_added, reply};
+  return reply;
+}
+
 void XReadBlock(ReadOpts opts, ConnectionContext* cntx) {
   // If BLOCK is not set just return an empty array as there are no resolvable
   // entries.
@@ -2822,12 +2823,19 @@ void XReadBlock(ReadOpts opts, ConnectionContext* cntx) {
     if (!res_it.ok())
       return false;
 
-    auto sitem = opts.stream_ids.at(key);
+    const auto& sitem = opts.stream_ids.at(key);
     if (sitem.id.val.ms != UINT64_MAX && sitem.id.val.seq != UINT64_MAX)
       return true;
 
     const CompactObj& cobj = (*res_it)->second;
     stream* s = GetReadOnlyStream(cobj);
+
+    // The checker runs for every consumer of the group parked on the key, while usually only
+    // the first one of them can be served. The last valid id never exceeds the last generated
+    // id, so the cheap comparison rejects the rest without looking up the last entry.
+    if (streamCompareID(&s->last_id, &sitem.group->last_id) <= 0)
+      return false;
+
     streamID last_id = s->last_id;
     if (s->length) {
       streamLastValidID(s, &last_id);
@@ -2844,6 +2852,7 @@ void XReadBlock(ReadOpts opts, ConnectionContext* cntx) {
   // only the shard that contains the woken key blocks for the awoken
   // transaction to proceed.
   OpResult<RecordVec> result;
+  OpResult<shared_ptr<const string>> shared_reply = OpStatus::SKIPPED;
   std::string key;
   auto range_cb = [&](Transaction* t, EngineShard* shard) {
     if (auto wake_key = t->GetWakeKey(shard->shard_id()); wake_key) {
@@ -2863,13 +2872,22 @@ void XReadBlock(ReadOpts opts, ConnectionContext* cntx) {
       range_opts.consumer = sitem.consumer;
       range_opts.noack = opts.noack;
 
-      result = OpRange(t->GetOpArgs(shard), *wake_key, range_opts);
+      // Plain readers of the same entries share the reply, group readers change the group.
+      if (opts.read_group) {
+        result = OpRange(t->GetOpArgs(shard), *wake_key, range_opts);
+      } else if (shared_reply = OpSharedRead(t->GetOpArgs(shard), *wake_key, range_opts);
+                 !shared_reply) {
+        result = shared_reply.status();
+      }
       key = *wake_key;
     }
     return OpStatus::OK;
   };
   cntx->transaction->Execute(std::move(range_cb), true);
 
+  if (shared_reply)
+    return rb->SendSerialized(**shared_reply);
+
   if (result) {
     SinkReplyBuilder::ReplyAggregator agg(cntx->reply_builder());
 
@@ -2880,13 +2898,7 @@ void XReadBlock(ReadOpts opts, ConnectionContext* cntx) {
 
     rb->StartArray(result->size());
     for (const auto& item : *result) {
-      rb->StartArray(2);
-      rb->SendBulkString(StreamIdRepr(item.id));
-      rb->StartArray(item.kv_arr.size() * 2);
-      for (const auto& k_v : item.kv_arr) {
-        rb->SendBulkString(k_v.first);
-        rb->SendBulkString(k_v.second);
-      }
+      SendRecord(item, rb);
     }
     return;
   } else {
@@ -3021,13 +3033,7 @@ void XReadImpl(CmdArgList args, std::optional<ReadOpts> opts, ConnectionContext*
     rb->SendBulkString(ArgS(args, i + opts->streams_arg));
     rb->StartArray(res[i].size());
     for (const auto& item : res[i]) {
-      rb->StartArray(2);
-      rb->SendBulkString(StreamIdRepr(item.id));
-      rb->StartArray(item.kv_arr.size() * 2);
-      for (const auto& k_v : item.kv_arr) {
-        rb->SendBulkString(k_v.first);
-        rb->SendBulkString(k_v.second);
-      }
+      SendRecord(item, rb);
     }
   }
 }
@@ -3170,13 +3176,7 @@ void StreamFamily::XRangeGeneric(CmdArgList args, bool is_rev, ConnectionContext
 
     rb->StartArray(result->size());
     for (const auto& item : *result) {
-      rb->StartArray(2);
-      rb->SendBulkString(StreamIdRepr(item.id));
-      rb->StartArray(item.kv_arr.size() * 2);
-      for (const auto& k_v : item.kv_arr) {
-        rb->SendBulkString(k_v.first);
-        rb->SendBulkString(k_v.second);
-      }
+      SendRecord(item, rb);
     }
     return;
   }
@@ -3287,13 +3287,7 @@ void StreamFamily::XAutoClaim(CmdArgList args, ConnectionContext* cntx) {
     const RecordVec& crec = cresult.records;
     rb->StartArray(crec.size());
     for (const auto& item : crec) {
-      rb->StartArray(2);
-      rb->SendBulkString(StreamIdRepr(item.id));
-      rb->StartArray(item.kv_arr.size() * 2);
-      for (const auto& [k, v] : item.kv_arr) {
-        rb->SendBulkString(k);
-        rb->SendBulkString(v);
-      }
+      SendRecord(item, rb);
     }
   }
 
@@ -108,6 +108,29 @@ TEST_F(StreamFamilyTest, Range) {
   EXPECT_THAT(sub1, ElementsAre("1-0", ArrLen(2)));
 }
 
+TEST_F(StreamFamilyTest, RangeMultipleFields) {
+  // Spans several listpack nodes of the stream.
+  for (unsigned i = 0; i < 250; ++i) {
+    Run({"xadd", "key", absl::StrCat(i + 1, "-0"), "name", absl::StrCat("event", i), "seq",
+         absl::StrCat(i), "empty", ""});
+  }
+
+  auto resp = Run({"xrange", "key", "100", "+", "count", "2"});
+  ASSERT_THAT(resp, ArrLen(2));
+  EXPECT_THAT(resp.GetVec()[0].GetVec(), ElementsAre("100-0", ArrLen(6)));
+  EXPECT_THAT(resp.GetVec()[1].GetVec()[1].GetVec(),
+              ElementsAre("name", "event100", "seq", "100", "empty", ""));
+
+  resp = Run({"xrevrange", "key", "+", "-", "count", "1"});
+  EXPECT_THAT(resp.GetVec(), ElementsAre("250-0", ArrLen(6)));
+
+  resp = Run({"xread", "count", "120", "streams", "key", "50"});
+  EXPECT_THAT(resp.GetVec(), ElementsAre("key", ArrLen(120)));
+  auto entries = resp.GetVec()[1].GetVec();
+  EXPECT_THAT(entries[119].GetVec()[1].GetVec(),
+              ElementsAre("name", "event169", "seq", "169", "empty", ""));
+}
+
 TEST_F(StreamFamilyTest, GroupCreate) {
   Run({"xadd", "key", "1-*", "f1", "v1"});
   auto resp = Run({"xgroup", "create", "key", "grname", "1"});
@@ -298,6 +321,42 @@ TEST_F(StreamFamilyTest, XReadBlock) {
   EXPECT_THAT(resp1.GetVec(), ElementsAre("foo", ArrLen(1)));
 }
 
+TEST_F(StreamFamilyTest, XReadBlockSharedReply) {
+  Run({"xadd", "foo", "1-1", "k1", "v1"});
+
+  // Readers blocked on the same stream and id share the serialized reply.
+  vector<RespExpr> resps(3);
+  vector<Fiber> fbs;
+  for (unsigned i = 0; i < resps.size(); ++i) {
+    fbs.push_back(pp_->at(i % 2)->LaunchFiber(Launch::dispatch, [&, i] {
+      resps[i] = Run(absl::StrCat("reader", i), {"xread", "block", "0", "streams", "foo", "$"});
+    }));
+  }
+  ThisFiber::SleepFor(50us);
+
+  pp_->at(1)->Await([&] { return Run({"xadd", "foo", "1-2", "k2", "v2"}); });
+  for (auto& fb : fbs)
+    fb.Join();
+
+  for (const auto& resp : resps) {
+    ASSERT_THAT(resp, ArrLen(2));
+    EXPECT_EQ(resp.GetVec()[0], "foo");
+    EXPECT_THAT(resp.GetVec()[1],
+                RespArray(ElementsAre("1-2", RespArray(ElementsAre("k2", "v2")))));
+  }
+
+  // The next readers get the new entries.
+  auto fb = pp_->at(0)->LaunchFiber(Launch::dispatch, [&] {
+    resps[0] = Run({"xread", "block", "0", "streams", "foo", "$"});
+  });
+  ThisFiber::SleepFor(50us);
+  pp_->at(1)->Await([&] { return Run({"xadd", "foo", "1-3", "k3", "v3"}); });
+  fb.Join();
+
+  ASSERT_THAT(resps[0], ArrLen(2));
+  EXPECT_THAT(resps[0].GetVec()[1], RespArray(ElementsAre("1-3", _)));
+}
+
 TEST_F(StreamFamilyTest, XReadGroupBlockwithoutBlock) {
   Run({"xadd", "foo", "1-*", "k1", "v1"});
   Run({"xadd", "foo", "1-*", "k2", "v2"});
@@ -356,6 +415,37 @@ TEST_F(StreamFamilyTest, XReadGroupBlock) {
   }
 }
 
+TEST_F(StreamFamilyTest, XReadGroupBlockManyConsumers) {
+  Run({"xgroup", "create", "foo", "group", "$", "MKSTREAM"});
+
+  constexpr unsigned kNumConsumers = 4;
+  vector<RespExpr> resps(kNumConsumers);
+  vector<Fiber> fibers;
+  for (unsigned i = 0; i < kNumConsumers; ++i) {
+    fibers.push_back(pp_->at(i % pp_->size())->LaunchFiber(Launch::dispatch, [&, i] {
+      resps[i] = Run(absl::StrCat("c", i), {"xreadgroup", "group", "group", absl::StrCat("c", i),
+                                            "block", "0", "streams", "foo", ">"});
+    }));
+  }
+  ThisFiber::SleepFor(50us);
+
+  // Every entry is delivered to a single consumer.
+  for (unsigned i = 0; i < kNumConsumers; ++i) {
+    Run({"xadd", "foo", "*", "k", absl::StrCat(i)});
+    ThisFiber::SleepFor(50us);
+  }
+
+  set<string> values;
+  for (unsigned i = 0; i < kNumConsumers; ++i) {
+    fibers[i].Join();
+    ASSERT_THAT(resps[i].GetVec(), ElementsAre("foo", ArrLen(1)));
+    auto fields = resps[i].GetVec()[1].GetVec()[0].GetVec()[1].GetVec();
+    values.insert(fields[1].GetString());
+  }
+  EXPECT_EQ(kNumConsumers, values.size());
+  EXPECT_THAT(Run({"xpending", "foo", "group"}).GetVec()[0], IntArg(kNumConsumers));
+}
+
 TEST_F(StreamFamilyTest, XReadInvalidArgs) {
   // Invalid COUNT value.
   auto resp = Run({"xread", "count", "invalid", "streams", "s1", "s2", "0", "0"});
@@ -586,6 +676,30 @@ TEST_F(StreamFamilyTest, XTrim) {
   EXPECT_THAT(resp, IntArg(0));
 }
 
+TEST_F(StreamFamilyTest, AmortizedApproxTrim) {
+  auto xadd = [this](unsigned from, unsigned to) {
+    for (unsigned i = from; i <= to; ++i)
+      Run({"xadd", "foo", "maxlen", "~", "100", absl::StrCat(i, "-0"), "field", "val"});
+  };
+
+  // XADD trims only once a full node is over the threshold.
+  xadd(1, 199);
+  EXPECT_THAT(Run({"xlen", "foo"}), IntArg(199));
+  xadd(200, 200);
+  EXPECT_THAT(Run({"xlen", "foo"}), IntArg(100));
+
+  // A node that is not full is trimmed by the heartbeat.
+  EXPECT_THAT(Run({"xdel", "foo", "150-0"}), IntArg(1));
+  xadd(201, 300);
+  EXPECT_THAT(Run({"xlen", "foo"}), IntArg(199));
+
+  shard_set->TEST_EnableHeartBeat();
+  ThisFiber::SleepFor(100ms);
+  EXPECT_THAT(Run({"xlen", "foo"}), IntArg(100));
+  EXPECT_THAT(Run({"xrange", "foo", "-", "+", "count", "1"}),
+              RespArray(ElementsAre("201-0", _)));
+}
+
 TEST_F(StreamFamilyTest, XTrimInvalidArgs) {
   // Missing threshold.
   auto resp = Run({"xtrim", "foo"});
@@ -748,6 +862,45 @@ TEST_F(StreamFamilyTest, XAck) {
   EXPECT_THAT(resp, ArrLen(0));
 }
 
+TEST_F(StreamFamilyTest, XPendingManyBlocks) {
+  // Enough entries for the PEL to span several blocks.
+  for (unsigned i = 0; i < 300; ++i)
+    Run({"xadd", "foo", absl::StrCat("1-", i), "k", "v"});
+  Run({"xgroup", "create", "foo", "group", "0"});
+  Run({"xreadgroup", "group", "group", "alice", "count", "100", "streams", "foo", ">"});
+  Run({"xreadgroup", "group", "group", "bob", "count", "200", "streams", "foo", ">"});
+
+  for (unsigned i = 0; i < 100; i += 2)
+    EXPECT_THAT(Run({"xack", "foo", "group", absl::StrCat("1-", i)}), IntArg(1));
+
+  auto resp = Run({"xpending", "foo", "group"});
+  EXPECT_THAT(resp, RespArray(ElementsAre(IntArg(250), "1-1", "1-299",
+                                          RespArray(ElementsAre(
+                                              RespArray(ElementsAre("alice", IntArg(50))),
+                                              RespArray(ElementsAre("bob", IntArg(200))))))));
+  resp = Run({"xpending", "foo", "group", "-", "+", "1", "bob"});
+  EXPECT_THAT(resp.GetVec(), ElementsAre("1-100", "bob", ArgType(RespExpr::INT64), IntArg(1)));
+  resp = Run({"xpending", "foo", "group", "1-50", "+", "1", "alice"});
+  EXPECT_THAT(resp.GetVec(), ElementsAre("1-51", "alice", ArgType(RespExpr::INT64), IntArg(1)));
+
+  Run({"xclaim", "foo", "group", "bob", "0", "1-1"});
+  EXPECT_THAT(Run({"xgroup", "delconsumer", "foo", "group", "alice"}), IntArg(49));
+
+  for (bool reload : {false, true}) {
+    if (reload)
+      Run({"debug", "reload"});
+    resp = Run({"xpending", "foo", "group"});
+    EXPECT_THAT(resp, RespArray(ElementsAre(IntArg(201), "1-1", "1-299",
+                                            RespArray(ElementsAre(RespArray(
+                                                ElementsAre("bob", IntArg(201))))))));
+    resp = Run({"xpending", "foo", "group", "-", "+", "2", "bob"});
+    EXPECT_THAT(resp, RespArray(ElementsAre(
+                          RespArray(ElementsAre("1-1", "bob", ArgType(RespExpr::INT64), IntArg(2))),
+                          RespArray(ElementsAre("1-100", "bob", ArgType(RespExpr::INT64),
+                                                IntArg(1))))));
+  }
+}
+
 TEST_F(StreamFamilyTest, XInfoGroups) {
   Run({"del", "mystream"});
   Run({"xgroup", "create", "mystream", "mygroup", "$", "MKSTREAM"});
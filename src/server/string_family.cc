@@ -9,6 +9,7 @@ extern "C" {
 }
 
 #include <absl/container/inlined_vector.h>
+#include <absl/strings/match.h>
 
 #include <algorithm>
 #include <array>
@@ -24,6 +25,7 @@ extern "C" {
 #include "server/engine_shard_set.h"
 #include "server/error.h"
 #include "server/journal/journal.h"
+#include "server/server_state.h"
 #include "server/tiered_storage.h"
 #include "server/transaction.h"
 
@@ -31,6 +33,25 @@ ABSL_FLAG(bool, tiered_skip_prefetch, false,
           "If true, does not load offloaded string back to in-memory store during GET command."
           "For testing/development purposes only.");
 
+ABSL_FLAG(uint32_t, borrowed_reply_min_size, 0,
+          "If positive, GET replies with values of at least this size are written to the socket "
+          "directly from the shard memory instead of being copied. The key stays read-locked "
+          "until the reply is sent, so slow clients may delay writers of that key. Values below "
+          "64KB are always copied, since borrowing takes two more hops. "
+          "0 disables borrowed replies.");
+
+ABSL_FLAG(string, split_counter_prefix, "",
+          "When non-empty, keys which start with this prefix are split counters: INCR, INCRBY, "
+          "DECR and DECRBY accumulate on the connection thread and are folded into the key every "
+          "split_counter_flush_ms. Their replies are estimates, which include the increments of "
+          "the thread but may miss those of other threads since the last fold. GET folds the "
+          "increments of all threads before reading the key, other reads may be stale by up to "
+          "one interval. Increments that can not be folded, for example because the key was "
+          "overwritten with a non integer value, are dropped.");
+
+ABSL_FLAG(uint32_t, split_counter_flush_ms, 100,
+          "Interval at which the increments of split counters are folded into their keys.");
+
 namespace dfly {
 
 namespace {
@@ -43,6 +64,9 @@ using CI = CommandId;
 constexpr uint32_t kMaxStrLen = 1 << 28;
 constexpr size_t kMinTieredLen = TieredStorage::kMinBlobLen;
 
+// Borrowing a value takes two more hops than copying it, which only pays off for large values.
+constexpr uint32_t kMinBorrowedLen = 1 << 16;
+
 size_t CopyValueToBuffer(const PrimeValue& pv, char* dest) {
   DCHECK_EQ(pv.ObjType(), OBJ_STRING);
   DCHECK(!pv.IsExternal());
@@ -60,6 +84,43 @@ string GetString(const PrimeValue& pv) {
   return res;
 }
 
+// Sends a string value without copying it on the shard thread. The transaction keeps the key
+// read-locked while the reply is written from the coordinator thread, which is safe since
+// references to locked values are readable from any thread (see CompactObj::AsRef).
+// The lock is released by a concluding hop once the reply has been sent.
+// A value with a pending offload is copied, the completion of the offload frees it regardless of
+// the key locks.
+OpStatus SendBorrowedValue(string_view key, Transaction* trans, RedisReplyBuilder* rb) {
+  PrimeValue ref;
+  string copy;
+  bool borrowed = false;
+  OpStatus status = OpStatus::OK;
+  auto cb = [&](Transaction* t, EngineShard* shard) {
+    auto res = shard->db_slice().FindAndFetchReadOnly(t->GetDbContext(), key, OBJ_STRING);
+    if (!res) {
+      status = res.status();
+    } else if ((*res)->second.HasIoPending()) {
+      copy = GetString((*res)->second);
+    } else {
+      ref = (*res)->second.AsRef();
+      borrowed = true;
+    }
+    return OpStatus::OK;
+  };
+
+  trans->Refurbish();
+  trans->Schedule();
+  trans->Execute(cb, false);
+
+  if (status == OpStatus::OK) {
+    string scratch;
+    rb->SendBulkString(borrowed ? ref.GetSlice(&scratch) : copy);
+  }
+
+  trans->Conclude();
+  return status;
+}
+
 OpResult<uint32_t> OpSetRange(const OpArgs& op_args, string_view key, size_t start,
                               string_view value) {
   VLOG(2) << "SetRange(" << key << ", " << start << ", " << value << ")";
@@ -299,6 +360,46 @@ OpResult<int64_t> OpIncrBy(const OpArgs& op_args, string_view key, int64_t incr,
   return new_val;
 }
 
+// Copy of --split_counter_prefix, taken by StringFamily::Init.
+string split_counter_prefix;
+const CommandId* incrby_cid = nullptr;
+
+bool IsSplitCounter(string_view key, const ConnectionContext* cntx) {
+  return !split_counter_prefix.empty() && absl::StartsWith(key, split_counter_prefix) &&
+         cntx->protocol() == Protocol::REDIS && !cntx->transaction->IsMulti();
+}
+
+// Applies the folded increments of a split counter with a standalone INCRBY transaction, so they
+// are journaled as such.
+void FoldSplitCounter(DbIndex db, string_view key, int64_t delta) {
+  string key_str{key};
+  string delta_str = absl::StrCat(delta);
+  CmdArgVec args{MutableSlice{key_str.data(), key_str.size()},
+                 MutableSlice{delta_str.data(), delta_str.size()}};
+
+  boost::intrusive_ptr<Transaction> trans{new Transaction{incrby_cid}};
+  trans->InitByArgs(db, absl::MakeSpan(args));
+
+  auto cb = [&](Transaction* t, EngineShard* shard) {
+    return OpIncrBy(t->GetOpArgs(shard), key_str, delta, false);
+  };
+  OpResult<int64_t> res = trans->ScheduleSingleHopT(std::move(cb));
+  LOG_IF(WARNING, !res) << "Dropped " << delta << " increments of split counter " << key_str
+                        << ": " << res.status();
+}
+
+// Folds the cells of the split counter on all threads.
+void FoldSplitCounterCells(DbIndex db, string_view key) {
+  atomic_int64_t delta{0};
+  shard_set->pool()->Await([&](unsigned, util::ProactorBase*) {
+    int64_t pending = ServerState::tlocal()->split_counters()->Take(db, key);
+    delta.fetch_add(pending, memory_order_relaxed);
+  });
+
+  if (int64_t val = delta.load(memory_order_relaxed); val != 0)
+    FoldSplitCounter(db, key, val);
+}
+
 int64_t AbsExpiryToTtl(int64_t abs_expiry_time, bool as_milli) {
   using std::chrono::duration_cast;
   using std::chrono::milliseconds;
@@ -446,7 +547,7 @@ OpResult<array<int64_t, 5>> OpThrottle(const OpArgs& op_args, const string_view
   if (!limited) {
     if (IsValid(res.it)) {
       if (IsValid(res.exp_it)) {
-        res.exp_it->second = db_slice.FromAbsoluteTime(new_tat_ms);
+        db_slice.SetExpireTime(op_args.db_cntx.db_index, res.it, res.exp_it, new_tat_ms);
       } else {
         db_slice.AddExpire(op_args.db_cntx.db_index, res.it, new_tat_ms);
       }
@@ -501,15 +602,17 @@ SinkReplyBuilder::MGetResponse OpMGet(bool fetch_mcflag, bool fetch_mcver, const
 
   SinkReplyBuilder::MGetResponse response(keys.size());
   absl::InlinedVector<PrimeConstIterator, 32> iters(keys.size());
+  absl::InlinedVector<OpResult<PrimeConstIterator>, 32> find_res(keys.size());
+
+  db_slice.FindAndFetchManyReadOnly(t->GetDbContext(), keys, OBJ_STRING, find_res.data());
 
   size_t total_size = 0;
   for (size_t i = 0; i < keys.size(); ++i) {
-    OpResult<PrimeConstIterator> it_res =
-        db_slice.FindAndFetchReadOnly(t->GetDbContext(), keys[i], OBJ_STRING);
+    const OpResult<PrimeConstIterator>& it_res = find_res[i];
     if (!it_res)
       continue;
-    iters[i] = *it_res;
-    total_size += (*it_res)->second.Size();
+    iters[i] = it_res.value();
+    total_size += iters[i]->second.Size();
   }
 
   response.storage_list = SinkReplyBuilder::AllocMGetStorage(total_size);
@@ -571,13 +674,13 @@ OpResult<optional<string>> SetCmd::Set(const SetParams& params, string_view key,
 
   VLOG(2) << "Set " << key << "(" << db_slice.shard_id() << ") ";
 
+  bool fetch_value = params.prev_val || (params.flags & SET_GET);
   if (params.IsConditionalSet()) {
-    bool fetch_value = params.prev_val || (params.flags & SET_GET);
     DbSlice::ItAndUpdater find_res;
     if (fetch_value) {
       find_res = db_slice.FindAndFetchMutable(op_args_.db_cntx, key);
     } else {
-      find_res = db_slice.FindMutable(op_args_.db_cntx, key);
+      find_res = db_slice.FindMutableToReplace(op_args_.db_cntx, key);
     }
     if (IsValid(find_res.it)) {
       result_builder.CachePrevValueIfNeeded(find_res.it->second);
@@ -599,8 +702,9 @@ OpResult<optional<string>> SetCmd::Set(const SetParams& params, string_view key,
   }
   // At this point we either need to add missing entry, or we
   // will override an existing one
-  // Trying to add a new entry.
-  auto op_res = db_slice.AddOrFind(op_args_.db_cntx, key);
+  // Trying to add a new entry. An existing value that is not returned is not read from disk.
+  auto op_res = fetch_value ? db_slice.AddOrFindAndFetch(op_args_.db_cntx, key)
+                            : db_slice.AddOrFindToReplace(op_args_.db_cntx, key);
   RETURN_ON_BAD_STATUS(op_res);
   auto& add_res = *op_res;
 
@@ -611,7 +715,8 @@ OpResult<optional<string>> SetCmd::Set(const SetParams& params, string_view key,
   }
 
   // Adding new value.
-  PrimeValue tvalue{value};
+  PrimeValue tvalue;
+  tvalue.SetSharedString(value);
   tvalue.SetFlag(params.memcache_flags != 0);
   it->second = std::move(tvalue);
 
@@ -627,7 +732,7 @@ OpResult<optional<string>> SetCmd::Set(const SetParams& params, string_view key,
     it->first.SetSticky(true);
   }
 
-  if (shard->tiered_storage() &&
+  if (shard->tiered_storage() && !shard->tiered_storage()->OffloadsColdValues() &&
       TieredStorage::EligibleForOffload(value)) {  // external storage enabled.
     // TODO: we may have a bug if we block the fiber inside UnloadItem - "it" may be invalid
     // afterwards. handle this
@@ -638,6 +743,7 @@ OpResult<optional<string>> SetCmd::Set(const SetParams& params, string_view key,
     RecordJournal(params, key, value);
   }
 
+  db_slice.OnKeyspaceEvent(op_args_.db_cntx.db_index, KEYSPACE_EVENT_SET, key);
   return std::move(result_builder).Return(OpStatus::OK);
 }
 
@@ -665,7 +771,7 @@ OpStatus SetCmd::SetExisting(const SetParams& params, PrimeIterator it, ExpireIt
     if (at_ms) {  // Command has an expiry paramater.
       if (IsValid(e_it)) {
         // Updated existing expiry information.
-        e_it->second = db_slice.FromAbsoluteTime(at_ms);
+        db_slice.SetExpireTime(op_args_.db_cntx.db_index, it, e_it, at_ms);
       } else {
         // Add new expiry information.
         db_slice.AddExpire(op_args_.db_cntx.db_index, it, at_ms);
@@ -687,14 +793,16 @@ OpStatus SetCmd::SetExisting(const SetParams& params, PrimeIterator it, ExpireIt
   }
 
   db_slice.RemoveFromTiered(it, op_args_.db_cntx.db_index);
+  db_slice.LazyFree(&prime_value);
   // overwrite existing entry.
-  prime_value.SetString(value);
+  prime_value.SetSharedString(value);
   DCHECK(!prime_value.HasIoPending());
 
   if (manual_journal_ && op_args_.shard->journal()) {
     RecordJournal(params, key, value);
   }
 
+  db_slice.OnKeyspaceEvent(op_args_.db_cntx.db_index, KEYSPACE_EVENT_SET, key);
   return OpStatus::OK;
 }
 
@@ -849,6 +957,24 @@ void StringFamily::SetNx(CmdArgList args, ConnectionContext* cntx) {
 void StringFamily::Get(CmdArgList args, ConnectionContext* cntx) {
   string_view key = ArgS(args, 0);
 
+  if (IsSplitCounter(key, cntx))
+    FoldSplitCounterCells(cntx->db_index(), key);
+
+  // Hot keys replicated to this thread are served without a hop to their shard.
+  if (ServerState* ss = ServerState::tlocal();
+      !ss->hot_key_cache()->Empty() && !cntx->transaction->IsMulti()) {
+    if (auto entry = ss->hot_key_cache()->Find(cntx->db_index(), key); entry) {
+      ss->stats.hot_key_cache_hits++;
+      static_cast<RedisReplyBuilder*>(cntx->reply_builder())->SendBulkString(entry->value);
+      return;
+    }
+  }
+
+  uint32_t borrow_min_size = absl::GetFlag(FLAGS_borrowed_reply_min_size);
+  if (borrow_min_size > 0)
+    borrow_min_size = max(borrow_min_size, kMinBorrowedLen);
+  bool borrow = false;
+
   auto cb = [&](Transaction* t, EngineShard* shard) -> OpResult<string> {
     auto op_args = t->GetOpArgs(shard);
     DbSlice& db_slice = op_args.shard->db_slice();
@@ -858,9 +984,15 @@ void StringFamily::Get(CmdArgList args, ConnectionContext* cntx) {
     // A temporary code that allows running dragonfly without filling up memory store
     // when reading data from disk.
     if (TieredStorage* tiered = shard->tiered_storage();
-        tiered && absl::GetFlag(FLAGS_tiered_skip_prefetch)) {
+        tiered && (absl::GetFlag(FLAGS_tiered_skip_prefetch) || tiered->OffloadsColdValues())) {
       res = db_slice.FindReadOnly(op_args.db_cntx, key, OBJ_STRING);
-      if (res && (*res)->second.IsExternal()) {
+      bool hot = tiered->OffloadsColdValues() &&
+                 db_slice.freq_sketch().Estimate(CompactObj::HashCode(key)) >=
+                     TieredStorage::kPrefetchHeat;
+      if (res && (*res)->second.IsExternal() && hot) {
+        // The value became hot again, it is loaded back instead of being read in place.
+        res = db_slice.FindAndFetchReadOnly(op_args.db_cntx, key, OBJ_STRING);
+      } else if (res && (*res)->second.IsExternal()) {
         auto [offset, size] = (*res)->second.GetExternalSlice();
         string blob(size, '\0');
         auto ec = tiered->Read(offset, size, blob.data());
@@ -874,7 +1006,14 @@ void StringFamily::Get(CmdArgList args, ConnectionContext* cntx) {
     if (!res) {
       return res.status();
     }
-    return GetString((*res)->second);
+
+    const PrimeValue& pv = (*res)->second;
+    if (borrow_min_size > 0 && !t->IsMulti() && pv.Size() >= borrow_min_size &&
+        !pv.HasIoPending()) {
+      borrow = true;  // Skip the copy, the value is sent by SendBorrowedValue.
+      return string{};
+    }
+    return GetString(pv);
   };
 
   DVLOG(1) << "Before Get::ScheduleSingleHopT " << key;
@@ -882,6 +1021,13 @@ void StringFamily::Get(CmdArgList args, ConnectionContext* cntx) {
   OpResult<string> result = trans->ScheduleSingleHopT(std::move(cb));
 
   auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+  if (result && borrow) {
+    OpStatus status = SendBorrowedValue(key, trans, rb);
+    if (status == OpStatus::OK)
+      return;
+    result = status;
+  }
+
   if (result) {
     DVLOG(1) << "GET " << trans->DebugId() << ": " << key << " " << result.value();
     rb->SendBulkString(*result);
@@ -1103,6 +1249,15 @@ void StringFamily::Prepend(CmdArgList args, ConnectionContext* cntx) {
 }
 
 void StringFamily::IncrByGeneric(string_view key, int64_t val, ConnectionContext* cntx) {
+  bool split_counter = IsSplitCounter(key, cntx);
+  if (split_counter) {
+    ServerState* ss = ServerState::tlocal();
+    if (auto estimate = ss->split_counters()->Add(cntx->db_index(), key, val); estimate) {
+      ss->stats.split_counter_incrs++;
+      return cntx->reply_builder()->SendLong(*estimate);
+    }
+  }
+
   bool skip_on_missing = cntx->protocol() == Protocol::MEMCACHE;
 
   auto cb = [&](Transaction* t, EngineShard* shard) {
@@ -1115,6 +1270,9 @@ void StringFamily::IncrByGeneric(string_view key, int64_t val, ConnectionContext
 
   DVLOG(2) << "IncrByGeneric " << key << "/" << result.value();
 
+  if (split_counter && result)
+    ServerState::tlocal()->split_counters()->Open(cntx->db_index(), key, result.value());
+
   switch (result.status()) {
     case OpStatus::OK:
       builder->SendLong(result.value());
@@ -1505,10 +1663,26 @@ void StringFamily::ClThrottle(CmdArgList args, ConnectionContext* cntx) {
   }
 }
 
-void StringFamily::Init(util::ProactorPool* pp) {
+void StringFamily::Init(util::ProactorPool* pp, const CommandRegistry& registry) {
+  split_counter_prefix = absl::GetFlag(FLAGS_split_counter_prefix);
+  if (split_counter_prefix.empty())
+    return;
+
+  incrby_cid = registry.Find("INCRBY");
+
+  chrono::milliseconds interval{absl::GetFlag(FLAGS_split_counter_flush_ms)};
+  pp->Await([interval](unsigned, util::ProactorBase*) {
+    ServerState::tlocal()->split_counters()->StartFlusher(interval, FoldSplitCounter);
+  });
 }
 
 void StringFamily::Shutdown() {
+  if (split_counter_prefix.empty())
+    return;
+
+  shard_set->pool()->AwaitFiberOnAll(
+      [](util::ProactorBase*) { ServerState::tlocal()->split_counters()->StopFlusher(); });
+  split_counter_prefix.clear();
 }
 
 #define HFUNC(x) SetHandler(&StringFamily::x)
@@ -1565,8 +1739,9 @@ void StringFamily::Register(CommandRegistry* registry) {
       << CI{"GETEX", CO::WRITE | CO::DENYOOM | CO::FAST | CO::NO_AUTOJOURNAL, -1, 1, 1, acl::kGetEx}
              .HFUNC(GetEx)
       << CI{"GETSET", CO::WRITE | CO::DENYOOM | CO::FAST, 3, 1, 1, acl::kGetSet}.HFUNC(GetSet)
-      << CI{"MGET", CO::READONLY | CO::FAST | CO::REVERSE_MAPPING, -2, 1, -1, acl::kMGet}.HFUNC(
-             MGet)
+      << CI{"MGET", CO::READONLY | CO::FAST | CO::REVERSE_MAPPING | CO::OPTIMISTIC_READ, -2, 1, -1,
+            acl::kMGet}
+             .HFUNC(MGet)
       << CI{"MSET", kMSetMask, -3, 1, -1, acl::kMSet}.HFUNC(MSet)
       << CI{"MSETNX", kMSetMask, -3, 1, -1, acl::kMSetNx}.HFUNC(MSetNx)
       << CI{"STRLEN", CO::READONLY | CO::FAST, 2, 1, 1, acl::kStrLen}.HFUNC(StrLen)
@@ -61,7 +61,7 @@ class SetCmd {
 
 class StringFamily {
  public:
-  static void Init(util::ProactorPool* pp);
+  static void Init(util::ProactorPool* pp, const CommandRegistry& registry);
   static void Shutdown();
 
   static void Register(CommandRegistry* registry);
@@ -19,6 +19,12 @@ using namespace std;
 using namespace util;
 using absl::StrCat;
 
+ABSL_DECLARE_FLAG(uint32_t, borrowed_reply_min_size);
+ABSL_DECLARE_FLAG(uint32_t, tx_hop_batch_size);
+ABSL_DECLARE_FLAG(bool, tx_optimistic_reads);
+ABSL_DECLARE_FLAG(bool, hot_key_replication);
+ABSL_DECLARE_FLAG(uint32_t, hot_key_min_reads);
+
 namespace dfly {
 
 class StringFamilyTest : public BaseFamilyTest {
@@ -207,6 +213,25 @@ TEST_F(StringFamilyTest, SetHugeKey) {
   Run({"del", key});
 }
 
+TEST_F(StringFamilyTest, BorrowedGet) {
+  absl::SetFlag(&FLAGS_borrowed_reply_min_size, 1024);
+
+  const string val(100000, 'v');
+  Run({"set", "key", val});
+  EXPECT_EQ(Run({"get", "key"}), val);
+  EXPECT_EQ(Run({"get", "key"}), val);
+
+  // The key is unlocked after the reply.
+  EXPECT_EQ(Run({"set", "key", "small"}), "OK");
+  EXPECT_EQ(Run({"get", "key"}), "small");
+  EXPECT_THAT(Run({"get", "missing"}), ArgType(RespExpr::NIL));
+
+  Run({"lpush", "list", "a"});
+  EXPECT_THAT(Run({"get", "list"}), ErrArg("WRONGTYPE"));
+
+  absl::SetFlag(&FLAGS_borrowed_reply_min_size, 0);
+}
+
 TEST_F(StringFamilyTest, MGetSet) {
   Run({"mset", "z", "0"});         // single key
   auto resp = Run({"mget", "z"});  // single key
@@ -237,6 +262,166 @@ TEST_F(StringFamilyTest, MGetSet) {
   set_fb.Join();
 }
 
+TEST_F(StringFamilyTest, BatchedHops) {
+  if (shard_set->size() < 2)
+    GTEST_SKIP() << "Hops to the shard of the own thread are not batched";
+
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_tx_hop_batch_size, 3);
+
+  // A key that does not belong to the shard of thread 0, so its hops are dispatched.
+  string key = "counter";
+  while (Shard(key, shard_set->size()) == 0)
+    key += "x";
+
+  const unsigned kNumFibers = 4, kNumIncrs = 200;
+  vector<Fiber> fibers;
+  for (unsigned i = 0; i < kNumFibers; i++) {
+    fibers.push_back(pp_->at(0)->LaunchFiber([&, id = StrCat("conn", i)] {
+      string_view args[] = {"incr", key};
+      for (unsigned j = 0; j < kNumIncrs; j++)
+        Run(id, args);
+    }));
+  }
+  for (auto& fb : fibers)
+    fb.Join();
+
+  EXPECT_EQ(Run({"get", key}), StrCat(kNumFibers * kNumIncrs));
+
+  auto metrics = GetMetrics();
+  EXPECT_GT(metrics.coordinator_stats.tx_hop_batch_cnt, 0u);
+  EXPECT_GT(metrics.coordinator_stats.tx_batched_hop_cnt,
+            metrics.coordinator_stats.tx_hop_batch_cnt);
+}
+
+TEST_F(StringFamilyTest, SharedStrings) {
+  shard_set->RunBriefInParallel([](EngineShard*) { CompactObj::EnableSharedStrings(1024); });
+
+  string value(2000, 'v');
+  for (unsigned i = 0; i < 10; i++)
+    Run({"set", StrCat("key", i), value});
+  Run({"set", "small", "vvv"});
+
+  auto metrics = GetMetrics();
+  EXPECT_EQ(metrics.shared_string_refs, 10u);
+  EXPECT_LE(metrics.shared_string_blobs, shard_set->size());
+
+  // Writes copy the value.
+  Run({"append", "key0", "x"});
+  EXPECT_EQ(Run({"get", "key0"}), value + "x");
+  EXPECT_EQ(Run({"get", "key1"}), value);
+  EXPECT_EQ(GetMetrics().shared_string_refs, 9u);
+
+  for (unsigned i = 1; i < 10; i++)
+    Run({"del", StrCat("key", i)});
+  metrics = GetMetrics();
+  EXPECT_EQ(metrics.shared_string_refs, 0u);
+  EXPECT_EQ(metrics.shared_string_blobs, 0u);
+
+  shard_set->RunBriefInParallel([](EngineShard*) { CompactObj::EnableSharedStrings(0); });
+}
+
+TEST_F(StringFamilyTest, OptimisticMGet) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_tx_optimistic_reads, true);
+
+  Run({"mset", "x", "1", "y", "2", "z", "3"});
+  auto resp = Run({"mget", "x", "y", "z", "w"});
+  ASSERT_THAT(resp, ArrLen(4));
+  EXPECT_THAT(resp.GetVec(), ElementsAre("1", "2", "3", ArgType(RespExpr::NIL)));
+
+  if (GetDebugInfo().shards_count > 1) {
+    auto metrics = GetMetrics();
+    EXPECT_EQ(metrics.coordinator_stats.tx_optimistic_read_cnt, 1u);
+    EXPECT_EQ(metrics.coordinator_stats.tx_optimistic_conflict_cnt, 0u);
+  }
+
+  // Concurrent writes of both keys, the reads must never observe only one of them
+  auto set_fb = pp_->at(1)->LaunchFiber([&] {
+    for (size_t i = 1; i < 2000; ++i)
+      Run({"mset", "x", StrCat(i), "y", StrCat(i)});
+  });
+
+  auto mget_fb = pp_->at(0)->LaunchFiber([&] {
+    for (size_t i = 0; i < 1000; ++i) {
+      auto ivec = ToIntArr(Run({"mget", "x", "y"}));
+      ASSERT_EQ(ivec[0], ivec[1]);
+    }
+  });
+
+  set_fb.Join();
+  mget_fb.Join();
+}
+
+TEST_F(StringFamilyTest, HotKeyReplication) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_hot_key_replication, true);
+  absl::SetFlag(&FLAGS_hot_key_min_reads, 10);
+  Run({"flushall"});  // recreate the tables with top keys tracking
+
+  Run({"set", "key", "v1"});
+  for (unsigned i = 0; i < 20; ++i)
+    EXPECT_EQ(Run({"get", "key"}), "v1");
+
+  // The value is published asynchronously
+  ExpectConditionWithinTimeout([&] {
+    EXPECT_EQ(Run({"get", "key"}), "v1");
+    return GetMetrics().coordinator_stats.hot_key_cache_hits > 0;
+  });
+
+  // Writes are visible right away
+  Run({"set", "key", "v2"});
+  EXPECT_EQ(Run({"get", "key"}), "v2");
+  Run({"del", "key"});
+  EXPECT_THAT(Run({"get", "key"}), ArgType(RespExpr::NIL));
+}
+
+TEST_F(StringFamilyTest, SplitCounter) {
+  absl::FlagSaver fs;
+  SetTestFlag("split_counter_prefix", "cnt:");
+  SetTestFlag("split_counter_flush_ms", "100000");  // fold only on reads
+  ResetService();
+
+  // The first increment of the thread hops to the shard and opens the cell
+  EXPECT_THAT(Run({"incr", "cnt:a"}), IntArg(1));
+  EXPECT_THAT(Run({"incrby", "cnt:a", "5"}), IntArg(6));
+  EXPECT_THAT(Run({"decr", "cnt:a"}), IntArg(5));
+  EXPECT_EQ(GetMetrics().coordinator_stats.split_counter_incrs, 2u);
+
+  vector<Fiber> fibers;
+  for (unsigned i = 0; i < 4; ++i) {
+    fibers.push_back(pp_->at(i % pp_->size())->LaunchFiber([&] {
+      for (unsigned j = 0; j < 100; ++j)
+        Run({"incr", "cnt:a"});
+    }));
+  }
+  for (auto& fb : fibers)
+    fb.Join();
+
+  // GET folds the cells of all threads
+  EXPECT_EQ(Run({"get", "cnt:a"}), "405");
+  EXPECT_THAT(Run({"incr", "cnt:a"}), IntArg(406));
+
+  // Errors are reported by the hop that opens the cell
+  Run({"set", "cnt:s", "foo"});
+  EXPECT_THAT(Run({"incr", "cnt:s"}), ErrArg("not an integer"));
+
+  // Other keys are not affected, neither are transactions
+  EXPECT_THAT(Run({"incr", "a"}), IntArg(1));
+  EXPECT_THAT(Run({"incr", "a"}), IntArg(2));
+  Run({"multi"});
+  Run({"incr", "cnt:b"});
+  Run({"incr", "cnt:b"});
+  EXPECT_THAT(Run({"exec"}), RespArray(ElementsAre(IntArg(1), IntArg(2))));
+
+  // The flusher folds the cells periodically
+  SetTestFlag("split_counter_flush_ms", "1");
+  ResetService();
+  EXPECT_THAT(Run({"incr", "cnt:c"}), IntArg(1));
+  EXPECT_THAT(Run({"incr", "cnt:c"}), IntArg(2));
+  ExpectConditionWithinTimeout([&] { return Run({"getrange", "cnt:c", "0", "-1"}) == "2"; });
+}
+
 TEST_F(StringFamilyTest, MGetCachingModeBug2276) {
   absl::FlagSaver fs;
   SetTestFlag("cache_mode", "true");
@@ -9,6 +9,13 @@
 
 ABSL_FLAG(bool, enable_top_keys_tracking, false,
           "Enables / disables tracking of hot keys debugging feature");
+ABSL_FLAG(bool, hot_key_replication, false,
+          "If true, the values of hot string keys that are rarely written are replicated to all "
+          "threads, which serve GET for them without a hop to the shard of the key. "
+          "Implies enable_top_keys_tracking");
+ABSL_FLAG(uint32_t, hot_key_min_reads, 1000,
+          "Number of reads after which a key is considered hot and of reads without writes "
+          "after which its value is replicated, see hot_key_replication");
 
 namespace dfly {
 
@@ -47,23 +54,32 @@ DbTableStats& DbTableStats::operator+=(const DbTableStats& o) {
 }
 
 SlotStats& SlotStats::operator+=(const SlotStats& o) {
-  static_assert(sizeof(SlotStats) == 32);
+  static_assert(sizeof(SlotStats) == 56);
 
   ADD(key_count);
   ADD(total_reads);
   ADD(total_writes);
   ADD(memory_bytes);
+  ADD(total_read_bytes);
+  ADD(total_write_bytes);
+  ADD(ops_per_sec);
   return *this;
 }
 
 DbTable::DbTable(PMR_NS::memory_resource* mr, DbIndex db_index)
     : prime(kInitSegmentLog, detail::PrimeTablePolicy{}, mr),
+#ifdef DF_INLINE_EXPIRE
+      expire(&prime),
+#else
       expire(0, detail::ExpireTablePolicy{}, mr),
+#endif
       mcflag(0, detail::ExpireTablePolicy{}, mr),
-      top_keys({.enabled = absl::GetFlag(FLAGS_enable_top_keys_tracking)}),
+      top_keys({.enabled = absl::GetFlag(FLAGS_enable_top_keys_tracking) ||
+                         absl::GetFlag(FLAGS_hot_key_replication)}),
       index(db_index) {
   if (ClusterConfig::IsEnabled()) {
     slots_stats.resize(ClusterConfig::kMaxSlotNum + 1);
+    slots_sampled_ops.resize(ClusterConfig::kMaxSlotNum + 1);
   }
 }
 
@@ -75,6 +91,12 @@ void DbTable::Clear() {
   prime.Clear();
   expire.Clear();
   mcflag.Clear();
+  expiring_fields.clear();
+  expiring_fields_cursor.clear();
+  expiry_wheel.Clear();
+  slot_keys.Clear();
+  big_keys.Clear();
+  big_keys_cursor = PrimeTable::Cursor{};
   stats = DbTableStats{};
 }
 
@@ -4,7 +4,10 @@
 
 #pragma once
 
+#include <absl/container/btree_map.h>
 #include <absl/container/flat_hash_map.h>
+#include <absl/container/flat_hash_set.h>
+#include <xxhash.h>
 
 #include <boost/smart_ptr/intrusive_ptr.hpp>
 #include <boost/smart_ptr/intrusive_ref_counter.hpp>
@@ -12,8 +15,12 @@
 #include "core/expire_period.h"
 #include "core/intent_lock.h"
 #include "server/cluster/cluster_config.h"
+#include "server/big_keys.h"
+#include "server/cluster/slot_key_index.h"
 #include "server/conn_context.h"
 #include "server/detail/table.h"
+#include "server/expiry_wheel.h"
+#include "server/hot_key_cache.h"
 #include "server/top_keys.h"
 
 extern "C" {
@@ -24,13 +31,187 @@ namespace dfly {
 using PrimeKey = detail::PrimeKey;
 using PrimeValue = detail::PrimeValue;
 
-using PrimeTable = DashTable<PrimeKey, PrimeValue, detail::PrimeTablePolicy>;
-using ExpireTable = DashTable<PrimeKey, ExpirePeriod, detail::ExpireTablePolicy>;
+using PrimeTable = DashTable<PrimeKey, detail::PrimeSlotValue, detail::PrimeTablePolicy>;
 
 /// Iterators are invalidated when new keys are added to the table or some entries are deleted.
 /// Iterators are still valid if a different entry in the table was mutated.
 using PrimeIterator = PrimeTable::iterator;
 using PrimeConstIterator = PrimeTable::const_iterator;
+
+#ifdef DF_INLINE_EXPIRE
+
+// Exposes the expiry periods that are kept in the prime table slots (see PrimeSlotValue) with
+// the interface of the expire table. Its entries are the prime entries with the expire bit set,
+// so unlike with the separate table, its iterators are invalidated together with the prime ones.
+class InlineExpireTable {
+  template <bool IsConst> class Iterator {
+    using PrimeIt = std::conditional_t<IsConst, PrimeConstIterator, PrimeIterator>;
+    using SlotValue =
+        std::conditional_t<IsConst, const detail::PrimeSlotValue, detail::PrimeSlotValue>;
+
+   public:
+    // Stands for the ExpirePeriod reference of the expire table entries.
+    class PeriodRef {
+     public:
+      explicit PeriodRef(SlotValue* value) : value_(value) {
+      }
+
+      operator ExpirePeriod() const {
+        return value_->expire_period();
+      }
+
+      uint64_t duration_ms() const {
+        return value_->expire_period().duration_ms();
+      }
+
+      bool is_second_precision() const {
+        return value_->expire_period().is_second_precision();
+      }
+
+      template <bool B = IsConst, typename std::enable_if_t<!B>* = nullptr>
+      PeriodRef& operator=(ExpirePeriod period) {
+        value_->set_expire_period(period);
+        return *this;
+      }
+
+     private:
+      SlotValue* value_;
+    };
+
+    struct Pair {
+      std::conditional_t<IsConst, const PrimeKey&, PrimeKey&> first;
+      PeriodRef second;
+
+      Pair* operator->() {
+        return this;
+      }
+    };
+
+    Iterator() = default;
+
+    explicit Iterator(PrimeIt it) : it_(it) {
+    }
+
+    // Conversion from iterator to const_iterator.
+    template <bool B = IsConst, typename std::enable_if_t<B>* = nullptr>
+    Iterator(const Iterator<false>& other) : it_(other.prime_it()) {
+    }
+
+    bool is_done() const {
+      return it_.is_done();
+    }
+
+    Pair operator->() const {
+      auto pair = it_.operator->();
+      return Pair{pair.first, PeriodRef{&pair.second}};
+    }
+
+    PrimeIt prime_it() const {
+      return it_;
+    }
+
+   private:
+    PrimeIt it_;
+  };
+
+ public:
+  static constexpr size_t kSegBytes = PrimeTable::kSegBytes;
+
+  using Cursor = PrimeTable::Cursor;
+  using iterator = Iterator<false>;
+  using const_iterator = Iterator<true>;
+
+  explicit InlineExpireTable(PrimeTable* prime) : prime_(prime) {
+  }
+
+  template <typename U> iterator Find(U&& key) {
+    return FromPrime(prime_->Find(std::forward<U>(key)));
+  }
+
+  template <typename U> const_iterator Find(U&& key) const {
+    return FromPrime(std::as_const(*prime_).Find(std::forward<U>(key)));
+  }
+
+  // The expiry entry of the key that it points to, does not need a lookup.
+  template <typename It> static auto FromPrime(It it) {
+    using Res = std::conditional_t<std::is_same_v<It, PrimeIterator>, iterator, const_iterator>;
+    return (!it.is_done() && it->second.HasExpire()) ? Res{it} : Res{};
+  }
+
+  // Sets the expiry period of an existing prime entry. Fails if it already has one.
+  std::pair<iterator, bool> Insert(const PrimeKey& key, ExpirePeriod period);
+
+  // Same as above for a prime entry that has no valid expiry period.
+  iterator InsertNew(const PrimeKey& key, ExpirePeriod period);
+
+  size_t Erase(const PrimeKey& key) {
+    iterator it = Find(key);
+    if (it.is_done())
+      return 0;
+    Erase(it);
+    return 1;
+  }
+
+  void Erase(iterator it);
+
+  // Traverses the prime table and calls cb for the entries with expiry.
+  template <typename Cb> Cursor Traverse(Cursor curs, Cb&& cb) {
+    return prime_->Traverse(curs, [&](PrimeIterator it) {
+      if (it->second.HasExpire())
+        cb(iterator{it});
+    });
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  // The periods are part of the prime table segments.
+  size_t mem_usage() const {
+    return 0;
+  }
+
+  void Clear() {
+    size_ = 0;
+  }
+
+  // The periods take no space of their own, reserving the prime table is enough.
+  void Reserve(size_t) {
+  }
+
+ private:
+  PrimeTable* prime_;
+  size_t size_ = 0;
+};
+
+inline auto InlineExpireTable::Insert(const PrimeKey& key, ExpirePeriod period)
+    -> std::pair<iterator, bool> {
+  PrimeIterator it = prime_->Find(key);
+  if (it.is_done() || it->second.HasExpire())
+    return {iterator{it}, false};
+
+  return {InsertNew(key, period), true};
+}
+
+inline auto InlineExpireTable::InsertNew(const PrimeKey& key, ExpirePeriod period) -> iterator {
+  PrimeIterator it = prime_->Find(key);
+  it->second.set_expire_period(period);
+  it->second.SetExpire(true);
+  ++size_;
+  return iterator{it};
+}
+
+inline void InlineExpireTable::Erase(iterator it) {
+  it.prime_it()->second.SetExpire(false);
+  --size_;
+}
+
+using ExpireTable = InlineExpireTable;
+
+#else
+using ExpireTable = DashTable<PrimeKey, ExpirePeriod, detail::ExpireTablePolicy>;
+#endif
+
 using ExpireIterator = ExpireTable::iterator;
 using ExpireConstIterator = ExpireTable::const_iterator;
 
@@ -55,6 +236,15 @@ struct SlotStats {
   uint64_t total_reads = 0;
   uint64_t total_writes = 0;
   uint64_t memory_bytes = 0;
+
+  // Approximate payload of the reads and writes: the key and, for strings, the value length.
+  // Writes of other types count the change of their memory usage instead of the value.
+  uint64_t total_read_bytes = 0;
+  uint64_t total_write_bytes = 0;
+
+  // Reads and writes per second, sampled by the shard heartbeat.
+  uint64_t ops_per_sec = 0;
+
   SlotStats& operator+=(const SlotStats& o);
 };
 
@@ -79,7 +269,61 @@ struct DbTableStats {
   DbTableStats& operator+=(const DbTableStats& o);
 };
 
-using LockTable = absl::flat_hash_map<std::string, IntentLock>;
+// Transaction locks of the keys of a db, striped by the fingerprint of the lock key. Keys that
+// share a stripe share its lock, which can only cause false conflicts between them: transactions
+// are ordered by the transaction queue, locks only decide whether they may run out of order.
+// Locking neither allocates nor copies keys and the table is small enough to stay in cache.
+class LockTable {
+ public:
+  static constexpr unsigned kNumStripes = 1 << 12;
+
+  LockTable() : locks_{new IntentLock[kNumStripes]} {
+  }
+
+  // Returns true if the lock was acquired. In any case, the intent is recorded.
+  bool Acquire(std::string_view key, IntentLock::Mode mode) {
+    IntentLock& lock = locks_[Stripe(key)];
+    num_locked_ += lock.IsFree();
+    return lock.Acquire(mode);
+  }
+
+  void Release(std::string_view key, IntentLock::Mode mode, unsigned count = 1) {
+    IntentLock& lock = locks_[Stripe(key)];
+    lock.Release(mode, count);
+    num_locked_ -= lock.IsFree();
+  }
+
+  // The lock that key shares with the other keys of its stripe
+  const IntentLock& Find(std::string_view key) const {
+    return locks_[Stripe(key)];
+  }
+
+  // Number of locked stripes
+  size_t size() const {
+    return num_locked_;
+  }
+
+  // Calls cb(stripe, lock) for every locked stripe
+  template <typename Cb> void ForEachLocked(Cb&& cb) const {
+    for (unsigned i = 0; i < kNumStripes; i++) {
+      if (!locks_[i].IsFree())
+        cb(i, locks_[i]);
+    }
+  }
+
+  void swap(LockTable& other) {
+    locks_.swap(other.locks_);
+    std::swap(num_locked_, other.num_locked_);
+  }
+
+ private:
+  static unsigned Stripe(std::string_view key) {
+    return XXH3_64bits(key.data(), key.size()) % kNumStripes;
+  }
+
+  std::unique_ptr<IntentLock[]> locks_;
+  size_t num_locked_ = 0;
+};
 
 // A single Db table that represents a table that can be chosen with "SELECT" command.
 struct DbTable : boost::intrusive_ref_counter<DbTable, boost::thread_unsafe_counter> {
@@ -95,15 +339,96 @@ struct DbTable : boost::intrusive_ref_counter<DbTable, boost::thread_unsafe_coun
 
   mutable DbTableStats stats;
   std::vector<SlotStats> slots_stats;
+  std::vector<uint64_t> slots_sampled_ops;  // total ops of each slot at the last rate sample.
   ExpireTable::Cursor expire_cursor;
 
+  // Segment ids where the next segment merging step starts from.
+  uint32_t prime_merge_cursor = 0;
+  uint32_t expire_merge_cursor = 0;
+
+  // Position of the cold values compression pass.
+  PrimeTable::Cursor compress_cursor;
+
+  // Position of the pass that converts small hashes and sorted sets back to listpacks.
+  PrimeTable::Cursor shrink_cursor;
+
+  // Position of the cold containers offloading pass.
+  PrimeTable::Cursor offload_cursor;
+
+  // Position of the cold strings offloading pass.
+  PrimeTable::Cursor offload_cold_cursor;
+
+  // Position of the tiered compaction pass.
+  PrimeTable::Cursor tiered_compact_cursor;
+
+  // The largest keys and the value size histograms, see DbSlice::ScanBigKeysStep.
+  BigKeys big_keys;
+  PrimeTable::Cursor big_keys_cursor;
+
+  // Keys of the hashes and sets that have members with expiry time, mapped to the position
+  // of the background expiry pass over their members. Entries of deleted keys or of values
+  // without expiring members are dropped lazily by DbSlice::DeleteExpiredFieldsStep.
+  struct FieldExpiryState {
+    uint32_t cursor = 0;
+    bool ttl_seen = false;  // whether the current pass has seen members with expiry time.
+  };
+  absl::btree_map<std::string, FieldExpiryState> expiring_fields;
+  std::string expiring_fields_cursor;  // the key where the next step starts.
+
+  // Keys of the streams that XADD trims approximately, mapped to their threshold. XADD trims
+  // inline only once a whole node is over it and DbSlice::TrimStreamsStep trims them in the
+  // background in between. Entries of deleted keys are dropped lazily by the step.
+  struct StreamRetention {
+    bool by_id = false;  // MINID if set, MAXLEN otherwise.
+    uint64_t max_len = 0;
+    uint64_t min_ms = 0, min_seq = 0;
+  };
+  absl::btree_map<std::string, StreamRetention> stream_retention;
+  std::string stream_retention_cursor;  // the key where the next step starts.
+
+  // Deadlines of the expiring keys, used by the active expiry when --expiry_wheel is set.
+  ExpiryWheel expiry_wheel;
+
+  // Keys of every cluster slot, maintained when --cluster_slot_key_index is set.
+  SlotKeyIndex slot_keys;
+
   TopKeys top_keys;
+
+  // Hot keys that are tracked for replication to the threads, see DbSlice::TrackHotRead.
+  absl::flat_hash_map<std::string, HotKeyState> hot_keys;
+
+  // Keys deleted since the last save started, written as tombstones by delta snapshots.
+  // Tracked only while there is a save to base a delta on, see DbSlice::StartSave.
+  absl::flat_hash_set<std::string> deleted_keys;
+
   DbIndex index;
 
+  // The share of this shard in the memory quota of the database, 0 if there is no quota.
+  size_t memory_quota = 0;
+
   explicit DbTable(PMR_NS::memory_resource* mr, DbIndex index);
   ~DbTable();
 
   void Clear();
+
+  // Memory used by the dictionaries and the objects of the database.
+  size_t MemoryUsage() const {
+    return prime.mem_usage() + expire.mem_usage() + stats.obj_memory_usage;
+  }
+
+  // The expiry entry of the key that it points to.
+  ExpireIterator FindExpire(PrimeIterator it) {
+#ifdef DF_INLINE_EXPIRE
+    return ExpireTable::FromPrime(it);
+#else
+    return it->second.HasExpire() ? expire.Find(it->first) : ExpireIterator{};
+#endif
+  }
+
+  // How much the memory usage may grow before the quota is reached, negative if it is exceeded.
+  ssize_t QuotaBudget() const {
+    return memory_quota ? ssize_t(memory_quota) - ssize_t(MemoryUsage()) : SSIZE_MAX;
+  }
 };
 
 // We use reference counting semantics of DbTable when doing snapshotting.
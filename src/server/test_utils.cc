@@ -77,6 +77,10 @@ void TestConnection::SendInvalidationMessageAsync(InvalidationMessage msg) {
   invalidate_messages.push_back(move(msg));
 }
 
+void TestConnection::SendSUnsubscribeAsync(SUnsubscribeMessage msg) {
+  sunsubscribe_messages.push_back(move(msg));
+}
+
 std::string TestConnection::RemoteEndpointStr() const {
   return "";
 }
@@ -255,9 +259,10 @@ void BaseFamilyTest::ResetService() {
           }
 
           LOG(ERROR) << "TxLocks for shard " << es->shard_id();
-          for (const auto& k_v : es->db_slice().GetDBTable(0)->trans_locks) {
-            LOG(ERROR) << "Key " << k_v.first << " " << k_v.second;
-          }
+          es->db_slice().GetDBTable(0)->trans_locks.ForEachLocked(
+              [](unsigned stripe, const IntentLock& lock) {
+                LOG(ERROR) << "Stripe " << stripe << " " << lock;
+              });
         }
       });
     }
@@ -469,6 +474,22 @@ auto BaseFamilyTest::GetMC(MP::CmdType cmd_type, std::initializer_list<std::stri
   return conn->SplitLines();
 }
 
+auto BaseFamilyTest::RunMCLine(std::string_view line, std::string_view value) -> MCResponse {
+  if (!ProactorBase::IsProactorThread()) {
+    return pp_->at(0)->Await([&] { return this->RunMCLine(line, value); });
+  }
+
+  string buf = absl::StrCat(line, "\r\n");
+  MP::Command cmd;
+  uint32_t consumed = 0;
+  CHECK_EQ(MP::OK, MP{}.Parse(buf, &consumed, &cmd)) << line;
+
+  TestConnWrapper* conn = AddFindConn(Protocol::MEMCACHE, GetId());
+  service_->DispatchMC(cmd, value, conn->cmd_cntx());
+
+  return conn->SplitLines();
+}
+
 int64_t BaseFamilyTest::CheckedInt(ArgSlice list) {
   RespExpr resp = Run(list);
   if (resp.type == RespExpr::INT64) {
@@ -581,6 +602,14 @@ size_t BaseFamilyTest::InvalidationMessagesLen(string_view conn_id) const {
   return it->second->conn()->invalidate_messages.size();
 }
 
+size_t BaseFamilyTest::SUnsubscribeMessagesLen(string_view conn_id) const {
+  auto it = connections_.find(conn_id);
+  if (it == connections_.end())
+    return 0;
+
+  return it->second->conn()->sunsubscribe_messages.size();
+}
+
 const facade::Connection::PubMessage& BaseFamilyTest::GetPublishedMessage(string_view conn_id,
                                                                           size_t index) const {
   auto it = connections_.find(conn_id);
@@ -596,6 +625,16 @@ const facade::Connection::InvalidationMessage& BaseFamilyTest::GetInvalidationMe
   return it->second->GetInvalidationMessage(index);
 }
 
+const facade::Connection::SUnsubscribeMessage& BaseFamilyTest::GetSUnsubscribeMessage(
+    string_view conn_id, size_t index) const {
+  auto it = connections_.find(conn_id);
+  CHECK(it != connections_.end());
+
+  const auto& msgs = it->second->conn()->sunsubscribe_messages;
+  CHECK_LT(index, msgs.size());
+  return msgs[index];
+}
+
 ConnectionContext::DebugInfo BaseFamilyTest::GetDebugInfo(const std::string& id) const {
   auto it = connections_.find(id);
   CHECK(it != connections_.end());
@@ -27,6 +27,8 @@ class TestConnection : public facade::Connection {
 
   void SendInvalidationMessageAsync(InvalidationMessage msg) final;
 
+  void SendSUnsubscribeAsync(SUnsubscribeMessage msg) final;
+
   bool IsPrivileged() const override {
     return is_privileged_;
   }
@@ -38,6 +40,8 @@ class TestConnection : public facade::Connection {
 
   std::vector<InvalidationMessage> invalidate_messages;
 
+  std::vector<SUnsubscribeMessage> sunsubscribe_messages;
+
  private:
   io::StringSink* sink_;
   bool is_privileged_ = false;
@@ -88,6 +92,9 @@ class BaseFamilyTest : public ::testing::Test {
   MCResponse RunMC(MemcacheParser::CmdType cmd_type, std::string_view key = std::string_view{});
   MCResponse GetMC(MemcacheParser::CmdType cmd_type, std::initializer_list<std::string_view> list);
 
+  // Parses a full memcache command line, e.g. "mg foo v", and dispatches it.
+  MCResponse RunMCLine(std::string_view line, std::string_view value = std::string_view{});
+
   int64_t CheckedInt(std::initializer_list<std::string_view> list) {
     return CheckedInt(ArgSlice{list.begin(), list.size()});
   }
@@ -129,12 +136,17 @@ class BaseFamilyTest : public ::testing::Test {
 
   size_t InvalidationMessagesLen(std::string_view conn_id) const;
 
+  size_t SUnsubscribeMessagesLen(std::string_view conn_id) const;
+
   const facade::Connection::PubMessage& GetPublishedMessage(std::string_view conn_id,
                                                             size_t index) const;
 
   const facade::Connection::InvalidationMessage& GetInvalidationMessage(std::string_view conn_id,
                                                                         size_t index) const;
 
+  const facade::Connection::SUnsubscribeMessage& GetSUnsubscribeMessage(std::string_view conn_id,
+                                                                        size_t index) const;
+
   static absl::flat_hash_set<std::string> GetLastUsedKeys();
   static void ExpectConditionWithinTimeout(const std::function<bool()>& condition,
                                            absl::Duration timeout = absl::Seconds(10));
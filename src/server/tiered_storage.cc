@@ -8,7 +8,12 @@ extern "C" {
 #include "redis/object.h"
 }
 
+#include <absl/base/internal/endian.h>
+#include <absl/random/random.h>
+#include <fcntl.h>
 #include <mimalloc.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "absl/cleanup/cleanup.h"
 #include "base/flags.h"
@@ -18,7 +23,22 @@ extern "C" {
 #include "util/fibers/fibers.h"
 
 ABSL_FLAG(uint32_t, tiered_storage_max_pending_writes, 32,
-          "Maximal number of pending writes per thread");
+          "Maximal number of pending writes per thread. Fewer of them are kept in flight while "
+          "the writes exceed tiered_write_latency_target_usec.");
+ABSL_FLAG(bool, tiered_offload_cold, false,
+          "If true, strings are offloaded by a background sweep in the order of their access "
+          "frequency, coldest first, instead of upon write. External strings that become hot "
+          "again are loaded back by their reads.");
+ABSL_FLAG(uint32_t, tiered_page_cache_mb, 0,
+          "Size in MB of the per thread cache of recently read pages of the backing file. "
+          "Useful with backing_file_direct, which bypasses the page cache of the kernel. "
+          "0 disables the cache.");
+ABSL_FLAG(bool, tiered_persistent, false,
+          "If true, the backing files are kept across restarts. The snapshots saved to disk "
+          "record the location of the external values instead of their contents, and loading "
+          "them at startup maps these values back to the kept files without copying them. "
+          "Such a snapshot can be loaded only as long as the backing files were not written "
+          "after it was saved, for example by the save on shutdown.");
 ABSL_FLAG(uint32_t, tiered_storage_throttle_us, 1,
           "Slow down tiered storage writes for at most this usec in case of I/O saturation "
           "specified by tiered_storage_max_pending_writes. 0 - do not throttle.");
@@ -32,6 +52,9 @@ using absl::GetFlag;
 constexpr size_t kBlockLen = 4096;
 constexpr size_t kBlockAlignment = 4096;
 
+// Reads of more pages bypass the page cache, so that big values do not evict hot pages.
+constexpr size_t kMaxCachedReadPages = 4;
+
 constexpr unsigned kSmallBinLen = 34;
 constexpr unsigned kMaxSmallBin = 2032;
 
@@ -86,17 +109,67 @@ static string BackingFileName(string_view base, unsigned index) {
   return absl::StrCat(base, "-", absl::Dec(index, absl::kZeroPad4), ".ssd");
 }
 
-static size_t ExternalizeEntry(size_t item_offset, DbTableStats* stats, PrimeValue* entry) {
+static optional<uint64_t> ReadGeneration(const string& path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return nullopt;
+
+  char buf[8];
+  ssize_t res = read(fd, buf, sizeof(buf));
+  close(fd);
+  if (res != sizeof(buf))
+    return nullopt;
+  uint64_t generation = absl::little_endian::Load64(buf);
+  return generation ? optional{generation} : nullopt;
+}
+
+// Replaces the file with rename, so that it holds either the old or the new generation if the
+// process crashes meanwhile. Synced before the backing file is modified, which blocks the
+// thread, but only for the first write after a snapshot.
+static error_code WriteGeneration(const string& path, uint64_t generation) {
+  string tmp_path = absl::StrCat(path, ".tmp");
+  int fd = open(tmp_path.c_str(), O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0666);
+  if (fd < 0)
+    return error_code{errno, system_category()};
+
+  char buf[8];
+  absl::little_endian::Store64(buf, generation);
+  bool written = write(fd, buf, sizeof(buf)) == sizeof(buf) && fdatasync(fd) == 0;
+  error_code ec = written ? error_code{} : error_code{errno, system_category()};
+  close(fd);
+  if (!ec && rename(tmp_path.c_str(), path.c_str()) != 0)
+    ec = error_code{errno, system_category()};
+  return ec;
+}
+
+static uint64_t NewGeneration() {
+  absl::BitGen bitgen;
+  uint64_t generation;
+  do {
+    generation = absl::Uniform<uint64_t>(bitgen);
+  } while (generation == 0);
+  return generation;
+}
+
+// Listpack blobs are counted in the table stats, external values have no encoding.
+static bool IsListpackBlob(const PrimeValue& pv) {
+  return (pv.ObjType() == OBJ_HASH && pv.Encoding() == kEncodingListPack) ||
+         (pv.ObjType() == OBJ_ZSET && pv.Encoding() == OBJ_ENCODING_LISTPACK);
+}
+
+static size_t ExternalizeEntry(size_t item_offset, size_t item_size, DbTableStats* stats,
+                               PrimeValue* entry) {
   CHECK(entry->HasIoPending());
 
   entry->SetIoPending(false);
 
   size_t heap_size = entry->MallocUsed();
-  size_t item_size = entry->Size();
+  unsigned obj_type = entry->ObjType();
 
-  stats->AddTypeMemoryUsage(entry->ObjType(), -heap_size);
+  stats->AddTypeMemoryUsage(obj_type, -heap_size);
+  stats->listpack_blob_cnt -= IsListpackBlob(*entry);
 
-  entry->SetExternal(item_offset, item_size);
+  entry->SetExternal(item_offset, item_size, obj_type);
 
   stats->tiered_entries += 1;
   stats->tiered_size += item_size;
@@ -277,7 +350,7 @@ unsigned TieredStorage::InflightWriteRequest::ExternalizeEntries(PerDb::BinRecor
       size_t item_offset = page_index_ * 4096 + offset + i * bin_size;
       CHECK(!pit.is_done());
 
-      ExternalizeEntry(item_offset, stats, &pit->second);
+      ExternalizeEntry(item_offset, pit->second.Size(), stats, &pit->second);
       VLOG(2) << "ExternalizeEntry: " << it->first;
       bin_record->enqueued_entries.erase(it);
     }
@@ -303,7 +376,11 @@ void TieredStorage::InflightWriteRequest::Undo(PerDb::BinRecord* bin_record, DbS
 }
 
 TieredStorage::TieredStorage(DbSlice* db_slice, size_t max_file_size)
-    : db_slice_(*db_slice), max_file_size_(max_file_size) {
+    : db_slice_(*db_slice),
+      max_file_size_(max_file_size),
+      page_cache_(size_t(GetFlag(FLAGS_tiered_page_cache_mb)) << 20),
+      offload_cold_(GetFlag(FLAGS_tiered_offload_cold)),
+      persistent_(GetFlag(FLAGS_tiered_persistent)) {
 }
 
 TieredStorage::~TieredStorage() {
@@ -314,8 +391,23 @@ TieredStorage::~TieredStorage() {
 
 error_code TieredStorage::Open(const string& base) {
   string path = BackingFileName(base, db_slice_.shard_id());
+  generation_path_ = absl::StrCat(path, ".gen");
+
+  // Free segments are reused only after their disk space is released, see ReleaseFreeSpace.
+  alloc_.set_hold_released(true);
+
+  // The contents of the file are kept only if they have a generation, which the snapshots that
+  // refer to them must match. A file truncated without the persistent mode has none.
+  optional<uint64_t> generation;
+  if (persistent_) {
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0 && st.st_size > 0)
+      generation = ReadGeneration(generation_path_);
+  } else {
+    unlink(generation_path_.c_str());
+  }
 
-  error_code ec = io_mgr_.Open(path);
+  error_code ec = io_mgr_.Open(path, generation.has_value());
   if (!ec) {
     size_t initial_size = io_mgr_.Span();
     if (initial_size) {  // Add initial storage.
@@ -323,30 +415,178 @@ error_code TieredStorage::Open(const string& base) {
       alloc_.AddStorage(0, initial_size);
     }
   }
+
+  if (!ec && persistent_) {
+    if (generation) {
+      generation_ = *generation;
+      sealed_ = restoring_ = true;
+    } else {
+      generation_ = NewGeneration();
+      ec = WriteGeneration(generation_path_, generation_);
+    }
+  }
   return ec;
 }
 
+uint64_t TieredStorage::SealForSnapshot() {
+  DCHECK(persistent_);
+  sealed_ = true;
+  return generation_;
+}
+
+error_code TieredStorage::RestoreExternal(DbIndex db_index, uint64_t generation, size_t offset,
+                                          size_t size, unsigned obj_type, PrimeValue* dest) {
+  if (!restoring_ || generation != generation_) {
+    LOG(ERROR) << "The snapshot refers to another version of the backing file " << generation_path_;
+    return make_error_code(errc::operation_not_permitted);
+  }
+
+  bool reserved = false;
+  if (size > 0 && offset + size <= io_mgr_.Span()) {
+    if (offset % kBlockLen == 0) {
+      reserved = alloc_.MallocAt(offset, size);
+    } else if (offset % kBlockLen + size <= kBlockLen) {
+      // An entry of a small bin page, whose block is reserved with its first entry.
+      uint32_t offs_page = offset / kBlockLen;
+      auto [it, inserted] = page_refcnt_.emplace(offs_page, 0);
+      reserved = !inserted || alloc_.MallocAt(offs_page * kBlockLen, kBlockLen);
+      if (reserved)
+        ++it->second;
+      else
+        page_refcnt_.erase(it);
+    }
+  }
+  if (!reserved) {
+    LOG(ERROR) << "Invalid external value " << offset << "/" << size << " in the snapshot";
+    return make_error_code(errc::invalid_argument);
+  }
+
+  dest->SetExternal(offset, size, obj_type);
+
+  DbTableStats* stats = db_slice_.MutableStats(db_index);
+  stats->tiered_entries += 1;
+  stats->tiered_size += size;
+  return error_code{};
+}
+
+void TieredStorage::Unseal() {
+  if (!sealed_)
+    return;
+
+  DCHECK(!restoring_);
+  sealed_ = false;
+  generation_ = NewGeneration();
+  if (error_code ec = WriteGeneration(generation_path_, generation_); ec) {
+    // Otherwise the snapshots saved so far would be restored from the modified file.
+    LOG(ERROR) << "Could not write " << generation_path_ << ": " << ec.message();
+    if (unlink(generation_path_.c_str()) != 0 && errno != ENOENT)
+      LOG(FATAL) << "Could not remove " << generation_path_;
+  }
+}
+
 std::error_code TieredStorage::Read(size_t offset, size_t len, char* dest) {
   DVLOG(1) << "Read " << offset << " " << len;
 
-  return io_mgr_.Read(offset, io::MutableBytes{reinterpret_cast<uint8_t*>(dest), len});
+  constexpr size_t kPageSize = PageCache::kPageSize;
+  size_t start = offset - offset % kPageSize;
+  size_t end = (offset + len + kPageSize - 1) / kPageSize * kPageSize;
+  if (page_cache_.capacity() == 0 || end - start > kMaxCachedReadPages * kPageSize)
+    return io_mgr_.Read(offset, io::MutableBytes{reinterpret_cast<uint8_t*>(dest), len});
+
+  if (ReadFromCache(offset, len, dest))
+    return error_code{};
+
+  uint64_t epoch = page_cache_.epoch();
+  unique_ptr<char[]> pages(new char[end - start]);
+  error_code ec =
+      io_mgr_.Read(start, io::MutableBytes{reinterpret_cast<uint8_t*>(pages.get()), end - start});
+  if (ec)
+    return ec;
+
+  for (size_t page = start; page < end; page += kPageSize) {
+    page_cache_.Insert(page, pages.get() + page - start, epoch);
+  }
+  memcpy(dest, pages.get() + offset - start, len);
+  return ec;
+}
+
+int64_t TieredStorage::WriteBlob(string_view blob, std::function<void(size_t, bool)> cb) {
+  DCHECK(!blob.empty());
+  if (restoring_)
+    return -1;
+
+  int64_t res = Malloc(blob.size());
+  if (res < 0) {
+    InitiateGrow(-res);
+    return -1;
+  }
+
+  constexpr size_t kMask = kBlockAlignment - 1;
+  size_t page_size = (blob.size() + kMask) & (~kMask);
+  char* block_ptr = (char*)mi_malloc_aligned(page_size, kBlockAlignment);
+  memcpy(block_ptr, blob.data(), blob.size());
+  stats_.blob_bytes += blob.size();
+
+  auto write_cb = [block_ptr, res, cb = std::move(cb)](int io_res) {
+    mi_free(block_ptr);
+    LOG_IF(ERROR, io_res < 0) << "Error writing to ssd storage "
+                              << util::detail::SafeErrorMessage(-io_res);
+    cb(res, io_res >= 0);
+  };
+
+  page_cache_.Invalidate(res, page_size);
+  Unseal();
+  io_mgr_.WriteAsync(res, string_view{block_ptr, page_size}, std::move(write_cb));
+  ++stats_.tiered_writes;
+  return res;
+}
+
+void TieredStorage::FreeBlob(size_t offset, size_t len) {
+  alloc_.Free(offset, len);
+  stats_.blob_bytes -= len;
+}
+
+bool TieredStorage::ReadFromCache(size_t offset, size_t len, char* dest) {
+  if (page_cache_.capacity() == 0)
+    return false;
+
+  constexpr size_t kPageSize = PageCache::kPageSize;
+  size_t start = offset - offset % kPageSize;
+  const char* pages[kMaxCachedReadPages];
+  unsigned num_pages = 0;
+  for (size_t page = start; page < offset + len; page += kPageSize) {
+    if (num_pages == kMaxCachedReadPages || !(pages[num_pages++] = page_cache_.Find(page))) {
+      ++stats_.page_cache_misses;
+      return false;
+    }
+  }
+
+  for (unsigned i = 0; i < num_pages; ++i) {
+    size_t page = start + i * kPageSize;
+    size_t from = max(offset, page);
+    size_t to = min(offset + len, page + kPageSize);
+    memcpy(dest + from - offset, pages[i] + from - page, to - from);
+  }
+  ++stats_.page_cache_hits;
+  return true;
 }
 
 void TieredStorage::Free(PrimeIterator it, DbTableStats* stats) {
   PrimeValue& entry = it->second;
   CHECK(entry.IsExternal());
-  DCHECK_EQ(entry.ObjType(), OBJ_STRING);
   auto [offset, len] = entry.GetExternalSlice();
 
   if (offset % kBlockLen == 0) {
-    alloc_.Free(offset, len);
+    pending_frees_.emplace_back(offset, len);
+    pending_free_bytes_ += len;
   } else {
     uint32_t offs_page = offset / kBlockLen;
     auto it = page_refcnt_.find(offs_page);
     CHECK(it != page_refcnt_.end()) << offs_page;
     CHECK_GT(it->second, 0u);
     if (--it->second == 0) {
-      alloc_.Free(offs_page * kBlockLen, kBlockLen);
+      pending_frees_.emplace_back(offs_page * kBlockLen, kBlockLen);
+      pending_free_bytes_ += kBlockLen;
       page_refcnt_.erase(it);
     }
   }
@@ -366,7 +606,7 @@ void TieredStorage::Shutdown() {
 TieredStats TieredStorage::GetStats() const {
   TieredStats res = stats_;
   res.storage_capacity = alloc_.capacity();
-  res.storage_reserved = alloc_.allocated_bytes();
+  res.storage_reserved = alloc_.allocated_bytes() - pending_free_bytes_;
 
   return res;
 }
@@ -394,7 +634,7 @@ void TieredStorage::FinishIoRequest(int io_res, InflightWriteRequest* req) {
   }
   delete req;
   --num_active_requests_;
-  if (num_active_requests_ < GetFlag(FLAGS_tiered_storage_max_pending_writes)) {
+  if (num_active_requests_ < MaxPendingWrites()) {
     this->throttle_ec_.notifyAll();
   }
   VLOG_IF(2, num_active_requests_ == 0) << "Finished active requests";
@@ -403,7 +643,6 @@ void TieredStorage::FinishIoRequest(int io_res, InflightWriteRequest* req) {
 PrimeIterator TieredStorage::Load(DbIndex db_index, PrimeIterator it, string_view key) {
   PrimeValue* entry = &it->second;
   CHECK(entry->IsExternal());
-  DCHECK_EQ(entry->ObjType(), OBJ_STRING);
   auto [offset, size] = entry->GetExternalSlice();
   string res(size, '\0');
   auto ec = Read(offset, size, res.data());
@@ -428,23 +667,80 @@ PrimeIterator TieredStorage::Load(DbIndex db_index, PrimeIterator it, string_vie
     return it;
   }
 
+  FinishLoad(db_index, it, key, res);
+  return it;
+}
+
+void TieredStorage::LoadMany(DbIndex db_index, absl::Span<const string_view> keys) {
+  PrimeTable* pt = db_slice_.GetTables(db_index).first;
+
+  struct PendingLoad {
+    string_view key;
+    size_t offset;
+    string blob;
+  };
+  vector<PendingLoad> pending;
+  for (string_view key : keys) {
+    PrimeIterator it = pt->Find(key);
+    if (IsValid(it) && it->second.IsExternal()) {
+      auto [offset, size] = it->second.GetExternalSlice();
+      pending.push_back(PendingLoad{key, offset, string(size, '\0')});
+    }
+  }
+
+  if (pending.empty())
+    return;
+
+  vector<IoMgr::ReadRequest> reqs;
+  for (PendingLoad& load : pending) {
+    if (!ReadFromCache(load.offset, load.blob.size(), load.blob.data())) {
+      reqs.push_back(IoMgr::ReadRequest{
+          load.offset,
+          io::MutableBytes{reinterpret_cast<uint8_t*>(load.blob.data()), load.blob.size()}});
+    }
+  }
+
+  error_code ec = io_mgr_.ReadMany(reqs);
+  CHECK(!ec) << "TBD";
+
+  // The reads preempt, the entries may have been changed, loaded by another read or deleted
+  // meanwhile.
+  for (const PendingLoad& load : pending) {
+    PrimeIterator it = pt->Find(load.key);
+    if (!IsValid(it) || !it->second.IsExternal() ||
+        it->second.GetExternalSlice().first != load.offset)
+      continue;
+    FinishLoad(db_index, it, load.key, load.blob);
+  }
+}
+
+void TieredStorage::FinishLoad(DbIndex db_index, PrimeIterator it, string_view key,
+                               const string& blob) {
+  PrimeValue* entry = &it->second;
   auto* stats = db_slice_.MutableStats(db_index);
-  Free(it, stats);
-  entry->SetString(res);
+  if (entry->ObjType() == OBJ_STRING) {
+    Free(it, stats);
+    entry->SetString(blob);
+  } else {
+    PrimeValue loaded;
+    error_code ec = codec_.parse(blob, &loaded);
+    CHECK(!ec) << "Corrupted tiered value of " << key << ": " << ec.message();
+
+    loaded.SetSticky(entry->IsSticky());
+    Free(it, stats);
+    loaded.SetExpire(entry->HasExpire());
+    *entry = std::move(loaded);
+    stats->listpack_blob_cnt += IsListpackBlob(*entry);
+  }
 
   size_t heap_size = entry->MallocUsed();
   stats->AddTypeMemoryUsage(entry->ObjType(), heap_size);
-  return it;
 }
 
 error_code TieredStorage::ScheduleOffload(DbIndex db_index, PrimeIterator it, string_view key) {
-  CHECK_EQ(OBJ_STRING, it->second.ObjType());
   DCHECK(!it->second.IsExternal());
   DCHECK(!it->second.HasIoPending());
 
-  // Relevant only for OBJ_STRING, see CHECK above.
-  size_t blob_len = it->second.Size();
-
   if (db_arr_.size() <= db_index) {
     db_arr_.resize(db_index + 1);
   }
@@ -452,10 +748,30 @@ error_code TieredStorage::ScheduleOffload(DbIndex db_index, PrimeIterator it, st
     db_arr_[db_index] = new PerDb;
   }
 
+  // The file must not change until the snapshot that refers to it is loaded.
+  if (restoring_) {
+    ++stats_.flush_skip_cnt;
+    return error_code{};
+  }
+
+  if (it->second.ObjType() != OBJ_STRING) {
+    CHECK(CanOffloadContainers());
+    if (num_active_requests_ >= MaxPendingWrites()) {
+      ++stats_.flush_skip_cnt;
+      return error_code{};
+    }
+
+    string blob = codec_.serialize(it->second);
+    WriteSingle(db_index, it, blob.size(), blob);
+    return error_code{};
+  }
+
+  size_t blob_len = it->second.Size();
+
   if (blob_len > kMaxSmallBin) {
     auto [schedule, res_it] = CanScheduleOffload(db_index, it, key);
     if (schedule) {
-      WriteSingle(db_index, res_it, blob_len);
+      WriteSingle(db_index, res_it, blob_len, {});
     } else {
       VLOG(2) << "Skip WriteSingle for: " << key;
     }
@@ -505,7 +821,6 @@ error_code TieredStorage::ScheduleOffload(DbIndex db_index, PrimeIterator it, st
 }
 
 void TieredStorage::CancelIo(DbIndex db_index, PrimeIterator it) {
-  DCHECK_EQ(OBJ_STRING, it->second.ObjType());
   VLOG(2) << "CancelIo: " << it->first.ToString();
   auto& prime_value = it->second;
 
@@ -516,7 +831,9 @@ void TieredStorage::CancelIo(DbIndex db_index, PrimeIterator it) {
 
   size_t blob_len = prime_value.Size();
   PerDb* db = db_arr_[db_index];
-  if (blob_len > kMaxSmallBin) {
+
+  // Containers are always written as single blobs.
+  if (prime_value.ObjType() != OBJ_STRING || blob_len > kMaxSmallBin) {
     string key = it->first.ToString();
     auto& enqueued_entries = db->bigbin_enqueued_entries;
     auto entry_it = enqueued_entries.find(key);
@@ -552,15 +869,71 @@ void TieredStorage::CancelAllIos(DbIndex db_index) {
   }
 }
 
+bool TieredStorage::StartCompaction(double max_ratio) {
+  FlushFrees();
+  compaction_pages_ = alloc_.GetSparsePages(max_ratio);
+  return !compaction_pages_.empty();
+}
+
+bool TieredStorage::IsCompactionCandidate(const PrimeValue& pv) const {
+  if (!pv.IsExternal() || compaction_pages_.empty())
+    return false;
+
+  size_t offset = pv.GetExternalSlice().first;
+  auto it = upper_bound(compaction_pages_.begin(), compaction_pages_.end(),
+                        pair<size_t, size_t>{offset, SIZE_MAX});
+  if (it == compaction_pages_.begin())
+    return false;
+  --it;
+  return offset < it->first + it->second;
+}
+
+void TieredStorage::Relocate(DbIndex db_index, PrimeIterator it, string_view key) {
+  unsigned max_pending_writes = MaxPendingWrites();
+  if (num_active_requests_ >= max_pending_writes)
+    return;
+
+  it = Load(db_index, it, key);
+  if (!IsValid(it) || it->second.IsExternal() || it->second.HasIoPending())
+    return;
+
+  ++stats_.compaction_moves;
+
+  // Load preempts, hence the writes are checked again so that offloading does not throttle.
+  const PrimeValue& pv = it->second;
+  bool can_offload = pv.ObjType() == OBJ_STRING ? pv.Size() >= kMinBlobLen : CanOffloadContainers();
+  if (can_offload && num_active_requests_ < max_pending_writes)
+    ScheduleOffload(db_index, it, key);
+}
+
+void TieredStorage::ReleaseFreeSpace() {
+  FlushFrees();
+  if (restoring_)
+    return;
+
+  for (auto [offset, len] : alloc_.TakeReleasedRanges()) {
+    VLOG(1) << "Release free range " << offset << "/" << len;
+    auto cb = [this, offset = offset, len = len](int io_res) {
+      LOG_IF(ERROR, io_res < 0) << "Error punching hole in the backing file: "
+                                << util::detail::SafeErrorMessage(-io_res);
+      alloc_.AddFreeRange(offset, len);
+    };
+    page_cache_.Invalidate(offset, len);
+    Unseal();
+    io_mgr_.PunchHoleAsync(offset, len, std::move(cb));
+  }
+}
+
 bool IsObjFitToUnload(const PrimeValue& pv) {
   return pv.ObjType() == OBJ_STRING && !pv.IsExternal() && pv.Size() >= 64 && !pv.HasIoPending();
 };
 
-void TieredStorage::WriteSingle(DbIndex db_index, PrimeIterator it, size_t blob_len) {
+void TieredStorage::WriteSingle(DbIndex db_index, PrimeIterator it, size_t blob_len,
+                                string_view blob) {
   VLOG(2) << "WriteSingle " << blob_len;
   DCHECK(!it->second.HasIoPending());
 
-  int64_t res = alloc_.Malloc(blob_len);
+  int64_t res = Malloc(blob_len);
   if (res < 0) {
     InitiateGrow(-res);
     return;
@@ -572,7 +945,11 @@ void TieredStorage::WriteSingle(DbIndex db_index, PrimeIterator it, size_t blob_
   auto emplace_res = enqueued_entries.emplace(req->key, req);
   CHECK(emplace_res.second);
 
-  it->second.GetString(req->block_ptr);
+  if (blob.empty()) {
+    it->second.GetString(req->block_ptr);
+  } else {
+    memcpy(req->block_ptr, blob.data(), blob_len);
+  }
   it->second.SetIoPending(true);
 
   auto cb = [this, req, db_index](int io_res) {
@@ -582,7 +959,7 @@ void TieredStorage::WriteSingle(DbIndex db_index, PrimeIterator it, size_t blob_
       mi_free(req->block_ptr);
       delete req;
       --num_active_requests_;
-      if (num_active_requests_ < GetFlag(FLAGS_tiered_storage_max_pending_writes)) {
+      if (num_active_requests_ < MaxPendingWrites()) {
         this->throttle_ec_.notifyAll();
       }
     };
@@ -611,18 +988,28 @@ void TieredStorage::WriteSingle(DbIndex db_index, PrimeIterator it, size_t blob_
     }
 
     enqueued_entries.erase(req->key);
-    ExternalizeEntry(req->offset, db_slice_.MutableStats(db_index), &it->second);
+    ExternalizeEntry(req->offset, req->blob_len, db_slice_.MutableStats(db_index), &it->second);
     VLOG_IF(2, num_active_requests_ == 0) << "Finished active requests";
   };
   ++num_active_requests_;
 
+  page_cache_.Invalidate(res, req->page_size);
+  Unseal();
   io_mgr_.WriteAsync(res, string_view{req->block_ptr, req->page_size}, std::move(cb));
   ++stats_.tiered_writes;
 }
 
+unsigned TieredStorage::MaxPendingWrites() const {
+  return io_mgr_.WriteDepth(GetFlag(FLAGS_tiered_storage_max_pending_writes));
+}
+
+bool TieredStorage::CanOffloadWithoutWait() const {
+  return num_active_requests_ < MaxPendingWrites();
+}
+
 std::pair<bool, PrimeIterator> TieredStorage::CanScheduleOffload(DbIndex db_index, PrimeIterator it,
                                                                  string_view key) {
-  unsigned max_pending_writes = GetFlag(FLAGS_tiered_storage_max_pending_writes);
+  unsigned max_pending_writes = MaxPendingWrites();
   unsigned throttle_usec = GetFlag(FLAGS_tiered_storage_throttle_us);
   PrimeIterator res_it = it;
   if (num_active_requests_ >= max_pending_writes && throttle_usec > 0) {
@@ -649,7 +1036,7 @@ std::pair<bool, PrimeIterator> TieredStorage::CanScheduleOffload(DbIndex db_inde
 bool TieredStorage::FlushPending(DbIndex db_index, unsigned bin_index) {
   PerDb* db = db_arr_[db_index];
 
-  int64_t res = alloc_.Malloc(kBlockLen);
+  int64_t res = Malloc(kBlockLen);
   VLOG(2) << "FlushPending Malloc:" << res;
   if (res < 0) {
     InitiateGrow(-res);
@@ -693,6 +1080,8 @@ bool TieredStorage::FlushPending(DbIndex db_index, unsigned bin_index) {
   auto cb = [this, req](int io_res) { this->FinishIoRequest(io_res, req); };
 
   ++num_active_requests_;
+  page_cache_.Invalidate(file_offset, kBlockLen);
+  Unseal();
   io_mgr_.WriteAsync(file_offset, req->block(), std::move(cb));
   ++stats_.tiered_writes;
 
@@ -721,4 +1110,21 @@ void TieredStorage::InitiateGrow(size_t grow_size) {
   CHECK(!ec) << "TBD";  // TODO
 }
 
+int64_t TieredStorage::Malloc(size_t len) {
+  int64_t res = alloc_.Malloc(len);
+  if (res < 0 && !pending_frees_.empty()) {
+    FlushFrees();
+    res = alloc_.Malloc(len);
+  }
+  return res;
+}
+
+void TieredStorage::FlushFrees() {
+  sort(pending_frees_.begin(), pending_frees_.end());
+  for (auto [offset, len] : pending_frees_)
+    alloc_.Free(offset, len);
+  pending_frees_.clear();
+  pending_free_bytes_ = 0;
+}
+
 }  // namespace dfly
@@ -7,10 +7,13 @@
 
 #include <absl/container/flat_hash_map.h>
 
+#include <functional>
+
 #include "core/external_alloc.h"
 #include "core/fibers.h"
 #include "server/common.h"
 #include "server/io_mgr.h"
+#include "server/page_cache.h"
 #include "server/table.h"
 
 namespace dfly {
@@ -21,14 +24,54 @@ class TieredStorage {
  public:
   enum : uint16_t { kMinBlobLen = 64 };
 
+  // Heat is the access frequency estimate of DbSlice::freq_sketch(). When cold values are
+  // offloaded, strings with heat of at most kMaxColdHeat are offloaded in the background and
+  // external strings whose heat reached kPrefetchHeat are loaded back by GET.
+  static constexpr unsigned kMaxColdHeat = 1;
+  static constexpr unsigned kPrefetchHeat = 4;
+
+  // Serializes hashes, sets and sorted sets when they are offloaded and parses them back on load.
+  // Provided by the owner, since the serialization format is implemented above this layer.
+  struct ContainerCodec {
+    std::function<std::string(const PrimeValue&)> serialize;
+    std::function<std::error_code(std::string_view, PrimeValue*)> parse;
+  };
+
   explicit TieredStorage(DbSlice* db_slice, size_t max_file_size);
   ~TieredStorage();
 
   std::error_code Open(const std::string& path);
 
+  // Whether the backing file is kept across restarts, see --tiered_persistent.
+  bool persistent() const {
+    return persistent_;
+  }
+
+  // Called by the snapshots that record the location of the external values instead of their
+  // contents. Returns the generation of the backing file, which changes before the file is
+  // modified next, so that the snapshot is not restored once its locations may be stale.
+  uint64_t SealForSnapshot();
+
+  // Maps an external value recorded by a snapshot saved with the given generation back to the
+  // kept backing file, without reading it. Possible only until FinishRestore, offloads are
+  // skipped until then so that the file is not modified while the snapshot is loaded.
+  std::error_code RestoreExternal(DbIndex db_index, uint64_t generation, size_t offset,
+                                  size_t size, unsigned obj_type, PrimeValue* dest);
+
+  // Called once the snapshot is loaded, or if there is none.
+  void FinishRestore() {
+    restoring_ = false;
+  }
+
   PrimeIterator Load(DbIndex db_index, PrimeIterator it, std::string_view key);
 
+  // Loads the external values of keys with a single batch of reads. Keys that are missing or
+  // in memory are skipped.
+  void LoadMany(DbIndex db_index, absl::Span<const std::string_view> keys);
+
   // Schedules unloading of the item, pointed by the iterator.
+  // Containers are written as a single serialized blob. Their offload is skipped instead of
+  // throttled when I/O is saturated, so it never preempts.
   std::error_code ScheduleOffload(DbIndex db_index, PrimeIterator it, std::string_view key);
 
   void CancelIo(DbIndex db_index, PrimeIterator it);
@@ -37,6 +80,23 @@ class TieredStorage {
     return val.size() >= kMinBlobLen;
   }
 
+  // Enables offloading of containers.
+  void SetContainerCodec(ContainerCodec codec) {
+    codec_ = std::move(codec);
+  }
+
+  bool CanOffloadContainers() const {
+    return bool(codec_.serialize);
+  }
+
+  // True if strings are offloaded by DbSlice::OffloadColdValuesStep instead of upon write.
+  bool OffloadsColdValues() const {
+    return offload_cold_;
+  }
+
+  // True if an offload can be scheduled now without throttling, i.e. without preempting.
+  bool CanOffloadWithoutWait() const;
+
   void Free(PrimeIterator it, DbTableStats* stats);
 
   void Shutdown();
@@ -49,12 +109,37 @@ class TieredStorage {
 
   void CancelAllIos(DbIndex db_index);
 
+  // Starts a compaction pass over the pages of the backing file whose share of used blocks is
+  // at most max_ratio. Returns false if there are no such pages.
+  bool StartCompaction(double max_ratio);
+
+  // Whether the value is stored in one of the pages of the current compaction pass.
+  bool IsCompactionCandidate(const PrimeValue& pv) const;
+
+  // Loads the value and offloads it again, outside of the compacted pages. Skipped if I/O is
+  // saturated. May preempt.
+  void Relocate(DbIndex db_index, PrimeIterator it, std::string_view key);
+
+  // Punches holes in the backing file at the segments of the allocator that became free, and
+  // makes them available for allocations once it is done.
+  void ReleaseFreeSpace();
+
   std::error_code Read(size_t offset, size_t len, char* dest);
 
+  // Starts writing a blob that is not the value of a key, like a block of a search index, and
+  // returns its offset, or -1 if the file has no space for it yet. cb is called with the offset
+  // and the result of the write, after which the blob can be read back with Read. It must be
+  // freed with FreeBlob once the write completed, also if it failed. Blobs are not moved by the
+  // compaction and not kept across restarts.
+  int64_t WriteBlob(std::string_view blob, std::function<void(size_t, bool)> cb);
+  void FreeBlob(size_t offset, size_t len);
+
  private:
   class InflightWriteRequest;
 
-  void WriteSingle(DbIndex db_index, PrimeIterator it, size_t blob_len);
+  // Writes the value as a single blob. blob holds the serialized container or is empty for
+  // strings, whose blob_len bytes are copied from the value.
+  void WriteSingle(DbIndex db_index, PrimeIterator it, size_t blob_len, std::string_view blob);
 
   // Returns a pair consisting of an bool denoting whether we can write to disk, and updated
   // iterator as this function can yield. 'it' should not be used after the call to this function.
@@ -65,9 +150,30 @@ class TieredStorage {
 
   void InitiateGrow(size_t size);
 
+  // Same as ExternalAllocator::Malloc. Returns the pending frees to the allocator if it has no
+  // space for len bytes.
+  int64_t Malloc(size_t len);
+
+  // Returns the ranges freed since the last call to the allocator, sorted by their offset.
+  void FlushFrees();
+
+  // Changes the generation before the first modification of the file since it was sealed.
+  void Unseal();
+
+  // The number of writes that may be pending, as allowed by the write depth of io_mgr_.
+  unsigned MaxPendingWrites() const;
+
   void FinishIoRequest(int io_res, InflightWriteRequest* req);
+
+  // Replaces the external value pointed by it with its loaded blob.
+  void FinishLoad(DbIndex db_index, PrimeIterator it, std::string_view key,
+                  const std::string& blob);
   void SetExternal(DbIndex db_index, size_t item_offset, PrimeValue* dest);
 
+  // Copies the range into dest if all its pages are cached. Counts a hit or a miss when the
+  // cache is enabled.
+  bool ReadFromCache(size_t offset, size_t len, char* dest);
+
   DbSlice& db_slice_;
   IoMgr io_mgr_;
   ExternalAllocator alloc_;
@@ -78,10 +184,28 @@ class TieredStorage {
   std::vector<PerDb*> db_arr_;
 
   absl::flat_hash_map<uint32_t, uint8_t> page_refcnt_;
+
+  // The ranges of the deleted values are returned to alloc_ in batches, so that the deletion of
+  // many values, like expiring ones, costs one bookkeeping update each.
+  std::vector<std::pair<size_t, size_t>> pending_frees_;
+  size_t pending_free_bytes_ = 0;
   util::fb2::EventCount throttle_ec_;
   TieredStats stats_;
   size_t max_file_size_;
   size_t allocated_size_ = 0;
+  ContainerCodec codec_;
+  PageCache page_cache_;
+  bool offload_cold_;
+
+  // The generation of the backing file is stored next to it, in generation_path_.
+  bool persistent_;
+  bool sealed_ = false;
+  bool restoring_ = false;
+  uint64_t generation_ = 0;
+  std::string generation_path_;
+
+  // Sorted (offset, length) pages of the current compaction pass.
+  std::vector<std::pair<size_t, size_t>> compaction_pages_;
 };
 
 }  // namespace dfly
@@ -111,6 +235,13 @@ class TieredStorage {
     return {};
   }
 
+  int64_t WriteBlob(std::string_view blob, std::function<void(size_t, bool)> cb) {
+    return -1;
+  }
+
+  void FreeBlob(size_t offset, size_t len) {
+  }
+
   // Schedules unloading of the item, pointed by the iterator.
   std::error_code ScheduleOffload(DbIndex db_index, PrimeIterator it) {
     return {};
@@ -123,6 +254,10 @@ class TieredStorage {
     return false;
   }
 
+  bool OffloadsColdValues() const {
+    return false;
+  }
+
   void Free(size_t offset, size_t len) {
   }
 
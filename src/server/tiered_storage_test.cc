@@ -2,6 +2,7 @@
 // See LICENSE for licensing terms.
 //
 
+#include <absl/strings/match.h>
 #include <absl/strings/str_cat.h>
 #include <gmock/gmock.h>
 
@@ -16,6 +17,11 @@ using absl::SetFlag;
 using absl::StrCat;
 
 ABSL_DECLARE_FLAG(string, tiered_prefix);
+ABSL_DECLARE_FLAG(dfly::MemoryBytesFlag, tiered_offload_containers_min_size);
+ABSL_DECLARE_FLAG(uint32_t, tiered_page_cache_mb);
+ABSL_DECLARE_FLAG(bool, tiered_offload_cold);
+ABSL_DECLARE_FLAG(bool, tiered_persistent);
+ABSL_DECLARE_FLAG(string, dbfilename);
 
 namespace dfly {
 
@@ -34,6 +40,7 @@ class TieredStorageTest : public BaseFamilyTest {
 void TieredStorageTest::SetUpTestSuite() {
   BaseFamilyTest::SetUpTestSuite();
   SetFlag(&FLAGS_tiered_prefix, "/tmp/spill");
+  SetFlag(&FLAGS_tiered_offload_containers_min_size, MemoryBytesFlag{1024});
 
   auto* force_epoll = absl::FindCommandLineFlag("force_epoll");
   if (force_epoll->CurrentValue() == "true") {
@@ -182,6 +189,22 @@ TEST_F(TieredStorageTest, AddBigValues) {
   EXPECT_GT(m.db_stats[0].tiered_entries, 0u);
 }
 
+TEST_F(TieredStorageTest, CoalescedWrites) {
+  // Every MSET offloads its values with writes that are submitted together.
+  FillExternalKeys(500, 5000);
+  usleep(20000);  // 20 milliseconds
+
+  Metrics m = GetMetrics();
+  EXPECT_GT(m.db_stats[0].tiered_entries, 0u);
+  EXPECT_GT(m.disk_stats.write_total, 0u);
+  EXPECT_EQ(m.disk_stats.write_total + m.disk_stats.coalesced_write_total,
+            m.tiered_stats.tiered_writes);
+
+  for (unsigned i = 0; i < 500; i += 50) {
+    EXPECT_EQ(Run({"get", StrCat("k", i)}), string(5000, 'a'));
+  }
+}
+
 TEST_F(TieredStorageTest, DelBigValues) {
   FillExternalKeys(100, 5000);
   EXPECT_EQ(100, CheckedInt({"dbsize"}));
@@ -329,4 +352,207 @@ TEST_F(TieredStorageTest, GetValueValidation) {
   EXPECT_EQ(m.db_stats[0].tiered_entries, 0);
 }
 
+TEST_F(TieredStorageTest, MGetBatched) {
+  FillExternalKeys(2000);
+  usleep(20000);  // 20 milliseconds
+
+  vector<string> cmd = {"mget"};
+  unsigned external = 0;
+  for (unsigned i = 0; i < 100; ++i) {
+    cmd.push_back(StrCat("k", i));
+    external += absl::StrContains(CheckedString({"debug", "object", cmd.back()}), "spill_len");
+  }
+  ASSERT_GT(external, 1u);
+
+  Metrics m = GetMetrics();
+  uint64_t reads = m.disk_stats.read_total;
+  size_t tiered_entries = m.db_stats[0].tiered_entries;
+
+  auto resp = Run(absl::Span<string>{cmd});
+  ASSERT_THAT(resp, ArrLen(100));
+  for (const auto& val : resp.GetVec())
+    EXPECT_EQ(val, string(256, 'a'));
+
+  // Values that share a page are read once.
+  m = GetMetrics();
+  EXPECT_EQ(m.db_stats[0].tiered_entries, tiered_entries - external);
+  EXPECT_LE(m.disk_stats.read_total - reads, external);
+}
+
+TEST_F(TieredStorageTest, PageCache) {
+  absl::FlagSaver fs;
+  SetFlag(&FLAGS_tiered_page_cache_mb, 1);
+  ResetService();
+
+  FillExternalKeys(2000);
+  usleep(20000);  // 20 milliseconds
+
+  unsigned external = 0;
+  for (unsigned i = 0; i < 200; ++i) {
+    string key = StrCat("k", i);
+    if (!absl::StrContains(CheckedString({"debug", "object", key}), "spill_len"))
+      continue;
+    ++external;
+    EXPECT_EQ(Run({"get", key}), string(256, 'a'));
+  }
+  ASSERT_GT(external, 1u);
+
+  // Small values share pages, so only the first read of a page misses the cache.
+  Metrics m = GetMetrics();
+  EXPECT_GT(m.tiered_stats.page_cache_hits, 0u);
+  EXPECT_LT(m.tiered_stats.page_cache_misses, external);
+}
+
+TEST_F(TieredStorageTest, OffloadCold) {
+  absl::FlagSaver fs;
+  SetFlag(&FLAGS_tiered_offload_cold, true);
+  ResetService();
+
+  FillExternalKeys(2000);
+  usleep(20000);  // 20 milliseconds
+  EXPECT_EQ(GetMetrics().db_stats[0].tiered_entries, 0u);
+
+  // Warms up k0, the other keys stay cold.
+  for (unsigned i = 0; i < 10; ++i)
+    Run({"get", "k0"});
+
+  for (unsigned i = 0; i < 100; ++i) {
+    shard_set->RunBlockingInParallel(
+        [](EngineShard* es) { es->db_slice().OffloadColdValuesStep(0, 32, 16); });
+  }
+  usleep(20000);  // 20 milliseconds
+
+  EXPECT_GT(GetMetrics().db_stats[0].tiered_entries, 100u);
+  EXPECT_THAT(CheckedString({"debug", "object", "k0"}), Not(HasSubstr("spill_len")));
+
+  // A cold value that became hot again is loaded back by its reads.
+  string key;
+  for (unsigned i = 1; i < 2000 && key.empty(); ++i) {
+    if (absl::StrContains(CheckedString({"debug", "object", StrCat("k", i)}), "spill_len"))
+      key = StrCat("k", i);
+  }
+  ASSERT_FALSE(key.empty());
+  for (unsigned i = 0; i < 10; ++i)
+    EXPECT_EQ(Run({"get", key}), string(256, 'a'));
+  EXPECT_THAT(CheckedString({"debug", "object", key}), Not(HasSubstr("spill_len")));
+}
+
+TEST_F(TieredStorageTest, Compaction) {
+  FillExternalKeys(1000, 5000);
+  usleep(20000);  // 20 milliseconds
+  ASSERT_GT(GetMetrics().db_stats[0].tiered_entries, 100u);
+
+  // Leaves the pages of the backing file sparse.
+  for (unsigned i = 0; i < 1000; ++i) {
+    if (i % 10)
+      Run({"del", StrCat("k", i)});
+  }
+
+  for (unsigned i = 0; i < 20; ++i) {
+    shard_set->RunBlockingInParallel(
+        [](EngineShard* es) { es->db_slice().CompactTieredStep(32, 16, 0.5); });
+  }
+  usleep(20000);  // 20 milliseconds
+
+  Metrics m = GetMetrics();
+  EXPECT_GT(m.tiered_stats.compaction_moves, 0u);
+  for (unsigned i = 0; i < 1000; i += 10) {
+    EXPECT_EQ(Run({"get", StrCat("k", i)}), string(5000, 'a'));
+  }
+}
+
+TEST_F(TieredStorageTest, OffloadContainers) {
+  for (unsigned i = 0; i < 100; ++i) {
+    string val(100, 'a' + i % 26);
+    Run({"hset", "hash", StrCat("f", i), val});
+    Run({"sadd", "set", StrCat(val, i)});
+    Run({"zadd", "zset", StrCat(i), StrCat(val, i)});
+  }
+  Run({"hset", "small", "f", "v"});
+
+  // The first traversal resets the access bits, the next ones offload the values once the
+  // backing file has grown.
+  Metrics m = GetMetrics();
+  for (unsigned i = 0; i < 20 && m.db_stats[0].tiered_entries < 3; ++i) {
+    shard_set->RunBlockingInParallel(
+        [](EngineShard* es) { es->db_slice().OffloadColdContainersStep(0, 32, 1024); });
+    usleep(5000);  // 5 milliseconds
+    m = GetMetrics();
+  }
+
+  EXPECT_EQ(m.db_stats[0].tiered_entries, 3);
+  EXPECT_THAT(CheckedString({"debug", "object", "hash"}), HasSubstr("spill_len"));
+  EXPECT_EQ(Run({"type", "set"}), "set");
+
+  EXPECT_EQ(Run({"hget", "hash", "f1"}), string(100, 'b'));
+  EXPECT_EQ(100, CheckedInt({"scard", "set"}));
+  EXPECT_EQ(Run({"zscore", "zset", StrCat(string(100, 'c'), 2)}), "2");
+  EXPECT_EQ(Run({"hget", "small", "f"}), "v");
+
+  m = GetMetrics();
+  EXPECT_EQ(m.db_stats[0].tiered_entries, 0);
+
+  Run({"del", "hash"});
+  EXPECT_EQ(0, CheckedInt({"exists", "hash"}));
+}
+
+TEST_F(TieredStorageTest, DeleteContainersWithoutLoad) {
+  for (unsigned i = 0; i < 100; ++i) {
+    string val(100, 'a' + i % 26);
+    Run({"hset", "hash", StrCat("f", i), val});
+    Run({"sadd", "set", StrCat(val, i)});
+    Run({"zadd", "zset", StrCat(i), StrCat(val, i)});
+  }
+  Run({"pexpire", "zset", "1000"});
+
+  Metrics m = GetMetrics();
+  for (unsigned i = 0; i < 20 && m.db_stats[0].tiered_entries < 3; ++i) {
+    shard_set->RunBlockingInParallel(
+        [](EngineShard* es) { es->db_slice().OffloadColdContainersStep(0, 32, 1024); });
+    usleep(5000);  // 5 milliseconds
+    m = GetMetrics();
+  }
+  ASSERT_EQ(m.db_stats[0].tiered_entries, 3);
+  uint64_t reads = m.disk_stats.read_total;
+
+  // Expiry, deletion and overwrite free the external values without reading them.
+  AdvanceTime(2000);
+  EXPECT_EQ(0, CheckedInt({"exists", "zset"}));
+  EXPECT_EQ(1, CheckedInt({"del", "hash"}));
+  EXPECT_EQ(Run({"set", "set", "v"}), "OK");
+
+  m = GetMetrics();
+  EXPECT_EQ(m.db_stats[0].tiered_entries, 0);
+  EXPECT_EQ(m.db_stats[0].tiered_size, 0u);
+  EXPECT_EQ(m.disk_stats.read_total, reads);
+  EXPECT_EQ(Run({"get", "set"}), "v");
+}
+
+TEST_F(TieredStorageTest, Persistent) {
+  absl::FlagSaver fs;
+  SetFlag(&FLAGS_tiered_persistent, true);
+  ResetService();
+
+  FillExternalKeys(1000, 1000);
+  usleep(20000);  // 20 milliseconds
+  unsigned tiered_entries = GetMetrics().db_stats[0].tiered_entries;
+  ASSERT_GT(tiered_entries, 100u);
+  ASSERT_EQ(Run({"save", "df", "tiered-persistent"}), "OK");
+
+  // Restarts and loads the snapshot, which maps the external values back to the backing file.
+  ShutdownService();
+  SetFlag(&FLAGS_dbfilename, "tiered-persistent");
+  ResetService();
+  while (service_->GetGlobalState() == GlobalState::LOADING)
+    usleep(1000);
+
+  Metrics m = GetMetrics();
+  EXPECT_EQ(m.db_stats[0].tiered_entries, tiered_entries);
+  EXPECT_EQ(m.tiered_stats.tiered_writes, 0u);
+  EXPECT_EQ(1000, CheckedInt({"dbsize"}));
+  for (unsigned i = 0; i < 1000; i += 7) {
+    EXPECT_EQ(Run({"get", StrCat("k", i)}), string(1000, 'a'));
+  }
+}
+
 }  // namespace dfly
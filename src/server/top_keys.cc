@@ -16,9 +16,9 @@ TopKeys::TopKeys(Options options)
     : options_(options), fingerprints_(options.enabled ? options_.buckets * options_.arrays : 0) {
 }
 
-void TopKeys::Touch(std::string_view key) {
+uint64_t TopKeys::Touch(std::string_view key) {
   if (!IsEnabled()) {
-    return;
+    return 0;
   }
 
   auto ResetCell = [&](Cell& cell, uint64_t fingerprint) {
@@ -31,6 +31,7 @@ void TopKeys::Touch(std::string_view key) {
 
   const uint64_t fingerprint = XXH3_64bits(key.data(), key.size());
   const int shift = absl::bit_width(options_.buckets);
+  uint64_t count = 0;
 
   for (uint64_t array = 0; array < options_.arrays; ++array) {
     // TODO: if we decide to keep this logic, CHECK that bit_width(buckets) * arrays < 64
@@ -59,7 +60,12 @@ void TopKeys::Touch(std::string_view key) {
         }
       }
     }
+
+    if (cell.fingerprint == fingerprint) {
+      count = std::max(count, cell.count);
+    }
   }
+  return count;
 }
 
 absl::flat_hash_map<std::string, uint64_t> TopKeys::GetTopKeys() const {
@@ -79,6 +85,12 @@ absl::flat_hash_map<std::string, uint64_t> TopKeys::GetTopKeys() const {
   return results;
 }
 
+void TopKeys::Reset() {
+  for (Cell& cell : fingerprints_) {
+    cell = Cell{};
+  }
+}
+
 bool TopKeys::IsEnabled() const {
   return options_.enabled;
 }
@@ -17,7 +17,7 @@ namespace dfly {
 //
 // Usage:
 // - Instanciate this class with proper options (see below)
-// - For every used key k, call Touch(k)
+// - For every used key k, call Touch(k), which also returns the estimated count of k
 // - At some point(s) in time, call GetTopKeys() to get an estimated list of top keys along with
 //   their approximate count (i.e. how many times Touch() was invoked for them).
 //
@@ -47,9 +47,13 @@ class TopKeys {
 
   explicit TopKeys(Options options);
 
-  void Touch(std::string_view key);
+  // Returns the estimated count of the key, including this touch.
+  uint64_t Touch(std::string_view key);
   absl::flat_hash_map<std::string, uint64_t> GetTopKeys() const;
 
+  // Forgets all the counts, to start a new measurement window.
+  void Reset();
+
   bool IsEnabled() const;
 
  private:
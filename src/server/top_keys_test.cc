@@ -30,6 +30,30 @@ TEST(TopKeysTest, MultiTouch) {
   EXPECT_THAT(top_keys.GetTopKeys(), UnorderedElementsAre(Pair("key1", 3)));
 }
 
+TEST(TopKeysTest, TouchCount) {
+  TopKeys top_keys({});
+  EXPECT_EQ(top_keys.Touch("key1"), 1u);
+  EXPECT_EQ(top_keys.Touch("key1"), 2u);
+  EXPECT_EQ(top_keys.Touch("key2"), 1u);
+  EXPECT_EQ(top_keys.Touch("key1"), 3u);
+
+  TopKeys disabled({.enabled = false});
+  EXPECT_EQ(disabled.Touch("key1"), 0u);
+}
+
+TEST(TopKeysTest, Reset) {
+  TopKeys top_keys({.min_key_count_to_record = 1});
+  top_keys.Touch("key1");
+  top_keys.Touch("key1");
+  top_keys.Reset();
+  EXPECT_TRUE(top_keys.GetTopKeys().empty());
+  EXPECT_EQ(top_keys.Touch("key1"), 1u);
+
+  TopKeys disabled({.enabled = false});
+  disabled.Reset();
+  EXPECT_TRUE(disabled.GetTopKeys().empty());
+}
+
 TEST(TopKeysTest, MinKeyCountToRecord) {
   TopKeys top_keys({.min_key_count_to_record = 3});
   top_keys.Touch("key1");
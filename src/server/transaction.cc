@@ -4,6 +4,7 @@
 
 #include "server/transaction.h"
 
+#include <absl/base/internal/cycleclock.h>
 #include <absl/strings/match.h>
 
 #include "base/logging.h"
@@ -12,16 +13,32 @@
 #include "server/db_slice.h"
 #include "server/engine_shard_set.h"
 #include "server/journal/journal.h"
+#include "server/proactor_watchdog.h"
+#include "server/request_trace.h"
 #include "server/server_state.h"
 
 ABSL_FLAG(uint32_t, tx_queue_warning_len, 96,
           "Length threshold for warning about long transaction queue");
 
+ABSL_FLAG(uint32_t, tx_hop_batch_size, 0,
+          "If positive, single shard hops that the connections of a thread issue while an earlier "
+          "hop to the same shard is running are dispatched together, up to this many hops at "
+          "once. 0 dispatches every hop on its own");
+
+ABSL_FLAG(bool, tx_latency_histograms, false,
+          "If true, record histograms of the latencies of the transaction phases of every "
+          "command, reported by INFO LATENCYSTATS and the metrics endpoint");
+
+ABSL_FLAG(bool, tx_optimistic_reads, false,
+          "If true, multi shard read-only commands that support it first read their keys without "
+          "scheduling and only schedule if a concurrent write was detected");
+
 namespace dfly {
 
 using namespace std;
 using namespace util;
 using absl::StrCat;
+using absl::base_internal::CycleClock;
 
 thread_local Transaction::TLTmpSpace Transaction::tmp_space;
 
@@ -71,6 +88,86 @@ void RecordTxScheduleStats(const Transaction* tx) {
   }
 }
 
+// Phase histograms of the command on the calling thread.
+ServerState::TxPhaseHistograms* PhaseHistos(const CommandId* cid) {
+  return ServerState::tlocal()->GetTxPhaseHistos(cid->name());
+}
+
+// Every kHopSampleRate-th hop a thread dispatches to the shards records its latency from the
+// submission until it starts on the shard, see EngineShard::LoadStats.
+constexpr unsigned kHopSampleRate = 64;
+
+// Returns the submission time of a sampled hop, 0 if it's not sampled.
+uint64_t SampleHopSubmission() {
+  static thread_local unsigned hop_cnt = 0;
+  return ++hop_cnt % kHopSampleRate == 0 ? absl::GetCurrentTimeNanos() : 0;
+}
+
+void RecordHopStart(uint64_t submit_ns) {
+  if (submit_ns)
+    EngineShard::tlocal()->RecordHopLatency((absl::GetCurrentTimeNanos() - submit_ns) / 1000);
+}
+
+// Single shard hops of a thread that wait to be dispatched together to their shard.
+struct HopBatch {
+  vector<function<void()>> hops;
+  unsigned in_flight = 0;  // dispatched batches that did not finish yet
+};
+
+thread_local vector<HopBatch> hop_batches;
+
+void DispatchHopBatch(ShardId sid) {
+  auto& batch = hop_batches[sid];
+  if (batch.hops.empty())
+    return;
+
+  auto& stats = ServerState::tlocal()->stats;
+  stats.tx_hop_batch_cnt++;
+  stats.tx_batched_hop_cnt += batch.hops.size();
+  batch.in_flight++;
+
+  // Taken out before Add(), which may suspend while other fibers push new hops to the batch.
+  vector<function<void()>> hops;
+  hops.swap(batch.hops);
+
+  // The hops run back to back and wake up their coordinators one after another. Afterwards the
+  // origin thread is notified to dispatch the hops that accumulated in the meantime. Adding them
+  // to the shard queue may suspend, which brief callbacks must not do, so a fiber does it.
+  shard_set->Add(sid, [hops = std::move(hops), origin = ProactorBase::me(), sid] {
+    for (const auto& hop : hops) {
+      EngineShard::tlocal()->RunHighPriorityHops();
+      hop();
+    }
+
+    origin->DispatchBrief([sid] {
+      auto& batch = hop_batches[sid];
+      DCHECK_GT(batch.in_flight, 0u);
+      if (--batch.in_flight > 0 || batch.hops.empty())
+        return;
+
+      fb2::Fiber("dispatch_hops", [sid] {
+        // A hop added in the meantime could have dispatched the batch already.
+        if (hop_batches[sid].in_flight == 0)
+          DispatchHopBatch(sid);
+      }).Detach();
+    });
+  });
+}
+
+// A hop is dispatched right away if no earlier batch to its shard is still running, so idle
+// connections do not wait. Otherwise it waits for the running batch to finish, so the number of
+// hops of a batch adapts to the load. A full batch is dispatched right away.
+void AddToHopBatch(ShardId sid, function<void()> hop, unsigned max_size) {
+  if (hop_batches.empty())
+    hop_batches.resize(shard_set->size());
+
+  auto& batch = hop_batches[sid];
+  batch.hops.push_back(std::move(hop));
+
+  if (batch.in_flight == 0 || batch.hops.size() >= max_size)
+    DispatchHopBatch(sid);
+}
+
 }  // namespace
 
 IntentLock::Mode Transaction::LockMode() const {
@@ -85,6 +182,10 @@ IntentLock::Mode Transaction::LockMode() const {
  * @param cs
  */
 Transaction::Transaction(const CommandId* cid) : cid_{cid} {
+  track_phases_ = absl::GetFlag(FLAGS_tx_latency_histograms);
+  if (auto* ss = ServerState::tlocal(); ss)
+    time_slowlog_ = ss->IsSlowLogEnabled();
+
   string_view cmd_name(cid_->name());
   if (cmd_name == "EXEC" || cmd_name == "EVAL" || cmd_name == "EVALSHA") {
     multi_.reset(new MultiData);
@@ -488,6 +589,88 @@ void Transaction::PrepareMultiForScheduleSingleHop(ShardId sid, DbIndex db, CmdA
   StoreKeysInArgs(*key_index, false);
 }
 
+bool Transaction::IsOptimisticReadAllowed() const {
+  return (cid_->opt_mask() & CO::OPTIMISTIC_READ) && !multi_ && !IsGlobal() &&
+         unique_shard_cnt_ > 1 && !shard_set->IsTieringEnabled() &&
+         absl::GetFlag(FLAGS_tx_optimistic_reads);
+}
+
+// The callbacks run in all shards without scheduling and acquiring locks, if none of the keys are
+// locked. Afterwards every shard validates that none of the keys changed and none of them is
+// locked, otherwise the regular path runs.
+//
+// A writer releases its locks per shard once it concluded there, so its writes do not become
+// visible in all shards at once. But it is scheduled, and so holds its locks, in all shards before
+// it runs in any of them. If a read observed its write in one shard, then in every other shard the
+// writer either still holds its locks or already changed the versions of the keys by the time of
+// the validation, which runs after all reads finished. Both fail the validation.
+bool Transaction::RunOptimisticRead() {
+  DCHECK(cid_->IsReadOnly());
+  DCHECK(cb_ptr_);
+
+  time_now_ms_ = GetCurrentTimeMs();
+
+  auto is_active = [this](ShardId sid) { return IsActive(sid); };
+  vector<vector<uint64_t>> versions(shard_set->size());  // versions of the keys before reading
+  atomic_bool conflict{false};
+
+  auto read_cb = [&](EngineShard* shard) {
+    ShardId sid = shard->shard_id();
+    KeyLockArgs lock_args = GetLockArgs(sid);
+    if (!shard->db_slice().CheckLock(IntentLock::SHARED, lock_args) ||
+        !shard->shard_lock()->Check(IntentLock::SHARED)) {
+      conflict.store(true, memory_order_relaxed);
+      return;
+    }
+
+    shard->db_slice().GetKeyVersions(lock_args, &versions[sid]);
+
+    RunnableResult result;
+    try {
+      result = (*cb_ptr_)(this, shard);
+    } catch (std::bad_alloc&) {
+      result = OpStatus::OUT_OF_MEMORY;
+    }
+    shard->db_slice().OnCbFinish();
+
+    // Errors are handled by the regular path
+    if (result != OpStatus::OK)
+      conflict.store(true, memory_order_relaxed);
+  };
+  shard_set->RunBlockingInParallel(read_cb, is_active);  // callbacks may preempt, e.g. to journal
+  num_hops_++;
+
+  auto validate_cb = [&](EngineShard* shard) {
+    ShardId sid = shard->shard_id();
+    KeyLockArgs lock_args = GetLockArgs(sid);
+    if (!shard->db_slice().CheckLock(IntentLock::SHARED, lock_args) ||
+        !shard->shard_lock()->Check(IntentLock::SHARED)) {
+      conflict.store(true, memory_order_relaxed);
+      return;
+    }
+
+    vector<uint64_t> current;
+    shard->db_slice().GetKeyVersions(lock_args, &current);
+    if (current != versions[sid])
+      conflict.store(true, memory_order_relaxed);
+  };
+  if (!conflict.load(memory_order_relaxed)) {
+    shard_set->RunBriefInParallel(validate_cb, is_active);
+    num_hops_++;
+  }
+
+  auto* ss = ServerState::tlocal();
+  if (conflict.load(memory_order_relaxed)) {
+    ss->stats.tx_optimistic_conflict_cnt++;
+    return false;
+  }
+
+  ss->stats.tx_optimistic_read_cnt++;
+  ss->stats.tx_width_freq_arr[unique_shard_cnt_ - 1]++;
+  local_result_ = OpStatus::OK;
+  return true;
+}
+
 // Runs in the dbslice thread. Returns true if the transaction continues running in the thread.
 bool Transaction::RunInShard(EngineShard* shard, bool txq_ooo) {
   DCHECK_GT(run_count_.load(memory_order_relaxed), 0u);
@@ -515,6 +698,12 @@ bool Transaction::RunInShard(EngineShard* shard, bool txq_ooo) {
   DCHECK(IsGlobal() || (sd.local_mask & KEYLOCK_ACQUIRED) || (multi_ && multi_->mode == GLOBAL));
   DCHECK(!txq_ooo || (sd.local_mask & OUT_OF_ORDER));
 
+  uint64_t run_start_ns = 0;
+  if (TimePhases()) {
+    run_start_ns = absl::GetCurrentTimeNanos();
+    RecordPhase(Phase::QUEUE_WAIT, hop_start_ns_, run_start_ns);
+  }
+
   /*************************************************************************/
   // Actually running the callback.
   // If you change the logic here, also please change the logic
@@ -522,7 +711,14 @@ bool Transaction::RunInShard(EngineShard* shard, bool txq_ooo) {
   try {
     // if a transaction is suspended, we still run it because of brpoplpush/blmove case
     // that needs to run lpush on its suspended shard.
-    result = (*cb_ptr_)(this, shard);
+    int64_t start_cycles = CycleClock::Now();
+    {
+      ProactorWatchdog::CommandScope watchdog_scope{cid_};
+      result = (*cb_ptr_)(this, shard);
+    }
+    uint64_t cycles = CycleClock::Now() - start_cycles;
+    cid_->AddCpuCycles(ServerState::tlocal()->thread_index(), cycles);
+    ProactorWatchdog::CheckSlice(*cid_, cycles);
 
     if (unique_shard_cnt_ == 1) {
       cb_ptr_ = nullptr;  // We can do it because only a single thread runs the callback.
@@ -550,6 +746,12 @@ bool Transaction::RunInShard(EngineShard* shard, bool txq_ooo) {
 
   shard->db_slice().OnCbFinish();
 
+  uint64_t conclude_start_ns = 0;
+  if (TimePhases()) {
+    conclude_start_ns = absl::GetCurrentTimeNanos();
+    RecordPhase(Phase::EXECUTION, run_start_ns, conclude_start_ns);
+  }
+
   // Handle result flags to alter behaviour.
   if (result.flags & RunnableResult::AVOID_CONCLUDING) {
     // Multi shard callbacks should either all or none choose to conclude. Because they can't
@@ -615,6 +817,9 @@ bool Transaction::RunInShard(EngineShard* shard, bool txq_ooo) {
         bcontroller->NotifyPending();
       }
     }
+
+    if (TimePhases())
+      RecordPhase(Phase::CONCLUDE, conclude_start_ns, absl::GetCurrentTimeNanos());
   }
 
   DecreaseRunCnt();
@@ -636,6 +841,7 @@ void Transaction::ScheduleInternal() {
   DVLOG(1) << "ScheduleInternal " << cid_->name() << " on " << unique_shard_cnt_ << " shards";
 
   auto is_active = [this](uint32_t i) { return IsActive(i); };
+  uint64_t start_ns = TimePhases() ? absl::GetCurrentTimeNanos() : 0;
 
   // Loop until successfully scheduled in all shards.
   while (true) {
@@ -654,6 +860,9 @@ void Transaction::ScheduleInternal() {
       coordinator_state_ |= COORD_SCHED;
 
       RecordTxScheduleStats(this);
+      if (TimePhases())
+        RecordPhase(Phase::SCHEDULE, start_ns, absl::GetCurrentTimeNanos());
+
       VLOG(2) << "Scheduled " << DebugId() << " num_shards: " << unique_shard_cnt_;
       break;
     }
@@ -702,6 +911,7 @@ OpStatus Transaction::ScheduleSingleHop(RunnableType cb) {
   DCHECK(IsAtomicMulti() || (coordinator_state_ & COORD_SCHED) == 0);  // Multi schedule in advance.
 
   cb_ptr_ = &cb;
+  int64_t start_cycles = CycleClock::Now();
 
   if (IsAtomicMulti()) {
     multi_->concluding = true;
@@ -724,6 +934,10 @@ OpStatus Transaction::ScheduleSingleHop(RunnableType cb) {
 
     // IsArmedInShard() first checks run_count_ before shard_data, so use release ordering.
     shard_data_[SidToId(unique_shard_id_)].is_armed.store(true, memory_order_relaxed);
+    if (TimePhases()) {
+      hop_start_ns_ = absl::GetCurrentTimeNanos();
+      num_hops_++;
+    }
     run_count_.store(1, memory_order_release);
 
     time_now_ms_ = GetCurrentTimeMs();
@@ -735,7 +949,8 @@ OpStatus Transaction::ScheduleSingleHop(RunnableType cb) {
     // then calls PollExecute that in turn runs the callback which calls DecreaseRunCnt. As a result
     // WaitForShardCallbacks below is unblocked before schedule_cb returns. However, if run_fast is
     // true, then we may mutate stack variables, but only before DecreaseRunCnt is called.
-    auto schedule_cb = [this, &was_ooo] {
+    auto schedule_cb = [this, &was_ooo, submit_ns = SampleHopSubmission()] {
+      RecordHopStart(submit_ns);
       bool run_fast = ScheduleUniqueShard(EngineShard::tlocal());
       if (run_fast) {
         was_ooo = true;
@@ -748,13 +963,27 @@ OpStatus Transaction::ScheduleSingleHop(RunnableType cb) {
     };
 
     ss = ServerState::tlocal();
+    unsigned batch_size = absl::GetFlag(FLAGS_tx_hop_batch_size);
     if (ss->thread_index() == unique_shard_id_ && ss->AllowInlineScheduling()) {
       DVLOG(2) << "Inline scheduling a transaction";
       schedule_cb();
       run_inline = true;
+    } else if (high_priority_) {
+      shard_set->AddHighPriority(unique_shard_id_, std::move(schedule_cb));
+    } else if (batch_size > 0) {
+      AddToHopBatch(unique_shard_id_, std::move(schedule_cb), batch_size);
     } else {
-      shard_set->Add(unique_shard_id_, std::move(schedule_cb));  // serves as a barrier.
+      // serves as a barrier.
+      shard_set->Add(unique_shard_id_, [schedule_cb = std::move(schedule_cb)] {
+        EngineShard::tlocal()->RunHighPriorityHops();
+        schedule_cb();
+      });
     }
+  } else if (IsOptimisticReadAllowed() && RunOptimisticRead()) {
+    cb_ptr_ = nullptr;
+    wait_cycles_ += CycleClock::Now() - start_cycles;
+    RecordHops();
+    return local_result_;
   } else {                 // This transaction either spans multiple shards and/or is multi.
     if (!IsAtomicMulti())  // Multi schedule in advance.
       ScheduleInternal();
@@ -764,7 +993,10 @@ OpStatus Transaction::ScheduleSingleHop(RunnableType cb) {
 
   DVLOG(2) << "ScheduleSingleHop before Wait " << DebugId() << " " << run_count_.load();
   WaitForShardCallbacks();
+  wait_cycles_ += CycleClock::Now() - start_cycles;
   DVLOG(2) << "ScheduleSingleHop after Wait " << DebugId();
+  if (TimePhases())
+    phase_totals_.hop_wait_ns += absl::GetCurrentTimeNanos() - hop_start_ns_;
 
   if (schedule_fast) {
     CHECK(!cb_ptr_);  // we should have reset it within the callback.
@@ -776,6 +1008,7 @@ OpStatus Transaction::ScheduleSingleHop(RunnableType cb) {
     ss->stats.tx_width_freq_arr[0]++;
   }
   cb_ptr_ = nullptr;
+  RecordHops();
   return local_result_;
 }
 
@@ -855,13 +1088,19 @@ void Transaction::Execute(RunnableType cb, bool conclude) {
                                   : (coordinator_state_ & ~COORD_CONCLUDING);
   }
 
+  int64_t start_cycles = CycleClock::Now();
   ExecuteAsync();
 
   DVLOG(1) << "Execute::WaitForCbs " << DebugId();
   WaitForShardCallbacks();
+  wait_cycles_ += CycleClock::Now() - start_cycles;
   DVLOG(1) << "Execute::WaitForCbs " << DebugId() << " completed";
+  if (TimePhases())
+    phase_totals_.hop_wait_ns += absl::GetCurrentTimeNanos() - hop_start_ns_;
 
   cb_ptr_ = nullptr;
+  if (conclude)
+    RecordHops();
 }
 
 // Runs in coordinator thread.
@@ -883,6 +1122,11 @@ void Transaction::ExecuteAsync() {
   IterateActiveShards(
       [](PerShardData& sd, auto i) { sd.is_armed.store(true, memory_order_relaxed); });
 
+  if (TimePhases()) {
+    hop_start_ns_ = absl::GetCurrentTimeNanos();
+    num_hops_++;
+  }
+
   // this fence prevents that a read or write operation before a release fence will be reordered
   // with a write operation after a release fence. Specifically no writes below will be reordered
   // upwards. Important, because it protects non-threadsafe local_mask from being accessed by
@@ -898,7 +1142,9 @@ void Transaction::ExecuteAsync() {
     return;
   }
 
-  auto cb = [this] {
+  auto cb = [this, submit_ns = SampleHopSubmission()] {
+    RecordHopStart(submit_ns);
+    EngineShard::tlocal()->RunHighPriorityHops();
     EngineShard::tlocal()->PollExecution("exec_cb", this);
 
     DVLOG(3) << "ptr_release " << DebugId();
@@ -909,6 +1155,69 @@ void Transaction::ExecuteAsync() {
   IterateActiveShards([&cb](PerShardData& sd, auto i) { shard_set->Add(i, cb); });
 }
 
+void Transaction::RecordHops() {
+  phase_totals_.hops += num_hops_;
+  if (track_phases_)
+    PhaseHistos(cid_)->hops.Add(num_hops_);
+  num_hops_ = 0;
+}
+
+void Transaction::RecordPhase(Phase phase, uint64_t start_ns, uint64_t end_ns) {
+  const char* name = nullptr;
+  base::Histogram* histo = nullptr;
+  atomic_uint64_t* total = nullptr;
+  ServerState::TxPhaseHistograms* histos = track_phases_ ? PhaseHistos(cid_) : nullptr;
+  switch (phase) {
+    case Phase::SCHEDULE:
+      name = "schedule";
+      histo = histos ? &histos->schedule : nullptr;
+      total = &phase_totals_.schedule_ns;
+      break;
+    case Phase::QUEUE_WAIT:
+      name = "queue_wait";
+      histo = histos ? &histos->queue_wait : nullptr;
+      total = &phase_totals_.queue_wait_ns;
+      break;
+    case Phase::EXECUTION:
+      name = "execution";
+      histo = histos ? &histos->execution : nullptr;
+      total = &phase_totals_.execution_ns;
+      break;
+    case Phase::CONCLUDE:
+      name = "conclude";
+      histo = histos ? &histos->conclude : nullptr;
+      total = &phase_totals_.conclude_ns;
+      break;
+  }
+
+  total->fetch_add(end_ns - start_ns, memory_order_relaxed);
+  if (histo)
+    histo->Add((end_ns - start_ns) / 1000);
+  if (trace_)
+    trace_->AddSpan(name, start_ns, end_ns);
+}
+
+void Transaction::RecordTxQueueLen(size_t len) {
+  uint32_t cur = phase_totals_.max_txq_len.load(memory_order_relaxed);
+  while (len > cur && !phase_totals_.max_txq_len.compare_exchange_weak(cur, len,
+                                                                       memory_order_relaxed)) {
+  }
+}
+
+SlowLogTxStats Transaction::GetSlowLogStats() const {
+  auto usec = [](const atomic_uint64_t& ns) { return ns.load(memory_order_relaxed) / 1000; };
+  SlowLogTxStats stats;
+  stats.schedule_usec = usec(phase_totals_.schedule_ns);
+  stats.queue_wait_usec = usec(phase_totals_.queue_wait_ns);
+  stats.execution_usec = usec(phase_totals_.execution_ns);
+  stats.conclude_usec = usec(phase_totals_.conclude_ns);
+  stats.hop_wait_usec = phase_totals_.hop_wait_ns / 1000;
+  stats.hops = phase_totals_.hops + num_hops_;
+  stats.shards = unique_shard_cnt_;
+  stats.txq_len = phase_totals_.max_txq_len.load(memory_order_relaxed);
+  return stats;
+}
+
 void Transaction::Conclude() {
   if (!IsScheduled())
     return;
@@ -961,9 +1270,17 @@ Transaction::RunnableResult Transaction::RunQuickie(EngineShard* shard) {
 
   CHECK(sd.is_armed.exchange(false, memory_order_relaxed));
 
+  uint64_t run_start_ns = 0;
+  if (TimePhases()) {
+    run_start_ns = absl::GetCurrentTimeNanos();
+    RecordPhase(Phase::QUEUE_WAIT, hop_start_ns_, run_start_ns);
+  }
+
   // Calling the callback in somewhat safe way
   RunnableResult result;
+  int64_t start_cycles = CycleClock::Now();
   try {
+    ProactorWatchdog::CommandScope watchdog_scope{cid_};
     result = (*cb_ptr_)(this, shard);
   } catch (std::bad_alloc&) {
     LOG_FIRST_N(ERROR, 16) << " out of memory";
@@ -972,8 +1289,14 @@ Transaction::RunnableResult Transaction::RunQuickie(EngineShard* shard) {
     LOG(FATAL) << "Unexpected exception " << e.what();
   }
 
+  uint64_t cycles = CycleClock::Now() - start_cycles;
+  cid_->AddCpuCycles(ServerState::tlocal()->thread_index(), cycles);
+  ProactorWatchdog::CheckSlice(*cid_, cycles);
   shard->db_slice().OnCbFinish();
 
+  if (TimePhases())
+    RecordPhase(Phase::EXECUTION, run_start_ns, absl::GetCurrentTimeNanos());
+
   // Handling the result, along with conclusion and journaling, is done by the caller
 
   cb_ptr_ = nullptr;  // We can do it because only a single shard runs the callback.
@@ -1074,6 +1397,8 @@ bool Transaction::ScheduleUniqueShard(EngineShard* shard) {
     coordinator_state_ |= COORD_SCHED;                  // safe because single shard
     txid_ = op_seq.fetch_add(1, memory_order_relaxed);  // -
     sd.pq_pos = shard->txq()->Insert(this);
+    if (TimePhases())
+      RecordTxQueueLen(shard->txq()->size());
 
     DCHECK_EQ(sd.local_mask & KEYLOCK_ACQUIRED, 0);
     shard->db_slice().Acquire(mode, lock_args);
@@ -1147,6 +1472,8 @@ bool Transaction::ScheduleInShard(EngineShard* shard) {
   sd.pq_pos = it;
 
   AnalyzeTxQueue(shard, txq);
+  if (TimePhases())
+    RecordTxQueueLen(txq->size());
   DVLOG(1) << "Insert into tx-queue, sid(" << sid << ") " << DebugId() << ", qlen " << txq->size();
 
   return true;
@@ -1212,13 +1539,13 @@ size_t Transaction::ReverseArgIndex(ShardId shard_id, size_t arg_index) const {
 }
 
 OpStatus Transaction::WaitOnWatch(const time_point& tp, WaitKeysProvider wkeys_provider,
-                                  KeyReadyChecker krc) {
+                                  KeyReadyChecker krc, bool key_only) {
   DVLOG(2) << "WaitOnWatch " << DebugId();
   using namespace chrono;
 
   auto cb = [&](Transaction* t, EngineShard* shard) {
     auto keys = wkeys_provider(t, shard);
-    return t->WatchInShard(keys, shard, krc);
+    return t->WatchInShard(keys, shard, krc, key_only);
   };
 
   Execute(std::move(cb), true);
@@ -1266,14 +1593,15 @@ OpStatus Transaction::WaitOnWatch(const time_point& tp, WaitKeysProvider wkeys_p
 }
 
 // Runs only in the shard thread.
-OpStatus Transaction::WatchInShard(ArgSlice keys, EngineShard* shard, KeyReadyChecker krc) {
+OpStatus Transaction::WatchInShard(ArgSlice keys, EngineShard* shard, KeyReadyChecker krc,
+                                   bool key_only) {
   ShardId idx = SidToId(shard->shard_id());
 
   auto& sd = shard_data_[idx];
   CHECK_EQ(0, sd.local_mask & SUSPENDED_Q);
 
   auto* bc = shard->EnsureBlockingController();
-  bc->AddWatched(keys, std::move(krc), this);
+  bc->AddWatched(keys, std::move(krc), this, key_only);
 
   sd.local_mask |= SUSPENDED_Q;
   sd.local_mask &= ~OUT_OF_ORDER;
@@ -1489,9 +1817,16 @@ void Transaction::LogJournalOnShard(EngineShard* shard, journal::Entry::Payload&
 
   bool is_multi = multi_commands || IsAtomicMulti();
 
+  // The replication filters match the single commands by their first key.
+  string_view key;
+  if (!is_multi && !args_.empty() && (!multi_ || multi_->role != SQUASHER)) {
+    if (ArgSlice shard_args = GetShardArgs(shard->shard_id()); !shard_args.empty())
+      key = shard_args.front();
+  }
+
   auto opcode = is_multi ? journal::Op::MULTI_COMMAND : journal::Op::COMMAND;
   journal->RecordEntry(txid_, opcode, db_index_, shard_cnt, unique_slot_checker_.GetUniqueSlotId(),
-                       std::move(payload), allow_await);
+                       std::move(payload), allow_await, key);
 }
 
 void Transaction::FinishLogJournalOnShard(EngineShard* shard, uint32_t shard_cnt) const {
@@ -1542,9 +1877,10 @@ OpResult<KeyIndex> DetermineKeys(const CommandId* cid, CmdArgList args) {
       return OpStatus::SYNTAX_ERR;
     }
 
-    string_view name{cid->name()};
+    using VariadicKeys = CommandId::VariadicKeys;
+    VariadicKeys kind = cid->variadic_keys();
 
-    if (name == "XREAD" || name == "XREADGROUP") {
+    if (kind == VariadicKeys::STREAMS) {
       for (size_t i = 0; i < args.size(); ++i) {
         string_view arg = ArgS(args, i);
         if (absl::EqualsIgnoreCase(arg, "STREAMS")) {
@@ -1562,24 +1898,17 @@ OpResult<KeyIndex> DetermineKeys(const CommandId* cid, CmdArgList args) {
       return OpStatus::SYNTAX_ERR;
     }
 
-    if (absl::EndsWith(name, "STORE"))
+    if (kind == VariadicKeys::DEST_NUM_KEYS)
       key_index.bonus = 0;  // Z<xxx>STORE <key> commands
 
-    unsigned num_keys_index;
-    if (absl::StartsWith(name, "EVAL"))
-      num_keys_index = 1;
-    else
-      num_keys_index = key_index.bonus ? *key_index.bonus + 1 : 0;
+    unsigned num_keys_index = kind == VariadicKeys::NUM_KEYS ? 0 : 1;
 
     string_view num = ArgS(args, num_keys_index);
     if (!absl::SimpleAtoi(num, &num_custom_keys) || num_custom_keys < 0)
       return OpStatus::INVALID_INT;
 
-    if (num_custom_keys == 0 &&
-        (absl::StartsWith(name, "ZDIFF") || absl::StartsWith(name, "ZUNION") ||
-         absl::StartsWith(name, "ZINTER"))) {
+    if (num_custom_keys == 0 && cid->requires_variadic_keys())
       return OpStatus::AT_LEAST_ONE_KEY;
-    }
 
     if (args.size() < size_t(num_custom_keys) + num_keys_index + 1)
       return OpStatus::SYNTAX_ERR;
@@ -1596,15 +1925,11 @@ OpResult<KeyIndex> DetermineKeys(const CommandId* cid, CmdArgList args) {
     }
     key_index.step = cid->opt_mask() & CO::INTERLEAVED_KEYS ? 2 : 1;
 
-    if (cid->opt_mask() & CO::STORE_LAST_KEY) {
-      string_view name{cid->name()};
-
-      if (name == "GEORADIUSBYMEMBER" && args.size() >= 5) {
-        // key member radius .. STORE destkey
-        string_view opt = ArgS(args, args.size() - 2);
-        if (absl::EqualsIgnoreCase(opt, "STORE") || absl::EqualsIgnoreCase(opt, "STOREDIST")) {
-          key_index.bonus = args.size() - 1;
-        }
+    if (cid->has_store_option() && args.size() >= 5) {
+      // key member radius .. STORE destkey
+      string_view opt = ArgS(args, args.size() - 2);
+      if (absl::EqualsIgnoreCase(opt, "STORE") || absl::EqualsIgnoreCase(opt, "STOREDIST")) {
+        key_index.bonus = args.size() - 1;
       }
     }
 
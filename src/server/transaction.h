@@ -10,6 +10,7 @@
 #include <absl/container/inlined_vector.h>
 #include <absl/functional/function_ref.h>
 
+#include <memory>
 #include <string_view>
 #include <variant>
 #include <vector>
@@ -26,6 +27,8 @@ namespace dfly {
 
 class EngineShard;
 class BlockingController;
+class RequestTrace;
+struct SlowLogTxStats;
 
 using facade::OpResult;
 using facade::OpStatus;
@@ -210,7 +213,10 @@ class Transaction {
   // or b) tp is reached. If tp is time_point::max() then waits indefinitely.
   // Expects that the transaction had been scheduled before, and uses Execute(.., true) to register.
   // Returns false if timeout occurred, true if was notified by one of the keys.
-  facade::OpStatus WaitOnWatch(const time_point& tp, WaitKeysProvider cb, KeyReadyChecker krc);
+  // key_only states that krc depends only on the key and not on the transaction, which lets
+  // the blocking controller check it once for all waiters of a key.
+  facade::OpStatus WaitOnWatch(const time_point& tp, WaitKeysProvider cb, KeyReadyChecker krc,
+                               bool key_only = false);
 
   // Returns true if transaction is awaked, false if it's timed-out and can be removed from the
   // blocking queue.
@@ -327,6 +333,24 @@ class Transaction {
     return cid_;
   }
 
+  // Records the phases of the transaction as spans of the sampled trace.
+  void SetTrace(std::shared_ptr<RequestTrace> trace) {
+    trace_ = std::move(trace);
+  }
+
+  // Single shard hops of a high priority transaction skip the backlog of the shard queue.
+  void SetHighPriority(bool high_priority) {
+    high_priority_ = high_priority;
+  }
+
+  // The time split of the phases for the slow log, collected while the slow log is enabled.
+  SlowLogTxStats GetSlowLogStats() const;
+
+  // Cycles the coordinator spent waiting for the hops, or running them inline.
+  uint64_t GetWaitCycles() const {
+    return wait_cycles_;
+  }
+
   std::string DebugId() const;
 
   // Prepares for running ScheduleSingleHop() for a single-shard multi tx.
@@ -469,10 +493,35 @@ class Transaction {
   // Optimized version of RunInShard for single shard uncontended cases.
   RunnableResult RunQuickie(EngineShard* shard);
 
+  // Records the number of hops since the previous call, called when the command concludes.
+  void RecordHops();
+
+  enum class Phase { SCHEDULE, QUEUE_WAIT, EXECUTION, CONCLUDE };
+
+  // Whether the phases are timed, for the histograms, the trace or the slow log.
+  bool TimePhases() const {
+    return track_phases_ || trace_ || time_slowlog_;
+  }
+
+  // Records a timed phase in the histograms with track_phases_, in the trace if sampled and in
+  // the totals for the slow log.
+  void RecordPhase(Phase phase, uint64_t start_ns, uint64_t end_ns);
+
+  // Records the length of a shard queue the transaction was scheduled into.
+  void RecordTxQueueLen(size_t len);
+
+  // Whether ScheduleSingleHop() can try to run the callback with RunOptimisticRead() first.
+  bool IsOptimisticReadAllowed() const;
+
+  // Runs the callback in all active shards without scheduling and verifies that none of the keys
+  // changed meanwhile. Returns false if the keys were locked or changed, then the caller must
+  // schedule and run the callback again.
+  bool RunOptimisticRead();
+
   void ExecuteAsync();
 
   // Adds itself to watched queue in the shard. Must run in that shard thread.
-  OpStatus WatchInShard(ArgSlice keys, EngineShard* shard, KeyReadyChecker krc);
+  OpStatus WatchInShard(ArgSlice keys, EngineShard* shard, KeyReadyChecker krc, bool key_only);
 
   // Expire blocking transaction, unlock keys and unregister it from the blocking controller
   void ExpireBlocking(WaitKeysProvider wcb);
@@ -580,6 +629,24 @@ class Transaction {
   DbIndex db_index_{0};
   uint64_t time_now_ms_{0};
 
+  // Set with --tx_latency_histograms to record the latencies of the phases of the transaction.
+  bool track_phases_{false};
+  uint32_t num_hops_{0};      // hops since the last conclusion, recorded with track_phases_
+  uint64_t hop_start_ns_{0};  // when the current hop was dispatched, only with TimePhases()
+  std::shared_ptr<RequestTrace> trace_;  // Set if the command was sampled for tracing
+  uint64_t wait_cycles_{0};              // See GetWaitCycles()
+
+  // Totals of the phases for the slow log, the shard phases are summed over the shards that run
+  // them in parallel.
+  bool time_slowlog_{false};
+  bool high_priority_{false};
+  struct PhaseTotals {
+    std::atomic_uint64_t schedule_ns{0}, queue_wait_ns{0}, execution_ns{0}, conclude_ns{0};
+    std::atomic_uint32_t max_txq_len{0};
+    uint64_t hop_wait_ns = 0;  // updated only by the coordinator
+    uint32_t hops = 0;         // updated only by the coordinator
+  } phase_totals_;
+
   std::atomic_uint32_t wakeup_requested_{0};  // whether tx was woken up
   std::atomic_uint32_t use_count_{0}, run_count_{0};
 
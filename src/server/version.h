@@ -29,8 +29,20 @@ enum class DflyVersion {
   // Supports limited partial sync
   VER2,
 
+  // - Receives LSN heartbeats in stable sync
+  VER3,
+
+  // - Reads the compact journal encoding with REPLCONF JOURNAL-COMMANDS
+  VER4,
+
+  // - Stripes the full sync of a flow over the connections that join it with DFLY STRIPE
+  VER5,
+
+  // - Receives the listpacks of hashes, sorted sets and lists as they are in memory in full sync
+  VER6,
+
   // Always points to the latest version
-  CURRENT_VER = VER2,
+  CURRENT_VER = VER6,
 };
 
 }  // namespace dfly
@@ -4,6 +4,9 @@
 
 #include "server/zset_family.h"
 
+#include <cmath>
+#include <deque>
+
 #include "server/acl/acl_commands_def.h"
 
 extern "C" {
@@ -714,23 +717,28 @@ void SendAtLeastOneKeyError(ConnectionContext* cntx) {
 }
 
 enum class AggType : uint8_t { SUM, MIN, MAX, NOOP };
-using ScoredMap = absl::flat_hash_map<std::string, double>;
 
-ScoredMap FromObject(const CompactObj& co, double weight) {
+// Members of a run are sorted by name and unique, so that runs of different keys and shards can
+// be combined by merging instead of hashing.
+using ScoredRun = ScoredArray;
+
+void SortByMember(ScoredRun* run) {
+  std::sort(run->begin(), run->end(),
+            [](const ScoredMember& a, const ScoredMember& b) { return a.first < b.first; });
+}
+
+ScoredRun FromObject(const CompactObj& co, double weight) {
   ZSetFamily::RangeParams params;
   params.with_scores = true;
   // RANGE is a read-only operation, but requires const_cast
   IntervalVisitor vis(Action::RANGE, params, &const_cast<CompactObj&>(co));
   vis(ZSetFamily::IndexInterval(0, -1));
 
-  ScoredArray arr = vis.PopResult();
-  ScoredMap res;
-  res.reserve(arr.size());
-
-  for (auto& elem : arr) {
+  ScoredRun res = vis.PopResult();
+  for (auto& elem : res) {
     elem.second *= weight;
-    res.emplace(std::move(elem));
   }
+  SortByMember(&res);
 
   return res;
 }
@@ -749,65 +757,83 @@ double Aggregate(double v1, double v2, AggType atype) {
   return 0;
 }
 
-// the result is in the destination.
-void UnionScoredMap(ScoredMap* dest, ScoredMap* src, AggType agg_type) {
-  ScoredMap* target = dest;
-  ScoredMap* iter = src;
+// K-way merge of the runs, the members that appear in several runs are aggregated.
+// If intersect is true, keeps only the members that appear in all the runs.
+// The members are moved out of the runs.
+ScoredRun MergeRuns(vector<ScoredRun>* runs, AggType agg_type, bool intersect) {
+  if (runs->empty())
+    return {};
 
-  if (iter->size() > target->size())
-    swap(target, iter);
+  if (runs->size() == 1)
+    return std::move(runs->front());
 
-  for (const auto& elem : *iter) {
-    auto [it, inserted] = target->emplace(elem);
-    if (!inserted) {
-      it->second = Aggregate(it->second, elem.second, agg_type);
-    }
-  }
+  vector<size_t> pos(runs->size(), 0);
 
-  if (target != dest)
-    dest->swap(*src);
-}
+  // Min-heap of the run indices ordered by their current members.
+  vector<unsigned> heap;
+  auto greater = [&](unsigned a, unsigned b) {
+    return (*runs)[a][pos[a]].first > (*runs)[b][pos[b]].first;
+  };
 
-void InterScoredMap(ScoredMap* dest, ScoredMap* src, AggType agg_type) {
-  ScoredMap* target = dest;
-  ScoredMap* iter = src;
+  for (unsigned i = 0; i < runs->size(); ++i) {
+    if (!(*runs)[i].empty())
+      heap.push_back(i);
+    else if (intersect)
+      return {};
+  }
+  make_heap(heap.begin(), heap.end(), greater);
+
+  // When some run is exhausted no more members can be found in all the runs.
+  bool exhausted = false;
+  auto pop = [&] {
+    pop_heap(heap.begin(), heap.end(), greater);
+    unsigned i = heap.back();
+    ScoredMember& res = (*runs)[i][pos[i]++];
+    if (pos[i] < (*runs)[i].size()) {
+      push_heap(heap.begin(), heap.end(), greater);
+    } else {
+      heap.pop_back();
+      exhausted = true;
+    }
+    return &res;
+  };
 
-  if (iter->size() > target->size())
-    swap(target, iter);
+  ScoredRun result;
+  while (!heap.empty()) {
+    ScoredMember* member = pop();
+    unsigned count = 1;
 
-  auto it = iter->begin();
-  while (it != iter->end()) {
-    auto inter_it = target->find(it->first);
-    if (inter_it == target->end()) {
-      auto copy_it = it++;
-      iter->erase(copy_it);
-    } else {
-      it->second = Aggregate(it->second, inter_it->second, agg_type);
-      ++it;
+    while (!heap.empty()) {
+      unsigned top = heap.front();
+      const ScoredMember& next = (*runs)[top][pos[top]];
+      if (next.first != member->first)
+        break;
+      member->second = Aggregate(member->second, pop()->second, agg_type);
+      ++count;
     }
+
+    if (!intersect || count == runs->size())
+      result.push_back(std::move(*member));
+
+    if (intersect && exhausted)
+      break;
   }
 
-  if (iter != dest)
-    dest->swap(*src);
+  return result;
 }
 
 using KeyIterWeightVec = vector<pair<PrimeConstIterator, double>>;
 
-ScoredMap UnionShardKeysWithScore(const KeyIterWeightVec& key_iter_weight_vec, AggType agg_type) {
-  ScoredMap result;
+ScoredRun UnionShardKeysWithScore(const KeyIterWeightVec& key_iter_weight_vec, AggType agg_type) {
+  vector<ScoredRun> runs;
   for (const auto& key_iter_weight : key_iter_weight_vec) {
     if (key_iter_weight.first.is_done()) {
       continue;
     }
 
-    ScoredMap sm = FromObject(key_iter_weight.first->second, key_iter_weight.second);
-    if (result.empty()) {
-      result.swap(sm);
-    } else {
-      UnionScoredMap(&result, &sm, agg_type);
-    }
+    runs.push_back(FromObject(key_iter_weight.first->second, key_iter_weight.second));
   }
-  return result;
+  return MergeRuns(&runs, agg_type, false);
 }
 
 double GetKeyWeight(Transaction* t, ShardId shard_id, const vector<double>& weights,
@@ -821,7 +847,7 @@ double GetKeyWeight(Transaction* t, ShardId shard_id, const vector<double>& weig
   return weights[windex];
 }
 
-OpResult<ScoredMap> OpUnion(EngineShard* shard, Transaction* t, string_view dest, AggType agg_type,
+OpResult<ScoredRun> OpUnion(EngineShard* shard, Transaction* t, string_view dest, AggType agg_type,
                             const vector<double>& weights, bool store) {
   ArgSlice keys = t->GetShardArgs(shard->shard_id());
   DVLOG(1) << "shard:" << shard->shard_id() << ", keys " << vector(keys.begin(), keys.end());
@@ -861,16 +887,17 @@ OpResult<ScoredMap> OpUnion(EngineShard* shard, Transaction* t, string_view dest
   return UnionShardKeysWithScore(key_weight_vec, agg_type);
 }
 
-ScoredMap ZSetFromSet(const PrimeValue& pv, double weight) {
-  ScoredMap result;
+ScoredRun ZSetFromSet(const PrimeValue& pv, double weight) {
+  ScoredRun result;
   container_utils::IterateSet(pv, [&result, weight](container_utils::ContainerEntry ce) {
-    result.emplace(ce.ToString(), weight);
+    result.emplace_back(ce.ToString(), weight);
     return true;
   });
+  SortByMember(&result);
   return result;
 }
 
-OpResult<ScoredMap> OpInter(EngineShard* shard, Transaction* t, string_view dest, AggType agg_type,
+OpResult<ScoredRun> OpInter(EngineShard* shard, Transaction* t, string_view dest, AggType agg_type,
                             const vector<double>& weights, bool store) {
   ArgSlice keys = t->GetShardArgs(shard->shard_id());
   DVLOG(1) << "shard:" << shard->shard_id() << ", keys " << vector(keys.begin(), keys.end());
@@ -914,28 +941,21 @@ OpResult<ScoredMap> OpInter(EngineShard* shard, Transaction* t, string_view dest
                                                  cmdargs_keys_offset)};
   }
 
-  ScoredMap result;
+  vector<ScoredRun> runs;
   for (auto it = it_arr.begin(); it != it_arr.end(); ++it) {
     if (it->first.it.is_done()) {
-      return ScoredMap{};
+      return ScoredRun{};
     }
+  }
 
-    ScoredMap sm;
+  for (auto it = it_arr.begin(); it != it_arr.end(); ++it) {
     if (it->first.it->second.ObjType() == OBJ_ZSET)
-      sm = FromObject(it->first.it->second, it->second);
-    else
-      sm = ZSetFromSet(it->first.it->second, it->second);
-
-    if (result.empty())
-      result.swap(sm);
+      runs.push_back(FromObject(it->first.it->second, it->second));
     else
-      InterScoredMap(&result, &sm, agg_type);
-
-    if (result.empty())
-      return result;
+      runs.push_back(ZSetFromSet(it->first.it->second, it->second));
   }
 
-  return result;
+  return MergeRuns(&runs, agg_type, true);
 }
 
 using ScoredMemberView = std::pair<double, std::string_view>;
@@ -1005,6 +1025,16 @@ OpResult<AddResult> OpAdd(const OpArgs& op_args, const ZParams& zparams, string_
     }
   }
 
+  // Results stored by ZUNIONSTORE and similar commands replace the key with a new map,
+  // which is built in a single pass.
+  if (zparams.override && zparams.flags == 0 && !is_list_pack &&
+      none_of(members.begin(), members.end(), [](const auto& m) { return isnan(m.first); })) {
+    detail::SortedMap* sm = (detail::SortedMap*)robj_wrapper->inner_obj();
+    sm->BulkInsert(members);
+    aresult.num_updated = sm->Size();
+    return aresult;
+  }
+
   for (size_t j = 0; j < members.size(); j++) {
     const auto& m = members[j];
     tmp_str = sdscpylen(tmp_str, m.second.data(), m.second.size());
@@ -1063,8 +1093,8 @@ void HandleOpStatus(ConnectionContext* cntx, OpStatus op_status) {
   }
 }
 
-OpResult<ScoredMap> IntersectResults(vector<OpResult<ScoredMap>>& results, AggType agg_type) {
-  ScoredMap result;
+OpResult<ScoredRun> IntersectResults(vector<OpResult<ScoredRun>>& results, AggType agg_type) {
+  vector<ScoredRun> runs;
   for (auto& op_res : results) {
     if (op_res.status() == OpStatus::SKIPPED)
       continue;
@@ -1073,20 +1103,9 @@ OpResult<ScoredMap> IntersectResults(vector<OpResult<ScoredMap>>& results, AggTy
       return op_res.status();
     }
 
-    if (op_res->empty()) {
-      return ScoredMap{};
-    }
-
-    if (result.empty()) {
-      result.swap(op_res.value());
-    } else {
-      InterScoredMap(&result, &op_res.value(), agg_type);
-    }
-
-    if (result.empty())
-      break;
+    runs.push_back(std::move(op_res.value()));
   }
-  return result;
+  return MergeRuns(&runs, agg_type, true);
 }
 
 OpResult<void> FillAggType(string_view agg, SetOpArgs* op_args) {
@@ -1199,7 +1218,7 @@ void ZUnionFamilyInternal(CmdArgList args, bool store, ConnectionContext* cntx)
     return SendAtLeastOneKeyError(cntx);
   }
 
-  vector<OpResult<ScoredMap>> maps(shard_set->size());
+  vector<OpResult<ScoredRun>> maps(shard_set->size());
 
   string_view dest_key = ArgS(args, 0);
 
@@ -1214,14 +1233,18 @@ void ZUnionFamilyInternal(CmdArgList args, bool store, ConnectionContext* cntx)
   // the last transaction hop (e.g. ZUNION)
   cntx->transaction->Execute(std::move(cb), !store);
 
-  ScoredMap result;
+  vector<ScoredRun> runs;
   for (auto& op_res : maps) {
     if (!op_res)
       return cntx->SendError(op_res.status());
-    UnionScoredMap(&result, &op_res.value(), op_args.agg_type);
+    runs.push_back(std::move(op_res.value()));
   }
 
+  ScoredRun result = MergeRuns(&runs, op_args.agg_type, false);
+  runs.clear();
+
   vector<ScoredMemberView> smvec;
+  smvec.reserve(result.size());
   for (const auto& elem : result) {
     smvec.emplace_back(elem.second, elem.first);
   }
@@ -1343,12 +1366,12 @@ void BZPopMinMax(CmdArgList args, ConnectionContext* cntx, bool is_max) {
   return rb->SendNullArray();
 }
 
-vector<ScoredMap> OpFetch(EngineShard* shard, Transaction* t) {
+vector<ScoredRun> OpFetch(EngineShard* shard, Transaction* t) {
   ArgSlice keys = t->GetShardArgs(shard->shard_id());
   DVLOG(1) << "shard:" << shard->shard_id() << ", keys " << vector(keys.begin(), keys.end());
   DCHECK(!keys.empty());
 
-  vector<ScoredMap> results;
+  vector<ScoredRun> results;
   results.reserve(keys.size());
 
   auto& db_slice = shard->db_slice();
@@ -1359,8 +1382,7 @@ vector<ScoredMap> OpFetch(EngineShard* shard, Transaction* t) {
       continue;
     }
 
-    ScoredMap sm = FromObject((*it)->second, 1);
-    results.push_back(std::move(sm));
+    results.push_back(FromObject((*it)->second, 1));
   }
 
   return results;
@@ -1404,25 +1426,6 @@ auto OpRange(const ZSetFamily::ZRangeSpec& range_spec, const OpArgs& op_args, st
   return iv.PopResult();
 }
 
-auto OpRanges(const std::vector<ZSetFamily::ZRangeSpec>& range_specs, const OpArgs& op_args,
-              string_view key) -> OpResult<vector<ScoredArray>> {
-  OpResult<PrimeConstIterator> res_it =
-      op_args.shard->db_slice().FindReadOnly(op_args.db_cntx, key, OBJ_ZSET);
-  if (!res_it)
-    return res_it.status();
-
-  // Action::RANGE is read-only, but requires mutable pointer, thus const_cast
-  PrimeValue& pv = const_cast<PrimeValue&>(res_it.value()->second);
-  vector<ScoredArray> result_arrays;
-  for (auto& range_spec : range_specs) {
-    IntervalVisitor iv{Action::RANGE, range_spec.params, &pv};
-    std::visit(iv, range_spec.interval);
-    result_arrays.push_back(iv.PopResult());
-  }
-
-  return result_arrays;
-}
-
 OpResult<unsigned> OpRemRange(const OpArgs& op_args, string_view key,
                               const ZSetFamily::ZRangeSpec& range_spec) {
   auto& db_slice = op_args.shard->db_slice();
@@ -1908,7 +1911,7 @@ void ZSetFamily::ZCount(CmdArgList args, ConnectionContext* cntx) {
 }
 
 void ZSetFamily::ZDiff(CmdArgList args, ConnectionContext* cntx) {
-  vector<vector<ScoredMap>> maps(shard_set->size());
+  vector<vector<ScoredRun>> maps(shard_set->size());
   auto cb = [&](Transaction* t, EngineShard* shard) {
     maps[shard->shard_id()] = OpFetch(shard, t);
     return OpStatus::OK;
@@ -1919,44 +1922,39 @@ void ZSetFamily::ZDiff(CmdArgList args, ConnectionContext* cntx) {
   const string_view key = ArgS(args, 1);
   const ShardId sid = Shard(key, maps.size());
   auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
-  // Extract the ScoredMap of the first key
+  // Extract the run of the first key
   auto& sm = maps[sid];
   if (sm.empty()) {
     rb->SendEmptyArray();
     return;
   }
-  auto result = std::move(sm[0]);
+  auto first = std::move(sm[0]);
   sm.erase(sm.begin());
 
-  auto filter = [&result](const auto& key) mutable {
-    auto it = result.find(key);
-    if (it != result.end()) {
-      result.erase(it);
-    }
-  };
-
-  // Total O(L)
-  // Iterate over the results of each shard
+  // Merge the runs of all the other keys, total O(L*logK).
+  vector<ScoredRun> runs;
   for (auto& vsm : maps) {
-    // Iterate over each fetched set
-    for (auto& sm : vsm) {
-      // Iterate over each key in the fetched set and filter
-      for (auto& [key, value] : sm) {
-        filter(key);
-      }
+    for (auto& run : vsm) {
+      runs.push_back(std::move(run));
     }
   }
+  ScoredRun removed = MergeRuns(&runs, AggType::NOOP, false);
 
+  // Both runs are sorted by member, hence the difference is a single pass over them.
   vector<ScoredMemberView> smvec;
-  for (const auto& elem : result) {
-    smvec.emplace_back(elem.second, elem.first);
+  auto rit = removed.begin();
+  for (const auto& elem : first) {
+    while (rit != removed.end() && rit->first < elem.first)
+      ++rit;
+    if (rit == removed.end() || rit->first != elem.first)
+      smvec.emplace_back(elem.second, elem.first);
   }
 
   // Total O(KlogK)
   std::sort(std::begin(smvec), std::end(smvec));
 
   const bool with_scores = ArgS(args, args.size() - 1) == "WITHSCORES";
-  rb->StartArray(result.size() * (with_scores ? 2 : 1));
+  rb->StartArray(smvec.size() * (with_scores ? 2 : 1));
   for (const auto& [score, key] : smvec) {
     rb->SendBulkString(key);
     if (with_scores) {
@@ -2017,7 +2015,7 @@ void ZSetFamily::ZInterStore(CmdArgList args, ConnectionContext* cntx) {
     return SendAtLeastOneKeyError(cntx);
   }
 
-  vector<OpResult<ScoredMap>> maps(shard_set->size(), OpStatus::SKIPPED);
+  vector<OpResult<ScoredRun>> maps(shard_set->size(), OpStatus::SKIPPED);
 
   auto cb = [&](Transaction* t, EngineShard* shard) {
     maps[shard->shard_id()] = OpInter(shard, t, dest_key, op_args.agg_type, op_args.weights, true);
@@ -2027,7 +2025,7 @@ void ZSetFamily::ZInterStore(CmdArgList args, ConnectionContext* cntx) {
   cntx->transaction->Schedule();
   cntx->transaction->Execute(std::move(cb), false);
 
-  OpResult<ScoredMap> result = IntersectResults(maps, op_args.agg_type);
+  OpResult<ScoredRun> result = IntersectResults(maps, op_args.agg_type);
   if (!result)
     return cntx->SendError(result.status());
 
@@ -2063,7 +2061,7 @@ void ZSetFamily::ZInter(CmdArgList args, ConnectionContext* cntx) {
     return SendAtLeastOneKeyError(cntx);
   }
 
-  vector<OpResult<ScoredMap>> maps(shard_set->size(), OpStatus::SKIPPED);
+  vector<OpResult<ScoredRun>> maps(shard_set->size(), OpStatus::SKIPPED);
 
   auto cb = [&](Transaction* t, EngineShard* shard) {
     maps[shard->shard_id()] = OpInter(shard, t, "", op_args.agg_type, op_args.weights, false);
@@ -2072,20 +2070,15 @@ void ZSetFamily::ZInter(CmdArgList args, ConnectionContext* cntx) {
 
   cntx->transaction->ScheduleSingleHop(std::move(cb));
 
-  OpResult<ScoredMap> result = IntersectResults(maps, op_args.agg_type);
+  OpResult<ScoredRun> result = IntersectResults(maps, op_args.agg_type);
   if (!result)
     return cntx->SendError(result.status());
 
-  std::vector<std::pair<std::string, double>> scored_array;
-  scored_array.reserve(result.value().size());
-  for (const auto& elem : result.value()) {
-    scored_array.emplace_back(elem.first, elem.second);
-  }
-
-  std::sort(scored_array.begin(), scored_array.end(),
-            [](const std::pair<std::string, double>& a, const std::pair<std::string, double>& b) {
-              return a.second < b.second;
-            });
+  // The run is sorted by member, so the stable sort orders the members with equal scores
+  // lexicographically.
+  ScoredArray& scored_array = result.value();
+  std::stable_sort(scored_array.begin(), scored_array.end(),
+                   [](const ScoredMember& a, const ScoredMember& b) { return a.second < b.second; });
 
   auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
   rb->SendScoredArray(scored_array, op_args_res->with_scores);
@@ -2106,7 +2099,7 @@ void ZSetFamily::ZInterCard(CmdArgList args, ConnectionContext* cntx) {
     return cntx->SendError(kSyntaxErr);
   }
 
-  vector<OpResult<ScoredMap>> maps(shard_set->size(), OpStatus::SKIPPED);
+  vector<OpResult<ScoredRun>> maps(shard_set->size(), OpStatus::SKIPPED);
 
   auto cb = [&](Transaction* t, EngineShard* shard) {
     maps[shard->shard_id()] = OpInter(shard, t, "", AggType::NOOP, {}, false);
@@ -2115,7 +2108,7 @@ void ZSetFamily::ZInterCard(CmdArgList args, ConnectionContext* cntx) {
 
   cntx->transaction->ScheduleSingleHop(std::move(cb));
 
-  OpResult<ScoredMap> result = IntersectResults(maps, AggType::NOOP);
+  OpResult<ScoredRun> result = IntersectResults(maps, AggType::NOOP);
   if (!result)
     return cntx->SendError(result.status());
 
@@ -2750,9 +2743,10 @@ void ZSetFamily::GeoDist(CmdArgList args, ConnectionContext* cntx) {
 }
 
 namespace {
-std::vector<ZSetFamily::ZRangeSpec> GetGeoRangeSpec(const GeoHashRadius& n) {
+// Returns the score ranges of the search box and its neighbors, sorted and merged, so that they
+// are visited in a single pass over the zset.
+vector<zrangespec> GetGeoRanges(const GeoHashRadius& n) {
   array<GeoHashBits, 9> neighbors;
-  unsigned int last_processed = 0;
 
   neighbors[0] = n.hash;
   neighbors[1] = n.neighbors.north;
@@ -2764,37 +2758,166 @@ std::vector<ZSetFamily::ZRangeSpec> GetGeoRangeSpec(const GeoHashRadius& n) {
   neighbors[7] = n.neighbors.south_east;
   neighbors[8] = n.neighbors.south_west;
 
-  // Get range_specs for neighbors (*and* our own hashbox)
-  std::vector<ZSetFamily::ZRangeSpec> range_specs;
-  for (unsigned int i = 0; i < neighbors.size(); i++) {
-    if (HASHISZERO(neighbors[i])) {
+  vector<zrangespec> ranges;
+  for (const GeoHashBits& box : neighbors) {
+    if (HASHISZERO(box)) {
       continue;
     }
 
-    // When a huge Radius (in the 5000 km range or more) is used,
-    // adjacent neighbors can be the same, leading to duplicated
-    // elements. Skip every range which is the same as the one
-    // processed previously.
-    if (last_processed && neighbors[i].bits == neighbors[last_processed].bits &&
-        neighbors[i].step == neighbors[last_processed].step) {
-      continue;
+    GeoHashFix52Bits min, max;
+    scoresOfGeoHashBox(box, &min, &max);
+    ranges.push_back({static_cast<double>(min), static_cast<double>(max), 0, 1});
+  }
+
+  // Adjacent boxes are often consecutive in the geohash order, and with huge radiuses the
+  // neighbors can be the same box. Merging them also removes the duplicates.
+  sort(ranges.begin(), ranges.end(),
+       [](const zrangespec& a, const zrangespec& b) { return a.min < b.min; });
+  vector<zrangespec> merged;
+  for (const zrangespec& range : ranges) {
+    if (!merged.empty() && range.min <= merged.back().max) {
+      merged.back().max = max(merged.back().max, range.max);
+    } else {
+      merged.push_back(range);
     }
+  }
+  return merged;
+}
 
-    GeoHashFix52Bits min, max;
-    scoresOfGeoHashBox(neighbors[i], &min, &max);
+// Filters the candidates of a geo search in batches. A vectorizable pass over the batch drops
+// the points whose latitude alone puts them out of the shape, and the exact distance is
+// computed only for the others, with the same functions as geoWithinShape.
+class GeoFilter {
+ public:
+  GeoFilter(const GeoShape& shape, unsigned long limit, GeoArray* out);
 
-    ZSetFamily::ScoreInterval si;
-    si.first = ZSetFamily::Bound{static_cast<double>(min), false};
-    si.second = ZSetFamily::Bound{static_cast<double>(max), true};
+  // Returns false once the limit is reached.
+  bool Add(string_view member, double score);
 
-    ZSetFamily::RangeParams range_params;
-    range_params.interval_type = ZSetFamily::RangeParams::IntervalType::SCORE;
-    range_params.with_scores = true;
-    range_specs.emplace_back(si, range_params);
+  // Filters the pending candidates.
+  bool Flush();
+
+ private:
+  static constexpr unsigned kBatchSize = 64;
+
+  // Same as EARTH_RADIUS_IN_METERS in geohash_helper.c.
+  static constexpr double kEarthRadiusMeters = 6372797.560856;
+
+  bool InShape(double lon, double lat, double* distance) const;
+
+  const GeoShape& shape_;
+  unsigned long limit_;
+  GeoArray* out_;
+  double lat_rad_;   // the latitude of the center, in radians.
+  double max_dlat_;  // the largest latitude difference from the center, in radians.
+
+  unsigned size_ = 0;
+  array<double, kBatchSize> scores_, lon_, lat_;
+  array<bool, kBatchSize> keep_;
+  array<string_view, kBatchSize> members_;
+};
+
+GeoFilter::GeoFilter(const GeoShape& shape, unsigned long limit, GeoArray* out)
+    : shape_(shape), limit_(limit), out_(out) {
+  double max_dist = shape.type == CIRCULAR_TYPE ? shape.t.radius * shape.conversion
+                                                : shape.t.r.height * shape.conversion / 2;
+  lat_rad_ = shape.xy[1] * M_PI / 180;
+  // The margin keeps the rejection on the safe side of rounding, the exact check follows.
+  max_dlat_ = max_dist / kEarthRadiusMeters * (1 + 1e-9);
+}
 
-    last_processed = i;
+bool GeoFilter::Add(string_view member, double score) {
+  members_[size_] = member;
+  scores_[size_] = score;
+  if (++size_ < kBatchSize)
+    return true;
+  return Flush();
+}
+
+bool GeoFilter::Flush() {
+  unsigned count = size_;
+  size_ = 0;
+
+  for (unsigned i = 0; i < count; ++i) {
+    double xy[2];
+    GeoHashBits hash = {.bits = (uint64_t)scores_[i], .step = GEO_STEP_MAX};
+    keep_[i] = geohashDecodeToLongLatWGS84(hash, xy);
+    lon_[i] = xy[0];
+    lat_[i] = xy[1];
+  }
+
+  for (unsigned i = 0; i < count; ++i)
+    keep_[i] = keep_[i] & (fabs(lat_[i] * (M_PI / 180) - lat_rad_) <= max_dlat_);
+
+  for (unsigned i = 0; i < count; ++i) {
+    double distance;
+    if (keep_[i] && InShape(lon_[i], lat_[i], &distance)) {
+      out_->emplace_back(lon_[i], lat_[i], distance, scores_[i], string{members_[i]});
+      if (limit_ > 0 && out_->size() >= limit_)
+        return false;
+    }
   }
-  return range_specs;
+  return true;
+}
+
+bool GeoFilter::InShape(double lon, double lat, double* distance) const {
+  if (shape_.type == CIRCULAR_TYPE) {
+    return geohashGetDistanceIfInRadiusWGS84(shape_.xy[0], shape_.xy[1], lon, lat,
+                                             shape_.t.radius * shape_.conversion, distance);
+  }
+  DCHECK_EQ(shape_.type, RECTANGLE_TYPE);
+  return geohashGetDistanceIfInRectangle(shape_.t.r.width * shape_.conversion,
+                                         shape_.t.r.height * shape_.conversion, shape_.xy[0],
+                                         shape_.xy[1], lon, lat, distance);
+}
+
+// Collects the members of the zset in the ranges that are within the shape. The members are
+// filtered on the shard thread, only the matching ones are copied.
+OpResult<GeoArray> OpGeoSearch(const OpArgs& op_args, string_view key, const GeoShape& shape,
+                               const vector<zrangespec>& ranges, unsigned long limit) {
+  OpResult<PrimeConstIterator> res_it =
+      op_args.shard->db_slice().FindReadOnly(op_args.db_cntx, key, OBJ_ZSET);
+  if (!res_it)
+    return res_it.status();
+
+  GeoArray ga;
+  GeoFilter filter{shape, limit, &ga};
+  const detail::RobjWrapper* robj_wrapper = res_it.value()->second.GetRobjWrapper();
+  if (robj_wrapper->encoding() == OBJ_ENCODING_LISTPACK) {
+    uint8_t* zl = (uint8_t*)robj_wrapper->inner_obj();
+    deque<string> int_members;  // the members encoded as integers, referenced by the batch.
+    for (const zrangespec& range : ranges) {
+      uint8_t* eptr = zzlFirstInRange(zl, &range);
+      uint8_t* sptr = eptr ? lpNext(zl, eptr) : nullptr;
+      for (; eptr; zzlNext(zl, &eptr, &sptr)) {
+        double score = zzlGetScore(sptr);
+        if (!zslValueLteMax(score, &range))
+          break;
+
+        unsigned int vlen = 0;
+        long long vlong = 0;
+        uint8_t* vstr = lpGetValue(eptr, &vlen, &vlong);
+        string_view member{reinterpret_cast<char*>(vstr), vlen};
+        if (!vstr) {
+          int_members.push_back(absl::StrCat(vlong));
+          member = int_members.back();
+        }
+        if (!filter.Add(member, score))
+          return ga;
+      }
+    }
+    filter.Flush();
+    return ga;
+  }
+
+  CHECK_EQ(robj_wrapper->encoding(), OBJ_ENCODING_SKIPLIST);
+  const detail::SortedMap* zs = (const detail::SortedMap*)robj_wrapper->inner_obj();
+  if (zs->IterateScoreRanges(ranges, [&](sds ele, double score) {
+        return filter.Add(string_view{ele, sdslen(ele)}, score);
+      })) {
+    filter.Flush();
+  }
+  return ga;
 }
 
 void SortIfNeeded(GeoArray* ga, Sorting sorting, uint64_t count) {
@@ -2878,35 +3001,22 @@ void GeoSearchStoreGeneric(ConnectionContext* cntx, const GeoShape& shape_ref, s
 
   // query
   GeoHashRadius georadius = geohashCalculateAreasByShapeWGS84(shape);
+  vector<zrangespec> ranges = GetGeoRanges(georadius);
+  unsigned long limit = geo_ops.any ? geo_ops.count : 0;
+
+  // get the matching members, they are filtered on the shard of the key.
   GeoArray ga;
-  auto range_specs = GetGeoRangeSpec(georadius);
-  // get all the matching members and add them to the potential result list
-  vector<OpResult<vector<ScoredArray>>> result_arrays;
   auto cb = [&](Transaction* t, EngineShard* shard) {
-    auto res_it = OpRanges(range_specs, t->GetOpArgs(shard), key);
-    if (res_it) {
-      result_arrays.emplace_back(res_it);
+    if (shard->shard_id() == from_shard) {
+      auto res = OpGeoSearch(t->GetOpArgs(shard), key, *shape, ranges, limit);
+      if (res) {
+        ga = std::move(res.value());
+      }
     }
     return OpStatus::OK;
   };
   cntx->transaction->Execute(std::move(cb), geo_ops.store == GeoStoreType::kNoStore);
 
-  // filter potential result list
-  double xy[2];
-  double distance;
-  unsigned long limit = geo_ops.any ? geo_ops.count : 0;
-  for (auto& result_array : result_arrays) {
-    for (auto& arr : *result_array) {
-      for (auto& p : arr) {
-        if (geoWithinShape(shape, p.second, xy, &distance) == 0) {
-          ga.emplace_back(xy[0], xy[1], distance, p.second, p.first);
-          if (limit > 0 && ga.size() >= limit)
-            break;
-        }
-      }
-    }
-  }
-
   // sort and trim by count
   SortIfNeeded(&ga, geo_ops.sorting, geo_ops.count);
 
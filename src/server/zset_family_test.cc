@@ -564,6 +564,36 @@ TEST_F(ZSetFamilyTest, ZInterCard) {
   EXPECT_EQ(2, CheckedInt({"zintercard", "2", "z1", "s2"}));
 }
 
+
+TEST_F(ZSetFamilyTest, ZSetOpsMultiShard) {
+  // Key zj holds the members mi with score i, for every i divisible by j + 1.
+  for (unsigned j = 0; j < 4; ++j) {
+    for (unsigned i = 0; i < 300; i += j + 1) {
+      Run({"zadd", absl::StrCat("z", j), absl::StrCat(i), absl::StrCat("m", i)});
+    }
+  }
+
+  EXPECT_EQ(300, CheckedInt({"zunionstore", "dest", "4", "z0", "z1", "z2", "z3"}));
+  auto resp = Run({"zrange", "dest", "0", "3", "withscores"});
+  EXPECT_THAT(resp.GetVec(), ElementsAre("m0", "0", "m1", "1", "m2", "4", "m5", "5"));
+  EXPECT_THAT(Run({"zscore", "dest", "m12"}), "48");
+  EXPECT_THAT(Run({"zrank", "dest", "m299"}), IntArg(180));
+
+  EXPECT_EQ(300, CheckedInt({"zunionstore", "dest", "2", "z0", "z1", "weights", "1", "10",
+                             "aggregate", "min"}));
+  EXPECT_THAT(Run({"zscore", "dest", "m2"}), "2");
+
+  resp = Run({"zinter", "4", "z0", "z1", "z2", "z3", "aggregate", "max", "withscores"});
+  ASSERT_THAT(resp, ArrLen(50));
+  EXPECT_THAT(resp.GetVec()[2].GetString(), "m12");
+  EXPECT_THAT(resp.GetVec()[3].GetString(), "12");
+  EXPECT_EQ(25, CheckedInt({"zintercard", "4", "z0", "z1", "z2", "z3"}));
+
+  resp = Run({"zdiff", "4", "z0", "z1", "z2", "z3"});
+  ASSERT_THAT(resp, ArrLen(100));
+  EXPECT_THAT(resp.GetVec()[0].GetString(), "m1");
+  EXPECT_THAT(resp.GetVec()[1].GetString(), "m5");
+}
 TEST_F(ZSetFamilyTest, ZAddBug148) {
   auto resp = Run({"zadd", "key", "1", "9fe9f1eb"});
   EXPECT_THAT(resp, IntArg(1));
@@ -941,6 +971,28 @@ TEST_F(ZSetFamilyTest, GeoSearch) {
                                 RespArray(ElementsAre(DoubleArg(9.1427), DoubleArg(38.7369))))))));
 }
 
+// Points every 0.001 degrees of longitude on the equator, about 111.2 meters apart. The key with
+// few points is a listpack, the other one a sorted map.
+TEST_F(ZSetFamilyTest, GeoSearchManyPoints) {
+  for (int points : {50, 400}) {
+    string key = absl::StrCat("line", points);
+    for (int i = -points / 2; i < points / 2; ++i) {
+      Run({"geoadd", key, absl::StrCat(i * 0.001), "0", absl::StrCat("p", i)});
+    }
+
+    auto resp = Run({"GEOSEARCH", key, "FROMLONLAT", "0", "0", "BYRADIUS", "2", "KM", "ASC"});
+    ASSERT_THAT(resp, ArrLen(35)) << points;  // |i| <= 17
+    EXPECT_EQ(resp.GetVec()[0], "p0");
+
+    resp = Run({"GEOSEARCH", key, "FROMLONLAT", "0", "0", "BYBOX", "4", "1", "KM"});
+    EXPECT_THAT(resp, ArrLen(35)) << points;
+
+    resp = Run({"GEOSEARCH", key, "FROMLONLAT", "0", "0", "BYRADIUS", "2", "KM", "COUNT", "5",
+                "ANY"});
+    EXPECT_THAT(resp, ArrLen(5)) << points;
+  }
+}
+
 TEST_F(ZSetFamilyTest, GeoRadiusByMember) {
   EXPECT_EQ(10, CheckedInt({"geoadd",  "Europe",    "13.4050", "52.5200", "Berlin",   "3.7038",
                             "40.4168", "Madrid",    "9.1427",  "38.7369", "Lisbon",   "2.3522",
@@ -987,4 +1039,30 @@ TEST_F(ZSetFamilyTest, GeoRadiusByMember) {
                            "WITHHASH and WITHCOORDS options"));
 }
 
+TEST_F(ZSetFamilyTest, ShrinkToListpack) {
+  for (int i = 0; i < 200; ++i) {
+    Run({"zadd", "key", absl::StrCat(i), absl::StrCat("m", i)});
+  }
+  EXPECT_EQ(0u, GetMetrics().db_stats[0].listpack_blob_cnt);
+
+  auto shrink = [] {
+    atomic_uint changed = 0;
+    shard_set->RunBlockingInParallel(
+        [&](EngineShard* es) { changed += es->db_slice().ShrinkEncodingsStep(0, 1024, 0.5); });
+    return changed.load();
+  };
+
+  // Still above half of the listpack limit.
+  EXPECT_THAT(Run({"zremrangebyrank", "key", "0", "129"}), IntArg(130));
+  EXPECT_EQ(0u, shrink());
+
+  EXPECT_THAT(Run({"zremrangebyrank", "key", "0", "9"}), IntArg(10));
+  EXPECT_EQ(1u, shrink());
+  EXPECT_EQ(1u, GetMetrics().db_stats[0].listpack_blob_cnt);
+
+  EXPECT_THAT(Run({"zcard", "key"}), IntArg(60));
+  EXPECT_THAT(Run({"zrange", "key", "0", "1"}), RespArray(ElementsAre("m140", "m141")));
+  EXPECT_THAT(Run({"zscore", "key", "m199"}), "199");
+}
+
 }  // namespace dfly
@@ -0,0 +1,291 @@
+"""
+Throughput benchmarks of full sync, stable sync, BGSAVE and DFS loading.
+
+They are skipped unless DRAGONFLY_BENCH_REPORT is set to the path of the JSON report:
+
+    DRAGONFLY_BENCH_REPORT=/tmp/bench.json pytest dragonfly/benchmark_test.py -s
+
+- DRAGONFLY_BENCH_BASELINE: the report of a previous run. The results that are worse than
+  the baseline by more than the tolerance are flagged in the "regressions" list of the report.
+- DRAGONFLY_BENCH_TOLERANCE: the relative tolerance, 0.1 by default.
+- DRAGONFLY_BENCH_SCALE: multiplies the number of keys of the datasets, 1 by default.
+"""
+
+import asyncio
+import glob
+import json
+import logging
+import os
+import time
+from dataclasses import dataclass
+
+import pytest
+from redis import asyncio as aioredis
+
+from .instance import DflyInstanceFactory
+from .replication_test import check_all_replicas_finished, parse_lag
+from .utility import chunked, disconnect_clients, wait_available_async
+
+REPORT_PATH = os.environ.get("DRAGONFLY_BENCH_REPORT")
+BASELINE_PATH = os.environ.get("DRAGONFLY_BENCH_BASELINE")
+TOLERANCE = float(os.environ.get("DRAGONFLY_BENCH_TOLERANCE", "0.1"))
+SCALE = float(os.environ.get("DRAGONFLY_BENCH_SCALE", "1"))
+
+pytestmark = [
+    pytest.mark.slow,
+    pytest.mark.skipif(REPORT_PATH is None, reason="DRAGONFLY_BENCH_REPORT is not set"),
+]
+
+BENCH_THREADS = 4
+
+
+@dataclass
+class Dataset:
+    strings: int = 0
+    string_size: int = 0
+    # Number of hashes, sets, sorted sets and lists, each.
+    containers: int = 0
+    elements: int = 0
+    element_size: int = 0
+    # Share of the keys with expiry time.
+    ttl_share: float = 0
+    tiered: bool = False
+
+    def args(self, name):
+        """Arguments of an instance that holds the dataset, name tells apart its files"""
+        args = {"proactor_threads": BENCH_THREADS}
+        if self.tiered:
+            args["tiered_prefix"] = f"{{DRAGONFLY_TMP}}/bench-tiered-{name}"
+        return args
+
+
+DATASETS = {
+    "strings": Dataset(strings=500_000, string_size=100),
+    "big_strings": Dataset(strings=20_000, string_size=10_000),
+    "containers": Dataset(containers=5_000, elements=100, element_size=20),
+    "ttl": Dataset(strings=300_000, string_size=100, ttl_share=0.5),
+    "tiered": Dataset(strings=100_000, string_size=2_000, tiered=True),
+}
+
+# Results of the benchmarks by name, written to the report at the end of the module.
+RESULTS = {}
+
+
+def lower_is_better(metric):
+    return not metric.endswith("_per_sec")
+
+
+def find_regressions(results, baseline):
+    regressions = []
+    for bench, metrics in results.items():
+        for metric, value in metrics.items():
+            base = baseline.get(bench, {}).get(metric)
+            if not base:
+                continue
+            change = (value - base) / base
+            if (change > TOLERANCE) if lower_is_better(metric) else (change < -TOLERANCE):
+                regressions.append(
+                    dict(bench=bench, metric=metric, baseline=base, value=value, change=change)
+                )
+    return regressions
+
+
+@pytest.fixture(scope="module", autouse=True)
+def bench_report():
+    yield
+    if not RESULTS:
+        return
+
+    report = {"scale": SCALE, "results": RESULTS, "regressions": []}
+    if BASELINE_PATH:
+        with open(BASELINE_PATH) as f:
+            report["regressions"] = find_regressions(RESULTS, json.load(f)["results"])
+        for r in report["regressions"]:
+            logging.warning(f"Regression of {r['bench']} {r['metric']}: {r['change']:+.1%}")
+
+    with open(REPORT_PATH, "w") as f:
+        json.dump(report, f, indent=2)
+
+
+def record(bench, **metrics):
+    logging.info(f"{bench}: {metrics}")
+    RESULTS[bench] = metrics
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+async def seed(client: aioredis.Redis, dataset: Dataset):
+    strings = int(dataset.strings * SCALE)
+    if strings > 0:
+        await client.execute_command(f"DEBUG POPULATE {strings} str {dataset.string_size} RAND")
+
+    containers = int(dataset.containers * SCALE)
+    members = [f"{j}:" + "x" * dataset.element_size for j in range(dataset.elements)]
+    for batch in chunked(100, range(containers)):
+        pipe = client.pipeline(transaction=False)
+        for i in batch:
+            pipe.hset(f"hash:{i}", mapping={m: i for m in members})
+            pipe.sadd(f"set:{i}", *members)
+            pipe.zadd(f"zset:{i}", {m: j for j, m in enumerate(members)})
+            pipe.rpush(f"list:{i}", *members)
+        await pipe.execute()
+
+    if dataset.ttl_share > 0:
+        step = round(1 / dataset.ttl_share)
+        for batch in chunked(1000, range(0, strings, step)):
+            pipe = client.pipeline(transaction=False)
+            for i in batch:
+                pipe.expire(f"str:{i}", 3600)
+            await pipe.execute()
+
+
+async def used_mb(client: aioredis.Redis):
+    return (await client.info("memory"))["used_memory"] / 2**20
+
+
+async def wait_stable_sync(c_replica: aioredis.Redis, timeout=600):
+    start = time.time()
+    while time.time() - start < timeout:
+        role = await c_replica.role()
+        if role[0] == "replica" and role[3] == "stable_sync":
+            return
+        await asyncio.sleep(0.05)
+    raise RuntimeError("Replica did not reach stable sync in time")
+
+
+async def wait_save(client: aioredis.Redis, timeout=600):
+    start = time.time()
+    while time.time() - start < timeout:
+        if (await client.info("persistence"))["saving"] == 0:
+            return
+        await asyncio.sleep(0.05)
+    raise RuntimeError("Save did not finish in time")
+
+
+@pytest.mark.asyncio
+@pytest.mark.parametrize("name", DATASETS.keys())
+async def test_bench_full_sync(df_local_factory: DflyInstanceFactory, name):
+    dataset = DATASETS[name]
+    master = df_local_factory.create(**dataset.args("master"))
+    replica = df_local_factory.create(**dataset.args("replica"))
+    df_local_factory.start_all([master, replica])
+    c_master = master.client()
+    c_replica = replica.client()
+
+    await seed(c_master, dataset)
+    mb = await used_mb(c_master)
+
+    start = time.time()
+    await c_replica.execute_command(f"REPLICAOF localhost {master.port}")
+    await wait_stable_sync(c_replica)
+    seconds = time.time() - start
+
+    await check_all_replicas_finished([c_replica], c_master)
+    assert await c_replica.dbsize() == await c_master.dbsize()
+    record(f"full_sync/{name}", mb=mb, seconds=seconds, mb_per_sec=mb / seconds)
+
+    await disconnect_clients(c_master, c_replica)
+
+
+@pytest.mark.asyncio
+@pytest.mark.parametrize("value_size", [100, 10_000])
+async def test_bench_stable_sync_lag(df_local_factory: DflyInstanceFactory, value_size):
+    master = df_local_factory.create(proactor_threads=BENCH_THREADS)
+    replica = df_local_factory.create(proactor_threads=BENCH_THREADS)
+    df_local_factory.start_all([master, replica])
+    c_master = master.client()
+    c_replica = replica.client()
+
+    await c_replica.execute_command(f"REPLICAOF localhost {master.port}")
+    await wait_stable_sync(c_replica)
+
+    duration = 10
+    num_writers = 8
+    keys = int(100_000 * SCALE)
+    value = "x" * value_size
+    writes = 0
+
+    async def write(writer):
+        nonlocal writes
+        client = master.client()
+        start = time.time()
+        i = writer
+        while time.time() - start < duration:
+            pipe = client.pipeline(transaction=False)
+            for _ in range(100):
+                pipe.set(f"key:{i % keys}", value)
+                i += num_writers
+            await pipe.execute()
+            writes += 100
+        await client.connection_pool.disconnect()
+
+    writers = [asyncio.create_task(write(i)) for i in range(num_writers)]
+
+    lags = []
+    while not all(w.done() for w in writers):
+        lags.append(parse_lag(await c_master.execute_command("INFO REPLICATION")))
+        await asyncio.sleep(0.05)
+    await asyncio.gather(*writers)
+
+    # The time the replica takes to catch up once the load stops.
+    start = time.time()
+    await check_all_replicas_finished([c_replica], c_master, timeout=600)
+    catch_up = time.time() - start
+
+    record(
+        f"stable_sync_lag/{value_size}",
+        writes_per_sec=writes / duration,
+        lag_p50=percentile(lags, 50),
+        lag_p99=percentile(lags, 99),
+        lag_max=max(lags),
+        catch_up_seconds=catch_up,
+    )
+
+    await disconnect_clients(c_master, c_replica)
+
+
+@pytest.mark.asyncio
+@pytest.mark.parametrize("name", DATASETS.keys())
+async def test_bench_save_and_load(df_local_factory: DflyInstanceFactory, tmp_dir, name):
+    dataset = DATASETS[name]
+    args = {**dataset.args("save"), "dir": "{DRAGONFLY_TMP}/", "dbfilename": f"bench-{name}"}
+    instance = df_local_factory.create(**args)
+    instance.start()
+    client = instance.client()
+
+    await seed(client, dataset)
+    keys = await client.dbsize()
+
+    start = time.time()
+    await client.execute_command("BGSAVE")
+    await wait_save(client)
+    save_seconds = time.time() - start
+
+    files = glob.glob(str(tmp_dir.absolute()) + f"/bench-{name}*.dfs")
+    file_mb = sum(os.path.getsize(f) for f in files) / 2**20
+    await client.connection_pool.disconnect()
+    # Killed, so that it does not save again on shutdown.
+    instance.stop(kill=True)
+
+    # The snapshot is loaded upon start, the time includes the start of the process.
+    start = time.time()
+    instance.start()
+    client = instance.client()
+    await wait_available_async(client, timeout=600)
+    load_seconds = time.time() - start
+    assert await client.dbsize() == keys
+
+    record(
+        f"save/{name}",
+        file_mb=file_mb,
+        seconds=save_seconds,
+        mb_per_sec=file_mb / save_seconds,
+    )
+    record(f"dfs_load/{name}", seconds=load_seconds, mb_per_sec=file_mb / load_seconds)
+
+    await client.connection_pool.disconnect()
+    for f in files:
+        os.remove(f)
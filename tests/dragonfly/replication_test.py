@@ -1911,3 +1911,228 @@ async def test_policy_based_eviction_propagation(df_local_factory, df_seeder_fac
     assert set(keys_master) == set(keys_replica)
 
     await disconnect_clients(c_master, *[c_replica])
+
+
+@dfly_args({"proactor_threads": 2})
+@pytest.mark.asyncio
+async def test_journal_compression(df_local_factory, df_seeder_factory):
+    master = df_local_factory.create()
+    replica = df_local_factory.create(replication_stream_compression=True)
+    df_local_factory.start_all([master, replica])
+    c_master = master.client()
+    c_replica = replica.client()
+
+    await c_replica.execute_command(f"REPLICAOF localhost {master.port}")
+    await wait_available_async(c_replica)
+
+    seeder = df_seeder_factory.create(port=master.port, keys=1000)
+    await seeder.run(target_ops=3000)
+    await check_all_replicas_finished([c_replica], c_master)
+    await check_data(seeder, [replica], [c_replica])
+
+    info = await c_master.execute_command("info replication")
+    ratios = re.findall("compression_ratio=([0-9.]+)", info)
+    assert len(ratios) == 1 and float(ratios[0]) > 0
+
+    await c_master.connection_pool.disconnect()
+    await c_replica.connection_pool.disconnect()
+
+
+@dfly_args({"proactor_threads": 2})
+@pytest.mark.asyncio
+async def test_read_staleness(df_local_factory):
+    master = df_local_factory.create()
+    replica = df_local_factory.create()
+    df_local_factory.start_all([master, replica])
+    c_master = master.client()
+    c_replica = replica.client()
+
+    await c_replica.execute_command("CLIENT READSTALENESS 1000")
+    await c_replica.execute_command(f"REPLICAOF localhost {master.port}")
+    await wait_available_async(c_replica)
+    await c_master.set("foo", "bar")
+    await check_all_replicas_finished([c_replica], c_master)
+    await asyncio.sleep(0.5)  # wait for the LSN heartbeats.
+
+    assert await c_replica.get("foo") == "bar"
+    info = await c_replica.execute_command("info replication")
+    assert "master_shard0:lsn_lag=0" in info
+
+    await c_replica.execute_command("CLIENT READSTALENESS 0")
+    assert await c_replica.get("foo") == "bar"
+
+    await c_master.connection_pool.disconnect()
+    await c_replica.connection_pool.disconnect()
+
+
+@pytest.mark.asyncio
+async def test_multi_shard_sync_apply(df_local_factory):
+    master = df_local_factory.create(proactor_threads=4)
+    replica = df_local_factory.create(proactor_threads=2, enable_multi_shard_sync=True)
+    df_local_factory.start_all([master, replica])
+    c_master = master.client()
+    c_replica = replica.client()
+
+    await c_replica.execute_command(f"REPLICAOF localhost {master.port}")
+    await wait_available_async(c_replica)
+
+    # Multi shard MSETs interleaved with single key writes to the same and to other keys.
+    async def write(start):
+        for i in range(start, start + 300):
+            await c_master.mset({f"k{i}": i, f"k{i + 1}": i, f"k{i + 2}": i})
+            await c_master.incr(f"k{i + 1}")
+            await c_master.set(f"other{i}", i)
+
+    await asyncio.gather(write(0), write(1000))
+
+    await check_all_replicas_finished([c_replica], c_master)
+    keys = await c_master.keys("*")
+    assert await c_replica.mget(keys) == await c_master.mget(keys)
+
+    await c_master.connection_pool.disconnect()
+    await c_replica.connection_pool.disconnect()
+
+
+@pytest.mark.asyncio
+async def test_cascading_replication(df_local_factory, df_seeder_factory):
+    master = df_local_factory.create(proactor_threads=4)
+    middle = df_local_factory.create(proactor_threads=2)
+    leaf = df_local_factory.create(proactor_threads=3)
+    df_local_factory.start_all([master, middle, leaf])
+    c_master = master.client()
+    c_middle = middle.client()
+    c_leaf = leaf.client()
+
+    seeder = df_seeder_factory.create(port=master.port, keys=1000)
+    await seeder.run(target_deviation=0.1)
+
+    await c_middle.execute_command(f"REPLICAOF localhost {master.port}")
+    await wait_available_async(c_middle)
+    await c_leaf.execute_command(f"REPLICAOF localhost {middle.port}")
+    await wait_available_async(c_leaf)
+
+    await seeder.run(target_ops=3000)
+    await check_all_replicas_finished([c_middle], c_master)
+    await check_all_replicas_finished([c_leaf], c_middle)
+    await check_data(seeder, [middle, leaf], [c_middle, c_leaf])
+
+    info = await c_middle.execute_command("info replication")
+    assert "connected_slaves:1" in info
+
+    # A full sync of the middle replica makes the leaf sync again.
+    await c_middle.execute_command("REPLICAOF NO ONE")
+    await c_middle.set("only-on-middle", "1")
+    await c_middle.execute_command(f"REPLICAOF localhost {master.port}")
+    await wait_available_async(c_middle)
+
+    await seeder.run(target_ops=1000)
+    await check_all_replicas_finished([c_middle], c_master)
+    await check_all_replicas_finished([c_leaf], c_middle)
+    await check_data(seeder, [middle, leaf], [c_middle, c_leaf])
+    assert await c_leaf.get("only-on-middle") is None
+
+    await c_master.connection_pool.disconnect()
+    await c_middle.connection_pool.disconnect()
+    await c_leaf.connection_pool.disconnect()
+
+
+@pytest.mark.asyncio
+@pytest.mark.parametrize("multi_shard_sync", [False, True])
+async def test_wait(df_local_factory, multi_shard_sync):
+    master = df_local_factory.create(proactor_threads=4)
+    replicas = [
+        df_local_factory.create(proactor_threads=2, enable_multi_shard_sync=multi_shard_sync)
+        for _ in range(2)
+    ]
+    df_local_factory.start_all([master] + replicas)
+    c_master = master.client()
+    c_replicas = [replica.client() for replica in replicas]
+
+    assert await c_master.execute_command("WAIT 1 100") == 0
+
+    for c_replica in c_replicas:
+        await c_replica.execute_command(f"REPLICAOF localhost {master.port}")
+        await wait_available_async(c_replica)
+
+    # The acks are sent on PING long before the periodic ack interval.
+    for i in range(20):
+        await c_master.mset({f"k{i}": i, f"l{i}": i})
+        start = time.time()
+        assert await c_master.execute_command("WAIT 2 0") == 2
+        assert time.time() - start < 1
+        for c_replica in c_replicas:
+            assert await c_replica.get(f"l{i}") == str(i)
+
+    assert await c_master.execute_command("WAITAOF 0 2 1000") == [0, 2]
+    with pytest.raises(redis.exceptions.ResponseError):
+        await c_master.execute_command("WAITAOF 1 0 0")
+    with pytest.raises(redis.exceptions.ResponseError):
+        await c_replicas[0].execute_command("WAIT 1 0")
+
+    replicas[1].stop(kill=True)
+    await c_master.set("after-stop", "1")
+    start = time.time()
+    assert await c_master.execute_command("WAIT 2 500") == 1
+    assert time.time() - start >= 0.5
+
+    await c_master.connection_pool.disconnect()
+    await c_replicas[0].connection_pool.disconnect()
+
+
+@dfly_args({"proactor_threads": 2})
+@pytest.mark.asyncio
+async def test_striped_full_sync(df_local_factory, df_seeder_factory):
+    master = df_local_factory.create()
+    replica = df_local_factory.create(replica_sync_stripes=4)
+    df_local_factory.start_all([master, replica])
+    c_master = master.client()
+    c_replica = replica.client()
+
+    # Enough data for every flow to write chunks to all of its stripes.
+    seeder = df_seeder_factory.create(port=master.port, keys=20_000, val_size=500)
+    await seeder.run(target_deviation=0.1)
+
+    await c_replica.execute_command(f"REPLICAOF localhost {master.port}")
+    await wait_available_async(c_replica)
+    await check_all_replicas_finished([c_replica], c_master)
+    await check_data(seeder, [replica], [c_replica])
+
+    # The stripes are closed after the full sync without breaking the stable sync.
+    await seeder.run(target_ops=2000)
+    await check_all_replicas_finished([c_replica], c_master)
+    await check_data(seeder, [replica], [c_replica])
+
+    await c_master.connection_pool.disconnect()
+    await c_replica.connection_pool.disconnect()
+
+
+@dfly_args({"proactor_threads": 2, "list_compress_depth": 1})
+@pytest.mark.asyncio
+async def test_full_sync_native_encodings(df_local_factory):
+    master = df_local_factory.create()
+    replica = df_local_factory.create()
+    df_local_factory.start_all([master, replica])
+    c_master = master.client()
+    c_replica = replica.client()
+
+    # Small hashes, sorted sets and lists are listpacks, sent as they are in memory.
+    for i in range(100):
+        await c_master.hset(f"hash{i}", mapping={"a": i, "b": "x" * i})
+        await c_master.zadd(f"zset{i}", {"a": i, "b": i + 0.5})
+        await c_master.rpush(f"list{i}", *[f"{j}" * 20 for j in range(i * 10)] or ["x"])
+
+    await c_replica.execute_command(f"REPLICAOF localhost {master.port}")
+    await wait_available_async(c_replica)
+    await check_all_replicas_finished([c_replica], c_master)
+
+    for i in range(100):
+        assert await c_replica.hgetall(f"hash{i}") == await c_master.hgetall(f"hash{i}")
+        assert await c_replica.zrange(f"zset{i}", 0, -1, withscores=True) == await c_master.zrange(
+            f"zset{i}", 0, -1, withscores=True
+        )
+        assert await c_replica.lrange(f"list{i}", 0, -1) == await c_master.lrange(
+            f"list{i}", 0, -1
+        )
+
+    await c_master.connection_pool.disconnect()
+    await c_replica.connection_pool.disconnect()
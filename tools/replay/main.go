@@ -16,6 +16,9 @@ import (
 
 var fHost = flag.String("host", "127.0.0.1:6379", "Redis host")
 var fClientBuffer = flag.Int("buffer", 100, "How many records to buffer per client")
+var fSpeed = flag.Float64("speed", 1, "Replay speed-up factor, 2 replays the traffic twice as fast")
+var fReport = flag.String("report", "", "Write per command latencies as json to this file")
+var fBaseline = flag.String("baseline", "", "Compare latencies against a report of a previous run")
 
 type RecordHeader struct {
 	Client  uint32
@@ -51,7 +54,9 @@ type ClientWorker struct {
 // Handles a single file and distributes messages to clients
 type FileWorker struct {
 	clientGroup sync.WaitGroup
-	timeOffset  time.Duration
+	baseTime    time.Time // time of the earliest record of all files
+	startTime   time.Time // when baseTime is replayed
+	latencies   *LatencyStats
 	// stats for output, updated by clients, read by rendering goroutine
 	processed atomic.Uint64
 	delayed   atomic.Uint64
@@ -60,6 +65,7 @@ type FileWorker struct {
 }
 
 func (c ClientWorker) Run(worker *FileWorker) {
+	latencies := make(map[string]*Histogram)
 	for msg := range c.incoming {
 		lag := time.Until(worker.HappensAt(time.Unix(0, int64(msg.Time))))
 		if lag < 0 {
@@ -67,9 +73,18 @@ func (c ClientWorker) Run(worker *FileWorker) {
 		}
 		time.Sleep(lag)
 
+		start := time.Now()
 		c.redis.Do(context.Background(), msg.values...).Result()
+		cmd := cmdName(msg.values)
+		h, ok := latencies[cmd]
+		if !ok {
+			h = &Histogram{}
+			latencies[cmd] = h
+		}
+		h.Add(time.Since(start))
 		worker.processed.Add(1)
 	}
+	worker.latencies.Merge(latencies)
 	worker.clientGroup.Done()
 }
 
@@ -106,7 +121,7 @@ func (w *FileWorker) Run(file string, wg *sync.WaitGroup) {
 }
 
 func (w *FileWorker) HappensAt(recordTime time.Time) time.Time {
-	return recordTime.Add(w.timeOffset)
+	return w.startTime.Add(time.Duration(float64(recordTime.Sub(w.baseTime)) / *fSpeed))
 }
 
 func RenderTable(area *pterm.AreaPrinter, files []string, workers []FileWorker) {
@@ -126,16 +141,27 @@ func RenderTable(area *pterm.AreaPrinter, files []string, workers []FileWorker)
 
 func main() {
 	flag.Parse()
-	files := os.Args[1:]
+	files := flag.Args()
+
+	var baseline map[string]CmdSummary
+	if *fBaseline != "" {
+		var err error
+		if baseline, err = ReadReport(*fBaseline); err != nil {
+			fmt.Println("Failed to read baseline: ", err)
+			os.Exit(1)
+		}
+	}
 
-	timeOffset := time.Now().Add(500 * time.Millisecond).Sub(DetermineBaseTime(files))
-	fmt.Println("Offset -> ", timeOffset)
+	baseTime := DetermineBaseTime(files)
+	startTime := time.Now().Add(500 * time.Millisecond)
+	fmt.Println("Offset -> ", startTime.Sub(baseTime))
 
 	// Start a worker for every file. They take care of spawning client workers.
 	var wg sync.WaitGroup
+	var latencies LatencyStats
 	workers := make([]FileWorker, len(files))
 	for i := range workers {
-		workers[i] = FileWorker{timeOffset: timeOffset}
+		workers[i] = FileWorker{baseTime: baseTime, startTime: startTime, latencies: &latencies}
 		wg.Add(1)
 		go workers[i].Run(files[i], &wg)
 	}
@@ -158,4 +184,14 @@ func main() {
 	}
 
 	RenderTable(area, files, workers) // to show last stats
+	area.Stop()
+
+	report := latencies.Report()
+	fmt.Println(RenderLatencies(report, baseline))
+	if *fReport != "" {
+		if err := WriteReport(*fReport, report); err != nil {
+			fmt.Println("Failed to write report: ", err)
+			os.Exit(1)
+		}
+	}
 }
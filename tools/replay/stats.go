@@ -0,0 +1,187 @@
+package main
+
+import (
+	"encoding/json"
+	"fmt"
+	"math/bits"
+	"os"
+	"sort"
+	"strings"
+	"sync"
+	"time"
+
+	"github.com/pterm/pterm"
+)
+
+// Number of linear sub-buckets per power of two, bounds the relative error to 1/8.
+const kSubBucketBits = 3
+
+// Latency histogram in microseconds with logarithmic buckets.
+type Histogram struct {
+	Counts [64 << kSubBucketBits]uint64
+	Count  uint64
+	Sum    uint64
+	Max    uint64
+}
+
+func bucketOf(v uint64) int {
+	if v < 1<<kSubBucketBits {
+		return int(v)
+	}
+	exp := bits.Len64(v) - 1 - kSubBucketBits
+	return (exp+1)<<kSubBucketBits + int((v>>exp)&(1<<kSubBucketBits-1))
+}
+
+// Lowest value that falls into bucket i.
+func bucketValue(i int) uint64 {
+	if i < 1<<kSubBucketBits {
+		return uint64(i)
+	}
+	exp := i>>kSubBucketBits - 1
+	return (uint64(1<<kSubBucketBits) | uint64(i&(1<<kSubBucketBits-1))) << exp
+}
+
+func (h *Histogram) Add(d time.Duration) {
+	us := uint64(d.Microseconds())
+	h.Counts[bucketOf(us)]++
+	h.Count++
+	h.Sum += us
+	if us > h.Max {
+		h.Max = us
+	}
+}
+
+func (h *Histogram) Merge(o *Histogram) {
+	for i := range h.Counts {
+		h.Counts[i] += o.Counts[i]
+	}
+	h.Count += o.Count
+	h.Sum += o.Sum
+	if o.Max > h.Max {
+		h.Max = o.Max
+	}
+}
+
+func (h *Histogram) Percentile(p float64) uint64 {
+	rank := uint64(p / 100 * float64(h.Count))
+	var seen uint64
+	for i, c := range h.Counts {
+		seen += c
+		if seen > rank {
+			return bucketValue(i)
+		}
+	}
+	return h.Max
+}
+
+// Latency summary of a single command, as stored in reports.
+type CmdSummary struct {
+	Count  uint64  `json:"count"`
+	MeanUs float64 `json:"mean_us"`
+	P50Us  uint64  `json:"p50_us"`
+	P99Us  uint64  `json:"p99_us"`
+	P999Us uint64  `json:"p999_us"`
+	MaxUs  uint64  `json:"max_us"`
+}
+
+func (h *Histogram) Summary() CmdSummary {
+	return CmdSummary{
+		Count:  h.Count,
+		MeanUs: float64(h.Sum) / float64(h.Count),
+		P50Us:  h.Percentile(50),
+		P99Us:  h.Percentile(99),
+		P999Us: h.Percentile(99.9),
+		MaxUs:  h.Max,
+	}
+}
+
+// Latencies by command name, filled by client workers when they finish.
+type LatencyStats struct {
+	mu    sync.Mutex
+	byCmd map[string]*Histogram
+}
+
+func (s *LatencyStats) Merge(local map[string]*Histogram) {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	if s.byCmd == nil {
+		s.byCmd = make(map[string]*Histogram)
+	}
+	for cmd, h := range local {
+		if dst, ok := s.byCmd[cmd]; ok {
+			dst.Merge(h)
+		} else {
+			s.byCmd[cmd] = h
+		}
+	}
+}
+
+func (s *LatencyStats) Report() map[string]CmdSummary {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	out := make(map[string]CmdSummary, len(s.byCmd))
+	for cmd, h := range s.byCmd {
+		out[cmd] = h.Summary()
+	}
+	return out
+}
+
+func cmdName(values []interface{}) string {
+	if len(values) == 0 {
+		return ""
+	}
+	if s, ok := values[0].(string); ok {
+		return strings.ToUpper(s)
+	}
+	return ""
+}
+
+func WriteReport(path string, report map[string]CmdSummary) error {
+	data, err := json.MarshalIndent(report, "", "  ")
+	if err != nil {
+		return err
+	}
+	return os.WriteFile(path, data, 0644)
+}
+
+func ReadReport(path string) (map[string]CmdSummary, error) {
+	data, err := os.ReadFile(path)
+	if err != nil {
+		return nil, err
+	}
+	var report map[string]CmdSummary
+	err = json.Unmarshal(data, &report)
+	return report, err
+}
+
+// Formats a latency, followed by its change relative to the baseline when there is one.
+func withDelta(cur, base uint64, hasBase bool) string {
+	if !hasBase || base == 0 {
+		return fmt.Sprint(cur)
+	}
+	return fmt.Sprintf("%d (%+.1f%%)", cur, (float64(cur)-float64(base))*100/float64(base))
+}
+
+func RenderLatencies(report, baseline map[string]CmdSummary) string {
+	cmds := make([]string, 0, len(report))
+	for cmd := range report {
+		cmds = append(cmds, cmd)
+	}
+	sort.Slice(cmds, func(i, j int) bool { return report[cmds[i]].Count > report[cmds[j]].Count })
+
+	tableData := pterm.TableData{{"command", "count", "p50 us", "p99 us", "p99.9 us", "max us"}}
+	for _, cmd := range cmds {
+		cur := report[cmd]
+		base, hasBase := baseline[cmd]
+		tableData = append(tableData, []string{
+			cmd,
+			fmt.Sprint(cur.Count),
+			withDelta(cur.P50Us, base.P50Us, hasBase),
+			withDelta(cur.P99Us, base.P99Us, hasBase),
+			withDelta(cur.P999Us, base.P999Us, hasBase),
+			withDelta(cur.MaxUs, base.MaxUs, hasBase),
+		})
+	}
+	content, _ := pterm.DefaultTable.WithHasHeader().WithBoxed().WithData(tableData).Srender()
+	return content
+}